@@ -1785,6 +1785,141 @@ toastid_valueid_exists(Oid toastrelid, Oid valueid)
 }
 
 
+/* ----------
+ * toast_overwrite_datum -
+ *
+ *	Overwrite the chunks of an uncompressed, externally stored value that
+ *	differ from the given new value of the same size. The chunks are updated
+ *	in place, so this is neither MVCC-safe nor undone if the transaction
+ *	aborts. It's meant for values that are always rewritten by their only
+ *	writer, such as the sketches continuous view combiners store, where it
+ *	turns rewriting a whole value into rewriting the pages that changed.
+ * ----------
+ */
+int
+toast_overwrite_datum(struct varlena * attr, struct varlena * newvalue)
+{
+	Relation	toastrel;
+	Relation   *toastidxs;
+	ScanKeyData toastkey;
+	SysScanDesc toastscan;
+	HeapTuple	ttup;
+	TupleDesc	toasttupDesc;
+	struct varatt_external toast_pointer;
+	int32		ressize;
+	int32		residx,
+				nextidx;
+	int32		numchunks;
+	int			num_indexes;
+	int			validIndex;
+	int			nwritten = 0;
+
+	if (!VARATT_IS_EXTERNAL_ONDISK(attr) || VARATT_IS_EXTENDED(newvalue))
+		return -1;
+
+	/* Must copy to access aligned fields */
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+
+	if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
+		return -1;
+
+	ressize = toast_pointer.va_extsize;
+	if (ressize != VARSIZE(newvalue) - VARHDRSZ)
+		return -1;
+
+	numchunks = ((ressize - 1) / TOAST_MAX_CHUNK_SIZE) + 1;
+
+	toastrel = heap_open(toast_pointer.va_toastrelid, RowExclusiveLock);
+	toasttupDesc = toastrel->rd_att;
+
+	validIndex = toast_open_indexes(toastrel,
+									RowExclusiveLock,
+									&toastidxs,
+									&num_indexes);
+
+	ScanKeyInit(&toastkey,
+				(AttrNumber) 1,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(toast_pointer.va_valueid));
+
+	nextidx = 0;
+
+	toastscan = systable_beginscan_ordered(toastrel, toastidxs[validIndex],
+										   SnapshotToast, 1, &toastkey);
+	while ((ttup = systable_getnext_ordered(toastscan, ForwardScanDirection)) != NULL)
+	{
+		HeapTuple	newtup;
+		Pointer		chunk;
+		bool		isnull;
+		char	   *chunkdata;
+		char	   *newdata;
+		int32		chunksize;
+
+		residx = DatumGetInt32(fastgetattr(ttup, 2, toasttupDesc, &isnull));
+		Assert(!isnull);
+		chunk = DatumGetPointer(fastgetattr(ttup, 3, toasttupDesc, &isnull));
+		Assert(!isnull);
+
+		if (!VARATT_IS_EXTENDED(chunk))
+		{
+			chunksize = VARSIZE(chunk) - VARHDRSZ;
+			chunkdata = VARDATA(chunk);
+		}
+		else if (VARATT_IS_SHORT(chunk))
+		{
+			chunksize = VARSIZE_SHORT(chunk) - VARHDRSZ_SHORT;
+			chunkdata = VARDATA_SHORT(chunk);
+		}
+		else
+		{
+			elog(ERROR, "found toasted toast chunk for toast value %u in %s",
+				 toast_pointer.va_valueid,
+				 RelationGetRelationName(toastrel));
+			chunksize = 0;		/* keep compiler quiet */
+			chunkdata = NULL;
+		}
+
+		if (residx != nextidx || residx >= numchunks ||
+			chunksize != (residx < numchunks - 1 ?
+						  TOAST_MAX_CHUNK_SIZE : ressize - residx * TOAST_MAX_CHUNK_SIZE))
+			elog(ERROR, "unexpected chunk %d of size %d for toast value %u in %s",
+				 residx, chunksize,
+				 toast_pointer.va_valueid,
+				 RelationGetRelationName(toastrel));
+
+		nextidx++;
+
+		newdata = VARDATA(newvalue) + residx * TOAST_MAX_CHUNK_SIZE;
+		if (memcmp(chunkdata, newdata, chunksize) == 0)
+			continue;
+
+		/*
+		 * The chunk keeps its size, so a copy of its tuple with the new data
+		 * replaces the old one byte for byte
+		 */
+		newtup = heap_copytuple(ttup);
+		memcpy((char *) newtup->t_data + (chunkdata - (char *) ttup->t_data),
+			   newdata, chunksize);
+		heap_inplace_update(toastrel, newtup);
+		heap_freetuple(newtup);
+
+		nwritten++;
+	}
+
+	if (nextidx != numchunks)
+		elog(ERROR, "missing chunk number %d for toast value %u in %s",
+			 nextidx,
+			 toast_pointer.va_valueid,
+			 RelationGetRelationName(toastrel));
+
+	systable_endscan_ordered(toastscan);
+	toast_close_indexes(toastidxs, num_indexes, RowExclusiveLock);
+	heap_close(toastrel, RowExclusiveLock);
+
+	return nwritten;
+}
+
+
 /* ----------
  * toast_fetch_datum -
  *
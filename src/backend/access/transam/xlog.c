@@ -594,6 +594,12 @@ typedef struct XLogCtlData
 	 */
 	bool		SharedHotStandbyActive;
 
+	/*
+	 * SharedUnloggedRelationsReset indicates if unlogged relations were reset
+	 * to their INIT fork at the end of recovery.  Protected by info_lck.
+	 */
+	bool		SharedUnloggedRelationsReset;
+
 	/*
 	 * WalWriterSleeping indicates whether the WAL writer is currently in
 	 * low-power mode (and hence should be nudged if an async commit occurs).
@@ -6950,8 +6956,14 @@ StartupXLOG(void)
 	 * end-of-recovery steps fail.
 	 */
 	if (InRecovery)
+	{
 		ResetUnloggedRelations(UNLOGGED_RELATION_INIT);
 
+		SpinLockAcquire(&XLogCtl->info_lck);
+		XLogCtl->SharedUnloggedRelationsReset = true;
+		SpinLockRelease(&XLogCtl->info_lck);
+	}
+
 	/*
 	 * We don't need the latch anymore. It's not strictly necessary to disown
 	 * it, but let's do it for the sake of tidiness.
@@ -7533,6 +7545,22 @@ RecoveryInProgress(void)
 	}
 }
 
+/*
+ * Were unlogged relations reset at the end of recovery? Continuous views with
+ * unlogged matrels are then restored from their checkpoints.
+ */
+bool
+UnloggedRelationsWereReset(void)
+{
+	bool		result;
+
+	SpinLockAcquire(&XLogCtl->info_lck);
+	result = XLogCtl->SharedUnloggedRelationsReset;
+	SpinLockRelease(&XLogCtl->info_lck);
+
+	return result;
+}
+
 /*
  * Is HotStandby active yet? This is only important in special backends
  * since normal backends won't ever be able to connect until this returns
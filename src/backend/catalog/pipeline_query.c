@@ -26,10 +26,13 @@
 #include "miscadmin.h"
 #include "catalog/namespace.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/tlist.h"
 #include "parser/analyze.h"
 #include "pipeline/cont_analyze.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/miscutils.h"
+#include "pipeline/read_cache.h"
 #include "postmaster/bgworker.h"
 #include "storage/pmsignal.h"
 #include "storage/proc.h"
@@ -89,7 +92,7 @@ get_next_id(Relation rel)
 
 	if (num_ids)
 	{
-		Oid ids[num_ids];
+		Oid *ids = palloc(sizeof(Oid) * num_ids);
 		int counts_per_combiner[continuous_query_num_combiners];
 		int i = 0;
 		Oid max;
@@ -205,6 +208,279 @@ GetPipelineQueryTuple(RangeVar *name)
 	return tuple;
 }
 
+/*
+ * get_freeze_column
+ *
+ * Get the name of the column holding the time bucket that rows of a view with freeze_after are
+ * frozen by, which is its first timestamp grouping column
+ */
+static char *
+get_freeze_column(Query *query)
+{
+	ListCell *lc;
+
+	foreach(lc, query->groupClause)
+	{
+		SortGroupClause *sgc = (SortGroupClause *) lfirst(lc);
+		TargetEntry *te = get_sortgroupclause_tle(sgc, query->targetList);
+		Oid type = exprType((Node *) te->expr);
+
+		if ((type == TIMESTAMPTZOID || type == TIMESTAMPOID) && te->resname)
+			return te->resname;
+	}
+
+	return NULL;
+}
+
+/*
+ * validate_output_coalescing
+ *
+ * Output stream updates can only be coalesced per group for aggregate views, and thresholds only
+ * apply to numeric columns
+ */
+static void
+validate_output_coalescing(Query *query)
+{
+	ListCell *lc;
+
+	if (!query->outputInterval && !query->outputThresholdColumn)
+		return;
+
+	if (!query->hasAggs && !query->groupClause)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("output stream coalescing requires an aggregate query")));
+
+	if (!query->outputThresholdColumn)
+		return;
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+
+		if (te->resjunk || !te->resname || pg_strcasecmp(te->resname, query->outputThresholdColumn) != 0)
+			continue;
+
+		switch (exprType((Node *) te->expr))
+		{
+			case INT2OID:
+			case INT4OID:
+			case INT8OID:
+			case FLOAT4OID:
+			case FLOAT8OID:
+			case NUMERICOID:
+				return;
+			default:
+				ereport(ERROR,
+						(errcode(ERRCODE_DATATYPE_MISMATCH),
+						 errmsg("\"output_threshold_column\" must be a numeric column")));
+		}
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_COLUMN),
+			 errmsg("output threshold column \"%s\" does not exist", query->outputThresholdColumn)));
+}
+
+/*
+ * validate_group_key
+ *
+ * Notification payloads and cached rows identify groups by one of the view's grouping columns
+ */
+static void
+validate_group_key(Query *query, char *key, char *option)
+{
+	ListCell *lc;
+	ListCell *lc2;
+
+	if (!key)
+		return;
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+
+		if (te->resjunk || !te->resname || pg_strcasecmp(te->resname, key) != 0)
+			continue;
+
+		foreach(lc2, query->groupClause)
+		{
+			SortGroupClause *sgc = (SortGroupClause *) lfirst(lc2);
+
+			if (te->ressortgroupref && sgc->tleSortGroupRef == te->ressortgroupref)
+				return;
+		}
+
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("\"%s\" must be a grouping column", option)));
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_COLUMN),
+			 errmsg("\"%s\" column \"%s\" does not exist", option, key)));
+}
+
+/*
+ * validate_ttl
+ *
+ * Groups are expired by a timestamp column, which is the view's first timestamp grouping column
+ * unless another one is given
+ */
+static void
+validate_ttl(Query *query)
+{
+	ListCell *lc;
+
+	if (!query->ttl)
+		return;
+
+	if (!query->ttlColumn)
+		query->ttlColumn = get_freeze_column(query);
+
+	if (!query->ttlColumn)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("\"ttl\" requires a \"ttl_column\" or grouping by a timestamp column"),
+				 errhint("For example, ... WITH (ttl = '1 day', ttl_column = 'last_seen') ...")));
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+		Oid type;
+
+		if (te->resjunk || !te->resname || pg_strcasecmp(te->resname, query->ttlColumn) != 0)
+			continue;
+
+		type = exprType((Node *) te->expr);
+		if (type != TIMESTAMPTZOID && type != TIMESTAMPOID)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("\"ttl_column\" must be of type timestamp or timestamptz")));
+
+		return;
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_COLUMN),
+			 errmsg("\"ttl_column\" column \"%s\" does not exist", query->ttlColumn)));
+}
+
+/*
+ * validate_downsample
+ *
+ * Groups are downsampled by a timestamp grouping column, which is the view's first one unless
+ * another one is given
+ */
+static void
+validate_downsample(Query *query)
+{
+	ListCell *lc;
+
+	if (!query->downsample)
+		return;
+
+	if (!query->downsampleColumn)
+		query->downsampleColumn = get_freeze_column(query);
+
+	if (!query->downsampleColumn)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("\"downsample\" requires grouping by a timestamp column")));
+
+	validate_group_key(query, query->downsampleColumn, OPTION_DOWNSAMPLE_COLUMN);
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+		Oid type;
+
+		if (te->resjunk || !te->resname || pg_strcasecmp(te->resname, query->downsampleColumn) != 0)
+			continue;
+
+		type = exprType((Node *) te->expr);
+		if (type != TIMESTAMPTZOID && type != TIMESTAMPOID)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("\"downsample_column\" must be of type timestamp or timestamptz")));
+	}
+}
+
+/*
+ * validate_top_n
+ *
+ * Combiners rank the groups of top-N views by a numeric column
+ */
+static void
+validate_top_n(Query *query)
+{
+	ListCell *lc;
+
+	if (!query->topN)
+		return;
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+
+		if (te->resjunk || !te->resname || pg_strcasecmp(te->resname, query->topNColumn) != 0)
+			continue;
+
+		switch (exprType((Node *) te->expr))
+		{
+			case INT2OID:
+			case INT4OID:
+			case INT8OID:
+			case FLOAT4OID:
+			case FLOAT8OID:
+			case NUMERICOID:
+				return;
+			default:
+				ereport(ERROR,
+						(errcode(ERRCODE_DATATYPE_MISMATCH),
+						 errmsg("\"top_n_column\" must be a numeric column")));
+		}
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_COLUMN),
+			 errmsg("\"top_n_column\" column \"%s\" does not exist", query->topNColumn)));
+}
+
+/*
+ * validate_dedup
+ *
+ * Events are deduplicated by a column of the typed streams they're read from, which must exist
+ * independently of what the query itself reads
+ */
+static void
+validate_dedup(Query *query)
+{
+	ListCell *lc;
+
+	if (!query->dedupKey)
+		return;
+
+	foreach(lc, query->rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->rtekind != RTE_RELATION || !IsStream(rte->relid))
+			continue;
+
+		if (IsInferredStream(rte->relid))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("\"dedup_key\" requires a typed stream")));
+
+		if (get_attnum(rte->relid, query->dedupKey) == InvalidAttrNumber)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_COLUMN),
+					 errmsg("dedup key column \"%s\" does not exist in stream \"%s\"",
+							 query->dedupKey, get_rel_name(rte->relid))));
+	}
+}
+
 /*
  * DefineContinuousView
  *
@@ -226,6 +502,20 @@ DefineContinuousView(Oid relid, Query *query, Oid matrelid, Oid seqrelid, bool g
 				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
 						errmsg("query is null")));
 
+	if (query->freezeAfter && get_freeze_column(query) == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("\"freeze_after\" requires grouping by a timestamp column"),
+				 errhint("For example, ... GROUP BY date_trunc('minute', arrival_timestamp) ...")));
+
+	validate_output_coalescing(query);
+	validate_group_key(query, query->notifyKey, OPTION_NOTIFY_KEY);
+	validate_group_key(query, query->readCacheKey, OPTION_READ_CACHE_KEY);
+	validate_ttl(query);
+	validate_downsample(query);
+	validate_top_n(query);
+	validate_dedup(query);
+
 	query_str = nodeToString(query);
 
 	pipeline_query = heap_open(PipelineQueryRelationId, RowExclusiveLock);
@@ -251,6 +541,7 @@ DefineContinuousView(Oid relid, Query *query, Oid matrelid, Oid seqrelid, bool g
 		values[Anum_pipeline_query_step_factor - 1] = Int16GetDatum(query->swStepFactor);
 	else
 		values[Anum_pipeline_query_step_factor - 1] = Int16GetDatum(0);
+	values[Anum_pipeline_query_step_auto - 1] = BoolGetDatum(gc && query->swStepAuto);
 
 	/* unused */
 	values[Anum_pipeline_query_tgfn - 1] = ObjectIdGetDatum(InvalidOid);
@@ -309,6 +600,57 @@ UpdateContViewIndexIds(Oid cvid, Oid pkindid, Oid lookupindid)
 	heap_close(pipeline_query, RowExclusiveLock);
 }
 
+/*
+ * UpdateContViewStepFactor
+ *
+ * Change the step factor of a sliding-window continuous view. Running workers and combiners pick up
+ * the new step size the next time they execute the view. Rows of the matrel that were written with the
+ * previous step size are left as they are, since they're read like any other steps until they expire.
+ */
+void
+UpdateContViewStepFactor(Oid cvid, int step_factor, bool step_auto)
+{
+	Relation pipeline_query = heap_open(PipelineQueryRelationId, RowExclusiveLock);
+	HeapTuple tup = SearchSysCache1(PIPELINEQUERYID, ObjectIdGetDatum(cvid));
+	bool replace[Natts_pipeline_query];
+	bool nulls[Natts_pipeline_query];
+	Datum values[Natts_pipeline_query];
+	HeapTuple new;
+	Datum tmp;
+	bool isnull;
+	Query *query;
+
+	if (!HeapTupleIsValid(tup))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_CONTINUOUS_VIEW),
+				errmsg("continuous view with id \"%d\" does not exist", cvid)));
+
+	/* Views built on top of this one read its step factor from its query */
+	tmp = SysCacheGetAttr(PIPELINEQUERYID, tup, Anum_pipeline_query_query, &isnull);
+	Assert(!isnull);
+	query = (Query *) stringToNode(TextDatumGetCString(tmp));
+	query->swStepFactor = step_factor;
+	query->swStepAuto = step_auto;
+
+	MemSet(replace, 0 , sizeof(replace));
+	MemSet(nulls, 0 , sizeof(nulls));
+	replace[Anum_pipeline_query_step_factor - 1] = true;
+	replace[Anum_pipeline_query_step_auto - 1] = true;
+	replace[Anum_pipeline_query_query - 1] = true;
+	values[Anum_pipeline_query_step_factor - 1] = Int16GetDatum(step_factor);
+	values[Anum_pipeline_query_step_auto - 1] = BoolGetDatum(step_auto);
+	values[Anum_pipeline_query_query - 1] = CStringGetTextDatum(nodeToString(query));
+
+	new = heap_modify_tuple(tup, RelationGetDescr(pipeline_query), values, nulls, replace);
+
+	simple_heap_update(pipeline_query, &tup->t_self, new);
+	CatalogUpdateIndexes(pipeline_query, new);
+	CommandCounterIncrement();
+
+	ReleaseSysCache(tup);
+	heap_close(pipeline_query, RowExclusiveLock);
+}
+
 void
 UpdateContViewRelIds(Oid cvid, Oid cvrelid, Oid osrelid)
 {
@@ -602,6 +944,57 @@ GetContQueryForId(Oid id)
 	tmp = SysCacheGetAttr(PIPELINEQUERYRELID, tup, Anum_pipeline_query_query, &isnull);
 	query = (Query *) stringToNode(TextDatumGetCString(tmp));
 	cq->sql = deparse_query_def(query);
+	cq->delta_merge = query->deltaMerge;
+	cq->lazy_grouping_sets = query->lazyGroupingSets;
+
+	if (query->freezeAfter)
+	{
+		cq->freeze_after_ms = query->freezeAfter;
+		cq->freeze_column = pstrdup(get_freeze_column(query));
+	}
+
+	cq->sample_rate = query->sampleRate;
+	cq->join_window_ms = query->joinWindow;
+	cq->max_staleness_ms = query->maxStaleness;
+	cq->finalize_cache = query->finalizeCache;
+	cq->rollup_of = query->rollupOf;
+	cq->rollup_targets = query->rollupTargets;
+	if (query->notifyChannel)
+		cq->notify_channel = pstrdup(query->notifyChannel);
+	if (query->notifyKey)
+		cq->notify_key = pstrdup(query->notifyKey);
+	if (query->readCacheKey)
+		cq->read_cache_key = pstrdup(query->readCacheKey);
+	if (query->ttl)
+	{
+		cq->ttl_ms = query->ttl;
+		cq->ttl_column = pstrdup(query->ttlColumn);
+	}
+	if (query->mergeGroup)
+		cq->merge_group = pstrdup(query->mergeGroup);
+	cq->checkpoint_interval_ms = query->checkpointInterval;
+	if (query->topN)
+	{
+		cq->top_n = query->topN;
+		cq->top_n_column = pstrdup(query->topNColumn);
+	}
+	if (query->downsample)
+	{
+		cq->downsample = ParseDownsamplePolicy(query->downsample);
+		cq->downsample_column = pstrdup(query->downsampleColumn);
+	}
+	cq->cluster_groups = query->clusterGroups;
+	if (query->dedupKey)
+	{
+		cq->dedup_key = pstrdup(query->dedupKey);
+		cq->dedup_window_ms = query->dedupWindow;
+	}
+	cq->output_interval_ms = query->outputInterval;
+	if (query->outputThresholdColumn)
+	{
+		cq->output_threshold = query->outputThreshold;
+		cq->output_threshold_column = pstrdup(query->outputThresholdColumn);
+	}
 
 	if (row->gc)
 	{
@@ -609,6 +1002,8 @@ GetContQueryForId(Oid id)
 
 		cq->is_sw = row->gc;
 		cq->sw_step_factor = query->swStepFactor;
+		cq->sw_step_auto = row->step_auto;
+		cq->sw_lateness_ms = query->swAllowedLateness;
 		i = GetSWInterval(cq->name);
 		cq->sw_interval_ms = 1000 * (int) DatumGetFloat8(
 				DirectFunctionCall2(interval_part, CStringGetTextDatum("epoch"), (Datum) i));
@@ -764,6 +1159,7 @@ RemovePipelineQueryById(Oid oid)
 
 	/* Remove transition state entry */
 	RemoveTStateEntry(row->id);
+	ReadCacheInvalidate(row->id);
 
 	simple_heap_delete(pipeline_query, &tuple->t_self);
 
@@ -841,6 +1237,8 @@ DefineContinuousTransform(Oid relid, Query *query, Oid typoid, Oid fnoid, bool a
 				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
 						errmsg("query is null")));
 
+	validate_dedup(query);
+
 	query_str = nodeToString(query);
 
 	pipeline_query = heap_open(PipelineQueryRelationId, RowExclusiveLock);
@@ -914,6 +1312,7 @@ DefineContinuousTransform(Oid relid, Query *query, Oid typoid, Oid fnoid, bool a
 	values[Anum_pipeline_query_gc - 1] = BoolGetDatum(false);
 	values[Anum_pipeline_query_adhoc - 1] = BoolGetDatum(adhoc);
 	values[Anum_pipeline_query_step_factor - 1] = Int16GetDatum(0);
+	values[Anum_pipeline_query_step_auto - 1] = BoolGetDatum(false);
 
 	tup = heap_form_tuple(pipeline_query->rd_att, values, nulls);
 
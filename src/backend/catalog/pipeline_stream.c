@@ -34,6 +34,7 @@
 #include "parser/analyze.h"
 #include "pipeline/cont_analyze.h"
 #include "pipeline/stream.h"
+#include "pipeline/stream_readers.h"
 #include "utils/builtins.h"
 #include "tcop/tcopprot.h"
 #include "utils/guc.h"
@@ -174,9 +175,11 @@ streams_to_meta(Relation pipeline_query)
 		bool isnull;
 		Form_pipeline_query row = (Form_pipeline_query) GETSTRUCT(tup);
 		ContAnalyzeContext *context;
+		Query *query;
 
 		tmp = SysCacheGetAttr(PIPELINEQUERYRELID, tup, Anum_pipeline_query_query, &isnull);
-		querystring = deparse_query_def((Query *) stringToNode(TextDatumGetCString(tmp)));
+		query = (Query *) stringToNode(TextDatumGetCString(tmp));
+		querystring = deparse_query_def(query);
 
 		parsetree_list = pg_parse_query(querystring);
 		parsetree = (Node *) lfirst(parsetree_list->head);
@@ -219,7 +222,8 @@ streams_to_meta(Relation pipeline_query)
 				add_coltypes(entry, context->types);
 			}
 
-			if (row->active)
+			/* rollups are fed by their source view's combiners rather than by reading streams */
+			if (row->active && !OidIsValid(query->rollupOf))
 				entry->queries = bms_add_member(entry->queries, row->id);
 		}
 	}
@@ -353,6 +357,47 @@ PackTupleDesc(TupleDesc desc)
 	return result;
 }
 
+/*
+ * stream_row_changed
+ *
+ * Would replacing the given columns of a pipeline_stream row change it?
+ */
+static bool
+stream_row_changed(HeapTuple tup, Datum *values, bool *nulls, bool *replaces)
+{
+	int i;
+
+	for (i = 0; i < Natts_pipeline_stream; i++)
+	{
+		bool isnull;
+		Datum old;
+		bytea *oldbytes;
+		bytea *newbytes;
+
+		if (!replaces[i])
+			continue;
+
+		old = SysCacheGetAttr(PIPELINESTREAMRELID, tup, i + 1, &isnull);
+
+		if (isnull != nulls[i])
+			return true;
+		if (isnull)
+			continue;
+		if (DatumGetPointer(values[i]) == NULL)
+			return true;
+
+		/* both of the replaced columns are byteas */
+		oldbytes = DatumGetByteaP(old);
+		newbytes = DatumGetByteaP(values[i]);
+
+		if (VARSIZE(oldbytes) != VARSIZE(newbytes) ||
+				memcmp(VARDATA(oldbytes), VARDATA(newbytes), VARSIZE(oldbytes) - VARHDRSZ) != 0)
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * update_pipeline_stream_targets_and_desc
  *
@@ -404,6 +449,18 @@ update_pipeline_stream_catalog(Relation pipeline_stream, HTAB *hash)
 			replaces[Anum_pipeline_stream_desc - 1] = true;
 		}
 
+		keys = lappend_oid(keys, entry->relid);
+
+		/*
+		 * Rewriting a stream's row makes every backend inserting into it rebuild its insert info, so
+		 * the rows of streams that aren't affected by the change are left alone
+		 */
+		if (!stream_row_changed(tup, values, nulls, replaces))
+		{
+			ReleaseSysCache(tup);
+			continue;
+		}
+
 		newtup = heap_modify_tuple(tup, pipeline_stream->rd_att,
 				values, nulls, replaces);
 
@@ -413,8 +470,6 @@ update_pipeline_stream_catalog(Relation pipeline_stream, HTAB *hash)
 		ReleaseSysCache(tup);
 
 		CommandCounterIncrement();
-
-		keys = lappend_oid(keys, entry->relid);
 	}
 
 	return keys;
@@ -501,6 +556,8 @@ UpdatePipelineStreamCatalog(void)
 	keys = update_pipeline_stream_catalog(pipeline_stream, hash);
 	mark_nonexistent_streams(pipeline_stream, keys);
 
+	InvalidateStreamReadersCache();
+
 	heap_close(pipeline_stream, NoLock);
 	heap_close(pipeline_query, NoLock);
 }
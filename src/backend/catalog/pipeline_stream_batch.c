@@ -0,0 +1,133 @@
+/*-------------------------------------------------------------------------
+ *
+ * pipeline_stream_batch.c
+ *	  routines to support manipulation of the pipeline_stream_batch relation
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * IDENTIFICATION
+ *	  src/backend/catalog/pipeline_stream_batch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/indexing.h"
+#include "catalog/pipeline_stream_batch.h"
+#include "catalog/pipeline_stream_batch_fn.h"
+#include "utils/fmgroids.h"
+#include "utils/rel.h"
+
+/*
+ * StreamBatchIsRecorded
+ *
+ * Has the given combiner, or any combiner if ANY_COMBINER is given, committed the results of the
+ * stream batch with the given id?
+ */
+bool
+StreamBatchIsRecorded(int64 id, int combiner)
+{
+	Relation pipeline_stream_batch = heap_open(PipelineStreamBatchRelationId, AccessShareLock);
+	ScanKeyData skey[2];
+	SysScanDesc scan;
+	bool found;
+	int nkeys = 1;
+
+	ScanKeyInit(&skey[0], Anum_pipeline_stream_batch_id, BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(id));
+
+	if (combiner != ANY_COMBINER)
+	{
+		ScanKeyInit(&skey[1], Anum_pipeline_stream_batch_combiner, BTEqualStrategyNumber, F_INT4EQ,
+				Int32GetDatum(combiner));
+		nkeys++;
+	}
+
+	scan = systable_beginscan(pipeline_stream_batch, PipelineStreamBatchIdIndexId, true, NULL, nkeys, skey);
+	found = HeapTupleIsValid(systable_getnext(scan));
+	systable_endscan(scan);
+
+	heap_close(pipeline_stream_batch, AccessShareLock);
+
+	return found;
+}
+
+/*
+ * RecordStreamBatch
+ *
+ * Record that the given combiner has committed the results of the stream batch with the given id, which
+ * must be done in the transaction committing them
+ */
+void
+RecordStreamBatch(int64 id, int combiner)
+{
+	Relation pipeline_stream_batch;
+	HeapTuple tup;
+	bool nulls[Natts_pipeline_stream_batch];
+	Datum values[Natts_pipeline_stream_batch];
+
+	if (StreamBatchIsRecorded(id, combiner))
+		return;
+
+	MemSet(nulls, 0, sizeof(nulls));
+
+	pipeline_stream_batch = heap_open(PipelineStreamBatchRelationId, RowExclusiveLock);
+
+	values[Anum_pipeline_stream_batch_id - 1] = Int64GetDatum(id);
+	values[Anum_pipeline_stream_batch_committed - 1] = TimestampTzGetDatum(GetCurrentTransactionStartTimestamp());
+	values[Anum_pipeline_stream_batch_combiner - 1] = Int32GetDatum(combiner);
+
+	tup = heap_form_tuple(pipeline_stream_batch->rd_att, values, nulls);
+	simple_heap_insert(pipeline_stream_batch, tup);
+	CatalogUpdateIndexes(pipeline_stream_batch, tup);
+	CommandCounterIncrement();
+
+	heap_freetuple(tup);
+	heap_close(pipeline_stream_batch, NoLock);
+}
+
+/*
+ * RemoveStreamBatchesBefore
+ *
+ * Removes the given combiner's rows committed before the given time, and returns how many were removed.
+ * any_left is set to whether the combiner has any rows left.
+ */
+int
+RemoveStreamBatchesBefore(int combiner, TimestampTz before, bool *any_left)
+{
+	Relation pipeline_stream_batch = heap_open(PipelineStreamBatchRelationId, RowExclusiveLock);
+	HeapScanDesc scan;
+	HeapTuple tup;
+	int removed = 0;
+
+	*any_left = false;
+
+	scan = heap_beginscan_catalog(pipeline_stream_batch, 0, NULL);
+
+	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		Form_pipeline_stream_batch row = (Form_pipeline_stream_batch) GETSTRUCT(tup);
+
+		if (row->combiner != combiner)
+			continue;
+
+		if (row->committed < before)
+		{
+			simple_heap_delete(pipeline_stream_batch, &tup->t_self);
+			removed++;
+		}
+		else
+			*any_left = true;
+	}
+
+	heap_endscan(scan);
+	heap_close(pipeline_stream_batch, NoLock);
+
+	if (removed)
+		CommandCounterIncrement();
+
+	return removed;
+}
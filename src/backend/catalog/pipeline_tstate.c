@@ -141,8 +141,12 @@ GetDistinctBloomFilter(Oid id)
 	if (HeapTupleIsValid(tuple))
 		datum = SysCacheGetAttr(PIPELINETSTATEID, tuple, Anum_pipeline_tstate_distinct, &isnull);
 
+	/*
+	 * New filters are blocked, since every event probes them, and scalable, since there's no
+	 * telling how many distinct rows they'll see
+	 */
 	if (isnull)
-		bloom = BloomFilterCreate();
+		bloom = BloomFilterCreateScalable();
 	else
 		bloom = BloomFilterCopy((BloomFilter *) PG_DETOAST_DATUM(datum));
 
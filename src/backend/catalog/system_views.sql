@@ -934,6 +934,13 @@ LANGUAGE INTERNAL
 STRICT IMMUTABLE
 AS 'jsonb_set';
 
+CREATE OR REPLACE FUNCTION
+  pipeline_explain_analyze(cv text, batches integer DEFAULT 10)
+RETURNS SETOF text
+LANGUAGE INTERNAL
+STRICT VOLATILE
+AS 'pipeline_explain_analyze';
+
 --
 -- PipelineDB system views
 --
@@ -943,14 +950,19 @@ CREATE VIEW pipeline_proc_stats AS
 	SELECT type, pid, start_time,
 		input_rows, output_rows, updated_rows, input_bytes,
 		output_bytes, updated_bytes, executions, tuples_ps, bytes_ps,
-		time_pb, tuples_pb, memory, errors
+		time_pb, tuples_pb, memory, errors, sw_cache_bytes, sw_cache_hits,
+		sw_cache_misses, worker_queue_latency, exec_latency, combiner_queue_latency,
+		lookup_latency, combine_latency, sync_latency, end_to_end_latency
 	FROM cq_proc_stat_get() ORDER BY type, pid;
 
 -- continuous query stats
 CREATE VIEW pipeline_query_stats AS
 	SELECT name, type, input_rows, output_rows, updated_rows, input_bytes,
 		output_bytes, updated_bytes, tuples_ps, bytes_ps, time_pb, tuples_pb,
-		errors
+		errors, exec_latency, lookup_latency, combine_latency, sync_latency,
+		end_to_end_latency, group_cache_hits, group_cache_misses, lookups,
+		lookup_groups, lookup_time, lookup_blocks, hot_updates, combine_time, sync_time,
+		stale_drops
 	FROM cq_stat_get() ORDER BY name, type;
 
 -- stream stats
@@ -213,6 +213,25 @@ typedef struct CopyStateData
 	bool to_inferred_stream;
 	List *attnamelist;
 	MemoryContext to_stream_ctxt;
+
+	/*
+	 * Buffer that stream tuples are formed in directly, reused across batches
+	 * so that no memory is allocated per stream tuple
+	 */
+	bool stream_fast_path;
+	char *stream_buf;
+	Size stream_buf_size;
+	Size stream_buf_len;
+	HeapTupleData *stream_tuples;
+
+	/*
+	 * If set, a COPY FROM STDIN into a stream runs as a copy-both session, in
+	 * which each CopyData frame the client sends is acknowledged once all of
+	 * its rows have been written to the stream
+	 */
+	bool batch_ack;
+	uint64 frames_received;
+	uint64 frames_acked;
 } CopyStateData;
 
 /* DestReceiver for COPY (SELECT) TO */
@@ -307,12 +326,26 @@ static uint64 CopyTo(CopyState cstate);
 static void CopyOneRowTo(CopyState cstate, Oid tupleOid,
 			 Datum *values, bool *nulls);
 static uint64 CopyFrom(CopyState cstate);
+/*
+ * Maximum number of tuples buffered by CopyFrom before they're written out,
+ * and the initial size of the buffer stream tuples are formed in
+ */
+#define MAX_BUFFERED_TUPLES 1000
+#define STREAM_COPY_BUF_SIZE (2 * 65536)
+
 static void CopyFromInsertBatch(CopyState cstate, EState *estate,
 					CommandId mycid, int hi_options,
 					ResultRelInfo *resultRelInfo, TupleTableSlot *myslot,
 					BulkInsertState bistate,
 					int nBufferedTuples, HeapTuple *bufferedTuples,
 					int firstBufferedLineNo);
+static bool CopyFromStreamSetup(CopyState cstate, TupleDesc tupDesc);
+static HeapTuple CopyFromStreamFormTuple(CopyState cstate, TupleDesc tupDesc,
+					Datum *values, bool *nulls, int nBufferedTuples);
+static void CopyFromStreamBatch(CopyState cstate, TupleDesc tupDesc,
+					int nBufferedTuples, HeapTuple *bufferedTuples);
+static bool CopyFromStreamFrameDone(CopyState cstate);
+static void CopyFromStreamSendAck(CopyState cstate, uint64 processed);
 static bool CopyReadLine(CopyState cstate);
 static bool CopyReadLineText(CopyState cstate);
 static int	CopyReadAttributesText(CopyState cstate);
@@ -404,7 +437,8 @@ ReceiveCopyBegin(CopyState cstate)
 		int16		format = (cstate->binary ? 1 : 0);
 		int			i;
 
-		pq_beginmessage(&buf, 'G');
+		/* batch acks are sent back as CopyData, so they need a copy-both session */
+		pq_beginmessage(&buf, cstate->batch_ack ? 'W' : 'G');
 		pq_sendbyte(&buf, format);		/* overall format */
 		pq_sendint(&buf, natts, 2);
 		for (i = 0; i < natts; i++)
@@ -642,6 +676,8 @@ CopyGetData(CopyState cstate, void *databuf, int minread, int maxread)
 					switch (mtype)
 					{
 						case 'd':		/* CopyData */
+							if (cstate->batch_ack)
+								cstate->frames_received++;
 							break;
 						case 'c':		/* CopyDone */
 							/* COPY IN correctly terminated by frontend */
@@ -1079,6 +1115,14 @@ ProcessCopyOptions(CopyState cstate,
 						 errmsg("conflicting or redundant options")));
 			cstate->freeze = defGetBoolean(defel);
 		}
+		else if (strcmp(defel->defname, "batch_ack") == 0)
+		{
+			if (cstate->batch_ack)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			cstate->batch_ack = defGetBoolean(defel);
+		}
 		else if (strcmp(defel->defname, "delimiter") == 0)
 		{
 			if (cstate->delim)
@@ -1333,6 +1377,12 @@ ProcessCopyOptions(CopyState cstate,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("COPY force null only available using COPY FROM")));
 
+	/* Check batch_ack */
+	if (cstate->batch_ack && !is_from)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COPY batch_ack only available using COPY FROM")));
+
 	/* Don't allow the delimiter to appear in the null string. */
 	if (strchr(cstate->null_print, cstate->delim[0]) != NULL)
 		ereport(ERROR,
@@ -2254,7 +2304,6 @@ CopyFrom(CopyState cstate)
 	bool		useHeapMultiInsert;
 	int			nBufferedTuples = 0;
 
-#define MAX_BUFFERED_TUPLES 1000
 	HeapTuple  *bufferedTuples = NULL;	/* initialize to silence warning */
 	Size		bufferedTuplesSize = 0;
 	int			firstBufferedLineNo = 0;
@@ -2412,6 +2461,13 @@ CopyFrom(CopyState cstate)
 		bufferedTuples = palloc(MAX_BUFFERED_TUPLES * sizeof(HeapTuple));
 	}
 
+	/*
+	 * Streams have no triggers, constraints or indexes, so stream tuples can
+	 * usually be formed directly in a reusable batch buffer.
+	 */
+	if (cstate->to_stream)
+		cstate->stream_fast_path = CopyFromStreamSetup(cstate, tupDesc);
+
 	/* Prepare to catch AFTER triggers. */
 	if (!cstate->to_stream)
 		AfterTriggerBeginQuery();
@@ -2445,12 +2501,13 @@ CopyFrom(CopyState cstate)
 
 		CHECK_FOR_INTERRUPTS();
 
-		if (nBufferedTuples == 0)
+		if (nBufferedTuples == 0 || cstate->stream_fast_path)
 		{
 			/*
 			 * Reset the per-tuple exprcontext. We can only do this if the
-			 * tuple buffer is empty. (Calling the context the per-tuple
-			 * memory context is a bit of a misnomer now.)
+			 * tuple buffer is empty, or if buffered tuples don't live in it.
+			 * (Calling the context the per-tuple memory context is a bit of a
+			 * misnomer now.)
 			 */
 			ResetPerTupleExprContext(estate);
 		}
@@ -2461,6 +2518,49 @@ CopyFrom(CopyState cstate)
 		if (!NextCopyFrom(cstate, econtext, values, nulls, &loaded_oid))
 			break;
 
+		if (cstate->stream_fast_path)
+		{
+			tuple = CopyFromStreamFormTuple(cstate, tupDesc, values, nulls, nBufferedTuples);
+
+			/* if the batch buffer is full, flush it and try again */
+			if (tuple == NULL)
+			{
+				CopyFromStreamBatch(cstate, tupDesc, nBufferedTuples, bufferedTuples);
+				nBufferedTuples = 0;
+				bufferedTuplesSize = 0;
+
+				tuple = CopyFromStreamFormTuple(cstate, tupDesc, values, nulls, nBufferedTuples);
+				Assert(tuple);
+			}
+
+			MemoryContextSwitchTo(oldcontext);
+
+			bufferedTuples[nBufferedTuples++] = tuple;
+			bufferedTuplesSize += tuple->t_len;
+
+			if (nBufferedTuples == MAX_BUFFERED_TUPLES ||
+				bufferedTuplesSize > 65535)
+			{
+				CopyFromStreamBatch(cstate, tupDesc, nBufferedTuples, bufferedTuples);
+				nBufferedTuples = 0;
+				bufferedTuplesSize = 0;
+			}
+
+			processed++;
+
+			if (cstate->batch_ack && CopyFromStreamFrameDone(cstate))
+			{
+				if (nBufferedTuples > 0)
+					CopyFromStreamBatch(cstate, tupDesc, nBufferedTuples, bufferedTuples);
+				nBufferedTuples = 0;
+				bufferedTuplesSize = 0;
+
+				CopyFromStreamSendAck(cstate, processed);
+			}
+
+			continue;
+		}
+
 		/* And now we can form the input tuple. */
 		tuple = heap_form_tuple(tupDesc, values, nulls);
 
@@ -2522,12 +2622,7 @@ CopyFrom(CopyState cstate)
 					 * path we need to handle for them.
 					 */
 					if (cstate->to_stream)
-					{
-						MemoryContext old_cxt = MemoryContextSwitchTo(cstate->to_stream_ctxt);
-						CopyIntoStream(cstate->rel, tupDesc, bufferedTuples, nBufferedTuples);
-						MemoryContextReset(cstate->to_stream_ctxt);
-						MemoryContextSwitchTo(old_cxt);
-					}
+						CopyFromStreamBatch(cstate, tupDesc, nBufferedTuples, bufferedTuples);
 					else
 					{
 
@@ -2565,6 +2660,16 @@ CopyFrom(CopyState cstate)
 			 * tuples inserted by an INSERT command.
 			 */
 			processed++;
+
+			if (cstate->batch_ack && CopyFromStreamFrameDone(cstate))
+			{
+				if (nBufferedTuples > 0)
+					CopyFromStreamBatch(cstate, tupDesc, nBufferedTuples, bufferedTuples);
+				nBufferedTuples = 0;
+				bufferedTuplesSize = 0;
+
+				CopyFromStreamSendAck(cstate, processed);
+			}
 		}
 	}
 
@@ -2572,12 +2677,7 @@ CopyFrom(CopyState cstate)
 	if (nBufferedTuples > 0)
 	{
 		if (cstate->to_stream)
-		{
-			MemoryContext old_cxt = MemoryContextSwitchTo(cstate->to_stream_ctxt);
-			CopyIntoStream(cstate->rel, tupDesc, bufferedTuples, nBufferedTuples);
-			MemoryContextReset(cstate->to_stream_ctxt);
-			MemoryContextSwitchTo(old_cxt);
-		}
+			CopyFromStreamBatch(cstate, tupDesc, nBufferedTuples, bufferedTuples);
 		else
 		{
 			CopyFromInsertBatch(cstate, estate, mycid, hi_options,
@@ -2587,6 +2687,14 @@ CopyFrom(CopyState cstate)
 		}
 	}
 
+	/* Acknowledge any trailing frames and end our half of the copy-both session */
+	if (cstate->batch_ack)
+	{
+		if (cstate->frames_received > cstate->frames_acked)
+			CopyFromStreamSendAck(cstate, processed);
+		pq_putemptymessage('c');
+	}
+
 	/* Done, clean up */
 	error_context_stack = errcallback.previous;
 
@@ -2628,6 +2736,155 @@ CopyFrom(CopyState cstate)
 	return processed;
 }
 
+/*
+ * A subroutine of CopyFrom, to prepare for forming stream tuples directly in
+ * a reusable batch buffer. Returns false if the stream's tuples can't be
+ * formed this way, in which case they're formed with heap_form_tuple.
+ */
+static bool
+CopyFromStreamSetup(CopyState cstate, TupleDesc tupDesc)
+{
+	int i;
+
+	if (tupDesc->tdhasoid)
+		return false;
+
+	/* heap_form_tuple flattens any toasted values embedded in composites */
+	for (i = 0; i < tupDesc->natts; i++)
+	{
+		if (type_is_rowtype(tupDesc->attrs[i]->atttypid))
+			return false;
+	}
+
+	cstate->stream_buf_size = STREAM_COPY_BUF_SIZE;
+	cstate->stream_buf_len = 0;
+	cstate->stream_buf = MemoryContextAlloc(cstate->copycontext, cstate->stream_buf_size);
+	cstate->stream_tuples = MemoryContextAlloc(cstate->copycontext,
+			MAX_BUFFERED_TUPLES * sizeof(HeapTupleData));
+
+	return true;
+}
+
+/*
+ * A subroutine of CopyFrom, to form a stream tuple in place in the batch
+ * buffer. This is equivalent to heap_form_tuple, but doesn't allocate
+ * anything. Returns NULL if the tuple doesn't fit in what's left of the
+ * buffer, in which case the current batch must be flushed first.
+ */
+static HeapTuple
+CopyFromStreamFormTuple(CopyState cstate, TupleDesc tupDesc,
+						Datum *values, bool *nulls, int nBufferedTuples)
+{
+	HeapTuple	tuple = &cstate->stream_tuples[nBufferedTuples];
+	HeapTupleHeader td;
+	Size		len;
+	Size		data_len;
+	int			hoff;
+	bool		hasnull = false;
+	int			i;
+
+	for (i = 0; i < tupDesc->natts; i++)
+	{
+		if (nulls[i])
+		{
+			hasnull = true;
+			break;
+		}
+	}
+
+	len = offsetof(HeapTupleHeaderData, t_bits);
+	if (hasnull)
+		len += BITMAPLEN(tupDesc->natts);
+
+	hoff = len = MAXALIGN(len);
+	data_len = heap_compute_data_size(tupDesc, values, nulls);
+	len += data_len;
+
+	if (cstate->stream_buf_len + len > cstate->stream_buf_size)
+	{
+		if (nBufferedTuples > 0)
+			return NULL;
+
+		/* a single tuple that is larger than the whole buffer */
+		Assert(cstate->stream_buf_len == 0);
+		cstate->stream_buf = repalloc(cstate->stream_buf, len);
+		cstate->stream_buf_size = len;
+	}
+
+	td = (HeapTupleHeader) (cstate->stream_buf + cstate->stream_buf_len);
+	MemSet(td, 0, len);
+
+	tuple->t_len = len;
+	ItemPointerSetInvalid(&(tuple->t_self));
+	tuple->t_tableOid = RelationGetRelid(cstate->rel);
+	tuple->t_data = td;
+
+	HeapTupleHeaderSetDatumLength(td, len);
+	HeapTupleHeaderSetTypeId(td, tupDesc->tdtypeid);
+	HeapTupleHeaderSetTypMod(td, tupDesc->tdtypmod);
+	ItemPointerSetInvalid(&(td->t_ctid));
+	HeapTupleHeaderSetNatts(td, tupDesc->natts);
+	td->t_hoff = hoff;
+
+	heap_fill_tuple(tupDesc, values, nulls, (char *) td + hoff, data_len,
+					&td->t_infomask, (hasnull ? td->t_bits : NULL));
+
+	cstate->stream_buf_len += MAXALIGN(len);
+
+	return tuple;
+}
+
+/*
+ * A subroutine of CopyFrom, to write the current batch of buffered tuples
+ * to a stream.
+ */
+static void
+CopyFromStreamBatch(CopyState cstate, TupleDesc tupDesc,
+					int nBufferedTuples, HeapTuple *bufferedTuples)
+{
+	MemoryContext old_cxt = MemoryContextSwitchTo(cstate->to_stream_ctxt);
+
+	CopyIntoStream(cstate->rel, tupDesc, bufferedTuples, nBufferedTuples);
+	MemoryContextReset(cstate->to_stream_ctxt);
+	MemoryContextSwitchTo(old_cxt);
+
+	cstate->stream_buf_len = 0;
+}
+
+/*
+ * A subroutine of CopyFrom, to check if every CopyData frame received so far
+ * has been fully consumed, in which case the rows it contained have all been
+ * read. Clients must not split rows across frames for frames to be
+ * acknowledged individually.
+ */
+static bool
+CopyFromStreamFrameDone(CopyState cstate)
+{
+	return cstate->frames_received > cstate->frames_acked &&
+		cstate->fe_msgbuf->cursor >= cstate->fe_msgbuf->len &&
+		cstate->raw_buf_index >= cstate->raw_buf_len;
+}
+
+/*
+ * A subroutine of CopyFrom, to acknowledge every frame received so far. The
+ * ack is sent as a CopyData message containing an 'a' byte followed by the
+ * number of frames and the number of rows written so far, as 64-bit integers.
+ */
+static void
+CopyFromStreamSendAck(CopyState cstate, uint64 processed)
+{
+	StringInfoData buf;
+
+	cstate->frames_acked = cstate->frames_received;
+
+	pq_beginmessage(&buf, 'd');
+	pq_sendbyte(&buf, 'a');
+	pq_sendint64(&buf, cstate->frames_acked);
+	pq_sendint64(&buf, processed);
+	pq_endmessage(&buf);
+	pq_flush();
+}
+
 /*
  * A subroutine of CopyFrom, to write the current batch of buffered heap
  * tuples to the heap. Also updates indexes and runs AFTER ROW INSERT
@@ -2834,6 +3091,19 @@ BeginCopyFrom(Relation rel,
 	cstate->num_defaults = num_defaults;
 	cstate->is_program = is_program;
 
+	if (cstate->batch_ack)
+	{
+		if (!cstate->to_stream)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("COPY batch_ack is only supported for streams")));
+		if (!pipe || whereToSendOutput != DestRemote ||
+				PG_PROTOCOL_MAJOR(FrontendProtocol) < 3)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("COPY batch_ack is only supported from STDIN using the version 3 protocol")));
+	}
+
 	if (pipe)
 	{
 		Assert(!is_program);	/* the grammar does not allow this */
@@ -43,19 +43,25 @@
 #include "nodes/nodeFuncs.h"
 #include "nodes/pg_list.h"
 #include "optimizer/tlist.h"
+#include "parser/parsetree.h"
 #include "parser/analyze.h"
 #include "parser/parse_coerce.h"
 #include "parser/parse_func.h"
 #include "pipeline/cqmatrel.h"
 #include "pipeline/cont_analyze.h"
 #include "pipeline/cont_plan.h"
+#include "pipeline/cont_scheduler.h"
 #include "pipeline/miscutils.h"
+#include "pipeline/read_cache.h"
+#include "pipeline/sink.h"
 #include "pipeline/stream.h"
 #include "regex/regex.h"
+#include "rewrite/rewriteHandler.h"
 #include "tcop/dest.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
@@ -71,6 +77,8 @@
 
 /* guc params */
 int continuous_view_fillfactor;
+bool continuous_view_sw_time_index = true;
+bool continuous_view_window_index = true;
 
 /* hooks */
 bool use_ls_hash_group_index = true;
@@ -304,6 +312,221 @@ create_lookup_index(RangeVar *cv, Oid matrelid, RangeVar *matrel, Query *query,
 	return index_oid;
 }
 
+/*
+ * create_sw_time_index
+ *
+ * Create a BRIN index on a sliding-window matrel's time column. Steps are mostly written in
+ * the order they arrive, so this lets expiry skip the block ranges that only contain rows
+ * still in the window, at the cost of a tiny index that's cheap to maintain.
+ */
+static void
+create_sw_time_index(RangeVar *cv, Oid matrelid, RangeVar *matrel)
+{
+	IndexStmt *index;
+	IndexElem *indexcol;
+	ColumnRef *col = GetSWTimeColumn(cv);
+	char *namespace;
+	char *colname;
+
+	if (!IsA(col, ColumnRef))
+		elog(ERROR, "unexpected sliding window expression type found: %d", nodeTag(col));
+
+	DeconstructQualifiedName(col->fields, &namespace, &colname);
+
+	indexcol = makeNode(IndexElem);
+	indexcol->name = colname;
+	indexcol->ordering = SORTBY_DEFAULT;
+	indexcol->nulls_ordering = SORTBY_NULLS_DEFAULT;
+
+	index = makeNode(IndexStmt);
+	index->idxname = ChooseRelationName(matrel->relname, NULL, "brin_idx", get_rel_namespace(matrelid));
+	index->relation = matrel;
+	index->accessMethod = "brin";
+	index->indexParams = list_make1(indexcol);
+
+	DefineIndex(matrelid, index, InvalidOid, false, false, false, false);
+	CommandCounterIncrement();
+}
+
+/*
+ * create_ttl_index
+ *
+ * Create a btree index on the column a view with a ttl expires its groups by, so that combiners
+ * only visit the groups that have expired. Downsampled views get one on the column their groups
+ * are downsampled by for the same reason.
+ */
+static void
+create_ttl_index(Oid matrelid, RangeVar *matrel, char *colname, char *suffix)
+{
+	IndexStmt *index;
+	IndexElem *indexcol;
+	AttrNumber attno = get_attnum(matrelid, colname);
+	Oid type = get_atttype(matrelid, attno);
+
+	/* aggregates with timestamp results may store something else in the matrel */
+	if (type != TIMESTAMPTZOID && type != TIMESTAMPOID)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("\"ttl_column\" must be a grouping column or an aggregate storing a timestamp"),
+				 errhint("max(arrival_timestamp) and min(arrival_timestamp) store timestamps.")));
+
+	indexcol = makeNode(IndexElem);
+	indexcol->name = colname;
+	indexcol->ordering = SORTBY_DEFAULT;
+	indexcol->nulls_ordering = SORTBY_NULLS_DEFAULT;
+
+	index = makeNode(IndexStmt);
+	index->idxname = ChooseRelationName(matrel->relname, NULL, suffix, get_rel_namespace(matrelid));
+	index->relation = matrel;
+	index->accessMethod = "btree";
+	index->indexParams = list_make1(indexcol);
+
+	DefineIndex(matrelid, index, InvalidOid, false, false, false, false);
+	CommandCounterIncrement();
+}
+
+/*
+ * create_window_index
+ *
+ * Create a btree index on the PARTITION BY and ORDER BY columns of a view with WINDOWs. Window
+ * functions are evaluated over the matrel when the view is read, and the index provides the rows
+ * of each partition in window order, so reads restricted to some partitions only visit those
+ * partitions and don't need to sort them.
+ */
+static void
+create_window_index(Oid matrelid, RangeVar *matrel, Oid overlayid)
+{
+	Relation overlayrel = heap_open(overlayid, NoLock);
+	Query *query = copyObject(get_view_query(overlayrel));
+	WindowClause *wc;
+	IndexStmt *index;
+	List *cols = NIL;
+	ListCell *lc;
+
+	heap_close(overlayrel, NoLock);
+
+	if (query->windowClause == NIL)
+		return;
+
+	/* All WINDOWs of a continuous view have identical PARTITION BY and ORDER BY clauses */
+	wc = (WindowClause *) linitial(query->windowClause);
+
+	foreach(lc, list_concat(list_copy(wc->partitionClause), list_copy(wc->orderClause)))
+	{
+		SortGroupClause *sgc = (SortGroupClause *) lfirst(lc);
+		TargetEntry *te = get_sortgroupclause_tle(sgc, query->targetList);
+		IndexElem *indexcol;
+		Var *var;
+
+		/* Only plain matrel columns can be covered */
+		if (!IsA(te->expr, Var))
+			return;
+
+		var = (Var *) te->expr;
+		if (var->varlevelsup || rt_fetch(var->varno, query->rtable)->relid != matrelid)
+			return;
+
+		indexcol = makeNode(IndexElem);
+		indexcol->name = get_attname(matrelid, var->varattno);
+		indexcol->ordering = SORTBY_DEFAULT;
+		indexcol->nulls_ordering = SORTBY_NULLS_DEFAULT;
+
+		cols = lappend(cols, indexcol);
+	}
+
+	index = makeNode(IndexStmt);
+	index->idxname = ChooseRelationName(matrel->relname, NULL, "window_idx", get_rel_namespace(matrelid));
+	index->relation = matrel;
+	index->accessMethod = "btree";
+	index->indexParams = cols;
+
+	DefineIndex(matrelid, index, InvalidOid, false, false, false, false);
+	CommandCounterIncrement();
+}
+
+/*
+ * check_top_n_column
+ *
+ * Combiners of top-N views read the values they rank groups by straight from the matrel
+ */
+static void
+check_top_n_column(Oid matrelid, char *colname)
+{
+	AttrNumber attno = get_attnum(matrelid, colname);
+
+	/* aggregates with numeric results may store a transition state in the matrel */
+	switch (get_atttype(matrelid, attno))
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+			break;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("\"top_n_column\" must be a grouping column or an aggregate storing a number"),
+					 errhint("count and sum over smallint or integer columns store numbers, as do min and max over numbers.")));
+	}
+}
+
+static void
+check_relation_already_exists(RangeVar *rv)
+{
+	Oid namespace = RangeVarGetCreationNamespace(rv);
+
+	if (OidIsValid(get_relname_relid(rv->relname, namespace)))
+		ereport(ERROR,
+				(errcode(ERRCODE_DUPLICATE_TABLE),
+				 errmsg("relation \"%s\" already exists", rv->relname)));
+}
+
+/*
+ * create_checkpoint_rel
+ *
+ * Create the logged table an unlogged matrel is periodically checkpointed to by combiners, and restored
+ * from after crash recovery resets it. Its columns are the matrel's, without any constraints, so that
+ * rows can be copied between the two as is.
+ */
+static void
+create_checkpoint_rel(RangeVar *view, Oid matrelid, List *coldefs)
+{
+	CreateStmt *create = makeNode(CreateStmt);
+	ObjectAddress address;
+	ObjectAddress referenced;
+	ListCell *lc;
+
+	create->relation = makeRangeVar(view->schemaname, CVNameToCkptRelName(view->relname), -1);
+	create->relation->relpersistence = RELPERSISTENCE_PERMANENT;
+
+	check_relation_already_exists(create->relation);
+
+	foreach(lc, coldefs)
+	{
+		ColumnDef *def = (ColumnDef *) lfirst(lc);
+
+		def->constraints = NIL;
+		def->raw_default = NULL;
+		def->cooked_default = NULL;
+	}
+	create->tableElts = coldefs;
+
+	address = DefineRelation(create, RELKIND_RELATION, InvalidOid, NULL);
+	CommandCounterIncrement();
+
+	AlterTableCreateToastTable(address.objectId, (Datum) 0, AccessExclusiveLock);
+
+	/* It goes away along with the matrel */
+	referenced.classId = RelationRelationId;
+	referenced.objectId = matrelid;
+	referenced.objectSubId = 0;
+
+	recordDependencyOn(&address, &referenced, DEPENDENCY_INTERNAL);
+	CommandCounterIncrement();
+}
+
 static Oid
 create_pkey_index(RangeVar *cv, Oid matrelid, RangeVar *matrel, char *colname)
 {
@@ -515,21 +738,115 @@ create_coldefs_from_tlist(Query *query)
 			type = BOOLOID;
 
 		coldef = make_coldef(colname, type, exprTypmod((Node *) tle->expr));
+
+		/*
+		 * Large sketches are stored out-of-line uncompressed, so combiners that update in place
+		 * can rewrite only the chunks of them that changed instead of the whole sketch
+		 */
+		if (continuous_query_combiner_inplace_updates &&
+				(type == HLLOID || type == BLOOMOID || type == CMSKETCHOID))
+			coldef->storage = 'e';
+
 		defs = lappend(defs, coldef);
 	}
 
 	return defs;
 }
 
+/*
+ * add_finalize_cache_coldefs
+ *
+ * For views with finalize_cache, each overlay view column that finalizes aggregate states gets
+ * a matrel column the combiner keeps its finalized value in, which the view then reads instead
+ */
+static List *
+add_finalize_cache_coldefs(List *defs, SelectStmt *viewselect, Query *query)
+{
+	ListCell *vlc;
+	ListCell *qlc = list_head(query->targetList);
+	int attno = 0;
+
+	foreach(vlc, viewselect->targetList)
+	{
+		ResTarget *res = (ResTarget *) lfirst(vlc);
+		TargetEntry *tle = NULL;
+		ColumnRef *cref;
+		char *colname;
+		Oid type;
+
+		for (; qlc != NULL; qlc = lnext(qlc))
+		{
+			tle = (TargetEntry *) lfirst(qlc);
+			if (!tle->resjunk)
+				break;
+		}
+
+		if (qlc == NULL)
+			elog(ERROR, "overlay view has more columns than its continuous query");
+		qlc = lnext(qlc);
+		attno++;
+
+		/* Columns that are read from the matrel as is have nothing to finalize */
+		if (IsA(res->val, ColumnRef))
+			continue;
+
+		colname = psprintf(CQ_MATREL_FINAL_PREFIX "%d", attno);
+		type = exprType((Node *) tle->expr);
+		if (type == VOIDOID)
+			type = BOOLOID;
+
+		defs = lappend(defs, make_coldef(colname, type, exprTypmod((Node *) tle->expr)));
+
+		/* The view column keeps its name, see TransformSelectStmtForContProcess */
+		Assert(res->name);
+
+		cref = makeNode(ColumnRef);
+		cref->fields = list_make1(makeString(colname));
+		cref->location = -1;
+		res->val = (Node *) cref;
+	}
+
+	return defs;
+}
+
+/*
+ * check_rollup_coldefs
+ *
+ * Verifies that each of a rollup's matrel columns is produced by one of the expressions computing its
+ * partial results from its source view's matrel rows
+ */
 static void
-check_relation_already_exists(RangeVar *rv)
+check_rollup_coldefs(List *defs, List *targets, RangeVar *source)
 {
-	Oid namespace = RangeVarGetCreationNamespace(rv);
+	ListCell *lc;
 
-	if (OidIsValid(get_relname_relid(rv->relname, namespace)))
-		ereport(ERROR,
-				(errcode(ERRCODE_DUPLICATE_TABLE),
-				 errmsg("relation \"%s\" already exists", rv->relname)));
+	foreach(lc, defs)
+	{
+		ColumnDef *def = (ColumnDef *) lfirst(lc);
+		TargetEntry *match = NULL;
+		ListCell *tlc;
+
+		if (pg_strcasecmp(def->colname, CQ_MATREL_PKEY) == 0)
+			continue;
+
+		foreach(tlc, targets)
+		{
+			TargetEntry *te = (TargetEntry *) lfirst(tlc);
+
+			if (strcmp(te->resname, def->colname) == 0)
+			{
+				match = te;
+				break;
+			}
+		}
+
+		if (!match || exprType((Node *) match->expr) != def->typeName->typeOid)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("column \"%s\" can't be derived from the rows of \"%s\"", def->colname, source->relname),
+					 errhint("Rollups may only group on expressions of the grouping columns of \"%s\" and combine its aggregate columns.",
+							 source->relname)));
+	}
 }
 
 /*
@@ -577,6 +894,11 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 	ColumnDef *new;
 	CreateStreamStmt *create_osrel;
 	Oid osrelid = InvalidOid;
+	RangeVar *rollup_source = NULL;
+	SelectStmt *rollup_select = NULL;
+	SelectStmt *rollup;
+	ContQuery *source = NULL;
+	List *ckpt_coldefs = NIL;
 
 	Assert(((SelectStmt *) stmt->query)->forContinuousView);
 
@@ -598,12 +920,27 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 
 	pipeline_query = heap_open(PipelineQueryRelationId, ExclusiveLock);
 
+	/*
+	 * Rollups are analyzed as the equivalent query over their source view's streams, so that their matrels
+	 * are created exactly as if they read those streams themselves
+	 */
+	rollup = TransformRollupSelectStmt((SelectStmt *) stmt->query, &rollup_source, &rollup_select);
+	if (rollup)
+	{
+		source = GetContQueryForView(rollup_source);
+		stmt->query = (Node *) rollup;
+	}
+
 	CreateInferredStreams((SelectStmt *) stmt->query);
 	MakeSelectsContinuous((SelectStmt *) stmt->query);
 
 	/* Apply any CQ storage options like max_age, step_factor */
 	ApplyStorageOptions(stmt);
 
+	/* Checkpointed matrels aren't WAL-logged, and are restored from their checkpoints after a crash */
+	if (((SelectStmt *) stmt->query)->checkpointInterval)
+		matrel->relpersistence = RELPERSISTENCE_UNLOGGED;
+
 	ValidateParsedContQuery(stmt->into->rel, stmt->query, querystring);
 
 	/* Deparse query so that analyzer always see the same canonicalized SelectStmt */
@@ -611,8 +948,31 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 	cont_select_sql = deparse_query_def(cont_query);
 	cont_select = (SelectStmt *) linitial(pg_parse_query(cont_select_sql));
 	cont_select->swStepFactor = ((SelectStmt *) stmt->query)->swStepFactor;
+	cont_select->deltaMerge = ((SelectStmt *) stmt->query)->deltaMerge;
+	cont_select->lazyGroupingSets = ((SelectStmt *) stmt->query)->lazyGroupingSets;
 	context = MakeContAnalyzeContext(NULL, cont_select, Worker);
 
+	if (rollup)
+	{
+		Query *rollup_query;
+
+		if (context->is_sw || cont_query->deltaMerge)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("rollups of continuous views can't be sliding-window or delta_merge views")));
+
+		/* the source view's combiners derive our partial results from their matrel rows */
+		rollup_query = parse_analyze((Node *) rollup_select, querystring, NULL, 0);
+		cont_query->rollupOf = source->id;
+		foreach(lc, rollup_query->targetList)
+		{
+			TargetEntry *te = (TargetEntry *) lfirst(lc);
+
+			if (!te->resjunk)
+				cont_query->rollupTargets = lappend(cont_query->rollupTargets, te);
+		}
+	}
+
 	/*
 	 * Get the transformed SelectStmt used by CQ workers. We do this
 	 * because the targetList of this SelectStmt contains all columns
@@ -672,6 +1032,12 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 	pkey->contype = CONSTR_PRIMARY;
 	pk_coldef->constraints = list_make1(pkey);
 
+	if (rollup)
+		check_rollup_coldefs(tableElts, cont_query->rollupTargets, rollup_source);
+
+	if (cont_query->finalizeCache)
+		tableElts = add_finalize_cache_coldefs(tableElts, viewselect, cont_query);
+
 	if (!GetContinuousViewOption(stmt->into->options, OPTION_FILLFACTOR))
 		stmt->into->options = add_default_fillfactor(stmt->into->options);
 
@@ -685,6 +1051,9 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 	create_stmt->oncommit = stmt->into->onCommit;
 	create_stmt->options = stmt->into->options;
 
+	if (matrel->relpersistence == RELPERSISTENCE_UNLOGGED)
+		ckpt_coldefs = copyObject(tableElts);
+
 	if (IsBinaryUpgrade)
 		set_next_oids_for_matrel();
 	address = DefineRelation(create_stmt, RELKIND_RELATION, InvalidOid, NULL);
@@ -699,6 +1068,10 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 						   true);
 	AlterTableCreateToastTable(matrelid, toast_options, AccessExclusiveLock);
 
+	/* Binary upgrades dump the checkpoint table like any other table */
+	if (ckpt_coldefs && !IsBinaryUpgrade)
+		create_checkpoint_rel(view, matrelid, ckpt_coldefs);
+
 	/* Create the sequence for primary keys */
 	if (!pk)
 	{
@@ -785,10 +1158,51 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 		set_next_oids_for_pk_index();
 	pkey_idx_oid = create_pkey_index(view, matrelid, matrel, pk ? strVal(pk->arg) : CQ_MATREL_PKEY);
 
+	/*
+	 * Binary upgrades dump this index along with user-created ones, so that its OID is
+	 * preserved, so it's only created here otherwise
+	 */
+	if (context->is_sw && continuous_view_sw_time_index && !IsBinaryUpgrade)
+		create_sw_time_index(view, matrelid, matrel);
+
+	if (cont_query->ttl && !IsBinaryUpgrade)
+		create_ttl_index(matrelid, matrel, cont_query->ttlColumn, "ttl_idx");
+
+	if (cont_query->downsample && !IsBinaryUpgrade &&
+			(!cont_query->ttl || pg_strcasecmp(cont_query->ttlColumn, cont_query->downsampleColumn) != 0))
+		create_ttl_index(matrelid, matrel, cont_query->downsampleColumn, "downsample_idx");
+
+	if (continuous_view_window_index && !IsBinaryUpgrade)
+		create_window_index(matrelid, matrel, overlayid);
+
+	if (cont_query->topN)
+		check_top_n_column(matrelid, cont_query->topNColumn);
+
 	UpdateContViewIndexIds(cvid, pkey_idx_oid, lookup_idx_oid);
 	CommandCounterIncrement();
 
 	record_cv_dependencies(pqoid, matrelid, osrelid, seqrelid, overlayid, lookup_idx_oid, pkey_idx_oid, workerselect, query);
+
+	if (rollup)
+	{
+		ObjectAddress dependent;
+		ObjectAddress referenced;
+
+		/* A rollup can't outlive the view it's derived from */
+		dependent.classId = RelationRelationId;
+		dependent.objectId = overlayid;
+		dependent.objectSubId = 0;
+
+		referenced.classId = RelationRelationId;
+		referenced.objectId = source->relid;
+		referenced.objectSubId = 0;
+
+		recordDependencyOn(&dependent, &referenced, DEPENDENCY_NORMAL);
+
+		/* Make the source view's combiners pick up their new rollup */
+		CacheInvalidateRelcacheByRelid(source->matrelid);
+	}
+
 	allowSystemTableMods = saveAllowSystemTableMods;
 
 	/*
@@ -803,6 +1217,7 @@ ExecCreateContViewStmt(CreateContViewStmt *stmt, const char *querystring)
 	heap_close(pipeline_query, NoLock);
 
 	pgstat_report_create_drop_cv(true);
+	ActivateContQueryDatabase();
 }
 
 /*
@@ -815,6 +1230,8 @@ ExecTruncateContViewStmt(TruncateContViewStmt *stmt)
 	Relation pipeline_query;
 	List *views = NIL;
 	TruncateStmt *trunc = makeNode(TruncateStmt);
+	Oid matrelid;
+	Oid ckptid;
 
 	pipeline_query = heap_open(PipelineQueryRelationId, RowExclusiveLock);
 
@@ -832,24 +1249,38 @@ ExecTruncateContViewStmt(TruncateContViewStmt *stmt)
 					errmsg("continuous view \"%s\" does not exist", rv->relname)));
 
 		row = (Form_pipeline_query) GETSTRUCT(tuple);
+		views = lappend_oid(views, row->id);
+		matrelid = row->matrelid;
 
 		ReleaseSysCache(tuple);
 
-		views = lappend_oid(views, row->id);
 		matrel = GetMatRelName(rv);
 
 		trunc->relations = lappend(trunc->relations, matrel);
+
+		/* a checkpointed view must not be restored to what it held before it was truncated */
+		ckptid = CQMatRelGetCheckpointRelId(rv->relname, matrelid);
+		if (OidIsValid(ckptid))
+			trunc->relations = lappend(trunc->relations, makeRangeVar(matrel->schemaname,
+					get_rel_name(ckptid), -1));
 	}
 
 	trunc->restart_seqs = stmt->restart_seqs;
 	trunc->behavior = stmt->behavior;
 
-	/* Reset all CQ level transition state */
+	/*
+	 * Call TRUNCATE on the backing view table(s). Each matrel gets a new, empty relfilenode, and
+	 * combiners forget what they've cached about its groups once they see it, see forget_truncated_groups.
+	 */
+	ExecuteTruncate(trunc);
+
+	/* Combiners can't sync these views while we hold their matrels' locks, so this can't race with them */
 	foreach(lc, views)
 		ResetTStateEntry(lfirst_oid(lc));
 
-	/* Call TRUNCATE on the backing view table(s). */
-	ExecuteTruncate(trunc);
+	/* Combiners can't sync these views until we commit, so rows they've yet to cache are older */
+	foreach(lc, views)
+		ReadCacheInvalidate(lfirst_oid(lc));
 
 	heap_close(pipeline_query, NoLock);
 }
@@ -1054,6 +1485,7 @@ void
 ExecActivateStmt(ActivateStmt *stmt)
 {
 	set_cq_enabled(stmt->queries, true);
+	ActivateContQueryDatabase();
 }
 
 void
@@ -1173,6 +1605,30 @@ record_ct_dependencies(Oid pqoid, Oid relid, Oid fnoid, SelectStmt *stmt, Query
 			recordDependencyOn(&dependent, &referenced, DEPENDENCY_NORMAL);
 		}
 	}
+	else if (fnoid == PIPELINE_SINK_OID)
+	{
+		Value *v;
+		Oid sinkfn;
+
+		if (list_length(args) != 1)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+					errmsg("pipeline_sink must be given a single sink function"),
+					errhint("Sink functions take an array of rows, for example: deliver(rows anyarray).")));
+
+		v = (Value *) linitial(args);
+		sinkfn = LookupSinkFunction(strVal(v), false);
+
+		referenced.classId = ProcedureRelationId;
+		referenced.objectId = sinkfn;
+		referenced.objectSubId = 0;
+
+		dependent.classId = RelationRelationId;
+		dependent.objectId = relid;
+		dependent.objectSubId = 0;
+
+		recordDependencyOn(&dependent, &referenced, DEPENDENCY_NORMAL);
+	}
 }
 
 void
@@ -1184,7 +1640,7 @@ ExecCreateContTransformStmt(CreateContTransformStmt *stmt, const char *querystri
 	Oid pqoid;
 	ObjectAddress relobj;
 	Oid relid;
-	Oid fargtypes[1];	/* dummy */
+	Oid fargtypes[1];
 	Oid tgfnid;
 	Oid funcrettype;
 	CreateStmt *create;
@@ -1194,19 +1650,40 @@ ExecCreateContTransformStmt(CreateContTransformStmt *stmt, const char *querystri
 	transform = stmt->into->rel;
 	check_relation_already_exists(transform);
 
-	/* Find and validate the transform output function. */
-	tgfnid = LookupFuncName(stmt->funcname, 0, fargtypes, false);
-	funcrettype = get_func_rettype(tgfnid);
-	if (funcrettype != TRIGGEROID)
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
-				errmsg("function %s must return type \"trigger\"",
-				NameListToString(stmt->funcname))));
+	/*
+	 * Find and validate the transform output function. It's either a trigger function called for each row,
+	 * or a batch output function taking an array of all of the rows produced by a batch.
+	 */
+	fargtypes[0] = ANYARRAYOID;
+	tgfnid = LookupFuncName(stmt->funcname, 1, fargtypes, true);
+
+	if (OidIsValid(tgfnid))
+	{
+		if (stmt->args)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+					errmsg("batch output function %s cannot be given arguments",
+					NameListToString(stmt->funcname))));
+	}
+	else
+	{
+		tgfnid = LookupFuncName(stmt->funcname, 0, fargtypes, false);
+		funcrettype = get_func_rettype(tgfnid);
+		if (funcrettype != TRIGGEROID)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+					errmsg("function %s must return type \"trigger\"",
+					NameListToString(stmt->funcname))));
+	}
 
 	pipeline_query = heap_open(PipelineQueryRelationId, ExclusiveLock);
 
 	CreateInferredStreams((SelectStmt *) stmt->query);
 	MakeSelectsContinuous((SelectStmt *) stmt->query);
+	ApplySampleOption((SelectStmt *) stmt->query, stmt->into);
+	ApplyDedupOptions((SelectStmt *) stmt->query, stmt->into);
+	ApplyJoinWindowOption((SelectStmt *) stmt->query, stmt->into);
+	ApplyMaxStalenessOption((SelectStmt *) stmt->query, stmt->into);
 
 	ValidateParsedContQuery(stmt->into->rel, stmt->query, querystring);
 	ValidateSubselect(stmt->query, "continuous transforms");
@@ -1231,6 +1708,8 @@ ExecCreateContTransformStmt(CreateContTransformStmt *stmt, const char *querystri
 	CommandCounterIncrement();
 
 	heap_close(pipeline_query, NoLock);
+
+	ActivateContQueryDatabase();
 }
 
 /*
@@ -90,6 +90,7 @@ static SeqTableData *last_used_seq = NULL;
 static void fill_seq_with_data(Relation rel, HeapTuple tuple);
 static Relation open_share_lock(SeqTable seq);
 static void create_seq_hashtable(void);
+static int64 nextval_cached(Oid relid, int64 ncache);
 static void init_sequence(Oid relid, SeqTable *p_elm, Relation *p_rel);
 static Form_pg_sequence read_seq_tuple(SeqTable elm, Relation rel,
 			   Buffer *buf, HeapTuple seqtuple);
@@ -531,6 +532,46 @@ nextval_oid(PG_FUNCTION_ARGS)
 
 int64
 nextval_internal(Oid relid)
+{
+	return nextval_cached(relid, 1);
+}
+
+/*
+ * nextval_block_internal
+ *
+ * Like nextval_internal, but reserves up to *nvalues consecutive values at
+ * once, as if the sequence's cache were at least that large, and sets
+ * *nvalues to the number of values starting at the result that the caller
+ * now owns. Only ascending sequences with an increment of one hand out
+ * more than a single value.
+ */
+int64
+nextval_block_internal(Oid relid, int64 *nvalues)
+{
+	int64		result = nextval_cached(relid, *nvalues);
+	SeqTable	elm = last_used_seq;
+
+	Assert(elm && elm->relid == relid);
+
+	if (elm->increment == 1 && elm->cached >= elm->last)
+	{
+		*nvalues = elm->cached - elm->last + 1;
+		elm->last = elm->cached;
+	}
+	else
+		*nvalues = 1;
+
+	return result;
+}
+
+/*
+ * nextval_cached
+ *
+ * Guts of nextval_internal: caches at least ncache values in this backend
+ * when the sequence has to be read
+ */
+static int64
+nextval_cached(Oid relid, int64 ncache)
 {
 	SeqTable	elm;
 	Relation	seqrel;
@@ -589,7 +630,7 @@ nextval_internal(Oid relid)
 	incby = seq->increment_by;
 	maxv = seq->max_value;
 	minv = seq->min_value;
-	fetch = cache = seq->cache_value;
+	fetch = cache = Max(seq->cache_value, ncache);
 	log = seq->log_cnt;
 
 	if (!seq->is_called)
@@ -1183,6 +1183,12 @@ vacuum_rel(Oid relid, RangeVar *relation, int options, VacuumParams *params)
 	/* If this is a matrel for a SW continuous view, delete all expired tuples */
 	DeleteSWExpiredTuples(relid);
 
+	/* If this is a matrel for a view with freeze_after, compact its frozen buckets */
+	FreezeMatRelBuckets(relid);
+
+	/* If this is a matrel for a view with a downsample policy, merge its aged buckets */
+	DownsampleMatRelBuckets(relid);
+
 	/* Begin a transaction for vacuuming this relation */
 	StartTransactionCommand();
 
@@ -19,10 +19,14 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "executor/executor.h"
 #include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/int8.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 
 
 static TupleHashTable CurTupleHashTable = NULL;
@@ -37,6 +41,62 @@ static uint32 TupleHashTableConstantHash(const void *key, Size keysize);
  *		Utility routines for grouping tuples together
  *****************************************************************************/
 
+/*
+ * key_attrs_equal
+ *
+ * Applies the given equality function to two non-NULL key attributes, inlining those of the most
+ * common fixed-width key types to save a function call per key for every tuple
+ */
+static inline bool
+key_attrs_equal(FmgrInfo *eqfunction, Datum attr1, Datum attr2)
+{
+	PGFunction	fn = eqfunction->fn_addr;
+
+	if (fn == int4eq)
+		return DatumGetInt32(attr1) == DatumGetInt32(attr2);
+#ifdef HAVE_INT64_TIMESTAMP
+	if (fn == int8eq || fn == timestamp_eq)
+#else
+	if (fn == int8eq)
+#endif
+		return DatumGetInt64(attr1) == DatumGetInt64(attr2);
+
+	return DatumGetBool(FunctionCall2(eqfunction, attr1, attr2));
+}
+
+/*
+ * hash_key_attr
+ *
+ * Hashes a non-NULL key attribute, inlining the hash functions of the same key types as
+ * key_attrs_equal. Lookups may hash input and table tuples with different functions of the
+ * same hash opfamily, so the inlined ones produce exactly the values of those they replace.
+ */
+static inline uint32
+hash_key_attr(FmgrInfo *hashfunction, Datum attr)
+{
+	PGFunction	fn = hashfunction->fn_addr;
+
+	if (fn == hashint4)
+		return DatumGetUInt32(hash_uint32(DatumGetInt32(attr)));
+#ifdef HAVE_INT64_TIMESTAMP
+	if (fn == hashint8 || fn == timestamp_hash)
+#else
+	if (fn == hashint8)
+#endif
+	{
+		int64		val = DatumGetInt64(attr);
+		uint32		lohalf = (uint32) val;
+		uint32		hihalf = (uint32) (val >> 32);
+
+		/* see hashint8 */
+		lohalf ^= (val >= 0) ? hihalf : ~hihalf;
+
+		return DatumGetUInt32(hash_uint32(lohalf));
+	}
+
+	return DatumGetUInt32(FunctionCall1(hashfunction, attr));
+}
+
 /*
  * execTuplesMatch
  *		Return true if two tuples match in all the indicated fields.
@@ -99,8 +159,7 @@ execTuplesMatch(TupleTableSlot *slot1,
 
 		/* Apply the type-specific equality function */
 
-		if (!DatumGetBool(FunctionCall2(&eqfunctions[i],
-										attr1, attr2)))
+		if (!key_attrs_equal(&eqfunctions[i], attr1, attr2))
 		{
 			result = false;		/* they aren't equal */
 			break;
@@ -166,8 +225,7 @@ execTuplesUnequal(TupleTableSlot *slot1,
 
 		/* Apply the type-specific equality function */
 
-		if (!DatumGetBool(FunctionCall2(&eqfunctions[i],
-										attr1, attr2)))
+		if (!key_attrs_equal(&eqfunctions[i], attr1, attr2))
 		{
 			result = true;		/* they are unequal */
 			break;
@@ -581,8 +639,7 @@ TupleHashTableHash(const void *key, Size keysize)
 		{
 			uint32		hkey;
 
-			hkey = DatumGetUInt32(FunctionCall1(&hashfunctions[i],
-												attr));
+			hkey = hash_key_attr(&hashfunctions[i], attr);
 			hashkey ^= hkey;
 		}
 	}
@@ -148,13 +148,31 @@
 #include "parser/parse_coerce.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/int8.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
 #include "utils/tuplesort.h"
 #include "utils/datum.h"
 
 
+/*
+ * Transition functions of the most common aggregates over fixed-width types, which
+ * advance_transition_function runs inline instead of through fmgr, see get_inline_transfn
+ */
+typedef enum AggInlineTransFn
+{
+	AGG_INLINE_NONE = 0,
+	AGG_INLINE_INT8INC,			/* count(*) and count(x) */
+	AGG_INLINE_INT8PL,			/* combining counts */
+	AGG_INLINE_INT4_SUM,		/* sum(int4) */
+	AGG_INLINE_INT4_LARGER,		/* max(int4) */
+	AGG_INLINE_INT4_SMALLER,	/* min(int4) */
+	AGG_INLINE_INT8_LARGER,		/* max(int8), and max(timestamp) with integer timestamps */
+	AGG_INLINE_INT8_SMALLER		/* min(int8), and min(timestamp) with integer timestamps */
+} AggInlineTransFn;
+
 /*
  * AggStatePerAggData - per-aggregate working state for the Agg scan
  */
@@ -210,6 +228,9 @@ typedef struct AggStatePerAggData
 	FmgrInfo	transfn;
 	FmgrInfo	finalfn;
 
+	/* transfn to run inline rather than through fmgr, if any */
+	AggInlineTransFn inline_transfn;
+
 	/* Input collation derived for aggregate */
 	Oid			aggCollation;
 
@@ -614,6 +635,120 @@ initialize_aggregates(AggState *aggstate,
 	}
 }
 
+/*
+ * get_inline_transfn
+ *
+ * Which of the transition functions advance_inline_transition runs is the given one, if any? Only
+ * pass-by-value transition states are updated inline, so int8 ones are only with USE_FLOAT8_BYVAL.
+ */
+static AggInlineTransFn
+get_inline_transfn(AggStatePerAgg peraggstate)
+{
+	PGFunction fn = peraggstate->transfn.fn_addr;
+
+	if (!peraggstate->transtypeByVal)
+		return AGG_INLINE_NONE;
+
+	if (fn == int4_sum)
+		return AGG_INLINE_INT4_SUM;
+
+	/* in case any of them has been made non-strict */
+	if (!peraggstate->transfn.fn_strict)
+		return AGG_INLINE_NONE;
+
+	if (fn == int8inc || fn == int8inc_any)
+		return AGG_INLINE_INT8INC;
+	if (fn == int8pl)
+		return AGG_INLINE_INT8PL;
+	if (fn == int4larger)
+		return AGG_INLINE_INT4_LARGER;
+	if (fn == int4smaller)
+		return AGG_INLINE_INT4_SMALLER;
+#ifdef HAVE_INT64_TIMESTAMP
+	if (fn == int8larger || fn == timestamp_larger)
+		return AGG_INLINE_INT8_LARGER;
+	if (fn == int8smaller || fn == timestamp_smaller)
+		return AGG_INLINE_INT8_SMALLER;
+#else
+	if (fn == int8larger)
+		return AGG_INLINE_INT8_LARGER;
+	if (fn == int8smaller)
+		return AGG_INLINE_INT8_SMALLER;
+#endif
+
+	return AGG_INLINE_NONE;
+}
+
+/*
+ * advance_inline_transition
+ *
+ * Does what the inlined transition function would do, including raising the same overflow errors.
+ * All of them but int4_sum are strict, so advance_transition_function has already made sure that
+ * they're only given non-NULL values.
+ */
+static inline void
+advance_inline_transition(AggStatePerAgg peraggstate, AggStatePerGroup pergroupstate,
+						  FunctionCallInfo fcinfo)
+{
+	Datum		trans = pergroupstate->transValue;
+	Datum		arg = fcinfo->arg[1];
+	int64		a;
+	int64		b;
+	int64		result;
+
+	switch (peraggstate->inline_transfn)
+	{
+		case AGG_INLINE_INT8INC:
+			a = DatumGetInt64(trans);
+			result = a + 1;
+			if (result < 0 && a > 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						 errmsg("bigint out of range")));
+			pergroupstate->transValue = Int64GetDatum(result);
+			break;
+		case AGG_INLINE_INT8PL:
+			a = DatumGetInt64(trans);
+			b = DatumGetInt64(arg);
+			result = a + b;
+			/* see int8pl */
+			if (((a < 0) == (b < 0)) && ((result < 0) != (a < 0)))
+				ereport(ERROR,
+						(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						 errmsg("bigint out of range")));
+			pergroupstate->transValue = Int64GetDatum(result);
+			break;
+		case AGG_INLINE_INT4_SUM:
+			if (fcinfo->argnull[1])
+				break;
+			if (pergroupstate->transValueIsNull)
+				pergroupstate->transValue = Int64GetDatum((int64) DatumGetInt32(arg));
+			else
+				pergroupstate->transValue = Int64GetDatum(DatumGetInt64(trans) + (int64) DatumGetInt32(arg));
+			pergroupstate->transValueIsNull = false;
+			break;
+		case AGG_INLINE_INT4_LARGER:
+			if (DatumGetInt32(arg) > DatumGetInt32(trans))
+				pergroupstate->transValue = arg;
+			break;
+		case AGG_INLINE_INT4_SMALLER:
+			if (DatumGetInt32(arg) < DatumGetInt32(trans))
+				pergroupstate->transValue = arg;
+			break;
+		case AGG_INLINE_INT8_LARGER:
+			if (DatumGetInt64(arg) > DatumGetInt64(trans))
+				pergroupstate->transValue = arg;
+			break;
+		case AGG_INLINE_INT8_SMALLER:
+			if (DatumGetInt64(arg) < DatumGetInt64(trans))
+				pergroupstate->transValue = arg;
+			break;
+		case AGG_INLINE_NONE:
+			Assert(false);
+			break;
+	}
+}
+
 /*
  * Given new input value(s), advance the transition function of one aggregate
  * within one grouping set only (already set in aggstate->current_set)
@@ -681,6 +816,12 @@ advance_transition_function(AggState *aggstate,
 		}
 	}
 
+	if (peraggstate->inline_transfn != AGG_INLINE_NONE)
+	{
+		advance_inline_transition(peraggstate, pergroupstate, fcinfo);
+		return;
+	}
+
 	/* We run the transition functions in per-input-tuple memory context */
 	oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
 
@@ -2506,6 +2647,8 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 						&peraggstate->transtypeLen,
 						&peraggstate->transtypeByVal);
 
+		peraggstate->inline_transfn = get_inline_transfn(peraggstate);
+
 		/*
 		 * initval is potentially null, so don't try to access it as a struct
 		 * field. Must do it the hard way with SysCacheGetAttr.
@@ -81,7 +81,10 @@ ExecContinuousUnique(ContinuousUniqueState *node)
 
 		if (missing)
 		{
-			BloomFilterAdd(node->distinct, buf.data, buf.len);
+			/* the filter may grow, and must live as long as the node */
+			oldcontext = MemoryContextSwitchTo(node->tmpContext);
+			node->distinct = BloomFilterAdd(node->distinct, buf.data, buf.len);
+			MemoryContextSwitchTo(oldcontext);
 			node->dirty = true;
 			break;
 		}
@@ -71,6 +71,7 @@ ExecHashJoin(HashJoinState *node)
 	TupleTableSlot *outerTupleSlot;
 	uint32		hashvalue;
 	int			batchno;
+	MemoryContext oldcxt;
 
 	/*
 	 * get information from HashJoin node
@@ -165,7 +166,12 @@ ExecHashJoin(HashJoinState *node)
 
 				/*
 				 * create the hash table
+				 *
+				 * Continuous query workers run plans outside of the query
+				 * context and may keep the hash table across many executions
+				 * of the plan, so make sure it lives as long as the plan does.
 				 */
+				oldcxt = MemoryContextSwitchTo(node->js.ps.state->es_query_cxt);
 				hashtable = ExecHashTableCreate((Hash *) hashNode->ps.plan,
 												node->hj_HashOperators,
 												HJ_FILL_INNER(node));
@@ -176,6 +182,7 @@ ExecHashJoin(HashJoinState *node)
 				 */
 				hashNode->hashtable = hashtable;
 				(void) MultiExecProcNode((PlanState *) hashNode);
+				MemoryContextSwitchTo(oldcxt);
 
 				/*
 				 * If the inner relation is completely empty, and we're not
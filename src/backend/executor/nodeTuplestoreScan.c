@@ -20,6 +20,7 @@
 
 #include "executor/executor.h"
 #include "executor/nodeTuplestoreScan.h"
+#include "pipeline/tuplebatch.h"
 #include "utils/tuplestore.h"
 
 static TupleTableSlot *TuplestoreNext(TuplestoreScanState * node);
@@ -65,7 +66,12 @@ TuplestoreNext(TuplestoreScanState * node)
 	TuplestoreScan *scan = (TuplestoreScan *) node->ss.ps.plan;
 	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
 
-	if (!tuplestore_gettupleslot(scan->store, true, false, slot))
+	if (scan->batch)
+	{
+		if (!TupleBatchGetTupleSlot(scan->batch, slot))
+			return NULL;
+	}
+	else if (!tuplestore_gettupleslot(scan->store, true, false, slot))
 		return NULL;
 
 	return slot;
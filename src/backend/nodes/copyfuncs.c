@@ -640,6 +640,7 @@ _copyTuplestoreScan(const TuplestoreScan *from)
 
 	CopyScanFields((const Scan *) from, (Scan *) newnode);
 	COPY_SCALAR_FIELD(store);
+	COPY_SCALAR_FIELD(batch);
 	COPY_SCALAR_FIELD(desc);
 
 	return newnode;
@@ -2739,6 +2740,35 @@ _copyQuery(const Query *from)
 	COPY_SCALAR_FIELD(isCombine);
 	COPY_SCALAR_FIELD(isCombineLookup);
 	COPY_SCALAR_FIELD(swStepFactor);
+	COPY_SCALAR_FIELD(swStepAuto);
+	COPY_SCALAR_FIELD(swAllowedLateness);
+	COPY_SCALAR_FIELD(freezeAfter);
+	COPY_SCALAR_FIELD(deltaMerge);
+	COPY_SCALAR_FIELD(lazyGroupingSets);
+	COPY_STRING_FIELD(workerPool);
+	COPY_SCALAR_FIELD(outputInterval);
+	COPY_SCALAR_FIELD(outputThreshold);
+	COPY_STRING_FIELD(outputThresholdColumn);
+	COPY_SCALAR_FIELD(sampleRate);
+	COPY_STRING_FIELD(dedupKey);
+	COPY_SCALAR_FIELD(dedupWindow);
+	COPY_SCALAR_FIELD(joinWindow);
+	COPY_STRING_FIELD(notifyChannel);
+	COPY_STRING_FIELD(notifyKey);
+	COPY_SCALAR_FIELD(finalizeCache);
+	COPY_SCALAR_FIELD(rollupOf);
+	COPY_NODE_FIELD(rollupTargets);
+	COPY_STRING_FIELD(readCacheKey);
+	COPY_SCALAR_FIELD(ttl);
+	COPY_STRING_FIELD(ttlColumn);
+	COPY_STRING_FIELD(mergeGroup);
+	COPY_SCALAR_FIELD(checkpointInterval);
+	COPY_SCALAR_FIELD(topN);
+	COPY_STRING_FIELD(topNColumn);
+	COPY_SCALAR_FIELD(maxStaleness);
+	COPY_STRING_FIELD(downsample);
+	COPY_STRING_FIELD(downsampleColumn);
+	COPY_SCALAR_FIELD(clusterGroups);
 
 	return newnode;
 }
@@ -2812,6 +2842,33 @@ _copySelectStmt(const SelectStmt *from)
 	COPY_NODE_FIELD(rarg);
 	COPY_SCALAR_FIELD(forContinuousView);
 	COPY_SCALAR_FIELD(swStepFactor);
+	COPY_SCALAR_FIELD(swStepAuto);
+	COPY_SCALAR_FIELD(swAllowedLateness);
+	COPY_SCALAR_FIELD(freezeAfter);
+	COPY_SCALAR_FIELD(deltaMerge);
+	COPY_SCALAR_FIELD(lazyGroupingSets);
+	COPY_STRING_FIELD(workerPool);
+	COPY_SCALAR_FIELD(outputInterval);
+	COPY_SCALAR_FIELD(outputThreshold);
+	COPY_STRING_FIELD(outputThresholdColumn);
+	COPY_SCALAR_FIELD(sampleRate);
+	COPY_STRING_FIELD(dedupKey);
+	COPY_SCALAR_FIELD(dedupWindow);
+	COPY_SCALAR_FIELD(joinWindow);
+	COPY_STRING_FIELD(notifyChannel);
+	COPY_STRING_FIELD(notifyKey);
+	COPY_SCALAR_FIELD(finalizeCache);
+	COPY_STRING_FIELD(readCacheKey);
+	COPY_SCALAR_FIELD(ttl);
+	COPY_STRING_FIELD(ttlColumn);
+	COPY_STRING_FIELD(mergeGroup);
+	COPY_SCALAR_FIELD(checkpointInterval);
+	COPY_SCALAR_FIELD(topN);
+	COPY_STRING_FIELD(topNColumn);
+	COPY_SCALAR_FIELD(maxStaleness);
+	COPY_STRING_FIELD(downsample);
+	COPY_STRING_FIELD(downsampleColumn);
+	COPY_SCALAR_FIELD(clusterGroups);
 
 	return newnode;
 }
@@ -2228,6 +2228,33 @@ _outSelectStmt(StringInfo str, const SelectStmt *node)
 	WRITE_BOOL_FIELD(all);
 	WRITE_BOOL_FIELD(forContinuousView);
 	WRITE_FLOAT_FIELD(swStepFactor, "%.2f");
+	WRITE_BOOL_FIELD(swStepAuto);
+	WRITE_INT_FIELD(swAllowedLateness);
+	WRITE_INT_FIELD(freezeAfter);
+	WRITE_BOOL_FIELD(deltaMerge);
+	WRITE_BOOL_FIELD(lazyGroupingSets);
+	WRITE_STRING_FIELD(workerPool);
+	WRITE_INT_FIELD(outputInterval);
+	WRITE_FLOAT_FIELD(outputThreshold, "%.17g");
+	WRITE_STRING_FIELD(outputThresholdColumn);
+	WRITE_FLOAT_FIELD(sampleRate, "%.17g");
+	WRITE_STRING_FIELD(dedupKey);
+	WRITE_INT_FIELD(dedupWindow);
+	WRITE_INT_FIELD(joinWindow);
+	WRITE_STRING_FIELD(notifyChannel);
+	WRITE_STRING_FIELD(notifyKey);
+	WRITE_BOOL_FIELD(finalizeCache);
+	WRITE_STRING_FIELD(readCacheKey);
+	WRITE_INT_FIELD(ttl);
+	WRITE_STRING_FIELD(ttlColumn);
+	WRITE_STRING_FIELD(mergeGroup);
+	WRITE_INT_FIELD(checkpointInterval);
+	WRITE_INT_FIELD(topN);
+	WRITE_STRING_FIELD(topNColumn);
+	WRITE_INT_FIELD(maxStaleness);
+	WRITE_STRING_FIELD(downsample);
+	WRITE_STRING_FIELD(downsampleColumn);
+	WRITE_BOOL_FIELD(clusterGroups);
 	WRITE_NODE_FIELD(larg);
 	WRITE_NODE_FIELD(rarg);
 }
@@ -2425,6 +2452,35 @@ _outQuery(StringInfo str, const Query *node)
 	WRITE_BOOL_FIELD(isCombine);
 	WRITE_BOOL_FIELD(isCombineLookup);
 	WRITE_FLOAT_FIELD(swStepFactor, "%.2f");
+	WRITE_BOOL_FIELD(swStepAuto);
+	WRITE_INT_FIELD(swAllowedLateness);
+	WRITE_INT_FIELD(freezeAfter);
+	WRITE_BOOL_FIELD(deltaMerge);
+	WRITE_BOOL_FIELD(lazyGroupingSets);
+	WRITE_STRING_FIELD(workerPool);
+	WRITE_INT_FIELD(outputInterval);
+	WRITE_FLOAT_FIELD(outputThreshold, "%.17g");
+	WRITE_STRING_FIELD(outputThresholdColumn);
+	WRITE_FLOAT_FIELD(sampleRate, "%.17g");
+	WRITE_STRING_FIELD(dedupKey);
+	WRITE_INT_FIELD(dedupWindow);
+	WRITE_INT_FIELD(joinWindow);
+	WRITE_STRING_FIELD(notifyChannel);
+	WRITE_STRING_FIELD(notifyKey);
+	WRITE_BOOL_FIELD(finalizeCache);
+	WRITE_OID_FIELD(rollupOf);
+	WRITE_NODE_FIELD(rollupTargets);
+	WRITE_STRING_FIELD(readCacheKey);
+	WRITE_INT_FIELD(ttl);
+	WRITE_STRING_FIELD(ttlColumn);
+	WRITE_STRING_FIELD(mergeGroup);
+	WRITE_INT_FIELD(checkpointInterval);
+	WRITE_INT_FIELD(topN);
+	WRITE_STRING_FIELD(topNColumn);
+	WRITE_INT_FIELD(maxStaleness);
+	WRITE_STRING_FIELD(downsample);
+	WRITE_STRING_FIELD(downsampleColumn);
+	WRITE_BOOL_FIELD(clusterGroups);
 }
 
 static void
@@ -233,6 +233,35 @@ _readQuery(void)
 	READ_BOOL_FIELD(isCombine);
 	READ_BOOL_FIELD(isCombineLookup);
 	READ_INT_FIELD(swStepFactor);
+	READ_BOOL_FIELD(swStepAuto);
+	READ_INT_FIELD(swAllowedLateness);
+	READ_INT_FIELD(freezeAfter);
+	READ_BOOL_FIELD(deltaMerge);
+	READ_BOOL_FIELD(lazyGroupingSets);
+	READ_STRING_FIELD(workerPool);
+	READ_INT_FIELD(outputInterval);
+	READ_FLOAT_FIELD(outputThreshold);
+	READ_STRING_FIELD(outputThresholdColumn);
+	READ_FLOAT_FIELD(sampleRate);
+	READ_STRING_FIELD(dedupKey);
+	READ_INT_FIELD(dedupWindow);
+	READ_INT_FIELD(joinWindow);
+	READ_STRING_FIELD(notifyChannel);
+	READ_STRING_FIELD(notifyKey);
+	READ_BOOL_FIELD(finalizeCache);
+	READ_OID_FIELD(rollupOf);
+	READ_NODE_FIELD(rollupTargets);
+	READ_STRING_FIELD(readCacheKey);
+	READ_INT_FIELD(ttl);
+	READ_STRING_FIELD(ttlColumn);
+	READ_STRING_FIELD(mergeGroup);
+	READ_INT_FIELD(checkpointInterval);
+	READ_INT_FIELD(topN);
+	READ_STRING_FIELD(topNColumn);
+	READ_INT_FIELD(maxStaleness);
+	READ_STRING_FIELD(downsample);
+	READ_STRING_FIELD(downsampleColumn);
+	READ_BOOL_FIELD(clusterGroups);
 
 	READ_DONE();
 }
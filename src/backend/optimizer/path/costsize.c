@@ -119,6 +119,9 @@ bool		enable_material = true;
 bool		enable_mergejoin = true;
 bool		enable_hashjoin = true;
 
+/* probe indexes of tables joined against streams in join key order, once per batch */
+bool		continuous_query_batched_join_probes = false;
+
 typedef struct
 {
 	PlannerInfo *root;
@@ -21,12 +21,15 @@
 #include "nodes/makefuncs.h"
 #include "foreign/fdwapi.h"
 #include "nodes/relation.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "parser/parsetree.h"
 #include "pipeline/cont_plan.h"
+#include "pipeline/cont_scheduler.h"
 #include "utils/rel.h"
+#include "utils/selfuncs.h"
 
 /* Hook for plugins to get control in add_paths_to_joinrel() */
 set_join_pathlist_hook_type set_join_pathlist_hook = NULL;
@@ -72,6 +75,9 @@ try_stream_index_join_path(PlannerInfo *root,
 						List *restrict_clauses,
 						JoinPathExtraData *extra);
 
+static void cost_stream_index_join_probes(PlannerInfo *root, NestPath *path,
+							  Path *outer_path, Path *inner_path);
+
 static void
 physical_group_lookup(PlannerInfo *root,
 					RelOptInfo *joinrel,
@@ -247,8 +253,11 @@ add_paths_to_joinrel(PlannerInfo *root,
 					outerpath, innerpath, restrictlist, &extra);
 		}
 
-		/* Set the cheapest path, only if we actually added any paths. */
-		if (joinrel->pathlist)
+		/*
+		 * Set the cheapest path, only if we actually added any paths. Probes costed by batch
+		 * size can be compared with the other join strategies, so let those compete.
+		 */
+		if (joinrel->pathlist && !continuous_query_batched_join_probes)
 		{
 			set_cheapest(joinrel);
 			return;
@@ -556,12 +565,68 @@ try_stream_index_join_path(PlannerInfo *root,
 									  restrict_clauses,
 									  pathkeys, required_outer);
 
-	/* we only care about the cost of the table side of a stream-table join */
-	path->path.startup_cost = 0;
-	path->path.total_cost = inner_path->total_cost;
+	if (continuous_query_batched_join_probes)
+		cost_stream_index_join_probes(root, path, outer_path, inner_path);
+	else
+	{
+		/* we only care about the cost of the table side of a stream-table join */
+		path->path.startup_cost = 0;
+		path->path.total_cost = inner_path->total_cost;
+	}
+
 	add_path(joinrel, (Path *) path);
 }
 
+/*
+ * cost_stream_index_join_probes
+ *		Cost a stream-table nestloop whose outer side is sorted on the join keys
+ *
+ * The stream side reads a full batch at a time, which createplan sorts on the values used to probe
+ * the table's index. Consecutive probes for the same key are then nearly free, since they revisit the
+ * pages of the previous probe, so we only charge the full index cost once per distinct key.
+ */
+static void
+cost_stream_index_join_probes(PlannerInfo *root, NestPath *path, Path *outer_path, Path *inner_path)
+{
+	double rows = continuous_query_batch_size;
+	double ndistinct = rows;
+	List *keys = NIL;
+	Path sort_path;
+	Cost run_cost;
+	ListCell *lc;
+
+	if (inner_path->param_info)
+	{
+		foreach(lc, inner_path->param_info->ppi_clauses)
+		{
+			RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+			if (!is_opclause(rinfo->clause) || list_length(((OpExpr *) rinfo->clause)->args) != 2)
+				continue;
+
+			if (bms_is_subset(rinfo->left_relids, outer_path->parent->relids))
+				keys = lappend(keys, get_leftop(rinfo->clause));
+			else if (bms_is_subset(rinfo->right_relids, outer_path->parent->relids))
+				keys = lappend(keys, get_rightop(rinfo->clause));
+		}
+	}
+
+	if (keys)
+		ndistinct = estimate_num_groups(root, keys, rows, NULL);
+	ndistinct = clamp_row_est(Min(ndistinct, rows));
+
+	cost_sort(&sort_path, root, NIL, outer_path->total_cost, rows,
+			  outer_path->parent->width, 0.0, work_mem, -1.0);
+
+	run_cost = ndistinct * inner_path->total_cost;
+	run_cost += (rows - ndistinct) * (cpu_operator_cost + cpu_tuple_cost * inner_path->rows);
+	run_cost += cpu_tuple_cost * rows * inner_path->rows;
+
+	path->path.rows = rows * inner_path->rows;
+	path->path.startup_cost = sort_path.startup_cost;
+	path->path.total_cost = sort_path.total_cost + run_cost;
+}
+
 /*
  * try_mergejoin_path
  *	  Consider a merge join path; if it appears useful, push it into
@@ -42,7 +42,9 @@
 #include "optimizer/tlist.h"
 #include "optimizer/var.h"
 #include "parser/parse_clause.h"
+#include "parser/parse_oper.h"
 #include "parser/parsetree.h"
+#include "pipeline/cont_plan.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 
@@ -91,6 +93,8 @@ static CustomScan *create_customscan_plan(PlannerInfo *root,
 					   List *tlist, List *scan_clauses);
 static NestLoop *create_nestloop_plan(PlannerInfo *root, NestPath *best_path,
 					 Plan *outer_plan, Plan *inner_plan);
+static Plan *sort_stream_join_probes(PlannerInfo *root, NestPath *best_path,
+						Plan *outer_plan, List *nestParams);
 static MergeJoin *create_mergejoin_plan(PlannerInfo *root, MergePath *best_path,
 					  Plan *outer_plan, Plan *inner_plan);
 static HashJoin *create_hashjoin_plan(PlannerInfo *root, HashPath *best_path,
@@ -2367,6 +2371,9 @@ create_nestloop_plan(PlannerInfo *root,
 			prev = cell;
 	}
 
+	if (continuous_query_batched_join_probes)
+		outer_plan = sort_stream_join_probes(root, best_path, outer_plan, nestParams);
+
 	join_plan = make_nestloop(tlist,
 							  joinclauses,
 							  otherclauses,
@@ -2380,6 +2387,61 @@ create_nestloop_plan(PlannerInfo *root,
 	return join_plan;
 }
 
+/*
+ * sort_stream_join_probes
+ *	  Sort the stream side of a stream-table nestloop on the values it probes the table with
+ *
+ * The outer plan then reads a whole batch of events up front, and the inner index is probed in key
+ * order, with all probes for the same key made one after the other.
+ */
+static Plan *
+sort_stream_join_probes(PlannerInfo *root, NestPath *best_path, Plan *outer_plan, List *nestParams)
+{
+	RelOptInfo *outerrel = best_path->outerjoinpath->parent;
+	int			numCols = 0;
+	AttrNumber *sortColIdx;
+	Oid		   *sortOperators;
+	Oid		   *collations;
+	bool	   *nullsFirst;
+	ListCell   *lc;
+
+	if (nestParams == NIL || outerrel->reloptkind != RELOPT_BASEREL ||
+		!IS_STREAM_RTE(outerrel->relid, root))
+		return outer_plan;
+
+	sortColIdx = (AttrNumber *) palloc(list_length(nestParams) * sizeof(AttrNumber));
+	sortOperators = (Oid *) palloc(list_length(nestParams) * sizeof(Oid));
+	collations = (Oid *) palloc(list_length(nestParams) * sizeof(Oid));
+	nullsFirst = (bool *) palloc(list_length(nestParams) * sizeof(bool));
+
+	foreach(lc, nestParams)
+	{
+		NestLoopParam *nlp = (NestLoopParam *) lfirst(lc);
+		TargetEntry *tle = tlist_member((Node *) nlp->paramval, outer_plan->targetlist);
+		Oid			sortop;
+
+		if (tle == NULL)
+			continue;
+
+		get_sort_group_operators(exprType((Node *) tle->expr), false, false, false,
+								 &sortop, NULL, NULL, NULL);
+		if (!OidIsValid(sortop))
+			continue;
+
+		sortColIdx[numCols] = tle->resno;
+		sortOperators[numCols] = sortop;
+		collations[numCols] = exprCollation((Node *) tle->expr);
+		nullsFirst[numCols] = false;
+		numCols++;
+	}
+
+	if (numCols == 0)
+		return outer_plan;
+
+	return (Plan *) make_sort(root, outer_plan, numCols, sortColIdx, sortOperators,
+							  collations, nullsFirst, -1.0);
+}
+
 static MergeJoin *
 create_mergejoin_plan(PlannerInfo *root,
 					  MergePath *best_path,
@@ -126,6 +126,33 @@ parse_analyze(Node *parseTree, const char *sourceText,
 		query->isContinuous = stmt->forContinuousView;
 		query->isCombineLookup = stmt->forCombineLookup;
 		query->swStepFactor = stmt->swStepFactor;
+		query->swStepAuto = stmt->swStepAuto;
+		query->swAllowedLateness = stmt->swAllowedLateness;
+		query->freezeAfter = stmt->freezeAfter;
+		query->deltaMerge = stmt->deltaMerge;
+		query->lazyGroupingSets = stmt->lazyGroupingSets;
+		query->workerPool = stmt->workerPool;
+		query->outputInterval = stmt->outputInterval;
+		query->outputThreshold = stmt->outputThreshold;
+		query->outputThresholdColumn = stmt->outputThresholdColumn;
+		query->sampleRate = stmt->sampleRate;
+		query->dedupKey = stmt->dedupKey;
+		query->dedupWindow = stmt->dedupWindow;
+		query->joinWindow = stmt->joinWindow;
+		query->notifyChannel = stmt->notifyChannel;
+		query->notifyKey = stmt->notifyKey;
+		query->finalizeCache = stmt->finalizeCache;
+		query->readCacheKey = stmt->readCacheKey;
+		query->ttl = stmt->ttl;
+		query->ttlColumn = stmt->ttlColumn;
+		query->mergeGroup = stmt->mergeGroup;
+		query->checkpointInterval = stmt->checkpointInterval;
+		query->topN = stmt->topN;
+		query->topNColumn = stmt->topNColumn;
+		query->maxStaleness = stmt->maxStaleness;
+		query->downsample = stmt->downsample;
+		query->downsampleColumn = stmt->downsampleColumn;
+		query->clusterGroups = stmt->clusterGroups;
 	}
 
 	if (post_parse_analyze_hook)
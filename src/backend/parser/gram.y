@@ -2866,27 +2866,29 @@ explain_type:  CONTINUOUS TRANSFORM { $$ = OBJECT_CONTTRANSFORM; }
 /*****************************************************************************
  *
  *    QUERY :
- *        CREATE STREAM relname
+ *        CREATE STREAM relname [ OPTIONS (...) ]
  *
  *****************************************************************************/
 
-CreateStreamStmt: CREATE STREAM qualified_name '(' OptTableElementList ')'
+CreateStreamStmt: CREATE STREAM qualified_name '(' OptTableElementList ')' create_generic_options
         {
           CreateStreamStmt *n = makeNode(CreateStreamStmt);
           n->ft.base.relation = $3;
           n->ft.base.tableElts = $5;
           n->ft.base.if_not_exists = false;
           n->ft.servername = PIPELINE_STREAM_SERVER;
+          n->ft.options = $7;
           n->is_inferred = false;
           $$ = (Node *)n;
         }
-    | CREATE STREAM IF_P NOT EXISTS qualified_name '(' OptTableElementList ')'
+    | CREATE STREAM IF_P NOT EXISTS qualified_name '(' OptTableElementList ')' create_generic_options
         {
           CreateStreamStmt *n = makeNode(CreateStreamStmt);
           n->ft.base.relation = $6;
           n->ft.base.tableElts = $8;
           n->ft.base.if_not_exists = true;
           n->ft.servername = PIPELINE_STREAM_SERVER;
+          n->ft.options = $10;
           n->is_inferred = false;
           $$ = (Node *)n;
         }
@@ -12,6 +12,10 @@
 #include "postgres.h"
 
 #include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "pipeline/bloom.h"
 #include "pipeline/miscutils.h"
 #include "utils/elog.h"
@@ -24,23 +28,68 @@
 
 #define MURMUR_SEED 0x99496f1ddc863e6fL
 
+#define SCALABLE_HEADER_SIZE sizeof(BloomFilter)
+#define SCALABLE_FIRST(bf) ((BloomFilter *) ((char *) (bf) + SCALABLE_HEADER_SIZE))
+#define SCALABLE_NEXT(slice) ((BloomFilter *) ((char *) (slice) + BloomFilterSize(slice)))
+#define SCALABLE_SET_BITS(bf) ((bf)->b[0])
+#define SCALABLE_MAX_FILL 0.4375
+
 /*
  * Murmur is faster than an SHA-based approach and provides as-good collision
  * resistance.  The combinatorial generation approach described in
  * http://www.eecs.harvard.edu/~kirsch/pubs/bbbf/esa06.pdf
  * does prove to work in actual tests, and is obviously faster
  * than performing multiple iterations of Murmur.
+ *
+ * A blocked filter uses the first hash to pick one cache line sized block
+ * for each key, and sets all of the key's k bits within it, so a lookup
+ * touches a single block rather than k random words of a large filter, at
+ * the cost of a slightly higher false positive rate for the same size, since
+ * keys aren't spread perfectly evenly over the blocks.
+ *
+ * A scalable filter (http://gsd.di.uminho.pt/members/cbm/ps/dbloom.pdf) is a
+ * chain of blocked filters, each one with twice the capacity of the previous
+ * one and half its false positive rate, so that the false positive rate of
+ * the whole chain stays below the one it was created with however many keys
+ * are added to it. Keys are added to the newest filter, and a new one is
+ * appended shortly before half of its bits are set, which is when a filter
+ * with an optimal k is at its capacity: blocks fill unevenly, so a blocked
+ * filter is past its false positive rate by then. Halving that rate takes one
+ * more hash function, and doubling the capacity with it takes
+ * 2 * (k + 1) / k times the bits.
+ *
+ * The chain is stored as a single varlena: a header without any bits of its
+ * own, where m is the total number of bits, k is the number of filters and
+ * the only word counts the bits set in the newest filter, followed by each
+ * filter in turn.
+ *
+ * A sparse filter only has the nonzero words of a regular filter, followed
+ * by their positions. Workers send their filters to combiners in this form,
+ * since a filter that has only seen one batch's keys has few of those set.
+ * Combiners union them into their own filters directly, and copying one
+ * gives back the regular filter.
  */
+#define SPARSE_WORD_SIZE (sizeof(uint64_t) + sizeof(uint32_t))
+#define SPARSE_NWORDS(bf) ((VARSIZE(bf) - offsetof(BloomFilter, b)) / SPARSE_WORD_SIZE)
+#define SPARSE_POSITIONS(bf) ((uint32_t *) ((bf)->b + SPARSE_NWORDS(bf)))
 
-BloomFilter *
-BloomFilterCreateWithMAndK(uint32_t m, uint16_t k)
+static BloomFilter *
+create_bloom(uint32_t m, uint16_t k, uint16_t flags)
 {
 	BloomFilter *bf;
 	uint32_t blen = ceil(m / 64.0); /* round m up to nearest uint64_t limit */
 
+	/* blocked filters are made of whole blocks, and use all of their bits */
+	if (flags & BLOOM_BLOCKED)
+	{
+		blen = TYPEALIGN(BLOOM_BLOCK_WORDS, blen);
+		m = blen * 64;
+	}
+
 	bf = palloc0(sizeof(BloomFilter) + (sizeof(uint64_t) * blen));
 	bf->m = m;
 	bf->k = k;
+	bf->flags = flags;
 	bf->blen = blen;
 
 	SET_VARSIZE(bf, BloomFilterSize(bf));
@@ -48,6 +97,12 @@ BloomFilterCreateWithMAndK(uint32_t m, uint16_t k)
 	return bf;
 }
 
+BloomFilter *
+BloomFilterCreateWithMAndK(uint32_t m, uint16_t k)
+{
+	return create_bloom(m, k, 0);
+}
+
 BloomFilter *
 BloomFilterCreateWithPAndN(float8 p, uint32_t n)
 {
@@ -63,6 +118,50 @@ BloomFilterCreate(void)
 	return BloomFilterCreateWithPAndN(DEFAULT_P, DEFAULT_N);
 }
 
+BloomFilter *
+BloomFilterCreateBlockedWithPAndN(float8 p, uint32_t n)
+{
+	uint32_t m = -1 * ceil(n * log(p) / (pow(log(2), 2)));
+	uint16_t k = round(log(2.0) * m / n);
+	return create_bloom(m, k, BLOOM_BLOCKED);
+}
+
+BloomFilter *
+BloomFilterCreateBlocked(void)
+{
+	return BloomFilterCreateBlockedWithPAndN(DEFAULT_P, DEFAULT_N);
+}
+
+/*
+ * BloomFilterCreateScalableWithPAndN
+ *
+ * Create a scalable filter whose first filter holds n keys, and whose false positive
+ * rate stays below p however many keys are added to it
+ */
+BloomFilter *
+BloomFilterCreateScalableWithPAndN(float8 p, uint32_t n)
+{
+	/* the false positive rates of the chain add up to twice that of its first filter */
+	BloomFilter *first = BloomFilterCreateBlockedWithPAndN(p / 2, n);
+	BloomFilter *bf = palloc0(SCALABLE_HEADER_SIZE + BloomFilterSize(first));
+
+	bf->m = first->m;
+	bf->k = 1;
+	bf->flags = BLOOM_SCALABLE;
+	memcpy(SCALABLE_FIRST(bf), first, BloomFilterSize(first));
+	pfree(first);
+
+	SET_VARSIZE(bf, BloomFilterSize(bf));
+
+	return bf;
+}
+
+BloomFilter *
+BloomFilterCreateScalable(void)
+{
+	return BloomFilterCreateScalableWithPAndN(DEFAULT_P, DEFAULT_N / 16);
+}
+
 void
 BloomFilterDestroy(BloomFilter *bf)
 {
@@ -72,18 +171,127 @@ BloomFilterDestroy(BloomFilter *bf)
 BloomFilter *
 BloomFilterCopy(BloomFilter *bf)
 {
-	Size size = BloomFilterSize(bf);
-	char *new = palloc(size);
+	Size size;
+	char *new;
+
+	if (BLOOM_IS_SPARSE(bf))
+	{
+		BloomFilter *result = palloc0(sizeof(BloomFilter) + (sizeof(uint64_t) * bf->blen));
+		uint32_t *positions = SPARSE_POSITIONS(bf);
+		uint32_t i;
+
+		memcpy(result, bf, offsetof(BloomFilter, b));
+		result->flags &= ~BLOOM_SPARSE;
+		SET_VARSIZE(result, BloomFilterSize(result));
+
+		for (i = 0; i < SPARSE_NWORDS(bf); i++)
+			result->b[positions[i]] = bf->b[i];
+
+		return result;
+	}
+
+	size = BloomFilterSize(bf);
+	new = palloc(size);
 	memcpy(new, (char *) bf, size);
 	return (BloomFilter *) new;
 }
 
-void
-BloomFilterAdd(BloomFilter *bf, void *key, Size size)
+/*
+ * BloomFilterCompact
+ *
+ * Returns the sparse form of the given filter if it's smaller, or the filter itself otherwise
+ */
+BloomFilter *
+BloomFilterCompact(BloomFilter *bf)
 {
+	BloomFilter *sparse;
+	uint32_t *positions;
+	uint32_t n = 0;
 	uint32_t i;
-	uint64_t hash[2];
-	MurmurHash3_128(key, size, MURMUR_SEED, &hash);
+	Size size;
+
+	if (BLOOM_IS_SCALABLE(bf) || BLOOM_IS_SPARSE(bf))
+		return bf;
+
+	for (i = 0; i < bf->blen; i++)
+	{
+		if (bf->b[i])
+			n++;
+	}
+
+	size = offsetof(BloomFilter, b) + (n * SPARSE_WORD_SIZE);
+	if (size >= BloomFilterSize(bf))
+		return bf;
+
+	sparse = palloc(size);
+	memcpy(sparse, bf, offsetof(BloomFilter, b));
+	sparse->flags |= BLOOM_SPARSE;
+	SET_VARSIZE(sparse, size);
+
+	positions = SPARSE_POSITIONS(sparse);
+	n = 0;
+
+	for (i = 0; i < bf->blen; i++)
+	{
+		if (bf->b[i])
+		{
+			sparse->b[n] = bf->b[i];
+			positions[n++] = i;
+		}
+	}
+
+	return sparse;
+}
+
+/*
+ * get_block_mask
+ *
+ * Returns the block of the given blocked filter that the key with the given hash belongs to,
+ * and sets mask to the bits of the key within that block
+ */
+static uint64_t *
+get_block_mask(BloomFilter *bf, uint64_t *hash, uint64_t *mask)
+{
+	uint32_t h1 = (uint32_t) hash[1];
+	uint32_t h2 = (uint32_t) (hash[1] >> 32) | 1; /* odd, so that the k bits don't cycle early */
+	uint32_t i;
+
+	memset(mask, 0, sizeof(uint64_t) * BLOOM_BLOCK_WORDS);
+
+	for (i = 0; i < bf->k; i++)
+	{
+		uint32_t bit = (h1 + i * h2) % BLOOM_BLOCK_BITS;
+		mask[bit / 64] |= (uint64_t) 1 << (bit % 64);
+	}
+
+	return &bf->b[(hash[0] % (bf->blen / BLOOM_BLOCK_WORDS)) * BLOOM_BLOCK_WORDS];
+}
+
+/*
+ * add_hash
+ *
+ * Set the bits of the key with the given hash, returning how many of them weren't set
+ * yet if the filter is blocked
+ */
+static int
+add_hash(BloomFilter *bf, uint64_t *hash)
+{
+	uint32_t i;
+	int added = 0;
+
+	if (BLOOM_IS_BLOCKED(bf))
+	{
+		uint64_t mask[BLOOM_BLOCK_WORDS];
+		uint64_t *block = get_block_mask(bf, hash, mask);
+
+		for (i = 0; i < BLOOM_BLOCK_WORDS; i++)
+		{
+			added += __builtin_popcountll(mask[i] & ~block[i]);
+			block[i] |= mask[i];
+		}
+
+		return added;
+	}
 
 	for (i = 0; i < bf->k; i++)
 	{
@@ -91,14 +299,40 @@ BloomFilterAdd(BloomFilter *bf, void *key, Size size)
 		uint32_t idx = h % bf->m;
 		bf->b[BUCKET_IDX(bf, idx)] |= BIT_MASK(idx);
 	}
+
+	return added;
 }
 
-bool
-BloomFilterContains(BloomFilter *bf, void *key, Size size)
+static bool
+contains_hash(BloomFilter *bf, uint64_t *hash)
 {
 	uint32_t i;
-	uint64_t hash[2];
-	MurmurHash3_128(key, size, MURMUR_SEED, &hash);
+
+	if (BLOOM_IS_BLOCKED(bf))
+	{
+		uint64_t mask[BLOOM_BLOCK_WORDS];
+		uint64_t *block = get_block_mask(bf, hash, mask);
+#ifdef __SSE2__
+		__m128i missing = _mm_setzero_si128();
+
+		for (i = 0; i < BLOOM_BLOCK_WORDS; i += 2)
+		{
+			__m128i b = _mm_loadu_si128((const __m128i *) &block[i]);
+			__m128i m = _mm_loadu_si128((const __m128i *) &mask[i]);
+
+			missing = _mm_or_si128(missing, _mm_andnot_si128(b, m));
+		}
+
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xffff;
+#else
+		uint64_t missing = 0;
+
+		for (i = 0; i < BLOOM_BLOCK_WORDS; i++)
+			missing |= mask[i] & ~block[i];
+
+		return missing == 0;
+#endif
+	}
 
 	for (i = 0; i < bf->k; i++)
 	{
@@ -111,13 +345,123 @@ BloomFilterContains(BloomFilter *bf, void *key, Size size)
 	return true;
 }
 
+/*
+ * scalable_grow
+ *
+ * Returns a copy of the given scalable filter with a new, empty filter appended to it. The copy
+ * is a new allocation since scalable filters may be read straight from a tuple.
+ */
+static BloomFilter *
+scalable_grow(BloomFilter *bf)
+{
+	BloomFilter *newest = SCALABLE_FIRST(bf);
+	BloomFilter *next;
+	BloomFilter *result;
+	Size size = BloomFilterSize(bf);
+	int i;
+
+	for (i = 1; i < bf->k; i++)
+		newest = SCALABLE_NEXT(newest);
+
+	next = create_bloom(2.0 * newest->m * (newest->k + 1) / newest->k, newest->k + 1, BLOOM_BLOCKED);
+
+	result = palloc(size + BloomFilterSize(next));
+	memcpy(result, bf, size);
+	memcpy((char *) result + size, next, BloomFilterSize(next));
+
+	result->m += next->m;
+	result->k++;
+	SCALABLE_SET_BITS(result) = 0;
+	SET_VARSIZE(result, size + BloomFilterSize(next));
+
+	pfree(next);
+
+	return result;
+}
+
+/*
+ * BloomFilterAdd
+ *
+ * Add the given key to the given filter, returning the filter it's been added to. Only
+ * scalable filters are ever replaced by a new one.
+ */
+BloomFilter *
+BloomFilterAdd(BloomFilter *bf, void *key, Size size)
+{
+	uint64_t hash[2];
+
+	if (BLOOM_IS_SCALABLE(bf))
+	{
+		BloomFilter *newest = SCALABLE_FIRST(bf);
+		int i;
+
+		/* every filter of the chain hashes its keys independently of the others */
+		for (i = 1; i < bf->k; i++)
+			newest = SCALABLE_NEXT(newest);
+
+		MurmurHash3_128(key, size, MURMUR_SEED + bf->k - 1, &hash);
+		SCALABLE_SET_BITS(bf) += add_hash(newest, hash);
+
+		if (SCALABLE_SET_BITS(bf) >= newest->m * SCALABLE_MAX_FILL)
+			bf = scalable_grow(bf);
+
+		return bf;
+	}
+
+	MurmurHash3_128(key, size, MURMUR_SEED, &hash);
+	add_hash(bf, hash);
+
+	return bf;
+}
+
+bool
+BloomFilterContains(BloomFilter *bf, void *key, Size size)
+{
+	uint64_t hash[2];
+
+	if (BLOOM_IS_SCALABLE(bf))
+	{
+		BloomFilter *slice = SCALABLE_FIRST(bf);
+		int i;
+
+		for (i = 0; i < bf->k; i++)
+		{
+			MurmurHash3_128(key, size, MURMUR_SEED + i, &hash);
+			if (contains_hash(slice, hash))
+				return true;
+			slice = SCALABLE_NEXT(slice);
+		}
+
+		return false;
+	}
+
+	MurmurHash3_128(key, size, MURMUR_SEED, &hash);
+
+	return contains_hash(bf, hash);
+}
+
 BloomFilter *
 BloomFilterUnion(BloomFilter *result, BloomFilter *incoming)
 {
 	uint32_t i;
 
+	if (BLOOM_IS_SCALABLE(result) || BLOOM_IS_SCALABLE(incoming))
+		elog(ERROR, "scalable Bloom filters can't be combined");
+
+	Assert(!BLOOM_IS_SPARSE(result));
 	Assert(result->m == incoming->m);
 	Assert(result->k == incoming->k);
+	Assert(result->flags == (incoming->flags & ~BLOOM_SPARSE));
+
+	if (BLOOM_IS_SPARSE(incoming))
+	{
+		uint32_t *positions = SPARSE_POSITIONS(incoming);
+
+		for (i = 0; i < SPARSE_NWORDS(incoming); i++)
+			result->b[positions[i]] |= incoming->b[i];
+
+		return result;
+	}
 
 	for (i = 0; i < result->blen; i++)
 		result->b[i] |= incoming->b[i];
@@ -130,8 +474,13 @@ BloomFilterIntersection(BloomFilter *result, BloomFilter *incoming)
 {
 	uint32_t i;
 
+	if (BLOOM_IS_SCALABLE(result) || BLOOM_IS_SCALABLE(incoming))
+		elog(ERROR, "scalable Bloom filters can't be combined");
+
 	Assert(result->m == incoming->m);
 	Assert(result->k == incoming->k);
+	Assert(result->flags == incoming->flags);
+	Assert(!BLOOM_IS_SPARSE(result));
 
 	for (i = 0; i < result->blen; i++)
 		result->b[i] &= incoming->b[i];
@@ -142,17 +491,67 @@ BloomFilterIntersection(BloomFilter *result, BloomFilter *incoming)
 Size
 BloomFilterSize(BloomFilter *bf)
 {
+	if (BLOOM_IS_SPARSE(bf))
+		return VARSIZE(bf);
+
+	if (BLOOM_IS_SCALABLE(bf))
+	{
+		BloomFilter *slice = SCALABLE_FIRST(bf);
+		Size size = SCALABLE_HEADER_SIZE;
+		int i;
+
+		for (i = 0; i < bf->k; i++)
+		{
+			size += BloomFilterSize(slice);
+			slice = SCALABLE_NEXT(slice);
+		}
+
+		return size;
+	}
+
 	return sizeof(BloomFilter) + (sizeof(uint64_t) * bf->blen);
 }
 
-uint64_t
-BloomFilterCardinality(BloomFilter *bf)
+/*
+ * count_bits
+ *
+ * Unblocked filters only have their bits counted in the low half of each word, which is what
+ * their cardinalities have always been estimated from
+ */
+static uint64_t
+count_bits(BloomFilter *bf)
 {
 	uint32_t i;
-	float8 x = 0;
+	uint64_t x = 0;
 
 	for (i = 0; i < bf->blen; i++)
-		x += __builtin_popcount(bf->b[i]);
+		x += BLOOM_IS_BLOCKED(bf) ? __builtin_popcountll(bf->b[i]) : __builtin_popcount(bf->b[i]);
+
+	return x;
+}
+
+uint64_t
+BloomFilterCardinality(BloomFilter *bf)
+{
+	float8 x;
+
+	/* every key is in exactly one filter of the chain */
+	if (BLOOM_IS_SCALABLE(bf))
+	{
+		BloomFilter *slice = SCALABLE_FIRST(bf);
+		uint64_t card = 0;
+		int i;
+
+		for (i = 0; i < bf->k; i++)
+		{
+			card += BloomFilterCardinality(slice);
+			slice = SCALABLE_NEXT(slice);
+		}
+
+		return card;
+	}
+
+	x = count_bits(bf);
 
 	/* From: http://en.wikipedia.org/wiki/Bloom_filter#Approximating_the_number_of_items_in_a_Bloom_filter */
 	return -1.0 * bf->m * log(1 - (x / bf->m)) / bf->k;
@@ -161,12 +560,95 @@ BloomFilterCardinality(BloomFilter *bf)
 float8
 BloomFilterFillRatio(BloomFilter *bf)
 {
-	uint32_t i;
 	uint64_t x = 0;
+	uint32_t blen = 0;
+
+	if (BLOOM_IS_SCALABLE(bf))
+	{
+		BloomFilter *slice = SCALABLE_FIRST(bf);
+		int i;
+
+		for (i = 0; i < bf->k; i++)
+		{
+			x += count_bits(slice);
+			blen += slice->blen;
+			slice = SCALABLE_NEXT(slice);
+		}
+	}
+	else
+	{
+		x = count_bits(bf);
+		blen = bf->blen;
+	}
 
+	return x / (blen * 8.0);
+}
 
-	for (i = 0; i < bf->blen; i++)
-		x += __builtin_popcount(bf->b[i]);
+/*
+ * is_valid_filter
+ *
+ * Checks a regular or sparse filter of at most size bytes
+ */
+static bool
+is_valid_filter(BloomFilter *bf, Size size)
+{
+	uint32_t i;
+
+	if (size < offsetof(BloomFilter, b) || bf->m == 0 || bf->blen == 0 || BLOOM_IS_SCALABLE(bf))
+		return false;
+
+	if (BLOOM_IS_BLOCKED(bf) && bf->blen % BLOOM_BLOCK_WORDS)
+		return false;
+
+	if (!BLOOM_IS_SPARSE(bf))
+		return size >= BloomFilterSize(bf);
+
+	if ((VARSIZE(bf) - offsetof(BloomFilter, b)) % SPARSE_WORD_SIZE || VARSIZE(bf) > size)
+		return false;
+
+	for (i = 0; i < SPARSE_NWORDS(bf); i++)
+	{
+		if (SPARSE_POSITIONS(bf)[i] >= bf->blen)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * BloomFilterIsValid
+ *
+ * Checks that the given filter, e.g. one received from outside of the server, is well formed, so that
+ * reading or merging it stays within it
+ */
+bool
+BloomFilterIsValid(BloomFilter *bf)
+{
+	Size size = VARSIZE(bf);
+	BloomFilter *slice;
+	Size pos;
+	int i;
+
+	if (size < sizeof(BloomFilter))
+		return false;
+
+	if (!BLOOM_IS_SCALABLE(bf))
+		return is_valid_filter(bf, size) && (BLOOM_IS_SPARSE(bf) || size == BloomFilterSize(bf));
+
+	if (BLOOM_IS_SPARSE(bf) || bf->k == 0)
+		return false;
+
+	/* each slice is a regular filter whose size follows from its header */
+	pos = SCALABLE_HEADER_SIZE;
+	for (i = 0; i < bf->k; i++)
+	{
+		slice = (BloomFilter *) ((char *) bf + pos);
+
+		if (size - pos < sizeof(BloomFilter) || BLOOM_IS_SPARSE(slice) || !is_valid_filter(slice, size - pos))
+			return false;
+
+		pos += BloomFilterSize(slice);
+	}
 
-	return x / (bf->blen * 8.0);
+	return pos == size;
 }
@@ -14,6 +14,7 @@
 #include "pipeline/cmsketch.h"
 #include "pipeline/miscutils.h"
 #include "utils/elog.h"
+#include "utils/memutils.h"
 #include "utils/palloc.h"
 
 /*
@@ -24,6 +25,27 @@
 #define DEFAULT_EPS 0.002
 #define MURMUR_SEED 0x99496f1ddc863e6fL
 
+/* sketches with more rows than this are very unlikely, since each one divides the failure probability by e */
+#define MAX_STACK_ROWS 32
+
+/*
+ * A sparse sketch only has the nonzero counters of a regular sketch, as (position, value) pairs
+ * following the header. Workers send their sketches to combiners in this form, since a sketch
+ * that has only seen one batch's keys has few of those. Being smaller than a regular sketch of
+ * the same dimensions is what tells them apart. Combiners merge them into their own sketches
+ * directly, and copying one gives back the regular sketch.
+ */
+typedef struct SparseCounter
+{
+	uint32_t pos;
+	uint32_t value;
+} SparseCounter;
+
+#define SPARSE_HEADER_SIZE offsetof(CountMinSketch, table)
+#define IS_SPARSE(cms) (VARSIZE(cms) < CountMinSketchSize(cms))
+#define SPARSE_NCOUNTERS(cms) ((VARSIZE(cms) - SPARSE_HEADER_SIZE) / sizeof(SparseCounter))
+#define SPARSE_COUNTERS(cms) ((SparseCounter *) (cms)->table)
+
 CountMinSketch *
 CountMinSketchCreateWithDAndW(uint32_t d, uint32_t w)
 {
@@ -60,12 +82,89 @@ CountMinSketch *
 CountMinSketchCopy(CountMinSketch *cms)
 {
 	Size size = CountMinSketchSize(cms);
-	char *new = palloc(size);
+	char *new;
+
+	if (IS_SPARSE(cms))
+	{
+		CountMinSketch *result = CountMinSketchCreateWithDAndW(cms->d, cms->w);
+		return CountMinSketchMerge(result, cms);
+	}
+
+	new = palloc(size);
 	memcpy(new, (char *) cms, size);
 	return (CountMinSketch *) new;
 }
 
-void
+/*
+ * CountMinSketchCompact
+ *
+ * Returns the sparse form of the given sketch if it's smaller, or the sketch itself otherwise
+ */
+CountMinSketch *
+CountMinSketchCompact(CountMinSketch *cms)
+{
+	CountMinSketch *sparse;
+	SparseCounter *counters;
+	uint32_t n = 0;
+	uint32_t i;
+	Size size;
+
+	if (IS_SPARSE(cms))
+		return cms;
+
+	for (i = 0; i < cms->d * cms->w; i++)
+	{
+		if (cms->table[i])
+			n++;
+	}
+
+	size = SPARSE_HEADER_SIZE + (n * sizeof(SparseCounter));
+	if (size >= CountMinSketchSize(cms))
+		return cms;
+
+	sparse = palloc(size);
+	memcpy(sparse, cms, SPARSE_HEADER_SIZE);
+	SET_VARSIZE(sparse, size);
+
+	counters = SPARSE_COUNTERS(sparse);
+	n = 0;
+
+	for (i = 0; i < cms->d * cms->w; i++)
+	{
+		if (cms->table[i])
+		{
+			counters[n].pos = i;
+			counters[n++].value = cms->table[i];
+		}
+	}
+
+	return sparse;
+}
+
+/*
+ * get_counters
+ *
+ * Sets counters to the positions in the table of the given key's counter in each row. All
+ * of them are derived from a single 128-bit hash.
+ */
+static void
+get_counters(CountMinSketch *cms, void *key, Size size, uint32_t *counters)
+{
+	uint32_t i;
+	uint64_t hash[2];
+
+	MurmurHash3_128(key, size, MURMUR_SEED, &hash);
+
+	for (i = 0; i < cms->d; i++)
+		counters[i] = i * cms->w + (hash[0] + (i * hash[1])) % cms->w;
+}
+
+/*
+ * CountMinSketchAdd
+ *
+ * Adds count occurrences of the given key, returning its new estimated frequency
+ */
+uint32_t
 CountMinSketchAdd(CountMinSketch *cms, void *key, Size size, uint32_t count)
 {
 	/*
@@ -73,28 +172,31 @@ CountMinSketchAdd(CountMinSketch *cms, void *key, Size size, uint32_t count)
 	 * variant which apparently has better accuracy--albeit moderately slower.
 	 *
 	 * http://dimacs.rutgers.edu/~graham/pubs/papers/cmencyc.pdf
+	 *
+	 * The counters are located once for both passes, since that's where most of the time goes.
 	 */
+	uint32_t stack_counters[MAX_STACK_ROWS];
+	uint32_t *counters = stack_counters;
 	uint32_t min = UINT_MAX;
 	uint32_t i;
-	uint64_t hash[2];
 
-	MurmurHash3_128(key, size, MURMUR_SEED, &hash);
+	if (cms->d > MAX_STACK_ROWS)
+		counters = palloc(sizeof(uint32_t) * cms->d);
+
+	get_counters(cms, key, size, counters);
 
 	for (i = 0; i < cms->d; i++)
-	{
-		uint32_t start = i * cms->w;
-		uint32_t j = (hash[0] + (i * hash[1])) % cms->w;
-		min = Min(min, cms->table[start + j]);
-	}
+		min = Min(min, cms->table[counters[i]]);
 
 	for (i = 0; i < cms->d; i++)
-	{
-		uint32_t start = i * cms->w;
-		uint32_t j = (hash[0] + (i * hash[1])) % cms->w;
-		cms->table[start + j] = Max(cms->table[start + j], min + count);
-	}
+		cms->table[counters[i]] = Max(cms->table[counters[i]], min + count);
 
 	cms->count += count;
+
+	if (counters != stack_counters)
+		pfree(counters);
+
+	return min + count;
 }
 
 uint32_t
@@ -136,8 +238,20 @@ CountMinSketchMerge(CountMinSketch *result, CountMinSketch* incoming)
 	if (result->d != incoming->d || result->w != incoming->w)
 		elog(ERROR, "cannot merge count-min sketches of different sizes");
 
-	for (i = 0; i < result->d * result->w; i++)
-		result->table[i] += incoming->table[i];
+	Assert(!IS_SPARSE(result));
+
+	if (IS_SPARSE(incoming))
+	{
+		SparseCounter *counters = SPARSE_COUNTERS(incoming);
+
+		for (i = 0; i < SPARSE_NCOUNTERS(incoming); i++)
+			result->table[counters[i].pos] += counters[i].value;
+	}
+	else
+	{
+		for (i = 0; i < result->d * result->w; i++)
+			result->table[i] += incoming->table[i];
+	}
 
 	result->count += incoming->count;
 
@@ -149,3 +263,38 @@ CountMinSketchSize(CountMinSketch *cms)
 {
 	return sizeof(CountMinSketch) + (sizeof(uint32_t) * cms->d * cms->w);
 }
+
+/*
+ * CountMinSketchIsValid
+ *
+ * Checks that the given sketch, e.g. one received from outside of the server, is well formed, so that
+ * reading or merging it stays within it
+ */
+bool
+CountMinSketchIsValid(CountMinSketch *cms)
+{
+	Size size = VARSIZE(cms);
+	uint64 ncounters;
+	uint32_t i;
+
+	if (size < SPARSE_HEADER_SIZE || cms->d == 0 || cms->w == 0)
+		return false;
+
+	ncounters = (uint64) cms->d * cms->w;
+	if (ncounters > MaxAllocSize / sizeof(uint32_t))
+		return false;
+
+	if (!IS_SPARSE(cms))
+		return size == CountMinSketchSize(cms);
+
+	if ((size - SPARSE_HEADER_SIZE) % sizeof(SparseCounter))
+		return false;
+
+	for (i = 0; i < SPARSE_NCOUNTERS(cms); i++)
+	{
+		if (SPARSE_COUNTERS(cms)[i].pos >= ncounters)
+			return false;
+	}
+
+	return true;
+}
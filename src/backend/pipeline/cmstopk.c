@@ -0,0 +1,444 @@
+/*-------------------------------------------------------------------------
+ *
+ * cmstopk.c
+ *	  Count-Min Sketch heavy hitters implementation
+ *
+ *	  The sketch is updated and the heap of candidates is maintained in the
+ *	  same pass, using the sketch's estimates as candidate frequencies. Merging
+ *	  merges the sketches and then re-estimates the union of both heaps with the
+ *	  merged sketch, which is what keeps this usable for continuous queries.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/cmstopk.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+#include "pipeline/cmstopk.h"
+#include "pipeline/miscutils.h"
+#include "utils/datum.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+
+/*
+ * A candidate that hasn't been stored in a CMSTopK yet
+ */
+typedef struct Candidate
+{
+	uint64_t frequency;
+	char *value;
+	uint32_t vallen;
+	char *key;
+	uint32_t keylen;
+	Datum byval;
+} Candidate;
+
+#define ENTRY_VALUE(topk, e) (CMSTopKData(topk) + (e)->offset)
+#define ENTRY_KEY(topk, e) (ENTRY_VALUE(topk, e) + MAXALIGN((e)->vallen))
+#define ENTRY_SIZE(e) (MAXALIGN((e)->vallen) + MAXALIGN((e)->keylen))
+
+/*
+ * get_key
+ *
+ * Serialize the given value into the bytes it is hashed as
+ */
+static void
+get_key(CMSTopK *topk, Datum value, StringInfo buf)
+{
+	TypeCacheEntry typ;
+
+	typ.type_id = topk->typoid;
+	typ.typbyval = topk->typbyval;
+	typ.typlen = topk->typlen;
+	typ.typtype = topk->typtype;
+
+	DatumToBytes(value, &typ, buf);
+}
+
+static Datum
+entry_value(CMSTopK *topk, CMSTopKEntry *e)
+{
+	Datum result;
+
+	if (!topk->typbyval)
+		return PointerGetDatum(ENTRY_VALUE(topk, e));
+
+	memcpy(&result, ENTRY_VALUE(topk, e), sizeof(Datum));
+
+	return result;
+}
+
+static bool
+entry_matches(CMSTopK *topk, CMSTopKEntry *e, char *key, uint32_t keylen)
+{
+	return e->keylen == keylen && memcmp(ENTRY_KEY(topk, e), key, keylen) == 0;
+}
+
+static void
+entry_to_candidate(CMSTopK *topk, CMSTopKEntry *e, Candidate *c)
+{
+	c->frequency = e->frequency;
+	c->value = ENTRY_VALUE(topk, e);
+	c->vallen = e->vallen;
+	c->key = ENTRY_KEY(topk, e);
+	c->keylen = e->keylen;
+}
+
+static void
+datum_to_candidate(CMSTopK *topk, Datum value, StringInfo key, uint64_t freq, Candidate *c)
+{
+	c->frequency = freq;
+	c->key = key->data;
+	c->keylen = key->len;
+
+	if (topk->typbyval)
+	{
+		c->byval = value;
+		c->value = (char *) &c->byval;
+		c->vallen = sizeof(Datum);
+		return;
+	}
+
+	if (topk->typlen == -1)
+		value = PointerGetDatum(PG_DETOAST_DATUM_PACKED(value));
+
+	c->value = DatumGetPointer(value);
+	c->vallen = datumGetSize(value, false, topk->typlen);
+}
+
+/*
+ * build
+ *
+ * Build a new CMSTopK with the given sketch and candidates. The candidates are stored in
+ * heap order, so they must already form a valid heap.
+ */
+static CMSTopK *
+build(CMSTopK *template, CountMinSketch *cms, Candidate *cands, int n)
+{
+	Size size = MAXALIGN(sizeof(CMSTopK)) + MAXALIGN(CountMinSketchSize(cms)) +
+			sizeof(CMSTopKEntry) * template->k;
+	CMSTopK *result;
+	CMSTopKEntry *heap;
+	uint32_t offset = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		size += MAXALIGN(cands[i].vallen) + MAXALIGN(cands[i].keylen);
+
+	result = palloc0(size);
+	memcpy(result, template, sizeof(CMSTopK));
+	memcpy(CMSTopKSketch(result), cms, CountMinSketchSize(cms));
+	result->n = n;
+
+	heap = CMSTopKHeap(result);
+	for (i = 0; i < n; i++)
+	{
+		CMSTopKEntry *e = &heap[i];
+
+		e->frequency = cands[i].frequency;
+		e->offset = offset;
+		e->vallen = cands[i].vallen;
+		e->keylen = cands[i].keylen;
+
+		memcpy(ENTRY_VALUE(result, e), cands[i].value, cands[i].vallen);
+		memcpy(ENTRY_KEY(result, e), cands[i].key, cands[i].keylen);
+
+		offset += ENTRY_SIZE(e);
+	}
+
+	SET_VARSIZE(result, size);
+
+	return result;
+}
+
+static void
+sift_up(CMSTopKEntry *heap, int i)
+{
+	while (i > 0)
+	{
+		int parent = (i - 1) / 2;
+		CMSTopKEntry tmp;
+
+		if (heap[parent].frequency <= heap[i].frequency)
+			break;
+
+		tmp = heap[parent];
+		heap[parent] = heap[i];
+		heap[i] = tmp;
+		i = parent;
+	}
+}
+
+static void
+sift_down(CMSTopKEntry *heap, int n, int i)
+{
+	for (;;)
+	{
+		int smallest = i;
+		int left = 2 * i + 1;
+		int right = left + 1;
+		CMSTopKEntry tmp;
+
+		if (left < n && heap[left].frequency < heap[smallest].frequency)
+			smallest = left;
+		if (right < n && heap[right].frequency < heap[smallest].frequency)
+			smallest = right;
+		if (smallest == i)
+			break;
+
+		tmp = heap[smallest];
+		heap[smallest] = heap[i];
+		heap[i] = tmp;
+		i = smallest;
+	}
+}
+
+/*
+ * candidate_cmp
+ *
+ * Sorts candidates by descending frequency
+ */
+static int
+candidate_cmp(const void *a, const void *b)
+{
+	uint64_t f1 = ((Candidate *) a)->frequency;
+	uint64_t f2 = ((Candidate *) b)->frequency;
+
+	if (f1 > f2)
+		return -1;
+	if (f2 > f1)
+		return 1;
+	return 0;
+}
+
+/*
+ * entry_cmp
+ *
+ * Sorts heap entries by descending frequency
+ */
+static int
+entry_cmp(const void *a, const void *b)
+{
+	uint64_t f1 = ((CMSTopKEntry *) a)->frequency;
+	uint64_t f2 = ((CMSTopKEntry *) b)->frequency;
+
+	if (f1 > f2)
+		return -1;
+	if (f2 > f1)
+		return 1;
+	return 0;
+}
+
+CMSTopK *
+CMSTopKCreate(uint16_t k, TypeCacheEntry *typ)
+{
+	CountMinSketch *cms = CountMinSketchCreate();
+	CMSTopK template;
+	CMSTopK *topk;
+
+	MemSet(&template, 0, sizeof(CMSTopK));
+	template.k = k;
+	template.typoid = typ->type_id;
+	template.typlen = typ->typlen;
+	template.typbyval = typ->typbyval;
+	template.typalign = typ->typalign;
+	template.typtype = typ->typtype;
+
+	topk = build(&template, cms, NULL, 0);
+	CountMinSketchDestroy(cms);
+
+	return topk;
+}
+
+CMSTopK *
+CMSTopKCopy(CMSTopK *topk)
+{
+	Size size = CMSTopKSize(topk);
+	char *new = palloc(size);
+	memcpy(new, (char *) topk, size);
+	return (CMSTopK *) new;
+}
+
+/*
+ * CMSTopKAdd
+ *
+ * Adds count occurrences of the given value to the sketch, and updates its candidate
+ * entry with the sketch's new estimate. A value that isn't a candidate yet replaces
+ * the least frequent one if its estimate is higher.
+ */
+CMSTopK *
+CMSTopKAdd(CMSTopK *topk, Datum value, uint32_t count)
+{
+	CMSTopKEntry *heap = CMSTopKHeap(topk);
+	StringInfoData key;
+	uint32_t freq;
+	int slot = -1;
+	int i;
+
+	initStringInfo(&key);
+	get_key(topk, value, &key);
+
+	freq = CountMinSketchAdd(CMSTopKSketch(topk), key.data, key.len, count);
+
+	for (i = 0; i < topk->n; i++)
+	{
+		if (entry_matches(topk, &heap[i], key.data, key.len))
+		{
+			heap[i].frequency = freq;
+			sift_down(heap, topk->n, i);
+			pfree(key.data);
+			return topk;
+		}
+	}
+
+	if (topk->n < topk->k)
+		slot = topk->n;
+	else if (topk->k > 0 && freq > heap[0].frequency)
+		slot = 0;
+
+	/*
+	 * The new candidate's value is stored in a rebuilt copy, dropping the evicted value.
+	 * Once the heavy hitters have been seen this should be rare.
+	 */
+	if (slot >= 0)
+	{
+		int n = Max(topk->n, slot + 1);
+		Candidate *cands = palloc(sizeof(Candidate) * n);
+		CMSTopK *result;
+
+		for (i = 0; i < topk->n; i++)
+			entry_to_candidate(topk, &heap[i], &cands[i]);
+		datum_to_candidate(topk, value, &key, freq, &cands[slot]);
+
+		result = build(topk, CMSTopKSketch(topk), cands, n);
+		heap = CMSTopKHeap(result);
+
+		if (slot == 0)
+			sift_down(heap, n, 0);
+		else
+			sift_up(heap, slot);
+
+		pfree(cands);
+		topk = result;
+	}
+
+	pfree(key.data);
+
+	return topk;
+}
+
+/*
+ * CMSTopKMerge
+ *
+ * Merges the incoming sketch into the given one, and recomputes the heap from the union of
+ * both sets of candidates using the merged sketch's estimates
+ */
+CMSTopK *
+CMSTopKMerge(CMSTopK *topk, CMSTopK *incoming)
+{
+	CountMinSketch *cms = CMSTopKSketch(topk);
+	CMSTopKEntry *heap = CMSTopKHeap(topk);
+	CMSTopKEntry *inheap = CMSTopKHeap(incoming);
+	Candidate *cands;
+	CMSTopK *result;
+	int n = 0;
+	int i;
+	int j;
+
+	if (topk->typoid != incoming->typoid)
+		elog(ERROR, "cannot merge count-min sketch heavy hitters of different types");
+
+	CountMinSketchMerge(cms, CMSTopKSketch(incoming));
+
+	cands = palloc(sizeof(Candidate) * (topk->n + incoming->n));
+
+	for (i = 0; i < topk->n; i++)
+		entry_to_candidate(topk, &heap[i], &cands[n++]);
+
+	for (i = 0; i < incoming->n; i++)
+	{
+		char *key = ENTRY_KEY(incoming, &inheap[i]);
+
+		for (j = 0; j < topk->n; j++)
+		{
+			if (entry_matches(topk, &heap[j], key, inheap[i].keylen))
+				break;
+		}
+
+		if (j == topk->n)
+			entry_to_candidate(incoming, &inheap[i], &cands[n++]);
+	}
+
+	for (i = 0; i < n; i++)
+		cands[i].frequency = CountMinSketchEstimateFrequency(cms, cands[i].key, cands[i].keylen);
+
+	/* Ascending order is a valid min-heap */
+	qsort(cands, n, sizeof(Candidate), candidate_cmp);
+	n = Min(n, topk->k);
+
+	for (i = 0; i < n / 2; i++)
+	{
+		Candidate tmp = cands[i];
+		cands[i] = cands[n - i - 1];
+		cands[n - i - 1] = tmp;
+	}
+
+	result = build(topk, cms, cands, n);
+	pfree(cands);
+
+	return result;
+}
+
+/*
+ * CMSTopKValues
+ *
+ * Returns the candidates' values in descending order of estimated frequency
+ */
+Datum *
+CMSTopKValues(CMSTopK *topk, uint64_t **freqs, uint16_t *found)
+{
+	CMSTopKEntry *entries = palloc(sizeof(CMSTopKEntry) * Max(topk->n, 1));
+	Datum *values = palloc(sizeof(Datum) * Max(topk->n, 1));
+	int i;
+
+	memcpy(entries, CMSTopKHeap(topk), sizeof(CMSTopKEntry) * topk->n);
+	qsort(entries, topk->n, sizeof(CMSTopKEntry), entry_cmp);
+
+	if (freqs)
+		*freqs = palloc(sizeof(uint64_t) * Max(topk->n, 1));
+
+	for (i = 0; i < topk->n; i++)
+	{
+		values[i] = entry_value(topk, &entries[i]);
+		if (freqs)
+			(*freqs)[i] = entries[i].frequency;
+	}
+
+	*found = topk->n;
+	pfree(entries);
+
+	return values;
+}
+
+uint32_t
+CMSTopKEstimateFrequency(CMSTopK *topk, Datum value)
+{
+	StringInfoData key;
+	uint32_t result;
+
+	initStringInfo(&key);
+	get_key(topk, value, &key);
+	result = CountMinSketchEstimateFrequency(CMSTopKSketch(topk), key.data, key.len);
+	pfree(key.data);
+
+	return result;
+}
+
+Size
+CMSTopKSize(CMSTopK *topk)
+{
+	return VARSIZE(topk);
+}
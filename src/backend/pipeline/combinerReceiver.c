@@ -14,24 +14,81 @@
 #include "pgstat.h"
 
 #include "catalog/pg_type.h"
+#include "catalog/pipeline_query_fn.h"
 #include "access/htup_details.h"
 #include "access/printtup.h"
+#include "executor/executor.h"
+#include "executor/tstoreReceiver.h"
 #include "nodes/makefuncs.h"
 #include "parser/parse_type.h"
+#include "pipeline/bloom.h"
 #include "pipeline/combinerReceiver.h"
+#include "pipeline/cmsketch.h"
+#include "pipeline/cont_analyze.h"
 #include "pipeline/cont_execute.h"
+#include "pipeline/cont_plan.h"
+#include "pipeline/cont_scheduler.h"
+#include "pipeline/cqmatrel.h"
 #include "pipeline/miscutils.h"
 #include "pipeline/stream.h"
 #include "miscadmin.h"
 #include "storage/shm_alloc.h"
+#include "tcop/pquery.h"
+#include "utils/builtins.h"
 #include "utils/hashfuncs.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/portal.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
 
 #define MURMUR_SEED 0x155517D2
 
 CombinerReceiveFunc CombinerReceiveHook = NULL;
+CombinerBackend *CombinerBackendHook = NULL;
+
+/* whether CombinerBackendHook claims a query's partial results */
+typedef struct BackendClaim
+{
+	Oid query_id;
+	ContQuery *query;
+	bool claimed;
+} BackendClaim;
+
+/* claims are asked for once and kept until pipeline_query changes */
+static MemoryContext BackendClaimsCxt = NULL;
+static HTAB *backend_claims = NULL;
+static bool backend_claims_stale = false;
+
+/* guc parameters */
+int continuous_query_worker_partials_mem;
+int continuous_query_worker_partials_max_wait;
+int continuous_query_worker_hot_group_threshold;
+
+/*
+ * Partial results bound for a single combiner. They're serialized back to back in the layout that
+ * PartialTupleStateCopyFn produces, so that they can be written to the combiner's queue as is.
+ */
+typedef struct PartialsBuffer
+{
+	char *data;
+	Size len;
+	Size maxlen;
+	/* length of each serialized partial result, each of which starts at a MAXALIGN'd offset */
+	int *lens;
+	int n;
+	int maxn;
+} PartialsBuffer;
+
+#define PARTIALS_BUFFER_INITIAL_SIZE 8192
+#define PARTIALS_BUFFER_MAX_KEPT_SIZE (8 * 1024 * 1024)
+
+/* number of batches seen before any group is considered hot */
+#define HOT_GROUP_MIN_BATCHES 16
+/* number of batches after which hot group counts are halved, so that they follow changes in skew */
+#define HOT_GROUP_WINDOW 1024
 
 typedef struct
 {
@@ -41,16 +98,62 @@ typedef struct
 	FunctionCallInfo hash_fcinfo;
 	FuncExpr *hash;
 	int64 cv_name_hash;
-	List **partials;
+	PartialsBuffer *partials;
 	int ntups;
 	int nacks;
 	InsertBatchAck *acks;
+
+	/*
+	 * Partial results held across batches, already combined with each other so that each
+	 * group appears only once. They're sent to combiners once they exceed the memory budget
+	 * or have been held for too long.
+	 */
+	MemoryContext cxt;
+	MemoryContext held_cxt;
+	bool combine_checked;
+	PlannedStmt *combine_plan;
+	Tuplestorestate *combine_input;
+	TupleTableSlot *slot;
+	List *held;
+	Size held_bytes;
+	TimestampTz held_since;
+
+	/*
+	 * Hot groups are those that appeared in at least continuous_query_worker_hot_group_threshold
+	 * percent of recent batches. Their partial results are staged in hot and held even when
+	 * nothing else is, so that the combiner that owns them receives them combined across
+	 * batches rather than once per batch.
+	 */
+	CountMinSketch *hot_cms;
+	uint32 hot_batches;
+	PartialsBuffer hot;
+
+	/*
+	 * Copies of this batch's partial results for other views whose workers would have produced
+	 * exactly the same ones, each tagged with the other view's query id
+	 */
+	PartialsBuffer *tees;
+	int ntees;
 } CombinerState;
 
+static void send_partials(CombinerState *c);
+static void send_tees(CombinerState *c);
+static void release_held(CombinerState *c);
+static void release_hot(CombinerState *c);
+static bool init_combine(CombinerState *c);
+
 static void
 combiner_shutdown(DestReceiver *self)
 {
+	CombinerState *c = (CombinerState *) self;
 
+	/* don't lose anything we're still holding on to */
+	if (c->held || c->hot.n)
+	{
+		release_held(c);
+		release_hot(c);
+		send_partials(c);
+	}
 }
 
 static void
@@ -60,15 +163,310 @@ combiner_startup(DestReceiver *self, int operation,
 
 }
 
+/*
+ * stage_partial
+ *
+ * Reserves space for a serialized partial result with a tuple of the given length in the given buffer,
+ * filling in everything but the tuple's data. Returns where the tuple's HeapTupleHeader goes.
+ */
+static HeapTupleHeader
+stage_partial(CombinerState *c, PartialsBuffer *buf, uint64 hash, uint32 t_len, InsertBatchAck *acks, int nacks)
+{
+	int len = sizeof(PartialTupleState) + HEAPTUPLESIZE + t_len + (nacks * sizeof(InsertBatchAck));
+	Size start = MAXALIGN(buf->len);
+	PartialTupleState *pts;
+	HeapTuple tup;
+	char *pos;
+
+	if (start + len > buf->maxlen)
+	{
+		Size maxlen = Max(Max(buf->maxlen * 2, start + len), PARTIALS_BUFFER_INITIAL_SIZE);
+
+		if (buf->data)
+			buf->data = repalloc(buf->data, maxlen);
+		else
+			buf->data = MemoryContextAlloc(c->cxt, maxlen);
+		buf->maxlen = maxlen;
+	}
+
+	if (buf->n == buf->maxn)
+	{
+		int maxn = Max(buf->maxn * 2, 64);
+
+		if (buf->lens)
+			buf->lens = repalloc(buf->lens, sizeof(int) * maxn);
+		else
+			buf->lens = MemoryContextAlloc(c->cxt, sizeof(int) * maxn);
+		buf->maxn = maxn;
+	}
+
+	pts = (PartialTupleState *) (buf->data + start);
+	MemSet(pts, 0, sizeof(PartialTupleState));
+	pts->query_id = c->cont_query->id;
+	pts->hash = hash;
+	pts->nacks = nacks;
+	pts->insert_time = c->cont_exec->oldest_insert;
+	pts->arrival_time = c->cont_exec->newest_arrival;
+
+	pos = (char *) pts + sizeof(PartialTupleState);
+	pts->tup = ptr_difference(pts, pos);
+
+	tup = (HeapTuple) pos;
+	MemSet(tup, 0, HEAPTUPLESIZE);
+	tup->t_len = t_len;
+	ItemPointerSetInvalid(&tup->t_self);
+	tup->t_tableOid = InvalidOid;
+	pos += HEAPTUPLESIZE + t_len;
+
+	if (synchronous_stream_insert)
+	{
+		pts->acks = ptr_difference(pts, pos);
+		memcpy(pos, acks, sizeof(InsertBatchAck) * nacks);
+	}
+	else
+		pts->acks = NULL;
+
+	buf->lens[buf->n++] = len;
+	buf->len = start + len;
+
+	return (HeapTupleHeader) ((char *) tup + HEAPTUPLESIZE);
+}
+
+/*
+ * compact_values
+ *
+ * Returns the given values with any sketches replaced by their sparse forms where those are
+ * smaller, which combiners merge directly. A sketch built from a single batch usually has few
+ * counters or words set, so this keeps it from taking its full size in the combiner's queue.
+ */
+static Datum *
+compact_values(TupleDesc desc, Datum *values, bool *isnull)
+{
+	Datum *result = values;
+	int i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Oid type = desc->attrs[i]->atttypid;
+		struct varlena *state;
+		struct varlena *compact;
+
+		if (isnull[i] || (type != CMSKETCHOID && type != BLOOMOID))
+			continue;
+
+		state = PG_DETOAST_DATUM(values[i]);
+		if (type == CMSKETCHOID)
+			compact = (struct varlena *) CountMinSketchCompact((CountMinSketch *) state);
+		else
+			compact = (struct varlena *) BloomFilterCompact((BloomFilter *) state);
+
+		if (compact == state)
+			continue;
+
+		if (result == values)
+		{
+			result = palloc(sizeof(Datum) * desc->natts);
+			memcpy(result, values, sizeof(Datum) * desc->natts);
+		}
+
+		result[i] = PointerGetDatum(compact);
+	}
+
+	return result;
+}
+
+/*
+ * stage_slot
+ *
+ * Forms the slot's tuple directly into the given buffer, the same way heap_form_tuple would
+ */
+static void
+stage_slot(CombinerState *c, PartialsBuffer *buf, TupleTableSlot *slot, uint64 hash,
+		InsertBatchAck *acks, int nacks)
+{
+	TupleDesc desc = slot->tts_tupleDescriptor;
+	HeapTupleHeader td;
+	Datum *values;
+	Size data_len;
+	Size len;
+	int hoff;
+	bool hasnull = false;
+	int i;
+
+	slot_getallattrs(slot);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (slot->tts_isnull[i])
+		{
+			hasnull = true;
+			break;
+		}
+	}
+
+	values = compact_values(desc, slot->tts_values, slot->tts_isnull);
+
+	len = offsetof(HeapTupleHeaderData, t_bits);
+	if (hasnull)
+		len += BITMAPLEN(desc->natts);
+	if (desc->tdhasoid)
+		len += sizeof(Oid);
+
+	hoff = len = MAXALIGN(len);
+	data_len = heap_compute_data_size(desc, values, slot->tts_isnull);
+	len += data_len;
+
+	td = stage_partial(c, buf, hash, len, acks, nacks);
+	MemSet(td, 0, hoff);
+
+	HeapTupleHeaderSetDatumLength(td, len);
+	HeapTupleHeaderSetTypeId(td, desc->tdtypeid);
+	HeapTupleHeaderSetTypMod(td, desc->tdtypmod);
+	HeapTupleHeaderSetNatts(td, desc->natts);
+	td->t_hoff = hoff;
+
+	if (desc->tdhasoid)
+		td->t_infomask = HEAP_HASOID;
+
+	heap_fill_tuple(desc, values, slot->tts_isnull, (char *) td + hoff, data_len,
+			&td->t_infomask, (hasnull ? td->t_bits : NULL));
+
+	if (values != slot->tts_values)
+	{
+		for (i = 0; i < desc->natts; i++)
+		{
+			if (values[i] != slot->tts_values[i])
+				pfree(DatumGetPointer(values[i]));
+		}
+
+		pfree(values);
+	}
+}
+
+/*
+ * stage_tuple
+ *
+ * Copies the given tuple into the buffer of the combiner that reads the given group hash
+ */
+static void
+stage_tuple(CombinerState *c, HeapTuple tup, uint64 hash)
+{
+	HeapTupleHeader td = stage_partial(c, &c->partials[get_combiner_for_group_hash(hash)],
+			hash, tup->t_len, NULL, 0);
+	memcpy(td, tup->t_data, tup->t_len);
+}
+
+/*
+ * reset_partials
+ */
+static void
+reset_partials(PartialsBuffer *buf)
+{
+	buf->len = 0;
+	buf->n = 0;
+
+	/* buffers are reused across batches, but don't hold on to the memory used by an unusually large one */
+	if (buf->maxlen > PARTIALS_BUFFER_MAX_KEPT_SIZE)
+	{
+		pfree(buf->data);
+		buf->data = NULL;
+		buf->maxlen = 0;
+	}
+}
+
+/*
+ * get_staged_partial
+ *
+ * Returns the i-th partial result of the given buffer, which starts at *pos, pointing tup at its
+ * tuple and advancing *pos to the next partial result
+ */
+static PartialTupleState *
+get_staged_partial(PartialsBuffer *buf, int i, Size *pos, HeapTupleData *tup)
+{
+	PartialTupleState *pts = (PartialTupleState *) (buf->data + *pos);
+	HeapTuple stup = (HeapTuple) ptr_offset(pts, pts->tup);
+
+	tup->t_len = stup->t_len;
+	ItemPointerSetInvalid(&tup->t_self);
+	tup->t_tableOid = InvalidOid;
+	tup->t_data = (HeapTupleHeader) ((char *) stup + HEAPTUPLESIZE);
+
+	*pos = MAXALIGN(*pos + buf->lens[i]);
+
+	return pts;
+}
+
+/*
+ * is_hot_group
+ *
+ * Counts an appearance of the given group hash, returning true if the group has appeared in
+ * enough recent batches to be held regardless of whether other groups are. Workers aggregate
+ * each batch, so a group appears at most once per batch.
+ */
+static bool
+is_hot_group(CombinerState *c, uint64 hash)
+{
+	uint32 count;
+
+	if (continuous_query_worker_hot_group_threshold <= 0 || synchronous_stream_insert)
+		return false;
+
+	if (c->hot_cms == NULL)
+	{
+		MemoryContext old;
+
+		if (!init_combine(c))
+			return false;
+
+		old = MemoryContextSwitchTo(c->cxt);
+		c->hot_cms = CountMinSketchCreate();
+		MemoryContextSwitchTo(old);
+	}
+
+	count = CountMinSketchAdd(c->hot_cms, &hash, sizeof(uint64), 1);
+
+	if (c->hot_batches < HOT_GROUP_MIN_BATCHES)
+		return false;
+
+	return count * 100L >= (uint64) continuous_query_worker_hot_group_threshold * c->hot_batches;
+}
+
+/*
+ * count_hot_batch
+ *
+ * Counts the batch being flushed if it produced any partial results
+ */
+static void
+count_hot_batch(CombinerState *c)
+{
+	bool any = c->hot.n > 0;
+	int i;
+
+	if (c->hot_cms == NULL)
+		return;
+
+	for (i = 0; i < continuous_query_num_combiners && !any; i++)
+		any = c->partials[i].n > 0;
+
+	if (!any)
+		return;
+
+	if (++c->hot_batches < HOT_GROUP_WINDOW)
+		return;
+
+	for (i = 0; i < c->hot_cms->d * c->hot_cms->w; i++)
+		c->hot_cms->table[i] >>= 1;
+	c->hot_cms->count >>= 1;
+	c->hot_batches >>= 1;
+}
+
 static void
 combiner_receive(TupleTableSlot *slot, DestReceiver *self)
 {
 	CombinerState *c = (CombinerState *) self;
-	MemoryContext old = MemoryContextSwitchTo(ContQueryBatchContext);
-	PartialTupleState *pts = palloc0(sizeof(PartialTupleState));
 	InsertBatchAck *acks = NULL;
 	int nacks = 0;
-	int idx;
+	uint64 hash;
 
 	if (c->cont_query == NULL)
 		c->cont_query = c->cont_exec->current_query->query;
@@ -78,36 +476,66 @@ combiner_receive(TupleTableSlot *slot, DestReceiver *self)
 	if (synchronous_stream_insert)
 	{
 		if (c->acks == NULL)
+		{
+			MemoryContext old = MemoryContextSwitchTo(ContQueryBatchContext);
 			c->acks = InsertBatchAckCreate(c->cont_exec->yielded_msgs, &c->nacks);
+			MemoryContextSwitchTo(old);
+		}
 
 		c->ntups++;
 		acks = c->acks;
 		nacks = c->nacks;
 	}
 
-	pts->tup = ExecCopySlotTuple(slot);
-	pts->query_id = c->cont_query->id;
-	pts->nacks = nacks;
-	pts->acks = acks;
-
 	/* Shard by groups or id if no grouping. */
 	if (c->hash_fcinfo)
-		pts->hash = hash_group_for_combiner(slot, c->hash, c->hash_fcinfo);
+		hash = hash_group_for_combiner(slot, c->hash, c->hash_fcinfo);
 	else
-		pts->hash = c->cv_name_hash;
-
-	idx = get_combiner_for_group_hash(pts->hash);
-	c->partials[idx] = lappend(c->partials[idx], pts);
+		hash = c->cv_name_hash;
 
-	MemoryContextSwitchTo(old);
+	if (is_hot_group(c, hash))
+		stage_slot(c, &c->hot, slot, hash, acks, nacks);
+	else
+		stage_slot(c, &c->partials[get_combiner_for_group_hash(hash)], slot, hash, acks, nacks);
 }
 
 static void
 combiner_destroy(DestReceiver *self)
 {
 	CombinerState *c = (CombinerState *) self;
+	int i;
+
 	if (c->hash_fcinfo)
 		pfree(c->hash_fcinfo);
+
+	for (i = 0; i < continuous_query_num_combiners; i++)
+	{
+		if (c->partials[i].data)
+			pfree(c->partials[i].data);
+		if (c->partials[i].lens)
+			pfree(c->partials[i].lens);
+	}
+
+	if (c->hot.data)
+		pfree(c->hot.data);
+	if (c->hot.lens)
+		pfree(c->hot.lens);
+	if (c->hot_cms)
+		CountMinSketchDestroy(c->hot_cms);
+
+	if (c->tees)
+	{
+		for (i = 0; i < continuous_query_num_combiners; i++)
+		{
+			if (c->tees[i].data)
+				pfree(c->tees[i].data);
+			if (c->tees[i].lens)
+				pfree(c->tees[i].lens);
+		}
+
+		pfree(c->tees);
+	}
+
 	pfree(c->partials);
 	pfree(c);
 }
@@ -123,7 +551,8 @@ CreateCombinerDestReceiver(void)
 	self->pub.rDestroy = combiner_destroy;
 	self->pub.mydest = DestCombiner;
 
-	self->partials = palloc0(sizeof(List *) * continuous_query_num_combiners);
+	self->partials = palloc0(sizeof(PartialsBuffer) * continuous_query_num_combiners);
+	self->cxt = CurrentMemoryContext;
 
 	return (DestReceiver *) self;
 }
@@ -137,13 +566,26 @@ void
 SetCombinerDestReceiverParams(DestReceiver *self, ContExecutor *exec, ContQuery *query)
 {
 	CombinerState *c = (CombinerState *) self;
-	char *relname = get_rel_name(query->relid);
 
 	c->cont_exec = exec;
 	c->cont_query = query;
-	c->cv_name_hash = MurmurHash3_64(relname, strlen(relname), MURMUR_SEED);
+	c->cv_name_hash = GetCombinerNameHash(query);
+}
+
+/*
+ * GetCombinerNameHash
+ *
+ * Returns the hash determining which combiner reads the partial results of a query without groups
+ */
+uint64
+GetCombinerNameHash(ContQuery *query)
+{
+	char *relname = get_rel_name(query->relid);
+	uint64 hash = MurmurHash3_64(relname, strlen(relname), MURMUR_SEED);
 
 	pfree(relname);
+
+	return hash;
 }
 
 /*
@@ -170,77 +612,681 @@ SetCombinerDestReceiverHashFunc(DestReceiver *self, FuncExpr *hash)
 	c->hash = hash;
 }
 
-void
-CombinerDestReceiverFlush(DestReceiver *self)
+/*
+ * init_combine
+ *
+ * Prepares the plan used to combine held partial results with each other, which is the same one
+ * combiners use. Returns false if the query's partial results can't be combined by workers.
+ */
+static bool
+init_combine(CombinerState *c)
 {
-	CombinerState *c = (CombinerState *) self;
+	MemoryContext old;
+	PlannedStmt *plan;
+	TuplestoreScan *scan;
+	Relation rel;
+
+	if (c->combine_checked)
+		return c->combine_plan != NULL;
+
+	c->combine_checked = true;
+
+	old = MemoryContextSwitchTo(c->cxt);
+
+	plan = GetContPlan(c->cont_query, Combiner);
+
+	/* there is nothing to gain from holding on to the results of queries that don't aggregate */
+	if (!IsA(plan->planTree, Agg))
+	{
+		MemoryContextSwitchTo(old);
+		return false;
+	}
+
+	rel = heap_openrv(c->cont_query->matrel, AccessShareLock);
+
+	plan->isContinuous = false;
+	c->combine_input = tuplestore_begin_heap(false, false, continuous_query_combiner_work_mem);
+
+	scan = SetCombinerPlanTuplestorestate(plan, c->combine_input);
+	scan->desc = CreateTupleDescCopy(RelationGetDescr(rel));
+
+	c->slot = MakeSingleTupleTableSlot(scan->desc);
+	c->held_cxt = AllocSetContextCreate(c->cxt, "CombinerHeldPartialsCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	c->combine_plan = plan;
+
+	heap_close(rel, AccessShareLock);
+
+	MemoryContextSwitchTo(old);
+
+	return true;
+}
+
+/*
+ * combine_partials
+ *
+ * Combines this batch's partial results of hot groups, and those of all other groups if all is set,
+ * with the ones already held, replacing the held ones
+ */
+static void
+combine_partials(CombinerState *c, bool all)
+{
+	Tuplestorestate *output;
+	DestReceiver *dest;
+	Portal portal;
+	MemoryContext old;
+	ListCell *lc;
 	int i;
 
-	if (CombinerReceiveHook)
+	tuplestore_clear(c->combine_input);
+
+	foreach(lc, c->held)
+		tuplestore_puttuple(c->combine_input, (HeapTuple) lfirst(lc));
+
+	for (i = -1; i < (all ? continuous_query_num_combiners : 0); i++)
 	{
-		for (i = 0; i < continuous_query_num_combiners; i++)
+		PartialsBuffer *buf = i < 0 ? &c->hot : &c->partials[i];
+		Size pos = 0;
+		int j;
+
+		for (j = 0; j < buf->n; j++)
 		{
-			List *partials = c->partials[i];
-			ListCell *lc;
+			HeapTupleData tup;
 
-			if (partials == NIL)
-				continue;
+			get_staged_partial(buf, j, &pos, &tup);
+			tuplestore_puttuple(c->combine_input, &tup);
+		}
+
+		reset_partials(buf);
+	}
+
+	output = tuplestore_begin_heap(false, false, continuous_query_combiner_work_mem);
+
+	portal = CreatePortal("combine", true, true);
+	portal->visible = false;
+
+	PortalDefineQuery(portal,
+					  NULL,
+					  c->cont_query->matrel->relname,
+					  "SELECT",
+					  list_make1(c->combine_plan),
+					  NULL);
+
+	dest = CreateDestReceiver(DestTuplestore);
+	SetTuplestoreDestReceiverParams(dest, output, CurrentMemoryContext, true);
+
+	PortalStart(portal, NULL, EXEC_FLAG_COMBINE, NULL);
+
+	(void) PortalRun(portal,
+					 FETCH_ALL,
+					 true,
+					 dest,
+					 dest,
+					 NULL);
+
+	PortalDrop(portal, false);
+	(*dest->rDestroy) (dest);
+
+	/* the previously held tuples have all been copied into the combine input by now */
+	MemoryContextReset(c->held_cxt);
+	c->held = NIL;
+	c->held_bytes = 0;
+
+	old = MemoryContextSwitchTo(c->held_cxt);
+
+	foreach_tuple(c->slot, output)
+	{
+		HeapTuple tup = ExecCopySlotTuple(c->slot);
+
+		c->held = lappend(c->held, tup);
+		c->held_bytes += HEAPTUPLESIZE + tup->t_len;
+	}
+
+	MemoryContextSwitchTo(old);
+
+	ExecClearTuple(c->slot);
+	tuplestore_end(output);
+	tuplestore_clear(c->combine_input);
+}
+
+/*
+ * release_held
+ *
+ * Adds all held partial results to the partial results to send to combiners
+ */
+static void
+release_held(CombinerState *c)
+{
+	ListCell *lc;
 
-			foreach(lc, partials)
-			{
-				PartialTupleState *pts = (PartialTupleState *) lfirst(lc);
-				int len = (sizeof(PartialTupleState) +
-						HEAPTUPLESIZE + pts->tup->t_len +
-						(pts->nacks * sizeof(InsertBatchAck)));
+	if (c->held == NIL)
+		return;
 
-				CombinerReceiveHook(pts, len);
-			}
+	foreach(lc, c->held)
+	{
+		HeapTuple tup = (HeapTuple) lfirst(lc);
+		uint64 hash;
+
+		ExecStoreTuple(tup, c->slot, InvalidBuffer, false);
 
-			list_free_deep(partials);
-			c->partials[i] = NIL;
+		if (c->hash_fcinfo)
+			hash = hash_group_for_combiner(c->slot, c->hash, c->hash_fcinfo);
+		else
+			hash = c->cv_name_hash;
+
+		/* held states were combined from sparse ones into regular ones, so they're compacted again */
+		stage_slot(c, &c->partials[get_combiner_for_group_hash(hash)], c->slot, hash, NULL, 0);
+	}
+
+	ExecClearTuple(c->slot);
+
+	MemoryContextReset(c->held_cxt);
+	c->held = NIL;
+	c->held_bytes = 0;
+}
+
+/*
+ * release_hot
+ *
+ * Moves this batch's partial results of hot groups to the partial results to send to combiners
+ */
+static void
+release_hot(CombinerState *c)
+{
+	Size pos = 0;
+	int i;
+
+	for (i = 0; i < c->hot.n; i++)
+	{
+		HeapTupleData tup;
+		PartialTupleState *pts = get_staged_partial(&c->hot, i, &pos, &tup);
+
+		stage_tuple(c, &tup, pts->hash);
+	}
+
+	reset_partials(&c->hot);
+}
+
+/*
+ * hold_partials
+ *
+ * Holds on to this batch's partial results instead of sending them to combiners right away, combining
+ * them with any partial results held from previous batches. If workers don't hold partial results in
+ * general, only those of hot groups are held. Returns true if nothing needs to be sent yet.
+ */
+static bool
+hold_partials(CombinerState *c)
+{
+	bool any = false;
+	bool hold_all = continuous_query_worker_partials_mem > 0;
+	Size max_bytes;
+	int i;
+
+	for (i = 0; i < continuous_query_num_combiners; i++)
+	{
+		if (c->partials[i].n)
+		{
+			any = true;
+			break;
 		}
 	}
-	else
+
+	if (!any && c->hot.n == 0 && c->held == NIL)
+		return false;
+
+	/*
+	 * Synchronous inserts expect combiners to see their events as part of this batch, and so does
+	 * pipeline_flush for everything inserted before it was called
+	 */
+	if ((!hold_all && continuous_query_worker_hot_group_threshold <= 0) || c->acks ||
+			IsContQueryFlushPending() || !init_combine(c))
 	{
-		int ninserted = 0;
-		Size size = 0;
+		release_held(c);
+		release_hot(c);
+		return false;
+	}
 
-		for (i = 0; i < continuous_query_num_combiners; i++)
+	if (c->hot.n || (hold_all && any))
+	{
+		if (c->held == NIL)
+			c->held_since = GetCurrentTimestamp();
+
+		combine_partials(c, hold_all);
+	}
+
+	max_bytes = hold_all ? continuous_query_worker_partials_mem * 1024L :
+		continuous_query_combiner_work_mem * 1024L;
+
+	if (c->held_bytes < max_bytes &&
+			!TimestampDifferenceExceeds(c->held_since, GetCurrentTimestamp(),
+				continuous_query_worker_partials_max_wait))
+		return hold_all || !any;
+
+	release_held(c);
+
+	return false;
+}
+
+/*
+ * tee_buffer
+ *
+ * Copies all partial results of the given buffer into the tee buffers, tagged with the given query id
+ */
+static void
+tee_buffer(CombinerState *c, PartialsBuffer *buf, Oid query_id)
+{
+	Size pos = 0;
+	int i;
+
+	for (i = 0; i < buf->n; i++)
+	{
+		PartialTupleState *pts = (PartialTupleState *) (buf->data + pos);
+		PartialsBuffer *tee = &c->tees[get_combiner_for_group_hash(pts->hash)];
+		Size start = MAXALIGN(tee->len);
+		int len = buf->lens[i];
+
+		if (start + len > tee->maxlen)
 		{
-			List *partials = c->partials[i];
-			ListCell *lc;
-			ipc_queue *ipcq = NULL;
+			Size maxlen = Max(Max(tee->maxlen * 2, start + len), PARTIALS_BUFFER_INITIAL_SIZE);
 
-			if (partials == NIL)
-				continue;
+			if (tee->data)
+				tee->data = repalloc(tee->data, maxlen);
+			else
+				tee->data = MemoryContextAlloc(c->cxt, maxlen);
+			tee->maxlen = maxlen;
+		}
+
+		if (tee->n == tee->maxn)
+		{
+			int maxn = Max(tee->maxn * 2, 64);
+
+			if (tee->lens)
+				tee->lens = repalloc(tee->lens, sizeof(int) * maxn);
+			else
+				tee->lens = MemoryContextAlloc(c->cxt, sizeof(int) * maxn);
+			tee->maxn = maxn;
+		}
+
+		/* serialized partial results only contain relative pointers, so they can be copied as is */
+		memcpy(tee->data + start, pts, len);
+		((PartialTupleState *) (tee->data + start))->query_id = query_id;
 
-			foreach(lc, partials)
-			{
-				PartialTupleState *pts = (PartialTupleState *) lfirst(lc);
-				int len = (sizeof(PartialTupleState) +
-						HEAPTUPLESIZE + pts->tup->t_len +
-						(pts->nacks * sizeof(InsertBatchAck)));
+		tee->lens[tee->n++] = len;
+		tee->len = start + len;
 
-				if (ipcq == NULL)
-					ipcq = get_combiner_queue_with_lock(get_combiner_for_group_hash(pts->hash));
+		pos = MAXALIGN(pos + len);
+	}
+}
 
-				Assert(ipcq);
-				ipc_queue_push_nolock(ipcq, pts, len, true);
+/*
+ * CombinerDestReceiverTee
+ *
+ * Also sends the partial results of the batch being flushed to the given query, whose workers would
+ * have produced exactly the same ones. Must be called before flushing, and only for grouped views.
+ */
+void
+CombinerDestReceiverTee(DestReceiver *self, Oid query_id)
+{
+	CombinerState *c = (CombinerState *) self;
+	int i;
 
-				size += len;
-				ninserted++;
-			}
+	Assert(c->hash_fcinfo);
 
+	if (c->tees == NULL)
+		c->tees = MemoryContextAllocZero(c->cxt, sizeof(PartialsBuffer) * continuous_query_num_combiners);
+
+	for (i = 0; i < continuous_query_num_combiners; i++)
+		tee_buffer(c, &c->partials[i], query_id);
+	tee_buffer(c, &c->hot, query_id);
+
+	c->ntees++;
+}
+
+/*
+ * CombinerDestReceiverHasHeldPartials
+ */
+bool
+CombinerDestReceiverHasHeldPartials(DestReceiver *self)
+{
+	CombinerState *c = (CombinerState *) self;
+
+	return c->held != NIL;
+}
+
+void
+CombinerDestReceiverFlush(DestReceiver *self)
+{
+	CombinerState *c = (CombinerState *) self;
+
+	if (c->ntees)
+		send_tees(c);
+
+	count_hot_batch(c);
+
+	if (hold_partials(c))
+		return;
+
+	send_partials(c);
+}
+
+/*
+ * set_partial_names
+ *
+ * Fills in the names of the continuous view the given partial result belongs to, which is how a combiner
+ * on another node resolves it to its own copy of the view
+ */
+static void
+set_partial_names(PartialTupleState *pts)
+{
+	static Oid query_id = InvalidOid;
+	static NameData cv;
+	static NameData namespace;
+
+	if (pts->query_id != query_id)
+	{
+		ContQuery *query = GetContQueryForId(pts->query_id);
+
+		if (!query)
+			elog(ERROR, "continuous query with id %d not found", pts->query_id);
+
+		namestrcpy(&cv, query->name->relname);
+		namestrcpy(&namespace, query->name->schemaname);
+		query_id = pts->query_id;
+	}
+
+	pts->cv = cv;
+	pts->namespace = namespace;
+}
+
+/*
+ * forward_partial
+ *
+ * Offers a partial result to CombinerReceiveHook, which may take it to send it to a combiner on another node,
+ * e.g. one owning its group's hash range. Partials the hook doesn't take are left as they were, for this
+ * node's combiners.
+ */
+static bool
+forward_partial(PartialTupleState *pts, int len)
+{
+	bool taken;
+
+	set_partial_names(pts);
+
+	/* the hook expects a PartialTupleState with its pointers set */
+	PartialTupleStatePeekFn(pts, len);
+	taken = CombinerReceiveHook(pts, len);
+
+	if (!taken)
+	{
+		pts->acks = ptr_difference(pts, pts->acks);
+		pts->tup = ptr_difference(pts, pts->tup);
+	}
+
+	return taken;
+}
+
+/*
+ * backend_claims_callback
+ *
+ * Claims are only forgotten before the next push, since invalidations may be processed while one is in progress
+ */
+static void
+backend_claims_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	backend_claims_stale = true;
+}
+
+/*
+ * get_backend_claim
+ */
+static BackendClaim *
+get_backend_claim(Oid query_id)
+{
+	BackendClaim *claim;
+	MemoryContext old;
+	ContQuery *query;
+	bool claimed;
+
+	if (backend_claims == NULL)
+	{
+		HASHCTL ctl;
+
+		if (BackendClaimsCxt == NULL)
+		{
+			BackendClaimsCxt = AllocSetContextCreate(TopMemoryContext, "CombinerBackendClaimsCxt",
+					ALLOCSET_SMALL_MINSIZE,
+					ALLOCSET_SMALL_INITSIZE,
+					ALLOCSET_SMALL_MAXSIZE);
+			CacheRegisterSyscacheCallback(PIPELINEQUERYID, backend_claims_callback, (Datum) 0);
+		}
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(BackendClaim);
+		ctl.hcxt = BackendClaimsCxt;
+
+		backend_claims = hash_create("CombinerBackendClaims", 32, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	claim = (BackendClaim *) hash_search(backend_claims, &query_id, HASH_FIND, NULL);
+	if (claim)
+		return claim;
+
+	/* the claim is only entered once it's been made, in case the backend fails to make it */
+	old = MemoryContextSwitchTo(BackendClaimsCxt);
+	query = GetContQueryForId(query_id);
+	MemoryContextSwitchTo(old);
+
+	if (!query)
+		elog(ERROR, "continuous query with id %d not found", query_id);
+
+	claimed = CombinerBackendHook->claims(query);
+
+	claim = (BackendClaim *) hash_search(backend_claims, &query_id, HASH_ENTER, NULL);
+	claim->query = query;
+	claim->claimed = claimed;
+
+	return claim;
+}
+
+/*
+ * backend_receive
+ *
+ * Hands a partial result to CombinerBackendHook if it claims the partial's query, starting a batch for the
+ * query first if this is its first partial of the push. Returns true if the partial was handed over.
+ */
+static bool
+backend_receive(PartialTupleState *pts, int len, List **batches)
+{
+	BackendClaim *claim = get_backend_claim(pts->query_id);
+
+	if (!claim->claimed)
+		return false;
+
+	if (!list_member_ptr(*batches, claim))
+	{
+		if (CombinerBackendHook->begin_batch)
+			CombinerBackendHook->begin_batch(claim->query);
+		*batches = lappend(*batches, claim);
+	}
+
+	set_partial_names(pts);
+	PartialTupleStatePeekFn(pts, len);
+	CombinerBackendHook->receive(claim->query, pts, len);
+
+	return true;
+}
+
+/*
+ * GetCombinerBackendInfo
+ *
+ * Returns the metadata a combiner backend needs to combine the given view's partial results, allocated in the
+ * current memory context
+ */
+CombinerBackendInfo *
+GetCombinerBackendInfo(ContQuery *query)
+{
+	CombinerBackendInfo *info = palloc0(sizeof(CombinerBackendInfo));
+	Relation matrel;
+	ResultRelInfo *ri;
+
+	Assert(query->type == CONT_VIEW);
+
+	matrel = heap_openrv(query->matrel, AccessShareLock);
+	ri = CQMatRelOpen(matrel);
+
+	info->desc = CreateTupleDescCopy(RelationGetDescr(matrel));
+	info->hashfunc = GetGroupHashIndexExpr(ri);
+
+	CQMatRelClose(ri);
+	heap_close(matrel, AccessShareLock);
+
+	info->combine_query = GetContCombinerQuery(query->name);
+	info->combine_plan = GetContPlan(query, Combiner);
+
+	return info;
+}
+
+/*
+ * push_partials
+ *
+ * Writes the given per-combiner buffers to combiners, resetting them. Partials of queries claimed by
+ * CombinerBackendHook go to it instead, as one batch per query.
+ */
+static void
+push_partials(PartialsBuffer *bufs)
+{
+	List *batches = NIL;
+	ListCell *lc;
+	int ninserted = 0;
+	Size size = 0;
+	int i;
+
+	if (backend_claims_stale)
+	{
+		MemoryContextReset(BackendClaimsCxt);
+		backend_claims = NULL;
+		backend_claims_stale = false;
+	}
+
+	for (i = 0; i < continuous_query_num_combiners; i++)
+	{
+		PartialsBuffer *buf = &bufs[i];
+		ipc_queue *ipcq;
+		void **ptrs;
+		Size pos = 0;
+		int n = 0;
+		int j;
+
+		if (buf->n == 0)
+			continue;
+
+		ptrs = palloc(sizeof(void *) * buf->n);
+		for (j = 0; j < buf->n; j++)
+		{
+			PartialTupleState *pts = (PartialTupleState *) (buf->data + pos);
+			int len = buf->lens[j];
+
+			pos = MAXALIGN(pos + len);
+
+			if (CombinerBackendHook && backend_receive(pts, len, &batches))
+				continue;
+
+			if (CombinerReceiveHook && forward_partial(pts, len))
+				continue;
+
+			/* lens is compacted in place, since we never write past the partial we're reading */
+			ptrs[n] = pts;
+			buf->lens[n++] = len;
+			size += len;
+		}
+
+		if (n)
+		{
+			ipcq = get_combiner_queue_with_lock(i);
 			Assert(ipcq);
+
+			ipc_queue_push_serialized_nolock(ipcq, ptrs, buf->lens, n, true);
 			ipc_queue_unlock(ipcq);
 
-			list_free_deep(partials);
-			c->partials[i] = NIL;
+			ninserted += n;
 		}
 
-		pgstat_increment_cq_write(ninserted, size);
+		pfree(ptrs);
+		reset_partials(buf);
 	}
 
+	foreach(lc, batches)
+	{
+		BackendClaim *claim = (BackendClaim *) lfirst(lc);
+
+		if (CombinerBackendHook->flush)
+			CombinerBackendHook->flush(claim->query);
+	}
+	list_free(batches);
+
+	pgstat_increment_cq_write(ninserted, size);
+}
+
+/*
+ * CombinerReceivePartial
+ *
+ * Pushes a partial result received from another node onto the queue of this node's combiner owning its group.
+ * It's resolved to this node's copy of its continuous view by name, and its acks are dropped since they only
+ * mean something on the node that computed it.
+ */
+void
+CombinerReceivePartial(PartialTupleState *pts)
+{
+	PartialTupleState hdr = *pts;
+	ipc_queue *ipcq;
+	int len;
+
+	Assert(strlen(NameStr(pts->cv)));
+	Assert(strlen(NameStr(pts->namespace)));
+
+	hdr.query_id = InvalidOid;
+	hdr.nacks = 0;
+	len = sizeof(PartialTupleState) + HEAPTUPLESIZE + pts->tup->t_len;
+
+	ipcq = get_combiner_queue_with_lock(get_combiner_for_group_hash(pts->hash));
+	Assert(ipcq);
+
+	ipc_queue_push_nolock(ipcq, &hdr, len, true);
+	ipc_queue_unlock(ipcq);
+
+	pgstat_increment_cq_write(1, len);
+}
+
+/*
+ * send_tees
+ *
+ * Sends the copies of this batch's partial results made for other views. With synchronous inserts,
+ * each copy is acked by combiners just like the original.
+ */
+static void
+send_tees(CombinerState *c)
+{
+	int i;
+
+	push_partials(c->tees);
+
+	for (i = 0; i < c->nacks; i++)
+		InsertBatchIncrementNumCTuples(c->acks[i].batch, c->ntups * c->ntees);
+
+	c->ntees = 0;
+}
+
+/*
+ * send_partials
+ */
+static void
+send_partials(CombinerState *c)
+{
+	push_partials(c->partials);
+
 	if (c->acks)
 	{
 		int i;
@@ -26,6 +26,7 @@
 #include "catalog/pipeline_query.h"
 #include "catalog/pipeline_query_fn.h"
 #include "catalog/pipeline_stream_fn.h"
+#include "commands/defrem.h"
 #include "commands/pipelinecmds.h"
 #include "executor/executor.h"
 #include "lib/stringinfo.h"
@@ -909,6 +910,117 @@ validate_target_list(SelectStmt *stmt)
 	}
 }
 
+/*
+ * validate_stream_join
+ *
+ * Stream-stream joins buffer each stream's events in the workers, which tell the two streams' events
+ * apart by the stream they were written to, so they must join two different typed streams
+ */
+static void
+validate_stream_join(RangeVar *name, SelectStmt *select, ContAnalyzeContext *context)
+{
+	ListCell *lc;
+	Oid relids[2];
+	int i = 0;
+
+	if (list_length(context->streams) != 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("\"join_window\" requires a JOIN of exactly two streams")));
+
+	foreach(lc, context->streams)
+	{
+		RangeVar *rv = (RangeVar *) lfirst(lc);
+		bool is_inferred;
+
+		RangeVarIsForStream(rv, &is_inferred);
+		if (is_inferred)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("stream-stream JOINs require typed streams"),
+					errhint("Create \"%s\" with CREATE STREAM.", rv->relname),
+					parser_errposition(context->pstate, rv->location)));
+
+		if (equal(rv, name))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("continuous queries cannot read from themselves"),
+					errhint("Remove \"%s\" from the FROM clause.", rv->relname),
+					parser_errposition(context->pstate, rv->location)));
+
+		relids[i++] = RangeVarGetRelid(rv, NoLock, false);
+	}
+
+	if (relids[0] == relids[1])
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("stream-stream JOINs cannot join a stream with itself")));
+
+	if (has_clock_timestamp(select->whereClause, NULL))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("stream-stream JOINs are not supported for sliding window queries")));
+
+	if (select->dedupKey)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("\"dedup_key\" cannot be combined with \"join_window\"")));
+}
+
+/*
+ * validate_stream_union
+ *
+ * Each branch of a UNION ALL read by a continuous query must be a valid continuous query of its own.
+ * Workers tell the streams' events apart by the stream they were written to, so each branch must read
+ * a different typed stream.
+ */
+static void
+validate_stream_union(RangeVar *name, SelectStmt *select, const char *sql, List **relids)
+{
+	ContAnalyzeContext *context;
+	ListCell *lc;
+
+	if (select->op != SETOP_NONE)
+	{
+		if (select->op != SETOP_UNION || !select->all)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("continuous queries only support UNION ALL set operations")));
+
+		validate_stream_union(name, select->larg, sql, relids);
+		validate_stream_union(name, select->rarg, sql, relids);
+		return;
+	}
+
+	ValidateSubselect((Node *) select, "UNION ALL branches in continuous views");
+	ValidateParsedContQuery(name, (Node *) select, sql);
+
+	context = MakeContAnalyzeContext(make_parsestate(NULL), select, Worker);
+	collect_rels_and_streams((Node *) select->fromClause, context);
+
+	foreach(lc, context->streams)
+	{
+		RangeVar *rv = (RangeVar *) lfirst(lc);
+		bool is_inferred;
+		Oid relid;
+
+		RangeVarIsForStream(rv, &is_inferred);
+		if (is_inferred)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("UNION ALLs of streams require typed streams"),
+					errhint("Create \"%s\" with CREATE STREAM.", rv->relname)));
+
+		relid = RangeVarGetRelid(rv, NoLock, false);
+		if (list_member_oid(*relids, relid))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("stream \"%s\" is read by more than one branch of the UNION ALL", rv->relname)));
+
+		*relids = lappend_oid(*relids, relid);
+	}
+}
+
 /*
  * ValidateParsedContQuery
  */
@@ -952,8 +1064,21 @@ ValidateParsedContQuery(RangeVar *name, Node *node, const char *sql)
 	{
 		RangeSubselect *sub = (RangeSubselect *) linitial(select->fromClause);
 
+		if (select->joinWindow)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("stream-stream JOINs are not supported in subqueries")));
+
 		ValidateSubselect(sub->subquery, "subqueries in continuous views");
-		ValidateParsedContQuery(name, sub->subquery, sql);
+
+		if (IsA(sub->subquery, SelectStmt) && ((SelectStmt *) sub->subquery)->op != SETOP_NONE)
+		{
+			List *relids = NIL;
+
+			validate_stream_union(name, (SelectStmt *) sub->subquery, sql, &relids);
+		}
+		else
+			ValidateParsedContQuery(name, sub->subquery, sql);
 		return;
 	}
 
@@ -988,8 +1113,10 @@ ValidateParsedContQuery(RangeVar *name, Node *node, const char *sql)
 							errmsg("continuous queries must include a stream in the FROM clause")));
 	}
 
-	/* Ensure we're reading from at most one stream */
-	if (list_length(context->streams) > 1)
+	/* Ensure we're reading from at most one stream, unless it's a windowed stream-stream join */
+	if (select->joinWindow)
+		validate_stream_join(name, select, context);
+	else if (list_length(context->streams) > 1)
 	{
 		RangeVar *rv = (RangeVar *) lsecond(context->streams);
 		ereport(ERROR,
@@ -2120,6 +2247,46 @@ hoist_node(List **target_list, Node *node, ContAnalyzeContext *context)
 	return create_colref_for_res_target(rt);
 }
 
+/*
+ * Collects the distinct expressions grouped by in the given grouping set and all of its nested sets
+ */
+static void
+collect_grouping_set_exprs(Node *node, List **exprs)
+{
+	ListCell *lc;
+
+	if (!IsA(node, GroupingSet))
+	{
+		*exprs = list_append_unique(*exprs, node);
+		return;
+	}
+
+	foreach(lc, ((GroupingSet *) node)->content)
+		collect_grouping_set_exprs((Node *) lfirst(lc), exprs);
+}
+
+/*
+ * Returns a copy of the given grouping set with each of its expressions replaced by a column
+ * reference to its hoisted target list entry
+ */
+static Node *
+hoist_grouping_set(List **target_list, Node *node, ContAnalyzeContext *context)
+{
+	GroupingSet *gs;
+	List *content = NIL;
+	ListCell *lc;
+
+	if (!IsA(node, GroupingSet))
+		return (Node *) hoist_node(target_list, node, context);
+
+	gs = (GroupingSet *) copyObject(node);
+	foreach(lc, gs->content)
+		content = lappend(content, hoist_grouping_set(target_list, (Node *) lfirst(lc), context));
+	gs->content = content;
+
+	return (Node *) gs;
+}
+
 static Node *
 create_agg_node_for_view_overlay(ColumnRef *cref, FuncCall *workeragg, ContAnalyzeContext *context)
 {
@@ -2475,7 +2642,19 @@ TransformSelectStmtForContProcess(RangeVar *mat_relation, SelectStmt *stmt, Sele
 	context->view_combines = (list_length(context->windows) ||
 			(context->is_sw && (list_length(context->funcs) || list_length(stmt->groupClause))));
 
-	if (context->is_sw || context->view_combines)
+	/*
+	 * Delta-merge views store several partial rows per group, which the view combines on read.
+	 */
+	if (stmt->deltaMerge && (list_length(context->funcs) || list_length(stmt->groupClause)))
+		context->view_combines = true;
+
+	/*
+	 * So do lazy_grouping_sets views, which store only their finest grouping set.
+	 */
+	if (stmt->lazyGroupingSets)
+		context->view_combines = true;
+
+	if (context->is_sw || list_length(context->windows))
 		proj_and_group_for_windows(proc, view, context);
 
 	/*
@@ -2494,6 +2673,31 @@ TransformSelectStmtForContProcess(RangeVar *mat_relation, SelectStmt *stmt, Sele
 		List *nodes;
 		ListCell *glc;
 
+		/*
+		 * Views with lazy_grouping_sets only maintain their finest grouping set, which groups by
+		 * every expression of every set. The overlay view derives the actual sets from its rows.
+		 */
+		if (IsA(group_node, GroupingSet) && proc->lazyGroupingSets)
+		{
+			nodes = NIL;
+			collect_grouping_set_exprs(group_node, &nodes);
+
+			foreach(glc, nodes)
+			{
+				Node *node = (Node *) lfirst(glc);
+				ColumnRef *cref = hoist_node(&proc->targetList, node, context);
+
+				if (proc_type == Combiner)
+					tmp_list = list_append_unique(tmp_list, cref);
+				else
+					tmp_list = list_append_unique(tmp_list, node);
+			}
+
+			view->groupClause = lappend(view->groupClause,
+					hoist_grouping_set(&proc->targetList, group_node, context));
+			continue;
+		}
+
 		if (IsA(group_node, GroupingSet))
 			nodes = ((GroupingSet *) group_node)->content;
 		else
@@ -2763,6 +2967,8 @@ get_cont_query_select_stmt(RangeVar *rv)
 	sql = deparse_query_def(query);
 	select = (SelectStmt *) linitial(pg_parse_query(sql));
 	select->swStepFactor = query->swStepFactor;
+	select->deltaMerge = query->deltaMerge;
+	select->lazyGroupingSets = query->lazyGroupingSets;
 
 	ReleaseSysCache(tup);
 
@@ -2821,1192 +3027,2354 @@ GetContCombinerQuery(RangeVar *rv)
 }
 
 /*
- * attr_to_agg
- *
- * Given a matrel attribute, returns the aggregate node that it corresponds to
+ * Rollup rewriting state. A rollup's target expressions may only reference its source view's grouping
+ * columns, which are either replaced by the source view's expressions for them or by references to
+ * the source view's matrel columns holding them.
  */
-static Node *
-attr_to_aggs(AttrNumber attr, List *tlist)
+typedef struct RollupContext
 {
-	TargetEntry *te;
-	List *l;
-	Node *n;
-
-	Assert(list_length(tlist) >= attr);
-
-	te = list_nth(tlist, attr - 1);
-	l = pull_var_and_aggs((Node *) te);
-
-	Assert(list_length(l) == 1);
-
-	n = linitial(l);
-
-	Assert(IsA(n, Aggref) || IsA(n, WindowFunc));
-
-	return n;
-}
+	RangeVar *source;
+	List *columns;
+	List *aggs;
+	bool matrel;
+} RollupContext;
 
 /*
- * make_combine_args
- *
- * Possibly wraps the target argument in a recv function call to deserialize
- * hidden state before calling combine()
+ * find_rollup_column
  */
-static List *
-make_combine_args(ParseState *pstate, Oid combineinfn, Node *arg)
+static ResTarget *
+find_rollup_column(RollupContext *context, ColumnRef *cref, bool agg)
 {
-	List *args;
+	Node *field = (Node *) llast(cref->fields);
+	ListCell *lc;
 
-	if (OidIsValid(combineinfn))
+	if (!IsA(field, String))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("rollups must select their columns explicitly")));
+
+	foreach(lc, agg ? context->aggs : context->columns)
 	{
-		FuncCall *fn = makeNode(FuncCall);
-		fn->funcname = list_make1(makeString(get_func_name(combineinfn)));
-		fn->args = list_make1(arg);
-		args = list_make1(transformFuncCall(pstate, fn));
+		ResTarget *res = (ResTarget *) lfirst(lc);
+
+		if (strcmp(res->name, strVal(field)) == 0)
+			return res;
 	}
-	else
+
+	foreach(lc, agg ? context->columns : context->aggs)
 	{
-		/* transition state is stored as a first-class type, no deserialization needed */
-		args = list_make1(arg);
+		ResTarget *res = (ResTarget *) lfirst(lc);
+
+		if (strcmp(res->name, strVal(field)) != 0)
+			continue;
+
+		if (agg)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("only aggregate columns of \"%s\" can be combined", context->source->relname),
+					 errhint("Grouping columns such as \"%s\" can be used in the rollup's GROUP BY clause.",
+							 strVal(field))));
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_GROUPING_ERROR),
+					 errmsg("aggregate column \"%s\" of \"%s\" must be combined", strVal(field),
+							 context->source->relname),
+					 errhint("For example, ... SELECT combine(%s) FROM %s ...", strVal(field),
+							 context->source->relname)));
 	}
 
-	return args;
+	ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_COLUMN),
+			 errmsg("column \"%s\" of \"%s\" does not exist", strVal(field), context->source->relname)));
+
+	return NULL;
 }
 
 /*
- * extract_agg_final_info
+ * rollup_expr_mutator
  *
- * Given an Aggref or WindowFunc, extracts its aggregate function, output type,
- * and final type
+ * Returns a copy of the given raw expression with its column references resolved against the
+ * rollup's source view
  */
-static void
-extract_agg_final_info(Node *n, Oid *aggfn, Oid *type, Oid *finaltype)
+static Node *
+rollup_expr_mutator(Node *node, RollupContext *context)
 {
-	if (IsA(n, Aggref))
-	{
-		Aggref *agg = (Aggref *) n;
-		*aggfn = agg->aggfnoid;
-		*type = agg->aggtype;
-		*finaltype = agg->aggfinaltype;
-	}
-	else if (IsA(n, WindowFunc))
+	if (node == NULL)
+		return NULL;
+
+	switch (nodeTag(node))
 	{
-		WindowFunc *wfunc = (WindowFunc *) n;
-		*aggfn = wfunc->winfnoid;
-		*type = wfunc->wintype;
-		*finaltype = wfunc->winfinaltype;
-	}
-}
+		case T_ColumnRef:
+		{
+			ResTarget *res = find_rollup_column(context, (ColumnRef *) node, false);
+			ColumnRef *cref;
 
-static Query *
-get_worker_query_for_id(Oid id)
-{
-	HeapTuple tup;
-	bool isnull;
-	Datum tmp;
-	char *sql;
-	Query *query;
-	SelectStmt *sel;
-	RangeVar *matrel;
-	Form_pipeline_query row;
+			if (!context->matrel)
+				return copyObject(res->val);
 
-	tup = SearchSysCache1(PIPELINEQUERYID, ObjectIdGetDatum(id));
+			/* grouping columns are stored in matrel columns of the same name */
+			cref = makeNode(ColumnRef);
+			cref->fields = list_make1(makeString(pstrdup(res->name)));
+			cref->location = -1;
 
-	if (!HeapTupleIsValid(tup))
-		ereport(ERROR,
-				(errcode(ERRCODE_UNDEFINED_CONTINUOUS_VIEW),
-				errmsg("continuous view with id \"%d\" does not exist", id)));
+			return (Node *) cref;
+		}
+		case T_A_Const:
+		case T_ParamRef:
+			return copyObject(node);
+		case T_List:
+		{
+			List *result = NIL;
+			ListCell *lc;
 
-	tmp = SysCacheGetAttr(PIPELINEQUERYRELID, tup, Anum_pipeline_query_query, &isnull);
-	query = (Query *) stringToNode(TextDatumGetCString(tmp));
+			foreach(lc, (List *) node)
+				result = lappend(result, rollup_expr_mutator((Node *) lfirst(lc), context));
 
-	sql = deparse_query_def(query);
-	sel = (SelectStmt *) linitial(pg_parse_query(sql));
-	sel->swStepFactor = query->swStepFactor;
+			return (Node *) result;
+		}
+		case T_A_Expr:
+		{
+			A_Expr *expr = (A_Expr *) copyObject(node);
 
-	row = (Form_pipeline_query) GETSTRUCT(tup);
-	matrel = makeRangeVar(get_namespace_name(get_rel_namespace(row->matrelid)), get_rel_name(row->matrelid), -1);
+			expr->lexpr = rollup_expr_mutator(((A_Expr *) node)->lexpr, context);
+			expr->rexpr = rollup_expr_mutator(((A_Expr *) node)->rexpr, context);
 
-	ReleaseSysCache(tup);
+			return (Node *) expr;
+		}
+		case T_FuncCall:
+		{
+			FuncCall *func = (FuncCall *) copyObject(node);
 
-	sel = TransformSelectStmtForContProcess(matrel, sel, NULL, Worker);
-	return parse_analyze((Node *) sel, "SELECT", 0, 0);
-}
+			if (func->agg_order || func->agg_filter || func->over)
+				break;
 
-/*
- * make_combine_agg_for_viewdef
- *
- * Creates a combine aggregate for a view definition against a matrel
- */
-static Node *
-make_combine_agg_for_viewdef(ParseState *pstate, Oid cvid, Var *var,
-		 List *order, WindowDef *over)
-{
-	List *args;
-	Node *result;
-	Oid fnoid = InvalidOid;
-	Oid combinefn;
-	Oid transoutfn;
-	Oid combineinfn;
-	Oid type = InvalidOid;
-	Oid finaltype = InvalidOid;
-	Oid statetype;
-	Oid aggtype;
-	Query *q = get_worker_query_for_id(cvid);
+			func->args = (List *) rollup_expr_mutator((Node *) ((FuncCall *) node)->args, context);
 
-	Assert(!IsContQueryWorkerProcess());
+			return (Node *) func;
+		}
+		case T_TypeCast:
+		{
+			TypeCast *tc = (TypeCast *) copyObject(node);
 
-	result = attr_to_aggs(var->varattno, q->targetList);
+			tc->arg = rollup_expr_mutator(((TypeCast *) node)->arg, context);
 
-	extract_agg_final_info(result, &fnoid, &type, &finaltype);
-	GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
+			return (Node *) tc;
+		}
+		case T_BoolExpr:
+		{
+			BoolExpr *expr = (BoolExpr *) copyObject(node);
 
-	aggtype = OidIsValid(statetype) ? statetype : finaltype;
+			expr->args = (List *) rollup_expr_mutator((Node *) ((BoolExpr *) node)->args, context);
 
-	if (IsA(result, Aggref))
-	{
-		Aggref *agg = (Aggref *) result;
-
-		/*
-		 * Since we call attr_to_aggs on the target list of the worker plan, we'll see Aggrefs
-		 * instead of WindowFuncs. Force such cases into WindowFuncs.
-		 */
-		if (over)
+			return (Node *) expr;
+		}
+		case T_NullTest:
 		{
-			WindowFunc *win = makeNode(WindowFunc);
+			NullTest *test = (NullTest *) copyObject(node);
 
-			win->winfnoid = agg->aggfnoid;
-			win->winaggkind = AGGKIND_COMBINE;
-			win->wintype = aggtype;
-			win->winagg = true;
-			win->winstar = false;
+			test->arg = (Expr *) rollup_expr_mutator((Node *) ((NullTest *) node)->arg, context);
 
-			result = (Node *) win;
+			return (Node *) test;
 		}
-		else
+		case T_CoalesceExpr:
 		{
-			agg->aggkind = AGGKIND_COMBINE;
-			agg->aggfilter = NULL;
-			agg->aggtype = aggtype;
-			agg->aggstar = false;
+			CoalesceExpr *expr = (CoalesceExpr *) copyObject(node);
+
+			expr->args = (List *) rollup_expr_mutator((Node *) ((CoalesceExpr *) node)->args, context);
+
+			return (Node *) expr;
 		}
-	}
+		case T_CaseExpr:
+		{
+			CaseExpr *expr = (CaseExpr *) copyObject(node);
 
-	if (OidIsValid(statetype))
-		var->vartype = statetype;
+			expr->arg = (Expr *) rollup_expr_mutator((Node *) ((CaseExpr *) node)->arg, context);
+			expr->args = (List *) rollup_expr_mutator((Node *) ((CaseExpr *) node)->args, context);
+			expr->defresult = (Expr *) rollup_expr_mutator((Node *) ((CaseExpr *) node)->defresult, context);
 
-	args = make_combine_args(pstate, combineinfn, (Node *) var);
+			return (Node *) expr;
+		}
+		case T_CaseWhen:
+		{
+			CaseWhen *when = (CaseWhen *) copyObject(node);
 
-	if (IsA(result, Aggref))
-	{
-		Aggref *agg = (Aggref *) result;
-		agg->orig_args = agg->args;
-		agg->orig_directargs = agg->aggdirectargs;
-		agg->orig_order = agg->aggorder;
-		transformAggregateCall(pstate, agg, args, order, false);
-	}
-	else
-	{
-		((WindowFunc *) result)->args = args;
-		transformWindowFuncCall(pstate, (WindowFunc *) result, over);
+			when->expr = (Expr *) rollup_expr_mutator((Node *) ((CaseWhen *) node)->expr, context);
+			when->result = (Expr *) rollup_expr_mutator((Node *) ((CaseWhen *) node)->result, context);
+
+			return (Node *) when;
+		}
+		default:
+			break;
 	}
 
-	return (Node *) result;
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("rollups only support operators, function calls, casts and constants over grouping columns")));
+
+	return NULL;
 }
 
 /*
- * coerce_to_finalize
- *
- * Given an aggregate node, converts it to a finalize function call
+ * is_combine_call
  */
-static Node *
-coerce_to_finalize(ParseState *pstate, Oid aggfn, Oid type,
-		Oid finaltype, Node *arg, Oid combineinfn)
+static bool
+is_combine_call(Node *node)
 {
-	HeapTuple tup;
-	Form_pg_aggregate aggform;
-	Form_pg_proc procform;
-	Oid final;
-	FuncExpr *func;
-	int i;
-
-	tup = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggfn));
-	if (!HeapTupleIsValid(tup))
-		elog(ERROR, "cache lookup failed for aggregate %u", aggfn);
-	aggform = (Form_pg_aggregate) GETSTRUCT(tup);
-	final = aggform->aggfinalfn;
-
-	ReleaseSysCache(tup);
-	if (!OidIsValid(final))
-		return arg;
-
-	tup = SearchSysCache1(PROCOID, ObjectIdGetDatum(final));
-	if (!HeapTupleIsValid(tup))
-		elog(ERROR, "cache lookup failed for function %u", final);
-	procform = (Form_pg_proc) GETSTRUCT(tup);
-
-	func = (FuncExpr *) makeNode(FuncExpr);
-
-	/*
-	 * A final function may have a polymorphic type, but we know the exact output
-	 * type of this aggregate because it was already previously analyzed, so use it.
-	 */
-	func->funcresulttype = OidIsValid(finaltype) ? finaltype : type;
-	func->funcid = final;
-
-	if (IsA(arg, Var))
-		func->args = make_combine_args(pstate, combineinfn, arg);
-	else
-		func->args = list_make1(arg);
+	FuncCall *func;
 
-	/* final functions may take null dummy arguments for signature resolution */
-	for (i=1; i<procform->pronargs; i++)
-		func->args = lappend(func->args, makeNullConst(procform->proargtypes.values[i], -1, InvalidOid));
+	if (!IsA(node, FuncCall))
+		return false;
 
-	ReleaseSysCache(tup);
+	func = (FuncCall *) node;
 
-	return (Node *) func;
+	return list_length(func->funcname) == 1 && pg_strcasecmp(strVal(linitial(func->funcname)), MATREL_COMBINE) == 0;
 }
 
 /*
- * make_finalize_for_viewdef
+ * TransformRollupSelectStmt
  *
- * Creates a combine aggregate for a view definition against a matrel
+ * A continuous view that selects from another continuous view is a rollup of it. A rollup's groups are
+ * expressions of the other view's grouping columns and its aggregates combine the other view's aggregate
+ * columns, for example:
+ *
+ *   SELECT date_trunc('hour', minute) AS hour, combine(count) AS count FROM minutely GROUP BY hour
+ *
+ * Its partial results are derived from those of the other view by the other view's combiners, rather
+ * than computed by its own workers. Returns NULL if the given statement isn't a rollup. Otherwise, the
+ * continuous query over the other view's streams that is equivalent to the rollup is returned, and
+ * matrel_select is set to the statement computing the rollup's partial results from the other view's
+ * matrel rows.
  */
-static Node *
-make_finalize_for_viewdef(ParseState *pstate, Oid cvid, Var *var, Node *arg)
+SelectStmt *
+TransformRollupSelectStmt(SelectStmt *stmt, RangeVar **source, SelectStmt **matrel_select)
 {
-	Node *result;
-	Oid fnoid = InvalidOid;
-	Oid combinefn;
-	Oid transoutfn;
-	Oid combineinfn;
-	Oid statetype;
-	Oid type = InvalidOid;
-	Oid finaltype = InvalidOid;
-	Query *q = get_worker_query_for_id(cvid);
+	RollupContext rollup;
+	ContAnalyzeContext *context;
+	SelectStmt *select;
+	SelectStmt *matsel;
+	SelectStmt *parent;
+	RangeVar *rv;
+	ListCell *lc;
 
-	result = attr_to_aggs(var->varattno, q->targetList);
-	extract_agg_final_info(result, &fnoid, &type, &finaltype);
-	GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
+	if (stmt->op != SETOP_NONE || list_length(stmt->fromClause) != 1 || !IsA(linitial(stmt->fromClause), RangeVar))
+		return NULL;
 
-	if (!OidIsValid(statetype))
-		return (Node *) arg;
+	rv = (RangeVar *) linitial(stmt->fromClause);
+	if (!IsAContinuousView(rv))
+		return NULL;
 
-	return coerce_to_finalize(pstate, fnoid, type, finaltype, arg, combineinfn);
-}
+	if (stmt->whereClause || stmt->havingClause || stmt->distinctClause || stmt->windowClause ||
+			stmt->sortClause || stmt->limitCount || stmt->limitOffset || stmt->withClause)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("rollups of continuous views can't have WHERE, HAVING, DISTINCT, WINDOW, ORDER BY or LIMIT clauses")));
 
-/*
- * combine_target_belongs_to_cv
- *
- * Verify that the given combine target actually belongs to a continuous view.
- * This allows us to run combines on complex range tables such as joins, as long
- * as the target combine column is from a CV.
- */
-static bool
-combine_target_belongs_to_cv(Var *target, List *rangetable, RangeVar **cv)
-{
-	RangeTblEntry *targetrte;
-	ListCell *lc;
-	Value *colname;
+	parent = get_cont_query_select_stmt(rv);
+	name_res_targets(parent->targetList);
+	context = MakeContAnalyzeContext(make_parsestate(NULL), parent, Worker);
+	collect_windows(parent, context);
 
-	if (list_length(rangetable) < target->varno)
-	{
-		elog(ERROR, "range table entry %d not in range table of length %d",
-				target->varno, list_length(rangetable));
-	}
+	if (has_clock_timestamp(parent->whereClause, NULL) || list_length(context->windows) ||
+			parent->distinctClause || parent->havingClause)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("rollups of sliding-window continuous views or ones with WINDOW, DISTINCT or HAVING clauses are not supported")));
 
-	targetrte = (RangeTblEntry *) list_nth(rangetable, target->varno - 1);
+	MemSet(&rollup, 0, sizeof(RollupContext));
+	rollup.source = rv;
 
-	if (list_length(targetrte->eref->colnames) < target->varattno)
+	/* The other view's top-level aggregates can be combined, and its columns without aggregates grouped on */
+	foreach(lc, parent->targetList)
 	{
-		elog(ERROR, "attribute %d not column list of length %d",
-						target->varattno, list_length(targetrte->eref->colnames));
+		ResTarget *res = (ResTarget *) lfirst(lc);
+
+		context->funcs = NIL;
+		collect_agg_funcs((Node *) res, context);
+
+		if (!list_length(context->funcs))
+			rollup.columns = lappend(rollup.columns, res);
+		else if (list_length(context->funcs) == 1 && (Node *) linitial(context->funcs) == res->val)
+			rollup.aggs = lappend(rollup.aggs, res);
 	}
 
-	colname = (Value *) list_nth(targetrte->eref->colnames, target->varattno - 1);
+	select = makeNode(SelectStmt);
+	select->forContinuousView = stmt->forContinuousView;
+	select->fromClause = copyObject(parent->fromClause);
+	select->whereClause = copyObject(parent->whereClause);
 
-	foreach(lc, rangetable)
+	matsel = makeNode(SelectStmt);
+	matsel->fromClause = list_make1(GetMatRelName(rv));
+
+	foreach(lc, stmt->targetList)
 	{
-		ListCell *clc;
-		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+		ResTarget *res = (ResTarget *) lfirst(lc);
+		ResTarget *target = makeNode(ResTarget);
+		ResTarget *matres = makeNode(ResTarget);
 
-		if (rte->relkind != RELKIND_CONTVIEW)
-			continue;
+		target->location = res->location;
+		matres->location = -1;
 
-		foreach(clc, rte->eref->colnames)
+		if (is_combine_call(res->val))
 		{
-			Value *c = (Value *) lfirst(clc);
-			Relation rel;
-			RangeVar *rv;
-			char *cvname;
-			char *namespace;
+			FuncCall *func = (FuncCall *) res->val;
+			ResTarget *agg;
+			ColumnRef *cref;
 
-			if (!equal(colname, c))
-				continue;
+			if (list_length(func->args) != 1 || !IsA(linitial(func->args), ColumnRef) ||
+					func->agg_order || func->agg_filter || func->agg_distinct || func->over)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("combine must be given a single aggregate column of \"%s\"", rv->relname)));
 
-			/*
-			 * The view contains a column name that matches the target column,
-			 * so we just need to verify that it's actually a continuous view.
-			 */
-			rel = heap_open(rte->relid, NoLock);
-			namespace = get_namespace_name(RelationGetNamespace(rel));
-			cvname = RelationGetRelationName(rel);
-			relation_close(rel, NoLock);
-			rv = makeRangeVar(namespace, cvname, -1);
+			agg = find_rollup_column(&rollup, (ColumnRef *) linitial(func->args), true);
 
-			if (IsAContinuousView(rv))
-			{
-				*cv = rv;
-				return true;
-			}
-		}
-	}
+			/* the rollup aggregates exactly like the other view does, only over coarser groups */
+			target->name = pstrdup(res->name ? res->name : agg->name);
+			target->val = copyObject(agg->val);
 
-	return false;
-}
+			cref = makeNode(ColumnRef);
+			cref->fields = list_make1(makeString(pstrdup(agg->name)));
+			cref->location = -1;
+			matres->val = (Node *) cref;
+		}
+		else
+		{
+			context->funcs = NIL;
+			collect_agg_funcs((Node *) res, context);
 
-/*
- * find_attr_from_joinlist
- *
- * Given a join list and a variable within it, finds the attribute position of that variable
- * in its matrel's descriptor.
- *
- * This also sets the given Var's varno to the varno of the continuous view RTE in the range
- * table, because it simplifies things if we're not selecting directly from the messy join RTE.
- */
-static AttrNumber
-find_cv_attr(ParseState *pstate, RangeVar *cvrv, RangeTblEntry *joinrte, Var *var)
-{
-	RangeTblEntry *cvrte = NULL;
-	ListCell *lc;
-	Value *colname = (Value *) list_nth(joinrte->eref->colnames, var->varattno - 1);
-	Oid relid = RangeVarGetRelid(cvrv, NoLock, false);
-	int i = 0;
-	int varno = 0;
+			if (list_length(context->funcs))
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("rollups can only aggregate by combining aggregate columns of \"%s\"", rv->relname),
+						 errhint("For example, ... SELECT combine(count) FROM %s ...", rv->relname)));
+
+			target->name = pstrdup(res->name ? res->name : FigureColname(res->val));
+			rollup.matrel = false;
+			target->val = rollup_expr_mutator(res->val, &rollup);
+			rollup.matrel = true;
+			matres->val = rollup_expr_mutator(res->val, &rollup);
+		}
 
-	foreach(lc, pstate->p_rtable)
-	{
-		varno++;
-		cvrte = (RangeTblEntry *) lfirst(lc);
-		if (cvrte->relid == relid)
-			break;
+		matres->name = target->name;
+		select->targetList = lappend(select->targetList, target);
+		matsel->targetList = lappend(matsel->targetList, matres);
 	}
 
-	if (!cvrte || cvrte->relid != relid)
-		elog(ERROR, "could not find continuous view range table entry");
+	rollup.matrel = false;
 
-	foreach(lc, cvrte->eref->colnames)
+	foreach(lc, stmt->groupClause)
 	{
-		Value *c = (Value *) lfirst(lc);
-		i++;
-		if (equal(colname, c))
+		Node *node = (Node *) lfirst(lc);
+		Node *group = NULL;
+
+		if (IsA(node, GroupingSet))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("rollups of continuous views don't support grouping sets")));
+
+		/* The other view's columns take precedence over the rollup's output column names */
+		if (IsA(node, ColumnRef) && list_length(((ColumnRef *) node)->fields) == 1 &&
+				IsA(linitial(((ColumnRef *) node)->fields), String))
 		{
-			var->varno = varno;
-			return i;
+			char *name = strVal(linitial(((ColumnRef *) node)->fields));
+			bool is_source_col = false;
+			ListCell *tlc;
+
+			foreach(tlc, list_concat(list_copy(rollup.columns), rollup.aggs))
+			{
+				if (strcmp(((ResTarget *) lfirst(tlc))->name, name) == 0)
+					is_source_col = true;
+			}
+
+			foreach(tlc, select->targetList)
+			{
+				ResTarget *res = (ResTarget *) lfirst(tlc);
+
+				if (!is_source_col && strcmp(res->name, name) == 0)
+					group = copyObject(res->val);
+			}
 		}
+
+		if (group == NULL && IsA(node, A_Const))
+			group = copyObject(node);
+		else if (group == NULL)
+			group = rollup_expr_mutator(node, &rollup);
+
+		select->groupClause = lappend(select->groupClause, group);
 	}
 
-	elog(ERROR, "could not find column \"%s\" in continuous view range table entry", strVal(colname));
+	*source = rv;
+	*matrel_select = matsel;
 
-	return InvalidAttrNumber;
+	return select;
 }
 
 /*
- * ParseCombineFuncCall
+ * attr_to_agg
  *
- * Builds an expression for a combine() call on an aggregate CV column.
- * This may involve deserializing the column transition state.
+ * Given a matrel attribute, returns the aggregate node that it corresponds to
  */
-Node *
-ParseCombineFuncCall(ParseState *pstate, List *fargs,
-		List *order, Expr *filter, WindowDef *over, int location)
+static Node *
+attr_to_aggs(AttrNumber attr, List *tlist)
+{
+	TargetEntry *te;
+	List *l;
+	Node *n;
+
+	Assert(list_length(tlist) >= attr);
+
+	te = list_nth(tlist, attr - 1);
+	l = pull_var_and_aggs((Node *) te);
+
+	Assert(list_length(l) == 1);
+
+	n = linitial(l);
+
+	Assert(IsA(n, Aggref) || IsA(n, WindowFunc));
+
+	return n;
+}
+
+/*
+ * make_combine_args
+ *
+ * Possibly wraps the target argument in a recv function call to deserialize
+ * hidden state before calling combine()
+ */
+static List *
+make_combine_args(ParseState *pstate, Oid combineinfn, Node *arg)
+{
+	List *args;
+
+	if (OidIsValid(combineinfn))
+	{
+		FuncCall *fn = makeNode(FuncCall);
+		fn->funcname = list_make1(makeString(get_func_name(combineinfn)));
+		fn->args = list_make1(arg);
+		args = list_make1(transformFuncCall(pstate, fn));
+	}
+	else
+	{
+		/* transition state is stored as a first-class type, no deserialization needed */
+		args = list_make1(arg);
+	}
+
+	return args;
+}
+
+/*
+ * extract_agg_final_info
+ *
+ * Given an Aggref or WindowFunc, extracts its aggregate function, output type,
+ * and final type
+ */
+static void
+extract_agg_final_info(Node *n, Oid *aggfn, Oid *type, Oid *finaltype)
+{
+	if (IsA(n, Aggref))
+	{
+		Aggref *agg = (Aggref *) n;
+		*aggfn = agg->aggfnoid;
+		*type = agg->aggtype;
+		*finaltype = agg->aggfinaltype;
+	}
+	else if (IsA(n, WindowFunc))
+	{
+		WindowFunc *wfunc = (WindowFunc *) n;
+		*aggfn = wfunc->winfnoid;
+		*type = wfunc->wintype;
+		*finaltype = wfunc->winfinaltype;
+	}
+}
+
+static Query *
+get_worker_query_for_id(Oid id)
+{
+	HeapTuple tup;
+	bool isnull;
+	Datum tmp;
+	char *sql;
+	Query *query;
+	SelectStmt *sel;
+	RangeVar *matrel;
+	Form_pipeline_query row;
+
+	tup = SearchSysCache1(PIPELINEQUERYID, ObjectIdGetDatum(id));
+
+	if (!HeapTupleIsValid(tup))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_CONTINUOUS_VIEW),
+				errmsg("continuous view with id \"%d\" does not exist", id)));
+
+	tmp = SysCacheGetAttr(PIPELINEQUERYRELID, tup, Anum_pipeline_query_query, &isnull);
+	query = (Query *) stringToNode(TextDatumGetCString(tmp));
+
+	sql = deparse_query_def(query);
+	sel = (SelectStmt *) linitial(pg_parse_query(sql));
+	sel->swStepFactor = query->swStepFactor;
+	sel->deltaMerge = query->deltaMerge;
+	sel->lazyGroupingSets = query->lazyGroupingSets;
+
+	row = (Form_pipeline_query) GETSTRUCT(tup);
+	matrel = makeRangeVar(get_namespace_name(get_rel_namespace(row->matrelid)), get_rel_name(row->matrelid), -1);
+
+	ReleaseSysCache(tup);
+
+	sel = TransformSelectStmtForContProcess(matrel, sel, NULL, Worker);
+	return parse_analyze((Node *) sel, "SELECT", 0, 0);
+}
+
+/*
+ * make_combine_agg_for_viewdef
+ *
+ * Creates a combine aggregate for a view definition against a matrel
+ */
+static Node *
+make_combine_agg_for_viewdef(ParseState *pstate, Oid cvid, Var *var,
+		 List *order, WindowDef *over)
 {
-	Node *arg;
-	Var *var;
 	List *args;
+	Node *result;
+	Oid fnoid = InvalidOid;
 	Oid combinefn;
 	Oid transoutfn;
 	Oid combineinfn;
+	Oid type = InvalidOid;
+	Oid finaltype = InvalidOid;
 	Oid statetype;
-	RangeVar *rv;
-	Query *cont_qry;
-	TargetEntry *target;
-	RangeTblEntry *rte;
-	AttrNumber cvatt = InvalidAttrNumber;
+	Oid aggtype;
+	Query *q = get_worker_query_for_id(cvid);
 
-	if (list_length(fargs) != 1)
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-				 errmsg("combine called with %d arguments", list_length(fargs)),
-				 errhint("combine must be called with a single aggregate continuous view column reference.")));
+	Assert(!IsContQueryWorkerProcess());
 
-	arg = linitial(fargs);
+	result = attr_to_aggs(var->varattno, q->targetList);
 
-	if (!IsA(arg, Var))
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-				 errmsg("combine called with an invalid expression"),
-				 errhint("combine must be called with a single aggregate continuous view column reference.")));
+	extract_agg_final_info(result, &fnoid, &type, &finaltype);
+	GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
 
-	var = (Var *) arg;
+	aggtype = OidIsValid(statetype) ? statetype : finaltype;
 
-	if (!combine_target_belongs_to_cv(var, pstate->p_rtable, &rv))
+	if (IsA(result, Aggref))
 	{
-		Oid cvid;
-		RangeTblEntry *rte = list_nth(pstate->p_rtable, var->varno - 1);
-
-		if (rte->relkind != RELKIND_RELATION)
-			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-					 errmsg("the FROM clause is not a continuous view"),
-					 errhint("Only aggregate continuous view columns can be combined.")));
+		Aggref *agg = (Aggref *) result;
 
 		/*
-		 * Sliding-window CQ's use combine aggregates in their
-		 * view definition, so when they're created we can also
-		 * end up here. We do this check second because it's slow.
+		 * Since we call attr_to_aggs on the target list of the worker plan, we'll see Aggrefs
+		 * instead of WindowFuncs. Force such cases into WindowFuncs.
 		 */
-		if (!RelIdIsForMatRel(rte->relid, &cvid))
-			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-					 errmsg("\"%s\" is not a continuous view", get_rel_name(rte->relid)),
-					 errhint("Only aggregate continuous view columns can be combined.")));
+		if (over)
+		{
+			WindowFunc *win = makeNode(WindowFunc);
+
+			win->winfnoid = agg->aggfnoid;
+			win->winaggkind = AGGKIND_COMBINE;
+			win->wintype = aggtype;
+			win->winagg = true;
+			win->winstar = false;
+
+			result = (Node *) win;
+		}
+		else
+		{
+			agg->aggkind = AGGKIND_COMBINE;
+			agg->aggfilter = NULL;
+			agg->aggtype = aggtype;
+			agg->aggstar = false;
+		}
+	}
+
+	if (OidIsValid(statetype))
+		var->vartype = statetype;
+
+	args = make_combine_args(pstate, combineinfn, (Node *) var);
+
+	if (IsA(result, Aggref))
+	{
+		Aggref *agg = (Aggref *) result;
+		agg->orig_args = agg->args;
+		agg->orig_directargs = agg->aggdirectargs;
+		agg->orig_order = agg->aggorder;
+		transformAggregateCall(pstate, agg, args, order, false);
+	}
+	else
+	{
+		((WindowFunc *) result)->args = args;
+		transformWindowFuncCall(pstate, (WindowFunc *) result, over);
+	}
+
+	return (Node *) result;
+}
+
+/*
+ * coerce_to_finalize
+ *
+ * Given an aggregate node, converts it to a finalize function call
+ */
+static Node *
+coerce_to_finalize(ParseState *pstate, Oid aggfn, Oid type,
+		Oid finaltype, Node *arg, Oid combineinfn)
+{
+	HeapTuple tup;
+	Form_pg_aggregate aggform;
+	Form_pg_proc procform;
+	Oid final;
+	FuncExpr *func;
+	int i;
+
+	tup = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggfn));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for aggregate %u", aggfn);
+	aggform = (Form_pg_aggregate) GETSTRUCT(tup);
+	final = aggform->aggfinalfn;
+
+	ReleaseSysCache(tup);
+	if (!OidIsValid(final))
+		return arg;
+
+	tup = SearchSysCache1(PROCOID, ObjectIdGetDatum(final));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for function %u", final);
+	procform = (Form_pg_proc) GETSTRUCT(tup);
+
+	func = (FuncExpr *) makeNode(FuncExpr);
+
+	/*
+	 * A final function may have a polymorphic type, but we know the exact output
+	 * type of this aggregate because it was already previously analyzed, so use it.
+	 */
+	func->funcresulttype = OidIsValid(finaltype) ? finaltype : type;
+	func->funcid = final;
+
+	if (IsA(arg, Var))
+		func->args = make_combine_args(pstate, combineinfn, arg);
+	else
+		func->args = list_make1(arg);
+
+	/* final functions may take null dummy arguments for signature resolution */
+	for (i=1; i<procform->pronargs; i++)
+		func->args = lappend(func->args, makeNullConst(procform->proargtypes.values[i], -1, InvalidOid));
+
+	ReleaseSysCache(tup);
+
+	return (Node *) func;
+}
+
+/*
+ * make_finalize_for_viewdef
+ *
+ * Creates a combine aggregate for a view definition against a matrel
+ */
+static Node *
+make_finalize_for_viewdef(ParseState *pstate, Oid cvid, Var *var, Node *arg)
+{
+	Node *result;
+	Oid fnoid = InvalidOid;
+	Oid combinefn;
+	Oid transoutfn;
+	Oid combineinfn;
+	Oid statetype;
+	Oid type = InvalidOid;
+	Oid finaltype = InvalidOid;
+	Query *q = get_worker_query_for_id(cvid);
+
+	result = attr_to_aggs(var->varattno, q->targetList);
+	extract_agg_final_info(result, &fnoid, &type, &finaltype);
+	GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
+
+	if (!OidIsValid(statetype))
+		return (Node *) arg;
+
+	return coerce_to_finalize(pstate, fnoid, type, finaltype, arg, combineinfn);
+}
+
+/*
+ * combine_target_belongs_to_cv
+ *
+ * Verify that the given combine target actually belongs to a continuous view.
+ * This allows us to run combines on complex range tables such as joins, as long
+ * as the target combine column is from a CV.
+ */
+static bool
+combine_target_belongs_to_cv(Var *target, List *rangetable, RangeVar **cv)
+{
+	RangeTblEntry *targetrte;
+	ListCell *lc;
+	Value *colname;
+
+	if (list_length(rangetable) < target->varno)
+	{
+		elog(ERROR, "range table entry %d not in range table of length %d",
+				target->varno, list_length(rangetable));
+	}
+
+	targetrte = (RangeTblEntry *) list_nth(rangetable, target->varno - 1);
+
+	if (list_length(targetrte->eref->colnames) < target->varattno)
+	{
+		elog(ERROR, "attribute %d not column list of length %d",
+						target->varattno, list_length(targetrte->eref->colnames));
+	}
+
+	colname = (Value *) list_nth(targetrte->eref->colnames, target->varattno - 1);
+
+	foreach(lc, rangetable)
+	{
+		ListCell *clc;
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->relkind != RELKIND_CONTVIEW)
+			continue;
+
+		foreach(clc, rte->eref->colnames)
+		{
+			Value *c = (Value *) lfirst(clc);
+			Relation rel;
+			RangeVar *rv;
+			char *cvname;
+			char *namespace;
+
+			if (!equal(colname, c))
+				continue;
+
+			/*
+			 * The view contains a column name that matches the target column,
+			 * so we just need to verify that it's actually a continuous view.
+			 */
+			rel = heap_open(rte->relid, NoLock);
+			namespace = get_namespace_name(RelationGetNamespace(rel));
+			cvname = RelationGetRelationName(rel);
+			relation_close(rel, NoLock);
+			rv = makeRangeVar(namespace, cvname, -1);
+
+			if (IsAContinuousView(rv))
+			{
+				*cv = rv;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/*
+ * find_attr_from_joinlist
+ *
+ * Given a join list and a variable within it, finds the attribute position of that variable
+ * in its matrel's descriptor.
+ *
+ * This also sets the given Var's varno to the varno of the continuous view RTE in the range
+ * table, because it simplifies things if we're not selecting directly from the messy join RTE.
+ */
+static AttrNumber
+find_cv_attr(ParseState *pstate, RangeVar *cvrv, RangeTblEntry *joinrte, Var *var)
+{
+	RangeTblEntry *cvrte = NULL;
+	ListCell *lc;
+	Value *colname = (Value *) list_nth(joinrte->eref->colnames, var->varattno - 1);
+	Oid relid = RangeVarGetRelid(cvrv, NoLock, false);
+	int i = 0;
+	int varno = 0;
+
+	foreach(lc, pstate->p_rtable)
+	{
+		varno++;
+		cvrte = (RangeTblEntry *) lfirst(lc);
+		if (cvrte->relid == relid)
+			break;
+	}
+
+	if (!cvrte || cvrte->relid != relid)
+		elog(ERROR, "could not find continuous view range table entry");
+
+	foreach(lc, cvrte->eref->colnames)
+	{
+		Value *c = (Value *) lfirst(lc);
+		i++;
+		if (equal(colname, c))
+		{
+			var->varno = varno;
+			return i;
+		}
+	}
+
+	elog(ERROR, "could not find column \"%s\" in continuous view range table entry", strVal(colname));
+
+	return InvalidAttrNumber;
+}
+
+/*
+ * ParseCombineFuncCall
+ *
+ * Builds an expression for a combine() call on an aggregate CV column.
+ * This may involve deserializing the column transition state.
+ */
+Node *
+ParseCombineFuncCall(ParseState *pstate, List *fargs,
+		List *order, Expr *filter, WindowDef *over, int location)
+{
+	Node *arg;
+	Var *var;
+	List *args;
+	Oid combinefn;
+	Oid transoutfn;
+	Oid combineinfn;
+	Oid statetype;
+	RangeVar *rv;
+	Query *cont_qry;
+	TargetEntry *target;
+	RangeTblEntry *rte;
+	AttrNumber cvatt = InvalidAttrNumber;
+
+	if (list_length(fargs) != 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+				 errmsg("combine called with %d arguments", list_length(fargs)),
+				 errhint("combine must be called with a single aggregate continuous view column reference.")));
+
+	arg = linitial(fargs);
+
+	if (!IsA(arg, Var))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+				 errmsg("combine called with an invalid expression"),
+				 errhint("combine must be called with a single aggregate continuous view column reference.")));
+
+	var = (Var *) arg;
+
+	if (!combine_target_belongs_to_cv(var, pstate->p_rtable, &rv))
+	{
+		Oid cvid;
+		RangeTblEntry *rte = list_nth(pstate->p_rtable, var->varno - 1);
+
+		if (rte->relkind != RELKIND_RELATION)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+					 errmsg("the FROM clause is not a continuous view"),
+					 errhint("Only aggregate continuous view columns can be combined.")));
+
+		/*
+		 * Sliding-window CQ's use combine aggregates in their
+		 * view definition, so when they're created we can also
+		 * end up here. We do this check second because it's slow.
+		 */
+		if (!RelIdIsForMatRel(rte->relid, &cvid))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+					 errmsg("\"%s\" is not a continuous view", get_rel_name(rte->relid)),
+					 errhint("Only aggregate continuous view columns can be combined.")));
+
+		return make_combine_agg_for_viewdef(pstate, cvid, var, order, over);
+	}
+
+	/* Ok, it's a user combine query against an existing continuous view */
+	cont_qry = GetContViewQuery(rv);
+
+	rte = (RangeTblEntry *) list_nth(pstate->p_rtable, var->varno - 1);
+	cvatt = var->varattno;
+
+	/*
+	 * If this is a join, our varattno will point to the position of the target
+	 * combine column within the joined target list, so we need to pull out the
+	 * table-level var that will point us to the CQ's target list
+	 */
+	cvatt = find_cv_attr(pstate, rv, rte, var);
+
+	/*
+	 * Find the aggregate node in the CQ that corresponds
+	 * to the target combine column
+	 */
+	target = (TargetEntry *) list_nth(cont_qry->targetList, cvatt - 1);
+
+	if (IsA(target->expr, Aggref) || IsA(target->expr, WindowFunc))
+	{
+		Oid fnoid = InvalidOid;
+		Oid type = InvalidOid;
+		Oid finaltype = InvalidOid;
+		Oid aggtype;
+		Var *v;
+		Node *result;
+
+		extract_agg_final_info((Node *) target->expr, &fnoid, &type, &finaltype);
+		GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
+
+		aggtype = OidIsValid(statetype) ? statetype : finaltype;
+
+		v = makeVar(var->varno, cvatt, aggtype, InvalidOid, InvalidOid, InvalidOid);
+		args = make_combine_args(pstate, combineinfn, (Node *) v);
+
+		if (over)
+		{
+			WindowFunc *wfunc = makeNode(WindowFunc);
+
+			wfunc->winfnoid = fnoid;
+			wfunc->wintype = aggtype;
+			wfunc->args = args;
+			wfunc->winstar = false;
+			wfunc->winagg = true;
+			wfunc->aggfilter = filter;
+			wfunc->winaggkind = AGGKIND_COMBINE;
+
+			transformWindowFuncCall(pstate, wfunc, over);
+
+			result = (Node *) wfunc;
+		}
+		else
+		{
+			Aggref *agg = makeNode(Aggref);
+			Aggref *orig_agg = (Aggref *) target->expr;
+
+			Assert(IsA(orig_agg, Aggref));
+
+			agg->aggfnoid = fnoid;
+			agg->aggtype = aggtype;
+			agg->args = args;
+			agg->aggstar = false;
+			agg->aggfilter = filter;
+			agg->aggkind = AGGKIND_COMBINE;
+			agg->orig_args = orig_agg->args;
+			agg->orig_directargs = orig_agg->aggdirectargs;
+			agg->orig_order = orig_agg->aggorder;
+
+			transformAggregateCall(pstate, agg, args, order, false);
+
+			result = (Node *) agg;
+		}
+
+		/* combines on continuous views should always finalize */
+		return coerce_to_finalize(pstate, fnoid, type, finaltype, result, combineinfn);
+	}
+
+	/* TODO(usmanm): Eventually we should support nested aggregates and aggregates in expressions */
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+			errmsg("combine called with an invalid expression"),
+			errhint("combine must be called with a single aggregate continuous view column reference.")));
+}
+
+/*
+ * ParseFinalizeFuncCall
+ */
+Node *
+ParseFinalizeFuncCall(ParseState *pstate, List *fargs, int location)
+{
+	Node *arg;
+	Var *var;
+	Oid cvid;
+	RangeTblEntry *rte;
+	RangeVar *matrelrv;
+	Relation rel;
+	List *vars;
+
+	if (list_length(fargs) != 1)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+				 errmsg("finalize called with %d arguments", list_length(fargs)),
+				 errhint("finalize must be called with a single expression as its argument.")));
+	}
+
+	arg = linitial(fargs);
+
+	if (IsA(arg, Aggref))
+	{
+		Aggref *agg = (Aggref *) arg;
+
+		if (!AGGKIND_IS_COMBINE(agg->aggkind))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+					errmsg("finalize called with an invalid expression"),
+					errhint("finalize must be called with a single column reference or a combine(...) as its argument.")));
+
+		arg = linitial(agg->args);
+	}
+	else if (IsA(arg, WindowFunc))
+	{
+		WindowFunc *win = (WindowFunc *) arg;
+
+		if (!AGGKIND_IS_COMBINE(win->winaggkind))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+					errmsg("finalize called with an invalid expression"),
+					errhint("finalize must be called with a single column reference or a combine(...) as its argument.")));
+
+		arg = linitial(win->args);
+	}
+
+	/* The argument could be wrapped in a transout function */
+	vars = pull_var_and_aggs(arg);
+
+	if (list_length(vars) != 1)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+				 errmsg("finalize called with an invalid expression"),
+				 errhint("finalize must be called with a single column reference or a combine(...) as its argument.")));
+	}
+
+	var = (Var *) linitial(vars);
+	rte = list_nth(pstate->p_rtable, var->varno - 1);
+
+	rel = heap_open(rte->relid, NoLock);
+	matrelrv = makeRangeVar(get_namespace_name(RelationGetNamespace(rel)), RelationGetRelationName(rel), -1);
+	relation_close(rel, NoLock);
+
+	if (!RelIdIsForMatRel(rte->relid, &cvid))
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+				 errmsg("\"%s\" is not a continuous view", matrelrv->relname),
+				 errhint("Only aggregate continuous view columns can be finalized.")));
+	}
+
+	return make_finalize_for_viewdef(pstate, cvid, var, linitial(fargs));
+}
+
+/*
+ * CollectUserCombines
+ *
+ * Collect all combine aggregate calls
+ */
+static bool
+collect_combines_aggs(Node *node, List **combines)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, Aggref))
+	{
+		if (AGGKIND_IS_COMBINE(((Aggref *) node)->aggkind))
+			*combines = lappend(*combines, node);
+	}
+	else if (IsA(node, WindowFunc))
+	{
+		if (AGGKIND_IS_COMBINE(((WindowFunc *) node)->winaggkind))
+			*combines = lappend(*combines, node);
+	}
+
+	return expression_tree_walker(node, collect_combines_aggs, combines);
+}
+
+static bool
+pull_vars(Node *node, List **varlist)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, Var))
+	{
+		*varlist = lappend(*varlist, node);
+		return false;
+	}
+
+	return expression_tree_walker(node, pull_var_and_aggs_walker,
+								  (void *) varlist);
+}
+
+/*
+ * push_down_sw_predicate
+ *
+ * Push down any upper sliding-window predicates to the matrel SELECT.
+ * This makes it possible to create multiple sliding windows over the same
+ * continuous view.
+ */
+static void
+push_down_sw_predicate(Var *dummy, Query *upper, Query *lower)
+{
+	List *vars = NIL;
+	Var *real;
+
+	pull_vars(lower->jointree->quals, &vars);
+
+	if (list_length(vars) != 1)
+		elog(ERROR, "column \"arrival_timestamp\" does not exist");
+
+	/* sliding window predicates should only have a single qual */
+	if (!IsA(lower->jointree->quals, OpExpr))
+		elog(ERROR, "column \"arrival_timestamp\" does not exist");
+
+	real = (Var *) linitial(vars);
+
+	memcpy(dummy, real, sizeof(Var));
+	lower->jointree->quals = upper->jointree->quals;
+	upper->jointree->quals = (Node *) NIL;
+}
+
+/*
+ * get_dummy_sw_predicate
+ *
+ * Returns a placeholder sliding-window predicate that should be pushed down,
+ * or NULL if one doesn't exist.
+ */
+static Var *
+get_dummy_sw_predicate(Node *where)
+{
+	List *vars = NIL;
+	Var *var;
+
+	pull_vars(where, &vars);
+
+	if (list_length(vars) != 1)
+		return NULL;
+
+	var = (Var *) linitial(vars);
+	if (IS_SW_TIMESTAMP_REF(var))
+		return var;
+
+	return NULL;
+}
+
+/*
+ * RewriteContinuousViewSelect
+ *
+ * Possibly modify an overlay view SELECT rule before it's applied.
+ * This is mainly used for user_combines where we strip away the finalize function
+ * and put it on the *outer* SELECT.
+ */
+Query *
+RewriteContinuousViewSelect(Query *query, Query *rule, Relation cv, int rtindex)
+{
+	RangeVar *rv = makeRangeVar(get_namespace_name(RelationGetNamespace(cv)), RelationGetRelationName(cv), -1);
+	List *combines = NIL;
+	ListCell *lc;
+	RangeTblEntry *rte;
+	Var *dummy;
+
+	/* RTE is not a view? */
+	rte = rt_fetch(rtindex, query->rtable);
+	if (rte->relkind != RELKIND_CONTVIEW)
+		return rule;
+
+	/* try to bail early because this gets called from a hot path */
+	if (!IsAContinuousView(rv))
+		return rule;
+
+	/*
+	 * If there is an upper reference to arrival_timestamp, push it down
+	 * to the matrel select.
+	 */
+	dummy = get_dummy_sw_predicate(query->jointree->quals);
+	if (dummy)
+		push_down_sw_predicate(dummy, query, rule);
+
+	/* We only need to rewrite the overlay view definition if there are some user defines */
+	collect_combines_aggs((Node *) query->targetList, &combines);
+	if (list_length(combines) == 0)
+		return rule;
+
+	/* Remove finalize from any aggregate targets that are in combines */
+	foreach(lc, combines)
+	{
+		List *l = NIL;
+		Var *v;
+		Node *agg;
+		TargetEntry *te;
+		Oid fnoid = InvalidOid;
+		Oid type;
+		Oid finaltype;
+		Oid finalfn;
+		HeapTuple tup;
+		Form_pg_aggregate aggform;
+		FuncExpr *fexpr;
+		Expr *expr;
+		Oid combinefn;
+		Oid transoutfn;
+		Oid combineinfn;
+		Oid statetype;
+
+		pull_vars(lfirst(lc), &l);
+		Assert(list_length(l) == 1);
+		v = (Var *) linitial(l);
+
+		/* Not reading from us? */
+		if (v->varno != rtindex)
+			continue;
+
+		l = pull_var_and_aggs(lfirst(lc));
+		Assert(list_length(l) == 1);
+		agg = (Node *) linitial(l);
+
+		if (!IsA(agg, Aggref) && !IsA(agg, WindowFunc))
+		{
+			/* WTF? */
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
+					errmsg("combine called with an invalid expression"),
+					errhint("combine must be called with a single aggregate continuous view column reference.")));
+		}
+
+		extract_agg_final_info(agg, &fnoid, &type, &finaltype);
+
+		tup = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(fnoid));
+		if (!HeapTupleIsValid(tup))
+			elog(ERROR, "cache lookup failed for aggregate %u", fnoid);
+		aggform = (Form_pg_aggregate) GETSTRUCT(tup);
+		finalfn = aggform->aggfinalfn;
+		ReleaseSysCache(tup);
+
+		/* No finalize func? */
+		if (!OidIsValid(finalfn))
+			continue;
+
+		te = list_nth(rule->targetList, v->varattno - 1);
+
+		Assert(IsA(te->expr, FuncExpr));
+
+		/* Strip away the finalize func */
+		fexpr = (FuncExpr *) te->expr;
+
+		Assert(fexpr->funcid == finalfn);
+		expr = linitial(fexpr->args);
+
+		GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
+
+		/* XXX(usmanm): We can probably avoid this extra serialize/deserialize step */
+		if (OidIsValid(transoutfn))
+		{
+			fexpr->funcid = transoutfn;
+			fexpr->funcresulttype = statetype;
+		}
+		else
+			te->expr = expr;
+	}
+
+	return rule;
+}
+
+/*
+ * GetSWExpr
+ */
+Node *
+GetSWExpr(RangeVar *cv)
+{
+	SelectStmt *view;
+	SelectStmt *sel;
+
+	sel = get_cont_query_select_stmt(cv);
+	TransformSelectStmtForContProcess(cv, sel, &view, Worker);
+
+	return view->whereClause;
+}
+
+static Interval *
+parse_node_to_interval(Node *inode)
+{
+	ExprState *estate;
+	ParseState *ps = make_parsestate(NULL);
+	Expr *expr;
+	Datum d;
+	ExprContext *econtext = CreateStandaloneExprContext();
+	bool isnull;
+
+	inode = transformExpr(ps, (Node *) inode, EXPR_KIND_OTHER);
+	expr = expression_planner((Expr *) inode);
+
+	estate = ExecInitExpr(expr, NULL);
+	d = ExecEvalExpr(estate, econtext, &isnull, NULL);
+
+	free_parsestate(ps);
+	FreeExprContext(econtext, false);
+
+	return DatumGetIntervalP(d);
+}
+
+/*
+ * GetSWInterval
+ *
+ * Returns the interval associated with a SW
+ */
+Interval *
+GetSWInterval(RangeVar *rv)
+{
+	Node *sw_expr = GetSWExpr(rv);
+	ContAnalyzeContext context;
+	Node *expr;
+
+	find_clock_timestamp_expr(sw_expr, &context);
+	Assert(IsA(context.expr, A_Expr));
+
+	/* arrival_timestamp > clock_timestamp() - interval... */
+	expr = ((A_Expr *) context.expr)->rexpr;
+	Assert(IsA(expr, A_Expr));
+
+	expr = ((A_Expr *) expr)->rexpr;
+
+	return parse_node_to_interval(expr);
+}
+
+ColumnRef *
+GetSWTimeColumn(RangeVar *rv)
+{
+	Node *expr = GetSWExpr(rv);
+	ContAnalyzeContext context;
+
+	if (expr == NULL)
+		return NULL;
+
+	context.cols = NIL;
+	context.types = NIL;
+
+	collect_types_and_cols(expr, &context);
+
+	Assert(list_length(context.cols) == 1);
+
+	return linitial(context.cols);
+}
+
+ColumnRef *
+GetWindowTimeColumn(RangeVar *cv)
+{
+	SelectStmt *view;
+	SelectStmt *sel;
+	ContAnalyzeContext context;
 
-		return make_combine_agg_for_viewdef(pstate, cvid, var, order, over);
-	}
+	sel = get_cont_query_select_stmt(cv);
+	TransformSelectStmtForContProcess(cv, sel, &view, Worker);
 
-	/* Ok, it's a user combine query against an existing continuous view */
-	cont_qry = GetContViewQuery(rv);
+	if (view->whereClause)
+	{
+		context.cols = NIL;
+		context.types = NIL;
 
-	rte = (RangeTblEntry *) list_nth(pstate->p_rtable, var->varno - 1);
-	cvatt = var->varattno;
+		collect_types_and_cols(view->whereClause, &context);
 
-	/*
-	 * If this is a join, our varattno will point to the position of the target
-	 * combine column within the joined target list, so we need to pull out the
-	 * table-level var that will point us to the CQ's target list
-	 */
-	cvatt = find_cv_attr(pstate, rv, rte, var);
+		Assert(list_length(context.cols) == 1);
 
-	/*
-	 * Find the aggregate node in the CQ that corresponds
-	 * to the target combine column
-	 */
-	target = (TargetEntry *) list_nth(cont_qry->targetList, cvatt - 1);
+		return linitial(context.cols);
+	}
 
-	if (IsA(target->expr, Aggref) || IsA(target->expr, WindowFunc))
+	context.windows = NIL;
+	collect_windows(view, &context);
+
+	if (list_length(context.windows))
 	{
-		Oid fnoid = InvalidOid;
-		Oid type = InvalidOid;
-		Oid finaltype = InvalidOid;
-		Oid aggtype;
-		Var *v;
-		Node *result;
+		WindowDef *win = linitial(context.windows);
+		SortBy *sort = linitial(win->orderClause);
 
-		extract_agg_final_info((Node *) target->expr, &fnoid, &type, &finaltype);
-		GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
+		Assert(IsA(sort->node, ColumnRef));
 
-		aggtype = OidIsValid(statetype) ? statetype : finaltype;
+		return (ColumnRef *) sort->node;
+	}
 
-		v = makeVar(var->varno, cvatt, aggtype, InvalidOid, InvalidOid, InvalidOid);
-		args = make_combine_args(pstate, combineinfn, (Node *) v);
+	return NULL;
+}
 
-		if (over)
-		{
-			WindowFunc *wfunc = makeNode(WindowFunc);
+/*
+ * remove_conjunct
+ *
+ * Removes the given top-level conjunct from a raw WHERE clause
+ */
+static Node *
+remove_conjunct(Node *where, Node *conjunct)
+{
+	BoolExpr *be;
+	ListCell *lc;
 
-			wfunc->winfnoid = fnoid;
-			wfunc->wintype = aggtype;
-			wfunc->args = args;
-			wfunc->winstar = false;
-			wfunc->winagg = true;
-			wfunc->aggfilter = filter;
-			wfunc->winaggkind = AGGKIND_COMBINE;
+	if (where == conjunct)
+		return NULL;
 
-			transformWindowFuncCall(pstate, wfunc, over);
+	if (!IsA(where, BoolExpr) || ((BoolExpr *) where)->boolop != AND_EXPR)
+		return where;
 
-			result = (Node *) wfunc;
-		}
-		else
+	be = (BoolExpr *) where;
+
+	foreach(lc, be->args)
+	{
+		Node *arg = (Node *) lfirst(lc);
+
+		if (arg == conjunct)
 		{
-			Aggref *agg = makeNode(Aggref);
-			Aggref *orig_agg = (Aggref *) target->expr;
+			be->args = list_delete_ptr(be->args, arg);
+			break;
+		}
 
-			Assert(IsA(orig_agg, Aggref));
+		lfirst(lc) = remove_conjunct(arg, conjunct);
+	}
 
-			agg->aggfnoid = fnoid;
-			agg->aggtype = aggtype;
-			agg->args = args;
-			agg->aggstar = false;
-			agg->aggfilter = filter;
-			agg->aggkind = AGGKIND_COMBINE;
-			agg->orig_args = orig_agg->args;
-			agg->orig_directargs = orig_agg->aggdirectargs;
-			agg->orig_order = orig_agg->aggorder;
+	if (list_length(be->args) == 1)
+		return (Node *) linitial(be->args);
 
-			transformAggregateCall(pstate, agg, args, order, false);
+	return where;
+}
 
-			result = (Node *) agg;
+/*
+ * strip_node_locations
+ *
+ * Removes all location fields from a node string, since they only depend on how the query was written
+ */
+static void
+strip_node_locations(char *str)
+{
+	char *src = str;
+	char *dst = str;
+
+	while (*src)
+	{
+		if (strncmp(src, " :location ", 11) == 0)
+		{
+			src += 11;
+			if (*src == '-')
+				src++;
+			while (isdigit((unsigned char) *src))
+				src++;
+			continue;
 		}
 
-		/* combines on continuous views should always finalize */
-		return coerce_to_finalize(pstate, fnoid, type, finaltype, result, combineinfn);
+		*dst++ = *src++;
 	}
 
-	/* TODO(usmanm): Eventually we should support nested aggregates and aggregates in expressions */
-	ereport(ERROR,
-			(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-			errmsg("combine called with an invalid expression"),
-			errhint("combine must be called with a single aggregate continuous view column reference.")));
+	*dst = '\0';
 }
 
 /*
- * ParseFinalizeFuncCall
+ * GetSWStepKey
+ *
+ * Returns a string that is the same for all sliding-window views whose workers produce the same
+ * step-level partial results, that is views reading the same stream with the same filter, grouping
+ * and aggregates that only differ in window length. Only windows over arrival_timestamp are considered,
+ * since their predicate never filters out an event by the time workers read it. Returns NULL for
+ * any other view.
  */
-Node *
-ParseFinalizeFuncCall(ParseState *pstate, List *fargs, int location)
+char *
+GetSWStepKey(RangeVar *cv)
 {
-	Node *arg;
-	Var *var;
-	Oid cvid;
-	RangeTblEntry *rte;
-	RangeVar *matrelrv;
-	Relation rel;
-	List *vars;
+	SelectStmt *sel;
+	SelectStmt *proc;
+	ContAnalyzeContext context;
+	A_Expr *sw_expr;
+	Node *time;
+	Query *query;
+	char *key;
 
-	if (list_length(fargs) != 1)
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-				 errmsg("finalize called with %d arguments", list_length(fargs)),
-				 errhint("finalize must be called with a single expression as its argument.")));
-	}
+	sel = get_cont_query_select_stmt(cv);
 
-	arg = linitial(fargs);
+	if (!has_clock_timestamp(sel->whereClause, NULL))
+		return NULL;
 
-	if (IsA(arg, Aggref))
-	{
-		Aggref *agg = (Aggref *) arg;
+	proc = TransformSelectStmtForContProcess(GetMatRelName(cv), sel, NULL, Worker);
 
-		if (!AGGKIND_IS_COMBINE(agg->aggkind))
-			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-					errmsg("finalize called with an invalid expression"),
-					errhint("finalize must be called with a single column reference or a combine(...) as its argument.")));
+	MemSet(&context, 0, sizeof(ContAnalyzeContext));
+	find_clock_timestamp_expr(proc->whereClause, &context);
 
-		arg = linitial(agg->args);
-	}
-	else if (IsA(arg, WindowFunc))
-	{
-		WindowFunc *win = (WindowFunc *) arg;
+	if (context.expr == NULL || !IsA(context.expr, A_Expr))
+		return NULL;
 
-		if (!AGGKIND_IS_COMBINE(win->winaggkind))
-			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-					errmsg("finalize called with an invalid expression"),
-					errhint("finalize must be called with a single column reference or a combine(...) as its argument.")));
+	sw_expr = (A_Expr *) context.expr;
+	time = has_clock_timestamp(sw_expr->lexpr, NULL) ? sw_expr->rexpr : sw_expr->lexpr;
 
-		arg = linitial(win->args);
-	}
+	if (!IsA(time, ColumnRef) || pg_strcasecmp(FigureColname(time), ARRIVAL_TIMESTAMP) != 0)
+		return NULL;
 
-	/* The argument could be wrapped in a transout function */
-	vars = pull_var_and_aggs(arg);
+	proc->whereClause = remove_conjunct(proc->whereClause, (Node *) sw_expr);
 
-	if (list_length(vars) != 1)
+	query = parse_analyze((Node *) proc, "SELECT", 0, 0);
+
+	/* the step factor depends on the window length, but the resulting step is part of the query */
+	query->swStepFactor = 0;
+
+	key = nodeToString(query);
+	strip_node_locations(key);
+
+	return key;
+}
+
+/*
+ * CreateOuterSWTimeColumnRef
+ *
+ * If arrival_timestamp isn't found in an RTE, this hook is invoked by the parser.
+ * It ultimately allows us to try to push any references to arrival_timestamp down.
+ * This makes it easy to create sliding-window views on top of other sliding-window
+ * views because we can just push down the arrival_timestamp predicate down to the
+ * matrel SELECT.
+ */
+Node *
+CreateOuterSWTimeColumnRef(ParseState *pstate, ColumnRef *cref, Node *var)
+{
+	Var *result;
+	char *nspname = NULL;
+	char *relname = NULL;
+	char *colname = NULL;
+	RangeTblEntry *rte = NULL;
+	int	levels_up;
+	RangeVar *rv;
+	ColumnRef *sw_cref;
+
+	if (var != NULL)
+		return NULL;
+
+	/* Try to figure out the name of the sliding window timestamp column */
+	switch (list_length(cref->fields))
 	{
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-				 errmsg("finalize called with an invalid expression"),
-				 errhint("finalize must be called with a single column reference or a combine(...) as its argument.")));
+		case 1:
+		{
+			Assert(list_length(pstate->p_rtable) == 1);
+			rte = linitial(pstate->p_rtable);
+			colname = FigureColname((Node *) cref);
+			break;
+		}
+		case 2:
+		{
+			relname = strVal(linitial(cref->fields));
+			colname = strVal(lsecond(cref->fields));
+			rte = refnameRangeTblEntry(pstate, nspname, relname,
+					cref->location,
+					&levels_up);
+			break;
+		}
+		case 3:
+		{
+			nspname = strVal(linitial(cref->fields));
+			relname = strVal(lsecond(cref->fields));
+			colname = strVal(lthird(cref->fields));
+			rte = refnameRangeTblEntry(pstate, nspname, relname,
+					cref->location,
+					&levels_up);
+			break;
+		}
+		case 4:
+		{
+			nspname = strVal(lsecond(cref->fields));
+			relname = strVal(lthird(cref->fields));
+			colname = strVal(lfourth(cref->fields));
+			rte = refnameRangeTblEntry(pstate, nspname, relname,
+					cref->location,
+					&levels_up);
+			break;
+		}
+		default:
+			return NULL;
 	}
 
-	var = (Var *) linitial(vars);
-	rte = list_nth(pstate->p_rtable, var->varno - 1);
+	if (rte->relkind != RELKIND_CONTVIEW)
+		return NULL;
 
-	rel = heap_open(rte->relid, NoLock);
-	matrelrv = makeRangeVar(get_namespace_name(RelationGetNamespace(rel)), RelationGetRelationName(rel), -1);
-	relation_close(rel, NoLock);
+	rv = makeRangeVar(
+			get_namespace_name(get_rel_namespace(rte->relid)), get_rel_name(rte->relid), -1);
+
+	if (!GetGCFlag(rv))
+		return NULL;
+
+	sw_cref = GetSWTimeColumn(rv);
+	Assert(sw_cref);
+
+	/*
+	 * TODO(usmanm): For now we always allow ARRIVAL_TIMESTAMP because max_age hard codes it.
+	 * Should fix it.
+	 */
+	if (pg_strcasecmp(colname, FigureColname((Node *) sw_cref)) != 0 &&
+			pg_strcasecmp(colname, ARRIVAL_TIMESTAMP) != 0)
+		return NULL;
 
-	if (!RelIdIsForMatRel(rte->relid, &cvid))
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-				 errmsg("\"%s\" is not a continuous view", matrelrv->relname),
-				 errhint("Only aggregate continuous view columns can be finalized.")));
-	}
+	/* we only need to do something if the column couldn't be resolved at this level */
+	result = makeVar(SW_TIMESTAMP_REF, 1, TIMESTAMPTZOID, -1, InvalidOid, 0);
 
-	return make_finalize_for_viewdef(pstate, cvid, var, linitial(fargs));
+	return (Node *) result;
 }
 
 /*
- * CollectUserCombines
+ * GetContinuousViewOption
  *
- * Collect all combine aggregate calls
+ * Returns the given option or NULL if it wasn't supplied
  */
-static bool
-collect_combines_aggs(Node *node, List **combines)
+DefElem *
+GetContinuousViewOption(List *options, char *name)
 {
-	if (node == NULL)
-		return false;
+	ListCell *lc;
 
-	if (IsA(node, Aggref))
-	{
-		if (AGGKIND_IS_COMBINE(((Aggref *) node)->aggkind))
-			*combines = lappend(*combines, node);
-	}
-	else if (IsA(node, WindowFunc))
+	foreach(lc, options)
 	{
-		if (AGGKIND_IS_COMBINE(((WindowFunc *) node)->winaggkind))
-			*combines = lappend(*combines, node);
+		DefElem *de;
+
+		if (!IsA(lfirst(lc), DefElem))
+			continue;
+
+		de = (DefElem *) lfirst(lc);
+		if (de->defname && pg_strcasecmp(de->defname, name) == 0)
+			return de;
 	}
 
-	return expression_tree_walker(node, collect_combines_aggs, combines);
+	return NULL;
 }
 
-static bool
-pull_vars(Node *node, List **varlist)
+/*
+ * ApplyMaxAge
+ *
+ * Transforms a max_age WITH parameter into a sliding-window WHERE predicate
+ */
+void
+ApplyMaxAge(SelectStmt *stmt, DefElem *max_age)
 {
-	if (node == NULL)
-		return false;
+	A_Expr *where;
+	FuncCall *clock_ts;
+	TypeCast *interval;
+	A_Const *arg;
+	A_Expr *rexpr;
+	ColumnRef *arrival_ts;
+	RangeVar *sw_cv;
 
-	if (IsA(node, Var))
+	if (has_clock_timestamp(stmt->whereClause, NULL))
+		elog(ERROR, "cannot specify both \"max_age\" and a sliding window expression in the WHERE clause");
+
+	sw_cv = GetSWContinuousViewRangeVar(stmt->fromClause);
+	if (sw_cv == NULL && stmt->forContinuousView == false)
+		elog(ERROR, "\"max_age\" can only be specified when reading from a stream or continuous view");
+
+	if (!IsA(max_age->arg, String))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"max_age\" must be a valid interval string"),
+				 errhint("For example, ... WITH (max_age = '1 hour') ...")));
+
+	arg = makeNode(A_Const);
+	arg->val = *((Value *) max_age->arg);
+
+	interval = makeNode(TypeCast);
+	interval->arg = (Node *) arg;
+	interval->typeName = SystemTypeName("interval");
+
+	/*
+	 * If we are creating a view on top a continuous view, we must ensure that the step_size of the
+	 * continuous view is at most MIN_VIEW_MAX_AGE_FACTOR of the max_age being specified.
+	 */
+	if (sw_cv)
 	{
-		*varlist = lappend(*varlist, node);
-		return false;
+		Interval *sw_interval = GetSWInterval(sw_cv);
+		int step_factor = GetContWorkerQuery(sw_cv)->swStepFactor;
+		Interval *view_interval = parse_node_to_interval((Node *) interval);
+		Interval *step_interval;
+		Interval *min_interval;
+		bool is_lt;
+
+		Assert(sw_interval);
+
+		step_interval = DatumGetIntervalP(DirectFunctionCall2(
+				interval_mul, PointerGetDatum(sw_interval), Float8GetDatum(step_factor / (float8) 100.0)));
+		min_interval = DatumGetIntervalP(DirectFunctionCall2(
+				interval_div, PointerGetDatum(step_interval), Float8GetDatum(MIN_VIEW_MAX_AGE_FACTOR)));
+		is_lt = DatumGetBool(DirectFunctionCall2(
+				interval_lt, PointerGetDatum(view_interval), PointerGetDatum(min_interval)));
+
+		if (is_lt)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("\"max_age\" value is too small"),
+					errhint("\"max_age\" must be at least twice as much as the step size of the base continuous view.")));
 	}
 
-	return expression_tree_walker(node, pull_var_and_aggs_walker,
-								  (void *) varlist);
+	arrival_ts = makeNode(ColumnRef);
+	arrival_ts->fields = list_make1(makeString(ARRIVAL_TIMESTAMP));
+
+	clock_ts = makeNode(FuncCall);
+	clock_ts->funcname = list_make1(makeString(CLOCK_TIMESTAMP));
+
+	rexpr = makeA_Expr(AEXPR_OP, list_make1(makeString("-")), (Node *) clock_ts, (Node *) interval, -1);
+	where = makeA_Expr(AEXPR_OP, list_make1(makeString(">")), (Node *) arrival_ts, (Node *) rexpr, -1);
+
+	if (stmt->whereClause)
+	  stmt->whereClause = (Node *) makeBoolExpr(AND_EXPR, list_make2(where, stmt->whereClause), -1);
+	else
+	  stmt->whereClause = (Node *) where;
 }
 
 /*
- * push_down_sw_predicate
+ * interval_option_ms
  *
- * Push down any upper sliding-window predicates to the matrel SELECT.
- * This makes it possible to create multiple sliding windows over the same
- * continuous view.
+ * Get the value of an interval-valued view option in milliseconds
  */
-static void
-push_down_sw_predicate(Var *dummy, Query *upper, Query *lower)
+static int
+interval_option_ms(DefElem *def)
 {
-	List *vars = NIL;
-	Var *real;
-
-	pull_vars(lower->jointree->quals, &vars);
+	Interval *interval;
+	double ms;
 
-	if (list_length(vars) != 1)
-		elog(ERROR, "column \"arrival_timestamp\" does not exist");
+	if (!IsA(def->arg, String))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"%s\" must be a valid interval string", def->defname),
+				 errhint("For example, ... WITH (%s = '5 minutes') ...", def->defname)));
 
-	/* sliding window predicates should only have a single qual */
-	if (!IsA(lower->jointree->quals, OpExpr))
-		elog(ERROR, "column \"arrival_timestamp\" does not exist");
+	interval = DatumGetIntervalP(DirectFunctionCall3(interval_in, CStringGetDatum(strVal(def->arg)),
+			ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)));
+	ms = 1000 * DatumGetFloat8(DirectFunctionCall2(interval_part,
+			CStringGetTextDatum("epoch"), IntervalPGetDatum(interval)));
 
-	real = (Var *) linitial(vars);
+	if (ms <= 0 || ms > INT_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"%s\" must be a positive interval of at most %d milliseconds", def->defname, INT_MAX)));
 
-	memcpy(dummy, real, sizeof(Var));
-	lower->jointree->quals = upper->jointree->quals;
-	upper->jointree->quals = (Node *) NIL;
+	return (int) ms;
 }
 
 /*
- * get_dummy_sw_predicate
+ * downsample_interval_us
  *
- * Returns a placeholder sliding-window predicate that should be pushed down,
- * or NULL if one doesn't exist.
+ * Get the length in microseconds of one of the intervals of a downsample policy, counting days
+ * as 24 hours since buckets are aligned to fixed lengths of time
  */
-static Var *
-get_dummy_sw_predicate(Node *where)
+static int64
+downsample_interval_us(char *str)
 {
-	List *vars = NIL;
-	Var *var;
+	Interval *interval = DatumGetIntervalP(DirectFunctionCall3(interval_in, CStringGetDatum(str),
+			ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)));
+	int64 us;
 
-	pull_vars(where, &vars);
+	if (interval->month)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"downsample\" intervals cannot have month or year units")));
 
-	if (list_length(vars) != 1)
-		return NULL;
+#ifdef HAVE_INT64_TIMESTAMP
+	us = interval->time + interval->day * USECS_PER_DAY;
+#else
+	us = (int64) ((interval->time + interval->day * (double) SECS_PER_DAY) * USECS_PER_SEC);
+#endif
 
-	var = (Var *) linitial(vars);
-	if (IS_SW_TIMESTAMP_REF(var))
-		return var;
+	if (us <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"downsample\" intervals must be positive")));
 
-	return NULL;
+	return us;
 }
 
 /*
- * RewriteContinuousViewSelect
+ * ParseDownsamplePolicy
  *
- * Possibly modify an overlay view SELECT rule before it's applied.
- * This is mainly used for user_combines where we strip away the finalize function
- * and put it on the *outer* SELECT.
+ * Parses a downsample policy such as '1 day: 1 hour, 30 days: 1 day' into a list of DownsampleRules,
+ * each giving the age after which groups are merged into time buckets of the given resolution. Both
+ * the ages and the resolutions must increase from one rule to the next.
  */
-Query *
-RewriteContinuousViewSelect(Query *query, Query *rule, Relation cv, int rtindex)
+List *
+ParseDownsamplePolicy(char *policy)
 {
-	RangeVar *rv = makeRangeVar(get_namespace_name(RelationGetNamespace(cv)), RelationGetRelationName(cv), -1);
-	List *combines = NIL;
-	ListCell *lc;
-	RangeTblEntry *rte;
-	Var *dummy;
+	List *rules = NIL;
+	DownsampleRule *prev = NULL;
+	char *str = pstrdup(policy);
 
-	/* RTE is not a view? */
-	rte = rt_fetch(rtindex, query->rtable);
-	if (rte->relkind != RELKIND_CONTVIEW)
-		return rule;
+	while (str)
+	{
+		char *next = strchr(str, ',');
+		char *sep;
+		DownsampleRule *rule;
 
-	/* try to bail early because this gets called from a hot path */
-	if (!IsAContinuousView(rv))
-		return rule;
+		if (next)
+			*next++ = '\0';
 
-	/*
-	 * If there is an upper reference to arrival_timestamp, push it down
-	 * to the matrel select.
-	 */
-	dummy = get_dummy_sw_predicate(query->jointree->quals);
-	if (dummy)
-		push_down_sw_predicate(dummy, query, rule);
+		sep = strchr(str, ':');
+		if (sep == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid \"downsample\" policy \"%s\"", policy),
+					 errhint("For example, ... WITH (downsample = '1 day: 1 hour, 30 days: 1 day') ...")));
+		*sep = '\0';
 
-	/* We only need to rewrite the overlay view definition if there are some user defines */
-	collect_combines_aggs((Node *) query->targetList, &combines);
-	if (list_length(combines) == 0)
-		return rule;
+		rule = palloc0(sizeof(DownsampleRule));
+		rule->after = downsample_interval_us(str);
+		rule->resolution = downsample_interval_us(sep + 1);
 
-	/* Remove finalize from any aggregate targets that are in combines */
-	foreach(lc, combines)
-	{
-		List *l = NIL;
-		Var *v;
-		Node *agg;
-		TargetEntry *te;
-		Oid fnoid = InvalidOid;
-		Oid type;
-		Oid finaltype;
-		Oid finalfn;
-		HeapTuple tup;
-		Form_pg_aggregate aggform;
-		FuncExpr *fexpr;
-		Expr *expr;
-		Oid combinefn;
-		Oid transoutfn;
-		Oid combineinfn;
-		Oid statetype;
+		if (prev && (rule->after <= prev->after || rule->resolution <= prev->resolution))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("the ages and resolutions of a \"downsample\" policy must increase")));
 
-		pull_vars(lfirst(lc), &l);
-		Assert(list_length(l) == 1);
-		v = (Var *) linitial(l);
+		rules = lappend(rules, rule);
+		prev = rule;
+		str = next;
+	}
 
-		/* Not reading from us? */
-		if (v->varno != rtindex)
-			continue;
+	return rules;
+}
 
-		l = pull_var_and_aggs(lfirst(lc));
-		Assert(list_length(l) == 1);
-		agg = (Node *) linitial(l);
+/*
+ * ApplyStorageOptions
+ */
+void
+ApplyStorageOptions(CreateContViewStmt *stmt)
+{
+	DefElem *def;
+	SelectStmt *select = (SelectStmt *) stmt->query;
+	ContAnalyzeContext context;
+	ListCell *lc;
+
+	/* max_age */
+	def = GetContinuousViewOption(stmt->into->options, OPTION_MAX_AGE);
+	if (def)
+	{
+		ApplyMaxAge(select, def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
+
+	/* step_factor */
+	select->swStepFactor = 0;
+	select->swStepAuto = false;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_STEP_FACTOR);
+	if (def)
+	{
+		double factor;
 
-		if (!IsA(agg, Aggref) && !IsA(agg, WindowFunc))
+		if (!has_clock_timestamp(select->whereClause, NULL))
+			elog(ERROR, "can only specify \"step_factor\" for sliding window queries");
+
+		/* Adaptive views start out with the default step factor */
+		if (IsA(def->arg, String) && pg_strcasecmp(strVal(def->arg), STEP_FACTOR_AUTO) == 0)
 		{
-			/* WTF? */
-			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
-					errmsg("combine called with an invalid expression"),
-					errhint("combine must be called with a single aggregate continuous view column reference.")));
+			select->swStepAuto = true;
+			factor = sliding_window_step_factor;
 		}
+		else if (IsA(def->arg, Integer))
+			factor = intVal(def->arg);
+		else
+			factor = floatVal(def->arg);
 
-		extract_agg_final_info(agg, &fnoid, &type, &finaltype);
+		if (factor <= 0 || factor > 50)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"step_size\" must be a valid float in the range 0..50"),
+					 errhint("For example, ... WITH (step_factor = '25') ...")));
 
-		tup = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(fnoid));
-		if (!HeapTupleIsValid(tup))
-			elog(ERROR, "cache lookup failed for aggregate %u", fnoid);
-		aggform = (Form_pg_aggregate) GETSTRUCT(tup);
-		finalfn = aggform->aggfinalfn;
-		ReleaseSysCache(tup);
+		select->swStepFactor = factor;
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
+	else
+		select->swStepFactor = sliding_window_step_factor;
 
-		/* No finalize func? */
-		if (!OidIsValid(finalfn))
-			continue;
+	/* allowed_lateness */
+	select->swAllowedLateness = 0;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_ALLOWED_LATENESS);
+	if (def)
+	{
+		if (!has_clock_timestamp(select->whereClause, NULL))
+			elog(ERROR, "can only specify \"allowed_lateness\" for sliding window queries");
 
-		te = list_nth(rule->targetList, v->varattno - 1);
+		select->swAllowedLateness = interval_option_ms(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-		Assert(IsA(te->expr, FuncExpr));
+	/* freeze_after */
+	select->freezeAfter = 0;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_FREEZE_AFTER);
+	if (def)
+	{
+		if (!select->groupClause)
+			elog(ERROR, "can only specify \"freeze_after\" for queries grouping by a time bucket");
 
-		/* Strip away the finalize func */
-		fexpr = (FuncExpr *) te->expr;
+		select->freezeAfter = interval_option_ms(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-		Assert(fexpr->funcid == finalfn);
-		expr = linitial(fexpr->args);
+	/* pool */
+	select->workerPool = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_POOL);
+	if (def)
+	{
+		char *pool = defGetString(def);
 
-		GetCombineInfo(fnoid, &combinefn, &transoutfn, &combineinfn, &statetype);
+		if (GetWorkerPoolId(pool) < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_OBJECT),
+					 errmsg("worker pool \"%s\" does not exist", pool),
+					 errhint("Worker pools are configured with continuous_query_worker_pools.")));
 
-		/* XXX(usmanm): We can probably avoid this extra serialize/deserialize step */
-		if (OidIsValid(transoutfn))
-		{
-			fexpr->funcid = transoutfn;
-			fexpr->funcresulttype = statetype;
-		}
-		else
-			te->expr = expr;
+		if (GetWorkerPoolId(pool) != DEFAULT_WORKER_POOL)
+			select->workerPool = pstrdup(pool);
+
+		stmt->into->options = list_delete(stmt->into->options, def);
 	}
 
-	return rule;
-}
+	/* delta_merge */
+	select->deltaMerge = false;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_DELTA_MERGE);
+	if (def)
+	{
+		select->deltaMerge = defGetBoolean(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-/*
- * GetSWExpr
- */
-Node *
-GetSWExpr(RangeVar *cv)
-{
-	SelectStmt *view;
-	SelectStmt *sel;
+	if (select->deltaMerge)
+	{
+		MemSet(&context, 0, sizeof(ContAnalyzeContext));
+		collect_windows(select, &context);
 
-	sel = get_cont_query_select_stmt(cv);
-	TransformSelectStmtForContProcess(cv, sel, &view, Worker);
+		if (has_clock_timestamp(select->whereClause, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"delta_merge\" is not supported for sliding window queries")));
 
-	return view->whereClause;
-}
+		if (list_length(context.windows) || select->distinctClause)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"delta_merge\" is not supported for queries with WINDOWs or DISTINCT clauses")));
 
-static Interval *
-parse_node_to_interval(Node *inode)
-{
-	ExprState *estate;
-	ParseState *ps = make_parsestate(NULL);
-	Expr *expr;
-	Datum d;
-	ExprContext *econtext = CreateStandaloneExprContext();
-	bool isnull;
+		if (GetContinuousViewOption(stmt->into->options, OPTION_PK))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"delta_merge\" cannot be combined with a \"pk\" option"),
+					errhint("Each group may be stored as several rows, so it can't have a primary key of its own.")));
+	}
 
-	inode = transformExpr(ps, (Node *) inode, EXPR_KIND_OTHER);
-	expr = expression_planner((Expr *) inode);
+	/* lazy_grouping_sets */
+	select->lazyGroupingSets = false;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_LAZY_GROUPING_SETS);
+	if (def)
+	{
+		select->lazyGroupingSets = defGetBoolean(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-	estate = ExecInitExpr(expr, NULL);
-	d = ExecEvalExpr(estate, econtext, &isnull, NULL);
+	if (select->lazyGroupingSets)
+	{
+		bool has_sets = false;
 
-	free_parsestate(ps);
-	FreeExprContext(econtext, false);
+		foreach(lc, select->groupClause)
+		{
+			if (IsA(lfirst(lc), GroupingSet))
+				has_sets = true;
+		}
 
-	return DatumGetIntervalP(d);
-}
+		if (!has_sets)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("\"lazy_grouping_sets\" requires a GROUPING SETS, ROLLUP or CUBE clause")));
+	}
 
-/*
- * GetSWInterval
- *
- * Returns the interval associated with a SW
- */
-Interval *
-GetSWInterval(RangeVar *rv)
-{
-	Node *sw_expr = GetSWExpr(rv);
-	ContAnalyzeContext context;
-	Node *expr;
+	/* output_interval */
+	select->outputInterval = 0;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_OUTPUT_INTERVAL);
+	if (def)
+	{
+		select->outputInterval = interval_option_ms(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-	find_clock_timestamp_expr(sw_expr, &context);
-	Assert(IsA(context.expr, A_Expr));
+	/* output_threshold and output_threshold_column */
+	select->outputThreshold = 0;
+	select->outputThresholdColumn = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_OUTPUT_THRESHOLD);
+	if (def)
+	{
+		DefElem *col = GetContinuousViewOption(stmt->into->options, OPTION_OUTPUT_THRESHOLD_COLUMN);
 
-	/* arrival_timestamp > clock_timestamp() - interval... */
-	expr = ((A_Expr *) context.expr)->rexpr;
-	Assert(IsA(expr, A_Expr));
+		if (col == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"output_threshold\" requires an \"output_threshold_column\""),
+					 errhint("For example, ... WITH (output_threshold = 10, output_threshold_column = 'total') ...")));
 
-	expr = ((A_Expr *) expr)->rexpr;
+		if (IsA(def->arg, Integer))
+			select->outputThreshold = intVal(def->arg);
+		else
+			select->outputThreshold = floatVal(def->arg);
 
-	return parse_node_to_interval(expr);
-}
+		if (select->outputThreshold < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"output_threshold\" must be a non-negative number")));
 
-ColumnRef *
-GetSWTimeColumn(RangeVar *rv)
-{
-	Node *expr = GetSWExpr(rv);
-	ContAnalyzeContext context;
+		select->outputThresholdColumn = pstrdup(defGetString(col));
+		stmt->into->options = list_delete(stmt->into->options, def);
+		stmt->into->options = list_delete(stmt->into->options, col);
+	}
+	else if (GetContinuousViewOption(stmt->into->options, OPTION_OUTPUT_THRESHOLD_COLUMN))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"output_threshold_column\" requires an \"output_threshold\"")));
 
-	if (expr == NULL)
-		return NULL;
+	if (select->outputInterval || select->outputThresholdColumn)
+	{
+		if (has_clock_timestamp(select->whereClause, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("output stream coalescing is not supported for sliding window queries")));
 
-	context.cols = NIL;
-	context.types = NIL;
+		if (select->deltaMerge)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("output stream coalescing cannot be combined with \"delta_merge\"")));
+	}
 
-	collect_types_and_cols(expr, &context);
+	/* notify and notify_key */
+	select->notifyChannel = NULL;
+	select->notifyKey = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_NOTIFY);
+	if (def)
+	{
+		DefElem *key = GetContinuousViewOption(stmt->into->options, OPTION_NOTIFY_KEY);
 
-	Assert(list_length(context.cols) == 1);
+		select->notifyChannel = pstrdup(defGetString(def));
+		if (strlen(select->notifyChannel) == 0 || strlen(select->notifyChannel) >= NAMEDATALEN)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"notify\" must be a channel name of at most %d characters", NAMEDATALEN - 1)));
 
-	return linitial(context.cols);
-}
+		if (key)
+		{
+			select->notifyKey = pstrdup(defGetString(key));
+			stmt->into->options = list_delete(stmt->into->options, key);
+		}
+		stmt->into->options = list_delete(stmt->into->options, def);
 
-ColumnRef *
-GetWindowTimeColumn(RangeVar *cv)
-{
-	SelectStmt *view;
-	SelectStmt *sel;
-	ContAnalyzeContext context;
+		if (has_clock_timestamp(select->whereClause, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"notify\" is not supported for sliding window queries")));
+	}
+	else if (GetContinuousViewOption(stmt->into->options, OPTION_NOTIFY_KEY))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"notify_key\" requires a \"notify\" channel"),
+				 errhint("For example, ... WITH (notify = 'view_changes', notify_key = 'user_id') ...")));
 
-	sel = get_cont_query_select_stmt(cv);
-	TransformSelectStmtForContProcess(cv, sel, &view, Worker);
+	/* finalize_cache */
+	select->finalizeCache = false;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_FINALIZE_CACHE);
+	if (def)
+	{
+		select->finalizeCache = defGetBoolean(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-	if (view->whereClause)
+	if (select->finalizeCache)
 	{
-		context.cols = NIL;
-		context.types = NIL;
+		/* these views aggregate over several matrel rows on read, so there is no per-row value to cache */
+		MemSet(&context, 0, sizeof(ContAnalyzeContext));
+		collect_windows(select, &context);
 
-		collect_types_and_cols(view->whereClause, &context);
+		if (has_clock_timestamp(select->whereClause, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"finalize_cache\" is not supported for sliding window queries")));
 
-		Assert(list_length(context.cols) == 1);
+		if (list_length(context.windows))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"finalize_cache\" is not supported for queries with WINDOWs")));
 
-		return linitial(context.cols);
-	}
+		if (select->deltaMerge)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"finalize_cache\" cannot be combined with \"delta_merge\"")));
 
-	context.windows = NIL;
-	collect_windows(view, &context);
+		if (select->lazyGroupingSets)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"finalize_cache\" cannot be combined with \"lazy_grouping_sets\"")));
+	}
 
-	if (list_length(context.windows))
+	/* read_cache_key */
+	select->readCacheKey = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_READ_CACHE_KEY);
+	if (def)
 	{
-		WindowDef *win = linitial(context.windows);
-		SortBy *sort = linitial(win->orderClause);
+		select->readCacheKey = pstrdup(defGetString(def));
+		stmt->into->options = list_delete(stmt->into->options, def);
 
-		Assert(IsA(sort->node, ColumnRef));
+		/* cached rows must be the view's rows, so each group must have exactly one matrel row */
+		MemSet(&context, 0, sizeof(ContAnalyzeContext));
+		collect_windows(select, &context);
 
-		return (ColumnRef *) sort->node;
+		if (has_clock_timestamp(select->whereClause, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"read_cache_key\" is not supported for sliding window queries")));
+
+		if (list_length(context.windows))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"read_cache_key\" is not supported for queries with WINDOWs")));
+
+		if (select->deltaMerge)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"read_cache_key\" cannot be combined with \"delta_merge\"")));
+
+		if (select->lazyGroupingSets)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"read_cache_key\" cannot be combined with \"lazy_grouping_sets\"")));
 	}
 
-	return NULL;
-}
+	/* ttl and ttl_column */
+	select->ttl = 0;
+	select->ttlColumn = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_TTL);
+	if (def)
+	{
+		DefElem *col = GetContinuousViewOption(stmt->into->options, OPTION_TTL_COLUMN);
 
-/*
- * CreateOuterSWTimeColumnRef
- *
- * If arrival_timestamp isn't found in an RTE, this hook is invoked by the parser.
- * It ultimately allows us to try to push any references to arrival_timestamp down.
- * This makes it easy to create sliding-window views on top of other sliding-window
- * views because we can just push down the arrival_timestamp predicate down to the
- * matrel SELECT.
- */
-Node *
-CreateOuterSWTimeColumnRef(ParseState *pstate, ColumnRef *cref, Node *var)
-{
-	Var *result;
-	char *nspname = NULL;
-	char *relname = NULL;
-	char *colname = NULL;
-	RangeTblEntry *rte = NULL;
-	int	levels_up;
-	RangeVar *rv;
-	ColumnRef *sw_cref;
+		if (has_clock_timestamp(select->whereClause, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"ttl\" is not supported for sliding window queries"),
+					errhint("Rows of sliding window queries are already deleted once they leave the window.")));
 
-	if (var != NULL)
-		return NULL;
+		if (!select->groupClause)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"ttl\" requires a GROUP BY clause")));
 
-	/* Try to figure out the name of the sliding window timestamp column */
-	switch (list_length(cref->fields))
-	{
-		case 1:
-		{
-			Assert(list_length(pstate->p_rtable) == 1);
-			rte = linitial(pstate->p_rtable);
-			colname = FigureColname((Node *) cref);
-			break;
-		}
-		case 2:
-		{
-			relname = strVal(linitial(cref->fields));
-			colname = strVal(lsecond(cref->fields));
-			rte = refnameRangeTblEntry(pstate, nspname, relname,
-					cref->location,
-					&levels_up);
-			break;
-		}
-		case 3:
+		/* each group of a delta_merge view may have several rows, of which only some may be expired */
+		if (select->deltaMerge)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"ttl\" cannot be combined with \"delta_merge\"")));
+
+		select->ttl = interval_option_ms(def);
+
+		if (col)
 		{
-			nspname = strVal(linitial(cref->fields));
-			relname = strVal(lsecond(cref->fields));
-			colname = strVal(lthird(cref->fields));
-			rte = refnameRangeTblEntry(pstate, nspname, relname,
-					cref->location,
-					&levels_up);
-			break;
+			select->ttlColumn = pstrdup(defGetString(col));
+			stmt->into->options = list_delete(stmt->into->options, col);
 		}
-		case 4:
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
+	else if (GetContinuousViewOption(stmt->into->options, OPTION_TTL_COLUMN))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"ttl_column\" requires a \"ttl\""),
+				 errhint("For example, ... WITH (ttl = '1 day', ttl_column = 'last_seen') ...")));
+
+	/* downsample and downsample_column */
+	select->downsample = NULL;
+	select->downsampleColumn = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_DOWNSAMPLE);
+	if (def)
+	{
+		DefElem *col = GetContinuousViewOption(stmt->into->options, OPTION_DOWNSAMPLE_COLUMN);
+
+		if (has_clock_timestamp(select->whereClause, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"downsample\" is not supported for sliding window queries")));
+
+		if (!select->groupClause)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"downsample\" requires a GROUP BY clause")));
+
+		/* groups are merged into their coarser buckets as a single row */
+		if (select->deltaMerge)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"downsample\" cannot be combined with \"delta_merge\"")));
+
+		/* frozen buckets don't take any more updates */
+		if (select->freezeAfter)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"downsample\" cannot be combined with \"freeze_after\"")));
+
+		select->downsample = pstrdup(defGetString(def));
+		ParseDownsamplePolicy(select->downsample);
+
+		if (col)
 		{
-			nspname = strVal(lsecond(cref->fields));
-			relname = strVal(lthird(cref->fields));
-			colname = strVal(lfourth(cref->fields));
-			rte = refnameRangeTblEntry(pstate, nspname, relname,
-					cref->location,
-					&levels_up);
-			break;
+			select->downsampleColumn = pstrdup(defGetString(col));
+			stmt->into->options = list_delete(stmt->into->options, col);
 		}
-		default:
-			return NULL;
+		stmt->into->options = list_delete(stmt->into->options, def);
 	}
+	else if (GetContinuousViewOption(stmt->into->options, OPTION_DOWNSAMPLE_COLUMN))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"downsample_column\" requires a \"downsample\""),
+				 errhint("For example, ... WITH (downsample = '1 day: 1 hour', downsample_column = 'minute') ...")));
 
-	if (rte->relkind != RELKIND_CONTVIEW)
-		return NULL;
+	/* cluster_groups */
+	select->clusterGroups = false;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_CLUSTER_GROUPS);
+	if (def)
+	{
+		select->clusterGroups = defGetBoolean(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
 
-	rv = makeRangeVar(
-			get_namespace_name(get_rel_namespace(rte->relid)), get_rel_name(rte->relid), -1);
+		/* groups are clustered by the hash they're looked up with */
+		if (select->clusterGroups && !select->groupClause)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"cluster_groups\" requires a GROUP BY clause")));
+	}
 
-	if (!GetGCFlag(rv))
-		return NULL;
+	/* merge_group */
+	select->mergeGroup = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_MERGE_GROUP);
+	if (def)
+	{
+		/* only grouped aggregates are merged, by the grouping of their worker plans */
+		if (!select->groupClause)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"merge_group\" requires a GROUP BY clause")));
 
-	sw_cref = GetSWTimeColumn(rv);
-	Assert(sw_cref);
+		select->mergeGroup = pstrdup(defGetString(def));
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-	/*
-	 * TODO(usmanm): For now we always allow ARRIVAL_TIMESTAMP because max_age hard codes it.
-	 * Should fix it.
-	 */
-	if (pg_strcasecmp(colname, FigureColname((Node *) sw_cref)) != 0 &&
-			pg_strcasecmp(colname, ARRIVAL_TIMESTAMP) != 0)
-		return NULL;
+	/* checkpoint_interval */
+	select->checkpointInterval = 0;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_CHECKPOINT_INTERVAL);
+	if (def)
+	{
+		select->checkpointInterval = interval_option_ms(def);
+		stmt->into->options = list_delete(stmt->into->options, def);
+	}
 
-	/* we only need to do something if the column couldn't be resolved at this level */
-	result = makeVar(SW_TIMESTAMP_REF, 1, TIMESTAMPTZOID, -1, InvalidOid, 0);
+	/* top_n and top_n_column */
+	select->topN = 0;
+	select->topNColumn = NULL;
+	def = GetContinuousViewOption(stmt->into->options, OPTION_TOP_N);
+	if (def)
+	{
+		DefElem *col = GetContinuousViewOption(stmt->into->options, OPTION_TOP_N_COLUMN);
+		int64 n = defGetInt64(def);
 
-	return (Node *) result;
-}
+		if (col == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"top_n\" requires a \"top_n_column\""),
+					 errhint("For example, ... WITH (top_n = 10, top_n_column = 'total') ...")));
 
-/*
- * GetContinuousViewOption
- *
- * Returns the given option or NULL if it wasn't supplied
- */
-DefElem *
-GetContinuousViewOption(List *options, char *name)
-{
-	ListCell *lc;
+		if (n <= 0 || n > INT_MAX)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"top_n\" must be a positive integer")));
 
-	foreach(lc, options)
-	{
-		DefElem *de;
+		if (!select->groupClause)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"top_n\" requires a GROUP BY clause")));
 
-		if (!IsA(lfirst(lc), DefElem))
-			continue;
+		MemSet(&context, 0, sizeof(ContAnalyzeContext));
+		collect_windows(select, &context);
 
-		de = (DefElem *) lfirst(lc);
-		if (de->defname && pg_strcasecmp(de->defname, name) == 0)
-			return de;
+		if (has_clock_timestamp(select->whereClause, NULL) || list_length(context.windows))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"top_n\" is not supported for sliding window queries or queries with WINDOWs")));
+
+		/* the groups competing for the top must each be stored as exactly one row */
+		if (select->deltaMerge || select->lazyGroupingSets)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("\"top_n\" cannot be combined with \"delta_merge\" or \"lazy_grouping_sets\"")));
+
+		select->topN = (int) n;
+		select->topNColumn = pstrdup(defGetString(col));
+		stmt->into->options = list_delete(stmt->into->options, def);
+		stmt->into->options = list_delete(stmt->into->options, col);
 	}
+	else if (GetContinuousViewOption(stmt->into->options, OPTION_TOP_N_COLUMN))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"top_n_column\" requires a \"top_n\"")));
 
-	return NULL;
+	ApplySampleOption(select, stmt->into);
+	ApplyDedupOptions(select, stmt->into);
+	ApplyJoinWindowOption(select, stmt->into);
+	ApplyMaxStalenessOption(select, stmt->into);
 }
 
 /*
- * ApplyMaxAge
+ * ApplySampleOption
  *
- * Transforms a max_age WITH parameter into a sliding-window WHERE predicate
+ * Continuous views and transforms can read a random sample of their streams' events
  */
 void
-ApplyMaxAge(SelectStmt *stmt, DefElem *max_age)
+ApplySampleOption(SelectStmt *select, IntoClause *into)
 {
-	A_Expr *where;
-	FuncCall *clock_ts;
-	TypeCast *interval;
-	A_Const *arg;
-	A_Expr *rexpr;
-	ColumnRef *arrival_ts;
-	RangeVar *sw_cv;
+	DefElem *def;
+	double rate;
 
-	if (has_clock_timestamp(stmt->whereClause, NULL))
-		elog(ERROR, "cannot specify both \"max_age\" and a sliding window expression in the WHERE clause");
+	select->sampleRate = 0;
+	def = GetContinuousViewOption(into->options, OPTION_SAMPLE);
+	if (!def)
+		return;
 
-	sw_cv = GetSWContinuousViewRangeVar(stmt->fromClause);
-	if (sw_cv == NULL && stmt->forContinuousView == false)
-		elog(ERROR, "\"max_age\" can only be specified when reading from a stream or continuous view");
+	if (IsA(def->arg, Integer))
+		rate = intVal(def->arg);
+	else if (IsA(def->arg, Float))
+		rate = floatVal(def->arg);
+	else
+		rate = -1;
 
-	if (!IsA(max_age->arg, String))
+	if (rate <= 0 || rate > 1)
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("\"max_age\" must be a valid interval string"),
-				 errhint("For example, ... WITH (max_age = '1 hour') ...")));
-
-	arg = makeNode(A_Const);
-	arg->val = *((Value *) max_age->arg);
-
-	interval = makeNode(TypeCast);
-	interval->arg = (Node *) arg;
-	interval->typeName = SystemTypeName("interval");
+				 errmsg("\"sample\" must be a fraction in the range (0, 1]"),
+				 errhint("For example, ... WITH (sample = 0.01) ...")));
 
-	/*
-	 * If we are creating a view on top a continuous view, we must ensure that the step_size of the
-	 * continuous view is at most MIN_VIEW_MAX_AGE_FACTOR of the max_age being specified.
-	 */
-	if (sw_cv)
-	{
-		Interval *sw_interval = GetSWInterval(sw_cv);
-		int step_factor = GetContWorkerQuery(sw_cv)->swStepFactor;
-		Interval *view_interval = parse_node_to_interval((Node *) interval);
-		Interval *step_interval;
-		Interval *min_interval;
-		bool is_lt;
+	/* reading everything is what we do without the option anyways */
+	if (rate < 1)
+		select->sampleRate = rate;
 
-		Assert(sw_interval);
+	into->options = list_delete(into->options, def);
+}
 
-		step_interval = DatumGetIntervalP(DirectFunctionCall2(
-				interval_mul, PointerGetDatum(sw_interval), Float8GetDatum(step_factor / (float8) 100.0)));
-		min_interval = DatumGetIntervalP(DirectFunctionCall2(
-				interval_div, PointerGetDatum(step_interval), Float8GetDatum(MIN_VIEW_MAX_AGE_FACTOR)));
-		is_lt = DatumGetBool(DirectFunctionCall2(
-				interval_lt, PointerGetDatum(view_interval), PointerGetDatum(min_interval)));
+/*
+ * ApplyDedupOptions
+ *
+ * Continuous views and transforms can drop events whose key was already seen within a window
+ */
+void
+ApplyDedupOptions(SelectStmt *select, IntoClause *into)
+{
+	DefElem *key = GetContinuousViewOption(into->options, OPTION_DEDUP_KEY);
+	DefElem *window = GetContinuousViewOption(into->options, OPTION_DEDUP_WINDOW);
 
-		if (is_lt)
-			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-					errmsg("\"max_age\" value is too small"),
-					errhint("\"max_age\" must be at least twice as much as the step size of the base continuous view.")));
-	}
+	select->dedupKey = NULL;
+	select->dedupWindow = 0;
 
-	arrival_ts = makeNode(ColumnRef);
-	arrival_ts->fields = list_make1(makeString(ARRIVAL_TIMESTAMP));
+	if (!key && !window)
+		return;
 
-	clock_ts = makeNode(FuncCall);
-	clock_ts->funcname = list_make1(makeString(CLOCK_TIMESTAMP));
+	if (!key || !window)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"dedup_key\" and \"dedup_window\" must be given together"),
+				 errhint("For example, ... WITH (dedup_key = 'request_id', dedup_window = '10 minutes') ...")));
 
-	rexpr = makeA_Expr(AEXPR_OP, list_make1(makeString("-")), (Node *) clock_ts, (Node *) interval, -1);
-	where = makeA_Expr(AEXPR_OP, list_make1(makeString(">")), (Node *) arrival_ts, (Node *) rexpr, -1);
+	select->dedupKey = pstrdup(defGetString(key));
+	select->dedupWindow = interval_option_ms(window);
 
-	if (stmt->whereClause)
-	  stmt->whereClause = (Node *) makeBoolExpr(AND_EXPR, list_make2(where, stmt->whereClause), -1);
-	else
-	  stmt->whereClause = (Node *) where;
+	into->options = list_delete(into->options, key);
+	into->options = list_delete(into->options, window);
 }
 
 /*
- * ApplyStorageOptions
+ * ApplyJoinWindowOption
+ *
+ * Continuous views and transforms may join two streams, each event of one being joined with the
+ * events of the other that arrived within the join window
  */
 void
-ApplyStorageOptions(CreateContViewStmt *stmt)
+ApplyJoinWindowOption(SelectStmt *select, IntoClause *into)
 {
-	DefElem *def;
-	SelectStmt *select = (SelectStmt *) stmt->query;
-
-	/* max_age */
-	def = GetContinuousViewOption(stmt->into->options, OPTION_MAX_AGE);
-	if (def)
-	{
-		ApplyMaxAge(select, def);
-		stmt->into->options = list_delete(stmt->into->options, def);
-	}
+	DefElem *def = GetContinuousViewOption(into->options, OPTION_JOIN_WINDOW);
 
-	/* step_factor */
-	select->swStepFactor = 0;
-	def = GetContinuousViewOption(stmt->into->options, OPTION_STEP_FACTOR);
-	if (def)
-	{
-		double factor;
+	select->joinWindow = 0;
+	if (!def)
+		return;
 
-		if (!has_clock_timestamp(select->whereClause, NULL))
-			elog(ERROR, "can only specify \"step_factor\" for sliding window queries");
+	select->joinWindow = interval_option_ms(def);
+	into->options = list_delete(into->options, def);
+}
 
-		if (IsA(def->arg, Integer))
-			factor = intVal(def->arg);
-		else
-			factor = floatVal(def->arg);
+/*
+ * ApplyMaxStalenessOption
+ *
+ * Continuous views and transforms can have workers drop the events that arrived longer
+ * ago than max_staleness without reading them, so that they catch up right away after falling
+ * behind instead of working through the whole backlog
+ */
+void
+ApplyMaxStalenessOption(SelectStmt *select, IntoClause *into)
+{
+	DefElem *def = GetContinuousViewOption(into->options, OPTION_MAX_STALENESS);
 
-		if (factor <= 0 || factor > 50)
-			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-					 errmsg("\"step_size\" must be a valid float in the range 0..50"),
-					 errhint("For example, ... WITH (step_factor = '25') ...")));
+	select->maxStaleness = 0;
+	if (!def)
+		return;
 
-		select->swStepFactor = factor;
-		stmt->into->options = list_delete(stmt->into->options, def);
-	}
-	else
-		select->swStepFactor = sliding_window_step_factor;
+	select->maxStaleness = interval_option_ms(def);
+	into->options = list_delete(into->options, def);
 }
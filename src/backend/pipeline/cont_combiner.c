@@ -12,20 +12,39 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
+#include "access/genam.h"
+#include "access/hio.h"
 #include "access/htup_details.h"
+#include "access/itup.h"
+#include "access/relscan.h"
+#include "access/sysattr.h"
+#include "access/tuptoaster.h"
 #include "access/xact.h"
+#include "access/xlog.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pipeline_combine.h"
 #include "catalog/pipeline_query.h"
 #include "catalog/pipeline_query_fn.h"
+#include "catalog/pipeline_stream_batch_fn.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "commands/async.h"
 #include "commands/sequence.h"
+#include "commands/tablecmds.h"
 #include "executor/execdesc.h"
 #include "executor/executor.h"
+#include "executor/instrument.h"
 #include "executor/tstoreReceiver.h"
 #include "executor/tupletableReceiver.h"
+#include "lib/binaryheap.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
 #include "optimizer/paths.h"
 #include "parser/parse_clause.h"
 #include "parser/parse_coerce.h"
@@ -34,16 +53,28 @@
 #include "parser/parse_oper.h"
 #include "parser/parse_type.h"
 #include "pgstat.h"
+#include "pipeline/bloom.h"
+#include "pipeline/cmsketch.h"
 #include "pipeline/combinerReceiver.h"
 #include "pipeline/cont_analyze.h"
+#include "pipeline/cont_instrument.h"
+#include "pipeline/cont_memory.h"
 #include "pipeline/cont_plan.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/cqmatrel.h"
+#include "pipeline/hll.h"
 #include "pipeline/miscutils.h"
+#include "pipeline/read_cache.h"
 #include "pipeline/stream.h"
+#include "pipeline/stream_batch.h"
 #include "pipeline/stream_fdw.h"
+#include "pipeline/stream_log.h"
 #include "pipeline/sw_vacuum.h"
+#include "pipeline/tdigest.h"
+#include "storage/bufmgr.h"
 #include "storage/ipc.h"
+#include "storage/lmgr.h"
+#include "storage/smgr.h"
 #include "tcop/dest.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
@@ -52,6 +83,7 @@
 #include "utils/fmgroids.h"
 #include "utils/hashfuncs.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/pipelinefuncs.h"
@@ -60,8 +92,14 @@
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/timestamp.h"
+#include "utils/tqual.h"
+#include "utils/tuplesort.h"
+#include "utils/typcache.h"
 
 #define GROUPS_PLAN_LIFESPAN (10 * 1000)
+#define GROUP_CACHE_ENTRY_SIZE(entry) \
+	(sizeof(GroupCacheEntry) + GetMemoryChunkSpace((entry)->base.shared.firstTuple) + \
+	 GetMemoryChunkSpace((entry)->base.tuple))
 #define MURMUR_SEED 0x155517D2
 
 /*
@@ -70,9 +108,86 @@
  */
 #define EXISTING_ADDED 0x1
 
+/*
+ * Flag that indicates that a group cache entry was written by an earlier sync and
+ * must be checked against its on-disk tuple before it's used again.
+ */
+#define EXISTING_CACHED 0x2
+
+/*
+ * Flag that indicates that an on-disk tuple's group hash has been computed and kept in its entry
+ */
+#define EXISTING_HASHED 0x4
+
 #define OLD_TUPLE 0
 #define NEW_TUPLE 1
 
+/* Maximum number of new groups to buffer before inserting them all at once */
+#define MAX_BUFFERED_INSERTS 1000
+
+/*
+ * Views with an adaptive fillfactor: the number of group updates observed before choosing a new
+ * fillfactor, the HOT update rate below which it's lowered, and by how much
+ */
+#define FILLFACTOR_MIN_UPDATES 10000
+#define FILLFACTOR_MIN_HOT_RATE 0.9
+#define FILLFACTOR_STEP 10
+
+/* How often in ms to retry combining or forwarding partial results held back by a shard hand-off */
+#define HANDOFF_RETRY_MS 10
+
+/* False positive rate of group filters, and the fewest hashes their first filter is sized for */
+#define GROUP_FILTER_P 0.01
+#define GROUP_FILTER_MIN_N 4096
+
+int continuous_query_combiner_group_cache_mem;
+bool continuous_query_combiner_inplace_updates;
+bool continuous_query_combiner_group_filter;
+int continuous_query_delta_compaction_interval;
+bool continuous_query_combiner_reuse_result_rels;
+bool continuous_query_combiner_isolate_syncs;
+bool continuous_query_combiner_incremental_sw;
+int continuous_query_combiner_sw_cache_mem;
+int sliding_window_auto_step_rows;
+bool continuous_query_combiner_adaptive_fillfactor;
+bool continuous_query_combiner_batch_index_inserts;
+int continuous_view_min_fillfactor;
+int continuous_view_ttl_batch_size;
+
+/* memory used by the sliding-window caches of all views in this process */
+static Size sw_cache_bytes = 0;
+
+/* incremented by every relcache invalidation that may affect a kept matrel ResultRelInfo */
+static uint64 combiner_rel_invals = 0;
+
+/* relcache invalidations of each matrel with a group filter, see matrel_invals */
+typedef struct MatRelInvalsEntry
+{
+	Oid relid;
+	uint64 invals;
+} MatRelInvalsEntry;
+
+static HTAB *group_filter_invals = NULL;
+
+/*
+ * Stream batch ids of the partial results combined since we last committed, and whether we may
+ * have recorded any that haven't been removed yet
+ */
+static HTAB *batch_ids = NULL;
+static bool recorded_batch_ids = true;
+
+/*
+ * Partial results of shards that were moved to another combiner, which couldn't be forwarded
+ * to it yet because its queue was full
+ */
+typedef struct UnforwardedPartial
+{
+	PartialTupleState *pts;
+	int len;
+} UnforwardedPartial;
+
+static List *unforwarded = NIL;
+
 typedef struct
 {
 	AttrNumber arrival_ts_attr;
@@ -85,14 +200,117 @@ typedef struct
 	MemoryContext context;
 	TimestampTz last_tick;
 	TimestampTz last_matrel_sync;
+	/* matrel attributes of the overlay's grouping columns, and their positions in its output */
+	int n_group_attr;
+	AttrNumber *step_group_idx;
+	AttrNumber *overlay_group_idx;
+	TupleTableSlot *key_slot;
+	/* cached step groups, bucketed by step modulo the number of steps in the window */
+	List **ring;
+	int nsteps;
+	int64 expired_step;
+	/* overlay groups whose steps have changed since they were last computed */
+	List *dirty;
+	/* approximate memory used by cached groups, and the overlay groups whose steps were evicted */
+	Size cache_bytes;
+	List *evicted;
+	/* step size the ring was built for */
+	int step_ms;
+	/* matrel rows inserted since the step size of an adaptive view was last checked */
+	TimestampTz observed_since;
+	int64 new_steps;
+	/* latest window time seen in partial results for our shards, for views with allowed_lateness */
+	TimestampTz watermark;
 } SWOutputState;
 
 typedef struct
 {
 	HeapTupleEntryData base;
 	TimestampTz last_touched;
+	/* this group's cached step groups, which make up its window */
+	List *steps;
+	bool dirty;
+	/* set whenever this group is used, and cleared by each sweep of the eviction clock */
+	bool referenced;
+	/* whether some of this group's steps were evicted, and the range of step times they covered */
+	bool evicted;
+	TimestampTz oldest_step;
+	TimestampTz newest_step;
 } OverlayTupleEntry;
 
+typedef struct
+{
+	HeapTupleEntryData base;
+	OverlayTupleEntry *group;
+} StepTupleEntry;
+
+/* approximate memory used by cached sliding-window tuples, including the copy of their key kept by the hash table */
+#define SW_TUPLE_SIZE(len) (MAXALIGN(HEAPTUPLESIZE + (len)))
+#define SW_STEP_SIZE(entry) (MAXALIGN(sizeof(StepTupleEntry)) + \
+		SW_TUPLE_SIZE((entry)->base.shared.firstTuple->t_len) + SW_TUPLE_SIZE((entry)->base.tuple->t_len))
+#define SW_GROUP_SIZE(entry) (MAXALIGN(sizeof(OverlayTupleEntry)) + \
+		SW_TUPLE_SIZE((entry)->base.shared.firstTuple->t_len))
+
+typedef struct
+{
+	HeapTupleEntryData base;
+	bool referenced;
+} GroupCacheEntry;
+
+typedef struct
+{
+	HeapTupleEntryData base;
+	/* rows of this group other than base.tuple, which are merged into it by compaction */
+	List *deltas;
+} DeltaGroupEntry;
+
+typedef struct
+{
+	TupleHashEntryData shared;
+	TimestampTz last_output;
+	/* the group's overlay row as last written to the output stream, and the update held back since */
+	Datum output;
+	Datum pending;
+} OutputGroupEntry;
+
+/* Aggregate states that combiners can merge without executing the combine plan */
+typedef enum
+{
+	NATIVE_MERGE_NONE = 0,
+	NATIVE_MERGE_HLL,
+	NATIVE_MERGE_BLOOM,
+	NATIVE_MERGE_CMSKETCH,
+	NATIVE_MERGE_TDIGEST
+} NativeMergeKind;
+
+typedef struct
+{
+	HeapTupleEntryData base;
+	/* the group's values, with merged states replacing those of base.tuple */
+	Datum *values;
+	bool *nulls;
+} NativeGroupEntry;
+
+/*
+ * A rollup of a view, whose partial results our combiners derive from the view's own, see load_rollups
+ */
+typedef struct RollupState
+{
+	Oid id;
+	TupleDesc desc;
+	TupleTableSlot *slot;
+	ProjectionInfo *proj;
+	ExprContext *econtext;
+	/* rollup matrel attribute of each projected column */
+	AttrNumber *attmap;
+	int natts;
+	Datum *values;
+	bool *nulls;
+	FuncExpr *hashfunc;
+	FunctionCallInfo hash_fcinfo;
+	uint64 name_hash;
+} RollupState;
+
 typedef struct
 {
 	ContQueryState base;
@@ -102,7 +320,7 @@ typedef struct
 	TupleDesc desc;
 	MemoryContext plan_cache_cxt;
 	MemoryContext combine_cxt;
-	Tuplestorestate *batch;
+	TupleBatch *batch;
 	TupleTableSlot *slot;
 	TupleTableSlot *prev_slot;
 	TupleTableSlot *os_slot;
@@ -113,16 +331,92 @@ typedef struct
 	FmgrInfo *hash_funcs;
 	Oid *groupops;
 	FuncExpr *hashfunc;
+	/* btree index on hashfunc that groups are looked up with, if there is one */
+	Oid hash_index;
+	RegProcedure hash_index_eqproc;
+	RegProcedure hash_index_leproc;
+	/* evaluates hashfunc for on-disk tuples when there's a hash_index */
+	FmgrInfo hash_flinfo;
+	FunctionCallInfoData hash_fcinfo;
+	/*
+	 * Combiners of views with a hash_index: a filter of the hashes of every group in the matrel,
+	 * which the groups it rules out aren't looked up for. It's built from the index as of
+	 * GetCombinerShardReleases being group_filter_releases and matrel_invals being
+	 * group_filter_invals, and the hashes of the groups we insert are added to it.
+	 */
+	BloomFilter *group_filter;
+	uint64 group_filter_releases;
+	uint64 group_filter_invals;
 	TupleHashTable existing;
+	/*
+	 * If all of the query's aggregates only keep the greatest or least value they've seen,
+	 * like max, min and bool_or, these are the matrel columns they're stored in and the
+	 * operators that tell whether a new value would replace a stored one
+	 */
+	int nmonotone;
+	AttrNumber *monotone_atts;
+	FmgrInfo *monotone_ops;
+	/*
+	 * If all of the query's aggregates are sketches, these are indexed by matrel attribute
+	 * and give how each column's states are merged and the transition out function applied
+	 * to merged states. Groups are then merged into native_groups until the next sync.
+	 */
+	NativeMergeKind *native_merges;
+	Oid *native_transouts;
+	TupleHashTable native_groups;
+	/* if set, existing is kept across syncs in this context as a group cache */
+	MemoryContext group_cache_cxt;
+	/* set once the state uses more than continuous_query_state_mem, until its caches are released */
+	bool over_mem_limit;
 	Tuplestorestate *combined;
 	long pending_tuples;
 
-	/* Stores the hashes of the current batch, in parallel to the order of the batch's tuplestore */
+	/* partial results of shards being handed off to us, which are combined once the hand-off completes */
+	List *deferred;
+
+	/*
+	 * The matrel's ResultRelInfo kept across syncs, along with its index OIDs and the value of
+	 * combiner_rel_invals it was built at. Its index relations are only open during syncs.
+	 */
+	MemoryContext matrel_ri_cxt;
+	ResultRelInfo *matrel_ri;
+	Oid *matrel_indexes;
+	Bitmapset *matrel_indexed;
+	uint64 matrel_ri_invals;
+
+	/* the matrel's relfilenode as of our last combine, which TRUNCATE CONTINUOUS VIEW replaces */
+	Oid matrel_relfilenode;
+
+	/* insert time of the oldest event behind the partial results combined since the last sync */
+	TimestampTz oldest_insert;
+	/* arrival time of the newest event behind them, and of the newest one synced but not yet committed */
+	TimestampTz newest_arrival;
+	TimestampTz synced_arrival;
+
+	/* Stores the hashes of the current batch, in parallel to the order of the batch's tuples */
 	int64 *group_hashes;
 	int group_hashes_len;
+
+	/* Delta-merge views: hashes of the groups that were given delta rows since the last compaction */
+	int64 *delta_hashes;
+	int delta_hashes_len;
+	int ndelta_hashes;
+	TimestampTz last_compaction;
 	AttrNumber pk;
 	bool seq_pk;
 
+	/* the block of sequence primary keys being assigned to new groups, and the sequence's relfilenode then */
+	int64 pk_next;
+	int64 pk_end;
+	Oid pk_relfilenode;
+
+	/* number of rows the last run of the combine plan output */
+	uint64 ncombined;
+
+	/* Views with freeze_after: the matrel's time bucket column and the latest bucket seen for our shards */
+	AttrNumber freeze_attr;
+	TimestampTz freeze_watermark;
+
 	/* Projection to execute on output stream tuples */
 	ProjectionInfo *output_stream_proj;
 	TupleTableSlot *proj_input_slot;
@@ -131,6 +425,81 @@ typedef struct
 	TupleTableSlot *overlay_slot;
 	AttrNumber output_stream_arrival_ts;
 
+	/*
+	 * Views with output_interval or output_threshold: the last row written to the output stream for
+	 * each group and any update held back since, the overlay column compared against the threshold,
+	 * and when the next held back update is due
+	 */
+	TupleHashTable output_groups;
+	AttrNumber output_threshold_attr;
+	Oid output_threshold_type;
+	TimestampTz output_flush_at;
+
+	/* Views with a notify channel: the group attribute sent as payload, if any, and its output function */
+	AttrNumber notify_attr;
+	FmgrInfo notify_out;
+
+	/*
+	 * Views with finalize_cache: the matrel attributes holding finalized overlay values, and
+	 * the overlay attributes they're projected from
+	 */
+	int ncached;
+	AttrNumber *cached_attrs;
+	AttrNumber *cached_overlay_attrs;
+	Datum *cached_values;
+	bool *cached_nulls;
+	bool *cached_replace;
+
+	/*
+	 * Rollups of the view, loaded in rollup_cxt as of combiner_rel_invals being rollups_invals, and the
+	 * partial results derived for them since the last commit, which are forwarded once it's committed
+	 */
+	MemoryContext rollup_cxt;
+	List *rollups;
+	bool rollups_loaded;
+	uint64 rollups_invals;
+	MemoryContext rollup_partials_cxt;
+	List *rollup_partials;
+
+	/* updates of existing groups since the matrel's fillfactor was last chosen, and how many were HOT */
+	int64 ff_updates;
+	int64 ff_hot_updates;
+
+	/*
+	 * Views with a read_cache_key: the group attribute rows are cached by and its output function, and
+	 * the rows synced since the last commit, which are written to the read cache once it's committed.
+	 * read_cache_overflow is set if they're not all of the synced rows.
+	 */
+	AttrNumber read_cache_attr;
+	FmgrInfo read_cache_out;
+	MemoryContext read_cache_cxt;
+	List *read_cache_rows;
+	bool read_cache_overflow;
+	bool read_cache_synced;
+	uint64 read_cache_generation;
+
+	/*
+	 * Views with a ttl: the matrel attribute their groups expire by, the btree index on it if there
+	 * is one, and when we last deleted expired groups
+	 */
+	AttrNumber ttl_attr;
+	Oid ttl_index;
+	TimestampTz last_expiry;
+
+	/*
+	 * Top-N views: the matrel attribute groups are ranked by, and when we last pruned our groups.
+	 * If we had more groups than we keep then, new groups must reach the smallest value we kept
+	 * to be stored.
+	 */
+	AttrNumber top_n_attr;
+	Oid top_n_type;
+	bool top_n_full;
+	float8 top_n_threshold;
+	TimestampTz last_top_n_prune;
+
+	/* Views with an unlogged matrel: when we last checkpointed it */
+	TimestampTz last_checkpoint;
+
 	/* Sliding-window state */
 	SWOutputState *sw;
 
@@ -156,7 +525,7 @@ prepare_combine_plan(ContQueryCombinerState *state, PlannedStmt *plan)
 
 	plan->isContinuous = false;
 
-	scan = SetCombinerPlanTuplestorestate(plan, state->batch);
+	scan = SetCombinerPlanTupleBatch(plan, state->batch);
 	scan->desc = CreateTupleDescCopy(RelationGetDescr(rel));
 
 	state->combine_plan = plan;
@@ -190,7 +559,7 @@ get_values(ContQueryCombinerState *state)
 	 * was already generated by the worker when determining which combiner process to
 	 * send tuples to since we shard on groups.
 	 */
-	foreach_tuple(slot, state->batch)
+	foreach_batch_tuple(slot, state->batch)
 	{
 		Type typeinfo;
 		Form_pg_type typ;
@@ -357,1317 +726,6339 @@ get_cached_groups_plan(ContQueryCombinerState *state, List *values)
 	return plan;
 }
 
+static int
+int64_cmp(const void *a, const void *b)
+{
+	int64 l = *(const int64 *) a;
+	int64 r = *(const int64 *) b;
+
+	if (l < r)
+		return -1;
+	if (l > r)
+		return 1;
+	return 0;
+}
+
 /*
- * hash_groups
+ * sort_hashes
  *
- * Stores all of the tuples in the given tuplestore into a hashtable, keyed
- * by their grouping columns
+ * Sorts the given hashes and removes duplicates, returning the number of distinct hashes
  */
-static TupleHashTable
-hash_groups(ContQueryCombinerState *state)
+static int
+sort_hashes(int64 *hashes, int n)
 {
-	TupleHashTable existing = state->existing;
-	TupleHashTable groups = NULL;
-	bool isnew = false;
-	TupleTableSlot *slot = state->slot;
-	MemoryContext cxt = AllocSetContextCreate(CurrentMemoryContext, "CombinerGroupsHashTableCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
-	MemoryContext tmp_cxt = AllocSetContextCreate(cxt, "CombinerGroupsHashTableTmpCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
-
-	groups = BuildTupleHashTable(existing->numCols, existing->keyColIdx,
-			existing->tab_eq_funcs, existing->tab_hash_funcs, 1000,
-			existing->entrysize, cxt, tmp_cxt);
+	int pos;
+	int i;
 
-	tuplestore_rescan(state->batch);
+	if (n < 2)
+		return n;
 
-	foreach_tuple(slot, state->batch)
-		LookupTupleHashEntry(groups, slot, &isnew);
+	qsort(hashes, n, sizeof(int64), int64_cmp);
 
-	tuplestore_rescan(state->batch);
+	for (pos = 0, i = 1; i < n; i++)
+	{
+		if (hashes[i] != hashes[pos])
+			hashes[++pos] = hashes[i];
+	}
 
-	return groups;
+	return pos + 1;
 }
 
 /*
- * select_existing_groups
+ * group_filter_key
  *
- * Adds all existing groups in the matrel to the combine input set
+ * Group hashes of int4 hash functions may be widened differently, so they're only compared by
+ * their low 32 bits
+ */
+static inline int64
+group_filter_key(ContQueryCombinerState *state, int64 hash)
+{
+	if (state->hashfunc->funcresulttype == INT8OID)
+		return hash;
+
+	return (int64) (int32) hash;
+}
+
+/*
+ * add_to_group_filter
  */
 static void
-select_existing_groups(ContQueryCombinerState *state)
+add_to_group_filter(ContQueryCombinerState *state, int64 hash)
 {
-	TupleHashTable existing = state->existing;
-	PlannedStmt *plan = NULL;
-	Portal portal = NULL;
-	DestReceiver *dest;
-	HASH_SEQ_STATUS status;
-	HeapTupleEntry entry;
-	TupleTableSlot *slot = state->slot;
-	List *tups = NIL;
-	ListCell *lc;
-	List *values = NIL;
-	TupleHashTable batchgroups;
-	Relation matrel;
+	MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
+	int64 key = group_filter_key(state, hash);
 
-	if (state->isagg && state->ngroupatts > 0)
-	{
-		Assert(state->existing);
+	state->group_filter = BloomFilterAdd(state->group_filter, &key, sizeof(int64));
 
-		values = get_values(state);
+	MemoryContextSwitchTo(old);
+}
 
-		/*
-		 * If we're grouping and there aren't any uncached values to look up,
-		 * there is no need to execute a query.
-		 */
-		if (!values)
-			goto finish;
-	}
-	else if (state->isagg && state->ngroupatts == 0)
+/*
+ * forget_group_filter
+ */
+static void
+forget_group_filter(ContQueryCombinerState *state)
+{
+	if (state->group_filter)
+		BloomFilterDestroy(state->group_filter);
+	state->group_filter = NULL;
+}
+
+/*
+ * matrel_invals
+ *
+ * Returns how many relcache invalidations of the given matrel we've seen since we started
+ * counting them. Vacuums send them once they've removed dead groups, and pipeline_combine_table
+ * sends them once it has inserted groups of any shard.
+ */
+static uint64
+matrel_invals(Oid relid)
+{
+	MatRelInvalsEntry *entry;
+	bool found;
+
+	if (group_filter_invals == NULL)
 	{
-		/*
-		 * If we're not grouping on any columns, then there's only one row to look up
-		 * so we don't need to do a VALUES-matrel join. If it's already in existing, we're done
-		 */
-		if (hash_get_num_entries(state->existing->hashtab))
-			return;
-	}
+		HASHCTL ctl;
 
-	matrel = heap_openrv(state->base.query->matrel, RowShareLock);
+		MemSet(&ctl, 0, sizeof(HASHCTL));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(MatRelInvalsEntry);
+		ctl.hcxt = TopMemoryContext;
 
-	plan = get_cached_groups_plan(state, values);
+		group_filter_invals = hash_create("CombinerGroupFilterInvals", 32, &ctl,
+				HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
 
-	/*
-	 * Now run the query that retrieves existing tuples to merge this merge request with.
-	 * This query outputs to the tuplestore currently holding the incoming merge tuples.
-	 */
-	portal = CreatePortal("select_existing_groups", true, true);
-	portal->visible = false;
+	entry = (MatRelInvalsEntry *) hash_search(group_filter_invals, &relid, HASH_ENTER, &found);
+	if (!found)
+		entry->invals = 0;
 
-	PortalDefineQuery(portal,
-			NULL,
-			state->base.query->matrel->relname,
-			"SELECT",
-			list_make1(plan),
-			NULL);
+	return entry->invals;
+}
 
-	dest = CreateDestReceiver(DestTupleTable);
-	SetTupleTableDestReceiverParams(dest, existing, existing->tablecxt, true);
+/*
+ * build_group_filter
+ *
+ * Adds every hash in the group hash index to a new group filter. Entries of dead or uncommitted
+ * groups only make the filter less selective, so the index is read without a snapshot.
+ */
+static void
+build_group_filter(ContQueryCombinerState *state, Relation matrel, uint64 releases, uint64 invals)
+{
+	Relation index = index_open(state->hash_index, AccessShareLock);
+	MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
+	IndexScanDesc scan;
+	uint32 n = Max(index->rd_rel->reltuples, GROUP_FILTER_MIN_N);
 
-	PortalStart(portal, NULL, 0, NULL);
+	state->group_filter = BloomFilterCreateScalableWithPAndN(GROUP_FILTER_P, n);
+	state->group_filter_releases = releases;
+	state->group_filter_invals = invals;
 
-	(void) PortalRun(portal,
-					 FETCH_ALL,
-					 true,
-					 dest,
-					 dest,
-					 NULL);
-	PortalDrop(portal, false);
+	MemoryContextSwitchTo(old);
 
-	heap_close(matrel, NoLock);
+	scan = index_beginscan(matrel, index, SnapshotAny, 0, 0);
+	scan->xs_want_itup = true;
+	index_rescan(scan, NULL, 0, NULL, 0);
 
-finish:
-	batchgroups = hash_groups(state);
-	tuplestore_rescan(state->batch);
-	foreach_tuple(slot, state->batch)
+	while (index_getnext_tid(scan, ForwardScanDirection) != NULL)
 	{
-		HeapTuple tup = ExecCopySlotTuple(slot);
-		tups = lappend(tups, tup);
-	}
-	tuplestore_clear(state->batch);
+		bool isnull;
+		Datum d = index_getattr(scan->xs_itup, 1, scan->xs_itupdesc, &isnull);
 
-	/*
-	 * Now add the existing rows to the input of the final combine query
-	 */
-	hash_seq_init(&status, existing->hashtab);
-	while ((entry = (HeapTupleEntry) hash_seq_search(&status)) != NULL)
-	{
-		/*
-		 * We only need to add on-disk tuples to the input once, because they'll
-		 * be accumulated upon within the ongoing combine result until we sync.
-		 */
-		if (entry->flags & EXISTING_ADDED)
+		if (isnull)
 			continue;
 
-		/*
-		 * Our index can potentially have collisions, so we filter out any
-		 * tuples that were returned that aren't related to the batch we're
-		 * currently processing. This is just a matter of intersecting the
-		 * retrieved groups with the batch's groups.
-		 */
-		ExecStoreTuple(entry->tuple, slot, InvalidBuffer, false);
-		if (LookupTupleHashEntry(batchgroups, slot, NULL))
-		{
-			tuplestore_puttuple(state->batch, entry->tuple);
-			entry->flags |= EXISTING_ADDED;
-		}
-	}
-
-	foreach(lc, tups)
-	{
-		HeapTuple tup = (HeapTuple) lfirst(lc);
-		tuplestore_puttuple(state->batch, tup);
+		if (state->hashfunc->funcresulttype == INT8OID)
+			add_to_group_filter(state, DatumGetInt64(d));
+		else
+			add_to_group_filter(state, DatumGetInt32(d));
 	}
 
-	list_free(tups);
-	hash_destroy(batchgroups->hashtab);
+	index_endscan(scan);
+	index_close(index, NoLock);
 }
 
 /*
- * reset_existing_hashtable
+ * use_group_filter
  *
- * Free any memory associated with the given state's existing hashtable and
- * create a new hashtable.
+ * Determines whether the group filter can rule out lookups of the batch's groups, (re)building
+ * it if necessary. Only combiners use one, since the groups of their own shards are only ever inserted
+ * by them. A shard's previous owner may still insert its groups until it releases the shard though,
+ * so filters are rebuilt once any shard has been released since, as well as after anything that
+ * invalidates the matrel, which includes vacuums and pipeline_combine_table.
  */
-static TupleHashTable
-build_existing_hashtable(ContQueryCombinerState *state)
+static bool
+use_group_filter(ContQueryCombinerState *state, Relation matrel)
 {
-	MemoryContext existing_cxt = AllocSetContextCreate(state->combine_cxt, "CombinerExistingGroupsCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
-	MemoryContext existing_tmp_cxt = AllocSetContextCreate(existing_cxt, "CombinerExistingGroupsTmpCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
-	MemoryContext old = MemoryContextSwitchTo(state->combine_cxt);
-	TupleHashTable result;
+	uint64 releases;
+	uint64 invals;
 
-	result = BuildTupleHashTable(state->ngroupatts, state->groupatts, state->eq_funcs, state->hash_funcs, 1000,
-			sizeof(HeapTupleEntryData), existing_cxt, existing_tmp_cxt);
+	if (!continuous_query_combiner_group_filter || !am_cont_combiner)
+	{
+		forget_group_filter(state);
+		return false;
+	}
 
-	MemoryContextSwitchTo(old);
+	releases = GetCombinerShardReleases();
+	invals = matrel_invals(RelationGetRelid(matrel));
 
-	return result;
+	if (state->group_filter &&
+			(state->group_filter_releases != releases || state->group_filter_invals != invals))
+		forget_group_filter(state);
+
+	if (state->group_filter == NULL)
+		build_group_filter(state, matrel, releases, invals);
+
+	return true;
 }
 
 /*
- * build_projection
+ * get_hashes
+ *
+ * Returns the sorted, distinct group hashes of the batch's groups that aren't yet in existing,
+ * along with the number of partial results that belong to any of them. If filter is set, the
+ * groups the group filter rules out are left out and added to it, since they're about to be
+ * inserted.
  */
-static ProjectionInfo *
-build_projection(List *tlist, EState *estate, ExprContext *econtext,
-		TupleDesc input_desc)
+static int64 *
+get_hashes(ContQueryCombinerState *state, bool filter, int *nhashes, int *nmisses)
 {
-	TupleTableSlot *result_slot;
-	TupleDesc result_desc;
-	List *targetlist;
+	TupleTableSlot *slot = state->slot;
+	int64 *hashes = palloc(sizeof(int64) * state->group_hashes_len);
+	int pos = 0;
+	int n = 0;
+	int nnew = 0;
+	int misses = 0;
+	int i;
 
-	result_desc = ExecTypeFromTL(tlist, false);
-	result_slot = MakeSingleTupleTableSlot(result_desc);
-	targetlist = (List *) ExecPrepareExpr((Expr *) tlist, estate);
+	foreach_batch_tuple(slot, state->batch)
+	{
+		/* these are parallel to this tuplestore's underlying array of tuples */
+		if (!LookupTupleHashEntry(state->existing, slot, NULL))
+		{
+			int64 hash = state->group_hashes[pos];
+			int64 key = group_filter_key(state, hash);
+
+			/* new groups' hashes are kept at the end of hashes, which the others never reach */
+			if (filter && !BloomFilterContains(state->group_filter, &key, sizeof(int64)))
+				hashes[state->group_hashes_len - ++nnew] = hash;
+			else
+				hashes[n++] = hash;
+			misses++;
+		}
+		pos++;
+	}
 
-	return ExecBuildProjectionInfo(targetlist, econtext,
-								   result_slot, input_desc);
+	for (i = 0; i < nnew; i++)
+		add_to_group_filter(state, hashes[state->group_hashes_len - 1 - i]);
+
+	*nmisses = misses;
+	*nhashes = sort_hashes(hashes, n);
+
+	return hashes;
 }
 
 /*
- * project_overlay
+ * lock_group
+ *
+ * Locks the matrel tuple found at the given TID for update, returning a copy of
+ * its current version or NULL if it's been deleted. This does the same work as
+ * the PhysicalGroupLookup node does for planned lookups.
  */
-static Datum
-project_overlay(ContQueryCombinerState *state, HeapTuple tup, bool *isnull)
+static HeapTuple
+lock_group(Relation matrel, ItemPointer tid, EState **estate)
 {
-	TupleTableSlot *slot;
-	HeapTuple projected;
+	HeapTupleData tup;
+	HeapUpdateFailureData hufd;
+	HTSU_Result res;
+	Buffer buffer;
+	HeapTuple result = NULL;
 
-	if (!state->output_stream_proj)
-		return heap_copy_tuple_as_datum(tup, state->desc);
+	tup.t_self = *tid;
+	res = heap_lock_tuple(matrel, &tup, GetCurrentCommandId(false),
+			LockTupleExclusive, LockWaitBlock, true, &buffer, &hufd);
 
-	Assert(state->proj_input_slot);
+	switch (res)
+	{
+		case HeapTupleSelfUpdated:
+			/* This should NEVER happen, as a group is only looked up once per transaction */
+			elog(ERROR, "tuple updated again in the same transaction");
+			break;
 
-	/* Should we copy the input tuple so it doesn't get modified? */
-	ExecStoreTuple(tup, state->proj_input_slot, InvalidBuffer, false);
-	slot = ExecProject(state->output_stream_proj, NULL);
+		case HeapTupleMayBeUpdated:
+			result = heap_copytuple(&tup);
+			break;
 
-	if (TupIsNull(slot))
-	{
-		*isnull = true;
-		return (Datum) NULL;
+		case HeapTupleUpdated:
+			/* Was tuple deleted? */
+			if (ItemPointerEquals(&hufd.ctid, &tup.t_self))
+				break;
+
+			/* Tuple was updated, so fetch and lock the updated version */
+			if (*estate == NULL)
+			{
+				*estate = CreateExecutorState();
+				(*estate)->es_output_cid = GetCurrentCommandId(false);
+			}
+
+			result = EvalPlanQualFetch(*estate, matrel, LockTupleExclusive, false, &hufd.ctid, hufd.xmax);
+			break;
+
+		default:
+			elog(ERROR, "unrecognized heap_lock_tuple status: %u", res);
 	}
 
-	*isnull = false;
-	projected = ExecMaterializeSlot(slot);
+	ReleaseBuffer(buffer);
 
-	return heap_copy_tuple_as_datum(projected, state->overlay_desc);
+	return result;
 }
 
 /*
- * load_sw_matrel_groups
+ * Heap blocks of groups that are about to be read in order, which are prefetched up to
+ * target_prefetch_pages ahead of the group being read so that their reads overlap
+ */
+typedef struct GroupPrefetch
+{
+	Relation rel;
+	BlockNumber *blocks;
+	int nblocks;
+	int next; /* the next block to prefetch */
+	BlockNumber last; /* the block prefetched last */
+} GroupPrefetch;
+
+/*
+ * prefetch_groups
  *
- * Sync sliding-window matrel rows newer than the given timestamp
- * from disk into the local cache. If the cache already contains rows
- * covering the given timestamp, the matrel doesn't need to be scanned.
+ * Prefetches the blocks after the given position of a GroupPrefetch's blocks, which is the next one
+ * about to be read, that are within target_prefetch_pages of it. Blocks that aren't read
+ * are InvalidBlockNumber.
  */
 static void
-sync_sw_matrel_groups(ContQueryCombinerState *state, Relation matrel)
+prefetch_groups(GroupPrefetch *gp, int pos)
 {
-	HeapTuple tup = NULL;
-	HeapScanDesc scan;
-	ScanKeyData skey[1];
-	TimestampTz oldest;
-	FunctionCallInfoData hashfcinfo;
-	FmgrInfo flinfo;
-	int64 cv_name_hash;
-	bool close_matrel = matrel == NULL;
+#ifdef USE_PREFETCH
+	while (gp->next < gp->nblocks && gp->next <= pos + target_prefetch_pages)
+	{
+		BlockNumber block = gp->blocks[gp->next++];
 
-	/*
-	 * We only need to sync once, all other groups will be cached
-	 * from the combiner's output.
-	 */
-	if (state->sw->last_matrel_sync)
-		return;
+		/* consecutive groups are often on the same page, which is only prefetched once */
+		if (block == InvalidBlockNumber || block == gp->last)
+			continue;
 
-	/* If a matrel didn't get passed to us, we need to lock one ourselves */
-	if (matrel == NULL)
-		matrel = heap_openrv_extended(state->base.query->matrel, AccessShareLock, true);
+		PrefetchBuffer(gp->rel, MAIN_FORKNUM, block);
+		gp->last = block;
+	}
+#endif   /* USE_PREFETCH */
+}
 
-	if (matrel == NULL)
-		return;
+/*
+ * fetch_groups
+ *
+ * Probes the group hash index for each of the given sorted hashes, returning locked copies
+ * of all matrel rows found. Sorted probes mostly hit index pages that were just read. All
+ * hashes are probed before any rows are read, so that the rows' heap pages can be prefetched
+ * while the rows before them are read and locked.
+ */
+static List *
+fetch_groups(ContQueryCombinerState *state, Relation matrel, int64 *hashes, int nhashes)
+{
+	EState *estate = NULL;
+	Snapshot snapshot = GetTransactionSnapshot();
+	IndexScanDesc scan;
+	Relation index;
+	ScanKeyData key;
+	List *result = NIL;
+	ItemPointer tid;
+	ItemPointerData *tids;
+	int ntids = 0;
+	int maxtids = Max(nhashes, 1);
+	GroupPrefetch gp;
+	int i;
 
-	Assert(state->sw);
-	Assert(state->sw->arrival_ts_attr);
-	oldest = GetCurrentTimestamp() - (1000 * state->base.query->sw_interval_ms);
+	tids = palloc(sizeof(ItemPointerData) * maxtids);
 
-	/* We only need to scan for in-window rows */
-	ScanKeyInit(&skey[0],
-				state->sw->arrival_ts_attr,
-				BTGreaterEqualStrategyNumber, F_TIMESTAMP_GE, TimestampTzGetDatum(oldest));
+	index = index_open(state->hash_index, AccessShareLock);
+	scan = index_beginscan(matrel, index, snapshot, 1, 0);
 
-	scan = heap_beginscan(matrel, GetTransactionSnapshot(), 1, skey);
+	ScanKeyInit(&key, 1, BTEqualStrategyNumber, state->hash_index_eqproc, (Datum) 0);
 
-	if (state->hashfunc)
+	for (i = 0; i < nhashes; i++)
 	{
-		InitFunctionCallInfoData(hashfcinfo, &flinfo,
-				list_length(state->hashfunc->args), state->hashfunc->funccollid, NULL, NULL);
+		if (state->hashfunc->funcresulttype == INT8OID)
+			key.sk_argument = Int64GetDatum(hashes[i]);
+		else
+			key.sk_argument = Int32GetDatum((int32) hashes[i]);
 
-		fmgr_info(state->hashfunc->funcid, hashfcinfo.flinfo);
-		fmgr_info_set_expr((Node *) state->hashfunc, hashfcinfo.flinfo);
-	}
-	else
-	{
-		cv_name_hash = MurmurHash3_64(state->base.query->name->relname, strlen(state->base.query->name->relname), MURMUR_SEED);
+		index_rescan(scan, &key, 1, NULL, 0);
+
+		/* our index can have collisions, which are filtered out later on */
+		while ((tid = index_getnext_tid(scan, ForwardScanDirection)) != NULL)
+		{
+			if (ntids == maxtids)
+			{
+				maxtids *= 2;
+				tids = repalloc(tids, sizeof(ItemPointerData) * maxtids);
+			}
+			tids[ntids++] = *tid;
+		}
 	}
 
-	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
-	{
-		bool isnew;
-		HeapTupleEntry entry;
-		MemoryContext old;
-		int64 hash;
+	index_endscan(scan);
+	index_close(index, NoLock);
 
-		ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+	MemSet(&gp, 0, sizeof(GroupPrefetch));
+	gp.rel = matrel;
+	gp.last = InvalidBlockNumber;
 
-		if (state->hashfunc)
-			hash = hash_group_for_combiner(state->slot, state->hashfunc, &hashfcinfo);
-		else
-			hash = cv_name_hash;
+	if (target_prefetch_pages > 0)
+	{
+		gp.nblocks = ntids;
+		gp.blocks = palloc(sizeof(BlockNumber) * Max(ntids, 1));
+		for (i = 0; i < ntids; i++)
+			gp.blocks[i] = ItemPointerGetBlockNumber(&tids[i]);
+	}
 
-		/*
-		 * Shard groups across combiners.
-		 *
-		 * Note that this sharding logic must match exactly with what the worker
-		 * uses to shard partials across combiners. This combiner will act on whatever
-		 * tuples it receives from the worker, but these are the only tuples that will
-		 * be used as input into the overlay plan, so we need to ensure that we sync
-		 * all groups that this combiner will receive. Loading all matrel rows would
-		 * technically work as well, but we'd get duplicate output stream writes and
-		 * obviously waste memory.
-		 */
-		if (!is_group_hash_mine(hash))
-			continue;
+	for (i = 0; i < ntids; i++)
+	{
+		ItemPointerData visible = tids[i];
+		bool all_dead;
 
-		entry = (HeapTupleEntry) LookupTupleHashEntry(state->sw->step_groups, state->slot, &isnew);
+		prefetch_groups(&gp, i);
 
-		old = MemoryContextSwitchTo(state->sw->step_groups->tablecxt);
-		entry->tuple = heap_copytuple(tup);
-		MemoryContextSwitchTo(old);
+		/* index entries point to the root of their HOT chain, the same as for index_getnext */
+		if (heap_hot_search(&visible, matrel, snapshot, &all_dead))
+		{
+			HeapTuple locked = lock_group(matrel, &visible, &estate);
 
-		state->sw->last_matrel_sync = GetCurrentTimestamp();
+			if (locked)
+				result = lappend(result, locked);
+		}
 	}
 
-	heap_endscan(scan);
+	if (gp.blocks)
+		pfree(gp.blocks);
+	pfree(tids);
 
-	if (close_matrel)
-		heap_close(matrel, AccessShareLock);
+	if (estate)
+		FreeExecutorState(estate);
+
+	return result;
 }
 
 /*
- * compare_slots
+ * fetch_all_groups
+ *
+ * Returns locked copies of all of the matrel's rows, for views that don't group on any columns
  */
-static int
-compare_slots(TupleTableSlot *lslot, TupleTableSlot *rslot,
-		AttrNumber pk, bool *equal)
+static List *
+fetch_all_groups(Relation matrel)
 {
-	AttrNumber att;
-	TupleDesc desc;
-	int natts;
-	int num_changed = 0;
-
-	Assert(equalTupleDescs(lslot->tts_tupleDescriptor, rslot->tts_tupleDescriptor));
+	EState *estate = NULL;
+	HeapScanDesc scan;
+	HeapTuple tup;
+	List *result = NIL;
 
-	desc = lslot->tts_tupleDescriptor;
-	natts = desc->natts;
+	scan = heap_beginscan(matrel, GetTransactionSnapshot(), 0, NULL);
 
-	/*
-	 * Figure out which columns actually changed, as those are the only values
-	 * that we want to write to disk.
-	 */
-	for (att = 1; att <= natts; att++)
+	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
 	{
-		Datum prev;
-		Datum new;
-		bool prev_null;
-		bool new_null;
-		Form_pg_attribute attr = desc->attrs[att - 1];
+		HeapTuple locked = lock_group(matrel, &tup->t_self, &estate);
 
-		if (att == pk)
-			continue;
+		if (locked)
+			result = lappend(result, locked);
+	}
 
-		prev = slot_getattr(lslot, att, &prev_null);
-		new = slot_getattr(rslot, att, &new_null);
+	heap_endscan(scan);
 
-		/*
-		 * Note that this equality check only does a byte-by-byte comparison, which may yield false
-		 * negatives. This is fine, because a false negative will just cause an extraneous write, which
-		 * seems like a reasonable balance compared to looking up and invoking actual equality operators.
-		 */
-		if ((!prev_null && !new_null) && datumIsEqual(prev, new, attr->attbyval, attr->attlen))
-			equal[att - 1] = false;
-		else
-			num_changed++;
-	}
+	if (estate)
+		FreeExecutorState(estate);
 
-	return num_changed;
+	return result;
 }
 
 /*
- * add_matrel_tuples_to_overlay_input
+ * lookup_groups
  *
- * Add all existing cached matrel groups to the input of the overlay plan
- * we're about to execute. Note that we still add matrel rows that may
- * not have been modified by the most recent combine call, because their
- * corresponding values in the overlay output are dependent on the current
- * time.
+ * Adds the matrel's existing groups for the batch's uncached groups to existing by probing
+ * the group hash index directly. This avoids the planning, executor startup and portal
+ * overhead of running the group retrieval plan for every combine. Returns the number of groups
+ * that were looked up.
  */
-static List *
-add_cached_sw_tuples_to_overlay_input(ContQueryCombinerState *state)
+static int
+lookup_groups(ContQueryCombinerState *state, Relation matrel, int *nmisses)
 {
-	HASH_SEQ_STATUS seq;
-	HeapTupleEntry matrel_entry;
-	List *to_delete = NIL;
+	TupleHashTable existing = state->existing;
+	TupleTableSlot *slot = state->slot;
+	int64 *hashes;
+	int nhashes;
+	List *groups;
+	ListCell *lc;
 
-	hash_seq_init(&seq, state->sw->step_groups->hashtab);
-	while ((matrel_entry = (HeapTupleEntry) hash_seq_search(&seq)) != NULL)
+	hashes = get_hashes(state, use_group_filter(state, matrel), &nhashes, nmisses);
+	if (!nhashes)
 	{
-		Datum d;
-		bool isnull;
-		TimestampTz ts;
+		pfree(hashes);
+		return 0;
+	}
 
-		ExecStoreTuple(matrel_entry->tuple, state->slot, InvalidBuffer, false);
-		d = slot_getattr(state->slot, state->sw->arrival_ts_attr, &isnull);
-		ts = DatumGetTimestampTz(d);
-		Assert(!isnull);
+	groups = fetch_groups(state, matrel, hashes, nhashes);
 
-		if ((GetCurrentTimestamp() - ts) / 1000 > state->base.query->sw_interval_ms)
-		{
-			to_delete = lappend(to_delete, matrel_entry->tuple);
-			continue;
-		}
+	foreach(lc, groups)
+	{
+		HeapTuple locked = (HeapTuple) lfirst(lc);
+		MemoryContext old = MemoryContextSwitchTo(existing->tablecxt);
+		HeapTupleEntry entry;
+		bool isnew;
 
-		tuplestore_puttuple(state->sw->overlay_input, matrel_entry->tuple);
+		ExecStoreTuple(locked, slot, InvalidBuffer, false);
+		entry = (HeapTupleEntry) LookupTupleHashEntry(existing, slot, &isnew);
+		if (!isnew)
+			heap_freetuple(entry->tuple);
+		entry->tuple = heap_copytuple(locked);
+
+		MemoryContextSwitchTo(old);
+
+		heap_freetuple(locked);
 	}
-	tuplestore_rescan(state->sw->overlay_input);
 
-	return to_delete;
+	ExecClearTuple(slot);
+
+	list_free(groups);
+	pfree(hashes);
+
+	return nhashes;
 }
 
 /*
- * gc_cached_matrel_tuples
+ * hash_groups
  *
- * Garbage collect any out-of-window step tuples
+ * Stores all of the given tuples into a hashtable, keyed by their grouping columns
  */
-static void
-gc_cached_matrel_tuples(ContQueryCombinerState *state, List *expired)
+static TupleHashTable
+hash_groups(ContQueryCombinerState *state, List *tups)
 {
+	TupleHashTable existing = state->existing;
+	TupleHashTable groups = NULL;
+	bool isnew = false;
+	TupleTableSlot *slot = state->slot;
 	ListCell *lc;
+	MemoryContext cxt = AllocSetContextCreate(CurrentMemoryContext, "CombinerGroupsHashTableCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext tmp_cxt = AllocSetContextCreate(cxt, "CombinerGroupsHashTableTmpCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
 
-	Assert(state->sw);
-	Assert(state->sw->step_groups);
+	groups = BuildTupleHashTable(existing->numCols, existing->keyColIdx,
+			existing->tab_eq_funcs, existing->tab_hash_funcs, 1000,
+			existing->entrysize, cxt, tmp_cxt);
 
-	foreach(lc, expired)
+	foreach(lc, tups)
 	{
-		bool isnew;
-		HeapTuple tup = (HeapTuple) lfirst(lc);
-		HeapTupleEntry entry;
+		ExecStoreTuple((HeapTuple) lfirst(lc), slot, InvalidBuffer, false);
+		LookupTupleHashEntry(groups, slot, &isnew);
+	}
 
-		ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
-		entry = (HeapTupleEntry) LookupTupleHashEntry(state->sw->step_groups, state->slot, &isnew);
-		Assert(!isnew);
+	ExecClearTuple(slot);
 
-		RemoveTupleHashEntry(state->sw->step_groups, state->slot);
-		heap_freetuple(entry->tuple);
-	}
+	return groups;
 }
 
 /*
- * gc_cached_overlay_tuples
- *
- * GC any out-of-window tuples in the overlay cache. We indicate an
- * out-of-window tuple in the output stream by writing a null new tuple:
- *
- * INSERT INTO osrel (old, new) VALUES (<old tuple>, <null>)
+ * Groups of a batch keyed by the group hashes their partial results came with
  */
-static void
-gc_cached_overlay_tuples(ContQueryCombinerState *state,
-		TimestampTz this_tick, ResultRelInfo *osri)
+typedef struct BatchGroupEntry
 {
-	HASH_SEQ_STATUS seq;
-	OverlayTupleEntry *overlay_entry;
-	List *to_delete = NIL;
-	ListCell *lc;
+	int64 hash;
+	List *tuples; /* a tuple of each distinct group with this hash */
+} BatchGroupEntry;
 
-	hash_seq_init(&seq, state->sw->overlay_groups->hashtab);
-	while ((overlay_entry = (OverlayTupleEntry *) hash_seq_search(&seq)) != NULL)
-	{
-		Datum values[3];
-		bool nulls[3];
-		HeapTuple tup;
-		HeapTuple os_tup;
-
-		if (overlay_entry->last_touched == this_tick)
-			continue;
-
-		tup = overlay_entry->base.tuple;
-		to_delete = lappend(to_delete, overlay_entry->base.tuple);
+/*
+ * hash_batch_groups
+ *
+ * Stores all of the given tuples into a hashtable keyed by the group hashes workers already computed
+ * for them, so that they don't have to be hashed again. Group columns are only compared between
+ * tuples whose hashes are equal.
+ */
+static HTAB *
+hash_batch_groups(ContQueryCombinerState *state, List *tups, int64 *hashes, MemoryContext cxt)
+{
+	HASHCTL ctl;
+	HTAB *groups;
+	MemoryContext old;
+	ListCell *lc;
+	int i = 0;
 
-		MemSet(nulls, false, sizeof(nulls));
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(int64);
+	ctl.entrysize = sizeof(BatchGroupEntry);
+	ctl.hcxt = cxt;
 
-		nulls[state->output_stream_arrival_ts] = true;
-		nulls[NEW_TUPLE] = true;
-		values[NEW_TUPLE] = (Datum) 0;
-		values[OLD_TUPLE] = heap_copy_tuple_as_datum(tup, state->overlay_desc);
+	groups = hash_create("CombinerBatchGroups", Max(list_length(tups), 32), &ctl,
+			HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
 
-		os_tup = heap_form_tuple(state->os_slot->tts_tupleDescriptor, values, nulls);
-		ExecStoreTuple(os_tup, state->os_slot, InvalidBuffer, false);
-		ExecStreamInsert(NULL, osri, state->os_slot, NULL);
-	}
+	old = MemoryContextSwitchTo(cxt);
 
-	foreach(lc, to_delete)
+	foreach(lc, tups)
 	{
 		HeapTuple tup = (HeapTuple) lfirst(lc);
+		BatchGroupEntry *entry;
+		ListCell *glc;
+		bool found;
+
+		entry = (BatchGroupEntry *) hash_search(groups, &hashes[i++], HASH_ENTER, &found);
+		if (!found)
+		{
+			entry->tuples = NIL;
+		}
+		else
+		{
+			/* hot groups have many partial results per batch, but we only need one of them */
+			ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+			foreach(glc, entry->tuples)
+			{
+				ExecStoreTuple((HeapTuple) lfirst(glc), state->prev_slot, InvalidBuffer, false);
+				if (execTuplesMatch(state->slot, state->prev_slot, state->ngroupatts, state->groupatts,
+						state->eq_funcs, cxt))
+					break;
+			}
+
+			if (glc != NULL)
+				continue;
+		}
 
-		ExecStoreTuple(tup, state->overlay_slot, InvalidBuffer, false);
-		RemoveTupleHashEntry(state->sw->overlay_groups, state->overlay_slot);
+		entry->tuples = lappend(entry->tuples, tup);
 	}
+
+	MemoryContextSwitchTo(old);
+
+	ExecClearTuple(state->slot);
+	ExecClearTuple(state->prev_slot);
+
+	return groups;
 }
 
 /*
- * execute_sw_overlay_plan
+ * batch_has_group
  *
- * Execute the overlay plan to compute the instantaneous values over the sliding window
+ * Does the given existing group belong to any of the batch's groups hashed by hash_batch_groups? The
+ * existing group's hash is only computed once, no matter how many combines it's checked by.
  */
-static void
-execute_sw_overlay_plan(ContQueryCombinerState *state)
+static bool
+batch_has_group(ContQueryCombinerState *state, HTAB *groups, HeapTupleEntry existing, MemoryContext cxt)
 {
-	QueryDesc *query_desc;
-	struct Plan *plan;
+	BatchGroupEntry *entry;
+	ListCell *lc;
 
-	Assert(state->sw);
-	Assert(state->sw->overlay_plan);
-	Assert(state->sw->overlay_dest);
+	ExecStoreTuple(existing->tuple, state->slot, InvalidBuffer, false);
 
-	tuplestore_clear(state->sw->overlay_output);
-	query_desc = CreateQueryDesc(state->sw->overlay_plan,
-			NULL, InvalidSnapshot, InvalidSnapshot, state->sw->overlay_dest, NULL, 0);
-	query_desc->estate = CreateEState(query_desc);
+	if (!(existing->flags & EXISTING_HASHED))
+	{
+		MemoryContext old = MemoryContextSwitchTo(cxt);
 
-	plan = state->sw->overlay_plan->planTree;
-	query_desc->planstate = ExecInitNode(plan, query_desc->estate, 0);
-	ExecutePlan(query_desc->estate, query_desc->planstate,
-			query_desc->operation,
-			true, 0, ForwardScanDirection, state->sw->overlay_dest);
-	ExecEndNode(query_desc->planstate);
+		existing->hash = hash_group_for_combiner(state->slot, state->hashfunc, &state->hash_fcinfo);
+		existing->flags |= EXISTING_HASHED;
 
-	query_desc->planstate = NULL;
-	query_desc->estate = NULL;
+		MemoryContextSwitchTo(old);
+	}
 
-	tuplestore_rescan(state->sw->overlay_output);
+	entry = (BatchGroupEntry *) hash_search(groups, &existing->hash, HASH_FIND, NULL);
+	if (entry == NULL)
+		return false;
+
+	foreach(lc, entry->tuples)
+	{
+		ExecStoreTuple((HeapTuple) lfirst(lc), state->prev_slot, InvalidBuffer, false);
+		if (execTuplesMatch(state->slot, state->prev_slot, state->ngroupatts, state->groupatts,
+				state->eq_funcs, cxt))
+			return true;
+	}
+
+	return false;
 }
 
 /*
- * tick_sw_groups
+ * group_unchanged
  *
- * Since sliding-window values can change over time without receiving
- * new rows, we need to keep recomputing instantaneous values to write
- * to this CV's output stream if anything is reading it.
+ * Determines whether combining the given partial result with its group's on-disk row would
+ * leave the row unchanged, which is the case when none of its values would replace the
+ * row's values. Such partial results can be dropped before the combine plan ever sees them.
+ * Since monotone aggregates only ever move away from the on-disk values, this also holds
+ * for any result the group has accumulated in the ongoing sync.
  */
-static void
-tick_sw_groups(ContQueryCombinerState *state, Relation matrel, bool force)
+static bool
+group_unchanged(ContQueryCombinerState *state, TupleTableSlot *slot)
 {
-	TimestampTz this_tick = GetCurrentTimestamp();
-	OverlayTupleEntry *overlay_entry;
-	Relation osrel;
-	ResultRelInfo *osri;
-	StreamInsertState *sis;
-	List *to_delete = NIL;
+	HeapTupleEntry entry = (HeapTupleEntry) LookupTupleHashEntry(state->existing, slot, NULL);
+	TupleDesc desc = slot->tts_tupleDescriptor;
+	int i;
 
-	/* Ensure matrel rows are synced into memory */
-	sync_sw_matrel_groups(state, matrel);
+	if (entry == NULL)
+		return false;
 
-	if (!force && !TimestampDifferenceExceeds(state->sw->last_tick,
-			GetCurrentTimestamp(), state->base.query->sw_step_ms))
-		return;
+	for (i = 0; i < state->nmonotone; i++)
+	{
+		AttrNumber att = state->monotone_atts[i];
+		Datum new;
+		Datum old;
+		bool new_null;
+		bool old_null;
 
-	if (!hash_get_num_entries(state->sw->step_groups->hashtab))
-		return;
+		new = slot_getattr(slot, att, &new_null);
+		if (new_null)
+			continue;
 
-	osrel = try_relation_open(state->base.query->osrelid, RowExclusiveLock);
-	if (osrel == NULL)
-		return;
+		old = heap_getattr(entry->tuple, att, desc, &old_null);
+		if (old_null)
+			return false;
 
-	osri = CQOSRelOpen(osrel);
+		if (DatumGetBool(FunctionCall2Coll(&state->monotone_ops[i], desc->attrs[att - 1]->attcollation, new, old)))
+			return false;
+	}
 
-	BeginStreamModify(NULL, osri, NIL, 0, REENTRANT_STREAM_INSERT);
-	sis = (StreamInsertState *) osri->ri_FdwState;
-	Assert(sis);
+	return true;
+}
 
-	/* If nothing is reading from this output stream, there is nothing to do */
-	if (sis->targets == NULL)
-	{
-		EndStreamModify(NULL, osri);
-		CQOSRelClose(osri);
-		heap_close(osrel, NoLock);
-		return;
-	}
+/*
+ * remove_cached_group
+ *
+ * Removes the given entry from the group cache, given a slot containing any tuple of its group
+ */
+static void
+remove_cached_group(ContQueryCombinerState *state, GroupCacheEntry *entry, TupleTableSlot *slot)
+{
+	MinimalTuple key = entry->base.shared.firstTuple;
+	HeapTuple tup = entry->base.tuple;
 
-	/*
-	 * Compute instantaneous sliding-window values
-	 */
-	to_delete = add_cached_sw_tuples_to_overlay_input(state);
-	gc_cached_matrel_tuples(state, to_delete);
-	execute_sw_overlay_plan(state);
+	RemoveTupleHashEntry(state->existing, slot);
+	ExecClearTuple(slot);
 
-	/*
-	 * Write out any changed sliding-window values to the output stream
-	 */
-	tuplestore_rescan(state->sw->overlay_output);
-	foreach_tuple(state->overlay_slot, state->sw->overlay_output)
-	{
-		bool isnew;
-		Datum values[3];
-		bool nulls[3];
-		bool replaces[3];
-		HeapTuple new_tup = ExecMaterializeSlot(state->overlay_slot);
-		HeapTuple old_tup = NULL;
-		HeapTuple os_tup;
-		MemoryContext old;
+	pfree(key);
+	heap_freetuple(tup);
+}
 
-		Assert(!TupIsNull(state->overlay_slot));
-		overlay_entry = (OverlayTupleEntry *) LookupTupleHashEntry(state->sw->overlay_groups, state->overlay_slot, &isnew);
-		overlay_entry->last_touched = this_tick;
+/*
+ * validate_cached_groups
+ *
+ * Something other than this combiner may have modified or removed a cached group's
+ * row since we last wrote it, so before a cached group is used again we verify that
+ * the tuple we wrote is still the visible version of that row. This only costs a heap
+ * page access per group instead of an index lookup. Groups that fail the check are
+ * evicted so that they're looked up in the matrel again.
+ */
+static void
+validate_cached_groups(ContQueryCombinerState *state)
+{
+	TupleTableSlot *slot = state->slot;
+	Snapshot snapshot = GetTransactionSnapshot();
+	BlockNumber nblocks = InvalidBlockNumber;
+	Relation matrel = NULL;
+	GroupPrefetch gp;
+	int pos = 0;
 
-		if (!isnew)
+	MemSet(&gp, 0, sizeof(GroupPrefetch));
+	gp.last = InvalidBlockNumber;
+
+	/* find the pages of the cached groups about to be checked first, so that they can be prefetched */
+	if (target_prefetch_pages > 0)
+	{
+		gp.blocks = palloc(sizeof(BlockNumber) * Max(state->batch->ntuples, 1));
+
+		foreach_batch_tuple(slot, state->batch)
 		{
-			MemSet(replaces, false, sizeof(replaces));
-			ExecStoreTuple(overlay_entry->base.tuple, state->overlay_prev_slot, InvalidBuffer, false);
+			GroupCacheEntry *entry = (GroupCacheEntry *) LookupTupleHashEntry(state->existing, slot, NULL);
+			BlockNumber block = InvalidBlockNumber;
 
-			/*
-			 * Similarly to how we don't sync unchanged tuples to disk when combining,
-			 * we don't write unchanged tuples to output streams.
-			 */
-			if (!compare_slots(state->overlay_slot, state->overlay_prev_slot, state->pk, replaces))
-				continue;
+			if (entry && (entry->base.flags & EXISTING_CACHED))
+			{
+				if (matrel == NULL)
+				{
+					matrel = heap_openrv(state->base.query->matrel, RowShareLock);
+					nblocks = RelationGetNumberOfBlocks(matrel);
+				}
 
-			old_tup = overlay_entry->base.tuple;
+				block = ItemPointerGetBlockNumber(&entry->base.tuple->t_self);
+				if (block >= nblocks)
+					block = InvalidBlockNumber;
+			}
+
+			gp.blocks[gp.nblocks++] = block;
 		}
 
-		old = MemoryContextSwitchTo(state->sw->step_groups->tablecxt);
-		overlay_entry->base.tuple = heap_copytuple(new_tup);
-		MemoryContextSwitchTo(old);
+		TupleBatchRescan(state->batch);
+		gp.rel = matrel;
+	}
 
-		MemSet(nulls, true, sizeof(nulls));
+	foreach_batch_tuple(slot, state->batch)
+	{
+		GroupCacheEntry *entry = (GroupCacheEntry *) LookupTupleHashEntry(state->existing, slot, NULL);
+		HeapTuple cached;
+		HeapTupleData tup;
+		Buffer buf;
+		bool valid = false;
+
+		if (gp.rel)
+			prefetch_groups(&gp, pos);
+		pos++;
 
-		if (old_tup)
+		if (entry == NULL)
+			continue;
+
+		entry->referenced = true;
+
+		if (!(entry->base.flags & EXISTING_CACHED))
+			continue;
+
+		if (matrel == NULL)
 		{
-			nulls[OLD_TUPLE] = false;
-			values[OLD_TUPLE] = heap_copy_tuple_as_datum(old_tup, state->overlay_desc);
+			matrel = heap_openrv(state->base.query->matrel, RowShareLock);
+			nblocks = RelationGetNumberOfBlocks(matrel);
 		}
 
-		nulls[state->output_stream_arrival_ts] = true;
-		nulls[NEW_TUPLE] = false;
-		values[NEW_TUPLE] = heap_copy_tuple_as_datum(new_tup, state->overlay_desc);
+		cached = entry->base.tuple;
+		tup.t_self = cached->t_self;
 
-		/* Finally write the old and new tuple to the output stream */
-		os_tup = heap_form_tuple(state->os_slot->tts_tupleDescriptor, values, nulls);
-		ExecStoreTuple(os_tup, state->os_slot, InvalidBuffer, false);
-		ExecStreamInsert(NULL, osri, state->os_slot, NULL);
+		/* the matrel may have been truncated since we wrote this tuple */
+		if (ItemPointerGetBlockNumber(&tup.t_self) < nblocks &&
+				heap_fetch(matrel, snapshot, &tup, &buf, false, NULL))
+		{
+			valid = tup.t_len == cached->t_len &&
+				TransactionIdEquals(HeapTupleHeaderGetRawXmin(tup.t_data),
+						HeapTupleHeaderGetRawXmin(cached->t_data));
+			ReleaseBuffer(buf);
+		}
 
-		if (old_tup)
-			heap_freetuple(old_tup);
+		if (valid)
+			entry->base.flags &= ~EXISTING_CACHED;
+		else
+			remove_cached_group(state, entry, slot);
 	}
 
-	/*
-	 * Expire any out-of-window tuples in the overlay cache
-	 */
-	gc_cached_overlay_tuples(state, this_tick, osri);
-
-	/* Done, cleanup */
-	EndStreamModify(NULL, osri);
-	CQOSRelClose(osri);
-	heap_close(osrel, NoLock);
+	TupleBatchRescan(state->batch);
 
-	tuplestore_clear(state->sw->overlay_input);
-	tuplestore_clear(state->sw->overlay_output);
+	if (gp.blocks)
+		pfree(gp.blocks);
 
-	state->sw->last_tick = GetCurrentTimestamp();
+	if (matrel)
+		heap_close(matrel, NoLock);
 }
 
 /*
- * find_attr
+ * cache_group
  *
- * Find the attribute with the given name in the given TupleDesc
+ * Keeps the tuple that was just written for the given slot's group cached for later syncs
  */
-static AttrNumber
-find_attr(TupleDesc desc, char *name)
+static void
+cache_group(ContQueryCombinerState *state, GroupCacheEntry *entry, TupleTableSlot *slot)
 {
-	int i;
-	AttrNumber result = InvalidAttrNumber;
+	MemoryContext old = MemoryContextSwitchTo(state->existing->tablecxt);
+	bool isnew;
 
-	for (i = 0; i < desc->natts; i++)
-	{
-		if (pg_strcasecmp(name, NameStr(desc->attrs[i]->attname)) == 0)
-		{
-			result = i + 1;
-			break;
-		}
-	}
+	if (entry == NULL)
+		entry = (GroupCacheEntry *) LookupTupleHashEntry(state->existing, slot, &isnew);
+	else
+		heap_freetuple(entry->base.tuple);
 
-	return result;
+	entry->base.tuple = heap_copytuple(slot->tts_tuple);
+	entry->referenced = true;
+
+	MemoryContextSwitchTo(old);
 }
 
 /*
- * init_sw_state
+ * get_tuple_time
  *
- * Initialize the state necessary to write SW results to output streams
+ * Get the value of the given timestamp attribute of a partial result or matrel row
  */
-static void
-init_sw_state(ContQueryCombinerState *state, Relation matrel)
+static bool
+get_tuple_time(ContQueryCombinerState *state, HeapTuple tup, AttrNumber attr, TimestampTz *ts)
 {
-	MemoryContext tmp_cxt;
-	TuplestoreScan *scan;
-	MemoryContext old;
-	Oid *group_ops;
-	AttrNumber *group_idx;
-	FmgrInfo *eq_funcs;
-	FmgrInfo *hash_funcs;
-	ColumnRef *cref;
-	int n_group_attr = 0;
+	bool isnull;
+	Datum d = heap_getattr(tup, attr, state->desc, &isnull);
 
-	if (!state->isagg)
-		return;
+	if (isnull)
+		return false;
 
-	cref = GetWindowTimeColumn(state->base.query->name);
-	Assert(cref);
-	Assert(list_length(cref->fields) == 1);
-	Assert(IsA(linitial(cref->fields), String));
+	*ts = DatumGetTimestampTz(d);
 
-	state->sw = palloc0(sizeof(SWOutputState));
-	state->sw->arrival_ts_attr = find_attr(state->desc, strVal(linitial(cref->fields)));
+	return true;
+}
 
-	tmp_cxt = AllocSetContextCreate(CurrentMemoryContext, "SWOutputTmpCxt",
-				ALLOCSET_DEFAULT_MINSIZE,
-				ALLOCSET_DEFAULT_INITSIZE,
-				ALLOCSET_DEFAULT_MAXSIZE);
+/*
+ * sw_step_sealed
+ *
+ * Is the given partial result or matrel row in a step that the watermark has passed by more
+ * than the view's allowed_lateness? Such steps won't take any more updates.
+ */
+static bool
+sw_step_sealed(ContQueryCombinerState *state, HeapTuple tup)
+{
+	SWOutputState *sw = state->sw;
+	ContQuery *cq = state->base.query;
+	TimestampTz ts;
 
-	state->sw->step_groups = BuildTupleHashTable(state->ngroupatts,
-			state->groupatts, state->eq_funcs, state->hash_funcs, 1000,
-			sizeof(HeapTupleEntryData), CurrentMemoryContext, tmp_cxt);
+	if (sw == NULL || cq->sw_lateness_ms <= 0 || !sw->watermark)
+		return false;
 
-	state->sw->overlay_plan = GetContinuousViewOverlayPlan(state->base.query);
-	state->sw->context = AllocSetContextCreate(CurrentMemoryContext, "SWOutputCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
+	if (!get_tuple_time(state, tup, sw->arrival_ts_attr, &ts))
+		return false;
+
+	return ts + 1000 * ((int64) cq->sw_step_ms + cq->sw_lateness_ms) <= sw->watermark;
+}
+
+/*
+ * bucket_frozen
+ *
+ * Is the given partial result or matrel row in a time bucket that the watermark has passed by
+ * more than the view's freeze_after? Frozen buckets won't take any more updates.
+ */
+static bool
+bucket_frozen(ContQueryCombinerState *state, HeapTuple tup)
+{
+	TimestampTz ts;
+
+	if (!AttributeNumberIsValid(state->freeze_attr) || !state->freeze_watermark)
+		return false;
+
+	if (!get_tuple_time(state, tup, state->freeze_attr, &ts))
+		return false;
+
+	return ts + 1000 * (int64) state->base.query->freeze_after_ms <= state->freeze_watermark;
+}
+
+/*
+ * advance_watermarks
+ *
+ * Moves the watermarks up to the times of the given partial result. They never move past the
+ * current time, so a single event from the future can't seal or freeze everything.
+ */
+static void
+advance_watermarks(ContQueryCombinerState *state, HeapTuple tup, TimestampTz now)
+{
+	TimestampTz ts;
+
+	if (state->sw && state->base.query->sw_lateness_ms > 0 &&
+			get_tuple_time(state, tup, state->sw->arrival_ts_attr, &ts))
+		state->sw->watermark = Max(state->sw->watermark, Min(ts, now));
+
+	if (AttributeNumberIsValid(state->freeze_attr) &&
+			get_tuple_time(state, tup, state->freeze_attr, &ts))
+		state->freeze_watermark = Max(state->freeze_watermark, Min(ts, now));
+}
+
+/*
+ * trim_group_cache
+ *
+ * Keeps the groups written by a sync cached for subsequent syncs. If the cache has outgrown
+ * continuous_query_combiner_group_cache_mem, we evict groups with a CLOCK sweep: groups that
+ * were used since the last sweep are given a second chance and the others are evicted.
+ */
+static void
+trim_group_cache(ContQueryCombinerState *state)
+{
+	TupleHashTable existing = state->existing;
+	Size max_size = continuous_query_combiner_group_cache_mem * 1024L;
+	Size size = 0;
+	HASH_SEQ_STATUS status;
+	GroupCacheEntry *entry;
+
+	if (existing == NULL)
+		return;
+
+	MemoryContextReset(existing->tempcxt);
+
+	hash_seq_init(&status, existing->hashtab);
+	while ((entry = (GroupCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		/* sealed steps and frozen buckets won't be updated again, so there's no point in keeping them cached */
+		if (sw_step_sealed(state, entry->base.tuple) || bucket_frozen(state, entry->base.tuple))
+		{
+			ExecStoreTuple(entry->base.tuple, state->slot, InvalidBuffer, false);
+			remove_cached_group(state, entry, state->slot);
+			continue;
+		}
+
+		entry->base.flags = EXISTING_CACHED;
+		size += GROUP_CACHE_ENTRY_SIZE(entry);
+	}
+
+	while (size > max_size)
+	{
+		hash_seq_init(&status, existing->hashtab);
+		while ((entry = (GroupCacheEntry *) hash_seq_search(&status)) != NULL)
+		{
+			if (entry->referenced)
+			{
+				entry->referenced = false;
+				continue;
+			}
+
+			size -= GROUP_CACHE_ENTRY_SIZE(entry);
+			ExecStoreTuple(entry->base.tuple, state->slot, InvalidBuffer, false);
+			remove_cached_group(state, entry, state->slot);
+
+			if (size <= max_size)
+			{
+				hash_seq_term(&status);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * select_existing_groups
+ *
+ * Adds all existing groups in the matrel to the combine input set
+ */
+static void
+select_existing_groups(ContQueryCombinerState *state)
+{
+	TupleHashTable existing = state->existing;
+	PlannedStmt *plan = NULL;
+	Portal portal = NULL;
+	DestReceiver *dest;
+	HASH_SEQ_STATUS status;
+	HeapTupleEntry entry;
+	TupleTableSlot *slot = state->slot;
+	List *tups = NIL;
+	ListCell *lc;
+	List *values = NIL;
+	TupleHashTable batchgroups = NULL;
+	HTAB *hashed_groups = NULL;
+	MemoryContext hashed_cxt = NULL;
+	int64 *hashes = NULL;
+	bool use_hashes = OidIsValid(state->hash_index);
+	Relation matrel;
+	int nmisses = 0;
+	int ngroups = 0;
+	int pos = 0;
+	instr_time start;
+	long blocks;
+
+	if (state->group_cache_cxt)
+		validate_cached_groups(state);
+
+	INSTR_TIME_SET_CURRENT(start);
+	blocks = pgBufferUsage.shared_blks_hit + pgBufferUsage.shared_blks_read;
+
+	if (state->isagg && state->ngroupatts > 0)
+	{
+		Assert(state->existing);
+
+		if (OidIsValid(state->hash_index))
+		{
+			matrel = heap_openrv(state->base.query->matrel, RowShareLock);
+			ngroups = lookup_groups(state, matrel, &nmisses);
+			heap_close(matrel, NoLock);
+			goto finish;
+		}
+
+		values = get_values(state);
+		nmisses = ngroups = list_length(values);
+
+		/*
+		 * If we're grouping and there aren't any uncached values to look up,
+		 * there is no need to execute a query.
+		 */
+		if (!values)
+			goto finish;
+	}
+	else if (state->isagg && state->ngroupatts == 0)
+	{
+		/*
+		 * If we're not grouping on any columns, then there's only one row to look up
+		 * so we don't need to do a VALUES-matrel join. If it's already in existing, we're done
+		 */
+		if (hash_get_num_entries(state->existing->hashtab))
+			goto finish;
+
+		nmisses = state->batch->ntuples;
+		ngroups = 1;
+	}
+
+	matrel = heap_openrv(state->base.query->matrel, RowShareLock);
+
+	plan = get_cached_groups_plan(state, values);
+
+	/*
+	 * Now run the query that retrieves existing tuples to merge this merge request with.
+	 * This query outputs to the tuplestore currently holding the incoming merge tuples.
+	 */
+	portal = CreatePortal("select_existing_groups", true, true);
+	portal->visible = false;
+
+	PortalDefineQuery(portal,
+			NULL,
+			state->base.query->matrel->relname,
+			"SELECT",
+			list_make1(plan),
+			NULL);
+
+	dest = CreateDestReceiver(DestTupleTable);
+	SetTupleTableDestReceiverParams(dest, existing, existing->tablecxt, true);
+
+	PortalStart(portal, NULL, 0, NULL);
+
+	(void) PortalRun(portal,
+					 FETCH_ALL,
+					 true,
+					 dest,
+					 dest,
+					 NULL);
+	PortalDrop(portal, false);
+
+	heap_close(matrel, NoLock);
+
+finish:
+	if (ngroups)
+	{
+		instr_time elapsed;
+
+		INSTR_TIME_SET_CURRENT(elapsed);
+		INSTR_TIME_SUBTRACT(elapsed, start);
+		blocks = pgBufferUsage.shared_blks_hit + pgBufferUsage.shared_blks_read - blocks;
+
+		pgstat_increment_cq_lookup(ngroups, INSTR_TIME_GET_MICROSEC(elapsed), blocks);
+	}
+
+	/* partial results whose group was cached or already looked up by an earlier combine of this sync */
+	pgstat_increment_cq_group_cache(state->batch->ntuples - nmisses, nmisses);
+
+	/* group hashes are parallel to the batch's tuples, the same as for lookup_groups */
+	if (use_hashes)
+		hashes = palloc(sizeof(int64) * Max(state->batch->ntuples, 1));
+
+	TupleBatchRescan(state->batch);
+	foreach_batch_tuple(slot, state->batch)
+	{
+		int64 hash = use_hashes ? state->group_hashes[pos] : 0;
+
+		pos++;
+
+		if (state->nmonotone && group_unchanged(state, slot))
+			continue;
+
+		if (use_hashes)
+			hashes[list_length(tups)] = hash;
+
+		/* these point into the batch's arena, which survives the batch being emptied below */
+		tups = lappend(tups, ExecFetchSlotTuple(slot));
+	}
+	TupleBatchClearTuples(state->batch);
+
+	if (use_hashes)
+	{
+		hashed_cxt = AllocSetContextCreate(CurrentMemoryContext, "CombinerBatchGroupsCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+		hashed_groups = hash_batch_groups(state, tups, hashes, hashed_cxt);
+	}
+	else
+		batchgroups = hash_groups(state, tups);
+
+	/*
+	 * Now add the existing rows to the input of the final combine query
+	 */
+	hash_seq_init(&status, existing->hashtab);
+	while ((entry = (HeapTupleEntry) hash_seq_search(&status)) != NULL)
+	{
+		bool found;
+
+		/*
+		 * We only need to add on-disk tuples to the input once, because they'll
+		 * be accumulated upon within the ongoing combine result until we sync.
+		 */
+		if (entry->flags & EXISTING_ADDED)
+			continue;
+
+		/*
+		 * Our index can potentially have collisions, so we filter out any
+		 * tuples that were returned that aren't related to the batch we're
+		 * currently processing. This is just a matter of intersecting the
+		 * retrieved groups with the batch's groups.
+		 */
+		if (use_hashes)
+			found = batch_has_group(state, hashed_groups, entry, hashed_cxt);
+		else
+		{
+			ExecStoreTuple(entry->tuple, slot, InvalidBuffer, false);
+			found = LookupTupleHashEntry(batchgroups, slot, NULL) != NULL;
+		}
+
+		if (found)
+		{
+			TupleBatchPut(state->batch, entry->tuple);
+			entry->flags |= EXISTING_ADDED;
+		}
+	}
+
+	foreach(lc, tups)
+	{
+		HeapTuple tup = (HeapTuple) lfirst(lc);
+		TupleBatchAppend(state->batch, tup);
+	}
+
+	list_free(tups);
+
+	if (use_hashes)
+	{
+		MemoryContextDelete(hashed_cxt);
+		pfree(hashes);
+	}
+	else
+		hash_destroy(batchgroups->hashtab);
+}
+
+/*
+ * reset_existing_hashtable
+ *
+ * Free any memory associated with the given state's existing hashtable and
+ * create a new hashtable.
+ */
+static TupleHashTable
+build_existing_hashtable(ContQueryCombinerState *state)
+{
+	MemoryContext parent = state->group_cache_cxt ? state->group_cache_cxt : state->combine_cxt;
+	Size entrysize = state->group_cache_cxt ? sizeof(GroupCacheEntry) : sizeof(HeapTupleEntryData);
+	MemoryContext existing_cxt = AllocSetContextCreate(parent, "CombinerExistingGroupsCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext existing_tmp_cxt = AllocSetContextCreate(existing_cxt, "CombinerExistingGroupsTmpCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
 			ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext old = MemoryContextSwitchTo(state->combine_cxt);
+	TupleHashTable result;
+
+	result = BuildTupleHashTable(state->ngroupatts, state->groupatts, state->eq_funcs, state->hash_funcs, 1000,
+			entrysize, existing_cxt, existing_tmp_cxt);
 
-	old = MemoryContextSwitchTo(state->sw->context);
-	state->sw->overlay_input = tuplestore_begin_heap(true, true, work_mem);
-	state->sw->overlay_output = tuplestore_begin_heap(true, true, work_mem);
 	MemoryContextSwitchTo(old);
 
-	state->sw->overlay_plan->isContinuous = false;
-	scan = SetCombinerPlanTuplestorestate(state->sw->overlay_plan, state->sw->overlay_input);
-	scan->desc = state->desc;
+	return result;
+}
 
-	state->sw->overlay_dest = CreateDestReceiver(DestTuplestore);
-	SetTuplestoreDestReceiverParams(state->sw->overlay_dest, state->sw->overlay_output, state->sw->context, true);
+/*
+ * build_projection
+ */
+static ProjectionInfo *
+build_projection(List *tlist, EState *estate, ExprContext *econtext,
+		TupleDesc input_desc)
+{
+	TupleTableSlot *result_slot;
+	TupleDesc result_desc;
+	List *targetlist;
+
+	result_desc = ExecTypeFromTL(tlist, false);
+	result_slot = MakeSingleTupleTableSlot(result_desc);
+	targetlist = (List *) ExecPrepareExpr((Expr *) tlist, estate);
+
+	return ExecBuildProjectionInfo(targetlist, econtext,
+								   result_slot, input_desc);
+}
+
+/*
+ * project_overlay
+ */
+static Datum
+project_overlay(ContQueryCombinerState *state, HeapTuple tup, bool *isnull)
+{
+	TupleTableSlot *slot;
+	HeapTuple projected;
+
+	if (!state->output_stream_proj)
+		return heap_copy_tuple_as_datum(tup, state->desc);
+
+	Assert(state->proj_input_slot);
+
+	/* Should we copy the input tuple so it doesn't get modified? */
+	ExecStoreTuple(tup, state->proj_input_slot, InvalidBuffer, false);
+	slot = ExecProject(state->output_stream_proj, NULL);
+
+	if (TupIsNull(slot))
+	{
+		*isnull = true;
+		return (Datum) NULL;
+	}
+
+	*isnull = false;
+	projected = ExecMaterializeSlot(slot);
+
+	return heap_copy_tuple_as_datum(projected, state->overlay_desc);
+}
+
+/*
+ * cache_finalized
+ *
+ * Stores the finalized overlay values of the given matrel tuple in its finalize cache columns
+ */
+static HeapTuple
+cache_finalized(ContQueryCombinerState *state, HeapTuple tup, bool *replaced)
+{
+	TupleTableSlot *slot;
+	int i;
+
+	Assert(state->output_stream_proj);
+
+	ExecStoreTuple(tup, state->proj_input_slot, InvalidBuffer, false);
+	slot = ExecProject(state->output_stream_proj, NULL);
+	slot_getallattrs(slot);
+
+	for (i = 0; i < state->ncached; i++)
+	{
+		AttrNumber attno = state->cached_attrs[i];
+
+		state->cached_values[attno - 1] = slot->tts_values[state->cached_overlay_attrs[i] - 1];
+		state->cached_nulls[attno - 1] = slot->tts_isnull[state->cached_overlay_attrs[i] - 1];
+
+		if (replaced)
+			replaced[attno - 1] = true;
+	}
+
+	return heap_modify_tuple(tup, state->desc, state->cached_values, state->cached_nulls, state->cached_replace);
+}
+
+/*
+ * sw_step_number
+ */
+static int64
+sw_step_number(ContQueryCombinerState *state, TimestampTz ts)
+{
+	return ts / (1000 * (int64) Max(state->base.query->sw_step_ms, 1));
+}
+
+/*
+ * resize_sw_cache
+ */
+static void
+resize_sw_cache(SWOutputState *sw, int64 delta)
+{
+	sw->cache_bytes += delta;
+	sw_cache_bytes += delta;
+
+	if (MyProcStatCQEntry)
+		MyProcStatCQEntry->sw_cache_bytes = sw_cache_bytes;
+}
+
+/*
+ * sw_cache_reset_callback
+ *
+ * Stops counting a view's cache towards this process's total once its state is released
+ */
+static void
+sw_cache_reset_callback(void *arg)
+{
+	SWOutputState *sw = (SWOutputState *) arg;
+
+	resize_sw_cache(sw, -(int64) sw->cache_bytes);
+}
+
+/*
+ * sw_time_expired
+ */
+static bool
+sw_time_expired(ContQueryCombinerState *state, TimestampTz now, TimestampTz ts)
+{
+	return (now - ts) / 1000 > state->base.query->sw_interval_ms;
+}
+
+/*
+ * mark_sw_group_dirty
+ *
+ * Mark the given overlay group as needing to be computed again on the next tick
+ */
+static void
+mark_sw_group_dirty(SWOutputState *sw, OverlayTupleEntry *group)
+{
+	MemoryContext old;
+
+	if (group->dirty)
+		return;
+
+	group->dirty = true;
+
+	old = MemoryContextSwitchTo(sw->context);
+	sw->dirty = lappend(sw->dirty, group);
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * lookup_sw_overlay_group
+ *
+ * Find or create the overlay group the step group in the given slot belongs to. The lookup
+ * key is formed from the step group's grouping columns at their positions in the overlay's output.
+ * Returns NULL if the group doesn't exist and create is false.
+ */
+static OverlayTupleEntry *
+lookup_sw_overlay_group(ContQueryCombinerState *state, TupleTableSlot *slot, bool create)
+{
+	SWOutputState *sw = state->sw;
+	TupleDesc desc = state->overlay_desc;
+	Datum *values = palloc0(sizeof(Datum) * desc->natts);
+	bool *nulls = palloc(sizeof(bool) * desc->natts);
+	OverlayTupleEntry *entry;
+	bool isnew = false;
+	int i;
+
+	MemSet(nulls, true, sizeof(bool) * desc->natts);
+
+	for (i = 0; i < sw->n_group_attr; i++)
+	{
+		AttrNumber att = sw->overlay_group_idx[i] - 1;
+		values[att] = slot_getattr(slot, sw->step_group_idx[i], &nulls[att]);
+	}
+
+	ExecStoreTuple(heap_form_tuple(desc, values, nulls), sw->key_slot, InvalidBuffer, true);
+	entry = (OverlayTupleEntry *) LookupTupleHashEntry(sw->overlay_groups, sw->key_slot, create ? &isnew : NULL);
+
+	if (entry && isnew)
+	{
+		entry->base.tuple = NULL;
+		entry->last_touched = 0;
+		entry->steps = NIL;
+		entry->dirty = false;
+		entry->evicted = false;
+		resize_sw_cache(sw, SW_GROUP_SIZE(entry));
+	}
+
+	pfree(values);
+	pfree(nulls);
+
+	return entry;
+}
+
+/*
+ * cache_sw_step
+ *
+ * Add or replace the step group in the given slot in the local cache. New step groups are
+ * bucketed by their step so that they can be expired without looking at the rest of the window.
+ * Step groups that are already cached are left alone unless replace is true.
+ */
+static void
+cache_sw_step(ContQueryCombinerState *state, TupleTableSlot *slot, bool replace)
+{
+	SWOutputState *sw = state->sw;
+	StepTupleEntry *entry;
+	MemoryContext old;
+	bool isnew;
+
+	entry = (StepTupleEntry *) LookupTupleHashEntry(sw->step_groups, slot, &isnew);
+
+	if (isnew)
+	{
+		Datum d;
+		bool isnull;
+		int i;
+
+		d = slot_getattr(slot, sw->arrival_ts_attr, &isnull);
+		Assert(!isnull);
+
+		/* Steps older than those already expired are checked on the next tick */
+		i = Max(sw_step_number(state, DatumGetTimestampTz(d)), sw->expired_step) % sw->nsteps;
+		entry->group = lookup_sw_overlay_group(state, slot, true);
+
+		old = MemoryContextSwitchTo(sw->context);
+		entry->group->steps = lappend(entry->group->steps, entry);
+		sw->ring[i] = lappend(sw->ring[i], entry);
+		MemoryContextSwitchTo(old);
+	}
+	else if (replace)
+	{
+		resize_sw_cache(sw, -(int64) SW_STEP_SIZE(entry));
+		heap_freetuple(entry->base.tuple);
+	}
+	else
+		return;
+
+	old = MemoryContextSwitchTo(sw->step_groups->tablecxt);
+	entry->base.tuple = ExecCopySlotTuple(slot);
+	MemoryContextSwitchTo(old);
+
+	resize_sw_cache(sw, SW_STEP_SIZE(entry));
+
+	entry->group->referenced = true;
+	mark_sw_group_dirty(sw, entry->group);
+}
+
+/*
+ * load_sw_matrel_groups
+ *
+ * Load in-window sliding-window matrel rows from disk into the local cache. If evicted_only
+ * is true, only the rows of dirty overlay groups whose steps were evicted are loaded, and
+ * rows that are already cached are left alone.
+ */
+static void
+load_sw_matrel_groups(ContQueryCombinerState *state, Relation matrel, bool evicted_only)
+{
+	HeapTuple tup = NULL;
+	HeapScanDesc scan;
+	ScanKeyData skey[1];
+	TimestampTz oldest;
+	FunctionCallInfoData hashfcinfo;
+	FmgrInfo flinfo;
+	int64 cv_name_hash;
+	bool close_matrel = matrel == NULL;
+
+	/* If a matrel didn't get passed to us, we need to lock one ourselves */
+	if (matrel == NULL)
+		matrel = heap_openrv_extended(state->base.query->matrel, AccessShareLock, true);
+
+	if (matrel == NULL)
+		return;
+
+	Assert(state->sw);
+	Assert(state->sw->arrival_ts_attr);
+	oldest = GetCurrentTimestamp() - (1000 * state->base.query->sw_interval_ms);
+
+	/* We only need to scan for in-window rows */
+	ScanKeyInit(&skey[0],
+				state->sw->arrival_ts_attr,
+				BTGreaterEqualStrategyNumber, F_TIMESTAMP_GE, TimestampTzGetDatum(oldest));
+
+	scan = heap_beginscan(matrel, GetTransactionSnapshot(), 1, skey);
+
+	if (state->hashfunc)
+	{
+		InitFunctionCallInfoData(hashfcinfo, &flinfo,
+				list_length(state->hashfunc->args), state->hashfunc->funccollid, NULL, NULL);
+
+		fmgr_info(state->hashfunc->funcid, hashfcinfo.flinfo);
+		fmgr_info_set_expr((Node *) state->hashfunc, hashfcinfo.flinfo);
+	}
+	else
+	{
+		cv_name_hash = MurmurHash3_64(state->base.query->name->relname, strlen(state->base.query->name->relname), MURMUR_SEED);
+	}
+
+	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		int64 hash;
+
+		ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+
+		if (state->hashfunc)
+			hash = hash_group_for_combiner(state->slot, state->hashfunc, &hashfcinfo);
+		else
+			hash = cv_name_hash;
+
+		/*
+		 * Shard groups across combiners.
+		 *
+		 * Note that this sharding logic must match exactly with what the worker
+		 * uses to shard partials across combiners. This combiner will act on whatever
+		 * tuples it receives from the worker, but these are the only tuples that will
+		 * be used as input into the overlay plan, so we need to ensure that we sync
+		 * all groups that this combiner will receive. Loading all matrel rows would
+		 * technically work as well, but we'd get duplicate output stream writes and
+		 * obviously waste memory.
+		 */
+		if (!is_group_hash_mine(hash))
+			continue;
+
+		if (evicted_only)
+		{
+			OverlayTupleEntry *group = lookup_sw_overlay_group(state, state->slot, false);
+
+			if (group && group->evicted && group->dirty)
+				cache_sw_step(state, state->slot, false);
+			continue;
+		}
+
+		cache_sw_step(state, state->slot, true);
+		state->sw->last_matrel_sync = GetCurrentTimestamp();
+	}
+
+	heap_endscan(scan);
+
+	if (close_matrel)
+		heap_close(matrel, AccessShareLock);
+}
+
+/*
+ * sync_sw_matrel_groups
+ *
+ * Sync in-window sliding-window matrel rows from disk into the local cache
+ */
+static void
+sync_sw_matrel_groups(ContQueryCombinerState *state, Relation matrel)
+{
+	/*
+	 * We only need to sync once, all other groups will be cached
+	 * from the combiner's output.
+	 */
+	if (state->sw->last_matrel_sync)
+		return;
+
+	load_sw_matrel_groups(state, matrel, false);
+}
+
+/*
+ * compare_slots
+ */
+static int
+compare_slots(TupleTableSlot *lslot, TupleTableSlot *rslot,
+		AttrNumber pk, bool *equal)
+{
+	AttrNumber att;
+	TupleDesc desc;
+	int natts;
+	int num_changed = 0;
+
+	Assert(equalTupleDescs(lslot->tts_tupleDescriptor, rslot->tts_tupleDescriptor));
+
+	desc = lslot->tts_tupleDescriptor;
+	natts = desc->natts;
+
+	/*
+	 * Figure out which columns actually changed, as those are the only values
+	 * that we want to write to disk.
+	 */
+	for (att = 1; att <= natts; att++)
+	{
+		Datum prev;
+		Datum new;
+		bool prev_null;
+		bool new_null;
+		Form_pg_attribute attr = desc->attrs[att - 1];
+
+		if (att == pk)
+			continue;
+
+		prev = slot_getattr(lslot, att, &prev_null);
+		new = slot_getattr(rslot, att, &new_null);
+
+		/*
+		 * Note that this equality check only does a byte-by-byte comparison, which may yield false
+		 * negatives. This is fine, because a false negative will just cause an extraneous write, which
+		 * seems like a reasonable balance compared to looking up and invoking actual equality operators.
+		 */
+		if ((!prev_null && !new_null) && datumIsEqual(prev, new, attr->attbyval, attr->attlen))
+			equal[att - 1] = false;
+		else
+			num_changed++;
+	}
+
+	return num_changed;
+}
+
+/*
+ * expire_sw_steps
+ *
+ * Remove any out-of-window step groups from the cache, marking the overlay groups they
+ * belonged to as dirty. Only the buckets of steps that have left the window since the
+ * last call are looked at. Overlay groups whose steps were evicted are marked as dirty
+ * once their oldest evicted step has left the window.
+ */
+static void
+expire_sw_steps(ContQueryCombinerState *state)
+{
+	SWOutputState *sw = state->sw;
+	TimestampTz now = GetCurrentTimestamp();
+	int64 oldest = sw_step_number(state, now - 1000 * state->base.query->sw_interval_ms);
+	int64 step;
+	MemoryContext old;
+	List *evicted = NIL;
+	ListCell *lc;
+
+	old = MemoryContextSwitchTo(sw->context);
+
+	/* Each bucket only needs to be checked once, however long it's been since the last call */
+	for (step = Max(sw->expired_step, oldest - sw->nsteps + 1); step <= oldest; step++)
+	{
+		int i = step % sw->nsteps;
+		List *keep = NIL;
+		ListCell *lc;
+
+		foreach(lc, sw->ring[i])
+		{
+			StepTupleEntry *entry = (StepTupleEntry *) lfirst(lc);
+			HeapTuple tup = entry->base.tuple;
+			MinimalTuple key = entry->base.shared.firstTuple;
+			Datum d;
+			bool isnull;
+
+			ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+			d = slot_getattr(state->slot, sw->arrival_ts_attr, &isnull);
+			Assert(!isnull);
+
+			if ((now - DatumGetTimestampTz(d)) / 1000 <= state->base.query->sw_interval_ms)
+			{
+				keep = lappend(keep, entry);
+				continue;
+			}
+
+			entry->group->steps = list_delete_ptr(entry->group->steps, entry);
+			mark_sw_group_dirty(sw, entry->group);
+
+			resize_sw_cache(sw, -(int64) SW_STEP_SIZE(entry));
+			RemoveTupleHashEntry(sw->step_groups, state->slot);
+			heap_freetuple(tup);
+			pfree(key);
+		}
+
+		list_free(sw->ring[i]);
+		sw->ring[i] = keep;
+	}
+
+	sw->expired_step = Max(sw->expired_step, oldest);
+
+	foreach(lc, sw->evicted)
+	{
+		OverlayTupleEntry *group = (OverlayTupleEntry *) lfirst(lc);
+
+		if (sw_time_expired(state, now, group->oldest_step))
+			mark_sw_group_dirty(sw, group);
+
+		/* nothing of this group is left in the matrel's window either */
+		if (group->steps == NIL && sw_time_expired(state, now, group->newest_step))
+		{
+			group->evicted = false;
+			continue;
+		}
+
+		evicted = lappend(evicted, group);
+	}
+
+	list_free(sw->evicted);
+	sw->evicted = evicted;
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * add_dirty_sw_groups_to_overlay_input
+ *
+ * Add the in-window steps of all dirty overlay groups to the input of the overlay plan
+ * we're about to execute. Groups whose steps haven't changed since they were last computed
+ * would produce the same result, so they are left out.
+ */
+static void
+add_dirty_sw_groups_to_overlay_input(ContQueryCombinerState *state)
+{
+	ListCell *lc;
+
+	if (!continuous_query_combiner_incremental_sw)
+	{
+		HASH_SEQ_STATUS seq;
+		OverlayTupleEntry *entry;
+
+		hash_seq_init(&seq, state->sw->overlay_groups->hashtab);
+		while ((entry = (OverlayTupleEntry *) hash_seq_search(&seq)) != NULL)
+		{
+			if (entry->steps)
+				mark_sw_group_dirty(state->sw, entry);
+		}
+	}
+
+	foreach(lc, state->sw->dirty)
+	{
+		OverlayTupleEntry *entry = (OverlayTupleEntry *) lfirst(lc);
+		ListCell *slc;
+
+		foreach(slc, entry->steps)
+			tuplestore_puttuple(state->sw->overlay_input, ((StepTupleEntry *) lfirst(slc))->base.tuple);
+	}
+
+	tuplestore_rescan(state->sw->overlay_input);
+}
+
+/*
+ * remove_sw_overlay_group
+ */
+static void
+remove_sw_overlay_group(ContQueryCombinerState *state, OverlayTupleEntry *entry)
+{
+	MinimalTuple key = entry->base.shared.firstTuple;
+
+	Assert(entry->steps == NIL);
+
+	if (entry->evicted)
+		state->sw->evicted = list_delete_ptr(state->sw->evicted, entry);
+
+	if (entry->base.tuple)
+	{
+		resize_sw_cache(state->sw, -(int64) SW_TUPLE_SIZE(entry->base.tuple->t_len));
+		heap_freetuple(entry->base.tuple);
+	}
+
+	resize_sw_cache(state->sw, -(int64) SW_GROUP_SIZE(entry));
+	ExecStoreMinimalTuple(key, state->overlay_slot, false);
+	RemoveTupleHashEntry(state->sw->overlay_groups, state->overlay_slot);
+	ExecClearTuple(state->overlay_slot);
+	pfree(key);
+}
+
+/*
+ * gc_cached_overlay_tuples
+ *
+ * GC any dirty overlay groups that no longer produced a tuple. We indicate an
+ * out-of-window tuple in the output stream by writing a null new tuple:
+ *
+ * INSERT INTO osrel (old, new) VALUES (<old tuple>, <null>)
+ *
+ * If osri is NULL, nothing is reading from the output stream, so overlay groups
+ * without any steps left are removed and the rest are left dirty. Groups whose steps
+ * were evicted may still have steps in the matrel, so they are left dirty too.
+ */
+static void
+gc_cached_overlay_tuples(ContQueryCombinerState *state,
+		TimestampTz this_tick, ResultRelInfo *osri)
+{
+	List *dirty = state->sw->dirty;
+	ListCell *lc;
+	MemoryContext old;
+
+	state->sw->dirty = NIL;
+	old = MemoryContextSwitchTo(state->sw->context);
+
+	foreach(lc, dirty)
+	{
+		OverlayTupleEntry *entry = (OverlayTupleEntry *) lfirst(lc);
+		Datum values[3];
+		bool nulls[3];
+		HeapTuple os_tup;
+
+		if (osri == NULL)
+		{
+			if (entry->steps == NIL && !entry->evicted)
+				remove_sw_overlay_group(state, entry);
+			else
+				state->sw->dirty = lappend(state->sw->dirty, entry);
+			continue;
+		}
+
+		entry->dirty = false;
+
+		if (entry->last_touched == this_tick)
+			continue;
+
+		if (entry->base.tuple)
+		{
+			MemSet(nulls, false, sizeof(nulls));
+
+			nulls[state->output_stream_arrival_ts] = true;
+			nulls[NEW_TUPLE] = true;
+			values[NEW_TUPLE] = (Datum) 0;
+			values[OLD_TUPLE] = heap_copy_tuple_as_datum(entry->base.tuple, state->overlay_desc);
+
+			os_tup = heap_form_tuple(state->os_slot->tts_tupleDescriptor, values, nulls);
+			ExecStoreTuple(os_tup, state->os_slot, InvalidBuffer, false);
+			ExecStreamInsert(NULL, osri, state->os_slot, NULL);
+		}
+
+		if (entry->steps == NIL)
+		{
+			remove_sw_overlay_group(state, entry);
+		}
+		else if (entry->base.tuple)
+		{
+			resize_sw_cache(state->sw, -(int64) SW_TUPLE_SIZE(entry->base.tuple->t_len));
+			heap_freetuple(entry->base.tuple);
+			entry->base.tuple = NULL;
+		}
+	}
+
+	list_free(dirty);
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * reload_evicted_sw_groups
+ *
+ * Read the steps of dirty overlay groups whose steps were evicted back from the matrel, so that
+ * their windows can be computed. Dirty groups whose steps were all cached count as cache hits.
+ */
+static void
+reload_evicted_sw_groups(ContQueryCombinerState *state, Relation matrel)
+{
+	SWOutputState *sw = state->sw;
+	List *evicted = NIL;
+	ListCell *lc;
+	MemoryContext old;
+	int misses = 0;
+
+	foreach(lc, sw->evicted)
+	{
+		if (((OverlayTupleEntry *) lfirst(lc))->dirty)
+			misses++;
+	}
+
+	pgstat_increment_cq_sw_cache(list_length(sw->dirty) - misses, misses);
+
+	if (misses == 0)
+		return;
+
+	load_sw_matrel_groups(state, matrel, true);
+
+	old = MemoryContextSwitchTo(sw->context);
+
+	foreach(lc, sw->evicted)
+	{
+		OverlayTupleEntry *group = (OverlayTupleEntry *) lfirst(lc);
+
+		if (group->dirty)
+			group->evicted = false;
+		else
+			evicted = lappend(evicted, group);
+	}
+
+	list_free(sw->evicted);
+	sw->evicted = evicted;
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * trim_sw_cache
+ *
+ * If this view's sliding-window cache has outgrown continuous_query_combiner_sw_cache_mem, we evict
+ * the cached steps of whole overlay groups with a CLOCK sweep, like trim_group_cache does. Evicted
+ * groups only keep their last output and the range of times of their steps, and their steps are
+ * read back from the matrel once their window changes. If evict_all is set, every group is evicted.
+ */
+static void
+trim_sw_cache(ContQueryCombinerState *state, bool evict_all)
+{
+	SWOutputState *sw = state->sw;
+	Size max_size = evict_all ? 0 : continuous_query_combiner_sw_cache_mem * 1024L;
+	HASH_SEQ_STATUS status;
+	OverlayTupleEntry *entry;
+	MemoryContext old;
+	bool any = false;
+	int sweeps = 0;
+	int i;
+
+	if ((max_size == 0 && !evict_all) || sw->cache_bytes <= max_size)
+		return;
+
+	old = MemoryContextSwitchTo(sw->context);
+
+	/* every group left with cached steps has been referenced if we get to a third sweep */
+	while (sw->cache_bytes > max_size && sweeps++ < 2)
+	{
+		hash_seq_init(&status, sw->overlay_groups->hashtab);
+		while ((entry = (OverlayTupleEntry *) hash_seq_search(&status)) != NULL)
+		{
+			ListCell *lc;
+
+			if (entry->steps == NIL)
+				continue;
+
+			if (entry->referenced)
+			{
+				entry->referenced = false;
+				continue;
+			}
+
+			if (!entry->evicted)
+			{
+				entry->evicted = true;
+				entry->oldest_step = DT_NOEND;
+				entry->newest_step = DT_NOBEGIN;
+				sw->evicted = lappend(sw->evicted, entry);
+			}
+
+			foreach(lc, entry->steps)
+			{
+				StepTupleEntry *step = (StepTupleEntry *) lfirst(lc);
+				TimestampTz ts;
+				bool isnull;
+
+				ExecStoreTuple(step->base.tuple, state->slot, InvalidBuffer, false);
+				ts = DatumGetTimestampTz(slot_getattr(state->slot, sw->arrival_ts_attr, &isnull));
+				Assert(!isnull);
+
+				entry->oldest_step = Min(entry->oldest_step, ts);
+				entry->newest_step = Max(entry->newest_step, ts);
+
+				/* the step is removed from the ring below */
+				resize_sw_cache(sw, -(int64) SW_STEP_SIZE(step));
+				step->group = NULL;
+			}
+
+			list_free(entry->steps);
+			entry->steps = NIL;
+			any = true;
+
+			if (sw->cache_bytes <= max_size)
+			{
+				hash_seq_term(&status);
+				break;
+			}
+		}
+	}
+
+	for (i = 0; any && i < sw->nsteps; i++)
+	{
+		List *keep = NIL;
+		ListCell *lc;
+
+		foreach(lc, sw->ring[i])
+		{
+			StepTupleEntry *step = (StepTupleEntry *) lfirst(lc);
+			HeapTuple tup = step->base.tuple;
+			MinimalTuple key = step->base.shared.firstTuple;
+
+			if (step->group)
+			{
+				keep = lappend(keep, step);
+				continue;
+			}
+
+			ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+			RemoveTupleHashEntry(sw->step_groups, state->slot);
+			heap_freetuple(tup);
+			pfree(key);
+		}
+
+		list_free(sw->ring[i]);
+		sw->ring[i] = keep;
+	}
+
+	ExecClearTuple(state->slot);
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * execute_sw_overlay_plan
+ *
+ * Execute the overlay plan to compute the instantaneous values over the sliding window
+ */
+static void
+execute_sw_overlay_plan(ContQueryCombinerState *state)
+{
+	QueryDesc *query_desc;
+	struct Plan *plan;
+
+	Assert(state->sw);
+	Assert(state->sw->overlay_plan);
+	Assert(state->sw->overlay_dest);
+
+	tuplestore_clear(state->sw->overlay_output);
+	query_desc = CreateQueryDesc(state->sw->overlay_plan,
+			NULL, InvalidSnapshot, InvalidSnapshot, state->sw->overlay_dest, NULL, 0);
+	query_desc->estate = CreateEState(query_desc);
+
+	plan = state->sw->overlay_plan->planTree;
+	query_desc->planstate = ExecInitNode(plan, query_desc->estate, 0);
+	ExecutePlan(query_desc->estate, query_desc->planstate,
+			query_desc->operation,
+			true, 0, ForwardScanDirection, state->sw->overlay_dest);
+	ExecEndNode(query_desc->planstate);
+
+	query_desc->planstate = NULL;
+	query_desc->estate = NULL;
+
+	tuplestore_rescan(state->sw->overlay_output);
+}
+
+/*
+ * resize_sw_ring
+ *
+ * Rebucket the cached steps of a sliding-window view whose step size has changed. Steps written
+ * with the old step size stay cached until they expire like any others.
+ */
+static void
+resize_sw_ring(ContQueryCombinerState *state)
+{
+	SWOutputState *sw = state->sw;
+	List **ring = sw->ring;
+	int nsteps = sw->nsteps;
+	MemoryContext old;
+	int i;
+
+	sw->step_ms = state->base.query->sw_step_ms;
+	sw->nsteps = state->base.query->sw_interval_ms / Max(sw->step_ms, 1) + 2;
+	sw->ring = MemoryContextAllocZero(sw->context, sizeof(List *) * sw->nsteps);
+
+	/* the old step numbers mean nothing for the new step size, so the next tick checks every bucket */
+	sw->expired_step = 0;
+
+	old = MemoryContextSwitchTo(sw->context);
+
+	for (i = 0; i < nsteps; i++)
+	{
+		ListCell *lc;
+
+		foreach(lc, ring[i])
+		{
+			StepTupleEntry *entry = (StepTupleEntry *) lfirst(lc);
+			Datum d;
+			bool isnull;
+			int j;
+
+			ExecStoreTuple(entry->base.tuple, state->slot, InvalidBuffer, false);
+			d = slot_getattr(state->slot, sw->arrival_ts_attr, &isnull);
+			Assert(!isnull);
+
+			j = sw_step_number(state, DatumGetTimestampTz(d)) % sw->nsteps;
+			sw->ring[j] = lappend(sw->ring[j], entry);
+		}
+
+		list_free(ring[i]);
+	}
+
+	pfree(ring);
+
+	MemoryContextSwitchTo(old);
+
+	sw->observed_since = GetCurrentTimestamp();
+	sw->new_steps = 0;
+}
+
+/*
+ * tick_sw_groups
+ *
+ * Since sliding-window values can change over time without receiving
+ * new rows, we need to keep recomputing instantaneous values to write
+ * to this CV's output stream if anything is reading it.
+ */
+static void
+tick_sw_groups(ContQueryCombinerState *state, Relation matrel, bool force)
+{
+	TimestampTz this_tick = GetCurrentTimestamp();
+	OverlayTupleEntry *overlay_entry;
+	Relation osrel;
+	ResultRelInfo *osri;
+	StreamInsertState *sis;
+
+	if (state->sw->step_ms != state->base.query->sw_step_ms)
+		resize_sw_ring(state);
+
+	/* Ensure matrel rows are synced into memory */
+	sync_sw_matrel_groups(state, matrel);
+
+	if (!force && !TimestampDifferenceExceeds(state->sw->last_tick,
+			GetCurrentTimestamp(), state->base.query->sw_step_ms))
+		return;
+
+	expire_sw_steps(state);
+
+	if (state->sw->dirty == NIL &&
+			(continuous_query_combiner_incremental_sw || !hash_get_num_entries(state->sw->step_groups->hashtab)))
+		return;
+
+	osrel = try_relation_open(state->base.query->osrelid, RowExclusiveLock);
+	if (osrel == NULL)
+		return;
+
+	osri = CQOSRelOpen(osrel);
+
+	BeginStreamModify(NULL, osri, NIL, 0, REENTRANT_STREAM_INSERT);
+	sis = (StreamInsertState *) osri->ri_FdwState;
+	Assert(sis);
+
+	/* If nothing is reading from this output stream, there is nothing to do */
+	if (sis->targets == NULL)
+	{
+		gc_cached_overlay_tuples(state, this_tick, NULL);
+		EndStreamModify(NULL, osri);
+		CQOSRelClose(osri);
+		heap_close(osrel, NoLock);
+		trim_sw_cache(state, false);
+		return;
+	}
+
+	/*
+	 * Compute instantaneous sliding-window values of the groups whose windows changed
+	 */
+	reload_evicted_sw_groups(state, matrel);
+	add_dirty_sw_groups_to_overlay_input(state);
+	execute_sw_overlay_plan(state);
+
+	/*
+	 * Write out any changed sliding-window values to the output stream
+	 */
+	tuplestore_rescan(state->sw->overlay_output);
+	foreach_tuple(state->overlay_slot, state->sw->overlay_output)
+	{
+		bool isnew;
+		Datum values[3];
+		bool nulls[3];
+		bool replaces[3];
+		HeapTuple new_tup = ExecMaterializeSlot(state->overlay_slot);
+		HeapTuple old_tup = NULL;
+		HeapTuple os_tup;
+		MemoryContext old;
+
+		Assert(!TupIsNull(state->overlay_slot));
+		overlay_entry = (OverlayTupleEntry *) LookupTupleHashEntry(state->sw->overlay_groups, state->overlay_slot, &isnew);
+
+		if (isnew)
+		{
+			overlay_entry->base.tuple = NULL;
+			overlay_entry->steps = NIL;
+			overlay_entry->dirty = false;
+			overlay_entry->evicted = false;
+			resize_sw_cache(state->sw, SW_GROUP_SIZE(overlay_entry));
+			mark_sw_group_dirty(state->sw, overlay_entry);
+		}
+
+		overlay_entry->last_touched = this_tick;
+		overlay_entry->referenced = true;
+
+		if (overlay_entry->base.tuple)
+		{
+			MemSet(replaces, false, sizeof(replaces));
+			ExecStoreTuple(overlay_entry->base.tuple, state->overlay_prev_slot, InvalidBuffer, false);
+
+			/*
+			 * Similarly to how we don't sync unchanged tuples to disk when combining,
+			 * we don't write unchanged tuples to output streams.
+			 */
+			if (!compare_slots(state->overlay_slot, state->overlay_prev_slot, state->pk, replaces))
+				continue;
+
+			old_tup = overlay_entry->base.tuple;
+		}
+
+		old = MemoryContextSwitchTo(state->sw->step_groups->tablecxt);
+		overlay_entry->base.tuple = heap_copytuple(new_tup);
+		MemoryContextSwitchTo(old);
+
+		resize_sw_cache(state->sw, SW_TUPLE_SIZE(new_tup->t_len));
+
+		MemSet(nulls, true, sizeof(nulls));
+
+		if (old_tup)
+		{
+			nulls[OLD_TUPLE] = false;
+			values[OLD_TUPLE] = heap_copy_tuple_as_datum(old_tup, state->overlay_desc);
+		}
+
+		nulls[state->output_stream_arrival_ts] = true;
+		nulls[NEW_TUPLE] = false;
+		values[NEW_TUPLE] = heap_copy_tuple_as_datum(new_tup, state->overlay_desc);
+
+		/* Finally write the old and new tuple to the output stream */
+		os_tup = heap_form_tuple(state->os_slot->tts_tupleDescriptor, values, nulls);
+		ExecStoreTuple(os_tup, state->os_slot, InvalidBuffer, false);
+		ExecStreamInsert(NULL, osri, state->os_slot, NULL);
+
+		if (old_tup)
+		{
+			resize_sw_cache(state->sw, -(int64) SW_TUPLE_SIZE(old_tup->t_len));
+			heap_freetuple(old_tup);
+		}
+	}
+
+	/*
+	 * Expire any dirty groups in the overlay cache that are no longer in the window
+	 */
+	gc_cached_overlay_tuples(state, this_tick, osri);
+
+	/* Done, cleanup */
+	EndStreamModify(NULL, osri);
+	CQOSRelClose(osri);
+	heap_close(osrel, NoLock);
+
+	tuplestore_clear(state->sw->overlay_input);
+	tuplestore_clear(state->sw->overlay_output);
+
+	trim_sw_cache(state, false);
+
+	state->sw->last_tick = GetCurrentTimestamp();
+}
+
+/*
+ * find_attr
+ *
+ * Find the attribute with the given name in the given TupleDesc
+ */
+static AttrNumber
+find_attr(TupleDesc desc, char *name)
+{
+	int i;
+	AttrNumber result = InvalidAttrNumber;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (pg_strcasecmp(name, NameStr(desc->attrs[i]->attname)) == 0)
+		{
+			result = i + 1;
+			break;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * init_sw_state
+ *
+ * Initialize the state necessary to write SW results to output streams
+ */
+static void
+init_sw_state(ContQueryCombinerState *state, Relation matrel)
+{
+	MemoryContext tmp_cxt;
+	TuplestoreScan *scan;
+	MemoryContext old;
+	Oid *group_ops = NULL;
+	AttrNumber *group_idx = NULL;
+	FmgrInfo *eq_funcs;
+	FmgrInfo *hash_funcs;
+	ColumnRef *cref;
+	int n_group_attr = 0;
+	MemoryContextCallback *callback;
+
+	if (!state->isagg)
+		return;
+
+	cref = GetWindowTimeColumn(state->base.query->name);
+	Assert(cref);
+	Assert(list_length(cref->fields) == 1);
+	Assert(IsA(linitial(cref->fields), String));
+
+	state->sw = palloc0(sizeof(SWOutputState));
+	state->sw->arrival_ts_attr = find_attr(state->desc, strVal(linitial(cref->fields)));
+
+	tmp_cxt = AllocSetContextCreate(CurrentMemoryContext, "SWOutputTmpCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+
+	state->sw->step_groups = BuildTupleHashTable(state->ngroupatts,
+			state->groupatts, state->eq_funcs, state->hash_funcs, 1000,
+			sizeof(StepTupleEntry), CurrentMemoryContext, tmp_cxt);
+
+	state->sw->overlay_plan = GetContinuousViewOverlayPlan(state->base.query);
+	state->sw->context = AllocSetContextCreate(CurrentMemoryContext, "SWOutputCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	callback = MemoryContextAlloc(state->sw->context, sizeof(MemoryContextCallback));
+	callback->func = sw_cache_reset_callback;
+	callback->arg = state->sw;
+	MemoryContextRegisterResetCallback(state->sw->context, callback);
+
+	old = MemoryContextSwitchTo(state->sw->context);
+	state->sw->overlay_input = tuplestore_begin_heap(true, true, work_mem);
+	state->sw->overlay_output = tuplestore_begin_heap(true, true, work_mem);
+	MemoryContextSwitchTo(old);
+
+	state->sw->overlay_plan->isContinuous = false;
+	scan = SetCombinerPlanTuplestorestate(state->sw->overlay_plan, state->sw->overlay_input);
+	scan->desc = state->desc;
+
+	state->sw->overlay_dest = CreateDestReceiver(DestTuplestore);
+	SetTuplestoreDestReceiverParams(state->sw->overlay_dest, state->sw->overlay_output, state->sw->context, true);
+
+	if (IsA(state->sw->overlay_plan->planTree, Agg))
+	{
+		Agg *agg = (Agg *) state->sw->overlay_plan->planTree;
+		int i;
+
+		group_ops = agg->grpOperators;
+		n_group_attr = agg->numCols;
+
+		/*
+		 * Since this is a view over a matrel, these grouping attributes actually
+		 * refer to matrel attributes so we need to offset them by 1 to account for
+		 * the matrel's additional arrival_timestamp column.
+		 *
+		 * There is probably a better way to do this.
+		 */
+		group_idx = palloc0(sizeof(AttrNumber) * n_group_attr);
+		memcpy(group_idx, agg->grpColIdx, sizeof(AttrNumber) * n_group_attr);
+		state->sw->step_group_idx = agg->grpColIdx;
+		for (i = 0; i < n_group_attr; i++)
+		{
+			Assert(group_idx[i] >= 1);
+			group_idx[i] -= 1;
+		}
+	}
+
+	tmp_cxt = AllocSetContextCreate(CurrentMemoryContext, "SWOverlayOutputTmpCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+
+	execTuplesHashPrepare(n_group_attr, group_ops, &eq_funcs, &hash_funcs);
+	state->sw->overlay_groups = BuildTupleHashTable(n_group_attr,
+			group_idx, eq_funcs, hash_funcs, 1000, sizeof(OverlayTupleEntry), CurrentMemoryContext, tmp_cxt);
+
+	state->sw->n_group_attr = n_group_attr;
+	state->sw->overlay_group_idx = group_idx;
+	state->sw->key_slot = MakeSingleTupleTableSlot(state->overlay_desc);
+
+	/*
+	 * A window spans at most this many steps, so each bucket of the ring only ever
+	 * holds steps that would expire together
+	 */
+	state->sw->step_ms = state->base.query->sw_step_ms;
+	state->sw->nsteps = state->base.query->sw_interval_ms / Max(state->sw->step_ms, 1) + 2;
+	state->sw->ring = MemoryContextAllocZero(state->sw->context, sizeof(List *) * state->sw->nsteps);
+	state->sw->observed_since = GetCurrentTimestamp();
+}
+
+/*
+ * project_sw_overlay_into_ostream
+ *
+ * Execute the sliding-window overlay plan on step-sized matrel groups
+ * and write the result to the CV's output stream
+ */
+static void
+project_sw_overlay_into_ostream(ContQueryCombinerState *state, Relation matrel)
+{
+	Assert(state->sw);
+	Assert(state->sw->overlay_input);
+	Assert(state->sw->overlay_output);
+	Assert(state->sw->overlay_plan);
+	Assert(state->sw->overlay_dest);
+
+	/*
+	 * Add or replace any tuples in the cache based on the combiner's most recent output
+	 */
+	tuplestore_rescan(state->combined);
+	foreach_tuple(state->slot, state->combined)
+		cache_sw_step(state, state->slot, true);
+
+	/* Force a tick */
+	tick_sw_groups(state, matrel, true);
+}
+
+/*
+ * can_update_in_place
+ *
+ * Determines whether the new version of an existing group only changes fixed-width,
+ * non-indexed columns without changing which columns are null. Such a version has the
+ * same layout as the old one, so it can overwrite it without creating a new tuple version.
+ */
+static bool
+can_update_in_place(HeapTuple old, HeapTuple new, TupleDesc desc, bool *replace, Bitmapset *indexed)
+{
+	int i;
+
+	if (old->t_len != new->t_len || old->t_data->t_hoff != new->t_data->t_hoff)
+		return false;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		bool old_null;
+
+		if (!replace[i])
+			continue;
+
+		old_null = heap_attisnull(old, i + 1);
+		if (old_null != heap_attisnull(new, i + 1))
+			return false;
+
+		if (old_null)
+			continue;
+
+		if (desc->attrs[i]->attlen <= 0)
+			return false;
+
+		if (bms_is_member(i + 1 - FirstLowInvalidHeapAttributeNumber, indexed))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * overwrite_external_values
+ *
+ * Overwrites the changed chunks of each replaced value that's stored out-of-line without
+ * compression with its new value, which leaves the old tuple's TOAST pointer valid
+ * for the new version. Such columns are no longer replaced, so that a version that only
+ * changes them doesn't have to be written at all, and one that also changes fixed-width
+ * columns can still be updated in place. Returns the number of overwritten values.
+ */
+static int
+overwrite_external_values(HeapTuple old, TupleTableSlot *slot, bool *replace, Bitmapset *indexed)
+{
+	TupleDesc desc = slot->tts_tupleDescriptor;
+	int noverwritten = 0;
+	int i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute attr = desc->attrs[i];
+		Datum value;
+		bool isnull;
+
+		if (!replace[i] || slot->tts_isnull[i])
+			continue;
+
+		if (attr->attlen != -1 || attr->attstorage != 'e')
+			continue;
+
+		if (bms_is_member(i + 1 - FirstLowInvalidHeapAttributeNumber, indexed))
+			continue;
+
+		value = heap_getattr(old, i + 1, desc, &isnull);
+		if (isnull)
+			continue;
+
+		if (toast_overwrite_datum((struct varlena *) DatumGetPointer(value),
+				(struct varlena *) DatumGetPointer(slot->tts_values[i])) < 0)
+			continue;
+
+		replace[i] = false;
+		noverwritten++;
+	}
+
+	return noverwritten;
+}
+
+/*
+ * seq_relfilenode
+ *
+ * Returns the current relfilenode of the given sequence, which changes when it's restarted
+ */
+static Oid
+seq_relfilenode(Oid relid)
+{
+	HeapTuple tup = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+	Oid result;
+
+	if (!HeapTupleIsValid(tup))
+		return InvalidOid;
+
+	result = ((Form_pg_class) GETSTRUCT(tup))->relfilenode;
+	ReleaseSysCache(tup);
+
+	return result;
+}
+
+/*
+ * next_pk
+ *
+ * Returns the next primary key from the view's sequence. Keys are reserved in blocks of the given
+ * number of new groups the caller still expects to insert, so the sequence is read once per block.
+ */
+static int64
+next_pk(ContQueryCombinerState *state, int64 nexpected)
+{
+	if (state->pk_next == state->pk_end)
+	{
+		int64 n = Max(nexpected, 1);
+
+		state->pk_next = nextval_block_internal(state->base.query->seqrelid, &n);
+		state->pk_end = state->pk_next + n;
+		state->pk_relfilenode = seq_relfilenode(state->base.query->seqrelid);
+	}
+
+	return state->pk_next++;
+}
+
+typedef struct ClusteredGroup
+{
+	int64 hash;
+	HeapTuple tup;
+} ClusteredGroup;
+
+/*
+ * clustered_group_cmp
+ */
+static int
+clustered_group_cmp(const void *a, const void *b)
+{
+	int64 ha = ((ClusteredGroup *) a)->hash;
+	int64 hb = ((ClusteredGroup *) b)->hash;
+
+	if (ha < hb)
+		return -1;
+	if (ha > hb)
+		return 1;
+	return 0;
+}
+
+/*
+ * insert_clustered_groups
+ *
+ * For views with cluster_groups, inserts each new group into the heap page of the group preceding it
+ * in hash order if that page has room, so that groups with neighboring hashes, which are looked up
+ * together since lookups are sorted by hash, share pages. New groups are inserted in hash order, so
+ * that the ones without such a neighbor at least share pages with each other. Pages that are full
+ * make the insert fall back to the free space map, which vacuum refills as it prunes updated groups.
+ */
+static void
+insert_clustered_groups(ContQueryCombinerState *state, Relation matrel, HeapTuple *tups, int ntups)
+{
+	ClusteredGroup *groups = palloc(sizeof(ClusteredGroup) * ntups);
+	CommandId cid = GetCurrentCommandId(true);
+	IndexScanDesc scan;
+	Relation index;
+	ScanKeyData key;
+	int i;
+
+	for (i = 0; i < ntups; i++)
+	{
+		ExecStoreTuple(tups[i], state->slot, InvalidBuffer, false);
+		groups[i].hash = group_filter_key(state,
+				(int64) hash_group_for_combiner(state->slot, state->hashfunc, &state->hash_fcinfo));
+		groups[i].tup = tups[i];
+	}
+	ExecClearTuple(state->slot);
+
+	qsort(groups, ntups, sizeof(ClusteredGroup), clustered_group_cmp);
+
+	index = index_open(state->hash_index, AccessShareLock);
+	scan = index_beginscan(matrel, index, GetTransactionSnapshot(), 1, 0);
+
+	for (i = 0; i < ntups; i++)
+	{
+		ItemPointer tid;
+
+		ScanKeyInit(&key, 1, BTLessEqualStrategyNumber, state->hash_index_leproc,
+				state->hashfunc->funcresulttype == INT8OID ?
+				Int64GetDatum(groups[i].hash) : Int32GetDatum((int32) groups[i].hash));
+		index_rescan(scan, &key, 1, NULL, 0);
+
+		/* without a preceding group, we keep filling the page our last insert went to */
+		tid = index_getnext_tid(scan, BackwardScanDirection);
+		if (tid)
+			RelationSetTargetBlock(matrel, ItemPointerGetBlockNumber(tid));
+
+		heap_insert(matrel, groups[i].tup, cid, 0, NULL);
+		tups[i] = groups[i].tup;
+	}
+
+	index_endscan(scan);
+	index_close(index, NoLock);
+
+	pfree(groups);
+}
+
+/*
+ * insert_groups
+ *
+ * Inserts new groups into the matrel all at once, which locks each heap page and
+ * writes its WAL record once for many groups rather than once per group
+ */
+static void
+insert_groups(ContQueryCombinerState *state, ResultRelInfo *ri, EState *estate, HeapTuple *tups, int ntups,
+		CQMatRelIndexBatch *index_batch, BulkInsertState bistate)
+{
+	ExprContext *econtext = GetPerTupleExprContext(estate);
+	TupleTableSlot *scan = econtext->ecxt_scantuple;
+	int i;
+
+	if (state->base.query->cluster_groups && OidIsValid(state->hash_index_leproc) && OidIsValid(state->hash_index))
+		insert_clustered_groups(state, ri->ri_RelationDesc, tups, ntups);
+	else
+		heap_multi_insert(ri->ri_RelationDesc, tups, ntups, GetCurrentCommandId(true), 0, bistate);
+
+	for (i = 0; i < ntups; i++)
+	{
+		ExecStoreTuple(tups[i], state->slot, InvalidBuffer, false);
+		ExecInsertCQMatRelIndexTuples(ri, state->slot, estate, index_batch);
+
+		if (state->group_cache_cxt && state->existing)
+			cache_group(state, NULL, state->slot);
+
+		ResetPerTupleExprContext(estate);
+		heap_freetuple(tups[i]);
+	}
+
+	ExecClearTuple(state->slot);
+
+	/* index expressions were evaluated over our slot, but output stream projections expect their own */
+	econtext->ecxt_scantuple = scan;
+}
+
+/*
+ * open_matrel_ri
+ *
+ * Opens the given matrel's indexes for writing. If result relations are reused, the IndexInfos
+ * built the first time are kept until a relcache invalidation, and only the indexes themselves
+ * are opened and locked again for each sync.
+ */
+static ResultRelInfo *
+open_matrel_ri(ContQueryCombinerState *state, Relation matrel)
+{
+	ResultRelInfo *ri = state->matrel_ri;
+	MemoryContext old;
+	int i;
+
+	if (!continuous_query_combiner_reuse_result_rels)
+		return CQMatRelOpen(matrel);
+
+	if (ri && state->matrel_ri_invals == combiner_rel_invals)
+	{
+		ri->ri_RelationDesc = matrel;
+		for (i = 0; i < ri->ri_NumIndices; i++)
+			ri->ri_IndexRelationDescs[i] = index_open(state->matrel_indexes[i], RowExclusiveLock);
+
+		/* opening the indexes may have processed an invalidation that affects them */
+		if (state->matrel_ri_invals == combiner_rel_invals)
+			return ri;
+
+		ExecCloseIndices(ri);
+	}
+
+	if (state->matrel_ri_cxt)
+		MemoryContextReset(state->matrel_ri_cxt);
+	else
+		state->matrel_ri_cxt = AllocSetContextCreate(state->base.state_cxt, "CombinerMatRelInfoCxt",
+				ALLOCSET_SMALL_MINSIZE,
+				ALLOCSET_SMALL_INITSIZE,
+				ALLOCSET_SMALL_MAXSIZE);
+
+	/* any invalidation received from here on makes us build it again next time */
+	state->matrel_ri_invals = combiner_rel_invals;
+
+	old = MemoryContextSwitchTo(state->matrel_ri_cxt);
+
+	ri = CQMatRelOpen(matrel);
+	state->matrel_indexes = NULL;
+	if (ri->ri_NumIndices)
+	{
+		state->matrel_indexes = palloc(sizeof(Oid) * ri->ri_NumIndices);
+		for (i = 0; i < ri->ri_NumIndices; i++)
+			state->matrel_indexes[i] = RelationGetRelid(ri->ri_IndexRelationDescs[i]);
+	}
+	state->matrel_indexed = RelationGetIndexAttrBitmap(matrel, INDEX_ATTR_BITMAP_ALL);
+
+	MemoryContextSwitchTo(old);
+
+	state->matrel_ri = ri;
+
+	return ri;
+}
+
+/*
+ * close_matrel_ri
+ */
+static void
+close_matrel_ri(ContQueryCombinerState *state, ResultRelInfo *ri)
+{
+	if (ri == state->matrel_ri)
+		ExecCloseIndices(ri);
+	else
+		CQMatRelClose(ri);
+}
+
+/*
+ * write_output_row
+ *
+ * Writes a group's old and new overlay rows to a continuous view's output stream
+ */
+static void
+write_output_row(ContQueryCombinerState *state, ResultRelInfo *osri, Datum old, Datum new)
+{
+	TupleDesc desc = state->os_slot->tts_tupleDescriptor;
+	Datum *values = palloc0(sizeof(Datum) * desc->natts);
+	bool *nulls = palloc0(sizeof(bool) * desc->natts);
+	HeapTuple tup;
+
+	values[OLD_TUPLE] = old;
+	nulls[OLD_TUPLE] = old == (Datum) 0;
+	values[NEW_TUPLE] = new;
+	nulls[NEW_TUPLE] = new == (Datum) 0;
+	nulls[state->output_stream_arrival_ts - 1] = true;
+
+	tup = heap_form_tuple(desc, values, nulls);
+	ExecStoreTuple(tup, state->os_slot, InvalidBuffer, false);
+	ExecStreamInsert(NULL, osri, state->os_slot, NULL);
+
+	pfree(values);
+	pfree(nulls);
+}
+
+/*
+ * Views notify their channel of each changed group individually as long as at most this many groups
+ * changed in a sync, and with a single empty notification otherwise
+ */
+#define MAX_NOTIFY_KEYS 128
+
+/* the longest payload Async_Notify accepts */
+#define MAX_NOTIFY_PAYLOAD (BLCKSZ - NAMEDATALEN - 128)
+
+/*
+ * notify_key
+ *
+ * Returns the notification payload identifying the group in the given slot, or an empty one if it
+ * doesn't fit in a notification
+ */
+static char *
+notify_key(ContQueryCombinerState *state, TupleTableSlot *slot)
+{
+	bool isnull;
+	Datum d = slot_getattr(slot, state->notify_attr, &isnull);
+	char *key;
+
+	if (isnull)
+		return "";
+
+	key = OutputFunctionCall(&state->notify_out, d);
+	if (strlen(key) >= MAX_NOTIFY_PAYLOAD)
+		return "";
+
+	return key;
+}
+
+/*
+ * notify_changes
+ *
+ * Notify a view's channel of the groups a sync changed. Listeners are only sent notifications once
+ * the combiner commits, and identical notifications within a transaction are sent once.
+ */
+static void
+notify_changes(ContQueryCombinerState *state, List *keys, int nchanged)
+{
+	ListCell *lc;
+
+	if (nchanged == 0)
+		return;
+
+	if (!AttributeNumberIsValid(state->notify_attr) || nchanged > MAX_NOTIFY_KEYS)
+	{
+		Async_Notify(state->base.query->notify_channel, "");
+		return;
+	}
+
+	foreach(lc, keys)
+		Async_Notify(state->base.query->notify_channel, (char *) lfirst(lc));
+}
+
+/*
+ * cache_row
+ *
+ * Keeps the given finalized row of the group in the given slot to be written to the read cache
+ * once the sync is committed, or if row is 0, to remove the group's cached row
+ */
+static void
+cache_row(ContQueryCombinerState *state, TupleTableSlot *slot, Datum row)
+{
+	MemoryContext old;
+	ReadCacheRow *r;
+	bool isnull;
+	Datum d = slot_getattr(slot, state->read_cache_attr, &isnull);
+
+	/* groups with a NULL key can't be looked up */
+	if (isnull || state->read_cache_overflow)
+		return;
+
+	/* the cache couldn't hold all of these rows anyway, so we just drop the view's cached rows */
+	if (list_length(state->read_cache_rows) >= ReadCacheCapacity())
+	{
+		state->read_cache_overflow = true;
+		state->read_cache_rows = NIL;
+		MemoryContextReset(state->read_cache_cxt);
+		return;
+	}
+
+	old = MemoryContextSwitchTo(state->read_cache_cxt);
+
+	r = palloc(sizeof(ReadCacheRow));
+	r->key = OutputFunctionCall(&state->read_cache_out, d);
+	r->row = row && VARSIZE(DatumGetPointer(row)) <= READ_CACHE_ROW_SIZE ? datumCopy(row, false, -1) : (Datum) 0;
+	state->read_cache_rows = lappend(state->read_cache_rows, r);
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * begin_cached_rows
+ *
+ * A truncation can't happen while we hold a lock on the matrel, so rows written from now on are
+ * no older than one
+ */
+static void
+begin_cached_rows(ContQueryCombinerState *state)
+{
+	if (!state->read_cache_cxt || state->read_cache_synced)
+		return;
+
+	state->read_cache_generation = ReadCacheGeneration();
+	state->read_cache_synced = true;
+}
+
+/*
+ * forget_cached_rows
+ */
+static void
+forget_cached_rows(ContQueryCombinerState *state)
+{
+	if (!state->read_cache_cxt)
+		return;
+
+	state->read_cache_rows = NIL;
+	state->read_cache_overflow = false;
+	state->read_cache_synced = false;
+	MemoryContextReset(state->read_cache_cxt);
+}
+
+/*
+ * numeric_to_float8
+ *
+ * Converts a value of one of the numeric types views can compare groups by
+ */
+static float8
+numeric_to_float8(Datum d, Oid type, const char *option)
+{
+	switch (type)
+	{
+		case INT2OID:
+			return (float8) DatumGetInt16(d);
+		case INT4OID:
+			return (float8) DatumGetInt32(d);
+		case INT8OID:
+			return (float8) DatumGetInt64(d);
+		case FLOAT4OID:
+			return (float8) DatumGetFloat4(d);
+		case FLOAT8OID:
+			return DatumGetFloat8(d);
+		case NUMERICOID:
+			return DatumGetFloat8(DirectFunctionCall1(numeric_float8, d));
+		default:
+			elog(ERROR, "unsupported %s type %u", option, type);
+	}
+
+	return 0;
+}
+
+/*
+ * output_threshold_value
+ */
+static float8
+output_threshold_value(ContQueryCombinerState *state, Datum row, bool *isnull)
+{
+	HeapTupleHeader header = DatumGetHeapTupleHeader(row);
+	TupleDesc desc = state->output_stream_proj ? state->overlay_desc : state->desc;
+	HeapTupleData tup;
+	Datum d;
+
+	tup.t_len = HeapTupleHeaderGetDatumLength(header);
+	ItemPointerSetInvalid(&tup.t_self);
+	tup.t_tableOid = InvalidOid;
+	tup.t_data = header;
+
+	d = heap_getattr(&tup, state->output_threshold_attr, desc, isnull);
+	if (*isnull)
+		return 0;
+
+	return numeric_to_float8(d, state->output_threshold_type, OPTION_OUTPUT_THRESHOLD_COLUMN);
+}
+
+/*
+ * output_changed
+ *
+ * Does the given update differ from what was last written to the output stream for its group
+ * by more than the view's output threshold?
+ */
+static bool
+output_changed(ContQueryCombinerState *state, Datum prev, Datum new)
+{
+	float8 a;
+	float8 b;
+	bool anull;
+	bool bnull;
+
+	if (!AttributeNumberIsValid(state->output_threshold_attr))
+		return true;
+	if (prev == (Datum) 0 || new == (Datum) 0)
+		return true;
+
+	a = output_threshold_value(state, prev, &anull);
+	b = output_threshold_value(state, new, &bnull);
+
+	if (anull || bnull)
+		return anull != bnull;
+
+	return fabs(b - a) > state->base.query->output_threshold;
+}
+
+/*
+ * set_output_datum
+ */
+static void
+set_output_datum(Datum *dest, Datum value)
+{
+	if (*dest != (Datum) 0)
+		pfree(DatumGetPointer(*dest));
+	*dest = value == (Datum) 0 ? (Datum) 0 : datumCopy(value, false, -1);
+}
+
+/*
+ * coalesce_output
+ *
+ * Writes a group's update to the output stream unless its change since the last row written for the
+ * group is within the view's output threshold, or the group was written less than the view's output
+ * interval ago. Updates held back for the interval are coalesced and written by flush_coalesced_output.
+ */
+static void
+coalesce_output(ContQueryCombinerState *state, ResultRelInfo *osri, TupleTableSlot *slot, Datum old, Datum new)
+{
+	TupleHashTable groups = state->output_groups;
+	TimestampTz now = GetCurrentTimestamp();
+	int interval = state->base.query->output_interval_ms;
+	OutputGroupEntry *entry;
+	MemoryContext cxt;
+	bool isnew;
+
+	cxt = MemoryContextSwitchTo(groups->tablecxt);
+	entry = (OutputGroupEntry *) LookupTupleHashEntry(groups, slot, &isnew);
+	MemoryContextReset(groups->tempcxt);
+
+	if (isnew)
+	{
+		/* the old row is what was written to the output stream for this group before we were started */
+		entry->last_output = 0;
+		entry->output = (Datum) 0;
+		entry->pending = (Datum) 0;
+		set_output_datum(&entry->output, old);
+	}
+
+	if (!output_changed(state, entry->output, new))
+	{
+		set_output_datum(&entry->pending, (Datum) 0);
+	}
+	else if (interval > 0 && new != (Datum) 0 &&
+			!TimestampDifferenceExceeds(entry->last_output, now, interval))
+	{
+		TimestampTz due = entry->last_output + 1000 * (int64) interval;
+
+		set_output_datum(&entry->pending, new);
+		if (!state->output_flush_at || due < state->output_flush_at)
+			state->output_flush_at = due;
+	}
+	else
+	{
+		write_output_row(state, osri, entry->output, new);
+		set_output_datum(&entry->output, new);
+		set_output_datum(&entry->pending, (Datum) 0);
+		entry->last_output = now;
+	}
+
+	MemoryContextSwitchTo(cxt);
+}
+
+/*
+ * flush_coalesced_output
+ *
+ * Writes the updates held back for the output interval whose interval has passed
+ */
+static void
+flush_coalesced_output(ContQueryCombinerState *state)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	int interval = state->base.query->output_interval_ms;
+	TimestampTz next = 0;
+	TupleHashIterator iter;
+	OutputGroupEntry *entry;
+	StreamInsertState *sis;
+	ResultRelInfo *osri;
+	Relation osrel;
+	MemoryContext old;
+
+	if (!state->output_flush_at || now < state->output_flush_at)
+		return;
+
+	osrel = try_relation_open(state->base.query->osrelid, RowExclusiveLock);
+	if (osrel == NULL)
+		return;
+
+	osri = CQOSRelOpen(osrel);
+	BeginStreamModify(NULL, osri, NIL, 0, REENTRANT_STREAM_INSERT);
+	sis = (StreamInsertState *) osri->ri_FdwState;
+	Assert(sis);
+
+	old = MemoryContextSwitchTo(state->output_groups->tablecxt);
+
+	InitTupleHashIterator(state->output_groups, &iter);
+	while ((entry = (OutputGroupEntry *) ScanTupleHashTable(&iter)) != NULL)
+	{
+		TimestampTz due;
+
+		if (entry->pending == (Datum) 0)
+			continue;
+
+		due = entry->last_output + 1000 * (int64) interval;
+		if (due > now)
+		{
+			if (!next || due < next)
+				next = due;
+			continue;
+		}
+
+		/* if nothing is reading from the output stream anymore, the update is just dropped */
+		if (sis->targets)
+			write_output_row(state, osri, entry->output, entry->pending);
+
+		if (entry->output != (Datum) 0)
+			pfree(DatumGetPointer(entry->output));
+		entry->output = entry->pending;
+		entry->pending = (Datum) 0;
+		entry->last_output = now;
+	}
+	TermTupleHashIterator(&iter);
+
+	MemoryContextSwitchTo(old);
+
+	state->output_flush_at = next;
+
+	EndStreamModify(NULL, osri);
+	CQOSRelClose(osri);
+	heap_close(osrel, NoLock);
+}
+
+/*
+ * reaches_top_n
+ *
+ * Does the given group of a top-N view rank at least as high as the lowest ranked group we kept
+ * when we last pruned?
+ */
+static bool
+reaches_top_n(ContQueryCombinerState *state, TupleTableSlot *slot)
+{
+	AttrNumber attno = state->top_n_attr;
+
+	if (slot->tts_isnull[attno - 1])
+		return false;
+
+	return numeric_to_float8(slot->tts_values[attno - 1], state->top_n_type,
+			OPTION_TOP_N_COLUMN) >= state->top_n_threshold;
+}
+
+/*
+ * sync_combine
+ *
+ * Writes the combine results to a continuous view's table, performing
+ * UPDATES or INSERTS as necessary
+ */
+static void
+sync_combine(ContQueryCombinerState *state)
+{
+	TupleHashTable existing = state->existing;
+	TupleTableSlot *slot = state->slot;
+	Size size = sizeof(bool) * slot->tts_tupleDescriptor->natts;
+	bool *replace_all = palloc0(size);
+	EState *estate = CreateExecutorState();
+	int i;
+	Relation matrel;
+	Relation osrel;
+	ResultRelInfo *ri;
+	ResultRelInfo *osri;
+	Size nbytes_inserted = 0;
+	Size nbytes_updated = 0;
+	int ntups_inserted = 0;
+	int ntups_updated = 0;
+	int ntups_hot = 0;
+	CQMatRelIndexBatch *index_batch = NULL;
+	StreamInsertState *sis = NULL;
+	Bitmapset *os_targets = NULL;
+	HeapTuple *inserts = palloc(sizeof(HeapTuple) * MAX_BUFFERED_INSERTS);
+	int ninserts = 0;
+	BulkInsertState bistate;
+	int64 nexpected;
+	int64 nseen = 0;
+	Bitmapset *indexed = NULL;
+	bool skip_old = false;
+	bool notify = am_cont_combiner && state->base.query->notify_channel;
+	List *notify_keys = NIL;
+	int nchanged = 0;
+	bool cache_rows = state->read_cache_cxt != NULL;
+
+	matrel = try_relation_open(state->base.query->matrelid, RowExclusiveLock);
+	if (matrel == NULL)
+		return;
+
+	/*
+	 * We'll handle output stream writes separately for SWs since
+	 * they require the execution of an overlay plan
+	 */
+	if (!state->base.query->is_sw)
+	{
+		osrel = try_relation_open(state->base.query->osrelid, RowExclusiveLock);
+		if (osrel == NULL)
+			return;
+
+		osri = CQOSRelOpen(osrel);
+
+		BeginStreamModify(NULL, osri, NIL, 0, REENTRANT_STREAM_INSERT);
+		sis = (StreamInsertState *) osri->ri_FdwState;
+		Assert(sis);
+
+		os_targets = sis->targets;
+
+		/* If nothing is reading from the output stream, close it immediately */
+		if (os_targets == NULL)
+		{
+			EndStreamModify(NULL, osri);
+			CQOSRelClose(osri);
+			heap_close(osrel, NoLock);
+			sis = NULL;
+		}
+		else if (sis->read_map && find_attr(sis->desc, "old") == InvalidAttrNumber)
+		{
+			/*
+			 * None of the readers use the old rows, so don't project them unless the view's
+			 * output is coalesced, which compares updates against them
+			 */
+			skip_old = true;
+		}
+	}
+
+	/* TRUNCATE ... RESTART IDENTITY restarts the sequence, so the rest of our block may be handed out again */
+	if (state->seq_pk && state->pk_next != state->pk_end &&
+			seq_relfilenode(state->base.query->seqrelid) != state->pk_relfilenode)
+		state->pk_next = state->pk_end;
+
+	/*
+	 * Every combined row that doesn't match an existing group is a new group, unless it's pruned by
+	 * top-N. Cached groups may not be in this batch though, so then only the rows left bound them.
+	 */
+	if (state->seq_pk && existing && !state->group_cache_cxt)
+		nexpected = state->ncombined - hash_get_num_entries(existing->hashtab);
+	else
+		nexpected = -1;
+
+	/*
+	 * Keep the page new groups are inserted into pinned across insert_groups calls, but leave those
+	 * pages in shared buffers rather than in a bulk-write ring, since the groups are updated again
+	 */
+	bistate = GetBulkInsertState();
+	FreeAccessStrategy(bistate->strategy);
+	bistate->strategy = NULL;
+
+	ri = open_matrel_ri(state, matrel);
+
+	begin_cached_rows(state);
+
+	if (continuous_query_combiner_batch_index_inserts)
+		index_batch = CQMatRelBeginIndexBatch(ri, continuous_query_combiner_work_mem);
+
+	if (continuous_query_combiner_inplace_updates)
+	{
+		if (ri == state->matrel_ri)
+			indexed = state->matrel_indexed;
+		else
+			indexed = RelationGetIndexAttrBitmap(matrel, INDEX_ATTR_BITMAP_ALL);
+	}
+
+	estate->es_per_tuple_exprcontext = CreateStandaloneExprContext();
+	estate->es_per_tuple_exprcontext->ecxt_scantuple = state->proj_input_slot;
+
+	if (state->output_stream_proj)
+		state->output_stream_proj->pi_exprContext = estate->es_per_tuple_exprcontext;
+
+	foreach_tuple(slot, state->combined)
+	{
+		HeapTupleEntry update = NULL;
+		HeapTuple tup = NULL;
+		Datum os_values[3];
+		bool os_nulls[3];
+		int replaces = 0;
+
+		MemSet(os_nulls, false, sizeof(os_nulls));
+
+		nseen++;
+
+		/* Only replace values for non-group attributes */
+		MemSet(replace_all, true, size);
+		for (i = 0; i < state->ngroupatts; i++)
+			replace_all[state->groupatts[i] - 1] = false;
+
+		/* Never replace pkey */
+		replace_all[state->pk - 1] = false;
+
+		/* Finalized values are only refreshed when the groups they're finalized from change */
+		for (i = 0; i < state->ncached; i++)
+			replace_all[state->cached_attrs[i] - 1] = false;
+
+		slot_getallattrs(slot);
+
+		if (existing)
+			update = (HeapTupleEntry) LookupTupleHashEntry(existing, slot, NULL);
+
+		if (update)
+		{
+			ExecStoreTuple(update->tuple, state->prev_slot, InvalidBuffer, false);
+			replaces = compare_slots(state->prev_slot, state->slot,
+					state->pk, replace_all);
+
+			if (replaces == 0)
+				continue;
+
+			if (os_targets && (!skip_old || state->output_groups))
+				os_values[OLD_TUPLE] = project_overlay(state, update->tuple, &os_nulls[OLD_TUPLE]);
+			else
+				os_nulls[OLD_TUPLE] = true;
+
+			if (continuous_query_combiner_inplace_updates && !state->ncached)
+				replaces -= overwrite_external_values(update->tuple, slot, replace_all, indexed);
+
+			/*
+			 * The slot has the updated values, so store them in the updatable physical tuple
+			 */
+			tup = heap_modify_tuple(update->tuple, slot->tts_tupleDescriptor,
+					slot->tts_values, slot->tts_isnull, replace_all);
+			if (state->ncached)
+				tup = cache_finalized(state, tup, replace_all);
+			ExecStoreTuple(tup, slot, InvalidBuffer, false);
+
+			if (replaces == 0)
+			{
+				/* every changed value was overwritten where it's stored out-of-line */
+				ntups_hot++;
+			}
+			else if (continuous_query_combiner_inplace_updates &&
+					can_update_in_place(update->tuple, tup, slot->tts_tupleDescriptor, replace_all, indexed))
+			{
+				/* the on-disk tuple keeps its header, so our copy of it should too */
+				HeapTupleHeaderSetXmin(tup->t_data, HeapTupleHeaderGetRawXmin(update->tuple->t_data));
+				heap_inplace_update(matrel, tup);
+				ntups_hot++;
+			}
+			else
+			{
+				ExecCQMatRelUpdate(ri, slot, estate, index_batch);
+				if (HeapTupleIsHeapOnly(tup))
+					ntups_hot++;
+			}
+
+			if (state->group_cache_cxt)
+				cache_group(state, (GroupCacheEntry *) update, slot);
+
+			if (os_targets || cache_rows)
+				os_values[NEW_TUPLE] = project_overlay(state, tup, &os_nulls[NEW_TUPLE]);
+
+			ntups_updated++;
+			nbytes_updated += HEAPTUPLESIZE + slot->tts_tuple->t_len;
+		}
+		else
+		{
+			/* New groups that wouldn't have survived the last pruning of a top-N view aren't stored */
+			if (state->top_n_full && !reaches_top_n(state, slot))
+			{
+				ResetPerTupleExprContext(estate);
+				continue;
+			}
+
+			/* No existing tuple found, so it's an INSERT. Also generate a primary key for it if necessary. */
+			if (state->seq_pk)
+			{
+				int64 nleft = nexpected >= 0 ? nexpected - ntups_inserted : state->ncombined - nseen + 1;
+
+				slot->tts_values[state->pk - 1] = Int64GetDatum(next_pk(state, nleft));
+			}
+			slot->tts_isnull[state->pk - 1] = false;
+			tup = heap_form_tuple(slot->tts_tupleDescriptor, slot->tts_values, slot->tts_isnull);
+			if (state->ncached)
+				tup = cache_finalized(state, tup, NULL);
+			inserts[ninserts++] = tup;
+
+			if (os_targets || cache_rows)
+			{
+				os_nulls[OLD_TUPLE] = true;
+				os_nulls[NEW_TUPLE] = false;
+				os_values[OLD_TUPLE] = (Datum) NULL;
+				os_values[NEW_TUPLE] = project_overlay(state, tup, &os_nulls[NEW_TUPLE]);
+			}
+
+			ntups_inserted++;
+			nbytes_inserted += HEAPTUPLESIZE + tup->t_len;
+		}
+
+		if (notify && nchanged++ < MAX_NOTIFY_KEYS && AttributeNumberIsValid(state->notify_attr))
+			notify_keys = lappend(notify_keys, notify_key(state, slot));
+
+		if (cache_rows && !os_nulls[NEW_TUPLE])
+			cache_row(state, slot, os_values[NEW_TUPLE]);
+
+		/*
+		 * If anything is reading this CV's output stream, write out the
+		 * old and new rows to it
+		 */
+		if (os_targets &&
+				(os_nulls[OLD_TUPLE] == false || os_nulls[NEW_TUPLE] == false))
+		{
+			Datum old = os_nulls[OLD_TUPLE] ? (Datum) 0 : os_values[OLD_TUPLE];
+			Datum new = os_nulls[NEW_TUPLE] ? (Datum) 0 : os_values[NEW_TUPLE];
+
+			if (state->output_groups)
+				coalesce_output(state, osri, slot, old, new);
+			else
+				write_output_row(state, osri, old, new);
+		}
+
+		ResetPerTupleExprContext(estate);
+
+		if (ninserts == MAX_BUFFERED_INSERTS)
+		{
+			insert_groups(state, ri, estate, inserts, ninserts, index_batch, bistate);
+			ninserts = 0;
+		}
+	}
+
+	if (ninserts)
+		insert_groups(state, ri, estate, inserts, ninserts, index_batch, bistate);
+
+	FreeBulkInsertState(bistate);
+
+	if (notify)
+		notify_changes(state, notify_keys, nchanged);
+
+	if (sis)
+	{
+		EndStreamModify(NULL, osri);
+		CQOSRelClose(osri);
+		heap_close(osrel, NoLock);
+		sis = NULL;
+	}
+
+	/*
+	 * We handle SW output stream writes here so we can execute the
+	 * overlay plan on the whole batch all at once in order to to
+	 * compute output stream tuples.
+	 */
+	if (state->sw)
+		project_sw_overlay_into_ostream(state, matrel);
+
+	tuplestore_clear(state->combined);
+
+	/* each new row of a sliding-window view is a group appearing in a new step */
+	if (state->sw)
+		state->sw->new_steps += ntups_inserted;
+
+	/* the index entries of everything this sync wrote are inserted all at once, in key order */
+	CQMatRelEndIndexBatch(index_batch);
+
+	pgstat_increment_cq_update(ntups_updated, nbytes_updated);
+	pgstat_increment_cq_hot_update(ntups_hot);
+	pgstat_increment_cq_write(ntups_inserted, nbytes_inserted);
+
+	state->ff_updates += ntups_updated;
+	state->ff_hot_updates += ntups_hot;
+
+	close_matrel_ri(state, ri);
+	heap_close(matrel, NoLock);
+
+	FreeExecutorState(estate);
+}
+
+/*
+ * execute_combine_plan
+ *
+ * Runs the combine plan over the batch, storing the combined rows in combined
+ */
+static void
+execute_combine_plan(ContQueryCombinerState *state)
+{
+	Portal portal;
+	DestReceiver *dest;
+	bool instrumented;
+
+	portal = CreatePortal("combine", true, true);
+	portal->visible = false;
+
+	PortalDefineQuery(portal,
+					  NULL,
+					  state->base.query->matrel->relname,
+					  "SELECT",
+					  list_make1(state->combine_plan),
+					  NULL);
+
+	dest = CreateDestReceiver(DestTuplestore);
+	SetTuplestoreDestReceiverParams(dest, state->combined, state->combine_cxt, true);
+
+	PortalStart(portal, NULL, EXEC_FLAG_COMBINE, NULL);
+	instrumented = ContInstrumentStart(state->base.query->id, Combiner, portal->queryDesc->planstate);
+
+	(void) PortalRun(portal,
+					 FETCH_ALL,
+					 true,
+					 dest,
+					 dest,
+					 NULL);
+
+	if (instrumented)
+		ContInstrumentEnd(state->base.query->id, Combiner, portal->queryDesc);
+
+	state->ncombined = portal->queryDesc->estate->es_processed;
+
+	PortalDrop(portal, false);
+	TupleBatchClear(state->batch);
+}
+
+/*
+ * native_merge
+ *
+ * Merges the incoming state into the given state, which is modified in place or reallocated
+ */
+static Datum
+native_merge(NativeMergeKind kind, Datum state, Datum incoming)
+{
+	switch (kind)
+	{
+		case NATIVE_MERGE_HLL:
+			return PointerGetDatum(HLLUnion((HyperLogLog *) DatumGetPointer(state),
+					(HyperLogLog *) PG_DETOAST_DATUM(incoming)));
+		case NATIVE_MERGE_BLOOM:
+			return PointerGetDatum(BloomFilterUnion((BloomFilter *) DatumGetPointer(state),
+					(BloomFilter *) PG_DETOAST_DATUM(incoming)));
+		case NATIVE_MERGE_CMSKETCH:
+			return PointerGetDatum(CountMinSketchMerge((CountMinSketch *) DatumGetPointer(state),
+					(CountMinSketch *) PG_DETOAST_DATUM(incoming)));
+		case NATIVE_MERGE_TDIGEST:
+			/* merging compresses the incoming digest, so it must be our own copy */
+			return PointerGetDatum(TDigestMerge((TDigest *) DatumGetPointer(state),
+					(TDigest *) PG_DETOAST_DATUM_COPY(incoming)));
+		default:
+			elog(ERROR, "unrecognized native merge kind: %d", kind);
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * native_copy
+ *
+ * Returns a copy of the given incoming state that can be merged into, expanding it if it's sparse
+ */
+static Datum
+native_copy(NativeMergeKind kind, Datum incoming)
+{
+	switch (kind)
+	{
+		case NATIVE_MERGE_BLOOM:
+			return PointerGetDatum(BloomFilterCopy((BloomFilter *) PG_DETOAST_DATUM(incoming)));
+		case NATIVE_MERGE_CMSKETCH:
+			return PointerGetDatum(CountMinSketchCopy((CountMinSketch *) PG_DETOAST_DATUM(incoming)));
+		default:
+			return PointerGetDatum(PG_DETOAST_DATUM_COPY(incoming));
+	}
+}
+
+/*
+ * native_combine
+ *
+ * Merges the batch into its groups' states directly, without the combine plan. The merged
+ * groups are kept until the next sync, at which point they're stored in combined.
+ */
+static void
+native_combine(ContQueryCombinerState *state)
+{
+	TupleTableSlot *slot = state->slot;
+	TupleDesc desc = state->desc;
+	MemoryContext old;
+	int i;
+
+	if (state->native_groups == NULL)
+	{
+		MemoryContext cxt = AllocSetContextCreate(state->combine_cxt, "CombinerNativeGroupsCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+		MemoryContext tmp_cxt = AllocSetContextCreate(cxt, "CombinerNativeGroupsTmpCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+
+		state->native_groups = BuildTupleHashTable(state->ngroupatts, state->groupatts, state->eq_funcs,
+				state->hash_funcs, 1000, sizeof(NativeGroupEntry), cxt, tmp_cxt);
+	}
+
+	foreach_batch_tuple(slot, state->batch)
+	{
+		NativeGroupEntry *entry;
+		bool isnew;
+
+		entry = (NativeGroupEntry *) LookupTupleHashEntry(state->native_groups, slot, &isnew);
+		slot_getallattrs(slot);
+
+		old = MemoryContextSwitchTo(state->native_groups->tablecxt);
+
+		if (isnew)
+		{
+			entry->base.tuple = ExecCopySlotTuple(slot);
+			entry->values = palloc(sizeof(Datum) * desc->natts);
+			entry->nulls = palloc(sizeof(bool) * desc->natts);
+			heap_deform_tuple(entry->base.tuple, desc, entry->values, entry->nulls);
+
+			/* merges modify states in place, so they can't point into the tuple or be sparse */
+			for (i = 0; i < desc->natts; i++)
+			{
+				if (state->native_merges[i] && !entry->nulls[i])
+					entry->values[i] = native_copy(state->native_merges[i], entry->values[i]);
+			}
+		}
+		else
+		{
+			for (i = 0; i < desc->natts; i++)
+			{
+				if (!state->native_merges[i] || slot->tts_isnull[i])
+					continue;
+
+				if (entry->nulls[i])
+				{
+					entry->values[i] = native_copy(state->native_merges[i], slot->tts_values[i]);
+					entry->nulls[i] = false;
+				}
+				else
+					entry->values[i] = native_merge(state->native_merges[i], entry->values[i], slot->tts_values[i]);
+			}
+		}
+
+		MemoryContextSwitchTo(old);
+	}
+
+	TupleBatchClear(state->batch);
+}
+
+/*
+ * flush_native_groups
+ *
+ * Stores the groups merged since the last sync in combined, as the combine plan would have
+ */
+static void
+flush_native_groups(ContQueryCombinerState *state)
+{
+	TupleDesc desc = state->desc;
+	int ntargets = list_length(state->combine_plan->planTree->targetlist);
+	HASH_SEQ_STATUS status;
+	NativeGroupEntry *entry;
+	int i;
+
+	if (state->native_groups == NULL)
+		return;
+
+	state->ncombined = hash_get_num_entries(state->native_groups->hashtab);
+
+	hash_seq_init(&status, state->native_groups->hashtab);
+	while ((entry = (NativeGroupEntry *) hash_seq_search(&status)) != NULL)
+	{
+		HeapTuple tup;
+
+		for (i = 0; i < desc->natts; i++)
+		{
+			/* the combine plan doesn't output any columns past its target list */
+			if (i >= ntargets)
+				entry->nulls[i] = true;
+			else if (OidIsValid(state->native_transouts[i]) && !entry->nulls[i])
+				entry->values[i] = OidFunctionCall1(state->native_transouts[i], entry->values[i]);
+		}
+
+		tup = heap_form_tuple(desc, entry->values, entry->nulls);
+		tuplestore_puttuple(state->combined, tup);
+		heap_freetuple(tup);
+	}
+
+	MemoryContextDelete(state->native_groups->tablecxt);
+	state->native_groups = NULL;
+}
+
+/*
+ * compact_deltas
+ *
+ * Delta-merge views write each sync's combine result for a group as a new row rather than
+ * updating the group's existing row, and their overlay views combine all of a group's rows
+ * when they're read. Here we merge the rows of each group that was given deltas since the
+ * last compaction back into a single row, so that reads don't have to combine an ever
+ * growing number of them.
+ */
+static void
+compact_deltas(ContQueryCombinerState *state)
+{
+	TupleTableSlot *slot = state->slot;
+	TupleDesc desc = slot->tts_tupleDescriptor;
+	bool *replace;
+	MemoryContext cxt;
+	MemoryContext tmp_cxt;
+	MemoryContext old;
+	TupleHashTable groups;
+	HASH_SEQ_STATUS status;
+	DeltaGroupEntry *entry;
+	Relation matrel;
+	ResultRelInfo *ri;
+	EState *estate;
+	List *rows;
+	ListCell *lc;
+	int ndeltas = 0;
+	int i;
+
+	state->last_compaction = GetCurrentTimestamp();
+
+	/* without the group hash index there is no cheap way to find a group's rows */
+	if (!state->ndelta_hashes || (state->ngroupatts > 0 && !OidIsValid(state->hash_index)))
+	{
+		state->ndelta_hashes = 0;
+		return;
+	}
+
+	matrel = heap_openrv_extended(state->base.query->matrel, RowExclusiveLock, true);
+	if (matrel == NULL)
+		return;
+
+	/* make the deltas written by this sync visible to our scans */
+	CommandCounterIncrement();
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext, "CombinerDeltaCompactionCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	tmp_cxt = AllocSetContextCreate(cxt, "CombinerDeltaCompactionTmpCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	old = MemoryContextSwitchTo(cxt);
+
+	if (state->ngroupatts > 0)
+	{
+		state->ndelta_hashes = sort_hashes(state->delta_hashes, state->ndelta_hashes);
+		rows = fetch_groups(state, matrel, state->delta_hashes, state->ndelta_hashes);
+	}
+	else
+		rows = fetch_all_groups(matrel);
+
+	groups = BuildTupleHashTable(state->ngroupatts, state->groupatts, state->eq_funcs, state->hash_funcs, 1000,
+			sizeof(DeltaGroupEntry), cxt, tmp_cxt);
+
+	foreach(lc, rows)
+	{
+		HeapTuple tup = (HeapTuple) lfirst(lc);
+		bool isnew;
+
+		ExecStoreTuple(tup, slot, InvalidBuffer, false);
+		entry = (DeltaGroupEntry *) LookupTupleHashEntry(groups, slot, &isnew);
+
+		if (isnew)
+		{
+			entry->base.tuple = tup;
+			entry->deltas = NIL;
+		}
+		else
+			entry->deltas = lappend(entry->deltas, tup);
+	}
+	ExecClearTuple(slot);
+
+	/* the batch was consumed by the last combine, so we can use it as the compaction's input */
+	hash_seq_init(&status, groups->hashtab);
+	while ((entry = (DeltaGroupEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->deltas == NIL)
+			continue;
+
+		TupleBatchPut(state->batch, entry->base.tuple);
+		foreach(lc, entry->deltas)
+			TupleBatchPut(state->batch, (HeapTuple) lfirst(lc));
+
+		ndeltas += list_length(entry->deltas);
+	}
+
+	if (ndeltas)
+	{
+		execute_combine_plan(state);
+
+		replace = palloc(sizeof(bool) * desc->natts);
+		MemSet(replace, true, sizeof(bool) * desc->natts);
+		for (i = 0; i < state->ngroupatts; i++)
+			replace[state->groupatts[i] - 1] = false;
+		replace[state->pk - 1] = false;
+
+		ri = open_matrel_ri(state, matrel);
+		estate = CreateExecutorState();
+		estate->es_per_tuple_exprcontext = CreateStandaloneExprContext();
+
+		/* each group keeps its first row, which is overwritten with the merged result */
+		foreach_tuple(slot, state->combined)
+		{
+			HeapTuple tup;
+
+			slot_getallattrs(slot);
+			entry = (DeltaGroupEntry *) LookupTupleHashEntry(groups, slot, NULL);
+			Assert(entry && entry->deltas);
+
+			tup = heap_modify_tuple(entry->base.tuple, desc, slot->tts_values, slot->tts_isnull, replace);
+
+			foreach(lc, entry->deltas)
+				simple_heap_delete(matrel, &((HeapTuple) lfirst(lc))->t_self);
+
+			ExecStoreTuple(tup, slot, InvalidBuffer, false);
+			ExecCQMatRelUpdate(ri, slot, estate, NULL);
+
+			ResetPerTupleExprContext(estate);
+		}
+
+		tuplestore_clear(state->combined);
+
+		close_matrel_ri(state, ri);
+		FreeExecutorState(estate);
+	}
+
+	MemoryContextSwitchTo(old);
+	MemoryContextDelete(cxt);
+
+	heap_close(matrel, NoLock);
+
+	state->ndelta_hashes = 0;
+}
+
+/*
+ * combiner_cache_bytes
+ */
+static Size
+combiner_cache_bytes(ContQueryCombinerState *state)
+{
+	Size bytes = 0;
+
+	if (state->group_cache_cxt)
+		bytes += MemoryContextMemAllocated(state->group_cache_cxt, true);
+	if (state->sw)
+		bytes += MemoryContextMemAllocated(state->sw->context, true);
+
+	return bytes;
+}
+
+/*
+ * release_over_limit_caches
+ *
+ * Empties the caches of the states that were over continuous_query_state_mem, once their pending
+ * results have been synced. Everything released here is read back or planned again when needed.
+ */
+static void
+release_over_limit_caches(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+
+		if (!state || !state->over_mem_limit)
+			continue;
+
+		Assert(state->pending_tuples == 0);
+
+		if (state->group_cache_cxt)
+		{
+			MemoryContextResetAndDeleteChildren(state->group_cache_cxt);
+			state->existing = NULL;
+		}
+
+		if (state->sw)
+			trim_sw_cache(state, true);
+
+		state->groups_plan = NULL;
+		MemoryContextReset(state->plan_cache_cxt);
+
+		state->over_mem_limit = false;
+	}
+
+	bms_free(tmp);
+}
+
+/*
+ * publish_committed_arrivals
+ *
+ * Once the syncs of a batch have been committed, the views they were for are fresh up to the
+ * arrival time of the newest event behind them
+ */
+static void
+publish_committed_arrivals(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+
+		if (!state || !state->synced_arrival)
+			continue;
+
+		pgstat_report_cq_committed_arrival((PgStat_StatCQEntry *) &state->base.stats, state->synced_arrival);
+		state->synced_arrival = 0;
+	}
+
+	bms_free(tmp);
+}
+
+/*
+ * publish_cached_rows
+ *
+ * Writes the rows the syncs of a batch changed through to the read cache once they've been committed
+ */
+static void
+publish_cached_rows(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+
+		if (!state || !state->read_cache_synced)
+			continue;
+
+		ReadCachePut(state->base.query->id, state->read_cache_rows, !state->read_cache_overflow,
+				state->read_cache_generation);
+		forget_cached_rows(state);
+	}
+
+	bms_free(tmp);
+}
+
+/*
+ * sync_all
+ *
+ * With continuous_query_combiner_isolate_syncs, each view is synced in its own subtransaction, so that
+ * a failed sync only rolls back what it wrote itself. Otherwise a failed sync aborts the transaction,
+ * along with the rows of every view synced before it.
+ */
+static void
+sync_all(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	Bitmapset *synced = bms_copy(cont_exec->queries);
+	MemoryContext cxt = CurrentMemoryContext;
+	ResourceOwner owner = CurrentResourceOwner;
+	bool isolate = continuous_query_combiner_isolate_syncs;
+	bool failed = false;
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+		volatile bool error = false;
+
+		if (!state)
+			continue;
+
+		MyStatCQEntry = (PgStat_StatCQEntry *) &state->base.stats;
+
+		if (isolate)
+		{
+			BeginInternalSubTransaction(NULL);
+			MemoryContextSwitchTo(cxt);
+		}
+
+		PG_TRY();
+		{
+			if (state->pending_tuples > 0)
+			{
+				TimestampTz start = GetCurrentTimestamp();
+
+				flush_native_groups(state);
+				sync_combine(state);
+
+				pgstat_report_cq_latency(CQ_LATENCY_SYNC, start);
+				pgstat_report_cq_latency(CQ_LATENCY_END_TO_END, state->oldest_insert);
+			}
+
+			if (state->delta_hashes && TimestampDifferenceExceeds(state->last_compaction,
+					GetCurrentTimestamp(), continuous_query_delta_compaction_interval))
+				compact_deltas(state);
+
+			if (isolate)
+			{
+				ReleaseCurrentSubTransaction();
+				MemoryContextSwitchTo(cxt);
+				CurrentResourceOwner = owner;
+			}
+		}
+		PG_CATCH();
+		{
+			EmitErrorReport();
+			FlushErrorState();
+
+			if (isolate)
+			{
+				RollbackAndReleaseCurrentSubTransaction();
+				MemoryContextSwitchTo(cxt);
+				CurrentResourceOwner = owner;
+			}
+			else
+			{
+				AbortCurrentTransaction();
+				StartTransactionCommand();
+			}
+
+			error = true;
+		}
+		PG_END_TRY();
+
+		pgstat_report_cqstat(false);
+
+		/* the events behind a failed sync never make it to the matrel */
+		if (!error && state->newest_arrival > state->synced_arrival)
+			state->synced_arrival = state->newest_arrival;
+
+		state->pending_tuples = 0;
+		state->oldest_insert = 0;
+		state->newest_arrival = 0;
+
+		/*
+		 * A failed sync may have been a failed compaction, so we forget the groups with deltas
+		 * rather than failing again on the next sync. Their deltas stay correct to read, and
+		 * are compacted once the groups are given new deltas.
+		 */
+		if (error)
+			state->ndelta_hashes = 0;
+
+		/* only the failed view's rows were rolled back */
+		if (error && isolate)
+			forget_cached_rows(state);
+		else
+			failed |= error;
+
+		/* rollups must not be given partial results that never made it to our matrel */
+		if (error && state->rollup_partials)
+		{
+			state->rollup_partials = NIL;
+			MemoryContextReset(state->rollup_partials_cxt);
+		}
+
+		/* groups written by a failed sync may not match what's on disk, so the whole cache is dropped */
+		if (state->group_cache_cxt && !error)
+			trim_group_cache(state);
+		else
+		{
+			if (state->group_cache_cxt)
+				MemoryContextResetAndDeleteChildren(state->group_cache_cxt);
+			state->existing = NULL;
+		}
+
+		MemSet(state->group_hashes, 0, state->group_hashes_len);
+		MemoryContextResetAndDeleteChildren(state->combine_cxt);
+		state->native_groups = NULL;
+	}
+
+	/* a failed sync aborts the transaction, so none of the rows synced before it will be committed */
+	while (failed && (id = bms_first_member(synced)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+
+		if (state)
+			forget_cached_rows(state);
+	}
+
+	bms_free(synced);
+}
+
+/*
+ * forget_truncated_groups
+ *
+ * Once the matrel has been truncated, nothing we've cached about its groups is valid anymore. A
+ * truncation replaces the matrel's relfilenode and can't happen while we hold a lock on it, so the
+ * lock we take here keeps our caches valid until we commit.
+ */
+static void
+forget_truncated_groups(ContQueryCombinerState *state)
+{
+	Relation matrel = try_relation_open(state->base.query->matrelid, AccessShareLock);
+	Oid relfilenode;
+
+	if (matrel == NULL)
+		return;
+
+	relfilenode = matrel->rd_node.relNode;
+	heap_close(matrel, NoLock);
+
+	if (relfilenode == state->matrel_relfilenode)
+		return;
+
+	/* anything still pending was combined in this transaction, so only the caches are stale */
+	if (OidIsValid(state->matrel_relfilenode))
+	{
+		if (state->group_cache_cxt)
+		{
+			MemoryContextResetAndDeleteChildren(state->group_cache_cxt);
+			state->existing = NULL;
+		}
+
+		if (state->sw)
+			trim_sw_cache(state, true);
+
+		forget_group_filter(state);
+		state->ndelta_hashes = 0;
+	}
+
+	state->matrel_relfilenode = relfilenode;
+}
+
+/*
+ * combine
+ *
+ * Combines partial results of a continuous query with existing rows in the continuous view
+ */
+static void
+combine(ContQueryCombinerState *state)
+{
+	TimestampTz start;
+
+	forget_truncated_groups(state);
+
+	/* delta-merge views write each combine result as a new row, so there's nothing to look up */
+	if (state->isagg && !state->delta_hashes)
+	{
+		start = GetCurrentTimestamp();
+
+		if (state->existing == NULL)
+			state->existing = build_existing_hashtable(state);
+		select_existing_groups(state);
+
+		pgstat_report_cq_latency(CQ_LATENCY_LOOKUP, start);
+	}
+
+	start = GetCurrentTimestamp();
+
+	if (state->native_merges)
+	{
+		native_combine(state);
+		pgstat_report_cq_latency(CQ_LATENCY_COMBINE, start);
+		return;
+	}
+
+	foreach_tuple(state->slot, state->combined)
+	{
+		TupleBatchPutSlot(state->batch, state->slot);
+	}
+	tuplestore_clear(state->combined);
+
+	execute_combine_plan(state);
+
+	pgstat_report_cq_latency(CQ_LATENCY_COMBINE, start);
+}
+
+/*
+ * init_finalize_cache
+ *
+ * Finds the matrel columns that cache finalized overlay values, see add_finalize_cache_coldefs
+ */
+static void
+init_finalize_cache(ContQueryCombinerState *state, List *overlay_tlist)
+{
+	int natts = state->desc->natts;
+	ListCell *lc;
+	int i;
+
+	state->cached_attrs = palloc0(sizeof(AttrNumber) * list_length(overlay_tlist));
+	state->cached_overlay_attrs = palloc0(sizeof(AttrNumber) * list_length(overlay_tlist));
+
+	foreach(lc, overlay_tlist)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+		char *name;
+		AttrNumber attno;
+
+		if (te->resjunk)
+			continue;
+
+		name = psprintf(CQ_MATREL_FINAL_PREFIX "%d", te->resno);
+		attno = find_attr(state->desc, name);
+		pfree(name);
+
+		if (!AttributeNumberIsValid(attno))
+			continue;
+
+		if (state->desc->attrs[attno - 1]->atttypid != exprType((Node *) te->expr))
+			elog(ERROR, "finalize cache column %d has type %u but its overlay column has type %u",
+					attno, state->desc->attrs[attno - 1]->atttypid, exprType((Node *) te->expr));
+
+		state->cached_attrs[state->ncached] = attno;
+		state->cached_overlay_attrs[state->ncached] = te->resno;
+		state->ncached++;
+	}
+
+	state->cached_values = palloc0(sizeof(Datum) * natts);
+	state->cached_nulls = palloc0(sizeof(bool) * natts);
+	state->cached_replace = palloc0(sizeof(bool) * natts);
+
+	for (i = 0; i < state->ncached; i++)
+		state->cached_replace[state->cached_attrs[i] - 1] = true;
+}
+
+/*
+ * assign_output_stream_projection
+ *
+ * If this query's output stream requires a projection, assign the projection here.
+ * This is necessary when any aggregates have a final function that isn't applied until
+ * read time, as consumers of the output stream expect a finalized aggregate value.
+ */
+static void
+assign_output_stream_projection(ContQueryCombinerState *state)
+{
+	ListCell *lc;
+	bool needs_proj = false;
+	PlannedStmt *overlay;
+	EState *estate;
+	ExprContext *context;
+	Relation rel;
+
+	rel = heap_open(state->base.query->relid, NoLock);
+	state->overlay_desc = CreateTupleDescCopy(RelationGetDescr(rel));
+	state->overlay_slot = MakeSingleTupleTableSlot(state->overlay_desc);
+	state->overlay_prev_slot = MakeSingleTupleTableSlot(state->overlay_desc);
+	heap_close(rel, NoLock);
+
+	/*
+	 * Sliding windows are set up in init_sw_state,
+	 * and non-sliding windows aren't supported
+	 */
+	if (GetWindowTimeColumn(state->base.query->name))
+		return;
+
+	overlay = GetContinuousViewOverlayPlan(state->base.query);
+	estate = CreateExecutorState();
+	context = CreateStandaloneExprContext();
+
+	foreach(lc, overlay->planTree->targetlist)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+		if (IsA(te->expr, FuncExpr))
+		{
+			needs_proj = true;
+			break;
+		}
+	}
+
+	if (state->base.query->finalize_cache)
+		init_finalize_cache(state, overlay->planTree->targetlist);
+
+	/* cached rows must be the view's rows */
+	if (!needs_proj && !state->ncached && !state->base.query->read_cache_key)
+		return;
+
+	state->output_stream_proj = build_projection(overlay->planTree->targetlist, estate, context, NULL);
+	state->proj_input_slot = MakeSingleTupleTableSlot(state->desc);
+}
+
+/*
+ * find_time_index
+ *
+ * Finds a btree index of the given matrel whose first column is the given attribute
+ */
+static Oid
+find_time_index(Relation matrel, AttrNumber attr)
+{
+	List *indexes;
+	ListCell *lc;
+	Oid result = InvalidOid;
+
+	indexes = RelationGetIndexList(matrel);
+	foreach(lc, indexes)
+	{
+		Relation index = index_open(lfirst_oid(lc), AccessShareLock);
+
+		if (index->rd_rel->relam == BTREE_AM_OID && index->rd_index->indkey.values[0] == attr &&
+				heap_attisnull(index->rd_indextuple, Anum_pg_index_indpred))
+			result = RelationGetRelid(index);
+
+		index_close(index, AccessShareLock);
+
+		if (OidIsValid(result))
+			break;
+	}
+
+	list_free(indexes);
+
+	return result;
+}
+
+/*
+ * init_ttl
+ *
+ * Finds the matrel attribute groups of a view with a ttl expire by, and the btree index on it
+ */
+static void
+init_ttl(ContQueryCombinerState *state, Relation matrel)
+{
+	state->ttl_attr = find_attr(state->desc, state->base.query->ttl_column);
+	if (!AttributeNumberIsValid(state->ttl_attr))
+		elog(ERROR, "ttl_column \"%s\" not found", state->base.query->ttl_column);
+
+	state->ttl_index = find_time_index(matrel, state->ttl_attr);
+}
+
+/*
+ * init_top_n
+ *
+ * Finds the matrel attribute the groups of a top-N view are ranked by
+ */
+static void
+init_top_n(ContQueryCombinerState *state)
+{
+	state->top_n_attr = find_attr(state->desc, state->base.query->top_n_column);
+	if (!AttributeNumberIsValid(state->top_n_attr))
+		elog(ERROR, "top_n_column \"%s\" not found", state->base.query->top_n_column);
+
+	state->top_n_type = state->desc->attrs[state->top_n_attr - 1]->atttypid;
+}
+
+/*
+ * set_group_hash_index
+ *
+ * Finds the btree index on the matrel's group hash expression, for looking up
+ * existing groups without planning a query
+ */
+static void
+set_group_hash_index(ContQueryCombinerState *state, ResultRelInfo *ri)
+{
+	int i;
+
+	if (state->hashfunc == NULL)
+		return;
+
+	for (i = 0; i < ri->ri_NumIndices; i++)
+	{
+		IndexInfo *info = ri->ri_IndexRelationInfo[i];
+		Relation index = ri->ri_IndexRelationDescs[i];
+		Oid op;
+
+		if (index->rd_rel->relam != BTREE_AM_OID || info->ii_NumIndexAttrs != 1 ||
+				info->ii_Predicate != NIL || list_length(info->ii_Expressions) != 1)
+			continue;
+
+		if (!equal(linitial(info->ii_Expressions), state->hashfunc))
+			continue;
+
+		op = get_opfamily_member(index->rd_opfamily[0], index->rd_opcintype[0],
+				state->hashfunc->funcresulttype, BTEqualStrategyNumber);
+		if (!OidIsValid(op))
+			continue;
+
+		state->hash_index = RelationGetRelid(index);
+		state->hash_index_eqproc = get_opcode(op);
+
+		op = get_opfamily_member(index->rd_opfamily[0], index->rd_opcintype[0],
+				state->hashfunc->funcresulttype, BTLessEqualStrategyNumber);
+		state->hash_index_leproc = OidIsValid(op) ? get_opcode(op) : InvalidOid;
+
+		fmgr_info_cxt(state->hashfunc->funcid, &state->hash_flinfo, state->base.state_cxt);
+		fmgr_info_set_expr((Node *) state->hashfunc, &state->hash_flinfo);
+		InitFunctionCallInfoData(state->hash_fcinfo, &state->hash_flinfo,
+				list_length(state->hashfunc->args), state->hashfunc->funccollid, NULL, NULL);
+		break;
+	}
+}
+
+/*
+ * get_combine_input_attr
+ *
+ * Resolves the matrel column read by the given combine plan expression, or returns
+ * InvalidAttrNumber if it's not a plain column reference
+ */
+static AttrNumber
+get_combine_input_attr(Plan *plan, Node *node)
+{
+	Var *var;
+
+	if (!IsA(node, Var))
+		return InvalidAttrNumber;
+
+	var = (Var *) node;
+	while (var->varno == OUTER_VAR)
+	{
+		TargetEntry *te;
+
+		plan = outerPlan(plan);
+		if (plan == NULL || var->varattno < 1 || var->varattno > list_length(plan->targetlist))
+			return InvalidAttrNumber;
+
+		te = (TargetEntry *) list_nth(plan->targetlist, var->varattno - 1);
+		if (!IsA(te->expr, Var))
+			return InvalidAttrNumber;
+
+		var = (Var *) te->expr;
+	}
+
+	return var->varattno;
+}
+
+/*
+ * get_native_merge
+ *
+ * Determines whether the states of the given aggregate can be merged natively, going by
+ * the function that the combine plan would merge them with
+ */
+static NativeMergeKind
+get_native_merge(Oid aggfnoid)
+{
+	HeapTuple tup;
+	Form_pg_aggregate aggform;
+	Oid transfn;
+	Oid finalfn;
+
+	tup = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggfnoid));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for aggregate %u", aggfnoid);
+
+	aggform = (Form_pg_aggregate) GETSTRUCT(tup);
+	transfn = aggform->aggtransfn;
+	finalfn = aggform->aggfinalfn;
+	ReleaseSysCache(tup);
+
+	tup = SearchSysCache2(PIPELINECOMBINETRANSFNOID, ObjectIdGetDatum(finalfn), ObjectIdGetDatum(transfn));
+	if (HeapTupleIsValid(tup))
+	{
+		transfn = ((Form_pipeline_combine) GETSTRUCT(tup))->combinefn;
+		ReleaseSysCache(tup);
+	}
+
+	switch (transfn)
+	{
+		case F_HLL_UNION_AGG_TRANS:
+			return NATIVE_MERGE_HLL;
+		case F_BLOOM_UNION_AGG_TRANS:
+			return NATIVE_MERGE_BLOOM;
+		case F_CMSKETCH_MERGE_AGG_TRANS:
+			return NATIVE_MERGE_CMSKETCH;
+		case F_TDIGEST_MERGE_AGG_TRANS:
+			return NATIVE_MERGE_TDIGEST;
+		default:
+			return NATIVE_MERGE_NONE;
+	}
+}
+
+/*
+ * set_native_merges
+ *
+ * If every aggregate of the combine plan is a sketch we can merge natively, sets up the
+ * state to combine batches without executing the combine plan
+ */
+static void
+set_native_merges(ContQueryCombinerState *state)
+{
+	Plan *plan = state->combine_plan->planTree;
+	int natts = state->desc->natts;
+	NativeMergeKind *merges = palloc0(sizeof(NativeMergeKind) * natts);
+	Oid *transouts = palloc0(sizeof(Oid) * natts);
+	bool found = false;
+	ListCell *lc;
+
+	if (list_length(plan->targetlist) > natts)
+		return;
+
+	foreach(lc, plan->targetlist)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+		Node *expr = (Node *) te->expr;
+		Aggref *agg;
+		Oid transout = InvalidOid;
+
+		/* grouping columns are passed through */
+		if (IsA(expr, Var))
+		{
+			if (get_combine_input_attr(plan, expr) != te->resno)
+				return;
+			continue;
+		}
+
+		/* transition out functions are applied to the merged state */
+		if (IsA(expr, FuncExpr) && list_length(((FuncExpr *) expr)->args) == 1)
+		{
+			transout = ((FuncExpr *) expr)->funcid;
+			expr = (Node *) linitial(((FuncExpr *) expr)->args);
+		}
+
+		if (!IsA(expr, Aggref))
+			return;
+
+		agg = (Aggref *) expr;
+		if (list_length(agg->args) != 1 || agg->aggdistinct || agg->aggorder || agg->aggfilter)
+			return;
+
+		if (get_combine_input_attr(plan, (Node *) ((TargetEntry *) linitial(agg->args))->expr) != te->resno)
+			return;
+
+		merges[te->resno - 1] = get_native_merge(agg->aggfnoid);
+		if (merges[te->resno - 1] == NATIVE_MERGE_NONE)
+			return;
+
+		transouts[te->resno - 1] = transout;
+		found = true;
+	}
+
+	if (!found)
+		return;
+
+	state->native_merges = merges;
+	state->native_transouts = transouts;
+}
+
+/*
+ * set_monotone_aggs
+ *
+ * If every aggregate of the combine plan only keeps the greatest or least value it has seen,
+ * sets up the state to drop partial results that can't change their groups' on-disk rows.
+ * These are the aggregates that have a sort operator, such as max, min, bool_or and bool_and,
+ * and that operator tells us whether a new value would replace the stored one.
+ */
+static void
+set_monotone_aggs(ContQueryCombinerState *state)
+{
+	Plan *plan = state->combine_plan->planTree;
+	int natts = list_length(plan->targetlist);
+	AttrNumber *atts = palloc0(sizeof(AttrNumber) * natts);
+	Oid *ops = palloc0(sizeof(Oid) * natts);
+	int n = 0;
+	ListCell *lc;
+	int i;
+
+	foreach(lc, plan->targetlist)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+		Aggref *agg;
+		HeapTuple tup;
+		Oid sortop;
+		AttrNumber att;
+
+		if (IsA(te->expr, Var))
+			continue;
+
+		if (!IsA(te->expr, Aggref))
+			return;
+
+		agg = (Aggref *) te->expr;
+		if (list_length(agg->args) != 1 || agg->aggdistinct || agg->aggorder || agg->aggfilter)
+			return;
+
+		/* each aggregate must combine the matrel column it's stored in */
+		att = get_combine_input_attr(plan, (Node *) ((TargetEntry *) linitial(agg->args))->expr);
+		if (att != te->resno)
+			return;
+
+		tup = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(agg->aggfnoid));
+		if (!HeapTupleIsValid(tup))
+			elog(ERROR, "cache lookup failed for aggregate %u", agg->aggfnoid);
+		sortop = ((Form_pg_aggregate) GETSTRUCT(tup))->aggsortop;
+		ReleaseSysCache(tup);
+
+		if (!OidIsValid(sortop))
+			return;
+
+		atts[n] = att;
+		ops[n] = sortop;
+		n++;
+	}
+
+	if (n == 0)
+		return;
+
+	state->nmonotone = n;
+	state->monotone_atts = atts;
+	state->monotone_ops = palloc0(sizeof(FmgrInfo) * n);
+
+	for (i = 0; i < n; i++)
+		fmgr_info(get_opcode(ops[i]), &state->monotone_ops[i]);
+}
+
+/*
+ * init_output_coalescing
+ */
+static void
+init_output_coalescing(ContQueryCombinerState *state)
+{
+	MemoryContext cxt = AllocSetContextCreate(state->base.state_cxt, "CombinerOutputGroupsCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext tmp_cxt = AllocSetContextCreate(cxt, "CombinerOutputGroupsTmpCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
+
+	state->output_groups = BuildTupleHashTable(state->ngroupatts, state->groupatts, state->eq_funcs,
+			state->hash_funcs, 1000, sizeof(OutputGroupEntry), cxt, tmp_cxt);
+
+	if (state->base.query->output_threshold_column)
+	{
+		TupleDesc desc = state->output_stream_proj ? state->overlay_desc : state->desc;
+
+		state->output_threshold_attr = find_attr(desc, state->base.query->output_threshold_column);
+		if (!AttributeNumberIsValid(state->output_threshold_attr))
+			elog(ERROR, "output_threshold_column \"%s\" not found", state->base.query->output_threshold_column);
+		state->output_threshold_type = desc->attrs[state->output_threshold_attr - 1]->atttypid;
+	}
+
+	MemoryContextSwitchTo(old);
+}
+
+static ContQueryState *
+init_query_state(ContExecutor *cont_exec, ContQueryState *base)
+{
+	PlannedStmt *pstmt;
+	ContQueryCombinerState *state;
+	Relation matrel;
+	List *indices = NIL;
+	ListCell *lc;
+	Relation osrel ;
+
+	if (base->query->type != CONT_VIEW)
+	{
+		base->query = NULL;
+		return base;
+	}
+
+	state = (ContQueryCombinerState *) palloc0(sizeof(ContQueryCombinerState));
+	memcpy(&state->base, base, sizeof(ContQueryState));
+	pfree(base);
+	base = (ContQueryState *) state;
+
+	state->plan_cache_cxt = AllocSetContextCreate(base->state_cxt, "CombinerQueryPlanCacheCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	state->combine_cxt = AllocSetContextCreate(base->state_cxt, "CombinerQueryCombineCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	matrel = heap_openrv_extended(base->query->matrel, AccessShareLock, true);
+	pstmt = GetContPlan(base->query, Combiner);
+
+	state->batch = TupleBatchCreate(base->state_cxt);
+	state->combined = tuplestore_begin_heap(false, false, continuous_query_combiner_work_mem);
+
+	/* this also sets the state's desc field */
+	prepare_combine_plan(state, pstmt);
+	state->slot = MakeSingleTupleTableSlot(state->desc);
+	state->prev_slot = MakeSingleTupleTableSlot(state->desc);
+	state->groups_plan = NULL;
+
+	/* this will grow dynamically when needed, but this is a good starting size */
+	state->group_hashes_len = continuous_query_batch_size;
+	state->group_hashes = palloc0(state->group_hashes_len * sizeof(int64));
+
+	if (matrel == NULL)
+	{
+		base->query = NULL;
+		return base;
+	}
+
+	osrel = try_relation_open(base->query->osrelid, AccessShareLock);
+	state->os_slot = MakeSingleTupleTableSlot(CreateTupleDescCopy(RelationGetDescr(osrel)));
+	heap_close(osrel, AccessShareLock);
+
+	state->output_stream_arrival_ts = find_attr(state->os_slot->tts_tupleDescriptor, ARRIVAL_TIMESTAMP);
+	Assert(state->output_stream_arrival_ts);
+
+	assign_output_stream_projection(state);
+
+	if (IsA(state->combine_plan->planTree, Agg))
+	{
+		Agg *agg = (Agg *) state->combine_plan->planTree;
+		ResultRelInfo *ri;
+
+		state->groupatts = agg->grpColIdx;
+		state->ngroupatts = agg->numCols;
+		state->groupops = agg->grpOperators;
+		state->isagg = true;
+
+		ri = CQMatRelOpen(matrel);
+
+		if (state->ngroupatts)
+		{
+			state->hashfunc = GetGroupHashIndexExpr(ri);
+			set_group_hash_index(state, ri);
+		}
+
+		CQMatRelClose(ri);
+
+		execTuplesHashPrepare(state->ngroupatts, state->groupops, &state->eq_funcs, &state->hash_funcs);
+
+		if (base->query->delta_merge)
+		{
+			MemoryContext old = MemoryContextSwitchTo(base->state_cxt);
+
+			state->delta_hashes_len = continuous_query_batch_size;
+			state->delta_hashes = palloc(state->delta_hashes_len * sizeof(int64));
+			state->last_compaction = GetCurrentTimestamp();
+
+			MemoryContextSwitchTo(old);
+		}
+		else
+		{
+			/* sliding-window matrels are vacuumed constantly, so there's little point in caching their groups */
+			if (am_cont_combiner && continuous_query_combiner_group_cache_mem > 0 && !base->query->is_sw)
+				state->group_cache_cxt = AllocSetContextCreate(base->state_cxt, "CombinerGroupCacheCxt",
+						ALLOCSET_DEFAULT_MINSIZE,
+						ALLOCSET_DEFAULT_INITSIZE,
+						ALLOCSET_DEFAULT_MAXSIZE);
+
+			state->existing = build_existing_hashtable(state);
+			set_monotone_aggs(state);
+		}
+
+		/* sliding windows keep using the combine plan */
+		if (!base->query->is_sw)
+			set_native_merges(state);
+
+		if (base->query->freeze_column)
+			state->freeze_attr = find_attr(state->desc, base->query->freeze_column);
+
+		if (am_cont_combiner && !base->query->is_sw &&
+				(base->query->output_interval_ms > 0 || base->query->output_threshold_column))
+			init_output_coalescing(state);
+	}
+
+	if (base->query->notify_key)
+	{
+		Oid outfn;
+		bool isvarlena;
+
+		state->notify_attr = find_attr(state->desc, base->query->notify_key);
+		if (!AttributeNumberIsValid(state->notify_attr))
+			elog(ERROR, "notify_key \"%s\" not found", base->query->notify_key);
+
+		getTypeOutputInfo(state->desc->attrs[state->notify_attr - 1]->atttypid, &outfn, &isvarlena);
+		fmgr_info_cxt(outfn, &state->notify_out, base->state_cxt);
+	}
+
+	if (am_cont_combiner && base->query->read_cache_key && ReadCacheEnabled())
+	{
+		Oid outfn;
+		bool isvarlena;
+
+		state->read_cache_attr = find_attr(state->desc, base->query->read_cache_key);
+		if (!AttributeNumberIsValid(state->read_cache_attr))
+			elog(ERROR, "read_cache_key \"%s\" not found", base->query->read_cache_key);
+
+		getTypeOutputInfo(state->desc->attrs[state->read_cache_attr - 1]->atttypid, &outfn, &isvarlena);
+		fmgr_info_cxt(outfn, &state->read_cache_out, base->state_cxt);
+
+		state->read_cache_cxt = AllocSetContextCreate(base->state_cxt, "CombinerReadCacheCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+	}
+
+	/*
+	 * Find the primary key column
+	 */
+	indices = RelationGetIndexList(matrel);
+	foreach(lc, indices)
+	{
+		Oid indexoid = lfirst_oid(lc);
+		HeapTuple tup = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(indexoid));
+		Form_pg_index form;
+
+		if (!HeapTupleIsValid(tup))
+			elog(ERROR, "index %u for matrel %u not found", indexoid, RelationGetRelid(matrel));
+
+		form = (Form_pg_index) GETSTRUCT(tup);
+		if (form->indisprimary)
+		{
+			Assert(form->indnatts == 1);
+			state->pk = form->indkey.values[0];
+		}
+		ReleaseSysCache(tup);
+	}
+
+	if (state->base.query->is_sw)
+		init_sw_state(state, matrel);
+
+	if (am_cont_combiner && base->query->ttl_column)
+		init_ttl(state, matrel);
+
+	if (am_cont_combiner && base->query->top_n_column)
+		init_top_n(state);
+
+	heap_close(matrel, AccessShareLock);
+
+	Assert(AttributeNumberIsValid(state->pk));
+	state->seq_pk = OidIsValid(base->query->seqrelid);
+
+	return base;
+}
+
+/*
+ * set_group_hash
+ *
+ * Set the group hash at the given index, increasing the size of the group hashes array if necessary
+ */
+static void
+set_group_hash(ContQueryCombinerState *state, int index, int64 hash)
+{
+	int start = state->group_hashes_len;
+
+	while (index >= state->group_hashes_len)
+		state->group_hashes_len *= 2;
+
+	if (start != state->group_hashes_len)
+	{
+		MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
+		state->group_hashes = repalloc(state->group_hashes, state->group_hashes_len * sizeof(int64));
+		MemoryContextSwitchTo(old);
+	}
+
+	Assert(index < state->group_hashes_len);
+	state->group_hashes[index] = hash;
+}
+
+/*
+ * add_delta_hashes
+ *
+ * Remembers the groups of the batch just read, which will each be given a delta row
+ */
+static void
+add_delta_hashes(ContQueryCombinerState *state, int count)
+{
+	if (state->ndelta_hashes + count > state->delta_hashes_len)
+		state->ndelta_hashes = sort_hashes(state->delta_hashes, state->ndelta_hashes);
+
+	if (state->ndelta_hashes + count > state->delta_hashes_len)
+	{
+		MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
+
+		while (state->ndelta_hashes + count > state->delta_hashes_len)
+			state->delta_hashes_len *= 2;
+		state->delta_hashes = repalloc(state->delta_hashes, state->delta_hashes_len * sizeof(int64));
+
+		MemoryContextSwitchTo(old);
+	}
+
+	memcpy(state->delta_hashes + state->ndelta_hashes, state->group_hashes, count * sizeof(int64));
+	state->ndelta_hashes += count;
+}
+
+/*
+ * copy_partial
+ *
+ * Copies the given partial result without its acks, which are acknowledged once it's popped
+ * from our queue regardless of where it ends up being combined
+ */
+static PartialTupleState *
+copy_partial(PartialTupleState *pts, int *len)
+{
+	PartialTupleState hdr = *pts;
+	PartialTupleState *copy;
+
+	hdr.nacks = 0;
+	*len = sizeof(PartialTupleState) + HEAPTUPLESIZE + pts->tup->t_len;
+
+	copy = palloc(*len);
+	PartialTupleStateCopyFn(copy, &hdr, *len);
+	PartialTupleStatePeekFn(copy, *len);
+
+	return copy;
+}
+
+/*
+ * push_partial
+ */
+static bool
+push_partial(PartialTupleState *pts, int len)
+{
+	ipc_queue *ipcq = get_combiner_queue_with_lock(get_combiner_for_group_hash(pts->hash));
+	bool success;
+
+	/* combiners forwarding to each other must never wait on each other's full queues */
+	success = ipc_queue_push_nolock(ipcq, pts, len, false);
+	ipc_queue_unlock(ipcq);
+
+	return success;
+}
+
+/*
+ * flush_unforwarded
+ */
+static void
+flush_unforwarded(void)
+{
+	while (unforwarded != NIL)
+	{
+		UnforwardedPartial *u = (UnforwardedPartial *) linitial(unforwarded);
+
+		if (!push_partial(u->pts, u->len))
+			break;
+
+		unforwarded = list_delete_first(unforwarded);
+		pfree(u->pts);
+		pfree(u);
+	}
+}
+
+/*
+ * forward_partial
+ *
+ * Sends a partial result of a shard we no longer own to the combiner that owns it now, which
+ * happens for partial results that workers routed before seeing that the shard was moved
+ */
+static void
+forward_partial(ContExecutor *cont_exec, PartialTupleState *pts)
+{
+	MemoryContext old;
+	UnforwardedPartial *u;
+	PartialTupleState hdr = *pts;
+	int len = sizeof(PartialTupleState) + HEAPTUPLESIZE + pts->tup->t_len;
+
+	hdr.nacks = 0;
+
+	if (unforwarded == NIL && push_partial(&hdr, len))
+		return;
+
+	old = MemoryContextSwitchTo(cont_exec->exec_cxt);
+
+	u = palloc(sizeof(UnforwardedPartial));
+	u->pts = copy_partial(pts, &u->len);
+	unforwarded = lappend(unforwarded, u);
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * load_rollups
+ *
+ * Finds the views that are rollups of the given one and prepares the projections deriving their
+ * partial results from ours, see TransformRollupSelectStmt
+ */
+static void
+load_rollups(ContQueryCombinerState *state)
+{
+	MemoryContext old;
+	Bitmapset *ids;
+	int id;
+
+	if (state->rollups_loaded && state->rollups_invals == combiner_rel_invals)
+		return;
+
+	if (state->rollup_cxt == NULL)
+	{
+		state->rollup_cxt = AllocSetContextCreate(state->base.state_cxt, "CombinerRollupCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+		state->rollup_partials_cxt = AllocSetContextCreate(state->base.state_cxt, "CombinerRollupPartialsCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+	}
+	else
+		MemoryContextResetAndDeleteChildren(state->rollup_cxt);
+
+	state->rollups = NIL;
+	state->rollups_loaded = true;
+	state->rollups_invals = combiner_rel_invals;
+
+	old = MemoryContextSwitchTo(state->rollup_cxt);
+	ids = GetContinuousViewIds();
+
+	while ((id = bms_first_member(ids)) >= 0)
+	{
+		ContQuery *q = GetContQueryForViewId(id);
+		RollupState *r;
+		Relation matrel;
+		ResultRelInfo *ri;
+		ListCell *lc;
+		int i = 0;
+
+		if (q == NULL || q->rollup_of != state->base.query_id)
+			continue;
+
+		matrel = heap_openrv_extended(q->matrel, AccessShareLock, true);
+		if (matrel == NULL)
+			continue;
+
+		r = palloc0(sizeof(RollupState));
+		r->id = q->id;
+		r->desc = CreateTupleDescCopy(RelationGetDescr(matrel));
+		r->slot = MakeSingleTupleTableSlot(r->desc);
+		r->values = palloc0(sizeof(Datum) * r->desc->natts);
+		r->nulls = palloc0(sizeof(bool) * r->desc->natts);
+
+		ri = CQMatRelOpen(matrel);
+		r->hashfunc = GetGroupHashIndexExpr(ri);
+		CQMatRelClose(ri);
+		heap_close(matrel, AccessShareLock);
+
+		if (r->hashfunc)
+		{
+			r->hash_fcinfo = palloc0(sizeof(FunctionCallInfoData));
+			r->hash_fcinfo->flinfo = palloc0(sizeof(FmgrInfo));
+			r->hash_fcinfo->flinfo->fn_mcxt = state->rollup_cxt;
+
+			fmgr_info(r->hashfunc->funcid, r->hash_fcinfo->flinfo);
+			fmgr_info_set_expr((Node *) r->hashfunc, r->hash_fcinfo->flinfo);
+
+			r->hash_fcinfo->fncollation = r->hashfunc->funccollid;
+			r->hash_fcinfo->nargs = list_length(r->hashfunc->args);
+		}
+		else
+			r->name_hash = GetCombinerNameHash(q);
+
+		r->econtext = CreateStandaloneExprContext();
+		r->proj = build_projection(q->rollup_targets, CreateExecutorState(), r->econtext, state->desc);
+
+		r->natts = list_length(q->rollup_targets);
+		r->attmap = palloc0(sizeof(AttrNumber) * r->natts);
+
+		foreach(lc, q->rollup_targets)
+		{
+			TargetEntry *te = (TargetEntry *) lfirst(lc);
+
+			r->attmap[i] = find_attr(r->desc, te->resname);
+			if (!AttributeNumberIsValid(r->attmap[i]))
+				elog(ERROR, "rollup column \"%s\" not found in \"%s\"", te->resname, q->matrel->relname);
+			i++;
+		}
+
+		state->rollups = lappend(state->rollups, r);
+	}
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * derive_rollup_partials
+ *
+ * Derives the partial results of the view's rollups from the partial results in its current batch.
+ * Each of them is a valid partial result of a rollup group, since rollup groups are unions of our
+ * groups and rollup aggregates combine our aggregates' transition states.
+ */
+static void
+derive_rollup_partials(ContQueryCombinerState *state)
+{
+	MemoryContext old;
+	TupleTableSlot *slot = state->slot;
+
+	load_rollups(state);
+
+	if (state->rollups == NIL)
+		return;
+
+	old = MemoryContextSwitchTo(state->rollup_partials_cxt);
+
+	foreach_batch_tuple(slot, state->batch)
+	{
+		ListCell *lc;
+
+		foreach(lc, state->rollups)
+		{
+			RollupState *r = (RollupState *) lfirst(lc);
+			PartialTupleState *pts = palloc0(sizeof(PartialTupleState));
+			TupleTableSlot *proj;
+			int i;
+
+			r->econtext->ecxt_scantuple = slot;
+			proj = ExecProject(r->proj, NULL);
+			slot_getallattrs(proj);
+
+			MemSet(r->nulls, true, sizeof(bool) * r->desc->natts);
+			for (i = 0; i < r->natts; i++)
+			{
+				r->values[r->attmap[i] - 1] = proj->tts_values[i];
+				r->nulls[r->attmap[i] - 1] = proj->tts_isnull[i];
+			}
+
+			pts->tup = heap_form_tuple(r->desc, r->values, r->nulls);
+			pts->query_id = r->id;
+			pts->insert_time = state->oldest_insert;
+			pts->arrival_time = state->newest_arrival;
+
+			if (r->hashfunc)
+			{
+				ExecStoreTuple(pts->tup, r->slot, InvalidBuffer, false);
+				pts->hash = hash_group_for_combiner(r->slot, r->hashfunc, r->hash_fcinfo);
+				ExecClearTuple(r->slot);
+			}
+			else
+				pts->hash = r->name_hash;
+
+			ResetExprContext(r->econtext);
+			state->rollup_partials = lappend(state->rollup_partials, pts);
+		}
+	}
+	TupleBatchRescan(state->batch);
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * forward_rollup_partials
+ *
+ * Once the syncs of a batch have been committed, the partial results derived for rollups from the
+ * partial results they synced are sent to the rollups' combiners
+ */
+static void
+forward_rollup_partials(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+		ListCell *lc;
+
+		if (!state || state->rollup_partials == NIL)
+			continue;
+
+		foreach(lc, state->rollup_partials)
+			forward_partial(cont_exec, (PartialTupleState *) lfirst(lc));
+
+		state->rollup_partials = NIL;
+		MemoryContextReset(state->rollup_partials_cxt);
+	}
+
+	bms_free(tmp);
+}
+
+/*
+ * note_insert_time
+ *
+ * Remembers the insert time of the oldest event and the arrival time of the newest event behind the
+ * partial results of the current sync
+ */
+static void
+note_insert_time(ContQueryCombinerState *state, PartialTupleState *pts)
+{
+	if (pts->insert_time && (!state->oldest_insert || pts->insert_time < state->oldest_insert))
+		state->oldest_insert = pts->insert_time;
+	if (pts->arrival_time > state->newest_arrival)
+		state->newest_arrival = pts->arrival_time;
+}
+
+/*
+ * read_deferred
+ *
+ * Adds the deferred partial results of shards that have been handed off to us to the batch,
+ * returning how many were added
+ */
+static int
+read_deferred(ContQueryCombinerState *state, ContExecutor *cont_exec)
+{
+	List *deferred = state->deferred;
+	ListCell *lc;
+	int count = 0;
+
+	state->deferred = NIL;
+
+	foreach(lc, deferred)
+	{
+		PartialTupleState *pts = (PartialTupleState *) lfirst(lc);
+
+		if (get_combiner_for_group_hash(pts->hash) != MyContQueryProc->group_id)
+			forward_partial(cont_exec, pts);
+		else if (IsCombinerShardHandedOff(pts->hash))
+		{
+			MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
+			state->deferred = lappend(state->deferred, pts);
+			MemoryContextSwitchTo(old);
+			continue;
+		}
+		else
+		{
+			TupleBatchPut(state->batch, pts->tup);
+			set_group_hash(state, count++, pts->hash);
+			note_insert_time(state, pts);
+		}
+
+		pfree(pts);
+	}
+
+	list_free(deferred);
+
+	return count;
+}
+
+/*
+ * note_batch_ids
+ *
+ * Remember the stream batch ids of the events the given partial result was computed from, which are
+ * recorded in the transaction combining it
+ */
+static void
+note_batch_ids(PartialTupleState *pts)
+{
+	int i;
+
+	if (pts->acks == NULL)
+		return;
+
+	for (i = 0; i < pts->nacks; i++)
+	{
+		int64 id = pts->acks[i].client_batch_id;
+
+		if (id == 0)
+			continue;
+
+		if (batch_ids == NULL)
+		{
+			HASHCTL ctl;
+
+			MemSet(&ctl, 0, sizeof(HASHCTL));
+			ctl.keysize = sizeof(int64);
+			ctl.entrysize = sizeof(int64);
+			ctl.hcxt = TopMemoryContext;
+
+			batch_ids = hash_create("CombinerStreamBatchIds", 32, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+		}
+
+		hash_search(batch_ids, &id, HASH_ENTER, NULL);
+	}
+}
+
+static int
+read_batch(ContQueryCombinerState *state, ContExecutor *cont_exec)
+{
+	PartialTupleState *pts;
+	int len;
+	Size nbytes = 0;
+	int count = 0;
+	int late = 0;
+	bool watermarked = (state->sw && state->base.query->sw_lateness_ms > 0) ||
+		AttributeNumberIsValid(state->freeze_attr);
+	TimestampTz now = watermarked ? GetCurrentTimestamp() : 0;
+
+	if (state->deferred)
+		count = read_deferred(state, cont_exec);
+
+	while ((pts = (PartialTupleState *) ContExecutorYieldNextMessage(cont_exec, &len)) != NULL)
+	{
+		if (get_combiner_for_group_hash(pts->hash) != MyContQueryProc->group_id)
+		{
+			forward_partial(cont_exec, pts);
+			continue;
+		}
+
+		/* the shard's previous owner may not have committed its changes to these groups yet */
+		if (IsCombinerShardHandedOff(pts->hash))
+		{
+			MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
+			int copylen;
+
+			state->deferred = lappend(state->deferred, copy_partial(pts, &copylen));
+			MemoryContextSwitchTo(old);
+			continue;
+		}
+
+		note_batch_ids(pts);
+
+		if (watermarked)
+		{
+			advance_watermarks(state, pts->tup, now);
+
+			/* too late for its step or bucket, so its groups would just be looked up and rewritten for nothing */
+			if (sw_step_sealed(state, pts->tup) || bucket_frozen(state, pts->tup))
+			{
+				late++;
+				continue;
+			}
+		}
+
+		TupleBatchPut(state->batch, pts->tup);
+		set_group_hash(state, count, pts->hash);
+		note_insert_time(state, pts);
+
+		nbytes += len;
+		count++;
+	}
+
+	if (late)
+		elog(DEBUG1, "dropped %d late partial results for \"%s\"", late, state->base.query->name->relname);
+
+	if (!TupIsNull(state->slot))
+		ExecClearTuple(state->slot);
+
+	if (state->delta_hashes && count)
+		add_delta_hashes(state, count);
+
+	pgstat_increment_cq_read(count, nbytes);
+
+	return count;
+}
+
+/*
+ * forget_moved_delta_hashes
+ *
+ * Forgets the delta rows we've written to groups of shards that were moved to other combiners,
+ * since their new owners compact them from now on
+ */
+static void
+forget_moved_delta_hashes(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+		int n = 0;
+		int i;
+
+		if (state == NULL || state->delta_hashes == NULL)
+			continue;
+
+		for (i = 0; i < state->ndelta_hashes; i++)
+		{
+			if (get_combiner_for_group_hash(state->delta_hashes[i]) == MyContQueryProc->group_id)
+				state->delta_hashes[n++] = state->delta_hashes[i];
+		}
+
+		state->ndelta_hashes = n;
+	}
+}
+
+/*
+ * any_handoff_pending
+ */
+static bool
+any_handoff_pending(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp;
+	int id;
+
+	if (unforwarded != NIL)
+		return true;
+
+	tmp = bms_copy(cont_exec->queries);
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+
+		if (state && state->deferred)
+		{
+			bms_free(tmp);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * flush_all_coalesced_output
+ *
+ * Writes the coalesced output stream updates that have become due, returning how many
+ * milliseconds remain until the next ones do, or 0 if none are held back
+ */
+static int
+flush_all_coalesced_output(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	TimestampTz next = 0;
+	long secs;
+	int usecs;
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+
+		if (!state || !state->output_flush_at)
+			continue;
+
+		PG_TRY();
+		{
+			flush_coalesced_output(state);
+		}
+		PG_CATCH();
+		{
+			EmitErrorReport();
+			FlushErrorState();
+
+			AbortCurrentTransaction();
+			StartTransactionCommand();
+		}
+		PG_END_TRY();
+
+		if (state->output_flush_at && (!next || state->output_flush_at < next))
+			next = state->output_flush_at;
+	}
+
+	bms_free(tmp);
+
+	if (!next)
+		return 0;
+
+	TimestampDifference(GetCurrentTimestamp(), next, &secs, &usecs);
+
+	return Max(1, secs * 1000 + usecs / 1000);
+}
+
+static void
+combiner_relcache_callback(Datum arg, Oid relid)
+{
+	combiner_rel_invals++;
+
+	if (group_filter_invals == NULL)
+		return;
+
+	if (OidIsValid(relid))
+	{
+		MatRelInvalsEntry *entry = (MatRelInvalsEntry *) hash_search(group_filter_invals, &relid, HASH_FIND, NULL);
+
+		if (entry)
+			entry->invals++;
+	}
+	else
+	{
+		HASH_SEQ_STATUS status;
+		MatRelInvalsEntry *entry;
+
+		hash_seq_init(&status, group_filter_invals);
+		while ((entry = (MatRelInvalsEntry *) hash_seq_search(&status)) != NULL)
+			entry->invals++;
+	}
+}
+
+/*
+ * choose_sw_step_factor
+ *
+ * Pick the step factor of a sliding-window view with an adaptive step size. Smaller steps make windows
+ * more accurate, but each group has a row in the matrel for every step it appears in, so we use the
+ * smallest step factor whose windows are expected to span at most sliding_window_auto_step_rows rows.
+ *
+ * A step of s seconds has G * (1 - exp(-r * s / G)) groups in it if groups are touched at a rate of r per
+ * second spread over G groups, which we invert to estimate r from the rows added at the current step size.
+ * This combiner only sees the groups of its own shards, so the number of rows it aims for is scaled down
+ * accordingly. Returns -1 if the step factor should be left alone.
+ */
+static int
+choose_sw_step_factor(ContQueryCombinerState *state)
+{
+	SWOutputState *sw = state->sw;
+	ContQuery *cq = state->base.query;
+	long secs;
+	int usecs;
+	double elapsed;
+	double window = cq->sw_interval_ms / 1000.0;
+	double step = Max(cq->sw_step_ms / 1000.0, 1.0);
+	double groups = hash_get_num_entries(sw->overlay_groups->hashtab);
+	double budget = sliding_window_auto_step_rows;
+	double touched;
+	double rate;
+	int factor;
+
+	TimestampDifference(sw->observed_since, GetCurrentTimestamp(), &secs, &usecs);
+	elapsed = secs + usecs / 1000000.0;
+
+	/* Wait for a full window of observations at the current step size */
+	if (elapsed < window)
+		return -1;
+
+	if (groups > 0)
+	{
+		if (state->hashfunc)
+			budget = budget * GetCombinerShardCount(MyContQueryProc->group_id) / NUM_COMBINER_SHARDS;
+
+		touched = Min(sw->new_steps / elapsed * step / groups, 0.99);
+		rate = -groups * log(1.0 - touched) / step;
+
+		for (factor = 1; factor < 50; factor++)
+		{
+			double s = Max(window * factor / 100.0, 1.0);
+
+			if (window / s * groups * (1.0 - exp(-rate * s / groups)) <= budget)
+				break;
+		}
+	}
+	else
+		factor = 1;
+
+	sw->observed_since = GetCurrentTimestamp();
+	sw->new_steps = 0;
+
+	/* Estimates are noisy, so only move to step sizes that are substantially different */
+	if (factor * 2 > cq->sw_step_factor && factor < cq->sw_step_factor * 2)
+		return -1;
+
+	return factor;
+}
+
+/*
+ * adapt_sw_steps
+ *
+ * Update the step factors of sliding-window views with adaptive step sizes. Each view's step factor is
+ * only chosen by the combiner that would combine its rows if it weren't grouped. This runs after
+ * committing, so that a failed update can't take any of our combined rows with it.
+ */
+static void
+adapt_sw_steps(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+		ContQuery *cq;
+		int64 hash;
+		int factor;
+
+		if (state == NULL || state->sw == NULL || !state->base.query->sw_step_auto)
+			continue;
+
+		cq = state->base.query;
+		hash = MurmurHash3_64(cq->name->relname, strlen(cq->name->relname), MURMUR_SEED);
+
+		if (get_combiner_for_group_hash(hash) != MyContQueryProc->group_id)
+			continue;
+
+		factor = choose_sw_step_factor(state);
+		if (factor < 0)
+			continue;
+
+		elog(LOG, "changing step factor of continuous view \"%s\" from %d to %d",
+				cq->name->relname, cq->sw_step_factor, factor);
+
+		StartTransactionCommand();
+
+		PG_TRY();
+		{
+			UpdateContViewStepFactor(cq->id, factor, true);
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
+		{
+			/* the step factor may have been changed concurrently, in which case we'll just try again later */
+			EmitErrorReport();
+			FlushErrorState();
+
+			AbortCurrentTransaction();
+		}
+		PG_END_TRY();
+	}
+
+	bms_free(tmp);
+}
+
+/*
+ * choose_fillfactor
+ *
+ * Returns a lower fillfactor for the view's matrel if too few of its updates were HOT, which means
+ * that pages often don't have room for new versions of their groups. Those updates must insert into
+ * all of the matrel's indexes, which is what makes them bloat. Lower fillfactors reserve more room in
+ * the pages new groups are inserted into. Returns -1 if the fillfactor should stay as it is.
+ */
+static int
+choose_fillfactor(ContQueryCombinerState *state, int current)
+{
+	double rate;
+
+	if (state->ff_updates < FILLFACTOR_MIN_UPDATES)
+		return -1;
+
+	rate = (double) state->ff_hot_updates / state->ff_updates;
+	state->ff_updates = 0;
+	state->ff_hot_updates = 0;
+
+	if (rate >= FILLFACTOR_MIN_HOT_RATE || current <= continuous_view_min_fillfactor)
+		return -1;
+
+	return Max(current - FILLFACTOR_STEP, continuous_view_min_fillfactor);
+}
+
+/*
+ * adapt_fillfactors
+ *
+ * Lowers the fillfactors of matrels whose updates are too often not HOT. Like step factors, each
+ * view's fillfactor is only chosen by the combiner that would combine its rows if it weren't grouped,
+ * and is changed after committing.
+ */
+static void
+adapt_fillfactors(ContExecutor *cont_exec)
+{
+	Bitmapset *tmp;
+	int id;
+
+	if (!continuous_query_combiner_adaptive_fillfactor)
+		return;
+
+	tmp = bms_copy(cont_exec->queries);
+
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+		ContQuery *cq;
+		int64 hash;
+
+		if (state == NULL || state->ff_updates < FILLFACTOR_MIN_UPDATES)
+			continue;
+
+		cq = state->base.query;
+		hash = MurmurHash3_64(cq->name->relname, strlen(cq->name->relname), MURMUR_SEED);
+
+		if (get_combiner_for_group_hash(hash) != MyContQueryProc->group_id)
+		{
+			state->ff_updates = 0;
+			state->ff_hot_updates = 0;
+			continue;
+		}
+
+		StartTransactionCommand();
+
+		PG_TRY();
+		{
+			Relation matrel = heap_open(cq->matrelid, AccessShareLock);
+			int current = RelationGetFillFactor(matrel, HEAP_DEFAULT_FILLFACTOR);
+			int fillfactor;
+
+			heap_close(matrel, AccessShareLock);
+
+			fillfactor = choose_fillfactor(state, current);
+
+			/*
+			 * Changing reloptions takes an AccessExclusiveLock, so rather than waiting behind readers
+			 * of the matrel and holding up other combiners' syncs, we just try again after the next window
+			 */
+			if (fillfactor > 0 && ConditionalLockRelationOid(cq->matrelid, AccessExclusiveLock))
+			{
+				AlterTableCmd *cmd = makeNode(AlterTableCmd);
 
-	if (IsA(state->sw->overlay_plan->planTree, Agg))
-	{
-		Agg *agg = (Agg *) state->sw->overlay_plan->planTree;
-		int i;
+				elog(LOG, "changing fillfactor of continuous view \"%s\" from %d to %d",
+						cq->name->relname, current, fillfactor);
 
-		group_ops = agg->grpOperators;
-		n_group_attr = agg->numCols;
+				cmd->subtype = AT_SetRelOptions;
+				cmd->def = (Node *) list_make1(makeDefElem(OPTION_FILLFACTOR, (Node *) makeInteger(fillfactor)));
+				AlterTableInternal(cq->matrelid, list_make1(cmd), false);
+			}
 
-		/*
-		 * Since this is a view over a matrel, these grouping attributes actually
-		 * refer to matrel attributes so we need to offset them by 1 to account for
-		 * the matrel's additional arrival_timestamp column.
-		 *
-		 * There is probably a better way to do this.
-		 */
-		group_idx = palloc0(sizeof(AttrNumber) * n_group_attr);
-		memcpy(group_idx, agg->grpColIdx, sizeof(AttrNumber) * n_group_attr);
-		for (i = 0; i < n_group_attr; i++)
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
 		{
-			Assert(group_idx[i] >= 1);
-			group_idx[i] -= 1;
+			/* the matrel may have been dropped or altered concurrently, in which case we'll just try again later */
+			EmitErrorReport();
+			FlushErrorState();
+
+			AbortCurrentTransaction();
 		}
+		PG_END_TRY();
 	}
 
-	tmp_cxt = AllocSetContextCreate(CurrentMemoryContext, "SWOverlayOutputTmpCxt",
-				ALLOCSET_DEFAULT_MINSIZE,
-				ALLOCSET_DEFAULT_INITSIZE,
-				ALLOCSET_DEFAULT_MAXSIZE);
-
-	execTuplesHashPrepare(n_group_attr, group_ops, &eq_funcs, &hash_funcs);
-	state->sw->overlay_groups = BuildTupleHashTable(n_group_attr,
-			group_idx, eq_funcs, hash_funcs, 1000, sizeof(OverlayTupleEntry), CurrentMemoryContext, tmp_cxt);
+	bms_free(tmp);
 }
 
 /*
- * project_sw_overlay_into_ostream
+ * Combiners delete the expired groups of views with a ttl when they're idle, at most this often
+ * for each view unless the previous batch didn't delete all of them
+ */
+#define TTL_EXPIRY_INTERVAL_MS 1000
+
+/* how often a combiner removes the stream batch ids it recorded that are past their retention */
+#define BATCH_ID_REMOVAL_INTERVAL_MS 60000
+
+/* busy combiners still delete a batch of each view's expired groups this often */
+#define TTL_MAX_EXPIRY_DELAY_MS 10000
+
+/*
+ * Combiners prune the groups of top-N views at most this often, keeping a margin of groups
+ * ranked just below the top N so that groups on the rise aren't deleted before they get there
+ */
+#define TOP_N_PRUNE_INTERVAL_MS 1000
+#define TOP_N_MARGIN(n) ((n) / 4 + 1)
+
+/*
+ * delete_group
  *
- * Execute the sliding-window overlay plan on step-sized matrel groups
- * and write the result to the CV's output stream
+ * Deletes the given matrel row, which must be stored in our slot, and forgets it if we have it cached.
+ * Returns false if someone else is modifying it.
  */
-static void
-project_sw_overlay_into_ostream(ContQueryCombinerState *state, Relation matrel)
+static bool
+delete_group(ContQueryCombinerState *state, Relation matrel, HeapTuple tup, CommandId cid)
 {
-	Assert(state->sw);
-	Assert(state->sw->overlay_input);
-	Assert(state->sw->overlay_output);
-	Assert(state->sw->overlay_plan);
-	Assert(state->sw->overlay_dest);
+	HeapUpdateFailureData hufd;
+	ItemPointerData tid = tup->t_self;
 
-	/*
-	 * Add or replace any tuples in the cache based on the combiner's most recent output
-	 */
-	tuplestore_rescan(state->combined);
-	foreach_tuple(state->slot, state->combined)
+	if (heap_delete(matrel, &tid, cid, InvalidSnapshot, false, &hufd) != HeapTupleMayBeUpdated)
+		return false;
+
+	if (state->group_cache_cxt && state->existing)
 	{
-		bool isnew;
-		MemoryContext old;
-		HeapTupleEntry entry = (HeapTupleEntry)
-				LookupTupleHashEntry(state->sw->step_groups, state->slot, &isnew);
+		GroupCacheEntry *entry = (GroupCacheEntry *) LookupTupleHashEntry(state->existing, state->slot, NULL);
 
-		if (!isnew)
-			heap_freetuple(entry->tuple);
+		if (entry)
+			remove_cached_group(state, entry, state->slot);
+	}
 
-		old = MemoryContextSwitchTo(state->sw->step_groups->tablecxt);
-		entry->tuple = ExecCopySlotTuple(state->slot);
-		MemoryContextSwitchTo(old);
+	if (state->read_cache_cxt)
+	{
+		ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+		cache_row(state, state->slot, (Datum) 0);
 	}
 
-	/* Force a tick */
-	tick_sw_groups(state, matrel, true);
+	return true;
 }
 
 /*
- * sync_combine
+ * delete_expired_groups
  *
- * Writes the combine results to a continuous view's table, performing
- * UPDATES or INSERTS as necessary
+ * Deletes up to continuous_view_ttl_batch_size expired groups of the given view that belong to our
+ * shards, and forgets any we have cached. Since only we write the groups of our shards, nothing else
+ * needs to know about them. Returns true if there may be more expired groups for us to delete.
  */
-static void
-sync_combine(ContQueryCombinerState *state)
+static bool
+delete_expired_groups(ContQueryCombinerState *state)
 {
-	TupleHashTable existing = state->existing;
+	ContQuery *cq = state->base.query;
 	TupleTableSlot *slot = state->slot;
-	Size size = sizeof(bool) * slot->tts_tupleDescriptor->natts;
-	bool *replace_all = palloc0(size);
-	EState *estate = CreateExecutorState();
-	int i;
+	TimestampTz cutoff = GetCurrentTimestamp() - (1000 * (int64) cq->ttl_ms);
+	int64 name_hash = MurmurHash3_64(cq->name->relname, strlen(cq->name->relname), MURMUR_SEED);
+	int64 max_scanned = (int64) continuous_view_ttl_batch_size * continuous_query_num_combiners;
+	FunctionCallInfoData hashfcinfo;
+	FmgrInfo flinfo;
 	Relation matrel;
-	Relation osrel;
-	ResultRelInfo *ri;
-	ResultRelInfo *osri;
-	Size nbytes_inserted = 0;
-	Size nbytes_updated = 0;
-	int ntups_inserted = 0;
-	int ntups_updated = 0;
-	StreamInsertState *sis = NULL;
-	Bitmapset *os_targets = NULL;
+	Relation index = NULL;
+	HeapScanDesc heapscan = NULL;
+	IndexScanDesc indexscan = NULL;
+	ScanKeyData skey[1];
+	Oid type;
+	CommandId cid;
+	HeapTuple tup;
+	int ndeleted = 0;
+	int64 nscanned = 0;
+	bool more = false;
 
-	matrel = heap_openrv_extended(state->base.query->matrel, RowExclusiveLock, true);
+	matrel = try_relation_open(cq->matrelid, RowExclusiveLock);
 	if (matrel == NULL)
-		return;
+		return false;
 
-	/*
-	 * We'll handle output stream writes separately for SWs since
-	 * they require the execution of an overlay plan
-	 */
-	if (!state->base.query->is_sw)
+	begin_cached_rows(state);
+
+	cid = GetCurrentCommandId(true);
+	type = RelationGetDescr(matrel)->attrs[state->ttl_attr - 1]->atttypid;
+
+	if (state->hashfunc)
 	{
-		osrel = try_relation_open(state->base.query->osrelid, RowExclusiveLock);
-		if (osrel == NULL)
-			return;
+		InitFunctionCallInfoData(hashfcinfo, &flinfo,
+				list_length(state->hashfunc->args), state->hashfunc->funccollid, NULL, NULL);
 
-		osri = CQOSRelOpen(osrel);
+		fmgr_info(state->hashfunc->funcid, hashfcinfo.flinfo);
+		fmgr_info_set_expr((Node *) state->hashfunc, hashfcinfo.flinfo);
+	}
 
-		BeginStreamModify(NULL, osri, NIL, 0, REENTRANT_STREAM_INSERT);
-		sis = (StreamInsertState *) osri->ri_FdwState;
-		Assert(sis);
+	if (OidIsValid(state->ttl_index))
+	{
+		index = index_open(state->ttl_index, AccessShareLock);
 
-		os_targets = sis->targets;
+		ScanKeyEntryInitialize(&skey[0], 0, 1, BTLessEqualStrategyNumber, type,
+				InvalidOid, F_TIMESTAMP_LE, TimestampTzGetDatum(cutoff));
+		indexscan = index_beginscan(matrel, index, GetActiveSnapshot(), 1, 0);
+		index_rescan(indexscan, skey, 1, NULL, 0);
+	}
+	else
+	{
+		ScanKeyEntryInitialize(&skey[0], 0, state->ttl_attr, BTLessEqualStrategyNumber, type,
+				InvalidOid, F_TIMESTAMP_LE, TimestampTzGetDatum(cutoff));
+		heapscan = heap_beginscan(matrel, GetActiveSnapshot(), 1, skey);
+	}
 
-		/* If nothing is reading from the output stream, close it immediately */
-		if (os_targets == NULL)
+	for (;;)
+	{
+		int64 hash;
+
+		tup = indexscan ? index_getnext(indexscan, ForwardScanDirection) : heap_getnext(heapscan, ForwardScanDirection);
+		if (tup == NULL)
+			break;
+
+		/* the expired groups of other combiners' shards come first until they've deleted them */
+		if (++nscanned > max_scanned)
 		{
-			EndStreamModify(NULL, osri);
-			CQOSRelClose(osri);
-			heap_close(osrel, NoLock);
-			sis = NULL;
+			more = true;
+			break;
+		}
+
+		ExecStoreTuple(tup, slot, InvalidBuffer, false);
+
+		hash = state->hashfunc ? hash_group_for_combiner(slot, state->hashfunc, &hashfcinfo) : name_hash;
+		if (get_combiner_for_group_hash(hash) != MyContQueryProc->group_id)
+			continue;
+
+		/* groups someone else is modifying are left for the next batch */
+		if (!delete_group(state, matrel, tup, cid))
+			continue;
+
+		if (++ndeleted >= continuous_view_ttl_batch_size)
+		{
+			more = true;
+			break;
 		}
 	}
 
-	ri = CQMatRelOpen(matrel);
+	ExecClearTuple(slot);
 
-	estate->es_per_tuple_exprcontext = CreateStandaloneExprContext();
-	estate->es_per_tuple_exprcontext->ecxt_scantuple = state->proj_input_slot;
+	if (indexscan)
+	{
+		index_endscan(indexscan);
+		index_close(index, AccessShareLock);
+	}
+	else
+		heap_endscan(heapscan);
 
-	if (state->output_stream_proj)
-		state->output_stream_proj->pi_exprContext = estate->es_per_tuple_exprcontext;
+	heap_close(matrel, NoLock);
 
-	foreach_tuple(slot, state->combined)
+	return more;
+}
+
+/*
+ * expire_ttl_groups
+ *
+ * Deletes a batch of the expired groups of each view with a ttl that's due for one, each in its own
+ * transaction. Returns true if we have the state of any view with a ttl.
+ */
+static bool
+expire_ttl_groups(ContExecutor *cont_exec, bool idle)
+{
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	TimestampTz now = GetCurrentTimestamp();
+	bool any = false;
+	int id;
+
+	while ((id = bms_first_member(tmp)) >= 0)
 	{
-		HeapTupleEntry update = NULL;
-		HeapTuple tup = NULL;
-		HeapTuple os_tup;
-		Datum os_values[3];
-		bool os_nulls[3];
-		int replaces = 0;
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+		volatile bool more = false;
 
-		MemSet(os_nulls, false, sizeof(os_nulls));
+		if (state == NULL || !AttributeNumberIsValid(state->ttl_attr))
+			continue;
 
-		/* Only replace values for non-group attributes */
-		MemSet(replace_all, true, size);
-		for (i = 0; i < state->ngroupatts; i++)
-			replace_all[state->groupatts[i] - 1] = false;
+		any = true;
 
-		/* Never replace pkey */
-		replace_all[state->pk - 1] = false;
+		if (!TimestampDifferenceExceeds(state->last_expiry, now,
+				idle ? TTL_EXPIRY_INTERVAL_MS : TTL_MAX_EXPIRY_DELAY_MS))
+			continue;
 
-		slot_getallattrs(slot);
+		MyStatCQEntry = (PgStat_StatCQEntry *) &state->base.stats;
 
-		if (existing)
-			update = (HeapTupleEntry) LookupTupleHashEntry(existing, slot, NULL);
+		StartTransactionCommand();
 
-		if (update)
+		PG_TRY();
 		{
-			ExecStoreTuple(update->tuple, state->prev_slot, InvalidBuffer, false);
-			replaces = compare_slots(state->prev_slot, state->slot,
-					state->pk, replace_all);
+			PushActiveSnapshot(GetTransactionSnapshot());
+			more = delete_expired_groups(state);
+			PopActiveSnapshot();
 
-			if (replaces == 0)
-				continue;
-
-			if (os_targets)
-				os_values[OLD_TUPLE] = project_overlay(state, update->tuple, &os_nulls[OLD_TUPLE]);
+			CommitTransactionCommand();
 
-			/*
-			 * The slot has the updated values, so store them in the updatable physical tuple
-			 */
-			tup = heap_modify_tuple(update->tuple, slot->tts_tupleDescriptor,
-					slot->tts_values, slot->tts_isnull, replace_all);
-			ExecStoreTuple(tup, slot, InvalidBuffer, false);
-			ExecCQMatRelUpdate(ri, slot, estate);
+			if (state->read_cache_synced)
+				ReadCachePut(state->base.query->id, state->read_cache_rows, !state->read_cache_overflow,
+						state->read_cache_generation);
+		}
+		PG_CATCH();
+		{
+			/* the matrel may have been dropped or altered concurrently, in which case we'll just try again later */
+			EmitErrorReport();
+			FlushErrorState();
 
-			if (os_targets)
-				os_values[NEW_TUPLE] = project_overlay(state, tup, &os_nulls[NEW_TUPLE]);
+			if (ActiveSnapshotSet())
+				PopActiveSnapshot();
 
-			ntups_updated++;
-			nbytes_updated += HEAPTUPLESIZE + slot->tts_tuple->t_len;
+			AbortCurrentTransaction();
 		}
-		else
+		PG_END_TRY();
+
+		forget_cached_rows(state);
+
+		/* while we're idle, batches of a view with more expired groups follow each other */
+		state->last_expiry = (more && idle) ? 0 : now;
+	}
+
+	bms_free(tmp);
+
+	return any;
+}
+
+/*
+ * top_n_cmp
+ *
+ * Keeps the lowest ranked of the groups a top-N view keeps at the top of the heap
+ */
+static int
+top_n_cmp(Datum a, Datum b, void *arg)
+{
+	float8 x = DatumGetFloat8(a);
+	float8 y = DatumGetFloat8(b);
+
+	if (x < y)
+		return 1;
+	if (x > y)
+		return -1;
+	return 0;
+}
+
+/*
+ * delete_pruned_groups
+ *
+ * Keeps the groups of the given top-N view that belong to our shards and rank among the top N plus
+ * a margin, and deletes the rest. The global top N groups are always among the top N of the shards
+ * they belong to, so each combiner can prune its own shards independently.
+ */
+static void
+delete_pruned_groups(ContQueryCombinerState *state)
+{
+	ContQuery *cq = state->base.query;
+	TupleTableSlot *slot = state->slot;
+	int64 name_hash = MurmurHash3_64(cq->name->relname, strlen(cq->name->relname), MURMUR_SEED);
+	int keep = cq->top_n + TOP_N_MARGIN(cq->top_n);
+	FunctionCallInfoData hashfcinfo;
+	FmgrInfo flinfo;
+	Relation matrel;
+	HeapScanDesc scan;
+	binaryheap *heap;
+	CommandId cid;
+	HeapTuple tup;
+	int64 ngroups = 0;
+	int pass;
+
+	matrel = try_relation_open(cq->matrelid, RowExclusiveLock);
+	if (matrel == NULL)
+		return;
+
+	begin_cached_rows(state);
+
+	cid = GetCurrentCommandId(true);
+	heap = binaryheap_allocate(keep, top_n_cmp, NULL);
+
+	if (state->hashfunc)
+	{
+		InitFunctionCallInfoData(hashfcinfo, &flinfo,
+				list_length(state->hashfunc->args), state->hashfunc->funccollid, NULL, NULL);
+
+		fmgr_info(state->hashfunc->funcid, hashfcinfo.flinfo);
+		fmgr_info_set_expr((Node *) state->hashfunc, hashfcinfo.flinfo);
+	}
+
+	/*
+	 * The first pass finds the lowest value among the groups we keep, and the second one deletes
+	 * the groups ranked below it. Groups without a value rank lowest.
+	 */
+	for (pass = 0; pass < 2; pass++)
+	{
+		scan = heap_beginscan(matrel, GetActiveSnapshot(), 0, NULL);
+
+		while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
 		{
-			/* No existing tuple found, so it's an INSERT. Also generate a primary key for it if necessary. */
-			if (state->seq_pk)
-				slot->tts_values[state->pk - 1] = nextval_internal(state->base.query->seqrelid);
-			slot->tts_isnull[state->pk - 1] = false;
-			tup = heap_form_tuple(slot->tts_tupleDescriptor, slot->tts_values, slot->tts_isnull);
+			int64 hash;
+			float8 value;
+			bool isnull;
+
 			ExecStoreTuple(tup, slot, InvalidBuffer, false);
-			ExecCQMatRelInsert(ri, slot, estate);
 
-			if (os_targets)
+			hash = state->hashfunc ? hash_group_for_combiner(slot, state->hashfunc, &hashfcinfo) : name_hash;
+			if (get_combiner_for_group_hash(hash) != MyContQueryProc->group_id)
+				continue;
+
+			slot_getattr(slot, state->top_n_attr, &isnull);
+			value = isnull ? 0 : numeric_to_float8(slot->tts_values[state->top_n_attr - 1],
+					state->top_n_type, OPTION_TOP_N_COLUMN);
+
+			if (pass == 0)
 			{
-				os_nulls[OLD_TUPLE] = true;
-				os_nulls[NEW_TUPLE] = false;
-				os_values[OLD_TUPLE] = (Datum) NULL;
-				os_values[NEW_TUPLE] = project_overlay(state, tup, &os_nulls[NEW_TUPLE]);
+				ngroups++;
+
+				if (isnull)
+					continue;
+				if (heap->bh_size < keep)
+					binaryheap_add(heap, Float8GetDatum(value));
+				else if (value > DatumGetFloat8(binaryheap_first(heap)))
+					binaryheap_replace_first(heap, Float8GetDatum(value));
+			}
+			else if (isnull || value < state->top_n_threshold)
+			{
+				/* groups someone else is modifying are left for the next pruning */
+				delete_group(state, matrel, tup, cid);
 			}
-
-			ntups_inserted++;
-			nbytes_inserted += HEAPTUPLESIZE + slot->tts_tuple->t_len;
 		}
 
-		/*
-		 * If anything is reading this CV's output stream, write out the
-		 * old and new rows to it
-		 */
-		if (os_targets &&
-				(os_nulls[OLD_TUPLE] == false || os_nulls[NEW_TUPLE] == false))
-		{
-			os_nulls[state->output_stream_arrival_ts] = true;
-			os_tup = heap_form_tuple(state->os_slot->tts_tupleDescriptor, os_values, os_nulls);
-			ExecStoreTuple(os_tup, state->os_slot, InvalidBuffer, false);
-			ExecStreamInsert(NULL, osri, state->os_slot, NULL);
-		}
+		heap_endscan(scan);
 
-		ResetPerTupleExprContext(estate);
-	}
+		if (pass == 0)
+		{
+			state->top_n_full = ngroups > keep;
+			if (!state->top_n_full)
+				break;
 
-	if (sis)
-	{
-		EndStreamModify(NULL, osri);
-		CQOSRelClose(osri);
-		heap_close(osrel, NoLock);
-		sis = NULL;
+			/* if it's only groups without a value that don't fit, those are all we delete */
+			if (heap->bh_size == keep)
+				state->top_n_threshold = DatumGetFloat8(binaryheap_first(heap));
+			else
+				state->top_n_threshold = -get_float8_infinity();
+		}
 	}
 
-	/*
-	 * We handle SW output stream writes here so we can execute the
-	 * overlay plan on the whole batch all at once in order to to
-	 * compute output stream tuples.
-	 */
-	if (state->sw)
-		project_sw_overlay_into_ostream(state, matrel);
-
-	tuplestore_clear(state->combined);
-
-	pgstat_increment_cq_update(ntups_updated, nbytes_updated);
-	pgstat_increment_cq_write(ntups_inserted, nbytes_inserted);
+	ExecClearTuple(slot);
+	binaryheap_free(heap);
 
-	CQMatRelClose(ri);
 	heap_close(matrel, NoLock);
-
-	FreeExecutorState(estate);
 }
 
 /*
- * sync_all
+ * prune_top_n_groups
+ *
+ * Deletes the groups of each top-N view that no longer rank among the top, each in its own transaction
  */
 static void
-sync_all(ContExecutor *cont_exec)
+prune_top_n_groups(ContExecutor *cont_exec)
 {
 	Bitmapset *tmp = bms_copy(cont_exec->queries);
-	ContQueryCombinerState **states = (ContQueryCombinerState **) cont_exec->states;
+	TimestampTz now = GetCurrentTimestamp();
 	int id;
 
 	while ((id = bms_first_member(tmp)) >= 0)
 	{
-		ContQueryCombinerState *state = states[id];
-		if (!state)
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+
+		if (state == NULL || !AttributeNumberIsValid(state->top_n_attr))
+			continue;
+
+		if (!TimestampDifferenceExceeds(state->last_top_n_prune, now, TOP_N_PRUNE_INTERVAL_MS))
 			continue;
 
 		MyStatCQEntry = (PgStat_StatCQEntry *) &state->base.stats;
 
+		StartTransactionCommand();
+
 		PG_TRY();
 		{
-			if (state->pending_tuples > 0)
-				sync_combine(state);
+			PushActiveSnapshot(GetTransactionSnapshot());
+			delete_pruned_groups(state);
+			PopActiveSnapshot();
+
+			CommitTransactionCommand();
+
+			if (state->read_cache_synced)
+				ReadCachePut(state->base.query->id, state->read_cache_rows, !state->read_cache_overflow,
+						state->read_cache_generation);
 		}
 		PG_CATCH();
 		{
+			/* the matrel may have been dropped or altered concurrently, in which case we'll just try again later */
 			EmitErrorReport();
 			FlushErrorState();
 
+			if (ActiveSnapshotSet())
+				PopActiveSnapshot();
+
 			AbortCurrentTransaction();
-			StartTransactionCommand();
+
+			/* we don't know which groups survived, so admit new ones until we've pruned again */
+			state->top_n_full = false;
 		}
 		PG_END_TRY();
 
-		pgstat_report_cqstat(false);
-
-		state->pending_tuples = 0;
-		state->existing = NULL;
-		MemSet(state->group_hashes, 0, state->group_hashes_len);
-		MemoryContextResetAndDeleteChildren(state->combine_cxt);
+		forget_cached_rows(state);
+		state->last_top_n_prune = now;
 	}
+
+	bms_free(tmp);
 }
 
 /*
- * combine
+ * record_batch_ids
  *
- * Combines partial results of a continuous query with existing rows in the continuous view
+ * Record the ids of the stream batches we've combined since we last committed, in the transaction that's
+ * about to commit their results
  */
 static void
-combine(ContQueryCombinerState *state)
+record_batch_ids(void)
 {
-	Portal portal;
-	DestReceiver *dest;
+	HASH_SEQ_STATUS status;
+	int64 *id;
 
-	if (state->isagg)
-	{
-		if (state->existing == NULL)
-			state->existing = build_existing_hashtable(state);
-		select_existing_groups(state);
-	}
+	if (batch_ids == NULL || hash_get_num_entries(batch_ids) == 0)
+		return;
 
-	foreach_tuple(state->slot, state->combined)
+	hash_seq_init(&status, batch_ids);
+	while ((id = (int64 *) hash_seq_search(&status)) != NULL)
 	{
-		tuplestore_puttupleslot(state->batch, state->slot);
+		RecordStreamBatch(*id, MyContQueryProc->group_id);
+		hash_search(batch_ids, id, HASH_REMOVE, NULL);
 	}
-	tuplestore_clear(state->combined);
 
-	portal = CreatePortal("combine", true, true);
-	portal->visible = false;
+	recorded_batch_ids = true;
+}
 
-	PortalDefineQuery(portal,
-					  NULL,
-					  state->base.query->matrel->relname,
-					  "SELECT",
-					  list_make1(state->combine_plan),
-					  NULL);
+/*
+ * remove_old_batch_ids
+ *
+ * Remove the stream batch ids we recorded longer than stream_insert_batch_id_retention ago
+ */
+static void
+remove_old_batch_ids(void)
+{
+	static TimestampTz last_removal = 0;
+	TimestampTz now = GetCurrentTimestamp();
+	volatile bool any_left = true;
 
-	dest = CreateDestReceiver(DestTuplestore);
-	SetTuplestoreDestReceiverParams(dest, state->combined, state->combine_cxt, true);
+	if (!recorded_batch_ids || !TimestampDifferenceExceeds(last_removal, now, BATCH_ID_REMOVAL_INTERVAL_MS))
+		return;
 
-	PortalStart(portal, NULL, EXEC_FLAG_COMBINE, NULL);
+	StartTransactionCommand();
 
-	(void) PortalRun(portal,
-					 FETCH_ALL,
-					 true,
-					 dest,
-					 dest,
-					 NULL);
+	PG_TRY();
+	{
+		bool left;
 
-	PortalDrop(portal, false);
-	tuplestore_clear(state->batch);
+		RemoveStreamBatchesBefore(MyContQueryProc->group_id,
+				TimestampTzPlusMilliseconds(now, -1000L * stream_insert_batch_id_retention), &left);
+		CommitTransactionCommand();
+
+		any_left = left;
+	}
+	PG_CATCH();
+	{
+		EmitErrorReport();
+		FlushErrorState();
+
+		AbortCurrentTransaction();
+	}
+	PG_END_TRY();
+
+	recorded_batch_ids = any_left;
+	last_removal = now;
 }
 
 /*
- * assign_output_stream_projection
+ * checkpoint_matrels
  *
- * If this query's output stream requires a projection, assign the projection here.
- * This is necessary when any aggregates have a final function that isn't applied until
- * read time, as consumers of the output stream expect a finalized aggregate value.
+ * Copy the unlogged matrels of the views whose checkpoint interval has passed to their checkpoint tables.
+ * Each view's matrel is checkpointed by only one combiner, and we return the shortest checkpoint interval
+ * of the views we checkpoint, or 0 if there are none.
  */
-static void
-assign_output_stream_projection(ContQueryCombinerState *state)
+static int
+checkpoint_matrels(ContExecutor *cont_exec)
 {
-	ListCell *lc;
-	bool needs_proj = false;
-	PlannedStmt *overlay;
-	EState *estate;
-	ExprContext *context;
-	Relation rel;
+	Bitmapset *tmp = bms_copy(cont_exec->queries);
+	TimestampTz now = GetCurrentTimestamp();
+	int min_interval = 0;
+	int id;
 
-	rel = heap_open(state->base.query->relid, NoLock);
-	state->overlay_desc = CreateTupleDescCopy(RelationGetDescr(rel));
-	state->overlay_slot = MakeSingleTupleTableSlot(state->overlay_desc);
-	state->overlay_prev_slot = MakeSingleTupleTableSlot(state->overlay_desc);
-	heap_close(rel, NoLock);
+	while ((id = bms_first_member(tmp)) >= 0)
+	{
+		ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorGetState(cont_exec, id);
+		ContQuery *cv;
 
-	/*
-	 * Sliding windows are set up in init_sw_state,
-	 * and non-sliding windows aren't supported
-	 */
-	if (GetWindowTimeColumn(state->base.query->name))
-		return;
+		if (state == NULL || !state->base.query->checkpoint_interval_ms)
+			continue;
 
-	overlay = GetContinuousViewOverlayPlan(state->base.query);
-	estate = CreateExecutorState();
-	context = CreateStandaloneExprContext();
+		if (id % continuous_query_num_combiners != MyContQueryProc->group_id)
+			continue;
 
-	foreach(lc, overlay->planTree->targetlist)
-	{
-		TargetEntry *te = (TargetEntry *) lfirst(lc);
-		if (IsA(te->expr, FuncExpr))
+		cv = state->base.query;
+		min_interval = min_interval ? Min(min_interval, cv->checkpoint_interval_ms) : cv->checkpoint_interval_ms;
+
+		if (!TimestampDifferenceExceeds(state->last_checkpoint, now, cv->checkpoint_interval_ms))
+			continue;
+
+		StartTransactionCommand();
+
+		PG_TRY();
 		{
-			needs_proj = true;
-			break;
+			Oid ckptid;
+
+			PushActiveSnapshot(GetTransactionSnapshot());
+
+			ckptid = CQMatRelGetCheckpointRelId(cv->name->relname, cv->matrelid);
+			if (OidIsValid(ckptid) && CQMatRelCheckpoint(cv->matrelid, ckptid) < 0)
+				elog(WARNING, "continuous view \"%s\" could not be checkpointed since its checkpoint table doesn't match its matrel",
+						cv->name->relname);
+
+			PopActiveSnapshot();
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
+		{
+			/* the view may have been dropped concurrently, in which case we'll just try again later */
+			EmitErrorReport();
+			FlushErrorState();
+
+			if (ActiveSnapshotSet())
+				PopActiveSnapshot();
+
+			AbortCurrentTransaction();
 		}
+		PG_END_TRY();
+
+		state->last_checkpoint = now;
 	}
 
-	if (!needs_proj)
-		return;
+	bms_free(tmp);
 
-	state->output_stream_proj = build_projection(overlay->planTree->targetlist, estate, context, NULL);
-	state->proj_input_slot = MakeSingleTupleTableSlot(state->desc);
+	return min_interval;
 }
 
-static ContQueryState *
-init_query_state(ContExecutor *cont_exec, ContQueryState *base)
+/*
+ * restore_matrels
+ *
+ * After crash recovery has emptied all unlogged relations, copy each unlogged matrel's last checkpoint
+ * back into it. Every combiner does this for all views before writing to any matrel, and only the first
+ * one to get to a matrel finds it empty and restores it.
+ */
+static void
+restore_matrels(void)
 {
-	PlannedStmt *pstmt;
-	ContQueryCombinerState *state;
-	Relation matrel;
-	List *indices = NIL;
-	ListCell *lc;
-	Relation osrel ;
+	Bitmapset *views;
+	int id;
 
-	if (base->query->type != CONT_VIEW)
-	{
-		base->query = NULL;
-		return base;
-	}
+	if (!UnloggedRelationsWereReset())
+		return;
 
-	state = (ContQueryCombinerState *) palloc0(sizeof(ContQueryCombinerState));
-	memcpy(&state->base, base, sizeof(ContQueryState));
-	pfree(base);
-	base = (ContQueryState *) state;
+	StartTransactionCommand();
+	views = GetContinuousViewIds();
+	CommitTransactionCommand();
 
-	state->plan_cache_cxt = AllocSetContextCreate(base->state_cxt, "CombinerQueryPlanCacheCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
+	while ((id = bms_first_member(views)) >= 0)
+	{
+		StartTransactionCommand();
 
-	state->combine_cxt = AllocSetContextCreate(base->state_cxt, "CombinerQueryCombineCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
+		PG_TRY();
+		{
+			ContQuery *cv = GetContQueryForViewId(id);
 
-	matrel = heap_openrv_extended(base->query->matrel, AccessShareLock, true);
-	pstmt = GetContPlan(base->query, Combiner);
+			if (cv && cv->checkpoint_interval_ms)
+			{
+				Oid ckptid = CQMatRelGetCheckpointRelId(cv->name->relname, cv->matrelid);
+				int64 ntuples = -1;
 
-	state->batch = tuplestore_begin_heap(true, true, continuous_query_combiner_work_mem);
-	state->combined = tuplestore_begin_heap(false, false, continuous_query_combiner_work_mem);
+				PushActiveSnapshot(GetTransactionSnapshot());
+				if (OidIsValid(ckptid))
+					ntuples = CQMatRelRestore(cv->matrelid, ckptid);
+				PopActiveSnapshot();
 
-	/* this also sets the state's desc field */
-	prepare_combine_plan(state, pstmt);
-	state->slot = MakeSingleTupleTableSlot(state->desc);
-	state->prev_slot = MakeSingleTupleTableSlot(state->desc);
-	state->groups_plan = NULL;
+				if (ntuples >= 0)
+					elog(LOG, "restored " INT64_FORMAT " rows of continuous view \"%s\" from its last checkpoint",
+							ntuples, cv->name->relname);
+			}
 
-	/* this will grow dynamically when needed, but this is a good starting size */
-	state->group_hashes_len = continuous_query_batch_size;
-	state->group_hashes = palloc0(state->group_hashes_len * sizeof(int64));
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
+		{
+			EmitErrorReport();
+			FlushErrorState();
 
-	if (matrel == NULL)
-	{
-		base->query = NULL;
-		return base;
-	}
+			if (ActiveSnapshotSet())
+				PopActiveSnapshot();
 
-	osrel = try_relation_open(base->query->osrelid, AccessShareLock);
-	state->os_slot = MakeSingleTupleTableSlot(CreateTupleDescCopy(RelationGetDescr(osrel)));
-	heap_close(osrel, AccessShareLock);
+			AbortCurrentTransaction();
+		}
+		PG_END_TRY();
+	}
+}
 
-	state->output_stream_arrival_ts = find_attr(state->os_slot->tts_tupleDescriptor, ARRIVAL_TIMESTAMP);
-	Assert(state->output_stream_arrival_ts);
+/*
+ * prewarm_group_cache
+ *
+ * Fill the given view's group cache with the groups of its matrel that belong to our shards, until the
+ * cache is full. Groups are cached as if an earlier sync had written them, so they're checked against
+ * the matrel before they're used.
+ */
+static void
+prewarm_group_cache(ContQueryCombinerState *state)
+{
+	Size max_size = continuous_query_combiner_group_cache_mem * 1024L;
+	Size size = 0;
+	long ngroups = 0;
+	FunctionCallInfoData hashfcinfo;
+	FmgrInfo flinfo;
+	Relation matrel;
+	HeapScanDesc scan;
+	HeapTuple tup;
+	MemoryContext old;
 
-	assign_output_stream_projection(state);
+	if (!state->group_cache_cxt || !state->existing || !state->hashfunc)
+		return;
 
-	if (IsA(state->combine_plan->planTree, Agg))
-	{
-		Agg *agg = (Agg *) state->combine_plan->planTree;
-		ResultRelInfo *ri;
+	matrel = heap_openrv_extended(state->base.query->matrel, AccessShareLock, true);
+	if (matrel == NULL)
+		return;
 
-		state->groupatts = agg->grpColIdx;
-		state->ngroupatts = agg->numCols;
-		state->groupops = agg->grpOperators;
-		state->isagg = true;
+	InitFunctionCallInfoData(hashfcinfo, &flinfo,
+			list_length(state->hashfunc->args), state->hashfunc->funccollid, NULL, NULL);
+	fmgr_info(state->hashfunc->funcid, hashfcinfo.flinfo);
+	fmgr_info_set_expr((Node *) state->hashfunc, hashfcinfo.flinfo);
 
-		ri = CQMatRelOpen(matrel);
+	scan = heap_beginscan(matrel, GetActiveSnapshot(), 0, NULL);
 
-		if (state->ngroupatts)
-			state->hashfunc = GetGroupHashIndexExpr(ri);
+	while (size < max_size && (tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		GroupCacheEntry *entry;
+		bool isnew;
 
-		CQMatRelClose(ri);
+		ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
 
-		execTuplesHashPrepare(state->ngroupatts, state->groupops, &state->eq_funcs, &state->hash_funcs);
-		state->existing = build_existing_hashtable(state);
-	}
+		if (!is_group_hash_mine(hash_group_for_combiner(state->slot, state->hashfunc, &hashfcinfo)))
+			continue;
 
-	/*
-	 * Find the primary key column
-	 */
-	indices = RelationGetIndexList(matrel);
-	foreach(lc, indices)
-	{
-		Oid indexoid = lfirst_oid(lc);
-		HeapTuple tup = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(indexoid));
-		Form_pg_index form;
+		if (bucket_frozen(state, tup))
+			continue;
 
-		if (!HeapTupleIsValid(tup))
-			elog(ERROR, "index %u for matrel %u not found", indexoid, RelationGetRelid(matrel));
+		old = MemoryContextSwitchTo(state->existing->tablecxt);
 
-		form = (Form_pg_index) GETSTRUCT(tup);
-		if (form->indisprimary)
+		entry = (GroupCacheEntry *) LookupTupleHashEntry(state->existing, state->slot, &isnew);
+		if (isnew)
 		{
-			Assert(form->indnatts == 1);
-			state->pk = form->indkey.values[0];
+			entry->base.tuple = heap_copytuple(tup);
+			entry->base.flags = EXISTING_CACHED;
+			entry->referenced = false;
+			size += GROUP_CACHE_ENTRY_SIZE(entry);
+			ngroups++;
 		}
-		ReleaseSysCache(tup);
-	}
 
-	if (state->base.query->is_sw)
-		init_sw_state(state, matrel);
+		MemoryContextSwitchTo(old);
+	}
 
+	heap_endscan(scan);
 	heap_close(matrel, AccessShareLock);
 
-	Assert(AttributeNumberIsValid(state->pk));
-	state->seq_pk = OidIsValid(base->query->seqrelid);
+	ExecClearTuple(state->slot);
 
-	return base;
+	if (ngroups)
+		elog(DEBUG1, "prewarmed %ld groups of continuous view \"%s\"", ngroups, state->base.query->name->relname);
 }
 
 /*
- * set_group_hash
+ * prewarm
  *
- * Set the group hash at the given index, increasing the size of the group hashes array if necessary
+ * Build the state of every continuous view and fill its group cache before we read any input, so that
+ * a combiner that was just started, for instance on a promoted standby, doesn't build them all on its
+ * first batches
  */
 static void
-set_group_hash(ContQueryCombinerState *state, int index, int64 hash)
+prewarm(ContExecutor *cont_exec)
 {
-	int start = state->group_hashes_len;
-
-	while (index >= state->group_hashes_len)
-		state->group_hashes_len *= 2;
-
-	if (start != state->group_hashes_len)
-	{
-		MemoryContext old = MemoryContextSwitchTo(state->base.state_cxt);
-		state->group_hashes = repalloc(state->group_hashes, state->group_hashes_len);
-		MemoryContextSwitchTo(old);
-	}
+	Bitmapset *views;
+	int id;
 
-	Assert(index < state->group_hashes_len);
-	state->group_hashes[index] = hash;
-}
+	if (!continuous_query_prewarm)
+		return;
 
-static int
-read_batch(ContQueryCombinerState *state, ContExecutor *cont_exec)
-{
-	PartialTupleState *pts;
-	int len;
-	Size nbytes = 0;
-	int count = 0;
+	StartTransactionCommand();
+	views = GetContinuousViewIds();
+	CommitTransactionCommand();
 
-	while ((pts = (PartialTupleState *) ContExecutorYieldNextMessage(cont_exec, &len)) != NULL)
+	while ((id = bms_first_member(views)) >= 0)
 	{
-		if (!TupIsNull(state->slot))
-			ExecClearTuple(state->slot);
+		StartTransactionCommand();
 
-		ExecStoreTuple(heap_copytuple(pts->tup), state->slot, InvalidBuffer, false);
-		tuplestore_puttupleslot(state->batch, state->slot);
+		PG_TRY();
+		{
+			ContQueryCombinerState *state = (ContQueryCombinerState *) ContExecutorWarmQuery(cont_exec, id);
 
-		set_group_hash(state, count, pts->hash);
+			if (state)
+			{
+				PushActiveSnapshot(GetTransactionSnapshot());
+				prewarm_group_cache(state);
+				PopActiveSnapshot();
+			}
 
-		nbytes += len;
-		count++;
-	}
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
+		{
+			EmitErrorReport();
+			FlushErrorState();
 
-	if (!TupIsNull(state->slot))
-		ExecClearTuple(state->slot);
+			if (ActiveSnapshotSet())
+				PopActiveSnapshot();
 
-	pgstat_increment_cq_read(count, nbytes);
+			AbortCurrentTransaction();
+		}
+		PG_END_TRY();
+	}
 
-	return count;
+	MemoryContextSwitchTo(TopMemoryContext);
 }
 
 /*
@@ -1676,18 +7067,7 @@ read_batch(ContQueryCombinerState *state, ContExecutor *cont_exec)
 static bool
 need_sync(ContExecutor *cont_exec, TimestampTz last_sync)
 {
-	Bitmapset *tmp = bms_copy(cont_exec->queries);
-	ContQueryCombinerState **states = (ContQueryCombinerState **) cont_exec->states;
-	int id;
-
-	while ((id = bms_first_member(tmp)) >= 0)
-	{
-		ContQueryCombinerState *state = states[id];
-		if (state == NULL)
-			continue;
-	}
-
-	if (synchronous_stream_insert || continuous_query_commit_interval == 0)
+	if (synchronous_stream_insert || continuous_query_commit_interval == 0 || IsContQueryFlushPending())
 		return true;
 
 	return TimestampDifferenceExceeds(last_sync, GetCurrentTimestamp(), continuous_query_commit_interval);
@@ -1700,9 +7080,16 @@ ContinuousQueryCombinerMain(void)
 	Oid query_id;
 	TimestampTz first_seen = GetCurrentTimestamp();
 	bool do_commit = false;
+	bool over_mem_limit = false;
 	long total_pending = 0;
 	int min_tick_ms = 0;
+	int flush_ms = 0;
+	bool has_ttl = false;
+	int checkpoint_ms = 0;
+	bool idle;
+	int timeout;
 	Bitmapset *queries;
+	ListCell *lc;
 	int id;
 
 	/*
@@ -1727,9 +7114,18 @@ ContinuousQueryCombinerMain(void)
 
 	CommitTransactionCommand();
 
+	restore_matrels();
+	prewarm(cont_exec);
+
 	/* Set the commit level */
 	synchronous_commit = continuous_query_combiner_synchronous_commit;
 
+	/* Kept matrel ResultRelInfos are rebuilt after anything they may depend on changes */
+	CacheRegisterRelcacheCallback(combiner_relcache_callback, (Datum) 0);
+
+	/* nothing we haven't consumed yet is uncommitted */
+	ContQueryProcCommitted(cont_exec->ipcq);
+
 	for (;;)
 	{
 		CHECK_FOR_INTERRUPTS();
@@ -1737,9 +7133,33 @@ ContinuousQueryCombinerMain(void)
 		if (ShouldTerminateContQueryProcess())
 			break;
 
-		ContExecutorStartBatch(cont_exec, min_tick_ms);
+		flush_unforwarded();
+
+		/*
+		 * Partial results held back by shard hand-offs must be retried even if nothing else arrives,
+		 * and shards moved away from us are only released once we've committed
+		 */
+		timeout = min_tick_ms;
+		if (any_handoff_pending(cont_exec) || HasHandedOffCombinerShards())
+			timeout = timeout ? Min(timeout, HANDOFF_RETRY_MS) : HANDOFF_RETRY_MS;
+
+		/* coalesced output stream updates are written once their view's output interval has passed */
+		if (flush_ms)
+			timeout = timeout ? Min(timeout, flush_ms) : flush_ms;
+
+		/* expired groups are deleted while we're idle, so we must not wait forever for input */
+		if (has_ttl)
+			timeout = timeout ? Min(timeout, TTL_EXPIRY_INTERVAL_MS) : TTL_EXPIRY_INTERVAL_MS;
 
-		while ((query_id = ContExecutorStartNextQuery(cont_exec, min_tick_ms)) != InvalidOid)
+		/* unlogged matrels are checkpointed even if nothing arrives */
+		if (checkpoint_ms)
+			timeout = timeout ? Min(timeout, checkpoint_ms) : checkpoint_ms;
+
+		idle = true;
+
+		ContExecutorStartBatch(cont_exec, timeout);
+
+		while ((query_id = ContExecutorStartNextQuery(cont_exec, timeout)) != InvalidOid)
 		{
 			int count = 0;
 			ContQueryCombinerState *state = (ContQueryCombinerState *) cont_exec->current_query;
@@ -1756,9 +7176,11 @@ ContinuousQueryCombinerMain(void)
 
 				if (count)
 				{
+					idle = false;
 					state->pending_tuples += count;
 					total_pending += count;
 
+					derive_rollup_partials(state);
 					combine(state);
 
 					if (first_seen == 0)
@@ -1772,6 +7194,14 @@ ContinuousQueryCombinerMain(void)
 				}
 
 				MemoryContextResetAndDeleteChildren(state->base.tmp_cxt);
+
+				/* a state over its memory limit is synced right away, after which its caches are emptied */
+				if (ContQueryStateReportMemory(&state->base, combiner_cache_bytes(state),
+						MemoryContextMemAllocated(state->plan_cache_cxt, true)))
+				{
+					state->over_mem_limit = true;
+					over_mem_limit = true;
+				}
 			}
 			PG_CATCH();
 			{
@@ -1804,7 +7234,7 @@ next:
 
 		if (total_pending == 0)
 			do_commit = true;
-		else if (need_sync(cont_exec, first_seen))
+		else if (over_mem_limit || need_sync(cont_exec, first_seen))
 		{
 			sync_all(cont_exec);
 			do_commit = true;
@@ -1814,17 +7244,51 @@ next:
 		else
 			do_commit = false;
 
+		flush_ms = flush_all_coalesced_output(cont_exec);
+
+		if (over_mem_limit)
+		{
+			release_over_limit_caches(cont_exec);
+			over_mem_limit = false;
+		}
+
+		if (do_commit)
+			record_batch_ids();
+
 		ContExecutorEndBatch(cont_exec, do_commit);
+
+		if (do_commit)
+		{
+			ContQueryProcCommitted(cont_exec->ipcq);
+			publish_committed_arrivals(cont_exec);
+			publish_cached_rows(cont_exec);
+			forward_rollup_partials(cont_exec);
+		}
+
+		/* everything we had pending for shards moved away from us has been committed by now */
+		if (do_commit && ReleaseHandedOffCombinerShards())
+			forget_moved_delta_hashes(cont_exec);
+
+		if (do_commit)
+		{
+			adapt_sw_steps(cont_exec);
+			adapt_fillfactors(cont_exec);
+			has_ttl = expire_ttl_groups(cont_exec, idle);
+			prune_top_n_groups(cont_exec);
+			checkpoint_ms = checkpoint_matrels(cont_exec);
+			remove_old_batch_ids();
+			StreamLogAdvance(false);
+		}
 	}
 
-	for (query_id = 0; query_id < MAX_CQS; query_id++)
-	{
-		ContQueryCombinerState *state = (ContQueryCombinerState *) cont_exec->states[query_id];
+	/* whatever was consumed before shutting down doesn't need to be replayed */
+	StreamLogAdvance(true);
 
-		if (state == NULL)
-			continue;
+	foreach(lc, ContExecutorGetStates(cont_exec))
+	{
+		ContQueryState *state = (ContQueryState *) lfirst(lc);
 
-		MyStatCQEntry = (PgStat_StatCQEntry *) &state->base.stats;
+		MyStatCQEntry = (PgStat_StatCQEntry *) &state->stats;
 		pgstat_report_cqstat(true);
 	}
 
@@ -1845,6 +7309,7 @@ GetCombinerLookupPlan(ContQuery *view)
 	ContExecutor exec;
 	bool save = am_cont_combiner;
 
+	MemSet(&exec, 0, sizeof(ContExecutor));
 	exec.cxt = CurrentMemoryContext;
 	exec.current_query_id = view->id;
 
@@ -1871,78 +7336,277 @@ GetCombinerLookupPlan(ContQuery *view)
 
 		rel = heap_openrv_extended(view->matrel, AccessShareLock, true);
 
-		if (rel)
+		if (rel)
+		{
+			HeapTuple tuple;
+			HeapScanDesc scan = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+
+			while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+			{
+				TupleBatchPut(state->batch, tuple);
+				break;
+			}
+
+			heap_endscan(scan);
+			heap_close(rel, AccessShareLock);
+		}
+
+		state->existing = existing;
+		values = get_values(state);
+	}
+
+	am_cont_combiner = true;
+	plan = get_cached_groups_plan(state, values);
+	am_cont_combiner = save;
+
+	TupleBatchEnd(state->batch);
+
+	return plan;
+}
+
+/*
+ * equal_tupdesc
+ *
+ * This is less strict than equalTupleDescs and enforces enough similarity that we can merge tuples.
+ */
+static bool
+equal_tupdesc(TupleDesc tupdesc1, TupleDesc tupdesc2)
+{
+	int	i;
+
+	if (tupdesc1->natts != tupdesc2->natts)
+		return false;
+	if (tupdesc1->tdhasoid != tupdesc2->tdhasoid)
+		return false;
+
+	for (i = 0; i < tupdesc1->natts; i++)
+	{
+		Form_pg_attribute attr1 = tupdesc1->attrs[i];
+		Form_pg_attribute attr2 = tupdesc2->attrs[i];
+
+		if (strcmp(NameStr(attr1->attname), NameStr(attr2->attname)) != 0)
+			return false;
+		if (attr1->atttypid != attr2->atttypid)
+			return false;
+		if (attr1->attstattarget != attr2->attstattarget)
+			return false;
+		if (attr1->attndims != attr2->attndims)
+			return false;
+		if (attr1->attstorage != attr2->attstorage)
+			return false;
+		if (attr1->atthasdef != attr2->atthasdef)
+			return false;
+		if (attr1->attisdropped != attr2->attisdropped)
+			return false;
+		if (attr1->attcollation != attr2->attcollation)
+			return false;
+		/* attacl, attoptions and attfdwoptions are not even present... */
+	}
+
+	return true;
+}
+
+/*
+ * Sorted batches of pipeline_combine_table are only cut between groups, unless a group has this
+ * many times continuous_query_batch_size rows
+ */
+#define COMBINE_TABLE_MAX_BATCH_FACTOR 8
+
+/* rows of a table sorted by their group hash, see combine_sorted */
+typedef struct GroupSort
+{
+	TupleDesc desc;
+	AttrNumber hashattr;
+	Tuplesortstate *sort;
+	Datum *values;
+	bool *nulls;
+	int nrows;
+} GroupSort;
+
+/*
+ * begin_group_sort
+ */
+static void
+begin_group_sort(ContQueryCombinerState *state, GroupSort *gs)
+{
+	TupleDesc desc = state->desc;
+	Oid sortop = Int8LessOperator;
+	Oid collation = InvalidOid;
+	bool nullsfirst = false;
+	int i;
+
+	gs->desc = CreateTemplateTupleDesc(desc->natts + 1, false);
+	gs->hashattr = desc->natts + 1;
+	gs->values = palloc(sizeof(Datum) * (desc->natts + 1));
+	gs->nulls = palloc(sizeof(bool) * (desc->natts + 1));
+	gs->nrows = 0;
+
+	for (i = 0; i < desc->natts; i++)
+		memcpy(gs->desc->attrs[i], desc->attrs[i], ATTRIBUTE_FIXED_PART_SIZE);
+	TupleDescInitEntry(gs->desc, gs->hashattr, "$hash", INT8OID, -1, 0);
+
+	gs->sort = tuplesort_begin_heap(gs->desc, 1, &gs->hashattr, &sortop, &collation, &nullsfirst,
+			continuous_query_combiner_work_mem, false);
+}
+
+/*
+ * put_group_sort
+ *
+ * Adds a matrel row to the sort along with its group hash
+ */
+static void
+put_group_sort(ContQueryCombinerState *state, GroupSort *gs, HeapTuple tup, FunctionCallInfo hashfcinfo)
+{
+	TupleDesc desc = state->desc;
+	HeapTuple sorttup;
+
+	/* the sort copies each tuple into its own context */
+	MemoryContext old = MemoryContextSwitchTo(state->base.tmp_cxt);
+
+	ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+	slot_getallattrs(state->slot);
+
+	memcpy(gs->values, state->slot->tts_values, sizeof(Datum) * desc->natts);
+	memcpy(gs->nulls, state->slot->tts_isnull, sizeof(bool) * desc->natts);
+	gs->values[gs->hashattr - 1] = Int64GetDatum(hash_group_for_combiner(state->slot, state->hashfunc, hashfcinfo));
+	gs->nulls[gs->hashattr - 1] = false;
+
+	sorttup = heap_form_tuple(gs->desc, gs->values, gs->nulls);
+	tuplesort_putheaptuple(gs->sort, sorttup);
+
+	ExecClearTuple(state->slot);
+	MemoryContextSwitchTo(old);
+
+	if (++gs->nrows % continuous_query_batch_size == 0)
+		MemoryContextReset(state->base.tmp_cxt);
+}
+
+/*
+ * combine_group_sort
+ *
+ * Combines the sorted rows in batches that each hold all of the rows of their groups, so that
+ * each group is looked up and written once, in the order of the matrel's group lookup index
+ */
+static void
+combine_group_sort(ContExecutor *exec, ContQueryCombinerState *state, GroupSort *gs)
+{
+	TupleDesc desc = state->desc;
+	HeapTuple tup;
+	int64 last_hash = 0;
+	bool should_free;
+	MemoryContext old;
+
+	MemoryContextReset(state->base.tmp_cxt);
+
+	tuplesort_performsort(gs->sort);
+
+	old = MemoryContextSwitchTo(state->base.tmp_cxt);
+
+	while ((tup = tuplesort_getheaptuple(gs->sort, true, &should_free)) != NULL)
+	{
+		int64 hash;
+
+		heap_deform_tuple(tup, gs->desc, gs->values, gs->nulls);
+		hash = DatumGetInt64(gs->values[gs->hashattr - 1]);
+
+		/* the batch so far holds every row of its groups */
+		if (state->pending_tuples >= continuous_query_batch_size && (hash != last_hash ||
+				state->pending_tuples >= COMBINE_TABLE_MAX_BATCH_FACTOR * continuous_query_batch_size))
 		{
-			HeapTuple tuple;
-			HeapScanDesc scan = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+			combine(state);
+			sync_all(exec);
 
-			while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
-			{
-				if (!TupIsNull(state->slot))
-					ExecClearTuple(state->slot);
+			MemoryContextResetAndDeleteChildren(state->base.tmp_cxt);
+			state->pending_tuples = 0;
+		}
 
-				ExecStoreTuple(heap_copytuple(tuple), state->slot, InvalidBuffer, false);
-				tuplestore_puttupleslot(state->batch, state->slot);
-				break;
-			}
+		ExecStoreTuple(TupleBatchPut(state->batch, heap_form_tuple(desc, gs->values, gs->nulls)),
+				state->slot, InvalidBuffer, false);
+		set_group_hash(state, state->pending_tuples++, hash);
+		last_hash = hash;
 
-			heap_endscan(scan);
-			heap_close(rel, AccessShareLock);
-		}
+		if (should_free)
+			heap_freetuple(tup);
+	}
 
-		state->existing = existing;
-		values = get_values(state);
+	if (state->pending_tuples)
+	{
+		combine(state);
+		sync_all(exec);
 	}
 
-	am_cont_combiner = true;
-	plan = get_cached_groups_plan(state, values);
-	am_cont_combiner = save;
+	MemoryContextSwitchTo(old);
+	tuplesort_end(gs->sort);
+}
+
+/*
+ * combine_sorted_table
+ *
+ * Sorts the rows of the given scan by group hash and combines them group by group
+ */
+static void
+combine_sorted_table(ContExecutor *exec, ContQueryCombinerState *state, HeapScanDesc scan,
+		FunctionCallInfo hashfcinfo)
+{
+	GroupSort gs;
+	HeapTuple tup;
 
-	tuplestore_end(state->batch);
+	begin_group_sort(state, &gs);
 
-	return plan;
+	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+		put_group_sort(state, &gs, tup, hashfcinfo);
+
+	combine_group_sort(exec, state, &gs);
 }
 
 /*
- * equal_tupdesc
+ * init_external_combine
  *
- * This is less strict than equalTupleDescs and enforces enough similarity that we can merge tuples.
+ * Initializes the state of a view's combiner in a process that isn't one, so that it can merge
+ * rows into the view's matrel the way its combiners would. Since the rows may belong to any
+ * combiner's shards, the caller must hold an ExclusiveLock on the matrel.
  */
-static bool
-equal_tupdesc(TupleDesc tupdesc1, TupleDesc tupdesc2)
+static ContQueryCombinerState *
+init_external_combine(ContQuery *cv, ContExecutor *exec, FunctionCallInfo hashfcinfo)
 {
-	int	i;
+	ContQueryState *base;
+	ContQueryCombinerState *state;
 
-	if (tupdesc1->natts != tupdesc2->natts)
-		return false;
-	if (tupdesc1->tdhasoid != tupdesc2->tdhasoid)
-		return false;
+	MemSet(exec, 0, sizeof(ContExecutor));
+	exec->cxt = CurrentMemoryContext;
+	exec->current_query_id = cv->id;
+	exec->queries = bms_make_singleton(cv->id);
 
-	for (i = 0; i < tupdesc1->natts; i++)
+	base = palloc0(sizeof(ContQueryState));
+
+	base->query_id = cv->id;
+	base->query = cv;
+	base->state_cxt = CurrentMemoryContext;
+	base->tmp_cxt = AllocSetContextCreate(CurrentMemoryContext, "external combine temp cxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	state = (ContQueryCombinerState *) init_query_state(exec, base);
+	base = &state->base;
+	ContExecutorSetState(exec, cv->id, base);
+
+	MemSet(hashfcinfo, 0, sizeof(FunctionCallInfoData));
+	hashfcinfo->flinfo = palloc0(sizeof(FmgrInfo));
+	hashfcinfo->flinfo->fn_mcxt = base->tmp_cxt;
+
+	if (state->hashfunc)
 	{
-		Form_pg_attribute attr1 = tupdesc1->attrs[i];
-		Form_pg_attribute attr2 = tupdesc2->attrs[i];
+		fmgr_info(state->hashfunc->funcid, hashfcinfo->flinfo);
+		fmgr_info_set_expr((Node *) state->hashfunc, hashfcinfo->flinfo);
 
-		if (strcmp(NameStr(attr1->attname), NameStr(attr2->attname)) != 0)
-			return false;
-		if (attr1->atttypid != attr2->atttypid)
-			return false;
-		if (attr1->attstattarget != attr2->attstattarget)
-			return false;
-		if (attr1->attndims != attr2->attndims)
-			return false;
-		if (attr1->attstorage != attr2->attstorage)
-			return false;
-		if (attr1->atthasdef != attr2->atthasdef)
-			return false;
-		if (attr1->attisdropped != attr2->attisdropped)
-			return false;
-		if (attr1->attcollation != attr2->attcollation)
-			return false;
-		/* attacl, attoptions and attfdwoptions are not even present... */
+		hashfcinfo->fncollation = state->hashfunc->funccollid;
+		hashfcinfo->nargs = list_length(state->hashfunc->args);
 	}
 
-	return true;
+	state->pending_tuples = 0;
+
+	return state;
 }
 
 Datum
@@ -1972,52 +7636,24 @@ pipeline_combine_table(PG_FUNCTION_ARGS)
 		elog(ERROR, "schema of \"%s\" does not match the schema of \"%s\"",
 				text_to_cstring(relname), quote_qualified_identifier(cv->matrel->schemaname, cv->matrel->relname));
 
-	exec.cxt = CurrentMemoryContext;
-	exec.current_query_id = cv->id;
-	exec.queries = bms_make_singleton(cv->id);
-
-	base = palloc0(sizeof(ContQueryState));
-
-	base->query_id = cv->id;
-	base->query = cv;
-	base->state_cxt = CurrentMemoryContext;
-	base->tmp_cxt = AllocSetContextCreate(CurrentMemoryContext, "pipeline_combine_table temp cxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
-
-	state = (ContQueryCombinerState *) init_query_state(&exec, base);
+	state = init_external_combine(cv, &exec, hashfcinfo);
 	base = &state->base;
-	exec.states[cv->id] = base;
 
-	hashfcinfo->flinfo = palloc0(sizeof(FmgrInfo));
-	hashfcinfo->flinfo->fn_mcxt = base->tmp_cxt;
+	scan = heap_beginscan(srcrel, GetTransactionSnapshot(), 0, NULL);
 
+	/* grouped views merge the table's rows group by group */
 	if (state->hashfunc)
 	{
-		fmgr_info(state->hashfunc->funcid, hashfcinfo->flinfo);
-		fmgr_info_set_expr((Node *) state->hashfunc, hashfcinfo->flinfo);
-
-		hashfcinfo->fncollation = state->hashfunc->funccollid;
-		hashfcinfo->nargs = list_length(state->hashfunc->args);
+		combine_sorted_table(&exec, state, scan, hashfcinfo);
+		goto done;
 	}
 
-	scan = heap_beginscan(srcrel, GetTransactionSnapshot(), 0, NULL);
-	state->pending_tuples = 0;
-
 	Assert(base->tmp_cxt);
 	MemoryContextSwitchTo(base->tmp_cxt);
 
 	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
 	{
-		ExecStoreTuple(heap_copytuple(tup), state->slot, InvalidBuffer, false);
-		tuplestore_puttupleslot(state->batch, state->slot);
-
-		if (state->hashfunc)
-		{
-			int64 hash =  hash_group_for_combiner(state->slot, state->hashfunc, hashfcinfo);
-			set_group_hash(state, state->pending_tuples, hash);
-		}
+		ExecStoreTuple(TupleBatchPut(state->batch, tup), state->slot, InvalidBuffer, false);
 
 		if (++state->pending_tuples < continuous_query_batch_size)
 			continue;
@@ -2036,10 +7672,341 @@ pipeline_combine_table(PG_FUNCTION_ARGS)
 		sync_all(&exec);
 	}
 
+done:
 	heap_endscan(scan);
 
+	/* combiners' group filters don't know about the groups of their shards we've just inserted */
+	CacheInvalidateRelcache(matrel);
+
 	heap_close(srcrel, NoLock);
 	heap_close(matrel, NoLock);
 
 	PG_RETURN_BOOL(true);
 }
+
+/*
+ * DownsampleGroups
+ *
+ * Merges up to batch_size groups of a downsampled view whose time bucket is older than one of the
+ * view's downsample ages into the bucket of the oldest such age's resolution, using the view's
+ * combine functions, and deletes their rows. A group whose bucket starts a coarser bucket is the
+ * one the others are merged into. Since merged groups may belong to any combiner's shards, the
+ * caller must hold an ExclusiveLock on the matrel. Returns true if there may be more groups to merge.
+ */
+bool
+DownsampleGroups(ContQuery *cv, Relation matrel, int batch_size)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	DownsampleRule *first = (DownsampleRule *) linitial(cv->downsample);
+	FunctionCallInfo hashfcinfo = palloc0(sizeof(FunctionCallInfoData));
+	ContExecutor exec;
+	ContQueryCombinerState *state;
+	TupleDesc desc = RelationGetDescr(matrel);
+	Datum *values = palloc(sizeof(Datum) * desc->natts);
+	bool *nulls = palloc(sizeof(bool) * desc->natts);
+	Relation index = NULL;
+	HeapScanDesc heapscan = NULL;
+	IndexScanDesc indexscan = NULL;
+	ScanKeyData skey[1];
+	AttrNumber ts_attr;
+	Oid indexid;
+	Oid type;
+	CommandId cid;
+	HeapTuple tup;
+	GroupSort gs;
+	int nmerged = 0;
+	bool more = false;
+
+	state = init_external_combine(cv, &exec, hashfcinfo);
+	Assert(state->hashfunc);
+
+	ts_attr = find_attr(state->desc, cv->downsample_column);
+	if (!AttributeNumberIsValid(ts_attr))
+		elog(ERROR, "downsample_column \"%s\" not found", cv->downsample_column);
+
+	type = desc->attrs[ts_attr - 1]->atttypid;
+	cid = GetCurrentCommandId(true);
+	indexid = find_time_index(matrel, ts_attr);
+
+	if (OidIsValid(indexid))
+	{
+		index = index_open(indexid, AccessShareLock);
+
+		ScanKeyEntryInitialize(&skey[0], 0, 1, BTLessEqualStrategyNumber, type,
+				InvalidOid, F_TIMESTAMP_LE, TimestampTzGetDatum(now - first->after));
+		indexscan = index_beginscan(matrel, index, GetActiveSnapshot(), 1, 0);
+		index_rescan(indexscan, skey, 1, NULL, 0);
+	}
+	else
+	{
+		ScanKeyEntryInitialize(&skey[0], 0, ts_attr, BTLessEqualStrategyNumber, type,
+				InvalidOid, F_TIMESTAMP_LE, TimestampTzGetDatum(now - first->after));
+		heapscan = heap_beginscan(matrel, GetActiveSnapshot(), 1, skey);
+	}
+
+	begin_group_sort(state, &gs);
+
+	for (;;)
+	{
+		HeapUpdateFailureData hufd;
+		ItemPointerData tid;
+		HeapTuple merged;
+		TimestampTz ts;
+		bool isnull;
+		int64 resolution = 0;
+		int64 bucket;
+		ListCell *lc;
+
+		tup = indexscan ? index_getnext(indexscan, ForwardScanDirection) : heap_getnext(heapscan, ForwardScanDirection);
+		if (tup == NULL)
+			break;
+
+		ts = DatumGetTimestampTz(heap_getattr(tup, ts_attr, desc, &isnull));
+		if (isnull)
+			continue;
+
+		foreach(lc, cv->downsample)
+		{
+			DownsampleRule *rule = (DownsampleRule *) lfirst(lc);
+
+			if (ts <= now - rule->after)
+				resolution = rule->resolution;
+		}
+
+		if (resolution == 0)
+			continue;
+
+		/* buckets are aligned to multiples of their resolution since the timestamp epoch */
+		bucket = ts - (((ts % resolution) + resolution) % resolution);
+		if (bucket == ts)
+			continue;
+
+		/* the row's toasted values are deleted along with it */
+		merged = HeapTupleHasExternal(tup) ? toast_flatten_tuple(tup, desc) : heap_copytuple(tup);
+
+		tid = tup->t_self;
+		if (heap_delete(matrel, &tid, cid, InvalidSnapshot, false, &hufd) != HeapTupleMayBeUpdated)
+		{
+			heap_freetuple(merged);
+			continue;
+		}
+
+		heap_deform_tuple(merged, desc, values, nulls);
+		values[ts_attr - 1] = TimestampTzGetDatum(bucket);
+
+		tup = heap_form_tuple(desc, values, nulls);
+		put_group_sort(state, &gs, tup, hashfcinfo);
+
+		heap_freetuple(tup);
+		heap_freetuple(merged);
+
+		if (++nmerged >= batch_size)
+		{
+			more = true;
+			break;
+		}
+	}
+
+	if (indexscan)
+	{
+		index_endscan(indexscan);
+		index_close(index, AccessShareLock);
+	}
+	else
+		heap_endscan(heapscan);
+
+	/* the merged rows are looked up by their new buckets, which none of the deleted rows are in */
+	combine_group_sort(&exec, state, &gs);
+
+	/* combiners' group filters don't know about the groups of their shards we've just inserted */
+	if (nmerged)
+		CacheInvalidateRelcache(matrel);
+
+	return more;
+}
+
+/*
+ * State of pipeline_combine_partial for the continuous view it was last called with
+ */
+typedef struct CombinePartialState
+{
+	Oid query_id;
+	Oid matrelid;
+	TupleDesc desc;
+	TupleTableSlot *slot;
+	Datum *values;
+	bool *nulls;
+	FuncExpr *hashfunc;
+	FunctionCallInfo hash_fcinfo;
+	uint64 name_hash;
+} CombinePartialState;
+
+/*
+ * init_combine_partial_state
+ */
+static CombinePartialState *
+init_combine_partial_state(FunctionCallInfo fcinfo, ContQuery *cv)
+{
+	MemoryContext old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	CombinePartialState *state = palloc0(sizeof(CombinePartialState));
+	Relation matrel = heap_openrv(cv->matrel, AccessShareLock);
+	ResultRelInfo *ri;
+
+	state->query_id = cv->id;
+	state->matrelid = cv->matrelid;
+	state->desc = CreateTupleDescCopy(RelationGetDescr(matrel));
+	state->slot = MakeSingleTupleTableSlot(state->desc);
+	state->values = palloc0(sizeof(Datum) * state->desc->natts);
+	state->nulls = palloc0(sizeof(bool) * state->desc->natts);
+
+	ri = CQMatRelOpen(matrel);
+	state->hashfunc = GetGroupHashIndexExpr(ri);
+	CQMatRelClose(ri);
+	heap_close(matrel, AccessShareLock);
+
+	if (state->hashfunc)
+	{
+		state->hash_fcinfo = palloc0(sizeof(FunctionCallInfoData));
+		state->hash_fcinfo->flinfo = palloc0(sizeof(FmgrInfo));
+		state->hash_fcinfo->flinfo->fn_mcxt = fcinfo->flinfo->fn_mcxt;
+
+		fmgr_info(state->hashfunc->funcid, state->hash_fcinfo->flinfo);
+		fmgr_info_set_expr((Node *) state->hashfunc, state->hash_fcinfo->flinfo);
+
+		state->hash_fcinfo->fncollation = state->hashfunc->funccollid;
+		state->hash_fcinfo->nargs = list_length(state->hashfunc->args);
+	}
+	else
+		state->name_hash = GetCombinerNameHash(cv);
+
+	MemoryContextSwitchTo(old);
+
+	fcinfo->flinfo->fn_extra = state;
+
+	return state;
+}
+
+/*
+ * is_valid_partial_value
+ *
+ * Checks that a transition state submitted from outside of the server is one combiners can read.
+ * The types of the sketches combiners merge in place don't validate their input.
+ */
+static bool
+is_valid_partial_value(Oid type, struct varlena *value)
+{
+	switch (type)
+	{
+		case HLLOID:
+			return HLLIsValid((HyperLogLog *) value);
+		case BLOOMOID:
+			return BloomFilterIsValid((BloomFilter *) value);
+		case CMSKETCHOID:
+			return CountMinSketchIsValid((CountMinSketch *) value);
+		case TDIGESTOID:
+			return TDigestIsValid((TDigest *) value);
+		default:
+			return true;
+	}
+}
+
+/*
+ * pipeline_combine_partial
+ *
+ * Sends a partial result, a row of the given continuous view's matrel type holding its group's columns and
+ * the transition states of its aggregates, directly to the view's combiner owning its group, skipping workers.
+ * This is how partial results computed outside of the server, e.g. on edge servers, are merged into a view.
+ */
+Datum
+pipeline_combine_partial(PG_FUNCTION_ARGS)
+{
+	text *cv_name = PG_GETARG_TEXT_P(0);
+	HeapTupleHeader rec = PG_GETARG_HEAPTUPLEHEADER(1);
+	RangeVar *cv_rv = makeRangeVarFromNameList(textToQualifiedNameList(cv_name));
+	ContQuery *cv = GetContQueryForView(cv_rv);
+	CombinePartialState *state = (CombinePartialState *) fcinfo->flinfo->fn_extra;
+	TupleDesc recdesc;
+	HeapTupleData rectup;
+	PartialTupleState pts;
+	ipc_queue *ipcq;
+	bool matches;
+	int len;
+	int i;
+
+	if (cv == NULL)
+		elog(ERROR, "continuous view \"%s\" does not exist", text_to_cstring(cv_name));
+
+	/* the view may have been dropped and created again since we were last called */
+	if (state == NULL || state->query_id != cv->id || state->matrelid != cv->matrelid)
+		state = init_combine_partial_state(fcinfo, cv);
+
+	recdesc = lookup_rowtype_tupdesc(HeapTupleHeaderGetTypeId(rec), HeapTupleHeaderGetTypMod(rec));
+	matches = recdesc->natts == state->desc->natts;
+
+	for (i = 0; matches && i < state->desc->natts; i++)
+	{
+		Form_pg_attribute attr = state->desc->attrs[i];
+
+		if (attr->attisdropped != recdesc->attrs[i]->attisdropped)
+			matches = false;
+		else if (!attr->attisdropped && (attr->atttypid != recdesc->attrs[i]->atttypid ||
+				attr->atttypmod != recdesc->attrs[i]->atttypmod))
+			matches = false;
+	}
+
+	ReleaseTupleDesc(recdesc);
+
+	if (!matches)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				errmsg("partial result does not match the schema of \"%s\"",
+						quote_qualified_identifier(cv->matrel->schemaname, cv->matrel->relname))));
+
+	rectup.t_len = HeapTupleHeaderGetDatumLength(rec);
+	ItemPointerSetInvalid(&rectup.t_self);
+	rectup.t_tableOid = InvalidOid;
+	rectup.t_data = rec;
+
+	heap_deform_tuple(&rectup, state->desc, state->values, state->nulls);
+
+	/* combiners expect plain values, as workers send them */
+	for (i = 0; i < state->desc->natts; i++)
+	{
+		Form_pg_attribute attr = state->desc->attrs[i];
+
+		if (state->nulls[i] || attr->attisdropped || attr->attlen != -1)
+			continue;
+
+		state->values[i] = PointerGetDatum(PG_DETOAST_DATUM(state->values[i]));
+
+		if (!is_valid_partial_value(attr->atttypid, (struct varlena *) DatumGetPointer(state->values[i])))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg("invalid %s transition state in column \"%s\"",
+							format_type_be(attr->atttypid), NameStr(attr->attname))));
+	}
+
+	MemSet(&pts, 0, sizeof(PartialTupleState));
+	pts.tup = heap_form_tuple(state->desc, state->values, state->nulls);
+	pts.query_id = cv->id;
+	pts.insert_time = pts.arrival_time = GetCurrentTimestamp();
+
+	if (state->hashfunc)
+	{
+		ExecStoreTuple(pts.tup, state->slot, InvalidBuffer, false);
+		pts.hash = hash_group_for_combiner(state->slot, state->hashfunc, state->hash_fcinfo);
+		ExecClearTuple(state->slot);
+	}
+	else
+		pts.hash = state->name_hash;
+
+	len = sizeof(PartialTupleState) + HEAPTUPLESIZE + pts.tup->t_len;
+
+	ipcq = get_combiner_queue_with_lock(get_combiner_for_group_hash(pts.hash));
+	ipc_queue_push_nolock(ipcq, &pts, len, true);
+	ipc_queue_unlock(ipcq);
+
+	heap_freetuple(pts.tup);
+
+	PG_RETURN_BOOL(true);
+}
@@ -13,6 +13,8 @@
 
 #include "access/htup.h"
 #include "access/htup_details.h"
+#include "access/tupmacs.h"
+#include "access/tuptoaster.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
 #include "catalog/pipeline_query.h"
@@ -20,11 +22,14 @@
 #include "catalog/pg_type.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
+#include "pg_trace.h"
 #include "pgstat.h"
 #include "pipeline/cont_execute.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/miscutils.h"
 #include "pipeline/stream.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
 #include "storage/shm_alloc.h"
 #include "tcop/tcopprot.h"
 #include "utils/lsyscache.h"
@@ -34,6 +39,45 @@
 
 #define SLEEP_MS 1
 
+/*
+ * Completed batches set their inserter's latch, so this only bounds how long a waiter
+ * can go without checking for interrupts
+ */
+#define ACK_WAIT_TIMEOUT_MS 100
+
+/* maximum number of deferred insert batches a backend may have outstanding */
+#define MAX_DEFERRED_BATCHES 1024
+
+typedef struct DeferredInsertBatch
+{
+	uint64 token;
+	InsertBatch *batch;
+} DeferredInsertBatch;
+
+/* deferred insert batches that haven't been fully acked yet, in token order */
+static List *deferred_batches = NIL;
+static uint64 last_deferred_token = 0;
+
+/* guc parameters */
+bool continuous_query_work_stealing;
+bool continuous_query_adaptive_batching;
+int continuous_query_latency_target;
+bool continuous_query_batch_arena;
+bool continuous_query_prewarm;
+
+/* smallest batch size the adaptive controller shrinks batches to, the minimum of continuous_query_batch_size */
+#define MIN_ADAPTIVE_BATCH_SIZE 10
+/* weight of the latest batch in the moving average of batch latencies */
+#define LATENCY_DECAY 0.2
+
+/* a stolen message along with the queue it was stolen from */
+typedef struct StolenMessage
+{
+	ipc_queue *ipcq;
+	void *msg;
+	int len;
+} StolenMessage;
+
 typedef struct BufferedStreamTupleState
 {
 	int len;
@@ -145,10 +189,38 @@ StreamTupleStateCopyFn(void *dest, void *src, int len)
 	pos += VARSIZE(sts->desc);
 
 	cpysts->tup = ptr_difference(dest, pos);
-	memcpy(pos, sts->tup, HEAPTUPLESIZE);
-	pos += HEAPTUPLESIZE;
-	memcpy(pos, sts->tup->t_data, sts->tup->t_len);
-	pos += sts->tup->t_len;
+	cpysts->tups = NULL;
+
+	if (sts->columns)
+	{
+		/* columnar batches replace the tuples entirely */
+		cpysts->tup = NULL;
+		cpysts->columns = ptr_difference(dest, pos);
+		memcpy(pos, sts->columns, sts->columns->len);
+		pos += sts->columns->len;
+	}
+	else if (sts->ntups > 1)
+	{
+		int i;
+
+		/* Batched tuples are laid out back to back, with their t_data immediately following each header */
+		for (i = 0; i < sts->ntups; i++)
+		{
+			HeapTuple tup = sts->tups[i];
+
+			memcpy(pos, tup, HEAPTUPLESIZE);
+			pos += HEAPTUPLESIZE;
+			memcpy(pos, tup->t_data, tup->t_len);
+			pos += tup->t_len;
+		}
+	}
+	else
+	{
+		memcpy(pos, sts->tup, HEAPTUPLESIZE);
+		pos += HEAPTUPLESIZE;
+		memcpy(pos, sts->tup->t_data, sts->tup->t_len);
+		pos += sts->tup->t_len;
+	}
 
 	if (synchronous_stream_insert && sts->acks)
 	{
@@ -205,8 +277,31 @@ StreamTupleStatePeekFn(void *ptr, int len)
 
 	sts->desc =  ptr_offset(sts, sts->desc);
 	sts->record_descs = ptr_offset(sts, sts->record_descs);
+
+	if (sts->columns)
+	{
+		/* columnar batches don't carry any tuples */
+		sts->columns = ptr_offset(sts, sts->columns);
+		return;
+	}
+
 	sts->tup = ptr_offset(sts, sts->tup);
-	sts->tup->t_data = (HeapTupleHeader) (((char *) sts->tup) + HEAPTUPLESIZE);
+
+	if (sts->ntups > 1)
+	{
+		char *pos = (char *) sts->tup;
+		int i;
+
+		for (i = 0; i < sts->ntups; i++)
+		{
+			HeapTuple tup = (HeapTuple) pos;
+
+			tup->t_data = (HeapTupleHeader) (pos + HEAPTUPLESIZE);
+			pos += HEAPTUPLESIZE + tup->t_len;
+		}
+	}
+	else
+		sts->tup->t_data = (HeapTupleHeader) (((char *) sts->tup) + HEAPTUPLESIZE);
 }
 
 void
@@ -220,13 +315,287 @@ StreamTupleStatePopFn(void *ptr, int len)
 		for (i = 0; i < sts->nacks; i++)
 		{
 			InsertBatchAck *ack = &sts->acks[i];
-			InsertBatchAckTuple(ack);
+			int j;
+
+			/* Each tuple in a batched state is acked individually */
+			for (j = 0; j < Max(sts->ntups, 1); j++)
+				InsertBatchAckTuple(ack);
 		}
 	}
 }
 
+/*
+ * StreamTupleStateGetTuple
+ *
+ * Returns the nth tuple of a peeked StreamTupleState
+ */
+HeapTuple
+StreamTupleStateGetTuple(StreamTupleState *sts, int n)
+{
+	char *pos = (char *) sts->tup;
+	int i;
+
+	Assert(!sts->columns);
+	Assert(n < Max(sts->ntups, 1));
+
+	for (i = 0; i < n; i++)
+		pos += HEAPTUPLESIZE + ((HeapTuple) pos)->t_len;
+
+	return (HeapTuple) pos;
+}
+
+/*
+ * StreamTupleStateCreateBatch
+ *
+ * Create a StreamTupleState that packs multiple tuples into a single ipc_queue slot. All tuples share
+ * the same desc, acks and queries, so these are only serialized once per batch. Tuples with RECORD
+ * attributes can't be batched since each one may carry its own set of record descriptors.
+ */
 StreamTupleState *
-StreamTupleStateCreate(HeapTuple tup, TupleDesc desc, bytea *packed_desc, Bitmapset *queries,
+StreamTupleStateCreateBatch(Oid relid, HeapTuple *tups, int ntups, bytea *packed_desc, Bitmapset *queries,
+		InsertBatchAck *acks, int nacks, int *len)
+{
+	StreamTupleState *tupstate = palloc0(sizeof(StreamTupleState));
+	int i;
+
+	Assert(acks || nacks == 0);
+	Assert(ntups > 0);
+
+	*len =  sizeof(StreamTupleState);
+	*len += VARSIZE(packed_desc);
+
+	for (i = 0; i < ntups; i++)
+		*len += HEAPTUPLESIZE + tups[i]->t_len;
+
+	if (acks)
+		*len += sizeof(InsertBatchAck) * nacks;
+
+	if (queries)
+		*len += BITMAPSET_SIZE(queries->nwords);
+
+	tupstate->nacks = nacks;
+	tupstate->acks = acks;
+	tupstate->arrival_time = GetCurrentTimestamp();
+	tupstate->relid = relid;
+	tupstate->desc = packed_desc;
+	tupstate->queries = queries;
+	tupstate->tup = tups[0];
+	tupstate->ntups = ntups;
+	tupstate->tups = tups;
+
+	return tupstate;
+}
+
+/*
+ * encode_columnar_batch
+ *
+ * Lay out the given tuples column by column. Null values still occupy their entry in fixed-width
+ * value arrays so that any row can be located directly. Values are aligned relative to the
+ * beginning of the batch, which ends up MAXALIGNed when allocated locally.
+ */
+static StreamColumnarBatch *
+encode_columnar_batch(HeapTuple *tups, int ntups, TupleDesc desc)
+{
+	int natts = desc->natts;
+	Datum *values = palloc(sizeof(Datum) * natts * ntups);
+	bool *nulls = palloc(sizeof(bool) * natts * ntups);
+	StreamColumn *columns = palloc0(sizeof(StreamColumn) * natts);
+	StreamColumnarBatch *batch;
+	char *base;
+	uint32 size;
+	int row;
+	int i;
+
+	for (row = 0; row < ntups; row++)
+	{
+		Datum *rvalues = &values[row * natts];
+		bool *rnulls = &nulls[row * natts];
+
+		heap_deform_tuple(tups[row], desc, rvalues, rnulls);
+
+		/* toasted values don't mean anything to the reader, so flatten them */
+		for (i = 0; i < natts; i++)
+		{
+			if (!rnulls[i] && desc->attrs[i]->attlen == -1 &&
+					VARATT_IS_EXTERNAL(DatumGetPointer(rvalues[i])))
+				rvalues[i] = PointerGetDatum(heap_tuple_fetch_attr((struct varlena *) DatumGetPointer(rvalues[i])));
+		}
+	}
+
+	/* first compute the layout of each column */
+	size = MAXALIGN(offsetof(StreamColumnarBatch, columns) + sizeof(StreamColumn) * natts);
+
+	for (i = 0; i < natts; i++)
+	{
+		Form_pg_attribute attr = desc->attrs[i];
+		StreamColumn *col = &columns[i];
+
+		for (row = 0; row < ntups; row++)
+		{
+			if (nulls[row * natts + i])
+			{
+				col->nulls = size;
+				size += BITMAPLEN(ntups);
+				break;
+			}
+		}
+
+		if (attr->attlen > 0)
+		{
+			size = att_align_nominal(size, attr->attalign);
+			col->values = size;
+			size += att_align_nominal(attr->attlen, attr->attalign) * ntups;
+			continue;
+		}
+
+		size = INTALIGN(size);
+		col->offsets = size;
+		size += sizeof(uint32) * ntups;
+		col->values = size;
+
+		for (row = 0; row < ntups; row++)
+		{
+			if (nulls[row * natts + i])
+				continue;
+
+			size = att_align_nominal(size, attr->attalign);
+			size = att_addlength_datum(size, attr->attlen, values[row * natts + i]);
+		}
+	}
+
+	batch = palloc0(size);
+	base = (char *) batch;
+
+	batch->len = size;
+	batch->ntups = ntups;
+	batch->natts = natts;
+	memcpy(batch->columns, columns, sizeof(StreamColumn) * natts);
+
+	/* now fill in the values */
+	for (i = 0; i < natts; i++)
+	{
+		Form_pg_attribute attr = desc->attrs[i];
+		StreamColumn *col = &columns[i];
+		bits8 *bitmap = col->nulls ? (bits8 *) (base + col->nulls) : NULL;
+		uint32 *offsets = col->offsets ? (uint32 *) (base + col->offsets) : NULL;
+		uint32 stride = att_align_nominal(attr->attlen, attr->attalign);
+		uint32 pos = col->values;
+
+		for (row = 0; row < ntups; row++)
+		{
+			Datum v = values[row * natts + i];
+			uint32 start;
+
+			if (nulls[row * natts + i])
+				continue;
+
+			if (bitmap)
+				bitmap[row >> 3] |= (1 << (row & 07));
+
+			if (attr->attlen > 0)
+			{
+				char *dest = base + col->values + stride * row;
+
+				if (attr->attbyval)
+					store_att_byval(dest, v, attr->attlen);
+				else
+					memcpy(dest, DatumGetPointer(v), attr->attlen);
+				continue;
+			}
+
+			pos = att_align_nominal(pos, attr->attalign);
+			start = pos;
+			pos = att_addlength_datum(pos, attr->attlen, v);
+
+			memcpy(base + start, DatumGetPointer(v), pos - start);
+			offsets[row] = start - col->values;
+		}
+	}
+
+	pfree(values);
+	pfree(nulls);
+	pfree(columns);
+
+	return batch;
+}
+
+/*
+ * StreamTupleStateCreateColumnarBatch
+ *
+ * Like StreamTupleStateCreateBatch, but encodes the tuples column by column so that readers can
+ * fetch any attribute of any row directly, without deforming the tuples it belongs to
+ */
+StreamTupleState *
+StreamTupleStateCreateColumnarBatch(Oid relid, HeapTuple *tups, int ntups, TupleDesc desc, bytea *packed_desc,
+		Bitmapset *queries, InsertBatchAck *acks, int nacks, int *len)
+{
+	StreamTupleState *tupstate = palloc0(sizeof(StreamTupleState));
+
+	Assert(acks || nacks == 0);
+	Assert(ntups > 1);
+
+	tupstate->columns = encode_columnar_batch(tups, ntups, desc);
+
+	*len =  sizeof(StreamTupleState);
+	*len += VARSIZE(packed_desc);
+	*len += tupstate->columns->len;
+
+	if (acks)
+		*len += sizeof(InsertBatchAck) * nacks;
+
+	if (queries)
+		*len += BITMAPSET_SIZE(queries->nwords);
+
+	tupstate->nacks = nacks;
+	tupstate->acks = acks;
+	tupstate->arrival_time = GetCurrentTimestamp();
+	tupstate->relid = relid;
+	tupstate->desc = packed_desc;
+	tupstate->queries = queries;
+	tupstate->ntups = ntups;
+
+	return tupstate;
+}
+
+/*
+ * StreamColumnarBatchGetAttr
+ *
+ * Returns the value of the given (zero-based) attribute of the given row of a columnar batch. Varlena
+ * values point directly into the batch.
+ */
+Datum
+StreamColumnarBatchGetAttr(StreamColumnarBatch *batch, TupleDesc desc, int attnum, int row, bool *isnull)
+{
+	Form_pg_attribute attr = desc->attrs[attnum];
+	StreamColumn *col;
+	char *base = (char *) batch;
+
+	Assert(row < batch->ntups);
+
+	if (attnum >= batch->natts)
+	{
+		*isnull = true;
+		return (Datum) 0;
+	}
+
+	col = &batch->columns[attnum];
+
+	if (col->nulls && !(((bits8 *) (base + col->nulls))[row >> 3] & (1 << (row & 07))))
+	{
+		*isnull = true;
+		return (Datum) 0;
+	}
+
+	*isnull = false;
+
+	if (attr->attlen > 0)
+		return fetchatt(attr, base + col->values + att_align_nominal(attr->attlen, attr->attalign) * row);
+
+	return PointerGetDatum(base + col->values + ((uint32 *) (base + col->offsets))[row]);
+}
+
+StreamTupleState *
+StreamTupleStateCreate(Oid relid, HeapTuple tup, TupleDesc desc, bytea *packed_desc, Bitmapset *queries,
 		InsertBatchAck *acks, int nacks, int *len)
 {
 	StreamTupleState *tupstate = palloc0(sizeof(StreamTupleState));
@@ -249,6 +618,7 @@ StreamTupleStateCreate(HeapTuple tup, TupleDesc desc, bytea *packed_desc, Bitmap
 	tupstate->nacks = nacks;
 	tupstate->acks = acks;
 	tupstate->arrival_time = GetCurrentTimestamp();
+	tupstate->relid = relid;
 	tupstate->desc = packed_desc;
 
 	for (i = 0; i < desc->natts; i++)
@@ -290,6 +660,7 @@ StreamTupleStateCreate(HeapTuple tup, TupleDesc desc, bytea *packed_desc, Bitmap
 	tupstate->record_descs = rdescs;
 	tupstate->queries = queries;
 	tupstate->tup = tup;
+	tupstate->ntups = 1;
 
 	return tupstate;
 }
@@ -303,6 +674,7 @@ InsertBatchCreate(void)
 	pg_atomic_init_u32(&batch->num_ctups, 0);
 	pg_atomic_init_u32(&batch->num_wacks, 0);
 	pg_atomic_init_u32(&batch->num_wtups, 0);
+	batch->latch = MyLatch;
 	return batch;
 }
 
@@ -313,20 +685,204 @@ InsertBatchAllAcked(InsertBatch *batch)
 			pg_atomic_read_u32(&batch->num_cacks) >= pg_atomic_read_u32(&batch->num_ctups));
 }
 
+/*
+ * wait_for_ack
+ *
+ * Sleeps until this process's latch is set by a completed batch or the timeout elapses
+ */
+static void
+wait_for_ack(void)
+{
+	int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, ACK_WAIT_TIMEOUT_MS);
+
+	ResetLatch(MyLatch);
+
+	if (rc & WL_POSTMASTER_DEATH)
+		proc_exit(1);
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+/*
+ * InsertBatchIsAcked
+ *
+ * Returns true if all of the tuples sent for the given batch so far have been acked
+ */
+bool
+InsertBatchIsAcked(InsertBatch *batch)
+{
+	return InsertBatchAllAcked(batch);
+}
+
 void
 InsertBatchWaitAndRemove(InsertBatch *batch, int num_tuples)
 {
 	if (num_tuples)
 	{
+		instr_time start;
+		instr_time elapsed;
+
+		INSTR_TIME_SET_CURRENT(start);
+
 		pg_atomic_fetch_add_u32(&batch->num_wtups, num_tuples);
 		while (!InsertBatchAllAcked(batch))
+			wait_for_ack();
+
+		INSTR_TIME_SET_CURRENT(elapsed);
+		INSTR_TIME_SUBTRACT(elapsed, start);
+
+		MyStreamInsertWaits.ack_waits++;
+		MyStreamInsertWaits.ack_wait_time += INSTR_TIME_GET_MICROSEC(elapsed);
+	}
+
+	ShmemDynFree(batch);
+}
+
+/*
+ * free_deferred_batches
+ *
+ * Release the shared memory of any deferred batches that are still outstanding at backend exit
+ */
+static void
+free_deferred_batches(int code, Datum arg)
+{
+	ListCell *lc;
+
+	foreach(lc, deferred_batches)
+	{
+		DeferredInsertBatch *d = (DeferredInsertBatch *) lfirst(lc);
+		ShmemDynFree(d->batch);
+	}
+
+	deferred_batches = NIL;
+}
+
+/*
+ * reap_deferred_batches
+ *
+ * Free every deferred batch that has been fully acked
+ */
+static void
+reap_deferred_batches(void)
+{
+	ListCell *lc;
+	ListCell *prev = NULL;
+	ListCell *next;
+
+	for (lc = list_head(deferred_batches); lc != NULL; lc = next)
+	{
+		DeferredInsertBatch *d = (DeferredInsertBatch *) lfirst(lc);
+
+		next = lnext(lc);
+
+		if (InsertBatchAllAcked(d->batch))
 		{
-			pg_usleep(SLEEP_MS * 1000);
-			CHECK_FOR_INTERRUPTS();
+			ShmemDynFree(d->batch);
+			deferred_batches = list_delete_cell(deferred_batches, lc, prev);
+			pfree(d);
 		}
+		else
+			prev = lc;
 	}
+}
 
-	ShmemDynFree(batch);
+/*
+ * InsertBatchDefer
+ *
+ * Return without waiting for the given batch to be acked. Returns a token that can later be
+ * waited on or polled with InsertBatchWaitForToken and InsertBatchTokenAcked. Tokens increase
+ * monotonically within a backend, and a token is acked once it and all earlier tokens are.
+ */
+uint64
+InsertBatchDefer(InsertBatch *batch, int num_tuples)
+{
+	static bool registered = false;
+	DeferredInsertBatch *d;
+	MemoryContext old;
+
+	if (!num_tuples)
+	{
+		ShmemDynFree(batch);
+		return ++last_deferred_token;
+	}
+
+	if (!registered)
+	{
+		before_shmem_exit(free_deferred_batches, (Datum) 0);
+		registered = true;
+	}
+
+	pg_atomic_fetch_add_u32(&batch->num_wtups, num_tuples);
+
+	/* bound the number of outstanding batches, and the shared memory they hold */
+	reap_deferred_batches();
+	if (list_length(deferred_batches) >= MAX_DEFERRED_BATCHES)
+		InsertBatchWaitForToken(((DeferredInsertBatch *) linitial(deferred_batches))->token);
+
+	old = MemoryContextSwitchTo(TopMemoryContext);
+
+	d = palloc(sizeof(DeferredInsertBatch));
+	d->token = ++last_deferred_token;
+	d->batch = batch;
+	deferred_batches = lappend(deferred_batches, d);
+
+	MemoryContextSwitchTo(old);
+
+	return d->token;
+}
+
+/*
+ * InsertBatchWaitOrDefer
+ *
+ * Wait for the given batch to be acked, unless acks are deferred for this session
+ */
+void
+InsertBatchWaitOrDefer(InsertBatch *batch, int num_tuples)
+{
+	if (stream_insert_deferred_ack)
+		InsertBatchDefer(batch, num_tuples);
+	else
+		InsertBatchWaitAndRemove(batch, num_tuples);
+}
+
+/*
+ * InsertBatchLastToken
+ *
+ * Returns the token of the last batch deferred by this backend, or 0 if there isn't one
+ */
+uint64
+InsertBatchLastToken(void)
+{
+	return last_deferred_token;
+}
+
+/*
+ * InsertBatchTokenAcked
+ */
+bool
+InsertBatchTokenAcked(uint64 token)
+{
+	if (token > last_deferred_token)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("stream insert token " UINT64_FORMAT " has not been issued by this session", token)));
+
+	reap_deferred_batches();
+
+	if (deferred_batches == NIL)
+		return true;
+
+	return ((DeferredInsertBatch *) linitial(deferred_batches))->token > token;
+}
+
+/*
+ * InsertBatchWaitForToken
+ */
+void
+InsertBatchWaitForToken(uint64 token)
+{
+	while (!InsertBatchTokenAcked(token))
+		wait_for_ack();
 }
 
 void
@@ -344,13 +900,28 @@ InsertBatchIncrementNumWTuples(InsertBatch *batch, int n)
 void
 InsertBatchAckTuple(InsertBatchAck *ack)
 {
+	Latch *latch;
+
 	if (ack->batch_id != ack->batch->id)
 		return;
 
+	/* the inserter may free the batch as soon as our ack completes it */
+	latch = ack->batch->latch;
+
 	if (IsContQueryWorkerProcess())
 		pg_atomic_fetch_add_u32(&ack->batch->num_wacks, 1);
 	else if (IsContQueryCombinerProcess())
 		pg_atomic_fetch_add_u32(&ack->batch->num_cacks, 1);
+	else
+		return;
+
+	/*
+	 * Wake the inserter as soon as the final ack is in rather than letting it poll. The batch can't
+	 * be looked at anymore to tell whether ours was the final ack, so every ack sets the latch and the
+	 * inserter checks for itself.
+	 */
+	if (latch)
+		SetLatch(latch);
 }
 
 /*
@@ -407,6 +978,7 @@ InsertBatchAckCreate(List *sts, int *nacksptr)
 		InsertBatchAck *ack = lfirst(lc);
 		acks[i].batch_id = ack->batch_id;
 		acks[i].batch = ack->batch;
+		acks[i].client_batch_id = ack->client_batch_id;
 		i++;
 	}
 
@@ -416,6 +988,26 @@ InsertBatchAckCreate(List *sts, int *nacksptr)
 	return acks;
 }
 
+/*
+ * batch_context_create
+ *
+ * Creates a context for data that lives until the end of a batch or of a query's execution on it.
+ * Such data is mostly allocated piecemeal and released all at once, which is what Arenas are for.
+ */
+static MemoryContext
+batch_context_create(MemoryContext parent, const char *name)
+{
+	if (continuous_query_batch_arena)
+		return ArenaContextCreate(parent, name,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+
+	return AllocSetContextCreate(parent, name,
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+}
+
 ContExecutor *
 ContExecutorNew(ContQueryProcType type, ContQueryStateInit initfn)
 {
@@ -433,20 +1025,54 @@ ContExecutorNew(ContQueryProcType type, ContQueryStateInit initfn)
 
 	exec = palloc0(sizeof(ContExecutor));
 	exec->cxt = cxt;
-	exec->exec_cxt = AllocSetContextCreate(cxt, "ContExecutor Exec Context",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
+	exec->exec_cxt = batch_context_create(cxt, "ContExecutor Exec Context");
 
 	exec->ptype = type;
 	exec->current_query_id = InvalidOid;
 	exec->initfn = initfn;
+	exec->batch_size = GetContQueryRunParams()->batch_size;
+	exec->max_wait = GetContQueryRunParams()->max_wait;
 
 	if (exec->ptype == Worker)
 	{
-		exec->ipcmq = ipc_multi_queue_init(acquire_my_broker_ipc_queue(), acquire_my_ipc_queue());
-		ipc_multi_queue_set_priority_queue(exec->ipcmq, 0);
+		ipc_queue *queues[2];
+
+		queues[0] = acquire_my_broker_ipc_queue();
+		queues[1] = acquire_my_ipc_queue();
+		exec->ipcmq = ipc_multi_queue_init(queues, 2);
+
+		/*
+		 * The broker queue carries continuous transform output and is drained first unless it has been
+		 * given a weight, in which case it's read in proportion to that weight relative to the insert queue.
+		 */
+		if (continuous_query_transform_queue_weight > 0)
+			ipc_multi_queue_set_weight(exec->ipcmq, 0, continuous_query_transform_queue_weight);
+		else
+			ipc_multi_queue_set_priority_queue(exec->ipcmq, 0);
+
 		ipc_multi_queue_unpeek_all(exec->ipcmq);
+
+		if (GetDatabaseNumWorkers() > 1)
+		{
+			int first;
+			int nworkers;
+			int i;
+
+			/* we only steal from workers in our own pool, so that views pinned to a pool stay on it */
+			GetWorkerPoolWorkers(GetWorkerPoolForWorker(MyContQueryProc->group_id), &first, &nworkers);
+
+			exec->peers = palloc0(sizeof(ipc_queue *) * nworkers);
+			for (i = first; i < first + nworkers; i++)
+			{
+				if (i != MyContQueryProc->group_id)
+					exec->peers[exec->npeers++] = acquire_worker_ipc_queue(i);
+			}
+
+			exec->steal_cxt = AllocSetContextCreate(cxt, "ContExecutor Steal Context",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+		}
 	}
 	else
 	{
@@ -458,20 +1084,187 @@ ContExecutorNew(ContQueryProcType type, ContQueryStateInit initfn)
 	exec->max_msgs = continuous_query_batch_size;
 	exec->num_msgs = 0;
 
-	MemoryContextSwitchTo(old);
+	MemoryContextSwitchTo(old);
+
+	return exec;
+}
+
+/*
+ * steal_before
+ *
+ * Events inserted before this time have been waiting in their worker's queue for longer than a batch
+ * should take, so they're fair game for other workers
+ */
+static TimestampTz
+steal_before(void)
+{
+	return TimestampTzPlusMilliseconds(GetCurrentTimestamp(), -continuous_query_max_wait);
+}
+
+static bool
+can_steal(ContExecutor *exec)
+{
+	return continuous_query_work_stealing && exec->npeers > 0;
+}
+
+/*
+ * peers_have_stealable
+ */
+static bool
+peers_have_stealable(ContExecutor *exec)
+{
+	TimestampTz before = steal_before();
+	int i;
+
+	for (i = 0; i < exec->npeers; i++)
+	{
+		if (ipc_queue_has_stealable(exec->peers[i], before))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * steal_next
+ *
+ * Steals the next unread event from the first busy peer found, starting after the last peer stolen from
+ */
+static void *
+steal_next(ContExecutor *exec, int *len)
+{
+	TimestampTz before = steal_before();
+	int i;
+
+	for (i = 0; i < exec->npeers; i++)
+	{
+		ipc_queue *ipcq = exec->peers[exec->steal_idx];
+		MemoryContext old = MemoryContextSwitchTo(exec->steal_cxt);
+		void *ptr = ipc_queue_steal_next(ipcq, len, before);
+
+		if (ptr)
+		{
+			StolenMessage *msg = palloc(sizeof(StolenMessage));
+
+			msg->ipcq = ipcq;
+			msg->msg = ptr;
+			msg->len = *len;
+			exec->stolen_msgs = lappend(exec->stolen_msgs, msg);
+		}
+
+		MemoryContextSwitchTo(old);
+
+		if (ptr)
+			return ptr;
+
+		exec->steal_idx = (exec->steal_idx + 1) % exec->npeers;
+	}
+
+	return NULL;
+}
+
+/*
+ * pop_stolen
+ *
+ * The queues stolen events came from skip over them when popping, so we ack them ourselves
+ */
+static void
+pop_stolen(ContExecutor *exec)
+{
+	ListCell *lc;
+
+	if (exec->stolen_msgs == NIL)
+		return;
+
+	foreach(lc, exec->stolen_msgs)
+	{
+		StolenMessage *msg = (StolenMessage *) lfirst(lc);
+
+		if (msg->ipcq->pop_fn)
+			msg->ipcq->pop_fn(msg->msg, msg->len);
+	}
+
+	exec->stolen_msgs = NIL;
+	MemoryContextReset(exec->steal_cxt);
+}
+
+void
+ContExecutorDestroy(ContExecutor *exec)
+{
+	if (exec->ptype == Worker)
+	{
+		ipc_multi_queue_pop_peeked(exec->ipcmq);
+		pop_stolen(exec);
+	}
+	else
+		ipc_queue_pop_peeked(exec->ipcq);
+
+	MemoryContextDelete(exec->cxt);
+}
+
+/*
+ * set_batch_params
+ *
+ * Sets the batch size and maximum wait of the next batch. The configured values are ceilings for the
+ * adaptive ones, so lowering them at runtime takes effect immediately.
+ */
+static void
+set_batch_params(ContExecutor *exec)
+{
+	ContQueryRunParams *params = GetContQueryRunParams();
+
+	if (!continuous_query_adaptive_batching || exec->batch_size == 0)
+	{
+		exec->batch_size = params->batch_size;
+		exec->max_wait = params->max_wait;
+		exec->latency = 0;
+		return;
+	}
 
-	return exec;
+	exec->batch_size = Min(exec->batch_size, params->batch_size);
+	exec->max_wait = Min(exec->max_wait, params->max_wait);
 }
 
-void
-ContExecutorDestroy(ContExecutor *exec)
+/*
+ * adapt_batch_params
+ *
+ * Adapts the batch size and maximum wait to the load seen by the batch that just ended. Filled batches
+ * mean there is a backlog, so batches are grown to amortize per-batch costs, and mostly empty ones mean
+ * the queues are shallow, so they're shrunk. Independently, the maximum wait is cut while batches take
+ * longer than this process type's share of continuous_query_latency_target, measured from the insertion
+ * of their oldest event into our queue, and let grow back while they're well within it.
+ *
+ * Workers and combiners each get half the target, and each process adapts to its own load.
+ */
+static void
+adapt_batch_params(ContExecutor *exec)
 {
-	if (exec->ptype == Worker)
-		ipc_multi_queue_pop_peeked(exec->ipcmq);
+	ContQueryRunParams *params = GetContQueryRunParams();
+	double target = continuous_query_latency_target / 2.0;
+	long secs;
+	int usecs;
+	double latency;
+
+	if (!continuous_query_adaptive_batching || exec->num_msgs == 0 || !exec->oldest_insert)
+		return;
+
+	TimestampDifference(exec->oldest_insert, GetCurrentTimestamp(), &secs, &usecs);
+	latency = secs * 1000.0 + usecs / 1000.0;
+
+	if (exec->latency == 0)
+		exec->latency = latency;
 	else
-		ipc_queue_pop_peeked(exec->ipcq);
+		exec->latency = LATENCY_DECAY * latency + (1 - LATENCY_DECAY) * exec->latency;
 
-	MemoryContextDelete(exec->cxt);
+	if (exec->batch_filled)
+		exec->batch_size = Min((int64) exec->batch_size * 2, params->batch_size);
+	else if (exec->num_msgs < exec->batch_size / 4)
+		exec->batch_size = Max(exec->batch_size / 2, Min(MIN_ADAPTIVE_BATCH_SIZE, params->batch_size));
+
+	if (exec->latency > target)
+		exec->max_wait = Max(exec->max_wait / 2, 1);
+	else if (exec->latency < target / 2)
+		exec->max_wait = Min(exec->max_wait + Max(exec->max_wait / 4, 1), params->max_wait);
 }
 
 void
@@ -479,13 +1272,32 @@ ContExecutorStartBatch(ContExecutor *exec, int timeout)
 {
 	bool is_empty;
 
+	set_batch_params(exec);
+
 	if (exec->ptype == Worker)
+	{
 		is_empty = ipc_multi_queue_is_empty(exec->ipcmq);
+
+		/* If we're idle but other workers have a backlog, help them out */
+		if (is_empty && can_steal(exec))
+		{
+			is_empty = !peers_have_stealable(exec);
+
+			/* peers' backlogs don't wake us up, so poll for them */
+			if (is_empty && (timeout <= 0 || timeout > continuous_query_max_wait))
+				timeout = continuous_query_max_wait;
+		}
+	}
 	else
 		is_empty = ipc_queue_is_empty(exec->ipcq);
 
-	if (is_empty)
+	/* the scheduler scales combiners by how long they go with and without a backlog */
+	if (!is_empty)
+		MyContQueryProc->last_busy = GetCurrentTimestamp();
+	else
 	{
+		MyContQueryProc->last_idle = GetCurrentTimestamp();
+
 		if (!IsTransactionState())
 		{
 			char *proc_name = GetContQueryProcName(MyContQueryProc);
@@ -537,6 +1349,8 @@ ContExecutorStartBatch(ContExecutor *exec, int timeout)
 	exec->update_queries = true;
 
 	pgstat_start_cq(MyProcStatCQEntry);
+
+	TRACE_POSTGRESQL_CQ_BATCH_START((int) exec->ptype, MyContQueryProc->group_id);
 }
 
 static ContQueryState *
@@ -555,10 +1369,7 @@ init_query_state(ContExecutor *exec, ContQueryState *state)
 	state->query_id = exec->current_query_id;
 	state->state_cxt = state_cxt;
 	state->query = GetContQueryForId(exec->current_query_id);
-	state->tmp_cxt = AllocSetContextCreate(state_cxt, "QueryStateTmpCxt",
-			ALLOCSET_DEFAULT_MINSIZE,
-			ALLOCSET_DEFAULT_INITSIZE,
-			ALLOCSET_DEFAULT_MAXSIZE);
+	state->tmp_cxt = batch_context_create(state_cxt, "QueryStateTmpCxt");
 
 	if (state->query == NULL)
 		return state;
@@ -574,7 +1385,7 @@ init_query_state(ContExecutor *exec, ContQueryState *state)
 static ContQueryState *
 get_query_state(ContExecutor *exec)
 {
-	ContQueryState *state = exec->states[exec->current_query_id];
+	ContQueryState *state = ContExecutorGetState(exec, exec->current_query_id);
 	HeapTuple tup;
 	bool commit = false;
 
@@ -606,13 +1417,29 @@ get_query_state(ContExecutor *exec)
 		if (HeapTupleGetOid(tup) != state->query->oid)
 		{
 			MemoryContextDelete(state->state_cxt);
-			exec->states[exec->current_query_id] = NULL;
+			ContExecutorSetState(exec, exec->current_query_id, NULL);
 			state = NULL;
 		}
 		else
 		{
 			Form_pipeline_query row = (Form_pipeline_query) GETSTRUCT(tup);
 			state->query->active = row->active;
+
+			/*
+			 * The step size of a sliding-window view may change while it's running. Plans are built
+			 * from the query, so workers and combiners only need to take care of anything they've
+			 * derived from the old step size.
+			 */
+			if (state->query->is_sw)
+			{
+				state->query->sw_step_auto = row->step_auto;
+
+				if (row->step_factor != state->query->sw_step_factor)
+				{
+					state->query->sw_step_factor = row->step_factor;
+					state->query->sw_step_ms = (int) (state->query->sw_interval_ms * row->step_factor / 100.0);
+				}
+			}
 		}
 	}
 
@@ -623,7 +1450,7 @@ get_query_state(ContExecutor *exec)
 		MemoryContext old_cxt = MemoryContextSwitchTo(exec->cxt);
 		state = palloc0(sizeof(ContQueryState));
 		state = init_query_state(exec, state);
-		exec->states[exec->current_query_id] = state;
+		ContExecutorSetState(exec, exec->current_query_id, state);
 		MemoryContextSwitchTo(old_cxt);
 
 		if (state->query == NULL)
@@ -644,6 +1471,28 @@ get_query_state(ContExecutor *exec)
 	return state;
 }
 
+/*
+ * ContExecutorWarmQuery
+ *
+ * Build the state of the given query ahead of the first batch that reads it, so that a process that
+ * just started doesn't have to build all of its states while input is piling up. Must be called in
+ * a transaction. Returns NULL if the query doesn't exist anymore.
+ */
+ContQueryState *
+ContExecutorWarmQuery(ContExecutor *exec, Oid id)
+{
+	ContQueryState *state;
+
+	exec->current_query_id = id;
+	state = get_query_state(exec);
+
+	exec->current_query_id = InvalidOid;
+	exec->current_query = NULL;
+	MyStatCQEntry = NULL;
+
+	return state;
+}
+
 Oid
 ContExecutorStartNextQuery(ContExecutor *exec, int timeout)
 {
@@ -696,6 +1545,10 @@ ContExecutorStartNextQuery(ContExecutor *exec, int timeout)
 	{
 		MyStatCQEntry = (PgStat_StatCQEntry *) &exec->current_query->stats;
 		pgstat_start_cq(MyStatCQEntry);
+		exec->query_start = GetCurrentTimestamp();
+		exec->query_msgs = 0;
+
+		TRACE_POSTGRESQL_CQ_QUERY_START(exec->current_query_id);
 	}
 
 	return exec->current_query_id;
@@ -705,14 +1558,14 @@ void
 ContExecutorPurgeQuery(ContExecutor *exec)
 {
 	MemoryContext old = MemoryContextSwitchTo(exec->cxt);
-	ContQueryState *state = exec->states[exec->current_query_id];
+	ContQueryState *state = ContExecutorGetState(exec, exec->current_query_id);
 
 	exec->queries = bms_del_member(exec->queries, exec->current_query_id);
 
 	if (state)
 	{
 		MemoryContextDelete(state->state_cxt);
-		exec->states[exec->current_query_id] = NULL;
+		ContExecutorSetState(exec, exec->current_query_id, NULL);
 	}
 
 	exec->current_query = NULL;
@@ -720,6 +1573,83 @@ ContExecutorPurgeQuery(ContExecutor *exec)
 	MemoryContextSwitchTo(old);
 }
 
+/*
+ * ContExecutorGetState
+ *
+ * Returns the state of the given query, or NULL if there isn't one
+ */
+ContQueryState *
+ContExecutorGetState(ContExecutor *exec, Oid id)
+{
+	ContQueryStateEntry *entry;
+
+	if (exec->states == NULL)
+		return NULL;
+
+	entry = (ContQueryStateEntry *) hash_search(exec->states, &id, HASH_FIND, NULL);
+
+	return entry ? entry->state : NULL;
+}
+
+/*
+ * ContExecutorSetState
+ *
+ * Sets the state of the given query, or removes it if state is NULL. Query states are kept in a
+ * hash table rather than an array indexed by id, so that a process only pays for the queries it
+ * actually runs, however high their ids get.
+ */
+void
+ContExecutorSetState(ContExecutor *exec, Oid id, ContQueryState *state)
+{
+	ContQueryStateEntry *entry;
+
+	if (state == NULL)
+	{
+		if (exec->states)
+			hash_search(exec->states, &id, HASH_REMOVE, NULL);
+		return;
+	}
+
+	if (exec->states == NULL)
+	{
+		HASHCTL ctl;
+
+		MemSet(&ctl, 0, sizeof(HASHCTL));
+
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(ContQueryStateEntry);
+		ctl.hcxt = exec->cxt;
+
+		exec->states = hash_create("ContQueryStates", 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	entry = (ContQueryStateEntry *) hash_search(exec->states, &id, HASH_ENTER, NULL);
+	entry->state = state;
+}
+
+/*
+ * ContExecutorGetStates
+ *
+ * Returns a list of the states of all queries, in the current memory context. Errors raised
+ * while going through it won't leave a scan of the states table open.
+ */
+List *
+ContExecutorGetStates(ContExecutor *exec)
+{
+	HASH_SEQ_STATUS status;
+	ContQueryStateEntry *entry;
+	List *result = NIL;
+
+	if (exec->states == NULL)
+		return NIL;
+
+	hash_seq_init(&status, exec->states);
+	while ((entry = (ContQueryStateEntry *) hash_seq_search(&status)) != NULL)
+		result = lappend(result, entry->state);
+
+	return result;
+}
+
 static inline bool
 should_yield_item(ContExecutor *exec, void *ptr)
 {
@@ -744,40 +1674,176 @@ should_yield_item(ContExecutor *exec, void *ptr)
 	}
 }
 
+/*
+ * index_msg
+ *
+ * Add the peeked message at the given offset to the message index entries of the queries it's for
+ */
+static void
+index_msg(ContExecutor *exec, int offset)
+{
+	void *ptr = exec->peeked_msgs[offset].msg;
+	int id = -1;
+
+	for (;;)
+	{
+		ContQueryMsgIndexEntry *entry;
+		bool found;
+
+		if (exec->ptype == Worker)
+		{
+			id = bms_next_member(((StreamTupleState *) ptr)->queries, id);
+			if (id < 0)
+				break;
+		}
+		else if (id < 0)
+			id = ((PartialTupleState *) ptr)->query_id;
+		else
+			break;
+
+		entry = (ContQueryMsgIndexEntry *) hash_search(exec->msg_index, &id, HASH_ENTER, &found);
+
+		if (!found)
+		{
+			entry->max = 16;
+			entry->offsets = MemoryContextAlloc(exec->exec_cxt, sizeof(int) * entry->max);
+			entry->n = 0;
+		}
+		else if (entry->n == entry->max)
+		{
+			entry->max *= 2;
+			entry->offsets = repalloc(entry->offsets, sizeof(int) * entry->max);
+		}
+
+		entry->offsets[entry->n++] = offset;
+
+		if (exec->ptype != Worker)
+			break;
+	}
+}
+
+/*
+ * build_msg_index
+ *
+ * Index the batch's messages by the queries they're for, once all of them have been peeked. With many
+ * queries reading different streams, each one then only goes through its own messages rather than
+ * testing every message of the batch.
+ */
+static void
+build_msg_index(ContExecutor *exec)
+{
+	HASHCTL ctl;
+	int i;
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(ContQueryMsgIndexEntry);
+	ctl.hcxt = exec->exec_cxt;
+
+	exec->msg_index = hash_create("ContExecutorMsgIndex", 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	for (i = 0; i < exec->num_msgs; i++)
+		index_msg(exec, i);
+}
+
+/*
+ * unpack_batched_state
+ *
+ * Append one message per tuple of a batched StreamTupleState to the peeked messages. Each message is a
+ * local copy of the batch's header pointing to one of the batch's tuples, or to one of its rows for
+ * columnar batches, so the rest of the execution code never needs to know about batched slots. Returns the first unpacked message, which is consumed.
+ */
+static StreamTupleState *
+unpack_batched_state(ContExecutor *exec, StreamTupleState *batch, int len)
+{
+	MemoryContext old = MemoryContextSwitchTo(exec->exec_cxt);
+	StreamTupleState *sts = palloc(sizeof(StreamTupleState) * batch->ntups);
+	char *pos = (char *) batch->tup;
+	int i;
+
+	for (i = 0; i < batch->ntups; i++)
+	{
+		memcpy(&sts[i], batch, sizeof(StreamTupleState));
+		sts[i].ntups = 1;
+
+		if (batch->columns)
+		{
+			sts[i].tup = NULL;
+			sts[i].row = i;
+		}
+		else
+		{
+			sts[i].tup = (HeapTuple) pos;
+			pos += HEAPTUPLESIZE + sts[i].tup->t_len;
+		}
+
+		exec->peeked_msgs[exec->num_msgs].msg = &sts[i];
+		exec->peeked_msgs[exec->num_msgs].len = len / batch->ntups;
+		exec->num_msgs++;
+	}
+
+	exec->curr_msg++;
+
+	MemoryContextSwitchTo(old);
+
+	return &sts[0];
+}
+
 void *
 ContExecutorYieldNextMessage(ContExecutor *exec, int *len)
 {
-	static ContQueryRunParams *params = NULL;
-
 	/* We've yielded all items belonging to the CQ in this batch? */
 	if (exec->depleted)
 		return NULL;
 
 	if (exec->peek_timedout)
 	{
+		ContQueryMsgIndexEntry *entry;
+
 		if (exec->num_msgs == 0)
 		{
 			exec->depleted = true;
 			return NULL;
 		}
 
+		if (exec->msg_index == NULL)
+			build_msg_index(exec);
+
+		if (exec->query_msg_index == NULL)
+		{
+			exec->query_msg_index = (ContQueryMsgIndexEntry *) hash_search(exec->msg_index,
+					&exec->current_query_id, HASH_FIND, NULL);
+
+			if (exec->query_msg_index == NULL)
+			{
+				exec->depleted = true;
+				return NULL;
+			}
+		}
+
+		entry = exec->query_msg_index;
+
 		for (;;)
 		{
 			void *ptr;
 			int mlen;
+			int offset;
 
 			if (exec->depleted)
 				return NULL;
 
-			ptr = exec->peeked_msgs[exec->curr_msg].msg;
-			mlen = exec->peeked_msgs[exec->curr_msg].len;
+			offset = entry->offsets[exec->curr_msg];
+			ptr = exec->peeked_msgs[offset].msg;
+			mlen = exec->peeked_msgs[offset].len;
 			exec->curr_msg++;
 
-			if (exec->curr_msg == exec->num_msgs)
+			if (exec->curr_msg == entry->n)
 				exec->depleted = true;
 
 			if (should_yield_item(exec, ptr))
 			{
+				exec->query_msgs++;
 				*len = mlen;
 				return ptr;
 			}
@@ -790,41 +1856,73 @@ ContExecutorYieldNextMessage(ContExecutor *exec, int *len)
 		exec->peek_start = GetCurrentTimestamp();
 	}
 
-	if (!params)
-		params = GetContQueryRunParams();
-
 	for (;;)
 	{
 		void *ptr;
 		int mlen;
 
+		/* Yield any remaining tuples unpacked from the last batched slot first */
+		if (exec->curr_msg < exec->num_msgs)
+		{
+			ptr = exec->peeked_msgs[exec->curr_msg].msg;
+			mlen = exec->peeked_msgs[exec->curr_msg].len;
+			exec->curr_msg++;
+
+			if (should_yield_item(exec, ptr))
+			{
+				exec->query_msgs++;
+				*len = mlen;
+				return ptr;
+			}
+
+			continue;
+		}
+
 		/* We've read a full batch or waited long enough? */
-		if (exec->num_msgs == params->batch_size ||
-				TimestampDifferenceExceeds(exec->peek_start, GetCurrentTimestamp(), params->max_wait) ||
+		if (exec->num_msgs >= exec->batch_size ||
+				TimestampDifferenceExceeds(exec->peek_start, GetCurrentTimestamp(), exec->max_wait) ||
 				MyContQueryProc->db_meta->terminate)
 		{
+			exec->batch_filled = exec->num_msgs >= exec->batch_size;
 			exec->peek_timedout = true;
 			exec->depleted = true;
 			return NULL;
 		}
 
 		if (exec->ptype == Worker)
+		{
 			ptr = ipc_multi_queue_peek_next(exec->ipcmq, &mlen);
+
+			if (ptr == NULL && can_steal(exec))
+				ptr = steal_next(exec, &mlen);
+		}
 		else
 			ptr = ipc_queue_peek_next(exec->ipcq, &mlen);
 
 		if (ptr)
 		{
 			MemoryContext old;
+			int nmsgs = 1;
+			TimestampTz inserted = ipc_queue_last_read_time();
 
-			exec->peeked_msgs[exec->curr_msg].msg = ptr;
-			exec->peeked_msgs[exec->curr_msg].len = mlen;
+			pgstat_report_cq_latency(exec->ptype == Worker ? CQ_LATENCY_WORKER_QUEUE : CQ_LATENCY_COMBINER_QUEUE,
+					inserted);
+			if (!exec->oldest_insert || inserted < exec->oldest_insert)
+				exec->oldest_insert = inserted;
 
-			exec->curr_msg++;
-			exec->num_msgs++;
+			if (exec->ptype == Worker && ((StreamTupleState *) ptr)->ntups > 1)
+				nmsgs = ((StreamTupleState *) ptr)->ntups;
+
+			if (exec->ptype == Worker && ((StreamTupleState *) ptr)->arrival_time > exec->newest_arrival)
+				exec->newest_arrival = ((StreamTupleState *) ptr)->arrival_time;
 
-			/* This can happen is continuous_query_batch_size was increased at runtime */
-			if (exec->num_msgs == exec->max_msgs)
+			TRACE_POSTGRESQL_CQ_MESSAGE_READ(mlen, nmsgs);
+
+			/*
+			 * This can happen is continuous_query_batch_size was increased at runtime, or if we peeked a
+			 * batched slot that doesn't fit in the remaining space.
+			 */
+			while (exec->num_msgs + nmsgs >= exec->max_msgs)
 			{
 				exec->max_msgs *= 2;
 				exec->peeked_msgs = repalloc(exec->peeked_msgs, sizeof(ipc_message) * exec->max_msgs);
@@ -832,6 +1930,20 @@ ContExecutorYieldNextMessage(ContExecutor *exec, int *len)
 
 			exec->nbytes += mlen;
 
+			if (nmsgs > 1)
+			{
+				ptr = unpack_batched_state(exec, (StreamTupleState *) ptr, mlen);
+				mlen /= nmsgs;
+			}
+			else
+			{
+				exec->peeked_msgs[exec->curr_msg].msg = ptr;
+				exec->peeked_msgs[exec->curr_msg].len = mlen;
+
+				exec->curr_msg++;
+				exec->num_msgs++;
+			}
+
 			old = MemoryContextSwitchTo(exec->exec_cxt);
 
 			if (exec->ptype == Worker)
@@ -849,6 +1961,7 @@ ContExecutorYieldNextMessage(ContExecutor *exec, int *len)
 
 			if (should_yield_item(exec, ptr))
 			{
+				exec->query_msgs++;
 				*len = mlen;
 				return ptr;
 			}
@@ -858,11 +1971,134 @@ ContExecutorYieldNextMessage(ContExecutor *exec, int *len)
 	}
 }
 
+/*
+ * ContExecutorSameMessages
+ *
+ * Are the given queries for exactly the same messages of the current batch? Until the batch has been
+ * read in full, that's only known for the messages peeked so far.
+ */
+bool
+ContExecutorSameMessages(ContExecutor *exec, Oid a, Oid b)
+{
+	ContQueryMsgIndexEntry *ea;
+	ContQueryMsgIndexEntry *eb;
+
+	/* the index only covers a batch that has been read in full */
+	if (!exec->peek_timedout)
+	{
+		int i;
+
+		Assert(exec->ptype == Worker);
+
+		for (i = 0; i < exec->num_msgs; i++)
+		{
+			StreamTupleState *sts = (StreamTupleState *) exec->peeked_msgs[i].msg;
+
+			if (bms_is_member(a, sts->queries) != bms_is_member(b, sts->queries))
+				return false;
+		}
+
+		return true;
+	}
+
+	if (exec->msg_index == NULL)
+		build_msg_index(exec);
+
+	ea = (ContQueryMsgIndexEntry *) hash_search(exec->msg_index, &a, HASH_FIND, NULL);
+	eb = (ContQueryMsgIndexEntry *) hash_search(exec->msg_index, &b, HASH_FIND, NULL);
+
+	if (ea == NULL || eb == NULL)
+		return ea == eb;
+
+	return ea->n == eb->n && memcmp(ea->offsets, eb->offsets, sizeof(int) * ea->n) == 0;
+}
+
+/*
+ * ContExecutorCanFuse
+ *
+ * Can events for the given queries be handed directly to them within the current batch? That's only the
+ * case once the batch has been read in full, and as long as none of them have executed in it yet, since
+ * each query reads all of its events in a single pass over the batch.
+ */
+bool
+ContExecutorCanFuse(ContExecutor *exec, Bitmapset *queries)
+{
+	if (exec->ptype != Worker || !exec->peek_timedout || bms_is_empty(queries))
+		return false;
+
+	return bms_is_subset(queries, exec->exec_queries);
+}
+
+/*
+ * ContExecutorFuseTuples
+ *
+ * Append the given tuples to the current batch as if they had been read from the worker's queue, each one
+ * for its own set of queries. The tuples, queries and packed_desc must live as long as the batch does. The
+ * tuples are acked once the batch ends, like the events popped from the queues.
+ */
+void
+ContExecutorFuseTuples(ContExecutor *exec, Oid relid, bytea *packed_desc, HeapTuple *tups, Bitmapset **queries, int ntups,
+		InsertBatchAck *acks, int nacks)
+{
+	MemoryContext old = MemoryContextSwitchTo(exec->exec_cxt);
+	StreamTupleState *batch = palloc0(sizeof(StreamTupleState));
+	StreamTupleState *sts = palloc(sizeof(StreamTupleState) * ntups);
+	int i;
+
+	Assert(ContExecutorCanFuse(exec, queries[0]));
+
+	batch->arrival_time = GetCurrentTimestamp();
+	batch->relid = relid;
+	batch->desc = packed_desc;
+	batch->ntups = ntups;
+
+	if (acks)
+	{
+		batch->acks = palloc(sizeof(InsertBatchAck) * nacks);
+		memcpy(batch->acks, acks, sizeof(InsertBatchAck) * nacks);
+		batch->nacks = nacks;
+	}
+
+	while (exec->num_msgs + ntups >= exec->max_msgs)
+	{
+		exec->max_msgs *= 2;
+		exec->peeked_msgs = repalloc(exec->peeked_msgs, sizeof(ipc_message) * exec->max_msgs);
+	}
+
+	for (i = 0; i < ntups; i++)
+	{
+		memcpy(&sts[i], batch, sizeof(StreamTupleState));
+		sts[i].ntups = 1;
+		sts[i].tup = tups[i];
+		sts[i].queries = queries[i];
+
+		exec->peeked_msgs[exec->num_msgs].msg = &sts[i];
+		exec->peeked_msgs[exec->num_msgs].len = HEAPTUPLESIZE + tups[i]->t_len;
+
+		if (exec->msg_index)
+			index_msg(exec, exec->num_msgs);
+
+		exec->num_msgs++;
+
+		exec->queries_seen = bms_add_members(exec->queries_seen, queries[i]);
+	}
+
+	if (batch->arrival_time > exec->newest_arrival)
+		exec->newest_arrival = batch->arrival_time;
+
+	exec->fused_msgs = lappend(exec->fused_msgs, batch);
+
+	MemoryContextSwitchTo(old);
+}
+
 void
 ContExecutorEndQuery(ContExecutor *exec)
 {
 	pgstat_increment_cq_exec(1);
 
+	if (exec->current_query)
+		TRACE_POSTGRESQL_CQ_QUERY_DONE(exec->current_query_id, exec->query_msgs);
+
 	if (!exec->peeked_any)
 		return;
 
@@ -882,6 +2118,7 @@ ContExecutorEndQuery(ContExecutor *exec)
 
 	exec->current_query_id = InvalidOid;
 	exec->curr_msg = 0;
+	exec->query_msg_index = NULL;
 	exec->depleted = false;
 
 	list_free(exec->yielded_msgs);
@@ -889,6 +2126,9 @@ ContExecutorEndQuery(ContExecutor *exec)
 
 	if (exec->current_query)
 	{
+		if (exec->ptype == Worker)
+			pgstat_report_cq_latency(CQ_LATENCY_WORKER_EXEC, exec->query_start);
+
 		pgstat_end_cq(MyStatCQEntry);
 		if (IsContQueryWorkerProcess())
 			pgstat_report_cqstat(false);
@@ -902,6 +2142,8 @@ ContExecutorEndQuery(ContExecutor *exec)
 void
 ContExecutorEndBatch(ContExecutor *exec, bool commit)
 {
+	ListCell *lc;
+
 	Assert(IsTransactionState());
 
 	if (commit)
@@ -909,12 +2151,24 @@ ContExecutorEndBatch(ContExecutor *exec, bool commit)
 
 	pgstat_end_cq_batch(MyProcStatCQEntry, exec->num_msgs, exec->nbytes);
 
+	TRACE_POSTGRESQL_CQ_BATCH_DONE((int) exec->ptype, exec->num_msgs, (int) exec->nbytes);
+
+	adapt_batch_params(exec);
+
+	/* fused events never went through a queue, so we ack them here rather than when popping */
+	foreach(lc, exec->fused_msgs)
+		StreamTupleStatePopFn(lfirst(lc), 0);
+	exec->fused_msgs = NIL;
+
 	MemoryContextResetAndDeleteChildren(exec->exec_cxt);
 
 	if (exec->peeked_any)
 	{
 		if (exec->ptype == Worker)
+		{
 			ipc_multi_queue_pop_peeked(exec->ipcmq);
+			pop_stolen(exec);
+		}
 		else
 			ipc_queue_pop_peeked(exec->ipcq);
 	}
@@ -931,9 +2185,14 @@ ContExecutorEndBatch(ContExecutor *exec, bool commit)
 	exec->curr_msg = 0;
 	exec->num_msgs = 0;
 	exec->nbytes = 0;
+	exec->msg_index = NULL;
+	exec->query_msg_index = NULL;
 	exec->peeked_any = false;
 	exec->peek_timedout = false;
+	exec->batch_filled = false;
 	exec->depleted = false;
 	exec->queries_seen = NULL;
 	exec->exec_queries = NULL;
+	exec->oldest_insert = 0;
+	exec->newest_arrival = 0;
 }
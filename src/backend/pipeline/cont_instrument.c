@@ -0,0 +1,556 @@
+/*-------------------------------------------------------------------------
+ *
+ * cont_instrument.c
+ *
+ *	  Instrumentation of continuous query plans as they run
+ *
+ * Worker and combiner plans are executed once per batch by background
+ * processes, so EXPLAIN ANALYZE can't be used on them directly. Instead, a
+ * backend asks for a continuous query to be instrumented for a number of
+ * batches by taking one of the slots here. While a query has a slot, the
+ * processes that run it give each node of its plan an Instrumentation and add
+ * the node's timings and row counts to the slot after every batch. The process
+ * that completes the last batch of a plan puts the totals back into its own
+ * plan state and renders it as EXPLAIN ANALYZE would, so each node shows its
+ * per-loop averages across all processes and batches.
+ *
+ * Plans of the same query have the same shape in every process, so nodes are
+ * matched up by their position in a walk of the plan tree. Batches whose plan
+ * doesn't match the shape of the first one are ignored.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/cont_instrument.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "commands/explain.h"
+#include "executor/instrument.h"
+#include "miscadmin.h"
+#include "nodes/execnodes.h"
+#include "pipeline/cont_instrument.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+
+/* how often a backend waiting for instrumented batches checks whether they're done */
+#define WAIT_INTERVAL_MS 100
+
+typedef struct NodeTotals
+{
+	NodeTag tag;
+	double startup;
+	double total;
+	double ntuples;
+	double nloops;
+	double nfiltered1;
+	double nfiltered2;
+} NodeTotals;
+
+typedef struct PlanTotals
+{
+	int batches;
+	int nnodes;
+	/* set once a process has taken it upon itself to render the plan */
+	bool claimed;
+	bool done;
+	NodeTotals nodes[CONT_INSTRUMENT_MAX_NODES];
+	char text[CONT_INSTRUMENT_TEXT_SIZE];
+} PlanTotals;
+
+typedef struct InstrumentSlot
+{
+	bool used;
+	/* distinguishes successive uses of the same slot */
+	uint32 serial;
+	Oid dbid;
+	Oid query_id;
+	int batches;
+	/* indexed by ContQueryProcType */
+	PlanTotals plans[Worker + 1];
+} InstrumentSlot;
+
+typedef struct ContInstrumentShared
+{
+	slock_t mutex;
+	/* number of used slots, so that processes can skip looking for one in the common case */
+	pg_atomic_uint32 nactive;
+	uint32 serial;
+	InstrumentSlot slots[CONT_INSTRUMENT_SLOTS];
+} ContInstrumentShared;
+
+static ContInstrumentShared *instr_shared = NULL;
+
+typedef void (*plan_node_fn) (PlanState *planstate, int i, void *arg);
+
+/*
+ * ContInstrumentShmemSize
+ */
+Size
+ContInstrumentShmemSize(void)
+{
+	return MAXALIGN(sizeof(ContInstrumentShared));
+}
+
+/*
+ * ContInstrumentShmemInit
+ */
+void
+ContInstrumentShmemInit(void)
+{
+	bool found;
+
+	instr_shared = ShmemInitStruct("ContInstrument", ContInstrumentShmemSize(), &found);
+
+	if (!found)
+	{
+		MemSet(instr_shared, 0, ContInstrumentShmemSize());
+		SpinLockInit(&instr_shared->mutex);
+		pg_atomic_init_u32(&instr_shared->nactive, 0);
+	}
+}
+
+static int walk_plan(PlanState *planstate, int i, plan_node_fn fn, void *arg);
+
+/*
+ * walk_members
+ */
+static int
+walk_members(PlanState **planstates, int n, int i, plan_node_fn fn, void *arg)
+{
+	int j;
+
+	for (j = 0; j < n; j++)
+		i = walk_plan(planstates[j], i, fn, arg);
+
+	return i;
+}
+
+/*
+ * walk_subplans
+ */
+static int
+walk_subplans(List *subplans, int i, plan_node_fn fn, void *arg)
+{
+	ListCell *lc;
+
+	foreach(lc, subplans)
+		i = walk_plan(((SubPlanState *) lfirst(lc))->planstate, i, fn, arg);
+
+	return i;
+}
+
+/*
+ * walk_plan
+ *
+ * Calls fn for each node of the given plan, in the order EXPLAIN shows them, along with the
+ * node's position in that order. Returns the position after the plan's last node.
+ */
+static int
+walk_plan(PlanState *planstate, int i, plan_node_fn fn, void *arg)
+{
+	ListCell *lc;
+
+	if (planstate == NULL)
+		return i;
+
+	fn(planstate, i++, arg);
+
+	i = walk_subplans(planstate->initPlan, i, fn, arg);
+	i = walk_plan(outerPlanState(planstate), i, fn, arg);
+	i = walk_plan(innerPlanState(planstate), i, fn, arg);
+
+	switch (nodeTag(planstate))
+	{
+		case T_ModifyTableState:
+			i = walk_members(((ModifyTableState *) planstate)->mt_plans,
+					((ModifyTableState *) planstate)->mt_nplans, i, fn, arg);
+			break;
+		case T_AppendState:
+			i = walk_members(((AppendState *) planstate)->appendplans,
+					((AppendState *) planstate)->as_nplans, i, fn, arg);
+			break;
+		case T_MergeAppendState:
+			i = walk_members(((MergeAppendState *) planstate)->mergeplans,
+					((MergeAppendState *) planstate)->ms_nplans, i, fn, arg);
+			break;
+		case T_BitmapAndState:
+			i = walk_members(((BitmapAndState *) planstate)->bitmapplans,
+					((BitmapAndState *) planstate)->nplans, i, fn, arg);
+			break;
+		case T_BitmapOrState:
+			i = walk_members(((BitmapOrState *) planstate)->bitmapplans,
+					((BitmapOrState *) planstate)->nplans, i, fn, arg);
+			break;
+		case T_SubqueryScanState:
+			i = walk_plan(((SubqueryScanState *) planstate)->subplan, i, fn, arg);
+			break;
+		case T_CustomScanState:
+			foreach(lc, ((CustomScanState *) planstate)->custom_ps)
+				i = walk_plan((PlanState *) lfirst(lc), i, fn, arg);
+			break;
+		default:
+			break;
+	}
+
+	i = walk_subplans(planstate->subPlan, i, fn, arg);
+
+	return i;
+}
+
+/*
+ * add_instrument
+ *
+ * The executor checks each node for an Instrumentation as it runs it, so one can be added to
+ * a plan that has already been initialized
+ */
+static void
+add_instrument(PlanState *planstate, int i, void *arg)
+{
+	MemoryContext old;
+
+	if (planstate->instrument || i >= CONT_INSTRUMENT_MAX_NODES)
+		return;
+
+	old = MemoryContextSwitchTo(planstate->state->es_query_cxt);
+	planstate->instrument = InstrAlloc(1, INSTRUMENT_TIMER | INSTRUMENT_ROWS);
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * remove_instrument
+ */
+static void
+remove_instrument(PlanState *planstate, int i, void *arg)
+{
+	if (planstate->instrument)
+	{
+		pfree(planstate->instrument);
+		planstate->instrument = NULL;
+	}
+}
+
+/*
+ * take_totals
+ *
+ * Moves a node's numbers for the batch that just ran into the given totals, so that a plan
+ * kept across batches only reports each batch once
+ */
+static void
+take_totals(PlanState *planstate, int i, void *arg)
+{
+	NodeTotals *totals = (NodeTotals *) arg;
+	Instrumentation *instr = planstate->instrument;
+
+	if (i >= CONT_INSTRUMENT_MAX_NODES)
+		return;
+
+	MemSet(&totals[i], 0, sizeof(NodeTotals));
+	totals[i].tag = nodeTag(planstate);
+
+	if (instr == NULL)
+		return;
+
+	InstrEndLoop(instr);
+
+	totals[i].startup = instr->startup;
+	totals[i].total = instr->total;
+	totals[i].ntuples = instr->ntuples;
+	totals[i].nloops = instr->nloops;
+	totals[i].nfiltered1 = instr->nfiltered1;
+	totals[i].nfiltered2 = instr->nfiltered2;
+
+	instr->startup = instr->total = instr->ntuples = instr->nloops = 0;
+	instr->nfiltered1 = instr->nfiltered2 = 0;
+}
+
+/*
+ * put_totals
+ *
+ * Replaces a node's numbers with the totals of all instrumented batches
+ */
+static void
+put_totals(PlanState *planstate, int i, void *arg)
+{
+	NodeTotals *totals = (NodeTotals *) arg;
+	Instrumentation *instr = planstate->instrument;
+
+	if (instr == NULL || i >= CONT_INSTRUMENT_MAX_NODES)
+		return;
+
+	instr->running = false;
+	instr->startup = totals[i].startup;
+	instr->total = totals[i].total;
+	instr->ntuples = totals[i].ntuples;
+	instr->nloops = totals[i].nloops;
+	instr->nfiltered1 = totals[i].nfiltered1;
+	instr->nfiltered2 = totals[i].nfiltered2;
+}
+
+/*
+ * find_slot
+ *
+ * Must be called with the mutex held
+ */
+static InstrumentSlot *
+find_slot(Oid query_id)
+{
+	int i;
+
+	for (i = 0; i < CONT_INSTRUMENT_SLOTS; i++)
+	{
+		InstrumentSlot *slot = &instr_shared->slots[i];
+
+		if (slot->used && slot->dbid == MyDatabaseId && slot->query_id == query_id)
+			return slot;
+	}
+
+	return NULL;
+}
+
+/*
+ * ContInstrumentStart
+ *
+ * Called before a continuous query's plan runs on a batch. Returns true if the plan has been
+ * instrumented for this batch, in which case ContInstrumentEnd must be called once it has run.
+ */
+bool
+ContInstrumentStart(Oid query_id, ContQueryProcType ptype, PlanState *planstate)
+{
+	InstrumentSlot *slot;
+	bool active = false;
+
+	Assert(ptype == Worker || ptype == Combiner);
+
+	if (pg_atomic_read_u32(&instr_shared->nactive) == 0 && planstate->instrument == NULL)
+		return false;
+
+	SpinLockAcquire(&instr_shared->mutex);
+	slot = find_slot(query_id);
+	if (slot && !slot->plans[ptype].claimed)
+		active = true;
+	SpinLockRelease(&instr_shared->mutex);
+
+	/* a plan kept across batches may still be instrumented from an earlier request */
+	if (!active)
+	{
+		walk_plan(planstate, 0, remove_instrument, NULL);
+		return false;
+	}
+
+	walk_plan(planstate, 0, add_instrument, NULL);
+
+	return true;
+}
+
+/*
+ * render_plan
+ */
+static char *
+render_plan(QueryDesc *query_desc, NodeTotals *totals)
+{
+	ExplainState *es = NewExplainState();
+
+	es->analyze = true;
+	es->timing = true;
+
+	walk_plan(query_desc->planstate, 0, put_totals, totals);
+
+	ExplainBeginOutput(es);
+	ExplainPrintPlan(es, query_desc);
+	ExplainEndOutput(es);
+
+	/* remove the trailing newline */
+	if (es->str->len > 0 && es->str->data[es->str->len - 1] == '\n')
+		es->str->data[--es->str->len] = '\0';
+
+	return es->str->data;
+}
+
+/*
+ * ContInstrumentEnd
+ *
+ * Called once an instrumented plan has run on a batch, and before it's ended. Adds its numbers to
+ * the query's totals, and renders the plan if this was the last batch that was asked for.
+ */
+void
+ContInstrumentEnd(Oid query_id, ContQueryProcType ptype, QueryDesc *query_desc)
+{
+	NodeTotals totals[CONT_INSTRUMENT_MAX_NODES];
+	InstrumentSlot *slot;
+	PlanTotals *plan;
+	int nnodes;
+	uint32 serial = 0;
+	bool render = false;
+	bool matches = true;
+	int i;
+
+	nnodes = walk_plan(query_desc->planstate, 0, take_totals, totals);
+	nnodes = Min(nnodes, CONT_INSTRUMENT_MAX_NODES);
+
+	SpinLockAcquire(&instr_shared->mutex);
+
+	slot = find_slot(query_id);
+	plan = slot ? &slot->plans[ptype] : NULL;
+
+	if (plan && !plan->claimed)
+	{
+		if (plan->nnodes == 0)
+		{
+			plan->nnodes = nnodes;
+			for (i = 0; i < nnodes; i++)
+				plan->nodes[i].tag = totals[i].tag;
+		}
+
+		if (plan->nnodes != nnodes)
+			matches = false;
+
+		for (i = 0; matches && i < nnodes; i++)
+			if (plan->nodes[i].tag != totals[i].tag)
+				matches = false;
+
+		for (i = 0; matches && i < nnodes; i++)
+		{
+			plan->nodes[i].startup += totals[i].startup;
+			plan->nodes[i].total += totals[i].total;
+			plan->nodes[i].ntuples += totals[i].ntuples;
+			plan->nodes[i].nloops += totals[i].nloops;
+			plan->nodes[i].nfiltered1 += totals[i].nfiltered1;
+			plan->nodes[i].nfiltered2 += totals[i].nfiltered2;
+		}
+
+		if (matches && ++plan->batches >= slot->batches)
+		{
+			plan->claimed = true;
+			memcpy(totals, plan->nodes, sizeof(NodeTotals) * nnodes);
+			serial = slot->serial;
+			render = true;
+		}
+	}
+
+	SpinLockRelease(&instr_shared->mutex);
+
+	if (render)
+	{
+		char *text = render_plan(query_desc, totals);
+
+		SpinLockAcquire(&instr_shared->mutex);
+
+		/* the backend that asked for it may have given up in the mean time */
+		slot = find_slot(query_id);
+		if (slot && slot->serial == serial)
+		{
+			strlcpy(slot->plans[ptype].text, text, CONT_INSTRUMENT_TEXT_SIZE);
+			slot->plans[ptype].done = true;
+		}
+
+		SpinLockRelease(&instr_shared->mutex);
+
+		pfree(text);
+		walk_plan(query_desc->planstate, 0, remove_instrument, NULL);
+	}
+}
+
+/*
+ * release_slot
+ */
+static void
+release_slot(int code, Datum arg)
+{
+	InstrumentSlot *slot = &instr_shared->slots[DatumGetInt32(arg)];
+
+	SpinLockAcquire(&instr_shared->mutex);
+	if (slot->used)
+	{
+		slot->used = false;
+		pg_atomic_fetch_sub_u32(&instr_shared->nactive, 1);
+	}
+	SpinLockRelease(&instr_shared->mutex);
+}
+
+/*
+ * ExplainAnalyzeContQuery
+ *
+ * Instruments the worker and combiner plans of the given continuous view for the given number of
+ * batches each, and returns their EXPLAIN ANALYZE output. This waits for as long as it takes for
+ * the view to read that many batches, so it can be canceled.
+ */
+void
+ExplainAnalyzeContQuery(ContQuery *cq, int batches, char **worker_plan, char **combiner_plan)
+{
+	InstrumentSlot *slot = NULL;
+	int idx = -1;
+	int i;
+
+	Assert(cq->type == CONT_VIEW);
+
+	SpinLockAcquire(&instr_shared->mutex);
+
+	if (find_slot(cq->id) == NULL)
+	{
+		for (i = 0; i < CONT_INSTRUMENT_SLOTS; i++)
+		{
+			if (!instr_shared->slots[i].used)
+			{
+				idx = i;
+				break;
+			}
+		}
+	}
+
+	if (idx >= 0)
+	{
+		slot = &instr_shared->slots[idx];
+		MemSet(slot, 0, sizeof(InstrumentSlot));
+		slot->used = true;
+		slot->serial = ++instr_shared->serial;
+		slot->dbid = MyDatabaseId;
+		slot->query_id = cq->id;
+		slot->batches = batches;
+		pg_atomic_fetch_add_u32(&instr_shared->nactive, 1);
+	}
+
+	SpinLockRelease(&instr_shared->mutex);
+
+	if (slot == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_IN_USE),
+				errmsg("could not instrument continuous view \"%s\"", cq->name->relname),
+				errdetail("Either it's already being instrumented or %d other continuous views are.",
+					CONT_INSTRUMENT_SLOTS)));
+
+	PG_ENSURE_ERROR_CLEANUP(release_slot, Int32GetDatum(idx));
+	{
+		for (;;)
+		{
+			bool done;
+			int rc;
+
+			SpinLockAcquire(&instr_shared->mutex);
+			done = slot->plans[Worker].done && slot->plans[Combiner].done;
+			SpinLockRelease(&instr_shared->mutex);
+
+			if (done)
+				break;
+
+			rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, WAIT_INTERVAL_MS);
+			ResetLatch(MyLatch);
+
+			if (rc & WL_POSTMASTER_DEATH)
+				proc_exit(1);
+
+			CHECK_FOR_INTERRUPTS();
+		}
+
+		/* nothing writes to the texts once they're done */
+		*worker_plan = pstrdup(slot->plans[Worker].text);
+		*combiner_plan = pstrdup(slot->plans[Combiner].text);
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(release_slot, Int32GetDatum(idx));
+
+	release_slot(0, Int32GetDatum(idx));
+}
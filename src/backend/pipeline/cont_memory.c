@@ -0,0 +1,253 @@
+/*-------------------------------------------------------------------------
+ *
+ * cont_memory.c
+ *
+ *	  Accounting of the memory used by continuous query states
+ *
+ * Each worker and combiner keeps a state for every continuous query it runs,
+ * holding its plans, caches and any results that haven't been synced yet, all
+ * of which live below the state's context. After executing a query, processes
+ * publish how much memory its state uses here, so that the views behind a
+ * growing process can be found with pipeline_query_memory. Entries are only
+ * written by the process that owns them and are removed along with the state,
+ * or when the process exits.
+ *
+ * If continuous_query_state_mem is set, a state using more than that after
+ * executing a query is reported as over its limit, and the process gives up
+ * whatever it can rebuild: workers release their kept plan, and combiners
+ * sync the view's pending results right away and empty its caches.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/cont_memory.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "pipeline/cont_memory.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+/* guc parameters */
+int continuous_query_state_mem;
+
+typedef struct ContQueryMemoryKey
+{
+	Oid dbid;
+	Oid query_id;
+	pid_t pid;
+} ContQueryMemoryKey;
+
+typedef struct ContQueryMemoryEntry
+{
+	ContQueryMemoryKey key; /* hash key --- MUST BE FIRST */
+	ContQueryProcType ptype;
+	pg_atomic_uint64 bytes;
+	pg_atomic_uint64 peak_bytes;
+	pg_atomic_uint64 cache_bytes;
+	pg_atomic_uint64 plan_bytes;
+	pg_atomic_uint64 limit_exceeded;
+} ContQueryMemoryEntry;
+
+static HTAB *ContQueryMemory = NULL;
+static bool exit_callback_registered = false;
+
+/*
+ * ContQueryMemoryShmemSize
+ */
+Size
+ContQueryMemoryShmemSize(void)
+{
+	return hash_estimate_size(CONT_MEMORY_ENTRIES, sizeof(ContQueryMemoryEntry));
+}
+
+/*
+ * ContQueryMemoryShmemInit
+ */
+void
+ContQueryMemoryShmemInit(void)
+{
+	HASHCTL ctl;
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(ContQueryMemoryKey);
+	ctl.entrysize = sizeof(ContQueryMemoryEntry);
+
+	ContQueryMemory = ShmemInitHash("ContQueryMemory", CONT_MEMORY_ENTRIES, CONT_MEMORY_ENTRIES,
+			&ctl, HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * remove_proc_entries
+ *
+ * The states of an exiting process may not have been released
+ */
+static void
+remove_proc_entries(int code, Datum arg)
+{
+	HASH_SEQ_STATUS status;
+	ContQueryMemoryEntry *entry;
+
+	LWLockAcquire(ContQueryMemoryLock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, ContQueryMemory);
+	while ((entry = (ContQueryMemoryEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.pid == MyProcPid)
+			hash_search(ContQueryMemory, &entry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(ContQueryMemoryLock);
+}
+
+/*
+ * remove_state_entry
+ *
+ * Removes a state's entry once its context is released
+ */
+static void
+remove_state_entry(void *arg)
+{
+	ContQueryState *state = (ContQueryState *) arg;
+
+	if (state->mem == NULL)
+		return;
+
+	LWLockAcquire(ContQueryMemoryLock, LW_EXCLUSIVE);
+	hash_search(ContQueryMemory, &state->mem->key, HASH_REMOVE, NULL);
+	LWLockRelease(ContQueryMemoryLock);
+
+	state->mem = NULL;
+}
+
+/*
+ * attach_state_entry
+ *
+ * Returns NULL if there's no room left for the state's entry
+ */
+static ContQueryMemoryEntry *
+attach_state_entry(ContQueryState *state)
+{
+	ContQueryMemoryKey key;
+	ContQueryMemoryEntry *entry;
+	MemoryContextCallback *callback;
+	bool found;
+
+	if (!exit_callback_registered)
+	{
+		on_shmem_exit(remove_proc_entries, (Datum) 0);
+		exit_callback_registered = true;
+	}
+
+	/* the key is hashed as a blob, so its padding must be zeroed */
+	MemSet(&key, 0, sizeof(ContQueryMemoryKey));
+	key.dbid = MyDatabaseId;
+	key.query_id = state->query_id;
+	key.pid = MyProcPid;
+
+	LWLockAcquire(ContQueryMemoryLock, LW_EXCLUSIVE);
+
+	entry = (ContQueryMemoryEntry *) hash_search(ContQueryMemory, &key, HASH_ENTER_NULL, &found);
+	if (entry)
+	{
+		entry->ptype = IsContQueryWorkerProcess() ? Worker : Combiner;
+		pg_atomic_init_u64(&entry->bytes, 0);
+		pg_atomic_init_u64(&entry->peak_bytes, 0);
+		pg_atomic_init_u64(&entry->cache_bytes, 0);
+		pg_atomic_init_u64(&entry->plan_bytes, 0);
+		pg_atomic_init_u64(&entry->limit_exceeded, 0);
+	}
+
+	LWLockRelease(ContQueryMemoryLock);
+
+	if (entry)
+	{
+		callback = MemoryContextAlloc(state->state_cxt, sizeof(MemoryContextCallback));
+		callback->func = remove_state_entry;
+		callback->arg = (void *) state;
+		MemoryContextRegisterResetCallback(state->state_cxt, callback);
+	}
+
+	return entry;
+}
+
+/*
+ * ContQueryStateReportMemory
+ *
+ * Publishes the memory used by the given state, of which cache_bytes is used by caches and plan_bytes
+ * by plans kept across batches. Returns true if the state is over continuous_query_state_mem.
+ */
+bool
+ContQueryStateReportMemory(ContQueryState *state, Size cache_bytes, Size plan_bytes)
+{
+	Size bytes = MemoryContextMemAllocated(state->state_cxt, true);
+	bool exceeded = continuous_query_state_mem > 0 && bytes > continuous_query_state_mem * 1024L;
+	ContQueryMemoryEntry *entry = state->mem;
+
+	if (entry == NULL)
+		entry = state->mem = attach_state_entry(state);
+
+	if (entry == NULL)
+		return exceeded;
+
+	pg_atomic_write_u64(&entry->bytes, bytes);
+	pg_atomic_write_u64(&entry->cache_bytes, cache_bytes);
+	pg_atomic_write_u64(&entry->plan_bytes, plan_bytes);
+
+	if (bytes > pg_atomic_read_u64(&entry->peak_bytes))
+		pg_atomic_write_u64(&entry->peak_bytes, bytes);
+
+	if (exceeded)
+		pg_atomic_fetch_add_u64(&entry->limit_exceeded, 1);
+
+	return exceeded;
+}
+
+/*
+ * GetContQueryMemoryStats
+ *
+ * Returns a copy of the memory used by the states of every query of this database
+ */
+ContQueryMemoryStats *
+GetContQueryMemoryStats(int *nstats)
+{
+	ContQueryMemoryStats *result;
+	HASH_SEQ_STATUS status;
+	ContQueryMemoryEntry *entry;
+	int n = 0;
+
+	LWLockAcquire(ContQueryMemoryLock, LW_SHARED);
+
+	result = palloc0(sizeof(ContQueryMemoryStats) * Max(hash_get_num_entries(ContQueryMemory), 1));
+
+	hash_seq_init(&status, ContQueryMemory);
+	while ((entry = (ContQueryMemoryEntry *) hash_seq_search(&status)) != NULL)
+	{
+		ContQueryMemoryStats *stats;
+
+		if (entry->key.dbid != MyDatabaseId)
+			continue;
+
+		stats = &result[n++];
+		stats->query_id = entry->key.query_id;
+		stats->pid = entry->key.pid;
+		stats->ptype = entry->ptype;
+		stats->bytes = pg_atomic_read_u64(&entry->bytes);
+		stats->peak_bytes = pg_atomic_read_u64(&entry->peak_bytes);
+		stats->cache_bytes = pg_atomic_read_u64(&entry->cache_bytes);
+		stats->plan_bytes = pg_atomic_read_u64(&entry->plan_bytes);
+		stats->limit_exceeded = pg_atomic_read_u64(&entry->limit_exceeded);
+	}
+
+	LWLockRelease(ContQueryMemoryLock);
+
+	*nstats = n;
+
+	return result;
+}
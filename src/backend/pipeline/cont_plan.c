@@ -34,6 +34,7 @@
 #include "parser/parse_relation.h"
 #include "pipeline/cont_analyze.h"
 #include "pipeline/cont_plan.h"
+#include "pipeline/cont_query_cache.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/rel.h"
@@ -66,13 +67,10 @@ get_combiner_join_rel(PlannerInfo *root, int levels_needed, List *initial_rels)
 }
 
 static PlannedStmt *
-get_plan_from_stmt(Oid id, Node *node, const char *sql, bool is_combine)
+get_plan_from_query(Oid id, Query *query, bool is_combine)
 {
-	Query *query;
 	PlannedStmt	*plan;
 
-	query = linitial(pg_analyze_and_rewrite(node, sql, NULL, 0));
-
 	query->isContinuous = true;
 	query->isCombine = is_combine;
 	query->cqId = id;
@@ -106,6 +104,14 @@ get_plan_from_stmt(Oid id, Node *node, const char *sql, bool is_combine)
 	return plan;
 }
 
+static PlannedStmt *
+get_plan_from_stmt(Oid id, Node *node, const char *sql, bool is_combine)
+{
+	Query *query = linitial(pg_analyze_and_rewrite(node, sql, NULL, 0));
+
+	return get_plan_from_query(id, query, is_combine);
+}
+
 static SelectStmt *
 get_worker_select_stmt(ContQuery* view, SelectStmt** viewptr)
 {
@@ -117,17 +123,211 @@ get_worker_select_stmt(ContQuery* view, SelectStmt** viewptr)
 
 	selectstmt = (SelectStmt *) linitial(parsetree_list);
 	selectstmt->swStepFactor = view->sw_step_factor;
+	selectstmt->deltaMerge = view->delta_merge;
+	selectstmt->lazyGroupingSets = view->lazy_grouping_sets;
 	selectstmt = TransformSelectStmtForContProcess(view->matrel, selectstmt,
 												   viewptr, Worker);
 
 	return selectstmt;
 }
 
+static SelectStmt *
+get_combiner_select_stmt(ContQuery *view)
+{
+	List		*parsetree_list;
+	SelectStmt	*selectstmt;
+
+	parsetree_list = pg_parse_query(view->sql);
+	Assert(list_length(parsetree_list) == 1);
+
+	selectstmt = (SelectStmt *) linitial(parsetree_list);
+	selectstmt->swStepFactor = view->sw_step_factor;
+	selectstmt->deltaMerge = view->delta_merge;
+	selectstmt->lazyGroupingSets = view->lazy_grouping_sets;
+
+	return TransformSelectStmtForContProcess(view->matrel, selectstmt, NULL, Combiner);
+}
+
+/*
+ * get_cont_query
+ *
+ * Returns the analyzed and rewritten query the given process type plans for the given
+ * continuous query, from the shared cache if some other process has already built it
+ */
+static Query *
+get_cont_query(ContQuery *view, ContQueryProcType type)
+{
+	Query *query = ContQueryCacheLookup(view, type);
+	SelectStmt *stmt;
+	uint32 generation;
+
+	if (query)
+		return query;
+
+	generation = GetContQueryCacheGeneration();
+
+	if (type == Worker)
+		stmt = get_worker_select_stmt(view, NULL);
+	else
+		stmt = get_combiner_select_stmt(view);
+
+	query = linitial(pg_analyze_and_rewrite((Node *) stmt, view->sql, NULL, 0));
+	ContQueryCacheStore(view, type, query, generation);
+
+	return query;
+}
+
 static PlannedStmt *
 get_worker_plan(ContQuery *view)
 {
-	SelectStmt* stmt = get_worker_select_stmt(view, NULL);
-	return get_plan_from_stmt(view->id, (Node *) stmt, view->sql, false);
+	return get_plan_from_query(view->id, get_cont_query(view, Worker), false);
+}
+
+/*
+ * find_merged_target
+ *
+ * Returns the resno of the target computing the same thing as the given one, or 0 if there isn't one.
+ * Grouping targets must also have the same sortgroupref, since the grouping refers to them by it.
+ */
+static AttrNumber
+find_merged_target(List *tlist, TargetEntry *te)
+{
+	ListCell *lc;
+
+	foreach(lc, tlist)
+	{
+		TargetEntry *mte = (TargetEntry *) lfirst(lc);
+
+		if (mte->ressortgroupref == te->ressortgroupref && equal(mte->expr, te->expr))
+			return mte->resno;
+	}
+
+	return 0;
+}
+
+/*
+ * merge_worker_query
+ *
+ * If the given worker query only differs from the merged one in its target list, appends the
+ * targets it has that the merged one doesn't to the merged one's target list and returns the
+ * merged target each of its targets is found at, terminated by InvalidAttrNumber. Returns NULL
+ * otherwise, leaving the merged query as is.
+ */
+static AttrNumber *
+merge_worker_query(Query *merged, Query *query)
+{
+	List *tlist = merged->targetList;
+	List *added = NIL;
+	AttrNumber *attmap;
+	ListCell *lc;
+	bool same;
+	int i = 0;
+
+	/* these are set on each query as it's planned */
+	query->isContinuous = merged->isContinuous;
+	query->isCombine = merged->isCombine;
+	query->cqId = merged->cqId;
+	query->mergeGroup = merged->mergeGroup;
+
+	merged->targetList = query->targetList;
+	same = equal(merged, query);
+	merged->targetList = tlist;
+
+	if (!same)
+		return NULL;
+
+	attmap = palloc0(sizeof(AttrNumber) * (list_length(query->targetList) + 1));
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+
+		if (te->resjunk)
+			return NULL;
+
+		attmap[i] = find_merged_target(tlist, te);
+		if (!attmap[i])
+			attmap[i] = find_merged_target(added, te);
+
+		if (!attmap[i])
+		{
+			if (te->ressortgroupref)
+				return NULL;
+
+			te = flatCopyTargetEntry(te);
+			te->resno = list_length(tlist) + list_length(added) + 1;
+			added = lappend(added, te);
+			attmap[i] = te->resno;
+		}
+
+		i++;
+	}
+
+	merged->targetList = list_concat(tlist, added);
+
+	return attmap;
+}
+
+/*
+ * GetMergedWorkerPlan
+ *
+ * Plans the worker queries of the given view and of those of the given other views whose worker
+ * queries only differ from it in their targets as a single plan, whose targets are the view's
+ * followed by those of the others that it doesn't already have. Returns NULL if none of the others
+ * can be merged with the view. Otherwise *merged is set to the view followed by the views merged
+ * with it, and *attmaps to, for each of them, the plan's attribute each of its worker attributes is
+ * found at, terminated by InvalidAttrNumber.
+ */
+PlannedStmt *
+GetMergedWorkerPlan(ContQuery *view, List *others, List **merged, List **attmaps)
+{
+	Query *query = get_cont_query(view, Worker);
+	AttrNumber *attmap;
+	ListCell *lc;
+
+	*merged = NIL;
+	*attmaps = NIL;
+
+	if (!query->hasAggs || !query->groupClause)
+		return NULL;
+
+	attmap = palloc0(sizeof(AttrNumber) * (list_length(query->targetList) + 1));
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *te = (TargetEntry *) lfirst(lc);
+
+		if (te->resjunk)
+			return NULL;
+
+		attmap[te->resno - 1] = te->resno;
+	}
+
+	*merged = lappend(*merged, view);
+	*attmaps = lappend(*attmaps, attmap);
+
+	foreach(lc, others)
+	{
+		ContQuery *other = (ContQuery *) lfirst(lc);
+
+		if (other->is_sw != view->is_sw || other->sw_step_ms != view->sw_step_ms)
+			continue;
+
+		attmap = merge_worker_query(query, get_cont_query(other, Worker));
+		if (attmap == NULL)
+			continue;
+
+		*merged = lappend(*merged, other);
+		*attmaps = lappend(*attmaps, attmap);
+	}
+
+	if (list_length(*merged) == 1)
+	{
+		*merged = NIL;
+		*attmaps = NIL;
+		return NULL;
+	}
+
+	return get_plan_from_query(view->id, query, false);
 }
 
 static PlannedStmt *
@@ -138,7 +338,10 @@ get_plan_with_hook(Oid id, Node *node, const char* sql, bool is_combine)
 
 	PG_TRY();
 	{
-		result = get_plan_from_stmt(id, node, sql, is_combine);
+		if (IsA(node, Query))
+			result = get_plan_from_query(id, (Query *) node, is_combine);
+		else
+			result = get_plan_from_stmt(id, node, sql, is_combine);
 		join_search_hook = NULL;
 		post_parse_analyze_hook = NULL;
 	}
@@ -188,18 +391,9 @@ GetContinuousViewOverlayPlanMod(ContQuery *view, ViewModFunction mod_fn)
 static PlannedStmt *
 get_combiner_plan(ContQuery *view)
 {
-	List		*parsetree_list;
-	SelectStmt	*selectstmt;
+	Query *query = get_cont_query(view, Combiner);
 
-	parsetree_list = pg_parse_query(view->sql);
-	Assert(list_length(parsetree_list) == 1);
-
-	selectstmt = (SelectStmt *) linitial(parsetree_list);
-	selectstmt->swStepFactor = view->sw_step_factor;
-	selectstmt = TransformSelectStmtForContProcess(view->matrel, selectstmt, NULL, Combiner);
-	join_search_hook = get_combiner_join_rel;
-
-	return get_plan_with_hook(view->id, (Node*) selectstmt, view->sql, true);
+	return get_plan_with_hook(view->id, (Node *) query, view->sql, true);
 }
 
 PlannedStmt *
@@ -218,10 +412,10 @@ GetContPlan(ContQuery *view, ContQueryProcType type)
 }
 
 /*
- * SetCombinerPlanTuplestorestate
+ * get_combiner_scan
  */
-TuplestoreScan *
-SetCombinerPlanTuplestorestate(PlannedStmt *plan, Tuplestorestate *tupstore)
+static TuplestoreScan *
+get_combiner_scan(PlannedStmt *plan)
 {
 	TuplestoreScan *scan;
 
@@ -237,7 +431,33 @@ SetCombinerPlanTuplestorestate(PlannedStmt *plan, Tuplestorestate *tupstore)
 	else
 		elog(ERROR, "couldn't find TuplestoreScan node in combiner's plan");
 
+	return scan;
+}
+
+/*
+ * SetCombinerPlanTuplestorestate
+ */
+TuplestoreScan *
+SetCombinerPlanTuplestorestate(PlannedStmt *plan, Tuplestorestate *tupstore)
+{
+	TuplestoreScan *scan = get_combiner_scan(plan);
+
 	scan->store = tupstore;
+	scan->batch = NULL;
+
+	return scan;
+}
+
+/*
+ * SetCombinerPlanTupleBatch
+ */
+TuplestoreScan *
+SetCombinerPlanTupleBatch(PlannedStmt *plan, TupleBatch *batch)
+{
+	TuplestoreScan *scan = get_combiner_scan(plan);
+
+	scan->store = NULL;
+	scan->batch = batch;
 
 	return scan;
 }
@@ -393,6 +613,48 @@ create_index_on_matrel(IndexStmt *stmt)
 	}
 }
 
+/*
+ * invalidates_cont_queries
+ *
+ * Could the given utility statement change how an existing continuous query is analyzed?
+ * New continuous queries never have cached queries, so creating one doesn't.
+ */
+static bool
+invalidates_cont_queries(Node *parsetree)
+{
+	switch (nodeTag(parsetree))
+	{
+		case T_TransactionStmt:
+		case T_VariableSetStmt:
+		case T_VariableShowStmt:
+		case T_CopyStmt:
+		case T_ExplainStmt:
+		case T_ExplainContQueryStmt:
+		case T_PrepareStmt:
+		case T_ExecuteStmt:
+		case T_DeallocateStmt:
+		case T_DeclareCursorStmt:
+		case T_FetchStmt:
+		case T_ClosePortalStmt:
+		case T_NotifyStmt:
+		case T_ListenStmt:
+		case T_UnlistenStmt:
+		case T_LockStmt:
+		case T_CheckPointStmt:
+		case T_DiscardStmt:
+		case T_VacuumStmt:
+		case T_IndexStmt:
+		case T_CreateContViewStmt:
+		case T_CreateContTransformStmt:
+		case T_TruncateContViewStmt:
+		case T_ActivateStmt:
+		case T_DeactivateStmt:
+			return false;
+		default:
+			return true;
+	}
+}
+
 /*
  * ProcessUtilityOnContView
  *
@@ -420,6 +682,9 @@ ProcessUtilityOnContView(Node *parsetree, const char *sql, ProcessUtilityContext
 			vstmt->relation = GetMatRelName(vstmt->relation);
 	}
 
+	if (invalidates_cont_queries(parsetree))
+		InvalidateContQueryCache();
+
 	if (SaveUtilityHook != NULL)
 		(*SaveUtilityHook) (parsetree, sql, context, params, dest, tag);
 	else
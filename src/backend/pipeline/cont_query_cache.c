@@ -0,0 +1,299 @@
+/*-------------------------------------------------------------------------
+ *
+ * cont_query_cache.c
+ *
+ *	  Shared cache of analyzed continuous queries
+ *
+ * Every worker and combiner builds its own plan for each continuous query it
+ * runs, which means parsing the query's SQL, transforming it for the process
+ * type and analyzing and rewriting the result before it can be planned. With
+ * many processes and many views, that's most of the work of starting up. The
+ * first process to analyze a query for a given process type publishes the
+ * serialized Query here, so that the others only need to read it back in and
+ * plan it. Plans themselves can't be read back in from their serialized form,
+ * so they're still built by each process.
+ *
+ * Entries are keyed by database, query id and process type, and remember the
+ * pipeline_query row and step factor they were built from, so that a view that
+ * is replaced or has its step size changed is never given an outdated query.
+ * Anything else a query may depend on is covered by a generation counter, which
+ * is bumped whenever a transaction that ran DDL commits, right after its
+ * catalog invalidations are sent. Entries published by an older generation are
+ * ignored and eventually replaced.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/cont_query_cache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "miscadmin.h"
+#include "nodes/nodes.h"
+#include "pipeline/cont_query_cache.h"
+#include "port/atomics.h"
+#include "storage/lwlock.h"
+#include "storage/shm_alloc.h"
+#include "storage/shmem.h"
+#include "utils/inval.h"
+#include "utils/resowner.h"
+
+/* don't let the open addressed table get too crowded */
+#define MAX_CONT_QUERIES (CONT_QUERY_CACHE_SIZE * 3 / 4)
+
+typedef struct ContQueryCacheKey
+{
+	Oid dbid;
+	Oid id;
+	int type;
+} ContQueryCacheKey;
+
+typedef struct ContQueryCacheSlot
+{
+	ContQueryCacheKey key;
+	bool used;
+	/* what the entry was built from */
+	Oid oid;
+	int step_factor;
+	uint32 generation;
+	/* serialized Query, allocated with ShmemDynAlloc */
+	char *query;
+	Size size;
+} ContQueryCacheSlot;
+
+typedef struct ContQueryCache
+{
+	pg_atomic_uint32 generation;
+	int nqueries;
+	Size nbytes;
+	ContQueryCacheSlot slots[CONT_QUERY_CACHE_SIZE];
+} ContQueryCache;
+
+static ContQueryCache *query_cache = NULL;
+
+static bool inval_pending = false;
+static bool callback_registered = false;
+
+/*
+ * ContQueryCacheShmemSize
+ *
+ * The serialized queries are allocated dynamically, so room is left for them as well
+ */
+Size
+ContQueryCacheShmemSize(void)
+{
+	return add_size(MAXALIGN(sizeof(ContQueryCache)), CONT_QUERY_CACHE_BYTES);
+}
+
+/*
+ * ContQueryCacheShmemInit
+ */
+void
+ContQueryCacheShmemInit(void)
+{
+	bool found;
+
+	query_cache = ShmemInitStruct("ContQueryCache", sizeof(ContQueryCache), &found);
+
+	if (!found)
+	{
+		MemSet(query_cache, 0, sizeof(ContQueryCache));
+		pg_atomic_init_u32(&query_cache->generation, 0);
+	}
+}
+
+/*
+ * make_key
+ */
+static void
+make_key(ContQueryCacheKey *key, ContQuery *cq, ContQueryProcType type)
+{
+	MemSet(key, 0, sizeof(ContQueryCacheKey));
+	key->dbid = MyDatabaseId;
+	key->id = cq->id;
+	key->type = (int) type;
+}
+
+/*
+ * find_slot
+ *
+ * Must be called with ContQueryCacheLock held. Returns the slot for the given key, or the
+ * unused slot it belongs in if there isn't one. Slots are never emptied once used, since
+ * query ids are reused and the slot of a dropped query is simply taken over by the next one.
+ */
+static ContQueryCacheSlot *
+find_slot(ContQueryCacheKey *key)
+{
+	uint32 hash = DatumGetUInt32(hash_any((unsigned char *) key, sizeof(ContQueryCacheKey)));
+	int i = hash % CONT_QUERY_CACHE_SIZE;
+
+	for (;;)
+	{
+		ContQueryCacheSlot *slot = &query_cache->slots[i];
+
+		if (!slot->used || memcmp(&slot->key, key, sizeof(ContQueryCacheKey)) == 0)
+			return slot;
+
+		i = (i + 1) % CONT_QUERY_CACHE_SIZE;
+	}
+}
+
+/*
+ * current_generation
+ */
+static uint32
+current_generation(void)
+{
+	return pg_atomic_read_u32(&query_cache->generation);
+}
+
+/*
+ * GetContQueryCacheGeneration
+ *
+ * Must be called before a query is analyzed for storing in the cache, so that an invalidation
+ * that happens while it's being built discards it. Any catalog invalidations sent before the
+ * returned generation was reached are accepted, so the query is built from catalogs that are
+ * at least as new.
+ */
+uint32
+GetContQueryCacheGeneration(void)
+{
+	uint32 generation = current_generation();
+
+	AcceptInvalidationMessages();
+
+	return generation;
+}
+
+/*
+ * ContQueryCacheLookup
+ *
+ * Returns a copy of the cached Query for the given continuous query and process type in the
+ * current memory context, or NULL if there isn't a valid one
+ */
+Query *
+ContQueryCacheLookup(ContQuery *cq, ContQueryProcType type)
+{
+	ContQueryCacheKey key;
+	ContQueryCacheSlot *slot;
+	char *str = NULL;
+
+	make_key(&key, cq, type);
+
+	LWLockAcquire(ContQueryCacheLock, LW_SHARED);
+
+	slot = find_slot(&key);
+
+	if (slot->used && slot->query &&
+			slot->oid == cq->oid &&
+			slot->step_factor == cq->sw_step_factor &&
+			slot->generation == current_generation())
+		str = pstrdup(slot->query);
+
+	LWLockRelease(ContQueryCacheLock);
+
+	if (str == NULL)
+		return NULL;
+
+	return (Query *) stringToNode(str);
+}
+
+/*
+ * ContQueryCacheStore
+ *
+ * Publishes the given analyzed Query for the given continuous query and process type. generation
+ * is what GetContQueryCacheGeneration returned before the query was built, and if it has changed
+ * since then the query is dropped. The query isn't cached either if the cache is full.
+ */
+void
+ContQueryCacheStore(ContQuery *cq, ContQueryProcType type, Query *query, uint32 generation)
+{
+	ContQueryCacheKey key;
+	ContQueryCacheSlot *slot;
+	char *str = nodeToString(query);
+	Size size = strlen(str) + 1;
+	char *copy;
+	char *old = NULL;
+
+	if (size > CONT_QUERY_CACHE_BYTES / 16)
+	{
+		pfree(str);
+		return;
+	}
+
+	/* allocate outside of the lock, since the allocator takes its own lock */
+	copy = ShmemDynAlloc(size);
+	memcpy(copy, str, size);
+	pfree(str);
+
+	make_key(&key, cq, type);
+
+	LWLockAcquire(ContQueryCacheLock, LW_EXCLUSIVE);
+
+	slot = find_slot(&key);
+
+	if (generation == current_generation() &&
+			(slot->used || query_cache->nqueries < MAX_CONT_QUERIES) &&
+			query_cache->nbytes - slot->size + size <= CONT_QUERY_CACHE_BYTES)
+	{
+		if (!slot->used)
+		{
+			slot->key = key;
+			slot->used = true;
+			query_cache->nqueries++;
+		}
+
+		old = slot->query;
+		query_cache->nbytes += size - slot->size;
+		slot->query = copy;
+		slot->size = size;
+		slot->oid = cq->oid;
+		slot->step_factor = cq->sw_step_factor;
+		slot->generation = generation;
+		copy = NULL;
+	}
+
+	LWLockRelease(ContQueryCacheLock);
+
+	if (old)
+		ShmemDynFree(old);
+	if (copy)
+		ShmemDynFree(copy);
+}
+
+/*
+ * cache_release_callback
+ *
+ * The generation is bumped after the transaction's catalog invalidations are sent, so that any
+ * backend that sees the new generation also sees the new catalog state once it accepts them
+ */
+static void
+cache_release_callback(ResourceReleasePhase phase, bool isCommit, bool isTopLevel, void *arg)
+{
+	if (!inval_pending || !isTopLevel || phase != RESOURCE_RELEASE_AFTER_LOCKS)
+		return;
+
+	if (isCommit)
+		pg_atomic_fetch_add_u32(&query_cache->generation, 1);
+
+	inval_pending = false;
+}
+
+/*
+ * InvalidateContQueryCache
+ *
+ * Invalidates all cached queries once the current transaction commits
+ */
+void
+InvalidateContQueryCache(void)
+{
+	if (!callback_registered)
+	{
+		RegisterResourceReleaseCallback(cache_release_callback, NULL);
+		callback_registered = true;
+	}
+
+	inval_pending = true;
+}
@@ -20,6 +20,8 @@
 #include "access/htup_details.h"
 #include "access/xact.h"
 #include "catalog/pg_database.h"
+#include "catalog/pg_db_role_setting.h"
+#include "catalog/pg_type.h"
 #include "libpq/pqsignal.h"
 #include "miscadmin.h"
 #include "nodes/print.h"
@@ -27,7 +29,10 @@
 #include "pipeline/cont_execute.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/ipc/broker.h"
+#include "pipeline/metrics.h"
 #include "pipeline/miscutils.h"
+#include "pipeline/sink.h"
+#include "pipeline/stream_log.h"
 #include "postmaster/fork_process.h"
 #include "postmaster/postmaster.h"
 #include "storage/ipc.h"
@@ -39,15 +44,18 @@
 #include "storage/spin.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
 #include "utils/portal.h"
 #include "utils/ps_status.h"
+#include "utils/rel.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/timeout.h"
 
 #define NUM_BG_WORKERS_PER_DB (continuous_query_num_workers + continuous_query_num_combiners)
+#define COMBINER_PROC(db_meta, group_id) (&(db_meta)->db_procs[continuous_query_num_workers + (group_id)])
 #define NUM_LOCKS_PER_DB NUM_BG_WORKERS_PER_DB
 
 #define BG_PROC_STATUS_TIMEOUT 1000
@@ -57,6 +65,9 @@ typedef struct DatabaseEntry
 {
 	Oid oid;
 	NameData name;
+	/* from the database's continuous_query_database_* settings, 0 if they aren't set */
+	int num_workers;
+	int num_combiners;
 } DatabaseEntry;
 
 static List *DatabaseList = NIL;
@@ -72,14 +83,35 @@ bool am_cont_combiner = false;
 /* guc parameters */
 bool continuous_queries_enabled;
 bool continuous_query_crash_recovery;
+int  continuous_query_restart_delay;
+bool continuous_query_lazy_activation;
 int  continuous_query_num_combiners;
+int  continuous_query_num_active_combiners;
+bool continuous_query_combiner_autoscale;
+int  continuous_query_combiner_autoscale_busy_time;
+int  continuous_query_combiner_autoscale_idle_time;
 int  continuous_query_num_workers;
+int  continuous_query_database_num_workers;
+int  continuous_query_database_num_combiners;
 int  continuous_query_batch_size;
 int  continuous_query_max_wait;
 int  continuous_query_combiner_work_mem;
 int  continuous_query_combiner_synchronous_commit;
 int continuous_query_commit_interval;
 double continuous_query_proc_priority;
+char *continuous_query_numa_nodes;
+char *continuous_query_worker_pools;
+char *continuous_query_worker_cpus;
+char *continuous_query_combiner_cpus;
+char *continuous_query_broker_cpus;
+char *continuous_query_scheduler_cpus;
+char *continuous_query_cgroup;
+int continuous_query_transform_queue_weight;
+
+/* named worker pools, parsed from continuous_query_worker_pools the first time they're needed */
+static List *worker_pool_names = NIL;
+static List *worker_pool_sizes = NIL;
+static bool worker_pools_loaded = false;
 
 /* memory context for long-lived data */
 static MemoryContext ContQuerySchedulerContext;
@@ -95,11 +127,13 @@ typedef struct ContQuerySchedulerShmemStruct
 	pid_t pid;
 	HTAB *db_table;
 	ContQueryRunParams params;
+	bool metrics_exporter_started; /* it outlives the scheduler, so it's only ever started once */
 } ContQuerySchedulerShmemStruct;
 
 static ContQuerySchedulerShmemStruct *ContQuerySchedulerShmem;
 
 NON_EXEC_STATIC void ContQuerySchedulerMain(int argc, char *argv[]) __attribute__((noreturn));
+static void signal_cont_query_scheduler(int signal);
 
 static void
 update_run_params(void)
@@ -175,6 +209,9 @@ GetContQueryProcName(ContQueryProc *proc)
 		case AdhocVacuumer:
 			snprintf(buf, NAMEDATALEN, "adhoc vacuumer [%s]", NameStr(proc->db_meta->db_name));
 			break;
+		case Sink:
+			snprintf(buf, NAMEDATALEN, "sink [%s]", NameStr(proc->db_meta->db_name));
+			break;
 		case Scheduler:
 			return pstrdup("scheduler");
 			break;
@@ -183,6 +220,587 @@ GetContQueryProcName(ContQueryProc *proc)
 	return buf;
 }
 
+/*
+ * parse_numa_nodes
+ *
+ * Parse a comma separated list of NUMA node numbers, returning false if it's malformed
+ */
+static bool
+parse_numa_nodes(const char *value, List **nodes)
+{
+	char *raw = pstrdup(value);
+	List *elems;
+	ListCell *lc;
+
+	*nodes = NIL;
+
+	if (!SplitIdentifierString(raw, ',', &elems))
+		return false;
+
+	foreach(lc, elems)
+	{
+		char *elem = (char *) lfirst(lc);
+		char *end;
+		long node = strtol(elem, &end, 10);
+
+		if (*end != '\0' || end == elem || node < 0 || node >= MAX_NUMA_NODES)
+			return false;
+
+		*nodes = lappend_int(*nodes, (int) node);
+	}
+
+	return true;
+}
+
+bool
+check_continuous_query_numa_nodes(char **newval, void **extra, GucSource source)
+{
+	List *nodes;
+
+	if (*newval == NULL || **newval == '\0')
+		return true;
+
+	if (!parse_numa_nodes(*newval, &nodes))
+	{
+		GUC_check_errdetail("List must contain NUMA node numbers between 0 and %d.", MAX_NUMA_NODES - 1);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+check_continuous_query_cpus(char **newval, void **extra, GucSource source)
+{
+	bool cpus[MAX_CPUS];
+
+	if (*newval == NULL || **newval == '\0')
+		return true;
+
+	if (!ParseCPUList(*newval, cpus))
+	{
+		GUC_check_errdetail("List must contain CPU numbers or ranges of them between 0 and %d, e.g. \"0-3,8\".", MAX_CPUS - 1);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * parse_worker_pools
+ *
+ * Parse a comma separated list of name:size worker pools, returning false if it's malformed
+ */
+static bool
+parse_worker_pools(const char *value, List **names, List **sizes)
+{
+	char *raw = pstrdup(value);
+	List *elems;
+	ListCell *lc;
+
+	*names = NIL;
+	*sizes = NIL;
+
+	if (!SplitIdentifierString(raw, ',', &elems))
+		return false;
+
+	foreach(lc, elems)
+	{
+		char *name = (char *) lfirst(lc);
+		char *sep = strchr(name, ':');
+		char *end;
+		long size;
+		ListCell *lc2;
+
+		if (sep == NULL || sep == name)
+			return false;
+
+		*sep = '\0';
+		size = strtol(sep + 1, &end, 10);
+
+		if (*end != '\0' || end == sep + 1 || size < 1 || size > MAX_BACKENDS)
+			return false;
+
+		if (pg_strcasecmp(name, DEFAULT_WORKER_POOL_NAME) == 0)
+			return false;
+
+		foreach(lc2, *names)
+		{
+			if (pg_strcasecmp(name, (char *) lfirst(lc2)) == 0)
+				return false;
+		}
+
+		*names = lappend(*names, name);
+		*sizes = lappend_int(*sizes, (int) size);
+	}
+
+	return true;
+}
+
+bool
+check_continuous_query_worker_pools(char **newval, void **extra, GucSource source)
+{
+	List *names;
+	List *sizes;
+
+	if (*newval == NULL || **newval == '\0')
+		return true;
+
+	if (!parse_worker_pools(*newval, &names, &sizes))
+	{
+		GUC_check_errdetail("List must contain distinct name:size pairs with a positive size, and no pool can be named \"%s\".",
+				DEFAULT_WORKER_POOL_NAME);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * load_worker_pools
+ */
+static void
+load_worker_pools(void)
+{
+	MemoryContext old;
+
+	if (worker_pools_loaded)
+		return;
+
+	old = MemoryContextSwitchTo(TopMemoryContext);
+
+	if (continuous_query_worker_pools == NULL ||
+			!parse_worker_pools(continuous_query_worker_pools, &worker_pool_names, &worker_pool_sizes))
+	{
+		worker_pool_names = NIL;
+		worker_pool_sizes = NIL;
+	}
+
+	MemoryContextSwitchTo(old);
+
+	worker_pools_loaded = true;
+}
+
+/*
+ * GetNumWorkerPools
+ *
+ * Returns the number of worker pools, including the default one
+ */
+int
+GetNumWorkerPools(void)
+{
+	load_worker_pools();
+
+	return 1 + list_length(worker_pool_names);
+}
+
+/*
+ * GetWorkerPoolId
+ *
+ * Returns the id of the worker pool with the given name, or -1 if there isn't one
+ */
+int
+GetWorkerPoolId(const char *name)
+{
+	ListCell *lc;
+	int id = DEFAULT_WORKER_POOL;
+
+	if (name == NULL || pg_strcasecmp(name, DEFAULT_WORKER_POOL_NAME) == 0)
+		return DEFAULT_WORKER_POOL;
+
+	load_worker_pools();
+
+	foreach(lc, worker_pool_names)
+	{
+		id++;
+		if (pg_strcasecmp(name, (char *) lfirst(lc)) == 0)
+			return id;
+	}
+
+	return -1;
+}
+
+/*
+ * GetWorkerPoolWorkers
+ *
+ * Get the range of worker group ids that make up the given pool in the current database. Named
+ * pools take the last workers, in the order they're configured, and the default pool is made up
+ * of the rest. If that wouldn't leave the default pool at least one worker, the named pools are
+ * ignored and every pool is made up of all workers.
+ */
+void
+GetWorkerPoolWorkers(int pool, int *first, int *nworkers)
+{
+	int total = GetDatabaseNumWorkers();
+	int reserved = 0;
+	int id = DEFAULT_WORKER_POOL;
+	ListCell *lc;
+
+	load_worker_pools();
+
+	foreach(lc, worker_pool_sizes)
+		reserved += lfirst_int(lc);
+
+	*first = 0;
+	*nworkers = total;
+
+	if (reserved >= total)
+		return;
+
+	*nworkers = total - reserved;
+
+	foreach(lc, worker_pool_sizes)
+	{
+		if (id == pool)
+			return;
+
+		*first += *nworkers;
+		*nworkers = lfirst_int(lc);
+		id++;
+	}
+
+	/* unknown pools fall back to the default one */
+	if (id != pool)
+	{
+		*first = 0;
+		*nworkers = total - reserved;
+	}
+}
+
+/*
+ * GetWorkerPoolForWorker
+ *
+ * Returns the id of the pool the given worker belongs to
+ */
+int
+GetWorkerPoolForWorker(int group_id)
+{
+	int npools = GetNumWorkerPools();
+	int pool;
+
+	for (pool = 1; pool < npools; pool++)
+	{
+		int first;
+		int n;
+
+		GetWorkerPoolWorkers(pool, &first, &n);
+
+		if (first > 0 && group_id >= first && group_id < first + n)
+			return pool;
+	}
+
+	return DEFAULT_WORKER_POOL;
+}
+
+/*
+ * check_continuous_query_database_setting
+ *
+ * The per-database pool sizes are read from pg_db_role_setting by the scheduler, so setting them
+ * anywhere but with ALTER DATABASE ... SET would have no effect
+ */
+bool
+check_continuous_query_database_setting(int *newval, void **extra, GucSource source)
+{
+	if (source == PGC_S_DEFAULT || source == PGC_S_DATABASE || source == PGC_S_TEST)
+		return true;
+
+	GUC_check_errdetail("This parameter can only be set with ALTER DATABASE ... SET.");
+
+	return false;
+}
+
+/*
+ * ActivateContQueryDatabase
+ *
+ * With lazy activation, have the scheduler start the current database's continuous query processes
+ * if they aren't running yet. This is called on every stream insert, so it's cheap once they are.
+ */
+void
+ActivateContQueryDatabase(void)
+{
+	static bool activated = false;
+	ContQueryDatabaseMetadata *db_meta;
+
+	if (activated || !continuous_query_lazy_activation || IsContQueryProcess())
+		return;
+
+	db_meta = GetContQueryDatabaseMetadata(MyDatabaseId);
+
+	/* the scheduler hasn't seen this database yet, so we'll ask again next time */
+	if (db_meta == NULL)
+		return;
+
+	if (db_meta->running)
+	{
+		activated = true;
+		return;
+	}
+
+	if (!db_meta->activate)
+	{
+		db_meta->activate = true;
+		signal_cont_query_scheduler(SIGUSR2);
+	}
+}
+
+/*
+ * GetDatabaseNumWorkers
+ *
+ * Returns the number of worker processes run for the current database, which is how many worker
+ * queues stream inserts are spread over. It's fixed once the database's processes are started.
+ */
+int
+GetDatabaseNumWorkers(void)
+{
+	static int num_workers = 0;
+	ContQueryDatabaseMetadata *db_meta;
+
+	if (num_workers)
+		return num_workers;
+
+	/* continuous query processes are only started once their database's pool sizes are set */
+	if (MyContQueryProc && MyContQueryProc->db_meta)
+		return MyContQueryProc->db_meta->num_workers;
+
+	db_meta = GetContQueryDatabaseMetadata(MyDatabaseId);
+
+	/* the scheduler hasn't started this database's processes yet, but there's always a first worker */
+	if (db_meta == NULL || !db_meta->running)
+		return 1;
+
+	num_workers = db_meta->num_workers;
+
+	return num_workers;
+}
+
+/*
+ * GetContQueryNumaNode
+ *
+ * Get the NUMA node the given worker or combiner group should be placed on, or -1 if
+ * no placement has been configured. Groups are assigned to the configured nodes round robin.
+ */
+int
+GetContQueryNumaNode(int group_id)
+{
+	List *nodes;
+
+	if (continuous_query_numa_nodes == NULL || *continuous_query_numa_nodes == '\0')
+		return -1;
+
+	if (!parse_numa_nodes(continuous_query_numa_nodes, &nodes) || nodes == NIL)
+		return -1;
+
+	return list_nth_int(nodes, group_id % list_length(nodes));
+}
+
+/*
+ * GetCombinerForGroupHash
+ *
+ * Get the group id of the combiner that the given group hash is routed to. Processes that don't
+ * belong to a database's continuous query processes see the initial assignment of shards.
+ */
+int
+GetCombinerForGroupHash(uint64 hash)
+{
+	int shard = hash % NUM_COMBINER_SHARDS;
+
+	if (MyContQueryProc == NULL || MyContQueryProc->db_meta == NULL)
+		return shard % continuous_query_num_combiners;
+
+	return MyContQueryProc->db_meta->combiner_shards[shard].owner;
+}
+
+/*
+ * GetCombinerShardCount
+ *
+ * Get the number of shards currently owned by the combiner with the given group id
+ */
+int
+GetCombinerShardCount(int group_id)
+{
+	int count = 0;
+	int i;
+
+	if (MyContQueryProc == NULL || MyContQueryProc->db_meta == NULL)
+		return NUM_COMBINER_SHARDS / continuous_query_num_combiners;
+
+	for (i = 0; i < NUM_COMBINER_SHARDS; i++)
+	{
+		if (MyContQueryProc->db_meta->combiner_shards[i].owner == group_id)
+			count++;
+	}
+
+	return count;
+}
+
+/*
+ * IsCombinerShardHandedOff
+ *
+ * Returns true if the shard of the given group hash was moved and its previous owner may still
+ * have uncommitted changes for it
+ */
+bool
+IsCombinerShardHandedOff(uint64 hash)
+{
+	CombinerShard *shard;
+
+	if (MyContQueryProc == NULL || MyContQueryProc->db_meta == NULL)
+		return false;
+
+	shard = &MyContQueryProc->db_meta->combiner_shards[hash % NUM_COMBINER_SHARDS];
+	pg_read_barrier();
+
+	return shard->prev >= 0 && shard->prev != MyContQueryProc->group_id;
+}
+
+/*
+ * HasHandedOffCombinerShards
+ *
+ * Returns true if any shard was moved away from this combiner and hasn't been released yet
+ */
+bool
+HasHandedOffCombinerShards(void)
+{
+	CombinerShard *shards = MyContQueryProc->db_meta->combiner_shards;
+	int i;
+
+	for (i = 0; i < NUM_COMBINER_SHARDS; i++)
+	{
+		if (shards[i].prev == MyContQueryProc->group_id && shards[i].owner != MyContQueryProc->group_id)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * ReleaseHandedOffCombinerShards
+ *
+ * Called by combiners after committing, which completes the hand-off of any shard that was
+ * moved away from them. Returns true if any shards were released.
+ */
+bool
+ReleaseHandedOffCombinerShards(void)
+{
+	CombinerShard *shards = MyContQueryProc->db_meta->combiner_shards;
+	bool released = false;
+	int i;
+
+	for (i = 0; i < NUM_COMBINER_SHARDS; i++)
+	{
+		if (shards[i].prev == MyContQueryProc->group_id && shards[i].owner != MyContQueryProc->group_id)
+		{
+			shards[i].prev = -1;
+			released = true;
+		}
+	}
+
+	if (released)
+		pg_atomic_fetch_add_u64(&MyContQueryProc->db_meta->shard_releases, 1);
+
+	return released;
+}
+
+/*
+ * GetCombinerShardReleases
+ *
+ * Returns how many times combiners of this database have released handed off shards. Once a
+ * shard has been released its previous owner never writes its groups again, so anything a
+ * combiner learned about its own shards' groups is complete for as long as this is unchanged.
+ */
+uint64
+GetCombinerShardReleases(void)
+{
+	if (MyContQueryProc == NULL || MyContQueryProc->db_meta == NULL)
+		return 0;
+
+	return pg_atomic_read_u64(&MyContQueryProc->db_meta->shard_releases);
+}
+
+/*
+ * init_combiner_shards
+ */
+static void
+init_combiner_shards(ContQueryDatabaseMetadata *db_meta)
+{
+	int i;
+
+	for (i = 0; i < NUM_COMBINER_SHARDS; i++)
+	{
+		db_meta->combiner_shards[i].owner = i % db_meta->num_active_combiners;
+		db_meta->combiner_shards[i].prev = -1;
+	}
+}
+
+/*
+ * rebalance_combiner_shards
+ *
+ * Spreads the database's combiner shards evenly over its active combiners, moving as few
+ * shards as possible. Shards that are still being handed off aren't moved
+ * again until their previous owner has released them, so this is repeated until nothing is left to move.
+ */
+static void
+rebalance_combiner_shards(ContQueryDatabaseMetadata *db_meta)
+{
+	CombinerShard *shards = db_meta->combiner_shards;
+	int nactive = db_meta->num_active_combiners;
+	int counts[continuous_query_num_combiners];
+	bool move[NUM_COMBINER_SHARDS];
+	int quota;
+	int nmoved = 0;
+	int i;
+
+	quota = (NUM_COMBINER_SHARDS + nactive - 1) / nactive;
+	MemSet(counts, 0, sizeof(counts));
+
+	for (i = 0; i < NUM_COMBINER_SHARDS; i++)
+	{
+		int owner = shards[i].owner;
+
+		move[i] = false;
+
+		if (shards[i].prev >= 0)
+		{
+			if (owner < nactive)
+				counts[owner]++;
+			continue;
+		}
+
+		if (owner < nactive && counts[owner] < quota)
+			counts[owner]++;
+		else
+			move[i] = true;
+	}
+
+	for (i = 0; i < NUM_COMBINER_SHARDS; i++)
+	{
+		int target = 0;
+		int j;
+
+		if (!move[i])
+			continue;
+
+		for (j = 1; j < nactive; j++)
+		{
+			if (counts[j] < counts[target])
+				target = j;
+		}
+
+		/* the new owner must see who it's taking the shard from before it sees that it owns it */
+		shards[i].prev = shards[i].owner;
+		pg_write_barrier();
+		shards[i].owner = target;
+
+		counts[target]++;
+		nmoved++;
+	}
+
+	if (nmoved)
+		ereport(LOG,
+				(errmsg("moved %d combiner shards of database \"%s\" to spread them over %d combiners",
+						nmoved, NameStr(db_meta->db_name), nactive)));
+}
+
 /* status inquiry functions */
 bool
 IsContQuerySchedulerProcess(void)
@@ -290,6 +908,82 @@ ShouldTerminateContQueryProcess(void)
 	return (bool) got_SIGTERM;
 }
 
+/*
+ * read_database_settings
+ *
+ * Reads the pool sizes set for the given databases with ALTER DATABASE ... SET
+ */
+static void
+read_database_settings(List *dbs)
+{
+	Relation rel = heap_open(DbRoleSettingRelationId, AccessShareLock);
+	HeapScanDesc scan = heap_beginscan_catalog(rel, 0, NULL);
+	HeapTuple tup;
+
+	while (HeapTupleIsValid(tup = heap_getnext(scan, ForwardScanDirection)))
+	{
+		Form_pg_db_role_setting row = (Form_pg_db_role_setting) GETSTRUCT(tup);
+		DatabaseEntry *db_entry = NULL;
+		ArrayType *config;
+		Datum *elems;
+		bool isnull;
+		Datum d;
+		ListCell *lc;
+		int nelems;
+		int i;
+
+		if (OidIsValid(row->setrole))
+			continue;
+
+		foreach(lc, dbs)
+		{
+			if (((DatabaseEntry *) lfirst(lc))->oid == row->setdatabase)
+			{
+				db_entry = lfirst(lc);
+				break;
+			}
+		}
+
+		if (db_entry == NULL)
+			continue;
+
+		d = heap_getattr(tup, Anum_pg_db_role_setting_setconfig, RelationGetDescr(rel), &isnull);
+		if (isnull)
+			continue;
+
+		config = DatumGetArrayTypeP(d);
+		deconstruct_array(config, TEXTOID, -1, false, 'i', &elems, NULL, &nelems);
+
+		for (i = 0; i < nelems; i++)
+		{
+			char *name;
+			char *value;
+			int *result = NULL;
+
+			ParseLongOption(TextDatumGetCString(elems[i]), &name, &value);
+
+			if (pg_strcasecmp(name, "continuous_query_database_num_workers") == 0)
+				result = &db_entry->num_workers;
+			else if (pg_strcasecmp(name, "continuous_query_database_num_combiners") == 0)
+				result = &db_entry->num_combiners;
+
+			if (result && (!value || !parse_int(value, result, 0, NULL) || *result < 0))
+			{
+				elog(WARNING, "ignoring invalid setting for parameter \"%s\" of database \"%s\"",
+						name, NameStr(db_entry->name));
+				*result = 0;
+			}
+
+			free(name);
+			if (value)
+				free(value);
+		}
+	}
+
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+}
+
 static void
 refresh_database_list(void)
 {
@@ -345,6 +1039,8 @@ refresh_database_list(void)
 	heap_endscan(scan);
 	heap_close(pg_database, NoLock);
 
+	read_database_settings(dbs);
+
 	CommitTransactionCommand();
 
 	if (DatabaseList)
@@ -439,6 +1135,10 @@ cont_bgworker_main(Datum arg)
 
 	proc->latch = MyLatch;
 
+	/* a process that exited mid-batch left nothing in flight that survived it */
+	pg_atomic_write_u32(&proc->in_batch, 0);
+	pg_atomic_write_u32(&proc->holding_partials, 0);
+
 	switch (proc->type)
 	{
 		case Combiner:
@@ -450,8 +1150,13 @@ cont_bgworker_main(Datum arg)
 			run = &ContinuousQueryWorkerMain;
 			break;
 		case AdhocVacuumer:
-			/* Clean up and die. */
+			/* Clean up, replay what was logged to streams before the restart, and die. */
 			purge_adhoc_queries();
+			StreamLogReplay();
+			return;
+		case Sink:
+			/* the sink has no IPC queue of its own and no continuous query stats to report */
+			ContinuousQuerySinkMain();
 			return;
 		default:
 			elog(ERROR, "invalid continuous query process type: %d", proc->type);
@@ -465,6 +1170,11 @@ cont_bgworker_main(Datum arg)
 
 	/* Be nice! Give up some CPU. */
 	SetNicePriority();
+	SetNumaAffinity(GetContQueryNumaNode(proc->group_id));
+
+	/* an explicit CPU list takes precedence over the NUMA node's CPUs */
+	SetCPUAffinity(proc->type == Combiner ? continuous_query_combiner_cpus : continuous_query_worker_cpus);
+	JoinCGroup(continuous_query_cgroup);
 
 	/* Run the continuous execution function. */
 	run();
@@ -526,9 +1236,12 @@ run_cont_bgworker(ContQueryProc *proc)
 	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
 	worker.bgw_main = cont_bgworker_main;
 	worker.bgw_notify_pid = 0;
-	worker.bgw_restart_time = 1; /* recover in 1s */
+	worker.bgw_restart_time = continuous_query_restart_delay;
 	worker.bgw_main_arg = PointerGetDatum(proc);
 
+	/* a process that was just started hasn't been busy or idle for any time yet */
+	proc->last_idle = proc->last_busy = GetCurrentTimestamp();
+
 	success = RegisterDynamicBackgroundWorker(&worker, &handle);
 
 	if (success)
@@ -568,12 +1281,31 @@ terminate_database_workers(ContQueryDatabaseMetadata *db_meta)
 	SpinLockAcquire(&db_meta->mutex);
 
 	for (i = 0; i < NUM_BG_WORKERS_PER_DB; i++)
-		TerminateBackgroundWorker(db_meta->db_procs[i].bgw_handle);
+	{
+		if (db_meta->db_procs[i].bgw_handle)
+			TerminateBackgroundWorker(db_meta->db_procs[i].bgw_handle);
+	}
 
 	wait_for_db_workers(db_meta, BGWH_STOPPED);
 
 	for (i = 0; i < NUM_BG_WORKERS_PER_DB; i++)
-		pfree(db_meta->db_procs[i].bgw_handle);
+	{
+		if (db_meta->db_procs[i].bgw_handle)
+			pfree(db_meta->db_procs[i].bgw_handle);
+		db_meta->db_procs[i].bgw_handle = NULL;
+	}
+
+	/* the sink is stopped last, since workers may be waiting for it to make room in its queue */
+	if (db_meta->sink.bgw_handle)
+	{
+		TerminateBackgroundWorker(db_meta->sink.bgw_handle);
+		if (!wait_for_bg_worker_state(db_meta->sink.bgw_handle, BGWH_STOPPED, BG_PROC_STATUS_TIMEOUT))
+			elog(WARNING, "timed out waiting for continuous query process \"%s\" to reach state %d",
+					GetContQueryProcName(&db_meta->sink), BGWH_STOPPED);
+		pfree(db_meta->sink.bgw_handle);
+		db_meta->sink.bgw_handle = NULL;
+	}
+	db_meta->sink_ready = false;
 
 	db_meta->terminate = false;
 	db_meta->running = false;
@@ -616,10 +1348,11 @@ start_database_workers(ContQueryDatabaseMetadata *db_meta)
 		proc->group_id = group_id;
 		proc->db_meta = db_meta;
 
-		success &= run_cont_bgworker(proc);
+		if (group_id < db_meta->num_workers)
+			success &= run_cont_bgworker(proc);
 	}
 
-	/* Start combiner processes. */
+	/* Start combiner processes, the inactive ones are only started once shards are moved to them. */
 	for (group_id = 0; slot_idx < NUM_BG_WORKERS_PER_DB; slot_idx++, group_id++)
 	{
 		proc = &db_meta->db_procs[slot_idx];
@@ -630,7 +1363,8 @@ start_database_workers(ContQueryDatabaseMetadata *db_meta)
 		proc->group_id = group_id;
 		proc->db_meta = db_meta;
 
-		success &= run_cont_bgworker(proc);
+		if (group_id < db_meta->num_active_combiners)
+			success &= run_cont_bgworker(proc);
 	}
 
 	/* Start a single adhoc process for initial state clean up. */
@@ -643,6 +1377,16 @@ start_database_workers(ContQueryDatabaseMetadata *db_meta)
 
 	success &= run_cont_bgworker(proc);
 
+	/* Start the sink process, which creates its queue once it's running. */
+	proc = &db_meta->sink;
+	MemSet(proc, 0, sizeof(ContQueryProc));
+
+	proc->type = Sink;
+	proc->db_meta = db_meta;
+
+	db_meta->sink_ready = false;
+	success &= run_cont_bgworker(proc);
+
 	SpinLockRelease(&db_meta->mutex);
 
 	if (!success)
@@ -655,6 +1399,170 @@ start_database_workers(ContQueryDatabaseMetadata *db_meta)
 	db_meta->running = true;
 }
 
+/*
+ * target_num_active_combiners
+ *
+ * Returns the number of combiners the database's shards should be spread over. When autoscaling,
+ * a combiner is added once every active one has had a backlog for continuous_query_combiner_autoscale_busy_time,
+ * and one is removed once any of them has had nothing to do for continuous_query_combiner_autoscale_idle_time.
+ * Shards are spread evenly, so an idle combiner means that the others have room for its share as well.
+ * The count is only changed once per busy time, so that the effect of the last change is seen first.
+ */
+static int
+target_num_active_combiners(ContQueryDatabaseMetadata *db_meta)
+{
+	int nactive = db_meta->num_active_combiners;
+	bool all_busy = true;
+	bool any_idle = false;
+	TimestampTz now;
+	int i;
+
+	if (continuous_query_num_active_combiners > 0)
+		return Min(continuous_query_num_active_combiners, db_meta->num_combiners);
+
+	if (!continuous_query_combiner_autoscale)
+		return db_meta->num_combiners;
+
+	/* databases start out with a single combiner */
+	if (nactive == 0)
+		return 1;
+
+	now = GetCurrentTimestamp();
+
+	if (!TimestampDifferenceExceeds(db_meta->last_autoscale, now, continuous_query_combiner_autoscale_busy_time))
+		return nactive;
+
+	for (i = 0; i < nactive; i++)
+	{
+		ContQueryProc *proc = COMBINER_PROC(db_meta, i);
+
+		if (!TimestampDifferenceExceeds(proc->last_idle, now, continuous_query_combiner_autoscale_busy_time))
+			all_busy = false;
+		if (TimestampDifferenceExceeds(proc->last_busy, now, continuous_query_combiner_autoscale_idle_time))
+			any_idle = true;
+	}
+
+	if (all_busy && nactive < db_meta->num_combiners)
+		return nactive + 1;
+	if (any_idle && nactive > 1)
+		return nactive - 1;
+
+	return nactive;
+}
+
+/*
+ * combiner_is_running
+ *
+ * Combiners that crashed are restarted by the postmaster, so only ones that were never started
+ * or were terminated aren't running
+ */
+static bool
+combiner_is_running(ContQueryProc *proc)
+{
+	pid_t pid;
+
+	if (proc->bgw_handle == NULL)
+		return false;
+
+	return GetBackgroundWorkerPid(proc->bgw_handle, &pid) != BGWH_STOPPED;
+}
+
+/*
+ * update_active_combiners
+ *
+ * Starts any combiners the database's shards are about to be spread over that aren't running
+ */
+static void
+update_active_combiners(ContQueryDatabaseMetadata *db_meta)
+{
+	int target = target_num_active_combiners(db_meta);
+	int i;
+
+	for (i = 0; i < target; i++)
+	{
+		ContQueryProc *proc = COMBINER_PROC(db_meta, i);
+
+		if (combiner_is_running(proc))
+			continue;
+
+		if (proc->bgw_handle)
+			pfree(proc->bgw_handle);
+
+		if (!run_cont_bgworker(proc))
+		{
+			ereport(WARNING,
+					(errmsg("could not start continuous query process \"%s\"", GetContQueryProcName(proc)),
+					 errhint("Increase max_worker_processes to enable more capacity.")));
+			break;
+		}
+
+		if (!wait_for_bg_worker_state(proc->bgw_handle, BGWH_STARTED, BG_PROC_STATUS_TIMEOUT))
+			elog(WARNING, "timed out waiting for continuous query process \"%s\" to reach state %d",
+					GetContQueryProcName(proc), BGWH_STARTED);
+	}
+
+	/* shards must never be moved to a combiner that isn't running */
+	target = Max(i, 1);
+
+	if (target == db_meta->num_active_combiners)
+		return;
+
+	ereport(LOG,
+			(errmsg("changing the number of active combiners of database \"%s\" from %d to %d",
+					NameStr(db_meta->db_name), db_meta->num_active_combiners, target)));
+
+	db_meta->num_active_combiners = target;
+	db_meta->last_autoscale = GetCurrentTimestamp();
+}
+
+/*
+ * retire_idle_combiners
+ *
+ * Terminates the inactive combiners that have released all of their shards. Messages for shards
+ * that were moved away from a combiner may still reach it, which it forwards to their new owners,
+ * so it's only terminated once it has found its queue empty.
+ */
+static void
+retire_idle_combiners(ContQueryDatabaseMetadata *db_meta)
+{
+	CombinerShard *shards = db_meta->combiner_shards;
+	bool has_shards[continuous_query_num_combiners];
+	int i;
+
+	MemSet(has_shards, 0, sizeof(has_shards));
+
+	for (i = 0; i < NUM_COMBINER_SHARDS; i++)
+	{
+		has_shards[shards[i].owner] = true;
+		if (shards[i].prev >= 0)
+			has_shards[shards[i].prev] = true;
+	}
+
+	for (i = db_meta->num_active_combiners; i < continuous_query_num_combiners; i++)
+	{
+		ContQueryProc *proc = COMBINER_PROC(db_meta, i);
+
+		if (proc->bgw_handle == NULL || has_shards[i] || proc->last_idle < proc->last_busy)
+			continue;
+
+		TerminateBackgroundWorker(proc->bgw_handle);
+
+		/* if it takes longer than this to stop, it's terminated again the next time around */
+		if (!wait_for_bg_worker_state(proc->bgw_handle, BGWH_STOPPED, BG_PROC_STATUS_TIMEOUT))
+		{
+			elog(WARNING, "timed out waiting for continuous query process \"%s\" to reach state %d",
+					GetContQueryProcName(proc), BGWH_STOPPED);
+			continue;
+		}
+
+		elog(LOG, "stopped idle continuous query process \"%s\"", GetContQueryProcName(proc));
+
+		pfree(proc->bgw_handle);
+		proc->bgw_handle = NULL;
+		proc->latch = NULL;
+	}
+}
+
 static void
 reaper(void)
 {
@@ -703,6 +1611,7 @@ reaper(void)
 		if (!found)
 		{
 			char *pos;
+			int i;
 
 			db_meta = hash_search(ContQuerySchedulerShmem->db_table,
 					&db_entry->oid, HASH_ENTER, &found);
@@ -713,15 +1622,48 @@ reaper(void)
 			namestrcpy(&db_meta->db_name, NameStr(db_entry->name));
 			SpinLockInit(&db_meta->mutex);
 
+			/* the per-database pool sizes can't be more than there are queues for */
+			db_meta->num_workers = continuous_query_num_workers;
+			if (db_entry->num_workers > 0)
+				db_meta->num_workers = Min(db_entry->num_workers, continuous_query_num_workers);
+			db_meta->num_combiners = continuous_query_num_combiners;
+			if (db_entry->num_combiners > 0)
+				db_meta->num_combiners = Min(db_entry->num_combiners, continuous_query_num_combiners);
+
+			db_meta->num_active_combiners = target_num_active_combiners(db_meta);
+			init_combiner_shards(db_meta);
+
 			pos = (char *) db_meta;
 			pos += sizeof(ContQueryDatabaseMetadata);
 			db_meta->db_procs = (ContQueryProc *) pos;
 			pos += sizeof(ContQueryProc) * NUM_BG_WORKERS_PER_DB;
 
+			pg_atomic_init_u32(&db_meta->flushes_pending, 0);
+			pg_atomic_init_u64(&db_meta->shard_releases, 0);
+			for (i = 0; i < NUM_BG_WORKERS_PER_DB; i++)
+			{
+				pg_atomic_init_u32(&db_meta->db_procs[i].in_batch, 0);
+				pg_atomic_init_u32(&db_meta->db_procs[i].holding_partials, 0);
+				pg_atomic_init_u64(&db_meta->db_procs[i].batches_done, 0);
+				pg_atomic_init_u64(&db_meta->db_procs[i].committed_pos, 0);
+			}
+		}
+
+		if (!db_meta->running)
+		{
+			/* with lazy activation, a database's processes are only started once a backend needs them */
+			if (continuous_query_lazy_activation && !db_meta->activate)
+				continue;
+
+			db_meta->last_autoscale = GetCurrentTimestamp();
 			start_database_workers(db_meta);
 		}
 
-		Assert(db_meta->running);
+		update_active_combiners(db_meta);
+		rebalance_combiner_shards(db_meta);
+
+		if (continuous_query_combiner_autoscale)
+			retire_idle_combiners(db_meta);
 	}
 }
 
@@ -791,6 +1733,9 @@ ContQuerySchedulerMain(int argc, char *argv[])
 
 	SetProcessingMode(NormalProcessing);
 
+	SetCPUAffinity(continuous_query_scheduler_cpus);
+	JoinCGroup(continuous_query_cgroup);
+
 	/*
 	 * Create a memory context that we will do all our work in.  We do this so
 	 * that we can reset the context during error recovery and thereby avoid
@@ -856,7 +1801,7 @@ ContQuerySchedulerMain(int argc, char *argv[])
 	ContQuerySchedulerShmem->pid = MyProcPid;
 
 	refresh_database_list();
-	if (list_length(DatabaseList) * (NUM_BG_WORKERS_PER_DB + 1) > max_worker_processes)
+	if (list_length(DatabaseList) * (NUM_BG_WORKERS_PER_DB + 1) + (continuous_query_metrics_port > 0) > max_worker_processes)
 		ereport(ERROR,
 				(errmsg("%d background worker slots are required but there are only %d available",
 						list_length(DatabaseList) * NUM_BG_WORKERS_PER_DB, max_worker_processes),
@@ -867,6 +1812,10 @@ ContQuerySchedulerMain(int argc, char *argv[])
 	{
 		int rc;
 
+		/* retried until there's a free background worker slot for it */
+		if (continuous_query_metrics_port > 0 && !ContQuerySchedulerShmem->metrics_exporter_started)
+			ContQuerySchedulerShmem->metrics_exporter_started = StartContQueryMetricsExporter();
+
 		reaper();
 
 		/*
@@ -1002,6 +1951,57 @@ GetContQueryDatabaseMetadata(Oid db_oid)
 	return db_meta;
 }
 
+/*
+ * IsContQueryFlushPending
+ *
+ * Is a pipeline_flush waiting for this database's processes? Workers then don't hold on to
+ * partial results and combiners commit after every batch, until it's done.
+ */
+bool
+IsContQueryFlushPending(void)
+{
+	if (!MyContQueryProc)
+		return false;
+
+	return pg_atomic_read_u32(&MyContQueryProc->db_meta->flushes_pending) > 0;
+}
+
+/*
+ * ContQueryProcStartBatch
+ *
+ * Must be called before a batch reads anything, so that pipeline_flush knows anything
+ * consumed from queues from now on may still be in flight in this process
+ */
+void
+ContQueryProcStartBatch(void)
+{
+	pg_atomic_write_u32(&MyContQueryProc->in_batch, 1);
+}
+
+/*
+ * ContQueryProcEndBatch
+ *
+ * Called once everything a batch consumed has been sent on
+ */
+void
+ContQueryProcEndBatch(bool holding)
+{
+	pg_atomic_write_u32(&MyContQueryProc->holding_partials, holding);
+	pg_atomic_write_u32(&MyContQueryProc->in_batch, 0);
+	pg_atomic_fetch_add_u64(&MyContQueryProc->batches_done, 1);
+}
+
+/*
+ * ContQueryProcCommitted
+ *
+ * Called by combiners once everything they've consumed from their queue has been committed
+ */
+void
+ContQueryProcCommitted(ipc_queue *ipcq)
+{
+	pg_atomic_write_u64(&MyContQueryProc->committed_pos, pg_atomic_read_u64(&ipcq->tail));
+}
+
 /*
  * SignalContQuerySchedulerRefreshDBList
  */
@@ -18,10 +18,17 @@
 #include "catalog/pipeline_query_fn.h"
 #include "executor/execdesc.h"
 #include "executor/executor.h"
+#include "executor/hashjoin.h"
+#include "executor/tstoreReceiver.h"
 #include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "parser/parsetree.h"
 #include "pgstat.h"
 #include "pipeline/combinerReceiver.h"
+#include "pipeline/cont_analyze.h"
 #include "pipeline/cont_execute.h"
+#include "pipeline/cont_instrument.h"
+#include "pipeline/cont_memory.h"
 #include "pipeline/cont_plan.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/cqmatrel.h"
@@ -31,18 +38,60 @@
 #include "tcop/dest.h"
 #include "utils/builtins.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/memutils.h"
 #include "utils/resowner.h"
 #include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
 
 static ResourceOwner WorkerResOwner = NULL;
 
+/* guc parameters */
+bool continuous_query_reuse_worker_plans;
+int continuous_query_join_cache_max_age;
+bool continuous_query_worker_share_sw_steps;
+bool continuous_query_fuse_transforms;
+
+/* minimum time in ms between checks of whether the tables behind cached joins have been modified */
+#define JOIN_CACHE_CHECK_INTERVAL 1000
+
+/* incremented by every catalog invalidation that may affect a kept plan */
+static uint64 worker_plan_invals = 0;
+
+/* a view of a merge group whose partial results are computed by the plan of its first view */
+typedef struct MergedView
+{
+	Oid id;
+	Oid relid;
+	/* the attribute of the merged plan each of the view's worker attributes is found at */
+	AttrNumber *attmap;
+	TupleDesc desc;
+} MergedView;
+
 typedef struct {
 	ContQueryState base;
 	DestReceiver *dest;
 	QueryDesc *query_desc;
 	AttrNumber *groupatts;
 	FuncExpr *hashfunc;
+	/* whether the initialized plan may be kept across batches */
+	bool reusable;
+	/* context holding a kept plan, along with the value of worker_plan_invals it was initialized at */
+	MemoryContext plan_cxt;
+	uint64 plan_invals;
+	/* tables read by the inner side of hash joins and by subqueries whose results are kept along with the plan */
+	List *join_relids;
+	PgStat_Counter join_changes;
+	TimestampTz join_built;
+	TimestampTz join_checked;
+	/* equal for sliding-window views producing the same step-level partial results, NULL otherwise */
+	char *share_key;
+	/* step size the plan and share key of a sliding-window view were built for */
+	int step_ms;
+	/* for the first view of a merge group, the views its plan computes the partial results of, itself first */
+	List *merged;
+	TupleDesc merged_desc;
 } ContQueryWorkerState;
 
 static void
@@ -67,15 +116,378 @@ set_cont_executor(PlanState *planstate, ContExecutor *exec)
 		set_cont_executor(((SubqueryScanState *) planstate)->subplan, exec);
 		return;
 	}
+	else if (IsA(planstate, AppendState))
+	{
+		/* UNION ALLs of streams read each of them with one of the append's subplans */
+		AppendState *append = (AppendState *) planstate;
+		int i;
+
+		for (i = 0; i < append->as_nplans; i++)
+			set_cont_executor(append->appendplans[i], exec);
+		return;
+	}
 
 	set_cont_executor(planstate->lefttree, exec);
 	set_cont_executor(planstate->righttree, exec);
 }
 
+static bool plan_reads_tables_only(PlannedStmt *pstmt, Plan *plan, List **relids);
+
+/*
+ * collect_subplans_walker
+ */
+static bool
+collect_subplans_walker(Node *node, List **subplans)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, SubPlan))
+		*subplans = lappend(*subplans, node);
+
+	return expression_tree_walker(node, collect_subplans_walker, (void *) subplans);
+}
+
+/*
+ * subplans_are_cacheable
+ *
+ * Uncorrelated subqueries over tables, such as x IN (SELECT id FROM allowed) or x > (SELECT min(v) FROM
+ * thresholds), are only evaluated once by a kept plan: rescans leave the values of initPlans and the hash
+ * tables of hashed subplans alone unless a param they depend on changed, and these don't depend on any.
+ * Any subplan of the given node must be such a subquery, and the tables it reads are added to relids.
+ */
+static bool
+subplans_are_cacheable(PlannedStmt *pstmt, Plan *plan, List **relids)
+{
+	List *subplans = list_copy(plan->initPlan);
+	ListCell *lc;
+
+	collect_subplans_walker((Node *) plan->targetlist, &subplans);
+	collect_subplans_walker((Node *) plan->qual, &subplans);
+
+	if (IsA(plan, Result))
+		collect_subplans_walker(((Result *) plan)->resconstantqual, &subplans);
+	else if (IsA(plan, HashJoin))
+	{
+		collect_subplans_walker((Node *) ((HashJoin *) plan)->join.joinqual, &subplans);
+		collect_subplans_walker((Node *) ((HashJoin *) plan)->hashclauses, &subplans);
+	}
+
+	foreach(lc, subplans)
+	{
+		SubPlan *sub = (SubPlan *) lfirst(lc);
+		Plan *subplan = (Plan *) list_nth(pstmt->subplans, sub->plan_id - 1);
+
+		if (sub->parParam != NIL || !plan_reads_tables_only(pstmt, subplan, relids))
+		{
+			list_free(subplans);
+			return false;
+		}
+	}
+
+	list_free(subplans);
+
+	return true;
+}
+
+/*
+ * plan_reads_tables_only
+ *
+ * Can the given plan be executed once and have its output reused by every batch? The relids of the
+ * tables it reads are added to relids.
+ */
+static bool
+plan_reads_tables_only(PlannedStmt *pstmt, Plan *plan, List **relids)
+{
+	if (plan == NULL)
+		return true;
+
+	if (!bms_is_empty(plan->extParam) || !subplans_are_cacheable(pstmt, plan, relids))
+		return false;
+
+	switch (nodeTag(plan))
+	{
+		case T_Hash:
+		case T_Material:
+		case T_Sort:
+		case T_Result:
+		case T_Agg:
+		case T_Limit:
+		case T_Unique:
+		case T_BitmapIndexScan:
+			break;
+		case T_SeqScan:
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+		case T_BitmapHeapScan:
+		{
+			RangeTblEntry *rte = rt_fetch(((Scan *) plan)->scanrelid, pstmt->rtable);
+
+			if (rte->rtekind != RTE_RELATION || IsStream(rte->relid))
+				return false;
+
+			*relids = list_append_unique_oid(*relids, rte->relid);
+			break;
+		}
+		default:
+			return false;
+	}
+
+	return plan_reads_tables_only(pstmt, plan->lefttree, relids) &&
+			plan_reads_tables_only(pstmt, plan->righttree, relids);
+}
+
+/*
+ * plan_is_reusable
+ *
+ * Kept plans are rescanned instead of being reinitialized for each batch, so we only keep plans
+ * made of nodes whose rescan discards everything computed during the previous batch, and that
+ * don't read anything but streams. The exceptions are the inner side of stream-table hash joins,
+ * whose hash table is kept along with the plan, and uncorrelated subqueries over tables, whose results
+ * are. The tables read by those are added to join_relids.
+ */
+static bool
+plan_is_reusable(PlannedStmt *pstmt, Plan *plan, List **join_relids)
+{
+	if (plan == NULL)
+		return true;
+
+	if (!subplans_are_cacheable(pstmt, plan, join_relids))
+		return false;
+
+	switch (nodeTag(plan))
+	{
+		case T_Agg:
+		case T_Sort:
+		case T_Result:
+			break;
+		case T_ForeignScan:
+		{
+			RangeTblEntry *rte = rt_fetch(((Scan *) plan)->scanrelid, pstmt->rtable);
+
+			if (!IsStream(rte->relid))
+				return false;
+			break;
+		}
+		case T_HashJoin:
+			if (!plan_reads_tables_only(pstmt, plan->righttree, join_relids))
+				return false;
+			return plan_is_reusable(pstmt, plan->lefttree, join_relids);
+		default:
+			return false;
+	}
+
+	return plan_is_reusable(pstmt, plan->lefttree, join_relids) &&
+			plan_is_reusable(pstmt, plan->righttree, join_relids);
+}
+
+/*
+ * should_keep_plan
+ *
+ * Plans with cached joins or subqueries are governed by continuous_query_join_cache_max_age, everything else
+ * by continuous_query_reuse_worker_plans
+ */
+static bool
+should_keep_plan(ContQueryWorkerState *state)
+{
+	if (!state->reusable)
+		return false;
+
+	if (state->join_relids)
+		return continuous_query_join_cache_max_age > 0;
+
+	return continuous_query_reuse_worker_plans;
+}
+
+/*
+ * get_join_changes
+ *
+ * Returns the number of modifications made to the tables behind cached joins, as far as the
+ * stats collector knows
+ */
+static PgStat_Counter
+get_join_changes(ContQueryWorkerState *state)
+{
+	PgStat_Counter changes = 0;
+	ListCell *lc;
+
+	foreach(lc, state->join_relids)
+	{
+		PgStat_StatTabEntry *tabentry = pgstat_fetch_stat_tabentry(lfirst_oid(lc));
+
+		if (tabentry)
+			changes += tabentry->tuples_inserted + tabentry->tuples_updated + tabentry->tuples_deleted;
+	}
+
+	return changes;
+}
+
+/*
+ * join_tables_changed
+ *
+ * Have the tables behind cached joins or subqueries possibly been modified since they were read?
+ * Schema changes are caught by relcache invalidations, but data changes are only noticed through the
+ * stats collector, so the hash tables are also rebuilt once they're continuous_query_join_cache_max_age old.
+ */
+static bool
+join_tables_changed(ContQueryWorkerState *state)
+{
+	TimestampTz now;
+
+	if (state->join_relids == NIL)
+		return false;
+
+	now = GetCurrentTimestamp();
+
+	if (TimestampDifferenceExceeds(state->join_built, now, continuous_query_join_cache_max_age))
+		return true;
+
+	if (!TimestampDifferenceExceeds(state->join_checked, now, JOIN_CACHE_CHECK_INTERVAL))
+		return false;
+
+	state->join_checked = now;
+
+	return get_join_changes(state) != state->join_changes;
+}
+
+/*
+ * join_hash_tables_built
+ *
+ * The inner side of a cached join is never scanned again once its hash table has been built, but we can
+ * only rely on that if the hash table exists and fit in memory
+ */
+static bool
+join_hash_tables_built(PlanState *planstate)
+{
+	if (planstate == NULL)
+		return true;
+
+	if (IsA(planstate, HashJoinState))
+	{
+		HashJoinState *hjs = (HashJoinState *) planstate;
+
+		if (hjs->hj_HashTable == NULL || hjs->hj_HashTable->nbatch != 1)
+			return false;
+
+		return join_hash_tables_built(planstate->lefttree);
+	}
+
+	return join_hash_tables_built(planstate->lefttree) && join_hash_tables_built(planstate->righttree);
+}
+
+static void
+worker_plan_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	worker_plan_invals++;
+}
+
+static void
+worker_plan_relcache_callback(Datum arg, Oid relid)
+{
+	worker_plan_invals++;
+}
+
+/*
+ * get_share_key
+ *
+ * Returns the key identifying the step-level partial results of a grouped sliding-window view.
+ * Views with the same key read the same events and group them the same way, so one view's partial
+ * results can be sent to the others' combiners as is.
+ */
+static char *
+get_share_key(ContQueryState *base, FuncExpr *hash)
+{
+	MemoryContext old = MemoryContextSwitchTo(base->tmp_cxt);
+	char *key = GetSWStepKey(base->query->name);
+
+	MemoryContextSwitchTo(old);
+
+	if (key)
+		key = psprintf("%d %u %s", base->query->sw_step_ms, hash->funcid, key);
+
+	MemoryContextReset(base->tmp_cxt);
+
+	return key;
+}
+
+/*
+ * get_merged_plan
+ *
+ * The first view of a merge group plans its worker query merged with those of the others it
+ * only differs from in its aggregates, so that one plan reads and groups their events for all of
+ * them. Returns NULL if the view isn't the first of its group or there's nothing to merge.
+ */
+static PlannedStmt *
+get_merged_plan(ContQueryWorkerState *state)
+{
+	ContQuery *query = state->base.query;
+	Bitmapset *ids;
+	List *others = NIL;
+	List *merged;
+	List *attmaps;
+	PlannedStmt *pstmt;
+	ListCell *lc1;
+	ListCell *lc2;
+	int id;
+
+	/* sampling views and views dropping stale events don't read the same events as the rest of their group */
+	if (query->sample_rate || query->max_staleness_ms)
+		return NULL;
+
+	ids = GetContinuousViewIds();
+
+	while ((id = bms_first_member(ids)) >= 0)
+	{
+		ContQuery *other;
+
+		if (id == query->id)
+			continue;
+
+		other = GetContQueryForViewId(id);
+		if (other == NULL || other->merge_group == NULL || other->sample_rate || other->max_staleness_ms ||
+				strcmp(other->merge_group, query->merge_group) != 0)
+			continue;
+
+		if (id < query->id)
+			return NULL;
+
+		others = lappend(others, other);
+	}
+
+	pstmt = GetMergedWorkerPlan(query, others, &merged, &attmaps);
+	if (pstmt == NULL)
+		return NULL;
+
+	state->merged_desc = ExecTypeFromTL(pstmt->planTree->targetlist, false);
+
+	forboth(lc1, merged, lc2, attmaps)
+	{
+		ContQuery *cq = (ContQuery *) lfirst(lc1);
+		MergedView *mv = palloc0(sizeof(MergedView));
+		int natts = 0;
+		int i;
+
+		mv->id = cq->id;
+		mv->relid = cq->relid;
+		mv->attmap = (AttrNumber *) lfirst(lc2);
+
+		while (mv->attmap[natts] != InvalidAttrNumber)
+			natts++;
+
+		mv->desc = CreateTemplateTupleDesc(natts, false);
+		for (i = 0; i < natts; i++)
+			TupleDescCopyEntry(mv->desc, i + 1, state->merged_desc, mv->attmap[i]);
+
+		state->merged = lappend(state->merged, mv);
+	}
+
+	return pstmt;
+}
+
 static ContQueryState *
 init_query_state(ContExecutor *exec, ContQueryState *base)
 {
-	PlannedStmt *pstmt;
+	PlannedStmt *pstmt = NULL;
 	ContQueryWorkerState *state;
 	ResourceOwner res;
 
@@ -98,7 +510,11 @@ init_query_state(ContExecutor *exec, ContQueryState *base)
 		SetTransformDestReceiverParams(state->dest, exec, base->query);
 	}
 
-	pstmt = GetContPlan(base->query, Worker);
+	if (base->query->type == CONT_VIEW && base->query->merge_group)
+		pstmt = get_merged_plan(state);
+	if (pstmt == NULL)
+		pstmt = GetContPlan(base->query, Worker);
+
 	state->query_desc = CreateQueryDesc(pstmt, NULL, InvalidSnapshot, InvalidSnapshot, state->dest, NULL, 0);
 	state->query_desc->snapshot = GetTransactionSnapshot();
 	state->query_desc->snapshot->copied = true;
@@ -143,6 +559,10 @@ init_query_state(ContExecutor *exec, ContQueryState *base)
 			}
 
 			SetCombinerDestReceiverHashFunc(state->dest, hash);
+			state->hashfunc = hash;
+
+			if (base->query->is_sw)
+				state->share_key = get_share_key(base, hash);
 		}
 
 		CQMatRelClose(ri);
@@ -150,6 +570,13 @@ init_query_state(ContExecutor *exec, ContQueryState *base)
 	}
 
 	state->query_desc->estate->es_lastoid = InvalidOid;
+	state->step_ms = base->query->sw_step_ms;
+
+	state->reusable = plan_is_reusable(pstmt, pstmt->planTree, &state->join_relids);
+	state->plan_cxt = AllocSetContextCreate(base->state_cxt, "WorkerPlanCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
 
 	(*state->dest->rStartup) (state->dest, state->query_desc->operation, state->query_desc->tupDesc);
 
@@ -216,17 +643,326 @@ end_plan(QueryDesc *query_desc)
 	query_desc->planstate = NULL;
 }
 
+/*
+ * rescan_plan
+ *
+ * Prepare a kept plan for the next batch, or any plan for another pass over the current one if full
+ * is set. Each node's children are flagged as changed before the node is rescanned, so that it discards
+ * anything it computed from them rather than reusing it. Unless full is set, the hash tables of joins
+ * are kept. This must be called before the memory used while executing the plan is released, since
+ * nodes may release some of it themselves.
+ */
+static void
+rescan_plan(PlanState *planstate, bool full)
+{
+	if (planstate == NULL)
+		return;
+
+	if (IsA(planstate, HashJoinState) && !full)
+	{
+		/*
+		 * The inner side is left alone so that the join keeps its hash table for the next batch,
+		 * which join_hash_tables_built ensures it can.
+		 */
+		planstate->lefttree->chgParam = bms_add_member(planstate->lefttree->chgParam, 0);
+		ExecReScan(planstate);
+		rescan_plan(planstate->lefttree, full);
+		return;
+	}
+
+	if (planstate->lefttree)
+		planstate->lefttree->chgParam = bms_add_member(planstate->lefttree->chgParam, 0);
+	if (planstate->righttree)
+		planstate->righttree->chgParam = bms_add_member(planstate->righttree->chgParam, 0);
+
+	ExecReScan(planstate);
+
+	rescan_plan(planstate->lefttree, full);
+	rescan_plan(planstate->righttree, full);
+}
+
+/*
+ * release_plan
+ *
+ * End a plan kept across batches
+ */
+static void
+release_plan(ContQueryWorkerState *state)
+{
+	end_plan(state->query_desc);
+	FreeExecutorState(state->query_desc->estate);
+	state->query_desc->estate = NULL;
+
+	MemoryContextReset(state->plan_cxt);
+}
+
+/*
+ * replan_sw_steps
+ *
+ * Rebuild the plan of a sliding-window view whose step size has changed, since it truncates
+ * arrival timestamps to the old steps. Its share key was computed for the old steps too.
+ */
+static void
+replan_sw_steps(ContQueryWorkerState *state)
+{
+	MemoryContext old;
+
+	if (state->query_desc->estate)
+		release_plan(state);
+
+	old = MemoryContextSwitchTo(state->base.state_cxt);
+
+	state->query_desc->plannedstmt = GetContPlan(state->base.query, Worker);
+
+	if (state->share_key)
+	{
+		pfree(state->share_key);
+		state->share_key = get_share_key(&state->base, state->hashfunc);
+	}
+
+	MemoryContextSwitchTo(old);
+
+	state->step_ms = state->base.query->sw_step_ms;
+}
+
+/*
+ * flush_held_partials
+ *
+ * Partial results held across batches must reach combiners within continuous_query_worker_partials_max_wait,
+ * even if their queries haven't read anything since. Returns true if any partial results are still held.
+ */
+static bool
+flush_held_partials(ContExecutor *exec)
+{
+	bool held = false;
+	List *states = ContExecutorGetStates(exec);
+	ListCell *lc;
+
+	foreach(lc, states)
+	{
+		ContQueryWorkerState *state = (ContQueryWorkerState *) lfirst(lc);
+
+		if (state->base.query == NULL || state->dest->mydest != DestCombiner ||
+				!CombinerDestReceiverHasHeldPartials(state->dest))
+			continue;
+
+		CombinerDestReceiverFlush(state->dest);
+
+		if (CombinerDestReceiverHasHeldPartials(state->dest))
+			held = true;
+	}
+
+	list_free(states);
+
+	return held;
+}
+
+/*
+ * same_events
+ *
+ * Does the batch being executed contain exactly the same events for both given queries?
+ */
+static bool
+same_events(ContExecutor *exec, Oid a, Oid b)
+{
+	return ContExecutorSameMessages(exec, a, b);
+}
+
+/*
+ * share_partials
+ *
+ * Sliding-window views that only differ in window length produce the same step-level partial results,
+ * so the first one of them executed in a batch also sends its partial results to the others that were
+ * given exactly the same events, which then skip this batch. This runs after the plan has read all of
+ * its events, at which point all of the batch's events have been peeked. Returns the queries to skip.
+ */
+static Bitmapset *
+share_partials(ContExecutor *exec, ContQueryWorkerState *state, Bitmapset *shared)
+{
+	Bitmapset *pending;
+	int id;
+
+	/* sampling queries and queries dropping stale events don't read the same events as their twins */
+	if (!continuous_query_worker_share_sw_steps || state->share_key == NULL || state->base.query->sample_rate ||
+			state->base.query->max_staleness_ms)
+		return shared;
+
+	pending = bms_copy(exec->exec_queries);
+
+	while ((id = bms_first_member(pending)) >= 0)
+	{
+		ContQueryWorkerState *twin = (ContQueryWorkerState *) ContExecutorGetState(exec, id);
+		MemoryContext old;
+
+		/* a twin whose step size just changed recomputes its share key the next time it executes */
+		if (twin == NULL || twin->base.query == NULL || twin->share_key == NULL ||
+				twin->step_ms != twin->base.query->sw_step_ms || twin->base.query->sample_rate ||
+				twin->base.query->max_staleness_ms || bms_is_member(id, shared) || strcmp(twin->share_key, state->share_key) != 0)
+			continue;
+
+		if (!same_events(exec, state->base.query_id, id))
+			continue;
+
+		CombinerDestReceiverTee(state->dest, id);
+
+		old = MemoryContextSwitchTo(exec->exec_cxt);
+		shared = bms_add_member(shared, id);
+		MemoryContextSwitchTo(old);
+	}
+
+	bms_free(pending);
+
+	return shared;
+}
+
+/*
+ * send_merged
+ *
+ * Sends the partial results a merged plan computed for the views of a merge group to each of their
+ * combiners, projected to each view's own worker attributes. As with share_partials, only views that
+ * were given exactly the same events as the one whose plan it is are sent theirs, and they then skip
+ * this batch, while the others execute their own plans. Returns the queries to skip.
+ */
+static Bitmapset *
+send_merged(ContExecutor *exec, ContQueryWorkerState *state, Tuplestorestate *store, Bitmapset *shared)
+{
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(state->merged_desc);
+	int n = list_length(state->merged);
+	MergedView **views = palloc(sizeof(MergedView *) * n);
+	ContQueryWorkerState **targets = palloc(sizeof(ContQueryWorkerState *) * n);
+	TupleTableSlot **slots = palloc(sizeof(TupleTableSlot *) * n);
+	ListCell *lc;
+	int ntargets = 0;
+	int i;
+	int j;
+
+	foreach(lc, state->merged)
+	{
+		MergedView *mv = (MergedView *) lfirst(lc);
+		ContQueryWorkerState *target = state;
+
+		/* views that aren't loaded yet or have since been replaced by another one with their id plan themselves */
+		if (mv->id != state->base.query_id)
+		{
+			target = (ContQueryWorkerState *) ContExecutorGetState(exec, mv->id);
+
+			if (target == NULL || target->base.query == NULL || target->base.query->relid != mv->relid ||
+					!bms_is_member(mv->id, exec->exec_queries) || bms_is_member(mv->id, shared) ||
+					!same_events(exec, state->base.query_id, mv->id))
+				continue;
+		}
+
+		views[ntargets] = mv;
+		targets[ntargets] = target;
+		slots[ntargets] = MakeSingleTupleTableSlot(mv->desc);
+		ntargets++;
+	}
+
+	while (tuplestore_gettupleslot(store, true, false, slot))
+	{
+		slot_getallattrs(slot);
+
+		for (i = 0; i < ntargets; i++)
+		{
+			TupleTableSlot *out = slots[i];
+
+			ExecClearTuple(out);
+			for (j = 0; j < views[i]->desc->natts; j++)
+			{
+				out->tts_values[j] = slot->tts_values[views[i]->attmap[j] - 1];
+				out->tts_isnull[j] = slot->tts_isnull[views[i]->attmap[j] - 1];
+			}
+			ExecStoreVirtualTuple(out);
+
+			(*targets[i]->dest->receiveSlot) (out, targets[i]->dest);
+		}
+	}
+
+	for (i = 0; i < ntargets; i++)
+	{
+		MemoryContext old;
+
+		ExecDropSingleTupleTableSlot(slots[i]);
+
+		if (targets[i] == state)
+			continue;
+
+		flush_tuples(targets[i]);
+
+		old = MemoryContextSwitchTo(exec->exec_cxt);
+		shared = bms_add_member(shared, targets[i]->base.query_id);
+		MemoryContextSwitchTo(old);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	pfree(views);
+	pfree(targets);
+	pfree(slots);
+
+	return shared;
+}
+
+/*
+ * prewarm
+ *
+ * Build the plans of every continuous query before we read any input, so that a worker that was just
+ * started, for instance on a promoted standby, doesn't build them all on its first batches
+ */
+static void
+prewarm(ContExecutor *cont_exec)
+{
+	Bitmapset *queries;
+	int id;
+
+	if (!continuous_query_prewarm)
+		return;
+
+	StartTransactionCommand();
+	queries = GetContinuousQueryIds();
+	CommitTransactionCommand();
+
+	while ((id = bms_first_member(queries)) >= 0)
+	{
+		StartTransactionCommand();
+
+		PG_TRY();
+		{
+			ContExecutorWarmQuery(cont_exec, id);
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
+		{
+			EmitErrorReport();
+			FlushErrorState();
+
+			AbortCurrentTransaction();
+		}
+		PG_END_TRY();
+	}
+
+	MemoryContextSwitchTo(TopMemoryContext);
+}
+
 void
 ContinuousQueryWorkerMain(void)
 {
 	ContExecutor *cont_exec = ContExecutorNew(Worker, &init_query_state);
 	Oid query_id;
+	bool held = false;
+	Bitmapset *volatile shared;
+	ListCell *lc;
 
 	WorkerResOwner = ResourceOwnerCreate(NULL, "WorkerResOwner");
 
 	/* Workers never perform any writes, so only need read only transactions. */
 	XactReadOnly = true;
 
+	/* Kept plans are rebuilt after anything they may depend on changes */
+	CacheRegisterSyscacheCallback(PIPELINEQUERYID, worker_plan_syscache_callback, (Datum) 0);
+	CacheRegisterRelcacheCallback(worker_plan_relcache_callback, (Datum) 0);
+
+	prewarm(cont_exec);
+
 	for (;;)
 	{
 		CHECK_FOR_INTERRUPTS();
@@ -234,13 +970,24 @@ ContinuousQueryWorkerMain(void)
 		if (ShouldTerminateContQueryProcess())
 			break;
 
-		ContExecutorStartBatch(cont_exec, 0);
+		/* wake up in time to flush any partial results we're holding on to */
+		ContExecutorStartBatch(cont_exec, held ? continuous_query_worker_partials_max_wait : 0);
+		ContQueryProcStartBatch();
+		shared = NULL;
 
 		while ((query_id = ContExecutorStartNextQuery(cont_exec, 0)) != InvalidOid)
 		{
 			EState *estate = NULL;
 			ContQueryWorkerState *state = (ContQueryWorkerState *) cont_exec->current_query;
+			Tuplestorestate *store = NULL;
+			DestReceiver *dest;
 			volatile bool error = false;
+			bool keep;
+			bool instrumented;
+
+			/* another view already sent this batch's partial results to this one's combiners */
+			if (bms_is_member(query_id, shared))
+				goto next;
 
 			PG_TRY();
 			{
@@ -248,20 +995,107 @@ ContinuousQueryWorkerMain(void)
 					goto next;
 
 				MemoryContextSwitchTo(state->base.tmp_cxt);
-				state->query_desc->estate = estate = CreateEState(state->query_desc);
 
-				SetEStateSnapshot(estate);
-				CurrentResourceOwner = WorkerResOwner;
+				/* a kept plan is rebuilt if anything it may depend on has changed */
+				if (state->query_desc->estate &&
+						(!should_keep_plan(state) || state->plan_invals != worker_plan_invals ||
+						 join_tables_changed(state)))
+				{
+					CurrentResourceOwner = WorkerResOwner;
+					release_plan(state);
+				}
+
+				if (state->base.query->is_sw && state->step_ms != state->base.query->sw_step_ms)
+				{
+					CurrentResourceOwner = WorkerResOwner;
+					replan_sw_steps(state);
+					MemoryContextSwitchTo(state->base.tmp_cxt);
+				}
+
+				keep = should_keep_plan(state);
+
+				if (state->query_desc->estate)
+				{
+					estate = state->query_desc->estate;
+
+					SetEStateSnapshot(estate);
+					CurrentResourceOwner = WorkerResOwner;
+				}
+				else
+				{
+					if (keep)
+					{
+						MemoryContextSwitchTo(state->plan_cxt);
+						state->plan_invals = worker_plan_invals;
+
+						if (state->join_relids)
+						{
+							state->join_changes = get_join_changes(state);
+							state->join_built = state->join_checked = GetCurrentTimestamp();
+						}
+					}
+
+					state->query_desc->estate = estate = CreateEState(state->query_desc);
+
+					SetEStateSnapshot(estate);
+					CurrentResourceOwner = WorkerResOwner;
+
+					/* initialize the plan for execution within this xact */
+					init_plan(state->query_desc);
+
+					if (continuous_query_shared_stream_exprs)
+						ShareStreamExprs(state->query_desc->planstate, query_id);
+
+					MemoryContextSwitchTo(state->base.tmp_cxt);
+				}
 
-				/* initialize the plan for execution within this xact */
-				init_plan(state->query_desc);
 				set_cont_executor(state->query_desc->planstate, cont_exec);
+				instrumented = ContInstrumentStart(query_id, Worker, state->query_desc->planstate);
+
+				/* a merged plan's partial results are only sent once we know which views were given its events */
+				dest = state->dest;
+				if (state->merged)
+				{
+					store = tuplestore_begin_heap(false, false, work_mem);
+					dest = CreateDestReceiver(DestTuplestore);
+					SetTuplestoreDestReceiverParams(dest, store, state->base.tmp_cxt, false);
+				}
 
 				ExecutePlan(estate, state->query_desc->planstate, state->query_desc->operation,
-						true, 0, ForwardScanDirection, state->dest);
+						true, 0, ForwardScanDirection, dest);
+
+				/* stream-stream joins join the buffered events of their first stream in a second pass */
+				if (state->base.streams && StartStreamJoinPass(&state->base))
+				{
+					rescan_plan(state->query_desc->planstate, true);
+					ExecutePlan(estate, state->query_desc->planstate, state->query_desc->operation,
+							true, 0, ForwardScanDirection, dest);
+				}
+
+				if (state->base.streams)
+					EndMultiStreamBatch(&state->base, state->query_desc->planstate);
+
+				if (instrumented)
+					ContInstrumentEnd(query_id, Worker, state->query_desc);
+
+				/* a join that didn't build a reusable hash table would have to scan its table again */
+				if (keep && state->join_relids && !join_hash_tables_built(state->query_desc->planstate))
+					keep = false;
 
 				/* free up any resources used by this plan before committing */
-				end_plan(state->query_desc);
+				if (keep)
+					rescan_plan(state->query_desc->planstate, false);
+				else
+					end_plan(state->query_desc);
+
+				if (store)
+				{
+					shared = send_merged(cont_exec, state, store, shared);
+					tuplestore_end(store);
+				}
+
+				if (state->dest->mydest == DestCombiner)
+					shared = share_partials(cont_exec, state, shared);
 
 				/* flush tuples to combiners or transform out functions */
 				flush_tuples(state);
@@ -270,7 +1104,18 @@ ContinuousQueryWorkerMain(void)
 				MemoryContextSwitchTo(state->base.state_cxt);
 
 				UnsetEStateSnapshot(estate);
-				state->query_desc->estate = estate = NULL;
+
+				if (!keep)
+				{
+					state->query_desc->estate = NULL;
+					MemoryContextReset(state->plan_cxt);
+				}
+				estate = NULL;
+
+				/* a state over its memory limit gives up its kept plan, which is rebuilt on its next batch */
+				if (ContQueryStateReportMemory(&state->base, 0, MemoryContextMemAllocated(state->plan_cxt, true)) &&
+						state->query_desc->estate)
+					release_plan(state);
 			}
 			PG_CATCH();
 			{
@@ -305,20 +1150,21 @@ next:
 			ContExecutorEndQuery(cont_exec);
 		}
 
+		MemoryContextSwitchTo(cont_exec->exec_cxt);
+		held = flush_held_partials(cont_exec);
+
 		ContExecutorEndBatch(cont_exec, true);
+		ContQueryProcEndBatch(held);
 	}
 
 	StartTransactionCommand();
 
-	for (query_id = 0; query_id < MAX_CQS; query_id++)
+	foreach(lc, ContExecutorGetStates(cont_exec))
 	{
-		ContQueryWorkerState *state = (ContQueryWorkerState *) cont_exec->states[query_id];
+		ContQueryWorkerState *state = (ContQueryWorkerState *) lfirst(lc);
 		QueryDesc *query_desc;
 		EState *estate;
 
-		if (state == NULL)
-			continue;
-
 		/*
 		 * We wrap this in a separate try/catch block because ExecInitNode call can potentially throw
 		 * an error if the state was for a stream-table join and the table has been dropped.
@@ -335,6 +1181,11 @@ next:
 				query_desc->estate = estate = CreateEState(state->query_desc);
 				SetEStateSnapshot(estate);
 			}
+			else if (estate->es_snapshot == NULL)
+			{
+				/* kept plans don't hold on to a snapshot between batches */
+				SetEStateSnapshot(estate);
+			}
 
 			/* The cleanup functions below expect these things to be registered. */
 			RegisterSnapshotOnOwner(estate->es_snapshot, WorkerResOwner);
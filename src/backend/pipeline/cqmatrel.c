@@ -12,21 +12,39 @@
  */
 #include "postgres.h"
 
+#include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/itup.h"
 #include "access/xact.h"
+#include "access/xlog.h"
 #include "catalog/index.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_class.h"
+#include "commands/tablecmds.h"
 #include "executor/executor.h"
+#include "nodes/makefuncs.h"
 #include "nodes/execnodes.h"
 #include "pipeline/cqmatrel.h"
 #include "pipeline/miscutils.h"
+#include "storage/bufmgr.h"
 #include "utils/rel.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
+#include "utils/snapmgr.h"
 #include "utils/syscache.h"
+#include "utils/tuplesort.h"
 
 bool continuous_query_materialization_table_updatable;
 
+struct CQMatRelIndexBatch
+{
+	ResultRelInfo *ri;
+	/* for each of the matrel's indexes, its sorted pending entries, or NULL if it's maintained row by row */
+	Tuplesortstate **sorts;
+};
+
 /*
  * CQOSRelOpen
  *
@@ -86,13 +104,96 @@ CQMatRelClose(ResultRelInfo *rinfo)
 	pfree(rinfo);
 }
 
+/*
+ * CQMatRelBeginIndexBatch
+ *
+ * Starts collecting the entries of the given matrel's non-unique btree indexes rather than inserting
+ * them right away. They're sorted and inserted in key order by CQMatRelEndIndexBatch, so that
+ * consecutive inserts go to the same leaf pages instead of to random ones. Unique indexes are still
+ * maintained row by row, so that uniqueness is checked as rows are written. Returns NULL if none of
+ * the matrel's indexes can be batched.
+ */
+CQMatRelIndexBatch *
+CQMatRelBeginIndexBatch(ResultRelInfo *ri, int work_mem)
+{
+	CQMatRelIndexBatch *batch = NULL;
+	int i;
+
+	for (i = 0; i < ri->ri_NumIndices; i++)
+	{
+		Relation index = ri->ri_IndexRelationDescs[i];
+
+		if (index->rd_rel->relam != BTREE_AM_OID || index->rd_index->indisunique ||
+				!ri->ri_IndexRelationInfo[i]->ii_ReadyForInserts)
+			continue;
+
+		if (batch == NULL)
+		{
+			batch = palloc0(sizeof(CQMatRelIndexBatch));
+			batch->ri = ri;
+			batch->sorts = palloc0(sizeof(Tuplesortstate *) * ri->ri_NumIndices);
+		}
+
+		batch->sorts[i] = tuplesort_begin_index_btree(ri->ri_RelationDesc, index, false, work_mem, false);
+	}
+
+	return batch;
+}
+
+/*
+ * CQMatRelEndIndexBatch
+ *
+ * Inserts the index entries collected by the given batch
+ */
+void
+CQMatRelEndIndexBatch(CQMatRelIndexBatch *batch)
+{
+	ResultRelInfo *ri;
+	Datum values[INDEX_MAX_KEYS];
+	bool isnull[INDEX_MAX_KEYS];
+	int i;
+
+	if (batch == NULL)
+		return;
+
+	ri = batch->ri;
+
+	for (i = 0; i < ri->ri_NumIndices; i++)
+	{
+		Relation index = ri->ri_IndexRelationDescs[i];
+		IndexTuple itup;
+		bool should_free;
+
+		if (batch->sorts[i] == NULL)
+			continue;
+
+		tuplesort_performsort(batch->sorts[i]);
+
+		while ((itup = tuplesort_getindextuple(batch->sorts[i], true, &should_free)) != NULL)
+		{
+			index_deform_tuple(itup, RelationGetDescr(index), values, isnull);
+			index_insert(index, values, isnull, &itup->t_tid, ri->ri_RelationDesc, UNIQUE_CHECK_NO);
+
+			if (should_free)
+				pfree(itup);
+		}
+
+		tuplesort_end(batch->sorts[i]);
+	}
+
+	pfree(batch->sorts);
+	pfree(batch);
+}
+
 /*
  * ExecInsertCQMatRelIndexTuples
  *
- * This is a trimmed-down version of ExecInsertIndexTuples
+ * This is a trimmed-down version of ExecInsertIndexTuples. If a batch is given, the entries of
+ * the indexes it collects are added to it rather than inserted.
  */
 void
-ExecInsertCQMatRelIndexTuples(ResultRelInfo *indstate, TupleTableSlot *slot, EState *estate)
+ExecInsertCQMatRelIndexTuples(ResultRelInfo *indstate, TupleTableSlot *slot, EState *estate,
+		CQMatRelIndexBatch *batch)
 {
 	int			i;
 	int			numIndexes;
@@ -140,6 +241,12 @@ ExecInsertCQMatRelIndexTuples(ResultRelInfo *indstate, TupleTableSlot *slot, ESt
 
 		FormIndexDatum(indexInfo, slot, estate, values, isnull);
 
+		if (batch && batch->sorts[i])
+		{
+			tuplesort_putindextuplevalues(batch->sorts[i], relationDescs[i], &(tup->t_self), values, isnull);
+			continue;
+		}
+
 		index_insert(relationDescs[i], values, isnull, &(tup->t_self),
 				heapRelation, relationDescs[i]->rd_index->indisunique ? UNIQUE_CHECK_YES : UNIQUE_CHECK_NO);
 	}
@@ -151,12 +258,12 @@ ExecInsertCQMatRelIndexTuples(ResultRelInfo *indstate, TupleTableSlot *slot, ESt
  * Update an existing row of a CV materialization table.
  */
 void
-ExecCQMatRelUpdate(ResultRelInfo *ri, TupleTableSlot *slot, EState *estate)
+ExecCQMatRelUpdate(ResultRelInfo *ri, TupleTableSlot *slot, EState *estate, CQMatRelIndexBatch *batch)
 {
 	HeapTuple tup = ExecMaterializeSlot(slot);
 	simple_heap_update(ri->ri_RelationDesc, &tup->t_self, tup);
 	if (!HeapTupleIsHeapOnly(tup))
-		ExecInsertCQMatRelIndexTuples(ri, slot, estate);
+		ExecInsertCQMatRelIndexTuples(ri, slot, estate, batch);
 }
 
 /*
@@ -170,7 +277,7 @@ ExecCQMatRelInsert(ResultRelInfo *ri, TupleTableSlot *slot, EState *estate)
 	HeapTuple tup = ExecMaterializeSlot(slot);
 
 	heap_insert(ri->ri_RelationDesc, tup, GetCurrentCommandId(true), 0, NULL);
-	ExecInsertCQMatRelIndexTuples(ri, slot, estate);
+	ExecInsertCQMatRelIndexTuples(ri, slot, estate, NULL);
 }
 
 char *
@@ -205,3 +312,208 @@ CVNameToSeqRelName(char *cv_name)
 
 	return relname;
 }
+
+char *
+CVNameToCkptRelName(char *cv_name)
+{
+	char *relname = palloc0(NAMEDATALEN);
+
+	strcpy(relname, cv_name);
+	append_suffix(relname, CQ_CKPTREL_SUFFIX, NAMEDATALEN);
+
+	return relname;
+}
+
+/*
+ * CQMatRelGetCheckpointRelId
+ *
+ * Returns the OID of the table the given view's matrel is checkpointed to, InvalidOid if the matrel
+ * is logged or there's no such table
+ */
+Oid
+CQMatRelGetCheckpointRelId(char *cv_name, Oid matrelid)
+{
+	HeapTuple tup = SearchSysCache1(RELOID, ObjectIdGetDatum(matrelid));
+	Form_pg_class form;
+	Oid namespace;
+	char persistence;
+
+	if (!HeapTupleIsValid(tup))
+		return InvalidOid;
+
+	form = (Form_pg_class) GETSTRUCT(tup);
+	namespace = form->relnamespace;
+	persistence = form->relpersistence;
+	ReleaseSysCache(tup);
+
+	if (persistence != RELPERSISTENCE_UNLOGGED)
+		return InvalidOid;
+
+	return get_relname_relid(CVNameToCkptRelName(cv_name), namespace);
+}
+
+/*
+ * same_layout
+ *
+ * Can rows of one relation be stored as is in the other?
+ */
+static bool
+same_layout(Relation a, Relation b)
+{
+	TupleDesc da = RelationGetDescr(a);
+	TupleDesc db = RelationGetDescr(b);
+	int i;
+
+	if (da->natts != db->natts)
+		return false;
+
+	for (i = 0; i < da->natts; i++)
+	{
+		if (da->attrs[i]->atttypid != db->attrs[i]->atttypid ||
+				da->attrs[i]->attisdropped != db->attrs[i]->attisdropped)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * CQMatRelCheckpoint
+ *
+ * Replaces the contents of a checkpoint table with the rows of the given matrel visible to the active
+ * snapshot, and returns the number of rows copied or -1 if they no longer fit the checkpoint table.
+ *
+ * The checkpoint table is truncated first, so like COPY into a table truncated in the same transaction,
+ * the copy writes no WAL unless WAL is archived or streamed.
+ */
+int64
+CQMatRelCheckpoint(Oid matrelid, Oid ckptid)
+{
+	TruncateStmt *trunc = makeNode(TruncateStmt);
+	Relation matrel;
+	Relation ckpt;
+	HeapScanDesc scan;
+	HeapTuple tup;
+	BulkInsertState bistate;
+	MemoryContext tmp_cxt;
+	MemoryContext old;
+	CommandId cid;
+	int options = HEAP_INSERT_SKIP_FSM;
+	int64 ntuples = 0;
+
+	Assert(ActiveSnapshotSet());
+
+	trunc->relations = list_make1(makeRangeVar(get_namespace_name(get_rel_namespace(ckptid)),
+			get_rel_name(ckptid), -1));
+	trunc->behavior = DROP_RESTRICT;
+	ExecuteTruncate(trunc);
+	CommandCounterIncrement();
+
+	ckpt = heap_open(ckptid, AccessExclusiveLock);
+	matrel = heap_open(matrelid, AccessShareLock);
+
+	if (!same_layout(matrel, ckpt))
+	{
+		heap_close(matrel, NoLock);
+		heap_close(ckpt, NoLock);
+		return -1;
+	}
+
+	if (!XLogIsNeeded())
+		options |= HEAP_INSERT_SKIP_WAL;
+
+	tmp_cxt = AllocSetContextCreate(CurrentMemoryContext, "CQMatRelCheckpointCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	cid = GetCurrentCommandId(true);
+	bistate = GetBulkInsertState();
+	scan = heap_beginscan(matrel, GetActiveSnapshot(), 0, NULL);
+
+	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		old = MemoryContextSwitchTo(tmp_cxt);
+		heap_insert(ckpt, heap_copytuple(tup), cid, options, bistate);
+		MemoryContextSwitchTo(old);
+		MemoryContextReset(tmp_cxt);
+		ntuples++;
+	}
+
+	heap_endscan(scan);
+	FreeBulkInsertState(bistate);
+	MemoryContextDelete(tmp_cxt);
+
+	if (options & HEAP_INSERT_SKIP_WAL)
+		heap_sync(ckpt);
+
+	heap_close(matrel, NoLock);
+	heap_close(ckpt, NoLock);
+
+	return ntuples;
+}
+
+/*
+ * CQMatRelRestore
+ *
+ * Copies the rows of a checkpoint table into the given matrel if it's empty, as unlogged matrels are
+ * after crash recovery, and returns the number of rows copied or -1 if the matrel wasn't restored.
+ *
+ * The matrel is locked against concurrent writes so that concurrent restores of it are serialized,
+ * and the later ones find it already restored.
+ */
+int64
+CQMatRelRestore(Oid matrelid, Oid ckptid)
+{
+	Relation matrel;
+	Relation ckpt;
+	HeapScanDesc scan;
+	HeapTuple tup;
+	ResultRelInfo *ri;
+	EState *estate;
+	TupleTableSlot *slot;
+	MemoryContext old;
+	int64 ntuples = 0;
+
+	Assert(ActiveSnapshotSet());
+
+	matrel = heap_open(matrelid, ExclusiveLock);
+	ckpt = heap_open(ckptid, AccessShareLock);
+
+	if (RelationGetNumberOfBlocks(matrel) > 0 || !same_layout(matrel, ckpt))
+	{
+		heap_close(matrel, NoLock);
+		heap_close(ckpt, NoLock);
+		return -1;
+	}
+
+	estate = CreateExecutorState();
+	ri = CQMatRelOpen(matrel);
+	slot = MakeSingleTupleTableSlot(RelationGetDescr(matrel));
+
+	scan = heap_beginscan(ckpt, GetActiveSnapshot(), 0, NULL);
+
+	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		ResetPerTupleExprContext(estate);
+		old = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+
+		ExecStoreTuple(heap_copytuple(tup), slot, InvalidBuffer, false);
+		ExecCQMatRelInsert(ri, slot, estate);
+		ExecClearTuple(slot);
+
+		MemoryContextSwitchTo(old);
+		ntuples++;
+	}
+
+	heap_endscan(scan);
+
+	ExecDropSingleTupleTableSlot(slot);
+	CQMatRelClose(ri);
+	FreeExecutorState(estate);
+
+	heap_close(matrel, NoLock);
+	heap_close(ckpt, NoLock);
+
+	return ntuples;
+}
@@ -0,0 +1,380 @@
+/*-------------------------------------------------------------------------
+ *
+ * ddsketch.c
+ *	  DDSketch implementation.
+ *
+ *	  http://www.vldb.org/pvldb/vol12/p2195-masson.pdf
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/ddsketch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "pipeline/ddsketch.h"
+#include "utils/elog.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+
+/*
+ * With a relative error of 1%, 2048 buckets cover values spanning about 18 orders of
+ * magnitude, which is more than enough for latencies measured in anything from
+ * nanoseconds to hours
+ */
+#define DEFAULT_ALPHA 0.01
+#define DEFAULT_MAX_BUCKETS 2048
+
+/* buckets added beyond the ones needed when a store's range grows, so that it doesn't grow one bucket at a time */
+#define GROW_BUCKETS 16
+
+/* keys are clamped to this, which only matters for an alpha so small that no sketch could span its range anyway */
+#define MAX_KEY (PG_INT32_MAX / 2)
+
+/*
+ * A value v > 0 goes in the bucket with the key k such that gamma^(k-1) < v <= gamma^k,
+ * where gamma = (1 + alpha) / (1 - alpha). Every value in that bucket is within a relative
+ * error of alpha of 2 * gamma^k / (1 + gamma), which is what the bucket's values are
+ * estimated as. Negative values are stored by their absolute values in a separate store,
+ * and zeros are only counted.
+ *
+ * Each store is a contiguous range of keys. If a store would need more than max_buckets
+ * buckets, the lowest ones are collapsed into the lowest one that is kept, which only
+ * affects the accuracy of the quantiles of the values closest to zero.
+ */
+
+static int32
+get_key(DDSketch *s, float8 v)
+{
+	float8 k = ceil(log(v) / s->gamma_ln);
+
+	if (k > MAX_KEY)
+		return MAX_KEY;
+	if (k < -MAX_KEY)
+		return -MAX_KEY;
+
+	return (int32) k;
+}
+
+static float8
+get_value(DDSketch *s, int32 key)
+{
+	return 2.0 * exp(key * s->gamma_ln) / (1.0 + exp(s->gamma_ln));
+}
+
+DDSketch *
+DDSketchCreateWithAlpha(float8 alpha)
+{
+	DDSketch *s = palloc0(sizeof(DDSketch));
+
+	s->alpha = alpha;
+	s->gamma_ln = log((1.0 + alpha) / (1.0 - alpha));
+	s->max_buckets = DEFAULT_MAX_BUCKETS;
+	s->min = INFINITY;
+	s->max = -INFINITY;
+
+	SET_VARSIZE(s, DDSketchSize(s));
+
+	return s;
+}
+
+DDSketch *
+DDSketchCreate(void)
+{
+	return DDSketchCreateWithAlpha(DEFAULT_ALPHA);
+}
+
+void
+DDSketchDestroy(DDSketch *s)
+{
+	pfree(s);
+}
+
+DDSketch *
+DDSketchCopy(DDSketch *s)
+{
+	Size size = DDSketchSize(s);
+	char *new = palloc(size);
+	memcpy(new, (char *) s, size);
+	return (DDSketch *) new;
+}
+
+/*
+ * reserve
+ *
+ * Returns a sketch whose positive or negative store covers all keys from lo to hi, collapsing
+ * its lowest buckets if that takes more than max_buckets of them. The given sketch is freed if
+ * it's in the current memory context, the same way repalloc would free it.
+ */
+static DDSketch *
+reserve(DDSketch *s, bool neg, int32 lo, int32 hi)
+{
+	int32 offset = neg ? s->neg_offset : s->pos_offset;
+	uint32 len = neg ? s->neg_len : s->pos_len;
+	uint64 *buckets = neg ? DDSketchNegative(s) : DDSketchPositive(s);
+	int64 new_lo = lo;
+	int64 new_hi = hi;
+	uint32 new_len;
+	uint64 *new_buckets;
+	DDSketch *result;
+	uint32 i;
+
+	if (len && lo >= offset && hi < (int64) offset + len)
+		return s;
+
+	if (len)
+	{
+		new_lo = Min(new_lo, offset);
+		new_hi = Max(new_hi, (int64) offset + len - 1);
+	}
+
+	if (new_hi - new_lo + 1 > s->max_buckets)
+		new_lo = new_hi - s->max_buckets + 1;
+	else if (len)
+	{
+		int64 room = Min(GROW_BUCKETS, s->max_buckets - (new_hi - new_lo + 1));
+
+		if (new_hi > (int64) offset + len - 1)
+			new_hi += room;
+		else
+			new_lo -= room;
+	}
+
+	new_len = new_hi - new_lo + 1;
+
+	result = palloc0(offsetof(DDSketch, buckets) + sizeof(uint64) * (s->pos_len + s->neg_len - len + new_len));
+	memcpy(result, s, offsetof(DDSketch, buckets));
+
+	if (neg)
+	{
+		result->neg_offset = new_lo;
+		result->neg_len = new_len;
+		memcpy(DDSketchPositive(result), DDSketchPositive(s), sizeof(uint64) * s->pos_len);
+		new_buckets = DDSketchNegative(result);
+	}
+	else
+	{
+		result->pos_offset = new_lo;
+		result->pos_len = new_len;
+		memcpy(DDSketchNegative(result), DDSketchNegative(s), sizeof(uint64) * s->neg_len);
+		new_buckets = DDSketchPositive(result);
+	}
+
+	for (i = 0; i < len; i++)
+		new_buckets[Max((int64) offset + i, new_lo) - new_lo] += buckets[i];
+
+	SET_VARSIZE(result, DDSketchSize(result));
+
+	if (MemoryContextContains(CurrentMemoryContext, s))
+		pfree(s);
+
+	return result;
+}
+
+/*
+ * add_to_store
+ *
+ * Adds count values to the bucket with the given key. Keys below the store's range
+ * have been collapsed into its lowest bucket.
+ */
+static DDSketch *
+add_to_store(DDSketch *s, bool neg, int32 key, uint64 count)
+{
+	s = reserve(s, neg, key, key);
+
+	if (neg)
+		DDSketchNegative(s)[Max(key, s->neg_offset) - s->neg_offset] += count;
+	else
+		DDSketchPositive(s)[Max(key, s->pos_offset) - s->pos_offset] += count;
+
+	return s;
+}
+
+DDSketch *
+DDSketchAdd(DDSketch *s, float8 x, uint64 count)
+{
+	if (isnan(x) || isinf(x))
+		elog(ERROR, "ddsketch values must be finite");
+
+	if (count == 0)
+		return s;
+
+	if (x > 0)
+		s = add_to_store(s, false, get_key(s, x), count);
+	else if (x < 0)
+		s = add_to_store(s, true, get_key(s, -x), count);
+	else
+		s->zero_count += count;
+
+	s->count += count;
+	s->min = Min(s->min, x);
+	s->max = Max(s->max, x);
+
+	return s;
+}
+
+/*
+ * merge_store
+ *
+ * Adds the counts of one of the incoming sketch's stores to the same store of the given sketch
+ */
+static DDSketch *
+merge_store(DDSketch *s, DDSketch *incoming, bool neg)
+{
+	int32 offset = neg ? incoming->neg_offset : incoming->pos_offset;
+	uint32 len = neg ? incoming->neg_len : incoming->pos_len;
+	uint64 *buckets = neg ? DDSketchNegative(incoming) : DDSketchPositive(incoming);
+	uint32 lo = 0;
+	uint32 hi = len;
+	uint64 *dest;
+	int32 dest_offset;
+	uint32 i;
+
+	/* the ends of a store's range may be empty, and those don't need any room */
+	while (lo < hi && buckets[lo] == 0)
+		lo++;
+	while (hi > lo && buckets[hi - 1] == 0)
+		hi--;
+
+	if (lo == hi)
+		return s;
+
+	s = reserve(s, neg, offset + lo, offset + hi - 1);
+
+	dest = neg ? DDSketchNegative(s) : DDSketchPositive(s);
+	dest_offset = neg ? s->neg_offset : s->pos_offset;
+
+	for (i = lo; i < hi; i++)
+		dest[Max(offset + (int32) i, dest_offset) - dest_offset] += buckets[i];
+
+	return s;
+}
+
+DDSketch *
+DDSketchMerge(DDSketch *s, DDSketch *incoming)
+{
+	if (s->alpha != incoming->alpha)
+		elog(ERROR, "cannot merge ddsketches with different relative accuracies");
+
+	s = merge_store(s, incoming, false);
+	s = merge_store(s, incoming, true);
+
+	s->zero_count += incoming->zero_count;
+	s->count += incoming->count;
+	s->min = Min(s->min, incoming->min);
+	s->max = Max(s->max, incoming->max);
+
+	return s;
+}
+
+/*
+ * DDSketchQuantile
+ *
+ * Returns the estimated value at the given rank, going from the most negative values up
+ */
+float8
+DDSketchQuantile(DDSketch *s, float8 q)
+{
+	uint64 *buckets;
+	float8 rank;
+	float8 seen = 0;
+	float8 result;
+	int i;
+
+	if (s->count == 0)
+		return NAN;
+
+	if (q <= 0)
+		return s->min;
+	if (q >= 1)
+		return s->max;
+
+	rank = q * (s->count - 1);
+
+	buckets = DDSketchNegative(s);
+	for (i = s->neg_len - 1; i >= 0; i--)
+	{
+		seen += buckets[i];
+		if (seen > rank)
+		{
+			result = -get_value(s, s->neg_offset + i);
+			return Max(Min(result, s->max), s->min);
+		}
+	}
+
+	seen += s->zero_count;
+	if (seen > rank)
+		return 0;
+
+	buckets = DDSketchPositive(s);
+	for (i = 0; i < s->pos_len; i++)
+	{
+		seen += buckets[i];
+		if (seen > rank)
+		{
+			result = get_value(s, s->pos_offset + i);
+			return Max(Min(result, s->max), s->min);
+		}
+	}
+
+	return s->max;
+}
+
+/*
+ * DDSketchCDF
+ *
+ * Returns the estimated fraction of values less than or equal to x, where all values in x's
+ * bucket are taken to be equal to it
+ */
+float8
+DDSketchCDF(DDSketch *s, float8 x)
+{
+	uint64 *buckets;
+	uint64 below = 0;
+	int32 key;
+	int i;
+
+	if (s->count == 0)
+		return NAN;
+
+	if (x < s->min)
+		return 0;
+	if (x >= s->max)
+		return 1;
+
+	if (x < 0)
+	{
+		key = get_key(s, -x);
+		buckets = DDSketchNegative(s);
+		for (i = 0; i < s->neg_len; i++)
+		{
+			if (s->neg_offset + i >= key)
+				below += buckets[i];
+		}
+
+		return (float8) below / s->count;
+	}
+
+	for (i = 0; i < s->neg_len; i++)
+		below += DDSketchNegative(s)[i];
+	below += s->zero_count;
+
+	if (x > 0)
+	{
+		key = get_key(s, x);
+		buckets = DDSketchPositive(s);
+		for (i = 0; i < s->pos_len && s->pos_offset + i <= key; i++)
+			below += buckets[i];
+	}
+
+	return (float8) below / s->count;
+}
+
+Size
+DDSketchSize(DDSketch *s)
+{
+	return offsetof(DDSketch, buckets) + sizeof(uint64) * (s->pos_len + s->neg_len);
+}
@@ -0,0 +1,143 @@
+/*-------------------------------------------------------------------------
+ *
+ * dedup.c
+ *	  Dropping stream events whose key was recently seen
+ *
+ * Continuous queries created with a dedup_key and a dedup_window drop any
+ * event whose key was already seen by the same worker within the window.
+ * The keys seen are kept in a ring of DEDUP_GENERATIONS scalable Bloom
+ * filters, each one holding the keys seen over a fraction of the window.
+ * Keys are added to the newest filter and looked up in all of them, and
+ * rotating the ring empties the oldest one, so a key is remembered for at
+ * least the window and at most DEDUP_GENERATIONS / (DEDUP_GENERATIONS - 1)
+ * times it. Since it's a Bloom filter, a small fraction of events whose key
+ * wasn't seen are dropped as well.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/dedup.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "pipeline/dedup.h"
+#include "pipeline/miscutils.h"
+#include "utils/memutils.h"
+
+#define DEDUP_P 0.0001
+#define DEDUP_N (2 << 14) /* 16384 */
+
+/*
+ * DedupFilterCreate
+ *
+ * Create an empty filter in a new child of the current memory context
+ */
+DedupFilter *
+DedupFilterCreate(int window_ms)
+{
+	MemoryContext cxt = AllocSetContextCreate(CurrentMemoryContext, "DedupFilterCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext old = MemoryContextSwitchTo(cxt);
+	DedupFilter *df = palloc0(sizeof(DedupFilter));
+
+	df->cxt = cxt;
+	df->window_ms = window_ms;
+	df->generation_ms = Max(window_ms / (DEDUP_GENERATIONS - 1), 1);
+	df->rotated_at = GetCurrentTimestamp();
+	initStringInfo(&df->buf);
+
+	MemoryContextSwitchTo(old);
+
+	return df;
+}
+
+/*
+ * DedupFilterRotate
+ *
+ * Forget the keys of every generation that has fallen out of the window by the given time
+ */
+void
+DedupFilterRotate(DedupFilter *df, TimestampTz now)
+{
+	long secs;
+	int usecs;
+	int64 elapsed;
+	int n;
+	int i;
+
+	TimestampDifference(df->rotated_at, now, &secs, &usecs);
+	elapsed = secs * 1000 + usecs / 1000;
+
+	if (elapsed < df->generation_ms)
+		return;
+
+	n = Min(elapsed / df->generation_ms, DEDUP_GENERATIONS);
+
+	for (i = 0; i < n; i++)
+	{
+		df->newest = (df->newest + 1) % DEDUP_GENERATIONS;
+
+		if (df->generations[df->newest])
+		{
+			BloomFilterDestroy(df->generations[df->newest]);
+			df->generations[df->newest] = NULL;
+		}
+	}
+
+	if (n == DEDUP_GENERATIONS)
+		df->rotated_at = now;
+	else
+		df->rotated_at = TimestampTzPlusMilliseconds(df->rotated_at, n * df->generation_ms);
+}
+
+/*
+ * DedupFilterSeen
+ *
+ * Check if the given key was seen within the window, and remember that it's been seen now. Duplicates
+ * count as sightings too, so a key that keeps being retried keeps being dropped.
+ */
+bool
+DedupFilterSeen(DedupFilter *df, Datum key, TypeCacheEntry *typ)
+{
+	BloomFilter *newest = df->generations[df->newest];
+	BloomFilter *bf;
+	MemoryContext old;
+	bool seen = false;
+	int i;
+
+	resetStringInfo(&df->buf);
+
+	/* DatumToBytes treats fixed-length by-reference values as varlenas */
+	if (!typ->typbyval && typ->typlen > 0)
+		appendBinaryStringInfo(&df->buf, DatumGetPointer(key), typ->typlen);
+	else
+		DatumToBytes(key, typ, &df->buf);
+
+	if (newest && BloomFilterContains(newest, df->buf.data, df->buf.len))
+		return true;
+
+	for (i = 0; i < DEDUP_GENERATIONS && !seen; i++)
+	{
+		bf = df->generations[i];
+		if (i != df->newest && bf && BloomFilterContains(bf, df->buf.data, df->buf.len))
+			seen = true;
+	}
+
+	old = MemoryContextSwitchTo(df->cxt);
+
+	if (newest == NULL)
+		newest = BloomFilterCreateScalableWithPAndN(DEDUP_P, DEDUP_N);
+
+	/* scalable filters are copied when they grow */
+	bf = BloomFilterAdd(newest, df->buf.data, df->buf.len);
+	if (bf != newest)
+		BloomFilterDestroy(newest);
+	df->generations[df->newest] = bf;
+
+	MemoryContextSwitchTo(old);
+
+	return seen;
+}
@@ -0,0 +1,256 @@
+/*-------------------------------------------------------------------------
+ *
+ * distinct.c
+ *	  Distinct counting that's exact up to a threshold and falls back to an HLL.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/distinct.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "pipeline/distinct.h"
+#include "pipeline/hll.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+
+/* number of register updates applied to an HLL at once when a set is converted to one */
+#define CONVERT_BATCH 1024
+
+/*
+ * The hashes are 64 bits, so a set with a million of them has a collision with a
+ * probability of less than one in ten million, which is what "exact" means here.
+ */
+
+DistinctSet *
+DistinctSetCreate(uint32 threshold)
+{
+	DistinctSet *d = palloc0(offsetof(DistinctSet, hashes));
+
+	Assert(threshold <= DISTINCT_MAX_THRESHOLD);
+
+	d->encoding = DISTINCT_SET_ENCODING;
+	d->p = HLL_DEFAULT_P;
+	d->threshold = threshold;
+
+	SET_VARSIZE(d, DistinctSetSize(d));
+
+	return d;
+}
+
+struct varlena *
+DistinctCopy(struct varlena *d)
+{
+	Size size = VARSIZE(d);
+	struct varlena *new = palloc(size);
+	memcpy(new, d, size);
+	return new;
+}
+
+/*
+ * find
+ *
+ * Returns the position of the given hash in the set, or the position it would be inserted at
+ */
+static uint32
+find(DistinctSet *d, uint64 hash)
+{
+	uint32 lo = 0;
+	uint32 hi = d->num_hashes;
+
+	while (lo < hi)
+	{
+		uint32 mid = lo + (hi - lo) / 2;
+
+		if (d->hashes[mid] < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * add_set_to_hll
+ *
+ * Adds all of the hashes of the given set to the given HLL
+ */
+static HyperLogLog *
+add_set_to_hll(HyperLogLog *hll, DistinctSet *d)
+{
+	uint32 updates[CONVERT_BATCH];
+	uint32 i;
+	int n = 0;
+	int result;
+
+	for (i = 0; i < d->num_hashes; i++)
+	{
+		updates[n++] = HLLHashRegisterUpdate(hll->p, d->hashes[i]);
+		if (n == CONVERT_BATCH)
+		{
+			hll = HLLAddMany(hll, updates, n, &result);
+			n = 0;
+		}
+	}
+
+	if (n)
+		hll = HLLAddMany(hll, updates, n, &result);
+
+	return hll;
+}
+
+/*
+ * to_hll
+ *
+ * Returns an HLL of all of the hashes in the given set. The set is freed if it's in the
+ * current memory context.
+ */
+static HyperLogLog *
+to_hll(DistinctSet *d)
+{
+	HyperLogLog *hll = add_set_to_hll(HLLCreateWithP(d->p), d);
+
+	if (MemoryContextContains(CurrentMemoryContext, d))
+		pfree(d);
+
+	return hll;
+}
+
+/*
+ * add_hash
+ *
+ * Adds the given hash to the given set, which becomes an HLL if that takes it over its threshold
+ */
+static struct varlena *
+add_hash(DistinctSet *d, uint64 hash)
+{
+	uint32 pos = find(d, hash);
+	int result;
+
+	if (pos < d->num_hashes && d->hashes[pos] == hash)
+		return (struct varlena *) d;
+
+	if (d->num_hashes >= d->threshold)
+	{
+		HyperLogLog *hll = to_hll(d);
+		uint32 update = HLLHashRegisterUpdate(hll->p, hash);
+
+		return (struct varlena *) HLLAddMany(hll, &update, 1, &result);
+	}
+
+	if (MemoryContextContains(CurrentMemoryContext, d))
+		d = repalloc(d, DistinctSetSize(d) + sizeof(uint64));
+	else
+	{
+		DistinctSet *new = palloc(DistinctSetSize(d) + sizeof(uint64));
+		memcpy(new, d, DistinctSetSize(d));
+		d = new;
+	}
+
+	memmove(d->hashes + pos + 1, d->hashes + pos, sizeof(uint64) * (d->num_hashes - pos));
+	d->hashes[pos] = hash;
+	d->num_hashes++;
+
+	SET_VARSIZE(d, DistinctSetSize(d));
+
+	return (struct varlena *) d;
+}
+
+/*
+ * DistinctAdd
+ *
+ * Adds the given element to the given counter, returning the updated counter
+ */
+struct varlena *
+DistinctAdd(struct varlena *d, void *elem, Size len)
+{
+	int result;
+
+	if (DistinctIsExact(d))
+		return add_hash((DistinctSet *) d, HLLHash(elem, len));
+
+	return (struct varlena *) HLLAdd((HyperLogLog *) d, elem, len, &result);
+}
+
+/*
+ * merge_sets
+ *
+ * Returns the union of the given sets, as an HLL if it has more hashes than the first
+ * set's threshold
+ */
+static struct varlena *
+merge_sets(DistinctSet *d, DistinctSet *incoming)
+{
+	DistinctSet *result = palloc(DistinctSetSize(d) + sizeof(uint64) * incoming->num_hashes);
+	uint32 i = 0;
+	uint32 j = 0;
+	uint32 n = 0;
+
+	memcpy(result, d, offsetof(DistinctSet, hashes));
+
+	while (i < d->num_hashes || j < incoming->num_hashes)
+	{
+		uint64 hash;
+
+		if (j == incoming->num_hashes || (i < d->num_hashes && d->hashes[i] < incoming->hashes[j]))
+			hash = d->hashes[i++];
+		else if (i == d->num_hashes || incoming->hashes[j] < d->hashes[i])
+			hash = incoming->hashes[j++];
+		else
+		{
+			hash = d->hashes[i++];
+			j++;
+		}
+
+		result->hashes[n++] = hash;
+	}
+
+	result->num_hashes = n;
+	SET_VARSIZE(result, DistinctSetSize(result));
+
+	if (MemoryContextContains(CurrentMemoryContext, d))
+		pfree(d);
+
+	if (result->num_hashes > result->threshold)
+		return (struct varlena *) to_hll(result);
+
+	return (struct varlena *) result;
+}
+
+/*
+ * DistinctMerge
+ *
+ * Adds everything counted by the incoming counter to the given one, returning the updated counter
+ */
+struct varlena *
+DistinctMerge(struct varlena *d, struct varlena *incoming)
+{
+	if (DistinctIsExact(d) && DistinctIsExact(incoming))
+		return merge_sets((DistinctSet *) d, (DistinctSet *) incoming);
+
+	if (DistinctIsExact(incoming))
+		return (struct varlena *) add_set_to_hll((HyperLogLog *) d, (DistinctSet *) incoming);
+
+	if (DistinctIsExact(d))
+		d = (struct varlena *) to_hll((DistinctSet *) d);
+
+	return (struct varlena *) HLLUnion((HyperLogLog *) d, (HyperLogLog *) incoming);
+}
+
+/*
+ * DistinctCount
+ *
+ * Returns the number of distinct elements counted by the given counter, which is exact as long as
+ * it hasn't become an HLL
+ */
+uint64
+DistinctCount(struct varlena *d)
+{
+	if (DistinctIsExact(d))
+		return ((DistinctSet *) d)->num_hashes;
+
+	return HLLCardinality((HyperLogLog *) d);
+}
@@ -26,6 +26,142 @@
 
 #define MURMUR_SEED 0x02cd1b4c451c1fb8L
 
+/*
+ * The index is an open-addressing hash table with linear probing, mapping monitored values
+ * to their slot + 1, with 0 meaning an empty cell. It is sized to be at most half full.
+ */
+#define INDEX_BYTES(m) MAXALIGN(sizeof(uint16_t) * index_size(m))
+#define FSS_INDEX(fss) ((uint16_t *) ((fss)->monitored_elements + (fss)->m))
+
+typedef struct ElementIndex
+{
+	uint16_t *cells;
+	uint32_t mask;
+	MonitoredElement *elements;
+} ElementIndex;
+
+static uint32_t
+index_size(uint16_t m)
+{
+	uint32_t size = 1;
+
+	while (size < 2 * (uint32_t) m)
+		size <<= 1;
+
+	return size;
+}
+
+static void
+index_init(ElementIndex *idx, uint16_t *cells, uint16_t m, MonitoredElement *elements)
+{
+	idx->cells = cells;
+	idx->mask = index_size(m) - 1;
+	idx->elements = elements;
+}
+
+/*
+ * index_home
+ *
+ * Byval values are the values themselves, so they are mixed before being used as a position
+ */
+static uint32_t
+index_home(ElementIndex *idx, Datum value)
+{
+	uint64_t h = (uint64_t) value;
+
+	h ^= h >> 33;
+	h *= UINT64CONST(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+
+	return (uint32_t) h & idx->mask;
+}
+
+/*
+ * index_locate
+ *
+ * Returns the cell containing the given value's slot, or the empty cell it would go in
+ */
+static uint32_t
+index_locate(ElementIndex *idx, Datum value, bool isnull)
+{
+	uint32_t i = index_home(idx, value);
+
+	while (idx->cells[i])
+	{
+		MonitoredElement *elt = &idx->elements[idx->cells[i] - 1];
+
+		if (elt->value == value && IS_NULL(elt) == isnull)
+			break;
+
+		i = (i + 1) & idx->mask;
+	}
+
+	return i;
+}
+
+static int
+index_lookup(ElementIndex *idx, Datum value, bool isnull)
+{
+	return (int) idx->cells[index_locate(idx, value, isnull)] - 1;
+}
+
+static void
+index_insert(ElementIndex *idx, int slot)
+{
+	MonitoredElement *elt = &idx->elements[slot];
+
+	idx->cells[index_locate(idx, elt->value, IS_NULL(elt))] = slot + 1;
+}
+
+/*
+ * index_delete
+ *
+ * Removes the given slot's value, which must still be in the slot, shifting back any following
+ * entries in the same chain so that lookups don't need tombstones
+ */
+static void
+index_delete(ElementIndex *idx, int slot)
+{
+	MonitoredElement *elt = &idx->elements[slot];
+	uint32_t i = index_locate(idx, elt->value, IS_NULL(elt));
+	uint32_t j = i;
+
+	for (;;)
+	{
+		uint32_t home;
+
+		j = (j + 1) & idx->mask;
+		if (!idx->cells[j])
+			break;
+
+		home = index_home(idx, idx->elements[idx->cells[j] - 1].value);
+
+		/* Entries whose home is cyclically within (i, j] stay where they are */
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+
+		idx->cells[i] = idx->cells[j];
+		i = j;
+	}
+
+	idx->cells[i] = 0;
+}
+
+static void
+index_build(ElementIndex *idx, uint16_t m)
+{
+	int i;
+
+	MemSet(idx->cells, 0, sizeof(uint16_t) * index_size(m));
+
+	for (i = 0; i < m; i++)
+	{
+		if (!IS_SET(&idx->elements[i]))
+			break;
+		index_insert(idx, i);
+	}
+}
+
 FSS *
 FSSFromBytes(struct varlena *bytes)
 {
@@ -42,6 +178,8 @@ FSSFromBytes(struct varlena *bytes)
 	if (FSS_STORES_DATUMS(fss))
 	{
 		pos += sizeof(MonitoredElement) * fss->m;
+		if (FSS_IS_INDEXED(fss))
+			pos += INDEX_BYTES(fss->m);
 		fss->top_k = (ArrayType *) pos;
 	}
 	else
@@ -53,7 +191,7 @@ FSSFromBytes(struct varlena *bytes)
 FSS *
 FSSCreateWithMAndH(uint16_t k, TypeCacheEntry *typ, uint16_t m, uint16_t h)
 {
-	Size sz = sizeof(FSS) + (sizeof(Counter) * h) + (sizeof(MonitoredElement) * m);
+	Size sz = sizeof(FSS) + (sizeof(Counter) * h) + (sizeof(MonitoredElement) * m) + INDEX_BYTES(m);
 	char *pos;
 	FSS *fss;
 
@@ -74,7 +212,7 @@ FSSCreateWithMAndH(uint16_t k, TypeCacheEntry *typ, uint16_t m, uint16_t h)
 		for (i = 0; i < m; i++)
 			fss->monitored_elements[i].varlen_index = (Datum ) i;
 
-		pos += sizeof(MonitoredElement) * m;
+		pos += sizeof(MonitoredElement) * m + INDEX_BYTES(m);
 		fss->top_k = construct_empty_array(typ->type_id);
 	}
 	else
@@ -83,6 +221,7 @@ FSSCreateWithMAndH(uint16_t k, TypeCacheEntry *typ, uint16_t m, uint16_t h)
 	fss->h = h;
 	fss->m = m;
 	fss->k = k;
+	fss->flags = FSS_INDEXED;
 	fss->typ.typoid = typ->type_id;
 	fss->typ.typlen = typ->typlen;
 	fss->typ.typbyval = typ->typbyval;
@@ -192,6 +331,95 @@ element_cmp(const void *a, const void *b)
 	return 0;
 }
 
+/*
+ * first_free_slot
+ *
+ * Since unset elements sort last, the first of them can be found with a binary search
+ */
+static int
+first_free_slot(FSS *fss)
+{
+	int lo = 0;
+	int hi = fss->m;
+
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+
+		if (IS_SET(&fss->monitored_elements[mid]))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < fss->m ? lo : -1;
+}
+
+static void
+swap_elements(FSS *fss, ElementIndex *idx, int i, int j)
+{
+	MonitoredElement tmp;
+
+	if (idx)
+	{
+		MonitoredElement *a = &fss->monitored_elements[i];
+		MonitoredElement *b = &fss->monitored_elements[j];
+		uint32_t ca = index_locate(idx, a->value, IS_NULL(a));
+		uint32_t cb = index_locate(idx, b->value, IS_NULL(b));
+
+		idx->cells[ca] = j + 1;
+		idx->cells[cb] = i + 1;
+	}
+
+	tmp = fss->monitored_elements[i];
+	fss->monitored_elements[i] = fss->monitored_elements[j];
+	fss->monitored_elements[j] = tmp;
+}
+
+/*
+ * select_top
+ *
+ * Partially sorts the given elements so that the first n of them are the top n, in no
+ * particular order
+ */
+static void
+select_top(MonitoredElement *elts, int len, int n)
+{
+	int lo = 0;
+	int hi = len - 1;
+
+	while (lo < hi)
+	{
+		MonitoredElement pivot = elts[lo + (hi - lo) / 2];
+		int i = lo;
+		int j = hi;
+
+		while (i <= j)
+		{
+			while (element_cmp(&elts[i], &pivot) < 0)
+				i++;
+			while (element_cmp(&elts[j], &pivot) > 0)
+				j--;
+
+			if (i <= j)
+			{
+				MonitoredElement tmp = elts[i];
+				elts[i] = elts[j];
+				elts[j] = tmp;
+				i++;
+				j--;
+			}
+		}
+
+		if (n - 1 <= j)
+			hi = j;
+		else if (n - 1 >= i)
+			lo = i;
+		else
+			break;
+	}
+}
+
 FSS *
 FSSIncrement(FSS *fss, Datum datum, bool isnull)
 {
@@ -267,48 +495,43 @@ FSSIncrementWeighted(FSS *fss, Datum incoming, bool incoming_null, uint64_t weig
 
 	if (counter->count > 0)
 	{
-		int i;
-		bool found = false;
+		int i = -1;
 
-		for (i = 0; i < fss->m; i++)
+		if (FSS_IS_INDEXED(fss))
 		{
-			m_elt = &fss->monitored_elements[i];
+			ElementIndex idx;
 
-			if (!IS_SET(m_elt))
+			index_init(&idx, FSS_INDEX(fss), fss->m, fss->monitored_elements);
+			i = index_lookup(&idx, store_value, incoming_null);
+		}
+		else
+		{
+			for (i = 0; i < fss->m; i++)
 			{
-				free_slot = i;
-				break;
-			}
+				m_elt = &fss->monitored_elements[i];
 
-			if (m_elt->value == store_value && (incoming_null == IS_NULL(m_elt)))
-			{
-				found = true;
-				break;
+				if (!IS_SET(m_elt))
+					break;
+
+				if (m_elt->value == store_value && (incoming_null == IS_NULL(m_elt)))
+					break;
 			}
+
+			if (i == fss->m || !IS_SET(&fss->monitored_elements[i]))
+				i = -1;
 		}
 
 		/* We found datum, so its monitored */
-		if (found)
+		if (i >= 0)
 		{
+			m_elt = &fss->monitored_elements[i];
 			m_elt->frequency += weight;
 			slot = i;
 			goto done;
 		}
 	}
-	else if (!IS_SET(&fss->monitored_elements[fss->m - 1]))
-	{
-		int i;
 
-		/* Find the first free slot */
-		for (i = 0; i < fss->m; i++)
-		{
-			if (!IS_SET(&fss->monitored_elements[i]))
-			{
-				free_slot = i;
-				break;
-			}
-		}
-	}
+	free_slot = first_free_slot(fss);
 
 	/* This is only executed if datum is not monitored */
 	if (counter->alpha + weight >= fss->monitored_elements[fss->m - 1].frequency)
@@ -326,6 +549,14 @@ FSSIncrementWeighted(FSS *fss, Datum incoming, bool incoming_null, uint64_t weig
 			c = &fss->bitmap_counter[m_elt->counter];
 			c->count--;
 			c->alpha = m_elt->frequency;
+
+			if (FSS_IS_INDEXED(fss))
+			{
+				ElementIndex idx;
+
+				index_init(&idx, FSS_INDEX(fss), fss->m, fss->monitored_elements);
+				index_delete(&idx, slot);
+			}
 		}
 		else
 		{
@@ -348,6 +579,14 @@ FSSIncrementWeighted(FSS *fss, Datum incoming, bool incoming_null, uint64_t weig
 			fss = set_varlena(fss, m_elt, incoming, incoming_null);
 			m_elt = &fss->monitored_elements[slot];
 		}
+
+		if (FSS_IS_INDEXED(fss))
+		{
+			ElementIndex idx;
+
+			index_init(&idx, FSS_INDEX(fss), fss->m, fss->monitored_elements);
+			index_insert(&idx, slot);
+		}
 	}
 	else
 	{
@@ -358,26 +597,23 @@ FSSIncrementWeighted(FSS *fss, Datum incoming, bool incoming_null, uint64_t weig
 done:
 	if (needs_sort)
 	{
+		ElementIndex idx;
+
 		Assert(m_elt);
 
-		/* First slot updated? Don't need to sort. */
-		if (slot == 0)
-			needs_sort = false;
-		else
-		{
-			MonitoredElement *tmp = &fss->monitored_elements[slot - 1];
+		if (FSS_IS_INDEXED(fss))
+			index_init(&idx, FSS_INDEX(fss), fss->m, fss->monitored_elements);
 
-			/*
-			 * Is the slot before us still good? This should be enough to check because we only
-			 * ever increase the frequency or swap the last element on the monitored element array
-			 * when a new frequency is entered
-			 */
-			if (element_cmp((void *) tmp, (void *) m_elt) <= 0)
-				needs_sort = false;
+		/*
+		 * Only this slot has changed, and we only ever increase the frequency or replace the last
+		 * element on the monitored element array when a new frequency is entered, so moving it
+		 * towards the front until the slot before it is still good keeps the array sorted
+		 */
+		while (slot > 0 && element_cmp(&fss->monitored_elements[slot - 1], &fss->monitored_elements[slot]) > 0)
+		{
+			swap_elements(fss, FSS_IS_INDEXED(fss) ? &idx : NULL, slot - 1, slot);
+			slot--;
 		}
-
-		if (needs_sort)
-			qsort(fss->monitored_elements, fss->m, sizeof(MonitoredElement), element_cmp);
 	}
 
 	fss->count++;
@@ -399,6 +635,7 @@ FSSMerge(FSS *fss, FSS *incoming)
 	int i, j, k;
 	MonitoredElement *tmp;
 	ArrayType *top_k;
+	ElementIndex idx;
 
 	Assert(fss->h == incoming->h);
 	Assert(fss->m == incoming->m);
@@ -413,32 +650,28 @@ FSSMerge(FSS *fss, FSS *incoming)
 		fss->bitmap_counter[i].count = 0;
 	}
 
+	/* Index our elements so that matching the incoming ones doesn't take quadratic time */
+	index_init(&idx, palloc(sizeof(uint16_t) * index_size(fss->m)), fss->m, tmp);
+	index_build(&idx, fss->m);
+
 	k = fss->m;
 	for (i = 0; i < fss->m; i++)
 	{
-		bool found = false;
 		MonitoredElement *incoming_elt = &incoming->monitored_elements[i];
 
 		if (!IS_SET(incoming_elt))
 			break;
 
-		for (j = 0; j < fss->m; j++)
+		j = index_lookup(&idx, incoming_elt->value, IS_NULL(incoming_elt));
+
+		if (j >= 0)
 		{
 			MonitoredElement *elt = &tmp[j];
 
-			if (!IS_SET(elt))
-				break;
-
-			if (incoming_elt->value == elt->value && (IS_NULL(incoming_elt) == IS_NULL(elt)))
-			{
-				elt->frequency += incoming_elt->frequency;
-				elt->error += incoming_elt->error;
-				found = true;
-				break;
-			}
+			elt->frequency += incoming_elt->frequency;
+			elt->error += incoming_elt->error;
 		}
-
-		if (!found)
+		else
 		{
 			tmp[k] = *incoming_elt;
 			SET_NEW(&tmp[k]);
@@ -446,7 +679,12 @@ FSSMerge(FSS *fss, FSS *incoming)
 		}
 	}
 
-	qsort(tmp, k, sizeof(MonitoredElement), element_cmp);
+	pfree(idx.cells);
+
+	/* Only the top m elements are kept, so only those need to be sorted */
+	if (k > fss->m)
+		select_top(tmp, k, fss->m);
+	qsort(tmp, fss->m, sizeof(MonitoredElement), element_cmp);
 
 	/* If we added any new byref elements, we need to rebuild the varlena array */
 	if (k - fss->m > 0 && !fss->typ.typbyval)
@@ -486,6 +724,12 @@ FSSMerge(FSS *fss, FSS *incoming)
 	memcpy(fss->monitored_elements, tmp, sizeof(MonitoredElement) * fss->m);
 	pfree(tmp);
 
+	if (FSS_IS_INDEXED(fss))
+	{
+		index_init(&idx, FSS_INDEX(fss), fss->m, fss->monitored_elements);
+		index_build(&idx, fss->m);
+	}
+
 	for (i = 0; i < fss->m; i++)
 	{
 		MonitoredElement *elt = &fss->monitored_elements[i];
@@ -578,6 +822,9 @@ FSSSize(FSS *fss)
 {
 	Size sz = sizeof(FSS) + (sizeof(Counter) * fss->h) + (sizeof(MonitoredElement) * fss->m);
 
+	if (FSS_IS_INDEXED(fss))
+		sz += INDEX_BYTES(fss->m);
+
 	if (FSS_STORES_DATUMS(fss))
 		sz += ARR_SIZE(fss->top_k);
 
@@ -48,7 +48,11 @@
  * Portions Copyright (c) 2013-2015, PipelineDB
  *
  */
+#include <limits.h>
 #include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "pipeline/hll.h"
 #include "pipeline/miscutils.h"
@@ -58,8 +62,8 @@
 #include "utils/memutils.h"
 
 #define HLL_USE_EXPLICIT 1
+#define HLL_USE_COMPACT 1
 
-#define HLL_DEFAULT_P 14
 #define HLL_BITS_PER_REGISTER 6
 #define HLL_REGISTER_MAX ((1 << HLL_BITS_PER_REGISTER) - 1)
 #define HLL_SPARSE_VAL_MAX_LEN 4
@@ -279,6 +283,84 @@
 } while(0)
 
 
+/* -------------------------------------------------------------------------
+ *
+ * Merges and cardinality estimates work on every register of a dense HLL,
+ * so rather than getting and setting registers one at a time with the above
+ * macros, they unpack the registers into one byte each. Every group of 4
+ * registers is stored in 3 bytes, so a group can be unpacked and packed
+ * with a fixed set of shifts and no conditionals.
+ */
+#define HLL_DENSE_GROUP_REGISTERS 4
+#define HLL_DENSE_GROUP_BYTES 3
+
+/*
+ * hll_dense_unpack
+ *
+ * Unpack the m registers of a dense representation into one byte each
+ */
+static void
+hll_dense_unpack(uint8 *regs, const uint8 *M, int m)
+{
+	int i;
+
+	for (i = 0; i < m; i += HLL_DENSE_GROUP_REGISTERS)
+	{
+		*regs++ = M[0] & 63;
+		*regs++ = (M[0] >> 6 | M[1] << 2) & 63;
+		*regs++ = (M[1] >> 4 | M[2] << 4) & 63;
+		*regs++ = M[2] >> 2;
+
+		M += HLL_DENSE_GROUP_BYTES;
+	}
+}
+
+/*
+ * hll_dense_pack
+ *
+ * Pack m unpacked registers back into a dense representation
+ */
+static void
+hll_dense_pack(uint8 *M, const uint8 *regs, int m)
+{
+	int i;
+
+	for (i = 0; i < m; i += HLL_DENSE_GROUP_REGISTERS)
+	{
+		M[0] = regs[0] | regs[1] << 6;
+		M[1] = regs[1] >> 2 | regs[2] << 4;
+		M[2] = regs[2] >> 4 | regs[3] << 2;
+
+		M += HLL_DENSE_GROUP_BYTES;
+		regs += HLL_DENSE_GROUP_REGISTERS;
+	}
+}
+
+/*
+ * hll_registers_max
+ *
+ * Set each of the m unpacked registers in result to the greater of itself and
+ * its counterpart in incoming
+ */
+static void
+hll_registers_max(uint8 *result, const uint8 *incoming, int m)
+{
+	int i = 0;
+
+#ifdef __SSE2__
+	for (; i + sizeof(__m128i) <= m; i += sizeof(__m128i))
+	{
+		__m128i r = _mm_loadu_si128((const __m128i *) (result + i));
+		__m128i in = _mm_loadu_si128((const __m128i *) (incoming + i));
+
+		_mm_storeu_si128((__m128i *) (result + i), _mm_max_epu8(r, in));
+	}
+#endif
+
+	for (; i < m; i++)
+		result[i] = Max(result[i], incoming[i]);
+}
+
 #define HLL_SPARSE_XZERO_BIT 0x40 /* 01xxxxxx */
 #define HLL_SPARSE_IS_XZERO(p) (((*(p)) & 0xc0) == HLL_SPARSE_XZERO_BIT)
 #define HLL_SPARSE_XZERO_MAX_LEN (1 << 14) /* 16384 */
@@ -322,8 +404,26 @@
 	*((uint32 *) (p)) |= ((reg) << 8) & 0xffffff00; \
 } while(0)
 
+/*
+ * Compact representation
+ * ===
+ *
+ * The compact representation holds the same sorted registers as the explicit one, but each register
+ * is encoded as a varint of its distance from the previous register, shifted left by 6 bits, with the
+ * number of leading zeros minus one in the least significant 6 bits. A varint is little-endian in
+ * groups of 7 bits, with the most significant bit of every byte but the last one set.
+ *
+ * This takes 2 or 3 bytes per register for the low cardinalities the explicit representation covers,
+ * rather than 4. It's only a storage format: everything but computing the cardinality is done on an
+ * explicit copy, which is encoded again afterwards.
+ */
+#define HLL_COMPACT_LEADING_BITS 6
+#define HLL_COMPACT_LEADING_MASK ((1 << HLL_COMPACT_LEADING_BITS) - 1)
+#define HLL_COMPACT_MAX_ENTRY_SIZE 5
+
 #define HLL_IS_DENSE(hll) ((hll)->encoding == HLL_DENSE_DIRTY || (hll)->encoding == HLL_DENSE_CLEAN)
-#define HLL_IS_CLEAN(hll) ((hll)->encoding == HLL_DENSE_CLEAN || (hll)->encoding == HLL_SPARSE_CLEAN || (hll)->encoding == HLL_EXPLICIT_CLEAN)
+#define HLL_IS_CLEAN(hll) ((hll)->encoding == HLL_DENSE_CLEAN || (hll)->encoding == HLL_SPARSE_CLEAN || \
+		(hll)->encoding == HLL_EXPLICIT_CLEAN || (hll)->encoding == HLL_COMPACT_CLEAN)
 
 #define MURMUR_SEED 0xbee5bf4112801383L
 
@@ -392,17 +492,16 @@ hll_sparse_to_dense(HyperLogLog *sparse)
 }
 
 /*
- * Returns the number of leading zeroes for the hash code of the
- * given element. The value of m is set to the register
+ * Returns the number of leading zeroes for the given hash code.
+ * The value of m is set to the register
  */
 static uint8
-num_leading_zeroes(HyperLogLog *hll, void *elem, Size size, int *m)
+hash_leading_zeroes(uint8 p, uint64 h, int *m)
 {
-	uint64 h = MurmurHash3_64(elem, size, MURMUR_SEED);
 	uint64 index;
 	uint64 bit;
 	uint8 count = 0;
-	int numregs = (1 << hll->p);
+	int numregs = (1 << p);
 	int mask = (numregs - 1);
 
 	/* register index is the first p bits of the hash */
@@ -421,6 +520,16 @@ num_leading_zeroes(HyperLogLog *hll, void *elem, Size size, int *m)
 	return count;
 }
 
+/*
+ * Returns the number of leading zeroes for the hash code of the
+ * given element. The value of m is set to the register
+ */
+static uint8
+num_leading_zeroes(uint8 p, void *elem, Size size, int *m)
+{
+	return hash_leading_zeroes(p, HLLHash(elem, size), m);
+}
+
 static HyperLogLog *
 hll_dense_add_internal(HyperLogLog *hll, int m, uint8 leading, int *result)
 {
@@ -442,7 +551,7 @@ static HyperLogLog *
 hll_dense_add(HyperLogLog *hll, void *elem, Size size, int *result)
 {
 	int m;
-	uint8 leading = num_leading_zeroes(hll, elem, size, &m);
+	uint8 leading = num_leading_zeroes(hll->p, elem, size, &m);
 	return hll_dense_add_internal(hll, m, leading, result);
 }
 
@@ -778,7 +887,7 @@ static HyperLogLog *
 hll_sparse_add(HyperLogLog *hll, void *elem, Size size, int *result)
 {
 	int m;
-	uint8 leading = num_leading_zeroes(hll, elem, size, &m);
+	uint8 leading = num_leading_zeroes(hll->p, elem, size, &m);
 	return hll_sparse_add_internal(hll, m, leading, result, true);
 }
 
@@ -920,7 +1029,7 @@ static HyperLogLog *
 hll_explicit_add(HyperLogLog *hll, void *elem, Size size, int *result)
 {
 	int m;
-	uint8 leading = num_leading_zeroes(hll, elem, size, &m);
+	uint8 leading = num_leading_zeroes(hll->p, elem, size, &m);
 	return hll_explicit_add_internal(hll, m, leading, result);
 }
 
@@ -945,6 +1054,167 @@ hll_explicit_sum(HyperLogLog *hll, double *PE, int *ezp)
 	return E;
 }
 
+/*
+ * Decode the compact register at pos, whose number is relative to reg
+ */
+static uint8 *
+hll_compact_next(uint8 *pos, int *reg, uint8 *leading)
+{
+	uint32 val = 0;
+	int shift = 0;
+
+	do
+	{
+		val |= (uint32) (*pos & 0x7f) << shift;
+		shift += 7;
+	} while (*pos++ & 0x80);
+
+	*reg += val >> HLL_COMPACT_LEADING_BITS;
+	*leading = (val & HLL_COMPACT_LEADING_MASK) + 1;
+
+	return pos;
+}
+
+static int
+hll_compact_num_registers(HyperLogLog *hll)
+{
+	int count = 0;
+	int i;
+
+	/* Every register ends with exactly one byte that doesn't have its continuation bit set */
+	for (i = 0; i < hll->mlen; i++)
+		if (!(hll->M[i] & 0x80))
+			count++;
+
+	return count;
+}
+
+static HyperLogLog *
+hll_explicit_to_compact(HyperLogLog *hll)
+{
+	int nregs = HLL_EXPLICIT_GET_NUM_REGISTERS(hll);
+	uint8 *pos = hll->M;
+	uint8 *out;
+	HyperLogLog *compact;
+	int prev = 0;
+	int i;
+
+	Assert(HLL_IS_EXPLICIT(hll));
+
+	compact = palloc(sizeof(HyperLogLog) + nregs * HLL_COMPACT_MAX_ENTRY_SIZE);
+	compact->p = hll->p;
+	compact->card = hll->card;
+	compact->encoding = HLL_IS_CLEAN(hll) ? HLL_COMPACT_CLEAN : HLL_COMPACT_DIRTY;
+	out = compact->M;
+
+	for (i = 0; i < nregs; i++)
+	{
+		int reg = HLL_EXPLICIT_GET_REGISTER(pos);
+		uint32 val = ((uint32) (reg - prev) << HLL_COMPACT_LEADING_BITS) |
+				((HLL_EXPLICIT_GET_NUM_LEADING(pos) - 1) & HLL_COMPACT_LEADING_MASK);
+
+		while (val >= 0x80)
+		{
+			*out++ = (val & 0x7f) | 0x80;
+			val >>= 7;
+		}
+		*out++ = val;
+
+		prev = reg;
+		pos += HLL_EXPLICIT_ENTRY_SIZE;
+	}
+
+	compact->mlen = out - compact->M;
+	SET_VARSIZE(compact, HLLSize(compact));
+
+	return compact;
+}
+
+static HyperLogLog *
+hll_compact_to_explicit(HyperLogLog *hll)
+{
+	int nregs = hll_compact_num_registers(hll);
+	uint8 *pos = hll->M;
+	uint8 *end = hll->M + hll->mlen;
+	uint8 *out;
+	HyperLogLog *explicit;
+	int reg = 0;
+
+	Assert(HLL_IS_COMPACT(hll));
+
+	explicit = palloc0(sizeof(HyperLogLog) + nregs * HLL_EXPLICIT_ENTRY_SIZE);
+	explicit->p = hll->p;
+	explicit->card = hll->card;
+	explicit->encoding = HLL_IS_CLEAN(hll) ? HLL_EXPLICIT_CLEAN : HLL_EXPLICIT_DIRTY;
+	explicit->mlen = nregs * HLL_EXPLICIT_ENTRY_SIZE;
+	out = explicit->M;
+
+	while (pos < end)
+	{
+		uint8 leading;
+
+		pos = hll_compact_next(pos, &reg, &leading);
+		HLL_EXPLICIT_SET_REGISTER(out, reg);
+		HLL_EXPLICIT_SET_NUM_LEADING(out, leading);
+		out += HLL_EXPLICIT_ENTRY_SIZE;
+	}
+
+	SET_VARSIZE(explicit, HLLSize(explicit));
+
+	return explicit;
+}
+
+/*
+ * hll_recompact
+ *
+ * Returns the result of an operation on the explicit copy of a compact HLL, encoded
+ * as a compact HLL again unless it has outgrown the explicit representation
+ */
+static HyperLogLog *
+hll_recompact(HyperLogLog *compact, HyperLogLog *result, int changed)
+{
+	HyperLogLog *recompacted;
+
+	if (!changed)
+	{
+		pfree(result);
+		return compact;
+	}
+
+	if (!HLL_IS_EXPLICIT(result))
+		return result;
+
+	recompacted = hll_explicit_to_compact(result);
+	pfree(result);
+
+	return recompacted;
+}
+
+static double
+hll_compact_sum(HyperLogLog *hll, double *PE, int *ezp)
+{
+	int m = 1 << hll->p;
+	int count = 0;
+	double E = 0;
+	uint8 *pos = hll->M;
+	uint8 *end = hll->M + hll->mlen;
+	int reg = 0;
+
+	while (pos < end)
+	{
+		uint8 leading;
+
+		pos = hll_compact_next(pos, &reg, &leading);
+		E += PE[leading];
+		count++;
+	}
+
+	*ezp = m - count;
+	E += *ezp;
+
+	return E;
+}
+
 static double
 hll_sparse_sum(HyperLogLog *hll, double *PE, int *ezp)
 {
@@ -992,66 +1262,51 @@ hll_sparse_sum(HyperLogLog *hll, double *PE, int *ezp)
 
 /*
  * hll_dense_sum
+ *
+ * Registers only take 64 different values, so rather than adding up 2^(-reg[j]) for
+ * every register we count how many registers have each value and weight the counts.
+ * The counts are spread over a few histograms so that consecutive registers with
+ * the same value don't have to wait on each other's increments.
  */
 static double
 hll_dense_sum(HyperLogLog *hll, double *PE, int *ezp)
 {
   double E = 0;
   int j;
-  int ez = 0;
   int m = 1 << hll->p;
+  uint32 counts[4][64];
+  uint8 *r = hll->M;
 
-  if (m == (1 << 14) && HLL_BITS_PER_REGISTER == 6)
+  MemSet(counts, 0, sizeof(counts));
+
+  if (m < HLL_DENSE_GROUP_REGISTERS)
   {
-		/* fast path when p == 14 */
-		uint8 *r = hll->M;
-		unsigned long r0, r1, r2, r3, r4, r5, r6, r7, r8, r9,
-									r10, r11, r12, r13, r14, r15;
-		for (j = 0; j < 1024; j++)
+		for (j = 0; j < m; j++)
 		{
-			/* handle 16 registers per iteration.*/
-			r0 = r[0] & 63; if (r0 == 0) ez++;
-			r1 = (r[0] >> 6 | r[1] << 2) & 63; if (r1 == 0) ez++;
-			r2 = (r[1] >> 4 | r[2] << 4) & 63; if (r2 == 0) ez++;
-			r3 = (r[2] >> 2) & 63; if (r3 == 0) ez++;
-
-			r4 = r[3] & 63; if (r4 == 0) ez++;
-			r5 = (r[3] >> 6 | r[4] << 2) & 63; if (r5 == 0) ez++;
-			r6 = (r[4] >> 4 | r[5] << 4) & 63; if (r6 == 0) ez++;
-			r7 = (r[5] >> 2) & 63; if (r7 == 0) ez++;
-
-			r8 = r[6] & 63; if (r8 == 0) ez++;
-			r9 = (r[6] >> 6 | r[7] << 2) & 63; if (r9 == 0) ez++;
-			r10 = (r[7] >> 4 | r[8] << 4) & 63; if (r10 == 0) ez++;
-			r11 = (r[8] >> 2) & 63; if (r11 == 0) ez++;
-
-			r12 = r[9] & 63; if (r12 == 0) ez++;
-			r13 = (r[9] >> 6 | r[10] << 2) & 63; if (r13 == 0) ez++;
-			r14 = (r[10] >> 4 | r[11] << 4) & 63; if (r14 == 0) ez++;
-			r15 = (r[11] >> 2) & 63; if (r15 == 0) ez++;
-
-			E += (PE[r0] + PE[r1]) + (PE[r2] + PE[r3]) + (PE[r4] + PE[r5]) +
-					 (PE[r6] + PE[r7]) + (PE[r8] + PE[r9]) + (PE[r10] + PE[r11]) +
-					 (PE[r12] + PE[r13]) + (PE[r14] + PE[r15]);
-
-			r += 12;
+			unsigned long reg;
+
+			HLL_DENSE_GET_REGISTER(reg, hll->M, j);
+			counts[0][reg]++;
 		}
   }
   else
   {
-		for (j = 0; j < m; j++) {
-			unsigned long reg;
+		for (j = 0; j < m; j += HLL_DENSE_GROUP_REGISTERS)
+		{
+			counts[0][r[0] & 63]++;
+			counts[1][(r[0] >> 6 | r[1] << 2) & 63]++;
+			counts[2][(r[1] >> 4 | r[2] << 4) & 63]++;
+			counts[3][r[2] >> 2]++;
 
-			HLL_DENSE_GET_REGISTER(reg, hll->M, j);
-			if (reg == 0)
-				ez++;
-			else
-				E += PE[reg]; /* precomputed 2^(-reg[j]) */
+			r += HLL_DENSE_GROUP_BYTES;
 		}
-		E += ez;
   }
 
-  *ezp = ez;
+  /* PE[0] is 1, so this includes a 1 for every empty register */
+  for (j = 0; j < 64; j++)
+		E += (counts[0][j] + counts[1][j] + counts[2][j] + counts[3][j]) * PE[j];
+
+  *ezp = counts[0][0] + counts[1][0] + counts[2][0] + counts[3][0];
 
   return E;
 }
@@ -1094,7 +1349,7 @@ HLLCreateWithP(int p)
 	hll->mlen = mlen;
 
 	if (HLL_USE_EXPLICIT)
-		hll->encoding = HLL_EXPLICIT_CLEAN;
+		hll->encoding = HLL_USE_COMPACT ? HLL_COMPACT_CLEAN : HLL_EXPLICIT_CLEAN;
 	else
 	{
 		hll->encoding = HLL_SPARSE_CLEAN;
@@ -1149,6 +1404,12 @@ HLLAdd(HyperLogLog *hll, void *elem, Size len, int *result)
 {
 	HyperLogLog *ret;
 
+	if (HLL_IS_COMPACT(hll))
+	{
+		ret = HLLAdd(hll_compact_to_explicit(hll), elem, len, result);
+		return hll_recompact(hll, ret, *result);
+	}
+
 	if (HLL_IS_EXPLICIT(hll))
 		ret = hll_explicit_add(hll, elem, len, result);
 	else if (HLL_IS_SPARSE(hll))
@@ -1161,11 +1422,464 @@ HLLAdd(HyperLogLog *hll, void *elem, Size len, int *result)
 		ret->encoding =	HLL_IS_SPARSE(ret) ? HLL_SPARSE_DIRTY :
 				(HLL_IS_DENSE(ret) ? HLL_DENSE_DIRTY : HLL_EXPLICIT_DIRTY);
 
-	SET_VARSIZE(hll, HLLSize(hll));
+	SET_VARSIZE(ret, HLLSize(ret));
 
 	return ret;
 }
 
+/*
+ * HLLRegisterUpdate
+ *
+ * Returns the register update that adding the given element to an HLL with the given p
+ * would make. Updates are encoded like explicit registers, so that sorting them orders
+ * them by register and then by value.
+ */
+uint32
+HLLRegisterUpdate(uint8 p, void *elem, Size len)
+{
+	return HLLHashRegisterUpdate(p, HLLHash(elem, len));
+}
+
+/*
+ * HLLHash
+ *
+ * Returns the hash code HLLs use for the given element
+ */
+uint64
+HLLHash(void *elem, Size len)
+{
+	return MurmurHash3_64(elem, len, MURMUR_SEED);
+}
+
+/*
+ * HLLHashRegisterUpdate
+ *
+ * Returns the register update that adding an element with the given hash code to an HLL
+ * with the given p would make
+ */
+uint32
+HLLHashRegisterUpdate(uint8 p, uint64 hash)
+{
+	int m;
+	uint8 leading = hash_leading_zeroes(p, hash, &m);
+	uint32 update = 0;
+
+	HLL_EXPLICIT_SET_REGISTER(&update, m);
+	HLL_EXPLICIT_SET_NUM_LEADING(&update, leading);
+
+	return update;
+}
+
+static int
+register_update_cmp(const void *a, const void *b)
+{
+	uint32 l = *(const uint32 *) a;
+	uint32 r = *(const uint32 *) b;
+
+	if (l < r)
+		return -1;
+	if (l > r)
+		return 1;
+	return 0;
+}
+
+/*
+ * dedupe_register_updates
+ *
+ * Sort the given register updates and only keep the greatest one for each register,
+ * returning how many are left
+ */
+static int
+dedupe_register_updates(uint32 *updates, int n)
+{
+	int i;
+	int count = 0;
+
+	if (n <= 1)
+		return n;
+
+	qsort(updates, n, sizeof(uint32), register_update_cmp);
+
+	for (i = 0; i < n; i++)
+	{
+		/* The greatest update for each register is the last one */
+		if (count && HLL_EXPLICIT_GET_REGISTER(&updates[count - 1]) == HLL_EXPLICIT_GET_REGISTER(&updates[i]))
+			updates[count - 1] = updates[i];
+		else
+			updates[count++] = updates[i];
+	}
+
+	return count;
+}
+
+/*
+ * hll_unpack_registers
+ *
+ * Decode the registers of an HLL in any representation into one byte each
+ */
+static void
+hll_unpack_registers(HyperLogLog *hll, uint8 *regs)
+{
+	int m = 1 << hll->p;
+	int i;
+
+	memset(regs, 0, m);
+
+	if (HLL_IS_DENSE(hll))
+	{
+		if (m >= HLL_DENSE_GROUP_REGISTERS)
+			hll_dense_unpack(regs, hll->M, m);
+		else
+		{
+			for (i = 0; i < m; i++)
+				HLL_DENSE_GET_REGISTER(regs[i], hll->M, i);
+		}
+	}
+	else if (HLL_IS_EXPLICIT(hll))
+	{
+		uint32 *pos = (uint32 *) hll->M;
+
+		for (i = 0; i < HLL_EXPLICIT_GET_NUM_REGISTERS(hll); i++)
+			regs[HLL_EXPLICIT_GET_REGISTER(&pos[i])] = HLL_EXPLICIT_GET_NUM_LEADING(&pos[i]);
+	}
+	else if (HLL_IS_COMPACT(hll))
+	{
+		uint8 *pos = hll->M;
+		uint8 *end = hll->M + hll->mlen;
+		int reg = 0;
+
+		while (pos < end)
+		{
+			uint8 leading;
+
+			pos = hll_compact_next(pos, &reg, &leading);
+			regs[reg] = leading;
+		}
+	}
+	else
+	{
+		uint8 *pos = hll->M;
+		uint8 *end = pos + hll->mlen;
+		int idx = 0;
+
+		while (pos < end)
+		{
+			if (HLL_SPARSE_IS_ZERO(pos))
+			{
+				idx += HLL_SPARSE_ZERO_LEN(pos);
+				pos++;
+			}
+			else if (HLL_SPARSE_IS_XZERO(pos))
+			{
+				idx += HLL_SPARSE_XZERO_LEN(pos);
+				pos += 2;
+			}
+			else
+			{
+				int runlen = HLL_SPARSE_VAL_LEN(pos);
+
+				while (runlen--)
+					regs[idx++] = HLL_SPARSE_VAL_VALUE(pos);
+				pos++;
+			}
+		}
+	}
+}
+
+/*
+ * hll_from_registers
+ *
+ * Encode the given unpacked registers as a new sparse HLL with the given p, or as a
+ * dense one if the sparse representation can't hold them
+ */
+static HyperLogLog *
+hll_from_registers(uint8 p, uint8 *regs)
+{
+	int m = 1 << p;
+	uint8 *buf = palloc(m + 2);
+	uint8 *pos = buf;
+	HyperLogLog *result;
+	int i = 0;
+	bool dense = false;
+
+	while (i < m && !dense)
+	{
+		int runlen = 1;
+
+		if (regs[i] == 0)
+		{
+			while (i + runlen < m && regs[i + runlen] == 0 && runlen < HLL_SPARSE_XZERO_MAX_LEN)
+				runlen++;
+
+			if (runlen > 64)
+			{
+				HLL_SPARSE_XZERO_SET(pos, runlen);
+				pos += 2;
+			}
+			else
+			{
+				HLL_SPARSE_ZERO_SET(pos, runlen);
+				pos++;
+			}
+		}
+		else if (regs[i] > 32)
+			dense = true;
+		else
+		{
+			while (i + runlen < m && regs[i + runlen] == regs[i] && runlen < 4)
+				runlen++;
+
+			HLL_SPARSE_VAL_SET(pos, regs[i], runlen);
+			pos++;
+		}
+
+		i += runlen;
+
+		if (pos - buf > HLL_MAX_SPARSE_BYTES)
+			dense = true;
+	}
+
+	if (dense)
+	{
+		int mlen = (m * HLL_BITS_PER_REGISTER) / 8;
+
+		result = palloc0(sizeof(HyperLogLog) + mlen + 1);
+		result->mlen = mlen;
+		result->encoding = HLL_DENSE_DIRTY;
+
+		if (m >= HLL_DENSE_GROUP_REGISTERS)
+			hll_dense_pack(result->M, regs, m);
+		else
+		{
+			for (i = 0; i < m; i++)
+				HLL_DENSE_SET_REGISTER(result->M, i, regs[i]);
+		}
+	}
+	else
+	{
+		result = palloc(sizeof(HyperLogLog) + (pos - buf));
+		result->mlen = pos - buf;
+		result->encoding = HLL_SPARSE_DIRTY;
+		memcpy(result->M, buf, result->mlen);
+	}
+
+	result->p = p;
+	result->card = 0;
+
+	pfree(buf);
+
+	return result;
+}
+
+/*
+ * hll_fold
+ *
+ * Returns a copy of the given HLL at a lower precision. The register number is taken from the
+ * lowest bits of the hash and leading zeros are counted from the first bit above them, so the
+ * register number bits that no longer fit are the first ones counted by the lower precision.
+ */
+static HyperLogLog *
+hll_fold(HyperLogLog *hll, uint8 p)
+{
+	int m = 1 << hll->p;
+	int folded_m = 1 << p;
+	uint8 *regs = palloc(m);
+	uint8 *folded = palloc0(folded_m);
+	HyperLogLog *result;
+	int i;
+
+	Assert(p < hll->p);
+
+	hll_unpack_registers(hll, regs);
+
+	for (i = 0; i < m; i++)
+	{
+		int high = i >> p;
+		int leading;
+
+		if (!regs[i])
+			continue;
+
+		if (high)
+		{
+			leading = 1;
+			while (!(high & 1))
+			{
+				high >>= 1;
+				leading++;
+			}
+		}
+		else
+			leading = Min(hll->p - p + regs[i], HLL_REGISTER_MAX);
+
+		if (leading > folded[i & (folded_m - 1)])
+			folded[i & (folded_m - 1)] = leading;
+	}
+
+	result = hll_from_registers(p, folded);
+	SET_VARSIZE(result, HLLSize(result));
+
+	pfree(regs);
+	pfree(folded);
+
+	return result;
+}
+
+/*
+ * explicit_merge_updates
+ *
+ * Merge the given sorted, deduped register updates into an explicit HLL, returning a new one
+ * or NULL if there would be too many registers for the explicit representation
+ */
+static HyperLogLog *
+explicit_merge_updates(HyperLogLog *hll, uint32 *updates, int n, int *changed)
+{
+	int nregs = HLL_EXPLICIT_GET_NUM_REGISTERS(hll);
+	uint32 *regs = (uint32 *) hll->M;
+	uint32 *merged = palloc((nregs + n) * sizeof(uint32));
+	HyperLogLog *result;
+	int i = 0;
+	int j = 0;
+	int count = 0;
+
+	*changed = 0;
+
+	while (i < nregs || j < n)
+	{
+		int ri = i < nregs ? HLL_EXPLICIT_GET_REGISTER(&regs[i]) : INT_MAX;
+		int rj = j < n ? HLL_EXPLICIT_GET_REGISTER(&updates[j]) : INT_MAX;
+
+		if (ri < rj)
+			merged[count++] = regs[i++];
+		else if (rj < ri)
+		{
+			merged[count++] = updates[j++];
+			(*changed)++;
+		}
+		else
+		{
+			if (HLL_EXPLICIT_GET_NUM_LEADING(&updates[j]) > HLL_EXPLICIT_GET_NUM_LEADING(&regs[i]))
+			{
+				merged[count++] = updates[j];
+				(*changed)++;
+			}
+			else
+				merged[count++] = regs[i];
+			i++;
+			j++;
+		}
+	}
+
+	if (count > HLL_MAX_EXPLICIT_REGISTERS)
+	{
+		pfree(merged);
+		return NULL;
+	}
+
+	if (*changed == 0)
+	{
+		pfree(merged);
+		return hll;
+	}
+
+	result = palloc(sizeof(HyperLogLog) + count * HLL_EXPLICIT_ENTRY_SIZE);
+	memcpy(result, hll, sizeof(HyperLogLog));
+	result->mlen = count * HLL_EXPLICIT_ENTRY_SIZE;
+	memcpy(result->M, merged, result->mlen);
+
+	pfree(merged);
+
+	return result;
+}
+
+/*
+ * HLLAddMany
+ *
+ * Applies the given register updates, from HLLRegisterUpdate, to the given HLL. Updates to the
+ * same register are collapsed, and sparse and explicit HLLs are rewritten once for the whole
+ * batch rather than for every update, moving to a denser representation at most once. The
+ * number of registers that changed is returned in result. The given array of updates is
+ * reordered.
+ */
+HyperLogLog *
+HLLAddMany(HyperLogLog *hll, uint32 *updates, int n, int *result)
+{
+	int m = 1 << hll->p;
+	int changed = 0;
+	int i;
+
+	if (HLL_IS_COMPACT(hll))
+	{
+		HyperLogLog *explicit = hll_compact_to_explicit(hll);
+		HyperLogLog *ret = HLLAddMany(explicit, updates, n, result);
+
+		/* Explicit HLLs are never resized in place here, so a new one leaves the copy unused */
+		if (ret != explicit)
+			pfree(explicit);
+
+		return hll_recompact(hll, ret, *result);
+	}
+
+	n = dedupe_register_updates(updates, n);
+
+	if (HLL_IS_DENSE(hll))
+	{
+		for (i = 0; i < n; i++)
+		{
+			int r;
+
+			hll = hll_dense_add_internal(hll, HLL_EXPLICIT_GET_REGISTER(&updates[i]),
+					HLL_EXPLICIT_GET_NUM_LEADING(&updates[i]), &r);
+			changed += r;
+		}
+	}
+	else
+	{
+		HyperLogLog *merged = NULL;
+
+		if (HLL_IS_EXPLICIT(hll))
+			merged = explicit_merge_updates(hll, updates, n, &changed);
+
+		if (merged)
+			hll = merged;
+		else
+		{
+			/* The representation is rewritten from scratch, so work on unpacked registers */
+			uint8 *regs = palloc(m);
+
+			hll_unpack_registers(hll, regs);
+
+			changed = 0;
+			for (i = 0; i < n; i++)
+			{
+				int reg = HLL_EXPLICIT_GET_REGISTER(&updates[i]);
+				uint8 leading = HLL_EXPLICIT_GET_NUM_LEADING(&updates[i]);
+
+				if (leading > regs[reg])
+				{
+					regs[reg] = leading;
+					changed++;
+				}
+			}
+
+			/* An explicit HLL that's outgrown its representation is rewritten even if nothing changed */
+			if (changed || HLL_IS_EXPLICIT(hll))
+				hll = hll_from_registers(hll->p, regs);
+
+			pfree(regs);
+		}
+	}
+
+	if (changed)
+		hll->encoding = HLL_IS_SPARSE(hll) ? HLL_SPARSE_DIRTY :
+				(HLL_IS_DENSE(hll) ? HLL_DENSE_DIRTY : HLL_EXPLICIT_DIRTY);
+
+	SET_VARSIZE(hll, HLLSize(hll));
+	*result = changed;
+
+	return hll;
+}
+
 /*
  * HLLCardinality
  *
@@ -1215,6 +1929,11 @@ HLLCardinality(HyperLogLog *hll)
 		E = hll_sparse_sum(hll, PE, &ez);
 		hll->encoding = HLL_SPARSE_CLEAN;
   }
+  else if (HLL_IS_COMPACT(hll))
+  {
+		E = hll_compact_sum(hll, PE, &ez);
+		hll->encoding = HLL_COMPACT_CLEAN;
+  }
   else
   {
 		E = hll_explicit_sum(hll, PE, &ez);
@@ -1269,9 +1988,22 @@ hll_dense_union(HyperLogLog *result, HyperLogLog *incoming)
 
 	Assert(HLL_IS_DENSE(result));
 
-	if (HLL_IS_DENSE(incoming))
+	if (HLL_IS_DENSE(incoming) && m >= HLL_DENSE_GROUP_REGISTERS)
 	{
 		/* easy, just take the max of each HLL's registers */
+		uint8 *r0 = palloc(m);
+		uint8 *r1 = palloc(m);
+
+		hll_dense_unpack(r0, result->M, m);
+		hll_dense_unpack(r1, incoming->M, m);
+		hll_registers_max(r0, r1, m);
+		hll_dense_pack(result->M, r0, m);
+
+		pfree(r0);
+		pfree(r1);
+	}
+	else if (HLL_IS_DENSE(incoming))
+	{
 		for (reg=0; reg<m; reg++)
 		{
 			uint8 r0;
@@ -1405,17 +2137,8 @@ hll_sparse_union(HyperLogLog *result, HyperLogLog *incoming)
 	return result;
 }
 
-/*
- * HLLUnion
- *
- * Returns the lossless union of multiple HyperLogLogs
- *
- * This function can be potentially slow, but is optimized to run fast
- * for continuous queries and will try to upgrade to denser representations
- * as lazily as possible.
- */
-HyperLogLog *
-HLLUnion(HyperLogLog *result, HyperLogLog *incoming)
+static HyperLogLog *
+hll_union(HyperLogLog *result, HyperLogLog *incoming)
 {
 	/* EXPLICIT + EXPLICIT */
 	if (HLL_IS_EXPLICIT(result) && HLL_IS_EXPLICIT(incoming))
@@ -1451,3 +2174,142 @@ HLLUnion(HyperLogLog *result, HyperLogLog *incoming)
 
 	return result;
 }
+
+/*
+ * HLLUnion
+ *
+ * Returns the lossless union of multiple HyperLogLogs
+ *
+ * This function can be potentially slow, but is optimized to run fast
+ * for continuous queries and will try to upgrade to denser representations
+ * as lazily as possible. HLLs with different precisions are combined at the
+ * lower one.
+ */
+HyperLogLog *
+HLLUnion(HyperLogLog *result, HyperLogLog *incoming)
+{
+	HyperLogLog *compact = NULL;
+	HyperLogLog *copy = NULL;
+
+	if (result->p > incoming->p)
+		result = hll_fold(result, incoming->p);
+	else if (incoming->p > result->p)
+		incoming = copy = hll_fold(incoming, result->p);
+
+	if (HLL_IS_COMPACT(incoming))
+	{
+		incoming = hll_compact_to_explicit(incoming);
+		if (copy)
+			pfree(copy);
+		copy = incoming;
+	}
+
+	if (HLL_IS_COMPACT(result))
+	{
+		compact = result;
+		result = hll_compact_to_explicit(result);
+	}
+
+	result = hll_union(result, incoming);
+
+	if (compact)
+		result = hll_recompact(compact, result, 1);
+
+	if (copy)
+		pfree(copy);
+
+	return result;
+}
+
+/*
+ * HLLIsValid
+ *
+ * Checks that the given HLL, e.g. one received from outside of the server, is well formed for its encoding,
+ * so that reading its registers stays within it
+ */
+bool
+HLLIsValid(HyperLogLog *hll)
+{
+	uint8 *pos = hll->M;
+	uint8 *end;
+	int m;
+	int reg = 0;
+	int i;
+
+	if (VARSIZE(hll) < sizeof(HyperLogLog) || hll->mlen < 0 || VARSIZE(hll) != HLLSize(hll))
+		return false;
+
+	if (hll->p < 1 || hll->p > HLL_DEFAULT_P)
+		return false;
+
+	m = 1 << hll->p;
+	end = hll->M + hll->mlen;
+
+	if (HLL_IS_DENSE(hll))
+		return hll->mlen == (m * HLL_BITS_PER_REGISTER) / 8;
+
+	if (HLL_IS_EXPLICIT(hll))
+	{
+		if (hll->mlen % HLL_EXPLICIT_ENTRY_SIZE)
+			return false;
+
+		for (i = 0; i < HLL_EXPLICIT_GET_NUM_REGISTERS(hll); i++)
+		{
+			if (HLL_EXPLICIT_GET_REGISTER(pos) >= m)
+				return false;
+			pos += HLL_EXPLICIT_ENTRY_SIZE;
+		}
+
+		return true;
+	}
+
+	if (HLL_IS_COMPACT(hll))
+	{
+		uint8 leading;
+
+		/* the last register must end within the HLL */
+		if (hll->mlen && (hll->M[hll->mlen - 1] & 0x80))
+			return false;
+
+		while (pos < end)
+		{
+			pos = hll_compact_next(pos, &reg, &leading);
+			if (reg >= m)
+				return false;
+		}
+
+		return true;
+	}
+
+	if (HLL_IS_SPARSE(hll))
+	{
+		/* the runs of a sparse HLL cover all of its registers */
+		while (pos < end)
+		{
+			if (HLL_SPARSE_IS_XZERO(pos))
+			{
+				if (pos + 1 >= end)
+					return false;
+				reg += HLL_SPARSE_XZERO_LEN(pos);
+				pos += 2;
+			}
+			else if (HLL_SPARSE_IS_ZERO(pos))
+			{
+				reg += HLL_SPARSE_ZERO_LEN(pos);
+				pos++;
+			}
+			else
+			{
+				reg += HLL_SPARSE_VAL_LEN(pos);
+				pos++;
+			}
+
+			if (reg > m)
+				return false;
+		}
+
+		return reg == m;
+	}
+
+	return false;
+}
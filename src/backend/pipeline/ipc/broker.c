@@ -18,6 +18,7 @@
 #include "libpq/pqsignal.h"
 #include "miscadmin.h"
 #include "nodes/print.h"
+#include "portability/instr_time.h"
 #include "pipeline/cont_execute.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/ipc/broker.h"
@@ -51,6 +52,7 @@
 #define num_queues_per_worker 3
 #define num_queues_per_combiner 1
 #define max_locks (max_worker_processes * 2)
+#define worker_broker_id(db_meta, i) (((db_meta)->lock_idx + (i)) % continuous_query_num_ipc_brokers)
 
 typedef struct local_queue
 {
@@ -87,20 +89,27 @@ typedef struct broker_db_meta
 	/* index into broker_meta->locks array */
 	int lock_idx;
 
-	/* segment for ipc queues of all database worker and combiner processes */
-	dsm_segment *segment;
 	dsm_handle handle;
 
-	/* in local memory */
-	local_queue *lqueues;
+	/*
+	 * Segment for ipc queues of all database worker and combiner processes, and local queues, as seen by
+	 * each broker process. These live in each broker's local memory and are only ever touched by their owner.
+	 */
+	dsm_segment *segments[MAX_IPC_BROKERS];
+	local_queue *lqueues[MAX_IPC_BROKERS];
 } broker_db_meta;
 
-typedef struct BrokerMeta
+typedef struct BrokerProc
 {
 	pid_t pid;
 	Latch *latch;
 
 	pg_atomic_flag waiting;
+} BrokerProc;
+
+typedef struct BrokerMeta
+{
+	BrokerProc procs[MAX_IPC_BROKERS];
 
 	HTAB *db_meta_hash;
 
@@ -111,10 +120,15 @@ typedef struct BrokerMeta
 
 /* guc */
 int continuous_query_ipc_shared_mem;
+bool continuous_query_ipc_lock_free_insert;
+int continuous_query_num_ipc_brokers;
 
 /* flag to tell if we're in IPC broker process */
 static bool am_ipc_msg_broker = false;
 
+/* index of this IPC broker process, each broker handles a disjoint subset of worker queues */
+static int MyBrokerId = -1;
+
 /* metadata for managing dsm segments and ipc queues */
 static BrokerMeta *broker_meta = NULL;
 
@@ -169,7 +183,8 @@ IPCMessageBrokerShmemInit(void)
 
 		MemSet(broker_meta, 0, size);
 
-		pg_atomic_init_flag(&broker_meta->waiting);
+		for (i = 0; i < MAX_IPC_BROKERS; i++)
+			pg_atomic_init_flag(&broker_meta->procs[i].waiting);
 
 		MemSet(&ctl, 0, sizeof(HASHCTL));
 
@@ -337,29 +352,49 @@ purge_dropped_db_segments(bool force)
 			Oid dbid = lfirst_oid(lc);
 			bool found;
 
+			local_queue *lqueues;
+			bool in_use = false;
+			int i;
+
+			/* Another broker may have beaten us to it */
 			db_meta = hash_search(broker_meta->db_meta_hash, &dbid, HASH_FIND, &found);
-			Assert(found);
+			if (!found)
+				continue;
 
 			Assert(db_meta->handle > 0);
 
 			/* detach from main db segment */
-			if (db_meta->segment)
-				dsm_detach(db_meta->segment);
+			if (db_meta->segments[MyBrokerId])
+				dsm_detach(db_meta->segments[MyBrokerId]);
+			db_meta->segments[MyBrokerId] = NULL;
 
-			if (db_meta->lqueues)
+			lqueues = db_meta->lqueues[MyBrokerId];
+			if (lqueues)
 			{
-				int i;
-
 				for (i = 0; i < continuous_query_num_workers; i++)
 				{
-					local_queue *local_buf = &db_meta->lqueues[i];
+					local_queue *local_buf = &lqueues[i];
 					if (local_buf->slots)
 						list_free_deep(local_buf->slots);
 				}
 
-				pfree(db_meta->lqueues);
+				pfree(lqueues);
+			}
+			db_meta->lqueues[MyBrokerId] = NULL;
+
+			/* The last broker to let go of this database removes its entry */
+			for (i = 0; i < MAX_IPC_BROKERS; i++)
+			{
+				if (db_meta->segments[i] || db_meta->lqueues[i])
+				{
+					in_use = true;
+					break;
+				}
 			}
 
+			if (in_use)
+				continue;
+
 			hash_search(broker_meta->db_meta_hash, &dbid, HASH_REMOVE, &found);
 			Assert(found);
 		}
@@ -448,11 +483,40 @@ copy_lq_to_bwq(local_queue *local_buf, ipc_queue *bwq, uint64 *bwq_head, uint64
 	return copied;
 }
 
+/*
+ * copy_slot_range
+ *
+ * Copy the contiguous range of slots [start, end) from src to dest. This relies on worker->broker and
+ * broker->worker queues being the same size and always being at the same logical positions, so both
+ * the slot headers and their payloads can be moved with at most two memcpy calls.
+ */
+static void
+copy_slot_range(ipc_queue *src, ipc_queue *dest, uint64 start, uint64 end)
+{
+	uint64 start_off = ipc_queue_offset(src, start);
+	uint64 end_off = ipc_queue_offset(src, end);
+
+	Assert(src->size == dest->size);
+
+	if (start == end)
+		return;
+
+	if (start_off < end_off)
+		memcpy(dest->bytes + start_off, src->bytes + start_off, end_off - start_off);
+	else
+	{
+		/* Includes the padding at the end of the buffer, which a wrapping slot's header may occupy */
+		memcpy(dest->bytes + start_off, src->bytes + start_off, src->size + sizeof(ipc_queue_slot) - start_off);
+		memcpy(dest->bytes, src->bytes, end_off);
+	}
+}
+
 static uint64
 copy_wbq_to_bwq(ipc_queue *wbq, ipc_queue *bwq, uint64 *bwq_head, uint64 bwq_tail, bool *isfull)
 {
 	uint64 wbq_head = pg_atomic_read_u64(&wbq->head);
 	uint64 wbq_tail = wbq->cursor;
+	uint64 start = wbq_tail;
 	int free;
 	int count = 0;
 
@@ -462,13 +526,14 @@ copy_wbq_to_bwq(ipc_queue *wbq, ipc_queue *bwq, uint64 *bwq_head, uint64 bwq_tai
 	free = ipc_queue_free_size(bwq, wbq_tail, bwq_tail);
 	Assert(free >= 0);
 
+	/*
+	 * First find the longest run of slots that fits in the bwq. We only need to look at slot
+	 * headers here, the actual data is moved in bulk afterwards.
+	 */
 	while (true)
 	{
 		ipc_queue_slot *src_slot;
-		ipc_queue_slot *dest_slot;
 		int len_needed;
-		char *src_bytes;
-		char *dest_bytes;
 
 		Assert(wbq_tail <= wbq_head);
 
@@ -481,8 +546,6 @@ copy_wbq_to_bwq(ipc_queue *wbq, ipc_queue *bwq, uint64 *bwq_head, uint64 bwq_tai
 		}
 
 		src_slot = ipc_queue_slot_get(wbq, wbq_tail);
-		dest_slot =  ipc_queue_slot_get(bwq, wbq_tail);
-
 		len_needed = src_slot->next - wbq_tail;
 
 		if (len_needed > free)
@@ -492,21 +555,13 @@ copy_wbq_to_bwq(ipc_queue *wbq, ipc_queue *bwq, uint64 *bwq_head, uint64 bwq_tai
 		}
 
 		free -= len_needed;
-
-		*dest_slot = *src_slot;
-		dest_slot->peeked = false;
-
-		src_bytes = src_slot->wraps ? wbq->bytes : src_slot->bytes;
-		dest_bytes = src_slot->wraps ? bwq->bytes : dest_slot->bytes;
-		ipc_queue_check_overflow(bwq, dest_bytes, src_slot->len);
-
-		memcpy(dest_bytes, src_bytes, src_slot->len);
-
 		wbq_tail = src_slot->next;
 
 		count++;
 	}
 
+	copy_slot_range(wbq, bwq, start, wbq_tail);
+
 	wbq->cursor = wbq_tail;
 	*bwq_head = wbq_tail;
 
@@ -575,7 +630,7 @@ copy_messages(void)
 		int i;
 		char *ptr;
 
-		if (!db_meta->segment)
+		if (!db_meta->segments[MyBrokerId])
 		{
 			dsm_segment *segment = dsm_attach_and_pin(db_meta->handle);
 
@@ -585,20 +640,21 @@ copy_messages(void)
 				continue;
 			}
 
-			db_meta->segment = segment;
+			db_meta->segments[MyBrokerId] = segment;
 		}
 
-		if (!db_meta->lqueues)
-			db_meta->lqueues = MemoryContextAllocZero(CacheMemoryContext,
+		if (!db_meta->lqueues[MyBrokerId])
+			db_meta->lqueues[MyBrokerId] = MemoryContextAllocZero(CacheMemoryContext,
 					sizeof(local_queue) * continuous_query_num_workers);
 
-		ptr = dsm_segment_address(db_meta->segment);
+		ptr = dsm_segment_address(db_meta->segments[MyBrokerId]);
 
 		for (i = 0; i < continuous_query_num_workers; i++)
 		{
 			ipc_queue *bwq; /* broker->worker queue */
 			ipc_queue *wbq; /* worker->broker queue */
-			local_queue *local_buf = &db_meta->lqueues[i];
+			ipc_queue *iwq; /* insert->worker queue */
+			local_queue *local_buf = &db_meta->lqueues[MyBrokerId][i];
 			uint64 last_wbq_cur;
 			uint64 bwq_head;
 			int bwq_inserted = 0;
@@ -608,7 +664,17 @@ copy_messages(void)
 			bwq = (ipc_queue *) ptr;
 			ptr += ipc_queue_size;
 			wbq = (ipc_queue *) ptr;
-			ptr += 2 * ipc_queue_size;
+			ptr += ipc_queue_size;
+			iwq = (ipc_queue *) ptr;
+			ptr += ipc_queue_size;
+
+			/* Queues of this worker are handled by another broker */
+			if (worker_broker_id(db_meta, i) != MyBrokerId)
+				continue;
+
+			/* Move slots that stream inserts spilled to disk back into the insert queue */
+			if (ipc_queue_has_spill(iwq))
+				num_copied += ipc_queue_unspill(iwq);
 
 			/* check some invariants */
 			Assert(bwq->produced_by_broker);
@@ -640,6 +706,7 @@ copy_messages(void)
 			}
 
 			num_copied += copy_wbq_to_lq(wbq, local_buf);
+			pg_atomic_write_u64(&wbq->broker_buffered, local_buf->size);
 
 			if (wbq->cursor > last_wbq_cur)
 			{
@@ -675,38 +742,55 @@ have_no_pending_messages_or_out_of_space(void)
 		int i;
 		char *ptr;
 
-		if (!db_meta->segment)
+		if (!db_meta->segments[MyBrokerId])
 		{
 			success = false;
 			break;
 		}
 
-		ptr = dsm_segment_address(db_meta->segment);
+		ptr = dsm_segment_address(db_meta->segments[MyBrokerId]);
 
 		for (i = 0; i < continuous_query_num_workers; i++)
 		{
 			ipc_queue *dst;
 			ipc_queue *src;
+			ipc_queue *iwq;
 			char *pos;
 			uint64 dst_head;
 			uint64 dst_tail;
 			int free;
 			ipc_queue_slot *slot = NULL;
+			local_queue *local_buf = &db_meta->lqueues[MyBrokerId][i];
+
+			if (worker_broker_id(db_meta, i) != MyBrokerId)
+				continue;
 
 			pos = ptr + i * num_queues_per_worker * ipc_queue_size;
 			dst = (ipc_queue *) pos;
 			pos += ipc_queue_size;
 			src = (ipc_queue *) pos;
+			pos += ipc_queue_size;
+			iwq = (ipc_queue *) pos;
 
 			Assert(dst->produced_by_broker);
 			Assert(src->consumed_by_broker);
 
+			/*
+			 * Spilled slots are pending if the insert queue has drained enough. We're signaled when it drains,
+			 * so there's no need to spin on a queue that's still mostly full.
+			 */
+			if (ipc_queue_has_spill(iwq) && ipc_queue_fill_ratio(iwq) < 0.5)
+			{
+				success = false;
+				goto end;
+			}
+
 			dst_head = pg_atomic_read_u64(&dst->head);
 			dst_tail = pg_atomic_read_u64(&dst->tail);
 			free = ipc_queue_free_size(dst, dst_head, dst_tail);
 
-			if (db_meta->lqueues[i].size)
-				slot = (ipc_queue_slot *) linitial(db_meta->lqueues[i].slots);
+			if (local_buf->size)
+				slot = (ipc_queue_slot *) linitial(local_buf->slots);
 			else if (!ipc_queue_is_empty(src))
 				slot = (ipc_queue_slot *) ipc_queue_slot_get(src, src->cursor);
 
@@ -742,8 +826,8 @@ disconnect_from_all_segments(void)
 	hash_seq_init(&status, broker_meta->db_meta_hash);
 	while ((db_meta = (broker_db_meta *) hash_seq_search(&status)) != NULL)
 	{
-		if (db_meta->segment)
-			dsm_detach(db_meta->segment);
+		if (db_meta->segments[MyBrokerId])
+			dsm_detach(db_meta->segments[MyBrokerId]);
 	}
 
 	LWLockRelease(IPCMessageBrokerIndexLock);
@@ -765,9 +849,17 @@ ipc_msg_broker_main(int argc, char *argv[])
 	MyPMChildSlot = AssignPostmasterChildSlot();
 	MyStartTime = time(NULL);
 
-	init_ps_display("ipc message broker", "", "", "");
+	if (continuous_query_num_ipc_brokers > 1)
+	{
+		char name[NAMEDATALEN];
 
-	elog(LOG, "ipc message broker started");
+		snprintf(name, NAMEDATALEN, "ipc message broker%d", MyBrokerId);
+		init_ps_display(name, "", "", "");
+	}
+	else
+		init_ps_display("ipc message broker", "", "", "");
+
+	elog(LOG, "ipc message broker %d started", MyBrokerId);
 
 	if (PostAuthDelay)
 		pg_usleep(PostAuthDelay * 1000000L);
@@ -795,6 +887,9 @@ ipc_msg_broker_main(int argc, char *argv[])
 
 	SetProcessingMode(NormalProcessing);
 
+	SetCPUAffinity(continuous_query_broker_cpus);
+	JoinCGroup(continuous_query_cgroup);
+
 	/*
 	 * Create a memory context that we will do all our work in.  We do this so
 	 * that we can reset the context during error recovery and thereby avoid
@@ -857,8 +952,8 @@ ipc_msg_broker_main(int argc, char *argv[])
 	/* must unblock signals before calling rebuild_database_list */
 	PG_SETMASK(&UnBlockSig);
 
-	broker_meta->pid = MyProcPid;
-	broker_meta->latch = MyLatch;
+	broker_meta->procs[MyBrokerId].pid = MyProcPid;
+	broker_meta->procs[MyBrokerId].latch = MyLatch;
 
 	/* Loop forever */
 	for (;;)
@@ -878,13 +973,13 @@ ipc_msg_broker_main(int argc, char *argv[])
 		if (!num_copied)
 		{
 			/* Mark as waiting */
-			pg_atomic_test_set_flag(&broker_meta->waiting);
+			pg_atomic_test_set_flag(&broker_meta->procs[MyBrokerId].waiting);
 
 			/* If we have no pending messages or out of space is dest ipc_queues, sleep till we get signaled. */
 			if (have_no_pending_messages_or_out_of_space())
 			{
 				int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
-				pg_atomic_clear_flag(&broker_meta->waiting);
+				pg_atomic_clear_flag(&broker_meta->procs[MyBrokerId].waiting);
 				ResetLatch(MyLatch);
 
 				/* Emergency bail out if postmaster has died */
@@ -892,7 +987,7 @@ ipc_msg_broker_main(int argc, char *argv[])
 					proc_exit(1);
 			}
 
-			pg_atomic_clear_flag(&broker_meta->waiting);
+			pg_atomic_clear_flag(&broker_meta->procs[MyBrokerId].waiting);
 		}
 
 		/* Shutdown signaled? */
@@ -902,19 +997,25 @@ ipc_msg_broker_main(int argc, char *argv[])
 
 	disconnect_from_all_segments();
 
-	elog(LOG, "ipc message broker shutting down");
+	elog(LOG, "ipc message broker %d shutting down", MyBrokerId);
 
 	proc_exit(0); /* done */
 }
 
 /*
  * StartIPCMessageBroker
+ *
+ * Start the IPC message broker with the given id. Each broker moves messages for a disjoint
+ * subset of all databases' worker queues.
  */
 pid_t
-StartIPCMessageBroker(void)
+StartIPCMessageBroker(int id)
 {
 	pid_t pid;
 
+	Assert(id >= 0 && id < continuous_query_num_ipc_brokers);
+	MyBrokerId = id;
+
 	switch ((pid = fork_process()))
 	{
 		/* Error? */
@@ -971,6 +1072,33 @@ dsm_create_and_pin(Size size)
 	return segment;
 }
 
+/*
+ * bind_queues_to_numa_nodes
+ *
+ * Place each worker's and combiner's queues on the NUMA node that the process consuming them
+ * is pinned to. This must happen before the segment is first touched.
+ */
+static void
+bind_queues_to_numa_nodes(char *ptr)
+{
+	int i;
+
+	if (GetContQueryNumaNode(0) == -1)
+		return;
+
+	for (i = 0; i < continuous_query_num_workers; i++)
+	{
+		BindMemoryToNumaNode(ptr, ipc_queue_size * num_queues_per_worker, GetContQueryNumaNode(i));
+		ptr += ipc_queue_size * num_queues_per_worker;
+	}
+
+	for (i = 0; i < continuous_query_num_combiners; i++)
+	{
+		BindMemoryToNumaNode(ptr, ipc_queue_size * num_queues_per_combiner, GetContQueryNumaNode(i));
+		ptr += ipc_queue_size * num_queues_per_combiner;
+	}
+}
+
 static broker_db_meta *
 get_db_meta(Oid dbid)
 {
@@ -1038,6 +1166,7 @@ get_db_meta(Oid dbid)
 
 		/* Initialize all ipc_queues for worker and combiner processes. */
 		ptr = dsm_segment_address(segment);
+		bind_queues_to_numa_nodes(ptr);
 		MemSet(ptr, 0, db_dsm_segment_size);
 
 		for (i = 0; i < continuous_query_num_workers; i++)
@@ -1059,6 +1188,7 @@ get_db_meta(Oid dbid)
 			ipc_queue_init(ptr, ipc_queue_size, NULL);
 			ipc_queue_set_handlers(ipcq, StreamTupleStatePeekFn, popfn, NULL);
 			ipcq->produced_by_broker = true;
+			ipcq->broker_id = worker_broker_id(db_meta, i);
 			ptr += ipc_queue_size;
 
 			/* We use the same lock for these two producer queues */
@@ -1068,12 +1198,17 @@ get_db_meta(Oid dbid)
 			ipc_queue_init(ptr, ipc_queue_size, &lock_slot->lock);
 			ipc_queue_set_handlers(ipcq, NULL, NULL, StreamTupleStateCopyFn);
 			ipcq->consumed_by_broker = true;
+			ipcq->broker_id = worker_broker_id(db_meta, i);
 			ptr += ipc_queue_size;
 			lock_slot++;
 
 			/* insert->worker queue */
+			ipcq = (ipc_queue *) ptr;
 			ipc_queue_init(ptr, ipc_queue_size, &lock_slot->lock);
-			ipc_queue_set_handlers((ipc_queue *) ptr, StreamTupleStatePeekFn, popfn, StreamTupleStateCopyFn);
+			ipc_queue_set_handlers(ipcq, StreamTupleStatePeekFn, popfn, StreamTupleStateCopyFn);
+			ipcq->multi_producer = continuous_query_ipc_lock_free_insert;
+			ipcq->broker_id = worker_broker_id(db_meta, i);
+			ipc_queue_enable_spill(ipcq, MyDatabaseId, i);
 			ptr += ipc_queue_size;
 			lock_slot++;
 		}
@@ -1134,6 +1269,21 @@ acquire_my_broker_ipc_queue(void)
 	return get_worker_ipcq(my_ipc_meta->segment, MyContQueryProc->group_id, false, true);
 }
 
+/*
+ * acquire_worker_ipc_queue
+ *
+ * Returns the insert queue of another worker in this database, which must only be consumed from
+ * through ipc_queue_steal_next
+ */
+ipc_queue *
+acquire_worker_ipc_queue(int idx)
+{
+	Assert(my_ipc_meta);
+	Assert(IsContQueryWorkerProcess());
+
+	return get_worker_ipcq(my_ipc_meta->segment, idx, false, false);
+}
+
 ipc_queue *
 acquire_my_ipc_queue(void)
 {
@@ -1180,23 +1330,52 @@ release_my_ipc_queue()
 	my_ipc_meta = NULL;
 }
 
+/*
+ * wait_for_queue_lock
+ *
+ * Block until we hold the lock of a queue that another producer holds, counting the wait
+ */
+static void
+wait_for_queue_lock(ipc_queue *ipcq)
+{
+	instr_time start;
+	instr_time elapsed;
+
+	INSTR_TIME_SET_CURRENT(start);
+	ipc_queue_lock(ipcq, true);
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start);
+
+	MyStreamInsertWaits.queue_lock_waits++;
+	MyStreamInsertWaits.queue_lock_wait_time += INSTR_TIME_GET_MICROSEC(elapsed);
+}
+
+/*
+ * get_any_worker_queue_with_lock
+ *
+ * Lock the queue of any worker in the given pool, rotating through them
+ */
 ipc_queue *
-get_any_worker_queue_with_lock(void)
+get_any_worker_queue_with_lock(int pool)
 {
 	static long idx = -1;
 	static bool broker_handled;
+	int first;
+	int nworkers;
 	int ntries = 0;
 	ipc_queue *ipcq = NULL;
 	broker_db_meta *db_meta = get_db_meta(MyDatabaseId);
 	dsm_segment *segment = dsm_attach_and_pin(db_meta->handle);
 
+	GetWorkerPoolWorkers(pool, &first, &nworkers);
+
 	if (idx == -1)
 	{
-		idx = rand() % continuous_query_num_workers;
+		idx = rand() % nworkers;
 		broker_handled = IsContQueryWorkerProcess();
 	}
 
-	idx = (idx + 1) % continuous_query_num_workers;
+	idx = (idx + 1) % nworkers;
 
 	for (;;)
 	{
@@ -1204,36 +1383,39 @@ get_any_worker_queue_with_lock(void)
 		 * If we have multiple workers and we're trying to write from a continuous transform, never write to our
 		 * own queue.
 		 */
-		if (IsContQueryWorkerProcess() && continuous_query_num_workers > 1 && idx == MyContQueryProc->id)
+		if (IsContQueryWorkerProcess() && nworkers > 1 && first + idx == MyContQueryProc->id)
 		{
 			ntries++;
-			idx = (idx + 1) % continuous_query_num_workers;
+			idx = (idx + 1) % nworkers;
 		}
 
-		ipcq = get_worker_ipcq(segment, idx, true, broker_handled);
+		ipcq = get_worker_ipcq(segment, first + idx, true, broker_handled);
 
 		/*
 		 * Try to lock dsm_cqueue of any worker that is not already locked in
 		 * a round robin fashion.
 		 */
-		if (ntries < continuous_query_num_workers)
+		if (ntries < nworkers)
 		{
 			if (ipc_queue_lock(ipcq, false))
 				break;
+			MyStreamInsertWaits.queue_lock_misses++;
 		}
 		else
 		{
 			/* If all workers are locked, then just wait for the lock. */
-			ipc_queue_lock(ipcq, true);
+			wait_for_queue_lock(ipcq);
 			break;
 		}
 
 		ntries++;
-		idx = (idx + 1) % continuous_query_num_workers;
+		idx = (idx + 1) % nworkers;
 	}
 
 	Assert(ipcq);
-	Assert(LWLockHeldByMe(ipcq->lock));
+	Assert(ipcq->multi_producer || LWLockHeldByMe(ipcq->lock));
+
+	MyStreamInsertWaits.queue_locks++;
 
 	return ipcq;
 }
@@ -1244,7 +1426,14 @@ get_worker_queue_with_lock(int idx, bool broker_handled)
 	broker_db_meta *db_meta = get_db_meta(MyDatabaseId);
 	dsm_segment *segment = dsm_attach_and_pin(db_meta->handle);
 	ipc_queue *ipcq = get_worker_ipcq(segment, idx, true, broker_handled);
-	ipc_queue_lock(ipcq, true);
+
+	if (!ipc_queue_lock(ipcq, false))
+	{
+		MyStreamInsertWaits.queue_lock_misses++;
+		wait_for_queue_lock(ipcq);
+	}
+	MyStreamInsertWaits.queue_locks++;
+
 	return ipcq;
 }
 
@@ -1258,9 +1447,111 @@ get_combiner_queue_with_lock(int idx)
 	return ipcq;
 }
 
+/*
+ * get_ipc_queue_dbs
+ *
+ * Returns the ids of all databases whose queues have been created
+ */
+Oid *
+get_ipc_queue_dbs(int *ndbs)
+{
+	HASH_SEQ_STATUS status;
+	broker_db_meta *db_meta;
+	Oid *dbids;
+	int n = 0;
+
+	LWLockAcquire(IPCMessageBrokerIndexLock, LW_SHARED);
+
+	dbids = palloc(sizeof(Oid) * Max(hash_get_num_entries(broker_meta->db_meta_hash), 1));
+
+	hash_seq_init(&status, broker_meta->db_meta_hash);
+	while ((db_meta = (broker_db_meta *) hash_seq_search(&status)) != NULL)
+		dbids[n++] = db_meta->dbid;
+
+	LWLockRelease(IPCMessageBrokerIndexLock);
+
+	*ndbs = n;
+
+	return dbids;
+}
+
+/*
+ * get_db_ipc_queues
+ *
+ * Returns all worker and combiner queues of the given database, or NULL if they haven't been created yet.
+ * No queue locks are taken, so the queues must only be read with ipc_queue_stats_get. The segment they
+ * live in stays mapped until it's detached, and is returned in segment if that's not NULL.
+ */
+ipc_queue_info *
+get_db_ipc_queues(Oid dbid, dsm_segment **segment_out, int *nqueues)
+{
+	broker_db_meta *db_meta;
+	dsm_handle handle = 0;
+	dsm_segment *segment;
+	ipc_queue_info *queues;
+	char *ptr;
+	int n = 0;
+	int i;
+
+	LWLockAcquire(IPCMessageBrokerIndexLock, LW_SHARED);
+	db_meta = hash_search(broker_meta->db_meta_hash, &dbid, HASH_FIND, NULL);
+	if (db_meta)
+		handle = db_meta->handle;
+	LWLockRelease(IPCMessageBrokerIndexLock);
+
+	*nqueues = 0;
+	if (segment_out)
+		*segment_out = NULL;
+
+	if (!db_meta)
+		return NULL;
+
+	segment = dsm_attach_and_pin(handle);
+	if (!segment)
+		return NULL;
+
+	queues = palloc0(sizeof(ipc_queue_info) * num_queues_per_db);
+	ptr = dsm_segment_address(segment);
+
+	for (i = 0; i < continuous_query_num_workers; i++)
+	{
+		queues[n].type = "broker->worker";
+		queues[n].group_id = i;
+		queues[n++].queue = (ipc_queue *) ptr;
+		ptr += ipc_queue_size;
+
+		queues[n].type = "worker->broker";
+		queues[n].group_id = i;
+		queues[n++].queue = (ipc_queue *) ptr;
+		ptr += ipc_queue_size;
+
+		queues[n].type = "insert->worker";
+		queues[n].group_id = i;
+		queues[n++].queue = (ipc_queue *) ptr;
+		ptr += ipc_queue_size;
+	}
+
+	for (i = 0; i < continuous_query_num_combiners; i++)
+	{
+		queues[n].type = "worker->combiner";
+		queues[n].group_id = i;
+		queues[n++].queue = (ipc_queue *) ptr;
+		ptr += ipc_queue_size;
+	}
+
+	Assert(n == num_queues_per_db);
+	*nqueues = n;
+	if (segment_out)
+		*segment_out = segment;
+
+	return queues;
+}
+
 void
-signal_ipc_broker_process(void)
+signal_ipc_broker_process(int id)
 {
-	if (!pg_atomic_unlocked_test_flag(&broker_meta->waiting))
-		SetLatch(broker_meta->latch);
+	BrokerProc *proc = &broker_meta->procs[id];
+
+	if (!pg_atomic_unlocked_test_flag(&proc->waiting))
+		SetLatch(proc->latch);
 }
@@ -9,11 +9,17 @@
 
 #include "postgres.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "miscadmin.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/ipc/broker.h"
 #include "pipeline/ipc/queue.h"
 #include "port/atomics.h"
+#include "portability/instr_time.h"
+#include "storage/fd.h"
 #include "storage/latch.h"
 #include "storage/lwlock.h"
 #include "utils/memutils.h"
@@ -21,6 +27,27 @@
 #define MAGIC 0xDEADBABE /* x_x */
 #define WAIT_SLEEP_NS 250
 #define MAX_WAIT_SLEEP_NS 5000 /* 5ms */
+#define MP_PUBLISH_SPINS 1000
+#define SPIN_CHECK_INTERVAL 64
+#define MIN_SPIN_TIME_US 10
+
+/* Spilled items are preceded by their length, and never span segment files */
+#define SPILL_SEGMENT_SIZE (16 * 1024 * 1024)
+#define SPILL_DIR "base/" PG_TEMP_FILES_DIR
+#define SPILL_FILE_FMT SPILL_DIR "/" PG_TEMP_FILE_PREFIX "_ipcq_%u_%d.%lu"
+
+/* guc parameters */
+int continuous_query_ipc_spin_time;
+
+/*
+ * Current spin budget of this consumer in microseconds. It's halved each time spinning doesn't
+ * find any new data and doubled (up to continuous_query_ipc_spin_time) each time it does, so idle
+ * consumers quickly stop burning CPU.
+ */
+static int spin_budget = -1;
+
+/* insert time of the slot this process most recently peeked or stole */
+static TimestampTz last_read_time = 0;
 
 void
 ipc_queue_init(void *ptr, Size size, LWLock *lock)
@@ -39,10 +66,20 @@ ipc_queue_init(void *ptr, Size size, LWLock *lock)
 	/* Initialize atomic types. */
 	pg_atomic_init_u64(&ipcq->head, 0);
 	pg_atomic_init_u64(&ipcq->tail, 0);
+	pg_atomic_init_u64(&ipcq->reserved, 0);
 	ipcq->cursor = 0;
+	SpinLockInit(&ipcq->cursor_lock);
+	pg_atomic_init_u32(&ipcq->steals_in_progress, 0);
 
 	pg_atomic_init_u64(&ipcq->producer_latch, 0);
 	pg_atomic_init_u64(&ipcq->consumer_latch, 0);
+	pg_atomic_init_u32(&ipcq->consumer_spinning, 0);
+	pg_atomic_init_u64(&ipcq->producer_waits, 0);
+	pg_atomic_init_u64(&ipcq->broker_buffered, 0);
+
+	ipcq->spill_id = -1;
+	pg_atomic_init_u64(&ipcq->spill_head, 0);
+	pg_atomic_init_u64(&ipcq->spill_tail, 0);
 
 	ipcq->lock = lock;
 
@@ -50,8 +87,16 @@ ipc_queue_init(void *ptr, Size size, LWLock *lock)
 	ipcq->magic = MAGIC;
 }
 
-bool
-ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait)
+static bool push_batch_mp(ipc_queue *ipcq, void **ptrs, int *lens, int n, bool wait, bool copy);
+
+/*
+ * push_nolock
+ *
+ * Push an item into the queue. If copy is false, ptr points to data that has already been
+ * serialized by the queue's copy_fn, which is the case for slots read back from spill files.
+ */
+static bool
+push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait, bool copy)
 {
 	uint64 head;
 	uint64 tail;
@@ -60,8 +105,13 @@ ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait)
 	int len_needed;
 	char *pos;
 	bool needs_wrap = false;
+	bool waited = false;
 
 	Assert(ipcq->magic == MAGIC);
+
+	if (ipcq->multi_producer)
+		return push_batch_mp(ipcq, &ptr, &len, 1, wait, copy);
+
 	if (ipcq->lock)
 		Assert(LWLockHeldByMe(ipcq->lock));
 
@@ -111,6 +161,12 @@ ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait)
 
 		Assert(producer_latch);
 
+		if (!waited)
+		{
+			pg_atomic_fetch_add_u64(&ipcq->producer_waits, 1);
+			waited = true;
+		}
+
 		r = WaitLatch(producer_latch, WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
 		ResetLatch(producer_latch);
 
@@ -130,6 +186,7 @@ ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait)
 	slot->len = len;
 	slot->wraps = needs_wrap;
 	slot->peeked = false;
+	slot->stolen = false;
 
 	/*
 	 * If we're wrapping around, copy into the start of buffer, otherwise copy
@@ -139,7 +196,7 @@ ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait)
 	ipc_queue_check_overflow(ipcq, pos, len);
 
 	/* Copy over data. */
-	if (ipcq->copy_fn)
+	if (ipcq->copy_fn && copy)
 		ipcq->copy_fn(pos, ptr, len);
 	else
 		memcpy(pos, ptr, len);
@@ -152,6 +209,12 @@ ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait)
 	return true;
 }
 
+bool
+ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait)
+{
+	return push_nolock(ipcq, ptr, len, wait, true);
+}
+
 bool
 ipc_queue_push(ipc_queue *ipcq, void *ptr, int len, bool wait)
 {
@@ -164,6 +227,383 @@ ipc_queue_push(ipc_queue *ipcq, void *ptr, int len, bool wait)
 	return success;
 }
 
+/*
+ * mp_reserved_end
+ *
+ * Returns the position right after the given items if they were laid out contiguously
+ * starting at start, accounting for wrap arounds the same way ipc_queue_push_nolock does
+ */
+static uint64
+mp_reserved_end(ipc_queue *ipcq, uint64 start, int *lens, int n)
+{
+	uint64 end = start;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		int len_needed = sizeof(ipc_queue_slot) + lens[i];
+
+		if (len_needed > ipcq->size)
+			elog(ERROR, "item size %d exceeds ipc_queue size %ld", lens[i], ipcq->size);
+
+		if (ipc_queue_needs_wrap(ipcq, end, len_needed))
+			len_needed = lens[i] + ipcq->size - ipc_queue_offset(ipcq, end);
+
+		end += len_needed;
+	}
+
+	return end;
+}
+
+/*
+ * push_batch_nolock
+ *
+ * Push n items that fit in the queue together into a single producer ipc_queue, publishing them
+ * all at once
+ */
+static bool
+push_batch_nolock(ipc_queue *ipcq, void **ptrs, int *lens, int n, bool wait, bool copy)
+{
+	uint64 head;
+	uint64 end;
+	uint64 pos;
+	Latch *producer_latch = NULL;
+	TimestampTz now;
+	bool waited = false;
+	int i;
+
+	if (ipcq->lock)
+		Assert(LWLockHeldByMe(ipcq->lock));
+
+	head = pg_atomic_read_u64(&ipcq->head);
+	end = mp_reserved_end(ipcq, head, lens, n);
+
+	/* See push_nolock */
+	if (wait)
+	{
+		producer_latch = MyLatch;
+		pg_atomic_write_u64(&ipcq->producer_latch, (uint64) producer_latch);
+	}
+
+	for (;;)
+	{
+		uint64 tail = pg_atomic_read_u64(&ipcq->tail);
+		int r;
+
+		Assert(tail <= head);
+
+		if (ipc_queue_free_size(ipcq, head, tail) >= (int64) (end - head))
+			break;
+		else if (!wait)
+			return false;
+
+		if (!waited)
+		{
+			pg_atomic_fetch_add_u64(&ipcq->producer_waits, 1);
+			waited = true;
+		}
+
+		r = WaitLatch(producer_latch, WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
+		ResetLatch(producer_latch);
+
+		if (r & WL_POSTMASTER_DEATH)
+			return false;
+
+		if (ShouldTerminateContQueryProcess())
+			return false;
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	pg_atomic_write_u64(&ipcq->producer_latch, (uint64) NULL);
+
+	now = GetCurrentTimestamp();
+	pos = head;
+
+	for (i = 0; i < n; i++)
+	{
+		ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, pos);
+		int len_needed = sizeof(ipc_queue_slot) + lens[i];
+		bool needs_wrap = ipc_queue_needs_wrap(ipcq, pos, len_needed);
+		char *dest;
+
+		if (needs_wrap)
+			len_needed = lens[i] + ipcq->size - ipc_queue_offset(ipcq, pos);
+
+		pos += len_needed;
+
+		slot->time = now;
+		slot->len = lens[i];
+		slot->wraps = needs_wrap;
+		slot->peeked = false;
+		slot->stolen = false;
+		slot->next = pos;
+
+		dest = needs_wrap ? ipcq->bytes : slot->bytes;
+		ipc_queue_check_overflow(ipcq, dest, lens[i]);
+
+		if (ipcq->copy_fn && copy)
+			ipcq->copy_fn(dest, ptrs[i], lens[i]);
+		else
+			memcpy(dest, ptrs[i], lens[i]);
+	}
+
+	Assert(pos == end);
+
+	ipc_queue_update_head(ipcq, end);
+
+	return true;
+}
+
+/*
+ * ipc_queue_push_serialized_nolock
+ *
+ * Push n items that have already been serialized in the layout produced by the queue's copy_fn, so they're
+ * copied into the queue as is. Items are published in as few batches as the queue's size allows, which
+ * spares consumers from being signaled for each item. The queue's lock must be held unless it's multi producer.
+ */
+bool
+ipc_queue_push_serialized_nolock(ipc_queue *ipcq, void **ptrs, int *lens, int n, bool wait)
+{
+	Assert(ipcq->magic == MAGIC);
+
+	while (n > 0)
+	{
+		uint64 start;
+		uint64 end;
+		uint64 limit = ipcq->size;
+		int count = 0;
+		bool success;
+
+		/*
+		 * Other producers may move the reservation point of a multi producer queue before we
+		 * reserve our space, which changes how much space is wasted by wrapping around, so we
+		 * leave room for that.
+		 */
+		if (ipcq->multi_producer)
+		{
+			start = pg_atomic_read_u64(&ipcq->reserved);
+			limit = ipcq->size / 2;
+		}
+		else
+			start = pg_atomic_read_u64(&ipcq->head);
+
+		end = start;
+
+		/* take as many items as fit in the queue together */
+		while (count < n)
+		{
+			uint64 next = mp_reserved_end(ipcq, end, &lens[count], 1);
+
+			if (count > 0 && next - start > limit)
+				break;
+
+			end = next;
+			count++;
+		}
+
+		if (ipcq->multi_producer)
+			success = push_batch_mp(ipcq, ptrs, lens, count, wait, false);
+		else
+			success = push_batch_nolock(ipcq, ptrs, lens, count, wait, false);
+
+		if (!success)
+			return false;
+
+		ptrs += count;
+		lens += count;
+		n -= count;
+	}
+
+	return true;
+}
+
+/*
+ * ipc_queue_push_batch_mp
+ *
+ * Push n items into a multi producer ipc_queue without holding its lock. Space for all items is reserved
+ * with a single compare-and-swap on reserved, so concurrent producers only contend on that one word while
+ * copying their data in parallel. Once the data is copied, head is advanced past the reserved range, but
+ * only after all earlier reservations have been published, which guarantees that consumers only ever see
+ * contiguous committed slots.
+ *
+ * Returns false if wait is false and there isn't enough space for all items.
+ */
+bool
+ipc_queue_push_batch_mp(ipc_queue *ipcq, void **ptrs, int *lens, int n, bool wait)
+{
+	return push_batch_mp(ipcq, ptrs, lens, n, wait, true);
+}
+
+/*
+ * mp_publish
+ *
+ * Advance head past the reserved range [start, end) once all earlier reservations have been published
+ */
+static void
+mp_publish(ipc_queue *ipcq, uint64 start, uint64 end)
+{
+	int nspins = 0;
+
+	while (pg_atomic_read_u64(&ipcq->head) != start)
+	{
+		if (++nspins < MP_PUBLISH_SPINS)
+			pg_spin_delay();
+		else
+		{
+			pg_usleep(1);
+			nspins = 0;
+		}
+	}
+
+	pg_memory_barrier();
+	ipc_queue_update_head(ipcq, end);
+}
+
+static bool
+push_batch_mp(ipc_queue *ipcq, void **ptrs, int *lens, int n, bool wait, bool copy)
+{
+	uint64 start;
+	uint64 end;
+	uint64 pos;
+	TimestampTz now;
+	bool waited = false;
+	int i;
+
+	Assert(ipcq->magic == MAGIC);
+	Assert(ipcq->multi_producer);
+
+	if (n == 0)
+		return true;
+
+	for (;;)
+	{
+		uint64 tail;
+
+		start = pg_atomic_read_u64(&ipcq->reserved);
+		end = mp_reserved_end(ipcq, start, lens, n);
+
+		if (end - start > ipcq->size)
+			elog(ERROR, "batch size %ld exceeds ipc_queue size %ld", end - start, ipcq->size);
+
+		tail = pg_atomic_read_u64(&ipcq->tail);
+		Assert(tail <= start);
+
+		if (ipc_queue_free_size(ipcq, start, tail) < (int64) (end - start))
+		{
+			int r;
+
+			if (!wait)
+				return false;
+
+			if (!waited)
+			{
+				pg_atomic_fetch_add_u64(&ipcq->producer_waits, 1);
+				waited = true;
+			}
+
+			/*
+			 * Several producers may be waiting on the same queue and only one of them can advertise its latch,
+			 * so we never sleep for long in case our wake up was lost.
+			 */
+			pg_atomic_write_u64(&ipcq->producer_latch, (uint64) MyLatch);
+			r = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 1);
+			ResetLatch(MyLatch);
+
+			if (r & WL_POSTMASTER_DEATH)
+				return false;
+
+			if (ShouldTerminateContQueryProcess())
+				return false;
+
+			CHECK_FOR_INTERRUPTS();
+			continue;
+		}
+
+		if (pg_atomic_compare_exchange_u64(&ipcq->reserved, &start, end))
+			break;
+	}
+
+	/*
+	 * Our reservation must be published no matter what, otherwise every subsequent producer would
+	 * wait on it forever. Laying out the slots can't fail, so they're all written before copying
+	 * anything into them, and if a copy throws, the reserved slots are published as stolen, which
+	 * consumers skip over without reading them.
+	 */
+	HOLD_INTERRUPTS();
+
+	now = GetCurrentTimestamp();
+	pos = start;
+
+	for (i = 0; i < n; i++)
+	{
+		ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, pos);
+		int len_needed = sizeof(ipc_queue_slot) + lens[i];
+		bool needs_wrap = ipc_queue_needs_wrap(ipcq, pos, len_needed);
+
+		if (needs_wrap)
+			len_needed = lens[i] + ipcq->size - ipc_queue_offset(ipcq, pos);
+
+		pos += len_needed;
+
+		slot->time = now;
+		slot->len = lens[i];
+		slot->wraps = needs_wrap;
+		slot->peeked = false;
+		slot->stolen = false;
+		slot->next = pos;
+	}
+
+	Assert(pos == end);
+
+	PG_TRY();
+	{
+		pos = start;
+
+		for (i = 0; i < n; i++)
+		{
+			ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, pos);
+			char *dest = slot->wraps ? ipcq->bytes : slot->bytes;
+
+			ipc_queue_check_overflow(ipcq, dest, lens[i]);
+
+			if (ipcq->copy_fn && copy)
+				ipcq->copy_fn(dest, ptrs[i], lens[i]);
+			else
+				memcpy(dest, ptrs[i], lens[i]);
+
+			pos = slot->next;
+		}
+	}
+	PG_CATCH();
+	{
+		for (pos = start; pos < end; pos = ipc_queue_slot_get(ipcq, pos)->next)
+			ipc_queue_slot_get(ipcq, pos)->stolen = true;
+
+		mp_publish(ipcq, start, end);
+		RESUME_INTERRUPTS();
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	mp_publish(ipcq, start, end);
+	RESUME_INTERRUPTS();
+
+	return true;
+}
+
+/*
+ * ipc_queue_last_read_time
+ *
+ * Returns when the slot most recently peeked or stolen by this process was inserted
+ */
+TimestampTz
+ipc_queue_last_read_time(void)
+{
+	return last_read_time;
+}
+
 void *
 ipc_queue_peek_next(ipc_queue *ipcq, int *len)
 {
@@ -172,22 +612,35 @@ ipc_queue_peek_next(ipc_queue *ipcq, int *len)
 
 	Assert(ipcq->magic == MAGIC);
 
-	/* Are there any unread slots? */
-	if (!ipc_queue_has_unread(ipcq))
+	SpinLockAcquire(&ipcq->cursor_lock);
+
+	/* Skip over any slots that were stolen by other consumers */
+	for (;;)
 	{
-		*len = 0;
-		return NULL;
+		/* Are there any unread slots? */
+		if (!ipc_queue_has_unread(ipcq))
+		{
+			SpinLockRelease(&ipcq->cursor_lock);
+			*len = 0;
+			return NULL;
+		}
+
+		slot = ipc_queue_slot_get(ipcq, ipcq->cursor);
+		ipcq->cursor = slot->next;
+
+		if (!slot->stolen)
+			break;
 	}
 
-	slot = ipc_queue_slot_get(ipcq, ipcq->cursor);
+	SpinLockRelease(&ipcq->cursor_lock);
 
 	if (slot->wraps)
 		pos = ipcq->bytes;
 	else
 		pos = slot->bytes;
 
-	ipcq->cursor = slot->next;
 	*len = slot->len;
+	last_read_time = slot->time;
 
 	if (ipcq->peek_fn && !slot->peeked)
 	{
@@ -202,7 +655,10 @@ void
 ipc_queue_unpeek_all(ipc_queue *ipcq)
 {
 	Assert(ipcq->magic == MAGIC);
+
+	SpinLockAcquire(&ipcq->cursor_lock);
 	ipcq->cursor = pg_atomic_read_u64(&ipcq->tail);
+	SpinLockRelease(&ipcq->cursor_lock);
 }
 
 void
@@ -217,13 +673,17 @@ ipc_queue_update_tail(ipc_queue *ipcq, uint64 tail)
 	pg_write_barrier();
 
 	if (ipcq->produced_by_broker)
-		signal_ipc_broker_process();
+		signal_ipc_broker_process(ipcq->broker_id);
 	else
 	{
 		Latch *latch = (Latch *) pg_atomic_read_u64(&ipcq->producer_latch);
 		if (latch != NULL)
 			SetLatch(latch);
 	}
+
+	/* Let the broker know it can move spilled slots back into the queue */
+	if (ipc_queue_has_spill(ipcq))
+		signal_ipc_broker_process(ipcq->broker_id);
 }
 
 static inline void
@@ -241,13 +701,32 @@ ipc_queue_slot_pop(ipc_queue *ipcq, ipc_queue_slot *slot)
 	ipcq->pop_fn(pos, slot->len);
 }
 
+/*
+ * wait_for_steals
+ *
+ * Stolen slots are copied out of the queue after the cursor has been moved past them, so we must
+ * wait for those copies before the space they occupy can be reused
+ */
+static void
+wait_for_steals(ipc_queue *ipcq)
+{
+	while (pg_atomic_read_u32(&ipcq->steals_in_progress) > 0)
+		pg_spin_delay();
+
+	pg_read_barrier();
+}
+
 void
 ipc_queue_pop_peeked(ipc_queue *ipcq)
 {
-	uint64 cur = ipcq->cursor;
+	uint64 cur;
 
 	Assert(ipcq->magic == MAGIC);
 
+	SpinLockAcquire(&ipcq->cursor_lock);
+	cur = ipcq->cursor;
+	SpinLockRelease(&ipcq->cursor_lock);
+
 	if (ipcq->pop_fn)
 	{
 		uint64 start = pg_atomic_read_u64(&ipcq->tail);
@@ -258,11 +737,14 @@ ipc_queue_pop_peeked(ipc_queue *ipcq)
 		{
 			ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, start);
 
-			ipc_queue_slot_pop(ipcq, slot);
+			/* stolen slots are popped by the consumer that stole them */
+			if (!slot->stolen)
+				ipc_queue_slot_pop(ipcq, slot);
 			start = slot->next;
 		}
 	}
 
+	wait_for_steals(ipcq);
 	ipc_queue_update_tail(ipcq, cur);
 }
 
@@ -277,6 +759,8 @@ ipc_queue_pop_inserted_before(ipc_queue *ipcq, TimestampTz time)
 	head = pg_atomic_read_u64(&ipcq->head);
 	start = pg_atomic_read_u64(&ipcq->tail);
 
+	SpinLockAcquire(&ipcq->cursor_lock);
+
 	while (start < head)
 	{
 		ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, start);
@@ -284,16 +768,207 @@ ipc_queue_pop_inserted_before(ipc_queue *ipcq, TimestampTz time)
 		if (slot->time >= time)
 			break;
 
-		if (ipcq->pop_fn)
-			ipc_queue_slot_pop(ipcq, slot);
-
 		start = slot->next;
 	}
 
 	ipcq->cursor = start;
+
+	SpinLockRelease(&ipcq->cursor_lock);
+
+	if (ipcq->pop_fn)
+	{
+		uint64 pos = pg_atomic_read_u64(&ipcq->tail);
+
+		while (pos < start)
+		{
+			ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, pos);
+
+			if (!slot->stolen)
+				ipc_queue_slot_pop(ipcq, slot);
+			pos = slot->next;
+		}
+	}
+
+	wait_for_steals(ipcq);
 	ipc_queue_update_tail(ipcq, start);
 }
 
+/*
+ * get_stealable_slot
+ *
+ * Must be called with the cursor lock held. Returns the next unread slot if it can be stolen, which is
+ * the case if it was inserted before the given time and its consumer hasn't read it yet.
+ */
+static ipc_queue_slot *
+get_stealable_slot(ipc_queue *ipcq, TimestampTz before)
+{
+	ipc_queue_slot *slot;
+
+	if (!ipc_queue_has_unread(ipcq))
+		return NULL;
+
+	slot = ipc_queue_slot_get(ipcq, ipcq->cursor);
+
+	/* peeked slots have already been fixed up for their consumer's address space */
+	if (slot->peeked || slot->stolen || slot->time >= before)
+		return NULL;
+
+	return slot;
+}
+
+/*
+ * ipc_queue_has_stealable
+ */
+bool
+ipc_queue_has_stealable(ipc_queue *ipcq, TimestampTz before)
+{
+	bool result;
+
+	Assert(ipcq->magic == MAGIC);
+
+	if (!ipc_queue_has_unread(ipcq))
+		return false;
+
+	SpinLockAcquire(&ipcq->cursor_lock);
+	result = get_stealable_slot(ipcq, before) != NULL;
+	SpinLockRelease(&ipcq->cursor_lock);
+
+	return result;
+}
+
+/*
+ * ipc_queue_steal_next
+ *
+ * Takes the next unread slot away from this queue's consumer if it was inserted before the given time,
+ * and returns a peeked copy of it allocated in the current memory context. The caller is responsible
+ * for popping the copy once it's done with it, since the queue's consumer will skip over the slot.
+ */
+void *
+ipc_queue_steal_next(ipc_queue *ipcq, int *len, TimestampTz before)
+{
+	ipc_queue_slot *slot;
+	char *pos;
+	char *copy;
+
+	Assert(ipcq->magic == MAGIC);
+
+	*len = 0;
+
+	if (!ipc_queue_has_unread(ipcq))
+		return NULL;
+
+	SpinLockAcquire(&ipcq->cursor_lock);
+
+	slot = get_stealable_slot(ipcq, before);
+	if (slot == NULL)
+	{
+		SpinLockRelease(&ipcq->cursor_lock);
+		return NULL;
+	}
+
+	slot->stolen = true;
+	ipcq->cursor = slot->next;
+	pg_atomic_fetch_add_u32(&ipcq->steals_in_progress, 1);
+
+	SpinLockRelease(&ipcq->cursor_lock);
+
+	pos = slot->wraps ? ipcq->bytes : slot->bytes;
+	*len = slot->len;
+	last_read_time = slot->time;
+
+	copy = palloc(slot->len);
+	memcpy(copy, pos, slot->len);
+
+	pg_memory_barrier();
+	pg_atomic_fetch_sub_u32(&ipcq->steals_in_progress, 1);
+
+	if (ipcq->peek_fn)
+		ipcq->peek_fn(copy, *len);
+
+	return copy;
+}
+
+/*
+ * set_spinning
+ *
+ * Mark queues as having a spinning consumer or not. Producers write head before checking
+ * consumer_spinning and we check head after clearing it, so with the full barriers on both sides
+ * no wake up can be missed.
+ */
+static void
+set_spinning(ipc_queue **queues, int nqueues, bool spinning)
+{
+	int i;
+
+	for (i = 0; i < nqueues; i++)
+		pg_atomic_write_u32(&queues[i]->consumer_spinning, spinning ? 1 : 0);
+
+	pg_memory_barrier();
+}
+
+/*
+ * spin_until_non_empty
+ *
+ * Poll the heads of the given queues for up to the current spin budget, returning true if any of them
+ * got new data. This avoids the latch round trip when messages arrive at a high rate.
+ */
+static bool
+spin_until_non_empty(ipc_queue **queues, uint64 *tails, int nqueues)
+{
+	instr_time start;
+	instr_time now;
+	bool found = false;
+	int nspins = 0;
+	int i;
+
+	if (spin_budget == -1)
+		spin_budget = continuous_query_ipc_spin_time;
+	spin_budget = Min(spin_budget, continuous_query_ipc_spin_time);
+
+	if (spin_budget <= 0)
+		return false;
+
+	set_spinning(queues, nqueues, true);
+	INSTR_TIME_SET_CURRENT(start);
+
+	for (;;)
+	{
+		for (i = 0; i < nqueues; i++)
+		{
+			if (pg_atomic_read_u64(&queues[i]->head) > tails[i])
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (found)
+			break;
+
+		if (++nspins % SPIN_CHECK_INTERVAL == 0)
+		{
+			INSTR_TIME_SET_CURRENT(now);
+			INSTR_TIME_SUBTRACT(now, start);
+			if (INSTR_TIME_GET_MICROSEC(now) >= spin_budget)
+				break;
+		}
+
+		pg_spin_delay();
+	}
+
+	set_spinning(queues, nqueues, false);
+
+	if (found)
+		spin_budget = Min(Max(spin_budget * 2, MIN_SPIN_TIME_US), continuous_query_ipc_spin_time);
+	else
+		spin_budget = spin_budget / 2;
+
+	/* Never stop spinning entirely, otherwise we could never adapt back up */
+	spin_budget = Max(spin_budget, Min(MIN_SPIN_TIME_US, continuous_query_ipc_spin_time));
+
+	return found;
+}
+
 void
 ipc_queue_wait_non_empty(ipc_queue *ipcq, int timeoutms)
 {
@@ -315,6 +990,12 @@ ipc_queue_wait_non_empty(ipc_queue *ipcq, int timeoutms)
 	consumer_latch = MyLatch;
 	pg_atomic_write_u64(&ipcq->consumer_latch, (uint64) consumer_latch);
 
+	if (spin_until_non_empty(&ipcq, &tail, 1))
+	{
+		pg_atomic_write_u64(&ipcq->consumer_latch, (uint64) NULL);
+		return;
+	}
+
 	flags = WL_LATCH_SET | WL_POSTMASTER_DEATH;
 	if (timeoutms > 0)
 		flags |= WL_TIMEOUT;
@@ -358,6 +1039,11 @@ bool
 ipc_queue_lock(ipc_queue *mpq, bool wait)
 {
 	Assert(mpq->magic == MAGIC);
+
+	/* Multi producer queues don't need to be locked by producers */
+	if (mpq->multi_producer)
+		return true;
+
 	Assert(mpq->lock);
 
 	if (wait)
@@ -373,20 +1059,47 @@ void
 ipc_queue_unlock(ipc_queue *mpq)
 {
 	Assert(mpq->magic == MAGIC);
+
+	if (mpq->multi_producer)
+		return;
+
 	Assert(mpq->lock);
 	Assert(LWLockHeldByMe(mpq->lock));
 	LWLockRelease(mpq->lock);
 }
 
+/*
+ * ipc_queue_stats_get
+ *
+ * Nothing is locked, so the values may be slightly inconsistent with each other while the
+ * queue is in use, but tail never appears to be ahead of head
+ */
+void
+ipc_queue_stats_get(ipc_queue *ipcq, ipc_queue_stats *stats)
+{
+	Assert(ipcq->magic == MAGIC);
+
+	stats->size = ipcq->size;
+	stats->tail = pg_atomic_read_u64(&ipcq->tail);
+	stats->cursor = Max(ipcq->cursor, stats->tail);
+	pg_read_barrier();
+	stats->head = pg_atomic_read_u64(&ipcq->head);
+	stats->cursor = Min(stats->cursor, stats->head);
+	stats->wraps = stats->head / ipcq->size;
+	stats->producer_waits = pg_atomic_read_u64(&ipcq->producer_waits);
+	stats->spilled = ipcq->spill_id >= 0 ? ipc_queue_spill_size(ipcq) : 0;
+	stats->broker_buffered = pg_atomic_read_u64(&ipcq->broker_buffered);
+}
+
 void
 ipc_queue_update_head(ipc_queue *ipcq, uint64 head)
 {
 	pg_atomic_write_u64(&ipcq->head, head);
-	pg_write_barrier();
+	pg_memory_barrier();
 
 	if (ipcq->consumed_by_broker)
-		signal_ipc_broker_process();
-	else
+		signal_ipc_broker_process(ipcq->broker_id);
+	else if (!pg_atomic_read_u32(&ipcq->consumer_spinning))
 	{
 		Latch *latch = (Latch *) pg_atomic_read_u64(&ipcq->consumer_latch);
 		if (latch)
@@ -424,6 +1137,13 @@ ipc_multi_queue_wait_non_empty(ipc_multi_queue *ipcmq, int timeoutms)
 		pg_atomic_write_u64(&ipcq->consumer_latch, (uint64) consumer_latch);
 	}
 
+	if (spin_until_non_empty(ipcmq->queues, tails, ipcmq->nqueues))
+	{
+		for (i = 0; i < ipcmq->nqueues; i++)
+			pg_atomic_write_u64(&ipcmq->queues[i]->consumer_latch, (uint64) NULL);
+		return;
+	}
+
 	flags = WL_LATCH_SET | WL_POSTMASTER_DEATH;
 	if (timeoutms > 0)
 		flags |= WL_TIMEOUT;
@@ -469,27 +1189,35 @@ ipc_multi_queue_wait_non_empty(ipc_multi_queue *ipcmq, int timeoutms)
 void *
 ipc_multi_queue_peek_next(ipc_multi_queue *ipcmq, int *len)
 {
-	static int idx = 0;
-	int i;
 	void *ptr;
+	int i;
 
-	ptr = ipc_queue_peek_next(ipcmq->queues[idx], len);
+	if (ipcmq->pqueue != -1)
+	{
+		ptr = ipc_queue_peek_next(ipcmq->queues[ipcmq->pqueue], len);
+		if (ptr)
+			return ptr;
+	}
 
-	if (!ptr)
+	/* One extra iteration so that we come back around to the queue we started on with a full credit */
+	for (i = 0; i <= ipcmq->nqueues; i++)
 	{
-		for (i = 0; i < ipcmq->nqueues; i++)
+		if (ipcmq->current != ipcmq->pqueue && ipcmq->credit > 0)
 		{
-			idx = (idx + 1) % ipcmq->nqueues;
-			ptr = ipc_queue_peek_next(ipcmq->queues[idx], len);
+			ptr = ipc_queue_peek_next(ipcmq->queues[ipcmq->current], len);
 
 			if (ptr)
-				break;
+			{
+				ipcmq->credit--;
+				return ptr;
+			}
 		}
+
+		ipcmq->current = (ipcmq->current + 1) % ipcmq->nqueues;
+		ipcmq->credit = ipcmq->weights[ipcmq->current];
 	}
-	else if (idx != ipcmq->pqueue)
-		idx = (idx + 1) % ipcmq->nqueues;
 
-	return ptr;
+	return NULL;
 }
 
 void
@@ -501,6 +1229,20 @@ ipc_multi_queue_set_priority_queue(ipc_multi_queue *ipcmq, int pq)
 	ipcmq->pqueue = pq;
 }
 
+void
+ipc_multi_queue_set_weight(ipc_multi_queue *ipcmq, int nq, int weight)
+{
+	if (nq >= ipcmq->nqueues || nq < 0)
+		elog(ERROR, "queue number must be in [0, nqueues)");
+	if (weight < 1)
+		elog(ERROR, "queue weight must be positive");
+
+	ipcmq->weights[nq] = weight;
+
+	if (ipcmq->current == nq)
+		ipcmq->credit = Min(ipcmq->credit, weight);
+}
+
 void
 ipc_multi_queue_unpeek_all(ipc_multi_queue *ipcmq)
 {
@@ -544,16 +1286,27 @@ ipc_multi_queue_has_unread(ipc_multi_queue *ipcmq)
 }
 
 ipc_multi_queue *
-ipc_multi_queue_init(ipc_queue *q1, ipc_queue *q2)
+ipc_multi_queue_init(ipc_queue **queues, int nqueues)
 {
 	MemoryContext old = MemoryContextSwitchTo(TopMemoryContext);
 	ipc_multi_queue *ipcmq = palloc0(sizeof(ipc_multi_queue));
+	int i;
+
+	Assert(nqueues > 0);
+
+	ipcmq->queues = palloc0(sizeof(ipc_queue *) * nqueues);
+	ipcmq->weights = palloc0(sizeof(int) * nqueues);
 
-	ipcmq->queues = palloc0(sizeof(ipc_queue *) * 2);
-	ipcmq->queues[0] = q1;
-	ipcmq->queues[1] = q2;
-	ipcmq->nqueues = 2;
+	for (i = 0; i < nqueues; i++)
+	{
+		ipcmq->queues[i] = queues[i];
+		ipcmq->weights[i] = 1;
+	}
+
+	ipcmq->nqueues = nqueues;
 	ipcmq->pqueue = -1;
+	ipcmq->current = 0;
+	ipcmq->credit = ipcmq->weights[0];
 
 	MemoryContextSwitchTo(old);
 
@@ -568,3 +1321,301 @@ ipc_multi_queue_pop_inserted_before(ipc_multi_queue *ipcmq, TimestampTz time)
 	for (i = 0; i < ipcmq->nqueues; i++)
 		ipc_queue_pop_inserted_before(ipcmq->queues[i], time);
 }
+
+static void
+spill_path(ipc_queue *ipcq, uint64 segno, char *path)
+{
+	snprintf(path, MAXPGPATH, SPILL_FILE_FMT, ipcq->spill_dbid, ipcq->spill_id, segno);
+}
+
+/*
+ * open_spill_segment
+ *
+ * Open the spill file for the given segment, returning -1 if it couldn't be opened
+ */
+static int
+open_spill_segment(ipc_queue *ipcq, uint64 segno, bool for_write)
+{
+	char path[MAXPGPATH];
+	int fd;
+
+	spill_path(ipcq, segno, path);
+
+	if (!for_write)
+		fd = BasicOpenFile(path, O_RDONLY | PG_BINARY, 0);
+	else
+	{
+		fd = BasicOpenFile(path, O_RDWR | O_CREAT | PG_BINARY, S_IRUSR | S_IWUSR);
+
+		/* The temp file directory is created lazily */
+		if (fd < 0 && errno == ENOENT)
+		{
+			mkdir(SPILL_DIR, S_IRWXU);
+			fd = BasicOpenFile(path, O_RDWR | O_CREAT | PG_BINARY, S_IRUSR | S_IWUSR);
+		}
+	}
+
+	if (fd < 0)
+		elog(WARNING, "could not open ipc_queue spill file \"%s\": %m", path);
+
+	return fd;
+}
+
+/*
+ * ipc_queue_enable_spill
+ *
+ * Allow slots to be spilled for this queue, removing any spill files left over by a previous
+ * incarnation of it. Their slots are lost, since they may reference shared memory that's gone.
+ */
+void
+ipc_queue_enable_spill(ipc_queue *ipcq, Oid dbid, int id)
+{
+	char path[MAXPGPATH];
+	uint64 segno;
+
+	ipcq->spill_dbid = dbid;
+	ipcq->spill_id = id;
+
+	for (segno = 0; ; segno++)
+	{
+		spill_path(ipcq, segno, path);
+		if (unlink(path) < 0)
+			break;
+	}
+}
+
+/*
+ * ipc_queue_spill
+ *
+ * Append n items to the queue's spill files, serializing them with the queue's copy_fn. The IPC broker
+ * moves them back into the queue in order once it has room. The caller must hold the queue's lock unless
+ * it's a multi producer queue, in which case we take it here to serialize spilling producers.
+ *
+ * Either all items are spilled or none are, in which case false is returned.
+ */
+bool
+ipc_queue_spill(ipc_queue *ipcq, void **ptrs, int *lens, int n)
+{
+	uint64 head;
+	uint64 fd_segno = 0;
+	int fd = -1;
+	bool success = true;
+	int i;
+
+	Assert(ipcq->magic == MAGIC);
+	Assert(ipcq->spill_id >= 0);
+
+	for (i = 0; i < n; i++)
+	{
+		if (sizeof(uint32) + lens[i] > SPILL_SEGMENT_SIZE)
+			return false;
+	}
+
+	if (ipcq->multi_producer)
+		LWLockAcquire(ipcq->lock, LW_EXCLUSIVE);
+	else
+		Assert(LWLockHeldByMe(ipcq->lock));
+
+	head = pg_atomic_read_u64(&ipcq->spill_head);
+
+	for (i = 0; i < n && success; i++)
+	{
+		uint32 len = lens[i];
+		Size total = sizeof(uint32) + len;
+		uint64 offset = head % SPILL_SEGMENT_SIZE;
+		char *buf;
+
+		/* Items never span segments, so readers skip to the next segment when they hit the end of a file */
+		if (offset + total > SPILL_SEGMENT_SIZE)
+		{
+			head += SPILL_SEGMENT_SIZE - offset;
+			offset = 0;
+		}
+
+		if (fd < 0 || fd_segno != head / SPILL_SEGMENT_SIZE)
+		{
+			if (fd >= 0)
+				close(fd);
+
+			fd_segno = head / SPILL_SEGMENT_SIZE;
+			fd = open_spill_segment(ipcq, fd_segno, true);
+
+			if (fd < 0)
+			{
+				success = false;
+				break;
+			}
+		}
+
+		buf = palloc(total);
+		memcpy(buf, &len, sizeof(uint32));
+
+		if (ipcq->copy_fn)
+			ipcq->copy_fn(buf + sizeof(uint32), ptrs[i], len);
+		else
+			memcpy(buf + sizeof(uint32), ptrs[i], len);
+
+		if (lseek(fd, offset, SEEK_SET) < 0 || write(fd, buf, total) != total)
+		{
+			elog(WARNING, "could not write to ipc_queue spill file: %m");
+			success = false;
+		}
+
+		pfree(buf);
+		head += total;
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	/* Only publish the spilled items if all of them were written */
+	if (success)
+	{
+		pg_write_barrier();
+		pg_atomic_write_u64(&ipcq->spill_head, head);
+	}
+	else
+	{
+		/*
+		 * Readers rely on hitting the end of a segment file to know where it ends, so get rid of anything
+		 * we wrote past the published head
+		 */
+		uint64 start = pg_atomic_read_u64(&ipcq->spill_head);
+		uint64 segno;
+		char path[MAXPGPATH];
+
+		spill_path(ipcq, start / SPILL_SEGMENT_SIZE, path);
+		if (truncate(path, start % SPILL_SEGMENT_SIZE) < 0 && errno != ENOENT)
+			elog(WARNING, "could not truncate ipc_queue spill file \"%s\": %m", path);
+
+		for (segno = start / SPILL_SEGMENT_SIZE + 1; segno <= head / SPILL_SEGMENT_SIZE; segno++)
+		{
+			spill_path(ipcq, segno, path);
+			unlink(path);
+		}
+	}
+
+	if (ipcq->multi_producer)
+		LWLockRelease(ipcq->lock);
+
+	if (success)
+		signal_ipc_broker_process(ipcq->broker_id);
+
+	return success;
+}
+
+/*
+ * ipc_queue_unspill
+ *
+ * Move as many spilled items back into the queue as fit, in the order they were spilled, and remove spill
+ * files that have been fully consumed. Returns the number of items moved.
+ */
+int
+ipc_queue_unspill(ipc_queue *ipcq)
+{
+	uint64 head;
+	uint64 tail;
+	uint64 start;
+	uint64 fd_segno = 0;
+	uint64 segno;
+	int fd = -1;
+	int count = 0;
+	char *buf = NULL;
+	uint32 buflen = 0;
+
+	Assert(ipcq->magic == MAGIC);
+
+	if (!ipc_queue_has_spill(ipcq))
+		return 0;
+
+	if (!ipc_queue_lock(ipcq, false))
+		return 0;
+
+	head = pg_atomic_read_u64(&ipcq->spill_head);
+	pg_read_barrier();
+	start = tail = pg_atomic_read_u64(&ipcq->spill_tail);
+
+	while (tail < head)
+	{
+		uint64 offset = tail % SPILL_SEGMENT_SIZE;
+		uint32 len;
+		int nread;
+
+		if (SPILL_SEGMENT_SIZE - offset < sizeof(uint32))
+		{
+			tail += SPILL_SEGMENT_SIZE - offset;
+			continue;
+		}
+
+		if (fd < 0 || fd_segno != tail / SPILL_SEGMENT_SIZE)
+		{
+			if (fd >= 0)
+				close(fd);
+
+			fd_segno = tail / SPILL_SEGMENT_SIZE;
+			fd = open_spill_segment(ipcq, fd_segno, false);
+
+			if (fd < 0)
+				break;
+		}
+
+		if (lseek(fd, offset, SEEK_SET) < 0 || (nread = read(fd, &len, sizeof(uint32))) < 0)
+		{
+			elog(WARNING, "could not read from ipc_queue spill file: %m");
+			break;
+		}
+
+		/* We hit the end of the file, so the rest of this segment is unused */
+		if (nread == 0)
+		{
+			tail += SPILL_SEGMENT_SIZE - offset;
+			continue;
+		}
+
+		if (nread != sizeof(uint32))
+		{
+			elog(WARNING, "could not read from ipc_queue spill file: unexpected end of file");
+			break;
+		}
+
+		if (len > buflen)
+		{
+			if (buf)
+				pfree(buf);
+			buf = palloc(len);
+			buflen = len;
+		}
+
+		if (read(fd, buf, len) != len)
+		{
+			elog(WARNING, "could not read from ipc_queue spill file: %m");
+			break;
+		}
+
+		if (!push_nolock(ipcq, buf, len, false, false))
+			break;
+
+		tail += sizeof(uint32) + len;
+		count++;
+	}
+
+	if (fd >= 0)
+		close(fd);
+	if (buf)
+		pfree(buf);
+
+	pg_atomic_write_u64(&ipcq->spill_tail, tail);
+
+	ipc_queue_unlock(ipcq);
+
+	/* Producers only ever write at or after tail, so earlier segments can be removed */
+	for (segno = start / SPILL_SEGMENT_SIZE; segno < tail / SPILL_SEGMENT_SIZE; segno++)
+	{
+		char path[MAXPGPATH];
+
+		spill_path(ipcq, segno, path);
+		unlink(path);
+	}
+
+	return count;
+}
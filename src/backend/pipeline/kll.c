@@ -0,0 +1,477 @@
+/*-------------------------------------------------------------------------
+ *
+ * kll.c
+ *	  KLL quantile sketch implementation.
+ *
+ *	  https://arxiv.org/abs/1603.05346
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/kll.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "pipeline/kll.h"
+#include "utils/elog.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+
+/* this gives a rank error of about 1.3% with high probability */
+#define DEFAULT_K 200
+#define MIN_LEVEL_CAPACITY 8
+#define STACK_ITEMS 64
+
+#define LEVEL_SIZE(s, h) ((s)->levels[(h) + 1] - (s)->levels[h])
+
+/*
+ * Values are added to the lowest level. Once a level has as many items as its capacity,
+ * it's sorted and every other item of it is promoted to the level above, starting from
+ * either the first or the second one. The top level's capacity is k, and every level
+ * below has 2/3 of the capacity of the one above it, down to MIN_LEVEL_CAPACITY, so the
+ * sketch only ever has a few times k items.
+ *
+ * All levels are stored in a single array in the sketch, so that it can be stored as is.
+ * Levels are only ever compacted into free slots, so the sketch only needs to be
+ * reallocated when a level is added, since that raises the capacity of all the others.
+ */
+
+typedef struct WeightedItem
+{
+	float8 value;
+	uint64 weight;
+} WeightedItem;
+
+static uint32
+level_capacity(uint16 k, int num_levels, int h)
+{
+	float8 cap = ceil(k * pow(2.0 / 3.0, num_levels - h - 1));
+
+	return Max(MIN_LEVEL_CAPACITY, (uint32) cap);
+}
+
+static uint32
+total_capacity(uint16 k, int num_levels)
+{
+	uint32 total = 0;
+	int h;
+
+	for (h = 0; h < num_levels; h++)
+		total += level_capacity(k, num_levels, h);
+
+	return total;
+}
+
+/*
+ * flip
+ *
+ * A deterministic coin, so that a sketch always comes out the same for the same values
+ */
+static uint32
+flip(KLL *s)
+{
+	uint32 x = s->rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	s->rng = x;
+
+	return x & 1;
+}
+
+static int
+float8_cmp(const void *a, const void *b)
+{
+	float8 l = *(float8 *) a;
+	float8 r = *(float8 *) b;
+
+	if (l < r)
+		return -1;
+	return l > r ? 1 : 0;
+}
+
+static int
+weighted_item_cmp(const void *a, const void *b)
+{
+	return float8_cmp(&((WeightedItem *) a)->value, &((WeightedItem *) b)->value);
+}
+
+KLL *
+KLLCreateWithK(uint16 k)
+{
+	uint32 capacity = total_capacity(k, 1);
+	KLL *s = palloc0(offsetof(KLL, items) + sizeof(float8) * capacity);
+
+	s->k = k;
+	s->num_levels = 1;
+	s->capacity = capacity;
+	s->rng = 0x9E3779B9;
+	s->levels[0] = capacity;
+	s->levels[1] = capacity;
+	s->min = INFINITY;
+	s->max = -INFINITY;
+
+	SET_VARSIZE(s, KLLSize(s));
+
+	return s;
+}
+
+KLL *
+KLLCreate(void)
+{
+	return KLLCreateWithK(DEFAULT_K);
+}
+
+void
+KLLDestroy(KLL *s)
+{
+	pfree(s);
+}
+
+KLL *
+KLLCopy(KLL *s)
+{
+	Size size = KLLSize(s);
+	char *new = palloc(size);
+	memcpy(new, (char *) s, size);
+	return (KLL *) new;
+}
+
+/*
+ * resize
+ *
+ * Returns a copy of the given sketch with the given number of slots, which must hold all of
+ * its items. The given sketch is freed if it's in the current memory context, the same way
+ * repalloc would free it.
+ */
+static KLL *
+resize(KLL *s, uint32 capacity)
+{
+	uint32 nitems = s->capacity - s->levels[0];
+	uint32 start = capacity - nitems;
+	KLL *result;
+	int h;
+
+	Assert(nitems <= capacity);
+
+	result = palloc0(offsetof(KLL, items) + sizeof(float8) * capacity);
+	memcpy(result, s, offsetof(KLL, items));
+	memcpy(result->items + start, s->items + s->levels[0], sizeof(float8) * nitems);
+
+	for (h = 0; h <= s->num_levels; h++)
+		result->levels[h] = s->levels[h] - s->levels[0] + start;
+
+	result->capacity = capacity;
+	SET_VARSIZE(result, KLLSize(result));
+
+	if (MemoryContextContains(CurrentMemoryContext, s))
+		pfree(s);
+
+	return result;
+}
+
+/*
+ * compact_level
+ *
+ * Promotes every other item of the given level, which has at least two items, to the level
+ * above it, adding a level if it's the top one. If the level has an odd number of items, its
+ * first one stays. This frees half of the level's slots, which then become the lowest free
+ * ones by moving the levels below it up.
+ */
+static void
+compact_level(KLL *s, int h)
+{
+	uint32 start = s->levels[h];
+	uint32 end = s->levels[h + 1];
+	uint32 odd = (end - start) % 2;
+	uint32 half = (end - start) / 2;
+	uint32 offset = flip(s);
+	uint32 next_end;
+	uint32 pos;
+	uint32 a;
+	uint32 b;
+	float8 stack_items[STACK_ITEMS];
+	float8 *tmp = stack_items;
+	int i;
+
+	Assert(half > 0);
+
+	if (h == s->num_levels - 1)
+	{
+		if (s->num_levels == KLL_MAX_LEVELS)
+			elog(ERROR, "kll sketch has too many levels");
+
+		s->levels[h + 2] = end;
+		s->num_levels++;
+	}
+
+	next_end = s->levels[h + 2];
+
+	/* the lowest level is the only one that isn't kept sorted */
+	if (h == 0)
+		qsort(s->items + start + odd, end - start - odd, sizeof(float8), float8_cmp);
+
+	/* the kept items are moved right below the level above, going backwards so that none are overwritten */
+	for (i = half - 1; i >= 0; i--)
+		s->items[end - half + i] = s->items[start + odd + 2 * i + offset];
+
+	/* and merged into it */
+	if (half > STACK_ITEMS)
+		tmp = palloc(sizeof(float8) * half);
+	memcpy(tmp, s->items + end - half, sizeof(float8) * half);
+
+	pos = end - half;
+	a = 0;
+	b = end;
+
+	while (a < half)
+	{
+		if (b < next_end && s->items[b] < tmp[a])
+			s->items[pos++] = s->items[b++];
+		else
+			s->items[pos++] = tmp[a++];
+	}
+
+	if (tmp != stack_items)
+		pfree(tmp);
+
+	s->levels[h + 1] = end - half;
+	if (odd)
+		s->items[end - half - 1] = s->items[start];
+
+	memmove(s->items + s->levels[0] + half, s->items + s->levels[0], sizeof(float8) * (start - s->levels[0]));
+
+	for (i = 0; i <= h; i++)
+		s->levels[i] += half;
+}
+
+/*
+ * compress
+ *
+ * Makes room for at least one more item by compacting the lowest level that is at its capacity
+ */
+static KLL *
+compress(KLL *s)
+{
+	int num_levels = s->num_levels;
+	int h;
+
+	for (h = 0; h < s->num_levels; h++)
+	{
+		if (LEVEL_SIZE(s, h) >= level_capacity(s->k, s->num_levels, h))
+			break;
+	}
+
+	/* the sketch is full, and all of its slots are some level's capacity */
+	Assert(h < s->num_levels);
+
+	compact_level(s, h);
+
+	if (s->num_levels > num_levels && total_capacity(s->k, s->num_levels) > s->capacity)
+		s = resize(s, total_capacity(s->k, s->num_levels));
+
+	return s;
+}
+
+KLL *
+KLLAdd(KLL *s, float8 x)
+{
+	if (isnan(x))
+		elog(ERROR, "kll values can't be NaN");
+
+	if (s->levels[0] == 0)
+		s = compress(s);
+
+	s->items[--s->levels[0]] = x;
+
+	s->count++;
+	s->min = Min(s->min, x);
+	s->max = Max(s->max, x);
+
+	return s;
+}
+
+/*
+ * KLLMerge
+ *
+ * Adds each level of the incoming sketch to the same level of the given sketch and compacts
+ * every level that ends up at its capacity, from the lowest one up
+ */
+KLL *
+KLLMerge(KLL *s, KLL *incoming)
+{
+	int num_levels = Max(s->num_levels, incoming->num_levels);
+	uint32 nitems = (s->capacity - s->levels[0]) + (incoming->capacity - incoming->levels[0]);
+	uint32 capacity = Max(nitems, total_capacity(s->k, num_levels));
+	uint32 pos = capacity;
+	KLL *result;
+	int h;
+
+	if (s->k != incoming->k)
+		elog(ERROR, "cannot merge kll sketches with different k");
+
+	if (incoming->count == 0)
+		return s;
+
+	result = palloc0(offsetof(KLL, items) + sizeof(float8) * capacity);
+	memcpy(result, s, offsetof(KLL, items));
+	result->num_levels = num_levels;
+	result->capacity = capacity;
+	result->levels[num_levels] = capacity;
+
+	for (h = num_levels - 1; h >= 0; h--)
+	{
+		float8 *l = NULL;
+		float8 *r = NULL;
+		uint32 nl = 0;
+		uint32 nr = 0;
+		uint32 i = 0;
+		uint32 j = 0;
+
+		if (h < s->num_levels)
+		{
+			l = s->items + s->levels[h];
+			nl = LEVEL_SIZE(s, h);
+		}
+		if (h < incoming->num_levels)
+		{
+			r = incoming->items + incoming->levels[h];
+			nr = LEVEL_SIZE(incoming, h);
+		}
+
+		pos -= nl + nr;
+		result->levels[h] = pos;
+
+		if (h == 0)
+		{
+			memcpy(result->items + pos, l, sizeof(float8) * nl);
+			memcpy(result->items + pos + nl, r, sizeof(float8) * nr);
+			continue;
+		}
+
+		while (i < nl || j < nr)
+		{
+			float8 *dest = result->items + pos + i + j;
+
+			if (j == nr || (i < nl && l[i] <= r[j]))
+				*dest = l[i++];
+			else
+				*dest = r[j++];
+		}
+	}
+
+	for (h = 0; h < result->num_levels; h++)
+	{
+		if (LEVEL_SIZE(result, h) >= level_capacity(result->k, result->num_levels, h))
+			compact_level(result, h);
+	}
+
+	result->count += incoming->count;
+	result->min = Min(result->min, incoming->min);
+	result->max = Max(result->max, incoming->max);
+
+	nitems = result->capacity - result->levels[0];
+	capacity = Max(nitems, total_capacity(result->k, result->num_levels));
+	if (capacity != result->capacity)
+		result = resize(result, capacity);
+
+	SET_VARSIZE(result, KLLSize(result));
+
+	if (MemoryContextContains(CurrentMemoryContext, s))
+		pfree(s);
+
+	return result;
+}
+
+/*
+ * KLLQuantile
+ *
+ * Returns the smallest item whose rank, weighted by the number of values each item
+ * stands for, is at least q
+ */
+float8
+KLLQuantile(KLL *s, float8 q)
+{
+	uint32 nitems = s->capacity - s->levels[0];
+	WeightedItem *items;
+	float8 target;
+	uint64 seen = 0;
+	float8 result;
+	uint32 i;
+	int h;
+
+	if (s->count == 0)
+		return NAN;
+
+	if (q <= 0)
+		return s->min;
+	if (q >= 1)
+		return s->max;
+
+	items = palloc(sizeof(WeightedItem) * nitems);
+
+	for (h = 0; h < s->num_levels; h++)
+	{
+		for (i = s->levels[h]; i < s->levels[h + 1]; i++)
+		{
+			items[i - s->levels[0]].value = s->items[i];
+			items[i - s->levels[0]].weight = (uint64) 1 << h;
+		}
+	}
+
+	qsort(items, nitems, sizeof(WeightedItem), weighted_item_cmp);
+
+	target = q * s->count;
+	result = s->max;
+
+	for (i = 0; i < nitems; i++)
+	{
+		seen += items[i].weight;
+		if (seen >= target)
+		{
+			result = items[i].value;
+			break;
+		}
+	}
+
+	pfree(items);
+
+	return result;
+}
+
+/*
+ * KLLCDF
+ *
+ * Returns the estimated fraction of values less than or equal to x
+ */
+float8
+KLLCDF(KLL *s, float8 x)
+{
+	uint64 below = 0;
+	uint32 i;
+	int h;
+
+	if (s->count == 0)
+		return NAN;
+
+	for (h = 0; h < s->num_levels; h++)
+	{
+		for (i = s->levels[h]; i < s->levels[h + 1]; i++)
+		{
+			if (s->items[i] <= x)
+				below += (uint64) 1 << h;
+		}
+	}
+
+	return (float8) below / s->count;
+}
+
+Size
+KLLSize(KLL *s)
+{
+	return offsetof(KLL, items) + sizeof(float8) * s->capacity;
+}
@@ -0,0 +1,550 @@
+/*-------------------------------------------------------------------------
+ *
+ * metrics.c
+ *
+ *	  OpenMetrics exporter for continuous query stats
+ *
+ * A background worker that serves the stats of all continuous queries and
+ * IPC queues over HTTP at /metrics, in the OpenMetrics text format, so that
+ * they can be scraped by Prometheus without connecting to the database. It
+ * only reads shared memory: the shared counters of every worker, combiner and
+ * view (see pgstat_fetch_cq_shared_entries) and the IPC queues of every
+ * database. Nothing that needs catalog access is exported, so views are
+ * identified by their id. Totals like those of pipeline_stat_get are the sums
+ * of the per process series.
+ *
+ * The exporter is started by the scheduler when continuous_query_metrics_port
+ * is set, and handles one request at a time.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/metrics.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "pipeline/cont_scheduler.h"
+#include "pipeline/ipc/broker.h"
+#include "pipeline/ipc/queue.h"
+#include "pipeline/metrics.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+#define METRICS_BACKLOG 16
+#define METRICS_REQUEST_SIZE 4096
+#define METRICS_IO_TIMEOUT 1 /* seconds */
+#define METRICS_RESTART_TIME 10 /* seconds */
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* guc parameters */
+int continuous_query_metrics_port;
+char *continuous_query_metrics_listen_address;
+
+static volatile sig_atomic_t got_SIGTERM = false;
+
+typedef struct CQCounterMetric
+{
+	const char *name;
+	const char *help;
+	Size offset;
+} CQCounterMetric;
+
+static const CQCounterMetric cq_counters[] = {
+	{"input_rows", "Rows read", offsetof(PgStat_CQSharedEntry, input_rows)},
+	{"output_rows", "Rows written", offsetof(PgStat_CQSharedEntry, output_rows)},
+	{"updated_rows", "Rows updated", offsetof(PgStat_CQSharedEntry, updated_rows)},
+	{"input_bytes", "Bytes read", offsetof(PgStat_CQSharedEntry, input_bytes)},
+	{"output_bytes", "Bytes written", offsetof(PgStat_CQSharedEntry, output_bytes)},
+	{"updated_bytes", "Bytes updated", offsetof(PgStat_CQSharedEntry, updated_bytes)},
+	{"executions", "Batches executed", offsetof(PgStat_CQSharedEntry, executions)},
+	{"errors", "Errors raised while executing", offsetof(PgStat_CQSharedEntry, errors)}
+};
+
+/* a copy of the stats of an IPC queue, the queue itself may go away along with its segment */
+typedef struct QueueMetrics
+{
+	Oid dbid;
+	const char *type;
+	int group_id;
+	bool spills;
+	bool broker_consumed;
+	ipc_queue_stats stats;
+} QueueMetrics;
+
+/*
+ * sigterm_handler
+ */
+static void
+sigterm_handler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGTERM = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * StartContQueryMetricsExporter
+ */
+bool
+StartContQueryMetricsExporter(void)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	strcpy(worker.bgw_name, "continuous query metrics exporter");
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = METRICS_RESTART_TIME;
+	worker.bgw_main = ContQueryMetricsExporterMain;
+	worker.bgw_notify_pid = 0;
+
+	return RegisterDynamicBackgroundWorker(&worker, &handle);
+}
+
+/*
+ * database_name
+ *
+ * Names of databases are only known for those the scheduler has seen
+ */
+static const char *
+database_name(Oid dbid)
+{
+	ContQueryDatabaseMetadata *db_meta = GetContQueryDatabaseMetadata(dbid);
+
+	if (db_meta)
+		return NameStr(db_meta->db_name);
+
+	return psprintf("%u", dbid);
+}
+
+/*
+ * append_label
+ *
+ * Appends a label, escaping its value as OpenMetrics requires
+ */
+static void
+append_label(StringInfo buf, const char *name, const char *value, bool first)
+{
+	const char *c;
+
+	appendStringInfo(buf, "%s%s=\"", first ? "" : ",", name);
+
+	for (c = value; *c; c++)
+	{
+		if (*c == '\\' || *c == '"')
+		{
+			appendStringInfoChar(buf, '\\');
+			appendStringInfoChar(buf, *c);
+		}
+		else if (*c == '\n')
+			appendStringInfoString(buf, "\\n");
+		else
+			appendStringInfoChar(buf, *c);
+	}
+
+	appendStringInfoChar(buf, '"');
+}
+
+/*
+ * append_family
+ */
+static void
+append_family(StringInfo buf, const char *name, const char *type, const char *help)
+{
+	appendStringInfo(buf, "# TYPE %s %s\n", name, type);
+	appendStringInfo(buf, "# HELP %s %s\n", name, help);
+}
+
+/*
+ * append_cq_metrics
+ *
+ * Per process counters are exported as pipeline_proc_*, per view counters as pipeline_query_*
+ */
+static void
+append_cq_metrics(StringInfo buf)
+{
+	PgStat_CQSharedEntry *entries;
+	int nentries;
+	int i;
+
+	entries = pgstat_fetch_cq_shared_entries(&nentries);
+
+	for (i = 0; i < lengthof(cq_counters); i++)
+	{
+		const CQCounterMetric *metric = &cq_counters[i];
+		int level;
+
+		for (level = 0; level < 2; level++)
+		{
+			bool procs = (level == 0);
+			char *name = psprintf("pipeline_%s_%s", procs ? "proc" : "query", metric->name);
+			int j;
+
+			append_family(buf, name, "counter", metric->help);
+
+			for (j = 0; j < nentries; j++)
+			{
+				PgStat_CQSharedEntry *entry = &entries[j];
+				pid_t pid = GetStatCQEntryProcPid(entry->key);
+				ContQueryProcType ptype = GetStatCQEntryProcType(entry->key);
+				PgStat_Counter value = *(PgStat_Counter *) ((char *) entry + metric->offset);
+
+				if (procs != (pid != 0))
+					continue;
+
+				appendStringInfo(buf, "%s_total{", name);
+				append_label(buf, "database", database_name(entry->dbid), true);
+				append_label(buf, "type", ptype == Worker ? "worker" : "combiner", false);
+				if (procs)
+					append_label(buf, "pid", psprintf("%d", pid), false);
+				else
+					append_label(buf, "view_id", psprintf("%u", (Oid) GetStatCQEntryViewId(entry->key)), false);
+				appendStringInfo(buf, "} " INT64_FORMAT "\n", value);
+			}
+		}
+	}
+}
+
+/*
+ * read_queue_metrics
+ */
+static QueueMetrics *
+read_queue_metrics(int *nmetrics)
+{
+	QueueMetrics *metrics = NULL;
+	int size = 0;
+	Oid *dbids;
+	int ndbs;
+	int i;
+
+	*nmetrics = 0;
+	dbids = get_ipc_queue_dbs(&ndbs);
+
+	for (i = 0; i < ndbs; i++)
+	{
+		dsm_segment *segment = NULL;
+		ipc_queue_info *queues;
+		int nqueues;
+		int j;
+
+		queues = get_db_ipc_queues(dbids[i], &segment, &nqueues);
+
+		for (j = 0; j < nqueues; j++)
+		{
+			QueueMetrics *m;
+
+			if (*nmetrics == size)
+			{
+				size = size ? size * 2 : 16;
+				metrics = metrics ? repalloc(metrics, sizeof(QueueMetrics) * size) :
+						palloc(sizeof(QueueMetrics) * size);
+			}
+
+			m = &metrics[(*nmetrics)++];
+			m->dbid = dbids[i];
+			m->type = queues[j].type;
+			m->group_id = queues[j].group_id;
+			m->spills = queues[j].queue->spill_id >= 0;
+			m->broker_consumed = queues[j].queue->consumed_by_broker;
+			ipc_queue_stats_get(queues[j].queue, &m->stats);
+		}
+
+		if (segment)
+			dsm_detach(segment);
+	}
+
+	return metrics;
+}
+
+/*
+ * append_queue_sample
+ */
+static void
+append_queue_sample(StringInfo buf, const char *name, QueueMetrics *m, uint64 value)
+{
+	appendStringInfo(buf, "%s{", name);
+	append_label(buf, "database", database_name(m->dbid), true);
+	append_label(buf, "type", m->type, false);
+	append_label(buf, "group_id", psprintf("%d", m->group_id), false);
+	appendStringInfo(buf, "} " UINT64_FORMAT "\n", value);
+}
+
+/*
+ * append_queue_metrics
+ */
+static void
+append_queue_metrics(StringInfo buf)
+{
+	QueueMetrics *metrics;
+	int nmetrics;
+	int i;
+
+	metrics = read_queue_metrics(&nmetrics);
+
+	append_family(buf, "pipeline_queue_size_bytes", "gauge", "Size of the queue");
+	for (i = 0; i < nmetrics; i++)
+		append_queue_sample(buf, "pipeline_queue_size_bytes", &metrics[i], metrics[i].stats.size);
+
+	append_family(buf, "pipeline_queue_used_bytes", "gauge", "Bytes of the queue in use");
+	for (i = 0; i < nmetrics; i++)
+		append_queue_sample(buf, "pipeline_queue_used_bytes", &metrics[i],
+				metrics[i].stats.head - metrics[i].stats.tail);
+
+	append_family(buf, "pipeline_queue_unread_bytes", "gauge", "Bytes pushed but not yet read");
+	for (i = 0; i < nmetrics; i++)
+		append_queue_sample(buf, "pipeline_queue_unread_bytes", &metrics[i],
+				metrics[i].stats.head - metrics[i].stats.cursor);
+
+	append_family(buf, "pipeline_queue_pushed_bytes", "counter", "Bytes pushed");
+	for (i = 0; i < nmetrics; i++)
+		append_queue_sample(buf, "pipeline_queue_pushed_bytes_total", &metrics[i], metrics[i].stats.head);
+
+	append_family(buf, "pipeline_queue_wraps", "counter", "Times the queue wrapped around");
+	for (i = 0; i < nmetrics; i++)
+		append_queue_sample(buf, "pipeline_queue_wraps_total", &metrics[i], metrics[i].stats.wraps);
+
+	append_family(buf, "pipeline_queue_producer_waits", "counter", "Pushes that had to wait for space");
+	for (i = 0; i < nmetrics; i++)
+		append_queue_sample(buf, "pipeline_queue_producer_waits_total", &metrics[i],
+				metrics[i].stats.producer_waits);
+
+	append_family(buf, "pipeline_queue_spilled_bytes", "counter", "Bytes spilled to disk");
+	for (i = 0; i < nmetrics; i++)
+		if (metrics[i].spills)
+			append_queue_sample(buf, "pipeline_queue_spilled_bytes_total", &metrics[i],
+					metrics[i].stats.spilled);
+
+	append_family(buf, "pipeline_queue_broker_buffered_bytes", "gauge",
+			"Bytes copied out by a broker but not yet into the consumer's queue");
+	for (i = 0; i < nmetrics; i++)
+		if (metrics[i].broker_consumed)
+			append_queue_sample(buf, "pipeline_queue_broker_buffered_bytes", &metrics[i],
+					metrics[i].stats.broker_buffered);
+}
+
+/*
+ * send_all
+ */
+static bool
+send_all(pgsocket sock, const char *data, int len)
+{
+	while (len > 0)
+	{
+		ssize_t n = send(sock, data, len, 0);
+
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/*
+ * handle_request
+ *
+ * Reads the request line and headers, and responds with the metrics if they were asked for
+ */
+static void
+handle_request(pgsocket sock)
+{
+	char request[METRICS_REQUEST_SIZE];
+	int len = 0;
+	struct timeval timeout;
+	StringInfoData body;
+	char *header;
+	const char *status;
+
+	timeout.tv_sec = METRICS_IO_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *) &timeout, sizeof(timeout));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char *) &timeout, sizeof(timeout));
+
+	/* a request that doesn't fit is answered based on what we've read of it */
+	while (len < sizeof(request) - 1)
+	{
+		ssize_t n = recv(sock, request + len, sizeof(request) - 1 - len, 0);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+
+		len += n;
+		request[len] = '\0';
+
+		if (strstr(request, "\r\n\r\n"))
+			break;
+	}
+
+	initStringInfo(&body);
+
+	if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0)
+	{
+		status = "200 OK";
+		append_cq_metrics(&body);
+		append_queue_metrics(&body);
+		appendStringInfoString(&body, "# EOF\n");
+	}
+	else
+	{
+		status = "404 Not Found";
+		appendStringInfoString(&body, "Not Found\n");
+	}
+
+	header = psprintf("HTTP/1.1 %s\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %d\r\n"
+			"Connection: close\r\n\r\n",
+			status, strncmp(status, "200", 3) == 0 ? METRICS_CONTENT_TYPE : "text/plain",
+			body.len);
+
+	if (send_all(sock, header, strlen(header)))
+		send_all(sock, body.data, body.len);
+}
+
+/*
+ * listen_metrics_socket
+ */
+static pgsocket
+listen_metrics_socket(void)
+{
+	struct addrinfo hints;
+	struct addrinfo *addrs;
+	struct addrinfo *addr;
+	const char *host = continuous_query_metrics_listen_address;
+	char port[16];
+	pgsocket sock = PGINVALID_SOCKET;
+	int save_errno = 0;
+	int one = 1;
+	int rc;
+
+	if (host == NULL || host[0] == '\0' || strcmp(host, "*") == 0)
+		host = NULL;
+
+	snprintf(port, sizeof(port), "%d", continuous_query_metrics_port);
+
+	MemSet(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	rc = getaddrinfo(host, port, &hints, &addrs);
+	if (rc != 0)
+		ereport(ERROR,
+				(errmsg("could not resolve continuous_query_metrics_listen_address \"%s\": %s",
+						continuous_query_metrics_listen_address, gai_strerror(rc))));
+
+	for (addr = addrs; addr != NULL; addr = addr->ai_next)
+	{
+		sock = socket(addr->ai_family, SOCK_STREAM, 0);
+		if (sock == PGINVALID_SOCKET)
+		{
+			save_errno = errno;
+			continue;
+		}
+
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char *) &one, sizeof(one));
+
+		if (bind(sock, addr->ai_addr, addr->ai_addrlen) == 0 &&
+				listen(sock, METRICS_BACKLOG) == 0 &&
+				pg_set_noblock(sock))
+			break;
+
+		save_errno = errno;
+		closesocket(sock);
+		sock = PGINVALID_SOCKET;
+	}
+
+	freeaddrinfo(addrs);
+
+	if (sock == PGINVALID_SOCKET)
+	{
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_socket_access(),
+				 errmsg("could not listen on port %d for continuous query metrics: %m",
+						 continuous_query_metrics_port)));
+	}
+
+	return sock;
+}
+
+/*
+ * ContQueryMetricsExporterMain
+ */
+void
+ContQueryMetricsExporterMain(Datum arg)
+{
+	MemoryContext cxt;
+	pgsocket sock;
+
+	pqsignal(SIGTERM, sigterm_handler);
+	pqsignal(SIGPIPE, SIG_IGN);
+
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "ContQueryMetricsExporter");
+	cxt = AllocSetContextCreate(TopMemoryContext, "ContQueryMetricsExporterCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	sock = listen_metrics_socket();
+
+	elog(LOG, "continuous query metrics exporter listening on port %d", continuous_query_metrics_port);
+
+	while (!got_SIGTERM)
+	{
+		int rc = WaitLatchOrSocket(MyLatch, WL_LATCH_SET | WL_SOCKET_READABLE | WL_POSTMASTER_DEATH, sock, -1);
+
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		if (rc & WL_SOCKET_READABLE)
+		{
+			pgsocket client = accept(sock, NULL, NULL);
+			MemoryContext old;
+
+			if (client == PGINVALID_SOCKET)
+				continue;
+
+			old = MemoryContextSwitchTo(cxt);
+			handle_request(client);
+			MemoryContextSwitchTo(old);
+			MemoryContextReset(cxt);
+
+			closesocket(client);
+		}
+	}
+
+	closesocket(sock);
+	proc_exit(0);
+}
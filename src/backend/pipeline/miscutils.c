@@ -10,9 +10,14 @@
 #include <sys/resource.h>
 #include <math.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 #include "pipeline/miscutils.h"
 #include "port.h"
+#include "storage/fd.h"
 #include "utils/datum.h"
 #include "utils/typcache.h"
 
@@ -192,6 +197,131 @@ MurmurHash3_64(const void *key, const Size len, const uint64_t seed)
 	return hash[0];
 }
 
+/*
+ * FastHash
+ *
+ * A 64-bit hash after wyhash (https://github.com/wangyi-fudan/wyhash), which mixes 8 or 16 bytes
+ * at a time with a single 64x64->128 bit multiply and is about twice as fast as Murmur3 for
+ * the short keys we mostly hash. Keys are read in native byte order, so its values may differ
+ * between platforms and it must only be used for hashes that are never stored or sent to
+ * another server. Sketch elements keep using Murmur3 for that reason, since their hashes are
+ * part of the sketches stored in matrels.
+ */
+#define FASTHASH_P0 UINT64CONST(0xa0761d6478bd642f)
+#define FASTHASH_P1 UINT64CONST(0xe7037ed1a0b428db)
+#define FASTHASH_P2 UINT64CONST(0x8ebc6af09c88c6e3)
+#define FASTHASH_P3 UINT64CONST(0x589965cc75374cc3)
+
+static inline void
+fasthash_mum(uint64 *a, uint64 *b)
+{
+#ifdef PG_INT128_TYPE
+	uint128 r = (uint128) *a * *b;
+
+	*a = (uint64) r;
+	*b = (uint64) (r >> 64);
+#else
+	uint64 ha = *a >> 32, hb = *b >> 32, la = (uint32) *a, lb = (uint32) *b;
+	uint64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64 t = rl + (rm0 << 32);
+	uint64 c = t < rl;
+	uint64 lo = t + (rm1 << 32);
+
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64
+fasthash_mix(uint64 a, uint64 b)
+{
+	fasthash_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64
+fasthash_read64(const uint8 *p)
+{
+	uint64 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64
+fasthash_read32(const uint8 *p)
+{
+	uint32 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+uint64
+FastHash64(const void *key, const Size len, const uint64 seed)
+{
+	const uint8 *p = (const uint8 *) key;
+	uint64 h = seed ^ fasthash_mix(seed ^ FASTHASH_P0, FASTHASH_P1);
+	uint64 a;
+	uint64 b;
+
+	if (len <= 16)
+	{
+		if (len >= 4)
+		{
+			/* two possibly overlapping 4 byte reads from each end cover all of the key */
+			Size off = (len >> 3) << 2;
+
+			a = (fasthash_read32(p) << 32) | fasthash_read32(p + off);
+			b = (fasthash_read32(p + len - 4) << 32) | fasthash_read32(p + len - 4 - off);
+		}
+		else if (len > 0)
+		{
+			a = ((uint64) p[0] << 16) | ((uint64) p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		}
+		else
+			a = b = 0;
+	}
+	else
+	{
+		Size i = len;
+
+		if (i > 48)
+		{
+			uint64 h1 = h;
+			uint64 h2 = h;
+
+			do
+			{
+				h = fasthash_mix(fasthash_read64(p) ^ FASTHASH_P1, fasthash_read64(p + 8) ^ h);
+				h1 = fasthash_mix(fasthash_read64(p + 16) ^ FASTHASH_P2, fasthash_read64(p + 24) ^ h1);
+				h2 = fasthash_mix(fasthash_read64(p + 32) ^ FASTHASH_P3, fasthash_read64(p + 40) ^ h2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+
+			h ^= h1 ^ h2;
+		}
+
+		while (i > 16)
+		{
+			h = fasthash_mix(fasthash_read64(p) ^ FASTHASH_P1, fasthash_read64(p + 8) ^ h);
+			p += 16;
+			i -= 16;
+		}
+
+		/* the last 16 bytes, which may overlap with ones already mixed in */
+		a = fasthash_read64(p + i - 16);
+		b = fasthash_read64(p + i - 8);
+	}
+
+	a ^= FASTHASH_P1;
+	b ^= h;
+	fasthash_mum(&a, &b);
+
+	return fasthash_mix(a ^ FASTHASH_P0 ^ len, b ^ FASTHASH_P1);
+}
+
 /*
  * DatumToBytes
  */
@@ -290,3 +420,241 @@ SetDefaultPriority()
 {
 	return nice(default_priority);
 }
+
+#if defined(__linux__) && defined(__NR_mbind)
+#define HAVE_NUMA_SUPPORT
+#endif
+
+#ifdef HAVE_NUMA_SUPPORT
+/* from linux/mempolicy.h, which we don't want to depend on */
+#define MPOL_PREFERRED 1
+#define NUMA_CPULIST_PATH "/sys/devices/system/node/node%d/cpulist"
+#endif
+
+/*
+ * BindMemoryToNumaNode
+ *
+ * Prefer allocating the physical pages backing the given range on the given NUMA node. This only
+ * affects pages that haven't been faulted in yet, so it must be called before the memory is first
+ * touched. Only whole pages within the range are affected.
+ */
+void
+BindMemoryToNumaNode(void *addr, Size len, int node)
+{
+#ifdef HAVE_NUMA_SUPPORT
+	Size page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t start = TYPEALIGN(page_size, (uintptr_t) addr);
+	uintptr_t end = TYPEALIGN_DOWN(page_size, (uintptr_t) addr + len);
+	unsigned long mask;
+
+	if (node < 0 || end <= start)
+		return;
+
+	Assert(node < MAX_NUMA_NODES);
+	mask = 1UL << node;
+
+	if (syscall(__NR_mbind, (void *) start, end - start, MPOL_PREFERRED, &mask, MAX_NUMA_NODES + 1, 0) != 0)
+		elog(WARNING, "failed to bind memory to NUMA node %d: %m", node);
+#else
+	if (node >= 0)
+		elog(WARNING, "NUMA placement is not supported on this platform");
+#endif
+}
+
+/*
+ * ParseCPUList
+ *
+ * Parse a list of CPUs formatted as comma separated ranges, e.g. "0-7,16-23", setting each listed CPU
+ * in cpus, which must have MAX_CPUS entries. Returns false if the list is malformed.
+ */
+bool
+ParseCPUList(const char *value, bool *cpus)
+{
+	const char *pos = value;
+
+	MemSet(cpus, 0, sizeof(bool) * MAX_CPUS);
+
+	while (*pos)
+	{
+		char *end;
+		long first;
+		long last;
+		long cpu;
+
+		while (isspace((unsigned char) *pos))
+			pos++;
+
+		if (*pos == '\0')
+			break;
+
+		first = strtol(pos, &end, 10);
+		if (end == pos || first < 0 || first >= MAX_CPUS)
+			return false;
+
+		last = first;
+		pos = end;
+
+		if (*pos == '-')
+		{
+			pos++;
+			last = strtol(pos, &end, 10);
+			if (end == pos || last < first || last >= MAX_CPUS)
+				return false;
+			pos = end;
+		}
+
+		for (cpu = first; cpu <= last; cpu++)
+			cpus[cpu] = true;
+
+		while (isspace((unsigned char) *pos))
+			pos++;
+
+		if (*pos == ',')
+			pos++;
+		else if (*pos != '\0')
+			return false;
+	}
+
+	return true;
+}
+
+#ifdef __linux__
+/*
+ * set_affinity
+ *
+ * Restrict the current process to the given CPUs, returning false if none of them are set
+ */
+static bool
+set_affinity(bool *cpus, const char *what)
+{
+	cpu_set_t set;
+	int cpu;
+
+	CPU_ZERO(&set);
+	for (cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+	{
+		if (cpus[cpu])
+			CPU_SET(cpu, &set);
+	}
+
+	if (CPU_COUNT(&set) == 0)
+		return false;
+
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+		elog(WARNING, "failed to set CPU affinity to %s: %m", what);
+
+	return true;
+}
+#endif
+
+/*
+ * SetNumaAffinity
+ *
+ * Restrict the current process to the CPUs of the given NUMA node
+ */
+void
+SetNumaAffinity(int node)
+{
+#ifdef HAVE_NUMA_SUPPORT
+	char path[MAXPGPATH];
+	char buf[1024];
+	char what[32];
+	FILE *file;
+	bool cpus[MAX_CPUS];
+
+	if (node < 0)
+		return;
+
+	snprintf(path, MAXPGPATH, NUMA_CPULIST_PATH, node);
+	file = AllocateFile(path, "r");
+
+	if (file == NULL)
+	{
+		elog(WARNING, "could not open \"%s\": %m", path);
+		return;
+	}
+
+	if (fgets(buf, sizeof(buf), file) == NULL)
+	{
+		elog(WARNING, "could not read \"%s\": %m", path);
+		FreeFile(file);
+		return;
+	}
+
+	FreeFile(file);
+
+	/* cpulist is formatted as ranges, e.g. "0-7,16-23" */
+	buf[strcspn(buf, "\n")] = '\0';
+	if (!ParseCPUList(buf, cpus))
+	{
+		elog(WARNING, "could not parse CPU list of NUMA node %d: \"%s\"", node, buf);
+		return;
+	}
+
+	snprintf(what, sizeof(what), "NUMA node %d", node);
+	if (!set_affinity(cpus, what))
+		elog(WARNING, "NUMA node %d has no CPUs", node);
+#else
+	if (node >= 0)
+		elog(WARNING, "NUMA placement is not supported on this platform");
+#endif
+}
+
+/*
+ * SetCPUAffinity
+ *
+ * Restrict the current process to the given list of CPUs. An empty list leaves the process's
+ * affinity as is.
+ */
+void
+SetCPUAffinity(const char *cpulist)
+{
+	bool cpus[MAX_CPUS];
+
+	if (cpulist == NULL || *cpulist == '\0')
+		return;
+
+	if (!ParseCPUList(cpulist, cpus))
+	{
+		elog(WARNING, "invalid CPU list \"%s\"", cpulist);
+		return;
+	}
+
+#ifdef __linux__
+	if (!set_affinity(cpus, cpulist))
+		elog(WARNING, "CPU list \"%s\" is empty", cpulist);
+#else
+	elog(WARNING, "CPU affinity is not supported on this platform");
+#endif
+}
+
+/*
+ * JoinCGroup
+ *
+ * Move the current process into the control group with the given directory, e.g.
+ * /sys/fs/cgroup/cpu/pipelinedb. An empty path leaves the process where it is.
+ */
+void
+JoinCGroup(const char *path)
+{
+	char procs[MAXPGPATH];
+	FILE *file;
+
+	if (path == NULL || *path == '\0')
+		return;
+
+	snprintf(procs, MAXPGPATH, "%s/cgroup.procs", path);
+	file = AllocateFile(procs, "w");
+
+	if (file == NULL)
+	{
+		elog(WARNING, "could not open \"%s\": %m", procs);
+		return;
+	}
+
+	fprintf(file, "%d\n", MyProcPid);
+
+	/* the write is only checked by the kernel once it's flushed */
+	if (FreeFile(file) != 0)
+		elog(WARNING, "could not add process %d to control group \"%s\": %m", MyProcPid, path);
+}
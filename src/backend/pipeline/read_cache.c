@@ -0,0 +1,372 @@
+/*-------------------------------------------------------------------------
+ *
+ * read_cache.c
+ *
+ *	  Shared cache of the finalized rows of recently updated groups
+ *
+ * Continuous views created with a read_cache_key keep the finalized rows of
+ * the groups their combiners most recently wrote here, identified by the text
+ * value of that grouping column. Combiners write each row they change through
+ * to the cache once the transaction writing it has committed, so a group's
+ * cached row is always a row the view has returned at some point, and is never
+ * older than the last committed sync to change that group. Point reads of a
+ * single group can then be served by pipeline_cached_row without planning or
+ * executing a query over the view.
+ *
+ * The cache has a fixed number of slots, sized by continuous_view_read_cache_mem.
+ * When it's full, the slot to reuse is chosen clockwise, skipping over slots that
+ * have been rewritten since the clock hand last passed them, so the groups that
+ * are updated often stay cached. Rows and keys that don't fit in a slot aren't
+ * cached, and the previous row of such a group is removed.
+ *
+ * Truncating or dropping a view removes its rows, and advances a generation
+ * number that combiners must have seen before the sync producing the rows they
+ * write, so that rows committed before a truncation aren't written after it.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/read_cache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "miscadmin.h"
+#include "nodes/pg_list.h"
+#include "pipeline/read_cache.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+
+/* guc parameters */
+int continuous_view_read_cache_mem;
+
+typedef struct ReadCacheKey
+{
+	Oid dbid;
+	Oid viewid;
+	uint32 hash;
+} ReadCacheKey;
+
+typedef struct ReadCacheLookupEntry
+{
+	ReadCacheKey key; /* hash key --- MUST BE FIRST */
+	int slot;
+} ReadCacheLookupEntry;
+
+typedef struct ReadCacheSlot
+{
+	ReadCacheKey key;
+	bool valid;
+	bool recent; /* rewritten since the clock hand last passed it? */
+	uint16 keylen;
+	uint16 rowlen;
+	char data[READ_CACHE_ROW_SIZE]; /* the key, followed by the row */
+} ReadCacheSlot;
+
+typedef struct ReadCacheHeader
+{
+	int nslots;
+	int hand;
+	uint64 generation;
+	ReadCacheSlot slots[FLEXIBLE_ARRAY_MEMBER];
+} ReadCacheHeader;
+
+static ReadCacheHeader *ReadCache = NULL;
+static HTAB *ReadCacheLookup = NULL;
+
+/*
+ * read_cache_slots
+ */
+static int
+read_cache_slots(void)
+{
+	return ((Size) continuous_view_read_cache_mem * 1024) / sizeof(ReadCacheSlot);
+}
+
+/*
+ * ReadCacheShmemSize
+ */
+Size
+ReadCacheShmemSize(void)
+{
+	int nslots = read_cache_slots();
+	Size size;
+
+	if (nslots == 0)
+		return 0;
+
+	size = add_size(offsetof(ReadCacheHeader, slots), mul_size(nslots, sizeof(ReadCacheSlot)));
+	size = add_size(size, hash_estimate_size(nslots, sizeof(ReadCacheLookupEntry)));
+
+	return size;
+}
+
+/*
+ * ReadCacheShmemInit
+ */
+void
+ReadCacheShmemInit(void)
+{
+	int nslots = read_cache_slots();
+	HASHCTL ctl;
+	bool found;
+
+	if (nslots == 0)
+		return;
+
+	ReadCache = ShmemInitStruct("ReadCache",
+			add_size(offsetof(ReadCacheHeader, slots), mul_size(nslots, sizeof(ReadCacheSlot))), &found);
+
+	if (!found)
+	{
+		int i;
+
+		ReadCache->nslots = nslots;
+		ReadCache->hand = 0;
+		ReadCache->generation = 0;
+
+		for (i = 0; i < nslots; i++)
+			ReadCache->slots[i].valid = false;
+	}
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(ReadCacheKey);
+	ctl.entrysize = sizeof(ReadCacheLookupEntry);
+
+	ReadCacheLookup = ShmemInitHash("ReadCacheLookup", nslots, nslots, &ctl, HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * ReadCacheEnabled
+ */
+bool
+ReadCacheEnabled(void)
+{
+	return ReadCache != NULL;
+}
+
+/*
+ * ReadCacheCapacity
+ *
+ * Returns the number of rows the cache holds at most
+ */
+int
+ReadCacheCapacity(void)
+{
+	return ReadCache ? ReadCache->nslots : 0;
+}
+
+/*
+ * ReadCacheGeneration
+ *
+ * Rows may only be written to the cache if no view was truncated or dropped after the
+ * generation they were produced in was read
+ */
+uint64
+ReadCacheGeneration(void)
+{
+	uint64 result;
+
+	if (!ReadCache)
+		return 0;
+
+	LWLockAcquire(ContQueryReadCacheLock, LW_SHARED);
+	result = ReadCache->generation;
+	LWLockRelease(ContQueryReadCacheLock);
+
+	return result;
+}
+
+/*
+ * set_key
+ */
+static void
+set_key(ReadCacheKey *key, Oid viewid, char *value, int len)
+{
+	MemSet(key, 0, sizeof(ReadCacheKey));
+	key->dbid = MyDatabaseId;
+	key->viewid = viewid;
+	key->hash = DatumGetUInt32(hash_any((unsigned char *) value, len));
+}
+
+/*
+ * remove_slot
+ */
+static void
+remove_slot(ReadCacheSlot *slot)
+{
+	hash_search(ReadCacheLookup, &slot->key, HASH_REMOVE, NULL);
+	slot->valid = false;
+}
+
+/*
+ * claim_slot
+ *
+ * Returns the index of a free slot, evicting the row of the first slot the clock hand finds
+ * that hasn't been rewritten since it last passed it, if necessary
+ */
+static int
+claim_slot(void)
+{
+	for (;;)
+	{
+		int i = ReadCache->hand;
+		ReadCacheSlot *slot = &ReadCache->slots[i];
+
+		ReadCache->hand = (ReadCache->hand + 1) % ReadCache->nslots;
+
+		if (!slot->valid)
+			return i;
+
+		if (slot->recent)
+		{
+			slot->recent = false;
+			continue;
+		}
+
+		remove_slot(slot);
+
+		return i;
+	}
+}
+
+/*
+ * ReadCachePut
+ *
+ * Writes the given committed rows of a view through to the cache. If complete is false, the
+ * rows aren't all of the view's groups that changed, so none of its other rows can be trusted.
+ */
+void
+ReadCachePut(Oid viewid, List *rows, bool complete, uint64 generation)
+{
+	ListCell *lc;
+
+	if (!ReadCache)
+		return;
+
+	if (!complete)
+		ReadCacheInvalidate(viewid);
+
+	LWLockAcquire(ContQueryReadCacheLock, LW_EXCLUSIVE);
+
+	if (generation != ReadCache->generation)
+	{
+		LWLockRelease(ContQueryReadCacheLock);
+		return;
+	}
+
+	foreach(lc, rows)
+	{
+		ReadCacheRow *row = (ReadCacheRow *) lfirst(lc);
+		int keylen = strlen(row->key);
+		int rowlen = row->row ? VARSIZE(DatumGetPointer(row->row)) : 0;
+		bool fits = row->row && keylen + rowlen <= READ_CACHE_ROW_SIZE;
+		ReadCacheLookupEntry *entry;
+		ReadCacheSlot *slot;
+		ReadCacheKey key;
+		bool found;
+
+		set_key(&key, viewid, row->key, keylen);
+		entry = (ReadCacheLookupEntry *) hash_search(ReadCacheLookup, &key, HASH_FIND, NULL);
+
+		if (!fits)
+		{
+			if (entry)
+				remove_slot(&ReadCache->slots[entry->slot]);
+			continue;
+		}
+
+		if (entry)
+			slot = &ReadCache->slots[entry->slot];
+		else
+		{
+			int i = claim_slot();
+
+			entry = (ReadCacheLookupEntry *) hash_search(ReadCacheLookup, &key, HASH_ENTER, &found);
+			Assert(!found);
+			entry->slot = i;
+			slot = &ReadCache->slots[i];
+			slot->key = key;
+			slot->valid = true;
+		}
+
+		/* a different key with the same hash just replaces the slot's group */
+		slot->recent = true;
+		slot->keylen = keylen;
+		slot->rowlen = rowlen;
+		memcpy(slot->data, row->key, keylen);
+		memcpy(slot->data + keylen, DatumGetPointer(row->row), rowlen);
+	}
+
+	LWLockRelease(ContQueryReadCacheLock);
+}
+
+/*
+ * ReadCacheGet
+ *
+ * Returns a copy of the cached row of the given view's group whose read_cache_key has the given value
+ */
+Datum
+ReadCacheGet(Oid viewid, char *value, bool *found)
+{
+	int keylen = strlen(value);
+	ReadCacheLookupEntry *entry;
+	ReadCacheKey key;
+	char *result = NULL;
+
+	*found = false;
+
+	if (!ReadCache)
+		return (Datum) 0;
+
+	set_key(&key, viewid, value, keylen);
+
+	LWLockAcquire(ContQueryReadCacheLock, LW_SHARED);
+
+	entry = (ReadCacheLookupEntry *) hash_search(ReadCacheLookup, &key, HASH_FIND, NULL);
+	if (entry)
+	{
+		ReadCacheSlot *slot = &ReadCache->slots[entry->slot];
+
+		if (slot->valid && slot->keylen == keylen && memcmp(slot->data, value, keylen) == 0)
+		{
+			result = palloc(slot->rowlen);
+			memcpy(result, slot->data + keylen, slot->rowlen);
+			*found = true;
+		}
+	}
+
+	LWLockRelease(ContQueryReadCacheLock);
+
+	return PointerGetDatum(result);
+}
+
+/*
+ * ReadCacheInvalidate
+ *
+ * Removes all cached rows of the given view, and keeps rows produced before now from being written
+ */
+void
+ReadCacheInvalidate(Oid viewid)
+{
+	int i;
+
+	if (!ReadCache)
+		return;
+
+	LWLockAcquire(ContQueryReadCacheLock, LW_EXCLUSIVE);
+
+	for (i = 0; i < ReadCache->nslots; i++)
+	{
+		ReadCacheSlot *slot = &ReadCache->slots[i];
+
+		if (slot->valid && slot->key.dbid == MyDatabaseId && slot->key.viewid == viewid)
+			remove_slot(slot);
+	}
+
+	ReadCache->generation++;
+
+	LWLockRelease(ContQueryReadCacheLock);
+}
@@ -0,0 +1,492 @@
+/*-------------------------------------------------------------------------
+ *
+ * sink.c
+ *
+ *	  Asynchronous delivery of continuous transform output
+ *
+ * Continuous transforms that output to pipeline_sink('fn') don't call their
+ * output function themselves. Instead, workers push the transform's rows into
+ * a shared memory queue owned by the database's sink process, which calls fn
+ * with arrays of up to continuous_query_sink_batch_size rows. fn is expected
+ * to deliver the rows to an external system, so workers never wait on its I/O
+ * unless the queue is full, at which point they wait for the sink to catch up.
+ *
+ * Failed deliveries are retried with exponential backoff up to
+ * continuous_query_sink_max_retries times, after which the rows are dropped.
+ * Rows still in the queue when the sink process exits are lost.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/sink.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "parser/parse_func.h"
+#include "pgstat.h"
+#include "pipeline/cont_scheduler.h"
+#include "pipeline/ipc/queue.h"
+#include "pipeline/miscutils.h"
+#include "pipeline/sink.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+#include "utils/snapmgr.h"
+
+#define SINK_START_TIMEOUT 5000 /* ms */
+#define SINK_RETRY_MIN_DELAY 100 /* ms */
+#define SINK_RETRY_MAX_DELAY 10000 /* ms */
+#define SINK_IDLE_TIMEOUT 1000 /* ms */
+
+/* guc parameters */
+int continuous_query_sink_queue_size;
+int continuous_query_sink_batch_size;
+int continuous_query_sink_max_retries;
+
+/*
+ * Each queue slot holds some of the rows a transform produced in a batch, as MAXALIGNed composite
+ * datums following the message header
+ */
+typedef struct SinkMessage
+{
+	Oid fnoid;
+	Oid rowtype;
+	int nrows;
+} SinkMessage;
+
+#define SINK_MESSAGE_HDRSZ MAXALIGN(sizeof(SinkMessage))
+
+/* rows read off the queue for a single delivery function */
+typedef struct SinkBatch
+{
+	Oid fnoid;
+	Oid rowtype;
+	int nrows;
+	int maxrows;
+	Datum *rows;
+} SinkBatch;
+
+/* the sink queue segment of this process' database, as last attached by a producer */
+static dsm_segment *sink_segment = NULL;
+
+/*
+ * LookupSinkFunction
+ *
+ * Sink functions take an array of rows of any type
+ */
+Oid
+LookupSinkFunction(const char *name, bool missing_ok)
+{
+	Oid argtypes[1];
+
+	argtypes[0] = ANYARRAYOID;
+
+	return LookupFuncName(stringToQualifiedNameList(name), 1, argtypes, missing_ok);
+}
+
+/*
+ * dsm_attach_and_pin
+ */
+static dsm_segment *
+dsm_attach_and_pin(dsm_handle handle)
+{
+	ResourceOwner res;
+	ResourceOwner old;
+	dsm_segment *segment;
+
+	old = CurrentResourceOwner;
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "Sink dsm_segment ResourceOwner");
+
+	segment = dsm_attach(handle);
+	if (segment)
+		dsm_pin_mapping(segment);
+
+	res = CurrentResourceOwner;
+	CurrentResourceOwner = old;
+	ResourceOwnerDelete(res);
+
+	return segment;
+}
+
+/*
+ * get_sink_queue
+ *
+ * Attaches to the current sink queue of this process' database, waiting for the sink process to
+ * create one if it's just being started
+ */
+static ipc_queue *
+get_sink_queue(void)
+{
+	ContQueryDatabaseMetadata *db_meta;
+	TimestampTz start = GetCurrentTimestamp();
+	dsm_handle handle;
+
+	if (MyContQueryProc == NULL)
+		elog(ERROR, "pipeline_sink can only be used by continuous transforms");
+
+	db_meta = MyContQueryProc->db_meta;
+
+	while (!db_meta->sink_ready)
+	{
+		if (TimestampDifferenceExceeds(start, GetCurrentTimestamp(), SINK_START_TIMEOUT))
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("sink process for database \"%s\" is not running", NameStr(db_meta->db_name))));
+
+		CHECK_FOR_INTERRUPTS();
+		pg_usleep(10 * 1000); /* 10ms */
+	}
+
+	handle = db_meta->sink_handle;
+
+	/* the sink process was restarted since we last attached */
+	if (sink_segment && dsm_segment_handle(sink_segment) != handle)
+	{
+		dsm_detach(sink_segment);
+		sink_segment = NULL;
+	}
+
+	if (sink_segment == NULL)
+	{
+		sink_segment = dsm_attach_and_pin(handle);
+		if (sink_segment == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("sink process for database \"%s\" is not running", NameStr(db_meta->db_name))));
+	}
+
+	return (ipc_queue *) dsm_segment_address(sink_segment);
+}
+
+/*
+ * push_message
+ */
+static void
+push_message(ipc_queue *ipcq, StringInfo buf, Oid fnoid, Oid rowtype, int nrows)
+{
+	SinkMessage *msg = (SinkMessage *) buf->data;
+	void *ptrs[1];
+	int lens[1];
+
+	msg->fnoid = fnoid;
+	msg->rowtype = rowtype;
+	msg->nrows = nrows;
+
+	ptrs[0] = buf->data;
+	lens[0] = buf->len;
+
+	/* this waits for the sink process to make room if the queue is full */
+	ipc_queue_push_batch_mp(ipcq, ptrs, lens, 1, true);
+}
+
+/*
+ * SinkTuples
+ *
+ * Queues the given rows to be delivered to the given sink function by the sink process
+ */
+void
+SinkTuples(Oid fnoid, TupleDesc desc, HeapTuple *tups, int ntups)
+{
+	ipc_queue *ipcq;
+	StringInfoData buf;
+	Size maxlen;
+	int nrows = 0;
+	int i;
+
+	if (ntups == 0)
+		return;
+
+	ipcq = get_sink_queue();
+
+	/* large batches are split over several slots, so that each of them fits in the queue */
+	maxlen = ipcq->size / 4;
+
+	initStringInfo(&buf);
+	MemSet(buf.data, 0, SINK_MESSAGE_HDRSZ);
+	buf.len = SINK_MESSAGE_HDRSZ;
+
+	for (i = 0; i < ntups; i++)
+	{
+		Datum row = heap_copy_tuple_as_datum(tups[i], desc);
+		int len = VARSIZE(DatumGetPointer(row));
+
+		if (SINK_MESSAGE_HDRSZ + MAXALIGN(len) > maxlen)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("row of %d bytes is too large for the sink queue", len),
+					 errhint("Increase continuous_query_sink_queue_size.")));
+
+		if (nrows && buf.len + MAXALIGN(len) > maxlen)
+		{
+			push_message(ipcq, &buf, fnoid, desc->tdtypeid, nrows);
+			buf.len = SINK_MESSAGE_HDRSZ;
+			nrows = 0;
+		}
+
+		appendBinaryStringInfo(&buf, DatumGetPointer(row), len);
+		while (buf.len != MAXALIGN(buf.len))
+			appendStringInfoCharMacro(&buf, '\0');
+		nrows++;
+
+		pfree(DatumGetPointer(row));
+	}
+
+	push_message(ipcq, &buf, fnoid, desc->tdtypeid, nrows);
+
+	pfree(buf.data);
+}
+
+/*
+ * pipeline_sink
+ *
+ * Continuous transforms that output to pipeline_sink never actually call it, their rows are queued for
+ * the sink process by the transform receiver
+ */
+Datum
+pipeline_sink(PG_FUNCTION_ARGS)
+{
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+				 errmsg("pipeline_sink: must be called as trigger")));
+
+	ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("pipeline_sink can only be used as the output function of continuous transforms")));
+
+	PG_RETURN_NULL();
+}
+
+/*
+ * deliver
+ *
+ * Calls a batch's sink function with its rows in a transaction of its own, returning whether it succeeded
+ */
+static bool
+deliver(SinkBatch *batch, MemoryContext cxt)
+{
+	volatile bool success = true;
+
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	PG_TRY();
+	{
+		FmgrInfo finfo;
+		FunctionCallInfoData fcinfo;
+		FuncExpr *expr;
+		ArrayType *arr;
+
+		/* polymorphic sink functions resolve their argument to an array of the transform's rows */
+		expr = makeFuncExpr(batch->fnoid, get_func_rettype(batch->fnoid),
+				list_make1(makeNullConst(get_array_type(batch->rowtype), -1, InvalidOid)),
+				InvalidOid, InvalidOid, COERCE_EXPLICIT_CALL);
+
+		fmgr_info(batch->fnoid, &finfo);
+		fmgr_info_set_expr((Node *) expr, &finfo);
+
+		arr = construct_array(batch->rows, batch->nrows, batch->rowtype, -1, false, 'd');
+
+		InitFunctionCallInfoData(fcinfo, &finfo, 1, InvalidOid, NULL, NULL);
+		fcinfo.arg[0] = PointerGetDatum(arr);
+		fcinfo.argnull[0] = false;
+
+		FunctionCallInvoke(&fcinfo);
+
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		EmitErrorReport();
+		FlushErrorState();
+
+		AbortCurrentTransaction();
+
+		success = false;
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(cxt);
+
+	return success;
+}
+
+/*
+ * deliver_with_retries
+ */
+static void
+deliver_with_retries(SinkBatch *batch, MemoryContext cxt)
+{
+	int delay = SINK_RETRY_MIN_DELAY;
+	int attempt;
+
+	for (attempt = 0; attempt <= continuous_query_sink_max_retries; attempt++)
+	{
+		int rc;
+
+		if (attempt > 0)
+		{
+			rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, delay);
+			ResetLatch(MyLatch);
+
+			if (rc & WL_POSTMASTER_DEATH)
+				proc_exit(1);
+
+			if (ShouldTerminateContQueryProcess())
+				break;
+
+			delay = Min(delay * 2, SINK_RETRY_MAX_DELAY);
+		}
+
+		if (deliver(batch, cxt))
+			return;
+	}
+
+	elog(WARNING, "sink function %u failed %d times, dropping %d rows", batch->fnoid, attempt, batch->nrows);
+}
+
+/*
+ * add_rows
+ */
+static SinkBatch *
+add_rows(List **batches, SinkMessage *msg)
+{
+	SinkBatch *batch = NULL;
+	char *pos = (char *) msg + SINK_MESSAGE_HDRSZ;
+	ListCell *lc;
+	int i;
+
+	foreach(lc, *batches)
+	{
+		SinkBatch *b = (SinkBatch *) lfirst(lc);
+
+		if (b->fnoid == msg->fnoid && b->rowtype == msg->rowtype)
+		{
+			batch = b;
+			break;
+		}
+	}
+
+	if (batch == NULL)
+	{
+		batch = palloc0(sizeof(SinkBatch));
+		batch->fnoid = msg->fnoid;
+		batch->rowtype = msg->rowtype;
+		batch->maxrows = Max(msg->nrows, continuous_query_sink_batch_size);
+		batch->rows = palloc(sizeof(Datum) * batch->maxrows);
+		*batches = lappend(*batches, batch);
+	}
+
+	if (batch->nrows + msg->nrows > batch->maxrows)
+	{
+		batch->maxrows = batch->nrows + msg->nrows;
+		batch->rows = repalloc(batch->rows, sizeof(Datum) * batch->maxrows);
+	}
+
+	for (i = 0; i < msg->nrows; i++)
+	{
+		int len = VARSIZE(pos);
+
+		batch->rows[batch->nrows++] = PointerGetDatum(pos);
+		pos += MAXALIGN(len);
+	}
+
+	return batch;
+}
+
+/*
+ * ContinuousQuerySinkMain
+ */
+void
+ContinuousQuerySinkMain(void)
+{
+	ContQueryDatabaseMetadata *db_meta = MyContQueryProc->db_meta;
+	MemoryContext cxt;
+	dsm_segment *segment;
+	ResourceOwner res;
+	ipc_queue *ipcq;
+	Size size = continuous_query_sink_queue_size * 1024L;
+
+	cxt = AllocSetContextCreate(TopMemoryContext, "SinkBatchCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "Sink dsm_segment ResourceOwner");
+	segment = dsm_create(size, 0);
+	dsm_pin_mapping(segment);
+	res = CurrentResourceOwner;
+	CurrentResourceOwner = NULL;
+	ResourceOwnerDelete(res);
+
+	ipcq = (ipc_queue *) dsm_segment_address(segment);
+	ipc_queue_init(ipcq, size, NULL);
+	ipcq->multi_producer = true;
+
+	db_meta->sink_handle = dsm_segment_handle(segment);
+	pg_write_barrier();
+	db_meta->sink_ready = true;
+
+	elog(LOG, "continuous query process \"%s\" running with pid %d", GetContQueryProcName(MyContQueryProc), MyProcPid);
+	pgstat_report_activity(STATE_RUNNING, GetContQueryProcName(MyContQueryProc));
+
+	SetNicePriority();
+
+	for (;;)
+	{
+		List *batches = NIL;
+		ListCell *lc;
+		int nrows = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (ShouldTerminateContQueryProcess())
+			break;
+
+		ipc_queue_wait_non_empty(ipcq, SINK_IDLE_TIMEOUT);
+
+		MemoryContextSwitchTo(cxt);
+
+		/* slots are only popped once their rows have been delivered, so slow deliveries hold producers back */
+		while (nrows < continuous_query_sink_batch_size)
+		{
+			SinkMessage *msg;
+			int len;
+
+			msg = (SinkMessage *) ipc_queue_peek_next(ipcq, &len);
+			if (msg == NULL)
+				break;
+
+			/* slots aren't necessarily MAXALIGNed, so the rows are read from a copy */
+			msg = memcpy(palloc(len), msg, len);
+			add_rows(&batches, msg);
+			nrows += msg->nrows;
+		}
+
+		foreach(lc, batches)
+			deliver_with_retries((SinkBatch *) lfirst(lc), cxt);
+
+		if (nrows)
+			ipc_queue_pop_peeked(ipcq);
+
+		MemoryContextReset(cxt);
+	}
+
+	db_meta->sink_ready = false;
+	dsm_detach(segment);
+
+	elog(LOG, "continuous query process \"%s\" shutting down", GetContQueryProcName(MyContQueryProc));
+}
@@ -13,25 +13,43 @@
 #include "postgres.h"
 
 #include "access/htup_details.h"
+#include "access/sysattr.h"
+#include "access/tupconvert.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
 #include "catalog/pipeline_query.h"
 #include "catalog/pipeline_stream.h"
 #include "catalog/pipeline_stream_fn.h"
+#include "catalog/pg_proc.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
 #include "commands/trigger.h"
+#include "executor/executor.h"
+#include "foreign/foreign.h"
 #include "funcapi.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/planmain.h"
 #include "parser/analyze.h"
 #include "parser/parse_coerce.h"
 #include "parser/parse_collate.h"
 #include "parser/parse_target.h"
+#include "parser/parsetree.h"
 #include "pgstat.h"
 #include "pipeline/cont_scheduler.h"
+#include "pipeline/miscutils.h"
 #include "pipeline/stream.h"
+#include "pipeline/stream_batch.h"
+#include "pipeline/stream_capture.h"
+#include "pipeline/stream_desc.h"
+#include "pipeline/stream_json.h"
+#include "pipeline/stream_log.h"
+#include "pipeline/stream_quota.h"
+#include "pipeline/stream_readers.h"
 #include "storage/shm_alloc.h"
 #include "storage/ipc.h"
 #include "tcop/pquery.h"
@@ -39,6 +57,7 @@
 #include "tcop/tcopprot.h"
 #include "utils/lsyscache.h"
 #include "utils/guc.h"
+#include "utils/inval.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
@@ -48,117 +67,1770 @@
 
 /* guc parameters */
 bool synchronous_stream_insert;
+bool stream_insert_deferred_ack;
+bool stream_insert_columnar_batches;
 char *stream_targets;
+int stream_insert_backpressure;
+int stream_insert_backpressure_timeout;
+int stream_insert_spill_limit;
+
+StreamInsertWaits MyStreamInsertWaits;
 
 int (*copy_iter_hook) (void *arg, void *buf, int minread, int maxread) = NULL;
 void *copy_iter_arg = NULL;
 
+/* Queue fill ratio above which the shed backpressure policy starts sampling events */
+#define SHED_HIGH_WATERMARK 0.75
+#define BACKPRESSURE_SLEEP_US 1000
+
+#define STREAM_ROUTING_KEY_OPTION "routing_key"
+#define HASH_SEED 0x4b1f2c3d5e6f7a89L
+
+/*
+ * StreamBackpressureWait
+ *
+ * Called when none of the worker queues have space for the next slot. since is set to the time we first
+ * started waiting if it isn't already set. Returns true if the caller should retry writing the slot,
+ * and false if the slot should be dropped.
+ */
+bool
+StreamBackpressureWait(TimestampTz *since)
+{
+	if (*since == 0)
+		*since = GetCurrentTimestamp();
+
+	switch (stream_insert_backpressure)
+	{
+		case STREAM_BACKPRESSURE_FAIL:
+			ereport(ERROR,
+					(errcode(ERRCODE_STREAM_BUFFER_FULL),
+					 errmsg("stream buffer is full"),
+					 errhint("Retry the insert later or increase continuous_query_ipc_shared_mem.")));
+			break;
+		case STREAM_BACKPRESSURE_SHED:
+			return false;
+		default:
+			break;
+	}
+
+	if (stream_insert_backpressure_timeout &&
+			TimestampDifferenceExceeds(*since, GetCurrentTimestamp(), stream_insert_backpressure_timeout))
+		ereport(ERROR,
+				(errcode(ERRCODE_STREAM_BUFFER_FULL),
+				 errmsg("stream buffer is full"),
+				 errdetail("Timed out after waiting %d ms for space in worker queues.",
+						 stream_insert_backpressure_timeout)));
+
+	pg_usleep(BACKPRESSURE_SLEEP_US);
+	CHECK_FOR_INTERRUPTS();
+
+	return true;
+}
+
+/*
+ * ack_shed_tuples
+ *
+ * Shed tuples never reach a worker, so we ack them on its behalf to not block synchronous inserts
+ */
+static void
+ack_shed_tuples(InsertBatchAck *acks, int nacks, int ntups)
+{
+	int i;
+
+	for (i = 0; i < nacks; i++)
+	{
+		if (acks[i].batch_id == acks[i].batch->id)
+			pg_atomic_fetch_add_u32(&acks[i].batch->num_wacks, ntups);
+	}
+}
+
+/*
+ * StreamBackpressureShouldShed
+ *
+ * With the shed policy, once a queue fills past the high watermark we randomly drop slots with a
+ * probability that increases linearly with the queue's fill ratio, reaching 1 when the queue is full.
+ */
+bool
+StreamBackpressureShouldShed(ipc_queue *ipcq)
+{
+	double fill;
+
+	if (stream_insert_backpressure != STREAM_BACKPRESSURE_SHED)
+		return false;
+
+	fill = ipc_queue_fill_ratio(ipcq);
+
+	if (fill <= SHED_HIGH_WATERMARK)
+		return false;
+
+	return ((double) random() / (double) MAX_RANDOM_VALUE) <
+			(fill - SHED_HIGH_WATERMARK) / (1.0 - SHED_HIGH_WATERMARK);
+}
+
+/*
+ * StreamBackpressureSpill
+ *
+ * With the spill policy, append slots that don't fit in a worker queue to the queue's spill files
+ * instead of waiting, as long as the spill files haven't reached stream_insert_spill_limit. Returns
+ * true if the slots were spilled.
+ */
+bool
+StreamBackpressureSpill(ipc_queue *ipcq, StreamTupleState **sts, int *lens, int n)
+{
+	uint64 bytes = 0;
+	int i;
+
+	if (stream_insert_backpressure != STREAM_BACKPRESSURE_SPILL || ipcq->spill_id < 0)
+		return false;
+
+	for (i = 0; i < n; i++)
+		bytes += sizeof(uint32) + lens[i];
+
+	if (ipc_queue_spill_size(ipcq) + bytes > (uint64) stream_insert_spill_limit * 1024)
+		return false;
+
+	return ipc_queue_spill(ipcq, (void **) sts, lens, n);
+}
+
+/*
+ * Maximum number of tuples packed into a single ipc_queue slot
+ */
+#define MAX_TUPLES_PER_SLOT 64
+
+/*
+ * desc_is_batchable
+ *
+ * Tuples containing RECORD attributes need their own record descriptors, so those are
+ * never batched into shared slots
+ */
+static bool
+desc_is_batchable(TupleDesc desc)
+{
+	int i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (desc->attrs[i]->atttypid == RECORDOID)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * create_slot_state
+ *
+ * Create the StreamTupleState for the next ipc_queue slot, packing as many of the given tuples
+ * into it as is reasonable. The number of tuples packed is returned in ntups.
+ */
+static StreamTupleState *
+create_slot_state(ipc_queue *ipcq, Oid relid, TupleDesc desc, bytea *packed_desc, bool batchable, Bitmapset *targets,
+		HeapTuple *tuples, int ntuples, InsertBatchAck *acks, int nacks, int *len, int *ntups)
+{
+	Size bytes = 0;
+	int n = 0;
+
+	if (!batchable || ntuples == 1)
+	{
+		*ntups = 1;
+		return StreamTupleStateCreate(relid, tuples[0], desc, packed_desc, targets, acks, nacks, len);
+	}
+
+	/* Keep slots small relative to the queue so that a single slot never hogs it */
+	while (n < ntuples && n < MAX_TUPLES_PER_SLOT)
+	{
+		bytes += HEAPTUPLESIZE + tuples[n]->t_len;
+		n++;
+
+		if (bytes >= ipcq->size / 16)
+			break;
+	}
+
+	*ntups = n;
+
+	if (stream_insert_columnar_batches)
+	{
+		StreamTupleState *sts = StreamTupleStateCreateColumnarBatch(relid, tuples, n, desc, packed_desc,
+				targets, acks, nacks, len);
+
+		/* sparse rows can blow up when every value gets its own entry, so fall back if they do */
+		if (*len < ipcq->size / 8)
+			return sts;
+
+		pfree(sts->columns);
+		pfree(sts);
+	}
+
+	return StreamTupleStateCreateBatch(relid, tuples, n, packed_desc, targets, acks, nacks, len);
+}
+
+/*
+ * pool_num_workers
+ */
+static int
+pool_num_workers(int pool)
+{
+	int first;
+	int n;
+
+	GetWorkerPoolWorkers(pool, &first, &n);
+
+	return n;
+}
+
+/*
+ * next_worker_queue
+ *
+ * Get the next worker queue to write to. A negative worker means any worker of the given pool will do,
+ * in which case we rotate through them.
+ */
+static ipc_queue *
+next_worker_queue(int pool, int worker)
+{
+	if (worker < 0)
+		return get_any_worker_queue_with_lock(pool);
+
+	return get_worker_queue_with_lock(worker, IsContQueryWorkerProcess());
+}
+
+/*
+ * send_tuples_lock_free
+ *
+ * Write tuples to multi producer worker queues. Tuples are written in chunks of at most
+ * continuous_query_batch_size tuples, each of which is reserved and published atomically
+ * without taking the queue lock.
+ */
+static uint64
+send_tuples_lock_free(ipc_queue *ipcq, int pool, int worker, Oid relid, TupleDesc desc, bytea *packed_desc,
+		bool batchable, Bitmapset *targets, HeapTuple *tuples, int ntuples, InsertBatchAck *acks, int nacks,
+		int *nbatches)
+{
+	int nqueues = worker < 0 ? pool_num_workers(pool) : 1;
+	int nchunk = Min(ntuples, continuous_query_batch_size);
+	StreamTupleState **sts = palloc(sizeof(StreamTupleState *) * nchunk);
+	int *lens = palloc(sizeof(int) * nchunk);
+	uint64 size = 0;
+	int i = 0;
+
+	*nbatches = 0;
+
+	while (i < ntuples)
+	{
+		uint64 bytes = 0;
+		int ntries = 0;
+		bool shed = false;
+		bool spilled = false;
+		TimestampTz since = 0;
+		int ntups = 0;
+		int n = 0;
+		int j;
+
+		/* Never reserve more than a fraction of the queue at once so other producers can make progress */
+		while (i < ntuples && ntups < nchunk)
+		{
+			int nslot;
+
+			sts[n] = create_slot_state(ipcq, relid, desc, packed_desc, batchable, targets, &tuples[i],
+					Min(ntuples - i, nchunk - ntups), acks, nacks, &lens[n], &nslot);
+			bytes += sizeof(ipc_queue_slot) + lens[n];
+			n++;
+			i += nslot;
+			ntups += nslot;
+
+			if (bytes >= ipcq->size / 4)
+				break;
+		}
+
+		if (StreamBackpressureShouldShed(ipcq))
+			shed = true;
+		else if (ipc_queue_has_spill(ipcq) && StreamBackpressureSpill(ipcq, sts, lens, n))
+			spilled = true;
+
+		while (!shed && !spilled && !ipc_queue_push_batch_mp(ipcq, (void **) sts, lens, n, false))
+		{
+			if (++ntries >= nqueues && StreamBackpressureSpill(ipcq, sts, lens, n))
+				spilled = true;
+			else if (ntries >= nqueues && !StreamBackpressureWait(&since))
+				shed = true;
+			else
+				ipcq = next_worker_queue(pool, worker);
+		}
+
+		if (shed)
+			ack_shed_tuples(acks, nacks, ntups);
+
+		for (j = 0; j < n; j++)
+		{
+			if (!shed)
+				size += lens[j];
+
+			if (sts[j]->record_descs)
+				pfree(sts[j]->record_descs);
+			pfree(sts[j]);
+		}
+
+		(*nbatches)++;
+
+		/* Spread subsequent chunks across workers */
+		if (i < ntuples)
+			ipcq = next_worker_queue(pool, worker);
+	}
+
+	pfree(sts);
+	pfree(lens);
+
+	return size;
+}
+
+/*
+ * send_tuples
+ *
+ * Write tuples to worker queues. If worker is negative, tuples are spread across all workers of the
+ * given pool, otherwise they all go to the given worker's queue.
+ */
+static uint64
+send_tuples(int pool, int worker, Oid relid, TupleDesc desc, bytea *packed_desc, bool batchable, Bitmapset *targets,
+		HeapTuple *tuples, int ntuples, InsertBatchAck *acks, int nacks, int *nbatches)
+{
+	ipc_queue *ipcq;
+	int i;
+	int free;
+	uint64 tail;
+	uint64 head;
+	uint64 size = 0;
+	int ninserted;
+	int ntups;
+	int nfull = 0;
+	int nqueues = worker < 0 ? pool_num_workers(pool) : 1;
+	TimestampTz since = 0;
+	TimestampTz now = GetCurrentTimestamp();
+
+	ipcq = next_worker_queue(pool, worker);
+
+	if (ipcq->multi_producer)
+		return send_tuples_lock_free(ipcq, pool, worker, relid, desc, packed_desc, batchable, targets, tuples, ntuples,
+				acks, nacks, nbatches);
+
+	*nbatches = 1;
+
+	head = pg_atomic_read_u64(&ipcq->head);
+	tail = pg_atomic_read_u64(&ipcq->tail);
+	free = ipc_queue_free_size(ipcq, head, tail);
+	ninserted = 0;
+
+	Assert(free >= 0);
+
+	for (i = 0; i < ntuples; i += ntups)
+	{
+		int len;
+		StreamTupleState *sts = create_slot_state(ipcq, relid, desc, packed_desc, batchable, targets, &tuples[i],
+				ntuples - i, acks, nacks, &len, &ntups);
+		ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, head);
+		int len_needed = sizeof(ipc_queue_slot) + len;
+		bool needs_wrap = ipc_queue_needs_wrap(ipcq, head, len_needed);
+		char *dest_bytes;
+
+		Assert(IsContQueryWorkerProcess() ? ipcq->consumed_by_broker : true);
+		Assert(tail <= head);
+
+		if (needs_wrap)
+			len_needed = len + ipcq->size - ipc_queue_offset(ipcq, head);
+
+		if (free < len_needed)
+		{
+			tail = pg_atomic_read_u64(&ipcq->tail);
+			free = ipc_queue_free_size(ipcq, head, tail);
+		}
+
+		/* Keep spilling while the queue has spilled slots so that they're consumed in order */
+		if ((ipc_queue_has_spill(ipcq) || (free < len_needed && nfull + 1 >= nqueues)) &&
+				StreamBackpressureSpill(ipcq, &sts, &len, 1))
+		{
+			size += len;
+			nfull = 0;
+			since = 0;
+
+			if (sts->record_descs)
+				pfree(sts->record_descs);
+			pfree(sts);
+
+			continue;
+		}
+
+		if (StreamBackpressureShouldShed(ipcq) ||
+				(free < len_needed && ++nfull >= nqueues && !StreamBackpressureWait(&since)))
+		{
+			/* drop these tuples */
+			ack_shed_tuples(acks, nacks, ntups);
+
+			if (sts->record_descs)
+				pfree(sts->record_descs);
+			pfree(sts);
+			nfull = 0;
+			since = 0;
+
+			continue;
+		}
+
+		if (free < len_needed || ninserted >= continuous_query_batch_size)
+		{
+			if (free >= len_needed)
+				nfull = 0;
+
+			ipc_queue_update_head(ipcq, head);
+			ipc_queue_unlock(ipcq);
+
+			ipcq = next_worker_queue(pool, worker);
+
+			head = pg_atomic_read_u64(&ipcq->head);
+			tail = pg_atomic_read_u64(&ipcq->tail);
+			free = ipc_queue_free_size(ipcq, head, tail);
+
+			if (ninserted)
+				(*nbatches)++;
+
+			now = GetCurrentTimestamp();
+			ninserted = 0;
+
+			/* retry these tuples */
+			if (sts->record_descs)
+				pfree(sts->record_descs);
+			pfree(sts);
+			ntups = 0;
+
+			continue;
+		}
+
+		size += len;
+		ninserted += ntups;
+		nfull = 0;
+		since = 0;
+
+		free -= len_needed;
+		head += len_needed;
+
+		slot->time = now;
+		slot->len = len;
+		slot->peeked = false;
+		slot->wraps = needs_wrap;
+		slot->next = head;
+
+		dest_bytes = needs_wrap ? ipcq->bytes : slot->bytes;
+		ipc_queue_check_overflow(ipcq, dest_bytes, len);
+
+		StreamTupleStateCopyFn(dest_bytes, sts, len);
+
+		if (sts->record_descs)
+			pfree(sts->record_descs);
+		pfree(sts);
+	}
+
+	ipc_queue_update_head(ipcq, head);
+	ipc_queue_unlock(ipcq);
+
+	return size;
+}
+
+/*
+ * Per-backend cache of the catalog-derived state needed to insert into a stream, so that hot
+ * inserts into a stream don't need any catalog lookups
+ */
+typedef struct StreamInsertInfo
+{
+	Oid relid;
+	bool valid;
+	/* hash values of the stream's pipeline_stream and pg_foreign_table syscache entries */
+	uint32 stream_hashvalue;
+	uint32 ft_hashvalue;
+	/* readers of the stream, as of the stream_targets value below */
+	Bitmapset *targets;
+	char *stream_targets;
+	/* the stream's routing_key option, or NULL */
+	char *routing_key;
+	/*
+	 * attributes of the stream read by any of the targets, offset by FirstLowInvalidHeapAttributeNumber,
+	 * only valid if prunable is set
+	 */
+	bool prunable;
+	Bitmapset *read_attrs;
+	/* StreamQueryFilters for targets with simple WHERE clauses, allocated in filter_cxt */
+	List *filters;
+	MemoryContext filter_cxt;
+	/* targets in each worker pool, indexed by pool id, or NULL if all targets are in the default pool */
+	Bitmapset **pool_targets;
+} StreamInsertInfo;
+
+/* Conjuncts of a reader's WHERE clause that can be evaluated before its events are enqueued */
+typedef struct StreamQueryFilter
+{
+	int id;
+	List *quals;
+} StreamQueryFilter;
+
+struct StreamFilterState
+{
+	MemoryContext cxt;
+	ExprContext *econtext;
+	TupleTableSlot *slot;
+	Bitmapset *targets;
+	int nfilters;
+	int *ids;
+	List **quals; /* ExprStates of each filter */
+};
+
+typedef struct ReadAttrsContext
+{
+	Oid relid;
+	List *rtables; /* range tables of the enclosing queries, innermost first */
+	Bitmapset *attrs;
+	bool all;
+} ReadAttrsContext;
+
+static HTAB *stream_insert_info = NULL;
+
+/* incremented by every invalidation, to detect invalidations that arrive while building an entry */
+static uint64 stream_insert_info_invals = 0;
+
+/*
+ * invalidate_stream_insert_info
+ *
+ * Invalidate the cached insert info for the given stream, or all streams if relid is invalid
+ */
+static void
+invalidate_stream_insert_info(Oid relid)
+{
+	StreamInsertInfo *entry;
+
+	stream_insert_info_invals++;
+
+	if (OidIsValid(relid))
+	{
+		entry = (StreamInsertInfo *) hash_search(stream_insert_info, &relid, HASH_FIND, NULL);
+		if (entry)
+			entry->valid = false;
+	}
+	else
+	{
+		HASH_SEQ_STATUS status;
+
+		hash_seq_init(&status, stream_insert_info);
+		while ((entry = (StreamInsertInfo *) hash_seq_search(&status)) != NULL)
+			entry->valid = false;
+	}
+}
+
+/*
+ * has_target_with_hashvalue
+ *
+ * Does any of the given stream's targets have the given PIPELINEQUERYID hash value?
+ */
+static bool
+has_target_with_hashvalue(StreamInsertInfo *entry, uint32 hashvalue)
+{
+	int id = -1;
+
+	while ((id = bms_next_member(entry->targets, id)) >= 0)
+	{
+		if (GetSysCacheHashValue1(PIPELINEQUERYID, Int32GetDatum(id)) == hashvalue)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * stream_insert_info_syscache_callback
+ *
+ * Creating, dropping or activating a continuous view rewrites the pipeline_stream rows of the streams
+ * it reads from, so only the insert info of the streams whose rows were invalidated is rebuilt. Backends
+ * inserting into other streams don't notice. A hash value of 0 means the whole cache was reset.
+ */
+static void
+stream_insert_info_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	StreamInsertInfo *entry;
+	HASH_SEQ_STATUS status;
+
+	if (hashvalue == 0)
+	{
+		invalidate_stream_insert_info(InvalidOid);
+		return;
+	}
+
+	stream_insert_info_invals++;
+
+	hash_seq_init(&status, stream_insert_info);
+	while ((entry = (StreamInsertInfo *) hash_seq_search(&status)) != NULL)
+	{
+		if (!entry->valid)
+			continue;
+
+		switch (cacheid)
+		{
+			case PIPELINESTREAMRELID:
+				if (entry->stream_hashvalue == hashvalue)
+					entry->valid = false;
+				break;
+			case FOREIGNTABLEREL:
+				if (entry->ft_hashvalue == hashvalue)
+					entry->valid = false;
+				break;
+			default:
+				/* pipeline_query rows only concern the streams they're read by */
+				if (has_target_with_hashvalue(entry, hashvalue))
+					entry->valid = false;
+				break;
+		}
+	}
+}
+
+static void
+stream_insert_info_relcache_callback(Datum arg, Oid relid)
+{
+	invalidate_stream_insert_info(relid);
+}
+
+/*
+ * get_stream_routing_key
+ */
+static char *
+get_stream_routing_key(Relation stream)
+{
+	ForeignTable *ft = GetForeignTable(RelationGetRelid(stream));
+	ListCell *lc;
+
+	foreach(lc, ft->options)
+	{
+		DefElem *def = (DefElem *) lfirst(lc);
+
+		if (pg_strcasecmp(def->defname, STREAM_ROUTING_KEY_OPTION) == 0)
+			return defGetString(def);
+	}
+
+	return NULL;
+}
+
+/*
+ * read_attrs_walker
+ *
+ * Collect the attributes of the given stream referenced anywhere in a query, including
+ * in sublinks and subqueries
+ */
+static bool
+read_attrs_walker(Node *node, ReadAttrsContext *context)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, Var))
+	{
+		Var *var = (Var *) node;
+		List *rtable;
+		RangeTblEntry *rte;
+
+		if (var->varlevelsup >= list_length(context->rtables))
+			return false;
+
+		rtable = (List *) list_nth(context->rtables, var->varlevelsup);
+		if (var->varno < 1 || var->varno > list_length(rtable))
+			return false;
+
+		rte = rt_fetch(var->varno, rtable);
+		if (rte->rtekind != RTE_RELATION || rte->relid != context->relid)
+			return false;
+
+		/* whole-row references read everything */
+		if (var->varattno == InvalidAttrNumber)
+			context->all = true;
+		else
+			context->attrs = bms_add_member(context->attrs, var->varattno - FirstLowInvalidHeapAttributeNumber);
+
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+		bool result;
+
+		context->rtables = lcons(query->rtable, context->rtables);
+		result = query_tree_walker(query, read_attrs_walker, (void *) context, 0);
+		context->rtables = list_delete_first(context->rtables);
+
+		return result;
+	}
+
+	return expression_tree_walker(node, read_attrs_walker, (void *) context);
+}
+
+/*
+ * get_stream_read_attrs
+ *
+ * Get the union of the stream's attributes read by the given continuous queries. Returns false
+ * if all of the stream's attributes may be read.
+ */
+static bool
+get_stream_read_attrs(Oid relid, Bitmapset *queries, Bitmapset **attrs)
+{
+	ReadAttrsContext context;
+	int id = -1;
+
+	MemSet(&context, 0, sizeof(ReadAttrsContext));
+	context.relid = relid;
+
+	while ((id = bms_next_member(queries, id)) >= 0 && !context.all)
+	{
+		HeapTuple tup = SearchSysCache1(PIPELINEQUERYID, ObjectIdGetDatum(id));
+		Datum tmp;
+		bool isnull;
+		Query *query;
+
+		if (!HeapTupleIsValid(tup))
+		{
+			context.all = true;
+			break;
+		}
+
+		tmp = SysCacheGetAttr(PIPELINEQUERYID, tup, Anum_pipeline_query_query, &isnull);
+		Assert(!isnull);
+
+		query = (Query *) stringToNode(TextDatumGetCString(tmp));
+		read_attrs_walker((Node *) query, &context);
+
+		/* the stream scan reads a query's dedup key even if the query itself doesn't */
+		if (query->dedupKey && get_attnum(relid, query->dedupKey) != InvalidAttrNumber)
+			context.attrs = bms_add_member(context.attrs,
+					get_attnum(relid, query->dedupKey) - FirstLowInvalidHeapAttributeNumber);
+
+		ReleaseSysCache(tup);
+	}
+
+	*attrs = context.attrs;
+
+	return !context.all;
+}
+
+/*
+ * get_stream_readers
+ *
+ * Get the local backend's readers of the given stream and, for typed streams, the attributes
+ * they read. These are shared by all backends that write to the stream without restricting its
+ * readers to the ones in stream_targets.
+ */
+static Bitmapset *
+get_stream_readers(Oid relid, bool typed, bool *prunable, Bitmapset **read_attrs)
+{
+	bool shared = !(stream_targets && strlen(stream_targets));
+	Bitmapset *readers;
+	uint32 generation;
+
+	if (shared && StreamReadersCacheLookup(relid, &readers, prunable, read_attrs))
+		return readers;
+
+	generation = GetStreamReadersCacheGeneration();
+
+	readers = GetLocalStreamReaders(relid);
+	*read_attrs = NULL;
+	*prunable = typed && get_stream_read_attrs(relid, readers, read_attrs);
+
+	if (shared)
+		StreamReadersCacheStore(relid, readers, *prunable, *read_attrs, generation);
+
+	return readers;
+}
+
+/*
+ * is_simple_filter
+ *
+ * Can the given expression be evaluated on stream events by the inserting backend? Only leakproof,
+ * immutable operators over the stream's own columns are allowed, so that evaluating a filter can
+ * never fail an insert or depend on anything but the event itself.
+ */
+static bool
+is_simple_filter(Node *node, Index rtindex, TupleDesc desc)
+{
+	ListCell *lc;
+
+	if (node == NULL)
+		return false;
+
+	switch (nodeTag(node))
+	{
+		case T_Var:
+		{
+			Var *var = (Var *) node;
+			Form_pg_attribute attr;
+
+			if (var->varno != rtindex || var->varlevelsup != 0 ||
+					var->varattno <= 0 || var->varattno > desc->natts)
+				return false;
+
+			/* arrival_timestamp is only assigned by workers */
+			attr = desc->attrs[var->varattno - 1];
+			return !attr->attisdropped && pg_strcasecmp(NameStr(attr->attname), ARRIVAL_TIMESTAMP) != 0;
+		}
+		case T_Const:
+			return true;
+		case T_RelabelType:
+			return is_simple_filter((Node *) ((RelabelType *) node)->arg, rtindex, desc);
+		case T_NullTest:
+			return is_simple_filter((Node *) ((NullTest *) node)->arg, rtindex, desc);
+		case T_BooleanTest:
+			return is_simple_filter((Node *) ((BooleanTest *) node)->arg, rtindex, desc);
+		case T_BoolExpr:
+			foreach(lc, ((BoolExpr *) node)->args)
+				if (!is_simple_filter((Node *) lfirst(lc), rtindex, desc))
+					return false;
+			return true;
+		case T_OpExpr:
+		case T_ScalarArrayOpExpr:
+		{
+			Oid funcid;
+			List *args;
+
+			if (IsA(node, OpExpr))
+			{
+				set_opfuncid((OpExpr *) node);
+				funcid = ((OpExpr *) node)->opfuncid;
+				args = ((OpExpr *) node)->args;
+			}
+			else
+			{
+				set_sa_opfuncid((ScalarArrayOpExpr *) node);
+				funcid = ((ScalarArrayOpExpr *) node)->opfuncid;
+				args = ((ScalarArrayOpExpr *) node)->args;
+			}
+
+			if (func_volatile(funcid) != PROVOLATILE_IMMUTABLE || !get_func_leakproof(funcid))
+				return false;
+
+			foreach(lc, args)
+				if (!is_simple_filter((Node *) lfirst(lc), rtindex, desc))
+					return false;
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+/*
+ * get_stream_filters
+ *
+ * Get the StreamQueryFilters of the given readers of a stream. Only readers that read nothing but
+ * the stream can be filtered, and only the simple conjuncts of their WHERE clauses are used, so an
+ * event rejected by a filter is guaranteed to be rejected by its reader.
+ */
+static List *
+get_stream_filters(Relation stream, Bitmapset *queries)
+{
+	TupleDesc desc = RelationGetDescr(stream);
+	List *result = NIL;
+	int id = -1;
+
+	while ((id = bms_next_member(queries, id)) >= 0)
+	{
+		HeapTuple tup = SearchSysCache1(PIPELINEQUERYID, ObjectIdGetDatum(id));
+		StreamQueryFilter *filter;
+		RangeTblRef *rtr;
+		RangeTblEntry *rte;
+		Query *query;
+		List *quals = NIL;
+		ListCell *lc;
+		Datum tmp;
+		bool isnull;
+
+		if (!HeapTupleIsValid(tup))
+			continue;
+
+		tmp = SysCacheGetAttr(PIPELINEQUERYID, tup, Anum_pipeline_query_query, &isnull);
+		Assert(!isnull);
+
+		query = (Query *) stringToNode(TextDatumGetCString(tmp));
+		ReleaseSysCache(tup);
+
+		if (query->setOperations || !query->jointree->quals ||
+				list_length(query->jointree->fromlist) != 1 ||
+				!IsA(linitial(query->jointree->fromlist), RangeTblRef))
+			continue;
+
+		rtr = (RangeTblRef *) linitial(query->jointree->fromlist);
+		rte = rt_fetch(rtr->rtindex, query->rtable);
+
+		if (rte->rtekind != RTE_RELATION || rte->relid != RelationGetRelid(stream))
+			continue;
+
+		foreach(lc, make_ands_implicit((Expr *) query->jointree->quals))
+		{
+			Node *qual = (Node *) lfirst(lc);
+
+			if (is_simple_filter(qual, rtr->rtindex, desc))
+				quals = lappend(quals, qual);
+		}
+
+		if (quals == NIL)
+			continue;
+
+		filter = palloc(sizeof(StreamQueryFilter));
+		filter->id = id;
+		filter->quals = quals;
+
+		result = lappend(result, filter);
+	}
+
+	return result;
+}
+
+/*
+ * get_stream_pool_targets
+ *
+ * Split the given readers of a stream by the worker pool they're pinned to. Returns NULL if they're
+ * all in the default pool. Readers pinned to a pool that is no longer configured are in the default pool.
+ */
+static Bitmapset **
+get_stream_pool_targets(Bitmapset *queries)
+{
+	int npools = GetNumWorkerPools();
+	Bitmapset **result;
+	bool pinned = false;
+	int id = -1;
+
+	if (npools == 1)
+		return NULL;
+
+	result = palloc0(sizeof(Bitmapset *) * npools);
+
+	while ((id = bms_next_member(queries, id)) >= 0)
+	{
+		HeapTuple tup = SearchSysCache1(PIPELINEQUERYID, ObjectIdGetDatum(id));
+		int pool = DEFAULT_WORKER_POOL;
+
+		if (HeapTupleIsValid(tup))
+		{
+			Query *query;
+			Datum tmp;
+			bool isnull;
+
+			tmp = SysCacheGetAttr(PIPELINEQUERYID, tup, Anum_pipeline_query_query, &isnull);
+			Assert(!isnull);
+
+			query = (Query *) stringToNode(TextDatumGetCString(tmp));
+			ReleaseSysCache(tup);
+
+			pool = Max(GetWorkerPoolId(query->workerPool), DEFAULT_WORKER_POOL);
+		}
+
+		if (pool != DEFAULT_WORKER_POOL)
+			pinned = true;
+
+		result[pool] = bms_add_member(result[pool], id);
+	}
+
+	if (!pinned)
+	{
+		bms_free(result[DEFAULT_WORKER_POOL]);
+		pfree(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+/*
+ * get_stream_insert_info
+ */
+static StreamInsertInfo *
+get_stream_insert_info(Relation stream)
+{
+	Oid relid = RelationGetRelid(stream);
+	char *targets = stream_targets ? stream_targets : "";
+	StreamInsertInfo *entry;
+	MemoryContext old;
+	Bitmapset *readers;
+	char *key;
+	ListCell *lc;
+	bool found;
+	bool typed;
+	bool prunable;
+	Bitmapset *read_attrs = NULL;
+	List *filters = NIL;
+	Bitmapset **pool_targets;
+	uint64 invals;
+	int i;
+
+	if (stream_insert_info == NULL)
+	{
+		HASHCTL ctl;
+
+		MemSet(&ctl, 0, sizeof(HASHCTL));
+
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(StreamInsertInfo);
+		ctl.hcxt = CacheMemoryContext;
+
+		stream_insert_info = hash_create("StreamInsertInfo", 16, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		/*
+		 * readers are stored in pipeline_stream, the columns they read in pipeline_query and the
+		 * routing key in the stream's options
+		 */
+		CacheRegisterSyscacheCallback(PIPELINESTREAMRELID, stream_insert_info_syscache_callback, (Datum) 0);
+		CacheRegisterSyscacheCallback(FOREIGNTABLEREL, stream_insert_info_syscache_callback, (Datum) 0);
+		CacheRegisterSyscacheCallback(PIPELINEQUERYID, stream_insert_info_syscache_callback, (Datum) 0);
+		CacheRegisterRelcacheCallback(stream_insert_info_relcache_callback, (Datum) 0);
+	}
+
+	entry = (StreamInsertInfo *) hash_search(stream_insert_info, &relid, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		entry->valid = false;
+		entry->stream_hashvalue = GetSysCacheHashValue1(PIPELINESTREAMRELID, ObjectIdGetDatum(relid));
+		entry->ft_hashvalue = GetSysCacheHashValue1(FOREIGNTABLEREL, ObjectIdGetDatum(relid));
+		entry->targets = NULL;
+		entry->stream_targets = NULL;
+		entry->routing_key = NULL;
+		entry->read_attrs = NULL;
+		entry->filters = NIL;
+		entry->filter_cxt = NULL;
+		entry->pool_targets = NULL;
+	}
+
+	if (entry->valid && strcmp(entry->stream_targets, targets) == 0)
+		return entry;
+
+	entry->valid = false;
+	invals = stream_insert_info_invals;
+
+	key = stream->rd_rel->relkind == RELKIND_STREAM ? get_stream_routing_key(stream) : NULL;
+
+	/* inferred streams don't have a fixed set of attributes to prune or filter on */
+	typed = stream->rd_rel->relkind == RELKIND_STREAM && !is_inferred_stream_relation(stream);
+	readers = get_stream_readers(relid, typed, &prunable, &read_attrs);
+
+	if (typed)
+		filters = get_stream_filters(stream, readers);
+
+	pool_targets = get_stream_pool_targets(readers);
+
+	if (entry->targets)
+		bms_free(entry->targets);
+	if (entry->stream_targets)
+		pfree(entry->stream_targets);
+	if (entry->routing_key)
+		pfree(entry->routing_key);
+	if (entry->read_attrs)
+		bms_free(entry->read_attrs);
+	if (entry->pool_targets)
+	{
+		for (i = 0; i < GetNumWorkerPools(); i++)
+			bms_free(entry->pool_targets[i]);
+		pfree(entry->pool_targets);
+		entry->pool_targets = NULL;
+	}
+	if (entry->filter_cxt)
+		MemoryContextReset(entry->filter_cxt);
+	else
+		entry->filter_cxt = AllocSetContextCreate(CacheMemoryContext, "StreamFilterContext",
+				ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+
+	old = MemoryContextSwitchTo(CacheMemoryContext);
+
+	entry->targets = bms_copy(readers);
+	entry->stream_targets = pstrdup(targets);
+	entry->routing_key = key ? pstrdup(key) : NULL;
+	entry->prunable = prunable;
+	entry->read_attrs = bms_copy(read_attrs);
+
+	if (pool_targets)
+	{
+		entry->pool_targets = palloc(sizeof(Bitmapset *) * GetNumWorkerPools());
+		for (i = 0; i < GetNumWorkerPools(); i++)
+			entry->pool_targets[i] = bms_copy(pool_targets[i]);
+	}
+
+	MemoryContextSwitchTo(entry->filter_cxt);
+
+	entry->filters = NIL;
+	foreach(lc, filters)
+	{
+		StreamQueryFilter *filter = (StreamQueryFilter *) lfirst(lc);
+		StreamQueryFilter *copy = palloc(sizeof(StreamQueryFilter));
+
+		copy->id = filter->id;
+		copy->quals = copyObject(filter->quals);
+		entry->filters = lappend(entry->filters, copy);
+	}
+
+	MemoryContextSwitchTo(old);
+
+	bms_free(readers);
+	bms_free(read_attrs);
+
+	if (pool_targets)
+	{
+		for (i = 0; i < GetNumWorkerPools(); i++)
+			bms_free(pool_targets[i]);
+		pfree(pool_targets);
+	}
+
+	/* if anything was invalidated while we were reading the catalogs, rebuild it next time */
+	entry->valid = (invals == stream_insert_info_invals);
+
+	return entry;
+}
+
+/*
+ * GetStreamInsertTargets
+ *
+ * Get the queries the local backend should write the given stream's events to. The
+ * result is a copy of a cached bitmapset, so it may be modified or freed by the caller.
+ */
+Bitmapset *
+GetStreamInsertTargets(Relation stream)
+{
+	return bms_copy(get_stream_insert_info(stream)->targets);
+}
+
+/*
+ * GetStreamPoolTargets
+ *
+ * Get the local backend's targets for the given stream in each worker pool, indexed by pool id,
+ * or NULL if they're all in the default pool. Like GetStreamInsertTargets, the result is a copy.
+ */
+Bitmapset **
+GetStreamPoolTargets(Relation stream)
+{
+	StreamInsertInfo *info = get_stream_insert_info(stream);
+	Bitmapset **result;
+	int i;
+
+	if (info->pool_targets == NULL)
+		return NULL;
+
+	result = palloc(sizeof(Bitmapset *) * GetNumWorkerPools());
+	for (i = 0; i < GetNumWorkerPools(); i++)
+		result[i] = bms_copy(info->pool_targets[i]);
+
+	return result;
+}
+
+/*
+ * BeginStreamFilter
+ *
+ * Prepare to evaluate the simple WHERE clauses of the given targets on events described by desc.
+ * Returns NULL if none of the targets can be filtered this way.
+ */
+StreamFilterState *
+BeginStreamFilter(Relation stream, TupleDesc desc, Bitmapset *targets)
+{
+	StreamInsertInfo *info = get_stream_insert_info(stream);
+	TupleDesc reldesc = RelationGetDescr(stream);
+	StreamFilterState *state;
+	MemoryContext old;
+	ListCell *lc;
+	int i;
+
+	if (info->filters == NIL)
+		return NULL;
+
+	/* filters refer to the stream's attributes by number, so events must be laid out the same way */
+	if (desc->natts != reldesc->natts)
+		return NULL;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (desc->attrs[i]->atttypid != reldesc->attrs[i]->atttypid)
+			return NULL;
+	}
+
+	state = palloc0(sizeof(StreamFilterState));
+	state->cxt = AllocSetContextCreate(CurrentMemoryContext, "StreamFilterState",
+			ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+
+	old = MemoryContextSwitchTo(state->cxt);
+
+	state->econtext = CreateStandaloneExprContext();
+	state->slot = MakeSingleTupleTableSlot(desc);
+	state->targets = bms_copy(targets);
+	state->ids = palloc(sizeof(int) * list_length(info->filters));
+	state->quals = palloc(sizeof(List *) * list_length(info->filters));
+
+	foreach(lc, info->filters)
+	{
+		StreamQueryFilter *filter = (StreamQueryFilter *) lfirst(lc);
+
+		if (!bms_is_member(filter->id, targets))
+			continue;
+
+		state->ids[state->nfilters] = filter->id;
+		state->quals[state->nfilters] = (List *) ExecInitExpr((Expr *) filter->quals, NULL);
+		state->nfilters++;
+	}
+
+	MemoryContextSwitchTo(old);
+
+	if (!state->nfilters)
+	{
+		EndStreamFilter(state);
+		return NULL;
+	}
+
+	return state;
+}
+
+/*
+ * StreamFilterTargets
+ *
+ * Get the targets that may want the given event. The result is allocated in the caller's memory
+ * context and is NULL if no target wants the event.
+ */
+Bitmapset *
+StreamFilterTargets(StreamFilterState *state, HeapTuple tup)
+{
+	Bitmapset *result = bms_copy(state->targets);
+	MemoryContext old;
+	int i;
+
+	ExecStoreTuple(tup, state->slot, InvalidBuffer, false);
+	state->econtext->ecxt_scantuple = state->slot;
+
+	old = MemoryContextSwitchTo(state->econtext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < state->nfilters; i++)
+	{
+		if (!ExecQual(state->quals[i], state->econtext, false))
+			result = bms_del_member(result, state->ids[i]);
+	}
+
+	MemoryContextSwitchTo(old);
+
+	ResetExprContext(state->econtext);
+	ExecClearTuple(state->slot);
+
+	if (bms_is_empty(result))
+	{
+		bms_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+/*
+ * EndStreamFilter
+ */
+void
+EndStreamFilter(StreamFilterState *state)
+{
+	FreeExprContext(state->econtext, true);
+	ExecDropSingleTupleTableSlot(state->slot);
+	MemoryContextDelete(state->cxt);
+	pfree(state);
+}
+
+/*
+ * GetStreamReadDesc
+ *
+ * Get the subset of the given stream event descriptor that is read by any of the stream's readers,
+ * so that unread columns can be stripped from events before they're written to worker queues. Workers
+ * map event attributes to the attributes they read by name, so they never see the difference. The
+ * routing key is always kept since events are routed after being pruned. Returns NULL if nothing
+ * can be pruned.
+ */
+TupleDesc
+GetStreamReadDesc(Relation stream, TupleDesc desc)
+{
+	StreamInsertInfo *info = get_stream_insert_info(stream);
+	TupleDesc reldesc = RelationGetDescr(stream);
+	TupleDesc result;
+	bool *keep;
+	int nkeep = 0;
+	int i;
+	int j;
+
+	if (!info->prunable)
+		return NULL;
+
+	keep = palloc0(sizeof(bool) * desc->natts);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		char *name = NameStr(desc->attrs[i]->attname);
+
+		/* keep anything we don't know about */
+		keep[i] = true;
+
+		if (info->routing_key && pg_strcasecmp(name, info->routing_key) == 0)
+			continue;
+
+		for (j = 0; j < reldesc->natts; j++)
+		{
+			if (strcmp(NameStr(reldesc->attrs[j]->attname), name) == 0)
+			{
+				keep[i] = bms_is_member(j + 1 - FirstLowInvalidHeapAttributeNumber, info->read_attrs);
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < desc->natts; i++)
+		if (keep[i])
+			nkeep++;
+
+	if (nkeep == desc->natts)
+	{
+		pfree(keep);
+		return NULL;
+	}
+
+	result = CreateTemplateTupleDesc(nkeep, false);
+
+	for (i = 0, j = 0; i < desc->natts; i++)
+	{
+		if (keep[i])
+			TupleDescCopyEntry(result, ++j, desc, i + 1);
+	}
+
+	pfree(keep);
+
+	return result;
+}
+
+/*
+ * GetStreamRoutingAttr
+ *
+ * Get the attribute of desc named by the stream's routing_key option, or InvalidAttrNumber if
+ * the stream doesn't have one
+ */
+AttrNumber
+GetStreamRoutingAttr(Relation stream, TupleDesc desc)
+{
+	char *key = get_stream_insert_info(stream)->routing_key;
+	int i;
+
+	if (key == NULL)
+		return InvalidAttrNumber;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (pg_strcasecmp(NameStr(desc->attrs[i]->attname), key) == 0)
+			return i + 1;
+	}
+
+	/* Inferred streams may not have the routing key column in every insert */
+	return InvalidAttrNumber;
+}
+
+/*
+ * GetStreamRoutingWorker
+ *
+ * Get the worker of the given pool that the given tuple should be routed to based on the hash of its
+ * routing key. Tuples with a NULL key all go to the pool's first worker.
+ */
+int
+GetStreamRoutingWorker(int pool, TupleDesc desc, AttrNumber attno, HeapTuple tup)
+{
+	TypeCacheEntry *typ = lookup_type_cache(desc->attrs[attno - 1]->atttypid, 0);
+	StringInfoData buf;
+	bool isnull;
+	Datum d = heap_getattr(tup, attno, desc, &isnull);
+	int first;
+	int nworkers;
+	int worker;
+
+	GetWorkerPoolWorkers(pool, &first, &nworkers);
+
+	if (isnull)
+		return first;
+
+	initStringInfo(&buf);
+	DatumToBytes(d, typ, &buf);
+	worker = first + FastHash64(buf.data, buf.len, HASH_SEED) % nworkers;
+	pfree(buf.data);
+
+	return worker;
+}
+
+/*
+ * route_tuples
+ *
+ * Partition tuples by their routing worker so that tuples with equal keys are always written
+ * to the same worker. Returns the routed tuples grouped by worker, with counts giving the number
+ * of tuples for each worker.
+ */
+static HeapTuple *
+route_tuples(int pool, TupleDesc desc, AttrNumber attno, HeapTuple *tuples, int ntuples, int *counts)
+{
+	HeapTuple *routed = palloc(sizeof(HeapTuple) * ntuples);
+	int *workers = palloc(sizeof(int) * ntuples);
+	int nworkers = GetDatabaseNumWorkers();
+	int *offsets = palloc0(sizeof(int) * nworkers);
+	int i;
+
+	MemSet(counts, 0, sizeof(int) * nworkers);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		workers[i] = GetStreamRoutingWorker(pool, desc, attno, tuples[i]);
+		counts[workers[i]]++;
+	}
+
+	for (i = 1; i < nworkers; i++)
+		offsets[i] = offsets[i - 1] + counts[i - 1];
+
+	for (i = 0; i < ntuples; i++)
+		routed[offsets[workers[i]]++] = tuples[i];
+
+	pfree(workers);
+	pfree(offsets);
+
+	return routed;
+}
+
+/*
+ * send_to_workers
+ *
+ * Write tuples that all have the same targets to the given pool's worker queues, routing them if necessary
+ */
+static uint64
+send_to_workers(int pool, Oid relid, TupleDesc desc, bytea *packed_desc, bool batchable, AttrNumber attno,
+		Bitmapset *targets, HeapTuple *tuples, int ntuples, InsertBatchAck *acks, int nacks, int *nbatches)
+{
+	uint64 size = 0;
+
+	if (AttributeNumberIsValid(attno))
+	{
+		int nworkers = GetDatabaseNumWorkers();
+		int *counts = palloc(sizeof(int) * nworkers);
+		HeapTuple *routed = route_tuples(pool, desc, attno, tuples, ntuples, counts);
+		int offset = 0;
+		int i;
+
+		*nbatches = 0;
+
+		for (i = 0; i < nworkers; i++)
+		{
+			int n;
+
+			if (!counts[i])
+				continue;
+
+			size += send_tuples(pool, i, relid, desc, packed_desc, batchable, targets, &routed[offset], counts[i],
+					acks, nacks, &n);
+			*nbatches += n;
+			offset += counts[i];
+		}
+
+		pfree(routed);
+		pfree(counts);
+	}
+	else
+		size = send_tuples(pool, -1, relid, desc, packed_desc, batchable, targets, tuples, ntuples, acks, nacks, nbatches);
+
+	return size;
+}
+
+/*
+ * send_to_pools
+ *
+ * Write tuples that all have the same targets to the workers of each pool that any of those targets
+ * are pinned to. Each pool's workers ack the tuples written to them, so synchronous inserts are told
+ * to expect an extra ack for each additional pool.
+ */
+static uint64
+send_to_pools(Bitmapset **pool_targets, Oid relid, TupleDesc desc, bytea *packed_desc, bool batchable,
+		AttrNumber attno, Bitmapset *targets, HeapTuple *tuples, int ntuples, InsertBatchAck *acks, int nacks,
+		int *nbatches)
+{
+	uint64 size = 0;
+	int npools = 0;
+	int pool;
+
+	if (pool_targets == NULL)
+		return send_to_workers(DEFAULT_WORKER_POOL, relid, desc, packed_desc, batchable, attno, targets, tuples, ntuples,
+				acks, nacks, nbatches);
+
+	*nbatches = 0;
+
+	for (pool = 0; pool < GetNumWorkerPools(); pool++)
+	{
+		Bitmapset *ptargets = bms_intersect(targets, pool_targets[pool]);
+		int nb;
+
+		if (bms_is_empty(ptargets))
+			continue;
+
+		if (npools++)
+		{
+			int i;
+
+			for (i = 0; i < nacks; i++)
+				InsertBatchIncrementNumWTuples(acks[i].batch, ntuples);
+		}
+
+		size += send_to_workers(pool, relid, desc, packed_desc, batchable, attno, ptargets, tuples, ntuples,
+				acks, nacks, &nb);
+		*nbatches += nb;
+
+		bms_free(ptargets);
+	}
+
+	return size;
+}
+
 uint64
 SendTuplesToContWorkers(Relation stream, TupleDesc desc, HeapTuple *tuples,
 		int ntuples, InsertBatchAck *acks, int nacks)
 {
-	ipc_queue *ipcq;
-	Bitmapset *targets = GetLocalStreamReaders(RelationGetRelid(stream));
+	Bitmapset *targets = GetStreamInsertTargets(stream);
+	Bitmapset **pool_targets = GetStreamPoolTargets(stream);
+	StreamFilterState *filter;
+	StreamJsonState *json;
+	Bitmapset **tuptargets = NULL;
+	HeapTuple *inserted = tuples;
+	HeapTuple *extracted = NULL;
 	bytea *packed_desc;
-	int i;
-	int free;
-	uint64 tail;
-	uint64 head;
-	int nbatches = 1;
+	AttrNumber attno = InvalidAttrNumber;
+	int nbatches = 0;
 	uint64 size = 0;
-	int ninserted;
-	TimestampTz now = GetCurrentTimestamp();
+	bool batchable;
+	TupleDesc read_desc;
+	HeapTuple *pruned = NULL;
+	HeapTuple *sampled = NULL;
+	int i;
+
+	/* Only client inserts are subject to quotas, transforms write events derived from already admitted ones */
+	if (StreamQuotaEnabled() && !IsContQueryProcess())
+	{
+		int n = StreamQuotaAdmit(stream, tuples, ntuples, &sampled);
+
+		if (n < ntuples)
+		{
+			ack_shed_tuples(acks, nacks, ntuples - n);
+			tuples = sampled;
+			ntuples = n;
+		}
+		else
+			sampled = NULL;
+
+		if (ntuples == 0)
+		{
+			bms_free(targets);
+			pfree(sampled);
+			return 0;
+		}
+	}
+
+	/* Events written by continuous transforms are derived from captured ones, so only capture client inserts */
+	if (StreamCaptureEnabled() && !IsContQueryProcess())
+		StreamCaptureTuples(stream, desc, tuples, ntuples);
 
 	/* No reader? Noop. */
 	if (bms_is_empty(targets))
 		return 0;
 
-	packed_desc = PackTupleDesc(desc);
+	ActivateContQueryDatabase();
 
-	ipcq = get_any_worker_queue_with_lock();
-	head = pg_atomic_read_u64(&ipcq->head);
-	tail = pg_atomic_read_u64(&ipcq->tail);
-	free = ipc_queue_free_size(ipcq, head, tail);
-	ninserted = 0;
+	/* Extract declared JSON fields first, so that filters and readers see them like any other column */
+	json = BeginStreamJsonExtract(stream, desc);
+	if (json)
+	{
+		extracted = palloc(sizeof(HeapTuple) * ntuples);
+		for (i = 0; i < ntuples; i++)
+			extracted[i] = StreamJsonExtract(json, tuples[i]);
 
-	Assert(free >= 0);
+		EndStreamJsonExtract(json);
 
-	for (i = 0; i < ntuples; i++)
+		inserted = tuples;
+		tuples = extracted;
+	}
+
+	/* Find out which targets may want each tuple before any columns are stripped */
+	filter = BeginStreamFilter(stream, desc, targets);
+	if (filter)
 	{
-		HeapTuple tup = tuples[i];
-		int len;
-		StreamTupleState *sts = StreamTupleStateCreate(tup, desc, packed_desc, targets, acks, nacks, &len);
-		ipc_queue_slot *slot = ipc_queue_slot_get(ipcq, head);
-		int len_needed = sizeof(ipc_queue_slot) + len;
-		bool needs_wrap = ipc_queue_needs_wrap(ipcq, head, len_needed);
-		char *dest_bytes;
+		tuptargets = palloc(sizeof(Bitmapset *) * ntuples);
+		for (i = 0; i < ntuples; i++)
+			tuptargets[i] = StreamFilterTargets(filter, tuples[i]);
 
-		Assert(IsContQueryWorkerProcess() ? ipcq->consumed_by_broker : true);
-		Assert(tail <= head);
+		EndStreamFilter(filter);
+	}
 
-		if (needs_wrap)
-			len_needed = len + ipcq->size - ipc_queue_offset(ipcq, head);
+	/* Strip columns that none of the readers need */
+	read_desc = GetStreamReadDesc(stream, desc);
+	if (read_desc)
+	{
+		TupleConversionMap *map = convert_tuples_by_name(desc, read_desc,
+				gettext_noop("could not prune stream event"));
 
-		if (free < len_needed)
+		pruned = palloc(sizeof(HeapTuple) * ntuples);
+		for (i = 0; i < ntuples; i++)
+			pruned[i] = do_convert_tuple(tuples[i], map);
+
+		free_conversion_map(map);
+
+		desc = read_desc;
+		tuples = pruned;
+	}
+
+	packed_desc = PackStreamTupleDesc(RelationGetRelid(stream), desc);
+	batchable = desc_is_batchable(desc);
+
+	/*
+	 * Continuous transforms write to their own queues through the broker, which never writes to a
+	 * worker's own queue, so we don't route their output
+	 */
+	if (GetDatabaseNumWorkers() > 1 && !IsContQueryWorkerProcess())
+		attno = GetStreamRoutingAttr(stream, desc);
+
+	if (tuptargets)
+	{
+		/*
+		 * Batched slots share a single set of targets, so write each run of tuples with the same targets
+		 * separately. Tuples that no target wants are never written, so we ack them right away.
+		 */
+		for (i = 0; i < ntuples; )
 		{
-			tail = pg_atomic_read_u64(&ipcq->tail);
-			free = ipc_queue_free_size(ipcq, head, tail);
+			int n = 1;
+
+			while (i + n < ntuples && bms_equal(tuptargets[i], tuptargets[i + n]))
+				n++;
+
+			if (tuptargets[i])
+			{
+				int nb;
+
+				size += send_to_pools(pool_targets, RelationGetRelid(stream), desc, packed_desc, batchable, attno,
+						tuptargets[i], &tuples[i], n, acks, nacks, &nb);
+				nbatches += nb;
+			}
+			else
+				ack_shed_tuples(acks, nacks, n);
+
+			i += n;
 		}
 
-		if (free < len_needed || ninserted >= continuous_query_batch_size)
-		{
-			ipc_queue_update_head(ipcq, head);
-			ipc_queue_unlock(ipcq);
+		for (i = 0; i < ntuples; i++)
+			bms_free(tuptargets[i]);
+		pfree(tuptargets);
+	}
+	else
+		size = send_to_pools(pool_targets, RelationGetRelid(stream), desc, packed_desc, batchable, attno, targets,
+				tuples, ntuples, acks, nacks, &nbatches);
 
-			ipcq = get_any_worker_queue_with_lock();
+	pgstat_increment_stream_insert(RelationGetRelid(stream), ntuples, nbatches, size);
 
-			head = pg_atomic_read_u64(&ipcq->head);
-			tail = pg_atomic_read_u64(&ipcq->tail);
-			free = ipc_queue_free_size(ipcq, head, tail);
+	bms_free(targets);
+	pfree(packed_desc);
 
-			if (ninserted)
-				nbatches++;
+	if (pool_targets)
+	{
+		for (i = 0; i < GetNumWorkerPools(); i++)
+			bms_free(pool_targets[i]);
+		pfree(pool_targets);
+	}
 
-			now = GetCurrentTimestamp();
-			ninserted = 0;
+	if (pruned)
+	{
+		for (i = 0; i < ntuples; i++)
+			heap_freetuple(pruned[i]);
+		pfree(pruned);
+		FreeTupleDesc(read_desc);
+	}
+
+	if (extracted)
+	{
+		for (i = 0; i < ntuples; i++)
+			if (extracted[i] != inserted[i])
+				heap_freetuple(extracted[i]);
+		pfree(extracted);
+	}
 
-			/* retry this tuple */
-			i--;
+	if (sampled)
+		pfree(sampled);
 
-			continue;
+	return size;
+}
+
+/*
+ * FuseTuplesIntoContExecutor
+ *
+ * Hand tuples that a continuous transform running on the given worker writes to a stream directly to the
+ * stream's readers, which then read them later in the same batch instead of going through another queue.
+ * That's only possible when none of the readers are pinned to a worker pool and none of them have executed
+ * in the batch yet. Returns false without doing anything otherwise, in which case the tuples should be sent
+ * with SendTuplesToContWorkers.
+ */
+bool
+FuseTuplesIntoContExecutor(ContExecutor *exec, Relation stream, TupleDesc desc, HeapTuple *tuples,
+		int ntuples, InsertBatchAck *acks, int nacks)
+{
+	MemoryContext old;
+	Bitmapset *targets;
+	Bitmapset **pool_targets;
+	Bitmapset **tuptargets;
+	HeapTuple *fused;
+	StreamFilterState *filter;
+	StreamJsonState *json;
+	int nfused = 0;
+	int i;
+
+	targets = GetStreamInsertTargets(stream);
+	pool_targets = GetStreamPoolTargets(stream);
+
+	if (pool_targets || !ContExecutorCanFuse(exec, targets))
+	{
+		if (pool_targets)
+		{
+			for (i = 0; i < GetNumWorkerPools(); i++)
+				bms_free(pool_targets[i]);
+			pfree(pool_targets);
 		}
+		bms_free(targets);
+		return false;
+	}
 
-		size += len;
-		ninserted++;
+	/* fused tuples are read until the end of the batch, so they're kept in its context */
+	old = MemoryContextSwitchTo(exec->exec_cxt);
 
-		free -= len_needed;
-		head += len_needed;
+	fused = palloc(sizeof(HeapTuple) * ntuples);
+	tuptargets = palloc(sizeof(Bitmapset *) * ntuples);
 
-		slot->time = now;
-		slot->len = len;
-		slot->peeked = false;
-		slot->wraps = needs_wrap;
-		slot->next = head;
+	json = BeginStreamJsonExtract(stream, desc);
+	filter = BeginStreamFilter(stream, desc, targets);
 
-		dest_bytes = needs_wrap ? ipcq->bytes : slot->bytes;
-		ipc_queue_check_overflow(ipcq, dest_bytes, len);
+	for (i = 0; i < ntuples; i++)
+	{
+		HeapTuple tup = json ? StreamJsonExtract(json, tuples[i]) : tuples[i];
+		Bitmapset *t = filter ? StreamFilterTargets(filter, tup) : targets;
 
-		StreamTupleStateCopyFn(dest_bytes, sts, len);
+		/* tuples that no target wants are never read, so we ack them right away */
+		if (bms_is_empty(t))
+		{
+			ack_shed_tuples(acks, nacks, 1);
+			continue;
+		}
 
-		if (sts->record_descs)
-			pfree(sts->record_descs);
-		pfree(sts);
+		fused[nfused] = tup;
+		tuptargets[nfused] = t;
+		nfused++;
 	}
 
-	ipc_queue_update_head(ipcq, head);
-	ipc_queue_unlock(ipcq);
+	if (json)
+		EndStreamJsonExtract(json);
+	if (filter)
+		EndStreamFilter(filter);
 
-	pgstat_increment_stream_insert(RelationGetRelid(stream), ntuples, nbatches, size);
+	if (nfused)
+		ContExecutorFuseTuples(exec, RelationGetRelid(stream), PackStreamTupleDesc(RelationGetRelid(stream), desc),
+				fused, tuptargets, nfused, acks, nacks);
 
-	bms_free(targets);
-	pfree(packed_desc);
+	pgstat_increment_stream_insert(RelationGetRelid(stream), ntuples, 0, 0);
 
-	return size;
+	MemoryContextSwitchTo(old);
+
+	return true;
 }
 
 /*
@@ -171,8 +1843,13 @@ CopyIntoStream(Relation stream, TupleDesc desc, HeapTuple *tuples, int ntuples)
 {
 	InsertBatchAck *ack = NULL;
 	InsertBatch *batch = NULL;
-	bool snap = ActiveSnapshotSet();
+	bool snap;
+
+	/* a batch written by an earlier statement is dropped as a whole */
+	if (!StreamBatchClaim())
+		return;
 
+	snap = ActiveSnapshotSet();
 	if (snap)
 		PopActiveSnapshot();
 
@@ -182,14 +1859,27 @@ CopyIntoStream(Relation stream, TupleDesc desc, HeapTuple *tuples, int ntuples)
 		ack = palloc0(sizeof(InsertBatchAck));
 		ack->batch_id = batch->id;
 		ack->batch = batch;
+		ack->client_batch_id = StreamBatchCurrentId();
 	}
 
 	SendTuplesToContWorkers(stream, desc, tuples, ntuples, ack, ack ? 1 : 0);
 
 	if (batch)
 	{
+		StreamLogWriter *log = StreamLogBeginWrite(stream, desc, batch, ack->client_batch_id);
+
 		pfree(ack);
-		InsertBatchWaitAndRemove(batch, ntuples);
+
+		if (log)
+		{
+			int i;
+
+			for (i = 0; i < ntuples; i++)
+				StreamLogWriteTuple(log, tuples[i]);
+			StreamLogEndWrite(log, ntuples);
+		}
+		else
+			InsertBatchWaitOrDefer(batch, ntuples);
 	}
 
 	if (snap)
@@ -256,3 +1946,208 @@ pipeline_stream_insert(PG_FUNCTION_ARGS)
 
 	return PointerGetDatum(tup);
 }
+
+/*
+ * Rows buffered by pipeline_stream_insert_batch, per trigger
+ */
+typedef struct StreamInsertBuffer
+{
+	Oid trigid;
+	Oid relid;
+	int nstreams;
+	char **streams;
+	TupleDesc desc;
+	HeapTuple *tups;
+	int ntups;
+} StreamInsertBuffer;
+
+static List *stream_insert_buffers = NIL;
+static MemoryContext stream_insert_buffer_cxt = NULL;
+static bool stream_insert_callback_registered = false;
+
+/*
+ * flush_stream_insert_buffer
+ *
+ * Send all rows buffered for a trigger to each of its streams as a single batch
+ */
+static void
+flush_stream_insert_buffer(StreamInsertBuffer *buf)
+{
+	int i;
+
+	if (!buf->ntups)
+		return;
+
+	for (i = 0; i < buf->nstreams; i++)
+	{
+		RangeVar *stream = makeRangeVarFromNameList(textToQualifiedNameList(cstring_to_text(buf->streams[i])));
+		Relation rel = heap_openrv(stream, AccessShareLock);
+
+		SendTuplesToContWorkers(rel, buf->desc, buf->tups, buf->ntups, NULL, 0);
+
+		heap_close(rel, AccessShareLock);
+	}
+
+	for (i = 0; i < buf->ntups; i++)
+		heap_freetuple(buf->tups[i]);
+
+	buf->ntups = 0;
+}
+
+/*
+ * flush_stream_insert_buffers
+ *
+ * Flush the buffers of all triggers on the given relation, or of all triggers if relid is invalid
+ */
+static void
+flush_stream_insert_buffers(Oid relid)
+{
+	ListCell *lc;
+
+	foreach(lc, stream_insert_buffers)
+	{
+		StreamInsertBuffer *buf = (StreamInsertBuffer *) lfirst(lc);
+
+		if (!OidIsValid(relid) || buf->relid == relid)
+			flush_stream_insert_buffer(buf);
+	}
+}
+
+/*
+ * stream_insert_xact_callback
+ *
+ * Rows still buffered at commit are flushed before the transaction commits. The buffers live in the
+ * transaction's memory, so they're just forgotten once it ends.
+ */
+static void
+stream_insert_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PARALLEL_PRE_COMMIT:
+			flush_stream_insert_buffers(InvalidOid);
+			break;
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+			stream_insert_buffers = NIL;
+			stream_insert_buffer_cxt = NULL;
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * get_stream_insert_buffer
+ */
+static StreamInsertBuffer *
+get_stream_insert_buffer(TriggerData *trigdata)
+{
+	Trigger *trig = trigdata->tg_trigger;
+	StreamInsertBuffer *buf;
+	MemoryContext old;
+	ListCell *lc;
+	int i;
+
+	foreach(lc, stream_insert_buffers)
+	{
+		buf = (StreamInsertBuffer *) lfirst(lc);
+		if (buf->trigid == trig->tgoid)
+			return buf;
+	}
+
+	if (!stream_insert_callback_registered)
+	{
+		RegisterXactCallback(stream_insert_xact_callback, NULL);
+		stream_insert_callback_registered = true;
+	}
+
+	if (stream_insert_buffer_cxt == NULL)
+		stream_insert_buffer_cxt = AllocSetContextCreate(TopTransactionContext, "StreamInsertBufferContext",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+
+	old = MemoryContextSwitchTo(stream_insert_buffer_cxt);
+
+	buf = palloc0(sizeof(StreamInsertBuffer));
+	buf->trigid = trig->tgoid;
+	buf->relid = RelationGetRelid(trigdata->tg_relation);
+	buf->desc = CreateTupleDescCopy(RelationGetDescr(trigdata->tg_relation));
+	buf->tups = palloc(sizeof(HeapTuple) * continuous_query_batch_size);
+	buf->nstreams = trig->tgnargs;
+	buf->streams = palloc(sizeof(char *) * trig->tgnargs);
+
+	for (i = 0; i < trig->tgnargs; i++)
+		buf->streams[i] = pstrdup(trig->tgargs[i]);
+
+	stream_insert_buffers = lappend(stream_insert_buffers, buf);
+
+	MemoryContextSwitchTo(old);
+
+	return buf;
+}
+
+/*
+ * pipeline_stream_insert_batch
+ *
+ * Batching variant of pipeline_stream_insert. As a row level trigger it buffers rows and sends them to
+ * its streams in batches of up to continuous_query_batch_size rows, so each batch only locks a worker
+ * queue and packs the row descriptor once. Remaining rows are flushed when a statement level trigger
+ * using this function fires on the same relation, or at the latest when the transaction commits.
+ */
+Datum
+pipeline_stream_insert_batch(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	StreamInsertBuffer *buf;
+	MemoryContext old;
+	HeapTuple tup;
+
+	/* make sure it's called as a trigger */
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+				 errmsg("pipeline_stream_insert_batch: must be called as trigger")));
+
+	if (trigdata->tg_trigger->tgnargs < 1)
+		elog(ERROR, "pipeline_stream_insert_batch: must be provided a stream name");
+
+	/* and that it's called on update or insert */
+	if (!TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) && !TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+				 errmsg("pipeline_stream_insert_batch: must be called on insert or update")));
+
+	/* and that it's called after insert or update */
+	if (!TRIGGER_FIRED_AFTER(trigdata->tg_event))
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+				 errmsg("pipeline_stream_insert_batch: must be called after insert or update")));
+
+	/* statement level triggers flush whatever the row level triggers buffered */
+	if (TRIGGER_FIRED_FOR_STATEMENT(trigdata->tg_event))
+	{
+		flush_stream_insert_buffers(RelationGetRelid(trigdata->tg_relation));
+		return PointerGetDatum(NULL);
+	}
+
+	if (TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event))
+		tup = trigdata->tg_newtuple;
+	else
+		tup = trigdata->tg_trigtuple;
+
+	buf = get_stream_insert_buffer(trigdata);
+
+	old = MemoryContextSwitchTo(stream_insert_buffer_cxt);
+	buf->tups[buf->ntups++] = heap_copytuple(tup);
+	MemoryContextSwitchTo(old);
+
+	if (buf->ntups == continuous_query_batch_size)
+		flush_stream_insert_buffer(buf);
+
+	return PointerGetDatum(tup);
+}
@@ -0,0 +1,233 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_batch.c
+ *
+ *	  Dropping stream batches that were already written
+ *
+ * Stream writes made while stream_insert_batch_id is set form a batch with
+ * that id, and a later write of a batch with the same id is dropped, so that
+ * clients may retry a batch whose synchronous insert timed out without its
+ * events being counted twice.
+ *
+ * A batch is detected as a duplicate in one of two ways. The first statement
+ * to write it claims its id here, in a fixed number of shared slots that are
+ * reused oldest first, which catches retries of a batch that's still being
+ * consumed. Every combiner also records the ids of the batches it combined
+ * in pipeline_stream_batch, in the transaction committing their results to
+ * matrels, which catches retries of a batch whose claim has been reused or
+ * was lost in a restart. Each combiner removes its records once they're older
+ * than stream_insert_batch_id_retention.
+ *
+ * Batch ids travel with each event's InsertBatchAck, so they can only be used
+ * along with synchronous_stream_insert.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/stream_batch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "catalog/pipeline_stream_batch_fn.h"
+#include "miscadmin.h"
+#include "pipeline/cont_scheduler.h"
+#include "pipeline/stream.h"
+#include "pipeline/stream_batch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/int8.h"
+
+/* guc parameters */
+char *stream_insert_batch_id = NULL;
+int stream_insert_batch_id_retention;
+
+typedef struct StreamBatchKey
+{
+	Oid dbid;
+	int64 id;
+} StreamBatchKey;
+
+typedef struct StreamBatchClaimEntry
+{
+	StreamBatchKey key; /* hash key --- MUST BE FIRST */
+	int slot;
+} StreamBatchClaimEntry;
+
+typedef struct StreamBatchClaims
+{
+	int hand;
+	bool used[STREAM_BATCH_CLAIMS];
+	StreamBatchKey slots[STREAM_BATCH_CLAIMS];
+} StreamBatchClaims;
+
+static StreamBatchClaims *Claims = NULL;
+static HTAB *ClaimsLookup = NULL;
+
+/* the parsed value of stream_insert_batch_id, 0 if it isn't set */
+static int64 current_batch_id = 0;
+
+/* the batch this backend last claimed, which the rest of the same statement may keep writing */
+static int64 claimed_batch_id = 0;
+static TimestampTz claimed_at = 0;
+
+/*
+ * check_stream_insert_batch_id
+ */
+bool
+check_stream_insert_batch_id(char **newval, void **extra, GucSource source)
+{
+	int64 id;
+
+	if (*newval == NULL || **newval == '\0')
+		return true;
+
+	if (!scanint8(*newval, true, &id) || id <= 0)
+	{
+		GUC_check_errdetail("Stream batch ids must be positive bigints.");
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * assign_stream_insert_batch_id
+ */
+void
+assign_stream_insert_batch_id(const char *newval, void *extra)
+{
+	current_batch_id = 0;
+
+	if (newval && *newval)
+		scanint8(newval, true, &current_batch_id);
+}
+
+/*
+ * StreamBatchShmemSize
+ */
+Size
+StreamBatchShmemSize(void)
+{
+	return add_size(sizeof(StreamBatchClaims), hash_estimate_size(STREAM_BATCH_CLAIMS, sizeof(StreamBatchClaimEntry)));
+}
+
+/*
+ * StreamBatchShmemInit
+ */
+void
+StreamBatchShmemInit(void)
+{
+	HASHCTL ctl;
+	bool found;
+
+	Claims = ShmemInitStruct("StreamBatchClaims", sizeof(StreamBatchClaims), &found);
+
+	if (!found)
+		MemSet(Claims, 0, sizeof(StreamBatchClaims));
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(StreamBatchKey);
+	ctl.entrysize = sizeof(StreamBatchClaimEntry);
+
+	ClaimsLookup = ShmemInitHash("StreamBatchClaimsLookup", STREAM_BATCH_CLAIMS, STREAM_BATCH_CLAIMS,
+			&ctl, HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * StreamBatchCurrentId
+ *
+ * Returns the id of the batch stream writes are currently part of, or 0 if they aren't part of one.
+ * Continuous queries writing to streams never are.
+ */
+int64
+StreamBatchCurrentId(void)
+{
+	if (IsContQueryProcess())
+		return 0;
+
+	return current_batch_id;
+}
+
+/*
+ * claim
+ *
+ * Claims the given batch id for this database, returning false if it's already claimed
+ */
+static bool
+claim(int64 id)
+{
+	StreamBatchKey key;
+	StreamBatchClaimEntry *entry;
+	bool found;
+
+	MemSet(&key, 0, sizeof(StreamBatchKey));
+	key.dbid = MyDatabaseId;
+	key.id = id;
+
+	LWLockAcquire(StreamBatchClaimLock, LW_EXCLUSIVE);
+
+	entry = (StreamBatchClaimEntry *) hash_search(ClaimsLookup, &key, HASH_FIND, NULL);
+	if (entry)
+	{
+		LWLockRelease(StreamBatchClaimLock);
+		return false;
+	}
+
+	/* the oldest claim gives way */
+	if (Claims->used[Claims->hand])
+		hash_search(ClaimsLookup, &Claims->slots[Claims->hand], HASH_REMOVE, NULL);
+
+	entry = (StreamBatchClaimEntry *) hash_search(ClaimsLookup, &key, HASH_ENTER, &found);
+	Assert(!found);
+
+	entry->slot = Claims->hand;
+	Claims->slots[Claims->hand] = key;
+	Claims->used[Claims->hand] = true;
+	Claims->hand = (Claims->hand + 1) % STREAM_BATCH_CLAIMS;
+
+	LWLockRelease(StreamBatchClaimLock);
+
+	return true;
+}
+
+/*
+ * StreamBatchClaim
+ *
+ * Called before a stream write sends any events. Returns false if the write is part of a batch that was
+ * already written by an earlier statement, in which case it must be dropped.
+ */
+bool
+StreamBatchClaim(void)
+{
+	int64 id = StreamBatchCurrentId();
+	TimestampTz now = GetCurrentStatementStartTimestamp();
+
+	if (id == 0)
+		return true;
+
+	if (!synchronous_stream_insert)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("stream_insert_batch_id can only be used with synchronous_stream_insert")));
+
+	if (id == claimed_batch_id && now == claimed_at)
+		return true;
+
+	/*
+	 * We claim the id before looking for it in pipeline_stream_batch, so that a batch can only be written
+	 * twice if STREAM_BATCH_CLAIMS newer batches are claimed before its results are committed
+	 */
+	if (!claim(id) || StreamBatchIsRecorded(id, ANY_COMBINER))
+	{
+		elog(DEBUG1, "dropping already written stream batch " INT64_FORMAT, id);
+		return false;
+	}
+
+	claimed_batch_id = id;
+	claimed_at = now;
+
+	return true;
+}
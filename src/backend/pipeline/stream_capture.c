@@ -0,0 +1,249 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_capture.c
+ *
+ *	  Capture of the events inserted into streams, for replaying them later
+ *
+ * Each backend that inserts into streams while stream_capture_directory is set appends the batches
+ * it inserts to its own capture file in that directory. A capture file starts with
+ * STREAM_CAPTURE_MAGIC and an int32 version, followed by one record per batch:
+ *
+ *   int64   time the batch was inserted, in microseconds since the PostgreSQL epoch
+ *   int16   length of the quoted, qualified stream name, followed by the name
+ *   int16   number of columns, each followed by the int16 length of its quoted name and the name
+ *   int32   number of events
+ *   int32   length of the events that follow
+ *
+ * Events are encoded as tuples of COPY ... WITH (FORMAT binary), so they can be written to a stream
+ * by wrapping them in a binary COPY header and trailer, see bin/replay-capture. All integers are in
+ * network byte order.
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * src/backend/pipeline/stream_capture.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "fmgr.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "pipeline/stream.h"
+#include "pipeline/stream_capture.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/timestamp.h"
+
+/* guc parameter */
+char *stream_capture_directory = NULL;
+
+static int capture_fd = -1;
+
+/* Directory capture_fd was opened in, or that we failed to open it in */
+static char *capture_dir = NULL;
+
+/*
+ * write_capture
+ *
+ * Write all of the given bytes to the capture file, giving up on capturing if we can't
+ */
+static bool
+write_capture(char *data, int len)
+{
+	if (write(capture_fd, data, len) != len)
+	{
+		elog(WARNING, "could not write to stream capture file in \"%s\": %m", capture_dir);
+		close(capture_fd);
+		capture_fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * open_capture_file
+ *
+ * Make sure this backend's capture file in stream_capture_directory is open, creating the directory
+ * if needed. If that fails we don't retry until stream_capture_directory changes.
+ */
+static bool
+open_capture_file(void)
+{
+	char path[MAXPGPATH];
+	StringInfoData buf;
+	bool result;
+
+	if (capture_dir && strcmp(capture_dir, stream_capture_directory) == 0)
+		return capture_fd >= 0;
+
+	if (capture_fd >= 0)
+		close(capture_fd);
+	capture_fd = -1;
+
+	if (capture_dir)
+		pfree(capture_dir);
+	capture_dir = MemoryContextStrdup(TopMemoryContext, stream_capture_directory);
+
+	if (mkdir(capture_dir, S_IRWXU) < 0 && errno != EEXIST)
+	{
+		elog(WARNING, "could not create stream capture directory \"%s\": %m", capture_dir);
+		return false;
+	}
+
+	snprintf(path, MAXPGPATH, "%s/%d.%ld" STREAM_CAPTURE_SUFFIX, capture_dir, MyProcPid, (long) MyStartTime);
+
+	capture_fd = BasicOpenFile(path, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY, S_IRUSR | S_IWUSR);
+	if (capture_fd < 0)
+	{
+		elog(WARNING, "could not open stream capture file \"%s\": %m", path);
+		return false;
+	}
+
+	initStringInfo(&buf);
+	pq_sendbytes(&buf, STREAM_CAPTURE_MAGIC, strlen(STREAM_CAPTURE_MAGIC));
+	pq_sendint(&buf, STREAM_CAPTURE_VERSION, 4);
+
+	result = write_capture(buf.data, buf.len);
+	pfree(buf.data);
+
+	return result;
+}
+
+static void
+send_string(StringInfo buf, const char *s)
+{
+	int len = strlen(s);
+
+	pq_sendint(buf, len, 2);
+	pq_sendbytes(buf, s, len);
+}
+
+/*
+ * StreamCaptureTuples
+ *
+ * Append a batch of events inserted into the given stream to this backend's capture file. arrival_timestamp
+ * isn't captured, since replayed events get a new one. Failing to capture never fails the insert.
+ */
+void
+StreamCaptureTuples(Relation stream, TupleDesc desc, HeapTuple *tuples, int ntuples)
+{
+	MemoryContext cxt;
+	MemoryContext old;
+	StringInfoData buf;
+	FmgrInfo *send;
+	bool *captured;
+	Datum *values;
+	bool *nulls;
+	uint32 len;
+	int lenpos;
+	int natts = 0;
+	int i;
+	int j;
+
+	Assert(StreamCaptureEnabled());
+
+	if (!ntuples || !open_capture_file())
+		return;
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext, "StreamCaptureCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	old = MemoryContextSwitchTo(cxt);
+
+	send = palloc0(sizeof(FmgrInfo) * desc->natts);
+	captured = palloc0(sizeof(bool) * desc->natts);
+	values = palloc(sizeof(Datum) * desc->natts);
+	nulls = palloc(sizeof(bool) * desc->natts);
+
+	initStringInfo(&buf);
+	pq_sendint64(&buf, GetCurrentTimestamp());
+	send_string(&buf, quote_qualified_identifier(get_namespace_name(RelationGetNamespace(stream)),
+			RelationGetRelationName(stream)));
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute attr = desc->attrs[i];
+		int16 typlen;
+		bool typbyval;
+		char typalign;
+		char typdelim;
+		Oid typioparam;
+		Oid typsend;
+
+		if (attr->attisdropped || pg_strcasecmp(NameStr(attr->attname), ARRIVAL_TIMESTAMP) == 0)
+			continue;
+
+		get_type_io_data(attr->atttypid, IOFunc_send, &typlen, &typbyval, &typalign,
+				&typdelim, &typioparam, &typsend);
+
+		/* don't fail the insert over a column we can't encode, just skip the batch */
+		if (!OidIsValid(typsend))
+		{
+			elog(WARNING, "could not capture events of stream \"%s\": type %s has no binary output function",
+					RelationGetRelationName(stream), format_type_be(attr->atttypid));
+			goto done;
+		}
+
+		fmgr_info(typsend, &send[i]);
+		captured[i] = true;
+		natts++;
+	}
+
+	pq_sendint(&buf, natts, 2);
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (captured[i])
+			send_string(&buf, quote_identifier(NameStr(desc->attrs[i]->attname)));
+	}
+
+	pq_sendint(&buf, ntuples, 4);
+
+	/* the length of the events is filled in once they're encoded */
+	lenpos = buf.len;
+	pq_sendint(&buf, 0, 4);
+
+	for (i = 0; i < ntuples; i++)
+	{
+		heap_deform_tuple(tuples[i], desc, values, nulls);
+
+		pq_sendint(&buf, natts, 2);
+		for (j = 0; j < desc->natts; j++)
+		{
+			bytea *b;
+
+			if (!captured[j])
+				continue;
+
+			if (nulls[j])
+			{
+				pq_sendint(&buf, -1, 4);
+				continue;
+			}
+
+			b = SendFunctionCall(&send[j], values[j]);
+			pq_sendint(&buf, VARSIZE(b) - VARHDRSZ, 4);
+			pq_sendbytes(&buf, VARDATA(b), VARSIZE(b) - VARHDRSZ);
+		}
+	}
+
+	len = htonl(buf.len - lenpos - 4);
+	memcpy(buf.data + lenpos, &len, sizeof(len));
+
+	write_capture(buf.data, buf.len);
+
+done:
+	MemoryContextSwitchTo(old);
+	MemoryContextDelete(cxt);
+}
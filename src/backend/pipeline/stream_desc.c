@@ -0,0 +1,309 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_desc.c
+ *
+ *	  Shared cache of packed stream tuple descriptors
+ *
+ * Every stream event carries the descriptor it was written with. Rather than
+ * serializing the full descriptor into every message, producers register each
+ * distinct packed descriptor once in shared memory and send a small reference
+ * to it instead. Registered descriptors are immutable and are never evicted, so
+ * a reference stays valid for the lifetime of the server. If the cache is full,
+ * producers simply fall back to sending the full descriptor.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/stream_desc.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "catalog/pipeline_stream_fn.h"
+#include "pipeline/stream_desc.h"
+#include "storage/shm_alloc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+/* 'DESC', can never be the attribute count a packed descriptor begins with */
+#define STREAM_DESC_REF_MAGIC 0x44455343
+
+/* don't let the open addressed table get too crowded */
+#define MAX_STREAM_DESCS (STREAM_DESC_CACHE_SIZE * 3 / 4)
+
+typedef struct StreamDescRef
+{
+	int32 vl_len_;
+	uint32 magic;
+	uint32 id;
+} StreamDescRef;
+
+typedef struct StreamDescSlot
+{
+	uint32 hash;
+	bytea *desc;
+} StreamDescSlot;
+
+typedef struct StreamDescCache
+{
+	slock_t mutex;
+	int ndescs;
+	StreamDescSlot slots[STREAM_DESC_CACHE_SIZE];
+} StreamDescCache;
+
+typedef struct LocalStreamDesc
+{
+	Oid relid;
+	TupleDesc desc;
+	/* either a reference to the registered descriptor or the full packed descriptor */
+	bytea *packed;
+} LocalStreamDesc;
+
+static StreamDescCache *desc_cache = NULL;
+static HTAB *local_descs = NULL;
+
+/*
+ * StreamDescCacheShmemSize
+ */
+Size
+StreamDescCacheShmemSize(void)
+{
+	return MAXALIGN(sizeof(StreamDescCache));
+}
+
+/*
+ * StreamDescCacheShmemInit
+ */
+void
+StreamDescCacheShmemInit(void)
+{
+	bool found;
+
+	desc_cache = ShmemInitStruct("StreamDescCache", StreamDescCacheShmemSize(), &found);
+
+	if (!found)
+	{
+		MemSet(desc_cache, 0, StreamDescCacheShmemSize());
+		SpinLockInit(&desc_cache->mutex);
+	}
+}
+
+/*
+ * find_slot
+ *
+ * Must be called with the cache mutex held. Returns the index of the slot holding the given
+ * descriptor, or -1 if it isn't registered, in which case free is set to the slot it belongs in.
+ */
+static int
+find_slot(bytea *packed, uint32 hash, int *free)
+{
+	int i = hash % STREAM_DESC_CACHE_SIZE;
+
+	for (;;)
+	{
+		StreamDescSlot *slot = &desc_cache->slots[i];
+
+		if (slot->desc == NULL)
+		{
+			*free = i;
+			return -1;
+		}
+
+		if (slot->hash == hash && VARSIZE(slot->desc) == VARSIZE(packed) &&
+				memcmp(VARDATA(slot->desc), VARDATA(packed), VARSIZE(packed) - VARHDRSZ) == 0)
+			return i;
+
+		i = (i + 1) % STREAM_DESC_CACHE_SIZE;
+	}
+}
+
+/*
+ * register_desc
+ *
+ * Returns the id of the given packed descriptor in the shared cache, registering it
+ * if necessary. Returns 0 if the descriptor could not be registered.
+ */
+static uint32
+register_desc(bytea *packed)
+{
+	uint32 hash = DatumGetUInt32(hash_any((unsigned char *) VARDATA(packed), VARSIZE(packed) - VARHDRSZ));
+	bytea *copy;
+	int free;
+	int i;
+
+	SpinLockAcquire(&desc_cache->mutex);
+	i = find_slot(packed, hash, &free);
+	SpinLockRelease(&desc_cache->mutex);
+
+	if (i >= 0)
+		return i + 1;
+
+	/* allocate outside of the spinlock, since the allocator takes its own lock */
+	copy = ShmemDynAlloc(VARSIZE(packed));
+	memcpy(copy, packed, VARSIZE(packed));
+
+	SpinLockAcquire(&desc_cache->mutex);
+
+	/* someone else may have registered it in the mean time */
+	i = find_slot(packed, hash, &free);
+
+	if (i < 0 && desc_cache->ndescs < MAX_STREAM_DESCS)
+	{
+		desc_cache->slots[free].hash = hash;
+		desc_cache->slots[free].desc = copy;
+		desc_cache->ndescs++;
+		i = free;
+		copy = NULL;
+	}
+
+	SpinLockRelease(&desc_cache->mutex);
+
+	if (copy)
+		ShmemDynFree(copy);
+
+	return i + 1;
+}
+
+/*
+ * same_desc
+ *
+ * Compares only the attribute fields that are serialized by PackTupleDesc
+ */
+static bool
+same_desc(TupleDesc desc1, TupleDesc desc2)
+{
+	int i;
+
+	if (desc1->natts != desc2->natts)
+		return false;
+
+	for (i = 0; i < desc1->natts; i++)
+	{
+		Form_pg_attribute attr1 = desc1->attrs[i];
+		Form_pg_attribute attr2 = desc2->attrs[i];
+
+		if (attr1->atttypid != attr2->atttypid ||
+				attr1->atttypmod != attr2->atttypmod ||
+				attr1->attcollation != attr2->attcollation ||
+				strcmp(NameStr(attr1->attname), NameStr(attr2->attname)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * PackStreamTupleDesc
+ *
+ * Packs the given stream descriptor for inclusion in stream events. If the descriptor
+ * could be registered in the shared cache, only a small reference to it is returned.
+ * The result is allocated in the caller's memory context.
+ */
+bytea *
+PackStreamTupleDesc(Oid relid, TupleDesc desc)
+{
+	LocalStreamDesc *entry;
+	bytea *packed;
+	bytea *result;
+	MemoryContext old;
+	bool found;
+	uint32 id;
+
+	if (local_descs == NULL)
+	{
+		HASHCTL ctl;
+
+		MemSet(&ctl, 0, sizeof(HASHCTL));
+
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(LocalStreamDesc);
+		ctl.hcxt = CacheMemoryContext;
+
+		local_descs = hash_create("LocalStreamDescs", 16, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	entry = (LocalStreamDesc *) hash_search(local_descs, &relid, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		entry->desc = NULL;
+		entry->packed = NULL;
+	}
+	else if (entry->desc && same_desc(entry->desc, desc))
+		goto done;
+
+	if (entry->desc)
+	{
+		FreeTupleDesc(entry->desc);
+		pfree(entry->packed);
+		entry->desc = NULL;
+	}
+
+	old = MemoryContextSwitchTo(CacheMemoryContext);
+
+	packed = PackTupleDesc(desc);
+
+	id = register_desc(packed);
+	if (id)
+	{
+		StreamDescRef *ref = palloc0(sizeof(StreamDescRef));
+
+		SET_VARSIZE(ref, sizeof(StreamDescRef));
+		ref->magic = STREAM_DESC_REF_MAGIC;
+		ref->id = id;
+
+		pfree(packed);
+		packed = (bytea *) ref;
+	}
+
+	entry->packed = packed;
+	entry->desc = CreateTupleDescCopy(desc);
+
+	MemoryContextSwitchTo(old);
+
+done:
+	result = palloc(VARSIZE(entry->packed));
+	memcpy(result, entry->packed, VARSIZE(entry->packed));
+
+	return result;
+}
+
+/*
+ * StreamTupleDescGetId
+ *
+ * Returns the shared cache id of the given packed descriptor if it's a reference, 0 otherwise
+ */
+uint32
+StreamTupleDescGetId(bytea *desc)
+{
+	StreamDescRef *ref = (StreamDescRef *) desc;
+
+	if (VARSIZE(desc) != sizeof(StreamDescRef) || ref->magic != STREAM_DESC_REF_MAGIC)
+		return 0;
+
+	Assert(ref->id > 0 && ref->id <= STREAM_DESC_CACHE_SIZE);
+
+	return ref->id;
+}
+
+/*
+ * StreamTupleDescResolve
+ *
+ * Returns the full packed descriptor for the given packed descriptor or reference
+ */
+bytea *
+StreamTupleDescResolve(bytea *desc)
+{
+	uint32 id = StreamTupleDescGetId(desc);
+
+	if (!id)
+		return desc;
+
+	/* registered slots are never modified, so no lock is needed here */
+	Assert(desc_cache->slots[id - 1].desc);
+
+	return desc_cache->slots[id - 1].desc;
+}
@@ -12,27 +12,38 @@
  */
 #include "postgres.h"
 
+#include <math.h>
+
 #include "access/htup_details.h"
 #include "catalog/pg_type.h"
 #include "catalog/pipeline_stream_fn.h"
 #include "executor/executor.h"
 #include "foreign/fdwapi.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
 #include "nodes/relation.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/plancat.h"
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
+#include "optimizer/var.h"
 #include "parser/parse_coerce.h"
 #include "parser/parsetree.h"
 #include "pgstat.h"
 #include "pipeline/cont_execute.h"
 #include "pipeline/cont_scheduler.h"
+#include "pipeline/dedup.h"
 #include "pipeline/miscutils.h"
 #include "pipeline/stream.h"
+#include "pipeline/stream_batch.h"
+#include "pipeline/stream_desc.h"
 #include "pipeline/stream_fdw.h"
+#include "pipeline/stream_json.h"
+#include "pipeline/stream_vector.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/typcache.h"
@@ -42,6 +53,50 @@ typedef struct StreamFdwInfo
 	List *colnames;
 } StreamFdwInfo;
 
+/*
+ * How to decode one event attribute that a projection reads
+ */
+typedef struct StreamDeformAttr
+{
+	/* zero-based positions of the attribute in the event and result descriptors */
+	int evatt;
+	int outatt;
+	/* offset of the attribute within events that have no nulls, or -1 if it depends on the event */
+	int offset;
+	/* coercion of the value to the result type, with the value supplied as the case test value */
+	ExprState *coerce;
+	/*
+	 * set if the types differ but there's no cast between them, or the value is an unknown literal,
+	 * in which case the value is read in from its text form with these functions
+	 */
+	bool coerce_io;
+	FmgrInfo outfn;
+	FmgrInfo infn;
+	Oid ioparam;
+	int32 typmod;
+	/* length coercion of unknown literals read in by the input function, or NULL */
+	ExprState *coerce_typmod;
+} StreamDeformAttr;
+
+/*
+ * Decoding plan for events of a given descriptor projected into a given result descriptor. Only the
+ * attributes the projection reads are decoded, and those at fixed offsets are read directly from events
+ * without nulls.
+ */
+typedef struct StreamDeformInfo
+{
+	int natts;
+	StreamDeformAttr *atts;
+	/* number of leading event attributes an event must have to be read directly */
+	int maxatt;
+	/* are all attributes read at fixed offsets? */
+	bool fixed;
+	/* result attribute receiving the arrival timestamp, or -1 */
+	int arrival_att;
+	/* are the event's attributes exactly the result's, so that events can be scanned as they are? */
+	bool passthrough;
+} StreamDeformInfo;
+
 struct StreamProjectionInfo {
 	/*
 	 * Temporary context to use during stream projections,
@@ -67,6 +122,8 @@ struct StreamProjectionInfo {
 	 * may be cached across projections
 	 */
 	int *attrmap;
+	/* decoding plan for the current event descriptor, may be cached across projections */
+	StreamDeformInfo *deform;
 
 	/*
 	 * Serialized event descriptor used to detect when a new event descriptor
@@ -75,6 +132,96 @@ struct StreamProjectionInfo {
 	bytea *raweventdesc;
 };
 
+/*
+ * Descriptor-level projection state for registered event descriptors, which is kept
+ * across batches since a registered descriptor never changes
+ */
+typedef struct ProjectionCacheKey
+{
+	uint32 desc_id;
+	Oid query_id;
+} ProjectionCacheKey;
+
+typedef struct ProjectionCacheEntry
+{
+	ProjectionCacheKey key;
+	TupleDesc resultdesc;
+	TupleDesc eventdesc;
+	TupleTableSlot *curslot;
+	int *attrmap;
+	MemoryContext deform_cxt;
+	StreamDeformInfo *deform;
+} ProjectionCacheEntry;
+
+static HTAB *projection_cache = NULL;
+
+/* guc parameters */
+bool continuous_query_shared_stream_scan;
+bool continuous_query_shared_stream_exprs;
+int continuous_query_stream_join_buffer_size;
+
+/*
+ * Events decoded by the first query of a worker batch that reads them, so that the remaining
+ * queries reading the same event can skip decoding it again
+ */
+typedef struct DecodedEvent
+{
+	StreamTupleState *sts;
+	Datum *values;
+	bool *nulls;
+} DecodedEvent;
+
+static HTAB *decoded_events = NULL;
+
+/*
+ * An expression over stream columns computed by the plans of several queries reading the same
+ * stream, such as date_trunc('minute', ts) or (payload->>'user')::text. Expressions are
+ * identified by their text with Vars normalized to the stream's attributes, and are kept for the
+ * lifetime of the worker.
+ */
+typedef struct SharedExpr
+{
+	uint64 hash;
+	char *key;
+	int id;
+	/* queries whose plans compute this expression */
+	Bitmapset *queries;
+	bool shared;
+} SharedExpr;
+
+/*
+ * Evaluates an expression of a plan reading a stream through the worker's shared values,
+ * computing it with its own state if no other query has for the current event
+ */
+typedef struct SharedExprState
+{
+	ExprState xprstate;
+	ExprState *arg;
+	SharedExpr *expr;
+	int16 typlen;
+	bool typbyval;
+} SharedExprState;
+
+typedef struct SharedExprValueKey
+{
+	StreamTupleState *sts;
+	int id;
+} SharedExprValueKey;
+
+typedef struct SharedExprValue
+{
+	SharedExprValueKey key;
+	Datum value;
+	bool isnull;
+} SharedExprValue;
+
+static MemoryContext shared_exprs_cxt = NULL;
+static HTAB *shared_exprs = NULL;
+static HTAB *shared_expr_values = NULL;
+
+/* event of the current batch the stream scan being executed last returned, if any */
+static StreamTupleState *current_event = NULL;
+
 
 /*
  * stream_fdw_handler
@@ -197,6 +344,7 @@ BeginStreamScan(ForeignScanState *node, int eflags)
 	state->pi->econtext = CreateStandaloneExprContext();
 	state->pi->resultdesc = ExecTypeFromTL(physical_tlist, false);
 	state->pi->raweventdesc = NULL;
+	state->pi->curslot = NULL;
 
 	Assert(state->pi->resultdesc->natts == list_length(colnames));
 
@@ -214,16 +362,82 @@ BeginStreamScan(ForeignScanState *node, int eflags)
 	ExecAssignResultTypeFromTL(&node->ss.ps);
 	ExecAssignScanProjectionInfo(&node->ss);
 
+	/* queries reading several streams split each batch's events between them, see get_multi_stream_state */
+	state->input = -1;
+	foreach(lc, node->ss.ps.state->es_range_table)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->rtekind != RTE_RELATION || !IsStream(rte->relid) || list_member_oid(state->input_relids, rte->relid))
+			continue;
+
+		if (rte->relid == RelationGetRelid(node->ss.ss_currentRelation))
+			state->input = list_length(state->input_relids);
+		state->input_relids = lappend_oid(state->input_relids, rte->relid);
+	}
+
+	if (list_length(state->input_relids) < 2)
+		state->input = -1;
+
+	/* simple quals are evaluated by us over vectors of events rather than by ExecScan */
+	if (continuous_query_vectorized_quals && state->input < 0)
+	{
+		state->vquals = ExtractStreamVectorQuals(&node->ss.ps.qual, plan->scan.scanrelid);
+		if (state->vquals)
+			state->vec = StreamVectorCreate(state->pi->resultdesc->natts);
+	}
+
+	state->sample_skip = -1;
+
 	node->fdw_state = (void *) state;
 }
 
+/*
+ * reset_stream_scan
+ *
+ * Forget everything about the events read so far
+ */
+static void
+reset_stream_scan(StreamScanState *ss)
+{
+	/* the slot may be cached across batches, so don't leave it pointing to this batch's last event */
+	if (ss->pi->curslot)
+		ExecClearTuple(ss->pi->curslot);
+
+	MemoryContextReset(ss->pi->ctxt);
+	ss->pi->curslot = NULL;
+	ss->pi->deform = NULL;
+
+	/* the next event's descriptor will be used if this is NULL */
+	ss->pi->raweventdesc = NULL;
+
+	reset_record_type_cache();
+
+	pgstat_increment_cq_read(ss->ntuples, ss->nbytes);
+	ss->ntuples = 0;
+	ss->nbytes = 0;
+
+	if (ss->vec)
+	{
+		ss->vec->nrows = 0;
+		ss->vec->next = 0;
+	}
+
+	ss->dedup = NULL;
+
+	ss->join_next = NULL;
+	ss->join_phase = 0;
+}
+
 /*
  * ReScanStreamScan
+ *
+ * Plans kept across worker batches are rescanned at the end of each batch
  */
 void
 ReScanStreamScan(ForeignScanState *node)
 {
-
+	reset_stream_scan((StreamScanState *) node->fdw_state);
 }
 
 /*
@@ -232,16 +446,7 @@ ReScanStreamScan(ForeignScanState *node)
 void
 EndStreamScan(ForeignScanState *node)
 {
-	StreamScanState *ss = (StreamScanState *) node->fdw_state;
-
-	MemoryContextReset(ss->pi->ctxt);
-
-	/* the next event's descriptor will be used if this is NULL */
-	ss->pi->raweventdesc = NULL;
-
-	reset_record_type_cache();
-
-	pgstat_increment_cq_read(ss->ntuples, ss->nbytes);
+	reset_stream_scan((StreamScanState *) node->fdw_state);
 }
 
 /*
@@ -273,321 +478,1795 @@ map_field_positions(TupleDesc evdesc, TupleDesc desc)
 }
 
 /*
- * Initializes the given StreamProjectionInfo for the given
- * Tuple. This allows us to cache descriptor-level information, which
- * may only change after many event projections.
+ * Returns true if the given descriptors have the same attribute names
  */
-static void
-init_proj_info(StreamProjectionInfo *pi, StreamTupleState *sts)
+static bool
+same_attnames(TupleDesc desc1, TupleDesc desc2)
 {
-	MemoryContext old;
-
-	old = MemoryContextSwitchTo(pi->ctxt);
-
-	pi->eventdesc = UnpackTupleDesc(sts->desc);
-	pi->attrmap = map_field_positions(pi->eventdesc, pi->resultdesc);
-	pi->curslot = MakeSingleTupleTableSlot(pi->eventdesc);
+	int i;
 
-	pi->raweventdesc = palloc0(VARSIZE(sts->desc) + VARHDRSZ);
-	memcpy(pi->raweventdesc, sts->desc, VARSIZE(sts->desc) + VARHDRSZ);
+	if (desc1->natts != desc2->natts)
+		return false;
 
-	/*
-	 * Load RECORDOID tuple descriptors in the cache.
-	 */
-	if (sts->num_record_descs)
+	for (i = 0; i < desc1->natts; i++)
 	{
-		int i;
-
-		for (i = 0; i < sts->num_record_descs; i++)
-		{
-			RecordTupleDesc *rdesc = &sts->record_descs[i];
-			set_record_type_typemod(rdesc->typmod, UnpackTupleDesc(rdesc->desc));
-		}
+		if (strcmp(NameStr(desc1->attrs[i]->attname), NameStr(desc2->attrs[i]->attname)) != 0)
+			return false;
 	}
 
-	MemoryContextSwitchTo(old);
+	return true;
 }
 
 /*
- * Given a value, convert it to its original user input representation,
- * then attempt to read it in as the target output type
+ * init_coerce_io
+ *
+ * Looks up the functions for reading in values of the given event attribute from their text form, the
+ * way the parser would for an unknown literal. Values of other types without a cast to the result
+ * type are read in from their original user input.
  */
-static Datum
-coerce_raw_input(Datum value, Oid intype, Oid outtype)
+static void
+init_coerce_io(StreamDeformAttr *datt, Form_pg_attribute evatt, Form_pg_attribute outatt)
 {
-	char *orig;
 	Oid outfn;
 	Oid infn;
-	Oid ioparam;
 	bool isvlen;
-	Datum result;
 
-	getTypeOutputInfo(intype, &outfn, &isvlen);
-	orig = OidOutputFunctionCall(outfn, value);
+	getTypeOutputInfo(evatt->atttypid, &outfn, &isvlen);
+	fmgr_info(outfn, &datt->outfn);
 
-	getTypeInputInfo(outtype, &infn, &ioparam);
-	result = OidInputFunctionCall(infn, orig, ioparam, -1);
+	getTypeInputInfo(outatt->atttypid, &infn, &datt->ioparam);
+	fmgr_info(infn, &datt->infn);
 
-	return result;
+	datt->coerce_io = true;
+	datt->typmod = -1;
+
+	/* like coerce_type, only intervals are read in with their typmod, others are coerced to it afterwards */
+	if (evatt->atttypid == UNKNOWNOID)
+	{
+		if (getBaseType(outatt->atttypid) == INTERVALOID)
+			datt->typmod = outatt->atttypmod;
+		else if (outatt->atttypmod >= 0)
+		{
+			CaseTestExpr *ctest = makeNode(CaseTestExpr);
+			Node *n;
+
+			ctest->typeId = outatt->atttypid;
+			ctest->typeMod = -1;
+			ctest->collation = outatt->attcollation;
+
+			n = coerce_to_target_type(NULL, (Node *) ctest, outatt->atttypid, outatt->atttypid,
+					outatt->atttypmod, COERCION_ASSIGNMENT, COERCE_IMPLICIT_CAST, -1);
+			if (n != NULL && n != (Node *) ctest)
+				datt->coerce_typmod = ExecInitExpr((Expr *) n, NULL);
+		}
+	}
 }
 
-static HeapTuple
-exec_stream_project(StreamTupleState *sts, StreamScanState *node)
+/*
+ * build_deform_info
+ *
+ * Works out how to decode the attributes of events with the given descriptor that the projection reads
+ */
+static StreamDeformInfo *
+build_deform_info(TupleDesc evdesc, TupleDesc desc, int *attrmap)
 {
-	HeapTuple decoded;
-	MemoryContext oldcontext;
-	Datum *values;
-	bool *nulls;
+	StreamDeformInfo *deform = palloc0(sizeof(StreamDeformInfo));
+	int off = 0;
 	int i;
-	StreamProjectionInfo *pi = node->pi;
-	TupleDesc evdesc = pi->eventdesc;
-	TupleDesc desc = pi->resultdesc;
-
-	values = palloc0(sizeof(Datum) * desc->natts);
-	nulls = palloc0(sizeof(bool) * desc->natts);
-
-	/* assume every element in the output tuple is null until we actually see values */
-	MemSet(nulls, true, desc->natts);
 
-	ExecStoreTuple(sts->tup, pi->curslot, InvalidBuffer, false);
+	deform->atts = palloc0(sizeof(StreamDeformAttr) * Max(evdesc->natts, 1));
+	deform->fixed = true;
+	deform->arrival_att = -1;
 
-	/*
-	 * For each field in the event, place it in the corresponding field in the
-	 * output tuple, coercing types if necessary.
-	 */
 	for (i = 0; i < evdesc->natts; i++)
 	{
-		Datum v;
-		bool isnull;
-		int outatt = pi->attrmap[i];
-		Form_pg_attribute evatt;
+		Form_pg_attribute evatt = evdesc->attrs[i];
+		StreamDeformAttr *datt;
+		int outatt = attrmap[i];
+		int attoff = -1;
+
+		/* offsets are only known up to the first variable-width attribute */
+		if (off >= 0 && evatt->attlen > 0)
+		{
+			off = att_align_nominal(off, evatt->attalign);
+			attoff = off;
+			off += evatt->attlen;
+		}
+		else
+			off = -1;
 
 		if (outatt < 0)
 			continue;
 
-		/* this is the append-time value */
-		v = slot_getattr(pi->curslot, i + 1, &isnull);
-
-		if (isnull)
-			continue;
+		datt = &deform->atts[deform->natts++];
+		datt->evatt = i;
+		datt->outatt = outatt;
+		datt->offset = attoff;
 
-		evatt = evdesc->attrs[i];
-		nulls[outatt] = false;
+		deform->maxatt = i + 1;
+		if (attoff < 0)
+			deform->fixed = false;
 
-		/* if the append-time value's type is different from the target type, try to coerce it */
 		if (evatt->atttypid != desc->attrs[outatt]->atttypid)
 		{
-			Const *c = makeConst(evatt->atttypid, evatt->atttypmod, evatt->attcollation,
-					evatt->attlen, v, false, evatt->attbyval);
-			Node *n = coerce_to_target_type(NULL, (Node *) c, evatt->atttypid, desc->attrs[outatt]->atttypid,
-					desc->attrs[outatt]->atttypmod, COERCION_ASSIGNMENT, COERCE_IMPLICIT_CAST, -1);
+			CaseTestExpr *ctest = makeNode(CaseTestExpr);
+			Node *n;
+
+			ctest->typeId = evatt->atttypid;
+			ctest->typeMod = evatt->atttypmod;
+			ctest->collation = evatt->attcollation;
+
+			/* unknown values are coerced by their input function, which needs the literal */
+			n = evatt->atttypid == UNKNOWNOID ? NULL :
+				coerce_to_target_type(NULL, (Node *) ctest, evatt->atttypid, desc->attrs[outatt]->atttypid,
+						desc->attrs[outatt]->atttypmod, COERCION_ASSIGNMENT, COERCE_IMPLICIT_CAST, -1);
 
-			/* if the coercion is possible, do it */
 			if (n != NULL)
-			{
-				ExprState *estate = ExecInitExpr((Expr *) n, NULL);
-				v = ExecEvalExpr(estate, pi->econtext, &nulls[outatt], NULL);
-			}
+				datt->coerce = ExecInitExpr((Expr *) n, NULL);
 			else
-			{
-				/*
-				 * Slow path, fall back to the original user input and try to
-				 * coerce that to the target type
-				 */
-				v = coerce_raw_input(v, evatt->atttypid,
-						desc->attrs[outatt]->atttypid);
-			}
+				init_coerce_io(datt, evatt, desc->attrs[outatt]);
 		}
-
-		values[outatt] = v;
 	}
 
-	/* If arrival_timestamp is requested, pull value from StreamEvent and
-	 * update the HeapTuple. */
 	for (i = 0; i < desc->natts; i++)
 	{
 		if (pg_strcasecmp(NameStr(desc->attrs[i]->attname), ARRIVAL_TIMESTAMP) == 0)
 		{
-			values[i] = TimestampGetDatum(sts->arrival_time);
-			nulls[i] = false;
+			deform->arrival_att = i;
 			break;
 		}
 	}
 
-	oldcontext = MemoryContextSwitchTo(ContQueryBatchContext);
-
-	/* our result tuple needs to live for the duration of this query execution */
-	decoded = heap_form_tuple(desc, values, nulls);
+	deform->passthrough = evdesc->natts == desc->natts && deform->natts == desc->natts && deform->arrival_att < 0;
+	for (i = 0; i < deform->natts && deform->passthrough; i++)
+	{
+		StreamDeformAttr *datt = &deform->atts[i];
 
-	MemoryContextSwitchTo(oldcontext);
+		if (datt->evatt != i || datt->outatt != i || datt->coerce || datt->coerce_io)
+			deform->passthrough = false;
+	}
 
-	return decoded;
+	return deform;
 }
 
 /*
- * PlanStreamModify
+ * Looks up the projection state for a registered event descriptor, building it if necessary
  */
-List *
-PlanStreamModify(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index)
+static ProjectionCacheEntry *
+get_cached_proj_info(StreamProjectionInfo *pi, bytea *desc, uint32 desc_id, Oid query_id)
 {
-	return list_make1(root->parse->targetList);
-}
+	ProjectionCacheKey key;
+	ProjectionCacheEntry *entry;
+	MemoryContext old;
+	bool found;
 
+	if (projection_cache == NULL)
+	{
+		HASHCTL ctl;
 
-/*
- * IterateStreamScan
- */
-TupleTableSlot *
-IterateStreamScan(ForeignScanState *node)
-{
-	StreamTupleState *sts;
-	int len;
-	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
-	StreamScanState *state = (StreamScanState *) node->fdw_state;
+		MemSet(&ctl, 0, sizeof(HASHCTL));
 
-	HeapTuple tup;
-	bytea *piraw;
-	bytea *tupraw;
+		ctl.keysize = sizeof(ProjectionCacheKey);
+		ctl.entrysize = sizeof(ProjectionCacheEntry);
+		ctl.hcxt = CacheMemoryContext;
 
-	sts = (StreamTupleState *) ContExecutorYieldNextMessage(state->cont_executor, &len);
+		projection_cache = hash_create("StreamProjectionCache", 32, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
 
-	if (sts == NULL)
-		return NULL;
+	MemSet(&key, 0, sizeof(ProjectionCacheKey));
+	key.desc_id = desc_id;
+	key.query_id = query_id;
 
-	state->ntuples++;
-	state->nbytes += len;
+	entry = (ProjectionCacheEntry *) hash_search(projection_cache, &key, HASH_ENTER, &found);
 
-	/*
-	 * Check if the incoming event descriptor is different from the one we're
-	 * currently using before fully unpacking it.
-	 */
-	piraw = state->pi->raweventdesc;
-	tupraw = sts->desc;
+	if (!found)
+		entry->resultdesc = NULL;
 
-	if (piraw == NULL || VARSIZE(piraw) != VARSIZE(tupraw) ||
-			memcmp(VARDATA(piraw), VARDATA(tupraw), VARSIZE(piraw)))
-		init_proj_info(state->pi, sts);
+	/* query ids can be reused after a DROP, so make sure this is still the same projection */
+	if (entry->resultdesc && same_attnames(entry->resultdesc, pi->resultdesc))
+		return entry;
 
-	tup = exec_stream_project(sts, state);
-	ExecStoreTuple(tup, slot, InvalidBuffer, false);
+	if (entry->resultdesc)
+	{
+		ExecDropSingleTupleTableSlot(entry->curslot);
+		FreeTupleDesc(entry->eventdesc);
+		FreeTupleDesc(entry->resultdesc);
+		pfree(entry->attrmap);
+		MemoryContextDelete(entry->deform_cxt);
+		entry->resultdesc = NULL;
+	}
 
-	return slot;
+	old = MemoryContextSwitchTo(CacheMemoryContext);
+
+	entry->eventdesc = UnpackTupleDesc(StreamTupleDescResolve(desc));
+	entry->attrmap = map_field_positions(entry->eventdesc, pi->resultdesc);
+	entry->curslot = MakeSingleTupleTableSlot(entry->eventdesc);
+	entry->resultdesc = CreateTupleDescCopy(pi->resultdesc);
+
+	entry->deform_cxt = AllocSetContextCreate(CacheMemoryContext, "StreamDeformInfoContext",
+			ALLOCSET_SMALL_MINSIZE,
+			ALLOCSET_SMALL_INITSIZE,
+			ALLOCSET_SMALL_MAXSIZE);
+	MemoryContextSwitchTo(entry->deform_cxt);
+	entry->deform = build_deform_info(entry->eventdesc, entry->resultdesc, entry->attrmap);
+
+	MemoryContextSwitchTo(old);
+
+	return entry;
 }
 
 /*
- * BeginStreamModify
+ * Initializes the given StreamProjectionInfo for the given
+ * Tuple. This allows us to cache descriptor-level information, which
+ * may only change after many event projections. Registered event
+ * descriptors are additionally cached across batches.
  */
-void
-BeginStreamModify(ModifyTableState *mtstate, ResultRelInfo *result_info,
-						   List *fdw_private, int subplan_index, int eflags)
+static void
+init_proj_info(StreamScanState *state, StreamTupleState *sts)
 {
-	Relation stream = result_info->ri_RelationDesc;
-	Oid streamid = RelationGetRelid(stream);
-	StreamInsertState *sis = palloc0(sizeof(StreamInsertState));
-	Bitmapset *targets = GetLocalStreamReaders(streamid);
-	InsertBatchAck *ack = NULL;
-	InsertBatch *batch = NULL;
-	List *insert_tl = NIL;
-
-	if (fdw_private)
-		insert_tl = linitial(fdw_private);
-
-	if (!bms_is_empty(targets))
-	{
-		if (synchronous_stream_insert)
-		{
-			batch = InsertBatchCreate();
-			ack = palloc0(sizeof(InsertBatchAck));
+	StreamProjectionInfo *pi = state->pi;
+	MemoryContext old;
+	uint32 desc_id = StreamTupleDescGetId(sts->desc);
 
-			ack->batch_id = batch->id;
-			ack->batch = batch;
-		}
+	old = MemoryContextSwitchTo(pi->ctxt);
 
-		/*
-		 * We always write to the same worker from a combiner process to prevent
-		 * unnecessary reordering
-		 */
-		if (IsContQueryCombinerProcess())
-		{
-			int idx = MyContQueryProc->group_id % continuous_query_num_workers;
-			sis->worker_queue = get_worker_queue_with_lock(idx, false);
-		}
-		else
-		{
-			sis->worker_queue = get_any_worker_queue_with_lock();
-		}
+	if (pi->curslot)
+		ExecClearTuple(pi->curslot);
 
-		Assert(sis->worker_queue);
-	}
+	if (desc_id)
+	{
+		ProjectionCacheEntry *entry;
 
-	sis->flags = eflags;
-	sis->targets = targets;
-	sis->ack = ack;
-	sis->batch = batch;
-	sis->count = 0;
-	sis->bytes = 0;
-	sis->num_batches = 1;
+		entry = get_cached_proj_info(pi, sts->desc, desc_id, state->cont_executor->current_query_id);
 
-	if (is_inferred_stream_relation(stream))
-	{
-		Assert(insert_tl);
-		sis->desc = ExecTypeFromTL(insert_tl, false);
+		pi->eventdesc = entry->eventdesc;
+		pi->attrmap = entry->attrmap;
+		pi->curslot = entry->curslot;
+		pi->deform = entry->deform;
+	}
+	else
+	{
+		pi->eventdesc = UnpackTupleDesc(sts->desc);
+		pi->attrmap = map_field_positions(pi->eventdesc, pi->resultdesc);
+		pi->curslot = MakeSingleTupleTableSlot(pi->eventdesc);
+		pi->deform = build_deform_info(pi->eventdesc, pi->resultdesc, pi->attrmap);
+	}
+
+	pi->raweventdesc = palloc0(VARSIZE(sts->desc) + VARHDRSZ);
+	memcpy(pi->raweventdesc, sts->desc, VARSIZE(sts->desc) + VARHDRSZ);
+
+	/*
+	 * Load RECORDOID tuple descriptors in the cache.
+	 */
+	if (sts->num_record_descs)
+	{
+		int i;
+
+		for (i = 0; i < sts->num_record_descs; i++)
+		{
+			RecordTupleDesc *rdesc = &sts->record_descs[i];
+			set_record_type_typemod(rdesc->typmod, UnpackTupleDesc(rdesc->desc));
+		}
+	}
+
+	MemoryContextSwitchTo(old);
+}
+
+/*
+ * decoded_events_reset_callback
+ *
+ * Decoded events point into the batch's events, so they're forgotten along with the batch
+ */
+static void
+decoded_events_reset_callback(void *arg)
+{
+	decoded_events = NULL;
+}
+
+/*
+ * get_decoded_event
+ *
+ * Get the decoded values of the given event, decoding it if this is the first query in the
+ * current batch to read it
+ */
+static DecodedEvent *
+get_decoded_event(StreamTupleState *sts, TupleDesc evdesc)
+{
+	DecodedEvent *entry;
+	bool found;
+
+	if (decoded_events == NULL)
+	{
+		MemoryContextCallback *callback;
+		HASHCTL ctl;
+
+		MemSet(&ctl, 0, sizeof(HASHCTL));
+
+		ctl.keysize = sizeof(StreamTupleState *);
+		ctl.entrysize = sizeof(DecodedEvent);
+		ctl.hcxt = ContQueryBatchContext;
+
+		decoded_events = hash_create("DecodedEvents", 1024, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		callback = MemoryContextAlloc(ContQueryBatchContext, sizeof(MemoryContextCallback));
+		callback->func = decoded_events_reset_callback;
+		callback->arg = NULL;
+		MemoryContextRegisterResetCallback(ContQueryBatchContext, callback);
+	}
+
+	entry = (DecodedEvent *) hash_search(decoded_events, &sts, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		entry->values = MemoryContextAlloc(ContQueryBatchContext, sizeof(Datum) * evdesc->natts);
+		entry->nulls = MemoryContextAlloc(ContQueryBatchContext, sizeof(bool) * evdesc->natts);
+		heap_deform_tuple(sts->tup, evdesc, entry->values, entry->nulls);
+	}
+
+	return entry;
+}
+
+/*
+ * shared_expr_values_reset_callback
+ *
+ * Shared values are keyed by the batch's events, so they're forgotten along with the batch
+ */
+static void
+shared_expr_values_reset_callback(void *arg)
+{
+	shared_expr_values = NULL;
+}
+
+static HTAB *
+get_shared_expr_values(void)
+{
+	MemoryContextCallback *callback;
+	HASHCTL ctl;
+
+	if (shared_expr_values)
+		return shared_expr_values;
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+
+	ctl.keysize = sizeof(SharedExprValueKey);
+	ctl.entrysize = sizeof(SharedExprValue);
+	ctl.hcxt = ContQueryBatchContext;
+
+	shared_expr_values = hash_create("SharedExprValues", 1024, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	callback = MemoryContextAlloc(ContQueryBatchContext, sizeof(MemoryContextCallback));
+	callback->func = shared_expr_values_reset_callback;
+	callback->arg = NULL;
+	MemoryContextRegisterResetCallback(ContQueryBatchContext, callback);
+
+	return shared_expr_values;
+}
+
+/*
+ * exec_eval_shared_expr
+ *
+ * Returns the value of a shared expression for the current event, which is only computed by the
+ * first query of the batch to need it. Values are only remembered once they've been computed
+ * successfully, so a query failing on an event doesn't leave anything behind for the others.
+ */
+static Datum
+exec_eval_shared_expr(SharedExprState *sstate, ExprContext *econtext, bool *isNull, ExprDoneCond *isDone)
+{
+	SharedExprValueKey key;
+	SharedExprValue *entry;
+	MemoryContext old;
+	Datum value;
+	bool found;
+
+	if (isDone)
+		*isDone = ExprSingleResult;
+
+	if (!sstate->expr->shared || current_event == NULL)
+		return ExecEvalExpr(sstate->arg, econtext, isNull, NULL);
+
+	MemSet(&key, 0, sizeof(SharedExprValueKey));
+	key.sts = current_event;
+	key.id = sstate->expr->id;
+
+	entry = (SharedExprValue *) hash_search(get_shared_expr_values(), &key, HASH_FIND, NULL);
+	if (entry)
+	{
+		*isNull = entry->isnull;
+		return entry->value;
+	}
+
+	value = ExecEvalExpr(sstate->arg, econtext, isNull, NULL);
+
+	old = MemoryContextSwitchTo(ContQueryBatchContext);
+
+	if (!*isNull)
+		value = datumCopy(value, sstate->typbyval, sstate->typlen);
+
+	MemoryContextSwitchTo(old);
+
+	entry = (SharedExprValue *) hash_search(get_shared_expr_values(), &key, HASH_ENTER, &found);
+	entry->value = value;
+	entry->isnull = *isNull;
+
+	return value;
+}
+
+typedef struct NormalizeExprContext
+{
+	/* for expressions of a node above the stream scan, the scan's target list */
+	List *scan_tlist;
+} NormalizeExprContext;
+
+/*
+ * normalize_expr_mutator
+ *
+ * Rewrites Vars to refer to the stream's attributes the same way in every plan
+ */
+static Node *
+normalize_expr_mutator(Node *node, NormalizeExprContext *context)
+{
+	if (node == NULL)
+		return NULL;
+
+	if (IsA(node, Var))
+	{
+		Var *var = (Var *) copyObject(node);
+
+		if (var->varno == OUTER_VAR)
+		{
+			TargetEntry *te = (TargetEntry *) list_nth(context->scan_tlist, var->varattno - 1);
+			NormalizeExprContext scan = {NIL};
+
+			return normalize_expr_mutator((Node *) te->expr, &scan);
+		}
+
+		var->varno = var->varnoold = 1;
+		var->location = -1;
+
+		return (Node *) var;
+	}
+
+	return expression_tree_mutator(node, normalize_expr_mutator, (void *) context);
+}
+
+/*
+ * strip_locations
+ *
+ * Locations only say where the expression was in the view's definition
+ */
+static void
+strip_locations(char *str)
+{
+	const char *token = ":location ";
+	char *in = str;
+	char *out = str;
+
+	while (*in)
+	{
+		if (strncmp(in, token, strlen(token)) == 0)
+		{
+			in += strlen(token);
+			while (*in == '-' || isdigit((unsigned char) *in))
+				in++;
+			continue;
+		}
+
+		*out++ = *in++;
+	}
+
+	*out = '\0';
+}
+
+static bool
+contains_varlena_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+
+	if ((IsA(node, Var) || IsA(node, Const)) && get_typlen(exprType(node)) == -1)
+		return true;
+
+	return expression_tree_walker(node, contains_varlena_walker, context);
+}
+
+/*
+ * is_shareable_expr
+ *
+ * Only function calls over stream columns that work on variable-length values are worth looking up
+ * rather than computing, which covers JSON field extraction, text manipulation and functions that
+ * parse a text argument on every call, such as date_trunc. Anything that might not give the same
+ * value for the same event every time it's computed isn't shared.
+ */
+static bool
+is_shareable_expr(Expr *expr)
+{
+	if (!IsA(expr, FuncExpr) && !IsA(expr, OpExpr) && !IsA(expr, CoerceViaIO))
+		return false;
+
+	if (!contain_var_clause((Node *) expr) || contain_volatile_functions((Node *) expr) ||
+			contain_subplans((Node *) expr) || contain_agg_clause((Node *) expr) ||
+			expression_returns_set((Node *) expr))
+		return false;
+
+	return get_typlen(exprType((Node *) expr)) == -1 || contains_varlena_walker((Node *) expr, NULL);
+}
+
+/*
+ * get_shared_expr
+ *
+ * Look up the given expression of a plan reading the given stream, registering it for the given query
+ */
+static SharedExpr *
+get_shared_expr(Expr *expr, Oid relid, Oid query_id, List *scan_tlist)
+{
+	NormalizeExprContext context;
+	MemoryContext old;
+	SharedExpr *entry;
+	char *key;
+	uint64 hash;
+	bool found;
+
+	if (shared_exprs_cxt == NULL)
+	{
+		HASHCTL ctl;
+
+		shared_exprs_cxt = AllocSetContextCreate(TopMemoryContext, "SharedExprsCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+
+		MemSet(&ctl, 0, sizeof(HASHCTL));
+
+		ctl.keysize = sizeof(uint64);
+		ctl.entrysize = sizeof(SharedExpr);
+		ctl.hcxt = shared_exprs_cxt;
+
+		shared_exprs = hash_create("SharedExprs", 1024, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	context.scan_tlist = scan_tlist;
+	key = nodeToString(normalize_expr_mutator((Node *) expr, &context));
+	strip_locations(key);
+	key = psprintf("%u %s", relid, key);
+	hash = FastHash64(key, strlen(key), 0);
+
+	entry = (SharedExpr *) hash_search(shared_exprs, &hash, HASH_ENTER, &found);
+
+	if (!found)
+	{
+		entry->key = MemoryContextStrdup(shared_exprs_cxt, key);
+		entry->id = hash_get_num_entries(shared_exprs);
+		entry->queries = NULL;
+		entry->shared = false;
+	}
+	else if (strcmp(entry->key, key) != 0)
+	{
+		/* a hash collision, so this expression isn't shared */
+		return NULL;
+	}
+
+	old = MemoryContextSwitchTo(shared_exprs_cxt);
+	entry->queries = bms_add_member(entry->queries, query_id);
+	MemoryContextSwitchTo(old);
+
+	entry->shared = bms_num_members(entry->queries) > 1;
+
+	return entry;
+}
+
+static void share_expr_state(ExprState **pstate, Oid relid, Oid query_id, List *scan_tlist);
+
+static void
+share_expr_states(List *states, Oid relid, Oid query_id, List *scan_tlist)
+{
+	ListCell *lc;
+
+	foreach(lc, states)
+		share_expr_state((ExprState **) &lfirst(lc), relid, query_id, scan_tlist);
+}
+
+/*
+ * share_expr_state
+ *
+ * Have the shareable expressions within the given expression state evaluated through the worker's
+ * shared values. Shareable subexpressions of shareable expressions are shared too, since other
+ * queries may only compute those.
+ */
+static void
+share_expr_state(ExprState **pstate, Oid relid, Oid query_id, List *scan_tlist)
+{
+	ExprState *state = *pstate;
+	SharedExprState *sstate;
+	SharedExpr *expr;
+	Oid type;
+
+	/* already shared */
+	if (state == NULL || state->evalfunc == (ExprStateEvalFunc) exec_eval_shared_expr)
+		return;
+
+	switch (nodeTag(state))
+	{
+		case T_GenericExprState:
+			share_expr_state(&((GenericExprState *) state)->arg, relid, query_id, scan_tlist);
+			break;
+		case T_FuncExprState:
+			share_expr_states(((FuncExprState *) state)->args, relid, query_id, scan_tlist);
+			break;
+		case T_ScalarArrayOpExprState:
+			share_expr_states(((ScalarArrayOpExprState *) state)->fxprstate.args, relid, query_id, scan_tlist);
+			break;
+		case T_BoolExprState:
+			share_expr_states(((BoolExprState *) state)->args, relid, query_id, scan_tlist);
+			break;
+		case T_CoerceViaIOState:
+			share_expr_state(&((CoerceViaIOState *) state)->arg, relid, query_id, scan_tlist);
+			break;
+		case T_NullTestState:
+			share_expr_state(&((NullTestState *) state)->arg, relid, query_id, scan_tlist);
+			break;
+		case T_List:
+			share_expr_states((List *) state, relid, query_id, scan_tlist);
+			return;
+		default:
+			break;
+	}
+
+	if (!is_shareable_expr(state->expr))
+		return;
+
+	expr = get_shared_expr(state->expr, relid, query_id, scan_tlist);
+	if (expr == NULL)
+		return;
+
+	type = exprType((Node *) state->expr);
+
+	sstate = palloc0(sizeof(SharedExprState));
+	sstate->xprstate.type = T_ExprState;
+	sstate->xprstate.expr = state->expr;
+	sstate->xprstate.evalfunc = (ExprStateEvalFunc) exec_eval_shared_expr;
+	sstate->arg = state;
+	sstate->expr = expr;
+	get_typlenbyval(type, &sstate->typlen, &sstate->typbyval);
+
+	*pstate = (ExprState *) sstate;
+}
+
+/*
+ * get_stream_scan
+ *
+ * Returns the given plan state if it's a scan of a stream that reads all of its events on its own
+ */
+static ForeignScanState *
+get_stream_scan(PlanState *planstate)
+{
+	ForeignScanState *fss;
+
+	if (planstate == NULL || !IsA(planstate, ForeignScanState))
+		return NULL;
+
+	fss = (ForeignScanState *) planstate;
+	if (!IsStream(RelationGetRelid(fss->ss.ss_currentRelation)))
+		return NULL;
+
+	/* events of several streams are only read by a query's scans after they've been split between them */
+	if (((StreamScanState *) fss->fdw_state)->input >= 0)
+		return NULL;
+
+	return fss;
+}
+
+/*
+ * ShareStreamExprs
+ *
+ * Have the given query's plan compute expressions over a stream's columns that other queries on the
+ * same stream compute too only once per event and batch, shared with the other queries. Expressions
+ * are shared when they're evaluated by the stream scan itself, or by the aggregate directly above it,
+ * which evaluates its arguments for each event right after the scan has returned it.
+ */
+void
+ShareStreamExprs(PlanState *planstate, Oid query_id)
+{
+	ForeignScanState *scan;
+	MemoryContext old;
+
+	if (planstate == NULL)
+		return;
+
+	old = MemoryContextSwitchTo(planstate->state->es_query_cxt);
+
+	if ((scan = get_stream_scan(planstate)) != NULL)
+	{
+		Oid relid = RelationGetRelid(scan->ss.ss_currentRelation);
+
+		share_expr_states(scan->ss.ps.targetlist, relid, query_id, NIL);
+		share_expr_states(scan->ss.ps.qual, relid, query_id, NIL);
+	}
+	else if (IsA(planstate, AggState) && (scan = get_stream_scan(outerPlanState(planstate))) != NULL)
+	{
+		AggState *agg = (AggState *) planstate;
+		Oid relid = RelationGetRelid(scan->ss.ss_currentRelation);
+		List *scan_tlist = scan->ss.ps.plan->targetlist;
+		ListCell *lc;
+
+		foreach(lc, agg->aggs)
+		{
+			AggrefExprState *aggref = (AggrefExprState *) lfirst(lc);
+
+			share_expr_states(aggref->args, relid, query_id, scan_tlist);
+			share_expr_state(&aggref->aggfilter, relid, query_id, scan_tlist);
+		}
+	}
+
+	MemoryContextSwitchTo(old);
+
+	ShareStreamExprs(planstate->lefttree, query_id);
+	ShareStreamExprs(planstate->righttree, query_id);
+}
+
+/*
+ * decode_event
+ *
+ * Decodes the given event into the values of the result descriptor, which are stored
+ * stride elements apart from each other
+ */
+static void
+decode_event(StreamTupleState *sts, StreamScanState *node, Datum *values, bool *nulls, int stride)
+{
+	int i;
+	StreamProjectionInfo *pi = node->pi;
+	StreamDeformInfo *deform = pi->deform;
+	TupleDesc evdesc = pi->eventdesc;
+	TupleDesc desc = pi->resultdesc;
+	DecodedEvent *decoded_event = NULL;
+	char *tp = NULL;
+
+	/* assume every element in the output tuple is null until we actually see values */
+	for (i = 0; i < desc->natts; i++)
+		nulls[i * stride] = true;
+
+	/*
+	 * Columnar batches are read directly, without going through a slot. With shared scans, each
+	 * event is only decoded once per batch, no matter how many queries read it. Otherwise, events
+	 * without nulls are read directly if all the attributes we need are at fixed offsets.
+	 */
+	if (!sts->columns)
+	{
+		if (continuous_query_shared_stream_scan)
+			decoded_event = get_decoded_event(sts, evdesc);
+		else if (deform->fixed && !HeapTupleHasNulls(sts->tup) &&
+				HeapTupleHeaderGetNatts(sts->tup->t_data) >= deform->maxatt)
+			tp = (char *) sts->tup->t_data + sts->tup->t_data->t_hoff;
+		else
+			ExecStoreTuple(sts->tup, pi->curslot, InvalidBuffer, false);
+	}
+
+	/*
+	 * For each field in the event that we read, place it in the corresponding field in the
+	 * output tuple, coercing types if necessary.
+	 */
+	for (i = 0; i < deform->natts; i++)
+	{
+		StreamDeformAttr *datt = &deform->atts[i];
+		Form_pg_attribute evatt = evdesc->attrs[datt->evatt];
+		int outatt = datt->outatt;
+		Datum v;
+		bool isnull;
+
+		/* this is the append-time value */
+		if (sts->columns)
+			v = StreamColumnarBatchGetAttr(sts->columns, evdesc, datt->evatt, sts->row, &isnull);
+		else if (decoded_event)
+		{
+			v = decoded_event->values[datt->evatt];
+			isnull = decoded_event->nulls[datt->evatt];
+		}
+		else if (tp)
+		{
+			v = fetchatt(evatt, tp + datt->offset);
+			isnull = false;
+		}
+		else
+			v = slot_getattr(pi->curslot, datt->evatt + 1, &isnull);
+
+		if (isnull)
+			continue;
+
+		nulls[outatt * stride] = false;
+
+		/* if the append-time value's type is different from the target type, coerce it */
+		if (datt->coerce)
+		{
+			pi->econtext->caseValue_datum = v;
+			pi->econtext->caseValue_isNull = false;
+			v = ExecEvalExpr(datt->coerce, pi->econtext, &nulls[outatt * stride], NULL);
+		}
+		else if (datt->coerce_io)
+		{
+			char *str = OutputFunctionCall(&datt->outfn, v);
+
+			v = InputFunctionCall(&datt->infn, str, datt->ioparam, datt->typmod);
+
+			if (datt->coerce_typmod)
+			{
+				pi->econtext->caseValue_datum = v;
+				pi->econtext->caseValue_isNull = false;
+				v = ExecEvalExpr(datt->coerce_typmod, pi->econtext, &nulls[outatt * stride], NULL);
+			}
+		}
+
+		values[outatt * stride] = v;
+	}
+
+	/* If arrival_timestamp is requested, pull value from StreamEvent and
+	 * update the HeapTuple. */
+	if (deform->arrival_att >= 0)
+	{
+		values[deform->arrival_att * stride] = TimestampGetDatum(sts->arrival_time);
+		nulls[deform->arrival_att * stride] = false;
+	}
+}
+
+/*
+ * exec_stream_project
+ */
+static HeapTuple
+exec_stream_project(StreamTupleState *sts, StreamScanState *node)
+{
+	HeapTuple decoded;
+	MemoryContext oldcontext;
+	TupleDesc desc = node->pi->resultdesc;
+	Datum *values;
+	bool *nulls;
+
+	values = palloc0(sizeof(Datum) * desc->natts);
+	nulls = palloc0(sizeof(bool) * desc->natts);
+
+	decode_event(sts, node, values, nulls, 1);
+
+	oldcontext = MemoryContextSwitchTo(ContQueryBatchContext);
+
+	/* our result tuple needs to live for the duration of this query execution */
+	decoded = heap_form_tuple(desc, values, nulls);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return decoded;
+}
+
+/*
+ * PlanStreamModify
+ */
+List *
+PlanStreamModify(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index)
+{
+	return list_make1(root->parse->targetList);
+}
+
+
+/*
+ * sample_skip
+ *
+ * The number of events to skip before the next one that's read when reading a random sample of the
+ * given rate, which is geometrically distributed for independently sampled events
+ */
+static int
+sample_skip(double rate)
+{
+	double u = ((double) random() + 1.0) / ((double) MAX_RANDOM_VALUE + 2.0);
+	double n = floor(log(u) / log(1.0 - rate));
+
+	return n >= INT_MAX ? INT_MAX : (int) n;
+}
+
+/*
+ * start_dedup
+ *
+ * Prepare to drop the events of this batch whose key the current query has recently seen. The query's
+ * filter lives as long as its state does, so it's remembered across batches even if the plan isn't.
+ */
+static void
+start_dedup(StreamScanState *state)
+{
+	ContQueryState *cqs = state->cont_executor->current_query;
+	TupleDesc desc = state->pi->resultdesc;
+	MemoryContext old;
+	int i;
+
+	state->dedup_attno = InvalidAttrNumber;
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (pg_strcasecmp(NameStr(desc->attrs[i]->attname), cqs->query->dedup_key) == 0)
+		{
+			state->dedup_attno = i + 1;
+			break;
+		}
+	}
+
+	if (state->dedup_attno == InvalidAttrNumber)
+		return;
+
+	if (cqs->dedup == NULL || cqs->dedup->window_ms != cqs->query->dedup_window_ms)
+	{
+		old = MemoryContextSwitchTo(cqs->state_cxt);
+		if (cqs->dedup)
+			MemoryContextDelete(cqs->dedup->cxt);
+		cqs->dedup = DedupFilterCreate(cqs->query->dedup_window_ms);
+		MemoryContextSwitchTo(old);
+	}
+
+	DedupFilterRotate(cqs->dedup, GetCurrentTimestamp());
+
+	state->dedup = cqs->dedup;
+	state->dedup_type = lookup_type_cache(desc->attrs[state->dedup_attno - 1]->atttypid, 0);
+}
+
+/*
+ * is_duplicate
+ *
+ * Check if an event with the given key should be dropped. Events with a NULL key never are.
+ */
+static inline bool
+is_duplicate(StreamScanState *state, Datum key, bool isnull)
+{
+	if (state->dedup == NULL || isnull)
+		return false;
+
+	return DedupFilterSeen(state->dedup, key, state->dedup_type);
+}
+
+/*
+ * create_multi_stream_state
+ */
+static MultiStreamState *
+create_multi_stream_state(ContQueryState *cqs, List *relids)
+{
+	MultiStreamState *ms = MemoryContextAllocZero(cqs->state_cxt, sizeof(MultiStreamState));
+	ListCell *lc;
+	int i = 0;
+
+	ms->cxt = AllocSetContextCreate(cqs->state_cxt, "MultiStreamContext",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	ms->batch_cxt = AllocSetContextCreate(ms->cxt, "MultiStreamBatchContext",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	ms->ninputs = list_length(relids);
+	ms->inputs = MemoryContextAllocZero(ms->cxt, sizeof(StreamInput) * ms->ninputs);
+
+	foreach(lc, relids)
+		ms->inputs[i++].relid = lfirst_oid(lc);
+
+	return ms;
+}
+
+/*
+ * get_multi_stream_state
+ *
+ * Get the state of the current query's streams. The first of its scans to read anything in a batch
+ * reads all of the batch's events and splits them between the streams they were written to.
+ */
+static MultiStreamState *
+get_multi_stream_state(StreamScanState *state)
+{
+	ContQueryState *cqs = state->cont_executor->current_query;
+	MultiStreamState *ms;
+	StreamTupleState *sts;
+	MemoryContext old;
+	int len;
+
+	if (cqs->streams == NULL)
+		cqs->streams = create_multi_stream_state(cqs, state->input_relids);
+
+	ms = cqs->streams;
+
+	if (ms->loaded)
+		return ms;
+
+	old = MemoryContextSwitchTo(ms->batch_cxt);
+
+	while ((sts = (StreamTupleState *) ContExecutorYieldNextMessage(state->cont_executor, &len)) != NULL)
+	{
+		int i;
+
+		for (i = 0; i < ms->ninputs; i++)
+		{
+			if (sts->relid != ms->inputs[i].relid)
+				continue;
+
+			ms->inputs[i].pending = lappend(ms->inputs[i].pending, sts);
+			ms->inputs[i].pending_bytes += len;
+			break;
+		}
+	}
+
+	MemoryContextSwitchTo(old);
+
+	ms->loaded = true;
+
+	return ms;
+}
+
+/*
+ * yield_event
+ *
+ * Returns the next event of this batch that this scan reads. Scans of queries reading several streams
+ * only read the events of their own stream.
+ */
+static StreamTupleState *
+yield_event(StreamScanState *state, int *len)
+{
+	StreamInput *input;
+	StreamTupleState *sts;
+
+	if (state->input < 0)
+		return (StreamTupleState *) ContExecutorYieldNextMessage(state->cont_executor, len);
+
+	input = &get_multi_stream_state(state)->inputs[state->input];
+	if (input->pending == NIL)
+		return NULL;
+
+	sts = (StreamTupleState *) linitial(input->pending);
+	input->pending = list_delete_first(input->pending);
+
+	/* the stream's bytes are counted all at once once its first event is read */
+	*len = 0;
+	if (input->pending_bytes)
+	{
+		state->nbytes += input->pending_bytes;
+		input->pending_bytes = 0;
+	}
+
+	return sts;
+}
+
+/*
+ * next_event
+ *
+ * Returns the next event of this batch for the current query, preparing the projection
+ * state for its descriptor
+ */
+static StreamTupleState *
+next_event(StreamScanState *state)
+{
+	StreamTupleState *sts;
+	int len;
+	bytea *piraw;
+	bytea *tupraw;
+	ContQuery *query = state->cont_executor->current_query->query;
+	double rate = query->sample_rate;
+
+	for (;;)
+	{
+		sts = yield_event(state, &len);
+
+		if (sts == NULL)
+			return NULL;
+
+		if (state->ntuples == 0 && query->dedup_key)
+			start_dedup(state);
+
+		if (state->ntuples == 0 && query->max_staleness_ms)
+			state->stale_before = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), -query->max_staleness_ms);
+
+		state->ntuples++;
+		state->nbytes += len;
+
+		/* events that are too old to be worth reading are dropped before anything is decoded */
+		if (query->max_staleness_ms && sts->arrival_time < state->stale_before)
+		{
+			pgstat_increment_cq_stale_drop(1);
+			continue;
+		}
+
+		if (rate == 0)
+			break;
+
+		/* sampled out events are skipped before anything is decoded */
+		if (state->sample_skip < 0)
+			state->sample_skip = sample_skip(rate);
+
+		if (state->sample_skip == 0)
+		{
+			state->sample_skip = sample_skip(rate);
+			break;
+		}
+
+		state->sample_skip--;
+	}
+
+	/*
+	 * Check if the incoming event descriptor is different from the one we're
+	 * currently using before fully unpacking it.
+	 */
+	piraw = state->pi->raweventdesc;
+	tupraw = sts->desc;
+
+	if (piraw == NULL || VARSIZE(piraw) != VARSIZE(tupraw) ||
+			memcmp(VARDATA(piraw), VARDATA(tupraw), VARSIZE(piraw)))
+		init_proj_info(state, sts);
+
+	return sts;
+}
+
+/*
+ * fill_vector
+ *
+ * Decodes the next vector of events and evaluates the vectorized quals over it. Returns
+ * false if there are no events left.
+ */
+static bool
+fill_vector(StreamScanState *state)
+{
+	StreamVector *vec = state->vec;
+
+	vec->nrows = 0;
+	vec->next = 0;
+
+	while (vec->nrows < STREAM_VECTOR_SIZE)
+	{
+		StreamTupleState *sts = next_event(state);
+
+		if (sts == NULL)
+			break;
+
+		decode_event(sts, state, vec->values + vec->nrows, vec->nulls + vec->nrows, STREAM_VECTOR_SIZE);
+
+		/* duplicates are dropped before any quals are evaluated, just like they would be without vectors */
+		if (state->dedup && is_duplicate(state,
+				vec->values[(state->dedup_attno - 1) * STREAM_VECTOR_SIZE + vec->nrows],
+				vec->nulls[(state->dedup_attno - 1) * STREAM_VECTOR_SIZE + vec->nrows]))
+			continue;
+
+		vec->events[vec->nrows++] = sts;
+	}
+
+	if (!vec->nrows)
+		return false;
+
+	StreamVectorEvalQuals(vec, state->vquals);
+
+	return true;
+}
+
+/*
+ * next_vector_tuple
+ *
+ * Stores the next event that passed all of the vectorized quals in the given slot as a virtual
+ * tuple. Returns false if there are no events left.
+ */
+static bool
+next_vector_tuple(StreamScanState *state, TupleTableSlot *slot)
+{
+	StreamVector *vec = state->vec;
+	TupleDesc desc = state->pi->resultdesc;
+	int row;
+	int i;
+
+	for (;;)
+	{
+		if (vec->next == vec->nrows && !fill_vector(state))
+			return false;
+
+		row = vec->next++;
+		if (vec->selected[row])
+			break;
+	}
+
+	current_event = vec->events[row];
+
+	ExecClearTuple(slot);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		slot->tts_values[i] = vec->values[i * STREAM_VECTOR_SIZE + row];
+		slot->tts_isnull[i] = vec->nulls[i * STREAM_VECTOR_SIZE + row];
+	}
+
+	ExecStoreVirtualTuple(slot);
+
+	return true;
+}
+
+/*
+ * decode_join_side
+ *
+ * Decode this batch's events of the scan's side of a stream-stream join, which all of its passes read
+ */
+static void
+decode_join_side(StreamScanState *state, MultiStreamState *ms)
+{
+	StreamInput *side = &ms->inputs[state->input];
+	StreamTupleState *sts;
+
+	side->decoded = true;
+
+	while ((sts = next_event(state)) != NULL)
+	{
+		HeapTuple tup = exec_stream_project(sts, state);
+		MemoryContext old = MemoryContextSwitchTo(ms->batch_cxt);
+		StreamJoinTuple *jt = palloc(sizeof(StreamJoinTuple));
+
+		jt->tup = heap_copytuple(tup);
+		jt->arrival = sts->arrival_time;
+		side->fresh = lappend(side->fresh, jt);
+
+		MemoryContextSwitchTo(old);
+	}
+}
+
+/*
+ * next_join_tuple
+ *
+ * Returns the next tuple the current pass reads from the scan's side of a stream-stream join. The first
+ * pass reads the new tuples of the first stream and the buffered and new tuples of the second one, and
+ * the second pass reads the buffered tuples of the first stream and the new tuples of the second one.
+ */
+static HeapTuple
+next_join_tuple(StreamScanState *state)
+{
+	MultiStreamState *ms = get_multi_stream_state(state);
+	StreamInput *side = &ms->inputs[state->input];
+	bool read_buffered = (ms->pass == 0) == (state->input == 1);
+	bool read_fresh = ms->pass == 0 || state->input == 1;
+
+	if (!side->decoded)
+		decode_join_side(state, ms);
+
+	for (;;)
+	{
+		if (state->join_next)
+		{
+			StreamJoinTuple *jt = (StreamJoinTuple *) lfirst(state->join_next);
+
+			state->join_next = lnext(state->join_next);
+			return jt->tup;
+		}
+
+		switch (state->join_phase)
+		{
+			case 0:
+				if (read_buffered)
+					state->join_next = list_head(side->buffered);
+				break;
+			case 1:
+				if (read_fresh)
+					state->join_next = list_head(side->fresh);
+				break;
+			default:
+				return NULL;
+		}
+
+		state->join_phase++;
+	}
+}
+
+/*
+ * StartStreamJoinPass
+ *
+ * Prepare to execute the second pass of a stream-stream join over the current batch. Returns false if
+ * it wouldn't join anything.
+ */
+bool
+StartStreamJoinPass(ContQueryState *state)
+{
+	MultiStreamState *ms = state->streams;
+	StreamInput *second;
+
+	if (ms == NULL || !state->query->join_window_ms || !ms->loaded || ms->pass > 0 ||
+			ms->inputs[0].buffered == NIL)
+		return false;
+
+	second = &ms->inputs[1];
+	if (second->decoded ? second->fresh == NIL : second->pending == NIL)
+		return false;
+
+	ms->pass = 1;
+
+	return true;
+}
+
+/*
+ * decode_unread_sides
+ *
+ * Decode the events of any join sides whose scans didn't read anything in this batch, which can
+ * happen when the other side of the join turned out to be empty
+ */
+static void
+decode_unread_sides(MultiStreamState *ms, PlanState *planstate)
+{
+	if (planstate == NULL)
+		return;
+
+	if (IsA(planstate, ForeignScanState))
+	{
+		ForeignScanState *fss = (ForeignScanState *) planstate;
+
+		if (IsStream(RelationGetRelid(fss->ss.ss_currentRelation)))
+		{
+			StreamScanState *scan = (StreamScanState *) fss->fdw_state;
+
+			if (scan->input >= 0 && !ms->inputs[scan->input].decoded)
+				decode_join_side(scan, ms);
+		}
+
+		return;
+	}
+	else if (IsA(planstate, SubqueryScanState))
+	{
+		decode_unread_sides(ms, ((SubqueryScanState *) planstate)->subplan);
+		return;
+	}
+
+	decode_unread_sides(ms, planstate->lefttree);
+	decode_unread_sides(ms, planstate->righttree);
+}
+
+/*
+ * buffer_join_side
+ *
+ * Buffer the new events of a side of a stream-stream join for the following batches, and expire the
+ * events that arrived before the given time. The oldest events are also expired when the side's buffer
+ * exceeds continuous_query_stream_join_buffer_size.
+ */
+static void
+buffer_join_side(MultiStreamState *ms, StreamInput *side, TimestampTz expired)
+{
+	Size limit = (Size) continuous_query_stream_join_buffer_size * 1024;
+	MemoryContext old = MemoryContextSwitchTo(ms->cxt);
+	ListCell *lc;
+
+	foreach(lc, side->fresh)
+	{
+		StreamJoinTuple *fresh = (StreamJoinTuple *) lfirst(lc);
+		StreamJoinTuple *jt;
+
+		if (fresh->arrival < expired)
+			continue;
+
+		jt = palloc(sizeof(StreamJoinTuple));
+		jt->tup = heap_copytuple(fresh->tup);
+		jt->arrival = fresh->arrival;
+
+		side->buffered = lappend(side->buffered, jt);
+		side->buffered_bytes += HEAPTUPLESIZE + jt->tup->t_len;
+	}
+
+	MemoryContextSwitchTo(old);
+
+	while (side->buffered)
+	{
+		StreamJoinTuple *jt = (StreamJoinTuple *) linitial(side->buffered);
+
+		if (jt->arrival >= expired && side->buffered_bytes <= limit)
+			break;
+
+		side->buffered_bytes -= HEAPTUPLESIZE + jt->tup->t_len;
+		side->buffered = list_delete_first(side->buffered);
+		heap_freetuple(jt->tup);
+		pfree(jt);
+	}
+}
+
+/*
+ * EndMultiStreamBatch
+ *
+ * Forget the current batch's events of a query reading several streams. The new events of stream-stream
+ * joins are buffered for the following batches first, and the events that arrived longer than the join
+ * window ago are expired. This must be called before the plan is ended.
+ */
+void
+EndMultiStreamBatch(ContQueryState *state, PlanState *planstate)
+{
+	MultiStreamState *ms = state->streams;
+	int i;
+
+	if (ms == NULL || !ms->loaded)
+		return;
+
+	if (state->query->join_window_ms)
+	{
+		TimestampTz expired = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), -state->query->join_window_ms);
+
+		decode_unread_sides(ms, planstate);
+
+		for (i = 0; i < ms->ninputs; i++)
+			buffer_join_side(ms, &ms->inputs[i], expired);
+	}
+
+	for (i = 0; i < ms->ninputs; i++)
+	{
+		ms->inputs[i].pending = NIL;
+		ms->inputs[i].pending_bytes = 0;
+		ms->inputs[i].fresh = NIL;
+		ms->inputs[i].decoded = false;
+	}
+
+	MemoryContextReset(ms->batch_cxt);
+	ms->loaded = false;
+	ms->pass = 0;
+}
+
+/*
+ * store_event
+ *
+ * Stores the given event in the scan's slot without copying it. The queue messages events are read
+ * from are only popped once the batch ends, so events whose attributes are exactly the result's are
+ * stored as they are and deformed by the slot on demand, straight from queue memory. Other events are
+ * decoded into the slot's values.
+ */
+static void
+store_event(StreamTupleState *sts, StreamScanState *node, TupleTableSlot *slot)
+{
+	if (!sts->columns && node->pi->deform->passthrough)
+	{
+		ExecStoreTuple(sts->tup, slot, InvalidBuffer, false);
+		return;
+	}
+
+	ExecClearTuple(slot);
+	decode_event(sts, node, slot->tts_values, slot->tts_isnull, 1);
+	ExecStoreVirtualTuple(slot);
+}
+
+/*
+ * IterateStreamScan
+ */
+TupleTableSlot *
+IterateStreamScan(ForeignScanState *node)
+{
+	StreamTupleState *sts;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+	StreamScanState *state = (StreamScanState *) node->fdw_state;
+	HeapTuple tup;
+
+	current_event = NULL;
+
+	if (state->input >= 0 && state->cont_executor->current_query->query->join_window_ms)
+	{
+		tup = next_join_tuple(state);
+		if (tup == NULL)
+			return NULL;
+
+		ExecStoreTuple(tup, slot, InvalidBuffer, false);
+
+		return slot;
+	}
+
+	if (state->vec)
+		return next_vector_tuple(state, slot) ? slot : NULL;
+
+	for (;;)
+	{
+		Datum key = (Datum) 0;
+		bool isnull = true;
+
+		sts = next_event(state);
+		if (sts == NULL)
+			return NULL;
+
+		store_event(sts, state, slot);
+		current_event = sts;
+
+		if (state->dedup)
+			key = slot_getattr(slot, state->dedup_attno, &isnull);
+
+		if (!is_duplicate(state, key, isnull))
+			break;
+	}
+
+	return slot;
+}
+
+/*
+ * lock_pool_worker_queue
+ *
+ * Lock a worker queue of the given pool to write stream inserts to
+ */
+static ipc_queue *
+lock_pool_worker_queue(int pool)
+{
+	/*
+	 * We always write to the same worker from a combiner process to prevent
+	 * unnecessary reordering
+	 */
+	if (IsContQueryCombinerProcess())
+	{
+		int first;
+		int nworkers;
+
+		GetWorkerPoolWorkers(pool, &first, &nworkers);
+
+		return get_worker_queue_with_lock(first + MyContQueryProc->group_id % nworkers, false);
+	}
+
+	return get_any_worker_queue_with_lock(pool);
+}
+
+/*
+ * BeginStreamModify
+ */
+void
+BeginStreamModify(ModifyTableState *mtstate, ResultRelInfo *result_info,
+						   List *fdw_private, int subplan_index, int eflags)
+{
+	Relation stream = result_info->ri_RelationDesc;
+	Oid streamid = RelationGetRelid(stream);
+	StreamInsertState *sis = palloc0(sizeof(StreamInsertState));
+	Bitmapset *targets = GetStreamInsertTargets(stream);
+	Bitmapset **pool_targets = GetStreamPoolTargets(stream);
+	InsertBatchAck *ack = NULL;
+	InsertBatch *batch = NULL;
+	List *insert_tl = NIL;
+
+	if (fdw_private)
+		insert_tl = linitial(fdw_private);
+
+	if (!bms_is_empty(targets))
+	{
+		ActivateContQueryDatabase();
+
+		if (synchronous_stream_insert)
+		{
+			batch = InsertBatchCreate();
+			ack = palloc0(sizeof(InsertBatchAck));
+
+			ack->batch_id = batch->id;
+			ack->batch = batch;
+			ack->client_batch_id = StreamBatchCurrentId();
+		}
+
+		/* start out with the first pool any of the targets are in */
+		sis->worker_pool = DEFAULT_WORKER_POOL;
+		while (pool_targets && bms_is_empty(pool_targets[sis->worker_pool]))
+			sis->worker_pool++;
+
+		sis->worker_queue = lock_pool_worker_queue(sis->worker_pool);
+
+		Assert(sis->worker_queue);
+	}
+
+	sis->flags = eflags;
+	sis->targets = targets;
+	sis->pool_targets = pool_targets;
+	sis->ack = ack;
+	sis->batch = batch;
+	sis->count = 0;
+	sis->bytes = 0;
+	sis->num_batches = 1;
+
+	if (is_inferred_stream_relation(stream))
+	{
+		Assert(insert_tl);
+		sis->desc = ExecTypeFromTL(insert_tl, false);
 	}
 	else
 	{
 		sis->desc = RelationGetDescr(stream);
 	}
 
-	sis->packed_desc = PackTupleDesc(sis->desc);
+	if (sis->worker_queue)
+	{
+		TupleDesc read_desc;
+
+		if (!(eflags & REENTRANT_STREAM_INSERT))
+			sis->log = StreamLogBeginWrite(stream, sis->desc, batch, ack ? ack->client_batch_id : 0);
+
+		/* JSON fields are extracted first, so that filters and readers see them like any other column */
+		sis->json = BeginStreamJsonExtract(stream, sis->desc);
+
+		/* filters are evaluated on the events as they're inserted, before any columns are stripped */
+		sis->filter = BeginStreamFilter(stream, sis->desc, targets);
+
+		read_desc = GetStreamReadDesc(stream, sis->desc);
+
+		if (read_desc)
+		{
+			sis->read_map = convert_tuples_by_name(sis->desc, read_desc,
+					gettext_noop("could not prune stream event"));
+			sis->desc = read_desc;
+		}
+	}
+
+	sis->relid = streamid;
+	sis->packed_desc = PackStreamTupleDesc(streamid, sis->desc);
+	sis->routing_attr = InvalidAttrNumber;
+	sis->worker_idx = -1;
+
+	if (sis->worker_queue && GetDatabaseNumWorkers() > 1 && !IsContQueryProcess())
+		sis->routing_attr = GetStreamRoutingAttr(stream, sis->desc);
 
 	result_info->ri_FdwState = sis;
 }
 
 /*
- * ExecStreamInsert
+ * insert_into_pool
+ *
+ * Write an event for the given targets to a worker queue of the given pool, switching queues if the one
+ * we're holding is in another pool. Only one queue is ever locked at a time, so that backends writing to
+ * several pools can't deadlock on each other's queues. Returns the number of bytes written, or 0 if the
+ * event was shed.
  */
-TupleTableSlot *
-ExecStreamInsert(EState *estate, ResultRelInfo *result_info,
-						  TupleTableSlot *slot, TupleTableSlot *planSlot)
+static int
+insert_into_pool(StreamInsertState *sis, int pool, HeapTuple tup, Bitmapset *targets)
 {
-	StreamInsertState *sis = (StreamInsertState *) result_info->ri_FdwState;
-	HeapTuple tup = ExecMaterializeSlot(slot);
 	StreamTupleState *sts;
+	int first;
+	int nqueues;
 	int len;
+	bool spilled;
 
-	sts = StreamTupleStateCreate(tup, sis->desc, sis->packed_desc, sis->targets, sis->ack, sis->ack ? 1 : 0, &len);
+	Assert(sis->worker_queue);
 
-	if (sis->worker_queue)
+	sts = StreamTupleStateCreate(sis->relid, tup, sis->desc, sis->packed_desc, targets, sis->ack, sis->ack ? 1 : 0, &len);
+
+	GetWorkerPoolWorkers(pool, &first, &nqueues);
+
+	/*
+	 * Routed tuples always go to the worker their key hashes to. Otherwise, if we've written
+	 * a batch to a worker process, start writing to the next worker process.
+	 */
+	if (AttributeNumberIsValid(sis->routing_attr))
 	{
-		/*
-		 * If we've written a batch to a worker process, start writing to
-		 * the next worker process.
-		 */
-		if (sis->count && (sis->count % continuous_query_batch_size == 0))
+		int idx = GetStreamRoutingWorker(pool, sis->desc, sis->routing_attr, tup);
+
+		if (idx != sis->worker_idx)
 		{
 			ipc_queue_unlock(sis->worker_queue);
-			sis->worker_queue = get_any_worker_queue_with_lock();
+			sis->worker_queue = get_worker_queue_with_lock(idx, false);
+			sis->worker_idx = idx;
 			sis->num_batches++;
 		}
 
-		if (!ipc_queue_push_nolock(sis->worker_queue, sts, len, false))
+		nqueues = 1;
+	}
+	else if (pool != sis->worker_pool)
+	{
+		ipc_queue_unlock(sis->worker_queue);
+		sis->worker_queue = lock_pool_worker_queue(pool);
+		sis->num_batches++;
+	}
+	else if (sis->count && (sis->count % continuous_query_batch_size == 0))
+	{
+		ipc_queue_unlock(sis->worker_queue);
+		sis->worker_queue = get_any_worker_queue_with_lock(pool);
+		sis->num_batches++;
+	}
+
+	sis->worker_pool = pool;
+
+	if (StreamBackpressureShouldShed(sis->worker_queue))
+	{
+		pfree(sts);
+		return 0;
+	}
+
+	/* Keep spilling while the queue has spilled slots so that they're consumed in order */
+	spilled = ipc_queue_has_spill(sis->worker_queue) &&
+			StreamBackpressureSpill(sis->worker_queue, &sts, &len, 1);
+
+	if (!spilled && !ipc_queue_push_nolock(sis->worker_queue, sts, len, false))
+	{
+		int ntries = 0;
+		TimestampTz since = 0;
+		bool block = stream_insert_backpressure == STREAM_BACKPRESSURE_BLOCK &&
+				stream_insert_backpressure_timeout == 0;
+		sis->num_batches++;
+
+		do
 		{
-			int ntries = 0;
-			sis->num_batches++;
+			ntries++;
 
-			do
+			if (ntries >= nqueues && StreamBackpressureSpill(sis->worker_queue, &sts, &len, 1))
+				break;
+
+			/* All queues are full, so apply the backpressure policy unless we can just block on the queue */
+			if (ntries >= nqueues && !block && !StreamBackpressureWait(&since))
 			{
-				ntries++;
-				ipc_queue_unlock(sis->worker_queue);
-				sis->worker_queue = get_any_worker_queue_with_lock();
+				pfree(sts);
+				return 0;
 			}
-			while (!ipc_queue_push_nolock(sis->worker_queue, sts, len, ntries == continuous_query_num_workers));
-		}
 
+			ipc_queue_unlock(sis->worker_queue);
+			if (AttributeNumberIsValid(sis->routing_attr))
+				sis->worker_queue = get_worker_queue_with_lock(sis->worker_idx, false);
+			else
+				sis->worker_queue = get_any_worker_queue_with_lock(pool);
+		}
+		while (!ipc_queue_push_nolock(sis->worker_queue, sts, len, block && ntries >= nqueues));
 	}
 
 	pfree(sts);
 
+	return len;
+}
+
+/*
+ * ExecStreamInsert
+ */
+TupleTableSlot *
+ExecStreamInsert(EState *estate, ResultRelInfo *result_info,
+						  TupleTableSlot *slot, TupleTableSlot *planSlot)
+{
+	StreamInsertState *sis = (StreamInsertState *) result_info->ri_FdwState;
+	HeapTuple tup = ExecMaterializeSlot(slot);
+	HeapTuple orig = tup;
+	Bitmapset *targets = sis->targets;
+	MemoryContext old;
+	int len = 0;
+
+	/* the filtered targets and pruned tuple are freed along with the rest of this row's state */
+	old = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+
+	if (sis->json)
+		tup = StreamJsonExtract(sis->json, tup);
+
+	if (sis->filter)
+		targets = StreamFilterTargets(sis->filter, tup);
+
+	if (sis->read_map && targets)
+		tup = do_convert_tuple(tup, sis->read_map);
+
+	MemoryContextSwitchTo(old);
+
+	/* nobody wants this event */
+	if (targets == NULL)
+		return slot;
+
+	/* a batch written by an earlier statement is dropped as a whole */
+	if (!sis->batch_claimed)
+	{
+		sis->batch_dropped = !StreamBatchClaim();
+		sis->batch_claimed = true;
+	}
+
+	if (sis->batch_dropped)
+		return slot;
+
+	if (sis->pool_targets == NULL)
+		len = insert_into_pool(sis, DEFAULT_WORKER_POOL, tup, targets);
+	else
+	{
+		int npools = 0;
+		int pool;
+
+		/* each pool that gets the event acks it, so synchronous inserts wait for an extra ack per pool */
+		for (pool = 0; pool < GetNumWorkerPools(); pool++)
+		{
+			Bitmapset *ptargets;
+			int n;
+
+			old = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+			ptargets = bms_intersect(targets, sis->pool_targets[pool]);
+			MemoryContextSwitchTo(old);
+
+			if (bms_is_empty(ptargets))
+				continue;
+
+			n = insert_into_pool(sis, pool, tup, ptargets);
+			if (n == 0)
+				continue;
+
+			if (npools++ && sis->batch)
+				InsertBatchIncrementNumWTuples(sis->batch, 1);
+
+			len += n;
+		}
+	}
+
+	/* the event was shed */
+	if (len == 0)
+		return slot;
+
+	if (sis->log)
+	{
+		old = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+		StreamLogWriteTuple(sis->log, orig);
+		MemoryContextSwitchTo(old);
+	}
+
 	sis->count++;
 	sis->bytes += len;
 
@@ -604,10 +2283,18 @@ EndStreamModify(EState *estate, ResultRelInfo *result_info)
 
 	pgstat_increment_stream_insert(RelationGetRelid(result_info->ri_RelationDesc), sis->count, sis->num_batches, sis->bytes);
 
+	if (sis->filter)
+		EndStreamFilter(sis->filter);
+
+	if (sis->json)
+		EndStreamJsonExtract(sis->json);
+
 	if (sis->worker_queue)
 	{
 		ipc_queue_unlock(sis->worker_queue);
-		if (!(sis->flags & REENTRANT_STREAM_INSERT) && synchronous_stream_insert)
-			InsertBatchWaitAndRemove(sis->batch, sis->count);
+		if (sis->log)
+			StreamLogEndWrite(sis->log, sis->count);
+		else if (!(sis->flags & REENTRANT_STREAM_INSERT) && synchronous_stream_insert)
+			InsertBatchWaitOrDefer(sis->batch, sis->count);
 	}
 }
@@ -0,0 +1,524 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_json.c
+ *
+ *	  Extraction of declared JSON fields into typed stream columns
+ *
+ * A typed stream may declare which fields of its JSON columns its readers use, as in
+ *
+ *   CREATE STREAM s (payload json, x integer, name text)
+ *     OPTIONS (json_fields 'x = payload.x, name = payload.user.name')
+ *
+ * Each field maps a path of object keys, starting with the json, jsonb or text column holding
+ * the document, to a column of the stream. Events are extracted into those columns as they're
+ * inserted, so that each document is parsed once, only the declared paths are read from it and
+ * views read typed columns instead of parsing the document in their own expressions. Columns an
+ * event already has a value for are left alone, and fields that aren't in the document are NULL.
+ * Readers that only read the extracted columns don't get the document at all, since it's pruned
+ * from events along with every other column nobody reads.
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * src/backend/pipeline/stream_json.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <ctype.h>
+
+#include "access/htup_details.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "fmgr.h"
+#include "foreign/foreign.h"
+#include "lib/stringinfo.h"
+#include "pipeline/stream_json.h"
+#include "utils/builtins.h"
+#include "utils/jsonapi.h"
+#include "utils/jsonb.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+typedef struct StreamJsonField
+{
+	/* the attribute the field is extracted into and the attribute holding its document */
+	int attno;
+	int source;
+	/* path of object keys to the field within the document */
+	int nkeys;
+	char **keys;
+	/* input function of the attribute's type, which the field's text is read in with */
+	FmgrInfo infn;
+	Oid ioparam;
+	int32 typmod;
+} StreamJsonField;
+
+struct StreamJsonState
+{
+	MemoryContext cxt;
+	TupleDesc desc;
+	int nfields;
+	StreamJsonField *fields;
+	Datum *values;
+	bool *nulls;
+	/* text of each field extracted from the current event, or NULL if it isn't there */
+	char **texts;
+	bool *found;
+};
+
+/* State of the parse of a json or text document */
+typedef struct JsonExtractState
+{
+	JsonLexContext *lex;
+	StreamJsonState *state;
+	int source;
+	/* number of leading keys of each field's path that lead to where the parser is */
+	int *matched;
+	/* where the value of each field whose whole path matched starts */
+	char **starts;
+} JsonExtractState;
+
+/*
+ * get_json_fields_option
+ */
+static char *
+get_json_fields_option(Relation stream)
+{
+	ForeignTable *ft = GetForeignTable(RelationGetRelid(stream));
+	ListCell *lc;
+
+	foreach(lc, ft->options)
+	{
+		DefElem *def = (DefElem *) lfirst(lc);
+
+		if (pg_strcasecmp(def->defname, STREAM_JSON_FIELDS_OPTION) == 0)
+			return defGetString(def);
+	}
+
+	return NULL;
+}
+
+/*
+ * trim
+ *
+ * Strips leading and trailing whitespace from the given string in place
+ */
+static char *
+trim(char *str)
+{
+	char *end;
+
+	while (isspace((unsigned char) *str))
+		str++;
+
+	end = str + strlen(str);
+	while (end > str && isspace((unsigned char) end[-1]))
+		end--;
+	*end = '\0';
+
+	return str;
+}
+
+/*
+ * find_attr
+ */
+static int
+find_attr(TupleDesc desc, char *name)
+{
+	int i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (!desc->attrs[i]->attisdropped && pg_strcasecmp(NameStr(desc->attrs[i]->attname), name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * parse_field
+ *
+ * Parses a "column = source.key[.key ...]" entry of the json_fields option
+ */
+static void
+parse_field(Relation stream, TupleDesc desc, char *entry, StreamJsonField *field)
+{
+	char *eq = strchr(entry, '=');
+	char *path;
+	char *key;
+	List *keys = NIL;
+	Form_pg_attribute attr;
+	Oid source_type;
+	Oid infn;
+	ListCell *lc;
+	int i = 0;
+
+	if (eq == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("invalid %s entry \"%s\" for stream \"%s\"", STREAM_JSON_FIELDS_OPTION,
+						entry, RelationGetRelationName(stream)),
+				errhint("Entries look like \"column = source_column.key.key\".")));
+
+	*eq = '\0';
+	path = eq + 1;
+
+	field->attno = find_attr(desc, trim(entry));
+	if (field->attno < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_COLUMN),
+				errmsg("column \"%s\" of %s does not exist in stream \"%s\"", trim(entry),
+						STREAM_JSON_FIELDS_OPTION, RelationGetRelationName(stream))));
+
+	for (key = strtok(path, "."); key != NULL; key = strtok(NULL, "."))
+		keys = lappend(keys, pstrdup(trim(key)));
+
+	if (list_length(keys) < 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("%s path of column \"%s\" must start with a column followed by at least one key",
+						STREAM_JSON_FIELDS_OPTION, NameStr(desc->attrs[field->attno]->attname))));
+
+	field->source = find_attr(desc, (char *) linitial(keys));
+	if (field->source < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_COLUMN),
+				errmsg("column \"%s\" of %s does not exist in stream \"%s\"", (char *) linitial(keys),
+						STREAM_JSON_FIELDS_OPTION, RelationGetRelationName(stream))));
+
+	source_type = desc->attrs[field->source]->atttypid;
+	if (source_type != JSONOID && source_type != JSONBOID && source_type != TEXTOID)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				errmsg("column \"%s\" of %s must be of type json, jsonb or text",
+						NameStr(desc->attrs[field->source]->attname), STREAM_JSON_FIELDS_OPTION)));
+
+	if (field->source == field->attno)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("column \"%s\" can't be extracted from itself", NameStr(desc->attrs[field->attno]->attname))));
+
+	field->nkeys = list_length(keys) - 1;
+	field->keys = palloc(sizeof(char *) * field->nkeys);
+	for_each_cell(lc, lnext(list_head(keys)))
+		field->keys[i++] = (char *) lfirst(lc);
+
+	attr = desc->attrs[field->attno];
+	getTypeInputInfo(attr->atttypid, &infn, &field->ioparam);
+	fmgr_info(infn, &field->infn);
+	field->typmod = attr->atttypmod;
+}
+
+/*
+ * BeginStreamJsonExtract
+ *
+ * Prepare to extract the declared JSON fields of events of the given stream described by desc.
+ * Returns NULL if the stream doesn't declare any, or its events aren't laid out like the stream.
+ */
+StreamJsonState *
+BeginStreamJsonExtract(Relation stream, TupleDesc desc)
+{
+	TupleDesc reldesc = RelationGetDescr(stream);
+	StreamJsonState *state;
+	MemoryContext old;
+	char *option;
+	char *entry;
+	List *entries = NIL;
+	ListCell *lc;
+	int i = 0;
+
+	if (stream->rd_rel->relkind != RELKIND_STREAM)
+		return NULL;
+
+	option = get_json_fields_option(stream);
+	if (option == NULL)
+		return NULL;
+
+	/* fields are declared in terms of the stream's attributes */
+	if (desc->natts != reldesc->natts)
+		return NULL;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (desc->attrs[i]->atttypid != reldesc->attrs[i]->atttypid)
+			return NULL;
+	}
+
+	state = palloc0(sizeof(StreamJsonState));
+	state->cxt = AllocSetContextCreate(CurrentMemoryContext, "StreamJsonState",
+			ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE);
+
+	old = MemoryContextSwitchTo(state->cxt);
+
+	option = pstrdup(option);
+	for (entry = strtok(option, ","); entry != NULL; entry = strtok(NULL, ","))
+		entries = lappend(entries, pstrdup(entry));
+
+	state->desc = reldesc;
+	state->nfields = list_length(entries);
+	state->fields = palloc0(sizeof(StreamJsonField) * Max(state->nfields, 1));
+
+	i = 0;
+	foreach(lc, entries)
+		parse_field(stream, reldesc, (char *) lfirst(lc), &state->fields[i++]);
+
+	state->values = palloc(sizeof(Datum) * desc->natts);
+	state->nulls = palloc(sizeof(bool) * desc->natts);
+	state->texts = palloc(sizeof(char *) * Max(state->nfields, 1));
+	state->found = palloc(sizeof(bool) * Max(state->nfields, 1));
+
+	MemoryContextSwitchTo(old);
+
+	return state;
+}
+
+/*
+ * extract_field_start
+ */
+static void
+extract_field_start(void *arg, char *fname, bool isnull)
+{
+	JsonExtractState *es = (JsonExtractState *) arg;
+	StreamJsonState *state = es->state;
+	int level = es->lex->lex_level;
+	int i;
+
+	for (i = 0; i < state->nfields; i++)
+	{
+		StreamJsonField *field = &state->fields[i];
+
+		if (field->source != es->source || es->matched[i] != level - 1 || level > field->nkeys)
+			continue;
+
+		if (strcmp(field->keys[level - 1], fname) != 0)
+			continue;
+
+		es->matched[i] = level;
+		if (level == field->nkeys)
+			es->starts[i] = es->lex->token_start;
+	}
+}
+
+/*
+ * extract_field_end
+ */
+static void
+extract_field_end(void *arg, char *fname, bool isnull)
+{
+	JsonExtractState *es = (JsonExtractState *) arg;
+	StreamJsonState *state = es->state;
+	int level = es->lex->lex_level;
+	int i;
+
+	for (i = 0; i < state->nfields; i++)
+	{
+		StreamJsonField *field = &state->fields[i];
+
+		if (field->source != es->source || es->matched[i] != level)
+			continue;
+
+		/* scalars are taken in extract_scalar, and only the first of duplicate keys is used */
+		if (level == field->nkeys && !state->found[i])
+		{
+			state->found[i] = true;
+			if (!isnull)
+				state->texts[i] = pnstrdup(es->starts[i], es->lex->prev_token_terminator - es->starts[i]);
+		}
+
+		es->matched[i] = level - 1;
+	}
+}
+
+/*
+ * extract_scalar
+ */
+static void
+extract_scalar(void *arg, char *token, JsonTokenType tokentype)
+{
+	JsonExtractState *es = (JsonExtractState *) arg;
+	StreamJsonState *state = es->state;
+	int level = es->lex->lex_level;
+	int i;
+
+	for (i = 0; i < state->nfields; i++)
+	{
+		StreamJsonField *field = &state->fields[i];
+
+		if (field->source != es->source || es->matched[i] != level || level != field->nkeys || state->found[i])
+			continue;
+
+		state->found[i] = true;
+		if (tokentype != JSON_TOKEN_NULL)
+			state->texts[i] = pstrdup(token);
+	}
+}
+
+/*
+ * extract_json
+ *
+ * Extracts the fields of the given json or text document, parsing it once for all of them
+ */
+static void
+extract_json(StreamJsonState *state, int source, text *doc)
+{
+	JsonExtractState es;
+	JsonSemAction sem;
+
+	MemSet(&es, 0, sizeof(JsonExtractState));
+	es.lex = makeJsonLexContext(doc, true);
+	es.state = state;
+	es.source = source;
+	es.matched = palloc0(sizeof(int) * state->nfields);
+	es.starts = palloc0(sizeof(char *) * state->nfields);
+
+	MemSet(&sem, 0, sizeof(JsonSemAction));
+	sem.semstate = &es;
+	sem.object_field_start = extract_field_start;
+	sem.object_field_end = extract_field_end;
+	sem.scalar = extract_scalar;
+
+	pg_parse_json(es.lex, &sem);
+}
+
+/*
+ * extract_jsonb
+ *
+ * Extracts the fields of the given jsonb document by looking up each of their paths
+ */
+static void
+extract_jsonb(StreamJsonState *state, int source, Jsonb *doc)
+{
+	int i;
+
+	for (i = 0; i < state->nfields; i++)
+	{
+		StreamJsonField *field = &state->fields[i];
+		JsonbContainer *container = &doc->root;
+		JsonbValue *v = NULL;
+		int j;
+
+		if (field->source != source)
+			continue;
+
+		for (j = 0; j < field->nkeys; j++)
+		{
+			JsonbValue key;
+
+			if (!(container->header & JB_FOBJECT))
+			{
+				v = NULL;
+				break;
+			}
+
+			key.type = jbvString;
+			key.val.string.val = field->keys[j];
+			key.val.string.len = strlen(field->keys[j]);
+
+			v = findJsonbValueFromContainer(container, JB_FOBJECT, &key);
+			if (v == NULL)
+				break;
+
+			if (v->type == jbvBinary)
+				container = v->val.binary.data;
+			else if (j < field->nkeys - 1)
+			{
+				v = NULL;
+				break;
+			}
+		}
+
+		if (v == NULL)
+			continue;
+
+		state->found[i] = true;
+
+		switch (v->type)
+		{
+			case jbvNull:
+				break;
+			case jbvString:
+				state->texts[i] = pnstrdup(v->val.string.val, v->val.string.len);
+				break;
+			case jbvNumeric:
+				state->texts[i] = DatumGetCString(DirectFunctionCall1(numeric_out, NumericGetDatum(v->val.numeric)));
+				break;
+			case jbvBool:
+				state->texts[i] = pstrdup(v->val.boolean ? "true" : "false");
+				break;
+			default:
+				state->texts[i] = JsonbToCString(NULL, v->val.binary.data, v->val.binary.len);
+				break;
+		}
+	}
+}
+
+/*
+ * StreamJsonExtract
+ *
+ * Returns the given event with its declared JSON fields extracted into their columns, or the event
+ * itself if there's nothing to extract. The result is allocated in the current memory context.
+ */
+HeapTuple
+StreamJsonExtract(StreamJsonState *state, HeapTuple tup)
+{
+	bool extracted = false;
+	int i;
+	int j;
+
+	heap_deform_tuple(tup, state->desc, state->values, state->nulls);
+
+	MemSet(state->texts, 0, sizeof(char *) * state->nfields);
+	MemSet(state->found, 0, sizeof(bool) * state->nfields);
+
+	for (i = 0; i < state->nfields; i++)
+	{
+		StreamJsonField *field = &state->fields[i];
+		bool parsed = false;
+
+		/* each document is parsed once, for all of the fields it has that the event doesn't have yet */
+		for (j = 0; j < i; j++)
+		{
+			if (state->fields[j].source == field->source && state->nulls[state->fields[j].attno])
+				parsed = true;
+		}
+
+		if (parsed || !state->nulls[field->attno] || state->nulls[field->source])
+			continue;
+
+		if (state->desc->attrs[field->source]->atttypid == JSONBOID)
+			extract_jsonb(state, field->source, DatumGetJsonb(state->values[field->source]));
+		else
+			extract_json(state, field->source, DatumGetTextP(state->values[field->source]));
+	}
+
+	for (i = 0; i < state->nfields; i++)
+	{
+		StreamJsonField *field = &state->fields[i];
+
+		if (!state->nulls[field->attno] || state->texts[i] == NULL)
+			continue;
+
+		state->values[field->attno] = InputFunctionCall(&field->infn, state->texts[i], field->ioparam, field->typmod);
+		state->nulls[field->attno] = false;
+		extracted = true;
+	}
+
+	if (!extracted)
+		return tup;
+
+	return heap_form_tuple(state->desc, state->values, state->nulls);
+}
+
+/*
+ * EndStreamJsonExtract
+ */
+void
+EndStreamJsonExtract(StreamJsonState *state)
+{
+	MemoryContextDelete(state->cxt);
+	pfree(state);
+}
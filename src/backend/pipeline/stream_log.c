@@ -0,0 +1,1206 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_log.c
+ *
+ *	  Write-ahead log of stream inserts, for replaying them after a restart
+ *
+ * Events waiting in the worker queues only live in shared memory, so they're lost when the server
+ * restarts. With stream_log on, every stream write made by a client is also appended to its
+ * database's stream log in $PGDATA/pg_stream_log/<database oid>, and the log is flushed to disk
+ * before the write returns. Writes don't wait for their events to be consumed then: the log holds on
+ * to their InsertBatch instead, and frees it once it's been acked.
+ *
+ * A log is made of STREAM_LOG_SEGMENT_SIZE segments named after their number, each holding whole
+ * records. A record holds up to STREAM_LOG_RECORD_SIZE bytes worth of events of a single write:
+ *
+ *   StreamLogRecordHeader
+ *   StreamLogAttr    for each of the columns of the events
+ *   uint32           length of each event's tuple, followed by the tuple
+ *
+ * Backends flushing the log at the same time share a single fsync. The committed position of a log
+ * is the start of the oldest batch whose events haven't all been acked yet, and it's persisted to
+ * the log's control file at most every STREAM_LOG_PERSIST_INTERVAL_MS, at which point the segments
+ * before it are removed. When the server starts, the records between the committed position and the
+ * end of the log are written to the continuous queries again by the database's adhoc vacuumer, the
+ * first continuous query process to run once a database is started.
+ *
+ * Events may thus be consumed twice if the server restarts before their consumption was persisted.
+ * Writes made with stream_insert_batch_id aren't though, since the batches the combiners recorded
+ * aren't replayed. Batches are acked through the InsertBatchAck of their events, so the log can
+ * only be used along with synchronous_stream_insert.
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * src/backend/pipeline/stream_log.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/tupconvert.h"
+#include "access/tuptoaster.h"
+#include "access/xact.h"
+#include "catalog/pipeline_stream_batch_fn.h"
+#include "catalog/pipeline_stream_fn.h"
+#include "miscadmin.h"
+#include "pipeline/cont_scheduler.h"
+#include "pipeline/stream.h"
+#include "pipeline/stream_log.h"
+#include "port/pg_crc32c.h"
+#include "storage/fd.h"
+#include "storage/lwlock.h"
+#include "storage/shm_alloc.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/timestamp.h"
+
+#define STREAM_LOG_DIR "pg_stream_log"
+
+/* records are cut once they hold this many bytes of events */
+#define STREAM_LOG_RECORD_SIZE (1024 * 1024)
+
+/* the committed position is persisted at most this often */
+#define STREAM_LOG_PERSIST_INTERVAL_MS 1000
+
+#define STREAM_LOG_SLEEP_MS 5
+
+/* guc parameter */
+bool stream_log = false;
+
+#define StreamLogActive() (stream_log && synchronous_stream_insert)
+
+typedef struct StreamLogRecordHeader
+{
+	uint32 len; /* of the whole record, including this header */
+	pg_crc32c crc; /* of everything following it */
+	Oid relid;
+	int32 ntups;
+	int64 batch_id; /* the stream_insert_batch_id the events were written with, 0 if none */
+	int32 natts;
+} StreamLogRecordHeader;
+
+#define STREAM_LOG_CRC_START (offsetof(StreamLogRecordHeader, crc) + sizeof(pg_crc32c))
+
+typedef struct StreamLogAttr
+{
+	Oid type;
+	int32 typmod;
+	NameData name;
+} StreamLogAttr;
+
+typedef struct StreamLogControl
+{
+	uint64 committed;
+	pg_crc32c crc;
+} StreamLogControl;
+
+/* A batch written to the log whose events may not have been consumed yet */
+typedef struct StreamLogBatch
+{
+	uint64 start; /* position of the batch's first record */
+	InsertBatch *batch;
+	bool sealed; /* all of the batch's records have been written and flushed */
+	bool used;
+} StreamLogBatch;
+
+typedef struct StreamLog
+{
+	Oid dbid; /* hash key --- MUST BE FIRST */
+	bool loaded;
+	uint64 write_pos; /* end of the last record written */
+	uint64 flush_pos; /* everything before this has been flushed */
+	uint64 committed_pos; /* everything before this has been consumed */
+	uint64 persisted_pos; /* committed position in the control file */
+	TimestampTz persisted_at;
+	uint64 replay_pos; /* next record written before the restart to replay */
+	uint64 replay_end; /* end of the records written before the restart */
+	int nbatches;
+	StreamLogBatch batches[STREAM_LOG_MAX_BATCHES];
+} StreamLog;
+
+struct StreamLogWriter
+{
+	InsertBatch *batch;
+	TupleDesc desc; /* of the logged events */
+	TupleConversionMap *map; /* strips dropped columns from the written events, if there are any */
+	StringInfoData buf; /* the record being built */
+	int header_len; /* of its header and columns */
+	int ntups;
+	StreamLog *log;
+	int slot; /* the batch's slot in the log, -1 until its first record is written */
+	uint64 end; /* of its last record */
+};
+
+static HTAB *StreamLogs = NULL;
+
+/* slots of the batches this backend is writing, which are sealed if the writes fail */
+static List *open_slots = NIL;
+
+static int write_fd = -1;
+static uint64 write_segno = 0;
+
+static int read_fd = -1;
+static uint64 read_segno = 0;
+
+/*
+ * StreamLogShmemSize
+ */
+Size
+StreamLogShmemSize(void)
+{
+	if (!StreamLogActive())
+		return 0;
+
+	return hash_estimate_size(STREAM_LOG_MAX_DATABASES, sizeof(StreamLog));
+}
+
+/*
+ * StreamLogShmemInit
+ */
+void
+StreamLogShmemInit(void)
+{
+	HASHCTL ctl;
+
+	if (!stream_log)
+		return;
+
+	if (!synchronous_stream_insert)
+	{
+		if (!IsUnderPostmaster)
+			ereport(WARNING,
+					(errmsg("stream_log has no effect without synchronous_stream_insert")));
+		return;
+	}
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(StreamLog);
+
+	StreamLogs = ShmemInitHash("StreamLogs", STREAM_LOG_MAX_DATABASES, STREAM_LOG_MAX_DATABASES,
+			&ctl, HASH_ELEM | HASH_BLOBS);
+}
+
+static void
+log_dir_path(char *path, Oid dbid)
+{
+	snprintf(path, MAXPGPATH, STREAM_LOG_DIR "/%u", dbid);
+}
+
+static void
+segment_path(char *path, Oid dbid, uint64 segno)
+{
+	snprintf(path, MAXPGPATH, STREAM_LOG_DIR "/%u/%08X%08X", dbid, (uint32) (segno >> 32), (uint32) segno);
+}
+
+static void
+control_path(char *path, Oid dbid, bool tmp)
+{
+	snprintf(path, MAXPGPATH, STREAM_LOG_DIR "/%u/committed%s", dbid, tmp ? ".tmp" : "");
+}
+
+/*
+ * trim_segments
+ *
+ * Remove the segments of the given database's log outside of [from, to]. Returns false if no segments
+ * are left, and sets *oldest to the oldest one left otherwise.
+ */
+static bool
+trim_segments(Oid dbid, uint64 from, uint64 to, uint64 *oldest)
+{
+	char dir[MAXPGPATH];
+	DIR *d;
+	struct dirent *de;
+	bool found = false;
+
+	log_dir_path(dir, dbid);
+	d = AllocateDir(dir);
+
+	while ((de = ReadDir(d, dir)) != NULL)
+	{
+		uint32 hi;
+		uint32 lo;
+		uint64 segno;
+
+		if (strlen(de->d_name) != 16 || strspn(de->d_name, "0123456789ABCDEF") != 16 ||
+				sscanf(de->d_name, "%08X%08X", &hi, &lo) != 2)
+			continue;
+
+		segno = ((uint64) hi << 32) | lo;
+
+		if (segno < from || segno > to)
+		{
+			char path[MAXPGPATH];
+
+			segment_path(path, dbid, segno);
+			if (unlink(path) < 0 && errno != ENOENT)
+				ereport(WARNING,
+						(errcode_for_file_access(),
+						 errmsg("could not remove stream log segment \"%s\": %m", path)));
+			continue;
+		}
+
+		if (!found || segno < *oldest)
+			*oldest = segno;
+		found = true;
+	}
+
+	FreeDir(d);
+
+	return found;
+}
+
+/*
+ * read_at
+ *
+ * Read len bytes of the given database's log at pos into buf, returning false if they aren't all there
+ */
+static bool
+read_at(Oid dbid, uint64 pos, char *buf, int len)
+{
+	uint64 segno = pos / STREAM_LOG_SEGMENT_SIZE;
+	char path[MAXPGPATH];
+	int n;
+
+	segment_path(path, dbid, segno);
+
+	if (read_fd < 0 || read_segno != segno)
+	{
+		if (read_fd >= 0)
+			close(read_fd);
+
+		read_fd = BasicOpenFile(path, O_RDONLY | PG_BINARY, 0);
+		if (read_fd < 0)
+		{
+			if (errno == ENOENT)
+				return false;
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open stream log segment \"%s\": %m", path)));
+		}
+
+		read_segno = segno;
+	}
+
+	if (lseek(read_fd, pos % STREAM_LOG_SEGMENT_SIZE, SEEK_SET) < 0 || (n = read(read_fd, buf, len)) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read stream log segment \"%s\": %m", path)));
+
+	return n == len;
+}
+
+static void
+close_reader(void)
+{
+	if (read_fd >= 0)
+		close(read_fd);
+	read_fd = -1;
+}
+
+/*
+ * read_record
+ *
+ * Read the first record of the given database's log at or after *pos into rec, moving *pos to its start.
+ * Returns false if the log ends there, either because nothing more was written or because the rest of it
+ * is torn.
+ */
+static bool
+read_record(Oid dbid, uint64 *pos, StringInfo rec)
+{
+	uint64 p = *pos;
+
+	for (;;)
+	{
+		uint32 off = p % STREAM_LOG_SEGMENT_SIZE;
+		StreamLogRecordHeader hdr;
+		pg_crc32c crc;
+
+		/* records that didn't fit at the end of a segment were written to the next one */
+		if (STREAM_LOG_SEGMENT_SIZE - off < sizeof(StreamLogRecordHeader))
+		{
+			p += STREAM_LOG_SEGMENT_SIZE - off;
+			continue;
+		}
+
+		if (!read_at(dbid, p, (char *) &hdr, sizeof(StreamLogRecordHeader)))
+		{
+			if (off == 0)
+				return false;
+			p += STREAM_LOG_SEGMENT_SIZE - off;
+			continue;
+		}
+
+		if (hdr.len < sizeof(StreamLogRecordHeader) || hdr.len > STREAM_LOG_SEGMENT_SIZE - off ||
+				hdr.natts < 0 || hdr.ntups < 0 ||
+				sizeof(StreamLogRecordHeader) + hdr.natts * sizeof(StreamLogAttr) > hdr.len)
+			return false;
+
+		resetStringInfo(rec);
+		enlargeStringInfo(rec, hdr.len);
+
+		if (!read_at(dbid, p, rec->data, hdr.len))
+			return false;
+
+		rec->len = hdr.len;
+
+		INIT_CRC32C(crc);
+		COMP_CRC32C(crc, rec->data + STREAM_LOG_CRC_START, hdr.len - STREAM_LOG_CRC_START);
+		FIN_CRC32C(crc);
+
+		if (!EQ_CRC32C(crc, hdr.crc))
+			return false;
+
+		*pos = p;
+		return true;
+	}
+}
+
+/*
+ * read_control
+ *
+ * Read the committed position from the given database's control file, returning false if there isn't a
+ * valid one
+ */
+static bool
+read_control(Oid dbid, uint64 *committed)
+{
+	char path[MAXPGPATH];
+	StreamLogControl control;
+	pg_crc32c crc;
+	int fd;
+	int n;
+
+	control_path(path, dbid, false);
+
+	fd = OpenTransientFile(path, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+	{
+		if (errno == ENOENT)
+			return false;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open stream log control file \"%s\": %m", path)));
+	}
+
+	n = read(fd, &control, sizeof(StreamLogControl));
+	CloseTransientFile(fd);
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, &control.committed, sizeof(uint64));
+	FIN_CRC32C(crc);
+
+	if (n != sizeof(StreamLogControl) || !EQ_CRC32C(crc, control.crc))
+	{
+		ereport(LOG,
+				(errmsg("invalid stream log control file \"%s\"", path)));
+		return false;
+	}
+
+	*committed = control.committed;
+
+	return true;
+}
+
+/*
+ * load_log
+ *
+ * Find out where the given log ends, and which of its records must be replayed. StreamLogLock must be
+ * held exclusively.
+ */
+static void
+load_log(StreamLog *log)
+{
+	char dir[MAXPGPATH];
+	char path[MAXPGPATH];
+	StringInfoData rec;
+	uint64 committed;
+	uint64 pos;
+	uint64 oldest;
+	int nrecords = 0;
+	int fd;
+
+	log_dir_path(dir, log->dbid);
+
+	if (mkdir(STREAM_LOG_DIR, S_IRWXU) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m", STREAM_LOG_DIR)));
+	if (mkdir(dir, S_IRWXU) < 0 && errno != EEXIST)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create directory \"%s\": %m", dir)));
+
+	/* without a control file, everything that's left must be replayed */
+	if (!read_control(log->dbid, &committed))
+		committed = trim_segments(log->dbid, 0, PG_UINT64_MAX, &oldest) ? oldest * STREAM_LOG_SEGMENT_SIZE : 0;
+
+	initStringInfo(&rec);
+
+	for (pos = committed; read_record(log->dbid, &pos, &rec); nrecords++)
+		pos += ((StreamLogRecordHeader *) rec.data)->len;
+
+	pfree(rec.data);
+	close_reader();
+
+	/* new records are appended right after the last valid one */
+	segment_path(path, log->dbid, pos / STREAM_LOG_SEGMENT_SIZE);
+	fd = OpenTransientFile(path, O_RDWR | PG_BINARY, 0);
+	if (fd >= 0)
+	{
+		if (ftruncate(fd, pos % STREAM_LOG_SEGMENT_SIZE) < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not truncate stream log segment \"%s\": %m", path)));
+		CloseTransientFile(fd);
+	}
+
+	trim_segments(log->dbid, committed / STREAM_LOG_SEGMENT_SIZE, pos / STREAM_LOG_SEGMENT_SIZE, &oldest);
+
+	if (write_fd >= 0)
+		close(write_fd);
+	write_fd = -1;
+
+	log->write_pos = pos;
+	log->flush_pos = pos;
+	log->committed_pos = committed;
+	log->persisted_pos = committed;
+	log->persisted_at = GetCurrentTimestamp();
+	log->replay_pos = committed;
+	log->replay_end = pos;
+	log->nbatches = 0;
+	MemSet(log->batches, 0, sizeof(log->batches));
+	log->loaded = true;
+
+	if (nrecords)
+		ereport(LOG,
+				(errmsg("stream log of database %u has %d records to replay", log->dbid, nrecords)));
+}
+
+/*
+ * get_log
+ *
+ * Returns the current database's log, loading it if we're the first to use it. StreamLogLock must be
+ * held exclusively.
+ */
+static StreamLog *
+get_log(void)
+{
+	StreamLog *log;
+	bool found;
+
+	log = (StreamLog *) hash_search(StreamLogs, &MyDatabaseId, HASH_ENTER_NULL, &found);
+
+	if (log == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("too many databases are using the stream log"),
+				 errhint("At most %d databases may use stream_log.", STREAM_LOG_MAX_DATABASES)));
+
+	if (!found)
+		log->loaded = false;
+
+	if (!log->loaded)
+		load_log(log);
+
+	return log;
+}
+
+/*
+ * advance
+ *
+ * Free the batches of the given log that have been consumed, and advance its committed position past
+ * them. StreamLogLock must be held exclusively.
+ */
+static void
+advance(StreamLog *log)
+{
+	uint64 committed = log->write_pos;
+	int i;
+
+	for (i = 0; i < STREAM_LOG_MAX_BATCHES && log->nbatches; i++)
+	{
+		StreamLogBatch *b = &log->batches[i];
+
+		if (!b->used)
+			continue;
+
+		if (b->sealed && InsertBatchIsAcked(b->batch))
+		{
+			ShmemDynFree(b->batch);
+			b->used = false;
+			log->nbatches--;
+			continue;
+		}
+
+		committed = Min(committed, b->start);
+	}
+
+	/* records that haven't been replayed yet haven't been consumed either */
+	if (log->replay_pos < log->replay_end)
+		committed = Min(committed, log->replay_pos);
+
+	log->committed_pos = Max(log->committed_pos, committed);
+}
+
+/*
+ * get_free_slot
+ *
+ * Returns a free batch slot of the given log, waiting for outstanding batches to be consumed if there
+ * isn't any. StreamLogLock must be held exclusively, and is released while waiting.
+ */
+static int
+get_free_slot(StreamLog *log)
+{
+	for (;;)
+	{
+		int i;
+
+		if (log->nbatches == STREAM_LOG_MAX_BATCHES)
+			advance(log);
+
+		if (log->nbatches < STREAM_LOG_MAX_BATCHES)
+		{
+			for (i = 0; i < STREAM_LOG_MAX_BATCHES; i++)
+				if (!log->batches[i].used)
+					return i;
+		}
+
+		LWLockRelease(StreamLogLock);
+		pg_usleep(STREAM_LOG_SLEEP_MS * 1000);
+		CHECK_FOR_INTERRUPTS();
+		LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+	}
+}
+
+/*
+ * write_at
+ *
+ * Write len bytes to the current database's log at pos. StreamLogLock must be held exclusively.
+ */
+static void
+write_at(uint64 pos, char *data, int len)
+{
+	uint64 segno = pos / STREAM_LOG_SEGMENT_SIZE;
+	uint32 off = pos % STREAM_LOG_SEGMENT_SIZE;
+	char path[MAXPGPATH];
+
+	segment_path(path, MyDatabaseId, segno);
+
+	if (write_fd < 0 || write_segno != segno)
+	{
+		if (write_fd >= 0)
+			close(write_fd);
+
+		write_fd = BasicOpenFile(path, O_RDWR | O_CREAT | PG_BINARY, S_IRUSR | S_IWUSR);
+		if (write_fd < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open stream log segment \"%s\": %m", path)));
+
+		write_segno = segno;
+
+		/* make sure a new segment survives a crash */
+		if (off == 0)
+		{
+			char dir[MAXPGPATH];
+
+			log_dir_path(dir, MyDatabaseId);
+			fsync_fname(dir, true);
+		}
+	}
+
+	errno = 0;
+	if (lseek(write_fd, off, SEEK_SET) < 0 || write(write_fd, data, len) != len)
+	{
+		/* if write didn't set errno, assume problem is no disk space */
+		if (errno == 0)
+			errno = ENOSPC;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to stream log segment \"%s\": %m", path)));
+	}
+}
+
+/*
+ * seal_open_slots
+ *
+ * Writes that fail leave their batches behind, so we give up on them at the end of the transaction
+ */
+static void
+seal_open_slots(XactEvent event, void *arg)
+{
+	StreamLog *log;
+	ListCell *lc;
+
+	if (open_slots == NIL || (event != XACT_EVENT_COMMIT && event != XACT_EVENT_ABORT))
+		return;
+
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+
+	log = (StreamLog *) hash_search(StreamLogs, &MyDatabaseId, HASH_FIND, NULL);
+	Assert(log);
+
+	foreach(lc, open_slots)
+		log->batches[lfirst_int(lc)].sealed = true;
+
+	LWLockRelease(StreamLogLock);
+
+	list_free(open_slots);
+	open_slots = NIL;
+}
+
+/*
+ * write_record
+ *
+ * Append the writer's buffered events to the log as a single record
+ */
+static void
+write_record(StreamLogWriter *writer)
+{
+	StreamLogRecordHeader *hdr = (StreamLogRecordHeader *) writer->buf.data;
+	StreamLog *log;
+	uint64 pos;
+	pg_crc32c crc;
+
+	hdr->len = writer->buf.len;
+	hdr->ntups = writer->ntups;
+
+	INIT_CRC32C(crc);
+	COMP_CRC32C(crc, writer->buf.data + STREAM_LOG_CRC_START, writer->buf.len - STREAM_LOG_CRC_START);
+	FIN_CRC32C(crc);
+	hdr->crc = crc;
+
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+
+	log = get_log();
+
+	if (writer->slot < 0)
+		writer->slot = get_free_slot(log);
+
+	/* records never span segments */
+	pos = log->write_pos;
+	if (pos % STREAM_LOG_SEGMENT_SIZE + writer->buf.len > STREAM_LOG_SEGMENT_SIZE)
+		pos += STREAM_LOG_SEGMENT_SIZE - pos % STREAM_LOG_SEGMENT_SIZE;
+
+	write_at(pos, writer->buf.data, writer->buf.len);
+	log->write_pos = pos + writer->buf.len;
+
+	/* the batch holds back the committed position from its first record on */
+	if (!log->batches[writer->slot].used)
+	{
+		static bool registered = false;
+		MemoryContext old;
+
+		log->batches[writer->slot].start = pos;
+		log->batches[writer->slot].batch = writer->batch;
+		log->batches[writer->slot].sealed = false;
+		log->batches[writer->slot].used = true;
+		log->nbatches++;
+
+		if (!registered)
+		{
+			RegisterXactCallback(seal_open_slots, NULL);
+			registered = true;
+		}
+
+		old = MemoryContextSwitchTo(TopMemoryContext);
+		open_slots = lappend_int(open_slots, writer->slot);
+		MemoryContextSwitchTo(old);
+	}
+
+	LWLockRelease(StreamLogLock);
+
+	writer->log = log;
+	writer->end = pos + writer->buf.len;
+	writer->buf.len = writer->header_len;
+	writer->ntups = 0;
+}
+
+/*
+ * flush_log
+ *
+ * Make sure everything written to the given log before upto is on disk. Whoever gets to flush first
+ * flushes everything written so far, on behalf of all the others waiting.
+ */
+static void
+flush_log(StreamLog *log, uint64 upto)
+{
+	for (;;)
+	{
+		uint64 from;
+		uint64 to;
+		uint64 segno;
+
+		LWLockAcquire(StreamLogLock, LW_SHARED);
+		from = log->flush_pos;
+		LWLockRelease(StreamLogLock);
+
+		if (from >= upto)
+			return;
+
+		/* someone else was flushing, see if they flushed what we need */
+		if (!LWLockAcquireOrWait(StreamLogFlushLock, LW_EXCLUSIVE))
+			continue;
+
+		LWLockAcquire(StreamLogLock, LW_SHARED);
+		from = log->flush_pos;
+		to = log->write_pos;
+		LWLockRelease(StreamLogLock);
+
+		for (segno = from / STREAM_LOG_SEGMENT_SIZE; from < upto && segno <= (to - 1) / STREAM_LOG_SEGMENT_SIZE;
+				segno++)
+		{
+			char path[MAXPGPATH];
+			int fd;
+
+			segment_path(path, log->dbid, segno);
+
+			/* segments that were consumed in the meantime may be gone already */
+			fd = OpenTransientFile(path, O_RDWR | PG_BINARY, 0);
+			if (fd < 0 && errno == ENOENT)
+				continue;
+
+			if (fd < 0 || pg_fsync(fd) != 0)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not fsync stream log segment \"%s\": %m", path)));
+
+			CloseTransientFile(fd);
+		}
+
+		LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+		log->flush_pos = Max(log->flush_pos, to);
+		LWLockRelease(StreamLogLock);
+
+		LWLockRelease(StreamLogFlushLock);
+		return;
+	}
+}
+
+/*
+ * persist
+ *
+ * Write the given committed position to the log's control file, and remove the segments before it
+ */
+static void
+persist(StreamLog *log, uint64 pos)
+{
+	char dir[MAXPGPATH];
+	char path[MAXPGPATH];
+	char tmp[MAXPGPATH];
+	StreamLogControl control;
+	uint64 oldest;
+	int fd;
+
+	LWLockAcquire(StreamLogFlushLock, LW_EXCLUSIVE);
+
+	LWLockAcquire(StreamLogLock, LW_SHARED);
+	if (pos <= log->persisted_pos)
+	{
+		LWLockRelease(StreamLogLock);
+		LWLockRelease(StreamLogFlushLock);
+		return;
+	}
+	LWLockRelease(StreamLogLock);
+
+	log_dir_path(dir, log->dbid);
+	control_path(path, log->dbid, false);
+	control_path(tmp, log->dbid, true);
+
+	control.committed = pos;
+	INIT_CRC32C(control.crc);
+	COMP_CRC32C(control.crc, &control.committed, sizeof(uint64));
+	FIN_CRC32C(control.crc);
+
+	fd = OpenTransientFile(tmp, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+	{
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not create stream log control file \"%s\": %m", tmp)));
+		LWLockRelease(StreamLogFlushLock);
+		return;
+	}
+
+	if (write(fd, &control, sizeof(StreamLogControl)) != sizeof(StreamLogControl) || pg_fsync(fd) != 0)
+	{
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not write stream log control file \"%s\": %m", tmp)));
+		CloseTransientFile(fd);
+		LWLockRelease(StreamLogFlushLock);
+		return;
+	}
+
+	CloseTransientFile(fd);
+
+	if (rename(tmp, path) < 0)
+	{
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not rename stream log control file \"%s\" to \"%s\": %m", tmp, path)));
+		LWLockRelease(StreamLogFlushLock);
+		return;
+	}
+
+	fsync_fname(dir, true);
+
+	trim_segments(log->dbid, pos / STREAM_LOG_SEGMENT_SIZE, PG_UINT64_MAX, &oldest);
+
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+	log->persisted_pos = Max(log->persisted_pos, pos);
+	LWLockRelease(StreamLogLock);
+
+	LWLockRelease(StreamLogFlushLock);
+}
+
+/*
+ * StreamLogBeginWrite
+ *
+ * Start logging the events of a client's stream write of the given batch. Returns NULL if they aren't
+ * logged, in which case the batch must be waited on as usual.
+ */
+StreamLogWriter *
+StreamLogBeginWrite(Relation stream, TupleDesc desc, InsertBatch *batch, int64 batch_id)
+{
+	StreamLogWriter *writer;
+	StreamLogRecordHeader hdr;
+	int i;
+
+	if (!StreamLogActive() || batch == NULL || IsContQueryProcess())
+		return NULL;
+
+	writer = palloc0(sizeof(StreamLogWriter));
+	writer->batch = batch;
+	writer->slot = -1;
+	writer->desc = desc;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (desc->attrs[i]->attisdropped)
+		{
+			TupleDesc live = CreateTemplateTupleDesc(desc->natts, false);
+			int j;
+			int natts = 0;
+
+			for (j = 0; j < desc->natts; j++)
+				if (!desc->attrs[j]->attisdropped)
+					TupleDescCopyEntry(live, ++natts, desc, j + 1);
+			live->natts = natts;
+
+			writer->map = convert_tuples_by_name(desc, live, gettext_noop("could not log stream event"));
+			writer->desc = live;
+			break;
+		}
+	}
+
+	initStringInfo(&writer->buf);
+
+	MemSet(&hdr, 0, sizeof(StreamLogRecordHeader));
+	hdr.relid = RelationGetRelid(stream);
+	hdr.batch_id = batch_id;
+	hdr.natts = writer->desc->natts;
+	appendBinaryStringInfo(&writer->buf, (char *) &hdr, sizeof(StreamLogRecordHeader));
+
+	for (i = 0; i < writer->desc->natts; i++)
+	{
+		Form_pg_attribute att = writer->desc->attrs[i];
+		StreamLogAttr attr;
+
+		MemSet(&attr, 0, sizeof(StreamLogAttr));
+		attr.type = att->atttypid;
+		attr.typmod = att->atttypmod;
+		namestrcpy(&attr.name, NameStr(att->attname));
+		appendBinaryStringInfo(&writer->buf, (char *) &attr, sizeof(StreamLogAttr));
+	}
+
+	writer->header_len = writer->buf.len;
+
+	return writer;
+}
+
+/*
+ * StreamLogWriteTuple
+ *
+ * Log an event of the write. Events that point to toasted values are logged with the values themselves,
+ * since they may be gone after a restart.
+ */
+void
+StreamLogWriteTuple(StreamLogWriter *writer, HeapTuple tup)
+{
+	HeapTuple logged = tup;
+	uint32 len;
+
+	if (writer->map)
+		logged = do_convert_tuple(tup, writer->map);
+
+	if (HeapTupleHasExternal(logged))
+	{
+		HeapTuple flat = toast_flatten_tuple(logged, writer->desc);
+
+		if (logged != tup)
+			heap_freetuple(logged);
+		logged = flat;
+	}
+
+	len = logged->t_len;
+
+	if (writer->header_len + sizeof(uint32) + len > STREAM_LOG_SEGMENT_SIZE)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("stream event is too large for the stream log")));
+
+	if (writer->ntups && writer->buf.len + sizeof(uint32) + len > STREAM_LOG_RECORD_SIZE)
+		write_record(writer);
+
+	appendBinaryStringInfo(&writer->buf, (char *) &len, sizeof(uint32));
+	appendBinaryStringInfo(&writer->buf, (char *) logged->t_data, len);
+	writer->ntups++;
+
+	if (logged != tup)
+		heap_freetuple(logged);
+}
+
+/*
+ * StreamLogEndWrite
+ *
+ * Write and flush what's left of the write's events, and hand its batch over to the log. The given number
+ * of tuples is what the batch would otherwise have been waited on with.
+ */
+void
+StreamLogEndWrite(StreamLogWriter *writer, int num_tuples)
+{
+	if (writer->ntups)
+		write_record(writer);
+
+	/* nothing was logged */
+	if (writer->slot < 0)
+	{
+		InsertBatchWaitAndRemove(writer->batch, num_tuples);
+		pfree(writer->buf.data);
+		return;
+	}
+
+	flush_log(writer->log, writer->end);
+
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+	InsertBatchIncrementNumWTuples(writer->batch, num_tuples);
+	writer->log->batches[writer->slot].sealed = true;
+	open_slots = list_delete_int(open_slots, writer->slot);
+	LWLockRelease(StreamLogLock);
+
+	if (writer->map)
+		free_conversion_map(writer->map);
+	pfree(writer->buf.data);
+
+	StreamLogAdvance(false);
+}
+
+/*
+ * StreamLogAdvance
+ *
+ * Advance the current database's committed position past the batches that have been consumed, persisting
+ * it if it hasn't been for a while or force is set
+ */
+void
+StreamLogAdvance(bool force)
+{
+	StreamLog *log;
+	TimestampTz now = GetCurrentTimestamp();
+	uint64 pos;
+
+	if (!StreamLogActive())
+		return;
+
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+
+	log = (StreamLog *) hash_search(StreamLogs, &MyDatabaseId, HASH_FIND, NULL);
+	if (log == NULL || !log->loaded)
+	{
+		LWLockRelease(StreamLogLock);
+		return;
+	}
+
+	advance(log);
+	pos = log->committed_pos;
+
+	if (pos <= log->persisted_pos ||
+			(!force && !TimestampDifferenceExceeds(log->persisted_at, now, STREAM_LOG_PERSIST_INTERVAL_MS)))
+	{
+		LWLockRelease(StreamLogLock);
+		return;
+	}
+
+	log->persisted_at = now;
+
+	LWLockRelease(StreamLogLock);
+
+	persist(log, pos);
+}
+
+/*
+ * replay_record
+ *
+ * Write the events of a record that was logged before the restart to continuous queries again. Returns
+ * false if they were skipped.
+ */
+static bool
+replay_record(StreamLog *log, uint64 pos, StringInfo rec)
+{
+	StreamLogRecordHeader *hdr = (StreamLogRecordHeader *) rec->data;
+	StreamLogAttr *attrs = (StreamLogAttr *) (rec->data + sizeof(StreamLogRecordHeader));
+	char *data = (char *) (attrs + hdr->natts);
+	char *end = rec->data + hdr->len;
+	Relation stream;
+	TupleDesc desc;
+	HeapTuple *tups;
+	InsertBatch *batch;
+	InsertBatchAck ack;
+	int slot;
+	int i;
+
+	/* the batch's events were combined already */
+	if (hdr->batch_id && StreamBatchIsRecorded(hdr->batch_id, ANY_COMBINER))
+		return false;
+
+	stream = try_relation_open(hdr->relid, RowExclusiveLock);
+	if (stream == NULL)
+		return false;
+
+	if (!IsStream(hdr->relid) || bms_is_empty(GetStreamInsertTargets(stream)))
+	{
+		relation_close(stream, RowExclusiveLock);
+		return false;
+	}
+
+	desc = CreateTemplateTupleDesc(hdr->natts, false);
+	for (i = 0; i < hdr->natts; i++)
+		TupleDescInitEntry(desc, i + 1, NameStr(attrs[i].name), attrs[i].type, attrs[i].typmod, 0);
+
+	tups = palloc(sizeof(HeapTuple) * hdr->ntups);
+	for (i = 0; i < hdr->ntups; i++)
+	{
+		uint32 len;
+
+		if (data + sizeof(uint32) > end)
+			elog(ERROR, "invalid stream log record at " UINT64_FORMAT, pos);
+
+		memcpy(&len, data, sizeof(uint32));
+		data += sizeof(uint32);
+
+		if (len > end - data)
+			elog(ERROR, "invalid stream log record at " UINT64_FORMAT, pos);
+
+		tups[i] = (HeapTuple) palloc(HEAPTUPLESIZE + len);
+		tups[i]->t_len = len;
+		ItemPointerSetInvalid(&tups[i]->t_self);
+		tups[i]->t_tableOid = InvalidOid;
+		tups[i]->t_data = (HeapTupleHeader) ((char *) tups[i] + HEAPTUPLESIZE);
+		memcpy(tups[i]->t_data, data, len);
+		data += len;
+	}
+
+	batch = InsertBatchCreate();
+	ack.batch_id = batch->id;
+	ack.batch = batch;
+	ack.client_batch_id = hdr->batch_id;
+
+	SendTuplesToContWorkers(stream, desc, tups, hdr->ntups, &ack, 1);
+
+	/* the record was replayed once its batch holds back the committed position */
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+
+	slot = get_free_slot(log);
+	InsertBatchIncrementNumWTuples(batch, hdr->ntups);
+	log->batches[slot].start = pos;
+	log->batches[slot].batch = batch;
+	log->batches[slot].sealed = true;
+	log->batches[slot].used = true;
+	log->nbatches++;
+
+	LWLockRelease(StreamLogLock);
+
+	relation_close(stream, NoLock);
+
+	return true;
+}
+
+/*
+ * StreamLogReplay
+ *
+ * Write the events that were logged before the restart but not consumed to continuous queries again.
+ * Records that can't be replayed, for instance because their stream was dropped, are skipped.
+ */
+void
+StreamLogReplay(void)
+{
+	StreamLog *log;
+	StringInfoData rec;
+	uint64 pos;
+	uint64 end;
+	int nrecords = 0;
+
+	if (!StreamLogActive())
+		return;
+
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+	log = get_log();
+	pos = log->replay_pos;
+	end = log->replay_end;
+	LWLockRelease(StreamLogLock);
+
+	if (pos >= end)
+		return;
+
+	initStringInfo(&rec);
+
+	while (read_record(MyDatabaseId, &pos, &rec) && pos < end)
+	{
+		uint64 next = pos + ((StreamLogRecordHeader *) rec.data)->len;
+
+		StartTransactionCommand();
+
+		PG_TRY();
+		{
+			if (replay_record(log, pos, &rec))
+				nrecords++;
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
+		{
+			EmitErrorReport();
+			FlushErrorState();
+
+			AbortCurrentTransaction();
+		}
+		PG_END_TRY();
+
+		pos = next;
+
+		LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+		log->replay_pos = pos;
+		LWLockRelease(StreamLogLock);
+	}
+
+	pfree(rec.data);
+	close_reader();
+
+	LWLockAcquire(StreamLogLock, LW_EXCLUSIVE);
+	log->replay_pos = log->replay_end;
+	LWLockRelease(StreamLogLock);
+
+	StreamLogAdvance(false);
+
+	ereport(LOG,
+			(errmsg("replayed %d stream log records of database %u", nrecords, MyDatabaseId)));
+}
@@ -0,0 +1,258 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_quota.c
+ *
+ *	  Admission control of stream inserts
+ *
+ * So that a single producer can't fill every worker queue, client writes to
+ * streams may be limited to stream_insert_quota_events events and
+ * stream_insert_quota_bytes of event data per second. Usage is tracked in
+ * token buckets in shared memory, shared by all writes of the same role or to
+ * the same stream depending on stream_insert_quota_key. Each bucket holds up
+ * to a second worth of tokens, so short bursts above the limits are admitted
+ * as long as the average rate stays below them.
+ *
+ * The quota parameters can only be set by superusers, so per-role limits are
+ * set with ALTER ROLE ... SET, and a role's writes are accounted to the session
+ * role the settings were applied to. A bucket is always refilled at the limits
+ * of the write using it, so writes sharing a bucket should share limits too.
+ *
+ * Writes exceeding their quota are handled according to
+ * stream_insert_quota_action: delay waits until the bucket has paid back the
+ * write's tokens, reject fails the write, and sample only writes a random
+ * subset of its events that fits within the remaining tokens.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/stream_quota.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "miscadmin.h"
+#include "pipeline/stream_quota.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/timestamp.h"
+
+/* longest a delayed write sleeps before checking for interrupts */
+#define QUOTA_SLEEP_US 10000
+
+/* guc parameters */
+int stream_insert_quota_events;
+int stream_insert_quota_bytes;
+int stream_insert_quota_key;
+int stream_insert_quota_action;
+
+typedef struct StreamQuotaBucketKey
+{
+	Oid dbid; /* InvalidOid for role buckets */
+	Oid id; /* role or stream */
+} StreamQuotaBucketKey;
+
+typedef struct StreamQuotaBucket
+{
+	StreamQuotaBucketKey key;
+	/* tokens left, which are negative while delayed writes are paying them back */
+	double events;
+	double bytes;
+	TimestampTz refilled_at;
+} StreamQuotaBucket;
+
+static HTAB *quota_buckets = NULL;
+
+/*
+ * StreamQuotaShmemSize
+ */
+Size
+StreamQuotaShmemSize(void)
+{
+	return hash_estimate_size(STREAM_QUOTA_MAX_BUCKETS, sizeof(StreamQuotaBucket));
+}
+
+/*
+ * StreamQuotaShmemInit
+ */
+void
+StreamQuotaShmemInit(void)
+{
+	HASHCTL ctl;
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(StreamQuotaBucketKey);
+	ctl.entrysize = sizeof(StreamQuotaBucket);
+
+	quota_buckets = ShmemInitHash("StreamQuotaBuckets", STREAM_QUOTA_MAX_BUCKETS, STREAM_QUOTA_MAX_BUCKETS,
+			&ctl, HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * refill
+ *
+ * Adds the tokens earned since the bucket was last refilled, up to a second worth of them
+ */
+static void
+refill(StreamQuotaBucket *bucket, double event_rate, double byte_rate, TimestampTz now)
+{
+	double secs = (double) (now - bucket->refilled_at) / USECS_PER_SEC;
+
+	if (secs > 0)
+	{
+		bucket->events = Min(bucket->events + secs * event_rate, event_rate);
+		bucket->bytes = Min(bucket->bytes + secs * byte_rate, byte_rate);
+	}
+
+	bucket->refilled_at = now;
+}
+
+/*
+ * quota_exceeded
+ */
+static void
+quota_exceeded(Relation stream)
+{
+	if (stream_insert_quota_key == STREAM_QUOTA_KEY_STREAM)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("stream insert quota exceeded for stream \"%s\"", RelationGetRelationName(stream)),
+				 errhint("Retry the insert later or increase stream_insert_quota_events and stream_insert_quota_bytes.")));
+
+	ereport(ERROR,
+			(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+			 errmsg("stream insert quota exceeded for role \"%s\"", GetUserNameFromId(GetSessionUserId(), false)),
+			 errhint("Retry the insert later or increase stream_insert_quota_events and stream_insert_quota_bytes.")));
+}
+
+/*
+ * sample_admitted
+ *
+ * Picks n of the given tuples at random, keeping them in order
+ */
+static HeapTuple *
+sample_admitted(HeapTuple *tuples, int ntuples, int n)
+{
+	HeapTuple *result = palloc(sizeof(HeapTuple) * Max(n, 1));
+	int picked = 0;
+	int i;
+
+	for (i = 0; i < ntuples && picked < n; i++)
+	{
+		if ((double) random() / ((double) MAX_RANDOM_VALUE + 1) * (ntuples - i) < n - picked)
+			result[picked++] = tuples[i];
+	}
+
+	return result;
+}
+
+/*
+ * StreamQuotaAdmit
+ *
+ * Charges the given tuples to the writer's quota bucket. Returns how many of them may be written, and sets
+ * admitted to them, which are all of the given ones unless some were sampled away. The caller must ack the
+ * ones that weren't.
+ */
+int
+StreamQuotaAdmit(Relation stream, HeapTuple *tuples, int ntuples, HeapTuple **admitted)
+{
+	StreamQuotaBucketKey key;
+	StreamQuotaBucket *bucket;
+	double event_rate = stream_insert_quota_events > 0 ? stream_insert_quota_events : INFINITY;
+	double byte_rate = stream_insert_quota_bytes > 0 ? stream_insert_quota_bytes * 1024.0 : INFINITY;
+	double bytes = 0;
+	double wait = 0;
+	TimestampTz now = GetCurrentTimestamp();
+	bool found;
+	int result = ntuples;
+	int i;
+
+	*admitted = tuples;
+
+	if (!StreamQuotaEnabled() || ntuples == 0)
+		return ntuples;
+
+	for (i = 0; i < ntuples; i++)
+		bytes += tuples[i]->t_len;
+
+	MemSet(&key, 0, sizeof(key));
+	if (stream_insert_quota_key == STREAM_QUOTA_KEY_STREAM)
+	{
+		key.dbid = MyDatabaseId;
+		key.id = RelationGetRelid(stream);
+	}
+	else
+		key.id = GetSessionUserId();
+
+	LWLockAcquire(StreamQuotaLock, LW_EXCLUSIVE);
+
+	/* writers we have no room to track just aren't limited */
+	bucket = (StreamQuotaBucket *) hash_search(quota_buckets, &key, HASH_ENTER_NULL, &found);
+	if (bucket == NULL)
+	{
+		LWLockRelease(StreamQuotaLock);
+		return ntuples;
+	}
+
+	if (!found)
+	{
+		bucket->events = event_rate;
+		bucket->bytes = byte_rate;
+		bucket->refilled_at = now;
+	}
+
+	refill(bucket, event_rate, byte_rate, now);
+
+	if (bucket->events >= ntuples && bucket->bytes >= bytes)
+	{
+		bucket->events -= ntuples;
+		bucket->bytes -= bytes;
+		LWLockRelease(StreamQuotaLock);
+		return ntuples;
+	}
+
+	switch (stream_insert_quota_action)
+	{
+		case STREAM_QUOTA_REJECT:
+			LWLockRelease(StreamQuotaLock);
+			quota_exceeded(stream);
+			break;
+		case STREAM_QUOTA_SAMPLE:
+			result = (int) Max(Min(bucket->events, bucket->bytes / (bytes / ntuples)), 0);
+			bucket->events -= result;
+			bucket->bytes -= result * (bytes / ntuples);
+			break;
+		default:
+			/* the write goes ahead once the bucket has earned back all of its tokens */
+			bucket->events -= ntuples;
+			bucket->bytes -= bytes;
+			if (bucket->events < 0)
+				wait = Max(wait, -bucket->events / event_rate);
+			if (bucket->bytes < 0)
+				wait = Max(wait, -bucket->bytes / byte_rate);
+			break;
+	}
+
+	LWLockRelease(StreamQuotaLock);
+
+	if (wait > 0)
+	{
+		TimestampTz until = now + (TimestampTz) (wait * USECS_PER_SEC);
+
+		while ((now = GetCurrentTimestamp()) < until)
+		{
+			pg_usleep(Min(until - now, QUOTA_SLEEP_US));
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+
+	if (result < ntuples)
+		*admitted = sample_admitted(tuples, ntuples, result);
+
+	return result;
+}
@@ -0,0 +1,347 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_readers.c
+ *
+ *	  Shared cache of stream readers
+ *
+ * Before a backend can write to a stream, it needs to know which continuous
+ * queries read from it and which of the stream's attributes they read. Each
+ * backend keeps those in its own cache, but building them means reading the
+ * stream's pipeline_stream row and the query of every one of its readers. So
+ * that new backends don't all have to do that, the first backend to build them
+ * for a stream publishes them here, for the others to look up.
+ *
+ * Readers only change when pipeline_stream is updated, which happens when
+ * continuous queries are created, dropped, activated or deactivated. Those
+ * commands bump a generation counter when their transaction commits, right
+ * after its catalog invalidations are sent, and entries published by an older
+ * generation are ignored and replaced by the next backend that needs them.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/stream_readers.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "access/sysattr.h"
+#include "miscadmin.h"
+#include "pipeline/stream_readers.h"
+#include "port/atomics.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/inval.h"
+#include "utils/resowner.h"
+
+/* don't let the open addressed table get too crowded */
+#define MAX_STREAMS (STREAM_READERS_CACHE_SIZE * 3 / 4)
+
+/* query ids are allocated compactly, so streams whose readers have higher ids just aren't cached */
+#define MAX_CACHED_READER_ID 4096
+#define READERS_WORDS ((MAX_CACHED_READER_ID + BITS_PER_BITMAPWORD - 1) / BITS_PER_BITMAPWORD)
+#define ATTRS_WORDS ((MaxHeapAttributeNumber - FirstLowInvalidHeapAttributeNumber + BITS_PER_BITMAPWORD) / \
+		BITS_PER_BITMAPWORD)
+
+typedef struct StreamReadersKey
+{
+	Oid dbid;
+	Oid relid;
+} StreamReadersKey;
+
+typedef struct StreamReadersSlot
+{
+	StreamReadersKey key;
+	bool used;
+	uint32 generation;
+	bool prunable;
+	bitmapword readers[READERS_WORDS];
+	bitmapword read_attrs[ATTRS_WORDS];
+} StreamReadersSlot;
+
+typedef struct StreamReadersCache
+{
+	pg_atomic_uint32 generation;
+	int nstreams;
+	StreamReadersSlot slots[STREAM_READERS_CACHE_SIZE];
+} StreamReadersCache;
+
+static StreamReadersCache *readers_cache = NULL;
+
+static bool inval_pending = false;
+static bool callback_registered = false;
+
+/*
+ * StreamReadersCacheShmemSize
+ */
+Size
+StreamReadersCacheShmemSize(void)
+{
+	return MAXALIGN(sizeof(StreamReadersCache));
+}
+
+/*
+ * StreamReadersCacheShmemInit
+ */
+void
+StreamReadersCacheShmemInit(void)
+{
+	bool found;
+
+	readers_cache = ShmemInitStruct("StreamReadersCache", StreamReadersCacheShmemSize(), &found);
+
+	if (!found)
+	{
+		MemSet(readers_cache, 0, StreamReadersCacheShmemSize());
+		pg_atomic_init_u32(&readers_cache->generation, 0);
+	}
+}
+
+/*
+ * make_key
+ */
+static void
+make_key(StreamReadersKey *key, Oid relid)
+{
+	MemSet(key, 0, sizeof(StreamReadersKey));
+	key->dbid = MyDatabaseId;
+	key->relid = relid;
+}
+
+/*
+ * find_slot
+ *
+ * Must be called with StreamReadersCacheLock held. Returns the slot for the given stream, or the
+ * unused slot it belongs in if there isn't one.
+ */
+static StreamReadersSlot *
+find_slot(StreamReadersKey *key)
+{
+	uint32 hash = DatumGetUInt32(hash_any((unsigned char *) key, sizeof(StreamReadersKey)));
+	int i = hash % STREAM_READERS_CACHE_SIZE;
+
+	for (;;)
+	{
+		StreamReadersSlot *slot = &readers_cache->slots[i];
+
+		if (!slot->used || memcmp(&slot->key, key, sizeof(StreamReadersKey)) == 0)
+			return slot;
+
+		i = (i + 1) % STREAM_READERS_CACHE_SIZE;
+	}
+}
+
+/*
+ * words_to_bms
+ */
+static Bitmapset *
+words_to_bms(bitmapword *words, int nwords)
+{
+	Bitmapset *result;
+
+	while (nwords > 0 && words[nwords - 1] == 0)
+		nwords--;
+
+	if (nwords == 0)
+		return NULL;
+
+	result = palloc(BITMAPSET_SIZE(nwords));
+	result->nwords = nwords;
+	memcpy(result->words, words, nwords * sizeof(bitmapword));
+
+	return result;
+}
+
+/*
+ * bms_num_words
+ *
+ * Returns the number of words up to and including the given bitmapset's last nonzero one
+ */
+static int
+bms_num_words(Bitmapset *bms)
+{
+	int n = bms ? bms->nwords : 0;
+
+	while (n > 0 && bms->words[n - 1] == 0)
+		n--;
+
+	return n;
+}
+
+/*
+ * bms_to_words
+ */
+static void
+bms_to_words(Bitmapset *bms, bitmapword *words, int nwords)
+{
+	int n = bms_num_words(bms);
+
+	Assert(n <= nwords);
+
+	MemSet(words, 0, nwords * sizeof(bitmapword));
+	if (n)
+		memcpy(words, bms->words, n * sizeof(bitmapword));
+}
+
+/*
+ * current_generation
+ */
+static uint32
+current_generation(void)
+{
+	return pg_atomic_read_u32(&readers_cache->generation);
+}
+
+/*
+ * GetStreamReadersCacheGeneration
+ *
+ * Must be called before a stream's readers are read from the catalogs for storing in the cache,
+ * so that an invalidation that happens in the mean time discards them. Any catalog invalidations
+ * sent before the returned generation was reached are accepted first.
+ */
+uint32
+GetStreamReadersCacheGeneration(void)
+{
+	uint32 generation = current_generation();
+
+	AcceptInvalidationMessages();
+
+	return generation;
+}
+
+/*
+ * StreamReadersCacheLookup
+ *
+ * Gets the cached readers of the given stream and the attributes they read, allocated in the
+ * current memory context. Returns false if they aren't cached.
+ */
+bool
+StreamReadersCacheLookup(Oid relid, Bitmapset **readers, bool *prunable, Bitmapset **read_attrs)
+{
+	StreamReadersKey key;
+	StreamReadersSlot *slot;
+	bool found = false;
+
+	make_key(&key, relid);
+
+	LWLockAcquire(StreamReadersCacheLock, LW_SHARED);
+
+	slot = find_slot(&key);
+
+	if (slot->used && slot->generation == current_generation())
+	{
+		*readers = words_to_bms(slot->readers, READERS_WORDS);
+		*read_attrs = words_to_bms(slot->read_attrs, ATTRS_WORDS);
+		*prunable = slot->prunable;
+		found = true;
+	}
+
+	LWLockRelease(StreamReadersCacheLock);
+
+	return found;
+}
+
+/*
+ * StreamReadersCacheStore
+ *
+ * Publishes the readers of the given stream and the attributes they read. generation is what
+ * GetStreamReadersCacheGeneration returned before they were read from the catalogs, and if it
+ * has changed since then they're dropped.
+ */
+void
+StreamReadersCacheStore(Oid relid, Bitmapset *readers, bool prunable, Bitmapset *read_attrs, uint32 generation)
+{
+	StreamReadersKey key;
+	StreamReadersSlot *slot;
+
+	if (bms_num_words(readers) > READERS_WORDS || bms_num_words(read_attrs) > ATTRS_WORDS)
+		return;
+
+	make_key(&key, relid);
+
+	LWLockAcquire(StreamReadersCacheLock, LW_EXCLUSIVE);
+
+	if (generation != current_generation())
+	{
+		LWLockRelease(StreamReadersCacheLock);
+		return;
+	}
+
+	/*
+	 * Slots of dropped streams are never reused, so once the cache fills up it's simply
+	 * emptied if some of its entries are outdated, and they're published again as needed
+	 */
+	slot = find_slot(&key);
+
+	if (!slot->used && readers_cache->nstreams >= MAX_STREAMS)
+	{
+		int i;
+
+		for (i = 0; i < STREAM_READERS_CACHE_SIZE; i++)
+		{
+			if (readers_cache->slots[i].used && readers_cache->slots[i].generation != generation)
+				break;
+		}
+
+		if (i < STREAM_READERS_CACHE_SIZE)
+		{
+			MemSet(readers_cache->slots, 0, sizeof(readers_cache->slots));
+			readers_cache->nstreams = 0;
+			slot = find_slot(&key);
+		}
+	}
+
+	if (slot->used || readers_cache->nstreams < MAX_STREAMS)
+	{
+		if (!slot->used)
+		{
+			slot->key = key;
+			slot->used = true;
+			readers_cache->nstreams++;
+		}
+
+		bms_to_words(readers, slot->readers, READERS_WORDS);
+		bms_to_words(read_attrs, slot->read_attrs, ATTRS_WORDS);
+		slot->prunable = prunable;
+		slot->generation = generation;
+	}
+
+	LWLockRelease(StreamReadersCacheLock);
+}
+
+/*
+ * cache_release_callback
+ *
+ * The generation is bumped after the transaction's catalog invalidations are sent, so that any
+ * backend that sees the new generation also sees the new catalog state once it accepts them
+ */
+static void
+cache_release_callback(ResourceReleasePhase phase, bool isCommit, bool isTopLevel, void *arg)
+{
+	if (!inval_pending || !isTopLevel || phase != RESOURCE_RELEASE_AFTER_LOCKS)
+		return;
+
+	if (isCommit)
+		pg_atomic_fetch_add_u32(&readers_cache->generation, 1);
+
+	inval_pending = false;
+}
+
+/*
+ * InvalidateStreamReadersCache
+ *
+ * Invalidates the readers of all streams once the current transaction commits
+ */
+void
+InvalidateStreamReadersCache(void)
+{
+	if (!callback_registered)
+	{
+		RegisterResourceReleaseCallback(cache_release_callback, NULL);
+		callback_registered = true;
+	}
+
+	inval_pending = true;
+}
@@ -0,0 +1,477 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_vector.c
+ *
+ *	  Evaluation of simple stream scan quals over vectors of events
+ *
+ * Most continuous views filter their input with comparisons of a stream column
+ * against a constant. Rather than running each of those through the expression
+ * interpreter one event at a time, the stream scan decodes events into column
+ * vectors and evaluates such comparisons over a whole vector at once, using tight
+ * loops over flat arrays that the compiler can vectorize. Only the events that
+ * pass them are formed into tuples and handed to the rest of the plan, which
+ * evaluates whatever quals remain.
+ *
+ * Only comparisons between integer, floating point, date and timestamp values and
+ * text equality are vectorized, since their semantics are fully defined by the
+ * btree operator families they belong to, and none of them can fail.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/stream_vector.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/transam.h"
+#include "access/tuptoaster.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "nodes/execnodes.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/planmain.h"
+#include "pipeline/stream_vector.h"
+#include "utils/lsyscache.h"
+
+/* guc parameters */
+bool continuous_query_vectorized_quals;
+
+typedef enum VectorClass
+{
+	VECTOR_INT,
+	VECTOR_FLOAT,
+	VECTOR_DATE,
+	VECTOR_TIMESTAMP,
+	VECTOR_TIMESTAMPTZ,
+	VECTOR_TEXT
+} VectorClass;
+
+typedef struct StreamVectorQual
+{
+	/* zero-based attribute of the stream scan's tuple being compared */
+	int attno;
+	Oid atttype;
+	VectorClass cls;
+	/* ROWCOMPARE_* strategy, with the attribute always on the left */
+	int strategy;
+	int64 ival;
+	float8 fval;
+	text *tval;
+	Size tlen;
+} StreamVectorQual;
+
+/*
+ * Comparison results accepted by each strategy, indexed by the sign of compare(value, constant) + 1
+ */
+static const bool strategy_accepts[ROWCOMPARE_NE + 1][3] = {
+	{ false, false, false },
+	{ true, false, false },		/* ROWCOMPARE_LT */
+	{ true, true, false },		/* ROWCOMPARE_LE */
+	{ false, true, false },		/* ROWCOMPARE_EQ */
+	{ false, true, true },		/* ROWCOMPARE_GE */
+	{ false, false, true },		/* ROWCOMPARE_GT */
+	{ true, false, true }		/* ROWCOMPARE_NE */
+};
+
+/*
+ * get_vector_class
+ */
+static bool
+get_vector_class(Oid typid, VectorClass *cls)
+{
+	switch (typid)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+			*cls = VECTOR_INT;
+			return true;
+		case FLOAT4OID:
+		case FLOAT8OID:
+			*cls = VECTOR_FLOAT;
+			return true;
+		case DATEOID:
+			*cls = VECTOR_DATE;
+			return true;
+#ifdef HAVE_INT64_TIMESTAMP
+		case TIMESTAMPOID:
+			*cls = VECTOR_TIMESTAMP;
+			return true;
+		case TIMESTAMPTZOID:
+			*cls = VECTOR_TIMESTAMPTZ;
+			return true;
+#endif
+		case TEXTOID:
+			*cls = VECTOR_TEXT;
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * get_int_value
+ */
+static inline int64
+get_int_value(Datum d, Oid typid)
+{
+	switch (typid)
+	{
+		case INT2OID:
+			return (int64) DatumGetInt16(d);
+		case INT4OID:
+		case DATEOID:
+			return (int64) DatumGetInt32(d);
+		default:
+			return DatumGetInt64(d);
+	}
+}
+
+/*
+ * get_float_value
+ */
+static inline float8
+get_float_value(Datum d, Oid typid)
+{
+	if (typid == FLOAT4OID)
+		return (float8) DatumGetFloat4(d);
+
+	return DatumGetFloat8(d);
+}
+
+/*
+ * commute_strategy
+ */
+static int
+commute_strategy(int strategy)
+{
+	switch (strategy)
+	{
+		case ROWCOMPARE_LT:
+			return ROWCOMPARE_GT;
+		case ROWCOMPARE_LE:
+			return ROWCOMPARE_GE;
+		case ROWCOMPARE_GE:
+			return ROWCOMPARE_LE;
+		case ROWCOMPARE_GT:
+			return ROWCOMPARE_LT;
+	}
+
+	return strategy;
+}
+
+/*
+ * get_btree_strategy
+ *
+ * Returns the strategy of the given operator within the default btree operator family of
+ * its left input type, or 0 if it isn't a member of that family
+ */
+static int
+get_btree_strategy(Oid opno, Oid lefttype)
+{
+	Oid opclass = GetDefaultOpClass(lefttype, BTREE_AM_OID);
+	Oid opfamily;
+	List *interps;
+	ListCell *lc;
+	int strategy = 0;
+
+	if (!OidIsValid(opclass))
+		return 0;
+
+	opfamily = get_opclass_family(opclass);
+	interps = get_op_btree_interpretation(opno);
+
+	foreach(lc, interps)
+	{
+		OpBtreeInterpretation *interp = (OpBtreeInterpretation *) lfirst(lc);
+
+		if (interp->opfamily_id == opfamily)
+		{
+			strategy = interp->strategy;
+			break;
+		}
+	}
+
+	list_free_deep(interps);
+
+	return strategy;
+}
+
+/*
+ * make_vector_qual
+ *
+ * Returns a vectorized version of the given qual if it's a comparison of a stream attribute
+ * against a constant that we know how to vectorize, NULL otherwise
+ */
+static StreamVectorQual *
+make_vector_qual(Expr *expr, Index scanrelid)
+{
+	OpExpr *op;
+	Node *left;
+	Node *right;
+	Oid lefttype;
+	Oid righttype;
+	VectorClass lcls;
+	VectorClass rcls;
+	Var *var;
+	Const *c;
+	int strategy;
+	StreamVectorQual *q;
+
+	if (!IsA(expr, OpExpr))
+		return NULL;
+
+	op = (OpExpr *) expr;
+	if (list_length(op->args) != 2)
+		return NULL;
+
+	left = (Node *) linitial(op->args);
+	right = (Node *) lsecond(op->args);
+	lefttype = exprType(left);
+	righttype = exprType(right);
+
+	if (!get_vector_class(lefttype, &lcls) || !get_vector_class(righttype, &rcls) || lcls != rcls)
+		return NULL;
+
+	/* only builtin operators have semantics we can rely on */
+	set_opfuncid(op);
+	if (op->opfuncid >= FirstNormalObjectId)
+		return NULL;
+
+	strategy = get_btree_strategy(op->opno, lefttype);
+	if (!strategy)
+		return NULL;
+
+	/* text ordering depends on the collation, but equality is always bitwise */
+	if (lcls == VECTOR_TEXT && strategy != ROWCOMPARE_EQ && strategy != ROWCOMPARE_NE)
+		return NULL;
+
+	/* binary compatible conversions, such as from varchar to text, don't change the value */
+	while (IsA(left, RelabelType))
+		left = (Node *) ((RelabelType *) left)->arg;
+	while (IsA(right, RelabelType))
+		right = (Node *) ((RelabelType *) right)->arg;
+
+	if (IsA(left, Const) && IsA(right, Var))
+	{
+		Node *tmp = left;
+		Oid tmptype = lefttype;
+
+		left = right;
+		right = tmp;
+		lefttype = righttype;
+		righttype = tmptype;
+		strategy = commute_strategy(strategy);
+	}
+
+	if (!IsA(left, Var) || !IsA(right, Const))
+		return NULL;
+
+	var = (Var *) left;
+	c = (Const *) right;
+
+	if (var->varno != scanrelid || var->varlevelsup != 0 || var->varattno <= 0 || c->constisnull)
+		return NULL;
+
+	q = palloc0(sizeof(StreamVectorQual));
+	q->attno = var->varattno - 1;
+	q->atttype = lefttype;
+	q->cls = lcls;
+	q->strategy = strategy;
+
+	switch (lcls)
+	{
+		case VECTOR_INT:
+		case VECTOR_DATE:
+		case VECTOR_TIMESTAMP:
+		case VECTOR_TIMESTAMPTZ:
+			q->ival = get_int_value(c->constvalue, righttype);
+			break;
+		case VECTOR_FLOAT:
+			q->fval = get_float_value(c->constvalue, righttype);
+			break;
+		case VECTOR_TEXT:
+			q->tval = DatumGetTextPCopy(c->constvalue);
+			q->tlen = VARSIZE_ANY_EXHDR(q->tval);
+			break;
+	}
+
+	return q;
+}
+
+/*
+ * ExtractStreamVectorQuals
+ *
+ * Removes the quals that can be vectorized from the given implicitly ANDed list of
+ * qual ExprStates, and returns their vectorized versions
+ */
+List *
+ExtractStreamVectorQuals(List **qual, Index scanrelid)
+{
+	List *result = NIL;
+	List *remaining = NIL;
+	ListCell *lc;
+
+	foreach(lc, *qual)
+	{
+		ExprState *state = (ExprState *) lfirst(lc);
+		StreamVectorQual *q = make_vector_qual(state->expr, scanrelid);
+
+		if (q)
+			result = lappend(result, q);
+		else
+			remaining = lappend(remaining, state);
+	}
+
+	*qual = remaining;
+
+	return result;
+}
+
+/*
+ * StreamVectorCreate
+ */
+StreamVector *
+StreamVectorCreate(int natts)
+{
+	StreamVector *vec = palloc0(sizeof(StreamVector));
+
+	vec->natts = natts;
+	vec->events = palloc0(sizeof(StreamTupleState *) * STREAM_VECTOR_SIZE);
+	vec->values = palloc0(sizeof(Datum) * natts * STREAM_VECTOR_SIZE);
+	vec->nulls = palloc0(sizeof(bool) * natts * STREAM_VECTOR_SIZE);
+	vec->selected = palloc0(sizeof(bool) * STREAM_VECTOR_SIZE);
+
+	return vec;
+}
+
+/*
+ * eval_int_qual
+ */
+static void
+eval_int_qual(StreamVectorQual *q, Datum *values, bool *nulls, bool *selected, int n)
+{
+	int64 v[STREAM_VECTOR_SIZE];
+	const bool *ok = strategy_accepts[q->strategy];
+	int64 c = q->ival;
+	int i;
+
+	/* by-reference int8 values can only be read when they aren't null */
+	for (i = 0; i < n; i++)
+		v[i] = nulls[i] ? 0 : get_int_value(values[i], q->atttype);
+
+	for (i = 0; i < n; i++)
+		selected[i] = selected[i] & !nulls[i] & ok[(v[i] > c) - (v[i] < c) + 1];
+}
+
+/*
+ * eval_float_qual
+ */
+static void
+eval_float_qual(StreamVectorQual *q, Datum *values, bool *nulls, bool *selected, int n)
+{
+	float8 v[STREAM_VECTOR_SIZE];
+	bool nan[STREAM_VECTOR_SIZE];
+	const bool *ok = strategy_accepts[q->strategy];
+	float8 c = q->fval;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		v[i] = nulls[i] ? 0 : get_float_value(values[i], q->atttype);
+		nan[i] = isnan(v[i]);
+	}
+
+	/* NaNs are equal to each other and larger than anything else, just like float8_cmp_internal */
+	if (isnan(c))
+	{
+		for (i = 0; i < n; i++)
+			selected[i] = selected[i] & !nulls[i] & ok[nan[i] ? 1 : 0];
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		selected[i] = selected[i] & !nulls[i] & ok[nan[i] ? 2 : (v[i] > c) - (v[i] < c) + 1];
+}
+
+/*
+ * eval_text_qual
+ */
+static void
+eval_text_qual(StreamVectorQual *q, Datum *values, bool *nulls, bool *selected, int n)
+{
+	bool eq = q->strategy == ROWCOMPARE_EQ;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		text *t;
+		bool match;
+
+		if (!selected[i])
+			continue;
+
+		if (nulls[i])
+		{
+			selected[i] = false;
+			continue;
+		}
+
+		/* like texteq, avoid detoasting values whose length alone tells them apart */
+		if (toast_raw_datum_size(values[i]) - VARHDRSZ != q->tlen)
+		{
+			selected[i] = !eq;
+			continue;
+		}
+
+		t = DatumGetTextPP(values[i]);
+		match = memcmp(VARDATA_ANY(t), VARDATA_ANY(q->tval), q->tlen) == 0;
+
+		if ((Pointer) t != DatumGetPointer(values[i]))
+			pfree(t);
+
+		selected[i] = eq ? match : !match;
+	}
+}
+
+/*
+ * StreamVectorEvalQuals
+ *
+ * Marks the rows of the given vector that pass all of the given vectorized quals as selected
+ */
+void
+StreamVectorEvalQuals(StreamVector *vec, List *quals)
+{
+	ListCell *lc;
+
+	MemSet(vec->selected, true, sizeof(bool) * vec->nrows);
+
+	foreach(lc, quals)
+	{
+		StreamVectorQual *q = (StreamVectorQual *) lfirst(lc);
+		Datum *values = vec->values + q->attno * STREAM_VECTOR_SIZE;
+		bool *nulls = vec->nulls + q->attno * STREAM_VECTOR_SIZE;
+
+		Assert(q->attno < vec->natts);
+
+		switch (q->cls)
+		{
+			case VECTOR_INT:
+			case VECTOR_DATE:
+			case VECTOR_TIMESTAMP:
+			case VECTOR_TIMESTAMPTZ:
+				eval_int_qual(q, values, nulls, vec->selected, vec->nrows);
+				break;
+			case VECTOR_FLOAT:
+				eval_float_qual(q, values, nulls, vec->selected, vec->nrows);
+				break;
+			case VECTOR_TEXT:
+				eval_text_qual(q, values, nulls, vec->selected, vec->nrows);
+				break;
+		}
+	}
+}
@@ -3,7 +3,9 @@
  * sw_vacuum.c
  *
  *   Support for vacuuming discarded tuples for sliding window
- *   continuous views.
+ *   continuous views, for compacting the frozen time buckets of
+ *   views with freeze_after, and for downsampling the aged time
+ *   buckets of views with a downsample policy.
  *
  * Copyright (c) 2013-2015, PipelineDB
  *
@@ -12,28 +14,46 @@
  *-------------------------------------------------------------------------
  */
 #include "postgres.h"
+#include "access/genam.h"
+#include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/skey.h"
+#include "access/tuptoaster.h"
 #include "access/xact.h"
+#include "catalog/pg_am.h"
 #include "catalog/pipeline_query.h"
 #include "catalog/pipeline_query_fn.h"
-#include "executor/tstoreReceiver.h"
+#include "commands/vacuum.h"
 #include "miscadmin.h"
 #include "nodes/execnodes.h"
 #include "nodes/makefuncs.h"
+#include "nodes/tidbitmap.h"
 #include "optimizer/clauses.h"
 #include "optimizer/planner.h"
 #include "parser/parse_expr.h"
 #include "pipeline/cont_analyze.h"
 #include "pipeline/cqmatrel.h"
 #include "pipeline/sw_vacuum.h"
+#include "storage/bufmgr.h"
 #include "storage/lmgr.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
+#include "utils/fmgroids.h"
 #include "utils/hsearch.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+int sliding_window_vacuum_batch_size = 10000;
+
+/* a range of matrel blocks that may contain expired rows, excluding end */
+typedef struct SWBlockRange
+{
+	BlockNumber start;
+	BlockNumber end;
+} SWBlockRange;
 
 static Node *
 get_sw_vacuum_expr(RangeVar *rv)
@@ -43,6 +63,218 @@ get_sw_vacuum_expr(RangeVar *rv)
 	return (Node *) make_notclause((Expr *) expr);
 }
 
+/*
+ * get_sw_expiry
+ *
+ * Get the matrel attribute holding the given sliding-window view's time column,
+ * along with the time at or before which its rows are expired
+ */
+static AttrNumber
+get_sw_expiry(RangeVar *cvname, Oid relid, TimestampTz *cutoff)
+{
+	ColumnRef *col = GetWindowTimeColumn(cvname);
+	ContQuery *cq = GetContQueryForView(cvname);
+
+	if (col == NULL || cq == NULL)
+		return InvalidAttrNumber;
+
+	*cutoff = GetCurrentTimestamp() - (1000 * cq->sw_interval_ms);
+
+	return get_attnum(relid, strVal(llast(col->fields)));
+}
+
+/*
+ * init_sw_expired_skey
+ */
+static void
+init_sw_expired_skey(ScanKey skey, AttrNumber attno, Oid type, TimestampTz cutoff)
+{
+	ScanKeyEntryInitialize(skey, 0, attno, BTLessEqualStrategyNumber, type,
+			InvalidOid, F_TIMESTAMP_LE, TimestampTzGetDatum(cutoff));
+}
+
+/*
+ * get_sw_expired_ranges
+ *
+ * Get the ranges of the given matrel's blocks that may contain expired rows. If the matrel
+ * has a BRIN index on its time column, only the block ranges whose summaries include expired
+ * times are returned, otherwise the whole matrel is. The ranges are allocated in cxt.
+ */
+static List *
+get_sw_expired_ranges(Relation rel, AttrNumber ts_attr, TimestampTz cutoff, MemoryContext cxt)
+{
+	BlockNumber nblocks = RelationGetNumberOfBlocks(rel);
+	Oid type = RelationGetDescr(rel)->attrs[ts_attr - 1]->atttypid;
+	List *indexes = RelationGetIndexList(rel);
+	List *result = NIL;
+	SWBlockRange *range = NULL;
+	TIDBitmap *tbm = NULL;
+	TBMIterator *it;
+	TBMIterateResult *res;
+	MemoryContext old;
+	ListCell *lc;
+
+	foreach(lc, indexes)
+	{
+		Relation index = index_open(lfirst_oid(lc), AccessShareLock);
+
+		if (index->rd_rel->relam == BRIN_AM_OID && index->rd_index->indnatts == 1 &&
+				index->rd_index->indkey.values[0] == ts_attr)
+		{
+			IndexScanDesc scan;
+			ScanKeyData skey[1];
+
+			init_sw_expired_skey(&skey[0], 1, type, cutoff);
+
+			tbm = tbm_create(work_mem * 1024L);
+			scan = index_beginscan_bitmap(index, GetActiveSnapshot(), 1);
+			index_rescan(scan, skey, 1, NULL, 0);
+			index_getbitmap(scan, tbm);
+			index_endscan(scan);
+		}
+
+		index_close(index, AccessShareLock);
+
+		if (tbm)
+			break;
+	}
+
+	list_free(indexes);
+
+	old = MemoryContextSwitchTo(cxt);
+
+	if (tbm == NULL)
+	{
+		range = palloc(sizeof(SWBlockRange));
+		range->start = 0;
+		range->end = nblocks;
+		MemoryContextSwitchTo(old);
+
+		return list_make1(range);
+	}
+
+	/* BRIN bitmaps are lossy and ordered by block, so merge them into contiguous ranges */
+	it = tbm_begin_iterate(tbm);
+	while ((res = tbm_iterate(it)) != NULL)
+	{
+		if (range && range->end == res->blockno)
+		{
+			range->end++;
+			continue;
+		}
+
+		range = palloc(sizeof(SWBlockRange));
+		range->start = res->blockno;
+		range->end = res->blockno + 1;
+		result = lappend(result, range);
+	}
+	tbm_end_iterate(it);
+
+	MemoryContextSwitchTo(old);
+	tbm_free(tbm);
+
+	return result;
+}
+
+/*
+ * begin_sw_expired_scan
+ *
+ * Begin a scan of the given matrel's expired rows within the given range of blocks
+ */
+static HeapScanDesc
+begin_sw_expired_scan(Relation rel, AttrNumber ts_attr, TimestampTz cutoff,
+		BlockNumber start, BlockNumber end, ScanKey skey)
+{
+	HeapScanDesc scan;
+
+	init_sw_expired_skey(skey, ts_attr, RelationGetDescr(rel)->attrs[ts_attr - 1]->atttypid, cutoff);
+
+	scan = heap_beginscan_strat(rel, GetActiveSnapshot(), 1, skey, true, false);
+	heap_setscanlimits(scan, start, end - start);
+
+	return scan;
+}
+
+/*
+ * delete_sw_expired_batch
+ *
+ * Delete up to sliding_window_vacuum_batch_size expired tuples of the given matrel in their own
+ * transaction, starting from the given position within the given block ranges. Returns false
+ * once all of the ranges have been scanned.
+ */
+static bool
+delete_sw_expired_batch(Oid relid, AttrNumber ts_attr, TimestampTz cutoff,
+		List *ranges, int *range_idx, BlockNumber *block)
+{
+	Relation rel;
+	BlockNumber nblocks;
+	CommandId cid;
+	int ndeleted = 0;
+	bool more = false;
+
+	StartTransactionCommand();
+
+	rel = try_relation_open(relid, RowExclusiveLock);
+	if (rel == NULL)
+	{
+		CommitTransactionCommand();
+		return false;
+	}
+
+	nblocks = RelationGetNumberOfBlocks(rel);
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+	cid = GetCurrentCommandId(true);
+
+	for (; *range_idx < list_length(ranges) && !more; (*range_idx)++, *block = 0)
+	{
+		SWBlockRange *range = (SWBlockRange *) list_nth(ranges, *range_idx);
+		BlockNumber start = Max(*block, range->start);
+		BlockNumber end = Min(range->end, nblocks);
+		HeapScanDesc scan;
+		HeapTuple tup;
+		ScanKeyData skey[1];
+
+		if (start >= end)
+			continue;
+
+		scan = begin_sw_expired_scan(rel, ts_attr, cutoff, start, end, skey);
+
+		while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+		{
+			HeapUpdateFailureData hufd;
+			ItemPointerData tid = tup->t_self;
+
+			/*
+			 * We never wait on combiners here. Tuples that are being updated concurrently are
+			 * left for the next vacuum, by which point they've either been rewritten inside
+			 * the window or are still expired.
+			 */
+			(void) heap_delete(rel, &tid, cid, InvalidSnapshot, false, &hufd);
+
+			if (++ndeleted >= sliding_window_vacuum_batch_size)
+			{
+				/* Deleted tuples aren't visible to the next batch, so it can start from this block */
+				*block = ItemPointerGetBlockNumber(&tid);
+				more = true;
+				break;
+			}
+		}
+
+		heap_endscan(scan);
+
+		/* Resume within this range */
+		if (more)
+			break;
+	}
+
+	PopActiveSnapshot();
+
+	heap_close(rel, NoLock);
+	CommitTransactionCommand();
+
+	return more;
+}
 
 /*
  * DeleteSWExpiredTuples
@@ -60,9 +292,13 @@ DeleteSWExpiredTuples(Oid relid)
 	PlannedStmt *plan;
 	Portal portal;
 	DestReceiver *receiver;
+	MemoryContext callercxt = CurrentMemoryContext;
 	MemoryContext oldcxt;
 	MemoryContext runctx;
 	bool save_continuous_query_materialization_table_updatable = continuous_query_materialization_table_updatable;
+	AttrNumber ts_attr = InvalidAttrNumber;
+	TimestampTz cutoff = 0;
+	List *ranges = NIL;
 
 	continuous_query_materialization_table_updatable = true;
 
@@ -95,8 +331,30 @@ DeleteSWExpiredTuples(Oid relid)
 	/* Now we're certain relid is for a SW continuous view's matrel */
 
 	/*
-	 * TODO(usmanm): Use lock contention free strategy here. See https://news.ycombinator.com/item?id=9018129
+	 * Rather than running a single DELETE over the whole matrel, delete expired tuples in
+	 * small batches, each in its own short transaction, so that combiners never wait long
+	 * on us and vacuum cost-based delays apply between batches. The batches only look at
+	 * the block ranges that may contain expired tuples.
 	 */
+	if (sliding_window_vacuum_batch_size > 0)
+		ts_attr = get_sw_expiry(cvname, relid, &cutoff);
+
+	if (AttributeNumberIsValid(ts_attr))
+	{
+		Relation rel = try_relation_open(relid, AccessShareLock);
+
+		if (rel)
+		{
+			PushActiveSnapshot(GetTransactionSnapshot());
+			ranges = get_sw_expired_ranges(rel, ts_attr, cutoff, callercxt);
+			PopActiveSnapshot();
+
+			heap_close(rel, AccessShareLock);
+		}
+
+		goto end;
+	}
+
 	stmt = makeNode(DeleteStmt);
 	stmt->relation = matrel;
 	stmt->whereClause = get_sw_vacuum_expr(cvname);
@@ -138,6 +396,306 @@ end:
 	MemoryContextDelete(runctx);
 
 	CommitTransactionCommand();
+
+	if (ranges)
+	{
+		int range_idx = 0;
+		BlockNumber block = 0;
+
+		while (delete_sw_expired_batch(relid, ts_attr, cutoff, ranges, &range_idx, &block))
+			vacuum_delay_point();
+
+		list_free_deep(ranges);
+	}
+}
+
+/*
+ * compact_frozen_tuple
+ *
+ * Get a copy of the given matrel row with all of its inline values compressed, or NULL if
+ * none of them could be
+ */
+static HeapTuple
+compact_frozen_tuple(TupleDesc desc, HeapTuple tup)
+{
+	Datum *values = palloc(desc->natts * sizeof(Datum));
+	bool *nulls = palloc(desc->natts * sizeof(bool));
+	bool compressed = false;
+	HeapTuple result = NULL;
+	int i;
+
+	heap_deform_tuple(tup, desc, values, nulls);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Datum d;
+
+		/* Values that are short, already compressed or toasted are left alone */
+		if (nulls[i] || desc->attrs[i]->attlen != -1 ||
+				desc->attrs[i]->attstorage == 'p' || VARATT_IS_EXTENDED(DatumGetPointer(values[i])))
+			continue;
+
+		d = toast_compress_datum(values[i]);
+		if (DatumGetPointer(d) == NULL)
+			continue;
+
+		values[i] = d;
+		compressed = true;
+	}
+
+	if (compressed)
+		result = heap_form_tuple(desc, values, nulls);
+
+	pfree(values);
+	pfree(nulls);
+
+	return result;
+}
+
+/*
+ * freeze_matrel_batch
+ *
+ * Compact up to sliding_window_vacuum_batch_size rows of frozen time buckets of the given
+ * matrel in their own transaction, starting from the given position within the given block
+ * ranges. Returns false once all of the ranges have been scanned.
+ */
+static bool
+freeze_matrel_batch(Oid relid, AttrNumber ts_attr, TimestampTz cutoff,
+		List *ranges, int *range_idx, BlockNumber *block)
+{
+	Relation rel;
+	ResultRelInfo *ri;
+	EState *estate;
+	TupleTableSlot *slot;
+	BlockNumber nblocks;
+	CommandId cid;
+	int batch_size = sliding_window_vacuum_batch_size > 0 ? sliding_window_vacuum_batch_size : INT_MAX;
+	int ncompacted = 0;
+	bool more = false;
+
+	StartTransactionCommand();
+
+	rel = try_relation_open(relid, RowExclusiveLock);
+	if (rel == NULL)
+	{
+		CommitTransactionCommand();
+		return false;
+	}
+
+	nblocks = RelationGetNumberOfBlocks(rel);
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+	cid = GetCurrentCommandId(true);
+
+	ri = CQMatRelOpen(rel);
+	estate = CreateExecutorState();
+	slot = MakeSingleTupleTableSlot(RelationGetDescr(rel));
+
+	for (; *range_idx < list_length(ranges) && !more; (*range_idx)++, *block = 0)
+	{
+		SWBlockRange *range = (SWBlockRange *) list_nth(ranges, *range_idx);
+		BlockNumber start = Max(*block, range->start);
+		BlockNumber end = Min(range->end, nblocks);
+		HeapScanDesc scan;
+		HeapTuple tup;
+		ScanKeyData skey[1];
+
+		if (start >= end)
+			continue;
+
+		scan = begin_sw_expired_scan(rel, ts_attr, cutoff, start, end, skey);
+
+		while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+		{
+			HeapUpdateFailureData hufd;
+			LockTupleMode lockmode;
+			ItemPointerData tid = tup->t_self;
+			HeapTuple compacted = compact_frozen_tuple(RelationGetDescr(rel), tup);
+
+			if (compacted == NULL)
+				continue;
+
+			/*
+			 * As with expired tuples, we never wait on combiners. A row that's being updated
+			 * concurrently is in a bucket a combiner still considers open, and it's compacted
+			 * by a later vacuum once its bucket is frozen there too.
+			 */
+			if (heap_update(rel, &tid, compacted, cid, InvalidSnapshot, false, &hufd, &lockmode) == HeapTupleMayBeUpdated)
+			{
+				ExecStoreTuple(compacted, slot, InvalidBuffer, false);
+				if (!HeapTupleIsHeapOnly(compacted))
+					ExecInsertCQMatRelIndexTuples(ri, slot, estate, NULL);
+				ExecClearTuple(slot);
+			}
+
+			heap_freetuple(compacted);
+
+			if (++ncompacted >= batch_size)
+			{
+				/* New versions of compacted tuples are skipped by the next batch, so it can start from this block */
+				*block = ItemPointerGetBlockNumber(&tid);
+				more = true;
+				break;
+			}
+		}
+
+		heap_endscan(scan);
+
+		/* Resume within this range */
+		if (more)
+			break;
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExecutorState(estate);
+	CQMatRelClose(ri);
+
+	PopActiveSnapshot();
+
+	heap_close(rel, NoLock);
+	CommitTransactionCommand();
+
+	return more;
+}
+
+/*
+ * FreezeMatRelBuckets
+ *
+ * If relid is the matrel of a view with freeze_after, compress the rows of its time buckets
+ * that have been closed for longer than that. The combiners no longer update or look up these
+ * rows, so they can be kept in a compact form for the readers that remain.
+ */
+void
+FreezeMatRelBuckets(Oid relid)
+{
+	MemoryContext callercxt = CurrentMemoryContext;
+	MemoryContext oldcxt;
+	MemoryContext runctx;
+	char *relname;
+	RangeVar *cvname;
+	ContQuery *cq;
+	AttrNumber ts_attr = InvalidAttrNumber;
+	TimestampTz cutoff = 0;
+	List *ranges = NIL;
+
+	StartTransactionCommand();
+
+	runctx = AllocSetContextCreate(CurrentMemoryContext,
+			"FreezeMatRelBucketsContext",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	oldcxt = MemoryContextSwitchTo(runctx);
+
+	relname = get_rel_name(relid);
+	if (!relname)
+		goto end;
+
+	cvname = GetCVNameFromMatRelName(makeRangeVar(get_namespace_name(get_rel_namespace(relid)), relname, -1));
+	if (!cvname)
+		goto end;
+
+	cq = GetContQueryForView(cvname);
+	if (cq == NULL || !cq->freeze_column)
+		goto end;
+
+	ts_attr = get_attnum(relid, cq->freeze_column);
+
+	/*
+	 * Combiners freeze buckets by their own watermarks, which never pass the current time, so this
+	 * cutoff includes every bucket they've frozen
+	 */
+	cutoff = GetCurrentTimestamp() - (1000 * (int64) cq->freeze_after_ms);
+
+	if (AttributeNumberIsValid(ts_attr))
+	{
+		Relation rel = try_relation_open(relid, AccessShareLock);
+
+		if (rel)
+		{
+			PushActiveSnapshot(GetTransactionSnapshot());
+			ranges = get_sw_expired_ranges(rel, ts_attr, cutoff, callercxt);
+			PopActiveSnapshot();
+
+			heap_close(rel, AccessShareLock);
+		}
+	}
+
+end:
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(runctx);
+
+	CommitTransactionCommand();
+
+	if (ranges)
+	{
+		int range_idx = 0;
+		BlockNumber block = 0;
+
+		while (freeze_matrel_batch(relid, ts_attr, cutoff, ranges, &range_idx, &block))
+			vacuum_delay_point();
+
+		list_free_deep(ranges);
+	}
+}
+
+/*
+ * DownsampleMatRelBuckets
+ *
+ * If relid is the matrel of a view with a downsample policy, merge its groups whose time buckets
+ * have aged past the policy's ages into coarser buckets, in batches of their own transactions.
+ * Merged groups may belong to any combiner, so each batch locks the combiners out of the matrel,
+ * and we'd rather wait for the next vacuum than wait on them.
+ */
+void
+DownsampleMatRelBuckets(Oid relid)
+{
+	int batch_size = sliding_window_vacuum_batch_size > 0 ? sliding_window_vacuum_batch_size : INT_MAX;
+	bool more = true;
+
+	while (more)
+	{
+		char *relname;
+		RangeVar *cvname;
+		ContQuery *cq;
+		Relation rel;
+
+		more = false;
+
+		StartTransactionCommand();
+
+		relname = get_rel_name(relid);
+		if (!relname)
+			goto next;
+
+		cvname = GetCVNameFromMatRelName(makeRangeVar(get_namespace_name(get_rel_namespace(relid)), relname, -1));
+		if (!cvname)
+			goto next;
+
+		cq = GetContQueryForView(cvname);
+		if (cq == NULL || !cq->downsample)
+			goto next;
+
+		if (!ConditionalLockRelationOid(relid, ExclusiveLock))
+			goto next;
+
+		rel = try_relation_open(relid, NoLock);
+		if (rel == NULL)
+			goto next;
+
+		PushActiveSnapshot(GetTransactionSnapshot());
+		more = DownsampleGroups(cq, rel, batch_size);
+		PopActiveSnapshot();
+
+		heap_close(rel, NoLock);
+
+next:
+		CommitTransactionCommand();
+
+		if (more)
+			vacuum_delay_point();
+	}
 }
 
 /*
@@ -146,24 +704,16 @@ end:
 uint64_t
 NumSWExpiredTuples(Oid relid)
 {
-	uint64_t count;
+	uint64_t count = 0;
 	char *relname = get_rel_name(relid);
 	char *namespace = get_namespace_name(get_rel_namespace(relid));
 	RangeVar *matrel = makeRangeVar(namespace, relname, -1);
 	RangeVar *cvname;
-	SelectStmt *stmt;
-	CommandDest dest = DestTuplestore;
-	Tuplestorestate *store = NULL;
-	List *querytree_list;
-	List *parsetree_list;
-	PlannedStmt *plan;
-	Portal portal;
-	DestReceiver *receiver;
-	TupleTableSlot *slot;
-	QueryDesc *queryDesc;
-	StringInfoData sql;
-	Datum *datum;
-	bool isnull;
+	Relation rel;
+	AttrNumber ts_attr;
+	TimestampTz cutoff;
+	List *ranges;
+	ListCell *lc;
 	MemoryContext oldcontext;
 	MemoryContext runctx;
 	bool locked;
@@ -184,6 +734,21 @@ NumSWExpiredTuples(Oid relid)
 	if (!GetGCFlag(cvname))
 		return 0;
 
+	ts_attr = get_sw_expiry(cvname, relid, &cutoff);
+	if (!AttributeNumberIsValid(ts_attr))
+		return 0;
+
+	/* Don't wait on anything that's reorganizing the matrel */
+	if (!ConditionalLockRelationOid(relid, AccessShareLock))
+		return 0;
+
+	rel = try_relation_open(relid, NoLock);
+	if (rel == NULL)
+	{
+		UnlockRelationOid(relid, AccessShareLock);
+		return 0;
+	}
+
 	runctx = AllocSetContextCreate(CurrentMemoryContext,
 			"NumSWExpiredTuplesContext",
 			ALLOCSET_DEFAULT_MINSIZE,
@@ -192,62 +757,28 @@ NumSWExpiredTuples(Oid relid)
 
 	oldcontext = MemoryContextSwitchTo(runctx);
 
-	initStringInfo(&sql);
-	appendStringInfo(&sql, "SELECT COUNT(*) FROM %s.%s", namespace, relname);
-
-	parsetree_list = pg_parse_query(sql.data);
-	Assert(parsetree_list->length == 1);
-	resetStringInfo(&sql);
-
-	stmt = (SelectStmt *) linitial(parsetree_list);
-	stmt->whereClause = get_sw_vacuum_expr(cvname);
-
 	PushActiveSnapshot(GetTransactionSnapshot());
 
-	querytree_list = pg_analyze_and_rewrite((Node *) stmt, sql.data,
-			NULL, 0);
-	plan = pg_plan_query((Query *) linitial(querytree_list), 0, NULL);
-
-	portal = CreatePortal("__sw_num_expired__", true, true);
-	portal->visible = false;
-	PortalDefineQuery(portal,
-			NULL,
-			sql.data,
-			"SELECT",
-			list_make1(plan),
-			NULL);
-
-	store = tuplestore_begin_heap(true, true, work_mem);
-	receiver = CreateDestReceiver(dest);
-	SetTuplestoreDestReceiverParams(receiver, store, PortalGetHeapMemory(portal), true);
-
-	PortalStart(portal, NULL, 0, GetActiveSnapshot());
-	(void) PortalRun(portal,
-			FETCH_ALL,
-			true,
-			receiver,
-			receiver,
-			NULL);
+	ranges = get_sw_expired_ranges(rel, ts_attr, cutoff, runctx);
+	foreach(lc, ranges)
+	{
+		SWBlockRange *range = (SWBlockRange *) lfirst(lc);
+		HeapScanDesc scan;
+		ScanKeyData skey[1];
 
-	queryDesc = PortalGetQueryDesc(portal);
-	slot = MakeSingleTupleTableSlot(queryDesc->tupDesc);
-	tuplestore_gettupleslot(store, true, false, slot);
+		if (range->start >= range->end)
+			continue;
 
-	if (TupIsNull(slot))
-		count = 0;
-	else
-	{
-		slot_getallattrs(slot);
-		datum = (Datum *) heap_getattr(slot->tts_tuple, 1, slot->tts_tupleDescriptor, &isnull);
-		count = DatumGetInt64(datum);
+		scan = begin_sw_expired_scan(rel, ts_attr, cutoff, range->start, range->end, skey);
+		while (heap_getnext(scan, ForwardScanDirection) != NULL)
+			count++;
+		heap_endscan(scan);
 	}
 
-	(*receiver->rDestroy) (receiver);
-	tuplestore_end(store);
-	PortalDrop(portal, false);
-
 	PopActiveSnapshot();
 
+	heap_close(rel, AccessShareLock);
+
 	MemoryContextSwitchTo(oldcontext);
 	MemoryContextDelete(runctx);
 
@@ -61,24 +61,76 @@ TDigestCreateWithCompression(int compression)
 void
 TDigestDestroy(TDigest *t)
 {
-	if (t->unmerged_centroids != NIL)
-		list_free_deep(t->unmerged_centroids);
 	pfree(t);
 }
 
+/*
+ * reserve_unmerged
+ *
+ * Make room for a full buffer of unmerged centroids after the merged ones. A digest's size
+ * includes the whole buffer while it has any unmerged centroids, so copies of it keep the room.
+ */
+static TDigest *
+reserve_unmerged(TDigest *t)
+{
+	Size size = sizeof(TDigest) + sizeof(Centroid) * (t->num_centroids + t->threshold + 1);
+
+	Assert(t->num_unmerged == 0);
+
+	if (MemoryContextContains(CurrentMemoryContext, t))
+		t = repalloc(t, size);
+	else
+	{
+		TDigest *new = (TDigest *) palloc(size);
+		memcpy(new, t, TDigestSize(t));
+		t = new;
+	}
+
+	return t;
+}
+
 TDigest *
 TDigestAdd(TDigest *t, float8 x, int64 w)
 {
-	Centroid *c;
+	Centroid c;
+
+	c.weight = w;
+	c.mean = x;
+
+	return TDigestAddMany(t, &c, 1);
+}
+
+/*
+ * TDigestAddMany
+ *
+ * Adds the given centroids, merging them in whenever the buffer fills up
+ */
+TDigest *
+TDigestAddMany(TDigest *t, Centroid *centroids, int n)
+{
+	while (n > 0)
+	{
+		int room;
+		int i;
 
-	c = palloc0(sizeof(Centroid));
-	c->weight = w;
-	c->mean = x;
+		if (t->num_unmerged == 0)
+			t = reserve_unmerged(t);
 
-	t->unmerged_centroids = lappend(t->unmerged_centroids, c);
+		room = Min(n, t->threshold + 1 - t->num_unmerged);
+		memcpy(TDigestUnmerged(t) + t->num_unmerged, centroids, sizeof(Centroid) * room);
 
-	if (list_length(t->unmerged_centroids) > t->threshold)
-		t = TDigestCompress(t);
+		for (i = 0; i < room; i++)
+			t->unmerged_weight += centroids[i].weight;
+
+		t->num_unmerged += room;
+		centroids += room;
+		n -= room;
+
+		SET_VARSIZE(t, TDigestSize(t));
+
+		if (t->num_unmerged > t->threshold)
+			t = TDigestCompress(t);
+	}
 
 	return t;
 }
@@ -134,45 +186,59 @@ merge_centroid(mergeArgs *args, Centroid *merge)
 	}
 }
 
+/*
+ * get_scratch
+ *
+ * Returns a zeroed array of the given number of centroids to merge into. It's kept across
+ * calls since merges happen often and their sizes don't vary much.
+ */
+static Centroid *
+get_scratch(uint32 size)
+{
+	static Centroid *scratch = NULL;
+	static uint32 scratch_size = 0;
+
+	if (size > scratch_size)
+	{
+		if (scratch)
+			pfree(scratch);
+		scratch = MemoryContextAlloc(TopMemoryContext, sizeof(Centroid) * size);
+		scratch_size = size;
+	}
+
+	MemSet(scratch, 0, sizeof(Centroid) * size);
+
+	return scratch;
+}
+
 TDigest *
 TDigestCompress(TDigest *t)
 {
-	int num_unmerged = list_length(t->unmerged_centroids);
-	Centroid *unmerged_centroids;
-	uint64_t unmerged_weight = 0;
-	ListCell *lc;
+	int num_unmerged = t->num_unmerged;
+	Centroid *unmerged_centroids = TDigestUnmerged(t);
 	int i, j;
-	mergeArgs *args;
-	uint32_t num_centroids = t->num_centroids;
+	mergeArgs args;
 
 	if (!num_unmerged)
 		return t;
 
-	unmerged_centroids = palloc(sizeof(Centroid) * num_unmerged);
+	t->num_unmerged = 0;
 
-	i = 0;
-	foreach(lc, t->unmerged_centroids)
+	if (t->unmerged_weight == 0)
 	{
-		Centroid *c = (Centroid *) lfirst(lc);
-		memcpy(&unmerged_centroids[i], c, sizeof(Centroid));
-		unmerged_weight += c->weight;
-		i++;
-	}
-
-	list_free_deep(t->unmerged_centroids);
-	t->unmerged_centroids = NIL;
-
-	if (unmerged_weight == 0)
+		SET_VARSIZE(t, TDigestSize(t));
 		return t;
+	}
 
-	t->total_weight += unmerged_weight;
+	t->total_weight += t->unmerged_weight;
+	t->unmerged_weight = 0;
 
 	qsort(unmerged_centroids, num_unmerged, sizeof(Centroid), centroid_cmp);
 
-	args = palloc0(sizeof(mergeArgs));
-	args->centroids = palloc0(sizeof(Centroid) * t->size);
-	args->t = t;
-	args->min = INFINITY;
+	MemSet(&args, 0, sizeof(mergeArgs));
+	args.centroids = get_scratch(t->size);
+	args.t = t;
+	args.min = INFINITY;
 
 	i = 0;
 	j = 0;
@@ -183,52 +249,40 @@ TDigestCompress(TDigest *t)
 
 		if (a->mean <= b->mean)
 		{
-			merge_centroid(args, a);
+			merge_centroid(&args, a);
 			i++;
 		}
 		else
 		{
-			merge_centroid(args, b);
+			merge_centroid(&args, b);
 			j++;
 		}
 	}
 
 	while (i < num_unmerged)
-		merge_centroid(args, &unmerged_centroids[i++]);
-
-	pfree(unmerged_centroids);
+		merge_centroid(&args, &unmerged_centroids[i++]);
 
 	while (j < t->num_centroids)
-		merge_centroid(args, &t->centroids[j++]);
+		merge_centroid(&args, &t->centroids[j++]);
 
 	if (t->total_weight > 0)
 	{
-		t->min = Min(t->min, args->min);
-
-		if (args->centroids[args->idx].weight <= 0)
-			args->idx--;
+		t->min = Min(t->min, args.min);
 
-		t->num_centroids = args->idx + 1;
-		t->max = Max(t->max, args->max);
-	}
+		if (args.centroids[args.idx].weight <= 0)
+			args.idx--;
 
-	if (t->num_centroids > num_centroids)
-	{
-		if (MemoryContextContains(CurrentMemoryContext, t))
-			t = repalloc(t, TDigestSize(t));
-		else
-		{
-			TDigest *new = (TDigest *) palloc(TDigestSize(t));
-			memcpy(new, t, sizeof(TDigest));
-			t = new;
-		}
+		t->num_centroids = args.idx + 1;
+		t->max = Max(t->max, args.max);
 	}
 
+	/*
+	 * Merging never produces more centroids than it was given, so the merged centroids always
+	 * fit in the space taken by the previous ones and the buffer
+	 */
 	Assert(t->num_centroids <= t->size);
 
-	memcpy(t->centroids, args->centroids, sizeof(Centroid) * t->num_centroids);
-	pfree(args->centroids);
-	pfree(args);
+	memcpy(t->centroids, args.centroids, sizeof(Centroid) * t->num_centroids);
 
 	SET_VARSIZE(t, TDigestSize(t));
 
@@ -238,17 +292,9 @@ TDigestCompress(TDigest *t)
 TDigest *
 TDigestMerge(TDigest *t1, TDigest *t2)
 {
-	int i;
-
 	t2 = TDigestCompress(t2);
 
-	for (i = 0; i < t2->num_centroids; i++)
-	{
-		Centroid *c = &t2->centroids[i];
-		t1 = TDigestAdd(t1, c->mean, c->weight);
-	}
-
-	return t1;
+	return TDigestAddMany(t1, t2->centroids, t2->num_centroids);
 }
 
 float8
@@ -371,6 +417,123 @@ TDigestQuantile(TDigest *t, float8 q)
 	return t->max;
 }
 
+static int
+quantile_cmp(const void *a, const void *b, void *arg)
+{
+	float8 *qs = (float8 *) arg;
+	float8 x = qs[*(int *) a];
+	float8 y = qs[*(int *) b];
+
+	if (x < y)
+		return -1;
+	if (x > y)
+		return 1;
+	return 0;
+}
+
+/*
+ * TDigestQuantiles
+ *
+ * Estimates n quantiles at once, in a single pass over the centroids. Each result is the same as
+ * what TDigestQuantile would estimate for its quantile.
+ */
+void
+TDigestQuantiles(TDigest *t, float8 *qs, int n, float8 *results)
+{
+	int i;
+	int j;
+	int *order;
+	float8 left, right, idx;
+	uint64 weight_so_far;
+	Centroid *a, tmp;
+
+	t = TDigestCompress(t);
+
+	for (i = 0; i < n; i++)
+	{
+		if (qs[i] < 0 || qs[i] > 1)
+			elog(ERROR, "q should be in [0, 1], got %f", qs[i]);
+
+		if (t->num_centroids == 0)
+			results[i] = NAN;
+		else if (t->num_centroids == 1)
+			results[i] = t->centroids[0].mean;
+	}
+
+	if (t->num_centroids <= 1)
+		return;
+
+	/* the quantiles are visited in ascending order, so the centroids only have to be walked once */
+	order = palloc(sizeof(int) * n);
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	qsort_arg(order, n, sizeof(int), quantile_cmp, qs);
+
+	/*
+	 * Segment j ends between centroids j - 1 and j, where centroid -1 is a weightless one at the
+	 * minimum, and the last segment ends at the maximum. Each segment starts where the previous
+	 * one ended.
+	 */
+	weight_so_far = 0;
+	a = &tmp;
+	a->mean = t->min;
+	a->weight = 0;
+	left = t->min;
+	right = (t->centroids[0].weight * a->mean + a->weight * t->centroids[0].mean) /
+			(a->weight + t->centroids[0].weight);
+	j = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		float8 q = qs[order[i]];
+		float8 *result = &results[order[i]];
+
+		if (float_eq(q, 0.0))
+		{
+			*result = t->min;
+			continue;
+		}
+
+		if (float_eq(q, 1.0))
+		{
+			*result = t->max;
+			continue;
+		}
+
+		idx = q * t->total_weight;
+
+		for (;;)
+		{
+			Centroid *b;
+
+			if (idx < weight_so_far + a->weight)
+			{
+				float8 p = (idx - weight_so_far) / a->weight;
+				*result = left * (1 - p) + right * p;
+				break;
+			}
+
+			if (j == t->num_centroids)
+			{
+				*result = t->max;
+				break;
+			}
+
+			weight_so_far += a->weight;
+			a = &t->centroids[j++];
+			b = &t->centroids[j];
+			left = right;
+
+			if (j < t->num_centroids)
+				right = (b->weight * a->mean + a->weight * b->mean) / (a->weight + b->weight);
+			else
+				right = t->max;
+		}
+	}
+
+	pfree(order);
+}
+
 TDigest *
 TDigestCopy(TDigest *t)
 {
@@ -383,5 +546,28 @@ TDigestCopy(TDigest *t)
 Size
 TDigestSize(TDigest *t)
 {
-	return sizeof(TDigest) + (sizeof(Centroid) * t->num_centroids);
+	uint32 num_centroids = t->num_centroids;
+
+	if (t->num_unmerged)
+		num_centroids += t->threshold + 1;
+
+	return sizeof(TDigest) + (sizeof(Centroid) * num_centroids);
+}
+
+/*
+ * TDigestIsValid
+ *
+ * Checks that the given digest, e.g. one received from outside of the server, is well formed, so that
+ * reading or merging it stays within it
+ */
+bool
+TDigestIsValid(TDigest *t)
+{
+	if (VARSIZE(t) < offsetof(TDigest, centroids) || t->compression <= 0 || t->threshold == 0)
+		return false;
+
+	if (t->threshold > estimate_compression_threshold(1000) || t->num_unmerged > t->threshold + 1)
+		return false;
+
+	return t->num_centroids < MaxAllocSize / sizeof(Centroid) && VARSIZE(t) == TDigestSize(t);
 }
@@ -0,0 +1,347 @@
+/*-------------------------------------------------------------------------
+ *
+ * theta.c
+ *	  Theta sketch implementation.
+ *
+ *	  https://github.com/apache/datasketches-java/blob/master/docs/img/ThetaSketchFramework.pdf
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/theta.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "pipeline/miscutils.h"
+#include "pipeline/theta.h"
+#include "utils/elog.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+
+#define MURMUR_SEED 0x4d3a2c1ed5f27e9bL
+
+/* gives a relative standard error of 1 / sqrt(4096), or about 1.6% */
+#define DEFAULT_LG_K 12
+#define MIN_LG_SIZE 5
+
+#define THETA_MAX PG_UINT64_MAX
+
+#define TABLE_SIZE(ts) ((uint32) 1 << (ts)->lg_size)
+
+/*
+ * The table starts out small and doubles whenever it's half full, up to twice the nominal
+ * number of entries. Once a table of that size is three quarters full, theta is lowered to
+ * the smallest hash that keeps only the lowest 2^lg_k hashes, and the ones above it are
+ * dropped. The lowest bits of the hashes are used for their slots, since those stay uniform
+ * however low theta gets.
+ */
+
+static uint32
+max_entries(int lg_k, int lg_size)
+{
+	uint32 size = (uint32) 1 << lg_size;
+
+	if (lg_size > lg_k)
+		return size / 4 * 3;
+	return size / 2;
+}
+
+static int
+uint64_cmp(const void *a, const void *b)
+{
+	uint64 l = *(uint64 *) a;
+	uint64 r = *(uint64 *) b;
+
+	if (l < r)
+		return -1;
+	return l > r ? 1 : 0;
+}
+
+static ThetaSketch *
+create(int lg_k, int lg_size, uint64 theta)
+{
+	ThetaSketch *ts = palloc0(offsetof(ThetaSketch, entries) + sizeof(uint64) * ((Size) 1 << lg_size));
+
+	ts->lg_k = lg_k;
+	ts->lg_size = lg_size;
+	ts->theta = theta;
+
+	SET_VARSIZE(ts, ThetaSketchSize(ts));
+
+	return ts;
+}
+
+ThetaSketch *
+ThetaSketchCreateWithLgK(int lg_k)
+{
+	Assert(lg_k >= THETA_MIN_LG_K && lg_k <= THETA_MAX_LG_K);
+
+	return create(lg_k, MIN_LG_SIZE, THETA_MAX);
+}
+
+ThetaSketch *
+ThetaSketchCreate(void)
+{
+	return ThetaSketchCreateWithLgK(DEFAULT_LG_K);
+}
+
+void
+ThetaSketchDestroy(ThetaSketch *ts)
+{
+	pfree(ts);
+}
+
+ThetaSketch *
+ThetaSketchCopy(ThetaSketch *ts)
+{
+	Size size = ThetaSketchSize(ts);
+	char *new = palloc(size);
+	memcpy(new, (char *) ts, size);
+	return (ThetaSketch *) new;
+}
+
+/*
+ * find
+ *
+ * Returns the slot the given hash is in, or the empty slot it would go in
+ */
+static uint32
+find(ThetaSketch *ts, uint64 hash)
+{
+	uint32 mask = TABLE_SIZE(ts) - 1;
+	uint32 i = hash & mask;
+
+	while (ts->entries[i] != 0 && ts->entries[i] != hash)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static bool
+contains(ThetaSketch *ts, uint64 hash)
+{
+	return ts->entries[find(ts, hash)] == hash;
+}
+
+/*
+ * insert
+ *
+ * Inserts the given hash into a table that's known to have room for it
+ */
+static void
+insert(ThetaSketch *ts, uint64 hash)
+{
+	uint32 i = find(ts, hash);
+
+	if (ts->entries[i] == 0)
+	{
+		ts->entries[i] = hash;
+		ts->num_entries++;
+	}
+}
+
+/*
+ * rebuild
+ *
+ * Returns a sketch with the same hashes below the given theta as the given one, in a table
+ * with the given number of slots. The given sketch is freed if it's in the current memory
+ * context, the same way repalloc would free it.
+ */
+static ThetaSketch *
+rebuild(ThetaSketch *ts, int lg_size, uint64 theta)
+{
+	ThetaSketch *result = create(ts->lg_k, lg_size, theta);
+	uint32 i;
+
+	for (i = 0; i < TABLE_SIZE(ts); i++)
+	{
+		if (ts->entries[i] != 0 && ts->entries[i] < theta)
+			insert(result, ts->entries[i]);
+	}
+
+	if (MemoryContextContains(CurrentMemoryContext, ts))
+		pfree(ts);
+
+	return result;
+}
+
+/*
+ * make_room
+ *
+ * Returns a sketch with room for at least one more hash, either by growing its table or by
+ * lowering its theta so that only the lowest 2^lg_k of its hashes are kept
+ */
+static ThetaSketch *
+make_room(ThetaSketch *ts)
+{
+	uint32 k = (uint32) 1 << ts->lg_k;
+	uint64 *hashes;
+	uint64 theta;
+	uint32 n = 0;
+	uint32 i;
+
+	if (ts->num_entries < max_entries(ts->lg_k, ts->lg_size))
+		return ts;
+
+	if (ts->lg_size <= ts->lg_k)
+		return rebuild(ts, ts->lg_size + 1, ts->theta);
+
+	hashes = palloc(sizeof(uint64) * ts->num_entries);
+	for (i = 0; i < TABLE_SIZE(ts); i++)
+	{
+		if (ts->entries[i] != 0)
+			hashes[n++] = ts->entries[i];
+	}
+
+	qsort(hashes, n, sizeof(uint64), uint64_cmp);
+	theta = hashes[k];
+	pfree(hashes);
+
+	return rebuild(ts, ts->lg_size, theta);
+}
+
+static ThetaSketch *
+add_hash(ThetaSketch *ts, uint64 hash)
+{
+	/* 0 marks empty slots, so that one hash is never sampled */
+	if (hash == 0 || hash >= ts->theta)
+		return ts;
+
+	if (contains(ts, hash))
+		return ts;
+
+	/* making room may lower theta below this hash */
+	ts = make_room(ts);
+	if (hash < ts->theta)
+		insert(ts, hash);
+
+	return ts;
+}
+
+ThetaSketch *
+ThetaSketchAdd(ThetaSketch *ts, void *elem, Size len)
+{
+	return add_hash(ts, MurmurHash3_64(elem, len, MURMUR_SEED));
+}
+
+/*
+ * ThetaSketchUnion
+ *
+ * Adds all of the hashes of the incoming sketch to the given one, after lowering its theta to
+ * the incoming sketch's
+ */
+ThetaSketch *
+ThetaSketchUnion(ThetaSketch *result, ThetaSketch *incoming)
+{
+	uint32 i;
+
+	if (incoming->theta < result->theta)
+		result = rebuild(result, result->lg_size, incoming->theta);
+
+	for (i = 0; i < TABLE_SIZE(incoming); i++)
+		result = add_hash(result, incoming->entries[i]);
+
+	return result;
+}
+
+/*
+ * sized_for
+ *
+ * Returns the smallest table size that holds the given number of hashes without reaching
+ * the point at which it would be grown
+ */
+static int
+sized_for(int lg_k, uint32 num_entries)
+{
+	int lg_size = MIN_LG_SIZE;
+
+	while (lg_size <= lg_k && num_entries >= max_entries(lg_k, lg_size))
+		lg_size++;
+
+	return lg_size;
+}
+
+/*
+ * set_difference
+ *
+ * Returns a new sketch with the hashes of a below the lower of both thetas that are (or aren't)
+ * in b
+ */
+static ThetaSketch *
+set_difference(ThetaSketch *a, ThetaSketch *b, bool in_b)
+{
+	uint64 theta = Min(a->theta, b->theta);
+	uint32 n = 0;
+	ThetaSketch *result;
+	uint32 i;
+
+	for (i = 0; i < TABLE_SIZE(a); i++)
+	{
+		uint64 hash = a->entries[i];
+
+		if (hash != 0 && hash < theta && contains(b, hash) == in_b)
+			n++;
+	}
+
+	result = create(a->lg_k, sized_for(a->lg_k, n), theta);
+
+	for (i = 0; i < TABLE_SIZE(a); i++)
+	{
+		uint64 hash = a->entries[i];
+
+		if (hash != 0 && hash < theta && contains(b, hash) == in_b)
+			insert(result, hash);
+	}
+
+	return result;
+}
+
+/*
+ * ThetaSketchIntersection
+ *
+ * Returns a new sketch of the elements that are in both of the given ones
+ */
+ThetaSketch *
+ThetaSketchIntersection(ThetaSketch *a, ThetaSketch *b)
+{
+	/* probing the smaller table for each hash of the larger one would look at more hashes */
+	if (b->num_entries < a->num_entries)
+		return set_difference(b, a, true);
+
+	return set_difference(a, b, true);
+}
+
+/*
+ * ThetaSketchANotB
+ *
+ * Returns a new sketch of the elements of a that aren't in b
+ */
+ThetaSketch *
+ThetaSketchANotB(ThetaSketch *a, ThetaSketch *b)
+{
+	return set_difference(a, b, false);
+}
+
+/*
+ * ThetaSketchEstimate
+ *
+ * Returns the estimated number of distinct elements, which is exact as long as theta hasn't
+ * been lowered
+ */
+float8
+ThetaSketchEstimate(ThetaSketch *ts)
+{
+	if (ts->theta == THETA_MAX)
+		return ts->num_entries;
+
+	return ts->num_entries / ldexp((float8) ts->theta, -64);
+}
+
+Size
+ThetaSketchSize(ThetaSketch *ts)
+{
+	return offsetof(ThetaSketch, entries) + sizeof(uint64) * TABLE_SIZE(ts);
+}
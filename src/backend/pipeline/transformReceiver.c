@@ -23,11 +23,15 @@
 #include "parser/parse_type.h"
 #include "pipeline/transformReceiver.h"
 #include "pipeline/cont_execute.h"
+#include "pipeline/cont_scheduler.h"
 #include "pipeline/miscutils.h"
+#include "pipeline/sink.h"
 #include "pipeline/stream.h"
 #include "miscadmin.h"
 #include "storage/shm_alloc.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
@@ -39,8 +43,12 @@ typedef struct TransformState
 	ContExecutor *cont_exec;
 	Relation tg_rel;
 	FunctionCallInfo trig_fcinfo;
+	/* only used for batch output functions, which are called once per batch with an array of its rows */
+	FmgrInfo *batch_finfo;
+	/* only used by pipeline_sink, the function its rows are delivered to by the sink process */
+	Oid sink_fn;
 
-	/* only used by the optimized code path for pipeline_stream_insert */
+	/* rows buffered for pipeline_stream_insert, pipeline_sink or a batch output function */
 	HeapTuple *tups;
 	int nmaxtups;
 	int ntups;
@@ -70,12 +78,10 @@ transform_receive(TupleTableSlot *slot, DestReceiver *self)
 	if (t->tg_rel == NULL)
 		t->tg_rel = heap_open(t->cont_query->matrelid, AccessShareLock);
 
-	if (t->cont_query->tgfn != PIPELINE_STREAM_INSERT_OID)
+	if (t->trig_fcinfo)
 	{
 		TriggerData *cxt = (TriggerData *) t->trig_fcinfo->context;
 
-		Assert(t->trig_fcinfo);
-
 		cxt->tg_relation = t->tg_rel;
 		cxt->tg_trigtuple = ExecCopySlotTuple(slot);
 
@@ -104,7 +110,7 @@ transform_receive(TupleTableSlot *slot, DestReceiver *self)
 		t->tups[t->ntups] = ExecCopySlotTuple(slot);
 		t->ntups++;
 
-		if (synchronous_stream_insert && t->acks == NULL)
+		if (synchronous_stream_insert && t->acks == NULL && t->cont_query->tgfn == PIPELINE_STREAM_INSERT_OID)
 			t->acks = InsertBatchAckCreate(t->cont_exec->yielded_msgs, &t->nacks);
 	}
 
@@ -149,7 +155,31 @@ SetTransformDestReceiverParams(DestReceiver *self, ContExecutor *exec, ContQuery
 
 	Assert(OidIsValid(query->tgfn));
 
-	if (query->tgfn != PIPELINE_STREAM_INSERT_OID)
+	if (query->tgfn == PIPELINE_STREAM_INSERT_OID)
+		return;
+
+	if (query->tgfn == PIPELINE_SINK_OID)
+	{
+		Assert(query->tgnargs == 1);
+		t->sink_fn = LookupSinkFunction(query->tgargs[0], false);
+		return;
+	}
+
+	if (get_func_nargs(query->tgfn) == 1)
+	{
+		Oid rowtype = get_rel_type_id(query->matrelid);
+		FuncExpr *expr;
+
+		/* polymorphic batch output functions resolve their argument to an array of the transform's rows */
+		expr = makeFuncExpr(query->tgfn, get_func_rettype(query->tgfn),
+				list_make1(makeNullConst(get_array_type(rowtype), -1, InvalidOid)),
+				InvalidOid, InvalidOid, COERCE_EXPLICIT_CALL);
+
+		t->batch_finfo = palloc0(sizeof(FmgrInfo));
+		fmgr_info(query->tgfn, t->batch_finfo);
+		fmgr_info_set_expr((Node *) expr, t->batch_finfo);
+	}
+	else
 	{
 		FunctionCallInfo fcinfo = palloc0(sizeof(FunctionCallInfoData));
 		FmgrInfo *finfo = palloc0(sizeof(FmgrInfo));
@@ -183,9 +213,10 @@ SetTransformDestReceiverParams(DestReceiver *self, ContExecutor *exec, ContQuery
 }
 
 static void
-pipeline_stream_insert_batch(TransformState *t)
+stream_insert_batch(TransformState *t)
 {
 	int i;
+	bool fused = false;
 
 	if (t->ntups == 0)
 		return;
@@ -196,7 +227,7 @@ pipeline_stream_insert_batch(TransformState *t)
 	{
 		RangeVar *rv = makeRangeVarFromNameList(stringToQualifiedNameList(t->cont_query->tgargs[i]));
 		Relation rel = heap_openrv(rv, AccessShareLock);
-		Size size;
+		Size size = 0;
 
 		if (t->acks)
 		{
@@ -209,7 +240,17 @@ pipeline_stream_insert_batch(TransformState *t)
 			}
 		}
 
-		size = SendTuplesToContWorkers(rel, RelationGetDescr(t->tg_rel), t->tups, t->ntups, t->acks, t->nacks);
+		/* readers that this worker has yet to execute in its current batch can be given the tuples directly */
+		if (continuous_query_fuse_transforms &&
+				FuseTuplesIntoContExecutor(t->cont_exec, rel, RelationGetDescr(t->tg_rel), t->tups, t->ntups,
+					t->acks, t->nacks))
+		{
+			fused = true;
+			pgstat_increment_cq_write(t->ntups, 0);
+			pgstat_report_streamstat(false);
+		}
+		else
+			size = SendTuplesToContWorkers(rel, RelationGetDescr(t->tg_rel), t->tups, t->ntups, t->acks, t->nacks);
 
 		heap_close(rel, NoLock);
 
@@ -229,8 +270,12 @@ pipeline_stream_insert_batch(TransformState *t)
 
 	if (t->ntups)
 	{
-		for (i = 0; i < t->ntups; i++)
-			heap_freetuple(t->tups[i]);
+		/* fused tuples are read by the rest of the batch, and freed along with its context */
+		if (!fused)
+		{
+			for (i = 0; i < t->ntups; i++)
+				heap_freetuple(t->tups[i]);
+		}
 
 		pfree(t->tups);
 		t->tups = NULL;
@@ -244,6 +289,80 @@ pipeline_stream_insert_batch(TransformState *t)
 	}
 }
 
+/*
+ * output_batch
+ *
+ * Call a batch output function with an array of all of the rows the transform produced in this batch
+ */
+static void
+output_batch(TransformState *t)
+{
+	FunctionCallInfoData fcinfo;
+	TupleDesc desc;
+	Datum *rows;
+	ArrayType *arr;
+	int i;
+
+	if (t->ntups == 0)
+		return;
+
+	Assert(t->tg_rel);
+
+	desc = RelationGetDescr(t->tg_rel);
+	rows = palloc(sizeof(Datum) * t->ntups);
+
+	for (i = 0; i < t->ntups; i++)
+		rows[i] = heap_copy_tuple_as_datum(t->tups[i], desc);
+
+	arr = construct_array(rows, t->ntups, desc->tdtypeid, -1, false, 'd');
+
+	InitFunctionCallInfoData(fcinfo, t->batch_finfo, 1, InvalidOid, NULL, NULL);
+	fcinfo.arg[0] = PointerGetDatum(arr);
+	fcinfo.argnull[0] = false;
+
+	FunctionCallInvoke(&fcinfo);
+
+	pfree(arr);
+	for (i = 0; i < t->ntups; i++)
+	{
+		pfree(DatumGetPointer(rows[i]));
+		heap_freetuple(t->tups[i]);
+	}
+	pfree(rows);
+
+	pfree(t->tups);
+	t->tups = NULL;
+	t->ntups = 0;
+	t->nmaxtups = 0;
+}
+
+/*
+ * sink_batch
+ *
+ * Queue the rows the transform produced in this batch for the sink process
+ */
+static void
+sink_batch(TransformState *t)
+{
+	int i;
+
+	if (t->ntups == 0)
+		return;
+
+	Assert(t->tg_rel);
+
+	SinkTuples(t->sink_fn, RelationGetDescr(t->tg_rel), t->tups, t->ntups);
+	pgstat_increment_cq_write(t->ntups, 0);
+
+	for (i = 0; i < t->ntups; i++)
+		heap_freetuple(t->tups[i]);
+
+	pfree(t->tups);
+	t->tups = NULL;
+	t->ntups = 0;
+	t->nmaxtups = 0;
+}
+
 void
 TransformDestReceiverFlush(DestReceiver *self)
 {
@@ -251,7 +370,11 @@ TransformDestReceiverFlush(DestReceiver *self)
 
 	/* Optimized path for stream insertions */
 	if (t->cont_query->tgfn == PIPELINE_STREAM_INSERT_OID)
-		pipeline_stream_insert_batch(t);
+		stream_insert_batch(t);
+	else if (OidIsValid(t->sink_fn))
+		sink_batch(t);
+	else if (t->batch_finfo)
+		output_batch(t);
 	else
 	{
 		TriggerData *cxt = (TriggerData *) t->trig_fcinfo->context;
@@ -0,0 +1,233 @@
+/*-------------------------------------------------------------------------
+ *
+ * tuplebatch.c
+ *	  Arena-backed batches of heap tuples
+ *
+ *	  Tuples are copied into large blocks that are filled front to back and
+ *	  never freed individually. Clearing a batch keeps a single block around
+ *	  for the next batch and releases the rest, so a batch's tuples cost one
+ *	  copy each and are all freed together regardless of how many there are.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/backend/pipeline/tuplebatch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "executor/tuptable.h"
+#include "pipeline/tuplebatch.h"
+#include "storage/bufmgr.h"
+
+#define TUPLEBATCH_BLOCK_SIZE (64 * 1024)
+#define TUPLEBATCH_INIT_TUPLES 1024
+#define BLOCK_HEADER_SIZE (MAXALIGN(offsetof(TupleBatchBlock, data)))
+
+/*
+ * alloc_block
+ */
+static TupleBatchBlock *
+alloc_block(TupleBatch *batch, Size size)
+{
+	TupleBatchBlock *block = MemoryContextAlloc(batch->cxt, BLOCK_HEADER_SIZE + size);
+
+	block->size = size;
+	block->used = 0;
+
+	return block;
+}
+
+/*
+ * batch_alloc
+ *
+ * Carves len bytes out of the block being filled, starting a new one if they don't fit
+ */
+static char *
+batch_alloc(TupleBatch *batch, Size len)
+{
+	TupleBatchBlock *block = batch->blocks;
+	char *result;
+
+	len = MAXALIGN(len);
+
+	if (block == NULL || block->size - block->used < len)
+	{
+		/*
+		 * Oversized tuples get a block of their own behind the current one, so that
+		 * we keep filling the current block afterwards
+		 */
+		if (len > TUPLEBATCH_BLOCK_SIZE / 4 && block != NULL)
+		{
+			TupleBatchBlock *big = alloc_block(batch, len);
+
+			big->used = len;
+			big->next = block->next;
+			block->next = big;
+
+			return (char *) big + BLOCK_HEADER_SIZE;
+		}
+
+		block = alloc_block(batch, Max(len, TUPLEBATCH_BLOCK_SIZE));
+		block->next = batch->blocks;
+		batch->blocks = block;
+	}
+
+	result = (char *) block + BLOCK_HEADER_SIZE + block->used;
+	block->used += len;
+
+	return result;
+}
+
+/*
+ * TupleBatchCreate
+ */
+TupleBatch *
+TupleBatchCreate(MemoryContext parent)
+{
+	MemoryContext cxt = AllocSetContextCreate(parent, "TupleBatchCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+	TupleBatch *batch = MemoryContextAllocZero(cxt, sizeof(TupleBatch));
+
+	batch->cxt = cxt;
+	batch->maxtuples = TUPLEBATCH_INIT_TUPLES;
+	batch->tuples = MemoryContextAlloc(cxt, sizeof(HeapTuple) * batch->maxtuples);
+
+	return batch;
+}
+
+/*
+ * TupleBatchEnd
+ */
+void
+TupleBatchEnd(TupleBatch *batch)
+{
+	MemoryContextDelete(batch->cxt);
+}
+
+/*
+ * TupleBatchAppend
+ *
+ * Adds a tuple to the batch without copying it, so it must either already live in the
+ * batch's arena or outlive the batch's contents
+ */
+void
+TupleBatchAppend(TupleBatch *batch, HeapTuple tup)
+{
+	if (batch->ntuples == batch->maxtuples)
+	{
+		batch->maxtuples *= 2;
+		batch->tuples = repalloc(batch->tuples, sizeof(HeapTuple) * batch->maxtuples);
+	}
+
+	batch->tuples[batch->ntuples++] = tup;
+}
+
+/*
+ * TupleBatchPut
+ *
+ * Copies the given tuple into the batch's arena, returning the copy
+ */
+HeapTuple
+TupleBatchPut(TupleBatch *batch, HeapTuple tup)
+{
+	HeapTuple copy = (HeapTuple) batch_alloc(batch, HEAPTUPLESIZE + tup->t_len);
+
+	copy->t_len = tup->t_len;
+	copy->t_self = tup->t_self;
+	copy->t_tableOid = tup->t_tableOid;
+	copy->t_data = (HeapTupleHeader) ((char *) copy + HEAPTUPLESIZE);
+	memcpy((char *) copy->t_data, (char *) tup->t_data, tup->t_len);
+
+	TupleBatchAppend(batch, copy);
+
+	return copy;
+}
+
+/*
+ * TupleBatchPutSlot
+ */
+HeapTuple
+TupleBatchPutSlot(TupleBatch *batch, TupleTableSlot *slot)
+{
+	return TupleBatchPut(batch, ExecFetchSlotTuple(slot));
+}
+
+/*
+ * TupleBatchGetTupleSlot
+ *
+ * Stores the batch's next tuple in the given slot, returning false once the batch is exhausted.
+ * The slot points directly into the batch, so its tuple is only valid until the batch is cleared.
+ */
+bool
+TupleBatchGetTupleSlot(TupleBatch *batch, TupleTableSlot *slot)
+{
+	if (batch->readpos >= batch->ntuples)
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
+
+	ExecStoreTuple(batch->tuples[batch->readpos++], slot, InvalidBuffer, false);
+
+	return true;
+}
+
+/*
+ * TupleBatchRescan
+ */
+void
+TupleBatchRescan(TupleBatch *batch)
+{
+	batch->readpos = 0;
+}
+
+/*
+ * TupleBatchClearTuples
+ *
+ * Empties the batch while keeping its arena, so tuples that were in it remain valid and
+ * can be appended back
+ */
+void
+TupleBatchClearTuples(TupleBatch *batch)
+{
+	batch->ntuples = 0;
+	batch->readpos = 0;
+}
+
+/*
+ * TupleBatchClear
+ *
+ * Empties the batch and releases its tuples, keeping one block for the next batch to fill
+ */
+void
+TupleBatchClear(TupleBatch *batch)
+{
+	TupleBatchBlock *block = batch->blocks;
+	TupleBatchBlock *keep = NULL;
+
+	while (block)
+	{
+		TupleBatchBlock *next = block->next;
+
+		if (keep == NULL && block->size == TUPLEBATCH_BLOCK_SIZE)
+			keep = block;
+		else
+			pfree(block);
+
+		block = next;
+	}
+
+	if (keep)
+	{
+		keep->next = NULL;
+		keep->used = 0;
+	}
+
+	batch->blocks = keep;
+
+	TupleBatchClearTuples(batch);
+}
@@ -60,6 +60,7 @@
 #include "storage/latch.h"
 #include "storage/pg_shmem.h"
 #include "storage/procsignal.h"
+#include "storage/shmem.h"
 #include "storage/sinvaladt.h"
 #include "utils/ascii.h"
 #include "utils/builtins.h"
@@ -138,6 +139,24 @@ static PgStat_StatCQEntryLocal MyProcStatCQEntryLocal;
 volatile PgStat_StatCQEntry *MyProcStatCQEntry = (PgStat_StatCQEntry *) &MyProcStatCQEntryLocal;
 volatile PgStat_StatCQEntry *MyStatCQEntry = NULL;
 
+/*
+ * Shared counters of CQ processes and continuous views, keyed by database and
+ * the same key as their collector entries
+ */
+typedef struct CQSharedStatsKey
+{
+	Oid dbid;
+	uint64 key;
+} CQSharedStatsKey;
+
+typedef struct CQSharedStatsEntry
+{
+	CQSharedStatsKey key;
+	PgStat_CQSharedCounters counters;
+} CQSharedStatsEntry;
+
+static HTAB *CQSharedStats = NULL;
+
 /* ----------
  * Local data
  * ----------
@@ -5594,6 +5613,248 @@ pgstat_db_requested(Oid databaseid)
 	return false;
 }
 
+/*
+ * CQStatsShmemSize
+ */
+Size
+CQStatsShmemSize(void)
+{
+	return hash_estimate_size(PGSTAT_CQ_SHARED_ENTRIES, sizeof(CQSharedStatsEntry));
+}
+
+/*
+ * CQStatsShmemInit
+ */
+void
+CQStatsShmemInit(void)
+{
+	HASHCTL ctl;
+
+	MemSet(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(CQSharedStatsKey);
+	ctl.entrysize = sizeof(CQSharedStatsEntry);
+
+	CQSharedStats = ShmemInitHash("CQSharedStats", PGSTAT_CQ_SHARED_ENTRIES, PGSTAT_CQ_SHARED_ENTRIES,
+			&ctl, HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * make_cq_shared_key
+ */
+static void
+make_cq_shared_key(CQSharedStatsKey *skey, uint64 key)
+{
+	/* the key is hashed as a blob, so its padding must be zeroed */
+	MemSet(skey, 0, sizeof(CQSharedStatsKey));
+	skey->dbid = MyDatabaseId;
+	skey->key = key;
+}
+
+/*
+ * attach_cq_shared_counters
+ *
+ * Returns the shared counters for the given key, creating them if they don't exist yet. A view's
+ * counters start out from the totals the collector has kept for it across restarts, since nothing
+ * can have been counted for the view since the server started before its counters exist.
+ */
+static PgStat_CQSharedCounters *
+attach_cq_shared_counters(uint64 key)
+{
+	CQSharedStatsKey skey;
+	CQSharedStatsEntry *entry;
+	PgStat_StatCQEntry *persisted = NULL;
+	bool found;
+
+	make_cq_shared_key(&skey, key);
+
+	LWLockAcquire(CQStatsLock, LW_SHARED);
+	entry = (CQSharedStatsEntry *) hash_search(CQSharedStats, &skey, HASH_FIND, NULL);
+	LWLockRelease(CQStatsLock);
+
+	if (entry)
+		return &entry->counters;
+
+	if (GetStatCQEntryViewId(key) && pgStatSock != PGINVALID_SOCKET && pgstat_track_continuous_queries)
+	{
+		HTAB *cont_queries = pgstat_fetch_cqstat_all();
+
+		if (cont_queries)
+			persisted = (PgStat_StatCQEntry *) hash_search(cont_queries, &key, HASH_FIND, NULL);
+	}
+
+	LWLockAcquire(CQStatsLock, LW_EXCLUSIVE);
+
+	entry = (CQSharedStatsEntry *) hash_search(CQSharedStats, &skey, HASH_ENTER_NULL, &found);
+	if (entry && !found)
+	{
+		PgStat_CQSharedCounters *counters = &entry->counters;
+
+		pg_atomic_init_u64(&counters->input_rows, persisted ? persisted->input_rows : 0);
+		pg_atomic_init_u64(&counters->output_rows, persisted ? persisted->output_rows : 0);
+		pg_atomic_init_u64(&counters->updated_rows, persisted ? persisted->updated_rows : 0);
+		pg_atomic_init_u64(&counters->input_bytes, persisted ? persisted->input_bytes : 0);
+		pg_atomic_init_u64(&counters->output_bytes, persisted ? persisted->output_bytes : 0);
+		pg_atomic_init_u64(&counters->updated_bytes, persisted ? persisted->updated_bytes : 0);
+		pg_atomic_init_u64(&counters->executions, persisted ? persisted->executions : 0);
+		pg_atomic_init_u64(&counters->errors, persisted ? persisted->errors : 0);
+		pg_atomic_init_u64(&counters->committed_arrival, 0);
+	}
+
+	LWLockRelease(CQStatsLock);
+
+	return entry ? &entry->counters : NULL;
+}
+
+/*
+ * detach_cq_shared_counters
+ *
+ * Removes the shared counters for the given key. This is only done once their process has exited
+ * or their view has been dropped, so nothing should be incrementing them anymore.
+ */
+static void
+detach_cq_shared_counters(uint64 key)
+{
+	CQSharedStatsKey skey;
+
+	make_cq_shared_key(&skey, key);
+
+	LWLockAcquire(CQStatsLock, LW_EXCLUSIVE);
+	hash_search(CQSharedStats, &skey, HASH_REMOVE, NULL);
+	LWLockRelease(CQStatsLock);
+}
+
+/*
+ * pgstat_read_cq_shared_counters
+ *
+ * Replaces the given collector entry's counters with their current shared values, if there are
+ * any. Returns true if there were.
+ */
+bool
+pgstat_read_cq_shared_counters(PgStat_StatCQEntry *entry)
+{
+	CQSharedStatsKey skey;
+	CQSharedStatsEntry *shared;
+
+	make_cq_shared_key(&skey, entry->key);
+
+	LWLockAcquire(CQStatsLock, LW_SHARED);
+
+	shared = (CQSharedStatsEntry *) hash_search(CQSharedStats, &skey, HASH_FIND, NULL);
+	if (shared)
+	{
+		PgStat_CQSharedCounters *counters = &shared->counters;
+
+		entry->input_rows = pg_atomic_read_u64(&counters->input_rows);
+		entry->output_rows = pg_atomic_read_u64(&counters->output_rows);
+		entry->updated_rows = pg_atomic_read_u64(&counters->updated_rows);
+		entry->input_bytes = pg_atomic_read_u64(&counters->input_bytes);
+		entry->output_bytes = pg_atomic_read_u64(&counters->output_bytes);
+		entry->updated_bytes = pg_atomic_read_u64(&counters->updated_bytes);
+		entry->executions = pg_atomic_read_u64(&counters->executions);
+		entry->errors = pg_atomic_read_u64(&counters->errors);
+	}
+
+	LWLockRelease(CQStatsLock);
+
+	return shared != NULL;
+}
+
+/*
+ * pgstat_fetch_cq_shared_entries
+ *
+ * Returns a copy of the shared counters of all CQ processes and continuous views of all databases
+ */
+PgStat_CQSharedEntry *
+pgstat_fetch_cq_shared_entries(int *nentries)
+{
+	HASH_SEQ_STATUS status;
+	CQSharedStatsEntry *shared;
+	PgStat_CQSharedEntry *result;
+	int n = 0;
+
+	LWLockAcquire(CQStatsLock, LW_SHARED);
+
+	result = palloc(sizeof(PgStat_CQSharedEntry) * Max(hash_get_num_entries(CQSharedStats), 1));
+
+	hash_seq_init(&status, CQSharedStats);
+	while ((shared = (CQSharedStatsEntry *) hash_seq_search(&status)) != NULL)
+	{
+		PgStat_CQSharedCounters *counters = &shared->counters;
+		PgStat_CQSharedEntry *entry = &result[n++];
+
+		entry->dbid = shared->key.dbid;
+		entry->key = shared->key.key;
+		entry->input_rows = pg_atomic_read_u64(&counters->input_rows);
+		entry->output_rows = pg_atomic_read_u64(&counters->output_rows);
+		entry->updated_rows = pg_atomic_read_u64(&counters->updated_rows);
+		entry->input_bytes = pg_atomic_read_u64(&counters->input_bytes);
+		entry->output_bytes = pg_atomic_read_u64(&counters->output_bytes);
+		entry->updated_bytes = pg_atomic_read_u64(&counters->updated_bytes);
+		entry->executions = pg_atomic_read_u64(&counters->executions);
+		entry->errors = pg_atomic_read_u64(&counters->errors);
+	}
+
+	LWLockRelease(CQStatsLock);
+
+	*nentries = n;
+
+	return result;
+}
+
+/*
+ * pgstat_report_cq_committed_arrival
+ *
+ * Records that events that arrived up to the given time have been committed to a view's matrel.
+ * Combiners of the same view commit independently, so the newest arrival time of any of them is kept.
+ */
+void
+pgstat_report_cq_committed_arrival(PgStat_StatCQEntry *entry, TimestampTz arrival)
+{
+	PgStat_CQSharedCounters *shared = ((PgStat_StatCQEntryLocal *) entry)->shared;
+	uint64 current;
+
+	if (shared == NULL)
+		return;
+
+	current = pg_atomic_read_u64(&shared->committed_arrival);
+	while ((TimestampTz) current < arrival)
+	{
+		if (pg_atomic_compare_exchange_u64(&shared->committed_arrival, &current, (uint64) arrival))
+			break;
+	}
+}
+
+/*
+ * pgstat_fetch_cq_committed_arrival
+ *
+ * Returns the arrival time of the newest event committed to the given view's matrel since the
+ * server started, or 0 if there isn't one
+ */
+TimestampTz
+pgstat_fetch_cq_committed_arrival(Oid viewid)
+{
+	CQSharedStatsKey skey;
+	CQSharedStatsEntry *shared;
+	TimestampTz result = 0;
+	uint64 key = 0;
+
+	SetStatCQEntryViewId(key, viewid);
+	SetStatCQEntryProcPid(key, 0);
+	SetStatCQEntryProcType(key, Combiner);
+
+	make_cq_shared_key(&skey, key);
+
+	LWLockAcquire(CQStatsLock, LW_SHARED);
+
+	shared = (CQSharedStatsEntry *) hash_search(CQSharedStats, &skey, HASH_FIND, NULL);
+	if (shared)
+		result = (TimestampTz) pg_atomic_read_u64(&shared->counters.committed_arrival);
+
+	LWLockRelease(CQStatsLock);
+
+	return result;
+}
+
 /*
  * cq_stat_init
  */
@@ -5608,6 +5869,8 @@ pgstat_init_cqstat(PgStat_StatCQEntry *entry, Oid viewid, pid_t pid)
 	SetStatCQEntryViewId(entry->key, viewid);
 	SetStatCQEntryProcPid(entry->key, pid);
 	SetStatCQEntryProcType(entry->key, IsContQueryWorkerProcess() ? Worker : Combiner);
+
+	((PgStat_StatCQEntryLocal *) entry)->shared = attach_cq_shared_counters(entry->key);
 }
 
 /*
@@ -5701,6 +5964,88 @@ calculate_averages(volatile PgStat_StatCQEntry *entry)
 	entry->tuples_pb = tuples_pb;
 }
 
+/* upper bounds of all but the last latency histogram bucket, in microseconds */
+static const int64 cq_latency_bounds[PGSTAT_CQ_LATENCY_BUCKETS - 1] =
+	{100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000};
+
+/*
+ * pgstat_cq_latency_bound
+ *
+ * Returns the upper bound of the given latency histogram bucket in microseconds, or -1 for the last one
+ */
+int64
+pgstat_cq_latency_bound(int bucket)
+{
+	Assert(bucket >= 0 && bucket < PGSTAT_CQ_LATENCY_BUCKETS);
+
+	if (bucket == PGSTAT_CQ_LATENCY_BUCKETS - 1)
+		return -1;
+
+	return cq_latency_bounds[bucket];
+}
+
+/*
+ * pgstat_report_cq_latency
+ *
+ * Counts the time since start in the given stage's latency histogram, for the current process
+ * and, unless it's a queue stage, the current query
+ */
+void
+pgstat_report_cq_latency(PgStat_CQLatencyStage stage, TimestampTz start)
+{
+	long secs;
+	int usecs;
+	int64 elapsed;
+	int i;
+
+	if (!start)
+		return;
+
+	TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+	elapsed = (int64) secs * USECS_PER_SEC + usecs;
+
+	for (i = 0; i < PGSTAT_CQ_LATENCY_BUCKETS - 1; i++)
+	{
+		if (elapsed <= cq_latency_bounds[i])
+			break;
+	}
+
+	MyProcStatCQEntry->latency[stage][i]++;
+	if (MyStatCQEntry && stage != CQ_LATENCY_WORKER_QUEUE && stage != CQ_LATENCY_COMBINER_QUEUE)
+		MyStatCQEntry->latency[stage][i]++;
+
+	/* lookups keep their own total, see pgstat_increment_cq_lookup */
+	if (stage == CQ_LATENCY_COMBINE)
+	{
+		MyProcStatCQEntry->combine_time += elapsed;
+		if (MyStatCQEntry)
+			MyStatCQEntry->combine_time += elapsed;
+	}
+	else if (stage == CQ_LATENCY_SYNC)
+	{
+		MyProcStatCQEntry->sync_time += elapsed;
+		if (MyStatCQEntry)
+			MyStatCQEntry->sync_time += elapsed;
+	}
+}
+
+/*
+ * cq_stat_has_latencies
+ */
+static bool
+cq_stat_has_latencies(volatile PgStat_StatCQEntry *entry)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < CQ_NUM_LATENCY_STAGES; i++)
+		for (j = 0; j < PGSTAT_CQ_LATENCY_BUCKETS; j++)
+			if (entry->latency[i][j])
+				return true;
+
+	return false;
+}
+
 static void
 cq_stat_report_entry(volatile PgStat_StatCQEntry *entry)
 {
@@ -5711,9 +6056,13 @@ cq_stat_report_entry(volatile PgStat_StatCQEntry *entry)
 	 * there's no need to send a msg to the stats collector.
 	 */
 	if (entry->input_rows == 0 && entry->errors == 0 &&
-			entry->cv_create == 0 && entry->cv_drop == 0)
+			entry->cv_create == 0 && entry->cv_drop == 0 &&
+			entry->sw_cache_hits == 0 && entry->sw_cache_misses == 0 &&
+			!cq_stat_has_latencies(entry))
 		return;
 
+	StaticAssertStmt(sizeof(PgStat_MsgCQstat) <= PGSTAT_MAX_MSG_SIZE, "CQ stats message is too large");
+
 	calculate_averages(entry);
 
 	MemSet(&msg, 0, sizeof(PgStat_MsgCQstat));
@@ -5732,6 +6081,19 @@ cq_stat_report_entry(volatile PgStat_StatCQEntry *entry)
 	entry->updated_bytes = 0;
 	entry->executions = 0;
 	entry->errors = 0;
+	entry->sw_cache_hits = 0;
+	entry->sw_cache_misses = 0;
+	entry->group_cache_hits = 0;
+	entry->group_cache_misses = 0;
+	entry->lookups = 0;
+	entry->lookup_groups = 0;
+	entry->lookup_time = 0;
+	entry->lookup_blocks = 0;
+	entry->hot_updates = 0;
+	entry->combine_time = 0;
+	entry->sync_time = 0;
+	entry->stale_drops = 0;
+	MemSet((PgStat_Counter *) entry->latency, 0, sizeof(entry->latency));
 }
 
 /*
@@ -5811,6 +6173,9 @@ pgstat_fetch_stat_cqentry(HTAB *cont_queries, Oid viewoid, pid_t pid, ContQueryP
 static void
 cq_stat_aggregate(PgStat_StatCQEntry *result, PgStat_StatCQEntry *incoming)
 {
+	int i;
+	int j;
+
 	result->input_rows += incoming->input_rows;
 	result->output_rows += incoming->output_rows;
 	result->input_bytes += incoming->input_bytes;
@@ -5821,8 +6186,25 @@ cq_stat_aggregate(PgStat_StatCQEntry *result, PgStat_StatCQEntry *incoming)
 	result->errors += incoming->errors;
 	result->cv_create += incoming->cv_create;
 	result->cv_drop += incoming->cv_drop;
+	result->sw_cache_hits += incoming->sw_cache_hits;
+	result->sw_cache_misses += incoming->sw_cache_misses;
+	result->group_cache_hits += incoming->group_cache_hits;
+	result->group_cache_misses += incoming->group_cache_misses;
+	result->lookups += incoming->lookups;
+	result->lookup_groups += incoming->lookup_groups;
+	result->lookup_time += incoming->lookup_time;
+	result->lookup_blocks += incoming->lookup_blocks;
+	result->hot_updates += incoming->hot_updates;
+	result->combine_time += incoming->combine_time;
+	result->sync_time += incoming->sync_time;
+	result->stale_drops += incoming->stale_drops;
+
+	for (i = 0; i < CQ_NUM_LATENCY_STAGES; i++)
+		for (j = 0; j < PGSTAT_CQ_LATENCY_BUCKETS; j++)
+			result->latency[i][j] += incoming->latency[i][j];
 
 	result->memory = incoming->memory;
+	result->sw_cache_bytes = incoming->sw_cache_bytes;
 	result->tuples_ps = incoming->tuples_ps;
 	result->bytes_ps = incoming->bytes_ps;
 	result->time_pb = incoming->time_pb;
@@ -5911,6 +6293,8 @@ pgstat_send_cqpurge(Oid viewid, pid_t pid, ContQueryProcType ptype)
 
 	msg.m_databaseid = MyDatabaseId;
 
+	detach_cq_shared_counters(msg.m_key);
+
 	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_CQPURGE);
 	pgstat_send(&msg, sizeof(msg));
 }
@@ -6079,15 +6463,15 @@ pgstat_report_streamstat(bool force)
 void
 pgstat_increment_cq_read(uint64 nrows, Size nbytes)
 {
-	MyProcStatCQEntry->input_rows += nrows;
-	MyProcStatCQEntry->input_bytes += nbytes;
+	pgstat_add_cq_counter(MyProcStatCQEntry, input_rows, nrows);
+	pgstat_add_cq_counter(MyProcStatCQEntry, input_bytes, nbytes);
 
 	if (MyStatCQEntry)
 	{
 		PgStat_StatCQEntryLocal *lentry;
 
-		MyStatCQEntry->input_rows += nrows;
-		MyStatCQEntry->input_bytes += nbytes;
+		pgstat_add_cq_counter(MyStatCQEntry, input_rows, nrows);
+		pgstat_add_cq_counter(MyStatCQEntry, input_bytes, nbytes);
 
 		lentry = (PgStat_StatCQEntryLocal *) MyStatCQEntry;
 		lentry->avgstat.tuples[lentry->avgstat.i] += nrows;
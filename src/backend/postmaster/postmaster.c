@@ -252,8 +252,9 @@ static pid_t StartupPID = 0,
 			PgArchPID = 0,
 			PgStatPID = 0,
 			SysLoggerPID = 0,
-			ContQuerySchedulerPID = 0,
-			IPCMessageBrokerPID = 0;
+			ContQuerySchedulerPID = 0;
+
+static pid_t IPCMessageBrokerPIDs[MAX_IPC_BROKERS];
 
 /* Startup process's status */
 typedef enum
@@ -409,6 +410,8 @@ static CAC_state canAcceptConnections(void);
 static long PostmasterRandom(void);
 static void RandomSalt(char *md5Salt);
 static void signal_child(pid_t pid, int signal);
+static void signal_ipc_brokers(int signal);
+static bool is_ipc_broker_pid(pid_t pid, bool reset);
 static bool SignalSomeChildren(int signal, int targets);
 static void TerminateChildren(int signal);
 
@@ -1758,8 +1761,14 @@ ServerLoop(void)
 		if (ContQuerySchedulerPID == 0 && pmState == PM_RUN)
 			ContQuerySchedulerPID = StartContQueryScheduler();
 
-		if (IPCMessageBrokerPID == 0 && pmState == PM_RUN)
-			IPCMessageBrokerPID = StartIPCMessageBroker();
+		if (pmState == PM_RUN)
+		{
+			int i;
+
+			for (i = 0; i < continuous_query_num_ipc_brokers; i++)
+				if (IPCMessageBrokerPIDs[i] == 0)
+					IPCMessageBrokerPIDs[i] = StartIPCMessageBroker(i);
+		}
 
 		/* If we have lost the stats collector, try to start a new one */
 		if (PgStatPID == 0 && pmState == PM_RUN)
@@ -2583,8 +2592,7 @@ pmdie(SIGNAL_ARGS)
 					signal_child(WalWriterPID, SIGTERM);
 				if (ContQuerySchedulerPID != 0)
 					signal_child(ContQuerySchedulerPID, SIGTERM);
-				if (IPCMessageBrokerPID != 0)
-					signal_child(IPCMessageBrokerPID, SIGTERM);
+				signal_ipc_brokers(SIGTERM);
 
 				/*
 				 * If we're in recovery, we can't kill the startup process
@@ -2658,8 +2666,7 @@ pmdie(SIGNAL_ARGS)
 					signal_child(WalWriterPID, SIGTERM);
 				if (ContQuerySchedulerPID != 0)
 					signal_child(ContQuerySchedulerPID, SIGTERM);
-				if (IPCMessageBrokerPID != 0)
-					signal_child(IPCMessageBrokerPID, SIGTERM);
+				signal_ipc_brokers(SIGTERM);
 				pmState = PM_WAIT_BACKENDS;
 			}
 
@@ -2951,9 +2958,8 @@ reaper(SIGNAL_ARGS)
 			continue;
 		}
 
-		if (pid == IPCMessageBrokerPID)
+		if (is_ipc_broker_pid(pid, true))
 		{
-			IPCMessageBrokerPID = 0;
 			if (!EXIT_STATUS_0(exitstatus))
 				HandleChildCrash(pid, exitstatus,
 								 _("ipc message broker process"));
@@ -3448,13 +3454,20 @@ HandleChildCrash(int pid, int exitstatus, const char *procname)
 		signal_child(ContQuerySchedulerPID, (SendStop ? SIGSTOP : SIGQUIT));
 	}
 
-	if (pid == IPCMessageBrokerPID)
-		IPCMessageBrokerPID = 0;
-	else if (IPCMessageBrokerPID != 0 && take_action)
 	{
-		ereport(DEBUG2,
-				(errmsg_internal("sending %s to process %d", (SendStop ? "SIGSTOP" : "SIGQUIT"), (int) IPCMessageBrokerPID)));
-		signal_child(IPCMessageBrokerPID, (SendStop ? SIGSTOP : SIGQUIT));
+		int i;
+
+		for (i = 0; i < MAX_IPC_BROKERS; i++)
+		{
+			if (pid == IPCMessageBrokerPIDs[i])
+				IPCMessageBrokerPIDs[i] = 0;
+			else if (IPCMessageBrokerPIDs[i] != 0 && take_action)
+			{
+				ereport(DEBUG2,
+						(errmsg_internal("sending %s to process %d", (SendStop ? "SIGSTOP" : "SIGQUIT"), (int) IPCMessageBrokerPIDs[i])));
+				signal_child(IPCMessageBrokerPIDs[i], (SendStop ? SIGSTOP : SIGQUIT));
+			}
+		}
 	}
 
 	/*
@@ -3858,6 +3871,41 @@ signal_child(pid_t pid, int signal)
 #endif
 }
 
+/*
+ * Send a signal to all running IPC message broker processes
+ */
+static void
+signal_ipc_brokers(int signal)
+{
+	int i;
+
+	for (i = 0; i < MAX_IPC_BROKERS; i++)
+		if (IPCMessageBrokerPIDs[i] != 0)
+			signal_child(IPCMessageBrokerPIDs[i], signal);
+}
+
+/*
+ * Is the given pid one of the IPC message broker processes? If reset is true, the
+ * broker is also marked as no longer running.
+ */
+static bool
+is_ipc_broker_pid(pid_t pid, bool reset)
+{
+	int i;
+
+	for (i = 0; i < MAX_IPC_BROKERS; i++)
+	{
+		if (IPCMessageBrokerPIDs[i] == pid)
+		{
+			if (reset)
+				IPCMessageBrokerPIDs[i] = 0;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 /*
  * Send a signal to the targeted children (but NOT special children;
  * dead_end children are never signaled, either).
@@ -3932,8 +3980,7 @@ TerminateChildren(int signal)
 		signal_child(PgStatPID, signal);
 	if (ContQuerySchedulerPID != 0)
 		signal_child(ContQuerySchedulerPID, signal);
-	if (IPCMessageBrokerPID != 0)
-		signal_child(IPCMessageBrokerPID, signal);
+	signal_ipc_brokers(signal);
 }
 
 /*
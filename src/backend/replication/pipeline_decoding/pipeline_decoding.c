@@ -0,0 +1,375 @@
+/*-------------------------------------------------------------------------
+ *
+ * pipeline_decoding.c
+ *	  Logical decoding output plugin writing table changes to streams
+ *
+ * Feeding continuous views from a table with a pipeline_stream_insert trigger
+ * makes every write to the table pay for writing its rows to worker queues.
+ * This output plugin moves that work out of the writing transactions: the
+ * rows inserted or updated by committed transactions are read from the WAL
+ * whenever the slot is consumed, and written to streams in one batch per
+ * table and stream. Each route option maps a table to a stream:
+ *
+ *   SELECT pg_create_logical_replication_slot('orders', 'pipeline_decoding');
+ *   SELECT sum(data::integer) FROM pg_logical_slot_get_changes('orders', NULL, 10000,
+ *       'route', 'public.orders=orders_stream', 'route', 'public.refunds=orders_stream');
+ *
+ * which outputs the number of events each decoded transaction contributed.
+ * Consuming the slot periodically, e.g. from cron, keeps the streams up to
+ * date. Decoding requires wal_level = logical.
+ *
+ * Streams can't be written to while changes are being decoded, since catalog
+ * lookups then see the catalogs as of the decoded transaction, so events are
+ * buffered until decoding ends. Bound the memory that takes with the
+ * upto_nchanges argument. Events are written before the slot is advanced, so
+ * on a crash they may be written again by the next consumer, and reading
+ * changes with pg_logical_slot_peek_changes writes them too.
+ *
+ * Updated rows are written like inserted ones, deleted rows are ignored. TOASTed
+ * values an update didn't change aren't in the WAL, so they're written as NULL.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * IDENTIFICATION
+ *	  src/backend/replication/pipeline_decoding/pipeline_decoding.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/namespace.h"
+#include "catalog/pipeline_stream_fn.h"
+#include "nodes/makefuncs.h"
+#include "pipeline/stream.h"
+#include "replication/logical.h"
+#include "replication/output_plugin.h"
+#include "replication/walsender.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+PG_MODULE_MAGIC;
+
+/* These must be available to pg_dlsym() */
+extern void _PG_init(void);
+extern void _PG_output_plugin_init(OutputPluginCallbacks *cb);
+
+typedef struct StreamRoute
+{
+	Oid relid;
+	Oid stream;
+} StreamRoute;
+
+/* events read from a table's rows with the same descriptor, bound for a stream */
+typedef struct StreamRouteBatch
+{
+	Oid relid;
+	Oid stream;
+	TupleDesc desc;
+	HeapTuple *tups;
+	int ntups;
+	int maxtups;
+} StreamRouteBatch;
+
+typedef struct PipelineDecodingData
+{
+	MemoryContext context;
+	List *routes;
+	/* batches are written in the order they were started */
+	List *batches;
+	int xact_events;
+} PipelineDecodingData;
+
+static void pipeline_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is_init);
+static void pipeline_decode_shutdown(LogicalDecodingContext *ctx);
+static void pipeline_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn);
+static void pipeline_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
+static void pipeline_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, Relation rel,
+		ReorderBufferChange *change);
+
+void
+_PG_init(void)
+{
+}
+
+void
+_PG_output_plugin_init(OutputPluginCallbacks *cb)
+{
+	AssertVariableIsOfType(&_PG_output_plugin_init, LogicalOutputPluginInit);
+
+	cb->startup_cb = pipeline_decode_startup;
+	cb->begin_cb = pipeline_decode_begin_txn;
+	cb->change_cb = pipeline_decode_change;
+	cb->commit_cb = pipeline_decode_commit_txn;
+	cb->shutdown_cb = pipeline_decode_shutdown;
+}
+
+/*
+ * parse_route
+ *
+ * Parses a route of the form table=stream, both of which may be schema qualified
+ */
+static StreamRoute *
+parse_route(char *route)
+{
+	StreamRoute *result = palloc0(sizeof(StreamRoute));
+	char *sep = strchr(route, '=');
+	char *table;
+	RangeVar *rv;
+
+	if (sep == NULL || sep == route || sep[1] == '\0')
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid route \"%s\"", route),
+				 errhint("Routes must be of the form table=stream.")));
+
+	table = pnstrdup(route, sep - route);
+
+	rv = makeRangeVarFromNameList(stringToQualifiedNameList(table));
+	result->relid = RangeVarGetRelid(rv, NoLock, false);
+	if (get_rel_relkind(result->relid) != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table", table)));
+
+	rv = makeRangeVarFromNameList(stringToQualifiedNameList(sep + 1));
+	result->stream = RangeVarGetRelid(rv, NoLock, false);
+	if (!IsStream(result->stream))
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a stream", sep + 1)));
+
+	return result;
+}
+
+/*
+ * pipeline_decode_startup
+ */
+static void
+pipeline_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is_init)
+{
+	PipelineDecodingData *data = palloc0(sizeof(PipelineDecodingData));
+	ListCell *lc;
+
+	data->context = AllocSetContextCreate(ctx->context, "PipelineDecodingCxt",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	/* events are written by the consuming backend, which a walsender can't do */
+	if (am_walsender && !is_init)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("pipeline_decoding slots can only be consumed with pg_logical_slot_get_changes")));
+
+	ctx->output_plugin_private = data;
+	opt->output_type = OUTPUT_PLUGIN_TEXTUAL_OUTPUT;
+
+	foreach(lc, ctx->output_plugin_options)
+	{
+		DefElem *elem = lfirst(lc);
+
+		Assert(elem->arg == NULL || IsA(elem->arg, String));
+
+		if (strcmp(elem->defname, "route") == 0)
+		{
+			if (elem->arg == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("route requires a value")));
+
+			data->routes = lappend(data->routes, parse_route(strVal(elem->arg)));
+		}
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("option \"%s\" = \"%s\" is unknown",
+							elem->defname, elem->arg ? strVal(elem->arg) : "(null)")));
+	}
+
+	/* creating the slot doesn't decode anything, so it doesn't need any routes */
+	if (!is_init && data->routes == NIL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("at least one route is required")));
+}
+
+/*
+ * pipeline_decode_shutdown
+ *
+ * Decoding is over, so we can finally write the events it buffered
+ */
+static void
+pipeline_decode_shutdown(LogicalDecodingContext *ctx)
+{
+	PipelineDecodingData *data = ctx->output_plugin_private;
+	ListCell *lc;
+
+	foreach(lc, data->batches)
+	{
+		StreamRouteBatch *batch = (StreamRouteBatch *) lfirst(lc);
+		Relation stream = heap_open(batch->stream, AccessShareLock);
+
+		SendTuplesToContWorkers(stream, batch->desc, batch->tups, batch->ntups, NULL, 0);
+
+		heap_close(stream, AccessShareLock);
+	}
+
+	MemoryContextDelete(data->context);
+}
+
+/*
+ * pipeline_decode_begin_txn
+ */
+static void
+pipeline_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	PipelineDecodingData *data = ctx->output_plugin_private;
+
+	data->xact_events = 0;
+}
+
+/*
+ * pipeline_decode_commit_txn
+ *
+ * Outputs the number of events the transaction contributed, for transactions that contributed any
+ */
+static void
+pipeline_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, XLogRecPtr commit_lsn)
+{
+	PipelineDecodingData *data = ctx->output_plugin_private;
+
+	if (data->xact_events == 0)
+		return;
+
+	OutputPluginPrepareWrite(ctx, true);
+	appendStringInfo(ctx->out, "%d", data->xact_events);
+	OutputPluginWrite(ctx, true);
+}
+
+/*
+ * get_batch
+ *
+ * Returns the batch the given table's current rows bound for the given stream are added to
+ */
+static StreamRouteBatch *
+get_batch(PipelineDecodingData *data, Relation rel, Oid stream)
+{
+	StreamRouteBatch *batch = NULL;
+	ListCell *lc;
+
+	/* the latest batch of each route is the only one rows may still be added to */
+	foreach(lc, data->batches)
+	{
+		StreamRouteBatch *b = (StreamRouteBatch *) lfirst(lc);
+
+		if (b->relid == RelationGetRelid(rel) && b->stream == stream)
+			batch = b;
+	}
+
+	/* the table's descriptor changed since its last rows were buffered */
+	if (batch && !equalTupleDescs(batch->desc, RelationGetDescr(rel)))
+		batch = NULL;
+
+	if (batch == NULL)
+	{
+		batch = palloc0(sizeof(StreamRouteBatch));
+		batch->relid = RelationGetRelid(rel);
+		batch->stream = stream;
+		batch->desc = CreateTupleDescCopy(RelationGetDescr(rel));
+		batch->maxtups = 64;
+		batch->tups = palloc(sizeof(HeapTuple) * batch->maxtups);
+
+		data->batches = lappend(data->batches, batch);
+	}
+
+	if (batch->ntups == batch->maxtups)
+	{
+		batch->maxtups *= 2;
+		batch->tups = repalloc(batch->tups, sizeof(HeapTuple) * batch->maxtups);
+	}
+
+	return batch;
+}
+
+/*
+ * copy_event
+ *
+ * Copies a decoded row, replacing any TOAST pointers left in it by unchanged values with NULLs
+ */
+static HeapTuple
+copy_event(TupleDesc desc, HeapTuple tup)
+{
+	Datum *values;
+	bool *nulls;
+	bool toasted = false;
+	int i;
+
+	if (!HeapTupleHasExternal(tup))
+		return heap_copytuple(tup);
+
+	values = palloc(sizeof(Datum) * desc->natts);
+	nulls = palloc(sizeof(bool) * desc->natts);
+
+	heap_deform_tuple(tup, desc, values, nulls);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		if (nulls[i] || desc->attrs[i]->attlen != -1)
+			continue;
+
+		if (VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(values[i])))
+		{
+			nulls[i] = true;
+			toasted = true;
+		}
+	}
+
+	if (toasted)
+		tup = heap_form_tuple(desc, values, nulls);
+	else
+		tup = heap_copytuple(tup);
+
+	pfree(values);
+	pfree(nulls);
+
+	return tup;
+}
+
+/*
+ * pipeline_decode_change
+ */
+static void
+pipeline_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, Relation rel,
+		ReorderBufferChange *change)
+{
+	PipelineDecodingData *data = ctx->output_plugin_private;
+	MemoryContext old;
+	ListCell *lc;
+
+	if (change->action != REORDER_BUFFER_CHANGE_INSERT && change->action != REORDER_BUFFER_CHANGE_UPDATE)
+		return;
+
+	if (change->data.tp.newtuple == NULL)
+		return;
+
+	old = MemoryContextSwitchTo(data->context);
+
+	foreach(lc, data->routes)
+	{
+		StreamRoute *route = (StreamRoute *) lfirst(lc);
+		StreamRouteBatch *batch;
+
+		if (route->relid != RelationGetRelid(rel))
+			continue;
+
+		batch = get_batch(data, rel, route->stream);
+		batch->tups[batch->ntups++] = copy_event(batch->desc, &change->data.tp.newtuple->tuple);
+		data->xact_events++;
+	}
+
+	MemoryContextSwitchTo(old);
+}
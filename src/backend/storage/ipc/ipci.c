@@ -25,8 +25,17 @@
 #include "commands/async.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "pipeline/cont_instrument.h"
+#include "pipeline/cont_memory.h"
+#include "pipeline/cont_query_cache.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/ipc/broker.h"
+#include "pipeline/read_cache.h"
+#include "pipeline/stream_batch.h"
+#include "pipeline/stream_log.h"
+#include "pipeline/stream_quota.h"
+#include "pipeline/stream_desc.h"
+#include "pipeline/stream_readers.h"
 #include "postmaster/autovacuum.h"
 #include "postmaster/bgworker_internals.h"
 #include "postmaster/bgwriter.h"
@@ -131,6 +140,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		size = add_size(size, LWLockShmemSize());
 		size = add_size(size, ProcArrayShmemSize());
 		size = add_size(size, BackendStatusShmemSize());
+		size = add_size(size, CQStatsShmemSize());
 		size = add_size(size, SInvalShmemSize());
 		size = add_size(size, PMSignalShmemSize());
 		size = add_size(size, ProcSignalShmemSize());
@@ -154,6 +164,15 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		size = add_size(size, ShmemDynAllocSize());
 		size = add_size(size, ContQuerySchedulerShmemSize());
 		size = add_size(size, IPCMessageBrokerShmemSize());
+		size = add_size(size, StreamDescCacheShmemSize());
+		size = add_size(size, ContQueryCacheShmemSize());
+		size = add_size(size, StreamReadersCacheShmemSize());
+		size = add_size(size, ContInstrumentShmemSize());
+		size = add_size(size, ContQueryMemoryShmemSize());
+		size = add_size(size, ReadCacheShmemSize());
+		size = add_size(size, StreamBatchShmemSize());
+		size = add_size(size, StreamLogShmemSize());
+		size = add_size(size, StreamQuotaShmemSize());
 
 		/* might as well round it off to a multiple of a typical page size */
 		size = add_size(size, 8192 - (size % 8192));
@@ -232,6 +251,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		InitProcGlobal();
 	CreateSharedProcArray();
 	CreateSharedBackendStatus();
+	CQStatsShmemInit();
 	TwoPhaseShmemInit();
 	BackgroundWorkerShmemInit();
 
@@ -566,26 +566,19 @@ array_agg_finalfn(PG_FUNCTION_ARGS)
 {
 	Datum		result;
 	ArrayBuildState *state;
-	int			dims[1];
-	int			lbs[1];
 
 	state = PG_ARGISNULL(0) ? NULL : (ArrayBuildState *) PG_GETARG_POINTER(0);
 
 	if (state == NULL)
 		PG_RETURN_NULL();		/* returns null iff no input values */
 
-	dims[0] = state->nelems;
-	lbs[0] = 1;
-
 	/*
 	 * Make the result.  We cannot release the ArrayBuildState because
 	 * sometimes aggregate final functions are re-executed.  Rather, it is
 	 * nodeAgg.c's responsibility to reset the aggcontext when it's safe to do
 	 * so.
 	 */
-	result = makeMdArrayResult(state, 1, dims, lbs,
-							   CurrentMemoryContext,
-							   false);
+	result = makeArrayAggResult(state, CurrentMemoryContext);
 
 	PG_RETURN_DATUM(result);
 }
@@ -980,7 +973,26 @@ array_agg_combine(PG_FUNCTION_ARGS)
 	/*
 	 * The incoming arrays will be appended to the existing transition state,
 	 * but the order in which they're appended isn't predictable.
+	 *
+	 * Only the incoming values are ever touched here: if the existing state
+	 * was read back from disk, its values are still in its base array and
+	 * stay there until the state is serialized or finalized.
 	 */
+	if (toappend->base)
+	{
+		Datum *values;
+		bool *nulls;
+		int nvalues;
+
+		deconstruct_array(toappend->base, toappend->element_type,
+				toappend->typlen, toappend->typbyval, toappend->typalign,
+				&values, &nulls, &nvalues);
+
+		for (i=0; i<nvalues; i++)
+			result = accumArrayResult(result, values[i], nulls[i],
+					toappend->element_type, aggcontext);
+	}
+
 	for (i=0; i<toappend->nelems; i++)
 	{
 		result = accumArrayResult(result,
@@ -1537,20 +1537,11 @@ Datum
 arrayaggstatesend(PG_FUNCTION_ARGS)
 {
 	ArrayBuildState *state = PG_ARGISNULL(0) ? NULL : (ArrayBuildState *) PG_GETARG_POINTER(0);
-	ArrayType *vals;
-	int	dims[1];
-	int	lbs[1];
 
 	if (state == NULL)
 		PG_RETURN_NULL();
 
-	dims[0] = state->nelems;
-	lbs[0] = 1;
-
-	vals = construct_md_array(state->dvalues, state->dnulls, 1, dims, lbs, state->element_type,
-			state->typlen, state->typbyval, state->typalign);
-
-	PG_RETURN_ARRAYTYPE_P(vals);
+	PG_RETURN_DATUM(makeArrayAggResult(state, CurrentMemoryContext));
 }
 
 /*
@@ -1558,6 +1549,11 @@ arrayaggstatesend(PG_FUNCTION_ARGS)
  *
  *	Input function for array aggregation states, used by combiners to
  *	deserialize partial transition states sent to it by a worker process
+ *
+ *	The array isn't deconstructed: it's kept as the state's base chunk, and
+ *	values combined into the state are accumulated after it. Only the values
+ *	appended since the state was read then need to be built into an array
+ *	when it's serialized or finalized again.
  */
 Datum
 arrayaggstaterecv(PG_FUNCTION_ARGS)
@@ -1576,20 +1572,8 @@ arrayaggstaterecv(PG_FUNCTION_ARGS)
 	old = MemoryContextSwitchTo(context);
 	vals = (ArrayType *) PG_GETARG_ARRAYTYPE_P_COPY(0);
 
-	result = (ArrayBuildState *) palloc0(sizeof(ArrayBuildState));
-	result->mcontext = CurrentMemoryContext;
-	result->element_type = ARR_ELEMTYPE(vals);
-
-	get_typlenbyvalalign(result->element_type,
-						 &result->typlen,
-						 &result->typbyval,
-						 &result->typalign);
-
-	deconstruct_array(vals, result->element_type,
-			result->typlen, result->typbyval, result->typalign,
-			&result->dvalues, &result->dnulls, &result->nelems);
-
-	result->alen = result->nelems;
+	result = initArrayResult(ARR_ELEMTYPE(vals), context, false);
+	result->base = vals;
 
 	MemoryContextSwitchTo(old);
 
@@ -5074,6 +5058,7 @@ initArrayResult(Oid element_type, MemoryContext rcontext, bool subcontext)
 	astate->dnulls = (bool *)
 		MemoryContextAlloc(arr_context, astate->alen * sizeof(bool));
 	astate->nelems = 0;
+	astate->base = NULL;
 	astate->element_type = element_type;
 	get_typlenbyvalalign(element_type,
 						 &astate->typlen,
@@ -5172,6 +5157,101 @@ makeArrayResult(ArrayBuildState *astate,
 							 astate->private_cxt);
 }
 
+/*
+ * makeArrayAggResult - produce 1-D result of an array_agg transition state
+ *
+ * States deserialized by arrayaggstaterecv keep the stored array as an
+ * immutable base chunk and only accumulate the values appended to it since,
+ * so the result is the base followed by those values. This never releases
+ * astate, since aggregate final functions may be re-executed.
+ *
+ *	astate is working state (must not be NULL)
+ *	rcontext is where to construct result
+ */
+Datum
+makeArrayAggResult(ArrayBuildState *astate, MemoryContext rcontext)
+{
+	MemoryContext oldcontext;
+	Datum		result;
+	int			dims[1];
+	int			lbs[1];
+
+	dims[0] = astate->nelems;
+	lbs[0] = 1;
+
+	if (astate->base == NULL)
+		return makeMdArrayResult(astate, 1, dims, lbs, rcontext, false);
+
+	oldcontext = MemoryContextSwitchTo(rcontext);
+
+	if (astate->nelems == 0)
+	{
+		ArrayType  *copy = (ArrayType *) palloc(VARSIZE(astate->base));
+
+		memcpy(copy, astate->base, VARSIZE(astate->base));
+		result = PointerGetDatum(copy);
+	}
+	else
+	{
+		ArrayType  *tail;
+
+		tail = construct_md_array(astate->dvalues, astate->dnulls, 1, dims, lbs,
+								  astate->element_type, astate->typlen,
+								  astate->typbyval, astate->typalign);
+		result = DirectFunctionCall2(array_cat, PointerGetDatum(astate->base),
+									 PointerGetDatum(tail));
+		pfree(tail);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return result;
+}
+
+/*
+ * expandArrayAggState - fold the base chunk of an array_agg state into its values
+ *
+ * For callers that need direct access to all of the state's values rather
+ * than only those appended after its base.
+ */
+void
+expandArrayAggState(ArrayBuildState *astate)
+{
+	MemoryContext oldcontext;
+	Datum	   *values;
+	bool	   *nulls;
+	int			nvalues;
+	int			alen;
+
+	if (astate->base == NULL)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(astate->mcontext);
+
+	deconstruct_array(astate->base, astate->element_type, astate->typlen,
+					  astate->typbyval, astate->typalign,
+					  &values, &nulls, &nvalues);
+
+	alen = Max(nvalues + astate->nelems, astate->alen);
+	values = (Datum *) repalloc(values, alen * sizeof(Datum));
+	nulls = (bool *) repalloc(nulls, alen * sizeof(bool));
+	memcpy(values + nvalues, astate->dvalues, astate->nelems * sizeof(Datum));
+	memcpy(nulls + nvalues, astate->dnulls, astate->nelems * sizeof(bool));
+
+	pfree(astate->dvalues);
+	pfree(astate->dnulls);
+
+	astate->dvalues = values;
+	astate->dnulls = nulls;
+	astate->nelems += nvalues;
+	astate->alen = alen;
+
+	/* by-reference values still point into the base array, so it's kept */
+	astate->base = NULL;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
 /*
  * makeMdArrayResult - produce multi-D final result of accumArrayResult
  *
@@ -42,7 +42,7 @@ bloom_print(PG_FUNCTION_ARGS)
 }
 
 static BloomFilter *
-bloom_create(float8 p, uint64_t n)
+bloom_create(float8 p, uint64_t n, bool blocked)
 {
 	if (p <= 0 || p >= 1)
 		ereport(ERROR,
@@ -53,11 +53,14 @@ bloom_create(float8 p, uint64_t n)
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				errmsg("n must be non-zero")));
 
+	if (blocked)
+		return BloomFilterCreateBlockedWithPAndN(p, n);
+
 	return BloomFilterCreateWithPAndN(p, n);
 }
 
 static BloomFilter *
-bloom_startup(FunctionCallInfo fcinfo, float8 p, uint64_t n)
+bloom_startup(FunctionCallInfo fcinfo, float8 p, uint64_t n, bool blocked)
 {
 	BloomFilter *bloom;
 	Oid type = AggGetInitialArgType(fcinfo);
@@ -66,7 +69,7 @@ bloom_startup(FunctionCallInfo fcinfo, float8 p, uint64_t n)
 
 	if (p && n)
 	{
-		bloom = bloom_create(p, n);
+		bloom = bloom_create(p, n, blocked);
 	}
 	else
 		bloom = BloomFilterCreate();
@@ -82,7 +85,7 @@ bloom_add_datum(FunctionCallInfo fcinfo, BloomFilter *bloom, Datum elem)
 
 	buf = makeStringInfo();
 	DatumToBytes(elem, typ, buf);
-	BloomFilterAdd(bloom, buf->data, buf->len);
+	bloom = BloomFilterAdd(bloom, buf->data, buf->len);
 
 	pfree(buf->data);
 	pfree(buf);
@@ -107,7 +110,7 @@ bloom_agg_trans(PG_FUNCTION_ARGS)
 	old = MemoryContextSwitchTo(context);
 
 	if (PG_ARGISNULL(0))
-		state = bloom_startup(fcinfo, 0, 0);
+		state = bloom_startup(fcinfo, 0, 0, false);
 	else
 		state = (BloomFilter *) PG_GETARG_VARLENA_P(0);
 
@@ -139,7 +142,41 @@ bloom_agg_transp(PG_FUNCTION_ARGS)
 	old = MemoryContextSwitchTo(context);
 
 	if (PG_ARGISNULL(0))
-		state = bloom_startup(fcinfo, p, n);
+		state = bloom_startup(fcinfo, p, n, false);
+	else
+		state = (BloomFilter *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = bloom_add_datum(fcinfo, state, PG_GETARG_DATUM(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * bloom_agg transition function -
+ *
+ * 	adds the given element to the transition Bloom Filter using the given value for p and n,
+ * 	and a blocked filter if asked to
+ */
+Datum
+bloom_agg_trans_blocked(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	BloomFilter *state;
+	float8 p = PG_GETARG_FLOAT8(2);
+	uint64_t n = PG_GETARG_INT64(3);
+	bool blocked = PG_GETARG_BOOL(4);
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "bloom_agg_trans_blocked called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = bloom_startup(fcinfo, p, n, blocked);
 	else
 		state = (BloomFilter *) PG_GETARG_VARLENA_P(0);
 
@@ -286,7 +323,8 @@ bloom_emptyp(PG_FUNCTION_ARGS)
 {
 	float8 p = PG_GETARG_FLOAT8(0);
 	uint64_t n = PG_GETARG_INT64(1);
-	BloomFilter *bloom = bloom_create(p, n);
+	bool blocked = PG_NARGS() > 2 && PG_GETARG_BOOL(2);
+	BloomFilter *bloom = bloom_create(p, n, blocked);
 	PG_RETURN_POINTER(bloom);
 }
 
@@ -12,10 +12,15 @@
  */
 #include "postgres.h"
 
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
 #include "lib/stringinfo.h"
 #include "libpq/pqformat.h"
+#include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
 #include "pipeline/cmsketch.h"
+#include "pipeline/cmstopk.h"
 #include "pipeline/miscutils.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
@@ -328,3 +333,176 @@ cmsketch_addn(PG_FUNCTION_ARGS)
 
 	PG_RETURN_POINTER(cms);
 }
+
+static CMSTopK *
+cmsketch_topk_startup(FunctionCallInfo fcinfo, int64 k)
+{
+	Oid type = AggGetInitialArgType(fcinfo);
+
+	if (k <= 0 || k > PG_UINT16_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("k must be in [1, %d]", PG_UINT16_MAX)));
+
+	return CMSTopKCreate(k, lookup_type_cache(type, 0));
+}
+
+/*
+ * cmsketch_topk_agg transition function -
+ * 	adds the given element to the transition sketch and its heavy hitters
+ */
+Datum
+cmsketch_topk_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	CMSTopK *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "cmsketch_topk_agg_trans called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = cmsketch_topk_startup(fcinfo, PG_GETARG_INT64(2));
+	else
+		state = (CMSTopK *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = CMSTopKAdd(state, PG_GETARG_DATUM(1), 1);
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * cmsketch_topk_merge_agg transition function -
+ *
+ * 	returns the merge of the transition state and the given sketch
+ */
+Datum
+cmsketch_topk_merge_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	CMSTopK *state;
+	CMSTopK *incoming;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "cmsketch_topk_merge_agg_trans called in non-aggregate context");
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+	{
+		incoming = (CMSTopK *) PG_GETARG_VARLENA_P(1);
+		state = CMSTopKCopy(incoming);
+	}
+	else if (PG_ARGISNULL(1))
+		state = (CMSTopK *) PG_GETARG_VARLENA_P(0);
+	else
+	{
+		state = (CMSTopK *) PG_GETARG_VARLENA_P(0);
+		incoming = (CMSTopK *) PG_GETARG_VARLENA_P(1);
+		state = CMSTopKMerge(state, incoming);
+	}
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Returns the heavy hitters and their estimated frequencies
+ */
+Datum
+cmsketch_topk(PG_FUNCTION_ARGS)
+{
+	CMSTopK *topk;
+	Datum *values;
+	uint64_t *freqs;
+	uint16_t found;
+	Tuplestorestate *store;
+	ReturnSetInfo *rsi;
+	TupleDesc desc;
+	int i;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	topk = (CMSTopK *) PG_GETARG_VARLENA_P(0);
+	desc = CreateTemplateTupleDesc(2, false);
+	TupleDescInitEntry(desc, (AttrNumber) 1, "value", topk->typoid, -1, 0);
+	TupleDescInitEntry(desc, (AttrNumber) 2, "frequency", INT8OID, -1, 0);
+
+	rsi = (ReturnSetInfo *) fcinfo->resultinfo;
+	rsi->returnMode = SFRM_Materialize;
+	rsi->setDesc = BlessTupleDesc(desc);
+
+	store = tuplestore_begin_heap(false, false, work_mem);
+	values = CMSTopKValues(topk, &freqs, &found);
+
+	for (i = 0; i < found; i++)
+	{
+		Datum tup_values[2];
+		bool nulls[2];
+		HeapTuple tup;
+
+		MemSet(nulls, false, sizeof(nulls));
+
+		tup_values[0] = values[i];
+		tup_values[1] = Int64GetDatum(freqs[i]);
+
+		tup = heap_form_tuple(rsi->setDesc, tup_values, nulls);
+		tuplestore_puttuple(store, tup);
+	}
+
+	rsi->setResult = store;
+
+	PG_RETURN_NULL();
+}
+
+/*
+ * Returns the estimate frequency of the item
+ */
+Datum
+cmsketch_topk_frequency(PG_FUNCTION_ARGS)
+{
+	CMSTopK *topk;
+	Oid	val_type = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+	if (val_type == InvalidOid)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("could not determine input data type")));
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT32(0);
+
+	topk = (CMSTopK *) PG_GETARG_VARLENA_P(0);
+
+	if (topk->typoid != val_type)
+		elog(ERROR, "type mismatch for incoming value");
+
+	PG_RETURN_INT32(CMSTopKEstimateFrequency(topk, PG_GETARG_DATUM(1)));
+}
+
+/*
+ * Returns the number of items added to the sketch
+ */
+Datum
+cmsketch_topk_total(PG_FUNCTION_ARGS)
+{
+	CMSTopK *topk;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT64(0);
+
+	topk = (CMSTopK *) PG_GETARG_VARLENA_P(0);
+
+	PG_RETURN_INT64(CountMinSketchTotal(CMSTopKSketch(topk)));
+}
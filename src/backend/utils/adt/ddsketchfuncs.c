@@ -0,0 +1,250 @@
+/*-------------------------------------------------------------------------
+ *
+ * ddsketchfuncs.c
+ *		DDSketch functions
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/ddsketchfuncs.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+#include "pipeline/ddsketch.h"
+#include "utils/builtins.h"
+#include "utils/ddsketchfuncs.h"
+
+Datum
+ddsketch_print(PG_FUNCTION_ARGS)
+{
+	StringInfoData buf;
+	DDSketch *s;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	s = (DDSketch *) PG_GETARG_VARLENA_P(0);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "{ count = %ld, alpha = %g, buckets = %d, size = %dkB }",
+			s->count, s->alpha, s->pos_len + s->neg_len, (int) DDSketchSize(s) / 1024);
+
+	PG_RETURN_TEXT_P(CStringGetTextDatum(buf.data));
+}
+
+static DDSketch *
+ddsketch_create(float8 alpha)
+{
+	if (alpha <= 0 || alpha >= 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("alpha must be in (0, 1)")));
+	return DDSketchCreateWithAlpha(alpha);
+}
+
+static DDSketch *
+ddsketch_startup(FunctionCallInfo fcinfo, float8 alpha)
+{
+	DDSketch *s;
+
+	if (alpha)
+		s = ddsketch_create(alpha);
+	else
+		s = DDSketchCreate();
+
+	return s;
+}
+
+/*
+ * ddsketch_agg transition function -
+ * 	adds the given element to the transition ddsketch
+ */
+Datum
+ddsketch_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	DDSketch *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "ddsketch_agg_trans called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = ddsketch_startup(fcinfo, 0);
+	else
+		state = (DDSketch *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = DDSketchAdd(state, PG_GETARG_FLOAT8(1), 1);
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * ddsketch_agg transition function -
+ *
+ * 	adds the given element to the transition ddsketch using the given relative accuracy
+ */
+Datum
+ddsketch_agg_transp(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	DDSketch *state;
+	float8 alpha = PG_GETARG_FLOAT8(2);
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "ddsketch_agg_trans called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = ddsketch_startup(fcinfo, alpha);
+	else
+		state = (DDSketch *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = DDSketchAdd(state, PG_GETARG_FLOAT8(1), 1);
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * ddsketch_merge_agg transition function -
+ *
+ * 	returns the union of the transition state and the given ddsketch
+ */
+Datum
+ddsketch_merge_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	DDSketch *state;
+	DDSketch *incoming;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "ddsketch_merge_agg_trans called in non-aggregate context");
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+	{
+		incoming = (DDSketch *) PG_GETARG_VARLENA_P(1);
+		state = DDSketchCopy(incoming);
+	}
+	else if (PG_ARGISNULL(1))
+		state = (DDSketch *) PG_GETARG_VARLENA_P(0);
+	else
+	{
+		state = (DDSketch *) PG_GETARG_VARLENA_P(0);
+		incoming = (DDSketch *) PG_GETARG_VARLENA_P(1);
+		state = DDSketchMerge(state, incoming);
+	}
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * ddsketch_quantile
+ */
+Datum
+ddsketch_quantile(PG_FUNCTION_ARGS)
+{
+	DDSketch *s;
+	float8 q;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	s = (DDSketch *) PG_GETARG_VARLENA_P(0);
+	q = PG_GETARG_FLOAT8(1);
+
+	if (s->count == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(DDSketchQuantile(s, q));
+}
+
+/*
+ * ddsketch_cdf
+ */
+Datum
+ddsketch_cdf(PG_FUNCTION_ARGS)
+{
+	DDSketch *s;
+	float8 x;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	s = (DDSketch *) PG_GETARG_VARLENA_P(0);
+	x = PG_GETARG_FLOAT8(1);
+
+	if (s->count == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(DDSketchCDF(s, x));
+}
+
+Datum
+ddsketch_empty(PG_FUNCTION_ARGS)
+{
+	DDSketch *s = DDSketchCreate();
+	PG_RETURN_POINTER(s);
+}
+
+Datum
+ddsketch_emptyp(PG_FUNCTION_ARGS)
+{
+	float8 alpha = PG_GETARG_FLOAT8(0);
+	DDSketch *s = ddsketch_create(alpha);
+	PG_RETURN_POINTER(s);
+}
+
+Datum
+ddsketch_add(PG_FUNCTION_ARGS)
+{
+	DDSketch *s;
+
+	if (PG_ARGISNULL(0))
+		s = DDSketchCreate();
+	else
+		s = (DDSketch *) PG_GETARG_VARLENA_P(0);
+
+	s = DDSketchAdd(s, PG_GETARG_FLOAT8(1), 1);
+	PG_RETURN_POINTER(s);
+}
+
+Datum
+ddsketch_addn(PG_FUNCTION_ARGS)
+{
+	DDSketch *s;
+	int32 n = PG_GETARG_INT32(2);
+
+	if (n < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("n must be non-negative")));
+
+	if (PG_ARGISNULL(0))
+		s = DDSketchCreate();
+	else
+		s = (DDSketch *) PG_GETARG_VARLENA_P(0);
+
+	s = DDSketchAdd(s, PG_GETARG_FLOAT8(1), n);
+	PG_RETURN_POINTER(s);
+}
@@ -0,0 +1,409 @@
+/*-------------------------------------------------------------------------
+ *
+ * dictfuncs.c
+ *	  Dictionary encoding of text values, mostly useful for group keys
+ *
+ * dict_encode(dictionary, value) maps a text value to an int8 id and makes
+ * sure the dictionary table, which must have an int8 column named id and a
+ * text column named value, maps that id back to the value. dict_decode does
+ * the reverse lookup. Grouping a continuous view by dict_encode('dict', url)
+ * instead of url makes workers send, combiners hash and matrels store and
+ * index eight bytes per group instead of the full text value.
+ *
+ * Ids are hashes of the values, so that any number of workers can encode
+ * values concurrently without coordinating: they might both add the same
+ * (id, value) row to the dictionary, which is harmless since readers only
+ * need one of them, so dictionaries shouldn't have a unique constraint on id.
+ * The small chance of two values hashing to the same id is checked for and
+ * raises an error. Rows must never be removed from a dictionary that is still
+ * referenced by a continuous view.
+ *
+ * Each backend caches the (dictionary, id) -> value mappings it has seen, so
+ * that only the first occurrence of a value in a process hits the dictionary.
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/dictfuncs.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "pipeline/miscutils.h"
+#include "utils/builtins.h"
+#include "utils/dictfuncs.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+#define MURMUR_SEED 0x5bd1e9955bd1e995ULL
+#define DICT_CACHE_SIZE 65536
+
+typedef struct DictKey
+{
+	Oid relid;
+	int64 id;
+} DictKey;
+
+typedef struct DictEntry
+{
+	DictKey key;
+	char *value;
+} DictEntry;
+
+static MemoryContext DictCacheCxt = NULL;
+static HTAB *dict_cache = NULL;
+
+/* keys cached by the current transaction, which must be forgotten if it aborts */
+static List *pending = NIL;
+
+/*
+ * reset_dict_cache
+ */
+static void
+reset_dict_cache(void)
+{
+	if (DictCacheCxt)
+		MemoryContextReset(DictCacheCxt);
+	dict_cache = NULL;
+	pending = NIL;
+}
+
+/*
+ * forget_pending
+ *
+ * Forget the mappings cached by the current transaction, since the dictionary
+ * rows they were read from or written to might have been rolled back
+ */
+static void
+forget_pending(void)
+{
+	ListCell *lc;
+
+	if (dict_cache == NULL)
+		return;
+
+	foreach(lc, pending)
+	{
+		DictKey *key = (DictKey *) lfirst(lc);
+		DictEntry *entry = (DictEntry *) hash_search(dict_cache, key, HASH_FIND, NULL);
+
+		if (entry)
+		{
+			pfree(entry->value);
+			hash_search(dict_cache, key, HASH_REMOVE, NULL);
+		}
+	}
+
+	list_free_deep(pending);
+	pending = NIL;
+}
+
+/*
+ * dict_xact_callback
+ */
+static void
+dict_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+		case XACT_EVENT_PREPARE:
+			list_free_deep(pending);
+			pending = NIL;
+			break;
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+			forget_pending();
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * dict_subxact_callback
+ *
+ * We don't track which subtransaction cached what, so an aborted subtransaction
+ * makes us forget everything the current transaction cached. The mappings that
+ * are still valid will just be looked up again.
+ */
+static void
+dict_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+		SubTransactionId parentSubid, void *arg)
+{
+	if (event == SUBXACT_EVENT_ABORT_SUB)
+		forget_pending();
+}
+
+/*
+ * dict_relcache_callback
+ *
+ * A dictionary might have been truncated, dropped or renamed
+ */
+static void
+dict_relcache_callback(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS seq;
+	DictEntry *entry;
+
+	if (dict_cache == NULL)
+		return;
+
+	if (!OidIsValid(relid))
+	{
+		reset_dict_cache();
+		return;
+	}
+
+	hash_seq_init(&seq, dict_cache);
+	while ((entry = (DictEntry *) hash_seq_search(&seq)) != NULL)
+	{
+		if (entry->key.relid != relid)
+			continue;
+		pfree(entry->value);
+		hash_search(dict_cache, &entry->key, HASH_REMOVE, NULL);
+	}
+}
+
+/*
+ * init_dict_cache
+ */
+static void
+init_dict_cache(void)
+{
+	HASHCTL ctl;
+
+	if (dict_cache)
+		return;
+
+	if (DictCacheCxt == NULL)
+	{
+		DictCacheCxt = AllocSetContextCreate(TopMemoryContext, "DictCacheCxt",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+
+		RegisterXactCallback(dict_xact_callback, NULL);
+		RegisterSubXactCallback(dict_subxact_callback, NULL);
+		CacheRegisterRelcacheCallback(dict_relcache_callback, (Datum) 0);
+	}
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(DictKey);
+	ctl.entrysize = sizeof(DictEntry);
+	ctl.hcxt = DictCacheCxt;
+
+	dict_cache = hash_create("DictCache", 1024, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+/*
+ * dict_cache_get
+ */
+static DictEntry *
+dict_cache_get(Oid relid, int64 id)
+{
+	DictKey key;
+
+	init_dict_cache();
+
+	MemSet(&key, 0, sizeof(key));
+	key.relid = relid;
+	key.id = id;
+
+	return (DictEntry *) hash_search(dict_cache, &key, HASH_FIND, NULL);
+}
+
+/*
+ * dict_cache_put
+ *
+ * The cache is simply emptied once it's full, since the mappings that are still
+ * needed are quickly cached again
+ */
+static DictEntry *
+dict_cache_put(Oid relid, int64 id, char *value)
+{
+	DictKey key;
+	DictEntry *entry;
+	bool found;
+
+	init_dict_cache();
+
+	if (hash_get_num_entries(dict_cache) >= DICT_CACHE_SIZE)
+	{
+		reset_dict_cache();
+		init_dict_cache();
+	}
+
+	MemSet(&key, 0, sizeof(key));
+	key.relid = relid;
+	key.id = id;
+
+	entry = (DictEntry *) hash_search(dict_cache, &key, HASH_ENTER, &found);
+	if (!found)
+	{
+		MemoryContext old = MemoryContextSwitchTo(DictCacheCxt);
+
+		entry->value = pstrdup(value);
+		pending = lappend(pending, memcpy(palloc(sizeof(DictKey)), &key, sizeof(DictKey)));
+
+		MemoryContextSwitchTo(old);
+	}
+
+	return entry;
+}
+
+/*
+ * get_dict_name
+ */
+static char *
+get_dict_name(Oid relid)
+{
+	char *relname = get_rel_name(relid);
+
+	if (relname == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_TABLE),
+				errmsg("dictionary with OID %u does not exist", relid)));
+
+	return quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)), relname);
+}
+
+/*
+ * check_collision
+ */
+static void
+check_collision(Oid relid, int64 id, char *existing, char *value)
+{
+	if (strcmp(existing, value) == 0)
+		return;
+
+	ereport(ERROR,
+			(errcode(ERRCODE_DATA_EXCEPTION),
+			errmsg("dictionary \"%s\" maps id " INT64_FORMAT " to a different value", get_rel_name(relid), id),
+			errdetail("The values \"%s\" and \"%s\" have the same id.", existing, value)));
+}
+
+/*
+ * dict_encode
+ *
+ * Get the id of a value in the given dictionary, adding it to the dictionary if needed
+ */
+Datum
+dict_encode(PG_FUNCTION_ARGS)
+{
+	Oid relid = PG_GETARG_OID(0);
+	text *t = PG_GETARG_TEXT_PP(1);
+	char *value = text_to_cstring(t);
+	int64 id = (int64) MurmurHash3_64(VARDATA_ANY(t), VARSIZE_ANY_EXHDR(t), MURMUR_SEED);
+	DictEntry *entry;
+	char *relname;
+	Oid argtypes[2] = {INT8OID, TEXTOID};
+	Datum args[2];
+	bool exists = false;
+	uint64 i;
+	int rc;
+
+	entry = dict_cache_get(relid, id);
+	if (entry)
+	{
+		check_collision(relid, id, entry->value, value);
+		PG_RETURN_INT64(id);
+	}
+
+	relname = get_dict_name(relid);
+	args[0] = Int64GetDatum(id);
+	args[1] = PointerGetDatum(t);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "could not connect to SPI manager");
+
+	rc = SPI_execute_with_args(psprintf("SELECT value FROM %s WHERE id = $1", relname),
+			1, argtypes, args, NULL, false, 0);
+	if (rc != SPI_OK_SELECT)
+		elog(ERROR, "failed to look up id " INT64_FORMAT " in dictionary \"%s\": %s",
+				id, relname, SPI_result_code_string(rc));
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		char *existing = SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1);
+
+		if (existing == NULL)
+			continue;
+
+		check_collision(relid, id, existing, value);
+		exists = true;
+	}
+
+	/*
+	 * Another process might be adding the same row right now, but a duplicate is
+	 * harmless and it's cheaper than having concurrent encoders wait on each other
+	 */
+	if (!exists)
+	{
+		rc = SPI_execute_with_args(psprintf("INSERT INTO %s (id, value) VALUES ($1, $2)", relname),
+				2, argtypes, args, NULL, false, 0);
+		if (rc != SPI_OK_INSERT)
+			elog(ERROR, "failed to add id " INT64_FORMAT " to dictionary \"%s\": %s",
+					id, relname, SPI_result_code_string(rc));
+	}
+
+	SPI_finish();
+
+	dict_cache_put(relid, id, value);
+
+	PG_RETURN_INT64(id);
+}
+
+/*
+ * dict_decode
+ *
+ * Get the value of an id in the given dictionary, or NULL if it isn't there
+ */
+Datum
+dict_decode(PG_FUNCTION_ARGS)
+{
+	Oid relid = PG_GETARG_OID(0);
+	int64 id = PG_GETARG_INT64(1);
+	DictEntry *entry;
+	char *relname;
+	char *value = NULL;
+	Oid argtypes[1] = {INT8OID};
+	Datum args[1];
+	int rc;
+
+	entry = dict_cache_get(relid, id);
+	if (entry)
+		PG_RETURN_TEXT_P(cstring_to_text(entry->value));
+
+	relname = get_dict_name(relid);
+	args[0] = Int64GetDatum(id);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "could not connect to SPI manager");
+
+	rc = SPI_execute_with_args(psprintf("SELECT value FROM %s WHERE id = $1 AND value IS NOT NULL", relname),
+			1, argtypes, args, NULL, true, 1);
+	if (rc != SPI_OK_SELECT)
+		elog(ERROR, "failed to look up id " INT64_FORMAT " in dictionary \"%s\": %s",
+				id, relname, SPI_result_code_string(rc));
+
+	if (SPI_processed > 0)
+	{
+		value = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+		entry = dict_cache_put(relid, id, value);
+	}
+
+	SPI_finish();
+
+	if (entry == NULL)
+		PG_RETURN_NULL();
+
+	PG_RETURN_TEXT_P(cstring_to_text(entry->value));
+}
@@ -15,14 +15,42 @@
 #include "lib/stringinfo.h"
 #include "libpq/pqformat.h"
 #include "nodes/nodeFuncs.h"
+#include "pipeline/distinct.h"
 #include "pipeline/hll.h"
 #include "pipeline/miscutils.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
 #include "utils/hllfuncs.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
 #include "utils/typcache.h"
 
+/* Maximum number of register updates buffered for a transition HLL before they're applied */
+#define HLL_PENDING_ADDS 256
+
+/*
+ * Register updates buffered for a transition HLL, keyed by the HLL. They're applied in one
+ * pass once the buffer is full, or as soon as anything but its transition function reads it.
+ */
+typedef struct HLLPendingAdds
+{
+	HyperLogLog *hll;
+	MemoryContext context;
+	/*
+	 * If a reader applied the updates and that needed a new HLL, this is it. The aggregate
+	 * still refers to the old one, so later readers of the old one are given this instead.
+	 */
+	HyperLogLog *flushed;
+	int n;
+	uint32 updates[HLL_PENDING_ADDS];
+} HLLPendingAdds;
+
+static HTAB *pending_adds = NULL;
+static List *pending_contexts = NIL;
+
+static HyperLogLog *hll_add_datum(FunctionCallInfo fcinfo, HyperLogLog *hll, Datum elem);
+
 Datum
 hll_print(PG_FUNCTION_ARGS)
 {
@@ -70,6 +98,173 @@ hll_startup(FunctionCallInfo fcinfo, int p)
 	return hll;
 }
 
+/*
+ * forget_pending_adds
+ *
+ * Reset callback of a memory context transition HLLs with pending updates were allocated in
+ */
+static void
+forget_pending_adds(void *arg)
+{
+	MemoryContext context = (MemoryContext) arg;
+	HASH_SEQ_STATUS status;
+	HLLPendingAdds *entry;
+
+	pending_contexts = list_delete_ptr(pending_contexts, context);
+
+	hash_seq_init(&status, pending_adds);
+	while ((entry = (HLLPendingAdds *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->context == context)
+			hash_search(pending_adds, &entry->hll, HASH_REMOVE, NULL);
+	}
+}
+
+/*
+ * hll_pending_adds
+ *
+ * Get the buffer of pending register updates for the given transition HLL, which was
+ * allocated in the given aggregate context
+ */
+static HLLPendingAdds *
+hll_pending_adds(HyperLogLog *hll, MemoryContext context)
+{
+	HLLPendingAdds *entry;
+	bool found;
+
+	if (pending_adds == NULL)
+	{
+		HASHCTL ctl;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(HyperLogLog *);
+		ctl.entrysize = sizeof(HLLPendingAdds);
+		ctl.hcxt = TopMemoryContext;
+
+		pending_adds = hash_create("HLLPendingAdds", 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	entry = (HLLPendingAdds *) hash_search(pending_adds, &hll, HASH_ENTER, &found);
+	if (found)
+		return entry;
+
+	entry->context = context;
+	entry->flushed = NULL;
+	entry->n = 0;
+
+	/* The buffers go away with the HLLs they belong to */
+	if (!list_member_ptr(pending_contexts, context))
+	{
+		MemoryContextCallback *cb = MemoryContextAlloc(context, sizeof(MemoryContextCallback));
+		MemoryContext old = MemoryContextSwitchTo(TopMemoryContext);
+
+		cb->func = forget_pending_adds;
+		cb->arg = context;
+		MemoryContextRegisterResetCallback(context, cb);
+
+		pending_contexts = lappend(pending_contexts, context);
+		MemoryContextSwitchTo(old);
+	}
+
+	return entry;
+}
+
+/*
+ * apply_pending_adds
+ */
+static HyperLogLog *
+apply_pending_adds(HLLPendingAdds *entry)
+{
+	MemoryContext old = MemoryContextSwitchTo(entry->context);
+	HyperLogLog *hll;
+	int result;
+
+	hll = HLLAddMany(entry->hll, entry->updates, entry->n, &result);
+	entry->n = 0;
+
+	MemoryContextSwitchTo(old);
+
+	return hll;
+}
+
+/*
+ * HLLFlushPendingAdds
+ *
+ * Apply any register updates buffered for the given transition HLL, returning the updated HLL.
+ * Anything that reads a transition HLL other than its transition function must call this first.
+ */
+HyperLogLog *
+HLLFlushPendingAdds(HyperLogLog *hll)
+{
+	HLLPendingAdds *entry;
+	HyperLogLog *result;
+
+	if (pending_adds == NULL)
+		return hll;
+
+	entry = (HLLPendingAdds *) hash_search(pending_adds, &hll, HASH_FIND, NULL);
+	if (entry == NULL)
+		return hll;
+
+	if (entry->flushed)
+		return entry->flushed;
+
+	result = apply_pending_adds(entry);
+
+	if (result == hll)
+		hash_search(pending_adds, &hll, HASH_REMOVE, NULL);
+	else
+		entry->flushed = result;
+
+	return result;
+}
+
+/*
+ * HLLAggAdd
+ *
+ * Add the given element to a transition HLL that was allocated in the given aggregate context.
+ * Rather than rewriting the HLL for each element, its register update is buffered and the
+ * buffer is applied in one pass by HLLFlushPendingAdds. Window aggregates read their state
+ * between transitions without any final function to flush it, so their elements are added
+ * right away.
+ */
+HyperLogLog *
+HLLAggAdd(FunctionCallInfo fcinfo, MemoryContext context, HyperLogLog *hll, Datum elem)
+{
+	TypeCacheEntry *typ = (TypeCacheEntry *) fcinfo->flinfo->fn_extra;
+	HLLPendingAdds *entry;
+	StringInfoData buf;
+
+	if (AggCheckCallContext(fcinfo, NULL) != AGG_CONTEXT_AGGREGATE)
+		return hll_add_datum(fcinfo, hll, elem);
+
+	initStringInfo(&buf);
+	DatumToBytes(elem, typ, &buf);
+
+	entry = hll_pending_adds(hll, context);
+
+	/* A reader has already moved this HLL's updates to a new one, so carry on with that */
+	if (entry->flushed)
+	{
+		hll = entry->flushed;
+		hash_search(pending_adds, &entry->hll, HASH_REMOVE, NULL);
+		entry = hll_pending_adds(hll, context);
+	}
+
+	entry->updates[entry->n++] = HLLRegisterUpdate(hll->p, buf.data, buf.len);
+
+	pfree(buf.data);
+
+	/* We return the updated HLL to the aggregate, which forgets about the old one */
+	if (entry->n == HLL_PENDING_ADDS)
+	{
+		hll = apply_pending_adds(entry);
+		hash_search(pending_adds, &entry->hll, HASH_REMOVE, NULL);
+	}
+
+	return hll;
+}
+
 static HyperLogLog *
 hll_add_datum(FunctionCallInfo fcinfo, HyperLogLog *hll, Datum elem)
 {
@@ -109,7 +304,7 @@ hll_agg_trans(PG_FUNCTION_ARGS)
 		state = (HyperLogLog *) PG_GETARG_VARLENA_P(0);
 
 	if (!PG_ARGISNULL(1))
-		state = hll_add_datum(fcinfo, state, PG_GETARG_DATUM(1));
+		state = HLLAggAdd(fcinfo, context, state, PG_GETARG_DATUM(1));
 
 	MemoryContextSwitchTo(old);
 
@@ -140,7 +335,7 @@ hll_agg_transp(PG_FUNCTION_ARGS)
 		state = (HyperLogLog *) PG_GETARG_VARLENA_P(0);
 
 	if (!PG_ARGISNULL(1))
-		state = hll_add_datum(fcinfo, state, PG_GETARG_DATUM(1));
+		state = HLLAggAdd(fcinfo, context, state, PG_GETARG_DATUM(1));
 
 	MemoryContextSwitchTo(old);
 
@@ -211,7 +406,7 @@ hll_cache_cardinality(PG_FUNCTION_ARGS)
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
-	hll = (HyperLogLog *) PG_GETARG_VARLENA_P(0);
+	hll = HLLFlushPendingAdds((HyperLogLog *) PG_GETARG_VARLENA_P(0));
 	/* Calling this will cache the cardinality */
 	HLLCardinality(hll);
 
@@ -251,3 +446,122 @@ hll_add(PG_FUNCTION_ARGS)
 	hll = hll_add_datum(fcinfo, hll, PG_GETARG_DATUM(1));
 	PG_RETURN_POINTER(hll);
 }
+
+static struct varlena *
+hybrid_count_distinct_startup(FunctionCallInfo fcinfo, int threshold)
+{
+	Oid type = AggGetInitialArgType(fcinfo);
+	MemoryContext old;
+
+	if (threshold < 0 || threshold > DISTINCT_MAX_THRESHOLD)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("threshold must be in [0, %d]", DISTINCT_MAX_THRESHOLD)));
+
+	old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	fcinfo->flinfo->fn_extra = lookup_type_cache(type, 0);
+	MemoryContextSwitchTo(old);
+
+	return (struct varlena *) DistinctSetCreate(threshold);
+}
+
+static struct varlena *
+hybrid_count_distinct_add(FunctionCallInfo fcinfo, struct varlena *state, Datum elem)
+{
+	TypeCacheEntry *typ = (TypeCacheEntry *) fcinfo->flinfo->fn_extra;
+	StringInfoData buf;
+
+	initStringInfo(&buf);
+	DatumToBytes(elem, typ, &buf);
+	state = DistinctAdd(state, buf.data, buf.len);
+	pfree(buf.data);
+
+	return state;
+}
+
+/*
+ * hybrid_count_distinct transition function -
+ *
+ * 	adds the given element to the transition state, which counts distinct elements exactly
+ * 	until it has seen threshold of them and then becomes an HLL
+ */
+static Datum
+hybrid_count_distinct_trans_internal(FunctionCallInfo fcinfo, int threshold)
+{
+	MemoryContext old;
+	MemoryContext context;
+	struct varlena *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "hybrid_count_distinct_trans called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = hybrid_count_distinct_startup(fcinfo, threshold);
+	else
+		state = PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = hybrid_count_distinct_add(fcinfo, state, PG_GETARG_DATUM(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+hybrid_count_distinct_trans(PG_FUNCTION_ARGS)
+{
+	return hybrid_count_distinct_trans_internal(fcinfo, DISTINCT_DEFAULT_THRESHOLD);
+}
+
+Datum
+hybrid_count_distinct_transp(PG_FUNCTION_ARGS)
+{
+	return hybrid_count_distinct_trans_internal(fcinfo, PG_GETARG_INT32(2));
+}
+
+/*
+ * hybrid_count_distinct combine function -
+ *
+ * 	returns the union of the given states, whether they're exact or approximate
+ */
+Datum
+hybrid_count_distinct_combine(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	struct varlena *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "hybrid_count_distinct_combine called in non-aggregate context");
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = DistinctCopy(PG_GETARG_VARLENA_P(1));
+	else if (PG_ARGISNULL(1))
+		state = PG_GETARG_VARLENA_P(0);
+	else
+		state = DistinctMerge(PG_GETARG_VARLENA_P(0), PG_GETARG_VARLENA_P(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Returns the number of distinct elements counted by the given state
+ */
+Datum
+hybrid_count_distinct_final(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT64(0);
+
+	PG_RETURN_INT64(DistinctCount(PG_GETARG_VARLENA_P(0)));
+}
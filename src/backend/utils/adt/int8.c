@@ -25,6 +25,7 @@
 #include "utils/datum.h"
 #include "utils/int8.h"
 #include "utils/builtins.h"
+#include "utils/hllfuncs.h"
 #include "utils/typcache.h"
 
 #define MAXINT8LEN		25
@@ -1565,7 +1566,6 @@ hll_count_distinct_transition(PG_FUNCTION_ARGS)
 	MemoryContext old;
 	MemoryContext context;
 	HyperLogLog *hll;
-	int result;
 
 	if (!AggCheckCallContext(fcinfo, &context))
 			elog(ERROR, "aggregate function called in non-aggregate context");
@@ -1578,18 +1578,7 @@ hll_count_distinct_transition(PG_FUNCTION_ARGS)
 		hll = (HyperLogLog *) PG_GETARG_VARLENA_P(0);
 
 	if (!PG_ARGISNULL(1))
-	{
-		StringInfo buf = makeStringInfo();
-		TypeCacheEntry *typ = (TypeCacheEntry *) fcinfo->flinfo->fn_extra;
-
-		DatumToBytes(PG_GETARG_DATUM(1), typ, buf);
-
-		hll = HLLAdd(hll, buf->data, buf->len, &result);
-		SET_VARSIZE(hll, HLLSize(hll));
-
-		pfree(buf->data);
-		pfree(buf);
-	}
+		hll = HLLAggAdd(fcinfo, context, hll, PG_GETARG_DATUM(1));
 
 	MemoryContextSwitchTo(old);
 
@@ -1607,7 +1596,7 @@ hll_count_distinct_final(PG_FUNCTION_ARGS)
 	if (PG_ARGISNULL(0))
 		PG_RETURN_INT64(0);
 
-	hll = (HyperLogLog *) PG_GETARG_VARLENA_P(0);
+	hll = HLLFlushPendingAdds((HyperLogLog *) PG_GETARG_VARLENA_P(0));
 
 	PG_RETURN_INT64(HLLCardinality(hll));
 }
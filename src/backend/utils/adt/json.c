@@ -70,6 +70,7 @@ typedef enum					/* type categories for datum_to_json */
 
 typedef struct JsonAggState
 {
+	bytea	   *base;			/* deserialized prefix of str, or NULL */
 	StringInfo	str;
 	JsonTypeCategory key_category;
 	Oid			key_output_func;
@@ -107,6 +108,8 @@ static void datum_to_json(Datum val, bool is_null, StringInfo result,
 static void add_json(Datum val, bool is_null, StringInfo result,
 		 Oid val_type, bool key_scalar);
 static text *catenate_stringinfo_string(StringInfo buffer, const char *addon);
+static void append_json_agg_state(StringInfo dst, JsonAggState *state, int skip);
+static text *catenate_json_agg_state(JsonAggState *state, const char *addon);
 
 /* the null action object used for pure validation */
 static JsonSemAction nullSemAction =
@@ -1902,6 +1905,7 @@ json_agg_transfn(PG_FUNCTION_ARGS)
 		 */
 		oldcontext = MemoryContextSwitchTo(aggcontext);
 		state = (JsonAggState *) palloc(sizeof(JsonAggState));
+		state->base = NULL;
 		state->str = makeStringInfo();
 		MemoryContextSwitchTo(oldcontext);
 
@@ -1961,7 +1965,7 @@ json_agg_finalfn(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();
 
 	/* Else return state with appropriate array terminator added */
-	PG_RETURN_TEXT_P(catenate_stringinfo_string(state->str, "]"));
+	PG_RETURN_TEXT_P(catenate_json_agg_state(state, "]"));
 }
 
 /*
@@ -1995,6 +1999,7 @@ json_object_agg_transfn(PG_FUNCTION_ARGS)
 		 */
 		oldcontext = MemoryContextSwitchTo(aggcontext);
 		state = (JsonAggState *) palloc(sizeof(JsonAggState));
+		state->base = NULL;
 		state->str = makeStringInfo();
 		MemoryContextSwitchTo(oldcontext);
 
@@ -2073,7 +2078,7 @@ json_object_agg_finalfn(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();
 
 	/* Else return state with appropriate object terminator added */
-	PG_RETURN_TEXT_P(catenate_stringinfo_string(state->str, " }"));
+	PG_RETURN_TEXT_P(catenate_json_agg_state(state, " }"));
 }
 
 /*
@@ -2103,6 +2108,7 @@ json_agg_combine(PG_FUNCTION_ARGS)
 		 */
 		oldcontext = MemoryContextSwitchTo(aggcontext);
 		state = (JsonAggState *) palloc(sizeof(JsonAggState));
+		state->base = NULL;
 		state->str = makeStringInfo();
 		MemoryContextSwitchTo(oldcontext);
 
@@ -2119,8 +2125,7 @@ json_agg_combine(PG_FUNCTION_ARGS)
 		incoming = (JsonAggState *) PG_GETARG_POINTER(1);
 
 		/* skip the '[' in the beginning */
-		Assert(incoming->str->data[0] == '[');
-		appendBinaryStringInfo(state->str, incoming->str->data + 1, incoming->str->len - 1);
+		append_json_agg_state(state->str, incoming, 1);
 	}
 
 	PG_RETURN_POINTER(state);
@@ -2153,6 +2158,7 @@ json_object_agg_combine(PG_FUNCTION_ARGS)
 		 */
 		oldcontext = MemoryContextSwitchTo(aggcontext);
 		state = (JsonAggState *) palloc(sizeof(JsonAggState));
+		state->base = NULL;
 		state->str = makeStringInfo();
 		MemoryContextSwitchTo(oldcontext);
 
@@ -2169,8 +2175,7 @@ json_object_agg_combine(PG_FUNCTION_ARGS)
 		incoming = (JsonAggState *) PG_GETARG_POINTER(1);
 
 		/* skip the '{' in the beginning */
-		Assert(incoming->str->data[0] == '{');
-		appendBinaryStringInfo(state->str, incoming->str->data + 1, incoming->str->len - 1);
+		append_json_agg_state(state->str, incoming, 1);
 	}
 
 	PG_RETURN_POINTER(state);
@@ -2180,24 +2185,24 @@ Datum
 jsonaggstatesend(PG_FUNCTION_ARGS)
 {
 	JsonAggState *state = PG_ARGISNULL(0) ? NULL : (JsonAggState *) PG_GETARG_POINTER(0);
-	bytea *result;
 
 	if (!state)
 		PG_RETURN_NULL();
 
-	result = (bytea *) palloc0(state->str->len + VARHDRSZ);
-	SET_VARSIZE(result, state->str->len + VARHDRSZ);
-	memcpy(VARDATA(result), state->str->data, state->str->len);
-
-	PG_RETURN_BYTEA_P(result);
+	PG_RETURN_BYTEA_P(catenate_json_agg_state(state, ""));
 }
 
+/*
+ * The serialized state isn't copied into the StringInfo: it's kept as an
+ * immutable base that everything combined into the state is appended after,
+ * so that combines only ever touch the incoming values and the whole state
+ * is assembled once, when it's serialized or finalized.
+ */
 Datum
 jsonaggstaterecv(PG_FUNCTION_ARGS)
 {
 	MemoryContext context;
 	MemoryContext old;
-	bytea *bytes;
 	JsonAggState *result;
 
 	if (PG_ARGISNULL(0))
@@ -2206,19 +2211,64 @@ jsonaggstaterecv(PG_FUNCTION_ARGS)
 	if (!AggCheckCallContext(fcinfo, &context))
 		context = fcinfo->flinfo->fn_mcxt;
 
-	bytes = PG_GETARG_BYTEA_PP(0);
-
 	old = MemoryContextSwitchTo(context);
 
 	result = palloc0(sizeof(JsonAggState));
+	result->base = PG_GETARG_BYTEA_P_COPY(0);
 	result->str = makeStringInfo();
-	appendBinaryStringInfo(result->str, VARDATA_ANY(bytes), VARSIZE_ANY_EXHDR(bytes));
 
 	MemoryContextSwitchTo(old);
 
 	PG_RETURN_POINTER(result);
 }
 
+/*
+ * Append the contents of a json_agg or json_object_agg state to a StringInfo,
+ * skipping its first skip bytes
+ */
+static void
+append_json_agg_state(StringInfo dst, JsonAggState *state, int skip)
+{
+	if (state->base)
+	{
+		Assert(VARSIZE(state->base) - VARHDRSZ >= skip);
+		appendBinaryStringInfo(dst, VARDATA(state->base) + skip,
+							   VARSIZE(state->base) - VARHDRSZ - skip);
+		skip = 0;
+	}
+
+	Assert(state->str->len >= skip);
+	appendBinaryStringInfo(dst, state->str->data + skip, state->str->len - skip);
+}
+
+/*
+ * Like catenate_stringinfo_string, but for the base and appended contents of
+ * an aggregate state
+ */
+static text *
+catenate_json_agg_state(JsonAggState *state, const char *addon)
+{
+	int			baselen = state->base ? VARSIZE(state->base) - VARHDRSZ : 0;
+	int			addlen = strlen(addon);
+	text	   *result;
+	char	   *pos;
+
+	if (!state->base)
+		return catenate_stringinfo_string(state->str, addon);
+
+	result = (text *) palloc(baselen + state->str->len + addlen + VARHDRSZ);
+	SET_VARSIZE(result, baselen + state->str->len + addlen + VARHDRSZ);
+
+	pos = VARDATA(result);
+	memcpy(pos, VARDATA(state->base), baselen);
+	pos += baselen;
+	memcpy(pos, state->str->data, state->str->len);
+	pos += state->str->len;
+	memcpy(pos, addon, addlen);
+
+	return result;
+}
+
 /*
  * Helper function for aggregates: return given StringInfo's contents plus
  * specified trailing string, as a text datum.  We need this because aggregate
@@ -0,0 +1,251 @@
+/*-------------------------------------------------------------------------
+ *
+ * kllfuncs.c
+ *		KLL sketch functions
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/kllfuncs.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+#include "pipeline/kll.h"
+#include "utils/builtins.h"
+#include "utils/kllfuncs.h"
+
+Datum
+kll_print(PG_FUNCTION_ARGS)
+{
+	StringInfoData buf;
+	KLL *s;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	s = (KLL *) PG_GETARG_VARLENA_P(0);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "{ count = %ld, k = %d, levels = %d, items = %d, size = %dkB }",
+			s->count, s->k, s->num_levels, s->capacity - s->levels[0], (int) KLLSize(s) / 1024);
+
+	PG_RETURN_TEXT_P(CStringGetTextDatum(buf.data));
+}
+
+static KLL *
+kll_create(int32 k)
+{
+	if (k < 1 || k > PG_UINT16_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("k must be between 1 and %d", PG_UINT16_MAX)));
+	return KLLCreateWithK(k);
+}
+
+static KLL *
+kll_startup(FunctionCallInfo fcinfo, int32 k)
+{
+	KLL *s;
+
+	if (k)
+		s = kll_create(k);
+	else
+		s = KLLCreate();
+
+	return s;
+}
+
+/*
+ * kll_agg transition function -
+ * 	adds the given element to the transition KLL sketch
+ */
+Datum
+kll_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	KLL *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "kll_agg_trans called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = kll_startup(fcinfo, 0);
+	else
+		state = (KLL *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = KLLAdd(state, PG_GETARG_FLOAT8(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * kll_agg transition function -
+ *
+ * 	adds the given element to the transition kll using the given value for k
+ */
+Datum
+kll_agg_transp(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	KLL *state;
+	int32 k = PG_GETARG_INT32(2);
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "kll_agg_trans called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = kll_startup(fcinfo, k);
+	else
+		state = (KLL *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = KLLAdd(state, PG_GETARG_FLOAT8(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * kll_merge_agg transition function -
+ *
+ * 	returns the union of the transition state and the given KLL sketch
+ */
+Datum
+kll_merge_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	KLL *state;
+	KLL *incoming;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "kll_merge_agg_trans called in non-aggregate context");
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+	{
+		incoming = (KLL *) PG_GETARG_VARLENA_P(1);
+		state = KLLCopy(incoming);
+	}
+	else if (PG_ARGISNULL(1))
+		state = (KLL *) PG_GETARG_VARLENA_P(0);
+	else
+	{
+		state = (KLL *) PG_GETARG_VARLENA_P(0);
+		incoming = (KLL *) PG_GETARG_VARLENA_P(1);
+		state = KLLMerge(state, incoming);
+	}
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * kll_quantile
+ */
+Datum
+kll_quantile(PG_FUNCTION_ARGS)
+{
+	KLL *s;
+	float8 q;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	s = (KLL *) PG_GETARG_VARLENA_P(0);
+	q = PG_GETARG_FLOAT8(1);
+
+	if (s->count == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(KLLQuantile(s, q));
+}
+
+/*
+ * kll_cdf
+ */
+Datum
+kll_cdf(PG_FUNCTION_ARGS)
+{
+	KLL *s;
+	float8 x;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	s = (KLL *) PG_GETARG_VARLENA_P(0);
+	x = PG_GETARG_FLOAT8(1);
+
+	if (s->count == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(KLLCDF(s, x));
+}
+
+Datum
+kll_empty(PG_FUNCTION_ARGS)
+{
+	KLL *s = KLLCreate();
+	PG_RETURN_POINTER(s);
+}
+
+Datum
+kll_emptyp(PG_FUNCTION_ARGS)
+{
+	int32 k = PG_GETARG_INT32(0);
+	KLL *s = kll_create(k);
+	PG_RETURN_POINTER(s);
+}
+
+Datum
+kll_add(PG_FUNCTION_ARGS)
+{
+	KLL *s;
+
+	if (PG_ARGISNULL(0))
+		s = KLLCreate();
+	else
+		s = (KLL *) PG_GETARG_VARLENA_P(0);
+
+	s = KLLAdd(s, PG_GETARG_FLOAT8(1));
+	PG_RETURN_POINTER(s);
+}
+
+Datum
+kll_addn(PG_FUNCTION_ARGS)
+{
+	KLL *s;
+	int32 n = PG_GETARG_INT32(2);
+
+	if (n < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("n must be non-negative")));
+
+	if (PG_ARGISNULL(0))
+		s = KLLCreate();
+	else
+		s = (KLL *) PG_GETARG_VARLENA_P(0);
+
+	for (; n > 0; n--)
+		s = KLLAdd(s, PG_GETARG_FLOAT8(1));
+	PG_RETURN_POINTER(s);
+}
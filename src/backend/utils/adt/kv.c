@@ -13,14 +13,42 @@
 #include "utils/datum.h"
 #include "utils/builtins.h"
 #include "utils/kv.h"
+#include "utils/sortsupport.h"
 #include "utils/typcache.h"
 
 typedef struct KeyedAggState
 {
 	TypeCacheEntry *key_type;
 	TypeCacheEntry *value_type;
+	/* keys are compared with this so that types with a fast comparator skip fmgr */
+	SortSupportData sortkey;
+	/* true if both the key and the value are passed by value, so they're replaced in place */
+	bool byval;
 } KeyedAggState;
 
+/*
+ * create_keyed_agg_state
+ */
+static KeyedAggState *
+create_keyed_agg_state(Oid key_type, Oid value_type, Oid collation)
+{
+	KeyedAggState *state = palloc0(sizeof(KeyedAggState));
+
+	state->key_type = lookup_type_cache(key_type, TYPECACHE_LT_OPR | TYPECACHE_CMP_PROC_FINFO);
+
+	if (!OidIsValid(state->key_type->cmp_proc) || !OidIsValid(state->key_type->lt_opr))
+		elog(ERROR, "could not determine key type");
+
+	state->value_type = lookup_type_cache(value_type, 0);
+	state->byval = state->key_type->typbyval && state->value_type->typbyval;
+
+	state->sortkey.ssup_cxt = CurrentMemoryContext;
+	state->sortkey.ssup_collation = collation;
+	PrepareSortSupportFromOrderingOp(state->key_type->lt_opr, &state->sortkey);
+
+	return state;
+}
+
 /*
  * point_to_self
  */
@@ -63,28 +91,17 @@ copy_kv(KeyedAggState *state, KeyValue *kv)
  * compare_keys
  */
 static int
-compare_keys(KeyedAggState *state, KeyValue *kv, Datum incoming, bool incoming_null, Oid collation, bool *result_null)
+compare_keys(KeyedAggState *state, KeyValue *kv, Datum incoming, bool incoming_null, bool *result_null)
 {
-	TypeCacheEntry *type = state->key_type;
-	FunctionCallInfoData cmp_fcinfo;
-	int result;
-
 	if (incoming_null || KV_KEY_IS_NULL(kv))
 	{
 		*result_null = true;
 		return 0;
 	}
 
-	InitFunctionCallInfoData(cmp_fcinfo, &type->cmp_proc_finfo, 2, collation, NULL, NULL);
-	cmp_fcinfo.arg[0] = kv->key;
-	cmp_fcinfo.argnull[0] = KV_KEY_IS_NULL(kv);
-	cmp_fcinfo.arg[1] = incoming;
-	cmp_fcinfo.argnull[1] = incoming_null;
+	*result_null = false;
 
-	result = DatumGetInt32(FunctionCallInvoke(&cmp_fcinfo));
-	*result_null = cmp_fcinfo.isnull;
-
-	return result;
+	return ApplySortComparator(kv->key, false, incoming, false, &state->sortkey);
 }
 
 /*
@@ -111,6 +128,7 @@ set_kv(KeyedAggState *state, KeyValue *kv, Datum key, bool key_null, Datum value
 	else if (VARSIZE(kv) != new_size)
 		kv = repalloc(kv, new_size);
 
+	kv->flags = 0;
 	kv->klen = klen;
 	kv->vlen = vlen;
 
@@ -172,7 +190,8 @@ keyed_trans_startup(FunctionCallInfo fcinfo)
 	List *args = NIL;
 	KeyedAggState *state;
 	Node *node;
-	Oid type;
+	Oid key_type;
+	Oid value_type;
 	MemoryContext old;
 	KeyValue *result;
 
@@ -183,22 +202,21 @@ keyed_trans_startup(FunctionCallInfo fcinfo)
 	else
 		elog(ERROR, "fcinfo must be an aggregate function call");
 
-	node = linitial(args);
-	type = IsA(node, TargetEntry) ? exprType((Node *) ((TargetEntry *) node)->expr) : exprType(node);
-
-	old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-	state = palloc0(sizeof(KeyedAggState));
-	state->key_type = lookup_type_cache(type, TYPECACHE_CMP_PROC_FINFO);
-
-	if (!OidIsValid(state->key_type->cmp_proc))
-		elog(ERROR, "could not determine key type");
+	/* the key and value types are the same for every group, so this only needs to be done once */
+	state = (KeyedAggState *) fcinfo->flinfo->fn_extra;
+	if (state == NULL)
+	{
+		node = linitial(args);
+		key_type = IsA(node, TargetEntry) ? exprType((Node *) ((TargetEntry *) node)->expr) : exprType(node);
 
-	node = lsecond(args);
-	type = IsA(node, TargetEntry) ? exprType((Node *) ((TargetEntry *) node)->expr) : exprType(node);
+		node = lsecond(args);
+		value_type = IsA(node, TargetEntry) ? exprType((Node *) ((TargetEntry *) node)->expr) : exprType(node);
 
-	state->value_type = lookup_type_cache(type, 0);
-	fcinfo->flinfo->fn_extra = state;
-	MemoryContextSwitchTo(old);
+		old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+		state = create_keyed_agg_state(key_type, value_type, PG_GET_COLLATION());
+		fcinfo->flinfo->fn_extra = state;
+		MemoryContextSwitchTo(old);
+	}
 
 	result = set_kv(state, NULL, PG_GETARG_DATUM(1), PG_ARGISNULL(1), PG_GETARG_DATUM(2), PG_ARGISNULL(2));
 	result->key_type = state->key_type->type_id;
@@ -238,15 +256,27 @@ keyed_min_max_trans_internal(FunctionCallInfo fcinfo, int sign)
 	state = (KeyedAggState *) fcinfo->flinfo->fn_extra;
 	kv = point_to_self(state, PG_GETARG_BYTEA_P(0));
 
-	cmp = sign * compare_keys(state, kv, incoming_key,
-			PG_ARGISNULL(1), PG_GET_COLLATION(), &isnull);
+	cmp = sign * compare_keys(state, kv, incoming_key, PG_ARGISNULL(1), &isnull);
 
 	if (!isnull && cmp <= 0)
-		kv = set_kv(state, kv, incoming_key, PG_ARGISNULL(1), incoming_value, PG_ARGISNULL(2));
+	{
+		/*
+		 * The incoming key isn't NULL here, so if neither datum needs any space of its own the
+		 * state's size doesn't change and they can just be overwritten. Otherwise set_kv only
+		 * reallocates the state when the new datums need a different size.
+		 */
+		if (state->byval)
+		{
+			kv->key = incoming_key;
+			kv->value = incoming_value;
+			kv->flags = PG_ARGISNULL(2) ? KV_VALUE_NULL : 0;
+		}
+		else
+			kv = set_kv(state, kv, incoming_key, false, incoming_value, PG_ARGISNULL(2));
+	}
 
 	MemoryContextSwitchTo(old);
 
-
 	PG_RETURN_POINTER(kv);
 }
 
@@ -273,12 +303,14 @@ keyed_min_max_combine_internal(FunctionCallInfo fcinfo, int sign)
 		 * We can't use the startup function that the aggregate uses because
 		 * the combiner Aggref doesn't have all of the original arguments.
 		 */
-		old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-		kas = palloc0(sizeof(KeyedAggState));
-		kas->key_type = lookup_type_cache(incoming->key_type, TYPECACHE_CMP_PROC_FINFO);
-		kas->value_type = lookup_type_cache(incoming->value_type, 0);
-		fcinfo->flinfo->fn_extra = kas;
-		MemoryContextSwitchTo(old);
+		kas = (KeyedAggState *) fcinfo->flinfo->fn_extra;
+		if (kas == NULL)
+		{
+			old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+			kas = create_keyed_agg_state(incoming->key_type, incoming->value_type, incoming->key_collation);
+			fcinfo->flinfo->fn_extra = kas;
+			MemoryContextSwitchTo(old);
+		}
 
 		old = MemoryContextSwitchTo(context);
 		state = copy_kv(kas, incoming);
@@ -293,8 +325,7 @@ keyed_min_max_combine_internal(FunctionCallInfo fcinfo, int sign)
 	kas = (KeyedAggState *) fcinfo->flinfo->fn_extra;
 	incoming = point_to_self(kas, (struct varlena *) incoming);
 
-	cmp = sign * compare_keys(kas, state, incoming->key,
-			KV_KEY_IS_NULL(incoming), state->key_collation, &isnull);
+	cmp = sign * compare_keys(kas, state, incoming->key, KV_KEY_IS_NULL(incoming), &isnull);
 
 	if (!isnull && cmp <= 0)
 		state = copy_kv(kas, incoming);
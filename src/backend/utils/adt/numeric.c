@@ -7708,6 +7708,50 @@ int_avg_combine(PG_FUNCTION_ARGS)
 	PG_RETURN_ARRAYTYPE_P(collectarray);
 }
 
+/*
+ * Header of the serialized form of a NumericAggState, which is followed by the digits of
+ * sumX and then those of sumX2. It's only ever read back on the same server, so it's
+ * stored in the server's native layout and byte order.
+ */
+typedef struct NumericAggStatePacked
+{
+	int64		N;
+	int64		maxScaleCount;
+	int64		NaNcount;
+	int			maxScale;
+	bool		calcSumX2;
+	int			sumX_ndigits;
+	int			sumX_weight;
+	int			sumX_sign;
+	int			sumX_dscale;
+	int			sumX2_ndigits;
+	int			sumX2_weight;
+	int			sumX2_sign;
+	int			sumX2_dscale;
+} NumericAggStatePacked;
+
+/*
+ * unpack_var
+ */
+static char *
+unpack_var(NumericVar *var, int ndigits, int weight, int sign, int dscale, char *pos)
+{
+	init_var(var);
+
+	if (ndigits > 0)
+	{
+		alloc_var(var, ndigits);
+		memcpy(var->digits, pos, sizeof(NumericDigit) * ndigits);
+	}
+
+	var->ndigits = ndigits;
+	var->weight = weight;
+	var->sign = sign;
+	var->dscale = dscale;
+
+	return pos + sizeof(NumericDigit) * ndigits;
+}
+
 /*
  * naggstaterecv() -
  *
@@ -7721,10 +7765,8 @@ numaggstaterecv(PG_FUNCTION_ARGS)
 	MemoryContext old;
 	bytea *bytesin;
 	NumericAggState *result;
-	StringInfoData buf;
-	int nbytes;
-	int digitssize;
-	int i;
+	NumericAggStatePacked packed;
+	char *pos;
 
 	if (!AggCheckCallContext(fcinfo, &context))
 		context = fcinfo->flinfo->fn_mcxt;
@@ -7732,36 +7774,31 @@ numaggstaterecv(PG_FUNCTION_ARGS)
 	old = MemoryContextSwitchTo(context);
 
 	bytesin = (bytea *) PG_GETARG_BYTEA_P(0);
-	result = (NumericAggState *) palloc0(sizeof(NumericAggState));
-	nbytes = VARSIZE(bytesin);
 
-	initStringInfo(&buf);
-	appendBinaryStringInfo(&buf, VARDATA(bytesin), nbytes);
+	if (VARSIZE(bytesin) - VARHDRSZ < sizeof(NumericAggStatePacked))
+		elog(ERROR, "invalid numeric aggregate state");
+
+	/* the bytea's data isn't necessarily aligned for the header's int64s */
+	pos = VARDATA(bytesin);
+	memcpy(&packed, pos, sizeof(NumericAggStatePacked));
+	pos += sizeof(NumericAggStatePacked);
+
+	if (VARSIZE(bytesin) - VARHDRSZ != sizeof(NumericAggStatePacked) +
+			sizeof(NumericDigit) * (packed.sumX_ndigits + packed.sumX2_ndigits))
+		elog(ERROR, "invalid numeric aggregate state");
 
+	result = (NumericAggState *) palloc0(sizeof(NumericAggState));
 	result->agg_context = CurrentMemoryContext;
-	result->calcSumX2 = pq_getmsgint(&buf, 1);
-	result->N = pq_getmsgint64(&buf);
-	result->maxScale = pq_getmsgint(&buf, sizeof(int));
-	result->maxScaleCount = pq_getmsgint64(&buf);
-	result->NaNcount = pq_getmsgint64(&buf);
-
-	result->sumX.ndigits = pq_getmsgint(&buf, sizeof(int));
-	result->sumX.weight = pq_getmsgint(&buf, sizeof(int));
-	result->sumX.sign = pq_getmsgint(&buf, sizeof(int));
-	result->sumX.dscale = pq_getmsgint(&buf, sizeof(int));
-	digitssize = result->sumX.ndigits * sizeof(NumericDigit);
-	result->sumX.digits = palloc0(digitssize);
-	for (i=0; i<result->sumX.ndigits; i++)
-		result->sumX.digits[i] = pq_getmsgint(&buf, sizeof(NumericDigit));
-
-	result->sumX2.ndigits = pq_getmsgint(&buf, sizeof(int));
-	result->sumX2.weight = pq_getmsgint(&buf, sizeof(int));
-	result->sumX2.sign = pq_getmsgint(&buf, sizeof(int));
-	result->sumX2.dscale = pq_getmsgint(&buf, sizeof(int));
-	digitssize = result->sumX2.ndigits * sizeof(NumericDigit);
-	result->sumX2.digits = palloc0(digitssize);
-	for (i=0; i<result->sumX2.ndigits; i++)
-		result->sumX2.digits[i] = pq_getmsgint(&buf, sizeof(NumericDigit));
+	result->calcSumX2 = packed.calcSumX2;
+	result->N = packed.N;
+	result->maxScale = packed.maxScale;
+	result->maxScaleCount = packed.maxScaleCount;
+	result->NaNcount = packed.NaNcount;
+
+	pos = unpack_var(&result->sumX, packed.sumX_ndigits, packed.sumX_weight,
+			packed.sumX_sign, packed.sumX_dscale, pos);
+	pos = unpack_var(&result->sumX2, packed.sumX2_ndigits, packed.sumX2_weight,
+			packed.sumX2_sign, packed.sumX2_dscale, pos);
 
 	MemoryContextSwitchTo(old);
 
@@ -7778,49 +7815,73 @@ Datum
 numaggstatesend(PG_FUNCTION_ARGS)
 {
 	NumericAggState *nagg = (NumericAggState *) PG_GETARG_POINTER(0);
-	StringInfoData buf;
+	NumericAggStatePacked packed;
 	bytea *result;
-	int nbytes;
-	int i;
-
-	initStringInfo(&buf);
-
-	pq_sendint(&buf, nagg->calcSumX2, sizeof(bool));
-	pq_sendint64(&buf, nagg->N);
-	pq_sendint(&buf, nagg->maxScale, sizeof(int));
-	pq_sendint64(&buf, nagg->maxScaleCount);
-	pq_sendint64(&buf, nagg->NaNcount);
-
-	pq_sendint(&buf, nagg->sumX.ndigits, sizeof(int));
-	pq_sendint(&buf, nagg->sumX.weight, sizeof(int));
-	pq_sendint(&buf, nagg->sumX.sign, sizeof(int));
-	pq_sendint(&buf, nagg->sumX.dscale, sizeof(int));
-	for (i=0; i<nagg->sumX.ndigits; i++)
-		pq_sendint(&buf,  nagg->sumX.digits[i], sizeof(NumericDigit));
-
-	pq_sendint(&buf, nagg->sumX2.ndigits, sizeof(int));
-	pq_sendint(&buf, nagg->sumX2.weight, sizeof(int));
-	pq_sendint(&buf, nagg->sumX2.sign, sizeof(int));
-	pq_sendint(&buf, nagg->sumX2.dscale, sizeof(int));
-	for (i=0; i<nagg->sumX2.ndigits; i++)
-		pq_sendint(&buf,  nagg->sumX2.digits[i], sizeof(NumericDigit));
-
-	nbytes = buf.len - buf.cursor;
+	Size nbytes;
+	char *pos;
+
+	MemSet(&packed, 0, sizeof(NumericAggStatePacked));
+
+	packed.calcSumX2 = nagg->calcSumX2;
+	packed.N = nagg->N;
+	packed.maxScale = nagg->maxScale;
+	packed.maxScaleCount = nagg->maxScaleCount;
+	packed.NaNcount = nagg->NaNcount;
+
+	packed.sumX_ndigits = nagg->sumX.ndigits;
+	packed.sumX_weight = nagg->sumX.weight;
+	packed.sumX_sign = nagg->sumX.sign;
+	packed.sumX_dscale = nagg->sumX.dscale;
+
+	packed.sumX2_ndigits = nagg->sumX2.ndigits;
+	packed.sumX2_weight = nagg->sumX2.weight;
+	packed.sumX2_sign = nagg->sumX2.sign;
+	packed.sumX2_dscale = nagg->sumX2.dscale;
+
+	nbytes = sizeof(NumericAggStatePacked) +
+		sizeof(NumericDigit) * (nagg->sumX.ndigits + nagg->sumX2.ndigits);
+
 	result = (bytea *) palloc(nbytes + VARHDRSZ);
 	SET_VARSIZE(result, nbytes + VARHDRSZ);
 
-	pq_copymsgbytes(&buf, VARDATA(result), nbytes);
+	pos = VARDATA(result);
+	memcpy(pos, &packed, sizeof(NumericAggStatePacked));
+	pos += sizeof(NumericAggStatePacked);
+
+	if (nagg->sumX.ndigits > 0)
+		memcpy(pos, nagg->sumX.digits, sizeof(NumericDigit) * nagg->sumX.ndigits);
+	pos += sizeof(NumericDigit) * nagg->sumX.ndigits;
+
+	if (nagg->sumX2.ndigits > 0)
+		memcpy(pos, nagg->sumX2.digits, sizeof(NumericDigit) * nagg->sumX2.ndigits);
 
 	PG_RETURN_BYTEA_P(result);
 }
 
+#ifdef HAVE_INT128
+/*
+ * Size of a serialized Int128AggState: calcSumX2, N and sumX, followed by sumX2 only if
+ * calcSumX2 is set. sum and avg never need sumX2, so their states take 25 bytes rather
+ * than the size of the struct.
+ */
+#define INT128_AGG_STATE_SIZE(calcSumX2) \
+	(sizeof(bool) + sizeof(int64) + sizeof(int128) + ((calcSumX2) ? sizeof(int128) : 0))
+#endif
+
+/*
+ * numpolyaggstaterecv() -
+ *
+ *	Input function for 128-bit aggregation states. Their sums can't overflow, since adding
+ *	even 2^63 squares of 32-bit values stays well within 128 bits.
+ */
 Datum
 numpolyaggstaterecv(PG_FUNCTION_ARGS)
 {
 #ifdef HAVE_INT128
-	MemoryContext old;
 	MemoryContext context;
 	Int128AggState *state;
+	bytea *bytes;
+	char *pos;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
@@ -7828,9 +7889,28 @@ numpolyaggstaterecv(PG_FUNCTION_ARGS)
 	if (!AggCheckCallContext(fcinfo, &context))
 		context = fcinfo->flinfo->fn_mcxt;
 
-	old = MemoryContextSwitchTo(context);
-	state = (Int128AggState *) VARDATA_ANY(PG_GETARG_ARRAYTYPE_P_COPY(0));
-	MemoryContextSwitchTo(old);
+	bytes = PG_GETARG_BYTEA_P(0);
+	pos = VARDATA(bytes);
+
+	if (VARSIZE(bytes) - VARHDRSZ < INT128_AGG_STATE_SIZE(false) ||
+			VARSIZE(bytes) - VARHDRSZ != INT128_AGG_STATE_SIZE(*pos))
+		elog(ERROR, "invalid 128-bit aggregate state");
+
+	/*
+	 * The state is copied out field by field, since the bytea's data isn't aligned
+	 * for the int128s
+	 */
+	state = (Int128AggState *) MemoryContextAllocZero(context, sizeof(Int128AggState));
+
+	state->calcSumX2 = *pos;
+	pos += sizeof(bool);
+	memcpy(&state->N, pos, sizeof(int64));
+	pos += sizeof(int64);
+	memcpy(&state->sumX, pos, sizeof(int128));
+	pos += sizeof(int128);
+
+	if (state->calcSumX2)
+		memcpy(&state->sumX2, pos, sizeof(int128));
 
 	PG_RETURN_POINTER(state);
 #else
@@ -7838,19 +7918,37 @@ numpolyaggstaterecv(PG_FUNCTION_ARGS)
 #endif
 }
 
+/*
+ * numpolyaggstatesend() -
+ *
+ *	Output function for 128-bit aggregation states
+ */
 Datum
 numpolyaggstatesend(PG_FUNCTION_ARGS)
 {
 #ifdef HAVE_INT128
 	Int128AggState *state = PG_ARGISNULL(0) ? NULL : (Int128AggState *) PG_GETARG_POINTER(0);
 	bytea *result;
+	Size size;
+	char *pos;
 
 	if (state == NULL)
 		PG_RETURN_NULL();
 
-	result = (bytea *) palloc0(sizeof(Int128AggState) + VARHDRSZ);
-	SET_VARSIZE(result, sizeof(Int128AggState) + VARHDRSZ);
-	memcpy(VARDATA(result), state, sizeof(Int128AggState));
+	size = INT128_AGG_STATE_SIZE(state->calcSumX2);
+	result = (bytea *) palloc(size + VARHDRSZ);
+	SET_VARSIZE(result, size + VARHDRSZ);
+
+	pos = VARDATA(result);
+	*pos = state->calcSumX2;
+	pos += sizeof(bool);
+	memcpy(pos, &state->N, sizeof(int64));
+	pos += sizeof(int64);
+	memcpy(pos, &state->sumX, sizeof(int128));
+	pos += sizeof(int128);
+
+	if (state->calcSumX2)
+		memcpy(pos, &state->sumX2, sizeof(int128));
 
 	PG_RETURN_BYTEA_P(result);
 #else
@@ -1653,12 +1653,9 @@ cq_hypothetical_set_combine_multi(PG_FUNCTION_ARGS)
 	if (!AggCheckCallContext(fcinfo, NULL))
 			elog(ERROR, "aggregate function called in non-aggregate context");
 
+	/* the aggregate copies a new state into its own context, so there's no need to copy it here too */
 	if (PG_ARGISNULL(0))
-	{
-		statearr = (ArrayType *) PG_GETARG_ARRAYTYPE_P_COPY(1);
-
-		PG_RETURN_POINTER(statearr);
-	}
+		PG_RETURN_POINTER(incomingarr);
 
 	statearr = (ArrayType *) PG_GETARG_ARRAYTYPE_P(0);
 	state = (uint64 *) ARR_DATA_PTR(statearr);
@@ -1837,8 +1834,12 @@ cqosastaterecv(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(state);
 }
 
+/*
+ * Set up query-level working state for continuous percentile_cont aggregates, which is the
+ * evaluated direct arguments every group's state is initialized with
+ */
 static CQOSAAggState *
-cq_percentile_cont_float8_startup(PG_FUNCTION_ARGS, bool is_multiple)
+cq_percentile_cont_float8_per_query_startup(PG_FUNCTION_ARGS, bool is_multiple)
 {
 	CQOSAAggState *aggstate;
 	MemoryContext old;
@@ -1858,7 +1859,6 @@ cq_percentile_cont_float8_startup(PG_FUNCTION_ARGS, bool is_multiple)
 	 * aggregates where we can just read the incoming directargs in the final_fn.
 	 */
 	aggstate = palloc0(sizeof(CQOSAAggState));
-	aggstate->tdigest = TDigestCreate();
 	aggstate->is_multiple = is_multiple;
 	/* HACK: nulls_first implies descending */
 	aggstate->is_descending = sortcl->nulls_first;
@@ -1896,6 +1896,7 @@ cq_percentile_cont_float8_startup(PG_FUNCTION_ARGS, bool is_multiple)
 		aggstate->nulls[0] = false;
 	}
 
+	fcinfo->flinfo->fn_extra = (void *) aggstate;
 	MemoryContextSwitchTo(old);
 
 	FreeExprContext(econtext, false);
@@ -1903,6 +1904,26 @@ cq_percentile_cont_float8_startup(PG_FUNCTION_ARGS, bool is_multiple)
 	return aggstate;
 }
 
+/*
+ * Each group's state starts with an empty digest and the query's direct arguments. These are never
+ * modified, so every group created by the same aggregate call shares them.
+ */
+static CQOSAAggState *
+cq_percentile_cont_float8_startup(PG_FUNCTION_ARGS, bool is_multiple)
+{
+	CQOSAAggState *qstate = (CQOSAAggState *) fcinfo->flinfo->fn_extra;
+	CQOSAAggState *aggstate;
+
+	if (qstate == NULL)
+		qstate = cq_percentile_cont_float8_per_query_startup(fcinfo, is_multiple);
+
+	aggstate = palloc(sizeof(CQOSAAggState));
+	memcpy(aggstate, qstate, sizeof(CQOSAAggState));
+	aggstate->tdigest = TDigestCreate();
+
+	return aggstate;
+}
+
 /*
  * Transition function for percentile_cont aggregates with a single
  * numeric column. It uses t-digest to estimate quantiles.
@@ -1992,7 +2013,10 @@ cq_percentile_cont_float8_final(PG_FUNCTION_ARGS)
 {
 	CQOSAAggState *state;
 	float8 percentile;
+	float8 *percentiles;
+	float8 *results;
 	int i;
+	int n = 0;
 	Datum *result_datum;
 
 	/* If there were no regular rows, the result is NULL */
@@ -2015,6 +2039,8 @@ cq_percentile_cont_float8_final(PG_FUNCTION_ARGS)
 	}
 
 	result_datum = (Datum *) palloc(state->num_percentiles * sizeof(Datum));
+	percentiles = (float8 *) palloc(state->num_percentiles * sizeof(float8));
+	results = (float8 *) palloc(state->num_percentiles * sizeof(float8));
 
 	for (i = 0; i < state->num_percentiles; i++)
 	{
@@ -2032,7 +2058,16 @@ cq_percentile_cont_float8_final(PG_FUNCTION_ARGS)
 		if (state->nulls[i])
 			continue;
 
-		result_datum[i] = Float8GetDatum(TDigestQuantile(state->tdigest, percentile));
+		percentiles[n++] = percentile;
+	}
+
+	/* all of the percentiles are estimated in one pass over the digest */
+	TDigestQuantiles(state->tdigest, percentiles, n, results);
+
+	for (i = 0, n = 0; i < state->num_percentiles; i++)
+	{
+		if (!state->nulls[i])
+			result_datum[i] = Float8GetDatum(results[n++]);
 	}
 
 	if (state->is_multiple)
@@ -2150,6 +2185,9 @@ first_values_recv(PG_FUNCTION_ARGS)
 		fcinfo->arg[0] = PointerGetDatum(pos);
 		state->array = (ArrayBuildState *) DatumGetPointer(arrayaggstaterecv(fcinfo));
 		fcinfo->arg[0] = PointerGetDatum(bytes);
+
+		/* combining and finalizing first values work on all of the values directly */
+		expandArrayAggState(state->array);
 	}
 
 	MemoryContextSwitchTo(old);
@@ -2387,9 +2425,10 @@ static int
 compare_values(FirstValuesQueryState *qstate, Datum d1, bool isnull1, Datum d2, bool isnull2)
 {
 	int i;
-	HeapTuple tup1;
-	HeapTuple tup2;
+	HeapTupleData tup1;
+	HeapTupleData tup2;
 	int natts;
+	int result = 0;
 
 	if (qstate->num_sort == 1)
 		return ApplySortComparator(d1, isnull1, d2, isnull2, qstate->sortkey);
@@ -2398,20 +2437,18 @@ compare_values(FirstValuesQueryState *qstate, Datum d1, bool isnull1, Datum d2,
 
 	natts = qstate->tup_desc->natts;
 
-	tup1 = palloc0(sizeof(HeapTupleData));
-	tup1->t_data = DatumGetHeapTupleHeader(d1);
-	tup1->t_len = HeapTupleHeaderGetDatumLength(tup1->t_data);
+	tup1.t_data = DatumGetHeapTupleHeader(d1);
+	tup1.t_len = HeapTupleHeaderGetDatumLength(tup1.t_data);
 
-	tup2 = palloc0(sizeof(HeapTupleData));
-	tup2->t_data = DatumGetHeapTupleHeader(d2);
-	tup2->t_len = HeapTupleHeaderGetDatumLength(tup1->t_data);
+	tup2.t_data = DatumGetHeapTupleHeader(d2);
+	tup2.t_len = HeapTupleHeaderGetDatumLength(tup2.t_data);
 
 	ExecClearTuple(qstate->tup_slot1);
-	ExecStoreTuple(tup1, qstate->tup_slot1, InvalidBuffer, false);
+	ExecStoreTuple(&tup1, qstate->tup_slot1, InvalidBuffer, false);
 	ExecClearTuple(qstate->tup_slot2);
-	ExecStoreTuple(tup2, qstate->tup_slot2, InvalidBuffer, false);
+	ExecStoreTuple(&tup2, qstate->tup_slot2, InvalidBuffer, false);
 
-	for (i = 0; i < natts; i++)
+	for (i = 0; i < natts && result == 0; i++)
 	{
 		bool n0;
 		bool n1;
@@ -2419,19 +2456,135 @@ compare_values(FirstValuesQueryState *qstate, Datum d1, bool isnull1, Datum d2,
 		Datum d1 = slot_getattr(qstate->tup_slot2, i + 1, &n1);
 		SortSupport sortkey = qstate->sortkey + i;
 
-		int result = ApplySortComparator(d0, n0, d1, n1, sortkey);
+		result = ApplySortComparator(d0, n0, d1, n1, sortkey);
+	}
+
+	ExecClearTuple(qstate->tup_slot1);
+	ExecClearTuple(qstate->tup_slot2);
+
+	return result;
+}
+
+/*
+ * compare_to_args
+ *
+ * Compares the incoming arguments to the given stored value, without forming a tuple out of
+ * them when there are multiple sort columns
+ */
+static int
+compare_to_args(FirstValuesQueryState *qstate, FunctionCallInfo fcinfo, Datum d, bool isnull)
+{
+	HeapTupleData tup;
+	int natts;
+	int i;
+
+	if (qstate->num_sort == 1)
+		return ApplySortComparator(PG_GETARG_DATUM(1), PG_ARGISNULL(1), d, isnull, qstate->sortkey);
+
+	Assert(!isnull);
+
+	natts = qstate->tup_desc->natts;
+
+	tup.t_data = DatumGetHeapTupleHeader(d);
+	tup.t_len = HeapTupleHeaderGetDatumLength(tup.t_data);
+
+	ExecClearTuple(qstate->tup_slot2);
+	ExecStoreTuple(&tup, qstate->tup_slot2, InvalidBuffer, false);
+
+	for (i = 0; i < natts; i++)
+	{
+		bool n;
+		Datum v = slot_getattr(qstate->tup_slot2, i + 1, &n);
+		int result = ApplySortComparator(PG_GETARG_DATUM(i + 1), PG_ARGISNULL(i + 1), v, n, qstate->sortkey + i);
 
 		if (result != 0)
+		{
+			ExecClearTuple(qstate->tup_slot2);
 			return result;
+		}
 	}
 
-	ExecClearTuple(qstate->tup_slot1);
 	ExecClearTuple(qstate->tup_slot2);
 
-	/* they must be equal */
 	return 0;
 }
 
+/*
+ * insert_position
+ *
+ * Returns the position that the incoming arguments go in among the first n values of the
+ * given sorted array, after any values equal to them
+ */
+static int
+insert_position(FirstValuesQueryState *qstate, FunctionCallInfo fcinfo, ArrayBuildState *array, int n)
+{
+	int lo = 0;
+	int hi = n;
+
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+
+		if (compare_to_args(qstate, fcinfo, array->dvalues[mid], array->dnulls[mid]) < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+/*
+ * args_to_datum
+ *
+ * Returns the value to store for the incoming arguments, in the current memory context
+ */
+static Datum
+args_to_datum(FirstValuesQueryState *qstate, FunctionCallInfo fcinfo, bool *isnull)
+{
+	HeapTuple tup;
+	Datum result;
+	int nargs = PG_NARGS() - 1;
+	int i;
+
+	*isnull = false;
+
+	if (qstate->num_sort == 1)
+	{
+		if (PG_ARGISNULL(1))
+		{
+			*isnull = true;
+			return (Datum) 0;
+		}
+
+		return PG_GETARG_DATUM(1);
+	}
+
+	Assert(nargs == qstate->num_sort);
+
+	ExecClearTuple(qstate->tup_slot1);
+	for (i = 0; i < nargs; i++)
+	{
+		qstate->tup_slot1->tts_values[i] = PG_GETARG_DATUM(i + 1);
+		qstate->tup_slot1->tts_isnull[i] = PG_ARGISNULL(i + 1);
+	}
+
+	tup = heap_form_tuple(qstate->tup_desc, qstate->tup_slot1->tts_values, qstate->tup_slot1->tts_isnull);
+	result = heap_copy_tuple_as_datum(tup, qstate->tup_desc);
+	heap_freetuple(tup);
+
+	return result;
+}
+
+/*
+ * first_values_trans
+ *
+ * A group's array is kept sorted, since that's how it's read by every other function. A value
+ * only takes a comparison with the last one to be rejected once the array is full, and a binary
+ * search to be inserted. Values are only copied into the group's state once they're known to be
+ * among its first values, and the value that falls off the end is freed, so a group's memory is
+ * proportional to the number of values it keeps rather than the number of rows it has seen.
+ */
 Datum
 first_values_trans(PG_FUNCTION_ARGS)
 {
@@ -2442,89 +2595,63 @@ first_values_trans(PG_FUNCTION_ARGS)
 	ArrayBuildState *array;
 	Datum d;
 	bool isnull;
+	int pos;
 
 	if (!AggCheckCallContext(fcinfo, &context))
 			elog(ERROR, "aggregate function called in non-aggregate context");
 
-	old = MemoryContextSwitchTo(context);
-
 	if (fvstate == NULL)
+	{
+		old = MemoryContextSwitchTo(context);
 		fvstate = first_values_startup(fcinfo);
+		MemoryContextSwitchTo(old);
+	}
 
 	qstate = (FirstValuesQueryState *) fcinfo->flinfo->fn_extra;
 	array = fvstate->array;
 
-	if (qstate->num_sort > 1)
+	if (array == NULL || array->nelems < qstate->num_values)
 	{
-		int i;
-		int nargs = PG_NARGS() - 1;
-
-		Assert(nargs == qstate->num_sort);
+		pos = array ? insert_position(qstate, fcinfo, array, array->nelems) : 0;
 
-		ExecClearTuple(qstate->tup_slot1);
-		for (i = 0; i < nargs; i++)
-		{
-			qstate->tup_slot1->tts_values[i] = PG_GETARG_DATUM(i + 1);
-			qstate->tup_slot1->tts_isnull[i] = PG_ARGISNULL(i + 1);
-		}
-		ExecStoreVirtualTuple(qstate->tup_slot1);
-
-		d = ExecFetchSlotTupleDatum(qstate->tup_slot1);
-		isnull = false; /* We will never have a NULL tuple here */
+		/* accumArrayResult copies the value into the array's context */
+		d = args_to_datum(qstate, fcinfo, &isnull);
+		array = accumArrayResult(array, d, isnull, qstate->type, context);
 	}
-	else
+	else if (compare_to_args(qstate, fcinfo, array->dvalues[array->nelems - 1], array->dnulls[array->nelems - 1]) < 0)
 	{
-		d = PG_GETARG_DATUM(1);
-		isnull = PG_ARGISNULL(1);
-	}
+		pos = insert_position(qstate, fcinfo, array, array->nelems - 1);
 
-	if (array == NULL)
-		array = accumArrayResult(array, d, isnull, qstate->type, context);
-	else
-	{
-		bool needs_sort = false;
+		/* the last value falls off the end */
+		if (!array->typbyval && !array->dnulls[array->nelems - 1])
+			pfree(DatumGetPointer(array->dvalues[array->nelems - 1]));
 
-		/* Insert in sorted order */
-		if (array->nelems < qstate->num_values)
+		d = args_to_datum(qstate, fcinfo, &isnull);
+		if (!isnull)
 		{
-			array = accumArrayResult(array, d, isnull, qstate->type, context);
-			needs_sort = true;
-		}
-		else
-		{
-			/* Value should only be inserted if its smaller than the last element */
-			if (compare_values(qstate, d, isnull, array->dvalues[array->nelems - 1], array->dnulls[array->nelems - 1]) < 0)
-			{
-				array->dvalues[array->nelems - 1] = d;
-				array->dnulls[array->nelems - 1] = isnull;
-				needs_sort = true;
-			}
+			old = MemoryContextSwitchTo(array->mcontext);
+			d = datumCopy(d, array->typbyval, array->typlen);
+			MemoryContextSwitchTo(old);
 		}
 
-		/* Do we need to fix the position of the last element in the list? */
-		if (needs_sort)
-		{
-			int i;
-			for (i = 0; i < array->nelems - 1; i++)
-			{
-				if (compare_values(qstate, d, isnull, array->dvalues[i], array->dnulls[i]) < 0)
-				{
-					memmove(&array->dvalues[i + 1], &array->dvalues[i], sizeof(Datum) * (array->nelems - 1 - i));
-					memmove(&array->dnulls[i + 1], &array->dnulls[i], sizeof(bool) * (array->nelems - 1 - i));
-					array->dvalues[i] = d;
-					array->dnulls[i] = isnull;
-					break;
-				}
-			}
-		}
+		array->dvalues[array->nelems - 1] = d;
+		array->dnulls[array->nelems - 1] = isnull;
 	}
+	else
+		PG_RETURN_POINTER(fvstate);
 
-	MemoryContextSwitchTo(old);
+	/* move the new value, which is last, to its position */
+	if (pos < array->nelems - 1)
+	{
+		d = array->dvalues[array->nelems - 1];
+		isnull = array->dnulls[array->nelems - 1];
 
-	Assert(fvstate);
+		memmove(&array->dvalues[pos + 1], &array->dvalues[pos], sizeof(Datum) * (array->nelems - 1 - pos));
+		memmove(&array->dnulls[pos + 1], &array->dnulls[pos], sizeof(bool) * (array->nelems - 1 - pos));
 
-	if (array == NULL)
-		PG_RETURN_NULL();
+		array->dvalues[pos] = d;
+		array->dnulls[pos] = isnull;
+	}
 
 	fvstate->array = array;
 
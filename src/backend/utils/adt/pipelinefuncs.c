@@ -14,23 +14,36 @@
 #include "pgstat.h"
 #include "funcapi.h"
 
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_type.h"
 #include "catalog/pipeline_query.h"
+#include "catalog/pipeline_query_fn.h"
 #include "catalog/pipeline_stream.h"
 #include "catalog/pipeline_stream_fn.h"
 #include "fmgr.h"
+#include "libpq/pqformat.h"
 #include "pipeline/cont_analyze.h"
+#include "pipeline/cont_instrument.h"
+#include "pipeline/cont_memory.h"
+#include "pipeline/cont_scheduler.h"
+#include "pipeline/read_cache.h"
 #include "pipeline/stream.h"
 #include "miscadmin.h"
+#include "storage/ipc.h"
+#include "utils/acl.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
 #include "utils/int8.h"
+#include "utils/json.h"
 #include "utils/jsonapi.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/pipelinefuncs.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
 #include "utils/syscache.h"
 
 typedef struct JsonObjectIntSumState
@@ -45,6 +58,23 @@ typedef struct JsonObjectIntSumEntry
 	int64 value;
 } JsonObjectIntSumEntry;
 
+/*
+ * latency_histogram
+ *
+ * Returns the given stage's latency histogram of a stats entry as an int8 array
+ */
+static Datum
+latency_histogram(PgStat_StatCQEntry *entry, PgStat_CQLatencyStage stage)
+{
+	Datum buckets[PGSTAT_CQ_LATENCY_BUCKETS];
+	int i;
+
+	for (i = 0; i < PGSTAT_CQ_LATENCY_BUCKETS; i++)
+		buckets[i] = Int64GetDatum(entry->latency[stage][i]);
+
+	return PointerGetDatum(construct_array(buckets, PGSTAT_CQ_LATENCY_BUCKETS, INT8OID, 8, FLOAT8PASSBYVAL, 'd'));
+}
+
 /*
  * cq_proc_stat_get
  *
@@ -71,7 +101,7 @@ cq_proc_stat_get(PG_FUNCTION_ARGS)
 		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
 		/* build tupdesc for result tuples */
-		tupdesc = CreateTemplateTupleDesc(16, false);
+		tupdesc = CreateTemplateTupleDesc(26, false);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "type", TEXTOID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 2, "pid", INT4OID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 3, "start_time", TIMESTAMPTZOID, -1, 0);
@@ -88,6 +118,16 @@ cq_proc_stat_get(PG_FUNCTION_ARGS)
 		TupleDescInitEntry(tupdesc, (AttrNumber) 14, "memory", INT8OID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 15, "executions", INT8OID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 16, "errors", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 17, "sw_cache_bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 18, "sw_cache_hits", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 19, "sw_cache_misses", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 20, "worker_queue_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 21, "exec_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 22, "combiner_queue_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 23, "lookup_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 24, "combine_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 25, "sync_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 26, "end_to_end_latency", INT8ARRAYOID, -1, 0);
 
 		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
 
@@ -108,8 +148,8 @@ cq_proc_stat_get(PG_FUNCTION_ARGS)
 
 	while ((entry = (PgStat_StatCQEntry *) hash_seq_search(iter)) != NULL)
 	{
-		Datum values[16];
-		bool nulls[16];
+		Datum values[26];
+		bool nulls[26];
 		HeapTuple tup;
 		Datum result;
 		pid_t pid = GetStatCQEntryProcPid(entry->key);
@@ -129,6 +169,9 @@ cq_proc_stat_get(PG_FUNCTION_ARGS)
 			continue;
 		}
 
+		/* the collector's counters lag behind the process's, so use the live ones */
+		pgstat_read_cq_shared_counters(entry);
+
 		MemSet(values, 0, sizeof(values));
 		MemSet(nulls, 0, sizeof(nulls));
 
@@ -148,6 +191,16 @@ cq_proc_stat_get(PG_FUNCTION_ARGS)
 		values[13] = Int64GetDatum(entry->memory);
 		values[14] = Int64GetDatum(entry->executions);
 		values[15] = Int64GetDatum(entry->errors);
+		values[16] = Int64GetDatum(entry->sw_cache_bytes);
+		values[17] = Int64GetDatum(entry->sw_cache_hits);
+		values[18] = Int64GetDatum(entry->sw_cache_misses);
+		values[19] = latency_histogram(entry, CQ_LATENCY_WORKER_QUEUE);
+		values[20] = latency_histogram(entry, CQ_LATENCY_WORKER_EXEC);
+		values[21] = latency_histogram(entry, CQ_LATENCY_COMBINER_QUEUE);
+		values[22] = latency_histogram(entry, CQ_LATENCY_LOOKUP);
+		values[23] = latency_histogram(entry, CQ_LATENCY_COMBINE);
+		values[24] = latency_histogram(entry, CQ_LATENCY_SYNC);
+		values[25] = latency_histogram(entry, CQ_LATENCY_END_TO_END);
 
 		tup = heap_form_tuple(funcctx->tuple_desc, values, nulls);
 		result = HeapTupleGetDatum(tup);
@@ -184,7 +237,7 @@ cq_stat_get(PG_FUNCTION_ARGS)
 		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
 		/* build tupdesc for result tuples */
-		tupdesc = CreateTemplateTupleDesc(13, false);
+		tupdesc = CreateTemplateTupleDesc(28, false);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "name", TEXTOID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 2, "type", TEXTOID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 3, "input_rows", INT8OID, -1, 0);
@@ -198,6 +251,21 @@ cq_stat_get(PG_FUNCTION_ARGS)
 		TupleDescInitEntry(tupdesc, (AttrNumber) 11, "time_pb", INT8OID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 12, "tuples_pb", INT8OID, -1, 0);
 		TupleDescInitEntry(tupdesc, (AttrNumber) 13, "errors", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 14, "exec_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 15, "lookup_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 16, "combine_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 17, "sync_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 18, "end_to_end_latency", INT8ARRAYOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 19, "group_cache_hits", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 20, "group_cache_misses", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 21, "lookups", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 22, "lookup_groups", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 23, "lookup_time", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 24, "lookup_blocks", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 25, "hot_updates", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 26, "combine_time", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 27, "sync_time", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 28, "stale_drops", INT8OID, -1, 0);
 
 		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
 
@@ -218,8 +286,8 @@ cq_stat_get(PG_FUNCTION_ARGS)
 
 	while ((entry = (PgStat_StatCQEntry *) hash_seq_search(iter)) != NULL)
 	{
-		Datum values[13];
-		bool nulls[13];
+		Datum values[28];
+		bool nulls[28];
 		HeapTuple tup;
 		Datum result;
 		Oid viewid = GetStatCQEntryViewId(entry->key);
@@ -239,6 +307,8 @@ cq_stat_get(PG_FUNCTION_ARGS)
 			continue;
 		}
 
+		pgstat_read_cq_shared_counters(entry);
+
 		viewname = get_rel_name(cv->relid);
 
 		MemSet(values, 0, sizeof(values));
@@ -257,6 +327,21 @@ cq_stat_get(PG_FUNCTION_ARGS)
 		values[10] = Int64GetDatum(entry->time_pb);
 		values[11] = Int64GetDatum(entry->tuples_pb);
 		values[12] = Int64GetDatum(entry->errors);
+		values[13] = latency_histogram(entry, CQ_LATENCY_WORKER_EXEC);
+		values[14] = latency_histogram(entry, CQ_LATENCY_LOOKUP);
+		values[15] = latency_histogram(entry, CQ_LATENCY_COMBINE);
+		values[16] = latency_histogram(entry, CQ_LATENCY_SYNC);
+		values[17] = latency_histogram(entry, CQ_LATENCY_END_TO_END);
+		values[18] = Int64GetDatum(entry->group_cache_hits);
+		values[19] = Int64GetDatum(entry->group_cache_misses);
+		values[20] = Int64GetDatum(entry->lookups);
+		values[21] = Int64GetDatum(entry->lookup_groups);
+		values[22] = Int64GetDatum(entry->lookup_time);
+		values[23] = Int64GetDatum(entry->lookup_blocks);
+		values[24] = Int64GetDatum(entry->hot_updates);
+		values[25] = Int64GetDatum(entry->combine_time);
+		values[26] = Int64GetDatum(entry->sync_time);
+		values[27] = Int64GetDatum(entry->stale_drops);
 
 		tup = heap_form_tuple(funcctx->tuple_desc, values, nulls);
 		result = HeapTupleGetDatum(tup);
@@ -765,52 +850,78 @@ handle_key_start(void *_state, char *fname, bool isnull)
 }
 
 /*
- * handle_scalar
+ * json_object_int_sum_add
  */
 static void
-handle_scalar(void *_state, char *token, JsonTokenType tokentype)
+json_object_int_sum_add(JsonObjectIntSumState *state, char *key, int64 value)
 {
 	bool found;
-	JsonObjectIntSumState *state = (JsonObjectIntSumState *) _state;
-	JsonObjectIntSumEntry *entry = (JsonObjectIntSumEntry *) hash_search(state->kv, state->current_key, HASH_ENTER, &found);
-	int64 result;
+	JsonObjectIntSumEntry *entry = (JsonObjectIntSumEntry *) hash_search(state->kv, key, HASH_ENTER, &found);
 
 	if (!found)
 		entry->value = 0;
 
+	entry->value += value;
+}
+
+/*
+ * handle_scalar
+ */
+static void
+handle_scalar(void *_state, char *token, JsonTokenType tokentype)
+{
+	JsonObjectIntSumState *state = (JsonObjectIntSumState *) _state;
+	int64 result;
+
 	(void) scanint8(token, false, &result);
-	entry->value += result;
+	json_object_int_sum_add(state, state->current_key, result);
 }
 
 /*
- * json_object_int_sum_startup
+ * json_object_int_sum_create
+ *
+ * Each group gets its own hash table of sums in the aggregate context, so that its sums are
+ * only ever turned into JSON by the final function
  */
 static JsonObjectIntSumState *
-json_object_int_sum_startup(FunctionCallInfo fcinfo)
+json_object_int_sum_create(MemoryContext context)
 {
-	MemoryContext oldcontext;
-	JsonSemAction *sem;
+	MemoryContext oldcontext = MemoryContextSwitchTo(context);
 	JsonObjectIntSumState *state;
 	HASHCTL ctl;
 
-	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
 	state = palloc0(sizeof(JsonObjectIntSumState));
 
 	MemSet(&ctl, 0, sizeof(HASHCTL));
 	ctl.keysize = NAMEDATALEN;
 	ctl.entrysize = sizeof(JsonObjectIntSumEntry);
-	ctl.hcxt = CurrentMemoryContext;
+	ctl.hcxt = context;
 	state->kv = hash_create("json_object_sum", 32, &ctl, HASH_ELEM | HASH_CONTEXT);
 
+	MemoryContextSwitchTo(oldcontext);
+
+	return state;
+}
+
+/*
+ * json_object_int_sum_startup
+ */
+static JsonSemAction *
+json_object_int_sum_startup(FunctionCallInfo fcinfo)
+{
+	MemoryContext oldcontext;
+	JsonSemAction *sem;
+
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
 	sem = palloc0(sizeof(JsonSemAction));
-	sem->semstate = (void *) state;
 	sem->object_field_start = handle_key_start;
 	sem->scalar = handle_scalar;
 	fcinfo->flinfo->fn_extra = (void *) sem;
 
 	MemoryContextSwitchTo(oldcontext);
 
-	return state;
+	return sem;
 }
 
 /*
@@ -820,11 +931,9 @@ Datum
 json_object_int_sum_transfn(PG_FUNCTION_ARGS)
 {
 	MemoryContext aggcontext;
-	MemoryContext oldcontext;
 	JsonObjectIntSumState *state;
 	JsonLexContext *lex;
 	JsonSemAction *sem;
-	char *raw = TextDatumGetCString(PG_GETARG_TEXT_P(1));
 
 	if (!AggCheckCallContext(fcinfo, &aggcontext))
 	{
@@ -833,26 +942,140 @@ json_object_int_sum_transfn(PG_FUNCTION_ARGS)
 	}
 
 	if (PG_ARGISNULL(0))
-	{
-		oldcontext = MemoryContextSwitchTo(aggcontext);
-		state = json_object_int_sum_startup(fcinfo);
-		MemoryContextSwitchTo(oldcontext);
-	}
+		state = json_object_int_sum_create(aggcontext);
 	else
-	{
 		state = (JsonObjectIntSumState *) PG_GETARG_POINTER(0);
-	}
 
-	lex = makeJsonLexContextCstringLen(raw, strlen(raw), true);
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(state);
+
 	sem = (JsonSemAction *) fcinfo->flinfo->fn_extra;
+	if (sem == NULL)
+		sem = json_object_int_sum_startup(fcinfo);
+
+	lex = makeJsonLexContext(PG_GETARG_TEXT_PP(1), true);
 	sem->semstate = (void *) state;
 	pg_parse_json(lex, sem);
 
 	PG_RETURN_POINTER(state);
 }
 
+/*
+ * json_object_int_sum_combine
+ */
+Datum
+json_object_int_sum_combine(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	JsonObjectIntSumState *state;
+	JsonObjectIntSumState *incoming;
+	HASH_SEQ_STATUS seq;
+	JsonObjectIntSumEntry *entry;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "json_object_int_sum_combine called in non-aggregate context");
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	incoming = (JsonObjectIntSumState *) PG_GETARG_POINTER(1);
+
+	if (PG_ARGISNULL(0))
+		state = json_object_int_sum_create(aggcontext);
+	else
+		state = (JsonObjectIntSumState *) PG_GETARG_POINTER(0);
+
+	hash_seq_init(&seq, incoming->kv);
+	while ((entry = (JsonObjectIntSumEntry *) hash_seq_search(&seq)) != NULL)
+		json_object_int_sum_add(state, entry->key, entry->value);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * json_object_int_sum_send
+ *
+ * Serializes the sums as the number of keys followed by each NULL-terminated key and its sum
+ */
+Datum
+json_object_int_sum_send(PG_FUNCTION_ARGS)
+{
+	JsonObjectIntSumState *state;
+	HASH_SEQ_STATUS seq;
+	JsonObjectIntSumEntry *entry;
+	StringInfoData buf;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (JsonObjectIntSumState *) PG_GETARG_POINTER(0);
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, hash_get_num_entries(state->kv), 4);
+
+	hash_seq_init(&seq, state->kv);
+	while ((entry = (JsonObjectIntSumEntry *) hash_seq_search(&seq)) != NULL)
+	{
+		pq_sendbytes(&buf, entry->key, strlen(entry->key) + 1);
+		pq_sendint64(&buf, entry->value);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/*
+ * json_object_int_sum_recv
+ */
+Datum
+json_object_int_sum_recv(PG_FUNCTION_ARGS)
+{
+	MemoryContext context;
+	JsonObjectIntSumState *state;
+	bytea *bytes;
+	StringInfoData buf;
+	int n;
+	int i;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		context = fcinfo->flinfo->fn_mcxt;
+
+	bytes = PG_GETARG_BYTEA_P(0);
+	buf.data = VARDATA(bytes);
+	buf.len = VARSIZE(bytes) - VARHDRSZ;
+	buf.maxlen = buf.len;
+	buf.cursor = 0;
+
+	state = json_object_int_sum_create(context);
+	n = pq_getmsgint(&buf, 4);
+
+	for (i = 0; i < n; i++)
+	{
+		char *end = memchr(buf.data + buf.cursor, '\0', buf.len - buf.cursor);
+		char *key;
+
+		if (end == NULL || end - (buf.data + buf.cursor) >= NAMEDATALEN)
+			elog(ERROR, "invalid json_object_int_sum state");
+
+		key = (char *) pq_getmsgbytes(&buf, end - (buf.data + buf.cursor) + 1);
+		json_object_int_sum_add(state, key, pq_getmsgint64(&buf));
+	}
+
+	pq_getmsgend(&buf);
+
+	PG_RETURN_POINTER(state);
+}
+
 /*
  * json_object_int_sum_transout
+ *
+ * Turns the sums into a JSON object
  */
 Datum
 json_object_int_sum_transout(PG_FUNCTION_ARGS)
@@ -863,8 +1086,8 @@ json_object_int_sum_transout(PG_FUNCTION_ARGS)
 	StringInfoData buf;
 	bool first = true;
 
-	if (!IsContQueryProcess() && !AggCheckCallContext(fcinfo, NULL))
-		PG_RETURN_TEXT_P(PG_GETARG_TEXT_P(0));
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
 	state = (JsonObjectIntSumState *) PG_GETARG_POINTER(0);
 	initStringInfo(&buf);
@@ -874,9 +1097,9 @@ json_object_int_sum_transout(PG_FUNCTION_ARGS)
 	while ((entry = (JsonObjectIntSumEntry *) hash_seq_search(&seq)) != NULL)
 	{
 		if (!first)
-			appendStringInfo(&buf, ", \"%s\": %ld", entry->key, entry->value);
-		else
-			appendStringInfo(&buf, "\"%s\": %ld", entry->key, entry->value);
+			appendStringInfoString(&buf, ", ");
+		escape_json(&buf, entry->key);
+		appendStringInfo(&buf, ": " INT64_FORMAT, entry->value);
 		first = false;
 	}
 
@@ -1012,58 +1235,878 @@ pipeline_transforms(PG_FUNCTION_ARGS)
 	SRF_RETURN_DONE(funcctx);
 }
 
+#define FLUSH_POLL_MS 1
+
+/*
+ * flush_wait
+ *
+ * Waits a little while for continuous query processes to make progress toward a flush
+ */
+static void
+flush_wait(void)
+{
+	pg_usleep(FLUSH_POLL_MS * 1000);
+	CHECK_FOR_INTERRUPTS();
+}
+
+/*
+ * flush_proc_running
+ */
+static bool
+flush_proc_running(ContQueryDatabaseMetadata *db_meta, ContQueryProc *proc)
+{
+	return db_meta->running && proc->bgw_handle != NULL;
+}
+
+/*
+ * end_flush
+ */
+static void
+end_flush(int code, Datum arg)
+{
+	ContQueryDatabaseMetadata *db_meta = (ContQueryDatabaseMetadata *) DatumGetPointer(arg);
+
+	pg_atomic_fetch_sub_u32(&db_meta->flushes_pending, 1);
+}
+
+/*
+ * flush_workers
+ *
+ * Waits until workers have consumed everything that was in their queues when we started, and
+ * have sent all of the partial results it produced to combiners. Queues stay unlocked, so
+ * inserts made in the meantime aren't held up, and each queue is only waited on up to the
+ * logical position its head was at when we started.
+ */
+static void
+flush_workers(ContQueryDatabaseMetadata *db_meta, ipc_queue_info *queues)
+{
+	int nworkers = continuous_query_num_workers;
+	uint64 *insert_heads = palloc(sizeof(uint64) * nworkers);
+	uint64 *spill_heads = palloc(sizeof(uint64) * nworkers);
+	uint64 *broker_heads = palloc(sizeof(uint64) * nworkers);
+	uint64 *batches = palloc(sizeof(uint64) * nworkers);
+	int i;
+
+	/* each worker has a broker->worker, worker->broker and insert->worker queue, in that order */
+	for (i = 0; i < nworkers; i++)
+	{
+		ipc_queue *wbq = queues[i * 3 + 1].queue;
+		ipc_queue *iwq = queues[i * 3 + 2].queue;
+
+		spill_heads[i] = pg_atomic_read_u64(&iwq->spill_head);
+		insert_heads[i] = pg_atomic_read_u64(&iwq->head);
+		broker_heads[i] = pg_atomic_read_u64(&wbq->head);
+	}
+
+	/*
+	 * Not every worker slot has a running process, e.g. when continuous_query_database_num_workers is
+	 * set, and nothing would ever drain the queues of those that don't, so they're skipped
+	 */
+	for (i = 0; i < nworkers; i++)
+	{
+		ContQueryProc *proc = &db_meta->db_procs[i];
+		ipc_queue *bwq = queues[i * 3].queue;
+		ipc_queue *iwq = queues[i * 3 + 2].queue;
+
+		/* spilled slots are consumed once they've been moved back into the insert queue, after what was already there */
+		while (flush_proc_running(db_meta, proc) && pg_atomic_read_u64(&iwq->spill_tail) < spill_heads[i])
+			flush_wait();
+
+		if (spill_heads[i] > 0)
+			insert_heads[i] = Max(insert_heads[i], pg_atomic_read_u64(&iwq->head));
+
+		while (flush_proc_running(db_meta, proc) && pg_atomic_read_u64(&iwq->tail) < insert_heads[i])
+			flush_wait();
+
+		/* the broker keeps worker->broker and broker->worker queues at the same logical positions */
+		while (flush_proc_running(db_meta, proc) && pg_atomic_read_u64(&bwq->tail) < broker_heads[i])
+			flush_wait();
+	}
+
+	/*
+	 * Everything has been consumed, but the batches that consumed it may still be running in any worker,
+	 * since workers steal from each other. Those that are must end, and partial results held across
+	 * batches must be sent, which workers do right away while a flush is pending.
+	 */
+	for (i = 0; i < nworkers; i++)
+	{
+		ContQueryProc *proc = &db_meta->db_procs[i];
+
+		batches[i] = pg_atomic_read_u64(&proc->batches_done);
+		if (flush_proc_running(db_meta, proc) && proc->latch)
+			SetLatch(proc->latch);
+	}
+
+	for (i = 0; i < nworkers; i++)
+	{
+		ContQueryProc *proc = &db_meta->db_procs[i];
+
+		while (flush_proc_running(db_meta, proc) &&
+				((pg_atomic_read_u32(&proc->in_batch) && pg_atomic_read_u64(&proc->batches_done) == batches[i]) ||
+				 pg_atomic_read_u32(&proc->holding_partials)))
+			flush_wait();
+	}
+
+	pfree(insert_heads);
+	pfree(spill_heads);
+	pfree(broker_heads);
+	pfree(batches);
+}
+
+/*
+ * flush_combiners
+ *
+ * Waits until combiners have committed everything that was in their queues once workers were flushed
+ */
 static void
-ipc_queue_wait_till_empty(ipc_queue *ipcq)
+flush_combiners(ContQueryDatabaseMetadata *db_meta, ipc_queue_info *queues)
 {
-	while (true)
+	uint64 *heads = palloc(sizeof(uint64) * continuous_query_num_combiners);
+	int i;
+
+	queues += continuous_query_num_workers * 3;
+
+	for (i = 0; i < continuous_query_num_combiners; i++)
+	{
+		ContQueryProc *proc = &db_meta->db_procs[continuous_query_num_workers + i];
+
+		heads[i] = pg_atomic_read_u64(&queues[i].queue->head);
+		if (flush_proc_running(db_meta, proc) && proc->latch)
+			SetLatch(proc->latch);
+	}
+
+	/* combiners that were scaled down or never started don't drain their queues, so they're skipped */
+	for (i = 0; i < continuous_query_num_combiners; i++)
 	{
-		if (ipc_queue_is_empty(ipcq))
-			break;
-		pg_usleep(5000);
+		ContQueryProc *proc = &db_meta->db_procs[continuous_query_num_workers + i];
+
+		while (flush_proc_running(db_meta, proc) && pg_atomic_read_u64(&queues[i].queue->tail) < heads[i])
+			flush_wait();
+
+		/* combiners commit what they've consumed at least every continuous_query_commit_interval, and right away now */
+		while (flush_proc_running(db_meta, proc) && pg_atomic_read_u64(&proc->committed_pos) < heads[i])
+			flush_wait();
 	}
+
+	pfree(heads);
 }
 
 /*
  * pipeline_flush
+ *
+ * Waits until the effects of everything inserted into streams before it was called have been
+ * committed to continuous views. Inserts made while it's waiting aren't blocked, and aren't waited for.
  */
 Datum
 pipeline_flush(PG_FUNCTION_ARGS)
 {
-	int i;
-	ipc_queue *wqueues[continuous_query_num_workers * 2];
-	ipc_queue *cqueues[continuous_query_num_combiners];
-	ipc_queue *ipcq;
+	ContQueryDatabaseMetadata *db_meta = GetContQueryDatabaseMetadata(MyDatabaseId);
+	ipc_queue_info *queues;
+	int nqueues;
 
-	for (i = 0; i < continuous_query_num_workers; i++)
+	if (!db_meta)
+		PG_RETURN_BOOL(true);
+
+	queues = get_db_ipc_queues(MyDatabaseId, NULL, &nqueues);
+	if (!queues)
+		PG_RETURN_BOOL(true);
+
+	pg_atomic_fetch_add_u32(&db_meta->flushes_pending, 1);
+
+	PG_ENSURE_ERROR_CLEANUP(end_flush, PointerGetDatum(db_meta));
 	{
-		ipcq = get_worker_queue_with_lock(i, false);
-		ipc_queue_wait_till_empty(ipcq);
-		wqueues[i + continuous_query_num_workers] = ipcq;
+		flush_workers(db_meta, queues);
+		flush_combiners(db_meta, queues);
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(end_flush, PointerGetDatum(db_meta));
+
+	end_flush(0, PointerGetDatum(db_meta));
+	pfree(queues);
+
+	PG_RETURN_BOOL(true);
+}
 
-		ipcq = get_worker_queue_with_lock(i, true);
-		ipc_queue_wait_till_empty(ipcq);
-		wqueues[i] = ipcq;
+/* heads of all queues as of this backend's previous call of pipeline_queue_stats, for measuring rates */
+static uint64 *last_queue_heads = NULL;
+static int last_queue_count = 0;
+static TimestampTz last_queue_stats_time = 0;
+
+typedef struct QueueStatsState
+{
+	ipc_queue_info *queues;
+	ipc_queue_stats *stats;
+	double elapsed;
+} QueueStatsState;
+
+/*
+ * pipeline_queue_stats
+ *
+ * Returns a row for each worker and combiner queue of this database, read without taking
+ * any locks. bytes_ps is the rate at which bytes were pushed into each queue since the
+ * previous time this backend called this function, so it's NULL the first time.
+ */
+Datum
+pipeline_queue_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	QueueStatsState *state;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		TupleDesc	tupdesc;
+		MemoryContext oldcontext;
+		TimestampTz now;
+		int nqueues;
+		int i;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		tupdesc = CreateTemplateTupleDesc(13, false);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "type", TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 2, "group_id", INT4OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 3, "broker_id", INT4OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 4, "size", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 5, "bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 6, "unread_bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 7, "occupancy", FLOAT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 8, "total_bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 9, "bytes_ps", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 10, "wraps", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 11, "producer_waits", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 12, "spilled_bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 13, "broker_buffered_bytes", INT8OID, -1, 0);
+
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		state = palloc0(sizeof(QueueStatsState));
+		state->queues = get_db_ipc_queues(MyDatabaseId, NULL, &nqueues);
+		state->stats = palloc0(sizeof(ipc_queue_stats) * Max(nqueues, 1));
+
+		for (i = 0; i < nqueues; i++)
+			ipc_queue_stats_get(state->queues[i].queue, &state->stats[i]);
+
+		now = GetCurrentTimestamp();
+
+		if (last_queue_heads && last_queue_count == nqueues)
+		{
+			long secs;
+			int usecs;
+
+			TimestampDifference(last_queue_stats_time, now, &secs, &usecs);
+			state->elapsed = secs + usecs / 1000000.0;
+		}
+
+		/* each row replaces its queue's previous head once its rate has been computed */
+		if (last_queue_count != nqueues)
+		{
+			if (last_queue_heads)
+				pfree(last_queue_heads);
+			last_queue_heads = nqueues ? MemoryContextAlloc(TopMemoryContext, sizeof(uint64) * nqueues) : NULL;
+			last_queue_count = nqueues;
+		}
+
+		funcctx->max_calls = nqueues;
+		funcctx->user_fctx = (void *) state;
+		last_queue_stats_time = now;
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 
-	for (i = 0; i < continuous_query_num_combiners; i++)
+	funcctx = SRF_PERCALL_SETUP();
+	state = (QueueStatsState *) funcctx->user_fctx;
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		int i = funcctx->call_cntr;
+		ipc_queue *ipcq = state->queues[i].queue;
+		ipc_queue_stats *stats = &state->stats[i];
+		Datum values[13];
+		bool nulls[13];
+		HeapTuple tup;
+
+		MemSet(values, 0, sizeof(values));
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(state->queues[i].type);
+		values[1] = Int32GetDatum(state->queues[i].group_id);
+		if (ipcq->produced_by_broker || ipcq->consumed_by_broker)
+			values[2] = Int32GetDatum(ipcq->broker_id);
+		else
+			nulls[2] = true;
+		values[3] = Int64GetDatum(stats->size);
+		values[4] = Int64GetDatum(stats->head - stats->tail);
+		values[5] = Int64GetDatum(stats->head - stats->cursor);
+		values[6] = Float8GetDatum((double) (stats->head - stats->tail) / (double) stats->size);
+		values[7] = Int64GetDatum(stats->head);
+
+		if (state->elapsed > 0 && stats->head >= last_queue_heads[i])
+			values[8] = Int64GetDatum((int64) ((stats->head - last_queue_heads[i]) / state->elapsed));
+		else
+			nulls[8] = true;
+		last_queue_heads[i] = stats->head;
+
+		values[9] = Int64GetDatum(stats->wraps);
+		values[10] = Int64GetDatum(stats->producer_waits);
+		if (ipcq->spill_id >= 0)
+			values[11] = Int64GetDatum(stats->spilled);
+		else
+			nulls[11] = true;
+		if (ipcq->consumed_by_broker)
+			values[12] = Int64GetDatum(stats->broker_buffered);
+		else
+			nulls[12] = true;
+
+		tup = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tup));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * pipeline_stream_insert_token
+ *
+ * Returns the token of the last stream insert this session deferred waiting on,
+ * or NULL if it hasn't deferred any
+ */
+Datum
+pipeline_stream_insert_token(PG_FUNCTION_ARGS)
+{
+	uint64 token = InsertBatchLastToken();
+
+	if (!token)
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64((int64) token);
+}
+
+/*
+ * pipeline_stream_insert_acked
+ *
+ * Returns true if the events of the deferred stream insert identified by the given
+ * token, and of all inserts deferred before it, have been consumed
+ */
+Datum
+pipeline_stream_insert_acked(PG_FUNCTION_ARGS)
+{
+	int64 token = PG_GETARG_INT64(0);
+
+	if (token <= 0)
+		PG_RETURN_BOOL(true);
+
+	PG_RETURN_BOOL(InsertBatchTokenAcked((uint64) token));
+}
+
+/*
+ * pipeline_wait_for_stream_insert
+ *
+ * Waits until the events of the deferred stream insert identified by the given token,
+ * and of all inserts deferred before it, have been consumed
+ */
+Datum
+pipeline_wait_for_stream_insert(PG_FUNCTION_ARGS)
+{
+	int64 token = PG_GETARG_INT64(0);
+
+	if (token > 0)
+		InsertBatchWaitForToken((uint64) token);
+
+	PG_RETURN_BOOL(true);
+}
+
+/*
+ * pipeline_set_step_factor
+ *
+ * Changes the step factor of a sliding-window continuous view, or makes it adapt to the view's
+ * ingest rate and number of groups if given 'auto'
+ */
+Datum
+pipeline_set_step_factor(PG_FUNCTION_ARGS)
+{
+	text *name = PG_GETARG_TEXT_P(0);
+	char *value = text_to_cstring(PG_GETARG_TEXT_P(1));
+	RangeVar *rv = makeRangeVarFromNameList(textToQualifiedNameList(name));
+	ContQuery *cv = GetContQueryForView(rv);
+	int step_factor;
+	bool step_auto = false;
+
+	if (cv == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_CONTINUOUS_VIEW),
+				errmsg("continuous view \"%s\" does not exist", text_to_cstring(name))));
+
+	if (!pg_class_ownercheck(cv->relid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, ACL_KIND_CLASS, text_to_cstring(name));
+
+	if (!cv->is_sw)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				errmsg("\"%s\" is not a sliding window continuous view", text_to_cstring(name))));
+
+	if (pg_strcasecmp(value, STEP_FACTOR_AUTO) == 0)
+	{
+		/* Adaptive views keep their current step factor until they've been observed for a full window */
+		step_auto = true;
+		step_factor = cv->sw_step_factor;
+	}
+	else
+	{
+		char *end;
+		double factor = strtod(value, &end);
+
+		if (end == value || *end != '\0' || factor < 1 || factor > 50)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"step_factor\" must be a number in the range 1..50 or \"%s\"", STEP_FACTOR_AUTO)));
+
+		step_factor = (int) factor;
+	}
+
+	UpdateContViewStepFactor(cv->id, step_factor, step_auto);
+
+	PG_RETURN_BOOL(true);
+}
+
+/*
+ * get_query_stream
+ *
+ * Returns the stream the given continuous query reads from, or InvalidOid if it can't be found
+ */
+static Oid
+get_query_stream(Query *query)
+{
+	ListCell *lc;
+
+	foreach(lc, query->rtable)
 	{
-		ipcq = get_combiner_queue_with_lock(i);
-		ipc_queue_wait_till_empty(ipcq);
-		cqueues[i] = ipcq;
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+		Oid relid = InvalidOid;
+
+		if (rte->rtekind == RTE_RELATION && rte->relkind == RELKIND_STREAM)
+			relid = rte->relid;
+		else if (rte->rtekind == RTE_SUBQUERY)
+			relid = get_query_stream(rte->subquery);
+
+		if (OidIsValid(relid))
+			return relid;
 	}
 
+	return InvalidOid;
+}
+
+/*
+ * pipeline_backfill
+ *
+ * Feeds all rows of a table to a single continuous view through the stream it reads from. The
+ * rows are partially aggregated by the workers and combined into the view's matrel just like
+ * inserted events, but no other readers of the stream see them. Returns the number of rows.
+ */
+Datum
+pipeline_backfill(PG_FUNCTION_ARGS)
+{
+	text *name = PG_GETARG_TEXT_P(0);
+	text *relname = PG_GETARG_TEXT_P(1);
+	RangeVar *rv = makeRangeVarFromNameList(textToQualifiedNameList(name));
+	RangeVar *rel_rv = makeRangeVarFromNameList(textToQualifiedNameList(relname));
+	ContQuery *cv = GetContQueryForView(rv);
+	HeapTuple tup;
+	Datum tmp;
+	bool isnull;
+	Oid streamid;
+	Relation stream;
+	Relation srcrel;
+	HeapScanDesc scan;
+	HeapTuple *tuples;
+	int ntuples = 0;
+	int64 count = 0;
+	const char *target;
+	int save_nestlevel;
+	MemoryContext cxt;
+	MemoryContext old;
+	Snapshot snapshot;
+	AclResult aclresult;
+
+	if (cv == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_CONTINUOUS_VIEW),
+				errmsg("continuous view \"%s\" does not exist", text_to_cstring(name))));
+
+	if (!cv->active)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				errmsg("continuous view \"%s\" is not active", text_to_cstring(name))));
+
+	tup = SearchSysCache1(PIPELINEQUERYID, ObjectIdGetDatum(cv->id));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for continuous view %u", cv->id);
+
+	tmp = SysCacheGetAttr(PIPELINEQUERYID, tup, Anum_pipeline_query_query, &isnull);
+	Assert(!isnull);
+	streamid = get_query_stream((Query *) stringToNode(TextDatumGetCString(tmp)));
+	ReleaseSysCache(tup);
+
+	if (!OidIsValid(streamid))
+		elog(ERROR, "could not find the stream continuous view \"%s\" reads from", text_to_cstring(name));
+
+	stream = heap_open(streamid, RowExclusiveLock);
+	srcrel = heap_openrv(rel_rv, AccessShareLock);
+
+	if (srcrel->rd_rel->relkind != RELKIND_RELATION && srcrel->rd_rel->relkind != RELKIND_MATVIEW)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				errmsg("\"%s\" is not a table or materialized view", RelationGetRelationName(srcrel))));
+
+	aclresult = pg_class_aclcheck(RelationGetRelid(stream), GetUserId(), ACL_INSERT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, ACL_KIND_CLASS, RelationGetRelationName(stream));
+
+	aclresult = pg_class_aclcheck(RelationGetRelid(srcrel), GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, ACL_KIND_CLASS, RelationGetRelationName(srcrel));
+
 	/*
-	 * At this point there is no more data in continuous process queues, however, we must still wait
-	 * for commit_interval for everything to get flushed to disk. After that we can unlock all the
-	 * queues.
+	 * Only the view being backfilled reads the rows. stream_targets is restored when we're done,
+	 * so that later inserts in the same transaction reach all readers again.
 	 */
-	pg_usleep(continuous_query_commit_interval * 1000 * 2);
+	target = quote_identifier(psprintf("%s.%s", get_namespace_name(get_rel_namespace(cv->relid)),
+			get_rel_name(cv->relid)));
 
-	for (i = 0; i < continuous_query_num_combiners; i++)
-		ipc_queue_unlock(cqueues[i]);
+	save_nestlevel = NewGUCNestLevel();
+	(void) set_config_option("stream_targets", target, PGC_USERSET, PGC_S_SESSION,
+			GUC_ACTION_SAVE, true, 0, false);
 
-	for (i = 0; i < continuous_query_num_workers * 2; i++)
-		ipc_queue_unlock(wqueues[i]);
+	cxt = AllocSetContextCreate(CurrentMemoryContext, "pipeline_backfill",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
 
-	PG_RETURN_BOOL(true);
+	tuples = palloc(sizeof(HeapTuple) * continuous_query_batch_size);
+	/* sending rows to the stream replaces the active snapshot, so hold on to the one we scan with */
+	snapshot = RegisterSnapshot(GetActiveSnapshot());
+	scan = heap_beginscan(srcrel, snapshot, 0, NULL);
+
+	/* rows are sent in batches, which the workers aggregate in parallel */
+	old = MemoryContextSwitchTo(cxt);
+
+	while ((tup = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		tuples[ntuples++] = heap_copytuple(tup);
+
+		if (ntuples < continuous_query_batch_size)
+			continue;
+
+		CopyIntoStream(stream, RelationGetDescr(srcrel), tuples, ntuples);
+		count += ntuples;
+		ntuples = 0;
+
+		MemoryContextReset(cxt);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	if (ntuples)
+	{
+		CopyIntoStream(stream, RelationGetDescr(srcrel), tuples, ntuples);
+		count += ntuples;
+	}
+
+	MemoryContextSwitchTo(old);
+
+	heap_endscan(scan);
+	UnregisterSnapshot(snapshot);
+	MemoryContextDelete(cxt);
+	pfree(tuples);
+
+	AtEOXact_GUC(true, save_nestlevel);
+
+	heap_close(srcrel, NoLock);
+	heap_close(stream, NoLock);
+
+	PG_RETURN_INT64(count);
+}
+
+/*
+ * pipeline_latency_buckets
+ *
+ * Returns the upper bounds in microseconds of the buckets of the continuous query latency
+ * histograms. The histograms have one more bucket, for anything slower than the last bound.
+ */
+Datum
+pipeline_latency_buckets(PG_FUNCTION_ARGS)
+{
+	Datum bounds[PGSTAT_CQ_LATENCY_BUCKETS - 1];
+	int i;
+
+	for (i = 0; i < PGSTAT_CQ_LATENCY_BUCKETS - 1; i++)
+		bounds[i] = Int64GetDatum(pgstat_cq_latency_bound(i));
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(bounds, PGSTAT_CQ_LATENCY_BUCKETS - 1, INT8OID, 8, FLOAT8PASSBYVAL, 'd'));
+}
+
+/*
+ * add_plan_lines
+ */
+static List *
+add_plan_lines(List *lines, const char *header, char *plan)
+{
+	char *line;
+	char *next;
+
+	lines = lappend(lines, pstrdup(header));
+
+	for (line = plan; line; line = next)
+	{
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		lines = lappend(lines, psprintf("  %s", line));
+	}
+
+	return lines;
+}
+
+/*
+ * pipeline_explain_analyze
+ *
+ * Instruments the worker and combiner plans of a continuous view for the given number of batches
+ * each and returns their EXPLAIN ANALYZE output, one line per row. The numbers are summed over all
+ * processes that ran a plan, so each node shows per-loop averages across its batches.
+ */
+Datum
+pipeline_explain_analyze(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	List *lines;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		text *name = PG_GETARG_TEXT_P(0);
+		int batches = PG_GETARG_INT32(1);
+		ContQuery *cv = GetContQueryForView(makeRangeVarFromNameList(textToQualifiedNameList(name)));
+		MemoryContext old;
+		AclResult aclresult;
+		char *worker_plan;
+		char *combiner_plan;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+
+		if (cv == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_CONTINUOUS_VIEW),
+					errmsg("continuous view \"%s\" does not exist", text_to_cstring(name))));
+
+		if (!cv->active)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					errmsg("continuous view \"%s\" is not active", text_to_cstring(name))));
+
+		if (batches < 1)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("number of batches must be at least 1")));
+
+		aclresult = pg_class_aclcheck(cv->relid, GetUserId(), ACL_SELECT);
+		if (aclresult != ACLCHECK_OK)
+			aclcheck_error(aclresult, ACL_KIND_CLASS, cv->name->relname);
+
+		old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		ExplainAnalyzeContQuery(cv, batches, &worker_plan, &combiner_plan);
+
+		lines = add_plan_lines(NIL, "Worker plan:", worker_plan);
+		lines = add_plan_lines(lines, "Combiner plan:", combiner_plan);
+		funcctx->user_fctx = lines;
+
+		MemoryContextSwitchTo(old);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	lines = (List *) funcctx->user_fctx;
+
+	if (lines)
+	{
+		char *line = (char *) linitial(lines);
+
+		funcctx->user_fctx = list_delete_first(lines);
+		SRF_RETURN_NEXT(funcctx, CStringGetTextDatum(line));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+typedef struct QueryMemoryState
+{
+	ContQueryMemoryStats *stats;
+	int nstats;
+	int next;
+} QueryMemoryState;
+
+/*
+ * pipeline_query_memory
+ *
+ * Returns a row for the state of each continuous view of this database in each worker and combiner,
+ * with the memory it used after its last batch
+ */
+Datum
+pipeline_query_memory(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	QueryMemoryState *state;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		TupleDesc	tupdesc;
+		MemoryContext oldcontext;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		tupdesc = CreateTemplateTupleDesc(8, false);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "name", TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 2, "type", TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 3, "pid", INT4OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 4, "bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 5, "peak_bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 6, "cache_bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 7, "plan_bytes", INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 8, "limit_exceeded", INT8OID, -1, 0);
+
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		state = palloc0(sizeof(QueryMemoryState));
+		state->stats = GetContQueryMemoryStats(&state->nstats);
+
+		funcctx->user_fctx = (void *) state;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (QueryMemoryState *) funcctx->user_fctx;
+
+	while (state->next < state->nstats)
+	{
+		ContQueryMemoryStats *stats = &state->stats[state->next++];
+		ContQuery *cq = GetContQueryForId(stats->query_id);
+		Datum values[8];
+		bool nulls[8];
+		HeapTuple tup;
+
+		/* the view may have been dropped since */
+		if (cq == NULL)
+			continue;
+
+		MemSet(values, 0, sizeof(values));
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(get_rel_name(cq->relid));
+		values[1] = CStringGetTextDatum(stats->ptype == Worker ? "worker" : "combiner");
+		values[2] = Int32GetDatum(stats->pid);
+		values[3] = Int64GetDatum(stats->bytes);
+		values[4] = Int64GetDatum(stats->peak_bytes);
+		values[5] = Int64GetDatum(stats->cache_bytes);
+		values[6] = Int64GetDatum(stats->plan_bytes);
+		values[7] = Int64GetDatum(stats->limit_exceeded);
+
+		tup = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tup));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * pipeline_view_lag
+ *
+ * Returns the time since the arrival of the newest event committed to the given continuous view,
+ * which is how far behind its streams the view is while events keep arriving. NULL if nothing has
+ * been committed to the view since the server started.
+ */
+Datum
+pipeline_view_lag(PG_FUNCTION_ARGS)
+{
+	text *name = PG_GETARG_TEXT_P(0);
+	ContQuery *cv = GetContQueryForView(makeRangeVarFromNameList(textToQualifiedNameList(name)));
+	TimestampTz arrival;
+
+	if (cv == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_CONTINUOUS_VIEW),
+				errmsg("continuous view \"%s\" does not exist", text_to_cstring(name))));
+
+	arrival = pgstat_fetch_cq_committed_arrival(cv->id);
+	if (!arrival)
+		PG_RETURN_NULL();
+
+	PG_RETURN_DATUM(DirectFunctionCall2(timestamp_mi,
+			TimestampTzGetDatum(GetCurrentTimestamp()), TimestampTzGetDatum(arrival)));
+}
+
+/*
+ * pipeline_cached_row
+ *
+ * Returns the row of the continuous view whose row type the first argument has, for the group whose
+ * read_cache_key has the given text value, if it's in the read cache. For example,
+ *
+ *   SELECT (pipeline_cached_row(NULL::view, 'key')).*
+ */
+Datum
+pipeline_cached_row(PG_FUNCTION_ARGS)
+{
+	Oid type = get_fn_expr_argtype(fcinfo->flinfo, 0);
+	Oid relid = get_typ_typrelid(type);
+	HeapTuple tup;
+	Oid id;
+	Datum row;
+	bool found;
+
+	tup = SearchSysCache1(PIPELINEQUERYRELID, ObjectIdGetDatum(relid));
+	if (!HeapTupleIsValid(tup))
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				errmsg("%s is not the row type of a continuous view", format_type_be(type))));
+
+	id = ((Form_pipeline_query) GETSTRUCT(tup))->id;
+	ReleaseSysCache(tup);
+
+	if (pg_class_aclcheck(relid, GetUserId(), ACL_SELECT) != ACLCHECK_OK)
+		aclcheck_error(ACLCHECK_NO_PRIV, ACL_KIND_CLASS, get_rel_name(relid));
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	row = ReadCacheGet(id, text_to_cstring(PG_GETARG_TEXT_PP(1)), &found);
+	if (!found)
+		PG_RETURN_NULL();
+
+	PG_RETURN_DATUM(row);
+}
+
+/*
+ * pipeline_insert_waits
+ *
+ * Returns how often and for how long the stream inserts of the current session have waited for worker
+ * queue locks and for their events to be acked, so that clients can see where insert scaling flattens out
+ */
+Datum
+pipeline_insert_waits(PG_FUNCTION_ARGS)
+{
+	TupleDesc desc;
+	Datum values[6];
+	bool nulls[6];
+
+	if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = Int64GetDatum(MyStreamInsertWaits.queue_locks);
+	values[1] = Int64GetDatum(MyStreamInsertWaits.queue_lock_misses);
+	values[2] = Int64GetDatum(MyStreamInsertWaits.queue_lock_waits);
+	values[3] = Int64GetDatum(MyStreamInsertWaits.queue_lock_wait_time);
+	values[4] = Int64GetDatum(MyStreamInsertWaits.ack_waits);
+	values[5] = Int64GetDatum(MyStreamInsertWaits.ack_wait_time);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(desc), values, nulls)));
 }
@@ -15,140 +15,254 @@
 #include "pipeline/miscutils.h"
 #include "utils/array.h"
 #include "utils/datum.h"
-#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/setfuncs.h"
 #include "utils/typcache.h"
 
-#define MURMUR_SEED 0x02cffb4c45ee1fb8L
+#define HASH_SEED 0x02cffb4c45ee1fb8L
 
-typedef struct SetKey
+#define SET_INITIAL_SIZE 16
+
+/* marks an empty slot of the hash table */
+#define EMPTY_SLOT -1
+
+typedef struct SetEntry
 {
-	uint32 hash;
+	uint64 hash;
 	Datum value;
-	TypeCacheEntry *typ;
-} SetKey;
+	bool isnull;
+} SetEntry;
 
+/*
+ * Transition state of set_agg and exact_count_distinct. Each group keeps its distinct values
+ * in the order they were added, along with an open addressing hash table of their positions,
+ * so adding a value or merging another state only looks at the slots of the values' hashes.
+ * A NULL is kept in order like any other value, but isn't in the hash table.
+ */
 typedef struct SetAggState
 {
-	HTAB *htab;
 	TypeCacheEntry *typ;
 	bool has_null;
+	int nentries;
+	int capacity;
+	SetEntry *entries;
+	/* always a power of two */
+	int size;
+	int *slots;
 } SetAggState;
 
 /*
- * set_key_match
+ * set_hash
  */
-static int
-set_key_match(const void *kl, const void *kr, Size keysize)
+static uint64
+set_hash(SetAggState *state, Datum value)
 {
-	SetKey *l = (SetKey *) kl;
-	SetKey *r = (SetKey *) kr;
-	int cmp;
+	StringInfoData buf;
+	uint64 h;
 
-	Assert(l->typ->type_id == r->typ->type_id);
+	initStringInfo(&buf);
+	DatumToBytes(value, state->typ, &buf);
 
-	cmp = datumIsEqual(l->value, r->value, l->typ->typbyval, l->typ->typlen) ? 0 : 1;
+	h = FastHash64(buf.data, buf.len, HASH_SEED);
+	pfree(buf.data);
 
-	return DatumGetInt32(cmp);
+	return h;
 }
 
 /*
- * set_key_hash
+ * set_rehash
+ *
+ * Sizes the hash table for the given number of values and fills it with the ones in the set
  */
-static uint32
-set_key_hash(const void *key, Size keysize)
+static void
+set_rehash(SetAggState *state, int n)
 {
-	SetKey *k = (SetKey *) key;
-	StringInfoData buf;
-	uint64_t h;
+	int size = SET_INITIAL_SIZE;
+	int i;
 
-	initStringInfo(&buf);
-	DatumToBytes(k->value, k->typ, &buf);
+	while (size * 3 < n * 4)
+		size *= 2;
 
-	h = MurmurHash3_64(buf.data, buf.len, MURMUR_SEED);
-	pfree(buf.data);
+	if (state->slots)
+		pfree(state->slots);
+
+	state->size = size;
+	state->slots = palloc(sizeof(int) * size);
+	memset(state->slots, EMPTY_SLOT, sizeof(int) * size);
+
+	for (i = 0; i < state->nentries; i++)
+	{
+		uint32 mask = size - 1;
+		uint32 j;
 
-	return DatumGetUInt32(h);
+		if (state->entries[i].isnull)
+			continue;
+
+		/* all of these values are distinct, so only an empty slot needs to be looked for */
+		for (j = state->entries[i].hash & mask; state->slots[j] != EMPTY_SLOT; j = (j + 1) & mask)
+			;
+
+		state->slots[j] = i;
+	}
 }
 
 /*
- * set_agg_startup
+ * set_create
  */
-static void
-set_agg_startup(FunctionCallInfo fcinfo, Oid type)
+static SetAggState *
+set_create(Oid type, int n)
 {
-	MemoryContext old;
-	HASHCTL ctl;
-	SetAggState *state;
+	SetAggState *state = palloc0(sizeof(SetAggState));
 
-	old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-	state = palloc0(sizeof(SetAggState));
-
-	state->has_null = false;
-	state->typ = lookup_type_cache(type,
-			TYPECACHE_HASH_PROC | TYPECACHE_HASH_PROC_FINFO | TYPECACHE_CMP_PROC | TYPECACHE_CMP_PROC_FINFO);
+	state->typ = lookup_type_cache(type, 0);
 
 	if (type == RECORDOID || state->typ->typtype == TYPTYPE_COMPOSITE)
 		elog(ERROR, "composite types are not supported by set_agg");
 
-	MemSet(&ctl, 0, sizeof(ctl));
-	ctl.keysize = sizeof(SetKey);
-	ctl.entrysize = sizeof(SetKey);
-	ctl.match = set_key_match;
-	ctl.hash = set_key_hash;
-
-	state->htab = hash_create("SetAggHashTable", 1024, &ctl, HASH_FUNCTION | HASH_ELEM | HASH_COMPARE);
-	MemoryContextSwitchTo(old);
+	state->capacity = Max(n, SET_INITIAL_SIZE);
+	state->entries = palloc(sizeof(SetEntry) * state->capacity);
+	set_rehash(state, n);
 
-	fcinfo->flinfo->fn_extra = (void *) state;
+	return state;
 }
 
 /*
- * set_add
+ * set_find
+ *
+ * Returns the slot the given value's position is in, or the empty slot it would go in
  */
-static ArrayBuildState *
-set_add(FunctionCallInfo fcinfo, MemoryContext aggcontext, Datum d, bool isnull, ArrayBuildState *state)
+static int *
+set_find(SetAggState *state, uint64 hash, Datum value)
 {
-	SetKey key;
-	bool found;
-	SetAggState *sas;
-	StringInfoData buf;
-	uint64_t h;
-	Datum copy;
+	uint32 mask = state->size - 1;
+	uint32 i = hash & mask;
+
+	for (;;)
+	{
+		int *slot = &state->slots[i];
+		SetEntry *entry;
 
-	sas = (SetAggState *) fcinfo->flinfo->fn_extra;
+		if (*slot == EMPTY_SLOT)
+			return slot;
 
-	if (isnull)
+		entry = &state->entries[*slot];
+		if (entry->hash == hash &&
+				datumIsEqual(entry->value, value, state->typ->typbyval, state->typ->typlen))
+			return slot;
+
+		i = (i + 1) & mask;
+	}
+}
+
+/*
+ * set_append
+ */
+static SetEntry *
+set_append(SetAggState *state)
+{
+	if (state->nentries == state->capacity)
 	{
-		if (!sas->has_null)
-		{
-			state = accumArrayResult(state, 0, true, sas->typ->type_id, aggcontext);
-			sas->has_null = true;
-		}
+		state->capacity *= 2;
+		state->entries = repalloc(state->entries, sizeof(SetEntry) * state->capacity);
+	}
+
+	return &state->entries[state->nentries++];
+}
+
+/*
+ * set_add_hashed
+ *
+ * Adds a value with the given hash to the set, copying it into the current memory context
+ * if it isn't already in the set
+ */
+static void
+set_add_hashed(SetAggState *state, uint64 hash, Datum value)
+{
+	int *slot = set_find(state, hash, value);
+	SetEntry *entry;
+
+	if (*slot != EMPTY_SLOT)
+		return;
 
-		return state;
+	if ((state->nentries + 1) * 4 > state->size * 3)
+	{
+		set_rehash(state, state->nentries + 1);
+		slot = set_find(state, hash, value);
 	}
 
-	copy = datumCopy(d, sas->typ->typbyval, sas->typ->typlen);
+	*slot = state->nentries;
 
-	initStringInfo(&buf);
-	DatumToBytes(copy, sas->typ, &buf);
+	entry = set_append(state);
+	entry->hash = hash;
+	entry->value = datumCopy(value, state->typ->typbyval, state->typ->typlen);
+	entry->isnull = false;
+}
 
-	h = MurmurHash3_64(buf.data, buf.len, MURMUR_SEED);
-	pfree(buf.data);
+/*
+ * set_add_null
+ */
+static void
+set_add_null(SetAggState *state)
+{
+	SetEntry *entry;
+
+	if (state->has_null)
+		return;
+
+	entry = set_append(state);
+	MemSet(entry, 0, sizeof(SetEntry));
+	entry->isnull = true;
+	state->has_null = true;
+}
+
+/*
+ * set_add
+ */
+static void
+set_add(SetAggState *state, Datum value, bool isnull)
+{
+	if (isnull)
+		set_add_null(state);
+	else
+		set_add_hashed(state, set_hash(state, value), value);
+}
 
-	MemSet(&key, 0, sizeof(SetKey));
-	key.hash = h;
-	key.value = copy;
-	key.typ = sas->typ;
+/*
+ * set_to_array
+ *
+ * Returns an array of the values in the set, in the order they were added
+ */
+static ArrayType *
+set_to_array(SetAggState *state)
+{
+	int n = state->nentries;
+	Datum *values = palloc(sizeof(Datum) * Max(n, 1));
+	bool *nulls = palloc(sizeof(bool) * Max(n, 1));
+	int dims[1];
+	int lbs[1];
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+	int i;
+	ArrayType *result;
 
-	hash_search_with_hash_value(sas->htab, &key, h, HASH_ENTER, &found);
+	for (i = 0; i < n; i++)
+	{
+		values[i] = state->entries[i].value;
+		nulls[i] = state->entries[i].isnull;
+	}
 
-	if (!found)
-		state = accumArrayResult(state, d, false, sas->typ->type_id, aggcontext);
+	dims[0] = n;
+	lbs[0] = 1;
 
-	return state;
+	get_typlenbyvalalign(state->typ->type_id, &typlen, &typbyval, &typalign);
+	result = construct_md_array(values, nulls, 1, dims, lbs, state->typ->type_id, typlen, typbyval, typalign);
+
+	pfree(values);
+	pfree(nulls);
+
+	return result;
 }
 
 /*
@@ -157,7 +271,7 @@ set_add(FunctionCallInfo fcinfo, MemoryContext aggcontext, Datum d, bool isnull,
 Datum
 set_agg_trans(PG_FUNCTION_ARGS)
 {
-	ArrayBuildState *state = PG_ARGISNULL(0) ? NULL : (ArrayBuildState *) PG_GETARG_POINTER(0);
+	SetAggState *state = PG_ARGISNULL(0) ? NULL : (SetAggState *) PG_GETARG_POINTER(0);
 	MemoryContext old;
 	MemoryContext context;
 
@@ -166,10 +280,10 @@ set_agg_trans(PG_FUNCTION_ARGS)
 
 	old = MemoryContextSwitchTo(context);
 
-	if (fcinfo->flinfo->fn_extra == NULL)
-		set_agg_startup(fcinfo, AggGetInitialArgType(fcinfo));
+	if (state == NULL)
+		state = set_create(AggGetInitialArgType(fcinfo), 0);
 
-	state = set_add(fcinfo, context, PG_GETARG_DATUM(1), PG_ARGISNULL(1), state);
+	set_add(state, PG_GETARG_DATUM(1), PG_ARGISNULL(1));
 
 	MemoryContextSwitchTo(old);
 
@@ -178,11 +292,15 @@ set_agg_trans(PG_FUNCTION_ARGS)
 
 /*
  * set_agg_combine
+ *
+ * Adds the values of the incoming set to the transition state, in order. Their hashes are
+ * already known, so each one only takes a probe of the transition state's hash table.
  */
 Datum
 set_agg_combine(PG_FUNCTION_ARGS)
 {
-	ArrayBuildState *state;
+	SetAggState *state;
+	SetAggState *incoming;
 	MemoryContext old;
 	MemoryContext context;
 	int i;
@@ -193,23 +311,26 @@ set_agg_combine(PG_FUNCTION_ARGS)
 	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
 		PG_RETURN_NULL();
 
+	state = PG_ARGISNULL(0) ? NULL : (SetAggState *) PG_GETARG_POINTER(0);
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(state);
+
+	incoming = (SetAggState *) PG_GETARG_POINTER(1);
+
 	old = MemoryContextSwitchTo(context);
 
-	state = PG_ARGISNULL(0) ? NULL : (ArrayBuildState *) PG_GETARG_POINTER(0);
+	if (state == NULL)
+		state = set_create(incoming->typ->type_id, incoming->nentries);
 
-	/*
-	 * The incoming arrays will be appended to the existing transition state,
-	 * but the order in which they're appended isn't predictable.
-	 */
-	if (!PG_ARGISNULL(1))
+	for (i = 0; i < incoming->nentries; i++)
 	{
-		ArrayBuildState *incoming = (ArrayBuildState *) PG_GETARG_POINTER(1);
-
-		if (fcinfo->flinfo->fn_extra == NULL)
-			set_agg_startup(fcinfo, incoming->element_type);
+		SetEntry *entry = &incoming->entries[i];
 
-		for (i = 0; i < incoming->nelems; i++)
-			state = set_add(fcinfo, context, incoming->dvalues[i], incoming->dnulls[i], state);
+		if (entry->isnull)
+			set_add_null(state);
+		else
+			set_add_hashed(state, entry->hash, entry->value);
 	}
 
 	MemoryContextSwitchTo(old);
@@ -218,17 +339,89 @@ set_agg_combine(PG_FUNCTION_ARGS)
 }
 
 /*
- * set_agg_combine
+ * set_agg_send
+ *
+ * Serializes a set as an array of its values, which is also how sets are stored. Their hashes
+ * are cheap to recompute, so they're left out.
  */
 Datum
-set_cardinality(PG_FUNCTION_ARGS)
+set_agg_send(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_ARRAYTYPE_P(set_to_array((SetAggState *) PG_GETARG_POINTER(0)));
+}
+
+/*
+ * set_agg_recv
+ */
+Datum
+set_agg_recv(PG_FUNCTION_ARGS)
 {
-	Datum array;
+	ArrayType *vals;
+	SetAggState *result;
+	MemoryContext old;
+	MemoryContext context;
+	Datum *values;
+	bool *nulls;
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+	int n;
+	int i;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		context = fcinfo->flinfo->fn_mcxt;
 
 	if (PG_ARGISNULL(0))
-		PG_RETURN_INT64(0);
+		PG_RETURN_NULL();
+
+	old = MemoryContextSwitchTo(context);
+
+	vals = PG_GETARG_ARRAYTYPE_P(0);
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(vals), &typlen, &typbyval, &typalign);
+	deconstruct_array(vals, ARR_ELEMTYPE(vals), typlen, typbyval, typalign, &values, &nulls, &n);
+
+	/* the values are all distinct, so the set is sized for all of them upfront */
+	result = set_create(ARR_ELEMTYPE(vals), n);
 
-	array = DirectFunctionCall1(array_agg_finalfn, PG_GETARG_DATUM(0));;
-	PG_RETURN_INT32(DirectFunctionCall2(array_length, array, Int32GetDatum(1)));
+	for (i = 0; i < n; i++)
+		set_add(result, values[i], nulls[i]);
+
+	pfree(values);
+	pfree(nulls);
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(result);
 }
 
+/*
+ * set_agg_final
+ */
+Datum
+set_agg_final(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_ARRAYTYPE_P(set_to_array((SetAggState *) PG_GETARG_POINTER(0)));
+}
+
+/*
+ * set_cardinality
+ */
+Datum
+set_cardinality(PG_FUNCTION_ARGS)
+{
+	SetAggState *state;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT32(0);
+
+	state = (SetAggState *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_INT32(state->nentries);
+}
@@ -0,0 +1,301 @@
+/*-------------------------------------------------------------------------
+ *
+ * thetafuncs.c
+ *		Theta sketch functions
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/thetafuncs.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "lib/stringinfo.h"
+#include "nodes/nodeFuncs.h"
+#include "pipeline/miscutils.h"
+#include "pipeline/theta.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/thetafuncs.h"
+#include "utils/typcache.h"
+
+Datum
+theta_print(PG_FUNCTION_ARGS)
+{
+	StringInfoData buf;
+	ThetaSketch *ts;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	ts = (ThetaSketch *) PG_GETARG_VARLENA_P(0);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "{ lg_k = %d, theta = %.6f, entries = %u, estimate = %.0f, size = %dkB }",
+			ts->lg_k, ldexp((float8) ts->theta, -64), ts->num_entries, ThetaSketchEstimate(ts),
+			(int) (ThetaSketchSize(ts) / 1024));
+
+	PG_RETURN_TEXT_P(CStringGetTextDatum(buf.data));
+}
+
+static ThetaSketch *
+theta_create(int lg_k)
+{
+	if (lg_k < THETA_MIN_LG_K || lg_k > THETA_MAX_LG_K)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("lg_k must be in [%d, %d]", THETA_MIN_LG_K, THETA_MAX_LG_K)));
+
+	return ThetaSketchCreateWithLgK(lg_k);
+}
+
+static ThetaSketch *
+theta_startup(FunctionCallInfo fcinfo, int lg_k)
+{
+	Oid type = AggGetInitialArgType(fcinfo);
+	MemoryContext old;
+
+	old = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	fcinfo->flinfo->fn_extra = lookup_type_cache(type, 0);
+	MemoryContextSwitchTo(old);
+
+	if (lg_k > 0)
+		return theta_create(lg_k);
+
+	return ThetaSketchCreate();
+}
+
+static ThetaSketch *
+theta_add_datum(FunctionCallInfo fcinfo, ThetaSketch *ts, Datum elem)
+{
+	TypeCacheEntry *typ = (TypeCacheEntry *) fcinfo->flinfo->fn_extra;
+	StringInfoData buf;
+
+	initStringInfo(&buf);
+	DatumToBytes(elem, typ, &buf);
+	ts = ThetaSketchAdd(ts, buf.data, buf.len);
+	pfree(buf.data);
+
+	return ts;
+}
+
+/*
+ * theta_agg transition function -
+ * 	adds the given element to the transition sketch
+ */
+Datum
+theta_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	ThetaSketch *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "theta_agg_trans called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = theta_startup(fcinfo, 0);
+	else
+		state = (ThetaSketch *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = theta_add_datum(fcinfo, state, PG_GETARG_DATUM(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * theta_agg transition function -
+ *
+ * 	adds the given element to the transition sketch using the given value for lg_k
+ */
+Datum
+theta_agg_transp(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	ThetaSketch *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "theta_agg_transp called in non-aggregate context");
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = theta_startup(fcinfo, PG_GETARG_INT32(2));
+	else
+		state = (ThetaSketch *) PG_GETARG_VARLENA_P(0);
+
+	if (!PG_ARGISNULL(1))
+		state = theta_add_datum(fcinfo, state, PG_GETARG_DATUM(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * theta_union_agg transition function -
+ *
+ * 	returns the union of the transition state and the given sketch
+ */
+Datum
+theta_union_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	ThetaSketch *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "theta_union_agg_trans called in non-aggregate context");
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = ThetaSketchCopy((ThetaSketch *) PG_GETARG_VARLENA_P(1));
+	else if (PG_ARGISNULL(1))
+		state = (ThetaSketch *) PG_GETARG_VARLENA_P(0);
+	else
+		state = ThetaSketchUnion((ThetaSketch *) PG_GETARG_VARLENA_P(0), (ThetaSketch *) PG_GETARG_VARLENA_P(1));
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * theta_intersection_agg transition function -
+ *
+ * 	returns the intersection of the transition state and the given sketch
+ */
+Datum
+theta_intersection_agg_trans(PG_FUNCTION_ARGS)
+{
+	MemoryContext old;
+	MemoryContext context;
+	ThetaSketch *state;
+
+	if (!AggCheckCallContext(fcinfo, &context))
+		elog(ERROR, "theta_intersection_agg_trans called in non-aggregate context");
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	old = MemoryContextSwitchTo(context);
+
+	if (PG_ARGISNULL(0))
+		state = ThetaSketchCopy((ThetaSketch *) PG_GETARG_VARLENA_P(1));
+	else if (PG_ARGISNULL(1))
+		state = (ThetaSketch *) PG_GETARG_VARLENA_P(0);
+	else
+	{
+		ThetaSketch *prev = (ThetaSketch *) PG_GETARG_VARLENA_P(0);
+
+		state = ThetaSketchIntersection(prev, (ThetaSketch *) PG_GETARG_VARLENA_P(1));
+		if (MemoryContextContains(context, prev))
+			pfree(prev);
+	}
+
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Returns the union of the given sketches
+ */
+Datum
+theta_union(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+	if (PG_ARGISNULL(0))
+		PG_RETURN_POINTER(PG_GETARG_VARLENA_P(1));
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(PG_GETARG_VARLENA_P(0));
+
+	PG_RETURN_POINTER(ThetaSketchUnion(ThetaSketchCopy((ThetaSketch *) PG_GETARG_VARLENA_P(0)),
+			(ThetaSketch *) PG_GETARG_VARLENA_P(1)));
+}
+
+/*
+ * Returns the intersection of the given sketches
+ */
+Datum
+theta_intersection(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	PG_RETURN_POINTER(ThetaSketchIntersection((ThetaSketch *) PG_GETARG_VARLENA_P(0),
+			(ThetaSketch *) PG_GETARG_VARLENA_P(1)));
+}
+
+/*
+ * Returns a sketch of the elements of the first sketch that aren't in the second one
+ */
+Datum
+theta_a_not_b(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(PG_GETARG_VARLENA_P(0));
+
+	PG_RETURN_POINTER(ThetaSketchANotB((ThetaSketch *) PG_GETARG_VARLENA_P(0),
+			(ThetaSketch *) PG_GETARG_VARLENA_P(1)));
+}
+
+/*
+ * Returns the estimated number of distinct elements in the given sketch
+ */
+Datum
+theta_estimate(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT64(0);
+
+	PG_RETURN_INT64((int64) rint(ThetaSketchEstimate((ThetaSketch *) PG_GETARG_VARLENA_P(0))));
+}
+
+Datum
+theta_empty(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(ThetaSketchCreate());
+}
+
+Datum
+theta_emptyp(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(theta_create(PG_GETARG_INT32(0)));
+}
+
+Datum
+theta_add(PG_FUNCTION_ARGS)
+{
+	ThetaSketch *ts;
+
+	if (PG_ARGISNULL(0))
+		ts = ThetaSketchCreate();
+	else
+		ts = ThetaSketchCopy((ThetaSketch *) PG_GETARG_VARLENA_P(0));
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(ts);
+
+	fcinfo->flinfo->fn_extra = lookup_type_cache(get_fn_expr_argtype(fcinfo->flinfo, 1), 0);
+	ts = theta_add_datum(fcinfo, ts, PG_GETARG_DATUM(1));
+
+	PG_RETURN_POINTER(ts);
+}
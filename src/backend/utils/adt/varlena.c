@@ -79,6 +79,12 @@ typedef struct
 
 typedef struct StringAggState
 {
+	/*
+	 * Serialized state this one was deserialized from, or NULL. Its string
+	 * precedes buf, which then only holds what was appended after it.
+	 */
+	bytea *base;
+
 	/* string being built */
 	StringInfo buf;
 
@@ -121,6 +127,7 @@ static Datum text_to_array_internal(PG_FUNCTION_ARGS);
 static text *array_to_text_internal(FunctionCallInfo fcinfo, ArrayType *v,
 					   const char *fldsep, const char *null_string);
 static StringAggState *makeStringAggState(FunctionCallInfo fcinfo);
+static bytea *string_agg_state_result(StringAggState *state);
 static bool text_format_parse_digits(const char **ptr, const char *end_ptr,
 						 int *value);
 static const char *text_format_parse_format(const char *start_ptr,
@@ -494,12 +501,7 @@ bytea_string_agg_finalfn(PG_FUNCTION_ARGS)
 
 	if (state != NULL)
 	{
-		bytea *result;
-		int size = state->buf->len - state->dlen;
-		result = (bytea *) palloc(size + VARHDRSZ);
-		SET_VARSIZE(result, size + VARHDRSZ);
-		memcpy(VARDATA(result), state->buf->data + state->dlen, size);
-		PG_RETURN_BYTEA_P(result);
+		PG_RETURN_BYTEA_P(string_agg_state_result(state));
 	}
 	else
 		PG_RETURN_NULL();
@@ -4351,6 +4353,11 @@ string_agg_transfn(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(state);
 }
 
+/* base string of a deserialized state, following its first delimiter length */
+#define STRING_AGG_BASE_DATA(state) (VARDATA((state)->base) + sizeof(int32))
+#define STRING_AGG_BASE_LEN(state) \
+	((state)->base ? VARSIZE((state)->base) - VARHDRSZ - sizeof(int32) : 0)
+
 /*
  * Serializes a string aggregation transition state for transmission
  * to an external process
@@ -4360,43 +4367,55 @@ stringaggstatesend(PG_FUNCTION_ARGS)
 {
 	StringAggState *state = PG_ARGISNULL(0) ? NULL : (StringAggState *) PG_GETARG_POINTER(0);
 	StringInfoData buf;
-	bytea *result;
-	int nbytes;
-
-	initStringInfo(&buf);
 
-	pq_sendint(&buf, state->dlen, sizeof(int));
-	appendStringInfoString(&buf, state->buf->data);
+	if (state == NULL)
+		PG_RETURN_NULL();
 
-	nbytes = buf.len - buf.cursor;
-	result = (bytea *) palloc(nbytes + VARHDRSZ);
-	SET_VARSIZE(result, nbytes + VARHDRSZ);
+	pq_begintypsend(&buf);
+	enlargeStringInfo(&buf, sizeof(int32) + STRING_AGG_BASE_LEN(state) + state->buf->len);
 
-	pq_copymsgbytes(&buf, VARDATA(result), nbytes);
+	pq_sendint(&buf, state->dlen, sizeof(int32));
+	if (state->base)
+		pq_sendbytes(&buf, STRING_AGG_BASE_DATA(state), STRING_AGG_BASE_LEN(state));
+	pq_sendbytes(&buf, state->buf->data, state->buf->len);
 
-	PG_RETURN_BYTEA_P(result);
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
 
 /*
  * Deserializes a string aggregation transition state sent by an
  * external process
+ *
+ * The serialized string isn't copied into the state's buffer, but kept as its
+ * base: combines then only copy the incoming strings, and the whole string is
+ * assembled once, when the state is serialized or finalized.
  */
 Datum
 stringaggstaterecv(PG_FUNCTION_ARGS)
 {
-	bytea *bytesin = (bytea *) PG_GETARG_BYTEA_P(0);
 	StringAggState *result;
 	StringInfoData buf;
-	int nbytes = VARSIZE(bytesin) - VARHDRSZ;
+	MemoryContext context;
+	MemoryContext old;
 
-	result = (StringAggState *) palloc0(sizeof(StringAggState));
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	initStringInfo(&buf);
-	appendBinaryStringInfo(&buf, VARDATA(bytesin), nbytes);
+	if (!AggCheckCallContext(fcinfo, &context))
+		context = fcinfo->flinfo->fn_mcxt;
 
-	result->dlen = pq_getmsgint(&buf, sizeof(int));
-	result->buf = makeStringInfo();
-	appendStringInfoString(result->buf, pq_getmsgbytes(&buf, nbytes - sizeof(int)));
+	result = makeStringAggState(fcinfo);
+
+	old = MemoryContextSwitchTo(context);
+	result->base = PG_GETARG_BYTEA_P_COPY(0);
+	MemoryContextSwitchTo(old);
+
+	buf.data = VARDATA(result->base);
+	buf.len = VARSIZE(result->base) - VARHDRSZ;
+	buf.maxlen = buf.len;
+	buf.cursor = 0;
+
+	result->dlen = pq_getmsgint(&buf, sizeof(int32));
 
 	PG_RETURN_POINTER(result);
 }
@@ -4410,18 +4429,46 @@ string_agg_combine(PG_FUNCTION_ARGS)
 	StringAggState *state = PG_ARGISNULL(0) ? NULL : (StringAggState *) PG_GETARG_POINTER(0);
 	StringAggState *incoming = PG_ARGISNULL(1) ? NULL : (StringAggState *) PG_GETARG_POINTER(1);
 
+	if (incoming == NULL)
+		PG_RETURN_POINTER(state);
+
 	if (state == NULL)
 	{
 		state = makeStringAggState(fcinfo);
 		state->dlen = incoming->dlen;
 	}
 
-	if (incoming != NULL)
-		appendStringInfoString(state->buf, incoming->buf->data);
+	if (incoming->base)
+		appendBinaryStringInfo(state->buf, STRING_AGG_BASE_DATA(incoming), STRING_AGG_BASE_LEN(incoming));
+	appendBinaryStringInfo(state->buf, incoming->buf->data, incoming->buf->len);
 
 	PG_RETURN_POINTER(state);
 }
 
+/*
+ * Assembles the aggregated string of a state, without its first delimiter
+ */
+static bytea *
+string_agg_state_result(StringAggState *state)
+{
+	int baselen = STRING_AGG_BASE_LEN(state);
+	int size = baselen + state->buf->len - state->dlen;
+	bytea *result = (bytea *) palloc(size + VARHDRSZ);
+
+	SET_VARSIZE(result, size + VARHDRSZ);
+
+	if (baselen)
+	{
+		Assert(baselen >= state->dlen);
+		memcpy(VARDATA(result), STRING_AGG_BASE_DATA(state) + state->dlen, baselen - state->dlen);
+		memcpy(VARDATA(result) + baselen - state->dlen, state->buf->data, state->buf->len);
+	}
+	else
+		memcpy(VARDATA(result), state->buf->data + state->dlen, size);
+
+	return result;
+}
+
 Datum
 string_agg_finalfn(PG_FUNCTION_ARGS)
 {
@@ -4431,8 +4478,7 @@ string_agg_finalfn(PG_FUNCTION_ARGS)
 
 	/* trim off the delimiter of the first element */
 	if (state != NULL)
-		PG_RETURN_TEXT_P(cstring_to_text_with_len(
-				state->buf->data + state->dlen, state->buf->len - state->dlen));
+		PG_RETURN_TEXT_P(string_agg_state_result(state));
 	else
 		PG_RETURN_NULL();
 }
@@ -16,8 +16,17 @@
 
 #include "miscadmin.h"
 #include "pipeline/cont_plan.h"
+#include "pipeline/cont_instrument.h"
+#include "pipeline/cont_memory.h"
+#include "pipeline/cont_query_cache.h"
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/ipc/broker.h"
+#include "pipeline/read_cache.h"
+#include "pipeline/stream_batch.h"
+#include "pipeline/stream_desc.h"
+#include "pipeline/stream_log.h"
+#include "pipeline/stream_quota.h"
+#include "pipeline/stream_readers.h"
 #include "storage/shm_alloc.h"
 #include "tcop/utility.h"
 
@@ -34,6 +43,15 @@ PipelineShmemInit()
 	ShmemDynAllocShmemInit();
 	ContQuerySchedulerShmemInit();
 	IPCMessageBrokerShmemInit();
+	StreamDescCacheShmemInit();
+	ContQueryCacheShmemInit();
+	StreamReadersCacheShmemInit();
+	ContInstrumentShmemInit();
+	ContQueryMemoryShmemInit();
+	ReadCacheShmemInit();
+	StreamBatchShmemInit();
+	StreamLogShmemInit();
+	StreamQuotaShmemInit();
 }
 
 /*
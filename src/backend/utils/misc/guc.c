@@ -54,9 +54,21 @@
 #include "parser/parser.h"
 #include "parser/scansup.h"
 #include "pgstat.h"
+#include "pipeline/combinerReceiver.h"
 #include "pipeline/cont_analyze.h"
+#include "pipeline/cont_execute.h"
+#include "pipeline/cont_memory.h"
 #include "pipeline/cqmatrel.h"
+#include "pipeline/metrics.h"
+#include "pipeline/read_cache.h"
+#include "pipeline/sink.h"
 #include "pipeline/stream.h"
+#include "pipeline/stream_batch.h"
+#include "pipeline/stream_log.h"
+#include "pipeline/stream_quota.h"
+#include "pipeline/stream_capture.h"
+#include "pipeline/stream_fdw.h"
+#include "pipeline/sw_vacuum.h"
 #include "pipeline/update.h"
 #include "postmaster/autovacuum.h"
 #include "postmaster/bgworker.h"
@@ -205,6 +217,27 @@ static const struct config_enum_entry bytea_output_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry stream_insert_backpressure_options[] = {
+	{"block", STREAM_BACKPRESSURE_BLOCK, false},
+	{"fail", STREAM_BACKPRESSURE_FAIL, false},
+	{"shed", STREAM_BACKPRESSURE_SHED, false},
+	{"spill", STREAM_BACKPRESSURE_SPILL, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry stream_insert_quota_key_options[] = {
+	{"role", STREAM_QUOTA_KEY_ROLE, false},
+	{"stream", STREAM_QUOTA_KEY_STREAM, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry stream_insert_quota_action_options[] = {
+	{"delay", STREAM_QUOTA_DELAY, false},
+	{"reject", STREAM_QUOTA_REJECT, false},
+	{"sample", STREAM_QUOTA_SAMPLE, false},
+	{NULL, 0, false}
+};
+
 /*
  * We have different sets for client and server message level options because
  * they sort slightly different (see "log" level)
@@ -1635,6 +1668,275 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"stream_log", PGC_POSTMASTER, QUERY_TUNING,
+		 gettext_noop("Logs stream inserts to disk before they return, and replays them after a restart."),
+		 gettext_noop("Stream inserts then return once their events are logged, without waiting for them "
+					  "to be consumed. Requires synchronous_stream_insert.")
+		},
+		&stream_log,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_deferred_ack", PGC_USERSET, QUERY_TUNING,
+		 gettext_noop("Makes synchronous stream inserts return without waiting for their events to be consumed."),
+		 gettext_noop("Each insert's events can be waited on later with pipeline_wait_for_stream_insert, "
+					  "using the token returned by pipeline_stream_insert_token.")
+		},
+		&stream_insert_deferred_ack,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_columnar_batches", PGC_USERSET, QUERY_TUNING,
+		 gettext_noop("Encodes batched stream events column by column in worker queues."),
+		 gettext_noop("Workers then read only the attributes each continuous view needs, "
+					  "without deforming whole events.")
+		},
+		&stream_insert_columnar_batches,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_batched_join_probes", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes stream-table index joins probe the table once per batch in join key order."),
+		 gettext_noop("Such joins are then costed by batch size and compared with the other join strategies.")
+		},
+		&continuous_query_batched_join_probes,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_reuse_worker_plans", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes workers keep initialized plans across batches, rescanning them instead of reinitializing them."),
+		 gettext_noop("Plans are rebuilt after catalog changes, and only plans that read nothing but streams are kept.")
+		},
+		&continuous_query_reuse_worker_plans,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_worker_share_sw_steps", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes workers compute step-level partial results once for sliding-window continuous views that only differ in window length."),
+		 gettext_noop("Only applies to grouped views whose windows are over arrival_timestamp and have the same step size.")
+		},
+		&continuous_query_worker_share_sw_steps,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_fuse_transforms", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes workers hand the output of continuous transforms directly to the queries reading it."),
+		 gettext_noop("Only applies to output streams whose readers have yet to execute in the worker's current batch "
+					  "and aren't pinned to a worker pool. Other output is written to the workers' queues.")
+		},
+		&continuous_query_fuse_transforms,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_view_sw_time_index", PGC_USERSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Makes new sliding-window continuous views index their time column with BRIN."),
+		 gettext_noop("Vacuum uses the index to only look at the parts of the view that may contain expired rows.")
+		},
+		&continuous_view_sw_time_index,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_view_window_index", PGC_USERSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Makes new continuous views with WINDOWs index their PARTITION BY and ORDER BY columns."),
+		 gettext_noop("Reads use the index to only visit the partitions they need, already in window order.")
+		},
+		&continuous_view_window_index,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_inplace_updates", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes combiners overwrite existing groups in place when only fixed-width, non-indexed columns change."),
+		 gettext_noop("This avoids creating new tuple versions that must be vacuumed, but in-place writes "
+					  "are not rolled back if the combiner's transaction fails. Sketch columns of continuous views "
+					  "created while this is enabled are stored out-of-line without compression, so that only "
+					  "their changed chunks are rewritten.")
+		},
+		&continuous_query_combiner_inplace_updates,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_group_filter", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes combiners keep a Bloom filter of each continuous view's group hashes."),
+		 gettext_noop("Groups the filter rules out are inserted without being looked up in the view first.")
+		},
+		&continuous_query_combiner_group_filter,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_adaptive_fillfactor", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes combiners lower the fillfactor of continuous views whose updates are too rarely HOT."),
+		 gettext_noop("Updates that aren't HOT must insert into each of the view's indexes. "
+					  "The fillfactor isn't lowered below continuous_view_min_fillfactor.")
+		},
+		&continuous_query_combiner_adaptive_fillfactor,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_batch_index_inserts", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes combiners insert index entries of continuous views' tables all at once for each sync."),
+		 gettext_noop("Entries of non-unique btree indexes are sorted and inserted in key order. "
+					  "Unique indexes are still maintained row by row.")
+		},
+		&continuous_query_combiner_batch_index_inserts,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_reuse_result_rels", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes combiners keep the index information of continuous views' tables across syncs."),
+		 gettext_noop("It is rebuilt after any relcache invalidation, and the indexes are still locked for each sync.")
+		},
+		&continuous_query_combiner_reuse_result_rels,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_isolate_syncs", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes combiners sync each continuous view in its own subtransaction."),
+		 gettext_noop("A failed sync then only rolls back its own view's rows rather than those of every view "
+					  "synced in the same transaction.")
+		},
+		&continuous_query_combiner_isolate_syncs,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_incremental_sw", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes combiners only recompute sliding-window groups whose windows changed on each step."),
+		 gettext_noop("A group's window changes when one of its steps is updated or leaves the window. "
+					  "When off, every group is recomputed from all of its steps on each step.")
+		},
+		&continuous_query_combiner_incremental_sw,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_work_stealing", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes idle workers read events that have waited in other workers' queues for too long."),
+		 gettext_noop("Only events that have waited longer than continuous_query_max_wait are taken.")
+		},
+		&continuous_query_work_stealing,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_batch_arena", PGC_BACKEND, RESOURCES_MEM,
+		 gettext_noop("Makes continuous query processes allocate memory that only lives for a batch from arenas."),
+		 gettext_noop("Arenas make such allocations cheaper, but only reclaim most freed space at the end of "
+					  "the batch.")
+		},
+		&continuous_query_batch_arena,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_prewarm", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes continuous query processes build their plans and caches as soon as they start."),
+		 gettext_noop("Combiners also fill their group caches from continuous views, so that processes "
+					  "started after a restart or a standby's promotion are up to speed sooner.")
+		},
+		&continuous_query_prewarm,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_adaptive_batching", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes continuous query processes adapt their batch size and wait to their load."),
+		 gettext_noop("Batches grow while there is a backlog and shrink while queues are shallow, and waits are "
+					  "shortened to meet continuous_query_latency_target. continuous_query_batch_size and "
+					  "continuous_query_max_wait are then upper bounds.")
+		},
+		&continuous_query_adaptive_batching,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_shared_stream_scan", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes workers decode each stream event once per batch for all queries that read it."),
+		 gettext_noop("This reduces worker CPU usage when many continuous queries read the same stream.")
+		},
+		&continuous_query_shared_stream_scan,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_shared_stream_exprs", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes workers compute expressions over stream columns shared by several queries once per event."),
+		 gettext_noop("This applies to function calls on variable-length values, such as JSON field extraction, "
+					  "evaluated by the stream scans of continuous queries or the aggregates directly above them.")
+		},
+		&continuous_query_shared_stream_exprs,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_vectorized_quals", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Makes stream scans evaluate simple comparisons over vectors of events."),
+		 gettext_noop("Events rejected by these comparisons are never formed into tuples.")
+		},
+		&continuous_query_vectorized_quals,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_autoscale", PGC_SIGHUP, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Starts and stops each database's combiner processes as their load changes."),
+		 gettext_noop("Up to continuous_query_num_combiners combiners, or a database's own "
+					  "continuous_query_database_num_combiners, are run. This has no effect if "
+					  "continuous_query_num_active_combiners is set.")
+		},
+		&continuous_query_combiner_autoscale,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_ipc_lock_free_insert", PGC_POSTMASTER, QUERY_TUNING,
+		 gettext_noop("Lets stream inserts write to worker IPC queues without taking the queue lock."),
+		 gettext_noop("Producers reserve queue space atomically and publish their writes in order, "
+					  "so ingest throughput scales with the number of concurrent clients.")
+		},
+		&continuous_query_ipc_lock_free_insert,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"continuous_queries_enabled", PGC_USERSET, DEVELOPER_OPTIONS,
 		 gettext_noop("Continuous queries should be be enabled upon creation."),
@@ -1655,6 +1957,17 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"continuous_query_lazy_activation", PGC_SIGHUP, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Only start a database's continuous query processes once they're needed."),
+		 gettext_noop("Processes are started by the first stream insert into the database, or by creating or "
+					  "activating a continuous query in it. Once started, they keep running.")
+		},
+		&continuous_query_lazy_activation,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"anonymous_update_checks", PGC_POSTMASTER, DEVELOPER_OPTIONS,
 		 gettext_noop("Anonymously check for available updates."),
@@ -2771,6 +3084,89 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"continuous_query_combiner_group_cache_mem", PGC_BACKEND, RESOURCES_MEM,
+		 gettext_noop("Sets the maximum memory each combiner may use to cache the groups of each continuous view."),
+		 gettext_noop("Cached groups are updated without first being looked up in the continuous view, "
+					  "and the least recently used groups are evicted once this much memory is used. "
+					  "Zero disables caching."),
+		 GUC_UNIT_KB
+		},
+		&continuous_query_combiner_group_cache_mem,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_sw_cache_mem", PGC_SIGHUP, RESOURCES_MEM,
+		 gettext_noop("Sets the maximum memory each combiner may use to cache the steps of each sliding-window continuous view."),
+		 gettext_noop("Once this much memory is used, the steps of the least recently used groups are evicted "
+					  "and read back from the continuous view when their window changes. Zero means no limit."),
+		 GUC_UNIT_KB
+		},
+		&continuous_query_combiner_sw_cache_mem,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_state_mem", PGC_SIGHUP, RESOURCES_MEM,
+		 gettext_noop("Sets the maximum memory each worker and combiner may use for the state of each continuous query."),
+		 gettext_noop("A state over this much memory after executing its query gives up what can be rebuilt: workers "
+					  "release its kept plan, combiners sync its pending results and empty its caches. Zero means no limit."),
+		 GUC_UNIT_KB
+		},
+		&continuous_query_state_mem,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_view_read_cache_mem", PGC_POSTMASTER, RESOURCES_MEM,
+		 gettext_noop("Sets the shared memory used to cache the rows of recently updated groups of continuous views."),
+		 gettext_noop("Only views created with a read_cache_key are cached, and their cached rows are read with "
+					  "pipeline_cached_row. Zero disables the cache."),
+		 GUC_UNIT_KB
+		},
+		&continuous_view_read_cache_mem,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_delta_compaction_interval", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Sets the time after which combiners merge the delta rows of delta-merge continuous views."),
+		 gettext_noop("Delta rows are combined when the continuous view is read, so a higher value makes "
+					  "syncs cheaper but reads of recently updated groups more expensive."),
+		 GUC_UNIT_MS
+		},
+		&continuous_query_delta_compaction_interval,
+		10000, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"sliding_window_vacuum_batch_size", PGC_SIGHUP, AUTOVACUUM,
+		 gettext_noop("Sets the maximum number of expired rows deleted from a sliding-window continuous view per transaction."),
+		 gettext_noop("Each batch commits before the next one starts, and vacuum cost-based delays apply between "
+					  "batches. 0 deletes all expired rows in a single transaction.")
+		},
+		&sliding_window_vacuum_batch_size,
+		10000, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"sliding_window_auto_step_rows", PGC_SIGHUP, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets the number of rows a window of a sliding-window continuous view with step_factor = 'auto' should span."),
+		 gettext_noop("Such views use the smallest step size that is expected to keep the number of rows in their "
+					  "window below this, based on their observed ingest rate and number of groups.")
+		},
+		&sliding_window_auto_step_rows,
+		100000, 1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"continuous_query_max_wait", PGC_SIGHUP, QUERY_TUNING,
 		 gettext_noop("Sets the time a continuous query process will wait for a batch to accumulate."),
@@ -2783,6 +3179,76 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"continuous_query_latency_target", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Sets the end-to-end latency continuous_query_adaptive_batching aims for."),
+		 gettext_noop("Workers and combiners each aim for half of it."),
+		 GUC_UNIT_MS
+		},
+		&continuous_query_latency_target,
+		1000, 1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_worker_partials_mem", PGC_SIGHUP, RESOURCES_MEM,
+		 gettext_noop("Sets the maximum memory each continuous view may use for holding partial results in workers."),
+		 gettext_noop("Workers combine partial results across batches until they exceed this much memory, "
+					  "which reduces the number of partial results combiners receive. Zero sends "
+					  "partial results to combiners at the end of every batch."),
+		 GUC_UNIT_KB
+		},
+		&continuous_query_worker_partials_mem,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_worker_partials_max_wait", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Sets the maximum time workers hold on to partial results before sending them to combiners."),
+		 NULL,
+		 GUC_UNIT_MS
+		},
+		&continuous_query_worker_partials_max_wait,
+		1000, 1, 60000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_worker_hot_group_threshold", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Sets the percentage of recent batches a group must appear in for workers to hold its partial results."),
+		 gettext_noop("Partial results of such groups are combined across batches in workers, as if "
+					  "continuous_query_worker_partials_mem were set for them alone, so that the combiner "
+					  "owning them doesn't receive them for every batch. Zero disables this.")
+		},
+		&continuous_query_worker_hot_group_threshold,
+		0, 0, 100,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_join_cache_max_age", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Sets the maximum time workers keep hash tables built over tables joined against streams, and the results of uncorrelated subqueries over tables."),
+		 gettext_noop("They are rebuilt sooner when their tables are altered or modified. "
+					  "Zero rebuilds them for every batch."),
+		 GUC_UNIT_MS
+		},
+		&continuous_query_join_cache_max_age,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_stream_join_buffer_size", PGC_SIGHUP, RESOURCES_MEM,
+		 gettext_noop("Sets the maximum memory workers use to buffer the events of each stream of a stream-stream join."),
+		 gettext_noop("The oldest events are expired before the end of their join window once it's exceeded."),
+		 GUC_UNIT_KB
+		},
+		&continuous_query_stream_join_buffer_size,
+		16384, 64, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"continuous_query_batch_size", PGC_SIGHUP, QUERY_TUNING,
 		 gettext_noop("Sets the maximum number of events to accumulate before executing a continuous query plan on them."),
@@ -2803,6 +3269,134 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"continuous_query_database_num_combiners", PGC_SUSET, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the number of combiner processes to use for a database."),
+		 gettext_noop("Set with ALTER DATABASE ... SET, it takes effect when the database's processes "
+					  "are started. Zero uses continuous_query_num_combiners, which is also the maximum.")
+		},
+		&continuous_query_database_num_combiners,
+		0, 0, MAX_BACKENDS,
+		check_continuous_query_database_setting, NULL, NULL
+	},
+
+	{
+		{"continuous_query_database_num_workers", PGC_SUSET, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the number of worker processes to use for a database."),
+		 gettext_noop("Set with ALTER DATABASE ... SET, it takes effect when the database's processes "
+					  "are started. Zero uses continuous_query_num_workers, which is also the maximum.")
+		},
+		&continuous_query_database_num_workers,
+		0, 0, MAX_BACKENDS,
+		check_continuous_query_database_setting, NULL, NULL
+	},
+
+	{
+		{"continuous_query_num_active_combiners", PGC_SIGHUP, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the number of each database's combiner processes that groups are spread over."),
+		 gettext_noop("Changing it moves groups between running combiners without a restart. The remaining "
+					  "combiners are left idle. Zero spreads groups over all combiners.")
+		},
+		&continuous_query_num_active_combiners,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_autoscale_busy_time", PGC_SIGHUP, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the time all of a database's combiners must have a backlog for before another one is started."),
+		 NULL,
+		 GUC_UNIT_MS
+		},
+		&continuous_query_combiner_autoscale_busy_time,
+		5000, 100, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_autoscale_idle_time", PGC_SIGHUP, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the time one of a database's combiners must be idle for before one is stopped."),
+		 NULL,
+		 GUC_UNIT_MS
+		},
+		&continuous_query_combiner_autoscale_idle_time,
+		60000, 100, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_num_ipc_brokers", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the number of IPC message broker processes."),
+		 gettext_noop("Worker queues of all databases are spread across brokers, so more brokers "
+					  "remove the serial bottleneck of moving messages between workers.")
+		},
+		&continuous_query_num_ipc_brokers,
+		1, 1, MAX_IPC_BROKERS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_metrics_port", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the TCP port continuous query stats are served on in the OpenMetrics format."),
+		 gettext_noop("The stats are served at /metrics. 0 disables the exporter.")
+		},
+		&continuous_query_metrics_port,
+		0, 0, 65535,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_sink_queue_size", PGC_POSTMASTER, RESOURCES_MEM,
+		 gettext_noop("Sets the shared memory per DB used to queue rows for the sink process."),
+		 gettext_noop("Continuous transforms wait for the sink process once it's full."),
+		 GUC_UNIT_KB
+		},
+		&continuous_query_sink_queue_size,
+		8192, 256, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_sink_batch_size", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Sets the maximum number of rows the sink process delivers at once."),
+		 NULL
+		},
+		&continuous_query_sink_batch_size,
+		1000, 1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_sink_max_retries", PGC_SIGHUP, QUERY_TUNING,
+		 gettext_noop("Sets the number of times the sink process retries a failed delivery before dropping its rows."),
+		 NULL
+		},
+		&continuous_query_sink_max_retries,
+		3, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_ipc_spin_time", PGC_SIGHUP, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the maximum time in microseconds a continuous query process spins on its queues before sleeping."),
+		 gettext_noop("Producers don't need to wake up a spinning consumer, which avoids a system call per "
+					  "message at high message rates. 0 disables spinning.")
+		},
+		&continuous_query_ipc_spin_time,
+		0, 0, 10000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_transform_queue_weight", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets how many messages workers read from their transform queue for each message read from their insert queue."),
+		 gettext_noop("0 always reads the transform queue first.")
+		},
+		&continuous_query_transform_queue_weight,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"continuous_query_num_workers", PGC_BACKEND, RESOURCES_ASYNCHRONOUS,
 		 gettext_noop("Sets the number of parallel continuous query worker processes to use for each database."),
@@ -2823,6 +3417,80 @@ static struct config_int ConfigureNamesInt[] =
 		50, 1, 100,
 		NULL, NULL, NULL
 	},
+
+	{
+		{"continuous_view_min_fillfactor", PGC_SIGHUP, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets the lowest fillfactor combiners may give continuous views with adaptive fillfactors."),
+		 NULL
+		},
+		&continuous_view_min_fillfactor,
+		20, 10, 100,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_view_ttl_batch_size", PGC_SIGHUP, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets the maximum number of expired groups each combiner deletes from a continuous view with a ttl per transaction."),
+		 gettext_noop("Combiners delete expired groups while they're idle, and at least every few seconds otherwise.")
+		},
+		&continuous_view_ttl_batch_size,
+		1000, 1, INT_MAX,
+		NULL, NULL, NULL
+	},
+	{
+		{"stream_insert_backpressure_timeout", PGC_USERSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets the maximum time a blocked stream insert waits for worker queue space."),
+		 gettext_noop("Zero waits forever."),
+		 GUC_UNIT_MS
+		},
+		&stream_insert_backpressure_timeout,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_batch_id_retention", PGC_SIGHUP, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets how long combiners remember the stream batch ids they've committed."),
+		 gettext_noop("A batch retried after that long may be counted twice."),
+		 GUC_UNIT_S
+		},
+		&stream_insert_batch_id_retention,
+		86400, 1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_spill_limit", PGC_SIGHUP, RESOURCES_DISK,
+		 gettext_noop("Sets the maximum amount of disk space each worker queue may spill to with the spill backpressure policy."),
+		 gettext_noop("Stream inserts block once a queue's spill files reach this size."),
+		 GUC_UNIT_KB
+		},
+		&stream_insert_spill_limit,
+		1024 * 1024, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_quota_events", PGC_SUSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets the maximum number of events per second that stream inserts may write."),
+		 gettext_noop("Zero means no limit. Usage is shared according to stream_insert_quota_key.")
+		},
+		&stream_insert_quota_events,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_quota_bytes", PGC_SUSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets the maximum amount of event data per second that stream inserts may write."),
+		 gettext_noop("Zero means no limit. Usage is shared according to stream_insert_quota_key."),
+		 GUC_UNIT_KB
+		},
+		&stream_insert_quota_bytes,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"continuous_query_commit_interval", PGC_BACKEND, QUERY_TUNING_OTHER,
 		 gettext_noop("Sets the number of milliseconds that combiners will keep combining in memory before committing the result."),
@@ -2832,6 +3500,17 @@ static struct config_int ConfigureNamesInt[] =
 		50, 0, 60000,
 		NULL, NULL, NULL
 	},
+
+	{
+		{"continuous_query_restart_delay", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the time to wait before restarting a continuous query process that exited abnormally."),
+		 gettext_noop("Events queued for the process aren't consumed until it is restarted. Zero restarts it immediately."),
+		 GUC_UNIT_S
+		},
+		&continuous_query_restart_delay,
+		1, 0, 3600,
+		NULL, NULL, NULL
+	},
 	/* End-of-list marker */
 	{
 		{NULL, 0, 0, NULL, NULL}, NULL, 0, 0, 0, NULL, NULL, NULL
@@ -3584,6 +4263,123 @@ static struct config_string ConfigureNamesString[] =
 		NULL,
 		NULL, NULL, NULL,
 	},
+
+	{
+		{"stream_capture_directory", PGC_SUSET, LOGGING_WHAT,
+		 gettext_noop("Sets the directory that events inserted into streams are captured to for replaying."),
+		 gettext_noop("Each backend appends the batches it inserts to its own file in the directory. "
+					  "Relative paths are relative to the data directory. An empty string disables capture."),
+		 GUC_SUPERUSER_ONLY
+		},
+		&stream_capture_directory,
+		"",
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_numa_nodes", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("List of NUMA nodes to place continuous query processes and their queues on."),
+		 gettext_noop("Worker and combiner processes are assigned to nodes round robin. An empty list disables NUMA placement."),
+		 GUC_LIST_INPUT
+		},
+		&continuous_query_numa_nodes,
+		"",
+		check_continuous_query_numa_nodes, NULL, NULL
+	},
+
+	{
+		{"continuous_query_worker_pools", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("List of name:size worker pools that continuous views can be pinned to."),
+		 gettext_noop("Each database's last workers are split into these pools and the rest make up the default pool. "
+					  "Pools are ignored for databases that don't have enough workers to leave the default pool one."),
+		 GUC_LIST_INPUT
+		},
+		&continuous_query_worker_pools,
+		"",
+		check_continuous_query_worker_pools, NULL, NULL
+	},
+
+	{
+		{"continuous_query_metrics_listen_address", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Sets the host name or IP address the continuous query metrics exporter listens on."),
+		 gettext_noop("\"*\" listens on all addresses.")
+		},
+		&continuous_query_metrics_listen_address,
+		"localhost",
+		NULL, NULL, NULL
+	},
+
+	{
+		{"continuous_query_worker_cpus", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("List of CPUs to run continuous query worker processes on."),
+		 gettext_noop("Takes ranges of CPU numbers, e.g. 0-3,8. This takes precedence over continuous_query_numa_nodes. "
+					  "An empty list leaves the processes' CPU affinity as is."),
+		 GUC_LIST_INPUT
+		},
+		&continuous_query_worker_cpus,
+		"",
+		check_continuous_query_cpus, NULL, NULL
+	},
+
+	{
+		{"continuous_query_combiner_cpus", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("List of CPUs to run continuous query combiner processes on."),
+		 gettext_noop("Takes ranges of CPU numbers, e.g. 0-3,8. This takes precedence over continuous_query_numa_nodes. "
+					  "An empty list leaves the processes' CPU affinity as is."),
+		 GUC_LIST_INPUT
+		},
+		&continuous_query_combiner_cpus,
+		"",
+		check_continuous_query_cpus, NULL, NULL
+	},
+
+	{
+		{"continuous_query_broker_cpus", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("List of CPUs to run IPC message broker processes on."),
+		 gettext_noop("Takes ranges of CPU numbers, e.g. 0-3,8. This takes precedence over continuous_query_numa_nodes. "
+					  "An empty list leaves the processes' CPU affinity as is."),
+		 GUC_LIST_INPUT
+		},
+		&continuous_query_broker_cpus,
+		"",
+		check_continuous_query_cpus, NULL, NULL
+	},
+
+	{
+		{"continuous_query_scheduler_cpus", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("List of CPUs to run the continuous query scheduler process on."),
+		 gettext_noop("Takes ranges of CPU numbers, e.g. 0-3,8. This takes precedence over continuous_query_numa_nodes. "
+					  "An empty list leaves the processes' CPU affinity as is."),
+		 GUC_LIST_INPUT
+		},
+		&continuous_query_scheduler_cpus,
+		"",
+		check_continuous_query_cpus, NULL, NULL
+	},
+
+	{
+		{"continuous_query_cgroup", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
+		 gettext_noop("Control group directory to place continuous query processes in."),
+		 gettext_noop("Worker, combiner, broker and scheduler processes add themselves to its cgroup.procs when they start. "
+					  "An empty value leaves them in the postmaster's control group."),
+		 0
+		},
+		&continuous_query_cgroup,
+		"",
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_batch_id", PGC_USERSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets the id of the batch that stream inserts are part of."),
+		 gettext_noop("Inserts of a batch that was already written by an earlier statement are dropped. "
+					  "An empty value makes stream inserts part of no batch."),
+		 GUC_NOT_IN_SAMPLE
+		},
+		&stream_insert_batch_id,
+		"",
+		check_stream_insert_batch_id, assign_stream_insert_batch_id, NULL
+	},
 	/* End-of-list marker */
 	{
 		{NULL, 0, 0, NULL, NULL}, NULL, NULL, NULL, NULL, NULL
@@ -3840,6 +4636,38 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, assign_synchronous_commit, NULL
 	},
 
+	{
+		{"stream_insert_backpressure", PGC_USERSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets what stream inserts do when all worker queues are full."),
+		 gettext_noop("block waits for space, fail raises an error and shed samples events "
+					  "that are dropped as queues fill up.")
+		},
+		&stream_insert_backpressure,
+		STREAM_BACKPRESSURE_BLOCK, stream_insert_backpressure_options,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_quota_key", PGC_SUSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets whether stream insert quotas are shared by all inserts of a role or into a stream."),
+		 NULL
+		},
+		&stream_insert_quota_key,
+		STREAM_QUOTA_KEY_ROLE, stream_insert_quota_key_options,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"stream_insert_quota_action", PGC_SUSET, QUERY_TUNING_OTHER,
+		 gettext_noop("Sets what stream inserts exceeding their quota do."),
+		 gettext_noop("delay waits until the quota allows the insert, reject raises an error and sample "
+					  "only writes as many randomly chosen events as the quota allows.")
+		},
+		&stream_insert_quota_action,
+		STREAM_QUOTA_DELAY, stream_insert_quota_action_options,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	{
 		{NULL, 0, 0, NULL, NULL}, NULL, 0, NULL, NULL, NULL, NULL
@@ -0,0 +1,860 @@
+/*-------------------------------------------------------------------------
+ *
+ * arena.c
+ *	  Arena memory context definitions.
+ *
+ * An Arena is a MemoryContext for short-lived data that is allocated
+ * piecemeal and then released all at once, such as what continuous query
+ * processes build up while executing a query on a batch of events.  Chunks
+ * are carved out of a block by bumping a pointer: there are no freelists
+ * and chunk sizes aren't rounded up to powers of 2, so allocating is cheap
+ * and no space is lost to rounding.  The price is that pfree() doesn't make
+ * space reusable, except for the most recently allocated chunk, and for
+ * large chunks, which are given blocks of their own and are returned to
+ * malloc() when freed just like in an AllocSet.  repalloc() of the most
+ * recently allocated chunk grows it in place when there is room for it.
+ *
+ * Resetting an Arena frees its blocks, keeping the first one for reuse,
+ * so its cost depends on the number of blocks rather than chunks.  Since
+ * the space of freed chunks is only reclaimed by a reset, Arenas should
+ * only be used for data whose total size is bounded by the work done
+ * between resets.  Code that relies on pfree() to stay within a memory
+ * budget, such as tuplesort's or tuplestore's, doesn't fit them well.
+ *
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/mmgr/arena.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+
+/* We allow chunks to be at most 1/8 of maxBlockSize before giving them their own block */
+#define ARENA_CHUNK_FRACTION	8
+
+#define ARENA_BLOCKHDRSZ	MAXALIGN(sizeof(ArenaBlockData))
+#define ARENA_CHUNKHDRSZ	MAXALIGN(sizeof(ArenaChunkData))
+
+/* Portion of ARENA_CHUNKHDRSZ examined outside arena.c. */
+#define ARENA_CHUNK_PUBLIC	\
+	(offsetof(ArenaChunkData, size) + sizeof(Size))
+
+/* Portion of ARENA_CHUNKHDRSZ excluding trailing padding. */
+#ifdef MEMORY_CONTEXT_CHECKING
+#define ARENA_CHUNK_USED	\
+	(offsetof(ArenaChunkData, requested_size) + sizeof(Size))
+#else
+#define ARENA_CHUNK_USED	\
+	(offsetof(ArenaChunkData, size) + sizeof(Size))
+#endif
+
+typedef struct ArenaBlockData *ArenaBlock;		/* forward reference */
+typedef struct ArenaChunkData *ArenaChunk;
+
+/*
+ * ArenaContext
+ *
+ * The first block of the blocks list is the one chunks are carved out of.
+ * Large chunks' blocks are linked in behind it.
+ */
+typedef struct ArenaContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Info about storage allocated in this context: */
+	ArenaBlock	blocks;			/* head of list of blocks in this arena */
+	/* Allocation parameters for this context: */
+	Size		initBlockSize;	/* initial block size */
+	Size		maxBlockSize;	/* maximum block size */
+	Size		nextBlockSize;	/* next block size to allocate */
+	Size		allocChunkLimit;	/* larger chunks get their own block */
+	ArenaBlock	keeper;			/* if not NULL, keep this block over resets */
+} ArenaContext;
+
+typedef ArenaContext *Arena;
+
+/*
+ * ArenaBlock
+ *		The unit of memory that is obtained by arena.c from malloc().  It
+ *		holds any number of chunks, or a single large one.
+ *
+ *		Blocks are doubly linked so that large chunks' blocks can be freed
+ *		without looking for them.
+ */
+typedef struct ArenaBlockData
+{
+	Arena		arena;			/* arena that owns this block */
+	ArenaBlock	prev;			/* previous block in arena's blocks list */
+	ArenaBlock	next;			/* next block in arena's blocks list */
+	char	   *freeptr;		/* start of free space in this block */
+	char	   *endptr;			/* end of space in this block */
+}	ArenaBlockData;
+
+/*
+ * ArenaChunk
+ *		The prefix of each piece of memory in an ArenaBlock
+ *
+ * NB: this MUST match StandardChunkHeader as defined by utils/memutils.h.
+ */
+typedef struct ArenaChunkData
+{
+	/* arena is the owning arena */
+	void	   *arena;
+	/* size is always the size of the usable space in the chunk */
+	Size		size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* when debugging memory usage, also store actual requested size */
+	/* this is zero in a freed chunk */
+	Size		requested_size;
+#endif
+}	ArenaChunkData;
+
+#define ArenaIsValid(arena) PointerIsValid(arena)
+
+#define ArenaPointerGetChunk(ptr)	\
+					((ArenaChunk)(((char *)(ptr)) - ARENA_CHUNKHDRSZ))
+#define ArenaChunkGetPointer(chk)	\
+					((void *)(((char *)(chk)) + ARENA_CHUNKHDRSZ))
+#define ArenaChunkGetBlock(chk)	\
+					((ArenaBlock)(((char *)(chk)) - ARENA_BLOCKHDRSZ))
+
+/* Is the chunk the last one carved out of the arena's current block? */
+#define ArenaChunkIsLast(arena, chk) \
+	((arena)->blocks != NULL && \
+	 ((char *) (chk)) + ARENA_CHUNKHDRSZ + (chk)->size == (arena)->blocks->freeptr)
+
+/*
+ * These functions implement the MemoryContext API for Arena contexts.
+ */
+static void *ArenaAlloc(MemoryContext context, Size size);
+static void ArenaFree(MemoryContext context, void *pointer);
+static void *ArenaRealloc(MemoryContext context, void *pointer, Size size);
+static void ArenaInit(MemoryContext context);
+static void ArenaReset(MemoryContext context);
+static void ArenaDelete(MemoryContext context);
+static Size ArenaGetChunkSpace(MemoryContext context, void *pointer);
+static bool ArenaIsEmpty(MemoryContext context);
+static void ArenaStats(MemoryContext context, int level);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void ArenaCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Arena contexts.
+ */
+static MemoryContextMethods ArenaMethods = {
+	ArenaAlloc,
+	ArenaFree,
+	ArenaRealloc,
+	ArenaInit,
+	ArenaReset,
+	ArenaDelete,
+	ArenaGetChunkSpace,
+	ArenaIsEmpty,
+	ArenaStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,ArenaCheck
+#endif
+};
+
+#ifdef CLOBBER_FREED_MEMORY
+
+/* Wipe freed memory for debugging purposes */
+static void
+wipe_mem(void *ptr, size_t size)
+{
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	memset(ptr, 0x7F, size);
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, size);
+}
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void
+set_sentinel(void *base, Size offset)
+{
+	char	   *ptr = (char *) base + offset;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, 1);
+	*ptr = 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+}
+
+static bool
+sentinel_ok(const void *base, Size offset)
+{
+	const char *ptr = (const char *) base + offset;
+	bool		ret;
+
+	VALGRIND_MAKE_MEM_DEFINED(ptr, 1);
+	ret = *ptr == 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+
+	return ret;
+}
+#endif
+
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+
+/*
+ * Fill a just-allocated piece of memory with "random" data, see aset.c.
+ */
+static void
+randomize_mem(char *ptr, size_t size)
+{
+	static int	save_ctr = 1;
+	size_t		remaining = size;
+	int			ctr;
+
+	ctr = save_ctr;
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	while (remaining-- > 0)
+	{
+		*ptr++ = ctr;
+		if (++ctr > 251)
+			ctr = 1;
+	}
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr - size, size);
+	save_ctr = ctr;
+}
+#endif   /* RANDOMIZE_ALLOCATED_MEMORY */
+
+/*
+ * link_block
+ *		Links a block into the arena's blocks list, either at its head or
+ *		right behind it.
+ */
+static void
+link_block(Arena arena, ArenaBlock block, bool head)
+{
+	if (head || arena->blocks == NULL)
+	{
+		block->prev = NULL;
+		block->next = arena->blocks;
+		if (arena->blocks)
+			arena->blocks->prev = block;
+		arena->blocks = block;
+	}
+	else
+	{
+		block->prev = arena->blocks;
+		block->next = arena->blocks->next;
+		if (block->next)
+			block->next->prev = block;
+		arena->blocks->next = block;
+	}
+}
+
+static void
+unlink_block(Arena arena, ArenaBlock block)
+{
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		arena->blocks = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+}
+
+/*
+ * Public routines
+ */
+
+
+/*
+ * ArenaContextCreate
+ *		Create a new Arena context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging --- string will be copied)
+ * initBlockSize: initial allocation block size
+ * maxBlockSize: maximum allocation block size
+ *
+ * The ALLOCSET_*_INITSIZE and ALLOCSET_*_MAXSIZE parameters are reasonable
+ * choices for these.
+ */
+MemoryContext
+ArenaContextCreate(MemoryContext parent,
+				   const char *name,
+				   Size initBlockSize,
+				   Size maxBlockSize)
+{
+	Arena		arena;
+
+	/* Do the type-independent part of context creation */
+	arena = (Arena) MemoryContextCreate(T_ArenaContext,
+										sizeof(ArenaContext),
+										&ArenaMethods,
+										parent,
+										name);
+
+	/*
+	 * Make sure alloc parameters are reasonable, and save them.
+	 *
+	 * We somewhat arbitrarily enforce a minimum 1K block size.
+	 */
+	initBlockSize = MAXALIGN(initBlockSize);
+	if (initBlockSize < 1024)
+		initBlockSize = 1024;
+	maxBlockSize = MAXALIGN(maxBlockSize);
+	if (maxBlockSize < initBlockSize)
+		maxBlockSize = initBlockSize;
+	Assert(AllocHugeSizeIsValid(maxBlockSize)); /* must be safe to double */
+	arena->initBlockSize = initBlockSize;
+	arena->maxBlockSize = maxBlockSize;
+	arena->nextBlockSize = initBlockSize;
+
+	/*
+	 * Chunks that would take up a significant fraction of a block get a block
+	 * of their own, so as to waste little of the space left in the current
+	 * block when moving on to a new one, and so that their space can be given
+	 * back when they're freed.
+	 */
+	arena->allocChunkLimit = MAXALIGN_DOWN((maxBlockSize - ARENA_BLOCKHDRSZ) / ARENA_CHUNK_FRACTION -
+										   ARENA_CHUNKHDRSZ);
+
+	return (MemoryContext) arena;
+}
+
+/*
+ * ArenaInit
+ *		Context-type-specific initialization routine.
+ */
+static void
+ArenaInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: it's already OK.
+	 */
+}
+
+/*
+ * ArenaReset
+ *		Frees all memory which is allocated in the given arena.
+ *
+ * Like AllocSetReset, we hang onto the "keeper" block so that contexts that
+ * are repeatedly reset don't thrash malloc().
+ */
+static void
+ArenaReset(MemoryContext context)
+{
+	Arena		arena = (Arena) context;
+	ArenaBlock	block;
+
+	AssertArg(ArenaIsValid(arena));
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption and leaks before freeing */
+	ArenaCheck(context);
+#endif
+
+	block = arena->blocks;
+
+	/* New blocks list is either empty or just the keeper block */
+	arena->blocks = arena->keeper;
+
+	while (block != NULL)
+	{
+		ArenaBlock	next = block->next;
+
+		if (block == arena->keeper)
+		{
+			/* Reset the block, but don't return it to malloc */
+			char	   *datastart = ((char *) block) + ARENA_BLOCKHDRSZ;
+
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(datastart, block->freeptr - datastart);
+#else
+			/* wipe_mem() would have done this */
+			VALGRIND_MAKE_MEM_NOACCESS(datastart, block->freeptr - datastart);
+#endif
+			block->freeptr = datastart;
+			block->prev = NULL;
+			block->next = NULL;
+		}
+		else
+		{
+			/* Normal case, release the block */
+			context->mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+			free(block);
+		}
+		block = next;
+	}
+
+	/* Reset block size allocation sequence, too */
+	arena->nextBlockSize = arena->initBlockSize;
+}
+
+/*
+ * ArenaDelete
+ *		Frees all memory which is allocated in the given arena,
+ *		in preparation for deletion of the arena.
+ */
+static void
+ArenaDelete(MemoryContext context)
+{
+	Arena		arena = (Arena) context;
+	ArenaBlock	block = arena->blocks;
+
+	AssertArg(ArenaIsValid(arena));
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption and leaks before freeing */
+	ArenaCheck(context);
+#endif
+
+	/* Make it look empty, just in case... */
+	arena->blocks = NULL;
+	arena->keeper = NULL;
+
+	while (block != NULL)
+	{
+		ArenaBlock	next = block->next;
+
+		context->mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		block = next;
+	}
+}
+
+/*
+ * ArenaAlloc
+ *		Returns pointer to allocated memory of given size or NULL if
+ *		request could not be completed; memory is added to the arena.
+ */
+static void *
+ArenaAlloc(MemoryContext context, Size size)
+{
+	Arena		arena = (Arena) context;
+	ArenaBlock	block;
+	ArenaChunk	chunk;
+	Size		chunk_size = MAXALIGN(size);
+	Size		blksize;
+
+	AssertArg(ArenaIsValid(arena));
+
+	/*
+	 * If requested size exceeds maximum for chunks, allocate an entire block
+	 * for this request, behind the current block so that we don't lose the
+	 * use of the space remaining therein.
+	 */
+	if (chunk_size > arena->allocChunkLimit)
+	{
+		blksize = chunk_size + ARENA_BLOCKHDRSZ + ARENA_CHUNKHDRSZ;
+		block = (ArenaBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		arena->header.mem_allocated += blksize;
+		block->arena = arena;
+		block->freeptr = block->endptr = ((char *) block) + blksize;
+		link_block(arena, block, false);
+
+		chunk = (ArenaChunk) (((char *) block) + ARENA_BLOCKHDRSZ);
+	}
+	else
+	{
+		block = arena->blocks;
+
+		/*
+		 * Time to create a new block?  Whatever space is left in the current
+		 * one is given up on.
+		 */
+		if (block == NULL ||
+			(Size) (block->endptr - block->freeptr) < chunk_size + ARENA_CHUNKHDRSZ)
+		{
+			Size		required_size = chunk_size + ARENA_BLOCKHDRSZ + ARENA_CHUNKHDRSZ;
+
+			/*
+			 * The first block has size initBlockSize, and we double the space
+			 * in each succeeding block, but not more than maxBlockSize.
+			 */
+			blksize = arena->nextBlockSize;
+			arena->nextBlockSize <<= 1;
+			if (arena->nextBlockSize > arena->maxBlockSize)
+				arena->nextBlockSize = arena->maxBlockSize;
+
+			while (blksize < required_size)
+				blksize <<= 1;
+
+			block = (ArenaBlock) malloc(blksize);
+
+			/*
+			 * We could be asking for pretty big blocks here, so cope if malloc
+			 * fails.  But give up if there's less than a meg or so available...
+			 */
+			while (block == NULL && blksize > 1024 * 1024)
+			{
+				blksize >>= 1;
+				if (blksize < required_size)
+					break;
+				block = (ArenaBlock) malloc(blksize);
+			}
+
+			if (block == NULL)
+				return NULL;
+
+			arena->header.mem_allocated += blksize;
+			block->arena = arena;
+			block->freeptr = ((char *) block) + ARENA_BLOCKHDRSZ;
+			block->endptr = ((char *) block) + blksize;
+
+			/* The first block of the arena is kept over resets */
+			if (arena->keeper == NULL && blksize == arena->initBlockSize)
+				arena->keeper = block;
+
+			/* Mark unallocated space NOACCESS. */
+			VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+									   blksize - ARENA_BLOCKHDRSZ);
+
+			link_block(arena, block, true);
+		}
+
+		chunk = (ArenaChunk) (block->freeptr);
+
+		/* Prepare to initialize the chunk header. */
+		VALGRIND_MAKE_MEM_UNDEFINED(chunk, ARENA_CHUNK_USED);
+
+		block->freeptr += (chunk_size + ARENA_CHUNKHDRSZ);
+		Assert(block->freeptr <= block->endptr);
+	}
+
+	chunk->arena = (void *) arena;
+	chunk->size = chunk_size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	chunk->requested_size = size;
+	VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+							   sizeof(chunk->requested_size));
+	/* set mark to catch clobber of "unused" space */
+	if (size < chunk->size)
+		set_sentinel(ArenaChunkGetPointer(chunk), size);
+#endif
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+	/* fill the allocated space with junk */
+	randomize_mem((char *) ArenaChunkGetPointer(chunk), size);
+#endif
+
+	return ArenaChunkGetPointer(chunk);
+}
+
+/*
+ * ArenaFree
+ *		Frees allocated memory.
+ *
+ * Only large chunks and the most recently allocated chunk actually give
+ * their space back, everything else is reclaimed by the next reset.
+ */
+static void
+ArenaFree(MemoryContext context, void *pointer)
+{
+	Arena		arena = (Arena) context;
+	ArenaChunk	chunk = ArenaPointerGetChunk(pointer);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+							  sizeof(chunk->requested_size));
+	/* Test for someone scribbling on unused space in chunk */
+	if (chunk->requested_size < chunk->size)
+		if (!sentinel_ok(pointer, chunk->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 arena->header.name, chunk);
+#endif
+
+	if (chunk->size > arena->allocChunkLimit)
+	{
+		/* Big chunks are certain to have been allocated as single-chunk blocks */
+		ArenaBlock	block = ArenaChunkGetBlock(chunk);
+
+		if (block->arena != arena)
+			elog(ERROR, "could not find block containing chunk %p", chunk);
+
+		unlink_block(arena, block);
+		context->mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		return;
+	}
+
+	if (ArenaChunkIsLast(arena, chunk))
+	{
+		arena->blocks->freeptr = (char *) chunk;
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(chunk, chunk->size + ARENA_CHUNKHDRSZ);
+#else
+		VALGRIND_MAKE_MEM_NOACCESS(chunk, chunk->size + ARENA_CHUNKHDRSZ);
+#endif
+		return;
+	}
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Reset requested_size to 0 in freed chunks, so ArenaCheck skips them */
+	chunk->requested_size = 0;
+#endif
+#ifdef CLOBBER_FREED_MEMORY
+	wipe_mem(pointer, chunk->size);
+#endif
+}
+
+/*
+ * ArenaRealloc
+ *		Returns new pointer to allocated memory of given size or NULL if
+ *		request could not be completed; this memory is added to the arena.
+ *		Memory associated with given pointer is copied into the new memory,
+ *		and the old memory is freed.
+ */
+static void *
+ArenaRealloc(MemoryContext context, void *pointer, Size size)
+{
+	Arena		arena = (Arena) context;
+	ArenaChunk	chunk = ArenaPointerGetChunk(pointer);
+	Size		oldsize = chunk->size;
+	Size		chunk_size = MAXALIGN(size);
+	void	   *newPointer;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+							  sizeof(chunk->requested_size));
+	/* Test for someone scribbling on unused space in chunk */
+	if (chunk->requested_size < oldsize)
+		if (!sentinel_ok(pointer, chunk->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 arena->header.name, chunk);
+#endif
+
+	/*
+	 * Shrinking and growing within the chunk's padding leave it where it is,
+	 * as does growing the most recently allocated chunk when its block has
+	 * room for it.
+	 */
+	if (oldsize >= size ||
+		(oldsize <= arena->allocChunkLimit && chunk_size <= arena->allocChunkLimit &&
+		 ArenaChunkIsLast(arena, chunk) &&
+		 (Size) (arena->blocks->endptr - arena->blocks->freeptr) >= chunk_size - oldsize))
+	{
+		if (oldsize < size)
+		{
+			VALGRIND_MAKE_MEM_UNDEFINED(arena->blocks->freeptr, chunk_size - oldsize);
+			arena->blocks->freeptr += chunk_size - oldsize;
+			chunk->size = oldsize = chunk_size;
+		}
+
+#ifdef MEMORY_CONTEXT_CHECKING
+		chunk->requested_size = size;
+		VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+								   sizeof(chunk->requested_size));
+
+		/* set mark to catch clobber of "unused" space */
+		if (size < oldsize)
+			set_sentinel(pointer, size);
+#endif
+		VALGRIND_MAKE_MEM_DEFINED(pointer, size);
+
+		return pointer;
+	}
+
+	if (oldsize > arena->allocChunkLimit)
+	{
+		/*
+		 * The chunk must have been allocated as a single-chunk block.  Use
+		 * realloc() to make the containing block bigger with minimum space
+		 * wastage.
+		 */
+		ArenaBlock	block = ArenaChunkGetBlock(chunk);
+		Size		oldblksize = block->endptr - ((char *) block);
+		Size		blksize = chunk_size + ARENA_BLOCKHDRSZ + ARENA_CHUNKHDRSZ;
+
+		if (block->arena != arena)
+			elog(ERROR, "could not find block containing chunk %p", chunk);
+
+		block = (ArenaBlock) realloc(block, blksize);
+		if (block == NULL)
+			return NULL;
+
+		arena->header.mem_allocated += blksize - oldblksize;
+		block->freeptr = block->endptr = ((char *) block) + blksize;
+
+		/* Update pointers since block has likely been moved */
+		if (block->prev)
+			block->prev->next = block;
+		else
+			arena->blocks = block;
+		if (block->next)
+			block->next->prev = block;
+
+		chunk = (ArenaChunk) (((char *) block) + ARENA_BLOCKHDRSZ);
+		chunk->size = chunk_size;
+#ifdef MEMORY_CONTEXT_CHECKING
+		chunk->requested_size = size;
+		VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+								   sizeof(chunk->requested_size));
+		/* set mark to catch clobber of "unused" space */
+		if (size < chunk_size)
+			set_sentinel(ArenaChunkGetPointer(chunk), size);
+#endif
+
+		return ArenaChunkGetPointer(chunk);
+	}
+
+	/* Otherwise, allocate a new chunk and copy the old one into it */
+	newPointer = ArenaAlloc((MemoryContext) arena, size);
+
+	/* leave immediately if request was not completed */
+	if (newPointer == NULL)
+		return NULL;
+
+	/* transfer existing data (certain to fit) */
+	memcpy(newPointer, pointer, oldsize);
+
+	/* free old chunk */
+	ArenaFree((MemoryContext) arena, pointer);
+
+	return newPointer;
+}
+
+/*
+ * ArenaGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+ArenaGetChunkSpace(MemoryContext context, void *pointer)
+{
+	ArenaChunk	chunk = ArenaPointerGetChunk(pointer);
+
+	return chunk->size + ARENA_CHUNKHDRSZ;
+}
+
+/*
+ * ArenaIsEmpty
+ *		Is an arena empty of any allocated space?
+ */
+static bool
+ArenaIsEmpty(MemoryContext context)
+{
+	/* As for AllocSets, we say "empty" only if the context is new or just reset */
+	if (context->isReset)
+		return true;
+	return false;
+}
+
+/*
+ * ArenaStats
+ *		Displays stats about memory consumption of an arena.
+ */
+static void
+ArenaStats(MemoryContext context, int level)
+{
+	Arena		arena = (Arena) context;
+	Size		nblocks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	ArenaBlock	block;
+	int			i;
+
+	for (block = arena->blocks; block != NULL; block = block->next)
+	{
+		nblocks++;
+		totalspace += block->endptr - ((char *) block);
+		freespace += block->endptr - block->freeptr;
+	}
+
+	for (i = 0; i < level; i++)
+		fprintf(stderr, "  ");
+
+	fprintf(stderr,
+			"%s: %zu total in %zd blocks; %zu free; %zu used\n",
+			arena->header.name, totalspace, nblocks, freespace,
+			totalspace - freespace);
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * ArenaCheck
+ *		Walk through chunks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL, see AllocSetCheck.
+ */
+static void
+ArenaCheck(MemoryContext context)
+{
+	Arena		arena = (Arena) context;
+	char	   *name = arena->header.name;
+	ArenaBlock	block;
+
+	for (block = arena->blocks; block != NULL; block = block->next)
+	{
+		char	   *bpoz = ((char *) block) + ARENA_BLOCKHDRSZ;
+		long		blk_used = block->freeptr - bpoz;
+		long		blk_data = 0;
+		long		nchunks = 0;
+
+		if (block->arena != arena)
+			elog(WARNING, "problem in arena %s: bogus arena link in block %p",
+				 name, block);
+
+		if (block->next && block->next->prev != block)
+			elog(WARNING, "problem in arena %s: bad block links at block %p",
+				 name, block);
+
+		while (bpoz < block->freeptr)
+		{
+			ArenaChunk	chunk = (ArenaChunk) bpoz;
+			Size		chsize,
+						dsize;
+
+			chsize = chunk->size;		/* aligned chunk size */
+			VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+									  sizeof(chunk->requested_size));
+			dsize = chunk->requested_size;		/* real data */
+			if (dsize > 0)		/* not freed */
+				VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+										   sizeof(chunk->requested_size));
+
+			if (dsize > chsize)
+				elog(WARNING, "problem in arena %s: req size > alloc size for chunk %p in block %p",
+					 name, chunk, block);
+
+			/* single-chunk block? */
+			if (chsize > arena->allocChunkLimit &&
+				chsize + ARENA_CHUNKHDRSZ != blk_used)
+				elog(WARNING, "problem in arena %s: bad single-chunk %p in block %p",
+					 name, chunk, block);
+
+			if (chunk->arena != (void *) arena)
+				elog(WARNING, "problem in arena %s: bogus arena link in block %p, chunk %p",
+					 name, block, chunk);
+
+			if (dsize > 0 && dsize < chsize &&
+				!sentinel_ok(chunk, ARENA_CHUNKHDRSZ + dsize))
+				elog(WARNING, "problem in arena %s: detected write past chunk end in block %p, chunk %p",
+					 name, block, chunk);
+
+			blk_data += chsize;
+			nchunks++;
+
+			bpoz += ARENA_CHUNKHDRSZ + chsize;
+		}
+
+		if ((blk_data + (nchunks * ARENA_CHUNKHDRSZ)) != blk_used)
+			elog(WARNING, "problem in arena %s: found inconsistent memory block %p",
+				 name, block);
+	}
+}
+
+#endif   /* MEMORY_CONTEXT_CHECKING */
@@ -480,6 +480,33 @@ MemoryContextIsEmpty(MemoryContext context)
 	return (*context->methods->is_empty) (context);
 }
 
+/*
+ * MemoryContextMemAllocated
+ *		Space malloc'd for a memory context, and optionally its descendants.
+ *
+ * This counts whole blocks, so it includes space that's been freed within
+ * them but not given back to malloc.
+ */
+Size
+MemoryContextMemAllocated(MemoryContext context, bool recurse)
+{
+	Size		total;
+
+	AssertArg(MemoryContextIsValid(context));
+
+	total = context->mem_allocated;
+
+	if (recurse)
+	{
+		MemoryContext child;
+
+		for (child = context->firstchild; child != NULL; child = child->nextchild)
+			total += MemoryContextMemAllocated(child, true);
+	}
+
+	return total;
+}
+
 /*
  * MemoryContextStats
  *		Print statistics about the named context and all its descendants.
@@ -295,7 +295,8 @@ is_matrel(Archive *fout, TableInfo *ti, Oid matrel_oid)
  *
  * Returns true iff the given index is not an index created by CREATE CONTINUOUS VIEW,
  * which is indicated by it being the primary index on a matrel or an expression index
- * with a specific name.
+ * with a specific name. Sliding-window time indexes aren't created by CREATE CONTINUOUS VIEW
+ * during binary upgrades, so they're dumped like user indexes then.
  */
 static bool
 is_matrel_user_index(Archive *fout, Oid index_oid)
@@ -309,7 +310,12 @@ is_matrel_user_index(Archive *fout, Oid index_oid)
 	"JOIN pipeline_query pq ON pq.matrelid = i.indrelid "
 	"JOIN pg_class matrel ON pq.matrelid = matrel.oid "
 	"WHERE i.indexrelid = %u AND i.indisprimary = false "
-	"AND index.relname != matrel.relname || '_expr_idx';", index_oid);
+	"AND index.relname != matrel.relname || '_expr_idx'", index_oid);
+
+	if (!fout->dopt->binary_upgrade)
+		appendPQExpBuffer(pq, " AND index.relname != matrel.relname || '_brin_idx'");
+
+	appendPQExpBuffer(pq, ";");
 
 	res = ExecuteSqlQuery(fout, pq->data, PGRES_TUPLES_OK);
 	destroyPQExpBuffer(pq);
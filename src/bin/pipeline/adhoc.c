@@ -17,11 +17,15 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <signal.h>
+#include <sys/time.h>
 
 typedef struct App
 {
 	Model   *model;
 	Screen  *screen;
+	bool    dirty;			/* rows changed since the last screen refresh */
+	int     refresh_ms;
+	struct timeval last_refresh;
 } App;
 
 volatile bool keep_running = true;
@@ -33,6 +37,7 @@ sighandle(int x)
 }
 
 static void row_event_dispatcher(void *ctx, int type, Row *row);
+static int refresh_screen(App *app);
 
 /*
  * Initializes the padhoc app, and runs the main event loop.
@@ -43,6 +48,10 @@ static void row_event_dispatcher(void *ctx, int type, Row *row);
  * pfd[1] - screen tty fd (setup with ncurses)
  *
  * To ease debugging, the screen can be disabled (by leaving as NULL).
+ *
+ * Rows are applied to the model as soon as they arrive, but the screen is only
+ * redrawn every refresh_ms, so that high-cardinality queries whose rows change
+ * faster than they can be drawn don't saturate the client.
  */
 int
 main(int argc, char *argv[])
@@ -50,13 +59,14 @@ main(int argc, char *argv[])
 	bool ok;
 	adhoc_opts options;
 
-	App app = {0,0};
+	App app;
 	Model *model = ModelInit();
 
 	Screen *screen = 0;
 	PGRowStream *stream = 0;
 
 	memset(&options, 0, sizeof(adhoc_opts));
+	memset(&app, 0, sizeof(App));
 
 	handle_options(argc, argv, &options);
 
@@ -73,6 +83,7 @@ main(int argc, char *argv[])
 
 	app.model = model;
 	app.screen = screen;
+	app.refresh_ms = options.refresh_ms;
 
 	ok = PGRowStreamPostInit(stream);
 
@@ -91,6 +102,7 @@ main(int argc, char *argv[])
 	{
 		struct pollfd pfd[2];
 		int rc = 0;
+		int timeout = refresh_screen(&app);
 
 		memset(&pfd, 0, sizeof(pfd));
 
@@ -103,7 +115,7 @@ main(int argc, char *argv[])
 			pfd[1].events = POLLIN;
 		}
 
-		rc = poll(pfd, screen ? 2 : 1, -1);
+		rc = poll(pfd, screen ? 2 : 1, timeout);
 
 		if (rc < 0)
 		{
@@ -180,6 +192,38 @@ row_event_dispatcher(void *ctx, int type, Row *row)
 			break;
 	}
 
-	if (app->screen && dirty)
-		ScreenUpdate(app->screen);
+	if (dirty)
+	{
+		app->dirty = true;
+		if (app->refresh_ms == 0)
+			refresh_screen(app);
+	}
+}
+
+/*
+ * Redraws the screen if rows have changed and the refresh interval has passed
+ * since the last redraw. Returns how many milliseconds to wait for before the
+ * next redraw is due, or -1 if there is nothing to redraw.
+ */
+static int
+refresh_screen(App *app)
+{
+	struct timeval now;
+	long elapsed;
+
+	if (!app->dirty || !app->screen)
+		return -1;
+
+	gettimeofday(&now, NULL);
+	elapsed = (now.tv_sec - app->last_refresh.tv_sec) * 1000 +
+		(now.tv_usec - app->last_refresh.tv_usec) / 1000;
+
+	if (elapsed < app->refresh_ms)
+		return (int) (app->refresh_ms - elapsed);
+
+	ScreenUpdate(app->screen);
+	app->dirty = false;
+	app->last_refresh = now;
+
+	return -1;
 }
@@ -19,6 +19,7 @@
  * General options:
  *   -c, --command=COMMAND    run adhoc sql command
  *   -d, --dbname=DBNAME      database name to connect to (default: "pipeline")
+ *   -r, --refresh=MS         minimum milliseconds between screen refreshes (default: 100)
  * Connection options:
  *   -h, --host=HOSTNAME      database server host or socket directory (default: "local socket")
  *   -p, --port=PORT          database server port (default: "5432")
@@ -73,6 +74,8 @@ usage()
 		env = user;
 
 	printf("  -d, --dbname=DBNAME      database name to connect to (default: \"%s\")\n", env);
+	printf("  -r, --refresh=MS         minimum milliseconds between screen refreshes, 0 refreshes on\n"
+		   "                           every row (default: %d)\n", DEFAULT_REFRESH_MS);
 
 	printf("Connection options:\n");
 
@@ -120,6 +123,7 @@ parse_psql_options(int argc, char *argv[], struct adhoc_opts * options)
 	{
 		{"command", required_argument, NULL, 'c'},
 		{"dbname", required_argument, NULL, 'd'},
+		{"refresh", required_argument, NULL, 'r'},
 		{"host", required_argument, NULL, 'h'},
 		{"port", required_argument, NULL, 'p'},
 		{"username", required_argument, NULL, 'U'},
@@ -133,8 +137,9 @@ parse_psql_options(int argc, char *argv[], struct adhoc_opts * options)
 	int			c;
 
 	memset(options, 0, sizeof *options);
+	options->refresh_ms = DEFAULT_REFRESH_MS;
 
-	while ((c = getopt_long(argc, argv, "d:c:h:p:U:wW?01",
+	while ((c = getopt_long(argc, argv, "d:c:h:p:r:U:wW?01",
 							long_options, &optindex)) != -1)
 	{
 		switch (c)
@@ -151,6 +156,14 @@ parse_psql_options(int argc, char *argv[], struct adhoc_opts * options)
 			case 'p':
 				options->port = pg_strdup(optarg);
 				break;
+			case 'r':
+				options->refresh_ms = atoi(optarg);
+				if (options->refresh_ms < 0)
+				{
+					fprintf(stderr, _("%s: refresh interval must not be negative\n"), pset.progname);
+					exit(EXIT_FAILURE);
+				}
+				break;
 			case 'U':
 				options->username = pg_strdup(optarg);
 				break;
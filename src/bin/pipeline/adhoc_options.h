@@ -11,6 +11,8 @@
 
 #include "libpq-fe.h"
 
+#define DEFAULT_REFRESH_MS 100
+
 typedef struct adhoc_opts
 {
 	char	   *dbname;
@@ -18,6 +20,7 @@ typedef struct adhoc_opts
 	char	   *port;
 	char	   *username;
 	char	   *action_string;
+	int			refresh_ms;		/* minimum time between screen refreshes */
 	PGconn 	   *db;
 } adhoc_opts;
 
@@ -42,10 +42,17 @@ model_update_lens(Model *m, Row *r)
 			m->maxlens[i] = 0;
 
 		m->nfields = RowSize(r);
+		m->layout++;
 	}
 
-	for (i = 0; i < m->nfields; ++i)
-		m->maxlens[i] = Max(m->maxlens[i], RowFieldLength(r, i));
+	for (i = 0; i < RowSize(r); ++i)
+	{
+		if (RowFieldLength(r, i) > m->maxlens[i])
+		{
+			m->maxlens[i] = RowFieldLength(r, i);
+			m->layout++;
+		}
+	}
 }
 
 /* allocates and initializes the model. */
@@ -81,6 +88,7 @@ ModelHeaderRow(Model *m, Row *r)
 
 	RowCleanup(&m->header);
 	m->header = *r;
+	m->layout++;
 }
 
 /* Set the columns used in the key */
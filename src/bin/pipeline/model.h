@@ -25,6 +25,9 @@
  * The lengths are used by the view part (Screen) to format the display.
  *
  * Maxlen of a column is a high watermark. It never shrinks.
+ *
+ * layout is bumped whenever the header or a column width changes, which
+ * requires the view to redraw every row.
  */
 
 typedef struct Model
@@ -33,6 +36,7 @@ typedef struct Model
 	size_t  *maxlens;
 	size_t  nfields;
 	Row     header;
+	uint64  layout;
 } Model;
 
 extern Model *ModelInit(void);
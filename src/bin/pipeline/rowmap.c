@@ -20,10 +20,18 @@ RowSize(Row *r)
 	return r->n;
 }
 
+/*
+ * Rows are kept both in a tree, which orders them for display, and in a hash
+ * table on their key fields. Updates to existing rows, which dominate for
+ * aggregate queries, only go through the hash table.
+ */
 typedef struct TreeNode
 {
 	bsd_rb_node_t node;
 	Row row;
+	uint32 hash;
+	uint64 version;
+	struct TreeNode *next;	/* next node in the same hash bucket */
 } TreeNode;
 
 typedef struct Key
@@ -32,10 +40,16 @@ typedef struct Key
 	int is_key;
 } Key;
 
+#define ROWMAP_INIT_BUCKETS 1024
+
 struct RowMap
 {
 	bsd_rb_tree_t tree;
 	bsd_rb_tree_ops_t ops;
+	TreeNode **buckets;
+	size_t nbuckets;		/* always a power of 2 */
+	size_t count;
+	uint64 version;			/* last version given to a row */
 };
 
 void
@@ -186,6 +200,140 @@ row_cmp_row_key(Row *r1, Row *r2)
 	return 0;
 }
 
+/* FNV-1a over the field, followed by a separator so that field boundaries count */
+static inline uint32
+hash_field(uint32 h, Field *f)
+{
+	size_t i = 0;
+
+	for (i = 0; i < f->n; ++i)
+	{
+		h ^= (unsigned char) f->data[i];
+		h *= 16777619;
+	}
+
+	h ^= 0xff;
+	h *= 16777619;
+
+	return h;
+}
+
+static uint32
+hash_row_row(Row *r)
+{
+	uint32 h = 2166136261u;
+	size_t i = 0;
+
+	for (i = 0; i < g_row_key_n; ++i)
+		h = hash_field(h, RowGetField(r, g_row_key[i]));
+
+	return h;
+}
+
+static uint32
+hash_row_key(Row *key)
+{
+	uint32 h = 2166136261u;
+	size_t i = 0;
+
+	for (i = 0; i < RowSize(key); ++i)
+		h = hash_field(h, RowGetField(key, i));
+
+	return h;
+}
+
+static inline TreeNode **
+bucket(RowMap *m, uint32 hash)
+{
+	return &m->buckets[hash & (m->nbuckets - 1)];
+}
+
+/* double the number of buckets once there are more rows than buckets */
+static void
+hash_grow(RowMap *m)
+{
+	size_t nbuckets = m->nbuckets * 2;
+	TreeNode **buckets = pg_malloc0(nbuckets * sizeof(TreeNode *));
+	size_t i = 0;
+
+	for (i = 0; i < m->nbuckets; ++i)
+	{
+		TreeNode *node = m->buckets[i];
+
+		while (node)
+		{
+			TreeNode *next = node->next;
+			TreeNode **b = &buckets[node->hash & (nbuckets - 1)];
+
+			node->next = *b;
+			*b = node;
+			node = next;
+		}
+	}
+
+	pg_free(m->buckets);
+	m->buckets = buckets;
+	m->nbuckets = nbuckets;
+}
+
+static void
+hash_insert(RowMap *m, TreeNode *node)
+{
+	TreeNode **b;
+
+	if (m->count >= m->nbuckets)
+		hash_grow(m);
+
+	b = bucket(m, node->hash);
+	node->next = *b;
+	*b = node;
+	m->count++;
+}
+
+static TreeNode *
+hash_find_row(RowMap *m, Row *row, uint32 hash)
+{
+	TreeNode *node = *bucket(m, hash);
+
+	for (; node; node = node->next)
+	{
+		if (node->hash == hash && row_cmp_row_row(&node->row, row) == 0)
+			return node;
+	}
+
+	return 0;
+}
+
+static TreeNode *
+hash_find_key(RowMap *m, Row *key, uint32 hash)
+{
+	TreeNode *node = *bucket(m, hash);
+
+	for (; node; node = node->next)
+	{
+		if (node->hash == hash && row_cmp_row_key(&node->row, key) == 0)
+			return node;
+	}
+
+	return 0;
+}
+
+static void
+hash_remove(RowMap *m, TreeNode *node)
+{
+	TreeNode **b = bucket(m, node->hash);
+
+	for (; *b; b = &(*b)->next)
+	{
+		if (*b == node)
+		{
+			*b = node->next;
+			m->count--;
+			return;
+		}
+	}
+}
+
 static int
 compare_key(void *ctx, const void *a, const void *b)
 {
@@ -219,6 +367,9 @@ RowMapInit()
 
 	bsd_rb_tree_init(&m->tree, &m->ops);
 
+	m->nbuckets = ROWMAP_INIT_BUCKETS;
+	m->buckets = pg_malloc0(m->nbuckets * sizeof(TreeNode *));
+
 	return m;
 }
 
@@ -243,6 +394,7 @@ RowMapDestroy(RowMap *m)
 		pg_free(delnode);
 	}
 
+	pg_free(m->buckets);
 	memset(m, 0, sizeof(RowMap));
 	pg_free(m);
 }
@@ -256,34 +408,46 @@ GetRow(RowIterator iter)
 void
 RowMapErase(RowMap *m, Row *key)
 {
-	RowIterator iter = RowMapFindWithKey(m, key);
+	TreeNode *node;
 
-	if (iter == RowMapEnd(m))
+	if (RowSize(key) == 0)
 		return;
 
-	RowCleanup(GetRow(iter));
-	bsd_rb_tree_remove_node(&m->tree, iter);
+	node = hash_find_key(m, key, hash_row_key(key));
+
+	if (node == 0)
+		return;
+
+	hash_remove(m, node);
+	bsd_rb_tree_remove_node(&m->tree, node);
+
+	RowCleanup(&node->row);
+	pg_free(node);
 }
 
 void
 RowMapUpdate(RowMap *m, Row *row)
 {
-	TreeNode *res = 0;
-
-	TreeNode *new_node = pg_malloc0(sizeof(TreeNode));
-	new_node->row = *row;
+	uint32 hash = hash_row_row(row);
+	TreeNode *node = hash_find_row(m, row, hash);
 
-	res = bsd_rb_tree_insert_node(&m->tree, new_node);
-
-	if (res != new_node)
+	if (node)
 	{
-		/* replace old contents, free unneeded new node */
-		
-		RowCleanup(&res->row);
+		/* same key, so the node keeps its place in the tree */
+		RowCleanup(&node->row);
 
-		res->row = *row;
-		pg_free(new_node);
+		node->row = *row;
+		node->version = ++m->version;
+		return;
 	}
+
+	node = pg_malloc0(sizeof(TreeNode));
+	node->row = *row;
+	node->hash = hash;
+	node->version = ++m->version;
+
+	bsd_rb_tree_insert_node(&m->tree, node);
+	hash_insert(m, node);
 }
 
 size_t
@@ -307,18 +471,16 @@ RowMapEnd(RowMap *m)
 RowIterator
 RowMapFindWithRow(RowMap *m, Row *row)
 {
-	Key k = { row, false };
-	void *node = bsd_rb_tree_find_node(&m->tree, &k);
-
-	return node;
+	return hash_find_row(m, row, hash_row_row(row));
 }
 
 RowIterator
 RowMapFindWithKey(RowMap *m, Row *key)
 {
-	Key k = { key, true};
-	void *node = bsd_rb_tree_find_node(&m->tree, &k);
-	return node;
+	if (RowSize(key) == 0)
+		return RowMapEnd(m);
+
+	return hash_find_key(m, key, hash_row_key(key));
 }
 
 RowIterator
@@ -354,6 +516,12 @@ RowIterator RowIteratorPrev(RowMap *m, RowIterator a)
 	return bsd_rb_tree_iterate(&m->tree, a, 0);
 }
 
+uint64
+RowIteratorVersion(RowIterator a)
+{
+	return ((TreeNode *)(a))->version;
+}
+
 /* debugging funcs */
 void
 RowDump(Row *row)
@@ -48,7 +48,9 @@ extern Field *RowGetField(Row *r, size_t i);
 extern Row RowGetKey(Row *r);
 
 /*
- * Interface modelled after an rbtree. Internally it is using bsd_rbtree
+ * Interface modelled after an rbtree. Internally it is using bsd_rbtree for
+ * ordered iteration, and a hash table on the key fields for lookups and
+ * updates.
  *
  * Row data is allocated outside here, but it is cleaned up here on
  * update/delete.
@@ -79,6 +81,13 @@ extern bool RowIteratorEqual(RowIterator a, RowIterator b);
 extern RowIterator RowIteratorNext(RowMap *m, RowIterator a);
 extern RowIterator RowIteratorPrev(RowMap *m, RowIterator a);
 
+/*
+ * Changes whenever the row is updated. Versions are never reused, even by
+ * rows that later get the same storage, so a (iterator, version) pair
+ * identifies the row contents exactly.
+ */
+extern uint64 RowIteratorVersion(RowIterator a);
+
 /* debugging funcs */
 extern void RowDump(Row *row);
 extern void RowDumpToString(Row *row, PQExpBuffer buf);
@@ -83,6 +83,9 @@ ScreenDestroy(Screen *s)
 	fclose(s->term_in);
 	RowCleanup(&s->key);
 
+	pg_free(s->drawn);
+	pg_free(s->drawn_versions);
+
 	memset(s, 0, sizeof(Screen));
 	pg_free(s);
 }
@@ -135,26 +138,46 @@ rightmost(Screen *s)
 	return s->model->nfields - 1;
 }
 
+/*
+ * Add at most room characters of str, so that rows never wrap onto the next
+ * line and only the lines being redrawn change.
+ */
+static inline void
+printwn(int *room, const char *str, int n)
+{
+	n = Min(n, *room);
+
+	if (n > 0)
+	{
+		addnstr(str, n);
+		*room -= n;
+	}
+}
+
 static inline void
-printwpad(int n)
+printwpad(int *room, int n)
 {
 	int i = 0;
 
-	for (i = 0; i < n; ++i) {
-		printw("%c", ' ');
+	for (i = 0; i < n && *room > 0; ++i, --*room) {
+		addch(' ');
 	}
 }
 
 /*
- * Render a row, taking column, x_pos and padding into account.
+ * Render a row on the given line, taking column, x_pos and padding into
+ * account.
  *
  * Note - render in this context means send the data to ncurses, the tty
  * 		  won't be updated until refresh() is called
  */
 static inline void
-render_row(Screen *s, Row *row, char sep)
+render_row(Screen *s, int line, Row *row, char sep)
 {
 	size_t i = 0;
+	int room = COLS;
+
+	move(line, 0);
 
 	for (i = s->x_col; i < RowSize(row); ++i)
 	{
@@ -167,29 +190,43 @@ render_row(Screen *s, Row *row, char sep)
 
 			if (s->x_pos < fn) {
 
-				printw("%s", fv + s->x_pos);
-				printwpad(padlen - fn);
+				printwn(&room, fv + s->x_pos, fn - s->x_pos);
+				printwpad(&room, padlen - fn);
 			}
 			else {
-				printwpad(padlen - s->x_pos);
+				printwpad(&room, padlen - s->x_pos);
 			}
 		}
 		else
 		{
-			printw("%s", fv);
-			printwpad(padlen - fn);
+			printwn(&room, fv, fn);
+			printwpad(&room, padlen - fn);
 		}
 
 		if (i != (RowSize(row) - 1))
-			printw("%c", sep);
+			printwn(&room, &sep, 1);
 	}
 
-	clrtoeol();
-	printw("\n");
+	if (room > 0)
+		clrtoeol();
 }
 
 /*
- * Render the whole screen by querying the model.
+ * Everything has to be redrawn when the terminal size, the horizontal scroll
+ * position or the column widths change.
+ */
+static bool
+screen_layout_changed(Screen *s)
+{
+	return s->drawn == NULL || s->nlines != lines(s) || s->drawn_cols != COLS ||
+		s->drawn_x_pos != s->x_pos || s->drawn_x_col != s->x_col ||
+		s->drawn_layout != s->model->layout;
+}
+
+/*
+ * Render the visible part of the screen by querying the model. Only lines
+ * that show a different row, or a newer version of the same row, than what
+ * was last drawn on them are sent to ncurses.
  */
 static void
 screen_render(Screen *s)
@@ -197,29 +234,52 @@ screen_render(Screen *s)
 	/* determine the visible set of rows using key */
 	RowIterator iter = RowMapLowerBound(rowmap(s), key(s));
 	RowIterator end = RowMapEnd(rowmap(s));
+	int line = 0;
 
-	/* reposition the cursor to the origin */
-	int i = 0;
-	int ctr = 0;
-	move(ctr, 0);
-
-	/* display the header row in reverse video at the top of screen */
-	attron(A_REVERSE);
-	render_row(s, &s->model->header, '|');
-	attroff(A_REVERSE);
-	ctr++;
-
-	/* render visible set */
-	for (; !RowIteratorEqual(iter,end) && ctr < lines(s); 
-		 iter = RowIteratorNext(rowmap(s), iter), ++ctr)
+	if (screen_layout_changed(s))
 	{
-		render_row(s, GetRow(iter), ' ');
+		s->nlines = lines(s);
+		s->drawn = pg_realloc(s->drawn, Max(s->nlines, 1) * sizeof(void *));
+		s->drawn_versions = pg_realloc(s->drawn_versions, Max(s->nlines, 1) * sizeof(uint64));
+		s->drawn_x_pos = s->x_pos;
+		s->drawn_x_col = s->x_col;
+		s->drawn_cols = COLS;
+		s->drawn_layout = s->model->layout;
+
+		/* display the header row in reverse video at the top of screen */
+		attron(A_REVERSE);
+		render_row(s, 0, &s->model->header, '|');
+		attroff(A_REVERSE);
+
+		/* an iterator that can't be visible, so that every line is drawn */
+		for (line = 0; line < s->nlines; ++line)
+			s->drawn[line] = (void *) s;
 	}
 
-	/* blank out any remaining rows below the last row */
-	for (i = ctr; i < lines(s); ++i) {
-		printw("\n");
-		clrtoeol();
+	/* render visible set, blanking out any remaining lines below the last row */
+	for (line = 1; line < s->nlines; ++line)
+	{
+		uint64 version = 0;
+
+		if (!RowIteratorEqual(iter, end))
+			version = RowIteratorVersion(iter);
+
+		if (s->drawn[line] != iter || s->drawn_versions[line] != version)
+		{
+			if (!RowIteratorEqual(iter, end))
+				render_row(s, line, GetRow(iter), ' ');
+			else
+			{
+				move(line, 0);
+				clrtoeol();
+			}
+
+			s->drawn[line] = iter;
+			s->drawn_versions[line] = version;
+		}
+
+		if (!RowIteratorEqual(iter, end))
+			iter = RowIteratorNext(rowmap(s), iter);
 	}
 }
 
@@ -31,6 +31,18 @@ typedef struct Screen
 	int     x_pos;
 	int     x_col;
 	int     pause;
+
+	/*
+	 * What was last drawn on each line, so that only lines whose row or row
+	 * version changed are rendered again.
+	 */
+	int     nlines;
+	void    **drawn;
+	uint64  *drawn_versions;
+	int     drawn_x_pos;
+	int     drawn_x_col;
+	int     drawn_cols;
+	uint64  drawn_layout;
 } Screen;
 
 extern Screen *ScreenInit(Model *m);
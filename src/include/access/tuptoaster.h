@@ -144,6 +144,16 @@ extern HeapTuple toast_insert_or_update(Relation rel,
  */
 extern void toast_delete(Relation rel, HeapTuple oldtup);
 
+/* ----------
+ * toast_overwrite_datum -
+ *
+ *	Overwrites the chunks of an uncompressed, externally stored value that
+ *	differ from a new value of the same size in place. Returns the number of
+ *	chunks written, or -1 if the value can't be overwritten.
+ * ----------
+ */
+extern int toast_overwrite_datum(struct varlena * attr, struct varlena * newvalue);
+
 /* ----------
  * heap_tuple_fetch_attr() -
  *
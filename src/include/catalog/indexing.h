@@ -336,6 +336,9 @@ DECLARE_UNIQUE_INDEX(pipeline_tstate_id_index, 4252, on pipeline_tstate using bt
 DECLARE_UNIQUE_INDEX(pipeline_combine_oid_index, 4256, on pipeline_combine using btree(oid oid_ops));
 #define PipelineCombineOidIndexId					4256
 
+DECLARE_UNIQUE_INDEX(pipeline_stream_batch_id_index, 4245, on pipeline_stream_batch using btree(id int8_ops, combiner int4_ops));
+#define PipelineStreamBatchIdIndexId					4245
+
 DECLARE_UNIQUE_INDEX(pg_policy_oid_index, 3257, on pg_policy using btree(oid oid_ops));
 #define PolicyOidIndexId				3257
 
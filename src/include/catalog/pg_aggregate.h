@@ -335,6 +335,7 @@ DATA(insert ( 4326	n 0 hll_union_agg_trans	hll_cache_cardinality		-				-				-
 /* bloom filter aggregates */
 DATA(insert ( 4329	n 0 bloom_agg_trans			-	-				-				-				f f 0	5030	0	0		0	_null_ _null_ ));
 DATA(insert ( 4330	n 0 bloom_agg_transp		-	-				-				-				f f 0	5030	0	0		0	_null_ _null_ ));
+DATA(insert ( 4316	n 0 bloom_agg_trans_blocked	-	-				-				-				f f 0	5030	0	0		0	_null_ _null_ ));
 DATA(insert ( 4333	n 0 bloom_union_agg_trans	-	-				-				-				f f 0	5030	0	0		0	_null_ _null_ ));
 DATA(insert ( 4335	n 0 bloom_intersection_agg_trans	-	-		-				-				f f 0	5030	0	0		0	_null_ _null_ ));
 
@@ -347,6 +348,20 @@ DATA(insert ( 4343	n 0 tdigest_merge_agg_trans	tdigest_compress	-				-				-				f
 DATA(insert ( 4348	n 0 cmsketch_agg_trans			-	-				-				-				f f 0	5038	0	0		0	_null_ _null_ ));
 DATA(insert ( 4349	n 0 cmsketch_agg_transp			-	-				-				-				f f 0	5038	0	0		0	_null_ _null_ ));
 DATA(insert ( 4352	n 0 cmsketch_merge_agg_trans	-	-				-				-				f f 0	5038	0	0		0	_null_ _null_ ));
+DATA(insert ( 4257	n 0 cmsketch_topk_agg_trans		-	-				-				-				f f 0	5043	0	0		0	_null_ _null_ ));
+DATA(insert ( 4259	n 0 cmsketch_topk_merge_agg_trans	-	-				-				-				f f 0	5043	0	0		0	_null_ _null_ ));
+DATA(insert ( 4264	n 0 ddsketch_agg_trans		-	-				-				-				f f 0	5045	0	0		0	_null_ _null_ ));
+DATA(insert ( 4265	n 0 ddsketch_agg_transp		-	-				-				-				f f 0	5045	0	0		0	_null_ _null_ ));
+DATA(insert ( 4268	n 0 ddsketch_merge_agg_trans	-	-				-				-				f f 0	5045	0	0		0	_null_ _null_ ));
+DATA(insert ( 4277	n 0 kll_agg_trans		-	-				-				-				f f 0	5047	0	0		0	_null_ _null_ ));
+DATA(insert ( 4278	n 0 kll_agg_transp		-	-				-				-				f f 0	5047	0	0		0	_null_ _null_ ));
+DATA(insert ( 4281	n 0 kll_merge_agg_trans	-	-				-				-				f f 0	5047	0	0		0	_null_ _null_ ));
+
+/* theta sketch aggregates */
+DATA(insert ( 4290	n 0 theta_agg_trans	-	-				-				-				f f 0	5049	0	0		0	_null_ _null_ ));
+DATA(insert ( 4291	n 0 theta_agg_transp	-	-				-				-				f f 0	5049	0	0		0	_null_ _null_ ));
+DATA(insert ( 4294	n 0 theta_union_agg_trans	-	-				-				-				f f 0	5049	0	0		0	_null_ _null_ ));
+DATA(insert ( 4296	n 0 theta_intersection_agg_trans	-	-				-				-				f f 0	5049	0	0		0	_null_ _null_ ));
 
 /* filtered space saving aggregates */
 DATA(insert ( 4396	n 0 fss_agg_trans			-	-				-				-				f f 0	5041	0	0		0	_null_ _null_ ));
@@ -395,8 +410,10 @@ DATA(insert ( 4455	n 0 keyed_max_trans		keyed_min_max_finalize				-				-				-
 DATA(insert ( 4456	n 0 keyed_max_trans		keyed_min_max_finalize				-				-				-				f f 413		20		0	0		0	_null_ _null_ ));
 DATA(insert ( 4457	n 0 keyed_max_trans		keyed_min_max_finalize				-				-				-				f f 3519	3500	0	0		0	_null_ _null_ ));
 
-DATA(insert ( 4463	n 0 set_agg_trans		array_agg_finalfn			-				-				-				f f 0 2281	0	0		0	_null_ _null_ ));
+DATA(insert ( 4463	n 0 set_agg_trans		set_agg_final				-				-				-				t f 0 2281	0	0		0	_null_ _null_ ));
 DATA(insert ( 4467	n 0 set_agg_trans		set_cardinality				-				-				-				f f 0 2281	0	0		0	_null_ _null_ ));
+DATA(insert ( 4116	n 0 hybrid_count_distinct_trans		hybrid_count_distinct_final	-				-				-				f f 0 17	0	0		0	_null_ _null_ ));
+DATA(insert ( 4117	n 0 hybrid_count_distinct_transp	hybrid_count_distinct_final	-				-				-				f f 0 17	0	0		0	_null_ _null_ ));
 
 DATA(insert ( 4469	o 1 first_values_trans	first_values_final				-				-				-				t f 0 2281	0	0		0	_null_ _null_ ));
 
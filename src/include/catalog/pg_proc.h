@@ -5496,6 +5496,14 @@ DESCR("bloom filter aggregate");
 DATA(insert OID = 4332 ( bloom_agg_transp	PGNSP PGUID 12 1 0 0 0 f f f f f f i 4 0 5030 "5030 2283 701 20" _null_ _null_ _null_ _null_ _null_ bloom_agg_transp _null_ _null_ _null_ ));
 DESCR("bloom filter aggregate");
 
+/* bloom filter aggregate with user-supplied p and n, optionally blocked */
+DATA(insert OID = 4316 ( bloom_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 4 0 5030 "2283 701 20 16" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("bloom filter aggregate");
+
+/* bloom filter aggregate with p, n and blocked transition function */
+DATA(insert OID = 4317 ( bloom_agg_trans_blocked	PGNSP PGUID 12 1 0 0 0 f f f f f f i 5 0 5030 "5030 2283 701 20 16" _null_ _null_ _null_ _null_ _null_ bloom_agg_trans_blocked _null_ _null_ _null_ ));
+DESCR("bloom filter aggregate");
+
 /* bloom filter union aggregate */
 DATA(insert OID = 4333 ( bloom_union_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5030 "5030" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
 DESCR("bloom filter union aggregate");
@@ -5588,10 +5596,118 @@ DESCR("count-min sketch estimate frequency");
 DATA(insert OID = 4386 ( cmsketch_frequency	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 23 "5038 25" _null_ _null_ _null_ _null_ _null_ cmsketch_frequency _null_ _null_ _null_ ));
 DESCR("count-min sketch estimate frequency");
 
-DATA(insert OID = 4355 ( cq_proc_stat_get PGNSP PGUID 12 1 1000 0 0 f f f f t t s 0 0 2249 "" "{25,23,1184,20,20,20,20,20,20,20,20,20,20,20,20,20}" "{o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{type,pid,start_time,input_rows,output_rows,updated_rows,input_bytes,output_bytes,updated_bytes,tuples_ps,bytes_ps,time_pb,tuples_pb,memory,executions,errors}" _null_ _null_ cq_proc_stat_get _null_ _null_ _null_ ));
+/* count-min sketch heavy hitters aggregate */
+DATA(insert OID = 4257 ( cmsketch_topk_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 2 0 5043 "2283 20" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("count-min sketch heavy hitters aggregate");
+DATA(insert OID = 4258 ( cmsketch_topk_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 5043 "5043 2283 20" _null_ _null_ _null_ _null_ _null_ cmsketch_topk_agg_trans _null_ _null_ _null_ ));
+DESCR("count-min sketch heavy hitters aggregate");
+DATA(insert OID = 4259 ( cmsketch_topk_merge_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5043 "5043" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("count-min sketch heavy hitters merge aggregate");
+DATA(insert OID = 4260 ( cmsketch_topk_merge_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5043 "5043 5043" _null_ _null_ _null_ _null_ _null_ cmsketch_topk_merge_agg_trans _null_ _null_ _null_ ));
+DESCR("count-min sketch heavy hitters merge aggregate");
+DATA(insert OID = 4261 ( cmsketch_topk	PGNSP PGUID 12 1 10 0 0 f f f f f t i 1 0 2249 "5043" "{2283,20}" "{o,o}" "{value,frequency}" _null_ _null_ cmsketch_topk _null_ _null_ _null_ ));
+DESCR("count-min sketch heavy hitters");
+DATA(insert OID = 4262 ( cmsketch_frequency	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 23 "5043 2283" _null_ _null_ _null_ _null_ _null_ cmsketch_topk_frequency _null_ _null_ _null_ ));
+DESCR("count-min sketch estimate frequency");
+DATA(insert OID = 4263 ( cmsketch_total	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 20 "5043" _null_ _null_ _null_ _null_ _null_ cmsketch_topk_total _null_ _null_ _null_ ));
+DESCR("count-min sketch total items");
+
+/* DDSketch aggregates and functions */
+DATA(insert OID = 4264 ( ddsketch_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5045 "701" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("DDSketch aggregate");
+DATA(insert OID = 4265 ( ddsketch_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 2 0 5045 "701 701" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("DDSketch aggregate");
+DATA(insert OID = 4266 ( ddsketch_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5045 "5045 701" _null_ _null_ _null_ _null_ _null_ ddsketch_agg_trans _null_ _null_ _null_ ));
+DESCR("DDSketch aggregate");
+DATA(insert OID = 4267 ( ddsketch_agg_transp	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 5045 "5045 701 701" _null_ _null_ _null_ _null_ _null_ ddsketch_agg_transp _null_ _null_ _null_ ));
+DESCR("DDSketch aggregate");
+DATA(insert OID = 4268 ( ddsketch_merge_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5045 "5045" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("DDSketch merge aggregate");
+DATA(insert OID = 4269 ( ddsketch_merge_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5045 "5045 5045" _null_ _null_ _null_ _null_ _null_ ddsketch_merge_agg_trans _null_ _null_ _null_ ));
+DESCR("DDSketch merge aggregate");
+DATA(insert OID = 4270 ( ddsketch_cdf	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 701 "5045 701" _null_ _null_ _null_ _null_ _null_ ddsketch_cdf _null_ _null_ _null_ ));
+DESCR("DDSketch cdf");
+DATA(insert OID = 4271 ( ddsketch_quantile	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 701 "5045 701" _null_ _null_ _null_ _null_ _null_ ddsketch_quantile _null_ _null_ _null_ ));
+DESCR("DDSketch quantile");
+DATA(insert OID = 4272 ( ddsketch_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 0 0 5045 "" _null_ _null_ _null_ _null_ _null_ ddsketch_empty _null_ _null_ _null_ ));
+DESCR("DDSketch empty");
+DATA(insert OID = 4273 ( ddsketch_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 5045 "701" _null_ _null_ _null_ _null_ _null_ ddsketch_emptyp _null_ _null_ _null_ ));
+DESCR("DDSketch empty");
+DATA(insert OID = 4274 ( ddsketch_add	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5045 "5045 701" _null_ _null_ _null_ _null_ _null_ ddsketch_add _null_ _null_ _null_ ));
+DESCR("DDSketch add");
+DATA(insert OID = 4275 ( ddsketch_add	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 5045 "5045 701 23" _null_ _null_ _null_ _null_ _null_ ddsketch_addn _null_ _null_ _null_ ));
+DESCR("DDSketch add");
+DATA(insert OID = 4276 ( ddsketch_print	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 25 "5045" _null_ _null_ _null_ _null_ _null_ ddsketch_print _null_ _null_ _null_ ));
+DESCR("DDSketch print function");
+
+/* KLL sketch aggregates and functions */
+DATA(insert OID = 4277 ( kll_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5047 "701" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("KLL sketch aggregate");
+DATA(insert OID = 4278 ( kll_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 2 0 5047 "701 23" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("KLL sketch aggregate");
+DATA(insert OID = 4279 ( kll_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5047 "5047 701" _null_ _null_ _null_ _null_ _null_ kll_agg_trans _null_ _null_ _null_ ));
+DESCR("KLL sketch aggregate");
+DATA(insert OID = 4280 ( kll_agg_transp	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 5047 "5047 701 23" _null_ _null_ _null_ _null_ _null_ kll_agg_transp _null_ _null_ _null_ ));
+DESCR("KLL sketch aggregate");
+DATA(insert OID = 4281 ( kll_merge_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5047 "5047" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("KLL sketch merge aggregate");
+DATA(insert OID = 4282 ( kll_merge_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5047 "5047 5047" _null_ _null_ _null_ _null_ _null_ kll_merge_agg_trans _null_ _null_ _null_ ));
+DESCR("KLL sketch merge aggregate");
+DATA(insert OID = 4283 ( kll_cdf	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 701 "5047 701" _null_ _null_ _null_ _null_ _null_ kll_cdf _null_ _null_ _null_ ));
+DESCR("KLL sketch cdf");
+DATA(insert OID = 4284 ( kll_quantile	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 701 "5047 701" _null_ _null_ _null_ _null_ _null_ kll_quantile _null_ _null_ _null_ ));
+DESCR("KLL sketch quantile");
+DATA(insert OID = 4285 ( kll_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 0 0 5047 "" _null_ _null_ _null_ _null_ _null_ kll_empty _null_ _null_ _null_ ));
+DESCR("KLL sketch empty");
+DATA(insert OID = 4286 ( kll_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 5047 "23" _null_ _null_ _null_ _null_ _null_ kll_emptyp _null_ _null_ _null_ ));
+DESCR("KLL sketch empty");
+DATA(insert OID = 4287 ( kll_add	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5047 "5047 701" _null_ _null_ _null_ _null_ _null_ kll_add _null_ _null_ _null_ ));
+DESCR("KLL sketch add");
+DATA(insert OID = 4288 ( kll_add	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 5047 "5047 701 23" _null_ _null_ _null_ _null_ _null_ kll_addn _null_ _null_ _null_ ));
+DESCR("KLL sketch add");
+DATA(insert OID = 4289 ( kll_print	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 25 "5047" _null_ _null_ _null_ _null_ _null_ kll_print _null_ _null_ _null_ ));
+DESCR("KLL sketch print function");
+
+/* theta sketch aggregates and functions */
+DATA(insert OID = 4290 ( theta_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5049 "2283" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("theta sketch aggregate");
+DATA(insert OID = 4291 ( theta_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 2 0 5049 "2283 23" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("theta sketch aggregate");
+DATA(insert OID = 4292 ( theta_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 2283" _null_ _null_ _null_ _null_ _null_ theta_agg_trans _null_ _null_ _null_ ));
+DESCR("theta sketch aggregate");
+DATA(insert OID = 4293 ( theta_agg_transp	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 5049 "5049 2283 23" _null_ _null_ _null_ _null_ _null_ theta_agg_transp _null_ _null_ _null_ ));
+DESCR("theta sketch aggregate");
+DATA(insert OID = 4294 ( theta_union_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5049 "5049" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("theta sketch union aggregate");
+DATA(insert OID = 4295 ( theta_union_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 5049" _null_ _null_ _null_ _null_ _null_ theta_union_agg_trans _null_ _null_ _null_ ));
+DESCR("theta sketch union aggregate");
+DATA(insert OID = 4296 ( theta_intersection_agg	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 5049 "5049" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("theta sketch intersection aggregate");
+DATA(insert OID = 4297 ( theta_intersection_agg_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 5049" _null_ _null_ _null_ _null_ _null_ theta_intersection_agg_trans _null_ _null_ _null_ ));
+DESCR("theta sketch intersection aggregate");
+DATA(insert OID = 4298 ( theta_union	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 5049" _null_ _null_ _null_ _null_ _null_ theta_union _null_ _null_ _null_ ));
+DESCR("theta sketch union");
+DATA(insert OID = 4299 ( theta_intersection	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 5049" _null_ _null_ _null_ _null_ _null_ theta_intersection _null_ _null_ _null_ ));
+DESCR("theta sketch intersection");
+DATA(insert OID = 4109 ( theta_a_not_b	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 5049" _null_ _null_ _null_ _null_ _null_ theta_a_not_b _null_ _null_ _null_ ));
+DESCR("theta sketch difference");
+DATA(insert OID = 4110 ( theta_estimate	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 20 "5049" _null_ _null_ _null_ _null_ _null_ theta_estimate _null_ _null_ _null_ ));
+DESCR("theta sketch distinct count estimate");
+DATA(insert OID = 4111 ( theta_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 0 0 5049 "" _null_ _null_ _null_ _null_ _null_ theta_empty _null_ _null_ _null_ ));
+DESCR("theta sketch empty");
+DATA(insert OID = 4112 ( theta_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 5049 "23" _null_ _null_ _null_ _null_ _null_ theta_emptyp _null_ _null_ _null_ ));
+DESCR("theta sketch empty");
+DATA(insert OID = 4113 ( theta_add	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 2283" _null_ _null_ _null_ _null_ _null_ theta_add _null_ _null_ _null_ ));
+DESCR("theta sketch add");
+DATA(insert OID = 4114 ( theta_add	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5049 "5049 25" _null_ _null_ _null_ _null_ _null_ theta_add _null_ _null_ _null_ ));
+DESCR("theta sketch add");
+DATA(insert OID = 4115 ( theta_print	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 25 "5049" _null_ _null_ _null_ _null_ _null_ theta_print _null_ _null_ _null_ ));
+DESCR("theta sketch print function");
+
+DATA(insert OID = 4355 ( cq_proc_stat_get PGNSP PGUID 12 1 1000 0 0 f f f f t t s 0 0 2249 "" "{25,23,1184,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,1016,1016,1016,1016,1016,1016,1016}" "{o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{type,pid,start_time,input_rows,output_rows,updated_rows,input_bytes,output_bytes,updated_bytes,tuples_ps,bytes_ps,time_pb,tuples_pb,memory,executions,errors,sw_cache_bytes,sw_cache_hits,sw_cache_misses,worker_queue_latency,exec_latency,combiner_queue_latency,lookup_latency,combine_latency,sync_latency,end_to_end_latency}" _null_ _null_ cq_proc_stat_get _null_ _null_ _null_ ));
 DESCR("get continuous query process stats");
 
-DATA(insert OID = 4356 ( cq_stat_get PGNSP PGUID 12 1 1000 0 0 f f f f t t s 0 0 2249 "" "{25,25,20,20,20,20,20,20,20,20,20,20,20}" "{o,o,o,o,o,o,o,o,o,o,o,o,o}" "{name,type,input_rows,output_rows,updated_rows,input_bytes,output_bytes,updated_bytes,tuples_ps,bytes_ps,time_pb,tuples_pb,errors}" _null_ _null_ cq_stat_get _null_ _null_ _null_ ));
+DATA(insert OID = 4356 ( cq_stat_get PGNSP PGUID 12 1 1000 0 0 f f f f t t s 0 0 2249 "" "{25,25,20,20,20,20,20,20,20,20,20,20,20,1016,1016,1016,1016,1016,20,20,20,20,20,20,20,20,20,20}" "{o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{name,type,input_rows,output_rows,updated_rows,input_bytes,output_bytes,updated_bytes,tuples_ps,bytes_ps,time_pb,tuples_pb,errors,exec_latency,lookup_latency,combine_latency,sync_latency,end_to_end_latency,group_cache_hits,group_cache_misses,lookups,lookup_groups,lookup_time,lookup_blocks,hot_updates,combine_time,sync_time,stale_drops}" _null_ _null_ cq_stat_get _null_ _null_ _null_ ));
 DESCR("get continuous query stats");
 
 /* hyperloglog empty */
@@ -5616,6 +5732,10 @@ DESCR("bloom filter empty");
 DATA(insert OID = 4361 ( bloom_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5030 "701 20" _null_ _null_ _null_ _null_ _null_ bloom_emptyp _null_ _null_ _null_ ));
 DESCR("bloom filter empty");
 
+/* bloom filter empty with user-supplied p and n, optionally blocked */
+DATA(insert OID = 4302 ( bloom_empty	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 5030 "701 20 16" _null_ _null_ _null_ _null_ _null_ bloom_emptyp _null_ _null_ _null_ ));
+DESCR("bloom filter empty");
+
 /* bloom filter add */
 DATA(insert OID = 4362 ( bloom_add	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 5030 "5030 2283" _null_ _null_ _null_ _null_ _null_ bloom_add _null_ _null_ _null_ ));
 DESCR("bloom filter add");
@@ -5876,11 +5996,30 @@ DESCR("set add function");
 DATA(insert OID = 4465 ( set_agg_combine PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 2281 "2281 2281" _null_ _null_ _null_ _null_ _null_ set_agg_combine _null_ _null_ _null_ ));
 DESCR("set aggregate combine function");
 DATA(insert OID = 4466 ( set_cardinality PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 23 "2281" _null_ _null_ _null_ _null_ _null_ set_cardinality _null_ _null_ _null_ ));
-DESCR("set print function");
+DESCR("set cardinality function");
+DATA(insert OID = 4122 ( set_agg_send	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 17 "2281" _null_ _null_ _null_ _null_ _null_ set_agg_send _null_ _null_ _null_ ));
+DESCR("set aggregate send function");
+DATA(insert OID = 4123 ( set_agg_recv	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 2281 "17" _null_ _null_ _null_ _null_ _null_ set_agg_recv _null_ _null_ _null_ ));
+DESCR("set aggregate recv function");
+DATA(insert OID = 4124 ( set_agg_final	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 2277 "2281 2283" _null_ _null_ _null_ _null_ _null_ set_agg_final _null_ _null_ _null_ ));
+DESCR("set aggregate final function");
 
 DATA(insert OID = 4467 ( exact_count_distinct	PGNSP PGUID 12 1 0 0 0 t f f f t f i 1 0 23 "2283" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
 DESCR("exact count distinct aggregate");
 
+DATA(insert OID = 4116 ( hybrid_count_distinct	PGNSP PGUID 12 1 0 0 0 t f f f f f i 1 0 20 "2283" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("count distinct aggregate that is exact up to a threshold");
+DATA(insert OID = 4117 ( hybrid_count_distinct	PGNSP PGUID 12 1 0 0 0 t f f f f f i 2 0 20 "2283 23" _null_ _null_ _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
+DESCR("count distinct aggregate that is exact up to a threshold");
+DATA(insert OID = 4118 ( hybrid_count_distinct_trans	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 17 "17 2283" _null_ _null_ _null_ _null_ _null_ hybrid_count_distinct_trans _null_ _null_ _null_ ));
+DESCR("hybrid count distinct transition function");
+DATA(insert OID = 4119 ( hybrid_count_distinct_transp	PGNSP PGUID 12 1 0 0 0 f f f f f f i 3 0 17 "17 2283 23" _null_ _null_ _null_ _null_ _null_ hybrid_count_distinct_transp _null_ _null_ _null_ ));
+DESCR("hybrid count distinct transition function");
+DATA(insert OID = 4120 ( hybrid_count_distinct_combine	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 17 "17 17" _null_ _null_ _null_ _null_ _null_ hybrid_count_distinct_combine _null_ _null_ _null_ ));
+DESCR("hybrid count distinct combine function");
+DATA(insert OID = 4121 ( hybrid_count_distinct_final	PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 20 "17" _null_ _null_ _null_ _null_ _null_ hybrid_count_distinct_final _null_ _null_ _null_ ));
+DESCR("hybrid count distinct final function");
+
 DATA(insert OID = 4469 ( first_values	PGNSP PGUID 12 1 0 2276 0 t f f f t f i 1 0 2277 "23" "{2283}" "{v}" _null_ _null_ _null_ aggregate_dummy _null_ _null_ _null_ ));
 DESCR("first_values aggregate");
 #define FIRST_VALUES_OID 4469
@@ -5904,6 +6043,12 @@ DATA(insert OID = 4477 (  json_object_int_sum_transfn	 PGNSP PGUID 12 1 0 0 0 f
 DESCR("json_object_sum transition function");
 DATA(insert OID = 4478 (  json_object_int_sum_transout PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 114 "2281" _null_ _null_ _null_ _null_ _null_ json_object_int_sum_transout _null_ _null_ _null_ ));
 DESCR("json_object_sum transition out function");
+DATA(insert OID = 4125 (  json_object_int_sum_combine PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 2281 "2281 2281" _null_ _null_ _null_ _null_ _null_ json_object_int_sum_combine _null_ _null_ _null_ ));
+DESCR("json_object_sum combine function");
+DATA(insert OID = 4126 (  json_object_int_sum_send PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 17 "2281" _null_ _null_ _null_ _null_ _null_ json_object_int_sum_send _null_ _null_ _null_ ));
+DESCR("json_object_sum send");
+DATA(insert OID = 4127 (  json_object_int_sum_recv PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 2281 "17" _null_ _null_ _null_ _null_ _null_ json_object_int_sum_recv _null_ _null_ _null_ ));
+DESCR("json_object_sum recv");
 
 /* continuous transforms */
 DATA(insert OID = 4479 ( pipeline_transforms PGNSP PGUID 12 1 20 0 0 f f f f t t s 0 0 2249 "" "{26,25,25,16,25,1009,25}" "{o,o,o,o,o,o,o}" "{id,schema,name,active,tgfn,tgargs,query}" _null_ _null_ pipeline_transforms _null_ _null_ _null_ ));
@@ -5911,6 +6056,11 @@ DESCR("get continuous transforms");
 DATA(insert OID = 4480 ( pipeline_stream_insert	PGNSP PGUID 12 1 0 0 0 f f f f t f v 0 0 2279 "" _null_ _null_ _null_ _null_ _null_ pipeline_stream_insert _null_ _null_ _null_ ));
 DESCR("trigger to insert into streams");
 #define PIPELINE_STREAM_INSERT_OID 4480
+DATA(insert OID = 4504 ( pipeline_stream_insert_batch	PGNSP PGUID 12 1 0 0 0 f f f f t f v 0 0 2279 "" _null_ _null_ _null_ _null_ _null_ pipeline_stream_insert_batch _null_ _null_ _null_ ));
+DESCR("trigger to insert into streams in batches");
+DATA(insert OID = 4515 ( pipeline_sink	PGNSP PGUID 12 1 0 0 0 f f f f t f v 0 0 2279 "" _null_ _null_ _null_ _null_ _null_ pipeline_sink _null_ _null_ _null_ ));
+DESCR("trigger to deliver rows to a sink function asynchronously");
+#define PIPELINE_SINK_OID 4515
 
 DATA(insert OID = 4481 (array_agg_array_combine	PGNSP PGUID 12 1 0 0 0 f f f f f f i 2 0 2281 "2281 2281" _null_ _null_ _null_ _null_ _null_ array_agg_array_combine _null_ _null_ _null_ ));
 DESCR("array aggregation combination function");
@@ -5928,6 +6078,36 @@ DESCR("serializer for poly numeric aggregation transition states");
 
 DATA(insert OID = 4493 ( pipeline_flush	   PGNSP PGUID 12 1 0 0 0 f f f f t f s 0 0 16 "" _null_ _null_ _null_ _null_ _null_ pipeline_flush _null_ _null_ _null_ ));
 DESCR("flush all continuous process queues");
+DATA(insert OID = 4505 ( pipeline_stream_insert_token	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 0 0 20 "" _null_ _null_ _null_ _null_ _null_ pipeline_stream_insert_token _null_ _null_ _null_ ));
+DESCR("token of the last deferred stream insert made by this session");
+DATA(insert OID = 4506 ( pipeline_stream_insert_acked	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 1 0 16 "20" _null_ _null_ _null_ _null_ _null_ pipeline_stream_insert_acked _null_ _null_ _null_ ));
+DESCR("check if a deferred stream insert and all earlier ones have been consumed");
+DATA(insert OID = 4507 ( pipeline_wait_for_stream_insert	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 1 0 16 "20" _null_ _null_ _null_ _null_ _null_ pipeline_wait_for_stream_insert _null_ _null_ _null_ ));
+DESCR("wait for a deferred stream insert and all earlier ones to be consumed");
+DATA(insert OID = 4508 ( pipeline_set_step_factor	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 2 0 16 "25 25" _null_ _null_ _null_ _null_ _null_ pipeline_set_step_factor _null_ _null_ _null_ ));
+DESCR("change the step factor of a sliding window continuous view");
+DATA(insert OID = 4509 ( pipeline_backfill	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 2 0 20 "25 25" _null_ _null_ _null_ _null_ _null_ pipeline_backfill _null_ _null_ _null_ ));
+DESCR("feed the rows of a table to a single continuous view");
+DATA(insert OID = 4510 ( pipeline_latency_buckets	   PGNSP PGUID 12 1 0 0 0 f f f f t f i 0 0 1016 "" _null_ _null_ _null_ _null_ _null_ pipeline_latency_buckets _null_ _null_ _null_ ));
+DESCR("upper bounds of the buckets of continuous query latency histograms, in microseconds");
+DATA(insert OID = 4511 ( pipeline_queue_stats	   PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{25,23,23,20,20,20,701,20,20,20,20,20,20}" "{o,o,o,o,o,o,o,o,o,o,o,o,o}" "{type,group_id,broker_id,size,bytes,unread_bytes,occupancy,total_bytes,bytes_ps,wraps,producer_waits,spilled_bytes,broker_buffered_bytes}" _null_ _null_ pipeline_queue_stats _null_ _null_ _null_ ));
+DESCR("occupancy and throughput of the continuous query process queues of the current database");
+DATA(insert OID = 4512 ( pipeline_explain_analyze	   PGNSP PGUID 12 1 1000 0 0 f f f f t t v 2 0 25 "25 23" _null_ _null_ _null_ _null_ _null_ pipeline_explain_analyze _null_ _null_ _null_ ));
+DESCR("instrument the plans of a continuous view for a number of batches and show where their time goes");
+DATA(insert OID = 4513 ( pipeline_query_memory	   PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{25,25,23,20,20,20,20,20}" "{o,o,o,o,o,o,o,o}" "{name,type,pid,bytes,peak_bytes,cache_bytes,plan_bytes,limit_exceeded}" _null_ _null_ pipeline_query_memory _null_ _null_ _null_ ));
+DESCR("memory used by the state of each continuous view in each worker and combiner");
+DATA(insert OID = 4514 ( pipeline_view_lag	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 1 0 1186 "25" _null_ _null_ _null_ _null_ _null_ pipeline_view_lag _null_ _null_ _null_ ));
+DESCR("time since the arrival of the newest event committed to a continuous view");
+DATA(insert OID = 4516 ( pipeline_cached_row	   PGNSP PGUID 12 1 0 0 0 f f f f f f v 2 0 2283 "2283 25" _null_ _null_ _null_ _null_ _null_ pipeline_cached_row _null_ _null_ _null_ ));
+DESCR("cached row of the continuous view group with the given read_cache_key value, or NULL if it isn't cached");
+DATA(insert OID = 4517 ( pipeline_insert_waits	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 0 0 2249 "" "{20,20,20,20,20,20}" "{o,o,o,o,o,o}" "{queue_locks,queue_lock_misses,queue_lock_waits,queue_lock_wait_time,ack_waits,ack_wait_time}" _null_ _null_ pipeline_insert_waits _null_ _null_ _null_ ));
+DESCR("time the stream inserts of the current session have spent waiting for worker queue locks and acks, in microseconds");
+DATA(insert OID = 4518 ( pipeline_combine_partial	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 2 0 16 "25 2249" _null_ _null_ _null_ _null_ _null_ pipeline_combine_partial _null_ _null_ _null_ ));
+DESCR("send a partial result of a continuous view directly to its combiners");
+DATA(insert OID = 4519 ( dict_encode	   PGNSP PGUID 12 1 0 0 0 f f f f t f v 2 0 20 "2205 25" _null_ _null_ _null_ _null_ _null_ dict_encode _null_ _null_ _null_ ));
+DESCR("id of a text value in a dictionary table, adding the value to it if needed");
+DATA(insert OID = 4520 ( dict_decode	   PGNSP PGUID 12 1 0 0 0 f f f f t f s 2 0 25 "2205 20" _null_ _null_ _null_ _null_ _null_ dict_decode _null_ _null_ _null_ ));
+DESCR("text value of an id in a dictionary table");
 
 DATA(insert OID = 4494 (jsonbaggstatesend PGNSP PGUID 12 1 0 0 0 f f f f f f i 1 0 3802 "2281" _null_ _null_ _null_ _null_ _null_ jsonbaggstatesend _null_ _null_ _null_ ));
 DESCR("serializer for json aggregationb transition states");
@@ -467,6 +467,7 @@ DATA(insert OID = 1013 (  _oidvector PGNSP PGUID -1 f b A f t \054 0	30 0 array_
 DATA(insert OID = 1014 (  _bpchar	 PGNSP PGUID -1 f b A f t \054 0 1042 0 array_in array_out array_recv array_send bpchartypmodin bpchartypmodout array_typanalyze i x f 0 -1 0 100 _null_ _null_ _null_ ));
 DATA(insert OID = 1015 (  _varchar	 PGNSP PGUID -1 f b A f t \054 0 1043 0 array_in array_out array_recv array_send varchartypmodin varchartypmodout array_typanalyze i x f 0 -1 0 100 _null_ _null_ _null_ ));
 DATA(insert OID = 1016 (  _int8		 PGNSP PGUID -1 f b A f t \054 0	20 0 array_in array_out array_recv array_send - - array_typanalyze d x f 0 -1 0 0 _null_ _null_ _null_ ));
+#define INT8ARRAYOID		1016
 DATA(insert OID = 1017 (  _point	 PGNSP PGUID -1 f b A f t \054 0 600 0 array_in array_out array_recv array_send - - array_typanalyze d x f 0 -1 0 0 _null_ _null_ _null_ ));
 DATA(insert OID = 1018 (  _lseg		 PGNSP PGUID -1 f b A f t \054 0 601 0 array_in array_out array_recv array_send - - array_typanalyze d x f 0 -1 0 0 _null_ _null_ _null_ ));
 DATA(insert OID = 1019 (  _path		 PGNSP PGUID -1 f b A f t \054 0 602 0 array_in array_out array_recv array_send - - array_typanalyze d x f 0 -1 0 0 _null_ _null_ _null_ ));
@@ -655,24 +656,28 @@ DATA(insert OID = 3927 ( _int8range		PGNSP PGUID  -1 f b A f t \054 0 3926 0 arr
 /* hyperloglog */
 DATA(insert OID = 3998 ( hll	PGNSP PGUID	-1 f b U f t \054 0	 0 5000 byteain   byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("hyperloglog");
+#define HLLOID			3998
 DATA(insert OID = 5000 ( _hll	PGNSP PGUID -1 f b A f t \054 0  3998 0 array_in array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("hyperloglog array");
 
 /* bloom filter */
 DATA(insert OID = 5030 ( bloom	PGNSP PGUID	-1 f b U f t \054 0	 0 5031 byteain	byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("bloom filter");
+#define BLOOMOID		5030
 DATA(insert OID = 5031 ( _bloom	PGNSP PGUID -1 f b A f t \054 0  5030 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("bloom filter array");
 
 /* t-digest */
 DATA(insert OID = 5034 ( tdigest	PGNSP PGUID	-1 f b U f t \054 0	 0 5035 byteain	byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("t-digest");
+#define TDIGESTOID		5034
 DATA(insert OID = 5035 ( _tdigest	PGNSP PGUID -1 f b A f t \054 0  5034 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("t-digest array");
 
 /* count-min sketch */
 DATA(insert OID = 5038 ( cmsketch	PGNSP PGUID	-1 f b U f t \054 0	 0 5039 byteain	byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("count-min sketch");
+#define CMSKETCHOID		5038
 DATA(insert OID = 5039 ( _cmsketch	PGNSP PGUID -1 f b A f t \054 0  5038 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("count-min sketch array");
 
@@ -682,6 +687,30 @@ DESCR("filtered space saving");
 DATA(insert OID = 5042 ( _fss	PGNSP PGUID -1 f b A f t \054 0  5041 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
 DESCR("filtered space saving array");
 
+/* count-min sketch heavy hitters */
+DATA(insert OID = 5043 ( cmsketch_topk	PGNSP PGUID	-1 f b U f t \054 0	 0 5044 byteain	byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("count-min sketch with heavy hitters");
+DATA(insert OID = 5044 ( _cmsketch_topk	PGNSP PGUID -1 f b A f t \054 0  5043 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("count-min sketch with heavy hitters array");
+
+/* DDSketch */
+DATA(insert OID = 5045 ( ddsketch	PGNSP PGUID	-1 f b U f t \054 0	 0 5046 byteain	byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("DDSketch");
+DATA(insert OID = 5046 ( _ddsketch	PGNSP PGUID -1 f b A f t \054 0  5045 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("DDSketch array");
+
+/* KLL sketch */
+DATA(insert OID = 5047 ( kll	PGNSP PGUID	-1 f b U f t \054 0	 0 5048 byteain	byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("KLL quantile sketch");
+DATA(insert OID = 5048 ( _kll	PGNSP PGUID -1 f b A f t \054 0  5047 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("KLL quantile sketch array");
+
+/* theta sketch */
+DATA(insert OID = 5049 ( theta	PGNSP PGUID	-1 f b U f t \054 0	 0 5050 byteain	byteaout   bytearecv byteasend - - - i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("theta sketch");
+DATA(insert OID = 5050 ( _theta	PGNSP PGUID -1 f b A f t \054 0  5049 0 array_in	array_out array_recv array_send - - array_typanalyze i x f 0 -1 0 0 _null_ _null_ _null_ ));
+DESCR("theta sketch array");
+
 /*
  * pseudo-types
  *
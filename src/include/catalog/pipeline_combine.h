@@ -192,6 +192,7 @@ DATA(insert (hll_cache_cardinality hll_agg_transp hll_cache_cardinality 0 hll_un
 /* bloom_agg */
 DATA(insert (0 bloom_agg_trans  0 0 bloom_union_agg_trans 5030));
 DATA(insert (0 bloom_agg_transp 0 0 bloom_union_agg_trans 5030));
+DATA(insert (0 bloom_agg_trans_blocked 0 0 bloom_union_agg_trans 5030));
 
 /* tdigest_agg */
 DATA(insert (tdigest_compress tdigest_agg_trans  tdigest_compress 0 tdigest_merge_agg_trans 5034));
@@ -201,6 +202,27 @@ DATA(insert (tdigest_compress tdigest_agg_transp tdigest_compress 0 tdigest_merg
 DATA(insert (0 cmsketch_agg_trans  0 0 cmsketch_merge_agg_trans 5038));
 DATA(insert (0 cmsketch_agg_transp 0 0 cmsketch_merge_agg_trans 5038));
 
+/* cmsketch_topk_agg */
+DATA(insert (0 cmsketch_topk_agg_trans 0 0 cmsketch_topk_merge_agg_trans 5043));
+
+/* ddsketch_agg */
+DATA(insert (0 ddsketch_agg_trans  0 0 ddsketch_merge_agg_trans 5045));
+DATA(insert (0 ddsketch_agg_transp 0 0 ddsketch_merge_agg_trans 5045));
+
+/* kll_agg */
+DATA(insert (0 kll_agg_trans  0 0 kll_merge_agg_trans 5047));
+DATA(insert (0 kll_agg_transp 0 0 kll_merge_agg_trans 5047));
+
+/* theta_agg */
+DATA(insert (0 theta_agg_trans  0 0 theta_union_agg_trans 5049));
+DATA(insert (0 theta_agg_transp 0 0 theta_union_agg_trans 5049));
+
+/* theta_union_agg */
+DATA(insert (0 theta_union_agg_trans 0 0 theta_union_agg_trans 5049));
+
+/* theta_intersection_agg */
+DATA(insert (0 theta_intersection_agg_trans 0 0 theta_intersection_agg_trans 5049));
+
 /* fss_agg */
 DATA(insert (0 fss_agg_trans  0 0 fss_merge_agg_trans 5041));
 DATA(insert (0 fss_agg_transp 0 0 fss_merge_agg_trans 5041));
@@ -211,13 +233,17 @@ DATA(insert (keyed_min_max_finalize keyed_min_trans  0 0 keyed_min_combine 17));
 DATA(insert (keyed_min_max_finalize keyed_max_trans  0 0 keyed_max_combine 17));
 
 /* set_agg */
-DATA(insert (array_agg_finalfn set_agg_trans  arrayaggstatesend arrayaggstaterecv set_agg_combine 17));
-DATA(insert (set_cardinality set_agg_trans  arrayaggstatesend arrayaggstaterecv set_agg_combine 17));
+DATA(insert (set_agg_final set_agg_trans  set_agg_send set_agg_recv set_agg_combine 17));
+DATA(insert (set_cardinality set_agg_trans  set_agg_send set_agg_recv set_agg_combine 17));
+
+/* hybrid_count_distinct */
+DATA(insert (hybrid_count_distinct_final hybrid_count_distinct_trans  0 0 hybrid_count_distinct_combine 17));
+DATA(insert (hybrid_count_distinct_final hybrid_count_distinct_transp 0 0 hybrid_count_distinct_combine 17));
 
 /* first_values */
 DATA(insert (first_values_final first_values_trans first_values_send first_values_recv first_values_combine 17));
 
 /* json_object_int_sum */
-DATA(insert (json_object_int_sum_transout json_object_int_sum_transfn json_object_int_sum_transout 0 json_object_int_sum_transfn 114));
+DATA(insert (json_object_int_sum_transout json_object_int_sum_transfn json_object_int_sum_send json_object_int_sum_recv json_object_int_sum_combine 17));
 
 #endif
@@ -43,6 +43,7 @@ CATALOG(pipeline_query,4242)
 	bool		gc;
 	bool 		adhoc;
 	int16 		step_factor;
+	bool		step_auto;
 
 	/* valid for transforms only */
 	Oid			tgfn;
@@ -65,7 +66,7 @@ typedef FormData_pipeline_query *Form_pipeline_query;
  *		compiler constants for pipeline_query
  * ----------------
  */
-#define Natts_pipeline_query             16
+#define Natts_pipeline_query             17
 #define Anum_pipeline_query_id           1
 #define Anum_pipeline_query_type         2
 #define Anum_pipeline_query_relid	        3
@@ -78,10 +79,11 @@ typedef FormData_pipeline_query *Form_pipeline_query;
 #define Anum_pipeline_query_gc           10
 #define Anum_pipeline_query_adhoc        11
 #define Anum_pipeline_query_step_factor  12
-#define Anum_pipeline_query_tgfn         13
-#define Anum_pipeline_query_tgnargs	      14
-#define Anum_pipeline_query_tgargs       15
-#define Anum_pipeline_query_query        16
+#define Anum_pipeline_query_step_auto    13
+#define Anum_pipeline_query_tgfn         14
+#define Anum_pipeline_query_tgnargs	      15
+#define Anum_pipeline_query_tgargs       16
+#define Anum_pipeline_query_query        17
 
 #define PIPELINE_QUERY_VIEW 		'v'
 #define PIPELINE_QUERY_TRANSFORM 	't'
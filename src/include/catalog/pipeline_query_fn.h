@@ -26,6 +26,13 @@ typedef enum ContQueryType
 	CONT_TRANSFORM
 } ContQueryType;
 
+/* groups whose time bucket is older than after are merged into buckets of the given resolution */
+typedef struct DownsampleRule
+{
+	int64 after; /* microseconds */
+	int64 resolution; /* microseconds */
+} DownsampleRule;
+
 typedef struct ContQuery
 {
 	Oid id;
@@ -45,8 +52,53 @@ typedef struct ContQuery
 	Oid seqrelid;
 	int sw_step_factor;
 	int sw_step_ms;
+	bool sw_step_auto;
+	int sw_lateness_ms;
 	uint64 sw_interval_ms;
 	bool is_sw;
+	bool delta_merge;
+	bool lazy_grouping_sets;
+	/* for views with freeze_after, how long until a bucket is frozen and the column holding it */
+	int freeze_after_ms;
+	char *freeze_column;
+	/* output stream coalescing: interval each group's updates are coalesced over, and change threshold */
+	int output_interval_ms;
+	double output_threshold;
+	char *output_threshold_column;
+	/* fraction of its streams' events the query reads, 0 if it reads all of them */
+	double sample_rate;
+	/* events whose dedup_key was seen in the last dedup_window_ms are dropped, see dedup.c */
+	char *dedup_key;
+	int dedup_window_ms;
+	/* for stream-stream joins, ms each stream's events are joined with the other's for, see stream_fdw.c */
+	int join_window_ms;
+	/* events that arrived more than max_staleness_ms ago are dropped unread by workers, see stream_fdw.c */
+	int max_staleness_ms;
+	/* channel notified of changed groups after each combiner commit, and the group column sent as payload */
+	char *notify_channel;
+	char *notify_key;
+	/* does the matrel cache finalized values of the overlay view's columns? */
+	bool finalize_cache;
+	/* for rollups, the query whose combiners derive this one's partial results from its own, see cont_combiner.c */
+	Oid rollup_of;
+	List *rollup_targets;
+	/* group column the finalized rows of recently updated groups are cached in shared memory by, see read_cache.c */
+	char *read_cache_key;
+	/* for views with a ttl, how long after the time in ttl_column their groups are deleted by combiners */
+	int ttl_ms;
+	char *ttl_column;
+	/* views of the same merge group grouping the same events the same way share a worker plan, see cont_worker.c */
+	char *merge_group;
+	/* for views with an unlogged matrel, ms between the combiners' checkpoints of it, see cont_combiner.c */
+	int checkpoint_interval_ms;
+	/* for top-N views, how many groups with the largest top_n_column values each combiner keeps */
+	int top_n;
+	char *top_n_column;
+	/* for downsampled views, the DownsampleRules merging aged groups into coarser downsample_column buckets */
+	List *downsample;
+	char *downsample_column;
+	/* do combiners insert new groups next to their neighbors in group hash order? see cont_combiner.c */
+	bool cluster_groups;
 
 	/* for transform */
 	Oid tgfn;
@@ -60,6 +112,7 @@ extern void RemovePipelineQueryById(Oid oid);
 extern Oid DefineContinuousView(Oid relid, Query *query, Oid matrel, Oid seqrel, bool gc, bool adhoc, Oid *pq_id);
 extern void UpdateContViewRelIds(Oid cvid, Oid cvrelid, Oid osrelid);
 extern void UpdateContViewIndexIds(Oid cvid, Oid pkindid, Oid lookupindid);
+extern void UpdateContViewStepFactor(Oid cvid, int step_factor, bool step_auto);
 extern Oid DefineContinuousTransform(Oid relid, Query *query, Oid typoid, Oid fnoid, bool adhoc, List *args);
 
 extern Relation OpenCVRelFromMatRel(Relation matrel, LOCKMODE lockmode);
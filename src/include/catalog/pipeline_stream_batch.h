@@ -0,0 +1,46 @@
+/*-------------------------------------------------------------------------
+ *
+ * pipeline_stream_batch.h
+ *		Definition of the pipeline_stream_batch catalog table
+ *
+ * Each row records that a combiner has committed the results of a stream
+ * batch written with a client-supplied stream_insert_batch_id.
+ *
+ * src/include/catalog/pipeline_stream_batch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_STREAM_BATCH_H
+#define PIPELINE_STREAM_BATCH_H
+
+#include "catalog/genbki.h"
+#include "datatype/timestamp.h"
+
+/*
+ * The CATALOG definition has to refer to the type of committed as "timestamptz" so that bootstrap
+ * mode recognizes it, as in pg_authid.h
+ */
+#define timestamptz TimestampTz
+
+#define PipelineStreamBatchRelationId  4244
+
+/* ----------------------------------------------------------------
+ * ----------------------------------------------------------------
+ */
+CATALOG(pipeline_stream_batch,4244) BKI_WITHOUT_OIDS
+{
+	int64 id;
+	timestamptz committed;
+	int32 combiner;
+} FormData_pipeline_stream_batch;
+
+#undef timestamptz
+
+typedef FormData_pipeline_stream_batch *Form_pipeline_stream_batch;
+
+#define Natts_pipeline_stream_batch				3
+#define Anum_pipeline_stream_batch_id			1
+#define Anum_pipeline_stream_batch_committed	2
+#define Anum_pipeline_stream_batch_combiner		3
+
+#endif
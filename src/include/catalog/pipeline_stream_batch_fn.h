@@ -0,0 +1,26 @@
+/*-------------------------------------------------------------------------
+ *
+ * pipeline_stream_batch_fn.h
+ *	 prototypes for functions in catalog/pipeline_stream_batch.c
+ *
+ *
+ * src/include/catalog/pipeline_stream_batch_fn.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_STREAM_BATCH_FN_H
+#define PIPELINE_STREAM_BATCH_FN_H
+
+#include "postgres.h"
+
+#include "catalog/pipeline_stream_batch.h"
+#include "utils/timestamp.h"
+
+/* matches the rows of any combiner */
+#define ANY_COMBINER -1
+
+extern bool StreamBatchIsRecorded(int64 id, int combiner);
+extern void RecordStreamBatch(int64 id, int combiner);
+extern int RemoveStreamBatchesBefore(int combiner, TimestampTz before, bool *any_left);
+
+#endif
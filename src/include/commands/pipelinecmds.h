@@ -22,6 +22,8 @@
 
 /* guc parameter */
 extern int continuous_view_fillfactor;
+extern bool continuous_view_sw_time_index;
+extern bool continuous_view_window_index;
 
 /* hooks */
 extern bool use_ls_hash_group_index;
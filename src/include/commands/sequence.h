@@ -72,6 +72,7 @@ extern Datum setval_oid(PG_FUNCTION_ARGS);
 extern Datum setval3_oid(PG_FUNCTION_ARGS);
 extern Datum lastval(PG_FUNCTION_ARGS);
 extern int64 nextval_internal(Oid relid);
+extern int64 nextval_block_internal(Oid relid, int64 *nvalues);
 
 extern Datum pg_sequence_parameters(PG_FUNCTION_ARGS);
 
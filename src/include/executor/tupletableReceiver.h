@@ -24,6 +24,7 @@ typedef struct HeapTupleEntryData
 	TupleHashEntryData shared;	/* common header for hash table entries */
 	HeapTuple tuple;	/* physical tuple belonging to this entry */
 	char flags;
+	int64 hash;			/* hash of the entry's group, if its owner keeps it */
 }	HeapTupleEntryData;
 
 extern DestReceiver *CreateTupleTableDestReceiver(void);
@@ -255,6 +255,7 @@ typedef enum NodeTag
 	 */
 	T_MemoryContext = 600,
 	T_AllocSetContext,
+	T_ArenaContext,
 
 	/*
 	 * TAGS FOR VALUE NODES (value.h)
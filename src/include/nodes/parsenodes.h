@@ -169,6 +169,35 @@ typedef struct Query
 	bool isCombine; /* is this query being run as a merge query? */
 	bool isCombineLookup; /* is this query a combiner looking up groups to combine with? */
 	double swStepFactor;
+	bool swStepAuto; /* is the step factor adapted to the view's ingest rate and cardinality? */
+	int swAllowedLateness; /* ms a step keeps taking updates after the watermark passes it, 0 if unbounded */
+	int freezeAfter; /* ms after which a time bucket is frozen once the watermark passes it, 0 if never */
+	bool deltaMerge; /* does this continuous view append deltas instead of updating groups? */
+	bool lazyGroupingSets; /* does this continuous view only store its finest grouping set? */
+	char *workerPool; /* worker pool this continuous view's events are routed to, NULL for the default one */
+	int outputInterval; /* ms a group's output stream updates are coalesced over, 0 if never */
+	double outputThreshold; /* minimum change of outputThresholdColumn that is written to the output stream */
+	char *outputThresholdColumn;
+	double sampleRate; /* fraction of its streams' events this continuous query reads, 0 if it reads all of them */
+	char *dedupKey; /* events whose dedupKey was seen in the last dedupWindow ms are dropped, if set */
+	int dedupWindow;
+	int joinWindow; /* ms a stream-stream join keeps each stream's events around for, 0 if there's no such join */
+	char *notifyChannel; /* channel notified of the groups each combiner transaction changes, if set */
+	char *notifyKey; /* group column whose value is each notification's payload, if set */
+	bool finalizeCache; /* does the combiner store finalized values next to the aggregate states? */
+	Oid rollupOf; /* id of the continuous query whose combiners produce this one's partial results, if any */
+	List *rollupTargets; /* expressions over rollupOf's matrel rows producing this one's partial results */
+	char *readCacheKey; /* group column the finalized rows of recently updated groups are cached by, if set */
+	int ttl; /* ms after the time in ttlColumn that groups are deleted, 0 if they're kept forever */
+	char *ttlColumn;
+	char *mergeGroup; /* views of the same merge group may share a worker plan, if set */
+	int checkpointInterval; /* ms between checkpoints of an unlogged matrel, 0 if the matrel is logged */
+	int topN; /* number of groups with the largest topNColumn values each combiner keeps, 0 if all are kept */
+	char *topNColumn;
+	int maxStaleness; /* ms after arriving that events are dropped unread by workers, 0 if they're always read */
+	char *downsample; /* policy of ages after which groups are merged into coarser downsampleColumn buckets, if set */
+	char *downsampleColumn;
+	bool clusterGroups; /* do combiners place new groups next to their neighbors in group hash order? */
 } Query;
 
 
@@ -1329,6 +1358,33 @@ typedef struct SelectStmt
 	bool forContinuousView; /* does this SELECT statement for a CREATE CONTINUOUS VIEW statement? */
 	bool forCombineLookup; /* is this SELECT stmt for looking up groups in the combiner? */
 	double swStepFactor;
+	bool swStepAuto;
+	int swAllowedLateness;
+	int freezeAfter;
+	bool deltaMerge;
+	bool lazyGroupingSets;
+	char *workerPool;
+	int outputInterval;
+	double outputThreshold;
+	char *outputThresholdColumn;
+	double sampleRate;
+	char *dedupKey;
+	int dedupWindow;
+	int joinWindow;
+	char *notifyChannel;
+	char *notifyKey;
+	bool finalizeCache;
+	char *readCacheKey;
+	int ttl;
+	char *ttlColumn;
+	char *mergeGroup;
+	int checkpointInterval;
+	int topN;
+	char *topNColumn;
+	int maxStaleness;
+	char *downsample;
+	char *downsampleColumn;
+	bool clusterGroups;
 } SelectStmt;
 
 
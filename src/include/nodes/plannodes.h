@@ -606,6 +606,7 @@ typedef struct TuplestoreScan
 {
 	Scan		scan;
 	Tuplestorestate *store; /* tuplestore to scan from */
+	struct TupleBatch *batch; /* batch to scan from instead of store, if set */
 	TupleDesc	desc; /* tuple descriptor of store to scan */
 } TuplestoreScan;
 
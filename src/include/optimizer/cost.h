@@ -61,6 +61,7 @@ extern bool enable_nestloop;
 extern bool enable_material;
 extern bool enable_mergejoin;
 extern bool enable_hashjoin;
+extern bool continuous_query_batched_join_probes;
 extern int	constraint_exclusion;
 
 extern double clamp_row_est(double nrows);
@@ -16,6 +16,7 @@
 #include "fmgr.h"
 #include "libpq/pqcomm.h"
 #include "pipeline/cont_scheduler.h"
+#include "port/atomics.h"
 #include "portability/instr_time.h"
 #include "postmaster/pgarch.h"
 #include "storage/barrier.h"
@@ -557,7 +558,7 @@ typedef union PgStat_Msg
  * ------------------------------------------------------------
  */
 
-#define PGSTAT_FILE_FORMAT_ID	0x01A5BC9D
+#define PGSTAT_FILE_FORMAT_ID	0x01A5BC9F
 
 /* ----------
  * PgStat_StatDBEntry			The collector's data per database
@@ -1046,6 +1047,28 @@ extern bool pgstat_track_streams;
 #define PGSTAT_AVERAGE_BUFFER_SIZE 10
 #define PGSTAT_AVERAGE_BUFFER_INTERVAL 2000 /* in ms */
 
+/*
+ * Stages events go through whose latencies are tracked. The queue stages are only tracked per process,
+ * since items are read from queues before it's known which query they're for.
+ */
+typedef enum PgStat_CQLatencyStage
+{
+	CQ_LATENCY_WORKER_QUEUE,	/* time spent in a worker's input queue */
+	CQ_LATENCY_WORKER_EXEC,		/* worker execution of a query on a batch */
+	CQ_LATENCY_COMBINER_QUEUE,	/* time spent in a combiner's input queue */
+	CQ_LATENCY_LOOKUP,			/* combiner lookup of the existing groups of a batch */
+	CQ_LATENCY_COMBINE,			/* combiner merge of a batch with its existing groups */
+	CQ_LATENCY_SYNC,			/* combiner write of the combined groups to the matrel */
+	CQ_LATENCY_END_TO_END,		/* from an event's insert into a stream until its results are synced */
+	CQ_NUM_LATENCY_STAGES
+} PgStat_CQLatencyStage;
+
+/*
+ * Latency histograms have buckets for latencies of up to 100us, 500us, 1ms, 5ms, 10ms, 50ms, 100ms,
+ * 500ms and 1s, and a last one for anything slower
+ */
+#define PGSTAT_CQ_LATENCY_BUCKETS 10
+
 typedef struct PgStat_StatCQAverageEntry
 {
 	int i;
@@ -1100,13 +1123,77 @@ typedef struct PgStat_StatCQEntry
 	PgStat_Counter time_pb;
 	PgStat_Counter tuples_pb;
 
+	/* combiner caches of sliding-window step groups */
+	PgStat_Counter sw_cache_bytes;
+	PgStat_Counter sw_cache_hits;
+	PgStat_Counter sw_cache_misses;
+
+	/* combiner lookups of existing groups, lookup_time is in microseconds */
+	PgStat_Counter group_cache_hits;
+	PgStat_Counter group_cache_misses;
+	PgStat_Counter lookups;
+	PgStat_Counter lookup_groups;
+	PgStat_Counter lookup_time;
+	PgStat_Counter lookup_blocks;
+
+	/* combiner updates of existing groups that didn't need new index entries */
+	PgStat_Counter hot_updates;
+
+	/* combiner time spent merging batches and writing them to matrels, in microseconds */
+	PgStat_Counter combine_time;
+	PgStat_Counter sync_time;
+
+	/* worker-dropped events that were older than their view's max_staleness */
+	PgStat_Counter stale_drops;
+
+	/* latency histograms, see PgStat_CQLatencyStage */
+	PgStat_Counter latency[CQ_NUM_LATENCY_STAGES][PGSTAT_CQ_LATENCY_BUCKETS];
+
 	TimestampTz last_report;
 } PgStat_StatCQEntry;
 
+/*
+ * The counters of each continuous query process and continuous view that are most often
+ * looked at are also kept in shared memory, where they're incremented as they change. The
+ * stats functions read them from there, so they don't lag behind the collector's messages.
+ */
+#define PGSTAT_CQ_SHARED_ENTRIES 4096
+
+typedef struct PgStat_CQSharedCounters
+{
+	pg_atomic_uint64 input_rows;
+	pg_atomic_uint64 output_rows;
+	pg_atomic_uint64 updated_rows;
+	pg_atomic_uint64 input_bytes;
+	pg_atomic_uint64 output_bytes;
+	pg_atomic_uint64 updated_bytes;
+	pg_atomic_uint64 executions;
+	pg_atomic_uint64 errors;
+	/* for a view's combiner entry, the arrival time of the newest event committed to its matrel */
+	pg_atomic_uint64 committed_arrival;
+} PgStat_CQSharedCounters;
+
+/* a copy of an entry's shared counters, see pgstat_fetch_cq_shared_entries */
+typedef struct PgStat_CQSharedEntry
+{
+	Oid dbid;
+	uint64 key;
+	PgStat_Counter input_rows;
+	PgStat_Counter output_rows;
+	PgStat_Counter updated_rows;
+	PgStat_Counter input_bytes;
+	PgStat_Counter output_bytes;
+	PgStat_Counter updated_bytes;
+	PgStat_Counter executions;
+	PgStat_Counter errors;
+} PgStat_CQSharedEntry;
+
 typedef struct PgStat_StatCQEntryLocal
 {
 	PgStat_StatCQEntry cqstat;
 	PgStat_StatCQAverageEntry avgstat;
+	/* NULL if there was no room for this entry's shared counters */
+	PgStat_CQSharedCounters *shared;
 } PgStat_StatCQEntryLocal;
 
 /*
@@ -1142,43 +1229,112 @@ extern volatile PgStat_StatCQEntry *MyStatCQEntry;
 
 extern void pgstat_increment_cq_read(uint64 nrows, Size nbytes);
 
+/* increments the given entry's local counter and its shared counter, if it has one */
+#define pgstat_add_cq_counter(entry, counter, n) \
+	do { \
+		PgStat_CQSharedCounters *_shared = ((PgStat_StatCQEntryLocal *) (entry))->shared; \
+		(entry)->counter += (n); \
+		if (_shared) \
+			pg_atomic_fetch_add_u64(&_shared->counter, (n)); \
+	} while(0)
+
 #define pgstat_increment_cq_write(rows, nbytes) \
 	do { \
-		MyProcStatCQEntry->output_rows += (rows); \
-		MyProcStatCQEntry->output_bytes += (nbytes); \
+		pgstat_add_cq_counter(MyProcStatCQEntry, output_rows, (rows)); \
+		pgstat_add_cq_counter(MyProcStatCQEntry, output_bytes, (nbytes)); \
 		if (MyStatCQEntry) \
 		{ \
-			MyStatCQEntry->output_rows += (rows); \
-			MyStatCQEntry->output_bytes += (nbytes); \
+			pgstat_add_cq_counter(MyStatCQEntry, output_rows, (rows)); \
+			pgstat_add_cq_counter(MyStatCQEntry, output_bytes, (nbytes)); \
 		} \
 	} while(0)
 
 #define pgstat_increment_cq_update(count, nbytes) \
 	do { \
-		MyProcStatCQEntry->updated_rows += (count); \
-		MyProcStatCQEntry->updated_bytes += (nbytes); \
+		pgstat_add_cq_counter(MyProcStatCQEntry, updated_rows, (count)); \
+		pgstat_add_cq_counter(MyProcStatCQEntry, updated_bytes, (nbytes)); \
 		if (MyStatCQEntry) \
 		{ \
-			MyStatCQEntry->updated_rows += (count); \
-			MyStatCQEntry->updated_bytes += (nbytes); \
+			pgstat_add_cq_counter(MyStatCQEntry, updated_rows, (count)); \
+			pgstat_add_cq_counter(MyStatCQEntry, updated_bytes, (nbytes)); \
 		} \
 	} while(0)
 
+#define pgstat_increment_cq_hot_update(count) \
+	do { \
+		MyProcStatCQEntry->hot_updates += (count); \
+		if (MyStatCQEntry) \
+			MyStatCQEntry->hot_updates += (count); \
+	} while(0)
+
 #define pgstat_increment_cq_exec(n) \
 	do { \
-		MyProcStatCQEntry->executions += (n); \
+		pgstat_add_cq_counter(MyProcStatCQEntry, executions, (n)); \
 		if (MyStatCQEntry) \
-			MyStatCQEntry->executions += (n); \
+			pgstat_add_cq_counter(MyStatCQEntry, executions, (n)); \
 	} while(0)
 
 #define pgstat_increment_cq_error(n) \
 	do { \
-		MyProcStatCQEntry->errors += (n); \
+		pgstat_add_cq_counter(MyProcStatCQEntry, errors, (n)); \
 		if (MyStatCQEntry) \
-			MyStatCQEntry->errors += (n); \
+			pgstat_add_cq_counter(MyStatCQEntry, errors, (n)); \
 	} while(0)
 
+#define pgstat_increment_cq_sw_cache(hits, misses) \
+	do { \
+		MyProcStatCQEntry->sw_cache_hits += (hits); \
+		MyProcStatCQEntry->sw_cache_misses += (misses); \
+		if (MyStatCQEntry) \
+		{ \
+			MyStatCQEntry->sw_cache_hits += (hits); \
+			MyStatCQEntry->sw_cache_misses += (misses); \
+		} \
+	} while(0)
+
+#define pgstat_increment_cq_group_cache(hits, misses) \
+	do { \
+		MyProcStatCQEntry->group_cache_hits += (hits); \
+		MyProcStatCQEntry->group_cache_misses += (misses); \
+		if (MyStatCQEntry) \
+		{ \
+			MyStatCQEntry->group_cache_hits += (hits); \
+			MyStatCQEntry->group_cache_misses += (misses); \
+		} \
+	} while(0)
+
+#define pgstat_increment_cq_stale_drop(n) \
+	do { \
+		MyProcStatCQEntry->stale_drops += (n); \
+		if (MyStatCQEntry) \
+			MyStatCQEntry->stale_drops += (n); \
+	} while(0)
+
+#define pgstat_increment_cq_lookup(groups, usecs, blocks) \
+	do { \
+		MyProcStatCQEntry->lookups++; \
+		MyProcStatCQEntry->lookup_groups += (groups); \
+		MyProcStatCQEntry->lookup_time += (usecs); \
+		MyProcStatCQEntry->lookup_blocks += (blocks); \
+		if (MyStatCQEntry) \
+		{ \
+			MyStatCQEntry->lookups++; \
+			MyStatCQEntry->lookup_groups += (groups); \
+			MyStatCQEntry->lookup_time += (usecs); \
+			MyStatCQEntry->lookup_blocks += (blocks); \
+		} \
+	} while(0)
+
+extern void pgstat_report_cq_latency(PgStat_CQLatencyStage stage, TimestampTz start);
+extern int64 pgstat_cq_latency_bound(int bucket);
+
+extern Size CQStatsShmemSize(void);
+extern void CQStatsShmemInit(void);
 extern void pgstat_init_cqstat(PgStat_StatCQEntry *entry, Oid viewid, pid_t pid);
+extern bool pgstat_read_cq_shared_counters(PgStat_StatCQEntry *entry);
+extern PgStat_CQSharedEntry *pgstat_fetch_cq_shared_entries(int *nentries);
+extern void pgstat_report_cq_committed_arrival(PgStat_StatCQEntry *entry, TimestampTz arrival);
+extern TimestampTz pgstat_fetch_cq_committed_arrival(Oid viewid);
 extern void pgstat_report_cqstat(bool force);
 extern void pgstat_report_create_drop_cv(bool create);
 extern void pgstat_send_cqpurge(Oid viewid, pid_t pid, ContQueryProcType ptype);
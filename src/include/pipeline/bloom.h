@@ -14,11 +14,27 @@
 
 #include "c.h"
 
+/* A block of a blocked filter is the size of a cache line */
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+
+/* all k bits of a key are set within one BLOOM_BLOCK_BITS block */
+#define BLOOM_BLOCKED 0x1
+/* a chain of progressively larger blocked filters, see bloom.c */
+#define BLOOM_SCALABLE 0x2
+/* only the nonzero words, as sent from workers to combiners, see bloom.c */
+#define BLOOM_SPARSE 0x4
+
+#define BLOOM_IS_BLOCKED(bf) (((bf)->flags & BLOOM_BLOCKED) != 0)
+#define BLOOM_IS_SCALABLE(bf) (((bf)->flags & BLOOM_SCALABLE) != 0)
+#define BLOOM_IS_SPARSE(bf) (((bf)->flags & BLOOM_SPARSE) != 0)
+
 typedef struct BloomFilter
 {
 	uint32	vl_len_;
 	uint32_t m;
 	uint16_t k;
+	uint16_t flags;
 	uint32_t blen;
 	uint64_t b[1];
 } BloomFilter;
@@ -26,15 +42,21 @@ typedef struct BloomFilter
 extern BloomFilter *BloomFilterCreateWithMAndK(uint32_t m, uint16_t k);
 extern BloomFilter *BloomFilterCreateWithPAndN(float8 p, uint32_t n);
 extern BloomFilter *BloomFilterCreate(void);
+extern BloomFilter *BloomFilterCreateBlockedWithPAndN(float8 p, uint32_t n);
+extern BloomFilter *BloomFilterCreateBlocked(void);
+extern BloomFilter *BloomFilterCreateScalableWithPAndN(float8 p, uint32_t n);
+extern BloomFilter *BloomFilterCreateScalable(void);
 extern void BloomFilterDestroy(BloomFilter *bf);
 
 extern BloomFilter *BloomFilterCopy(BloomFilter *bf);
-extern void BloomFilterAdd(BloomFilter *bf, void *key, Size size);
+extern BloomFilter *BloomFilterCompact(BloomFilter *bf);
+extern BloomFilter *BloomFilterAdd(BloomFilter *bf, void *key, Size size);
 extern bool BloomFilterContains(BloomFilter *bf, void *key, Size size);
 extern BloomFilter *BloomFilterUnion(BloomFilter *result, BloomFilter *incoming);
 extern BloomFilter *BloomFilterIntersection(BloomFilter *result, BloomFilter *incoming);
 extern uint64_t BloomFilterCardinality(BloomFilter *bf);
 extern float8 BloomFilterFillRatio(BloomFilter *bf);
 extern Size BloomFilterSize(BloomFilter *bf);
+extern bool BloomFilterIsValid(BloomFilter *bf);
 
 #endif
@@ -15,10 +15,10 @@
 #include "c.h"
 
 /*
- * Unfortunately we can't do top-K with Count-Min Sketch for continuous
- * queries because it will require us to store O(n) values. This isn't a
- * problem in the case when Count-Min Sketch structures are not being
- * merged in which case only O(1) values need to be stored.
+ * Exact top-K with Count-Min Sketch for continuous queries would require us
+ * to store O(n) values, since any value could become a heavy hitter after a
+ * merge. cmstopk.h bundles a sketch with a heap of k candidates, which gives
+ * approximate heavy hitters in O(k) space instead.
  */
 
 typedef struct CountMinSketch
@@ -36,11 +36,13 @@ extern CountMinSketch *CountMinSketchCreate(void);
 extern void CountMinSketchDestroy(CountMinSketch *cms);
 
 extern CountMinSketch *CountMinSketchCopy(CountMinSketch *cms);
-extern void CountMinSketchAdd(CountMinSketch *cms, void *key, Size size, uint32_t count);
+extern CountMinSketch *CountMinSketchCompact(CountMinSketch *cms);
+extern uint32_t CountMinSketchAdd(CountMinSketch *cms, void *key, Size size, uint32_t count);
 extern uint32_t CountMinSketchEstimateFrequency(CountMinSketch *cms, void *key, Size size);
 extern float8 CountMinSketchEstimateNormFrequency(CountMinSketch *cms, void *key, Size size);
 extern uint64_t CountMinSketchTotal(CountMinSketch *cms);
 extern CountMinSketch *CountMinSketchMerge(CountMinSketch *result, CountMinSketch* incoming);
 extern Size CountMinSketchSize(CountMinSketch *cms);
+extern bool CountMinSketchIsValid(CountMinSketch *cms);
 
 #endif
@@ -0,0 +1,63 @@
+/*-------------------------------------------------------------------------
+ *
+ * cmstopk.h
+ *	  Interface for Count-Min Sketch heavy hitters support
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/cmstopk.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_CMSTOPK_H
+#define PIPELINE_CMSTOPK_H
+
+#include "c.h"
+#include "postgres.h"
+#include "pipeline/cmsketch.h"
+#include "utils/typcache.h"
+
+/*
+ * A heap entry for one heavy hitter candidate. The candidate's value and the bytes
+ * it was hashed into the sketch as are stored in the data area at the given offset.
+ */
+typedef struct CMSTopKEntry
+{
+	uint64_t frequency;
+	uint32_t offset;
+	uint32_t vallen;
+	uint32_t keylen;
+	uint32_t pad;
+} CMSTopKEntry;
+
+/*
+ * A Count-Min Sketch bundled with a min-heap of the k candidates with the highest
+ * estimated frequencies seen so far. The sketch, the heap and the candidates'
+ * values are stored contiguously after this header.
+ */
+typedef struct CMSTopK
+{
+	uint32	vl_len_;
+	uint16_t k;
+	uint16_t n;
+	Oid typoid;
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+	char typtype;
+} CMSTopK;
+
+#define CMSTopKSketch(topk) ((CountMinSketch *) ((char *) (topk) + MAXALIGN(sizeof(CMSTopK))))
+#define CMSTopKHeap(topk) ((CMSTopKEntry *) ((char *) CMSTopKSketch(topk) + \
+		MAXALIGN(CountMinSketchSize(CMSTopKSketch(topk)))))
+#define CMSTopKData(topk) ((char *) (CMSTopKHeap(topk) + (topk)->k))
+
+extern CMSTopK *CMSTopKCreate(uint16_t k, TypeCacheEntry *typ);
+extern CMSTopK *CMSTopKCopy(CMSTopK *topk);
+extern CMSTopK *CMSTopKAdd(CMSTopK *topk, Datum value, uint32_t count);
+extern CMSTopK *CMSTopKMerge(CMSTopK *topk, CMSTopK *incoming);
+extern Datum *CMSTopKValues(CMSTopK *topk, uint64_t **freqs, uint16_t *found);
+extern uint32_t CMSTopKEstimateFrequency(CMSTopK *topk, Datum value);
+extern Size CMSTopKSize(CMSTopK *topk);
+
+#endif
@@ -13,15 +13,72 @@
 #ifndef COMBINER_RECEIVER_H
 #define COMBINER_RECEIVER_H
 
+#include "nodes/plannodes.h"
 #include "tcop/dest.h"
 #include "pipeline/cont_execute.h"
 
-typedef void (*CombinerReceiveFunc) (PartialTupleState *pts, int len);
+/*
+ * Called with each partial result a worker is about to send to a combiner, with its cv and namespace set. If the hook
+ * returns true, it has taken the partial, e.g. to send it to a combiner on another node with CombinerReceivePartial,
+ * and is then responsible for acking it with synchronous_stream_insert. Otherwise it goes to this node's combiners.
+ */
+typedef bool (*CombinerReceiveFunc) (PartialTupleState *pts, int len);
 extern CombinerReceiveFunc CombinerReceiveHook;
 
+/*
+ * A combiner backend combines and stores the partial results of the continuous views it claims in place of this
+ * node's combiners, e.g. in a specialized in-memory store. An extension installs one by pointing CombinerBackendHook
+ * at its callbacks in _PG_init. They're all called in workers:
+ *
+ * claims is called once per worker for each view, and returns whether the backend takes all of its partial results.
+ * Claimed views' matrels are never written to, so it's up to the backend to make its results readable.
+ *
+ * begin_batch is called before each batch of partial results of a claimed view is handed to receive, and flush once
+ * all of them have been. Either may be NULL.
+ *
+ * receive is called with each partial result of a claimed view, with its cv, namespace and pointers set. It's only
+ * valid until receive returns, so the backend must copy what it keeps. With synchronous_stream_insert, it must also
+ * copy the partial's acks and pass each of them to InsertBatchAckTuple once the partial is durably combined, e.g.
+ * after its own commit, just like combiners do after theirs.
+ *
+ * GetCombinerBackendInfo returns what is needed to combine a view's partial results the same way combiners would.
+ */
+typedef struct CombinerBackendInfo
+{
+	/* descriptor of the view's partial results, which is its matrel's */
+	TupleDesc desc;
+	/* the expression partial results are hashed by to find their combiner, NULL for views without groups */
+	FuncExpr *hashfunc;
+	/* the query combiners run over partial results, whose aggregates are the combine aggregates of its columns */
+	Query *combine_query;
+	/* the plan combiners run over partial results, see SetCombinerPlanTuplestorestate */
+	PlannedStmt *combine_plan;
+} CombinerBackendInfo;
+
+typedef struct CombinerBackend
+{
+	bool (*claims) (ContQuery *query);
+	void (*begin_batch) (ContQuery *query);
+	void (*receive) (ContQuery *query, PartialTupleState *pts, int len);
+	void (*flush) (ContQuery *query);
+} CombinerBackend;
+
+extern CombinerBackend *CombinerBackendHook;
+
+extern CombinerBackendInfo *GetCombinerBackendInfo(ContQuery *query);
+
+/* guc parameters */
+extern int continuous_query_worker_partials_mem;
+extern int continuous_query_worker_partials_max_wait;
+extern int continuous_query_worker_hot_group_threshold;
+
 extern DestReceiver *CreateCombinerDestReceiver(void);
 extern void SetCombinerDestReceiverParams(DestReceiver *self, ContExecutor *cont_exec, ContQuery *query);
 extern void SetCombinerDestReceiverHashFunc(DestReceiver *self, FuncExpr *hash);
+extern uint64 GetCombinerNameHash(ContQuery *query);
 extern void CombinerDestReceiverFlush(DestReceiver *self);
+extern void CombinerDestReceiverTee(DestReceiver *self, Oid query_id);
+extern bool CombinerDestReceiverHasHeldPartials(DestReceiver *self);
+extern void CombinerReceivePartial(PartialTupleState *pts);
 
 #endif
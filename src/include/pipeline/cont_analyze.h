@@ -47,6 +47,34 @@ typedef struct ContAnalyzeContext
 #define OPTION_MAX_AGE "max_age"
 #define OPTION_PK "pk"
 #define OPTION_STEP_FACTOR "step_factor"
+#define OPTION_DELTA_MERGE "delta_merge"
+#define OPTION_LAZY_GROUPING_SETS "lazy_grouping_sets"
+#define OPTION_ALLOWED_LATENESS "allowed_lateness"
+#define OPTION_FREEZE_AFTER "freeze_after"
+#define OPTION_POOL "pool"
+#define OPTION_OUTPUT_INTERVAL "output_interval"
+#define OPTION_OUTPUT_THRESHOLD "output_threshold"
+#define OPTION_OUTPUT_THRESHOLD_COLUMN "output_threshold_column"
+#define OPTION_SAMPLE "sample"
+#define OPTION_DEDUP_KEY "dedup_key"
+#define OPTION_DEDUP_WINDOW "dedup_window"
+#define OPTION_JOIN_WINDOW "join_window"
+#define OPTION_NOTIFY "notify"
+#define OPTION_NOTIFY_KEY "notify_key"
+#define OPTION_FINALIZE_CACHE "finalize_cache"
+#define OPTION_READ_CACHE_KEY "read_cache_key"
+#define OPTION_TTL "ttl"
+#define OPTION_TTL_COLUMN "ttl_column"
+#define OPTION_MERGE_GROUP "merge_group"
+#define OPTION_CHECKPOINT_INTERVAL "checkpoint_interval"
+#define OPTION_TOP_N "top_n"
+#define OPTION_TOP_N_COLUMN "top_n_column"
+#define OPTION_MAX_STALENESS "max_staleness"
+#define OPTION_DOWNSAMPLE "downsample"
+#define OPTION_DOWNSAMPLE_COLUMN "downsample_column"
+#define OPTION_CLUSTER_GROUPS "cluster_groups"
+
+#define STEP_FACTOR_AUTO "auto"
 
 #define SW_TIMESTAMP_REF 65100
 #define IS_SW_TIMESTAMP_REF(var) (IsA((var), Var) && ((Var *) (var))->varno >= SW_TIMESTAMP_REF)
@@ -71,6 +99,7 @@ extern void ApplyTransitionOut(List *nodes);
 extern List *transformContViewOverlayTargetList(ParseState *pstate, List *tlist);
 extern void transformCreateStreamStmt(CreateStreamStmt *stmt);
 extern SelectStmt *TransformSelectStmtForContProcess(RangeVar *mat_relation, SelectStmt *stmt, SelectStmt **viewptr, ContQueryProcType type);
+extern SelectStmt *TransformRollupSelectStmt(SelectStmt *stmt, RangeVar **source, SelectStmt **matrel_select);
 
 extern TupleDesc parserGetStreamDescr(Oid relid, ContAnalyzeContext *context);
 extern Node *ParseCombineFuncCall(ParseState *pstate, List *args, List *order, Expr *filter, WindowDef *over, int location);
@@ -85,11 +114,17 @@ extern Node *GetSWExpr(RangeVar *rv);
 extern ColumnRef *GetSWTimeColumn(RangeVar *rv);
 extern Interval *GetSWInterval(RangeVar *rv);
 extern ColumnRef *GetWindowTimeColumn(RangeVar *cv);
+extern char *GetSWStepKey(RangeVar *cv);
 extern Node *CreateOuterSWTimeColumnRef(ParseState *pstate, ColumnRef *cref, Node *var);
 
 extern DefElem *GetContinuousViewOption(List *options, char *name);
 extern void ApplyMaxAge(SelectStmt *stmt, DefElem *max_age);
 extern void ApplyStorageOptions(CreateContViewStmt *stmt);
+extern void ApplySampleOption(SelectStmt *select, IntoClause *into);
+extern void ApplyDedupOptions(SelectStmt *select, IntoClause *into);
+extern void ApplyJoinWindowOption(SelectStmt *select, IntoClause *into);
+extern void ApplyMaxStalenessOption(SelectStmt *select, IntoClause *into);
+extern List *ParseDownsamplePolicy(char *policy);
 
 /* Deparsing */
 extern char *deparse_query_def(Query *query);
@@ -23,7 +23,9 @@
 #include "pipeline/cont_scheduler.h"
 #include "pipeline/ipc/queue.h"
 #include "port/atomics.h"
+#include "storage/latch.h"
 #include "storage/spin.h"
+#include "utils/hsearch.h"
 #include "utils/timestamp.h"
 
 /* Represents a single batch of inserts made into a stream. */
@@ -38,6 +40,8 @@ typedef struct InsertBatch
 	pg_atomic_uint32 num_wtups;
 	/* Total number of tuples sent to combiners */
 	pg_atomic_uint32 num_ctups;
+	/* Latch of the process that inserted the batch, set by the ack that completes it */
+	Latch *latch;
 } InsertBatch;
 
 /* Represents the number of tuples processed for the stream batch. */
@@ -45,10 +49,18 @@ typedef struct InsertBatchAck
 {
 	int batch_id;
 	InsertBatch *batch;
+	/* the stream_insert_batch_id the batch was written with, 0 if none */
+	int64 client_batch_id;
 } InsertBatchAck;
 
 extern InsertBatch *InsertBatchCreate(void);
+extern bool InsertBatchIsAcked(InsertBatch *batch);
 extern void InsertBatchWaitAndRemove(InsertBatch *batch, int num_tuples);
+extern void InsertBatchWaitOrDefer(InsertBatch *batch, int num_tuples);
+extern uint64 InsertBatchDefer(InsertBatch *batch, int num_tuples);
+extern uint64 InsertBatchLastToken(void);
+extern bool InsertBatchTokenAcked(uint64 token);
+extern void InsertBatchWaitForToken(uint64 token);
 extern void InsertBatchIncrementNumCTuples(InsertBatch *batch, int n);
 extern void InsertBatchIncrementNumWTuples(InsertBatch *batch, int n);
 extern void InsertBatchAckTuple(InsertBatchAck *ack);
@@ -60,9 +72,31 @@ typedef struct RecordTupleDesc
 	bytea *desc;
 } RecordTupleDesc;
 
+/*
+ * Column of a columnar stream batch. All offsets are relative to the beginning of the batch, and
+ * nulls is 0 if none of the column's values are null. Fixed-width values are stored as an array
+ * with one entry per row, while variable-width values are stored back to back and located through
+ * an array of per-row offsets.
+ */
+typedef struct StreamColumn
+{
+	uint32 nulls; /* null bitmap, with a set bit for each non-null value */
+	uint32 offsets; /* value offsets, only used for variable-width columns */
+	uint32 values;
+} StreamColumn;
+
+typedef struct StreamColumnarBatch
+{
+	int32 len;
+	int32 ntups;
+	int32 natts;
+	StreamColumn columns[FLEXIBLE_ARRAY_MEMBER];
+} StreamColumnarBatch;
+
 typedef struct StreamTupleState
 {
 	TimestampTz arrival_time;
+	Oid relid; /* the stream this event was written to */
 
 	bytea *desc;
 	HeapTuple tup;
@@ -73,13 +107,34 @@ typedef struct StreamTupleState
 	int nacks;
 	InsertBatchAck *acks; /* the ack this tuple is responsible for */
 	Bitmapset *queries;
+
+	/*
+	 * Number of tuples packed into this state. Batched states share a single desc, ack set and
+	 * queries bitmapset, with tup pointing to the first of ntups serialized tuples.
+	 */
+	int ntups;
+	HeapTuple *tups; /* only used by producers before a batched state is serialized */
+
+	/*
+	 * Batched states may instead be encoded column by column, in which case tup is NULL and each
+	 * unpacked state reads its values from row of the shared columnar batch.
+	 */
+	StreamColumnarBatch *columns;
+	int row;
 } StreamTupleState;
 
 extern void StreamTupleStatePopFn(void *ptr, int len);
 extern void StreamTupleStatePeekFn(void *ptr, int len);
 extern void StreamTupleStateCopyFn(void *dest, void *src, int len);
-extern StreamTupleState *StreamTupleStateCreate(HeapTuple tup, TupleDesc desc, bytea *packed_desc,
+extern StreamTupleState *StreamTupleStateCreate(Oid relid, HeapTuple tup, TupleDesc desc, bytea *packed_desc,
+		Bitmapset *queries, InsertBatchAck *acks, int nacks, int *len);
+extern StreamTupleState *StreamTupleStateCreateBatch(Oid relid, HeapTuple *tups, int ntups, bytea *packed_desc,
 		Bitmapset *queries, InsertBatchAck *acks, int nacks, int *len);
+extern StreamTupleState *StreamTupleStateCreateColumnarBatch(Oid relid, HeapTuple *tups, int ntups, TupleDesc desc,
+		bytea *packed_desc, Bitmapset *queries, InsertBatchAck *acks, int nacks, int *len);
+extern HeapTuple StreamTupleStateGetTuple(StreamTupleState *sts, int n);
+extern Datum StreamColumnarBatchGetAttr(StreamColumnarBatch *batch, TupleDesc desc, int attnum, int row,
+		bool *isnull);
 
 
 typedef struct PartialTupleState
@@ -92,6 +147,11 @@ typedef struct PartialTupleState
 	uint64 hash;
 	Oid query_id;
 
+	/* when the oldest event of the worker batch this was computed from was inserted */
+	TimestampTz insert_time;
+	/* arrival time of the newest event of the worker batch this was computed from */
+	TimestampTz arrival_time;
+
 	/* For pipelinedb_enterprise */
 	NameData cv;
 	NameData namespace;
@@ -108,11 +168,33 @@ typedef struct ContQueryState
 	MemoryContext state_cxt;
 	MemoryContext tmp_cxt;
 	PgStat_StatCQEntryLocal stats;
+	/* where the memory used by this state is published, see cont_memory.c */
+	struct ContQueryMemoryEntry *mem;
+	/* keys recently seen by a query with a dedup_key, kept across batches, see dedup.c */
+	struct DedupFilter *dedup;
+	/* for queries reading several streams, their events split by stream, see stream_fdw.c */
+	struct MultiStreamState *streams;
 } ContQueryState;
 
 typedef struct ContExecutor ContExecutor;
 typedef ContQueryState *(*ContQueryStateInit) (ContExecutor *exec, ContQueryState *state);
 
+/* entry of a ContExecutor's states table */
+typedef struct ContQueryStateEntry
+{
+	Oid id; /* hash key --- MUST BE FIRST */
+	ContQueryState *state;
+} ContQueryStateEntry;
+
+/* entry of a ContExecutor's message index, holding the offsets into peeked_msgs of a query's messages */
+typedef struct ContQueryMsgIndexEntry
+{
+	Oid id; /* hash key --- MUST BE FIRST */
+	int *offsets;
+	int n;
+	int max;
+} ContQueryMsgIndexEntry;
+
 typedef struct ipc_message
 {
 	void *msg;
@@ -128,6 +210,13 @@ struct ContExecutor
 
 	ipc_queue *ipcq;
 	ipc_multi_queue *ipcmq;
+
+	/* other workers' insert queues that we may steal events from */
+	ipc_queue **peers;
+	int npeers;
+	int steal_idx;
+	MemoryContext steal_cxt;
+	List *stolen_msgs;
 	Bitmapset *queries;
 	bool update_queries;
 
@@ -144,21 +233,69 @@ struct ContExecutor
 	int curr_msg;
 	int num_msgs;
 	Size nbytes;
+	/*
+	 * Batch size and maximum wait of the current batch, which are continuous_query_batch_size and
+	 * continuous_query_max_wait unless continuous_query_adaptive_batching lowers them, whether the
+	 * current batch was filled, and the moving average of batch latencies the adaptation is based on
+	 */
+	int batch_size;
+	int max_wait;
+	bool batch_filled;
+	double latency;
+	/*
+	 * ContQueryMsgIndexEntrys keyed by query id, built once the batch has been read in full so that each
+	 * query after the first only goes through its own messages, and the current query's entry, if any.
+	 * curr_msg is then a position in the current query's offsets rather than in peeked_msgs.
+	 */
+	HTAB *msg_index;
+	ContQueryMsgIndexEntry *query_msg_index;
 
 	Bitmapset *queries_seen;
+	/* batched states whose events continuous transforms handed directly to the rest of the batch */
+	List *fused_msgs;
+
+	/* insert time of the oldest item read in the current batch, and when the current query started */
+	TimestampTz oldest_insert;
+	/* arrival time of the newest event read in the current worker batch */
+	TimestampTz newest_arrival;
+	TimestampTz query_start;
+	/* messages yielded to the current query, for the cq__query__done probe */
+	int query_msgs;
 
 	Oid current_query_id;
 	ContQueryState *current_query;
-	ContQueryState *states[MAX_CQS];
+	/* ContQueryStateEntrys of the queries we have state for, keyed by query id */
+	HTAB *states;
 	ContQueryStateInit initfn;
 };
 
+/* Whether idle workers steal unread events from busy workers */
+extern bool continuous_query_work_stealing;
+
+/* Whether batch sizes and waits adapt to load, and the end-to-end latency they then aim for */
+extern bool continuous_query_adaptive_batching;
+extern int continuous_query_latency_target;
+
+/* Whether per-batch memory is allocated from Arenas */
+extern bool continuous_query_batch_arena;
+
+/* Whether continuous query processes build their query states as soon as they start */
+extern bool continuous_query_prewarm;
+
 extern ContExecutor *ContExecutorNew(ContQueryProcType type, ContQueryStateInit initfn);
 extern void ContExecutorDestroy(ContExecutor *exec);
+extern ContQueryState *ContExecutorWarmQuery(ContExecutor *exec, Oid id);
 extern void ContExecutorStartBatch(ContExecutor *exec, int timeout);
 extern Oid ContExecutorStartNextQuery(ContExecutor *exec, int timeout);
 extern void ContExecutorPurgeQuery(ContExecutor *exec);
+extern ContQueryState *ContExecutorGetState(ContExecutor *exec, Oid id);
+extern void ContExecutorSetState(ContExecutor *exec, Oid id, ContQueryState *state);
+extern List *ContExecutorGetStates(ContExecutor *exec);
 extern void *ContExecutorYieldNextMessage(ContExecutor *exec, int *len);
+extern bool ContExecutorCanFuse(ContExecutor *exec, Bitmapset *queries);
+extern bool ContExecutorSameMessages(ContExecutor *exec, Oid a, Oid b);
+extern void ContExecutorFuseTuples(ContExecutor *exec, Oid relid, bytea *packed_desc, HeapTuple *tups, Bitmapset **queries,
+		int ntups, InsertBatchAck *acks, int nacks);
 extern void ContExecutorEndQuery(ContExecutor *exec);
 extern void ContExecutorEndBatch(ContExecutor *exec, bool commit);
 
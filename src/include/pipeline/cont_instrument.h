@@ -0,0 +1,37 @@
+/*-------------------------------------------------------------------------
+ *
+ * cont_instrument.h
+ *	  Interface for instrumenting the plans of continuous queries as they run
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/cont_instrument.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef CONT_INSTRUMENT_H
+#define CONT_INSTRUMENT_H
+
+#include "postgres.h"
+#include "catalog/pipeline_query_fn.h"
+#include "executor/execdesc.h"
+#include "pipeline/cont_scheduler.h"
+
+/* maximum number of continuous queries that can be instrumented at the same time */
+#define CONT_INSTRUMENT_SLOTS 4
+
+/* nodes of a plan beyond this many aren't instrumented */
+#define CONT_INSTRUMENT_MAX_NODES 128
+
+/* room for the EXPLAIN ANALYZE output of each plan, longer output is truncated */
+#define CONT_INSTRUMENT_TEXT_SIZE (32 * 1024)
+
+extern Size ContInstrumentShmemSize(void);
+extern void ContInstrumentShmemInit(void);
+
+extern bool ContInstrumentStart(Oid query_id, ContQueryProcType ptype, PlanState *planstate);
+extern void ContInstrumentEnd(Oid query_id, ContQueryProcType ptype, QueryDesc *query_desc);
+
+extern void ExplainAnalyzeContQuery(ContQuery *cq, int batches, char **worker_plan, char **combiner_plan);
+
+#endif
@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ * cont_memory.h
+ *	  Interface for accounting the memory used by continuous query states
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/cont_memory.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef CONT_MEMORY_H
+#define CONT_MEMORY_H
+
+#include "postgres.h"
+#include "pipeline/cont_execute.h"
+
+/* maximum number of query states whose memory is published at the same time */
+#define CONT_MEMORY_ENTRIES 4096
+
+/* guc parameters */
+extern int continuous_query_state_mem;
+
+/* a copy of the memory used by the state of a query in a process, see GetContQueryMemoryStats */
+typedef struct ContQueryMemoryStats
+{
+	Oid query_id;
+	pid_t pid;
+	ContQueryProcType ptype;
+	uint64 bytes;
+	uint64 peak_bytes;
+	uint64 cache_bytes;
+	uint64 plan_bytes;
+	uint64 limit_exceeded;
+} ContQueryMemoryStats;
+
+extern Size ContQueryMemoryShmemSize(void);
+extern void ContQueryMemoryShmemInit(void);
+
+extern bool ContQueryStateReportMemory(ContQueryState *state, Size cache_bytes, Size plan_bytes);
+extern ContQueryMemoryStats *GetContQueryMemoryStats(int *nstats);
+
+#endif
@@ -18,6 +18,7 @@
 #include "nodes/plannodes.h"
 #include "nodes/relation.h"
 #include "pipeline/cont_scheduler.h"
+#include "pipeline/tuplebatch.h"
 #include "tcop/utility.h"
 #include "utils/rel.h"
 #include "utils/relcache.h"
@@ -30,7 +31,9 @@ extern ProcessUtility_hook_type SaveUtilityHook;
 	((planner_rt_fetch(relid, root))->relkind == RELKIND_STREAM))
 
 extern PlannedStmt *GetContPlan(ContQuery *view, ContQueryProcType type);
+extern PlannedStmt *GetMergedWorkerPlan(ContQuery *view, List *others, List **merged, List **attmaps);
 extern TuplestoreScan *SetCombinerPlanTuplestorestate(PlannedStmt *plan, Tuplestorestate *tupstore);
+extern TuplestoreScan *SetCombinerPlanTupleBatch(PlannedStmt *plan, TupleBatch *batch);
 extern FuncExpr *GetGroupHashIndexExpr(ResultRelInfo *ri);
 extern PlannedStmt *GetCombinerLookupPlan(ContQuery *view);
 extern PlannedStmt *GetContinuousViewOverlayPlan(ContQuery *view);
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * cont_query_cache.h
+ *	  Interface for the shared cache of analyzed continuous queries
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/cont_query_cache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef CONT_QUERY_CACHE_H
+#define CONT_QUERY_CACHE_H
+
+#include "postgres.h"
+#include "catalog/pipeline_query_fn.h"
+#include "nodes/parsenodes.h"
+#include "pipeline/cont_scheduler.h"
+
+/* maximum number of analyzed queries kept, across all databases and process types */
+#define CONT_QUERY_CACHE_SIZE 4096
+
+/* shared memory reserved for the serialized queries */
+#define CONT_QUERY_CACHE_BYTES (8 * 1024 * 1024)
+
+extern Size ContQueryCacheShmemSize(void);
+extern void ContQueryCacheShmemInit(void);
+
+extern uint32 GetContQueryCacheGeneration(void);
+extern Query *ContQueryCacheLookup(ContQuery *cq, ContQueryProcType type);
+extern void ContQueryCacheStore(ContQuery *cq, ContQueryProcType type, Query *query, uint32 generation);
+extern void InvalidateContQueryCache(void);
+
+#endif
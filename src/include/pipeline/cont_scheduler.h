@@ -18,20 +18,45 @@
 #include "postmaster/bgworker.h"
 #include "storage/dsm.h"
 #include "storage/spin.h"
+#include "utils/guc.h"
+#include "utils/timestamp.h"
 
-#define MAX_CQS 1024
+/*
+ * Upper bound on continuous query ids. Processes keep their per-query state in hash tables,
+ * so nothing is sized by it.
+ */
+#define MAX_CQS 65536
 #define BGWORKER_IS_CONT_QUERY_PROC 0x1000
 
+/* workers that aren't in any of the pools named by continuous_query_worker_pools */
+#define DEFAULT_WORKER_POOL 0
+#define DEFAULT_WORKER_POOL_NAME "default"
+
 typedef enum
 {
 	Combiner = 0,
 	Worker,
 	AdhocVacuumer,
+	Sink,
 	Scheduler /* unused */
 } ContQueryProcType;
 
 typedef struct ContQueryDatabaseMetadata ContQueryDatabaseMetadata;
 
+/*
+ * Group hashes are routed to combiners through a fixed number of shards, each of which is
+ * owned by a single combiner. When the scheduler moves a shard, its previous owner is kept in
+ * prev until that combiner has committed everything it had pending for the shard, and the new
+ * owner doesn't combine anything for the shard until then.
+ */
+#define NUM_COMBINER_SHARDS 1024
+
+typedef struct CombinerShard
+{
+	volatile int owner;
+	volatile int prev; /* -1 unless the shard is being handed off */
+} CombinerShard;
+
 typedef struct ContQueryProc
 {
 	ContQueryProcType type;
@@ -41,9 +66,20 @@ typedef struct ContQueryProc
 	int id; /* unique across all cont query processes */
 	volatile int group_id; /* unqiue [0, n) for each db_oid, type pair */
 
+	/* NULL if the process isn't running, which combiners that own no shards may not be */
 	BackgroundWorkerHandle *bgw_handle;
 
 	ContQueryDatabaseMetadata *db_meta;
+
+	/* the last times the process found its queue empty and non-empty, which is how the scheduler sees its load */
+	volatile TimestampTz last_idle;
+	volatile TimestampTz last_busy;
+
+	/* progress published for pipeline_flush, see ContQueryProcEndBatch */
+	pg_atomic_uint32 in_batch;
+	pg_atomic_uint32 holding_partials; /* workers: partial results are held for later batches */
+	pg_atomic_uint64 batches_done;
+	pg_atomic_uint64 committed_pos; /* combiners: queue position everything before which is committed */
 } ContQueryProc;
 
 struct ContQueryDatabaseMetadata
@@ -56,6 +92,10 @@ struct ContQueryDatabaseMetadata
 	sig_atomic_t running;
 	sig_atomic_t dropdb;
 	sig_atomic_t terminate;
+	/* set by backends to have the scheduler start the processes when lazily activating databases */
+	sig_atomic_t activate;
+	/* number of pipeline_flush calls in progress, which make processes send and commit everything at once */
+	pg_atomic_uint32 flushes_pending;
 
 	int lock_idx; /* ContQuerySchedulerShmem->locks index where the locks for this DB's workers start */
 
@@ -63,6 +103,23 @@ struct ContQueryDatabaseMetadata
 	ContQueryProc *db_procs;
 
 	ContQueryProc adhoc_vacuumer;
+
+	/* delivers the rows of transforms that output to pipeline_sink, see sink.c */
+	ContQueryProc sink;
+	volatile dsm_handle sink_handle;
+	volatile bool sink_ready;
+
+	CombinerShard combiner_shards[NUM_COMBINER_SHARDS];
+	/* bumped each time a combiner releases shards it handed off, see GetCombinerShardReleases */
+	pg_atomic_uint64 shard_releases;
+
+	/* the number of workers and the maximum number of combiners run for this database */
+	int num_workers;
+	int num_combiners;
+
+	/* the first num_active_combiners combiners are running and the shards are spread over them */
+	int num_active_combiners;
+	TimestampTz last_autoscale;
 };
 
 typedef struct ContQueryRunParams
@@ -79,8 +136,16 @@ extern char *GetContQueryProcName(ContQueryProc *proc);
 /* guc parameters */
 extern bool continuous_queries_enabled;
 extern bool continuous_query_crash_recovery;
+extern int  continuous_query_restart_delay;
+extern bool continuous_query_lazy_activation;
 extern int  continuous_query_num_combiners;
+extern int  continuous_query_num_active_combiners;
+extern bool continuous_query_combiner_autoscale;
+extern int  continuous_query_combiner_autoscale_busy_time;
+extern int  continuous_query_combiner_autoscale_idle_time;
 extern int  continuous_query_num_workers;
+extern int  continuous_query_database_num_workers;
+extern int  continuous_query_database_num_combiners;
 extern int  continuous_query_batch_size;
 extern int  continuous_query_max_wait;
 extern int  continuous_query_combiner_work_mem;
@@ -88,6 +153,33 @@ extern int  continuous_query_combiner_synchronous_commit;
 
 extern int continuous_query_commit_interval;
 extern double continuous_query_proc_priority;
+extern char *continuous_query_numa_nodes;
+extern char *continuous_query_worker_pools;
+extern char *continuous_query_worker_cpus;
+extern char *continuous_query_combiner_cpus;
+extern char *continuous_query_broker_cpus;
+extern char *continuous_query_scheduler_cpus;
+extern char *continuous_query_cgroup;
+extern int continuous_query_transform_queue_weight;
+
+extern bool check_continuous_query_numa_nodes(char **newval, void **extra, GucSource source);
+extern bool check_continuous_query_database_setting(int *newval, void **extra, GucSource source);
+extern bool check_continuous_query_worker_pools(char **newval, void **extra, GucSource source);
+extern bool check_continuous_query_cpus(char **newval, void **extra, GucSource source);
+
+extern void ActivateContQueryDatabase(void);
+extern int GetDatabaseNumWorkers(void);
+extern int GetNumWorkerPools(void);
+extern int GetWorkerPoolId(const char *name);
+extern void GetWorkerPoolWorkers(int pool, int *first, int *nworkers);
+extern int GetWorkerPoolForWorker(int group_id);
+extern int GetCombinerForGroupHash(uint64 hash);
+extern int GetCombinerShardCount(int group_id);
+extern bool IsCombinerShardHandedOff(uint64 hash);
+extern bool HasHandedOffCombinerShards(void);
+extern bool ReleaseHandedOffCombinerShards(void);
+extern uint64 GetCombinerShardReleases(void);
+extern int GetContQueryNumaNode(int group_id);
 
 #define MyDSMCQueue (MyContQueryProc->cq_handle->cqueue)
 
@@ -112,6 +204,40 @@ extern bool IsContQueryTriggerProcess(void);
 extern pid_t StartContQueryScheduler(void);
 
 extern void ContinuousQueryCombinerMain(void);
+/* Maximum memory in kB each combiner may use to cache each continuous view's groups, 0 disables caching */
+extern int continuous_query_combiner_group_cache_mem;
+/* Whether combiners overwrite changed fixed-width, non-indexed columns of existing groups in place */
+extern bool continuous_query_combiner_inplace_updates;
+/* Whether combiners skip looking up groups that a filter of the matrel's group hashes rules out */
+extern bool continuous_query_combiner_group_filter;
+/* Whether combiners insert each sync's entries into non-unique matrel btree indexes all at once, in key order */
+extern bool continuous_query_combiner_batch_index_inserts;
+/* Whether combiners keep matrel ResultRelInfos across syncs */
+extern bool continuous_query_combiner_reuse_result_rels;
+/* Whether combiners sync each continuous view in its own subtransaction, so that a failed sync only loses its own view's rows */
+extern bool continuous_query_combiner_isolate_syncs;
+/* Whether combiners only recompute the sliding-window groups whose windows changed on each tick */
+extern bool continuous_query_combiner_incremental_sw;
+/* Maximum memory in KB each combiner uses to cache the steps of each sliding-window view, 0 means no limit */
+extern int continuous_query_combiner_sw_cache_mem;
+/* Number of matrel rows the window of each sliding-window view with an adaptive step should span */
+extern int sliding_window_auto_step_rows;
+/* Whether combiners lower the fillfactor of matrels whose group updates are too rarely HOT, and how far */
+extern bool continuous_query_combiner_adaptive_fillfactor;
+extern int continuous_view_min_fillfactor;
+/* Maximum number of expired groups each combiner deletes from a view with a ttl per transaction */
+extern int continuous_view_ttl_batch_size;
+/* Time in milliseconds after which combiners compact the delta rows of delta-merge views */
+extern int continuous_query_delta_compaction_interval;
+/* Whether workers keep initialized plans across batches */
+extern bool continuous_query_reuse_worker_plans;
+/* Maximum age in ms of hash tables kept for stream-table joins, 0 disables keeping them */
+extern int continuous_query_join_cache_max_age;
+/* Whether workers share step-level partial results among sliding-window views differing only in window length */
+extern bool continuous_query_worker_share_sw_steps;
+/* Whether workers hand the output of continuous transforms directly to the queries reading it */
+extern bool continuous_query_fuse_transforms;
+
 extern void ContinuousQueryWorkerMain(void);
 extern bool ShouldTerminateContQueryProcess(void);
 
@@ -120,4 +246,9 @@ extern void SignalContQuerySchedulerRefreshDBList(void);
 
 extern ContQueryDatabaseMetadata *GetContQueryDatabaseMetadata(Oid db_oid);
 
+extern bool IsContQueryFlushPending(void);
+extern void ContQueryProcStartBatch(void);
+extern void ContQueryProcEndBatch(bool holding);
+extern void ContQueryProcCommitted(ipc_queue *ipcq);
+
 #endif   /* CONT_SCHEDULER_H */
@@ -19,19 +19,32 @@ extern bool continuous_query_materialization_table_updatable;
 #define CQ_OSREL_SUFFIX "_osrel"
 #define CQ_MATREL_SUFFIX "_mrel"
 #define CQ_SEQREL_SUFFIX "_seq"
+#define CQ_CKPTREL_SUFFIX "_ckpt"
 #define CQ_MATREL_PKEY "$pk"
+#define CQ_MATREL_FINAL_PREFIX "$final_"
 #define MatRelUpdatesEnabled() (continuous_query_materialization_table_updatable)
 
+/* index entries of a matrel that are inserted all at once, in key order, see CQMatRelBeginIndexBatch */
+typedef struct CQMatRelIndexBatch CQMatRelIndexBatch;
+
 extern ResultRelInfo *CQMatRelOpen(Relation matrel);
 extern void CQOSRelClose(ResultRelInfo *rinfo);
 extern ResultRelInfo *CQOSRelOpen(Relation osrel);
 extern void CQMatRelClose(ResultRelInfo *rinfo);
-extern void ExecInsertCQMatRelIndexTuples(ResultRelInfo *indstate, TupleTableSlot *slot, EState *estate);
-extern void ExecCQMatRelUpdate(ResultRelInfo *ri, TupleTableSlot *slot, EState *estate);
+extern CQMatRelIndexBatch *CQMatRelBeginIndexBatch(ResultRelInfo *ri, int work_mem);
+extern void CQMatRelEndIndexBatch(CQMatRelIndexBatch *batch);
+extern void ExecInsertCQMatRelIndexTuples(ResultRelInfo *indstate, TupleTableSlot *slot, EState *estate,
+		CQMatRelIndexBatch *batch);
+extern void ExecCQMatRelUpdate(ResultRelInfo *ri, TupleTableSlot *slot, EState *estate, CQMatRelIndexBatch *batch);
 extern void ExecCQMatRelInsert(ResultRelInfo *ri, TupleTableSlot *slot, EState *estate);
 
 extern char *CVNameToOSRelName(char *cv_name);
 extern char *CVNameToMatRelName(char *cv_name);
 extern char *CVNameToSeqRelName(char *cv_name);
+extern char *CVNameToCkptRelName(char *cv_name);
+
+extern Oid CQMatRelGetCheckpointRelId(char *cv_name, Oid matrelid);
+extern int64 CQMatRelCheckpoint(Oid matrelid, Oid ckptid);
+extern int64 CQMatRelRestore(Oid matrelid, Oid ckptid);
 
 #endif
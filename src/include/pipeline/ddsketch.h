@@ -0,0 +1,59 @@
+/*-------------------------------------------------------------------------
+ *
+ * ddsketch.h
+ *	  Interface for DDSketch support
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/ddsketch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_DDSKETCH_H
+#define PIPELINE_DDSKETCH_H
+
+#include "c.h"
+
+/*
+ * A DDSketch counts values in logarithmically sized buckets, so that every quantile
+ * it returns is within a relative error of alpha of the actual one. Positive and
+ * negative values have a contiguous range of bucket keys each, and their counts are
+ * stored one after the other after this header.
+ */
+typedef struct DDSketch
+{
+	uint32	vl_len_;
+	uint32 max_buckets;
+	float8 alpha;
+	/* ln((1 + alpha) / (1 - alpha)), the width of each bucket on a log scale */
+	float8 gamma_ln;
+
+	uint64 count;
+	uint64 zero_count;
+	float8 min;
+	float8 max;
+
+	int32 pos_offset;
+	uint32 pos_len;
+	int32 neg_offset;
+	uint32 neg_len;
+	uint64 buckets[1];
+} DDSketch;
+
+#define DDSketchPositive(s) ((s)->buckets)
+#define DDSketchNegative(s) ((s)->buckets + (s)->pos_len)
+
+extern DDSketch *DDSketchCreate(void);
+extern DDSketch *DDSketchCreateWithAlpha(float8 alpha);
+extern void DDSketchDestroy(DDSketch *s);
+extern DDSketch *DDSketchCopy(DDSketch *s);
+
+extern DDSketch *DDSketchAdd(DDSketch *s, float8 x, uint64 count);
+extern DDSketch *DDSketchMerge(DDSketch *s, DDSketch *incoming);
+
+extern float8 DDSketchQuantile(DDSketch *s, float8 q);
+extern float8 DDSketchCDF(DDSketch *s, float8 x);
+
+extern Size DDSketchSize(DDSketch *s);
+
+#endif
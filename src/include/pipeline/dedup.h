@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * dedup.h
+ *	  Interface for dropping stream events whose key was recently seen
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/dedup.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_DEDUP_H
+#define PIPELINE_DEDUP_H
+
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+#include "pipeline/bloom.h"
+#include "utils/timestamp.h"
+#include "utils/typcache.h"
+
+#define DEDUP_GENERATIONS 4
+
+typedef struct DedupFilter
+{
+	MemoryContext cxt;
+	int window_ms;
+	/* each generation holds the keys seen over window_ms / (DEDUP_GENERATIONS - 1) */
+	int generation_ms;
+	TimestampTz rotated_at;
+	int newest;
+	BloomFilter *generations[DEDUP_GENERATIONS];
+	StringInfoData buf;
+} DedupFilter;
+
+extern DedupFilter *DedupFilterCreate(int window_ms);
+extern void DedupFilterRotate(DedupFilter *df, TimestampTz now);
+extern bool DedupFilterSeen(DedupFilter *df, Datum key, TypeCacheEntry *typ);
+
+#endif
@@ -0,0 +1,50 @@
+/*-------------------------------------------------------------------------
+ *
+ * distinct.h
+ *	  Interface for hybrid exact/approximate distinct counting
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/distinct.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_DISTINCT_H
+#define PIPELINE_DISTINCT_H
+
+#include "c.h"
+
+#include "pipeline/hll.h"
+
+#define DISTINCT_SET_ENCODING 'x'
+#define DISTINCT_DEFAULT_THRESHOLD 1024
+#define DISTINCT_MAX_THRESHOLD (1 << 20)
+
+/*
+ * A distinct counter keeps the exact set of the hashes of the elements it has seen until
+ * it has more than threshold of them, at which point it becomes an HLL with the same hash
+ * codes hll_agg would have used. Its encoding is at the same offset as an HLL's, so a
+ * counter is either a DistinctSet or a HyperLogLog, and DistinctIsExact tells which.
+ */
+typedef struct DistinctSet
+{
+	uint32	vl_len_;
+	char encoding;
+	/* p of the HLL this becomes */
+	uint8 p;
+	uint32 threshold;
+	uint32 num_hashes;
+	/* sorted */
+	uint64 hashes[1];
+} DistinctSet;
+
+#define DistinctIsExact(d) (((DistinctSet *) (d))->encoding == DISTINCT_SET_ENCODING)
+#define DistinctSetSize(d) (offsetof(DistinctSet, hashes) + sizeof(uint64) * (d)->num_hashes)
+
+extern DistinctSet *DistinctSetCreate(uint32 threshold);
+extern struct varlena *DistinctCopy(struct varlena *d);
+extern struct varlena *DistinctAdd(struct varlena *d, void *elem, Size len);
+extern struct varlena *DistinctMerge(struct varlena *d, struct varlena *incoming);
+extern uint64 DistinctCount(struct varlena *d);
+
+#endif
@@ -19,6 +19,13 @@
 
 #define FSS_STORES_DATUMS(fss) ((fss)->top_k != NULL)
 
+/*
+ * FSS summaries created with this flag store an index from monitored values to their
+ * slots in the monitored element array. Older summaries without it are still readable.
+ */
+#define FSS_INDEXED		0x01
+#define FSS_IS_INDEXED(fss) ((fss)->flags & FSS_INDEXED)
+
 #define ELEMENT_SET 	0x01
 #define ELEMENT_NEW 	0x02
 #define ELEMENT_NULL 0x04
@@ -63,6 +70,7 @@ typedef struct FSS
 	uint16_t h;
 	uint16_t m;
 	uint16_t k;
+	uint16_t flags;
 	FSSTypeInfo typ;
 	Counter *bitmap_counter; /* length h */
 	MonitoredElement *monitored_elements; /* length m */
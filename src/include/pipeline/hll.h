@@ -20,6 +20,7 @@
 #include "lib/stringinfo.h"
 #include "utils/datum.h"
 
+#define HLL_DEFAULT_P 14
 #define HLL_MAX_SPARSE_BYTES 11000
 #define HLL_MAX_EXPLICIT_REGISTERS 2048 /* 2048 * 4 = 8192 bytes */
 
@@ -29,10 +30,13 @@
 #define HLL_DENSE_CLEAN 'D'
 #define HLL_EXPLICIT_DIRTY 'e'
 #define HLL_EXPLICIT_CLEAN 'E'
+#define HLL_COMPACT_DIRTY 'c'
+#define HLL_COMPACT_CLEAN 'C'
 
 #define HLL_IS_SPARSE(hll) ((hll)->encoding == HLL_SPARSE_DIRTY || (hll)->encoding == HLL_SPARSE_CLEAN)
 #define HLL_IS_EXPLICIT(hll) ((hll)->encoding == HLL_EXPLICIT_DIRTY || (hll)->encoding == HLL_EXPLICIT_CLEAN)
 #define HLL_IS_DENSE(hll) ((hll)->encoding == HLL_DENSE_DIRTY || (hll)->encoding == HLL_DENSE_CLEAN)
+#define HLL_IS_COMPACT(hll) ((hll)->encoding == HLL_COMPACT_DIRTY || (hll)->encoding == HLL_COMPACT_CLEAN)
 
 #define HLL_EXPLICIT_GET_NUM_REGISTERS(hll) ((hll)->mlen / 4)
 
@@ -59,8 +63,13 @@ typedef struct HyperLogLog
 HyperLogLog *HLLCreateWithP(int p);
 HyperLogLog *HLLCreate(void);
 HyperLogLog *HLLAdd(HyperLogLog *hll, void *elem, Size len, int *result);
+uint32 HLLRegisterUpdate(uint8 p, void *elem, Size len);
+uint64 HLLHash(void *elem, Size len);
+uint32 HLLHashRegisterUpdate(uint8 p, uint64 hash);
+HyperLogLog *HLLAddMany(HyperLogLog *hll, uint32 *updates, int n, int *result);
 HyperLogLog *HLLCopy(HyperLogLog *src);
 uint64 HLLCardinality(HyperLogLog *hll);
 HyperLogLog *HLLUnion(HyperLogLog *result, HyperLogLog *incoming);
+bool HLLIsValid(HyperLogLog *hll);
 
 #endif
@@ -12,24 +12,41 @@
 #include "postgres.h"
 
 #include "pipeline/ipc/queue.h"
+#include "storage/dsm.h"
+
+/* upper bound on continuous_query_num_ipc_brokers */
+#define MAX_IPC_BROKERS 16
+
+typedef struct ipc_queue_info
+{
+	const char *type;
+	int group_id;
+	ipc_queue *queue;
+} ipc_queue_info;
 
 /* guc */
 extern int continuous_query_ipc_shared_mem;
+extern bool continuous_query_ipc_lock_free_insert;
+extern int continuous_query_num_ipc_brokers;
 
 extern Size IPCMessageBrokerShmemSize(void);
 extern void IPCMessageBrokerShmemInit(void);
 
-extern pid_t StartIPCMessageBroker(void);
+extern pid_t StartIPCMessageBroker(int id);
 extern bool IsIPCMessageBrokerProcess(void);
 
-extern void signal_ipc_broker_process(void);
+extern void signal_ipc_broker_process(int id);
 
 extern ipc_queue *acquire_my_ipc_queue(void);
 extern void release_my_ipc_queue(void);
 extern ipc_queue *acquire_my_broker_ipc_queue(void);
+extern ipc_queue *acquire_worker_ipc_queue(int idx);
 
-extern ipc_queue *get_any_worker_queue_with_lock(void);
+extern ipc_queue *get_any_worker_queue_with_lock(int pool);
 extern ipc_queue *get_worker_queue_with_lock(int idx, bool broker_handled);
 extern ipc_queue *get_combiner_queue_with_lock(int idx);
 
+extern Oid *get_ipc_queue_dbs(int *ndbs);
+extern ipc_queue_info *get_db_ipc_queues(Oid dbid, dsm_segment **segment, int *nqueues);
+
 #endif
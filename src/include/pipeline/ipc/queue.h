@@ -13,6 +13,7 @@
 
 #include "port/atomics.h"
 #include "storage/lwlock.h"
+#include "storage/spin.h"
 #include "utils/timestamp.h"
 
 typedef struct ipc_queue_slot
@@ -23,6 +24,7 @@ typedef struct ipc_queue_slot
 
 	bool wraps;
 	bool peeked;
+	bool stolen; /* read by another consumer, see ipc_queue_steal_next */
 
 	int    len;
 	char   bytes[1]; /* dynamically allocated */
@@ -39,23 +41,59 @@ typedef struct ipc_queue
 	LWLock *lock;
 	bool produced_by_broker;
 	bool consumed_by_broker;
+	int broker_id; /* the broker responsible for this queue, if it's produced or consumed by one */
+
+	/*
+	 * If set, producers don't take the lock but reserve space by atomically
+	 * advancing reserved, and then publish their slots by advancing head in
+	 * reservation order. Consumers only ever see slots before head, so they only
+	 * ever see contiguous committed slots.
+	 */
+	bool multi_producer;
 
 	uint64 size; /* physical size of buffer */
 
 	pg_atomic_uint64 head;
 	pg_atomic_uint64 tail;
+	pg_atomic_uint64 reserved;
 	uint64 cursor;
 
+	/*
+	 * Other consumers may steal unread slots from this queue, so cursor is only moved while holding
+	 * cursor_lock. Thieves copy stolen slots after releasing it, so tail isn't advanced while any
+	 * steals are still in progress.
+	 */
+	slock_t cursor_lock;
+	pg_atomic_uint32 steals_in_progress;
+
 	pg_atomic_uint64 producer_latch;
 	pg_atomic_uint64 consumer_latch;
+	pg_atomic_uint32 consumer_spinning; /* consumer is polling head, so producers needn't set its latch */
+
+	/* number of pushes that had to wait for space, see ipc_queue_stats_get */
+	pg_atomic_uint64 producer_waits;
+	/* for queues consumed by a broker, bytes it has copied out but not yet into the consumer's queue */
+	pg_atomic_uint64 broker_buffered;
 
 	ipc_queue_peek_fn peek_fn;
 	ipc_queue_pop_fn  pop_fn;
 	ipc_queue_copy_fn copy_fn;
 
+	/*
+	 * Slots that don't fit can be spilled to append-only segment files, see ipc_queue_spill.
+	 * spill_head and spill_tail are logical offsets into the spilled data, the same as head and tail.
+	 */
+	int spill_id; /* -1 if this queue can't spill */
+	Oid spill_dbid;
+	pg_atomic_uint64 spill_head;
+	pg_atomic_uint64 spill_tail;
+
 	char bytes[1]; /* length equal to size */
 } ipc_queue;
 
+/* guc parameters */
+extern int continuous_query_ipc_spin_time;
+
 extern void ipc_queue_init(void *ptr, Size size, LWLock *lock);
 extern void ipc_queue_set_handlers(ipc_queue *ipcq, ipc_queue_peek_fn peek_fn,
 		ipc_queue_pop_fn pop_fn, ipc_queue_copy_fn cpy_fn);
@@ -65,15 +103,24 @@ extern void ipc_queue_unpeek_all(ipc_queue *ipcq);
 extern void ipc_queue_pop_peeked(ipc_queue *ipcq);
 extern void ipc_queue_wait_non_empty(ipc_queue *ipcq, int timeoutms);
 extern void ipc_queue_pop_inserted_before(ipc_queue *ipcq, TimestampTz time);
+extern bool ipc_queue_has_stealable(ipc_queue *ipcq, TimestampTz before);
+extern void *ipc_queue_steal_next(ipc_queue *ipcq, int *len, TimestampTz before);
+extern TimestampTz ipc_queue_last_read_time(void);
 
 extern bool ipc_queue_lock(ipc_queue *ipcq, bool wait);
 extern void ipc_queue_unlock(ipc_queue *ipcq);
 
 extern bool ipc_queue_push_nolock(ipc_queue *ipcq, void *ptr, int len, bool wait);
 extern bool ipc_queue_push(ipc_queue *ipcq, void *ptr, int len, bool wait);
+extern bool ipc_queue_push_batch_mp(ipc_queue *ipcq, void **ptrs, int *lens, int n, bool wait);
+extern bool ipc_queue_push_serialized_nolock(ipc_queue *ipcq, void **ptrs, int *lens, int n, bool wait);
 extern void ipc_queue_update_head(ipc_queue *ipcq, uint64 head);
 extern void ipc_queue_update_tail(ipc_queue *ipcq, uint64 tail);
 
+extern void ipc_queue_enable_spill(ipc_queue *ipcq, Oid dbid, int id);
+extern bool ipc_queue_spill(ipc_queue *ipcq, void **ptrs, int *lens, int n);
+extern int ipc_queue_unspill(ipc_queue *ipcq);
+
 #define ipc_queue_offset(ipcq, ptr) ((ptr) % (ipcq)->size)
 #define ipc_queue_check_overflow(ipcq, pos, len) \
 	Assert((uintptr_t) (pos) + (len) < ((uintptr_t) (ipcq)->bytes + (ipcq)->size))
@@ -82,16 +129,47 @@ extern void ipc_queue_update_tail(ipc_queue *ipcq, uint64 tail);
 #define ipc_queue_slot_get(ipcq, ptr) ((ipc_queue_slot *) ((uintptr_t) (ipcq)->bytes + ipc_queue_offset((ipcq), (ptr))))
 #define ipc_queue_is_empty(ipcq) (pg_atomic_read_u64(&(ipcq)->head) == pg_atomic_read_u64(&(ipcq)->tail))
 #define ipc_queue_has_unread(ipcq) (pg_atomic_read_u64(&(ipcq)->head) > (ipcq)->cursor)
+#define ipc_queue_depth(ipcq) (pg_atomic_read_u64(&(ipcq)->head) - pg_atomic_read_u64(&(ipcq)->tail))
+#define ipc_queue_fill_ratio(ipcq) ((double) ipc_queue_depth(ipcq) / (double) (ipcq)->size)
+#define ipc_queue_spill_size(ipcq) (pg_atomic_read_u64(&(ipcq)->spill_head) - pg_atomic_read_u64(&(ipcq)->spill_tail))
+#define ipc_queue_has_spill(ipcq) ((ipcq)->spill_id >= 0 && ipc_queue_spill_size(ipcq) > 0)
+
+/*
+ * Point in time view of a queue, read without taking any locks. head and tail are logical
+ * positions, so head is the total number of bytes ever pushed, including the space wasted
+ * at the end of the buffer each time the queue wrapped around.
+ */
+typedef struct ipc_queue_stats
+{
+	uint64 size;
+	uint64 head;
+	uint64 tail;
+	uint64 cursor;
+	uint64 wraps;
+	uint64 producer_waits;
+	uint64 spilled;
+	uint64 broker_buffered;
+} ipc_queue_stats;
 
+extern void ipc_queue_stats_get(ipc_queue *ipcq, ipc_queue_stats *stats);
+
+/*
+ * Queues are read with weighted round robin: each queue gets up to weight consecutive reads before
+ * we move on to the next one. The priority queue, if set, is always read first.
+ */
 typedef struct ipc_multi_queue
 {
 	int pqueue;
 	int nqueues;
 	ipc_queue **queues;
+	int *weights;
+	int current;
+	int credit;
 } ipc_multi_queue;
 
-extern ipc_multi_queue *ipc_multi_queue_init(ipc_queue *q1, ipc_queue *q2);
+extern ipc_multi_queue *ipc_multi_queue_init(ipc_queue **queues, int nqueues);
 extern void ipc_multi_queue_set_priority_queue(ipc_multi_queue *ipcmq, int nq);
+extern void ipc_multi_queue_set_weight(ipc_multi_queue *ipcmq, int nq, int weight);
 extern void ipc_multi_queue_wait_non_empty(ipc_multi_queue *ipcmq, int timeoutms);
 extern void *ipc_multi_queue_peek_next(ipc_multi_queue *ipcmq, int *len);
 extern void ipc_multi_queue_unpeek_all(ipc_multi_queue *ipcmq);
@@ -0,0 +1,57 @@
+/*-------------------------------------------------------------------------
+ *
+ * kll.h
+ *	  Interface for KLL quantile sketch support
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/kll.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_KLL_H
+#define PIPELINE_KLL_H
+
+#include "c.h"
+
+/* an item at level h stands for 2^h values, so this is plenty for any stream */
+#define KLL_MAX_LEVELS 40
+
+/*
+ * A KLL sketch keeps a sample of the values it has seen in levels of compactors, each
+ * item of level h standing for 2^h values. The levels are stored back to back at the
+ * end of items, with any free slots before the lowest one: level h's items are
+ * items[levels[h]] through items[levels[h + 1] - 1], and all levels but the lowest
+ * are kept sorted.
+ */
+typedef struct KLL
+{
+	uint32	vl_len_;
+	uint16 k;
+	uint16 num_levels;
+	uint32 capacity;
+	/* state of the coin that picks which half of a compacted level is kept */
+	uint32 rng;
+
+	uint64 count;
+	float8 min;
+	float8 max;
+
+	uint32 levels[KLL_MAX_LEVELS + 1];
+	float8 items[1];
+} KLL;
+
+extern KLL *KLLCreate(void);
+extern KLL *KLLCreateWithK(uint16 k);
+extern void KLLDestroy(KLL *s);
+extern KLL *KLLCopy(KLL *s);
+
+extern KLL *KLLAdd(KLL *s, float8 x);
+extern KLL *KLLMerge(KLL *s, KLL *incoming);
+
+extern float8 KLLQuantile(KLL *s, float8 q);
+extern float8 KLLCDF(KLL *s, float8 x);
+
+extern Size KLLSize(KLL *s);
+
+#endif
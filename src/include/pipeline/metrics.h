@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * metrics.h
+ *	  Interface for the continuous query metrics exporter
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/metrics.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_METRICS_H
+#define PIPELINE_METRICS_H
+
+#include "postgres.h"
+
+/* guc parameters */
+extern int continuous_query_metrics_port;
+extern char *continuous_query_metrics_listen_address;
+
+extern bool StartContQueryMetricsExporter(void);
+extern void ContQueryMetricsExporterMain(Datum arg);
+
+#endif
@@ -28,6 +28,7 @@ extern char *random_hex(int len);
 /* hash functions */
 extern void MurmurHash3_128(const void *key, const Size len, const uint64_t seed, void *out);
 extern uint64_t MurmurHash3_64(const void *key, const Size len, const uint64_t seed);
+extern uint64 FastHash64(const void *key, const Size len, const uint64 seed);
 extern void SlotAttrsToBytes(TupleTableSlot *slot, int num_attrs, AttrNumber *attrs, StringInfo buf);
 extern void DatumToBytes(Datum d, TypeCacheEntry *typ, StringInfo buf);
 
@@ -35,4 +36,17 @@ extern void DatumToBytes(Datum d, TypeCacheEntry *typ, StringInfo buf);
 extern int SetNicePriority(void);
 extern int SetDefaultPriority(void);
 
+/* NUMA placement of memory and processes */
+#define MAX_NUMA_NODES 64
+
+extern void BindMemoryToNumaNode(void *addr, Size len, int node);
+extern void SetNumaAffinity(int node);
+
+/* CPU affinity and control group placement of processes */
+#define MAX_CPUS 1024
+
+extern bool ParseCPUList(const char *value, bool *cpus);
+extern void SetCPUAffinity(const char *cpulist);
+extern void JoinCGroup(const char *path);
+
 #endif   /* MISCUTILS_H */
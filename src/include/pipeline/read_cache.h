@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * read_cache.h
+ *	  Interface for the shared cache of recently updated continuous view rows
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/read_cache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef READ_CACHE_H
+#define READ_CACHE_H
+
+#include "postgres.h"
+
+/* space each cached row and its group key share, larger rows aren't cached */
+#define READ_CACHE_ROW_SIZE 1024
+
+/* guc parameters */
+extern int continuous_view_read_cache_mem;
+
+/* a finalized row of a view and the text value of its read_cache_key, see ReadCachePut */
+typedef struct ReadCacheRow
+{
+	char *key;
+	Datum row; /* 0 if the group's row doesn't fit in the cache */
+} ReadCacheRow;
+
+extern Size ReadCacheShmemSize(void);
+extern void ReadCacheShmemInit(void);
+
+extern bool ReadCacheEnabled(void);
+extern int ReadCacheCapacity(void);
+extern uint64 ReadCacheGeneration(void);
+extern void ReadCachePut(Oid viewid, List *rows, bool complete, uint64 generation);
+extern Datum ReadCacheGet(Oid viewid, char *key, bool *found);
+extern void ReadCacheInvalidate(Oid viewid);
+
+#endif
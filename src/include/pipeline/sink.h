@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * sink.h
+ *	  Interface for delivering continuous transform output asynchronously
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/sink.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_SINK_H
+#define PIPELINE_SINK_H
+
+#include "postgres.h"
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "fmgr.h"
+
+/* guc parameters */
+extern int continuous_query_sink_queue_size;
+extern int continuous_query_sink_batch_size;
+extern int continuous_query_sink_max_retries;
+
+extern Oid LookupSinkFunction(const char *name, bool missing_ok);
+extern void SinkTuples(Oid fnoid, TupleDesc desc, HeapTuple *tups, int ntups);
+extern void ContinuousQuerySinkMain(void);
+
+extern Datum pipeline_sink(PG_FUNCTION_ARGS);
+
+#endif
@@ -35,11 +35,66 @@ extern void *copy_iter_arg;
 
 /* Whether or not to wait on the inserted event to be consumed by the CV*/
 extern bool synchronous_stream_insert;
+
+/* Whether synchronous stream inserts return a token to wait on instead of waiting themselves */
+extern bool stream_insert_deferred_ack;
+
+/* Whether batched stream events are encoded column by column in worker queues */
+extern bool stream_insert_columnar_batches;
 extern char *stream_targets;
 
+/* What stream inserts do when all worker queues are full */
+typedef enum StreamBackpressurePolicy
+{
+	STREAM_BACKPRESSURE_BLOCK,
+	STREAM_BACKPRESSURE_FAIL,
+	STREAM_BACKPRESSURE_SHED,
+	STREAM_BACKPRESSURE_SPILL
+} StreamBackpressurePolicy;
+
+extern int stream_insert_backpressure;
+extern int stream_insert_backpressure_timeout;
+extern int stream_insert_spill_limit;
+
+/* Time the current backend's stream inserts have spent waiting, in microseconds, see pipeline_insert_waits */
+typedef struct StreamInsertWaits
+{
+	int64 queue_locks;
+	/* worker queues skipped because another producer held their lock */
+	int64 queue_lock_misses;
+	/* lock acquisitions that blocked because every worker queue was locked */
+	int64 queue_lock_waits;
+	int64 queue_lock_wait_time;
+	/* synchronous inserts waiting for their events to be acked */
+	int64 ack_waits;
+	int64 ack_wait_time;
+} StreamInsertWaits;
+
+extern StreamInsertWaits MyStreamInsertWaits;
+
+extern bool StreamBackpressureWait(TimestampTz *since);
+extern bool StreamBackpressureShouldShed(ipc_queue *ipcq);
+extern bool StreamBackpressureSpill(ipc_queue *ipcq, StreamTupleState **sts, int *lens, int n);
+
+extern Bitmapset *GetStreamInsertTargets(Relation stream);
+extern Bitmapset **GetStreamPoolTargets(Relation stream);
+extern TupleDesc GetStreamReadDesc(Relation stream, TupleDesc desc);
+
+/* Evaluates targets' simple WHERE clauses on the inserting backend */
+typedef struct StreamFilterState StreamFilterState;
+
+extern StreamFilterState *BeginStreamFilter(Relation stream, TupleDesc desc, Bitmapset *targets);
+extern Bitmapset *StreamFilterTargets(StreamFilterState *state, HeapTuple tup);
+extern void EndStreamFilter(StreamFilterState *state);
+extern AttrNumber GetStreamRoutingAttr(Relation stream, TupleDesc desc);
+extern int GetStreamRoutingWorker(int pool, TupleDesc desc, AttrNumber attno, HeapTuple tup);
+
 extern uint64 SendTuplesToContWorkers(Relation stream, TupleDesc desc, HeapTuple *tuples, int ntuples, InsertBatchAck *acks, int nacks);
+extern bool FuseTuplesIntoContExecutor(ContExecutor *exec, Relation stream, TupleDesc desc, HeapTuple *tuples,
+		int ntuples, InsertBatchAck *acks, int nacks);
 extern void CopyIntoStream(Relation stream, TupleDesc desc, HeapTuple *tuples, int ntuples);
 
 extern Datum pipeline_stream_insert(PG_FUNCTION_ARGS);
+extern Datum pipeline_stream_insert_batch(PG_FUNCTION_ARGS);
 
 #endif
@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_batch.h
+ *	  Interface for dropping stream batches that were already written
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/stream_batch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_BATCH_H
+#define STREAM_BATCH_H
+
+#include "postgres.h"
+
+#include "utils/guc.h"
+
+/* number of recently claimed batch ids kept in shared memory */
+#define STREAM_BATCH_CLAIMS 8192
+
+/* guc parameters */
+extern char *stream_insert_batch_id;
+extern int stream_insert_batch_id_retention;
+
+extern bool check_stream_insert_batch_id(char **newval, void **extra, GucSource source);
+extern void assign_stream_insert_batch_id(const char *newval, void *extra);
+
+extern Size StreamBatchShmemSize(void);
+extern void StreamBatchShmemInit(void);
+
+extern int64 StreamBatchCurrentId(void);
+extern bool StreamBatchClaim(void);
+
+#endif
@@ -0,0 +1,31 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_capture.h
+ *
+ * Capture of stream inserts for replaying them later
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * src/include/pipeline/stream_capture.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_CAPTURE_H
+#define STREAM_CAPTURE_H
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "utils/relcache.h"
+
+#define STREAM_CAPTURE_MAGIC "PDBCAPT\n"
+#define STREAM_CAPTURE_VERSION 1
+#define STREAM_CAPTURE_SUFFIX ".capture"
+
+/* Directory that backends append the batches they insert into streams to, if set */
+extern char *stream_capture_directory;
+
+#define StreamCaptureEnabled() (stream_capture_directory && stream_capture_directory[0] != '\0')
+
+extern void StreamCaptureTuples(Relation stream, TupleDesc desc, HeapTuple *tuples, int ntuples);
+
+#endif
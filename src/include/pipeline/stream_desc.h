@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_desc.h
+ *	  Interface for the shared stream descriptor cache
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/stream_desc.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_DESC_H
+#define STREAM_DESC_H
+
+#include "postgres.h"
+#include "access/tupdesc.h"
+
+/* maximum number of distinct stream descriptors that can be registered */
+#define STREAM_DESC_CACHE_SIZE 1024
+
+extern Size StreamDescCacheShmemSize(void);
+extern void StreamDescCacheShmemInit(void);
+
+extern bytea *PackStreamTupleDesc(Oid relid, TupleDesc desc);
+extern uint32 StreamTupleDescGetId(bytea *desc);
+extern bytea *StreamTupleDescResolve(bytea *desc);
+
+#endif
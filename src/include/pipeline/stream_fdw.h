@@ -10,11 +10,15 @@
 #ifndef STREAM_FDW_H
 #define STREAM_FDW_H
 
+#include "access/tupconvert.h"
 #include "foreign/foreign.h"
 #include "lib/stringinfo.h"
 #include "nodes/execnodes.h"
 #include "nodes/plannodes.h"
 #include "nodes/relation.h"
+#include "pipeline/stream.h"
+#include "pipeline/stream_log.h"
+#include "pipeline/stream_vector.h"
 #include "utils/rel.h"
 
 #define REENTRANT_STREAM_INSERT 0x1
@@ -25,10 +29,72 @@ typedef struct StreamScanState
 {
 	ContExecutor *cont_executor;
 	StreamProjectionInfo *pi;
+	/* if set, simple quals are evaluated over vectors of events before projecting them */
+	List *vquals;
+	StreamVector *vec;
 	Size nbytes;
 	int ntuples;
+	/* for sampling queries, the number of events left to skip before the next one is read, -1 initially */
+	int sample_skip;
+	/* for queries with a max_staleness, events that arrived before this are dropped, set by the first event of a batch */
+	TimestampTz stale_before;
+	/* for deduplicating queries, the query's filter and the attribute of its key, set by the first event of a batch */
+	struct DedupFilter *dedup;
+	AttrNumber dedup_attno;
+	struct TypeCacheEntry *dedup_type;
+	/* for queries reading several streams, which of them this scan reads, -1 otherwise */
+	int input;
+	List *input_relids;
+	/* for stream-stream joins, the next buffered or new event this pass reads, and which of those lists is read next */
+	ListCell *join_next;
+	int join_phase;
 } StreamScanState;
 
+/*
+ * A tuple of a stream-stream join, along with the time its event arrived
+ */
+typedef struct StreamJoinTuple
+{
+	HeapTuple tup;
+	TimestampTz arrival;
+} StreamJoinTuple;
+
+/*
+ * The events a query reads from one of several streams
+ */
+typedef struct StreamInput
+{
+	Oid relid;
+	/* this batch's events written to the stream */
+	List *pending;
+	Size pending_bytes;
+	/* for stream-stream joins, the tuples this batch's events have been decoded into */
+	bool decoded;
+	List *fresh;
+	/* for stream-stream joins, tuples of previous batches still within the join window, oldest first */
+	List *buffered;
+	Size buffered_bytes;
+} StreamInput;
+
+/*
+ * The events of each batch read by a query reading several streams are split between the streams they
+ * were written to, so that each stream's scan only reads its own events.
+ *
+ * Stream-stream joins are executed in up to two passes over each batch. The first one joins the
+ * new events of the first stream with the buffered and new events of the second one, and the
+ * second one joins the buffered events of the first stream with the new events of the second one.
+ */
+typedef struct MultiStreamState
+{
+	MemoryContext cxt;
+	MemoryContext batch_cxt;
+	/* have this batch's events been split between the streams? */
+	bool loaded;
+	int pass;
+	int ninputs;
+	StreamInput *inputs;
+} MultiStreamState;
+
 typedef struct StreamInsertState
 {
 	Bitmapset *targets;
@@ -40,14 +106,46 @@ typedef struct StreamInsertState
 	InsertBatch *batch;
 	InsertBatchAck *ack;
 
+	/* has this write claimed its stream batch id, and was that batch already written? */
+	bool batch_claimed;
+	bool batch_dropped;
+
+	/* if set, the original events are logged to the stream log as they're written */
+	StreamLogWriter *log;
+
 	TupleDesc desc;
+	Oid relid;
 	bytea *packed_desc;
 
+	/* if set, strips columns none of the stream's readers need from each event */
+	TupleConversionMap *read_map;
+
+	/* if set, evaluates the simple WHERE clauses of targets on each event */
+	StreamFilterState *filter;
+
+	/* if set, extracts the stream's declared JSON fields into their columns of each event */
+	struct StreamJsonState *json;
+
 	ipc_queue *worker_queue;
 
+	/* targets in each worker pool if any are pinned to one, and the pool worker_queue is in */
+	Bitmapset **pool_targets;
+	int worker_pool;
+
+	/* if set, tuples are routed to workers by the hash of this attribute */
+	AttrNumber routing_attr;
+	int worker_idx;
+
 	int flags;
 } StreamInsertState;
 
+/* Whether workers decode each event once per batch for all of the queries that read it */
+extern bool continuous_query_shared_stream_scan;
+/* Whether workers compute expressions over stream columns shared by several queries once per event */
+extern bool continuous_query_shared_stream_exprs;
+/* Maximum size in kB of the events buffered for each stream of a stream-stream join */
+extern int continuous_query_stream_join_buffer_size;
+
 extern Datum stream_fdw_handler(PG_FUNCTION_ARGS);
 
 extern void GetStreamSize(PlannerInfo *root, RelOptInfo *baserel, Oid streamid);
@@ -55,11 +153,15 @@ extern void GetStreamPaths(PlannerInfo *root, RelOptInfo *baserel, Oid streamid)
 extern ForeignScan *GetStreamScanPlan(PlannerInfo *root, RelOptInfo *baserel,
 		Oid streamid, ForeignPath *best_path, List *tlist, List *scan_clauses, Plan *outer_plan);
 extern void BeginStreamScan(ForeignScanState *node, int eflags);
+extern void ShareStreamExprs(PlanState *planstate, Oid query_id);
 extern List *PlanStreamModify(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index);
 extern TupleTableSlot *IterateStreamScan(ForeignScanState *node);
 extern void ReScanStreamScan(ForeignScanState *node);
 extern void EndStreamScan(ForeignScanState *node);
 
+extern bool StartStreamJoinPass(ContQueryState *state);
+extern void EndMultiStreamBatch(ContQueryState *state, PlanState *planstate);
+
 extern void BeginStreamModify(ModifyTableState *mtstate, ResultRelInfo *resultRelInfo,
 						   List *fdw_private, int subplan_index, int eflags);
 extern TupleTableSlot *ExecStreamInsert(EState *estate, ResultRelInfo *resultRelInfo,
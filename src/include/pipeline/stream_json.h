@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_json.h
+ *
+ * Extraction of declared JSON fields into typed stream columns
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * src/include/pipeline/stream_json.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_JSON_H
+#define STREAM_JSON_H
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "utils/relcache.h"
+
+#define STREAM_JSON_FIELDS_OPTION "json_fields"
+
+typedef struct StreamJsonState StreamJsonState;
+
+extern StreamJsonState *BeginStreamJsonExtract(Relation stream, TupleDesc desc);
+extern HeapTuple StreamJsonExtract(StreamJsonState *state, HeapTuple tup);
+extern void EndStreamJsonExtract(StreamJsonState *state);
+
+#endif
@@ -0,0 +1,46 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_log.h
+ *	  Interface for the write-ahead log of stream inserts
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/stream_log.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_LOG_H
+#define STREAM_LOG_H
+
+#include "postgres.h"
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "pipeline/cont_execute.h"
+#include "utils/relcache.h"
+
+/* size of each of a database's stream log segments */
+#define STREAM_LOG_SEGMENT_SIZE (16 * 1024 * 1024)
+
+/* number of databases that may use the stream log */
+#define STREAM_LOG_MAX_DATABASES 16
+
+/* number of batches per database that may be written to the stream log without being consumed yet */
+#define STREAM_LOG_MAX_BATCHES 1024
+
+/* guc parameter */
+extern bool stream_log;
+
+typedef struct StreamLogWriter StreamLogWriter;
+
+extern Size StreamLogShmemSize(void);
+extern void StreamLogShmemInit(void);
+
+extern StreamLogWriter *StreamLogBeginWrite(Relation stream, TupleDesc desc, InsertBatch *batch, int64 batch_id);
+extern void StreamLogWriteTuple(StreamLogWriter *writer, HeapTuple tup);
+extern void StreamLogEndWrite(StreamLogWriter *writer, int num_tuples);
+
+extern void StreamLogAdvance(bool force);
+extern void StreamLogReplay(void);
+
+#endif
@@ -0,0 +1,51 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_quota.h
+ *	  Interface for stream insert quotas
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/stream_quota.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_QUOTA_H
+#define STREAM_QUOTA_H
+
+#include "postgres.h"
+
+#include "access/htup.h"
+#include "utils/relcache.h"
+
+/* maximum number of roles or streams whose quota usage is tracked, across all databases */
+#define STREAM_QUOTA_MAX_BUCKETS 1024
+
+/* What each quota bucket is shared by */
+typedef enum StreamQuotaKey
+{
+	STREAM_QUOTA_KEY_ROLE,
+	STREAM_QUOTA_KEY_STREAM
+} StreamQuotaKey;
+
+/* What stream inserts exceeding their quota do */
+typedef enum StreamQuotaAction
+{
+	STREAM_QUOTA_DELAY,
+	STREAM_QUOTA_REJECT,
+	STREAM_QUOTA_SAMPLE
+} StreamQuotaAction;
+
+/* guc parameters */
+extern int stream_insert_quota_events;
+extern int stream_insert_quota_bytes;
+extern int stream_insert_quota_key;
+extern int stream_insert_quota_action;
+
+#define StreamQuotaEnabled() (stream_insert_quota_events > 0 || stream_insert_quota_bytes > 0)
+
+extern Size StreamQuotaShmemSize(void);
+extern void StreamQuotaShmemInit(void);
+
+extern int StreamQuotaAdmit(Relation stream, HeapTuple *tuples, int ntuples, HeapTuple **admitted);
+
+#endif
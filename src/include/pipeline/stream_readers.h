@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_readers.h
+ *	  Interface for the shared cache of stream readers
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/stream_readers.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_READERS_H
+#define STREAM_READERS_H
+
+#include "postgres.h"
+#include "nodes/bitmapset.h"
+
+/* maximum number of streams whose readers are kept, across all databases */
+#define STREAM_READERS_CACHE_SIZE 1024
+
+extern Size StreamReadersCacheShmemSize(void);
+extern void StreamReadersCacheShmemInit(void);
+
+extern uint32 GetStreamReadersCacheGeneration(void);
+extern bool StreamReadersCacheLookup(Oid relid, Bitmapset **readers, bool *prunable, Bitmapset **read_attrs);
+extern void StreamReadersCacheStore(Oid relid, Bitmapset *readers, bool prunable, Bitmapset *read_attrs,
+		uint32 generation);
+extern void InvalidateStreamReadersCache(void);
+
+#endif
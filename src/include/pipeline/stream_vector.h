@@ -0,0 +1,45 @@
+/*-------------------------------------------------------------------------
+ *
+ * stream_vector.h
+ *	  Interface for evaluating simple stream scan quals over vectors of events
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/stream_vector.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef STREAM_VECTOR_H
+#define STREAM_VECTOR_H
+
+#include "nodes/pg_list.h"
+#include "pipeline/cont_execute.h"
+
+/* Maximum number of events decoded and filtered together */
+#define STREAM_VECTOR_SIZE 1024
+
+/*
+ * Events decoded in column-major order, so that the value of attribute attno (zero-based)
+ * of the i-th event is values[attno * STREAM_VECTOR_SIZE + i]
+ */
+typedef struct StreamVector
+{
+	int natts;
+	int nrows;
+	/* next row to return from the vector */
+	int next;
+	StreamTupleState **events;
+	Datum *values;
+	bool *nulls;
+	/* rows that passed all vectorized quals */
+	bool *selected;
+} StreamVector;
+
+/* Whether stream scans evaluate simple quals over vectors of events */
+extern bool continuous_query_vectorized_quals;
+
+extern List *ExtractStreamVectorQuals(List **qual, Index scanrelid);
+extern StreamVector *StreamVectorCreate(int natts);
+extern void StreamVectorEvalQuals(StreamVector *vec, List *quals);
+
+#endif
@@ -3,7 +3,9 @@
  * sw_vacuum.h
  *
  *   Support for vacuuming discarded tuples for sliding window
- *   continuous views.
+ *   continuous views, for compacting the frozen time buckets of
+ *   views with freeze_after, and for downsampling the aged time
+ *   buckets of views with a downsample policy.
  *
  * Copyright (c) 2013-2015, PipelineDB
  *
@@ -16,11 +18,20 @@
 
 #include "postgres.h"
 #include "catalog/pg_class.h"
+#include "catalog/pipeline_query_fn.h"
 #include "executor/executor.h"
 #include "pgstat.h"
 #include "utils/relcache.h"
 
+/* Maximum number of expired tuples deleted from a sliding-window matrel per transaction, 0 deletes them all at once */
+extern int sliding_window_vacuum_batch_size;
+
 extern uint64_t NumSWExpiredTuples(Oid relid);
 extern void DeleteSWExpiredTuples(Oid relid);
+extern void FreezeMatRelBuckets(Oid relid);
+extern void DownsampleMatRelBuckets(Oid relid);
+
+/* implemented by cont_combiner.c, which merges the groups the way combiners do */
+extern bool DownsampleGroups(ContQuery *cv, Relation matrel, int batch_size);
 
 #endif /* SW_VACUUM_H */
@@ -13,7 +13,6 @@
 #define TDIGEST_H
 
 #include "c.h"
-#include "nodes/pg_list.h"
 
 typedef struct Centroid
 {
@@ -32,23 +31,34 @@ typedef struct TDigest {
 	float8 min;
 	float8 max;
 
-	List *unmerged_centroids;
+	/*
+	 * Added centroids are buffered after the merged ones, and merged once there are more than
+	 * threshold of them. These take up the bytes of what used to be a List pointer and padding,
+	 * which were always zero in stored digests.
+	 */
+	uint64 unmerged_weight;
 	uint32 num_centroids;
+	uint32 num_unmerged;
 	Centroid centroids[1];
 } TDigest;
 
+#define TDigestUnmerged(t) ((t)->centroids + (t)->num_centroids)
+
 extern TDigest *TDigestCreate(void);
 extern TDigest *TDigestCreateWithCompression(int compression);
 extern void TDigestDestroy(TDigest *t);
 extern TDigest *TDigestCopy(TDigest *t);
 
 extern TDigest *TDigestAdd(TDigest *t, float8 x, int64 w);
+extern TDigest *TDigestAddMany(TDigest *t, Centroid *centroids, int n);
 extern TDigest *TDigestCompress(TDigest *t);
 extern TDigest *TDigestMerge(TDigest *t1, TDigest *t2);
 
 extern float8 TDigestCDF(TDigest *t, float8 x);
 extern float8 TDigestQuantile(TDigest *t, float8 q);
+extern void TDigestQuantiles(TDigest *t, float8 *qs, int n, float8 *results);
 
 extern Size TDigestSize(TDigest *t);
+extern bool TDigestIsValid(TDigest *t);
 
 #endif
@@ -0,0 +1,52 @@
+/*-------------------------------------------------------------------------
+ *
+ * theta.h
+ *	  Interface for theta sketch support
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/theta.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_THETA_H
+#define PIPELINE_THETA_H
+
+#include "c.h"
+
+#define THETA_MIN_LG_K 4
+#define THETA_MAX_LG_K 20
+
+/*
+ * A theta sketch keeps the hashes of the distinct elements it has seen that are below
+ * theta, which starts out as the largest possible hash and is lowered to keep the sketch
+ * at around 2^lg_k hashes. The hashes are kept in an open addressing hash table of
+ * 2^lg_size slots, with empty slots set to 0.
+ *
+ * Since all of them are a uniform sample of the hashes below theta, the sketches can be
+ * combined with any set operation by applying it to their hashes below the smaller theta.
+ */
+typedef struct ThetaSketch
+{
+	uint32	vl_len_;
+	uint8 lg_k;
+	uint8 lg_size;
+	uint32 num_entries;
+	uint64 theta;
+	uint64 entries[1];
+} ThetaSketch;
+
+extern ThetaSketch *ThetaSketchCreate(void);
+extern ThetaSketch *ThetaSketchCreateWithLgK(int lg_k);
+extern void ThetaSketchDestroy(ThetaSketch *ts);
+extern ThetaSketch *ThetaSketchCopy(ThetaSketch *ts);
+
+extern ThetaSketch *ThetaSketchAdd(ThetaSketch *ts, void *elem, Size len);
+extern ThetaSketch *ThetaSketchUnion(ThetaSketch *result, ThetaSketch *incoming);
+extern ThetaSketch *ThetaSketchIntersection(ThetaSketch *a, ThetaSketch *b);
+extern ThetaSketch *ThetaSketchANotB(ThetaSketch *a, ThetaSketch *b);
+
+extern float8 ThetaSketchEstimate(ThetaSketch *ts);
+extern Size ThetaSketchSize(ThetaSketch *ts);
+
+#endif
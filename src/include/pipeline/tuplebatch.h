@@ -0,0 +1,60 @@
+/*-------------------------------------------------------------------------
+ *
+ * tuplebatch.h
+ *	  Interface for arena-backed batches of heap tuples
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * src/include/pipeline/tuplebatch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PIPELINE_TUPLEBATCH_H
+#define PIPELINE_TUPLEBATCH_H
+
+#include "postgres.h"
+
+#include "access/htup.h"
+#include "executor/tuptable.h"
+#include "utils/memutils.h"
+
+typedef struct TupleBatchBlock
+{
+	struct TupleBatchBlock *next;
+	Size size;
+	Size used;
+	char data[FLEXIBLE_ARRAY_MEMBER];
+} TupleBatchBlock;
+
+/*
+ * A TupleBatch holds a single batch's tuples in large, contiguously filled blocks and keeps
+ * an array of pointers to them, so putting a tuple is a single copy and clearing the batch
+ * releases all of its tuples at once. Unlike a tuplestore it never spills to disk, so it's
+ * only suitable for inputs that are already bounded in size.
+ */
+typedef struct TupleBatch
+{
+	MemoryContext cxt;
+	TupleBatchBlock *blocks; /* the head is the block currently being filled */
+	HeapTuple *tuples;
+	int ntuples;
+	int maxtuples;
+	int readpos;
+} TupleBatch;
+
+#define foreach_batch_tuple(slot, batch) \
+	while (TupleBatchGetTupleSlot((batch), (slot)))
+
+extern TupleBatch *TupleBatchCreate(MemoryContext parent);
+extern void TupleBatchEnd(TupleBatch *batch);
+
+extern HeapTuple TupleBatchPut(TupleBatch *batch, HeapTuple tup);
+extern HeapTuple TupleBatchPutSlot(TupleBatch *batch, TupleTableSlot *slot);
+extern void TupleBatchAppend(TupleBatch *batch, HeapTuple tup);
+extern bool TupleBatchGetTupleSlot(TupleBatch *batch, TupleTableSlot *slot);
+
+extern void TupleBatchRescan(TupleBatch *batch);
+extern void TupleBatchClearTuples(TupleBatch *batch);
+extern void TupleBatchClear(TupleBatch *batch);
+
+#endif
@@ -139,7 +139,16 @@ extern PGDLLIMPORT LWLockPadded *MainLWLockArray;
 #define MultiXactTruncationLock		(&MainLWLockArray[41].lock)
 #define ContQuerySchedulerLock		(&MainLWLockArray[42].lock)
 #define IPCMessageBrokerIndexLock	(&MainLWLockArray[43].lock)
-#define NUM_INDIVIDUAL_LWLOCKS		44
+#define ContQueryCacheLock			(&MainLWLockArray[44].lock)
+#define StreamReadersCacheLock		(&MainLWLockArray[45].lock)
+#define CQStatsLock					(&MainLWLockArray[46].lock)
+#define ContQueryMemoryLock			(&MainLWLockArray[47].lock)
+#define ContQueryReadCacheLock		(&MainLWLockArray[48].lock)
+#define StreamBatchClaimLock		(&MainLWLockArray[49].lock)
+#define StreamLogLock				(&MainLWLockArray[50].lock)
+#define StreamLogFlushLock			(&MainLWLockArray[51].lock)
+#define StreamQuotaLock				(&MainLWLockArray[52].lock)
+#define NUM_INDIVIDUAL_LWLOCKS		53
 
 /*
  * It's a bit odd to declare NUM_BUFFER_PARTITIONS and NUM_LOCK_PARTITIONS
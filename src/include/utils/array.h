@@ -176,6 +176,7 @@ typedef struct ArrayBuildState
 	bool		typbyval;
 	char		typalign;
 	bool		private_cxt;	/* use private memory context */
+	ArrayType  *base;			/* deserialized array preceding dvalues, or NULL */
 } ArrayBuildState;
 
 /*
@@ -423,6 +424,8 @@ extern Datum makeArrayResult(ArrayBuildState *astate,
 				MemoryContext rcontext);
 extern Datum makeMdArrayResult(ArrayBuildState *astate, int ndims,
 				  int *dims, int *lbs, MemoryContext rcontext, bool release);
+extern Datum makeArrayAggResult(ArrayBuildState *astate, MemoryContext rcontext);
+extern void expandArrayAggState(ArrayBuildState *astate);
 
 extern ArrayBuildStateArr *initArrayResultArr(Oid array_type, Oid element_type,
 				   MemoryContext rcontext, bool subcontext);
@@ -17,6 +17,7 @@
 extern Datum bloom_print(PG_FUNCTION_ARGS);
 extern Datum bloom_agg_trans(PG_FUNCTION_ARGS);
 extern Datum bloom_agg_transp(PG_FUNCTION_ARGS);
+extern Datum bloom_agg_trans_blocked(PG_FUNCTION_ARGS);
 extern Datum bloom_union_agg_trans(PG_FUNCTION_ARGS);
 extern Datum bloom_intersection_agg_trans(PG_FUNCTION_ARGS);
 extern Datum bloom_cardinality(PG_FUNCTION_ARGS);
@@ -25,5 +25,10 @@ extern Datum cmsketch_empty(PG_FUNCTION_ARGS);
 extern Datum cmsketch_emptyp(PG_FUNCTION_ARGS);
 extern Datum cmsketch_add(PG_FUNCTION_ARGS);
 extern Datum cmsketch_addn(PG_FUNCTION_ARGS);
+extern Datum cmsketch_topk_agg_trans(PG_FUNCTION_ARGS);
+extern Datum cmsketch_topk_merge_agg_trans(PG_FUNCTION_ARGS);
+extern Datum cmsketch_topk(PG_FUNCTION_ARGS);
+extern Datum cmsketch_topk_frequency(PG_FUNCTION_ARGS);
+extern Datum cmsketch_topk_total(PG_FUNCTION_ARGS);
 
 #endif
@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * ddsketchfuncs.h
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ *	  Interface for DDSketch functions
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef DDSKETCHFUNCS_H
+#define DDSKETCHFUNCS_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+extern Datum ddsketch_print(PG_FUNCTION_ARGS);
+extern Datum ddsketch_agg_trans(PG_FUNCTION_ARGS);
+extern Datum ddsketch_agg_transp(PG_FUNCTION_ARGS);
+extern Datum ddsketch_merge_agg_trans(PG_FUNCTION_ARGS);
+extern Datum ddsketch_cdf(PG_FUNCTION_ARGS);
+extern Datum ddsketch_quantile(PG_FUNCTION_ARGS);
+extern Datum ddsketch_empty(PG_FUNCTION_ARGS);
+extern Datum ddsketch_emptyp(PG_FUNCTION_ARGS);
+extern Datum ddsketch_add(PG_FUNCTION_ARGS);
+extern Datum ddsketch_addn(PG_FUNCTION_ARGS);
+
+#endif
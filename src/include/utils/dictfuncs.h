@@ -0,0 +1,21 @@
+/*-------------------------------------------------------------------------
+ *
+ * dictfuncs.h
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ * IDENTIFICATION
+ *	  src/include/utils/dictfuncs.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef DICTFUNCS_H
+#define DICTFUNCS_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+extern Datum dict_encode(PG_FUNCTION_ARGS);
+extern Datum dict_decode(PG_FUNCTION_ARGS);
+
+#endif
@@ -13,6 +13,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "pipeline/hll.h"
 
 extern Datum hll_print(PG_FUNCTION_ARGS);
 extern Datum hll_agg_trans(PG_FUNCTION_ARGS);
@@ -23,5 +24,12 @@ extern Datum hll_empty(PG_FUNCTION_ARGS);
 extern Datum hll_emptyp(PG_FUNCTION_ARGS);
 extern Datum hll_add(PG_FUNCTION_ARGS);
 extern Datum hll_cache_cardinality(PG_FUNCTION_ARGS);
+extern Datum hybrid_count_distinct_trans(PG_FUNCTION_ARGS);
+extern Datum hybrid_count_distinct_transp(PG_FUNCTION_ARGS);
+extern Datum hybrid_count_distinct_combine(PG_FUNCTION_ARGS);
+extern Datum hybrid_count_distinct_final(PG_FUNCTION_ARGS);
+
+extern HyperLogLog *HLLAggAdd(FunctionCallInfo fcinfo, MemoryContext context, HyperLogLog *hll, Datum elem);
+extern HyperLogLog *HLLFlushPendingAdds(HyperLogLog *hll);
 
 #endif
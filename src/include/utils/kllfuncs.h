@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * kllfuncs.h
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ *	  Interface for KLL sketch functions
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef KLLFUNCS_H
+#define KLLFUNCS_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+extern Datum kll_print(PG_FUNCTION_ARGS);
+extern Datum kll_agg_trans(PG_FUNCTION_ARGS);
+extern Datum kll_agg_transp(PG_FUNCTION_ARGS);
+extern Datum kll_merge_agg_trans(PG_FUNCTION_ARGS);
+extern Datum kll_cdf(PG_FUNCTION_ARGS);
+extern Datum kll_quantile(PG_FUNCTION_ARGS);
+extern Datum kll_empty(PG_FUNCTION_ARGS);
+extern Datum kll_emptyp(PG_FUNCTION_ARGS);
+extern Datum kll_add(PG_FUNCTION_ARGS);
+extern Datum kll_addn(PG_FUNCTION_ARGS);
+
+#endif
@@ -106,6 +106,7 @@ extern Size GetMemoryChunkSpace(void *pointer);
 extern MemoryContext GetMemoryChunkContext(void *pointer);
 extern MemoryContext MemoryContextGetParent(MemoryContext context);
 extern bool MemoryContextIsEmpty(MemoryContext context);
+extern Size MemoryContextMemAllocated(MemoryContext context, bool recurse);
 extern void MemoryContextStats(MemoryContext context);
 extern void MemoryContextAllowInCriticalSection(MemoryContext context,
 									bool allow);
@@ -161,4 +162,10 @@ extern MemoryContext AllocSetContextCreate(MemoryContext parent,
  */
 #define ALLOCSET_SEPARATE_THRESHOLD  8192
 
+/* arena.c */
+extern MemoryContext ArenaContextCreate(MemoryContext parent,
+				   const char *name,
+				   Size initBlockSize,
+				   Size maxBlockSize);
+
 #endif   /* MEMUTILS_H */
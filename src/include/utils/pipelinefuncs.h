@@ -49,11 +49,41 @@ extern Datum pipeline_get_worker_querydef(PG_FUNCTION_ARGS);
 extern Datum pipeline_get_combiner_querydef(PG_FUNCTION_ARGS);
 
 extern Datum pipeline_combine_table(PG_FUNCTION_ARGS);
+extern Datum pipeline_combine_partial(PG_FUNCTION_ARGS);
 
 extern Datum json_object_int_sum_transfn(PG_FUNCTION_ARGS);
 
 extern Datum json_object_int_sum_transout(PG_FUNCTION_ARGS);
 
+extern Datum json_object_int_sum_combine(PG_FUNCTION_ARGS);
+
+extern Datum json_object_int_sum_send(PG_FUNCTION_ARGS);
+
+extern Datum json_object_int_sum_recv(PG_FUNCTION_ARGS);
+
 extern Datum pipeline_flush(PG_FUNCTION_ARGS);
 
+extern Datum pipeline_set_step_factor(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_backfill(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_latency_buckets(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_queue_stats(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_explain_analyze(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_query_memory(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_view_lag(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_cached_row(PG_FUNCTION_ARGS);
+
+extern Datum pipeline_insert_waits(PG_FUNCTION_ARGS);
+
+/* deferred stream insert acks */
+extern Datum pipeline_stream_insert_token(PG_FUNCTION_ARGS);
+extern Datum pipeline_stream_insert_acked(PG_FUNCTION_ARGS);
+extern Datum pipeline_wait_for_stream_insert(PG_FUNCTION_ARGS);
+
 #endif
@@ -15,6 +15,9 @@
 
 extern Datum set_agg_trans(PG_FUNCTION_ARGS);
 extern Datum set_agg_combine(PG_FUNCTION_ARGS);
+extern Datum set_agg_send(PG_FUNCTION_ARGS);
+extern Datum set_agg_recv(PG_FUNCTION_ARGS);
+extern Datum set_agg_final(PG_FUNCTION_ARGS);
 extern Datum set_cardinality(PG_FUNCTION_ARGS);
 
 #endif
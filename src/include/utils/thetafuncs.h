@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * thetafuncs.h
+ *
+ * Copyright (c) 2013-2015, PipelineDB
+ *
+ *	  Interface for theta sketch functions
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef THETAFUNCS_H
+#define THETAFUNCS_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+extern Datum theta_print(PG_FUNCTION_ARGS);
+extern Datum theta_agg_trans(PG_FUNCTION_ARGS);
+extern Datum theta_agg_transp(PG_FUNCTION_ARGS);
+extern Datum theta_union_agg_trans(PG_FUNCTION_ARGS);
+extern Datum theta_intersection_agg_trans(PG_FUNCTION_ARGS);
+extern Datum theta_union(PG_FUNCTION_ARGS);
+extern Datum theta_intersection(PG_FUNCTION_ARGS);
+extern Datum theta_a_not_b(PG_FUNCTION_ARGS);
+extern Datum theta_estimate(PG_FUNCTION_ARGS);
+extern Datum theta_empty(PG_FUNCTION_ARGS);
+extern Datum theta_emptyp(PG_FUNCTION_ARGS);
+extern Datum theta_add(PG_FUNCTION_ARGS);
+
+#endif
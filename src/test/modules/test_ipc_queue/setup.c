@@ -0,0 +1,213 @@
+/*--------------------------------------------------------------------------
+ *
+ * setup.c
+ *		Code to set up the dynamic shared memory segment holding the
+ *		queues of a benchmark run, and the background workers producing
+ *		into and consuming from them.
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * IDENTIFICATION
+ *		src/test/modules/test_ipc_queue/setup.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "postmaster/bgworker.h"
+#include "storage/latch.h"
+#include "storage/procsignal.h"
+#include "utils/memutils.h"
+
+#include "test_ipc_queue.h"
+
+static LWLockTranche tranche;
+
+static void cleanup_background_workers(dsm_segment *seg, Datum arg);
+static void wait_for_workers_to_become_ready(BackgroundWorkerHandle **handles,
+								 int nworkers, volatile test_ipc_queue_header *hdr);
+
+/*
+ * Makes the lock tranche of the segment's queue locks known to this process,
+ * which every process using the locks must do
+ */
+void
+test_ipc_queue_register_tranche(test_ipc_queue_header *hdr, shm_toc *toc)
+{
+	tranche.name = "test_ipc_queue";
+	tranche.array_base = shm_toc_lookup(toc, TEST_IPC_QUEUE_KEY_LOCKS);
+	tranche.array_stride = sizeof(LWLock);
+
+	LWLockRegisterTranche(hdr->tranche_id, &tranche);
+}
+
+/*
+ * Set up a dynamic shared memory segment with the queues described by params,
+ * and start the workers using them.  The header is stored at key 0.
+ */
+void
+test_ipc_queue_setup(test_ipc_queue_header *params, dsm_segment **segp,
+				  test_ipc_queue_header **hdrp, BackgroundWorkerHandle ***handlesp)
+{
+	shm_toc_estimator e;
+	shm_toc    *toc;
+	dsm_segment *seg;
+	test_ipc_queue_header *hdr;
+	BackgroundWorkerHandle **handles;
+	BackgroundWorker worker;
+	MemoryContext oldcontext;
+	LWLock	   *locks;
+	Size		hdrsize;
+	Size		segsize;
+	int			nqueues = params->nconsumers * (params->relay ? 2 : 1);
+	int			nworkers = params->nproducers + params->nconsumers + (params->relay ? 1 : 0);
+	int			i;
+
+	hdrsize = offsetof(test_ipc_queue_header, consumers) +
+		sizeof(test_ipc_queue_consumer) * params->nconsumers;
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, hdrsize);
+	shm_toc_estimate_chunk(&e, sizeof(LWLock) * nqueues);
+	for (i = 0; i < nqueues; i++)
+		shm_toc_estimate_chunk(&e, params->queue_size);
+	shm_toc_estimate_keys(&e, 2 + nqueues);
+	segsize = shm_toc_estimate(&e);
+
+	seg = dsm_create(segsize, 0);
+	toc = shm_toc_create(PG_TEST_IPC_QUEUE_MAGIC, dsm_segment_address(seg), segsize);
+
+	hdr = shm_toc_allocate(toc, hdrsize);
+	MemSet(hdr, 0, hdrsize);
+	memcpy(hdr, params, offsetof(test_ipc_queue_header, consumers));
+	SpinLockInit(&hdr->mutex);
+	hdr->workers_total = nworkers;
+	hdr->workers_attached = 0;
+	hdr->workers_ready = 0;
+	hdr->tranche_id = LWLockNewTrancheId();
+	pg_atomic_init_u32(&hdr->started, 0);
+	shm_toc_insert(toc, 0, hdr);
+
+	locks = shm_toc_allocate(toc, sizeof(LWLock) * nqueues);
+	shm_toc_insert(toc, TEST_IPC_QUEUE_KEY_LOCKS, locks);
+	test_ipc_queue_register_tranche(hdr, toc);
+
+	for (i = 0; i < nqueues; i++)
+	{
+		void	   *ptr = shm_toc_allocate(toc, params->queue_size);
+		bool		relayed = params->relay && i < params->nconsumers;
+		ipc_queue  *ipcq;
+
+		/*
+		 * Producers need the lock unless the queue is lock free, but the relay is
+		 * the only producer of the queues it writes to
+		 */
+		LWLockInitialize(&locks[i], hdr->tranche_id);
+		MemSet(ptr, 0, sizeof(ipc_queue));
+		ipc_queue_init(ptr, params->queue_size, relayed ? NULL : &locks[i]);
+
+		ipcq = (ipc_queue *) ptr;
+		ipcq->multi_producer = params->lock_free && !relayed;
+
+		shm_toc_insert(toc, TEST_IPC_QUEUE_KEY(i), ptr);
+	}
+
+	/*
+	 * The handles must outlive this call, since the on_dsm_detach hook that
+	 * terminates the workers if we fail may run at abort.
+	 */
+	oldcontext = MemoryContextSwitchTo(TopTransactionContext);
+	handles = palloc0(sizeof(BackgroundWorkerHandle *) * (nworkers + 1));
+	MemoryContextSwitchTo(oldcontext);
+
+	on_dsm_detach(seg, cleanup_background_workers, PointerGetDatum(handles));
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;		/* new worker might not have library loaded */
+	sprintf(worker.bgw_library_name, "test_ipc_queue");
+	sprintf(worker.bgw_function_name, "test_ipc_queue_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "test_ipc_queue");
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(seg));
+	/* set bgw_notify_pid, so we can detect if the worker stops */
+	worker.bgw_notify_pid = MyProcPid;
+
+	oldcontext = MemoryContextSwitchTo(TopTransactionContext);
+	for (i = 0; i < nworkers; i++)
+	{
+		if (!RegisterDynamicBackgroundWorker(&worker, &handles[i]))
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("could not register background process"),
+				 errhint("You may need to increase max_worker_processes.")));
+	}
+	MemoryContextSwitchTo(oldcontext);
+
+	wait_for_workers_to_become_ready(handles, nworkers, hdr);
+
+	*segp = seg;
+	*hdrp = hdr;
+	*handlesp = handles;
+}
+
+static void
+cleanup_background_workers(dsm_segment *seg, Datum arg)
+{
+	BackgroundWorkerHandle **handles = (BackgroundWorkerHandle **) DatumGetPointer(arg);
+
+	for (; *handles; handles++)
+		TerminateBackgroundWorker(*handles);
+}
+
+static void
+wait_for_workers_to_become_ready(BackgroundWorkerHandle **handles, int nworkers,
+								 volatile test_ipc_queue_header *hdr)
+{
+	bool		save_set_latch_on_sigusr1;
+
+	save_set_latch_on_sigusr1 = set_latch_on_sigusr1;
+	set_latch_on_sigusr1 = true;
+
+	PG_TRY();
+	{
+		for (;;)
+		{
+			int			workers_ready;
+			int			i;
+
+			SpinLockAcquire(&hdr->mutex);
+			workers_ready = hdr->workers_ready;
+			SpinLockRelease(&hdr->mutex);
+			if (workers_ready >= nworkers)
+				break;
+
+			/* If any workers (or the postmaster) have died, we have failed. */
+			for (i = 0; i < nworkers; i++)
+			{
+				BgwHandleStatus status;
+				pid_t		pid;
+
+				status = GetBackgroundWorkerPid(handles[i], &pid);
+				if (status == BGWH_STOPPED || status == BGWH_POSTMASTER_DIED)
+					ereport(ERROR,
+							(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+							 errmsg("one or more background workers failed to start")));
+			}
+
+			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			CHECK_FOR_INTERRUPTS();
+			ResetLatch(MyLatch);
+		}
+	}
+	PG_CATCH();
+	{
+		set_latch_on_sigusr1 = save_set_latch_on_sigusr1;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	set_latch_on_sigusr1 = save_set_latch_on_sigusr1;
+}
@@ -0,0 +1,17 @@
+CREATE EXTENSION test_ipc_queue;
+
+--
+-- Timings vary from run to run, so we only check that every message arrives in order. Select *
+-- from the function to see throughput and latency.
+--
+-- a single producer and consumer
+SELECT messages FROM test_ipc_queue(1048576, 64, 100000);
+-- large messages in a small queue wrap around and fill it up
+SELECT messages, wraps > 0 AS wrapped FROM test_ipc_queue(16384, 3000, 10000);
+-- contended queues
+SELECT messages FROM test_ipc_queue(65536, 128, 20000, 4, 2);
+SELECT messages FROM test_ipc_queue(65536, 128, 20000, 4, 2, lock_free := true);
+-- through a relay, like messages that go through the ipc broker
+SELECT messages FROM test_ipc_queue(65536, 256, 20000, 2, 2, relay := true);
+-- messages that can't fit
+SELECT messages FROM test_ipc_queue(4096, 8192, 10);
@@ -0,0 +1,177 @@
+/*--------------------------------------------------------------------------
+ *
+ * test.c
+ *		Benchmark harness for continuous query ipc queues.
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * IDENTIFICATION
+ *		src/test/modules/test_ipc_queue/test.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "test_ipc_queue.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(test_ipc_queue);
+
+static int64 latency_percentile(int64 *hist, int64 total, float8 p);
+
+/*
+ * Runs producers pushing the given number of messages each into the queues of
+ * the consumers, optionally through a relay, and reports the throughput and the
+ * push to pop latencies of the run.  Small queues relative to the message size
+ * exercise wraparound and full queues, which shows up as producer waits.
+ */
+Datum
+test_ipc_queue(PG_FUNCTION_ARGS)
+{
+	test_ipc_queue_header params;
+	test_ipc_queue_header *hdr;
+	dsm_segment *seg;
+	BackgroundWorkerHandle **handles;
+	shm_toc    *toc;
+	TupleDesc	desc;
+	Datum		values[10];
+	bool		nulls[10];
+	int64		hist[TEST_IPC_QUEUE_LATENCY_BUCKETS];
+	int64		messages = 0;
+	int64		bytes = 0;
+	int64		max_latency = 0;
+	uint64		wraps = 0;
+	uint64		waits = 0;
+	TimestampTz start;
+	TimestampTz end = 0;
+	float8		seconds;
+	int			nqueues;
+	int			i;
+	int			j;
+
+	MemSet(&params, 0, sizeof(params));
+	params.queue_size = PG_GETARG_INT64(0);
+	params.message_size = PG_GETARG_INT32(1);
+	params.nmessages = PG_GETARG_INT64(2);
+	params.nproducers = PG_GETARG_INT32(3);
+	params.nconsumers = PG_GETARG_INT32(4);
+	params.relay = PG_GETARG_BOOL(5);
+	params.lock_free = PG_GETARG_BOOL(6);
+
+	if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (params.message_size < sizeof(test_ipc_queue_message))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("message size must be at least %zu bytes", sizeof(test_ipc_queue_message))));
+	if (params.queue_size < sizeof(ipc_queue) + 2 * sizeof(ipc_queue_slot) + params.message_size ||
+			params.queue_size != (Size) params.queue_size)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("queue size must be large enough for a message")));
+	if (params.nmessages < 0 || params.nmessages > PG_INT32_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of messages must be between 0 and %d", PG_INT32_MAX)));
+	if (params.nproducers < 1 || params.nconsumers < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of producers and consumers must be positive integers")));
+
+	test_ipc_queue_setup(&params, &seg, &hdr, &handles);
+
+	start = GetCurrentTimestamp();
+	pg_atomic_write_u32(&hdr->started, 1);
+
+	for (i = 0; handles[i]; i++)
+	{
+		if (WaitForBackgroundWorkerShutdown(handles[i]) != BGWH_STOPPED)
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("postmaster died during the benchmark")));
+	}
+
+	MemSet(hist, 0, sizeof(hist));
+	for (i = 0; i < hdr->nconsumers; i++)
+	{
+		test_ipc_queue_consumer *c = &hdr->consumers[i];
+
+		if (!c->finished)
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("consumer %d exited before receiving all messages", i)));
+
+		for (j = 0; j < TEST_IPC_QUEUE_LATENCY_BUCKETS; j++)
+			hist[j] += c->latency[j];
+
+		messages += c->messages;
+		bytes += c->bytes;
+		max_latency = Max(max_latency, c->max_latency);
+		end = Max(end, c->finished);
+	}
+
+	if (messages != hdr->nmessages * hdr->nproducers)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("received " INT64_FORMAT " messages, expected " INT64_FORMAT,
+						messages, hdr->nmessages * hdr->nproducers)));
+
+	toc = shm_toc_attach(PG_TEST_IPC_QUEUE_MAGIC, dsm_segment_address(seg));
+	nqueues = hdr->nconsumers * (hdr->relay ? 2 : 1);
+	for (i = 0; i < nqueues; i++)
+	{
+		ipc_queue_stats stats;
+
+		ipc_queue_stats_get(shm_toc_lookup(toc, TEST_IPC_QUEUE_KEY(i)), &stats);
+		wraps += stats.wraps;
+		waits += stats.producer_waits;
+	}
+
+	seconds = Max((float8) (end - start) / USECS_PER_SEC, 1e-6);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = Int64GetDatum(messages);
+	values[1] = Float8GetDatum(seconds);
+	values[2] = Float8GetDatum(messages / seconds);
+	values[3] = Float8GetDatum(bytes / seconds / (1024 * 1024));
+	values[4] = Int64GetDatum(latency_percentile(hist, messages, 0.5));
+	values[5] = Int64GetDatum(latency_percentile(hist, messages, 0.99));
+	values[6] = Int64GetDatum(latency_percentile(hist, messages, 0.999));
+	values[7] = Int64GetDatum(max_latency);
+	values[8] = Int64GetDatum(wraps);
+	values[9] = Int64GetDatum(waits);
+
+	dsm_detach(seg);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(desc), values, nulls)));
+}
+
+/*
+ * Returns the upper bound in microseconds of the histogram bucket holding the given percentile
+ */
+static int64
+latency_percentile(int64 *hist, int64 total, float8 p)
+{
+	int64		seen = 0;
+	int			i;
+
+	if (!total)
+		return 0;
+
+	for (i = 0; i < TEST_IPC_QUEUE_LATENCY_BUCKETS; i++)
+	{
+		seen += hist[i];
+		if (seen >= total * p)
+			break;
+	}
+
+	return INT64CONST(1) << Min(i, TEST_IPC_QUEUE_LATENCY_BUCKETS - 1);
+}
@@ -0,0 +1,24 @@
+/* src/test/modules/test_ipc_queue/test_ipc_queue--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION test_ipc_queue" to load this file. \quit
+
+CREATE FUNCTION test_ipc_queue(queue_size pg_catalog.int8,
+					   message_size pg_catalog.int4,
+					   nmessages pg_catalog.int8,
+					   producers pg_catalog.int4 default 1,
+					   consumers pg_catalog.int4 default 1,
+					   relay pg_catalog.bool default false,
+					   lock_free pg_catalog.bool default false,
+					   OUT messages pg_catalog.int8,
+					   OUT seconds pg_catalog.float8,
+					   OUT messages_per_second pg_catalog.float8,
+					   OUT mb_per_second pg_catalog.float8,
+					   OUT p50_us pg_catalog.int8,
+					   OUT p99_us pg_catalog.int8,
+					   OUT p999_us pg_catalog.int8,
+					   OUT max_us pg_catalog.int8,
+					   OUT wraps pg_catalog.int8,
+					   OUT producer_waits pg_catalog.int8)
+    RETURNS record STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
@@ -0,0 +1,95 @@
+/*--------------------------------------------------------------------------
+ *
+ * test_ipc_queue.h
+ *		Definitions for the continuous query ipc queue benchmark
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * IDENTIFICATION
+ *		src/test/modules/test_ipc_queue/test_ipc_queue.h
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef TEST_IPC_QUEUE_H
+#define TEST_IPC_QUEUE_H
+
+#include "pipeline/ipc/queue.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/lwlock.h"
+#include "storage/shm_toc.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+/* Identifier for shared memory segments used by this extension. */
+#define		PG_TEST_IPC_QUEUE_MAGIC		0x3c1a9e57
+
+/* Bucket i of a latency histogram counts latencies below 2^i microseconds. */
+#define		TEST_IPC_QUEUE_LATENCY_BUCKETS	32
+
+/*
+ * shm_toc keys of the queues and of their locks. Consumer i reads queue i. With a relay, producers
+ * write to queue consumers + i instead, and the relay moves its messages over to queue i.
+ */
+#define		TEST_IPC_QUEUE_KEY_LOCKS	1
+#define		TEST_IPC_QUEUE_KEY(i)		(2 + (i))
+
+/*
+ * Every message starts with this header, and the rest of it is filler. Producers send seq -1 to
+ * every queue once they're done.
+ */
+typedef struct
+{
+	TimestampTz sent;
+	int32		producer;
+	int32		seq;
+} test_ipc_queue_message;
+
+typedef struct
+{
+	int64		messages;
+	int64		bytes;
+	int64		max_latency;
+	int64		latency[TEST_IPC_QUEUE_LATENCY_BUCKETS];
+	TimestampTz finished;
+} test_ipc_queue_consumer;
+
+/*
+ * This structure is stored in the dynamic shared memory segment.  Workers are assigned their
+ * roles in the order in which they attach: producers first, then consumers, then the relay.
+ */
+typedef struct
+{
+	slock_t		mutex;
+	int			workers_total;
+	int			workers_attached;
+	int			workers_ready;
+
+	int			nproducers;
+	int			nconsumers;
+	bool		relay;
+	bool		lock_free;
+	int			message_size;
+	int64		nmessages;
+	Size		queue_size;
+	int			tranche_id;
+
+	/* set once all workers are ready, producers don't start before */
+	pg_atomic_uint32 started;
+
+	test_ipc_queue_consumer consumers[FLEXIBLE_ARRAY_MEMBER];
+} test_ipc_queue_header;
+
+/* Set up dynamic shared memory and background workers for a benchmark run. */
+extern void test_ipc_queue_setup(test_ipc_queue_header *params, dsm_segment **segp,
+				  test_ipc_queue_header **hdrp, BackgroundWorkerHandle ***handlesp);
+
+/* Makes the lock tranche of the segment's queues known to this process. */
+extern void test_ipc_queue_register_tranche(test_ipc_queue_header *hdr, shm_toc *toc);
+
+/* Main entrypoint for a worker. */
+extern void test_ipc_queue_main(Datum) pg_attribute_noreturn();
+
+#endif
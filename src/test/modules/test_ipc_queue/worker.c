@@ -0,0 +1,284 @@
+/*--------------------------------------------------------------------------
+ *
+ * worker.c
+ *		Background workers of the ipc queue benchmark.  Producers push
+ *		messages round robin into the consumers' queues, consumers pop
+ *		them and record their latency, and the optional relay moves
+ *		messages from the producers' queues into the consumers' queues,
+ *		the way the ipc broker moves them between processes.
+ *
+ * Copyright (c) 2013-2016, PipelineDB
+ *
+ * IDENTIFICATION
+ *		src/test/modules/test_ipc_queue/worker.c
+ *
+ * -------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
+#include "utils/resowner.h"
+
+#include "test_ipc_queue.h"
+
+/* how long the relay sleeps when it can't move anything, in case it misses a wake up */
+#define RELAY_WAIT_MS 10
+
+static void handle_sigterm(SIGNAL_ARGS);
+static void push_message(ipc_queue *ipcq, char *buf, int len);
+static void produce(test_ipc_queue_header *hdr, ipc_queue **queues, int producer);
+static void consume(test_ipc_queue_header *hdr, ipc_queue *ipcq, int consumer);
+static void relay(test_ipc_queue_header *hdr, ipc_queue **in, ipc_queue **out);
+
+/*
+ * Background worker entrypoint.
+ */
+void
+test_ipc_queue_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	shm_toc    *toc;
+	test_ipc_queue_header *hdr;
+	ipc_queue **queues;
+	int			nqueues;
+	int			myworkernumber;
+	PGPROC	   *registrant;
+	int			i;
+
+	pqsignal(SIGTERM, handle_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "test_ipc_queue worker");
+	seg = dsm_attach(DatumGetInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("unable to map dynamic shared memory segment")));
+	toc = shm_toc_attach(PG_TEST_IPC_QUEUE_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+			   errmsg("bad magic number in dynamic shared memory segment")));
+
+	hdr = shm_toc_lookup(toc, 0);
+	SpinLockAcquire(&hdr->mutex);
+	myworkernumber = hdr->workers_attached++;
+	SpinLockRelease(&hdr->mutex);
+	if (myworkernumber >= hdr->workers_total)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("too many ipc queue testing workers already")));
+
+	test_ipc_queue_register_tranche(hdr, toc);
+
+	nqueues = hdr->nconsumers * (hdr->relay ? 2 : 1);
+	queues = palloc(sizeof(ipc_queue *) * nqueues);
+	for (i = 0; i < nqueues; i++)
+		queues[i] = shm_toc_lookup(toc, TEST_IPC_QUEUE_KEY(i));
+
+	SpinLockAcquire(&hdr->mutex);
+	++hdr->workers_ready;
+	SpinLockRelease(&hdr->mutex);
+	registrant = BackendPidGetProc(MyBgworkerEntry->bgw_notify_pid);
+	if (registrant == NULL)
+	{
+		elog(DEBUG1, "registrant backend has exited prematurely");
+		proc_exit(1);
+	}
+	SetLatch(&registrant->procLatch);
+
+	if (myworkernumber < hdr->nproducers)
+		produce(hdr, hdr->relay ? queues + hdr->nconsumers : queues, myworkernumber);
+	else if (myworkernumber < hdr->nproducers + hdr->nconsumers)
+	{
+		int			consumer = myworkernumber - hdr->nproducers;
+
+		consume(hdr, queues[consumer], consumer);
+	}
+	else
+		relay(hdr, queues + hdr->nconsumers, queues);
+
+	dsm_detach(seg);
+	proc_exit(1);
+}
+
+static void
+push_message(ipc_queue *ipcq, char *buf, int len)
+{
+	test_ipc_queue_message *msg = (test_ipc_queue_message *) buf;
+
+	CHECK_FOR_INTERRUPTS();
+
+	msg->sent = GetCurrentTimestamp();
+	if (!ipc_queue_push(ipcq, buf, len, true))
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not push message")));
+}
+
+/*
+ * Pushes nmessages messages round robin into the given queues, followed by an
+ * end marker for each of them
+ */
+static void
+produce(test_ipc_queue_header *hdr, ipc_queue **queues, int producer)
+{
+	char	   *buf = palloc0(hdr->message_size);
+	test_ipc_queue_message *msg = (test_ipc_queue_message *) buf;
+	int64		i;
+
+	while (!pg_atomic_read_u32(&hdr->started))
+	{
+		CHECK_FOR_INTERRUPTS();
+		pg_usleep(100);
+	}
+
+	msg->producer = producer;
+
+	for (i = 0; i < hdr->nmessages; i++)
+	{
+		msg->seq = (int32) i;
+		push_message(queues[(producer + i) % hdr->nconsumers], buf, hdr->message_size);
+	}
+
+	msg->seq = -1;
+	for (i = 0; i < hdr->nconsumers; i++)
+		push_message(queues[i], buf, hdr->message_size);
+}
+
+/*
+ * Pops messages until every producer has sent its end marker, checking that each
+ * producer's messages come in order and recording their latencies
+ */
+static void
+consume(test_ipc_queue_header *hdr, ipc_queue *ipcq, int consumer)
+{
+	test_ipc_queue_consumer *stats = &hdr->consumers[consumer];
+	int32	   *last = palloc(sizeof(int32) * hdr->nproducers);
+	int			done = 0;
+	int			i;
+
+	for (i = 0; i < hdr->nproducers; i++)
+		last[i] = -1;
+
+	while (done < hdr->nproducers)
+	{
+		test_ipc_queue_message *msg;
+		int			len;
+
+		CHECK_FOR_INTERRUPTS();
+		ipc_queue_wait_non_empty(ipcq, 1000);
+
+		while ((msg = ipc_queue_peek_next(ipcq, &len)) != NULL)
+		{
+			TimestampTz now = GetCurrentTimestamp();
+			int64		latency = Max(now - msg->sent, 0);
+			int			bucket = 0;
+
+			if (len != hdr->message_size)
+				elog(ERROR, "message of size %d, expected %d", len, hdr->message_size);
+
+			if (msg->seq < 0)
+			{
+				done++;
+				continue;
+			}
+
+			if (msg->seq <= last[msg->producer])
+				elog(ERROR, "message %d of producer %d arrived after message %d", msg->seq,
+					 msg->producer, last[msg->producer]);
+			last[msg->producer] = msg->seq;
+
+			while (bucket < TEST_IPC_QUEUE_LATENCY_BUCKETS - 1 && (latency >> bucket))
+				bucket++;
+
+			stats->latency[bucket]++;
+			stats->max_latency = Max(stats->max_latency, latency);
+			stats->messages++;
+			stats->bytes += len;
+		}
+
+		ipc_queue_pop_peeked(ipcq);
+	}
+
+	stats->finished = GetCurrentTimestamp();
+}
+
+/*
+ * Moves messages from each of the producers' queues into the matching consumer
+ * queue until every producer's end marker has been moved
+ */
+static void
+relay(test_ipc_queue_header *hdr, ipc_queue **in, ipc_queue **out)
+{
+	int		   *done = palloc0(sizeof(int) * hdr->nconsumers);
+	int			finished = 0;
+	int			i;
+
+	for (i = 0; i < hdr->nconsumers; i++)
+		pg_atomic_write_u64(&in[i]->consumer_latch, (uint64) MyLatch);
+
+	while (finished < hdr->nconsumers)
+	{
+		int			moved = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		for (i = 0; i < hdr->nconsumers; i++)
+		{
+			test_ipc_queue_message *msg;
+			int			len;
+
+			while ((msg = ipc_queue_peek_next(in[i], &len)) != NULL)
+			{
+				if (!ipc_queue_push_nolock(out[i], msg, len, false))
+				{
+					ipc_queue_unpeek_all(in[i]);
+					break;
+				}
+
+				if (msg->seq < 0 && ++done[i] == hdr->nproducers)
+					finished++;
+
+				ipc_queue_pop_peeked(in[i]);
+				moved++;
+			}
+		}
+
+		if (moved)
+			continue;
+
+		/* successful pushes clear the producer latch, so set it again before sleeping */
+		for (i = 0; i < hdr->nconsumers; i++)
+			pg_atomic_write_u64(&out[i]->producer_latch, (uint64) MyLatch);
+
+		WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, RELAY_WAIT_MS);
+		ResetLatch(MyLatch);
+	}
+}
+
+/*
+ * When we receive a SIGTERM, we set InterruptPending and ProcDiePending just
+ * like a normal backend.  The next CHECK_FOR_INTERRUPTS() will do the right
+ * thing.
+ */
+static void
+handle_sigterm(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	SetLatch(MyLatch);
+
+	if (!proc_exit_inprogress)
+	{
+		InterruptPending = true;
+		ProcDiePending = true;
+	}
+
+	errno = save_errno;
+}
@@ -0,0 +1,38 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_adaptive_batching(pipeline, clean_db):
+  """
+  Verify that views get the right results when batch sizes and waits adapt to load, both under a
+  backlog and while events trickle in
+  """
+  pipeline.stop()
+  pipeline.run({
+    'continuous_query_adaptive_batching': 'on',
+    'continuous_query_latency_target': 20,
+    'continuous_query_batch_size': 1000
+  })
+
+  try:
+    pipeline.create_stream('adaptive_stream', x='integer')
+    pipeline.create_cv('test_adaptive_batching', 'SELECT x % 10 AS g, count(*), sum(x) FROM adaptive_stream GROUP BY g')
+
+    # a backlog grows batches
+    for _ in xrange(20):
+      pipeline.insert('adaptive_stream', ('x', ), [(x, ) for x in xrange(5000)])
+
+    # and a trickle shrinks them and their waits
+    for x in xrange(50):
+      pipeline.insert('adaptive_stream', ('x', ), [(x, )])
+      time.sleep(0.01)
+
+    pipeline.execute('SELECT pipeline_flush()')
+
+    rows = list(pipeline.execute('SELECT * FROM test_adaptive_batching ORDER BY g'))
+    assert len(rows) == 10
+    assert sum(r['count'] for r in rows) == 20 * 5000 + 50
+    assert sum(r['sum'] for r in rows) == 20 * sum(xrange(5000)) + sum(xrange(50))
+  finally:
+    pipeline.stop()
+    pipeline.run()
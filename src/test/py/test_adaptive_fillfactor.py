@@ -0,0 +1,35 @@
+from base import pipeline, clean_db
+
+
+def test_adaptive_fillfactor(pipeline, clean_db):
+  """
+  Verify that the fillfactor of views whose updates are rarely HOT is lowered, and that HOT
+  updates are counted
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_combiner_adaptive_fillfactor': 'on',
+                'continuous_view_min_fillfactor': '50'})
+
+  try:
+    pipeline.create_stream('ff_stream', k='integer', v='text')
+    pipeline.create_cv('test_adaptive_ff',
+                       'SELECT k, count(*), string_agg(v, \',\') FROM ff_stream GROUP BY k',
+                       fillfactor=100)
+
+    # every group grows on each update, so full pages rarely have room for its new versions
+    for n in xrange(150):
+      pipeline.insert('ff_stream', ('k', 'v'), [(k, str(n)) for k in xrange(100)])
+
+    row = pipeline.execute("SELECT reloptions FROM pg_class WHERE relname = 'test_adaptive_ff_mrel'").first()
+    fillfactor = int([o for o in row['reloptions'] if o.startswith('fillfactor=')][0].split('=')[1])
+    assert 50 <= fillfactor < 100
+
+    for row in pipeline.execute('SELECT * FROM test_adaptive_ff'):
+      assert row['count'] == 150
+
+    stats = pipeline.execute("SELECT * FROM pipeline_query_stats WHERE name = 'test_adaptive_ff' "
+                             "AND type = 'combiner'").first()
+    assert stats['hot_updates'] <= stats['updated_rows']
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+
+
+def test_allowed_lateness(pipeline, clean_db):
+  """
+  Verify that a sliding-window view over an event time column ignores events arriving after
+  the watermark has passed their step by more than allowed_lateness, and keeps the others
+  """
+  pipeline.create_stream('lateness_stream', x='integer', ts='timestamptz')
+  pipeline.create_cv('test_lateness',
+                     "SELECT x, COUNT(*) FROM lateness_stream WHERE ts > clock_timestamp() - interval '1 hour' GROUP BY x",
+                     step_factor=5, allowed_lateness='1 minute')
+
+  def insert(age):
+    pipeline.execute("""
+    INSERT INTO lateness_stream (x, ts)
+    SELECT x %% 10, now() - interval '%s' FROM generate_series(1, 100) x
+    """ % age)
+
+  # these advance the watermark to the current step
+  insert('0 seconds')
+
+  # within the allowed lateness of their step
+  insert('30 seconds')
+
+  # their step is long sealed, although they're still inside the window
+  insert('30 minutes')
+
+  result = list(pipeline.execute('SELECT * FROM test_lateness ORDER BY x'))
+  assert len(result) == 10
+  for row in result:
+    assert row['count'] == 20
+
+
+def test_allowed_lateness_requires_sw(pipeline, clean_db):
+  """
+  Verify that allowed_lateness can only be given for sliding-window views
+  """
+  pipeline.create_stream('lateness_stream', x='integer')
+
+  try:
+    pipeline.create_cv('test_lateness_no_sw', 'SELECT COUNT(*) FROM lateness_stream',
+                       allowed_lateness='1 minute')
+    assert False
+  except Exception, e:
+    assert 'can only specify "allowed_lateness" for sliding window queries' in e.message
@@ -0,0 +1,38 @@
+from base import pipeline, clean_db
+import json
+
+
+def test_append_aggs(pipeline, clean_db):
+  """
+  Verify that array_agg, string_agg and json_agg states read back from disk are still
+  complete after many combines of appended values
+  """
+  pipeline.create_stream('append_aggs_stream', k='integer', x='integer')
+  pipeline.create_cv('test_append_aggs', """
+  SELECT k, array_agg(x) AS arr, string_agg(x::text, ',') AS str,
+  string_agg(('\\x00'::bytea || x::text::bytea), '\\x01'::bytea) AS bytes,
+  json_agg(x) AS js, json_object_agg(x, x) AS obj, count(*)
+  FROM append_aggs_stream GROUP BY k
+  """)
+
+  expected = {}
+  for batch in xrange(20):
+    rows = [(k, batch * 10 + i) for k in xrange(4) for i in xrange(10)]
+    pipeline.insert('append_aggs_stream', ('k', 'x'), rows)
+    for k, x in rows:
+      expected.setdefault(k, []).append(x)
+
+  result = list(pipeline.execute('SELECT * FROM test_append_aggs ORDER BY k'))
+  assert len(result) == 4
+
+  for row in result:
+    values = sorted(expected[row['k']])
+    assert row['count'] == len(values)
+    assert sorted(row['arr']) == values
+    assert sorted(map(int, row['str'].split(','))) == values
+    assert sorted(json.loads(row['js'])) == values
+    assert sorted(map(int, json.loads(row['obj']).values())) == values
+
+    chunks = str(row['bytes']).split('\x01')
+    assert all(c[0] == '\x00' for c in chunks)
+    assert sorted(int(c[1:]) for c in chunks) == values
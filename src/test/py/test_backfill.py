@@ -0,0 +1,38 @@
+from base import pipeline, clean_db
+
+
+def test_backfill(pipeline, clean_db):
+  """
+  Verify that pipeline_backfill feeds a table's rows to a single continuous
+  view and leaves the stream's other readers alone
+  """
+  pipeline.create_stream('backfill_stream', x='integer', y='integer')
+  pipeline.create_cv('test_backfill', 'SELECT x, COUNT(*), SUM(y) FROM backfill_stream GROUP BY x')
+  pipeline.create_cv('test_backfill_other', 'SELECT COUNT(*) FROM backfill_stream')
+
+  rows = [(x % 10, x) for x in xrange(10000)]
+  pipeline.create_table('backfill_history', x='integer', y='integer')
+  pipeline.insert('backfill_history', ('x', 'y'), rows)
+
+  pipeline.insert('backfill_stream', ('x', 'y'), rows[:100])
+
+  result = pipeline.execute("SELECT pipeline_backfill('test_backfill', 'backfill_history')").first()
+  assert result['pipeline_backfill'] == 10000
+
+  result = list(pipeline.execute('SELECT * FROM test_backfill ORDER BY x'))
+  assert len(result) == 10
+  for row in result:
+    expected = [y for x, y in rows if x == row['x']] + [y for x, y in rows[:100] if x == row['x']]
+    assert row['count'] == len(expected)
+    assert row['sum'] == sum(expected)
+
+  row = pipeline.execute('SELECT * FROM test_backfill_other').first()
+  assert row['count'] == 100
+
+  # Inserts after a backfill reach all readers again
+  pipeline.insert('backfill_stream', ('x', 'y'), rows[:100])
+
+  row = pipeline.execute('SELECT SUM(count) FROM test_backfill').first()
+  assert row['sum'] == 10200
+  row = pipeline.execute('SELECT * FROM test_backfill_other').first()
+  assert row['count'] == 200
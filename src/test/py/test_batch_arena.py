@@ -0,0 +1,34 @@
+from base import pipeline, clean_db
+
+
+def test_batch_arena(pipeline, clean_db):
+  """
+  Verify that views get the same results whether or not per-batch memory comes from arenas, with
+  events large enough to be given arena blocks of their own
+  """
+  pipeline.create_stream('arena_stream', k='integer', s='text')
+  q = 'SELECT k, count(*), max(length(s)) AS len, string_agg(substring(s, 1, 2), \',\') AS agg FROM arena_stream GROUP BY k'
+
+  rows = [(x % 100, 'x' * (x % 97 == 0 and 2 ** 21 or x)) for x in xrange(1000)]
+
+  results = []
+  for batch_arena in ('on', 'off'):
+    pipeline.stop()
+    pipeline.run({'continuous_query_batch_arena': batch_arena})
+
+    try:
+      pipeline.create_cv('test_batch_arena', q)
+      pipeline.insert('arena_stream', ('k', 's'), rows)
+      pipeline.execute('SELECT pipeline_flush()')
+
+      result = list(pipeline.execute('SELECT k, count, len, length(agg) AS agg FROM test_batch_arena ORDER BY k'))
+      assert len(result) == 100
+      assert sum(r['count'] for r in result) == 1000
+      results.append(result)
+
+      pipeline.drop_cv('test_batch_arena')
+    finally:
+      pipeline.stop()
+      pipeline.run()
+
+  assert results[0] == results[1]
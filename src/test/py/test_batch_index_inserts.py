@@ -0,0 +1,35 @@
+from base import pipeline, clean_db
+
+
+def test_batch_index_inserts(pipeline, clean_db):
+  """
+  Verify that user-defined matrel indexes maintained in batches return the same rows as scans
+  """
+  pipeline.create_stream('batch_index_stream', k='integer', x='integer')
+  pipeline.create_cv('test_batch_index',
+                     'SELECT k, count(*), sum(x) FROM batch_index_stream GROUP BY k')
+  pipeline.execute('CREATE INDEX test_batch_index_count ON test_batch_index_mrel (count)')
+  pipeline.execute('CREATE INDEX test_batch_index_sum ON test_batch_index_mrel (sum, k)')
+
+  # indexed columns change on every update, so each new group version needs new index entries
+  for n in xrange(20):
+    pipeline.insert('batch_index_stream', ('k', 'x'), [(k, n) for k in xrange(n * 50, 2000)])
+
+  def rows(q):
+    return sorted(tuple(r) for r in pipeline.execute(q))
+
+  queries = ['SELECT k, count FROM test_batch_index_mrel WHERE count = 20',
+             'SELECT k, count FROM test_batch_index_mrel WHERE count BETWEEN 5 AND 10',
+             'SELECT k, sum FROM test_batch_index_mrel WHERE sum > 150 AND k < 1000']
+
+  scanned = [rows(q) for q in queries]
+  assert len(scanned[0]) == 1050
+
+  pipeline.execute('SET enable_seqscan TO off')
+  pipeline.execute('SET enable_bitmapscan TO off')
+  try:
+    for q, expected in zip(queries, scanned):
+      assert rows(q) == expected
+  finally:
+    pipeline.execute('RESET enable_seqscan')
+    pipeline.execute('RESET enable_bitmapscan')
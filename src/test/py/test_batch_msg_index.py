@@ -0,0 +1,26 @@
+from base import pipeline, clean_db
+
+
+def test_batch_msg_index(pipeline, clean_db):
+  """
+  Verify that each of many views over different streams reads exactly its own events when they're
+  all in the same worker batches
+  """
+  nstreams = 8
+  for i in xrange(nstreams):
+    pipeline.create_stream('msg_index_stream%d' % i, x='integer')
+    for j in xrange(3):
+      pipeline.create_cv('test_msg_index%d_%d' % (i, j),
+                         'SELECT x %% %d AS g, count(*) FROM msg_index_stream%d GROUP BY g' % (j + 2, i))
+
+  for _ in xrange(4):
+    for i in xrange(nstreams):
+      pipeline.insert('msg_index_stream%d' % i, ('x', ), [(x, ) for x in xrange(100 * (i + 1))])
+
+  pipeline.execute('SELECT pipeline_flush()')
+
+  for i in xrange(nstreams):
+    for j in xrange(3):
+      rows = list(pipeline.execute('SELECT * FROM test_msg_index%d_%d' % (i, j)))
+      assert len(rows) == j + 2
+      assert sum(r['count'] for r in rows) == 400 * (i + 1)
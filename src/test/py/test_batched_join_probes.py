@@ -0,0 +1,41 @@
+from base import pipeline, clean_db
+
+
+def test_batched_join_probes(pipeline, clean_db):
+  """
+  Verify that stream-table index joins return the same results when each batch is sorted
+  on its join keys, including duplicate and missing keys
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_batched_join_probes': 'on'})
+
+  try:
+    pipeline.create_table('probe_dim', k='integer', v='text')
+    pipeline.insert('probe_dim', ('k', 'v'), [(k, 'v%d' % (k % 7)) for k in xrange(10000)])
+    pipeline.execute('CREATE INDEX probe_dim_k_idx ON probe_dim (k)')
+    pipeline.execute('ANALYZE probe_dim')
+
+    pipeline.create_stream('probe_stream', k='integer', x='integer')
+    pipeline.create_cv('test_batched_probes',
+                       'SELECT d.v, COUNT(*), SUM(s.x) FROM probe_stream s JOIN probe_dim d ON s.k = d.k GROUP BY d.v')
+
+    # keys past the end of the table don't match anything
+    rows = [((i * 7919) % 12000, i) for i in xrange(1000)]
+    pipeline.insert('probe_stream', ('k', 'x'), rows)
+    pipeline.insert('probe_stream', ('k', 'x'), rows)
+
+    expected = {}
+    for k, x in rows:
+      if k >= 10000:
+        continue
+      v = 'v%d' % (k % 7)
+      count, total = expected.get(v, (0, 0))
+      expected[v] = (count + 2, total + 2 * x)
+
+    result = list(pipeline.execute('SELECT * FROM test_batched_probes'))
+    assert len(result) == len(expected)
+    for row in result:
+      assert (row['count'], row['sum']) == expected[row['v']]
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -148,3 +148,42 @@ def test_bloom_type(pipeline, clean_db):
                                  'FROM test_bloom_type ORDER BY x'))
   assert result[0][0] == 986
   assert result[1][0] == 495
+
+def test_blocked_bloom(pipeline, clean_db):
+  """
+  Verify that blocked Bloom filters contain everything added to them, combine correctly and
+  estimate their cardinalities about as well as unblocked ones
+  """
+  q = """
+  SELECT k::integer, bloom_agg(x::integer, 0.01, 10000, true) AS blocked,
+  bloom_agg(x::integer, 0.01, 10000) AS unblocked FROM test_bloom_stream GROUP BY k
+  """
+  desc = ('k', 'x')
+  pipeline.create_cv('test_blocked_bloom', q)
+
+  rows = []
+  for i in range(10000):
+    rows.append((i % 2, 2 * i))
+
+  pipeline.insert('test_bloom_stream', desc, rows)
+
+  result = pipeline.execute("""
+  SELECT bloom_cardinality(combine(blocked)) AS blocked, bloom_cardinality(combine(unblocked)) AS unblocked
+  FROM test_blocked_bloom
+  """).first()
+  assert abs(result['blocked'] - 10000) < 500
+  assert result['unblocked'] > 0
+
+  result = pipeline.execute("""
+  SELECT SUM(bloom_contains(b, 2 * x)::integer) AS hits, SUM(bloom_contains(b, 2 * x + 1)::integer) AS false_hits
+  FROM (SELECT combine(blocked) AS b FROM test_blocked_bloom) s, generate_series(0, 9999) x
+  """).first()
+  assert result['hits'] == 10000
+  assert result['false_hits'] < 200
+
+  result = pipeline.execute("""
+  SELECT bloom_contains(bloom_add(bloom_empty(0.01, 100, true), 42), 42),
+  bloom_contains(bloom_add(bloom_empty(0.01, 100, true), 42), 43)
+  """).first()
+  assert result[0]
+  assert not result[1]
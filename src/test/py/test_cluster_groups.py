@@ -0,0 +1,37 @@
+from base import pipeline, clean_db
+
+
+def test_cluster_groups(pipeline, clean_db):
+  """
+  Verify that views with cluster_groups combine new and existing groups like any other view
+  """
+  pipeline.create_stream('cluster_stream', x='integer', y='text')
+  pipeline.create_cv('test_cluster_groups',
+                     'SELECT x, y, COUNT(*), SUM(x) FROM cluster_stream GROUP BY x, y',
+                     cluster_groups='true')
+  pipeline.create_cv('test_no_cluster_groups',
+                     'SELECT x, y, COUNT(*), SUM(x) FROM cluster_stream GROUP BY x, y')
+
+  # each batch adds new groups in between the existing ones
+  for i in xrange(4):
+    pipeline.insert('cluster_stream', ('x', 'y'), [(x, 'y%d' % (x % 7)) for x in xrange(i, 4000, 2)])
+
+  expected = list(pipeline.execute('SELECT x, y, count, sum FROM test_no_cluster_groups ORDER BY x, y'))
+  rows = list(pipeline.execute('SELECT x, y, count, sum FROM test_cluster_groups ORDER BY x, y'))
+
+  assert len(rows) == 4000
+  assert [tuple(r) for r in rows] == [tuple(r) for r in expected]
+
+
+def test_cluster_groups_invalid(pipeline, clean_db):
+  """
+  Verify that cluster_groups requires groups to cluster
+  """
+  pipeline.create_stream('cluster_stream', x='integer')
+
+  try:
+    pipeline.create_cv('test_cluster_groups_invalid', 'SELECT COUNT(*) FROM cluster_stream',
+                       cluster_groups='true')
+    assert False
+  except Exception:
+    pass
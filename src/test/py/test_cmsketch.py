@@ -47,3 +47,72 @@ def test_cmsketch_type(pipeline, clean_db):
                                  'FROM test_cmsketch_type ORDER BY x'))
   assert result[0] == (1000, 0)
   assert result[1] == (500, 500)
+
+
+def test_cmsketch_topk_agg(pipeline, clean_db):
+  """
+  Verify that cmsketch_topk_agg tracks the most frequent values along with the sketch,
+  and that combining partial states recomputes them
+  """
+  pipeline.create_stream('test_cmsketch_topk_stream', k='integer', x='text')
+  q = """
+  SELECT k, cmsketch_topk_agg(x, 3) AS c FROM test_cmsketch_topk_stream
+  GROUP BY k
+  """
+  pipeline.create_cv('test_cmsketch_topk', q)
+
+  rows = []
+  for n in xrange(1000):
+    rows.append((n % 2, 'url%d' % (n % 4 if n % 10 else 100 + n)))
+
+  pipeline.insert('test_cmsketch_topk_stream', ('k', 'x'), rows)
+
+  def topk(q):
+    result = []
+    for row in pipeline.execute(q):
+      value, freq = row[0].strip('()').split(',')
+      result.append({'value': value, 'frequency': int(freq)})
+    return result
+
+  result = topk('SELECT cmsketch_topk(c) FROM test_cmsketch_topk WHERE k = 0')
+  assert len(result) == 3
+  assert set(r['value'] for r in result[:2]) == set(['url0', 'url2'])
+  assert [r['frequency'] for r in result[:2]] == [200, 200]
+
+  result = topk('SELECT cmsketch_topk(combine(c)) FROM test_cmsketch_topk')
+  assert len(result) == 3
+  assert set(r['value'] for r in result[:2]) == set(['url1', 'url3'])
+  assert [r['frequency'] for r in result] == [250, 250, 200]
+
+  result = pipeline.execute(
+    "SELECT cmsketch_frequency(combine(c), 'url1'::text) AS f, cmsketch_total(combine(c)) AS t "
+    "FROM test_cmsketch_topk").first()
+  assert result['f'] == 250
+  assert result['t'] == 1000
+
+
+def test_sparse_partials(pipeline, clean_db):
+  """
+  Verify that sketches sent to combiners in their sparse form are merged correctly,
+  both natively and by the combine plan
+  """
+  pipeline.create_stream('test_sparse_stream', k='integer', x='integer')
+  pipeline.create_cv('test_sparse_native',
+                     'SELECT k, cmsketch_agg(x) AS c, bloom_agg(x) AS b FROM test_sparse_stream GROUP BY k')
+  pipeline.create_cv('test_sparse_plan',
+                     'SELECT k, cmsketch_agg(x) AS c, bloom_agg(x) AS b, COUNT(*) FROM test_sparse_stream GROUP BY k')
+
+  # every batch only touches a handful of counters and words
+  for n in xrange(20):
+    pipeline.insert('test_sparse_stream', ('k', 'x'), [(n % 2, n), (n % 2, n), (n % 2, 1000)])
+
+  for cv in ('test_sparse_native', 'test_sparse_plan'):
+    result = list(pipeline.execute(
+      'SELECT k, cmsketch_frequency(c, 1000) AS f, cmsketch_frequency(c, 4) AS f4, cmsketch_total(c) AS t, '
+      'bloom_contains(b, 4) AS b4, bloom_contains(b, 5) AS b5 FROM %s ORDER BY k' % cv))
+    assert len(result) == 2
+    assert [r['f'] for r in result] == [10, 10]
+    assert [r['f4'] for r in result] == [2, 0]
+    assert [r['t'] for r in result] == [30, 30]
+    assert [r['b4'] for r in result] == [True, False]
+    assert [r['b5'] for r in result] == [False, True]
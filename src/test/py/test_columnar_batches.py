@@ -0,0 +1,44 @@
+from base import pipeline, clean_db
+import getpass
+import psycopg2
+
+
+def test_columnar_batches(pipeline, clean_db):
+  """
+  Verify that columnar batches project the same results as tuple batches, including
+  nulls, variable-width values and views reading only some of the columns
+  """
+  pipeline.create_stream('columnar_stream', x='integer', y='text', z='float8', w='numeric')
+  pipeline.create_cv('test_columnar_all',
+                     'SELECT COUNT(*), COUNT(x) AS cx, SUM(x) AS x, COUNT(DISTINCT y) AS y, '
+                     'SUM(z) AS z, SUM(w) AS w FROM columnar_stream')
+  pipeline.create_cv('test_columnar_some', 'SELECT y, SUM(x) AS x FROM columnar_stream GROUP BY y')
+
+  rows = []
+  for i in xrange(1000):
+    x = 'NULL' if i % 7 == 0 else str(i % 10)
+    y = 'NULL' if i % 11 == 0 else "'%s'" % ('y%d' % (i % 5) * (i % 3 + 1))
+    rows.append('(%s, %s, %d.5, %d.25)' % (x, y, i % 4, i % 3))
+  values = ', '.join(rows)
+
+  conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' % (getpass.getuser(), pipeline.port))
+  conn.autocommit = True
+  cur = conn.cursor()
+
+  cur.execute('INSERT INTO columnar_stream (x, y, z, w) VALUES %s' % values)
+  cur.execute('SET stream_insert_columnar_batches TO on')
+  cur.execute('INSERT INTO columnar_stream (x, y, z, w) VALUES %s' % values)
+  conn.close()
+
+  row = pipeline.execute('SELECT * FROM test_columnar_all').first()
+  assert row['count'] == 2000
+  assert row['cx'] == 2 * len([i for i in xrange(1000) if i % 7])
+  assert row['x'] == 2 * sum(i % 10 for i in xrange(1000) if i % 7)
+  assert row['y'] == 15
+  assert row['z'] == 2 * sum(i % 4 + 0.5 for i in xrange(1000))
+  assert float(row['w']) == 2 * sum(i % 3 + 0.25 for i in xrange(1000))
+
+  # Every group must have been aggregated evenly across both encodings
+  for row in pipeline.execute('SELECT * FROM test_columnar_some WHERE y IS NOT NULL'):
+    i = [i for i in xrange(1000) if i % 11 and 'y%d' % (i % 5) * (i % 3 + 1) == row['y']]
+    assert row['x'] == 2 * sum(n % 10 for n in i if n % 7)
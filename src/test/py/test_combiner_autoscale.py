@@ -0,0 +1,72 @@
+from base import pipeline, clean_db
+from subprocess import check_output
+import time
+
+
+def num_combiners():
+  out = check_output('ps aux | grep "combiner[0-9] \[pipeline\]" | grep -v grep || true',
+                     shell=True)
+  return len(filter(lambda s: len(s), out.split('\n')))
+
+
+def set_conf(pipeline, **kwargs):
+  for k, v in kwargs.iteritems():
+    if v is None:
+      pipeline.execute('ALTER SYSTEM RESET %s' % k)
+    else:
+      pipeline.execute('ALTER SYSTEM SET %s TO %s' % (k, v))
+  pipeline.execute('SELECT pg_reload_conf()')
+
+
+def test_combiner_autoscale(pipeline, clean_db):
+  """
+  Verify that idle combiners are stopped and started again when autoscaling is
+  turned on and off, and that groups are combined correctly throughout
+  """
+  pipeline.create_stream('autoscale_stream', k='integer', v='integer')
+  pipeline.create_cv('test_autoscale', 'SELECT k, COUNT(*), SUM(v) FROM autoscale_stream GROUP BY k')
+
+  rows = [(k, k) for k in xrange(1000)]
+
+  def insert(n):
+    for _ in xrange(n):
+      pipeline.insert('autoscale_stream', ('k', 'v'), rows)
+
+  insert(5)
+  assert num_combiners() == 2
+
+  set_conf(pipeline,
+           continuous_query_combiner_autoscale='on',
+           continuous_query_combiner_autoscale_busy_time='100ms',
+           continuous_query_combiner_autoscale_idle_time='500ms')
+
+  for _ in xrange(30):
+    if num_combiners() == 1:
+      break
+    time.sleep(0.5)
+  assert num_combiners() == 1
+
+  insert(5)
+
+  set_conf(pipeline,
+           continuous_query_combiner_autoscale=None,
+           continuous_query_combiner_autoscale_busy_time=None,
+           continuous_query_combiner_autoscale_idle_time=None)
+
+  for _ in xrange(30):
+    if num_combiners() == 2:
+      break
+    time.sleep(0.5)
+  assert num_combiners() == 2
+
+  insert(5)
+  time.sleep(2)
+
+  result = list(pipeline.execute('SELECT * FROM test_autoscale ORDER BY k'))
+  assert len(result) == 1000
+  for row in result:
+    assert row['count'] == 15
+    assert row['sum'] == 15 * row['k']
+
+  row = pipeline.execute('SELECT COUNT(*) FROM test_autoscale_mrel').first()
+  assert row['count'] == 1000
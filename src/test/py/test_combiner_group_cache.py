@@ -0,0 +1,51 @@
+from base import pipeline, clean_db
+
+
+def test_combiner_group_cache(pipeline, clean_db):
+  """
+  Verify that groups cached by combiners across commits are updated correctly, including
+  when they're evicted and when the continuous view is truncated underneath them
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_combiner_group_cache_mem': 64})
+
+  try:
+    pipeline.create_stream('group_cache_stream', k='integer', v='integer')
+    pipeline.create_cv('test_group_cache',
+                       'SELECT k, COUNT(*), SUM(v) FROM group_cache_stream GROUP BY k')
+    pipeline.create_cv('test_group_cache_single', 'SELECT COUNT(*) FROM group_cache_stream')
+
+    # Enough groups to outgrow the cache, with a few hot groups updated by every insert
+    for i in xrange(10):
+      rows = [(k, 1) for k in xrange(10)]
+      rows.extend((k, 1) for k in xrange(i * 1000, (i + 1) * 1000))
+      pipeline.insert('group_cache_stream', ('k', 'v'), rows)
+
+    rows = pipeline.execute('SELECT * FROM test_group_cache WHERE k < 10 ORDER BY k')
+    for row in rows:
+      assert row['count'] == 11
+      assert row['sum'] == row['count']
+
+    row = pipeline.execute('SELECT COUNT(*), SUM(count) FROM test_group_cache').first()
+    assert row['count'] == 10000
+    assert row['sum'] == 10 * 1010
+
+    row = pipeline.execute('SELECT * FROM test_group_cache_single').first()
+    assert row['count'] == 10 * 1010
+
+    # Cached groups that are no longer on disk must not be updated
+    pipeline.execute('TRUNCATE CONTINUOUS VIEW test_group_cache')
+    pipeline.execute('TRUNCATE CONTINUOUS VIEW test_group_cache_single')
+    pipeline.insert('group_cache_stream', ('k', 'v'), [(k, 2) for k in xrange(10)])
+
+    rows = list(pipeline.execute('SELECT * FROM test_group_cache ORDER BY k'))
+    assert len(rows) == 10
+    for row in rows:
+      assert row['count'] == 1
+      assert row['sum'] == 2
+
+    row = pipeline.execute('SELECT * FROM test_group_cache_single').first()
+    assert row['count'] == 10
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,42 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_combiner_rebalance(pipeline, clean_db):
+  """
+  Verify that groups keep being combined correctly while the number of active
+  combiners is changed without restarting
+  """
+  pipeline.create_stream('rebalance_stream', k='integer', v='integer')
+  pipeline.create_cv('test_rebalance', 'SELECT k, COUNT(*), SUM(v) FROM rebalance_stream GROUP BY k')
+  pipeline.create_cv('test_rebalance_total', 'SELECT COUNT(*) FROM rebalance_stream')
+
+  rows = [(k, k) for k in xrange(1000)]
+
+  def insert(n):
+    for _ in xrange(n):
+      pipeline.insert('rebalance_stream', ('k', 'v'), rows)
+
+  insert(5)
+
+  for n in [1, 0, 1, 0]:
+    pipeline.execute('ALTER SYSTEM SET continuous_query_num_active_combiners TO %d' % n)
+    pipeline.execute('SELECT pg_reload_conf()')
+    insert(5)
+    time.sleep(2)
+    insert(5)
+
+  pipeline.execute('ALTER SYSTEM RESET continuous_query_num_active_combiners')
+  pipeline.execute('SELECT pg_reload_conf()')
+
+  result = list(pipeline.execute('SELECT * FROM test_rebalance ORDER BY k'))
+  assert len(result) == 1000
+  for row in result:
+    assert row['count'] == 45
+    assert row['sum'] == 45 * row['k']
+
+  row = pipeline.execute('SELECT COUNT(*) FROM test_rebalance_mrel').first()
+  assert row['count'] == 1000
+
+  row = pipeline.execute('SELECT * FROM test_rebalance_total').first()
+  assert row['count'] == 45 * 1000
@@ -0,0 +1,53 @@
+from base import pipeline, clean_db
+
+
+def test_cont_query_cache(pipeline, clean_db):
+  """
+  Verify that processes sharing analyzed queries produce correct results, and
+  that replaced views never get the queries of the views they replaced
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_num_workers': 4,
+                'continuous_query_num_combiners': 4})
+
+  try:
+    pipeline.create_stream('cache_stream', x='integer', y='integer')
+    pipeline.create_table('cache_table', x='integer', z='text')
+    pipeline.insert('cache_table', ('x', 'z'), [(x, 'z%d' % x) for x in xrange(10)])
+
+    pipeline.create_cv('test_cache_grouped', 'SELECT x, COUNT(*), SUM(y) FROM cache_stream GROUP BY x')
+    pipeline.create_cv('test_cache_join',
+                       'SELECT t.z, COUNT(*) FROM cache_stream s JOIN cache_table t ON s.x = t.x GROUP BY t.z')
+
+    rows = [(x % 10, x) for x in xrange(1000)]
+    for _ in xrange(10):
+      pipeline.insert('cache_stream', ('x', 'y'), rows)
+
+    result = list(pipeline.execute('SELECT * FROM test_cache_grouped ORDER BY x'))
+    assert len(result) == 10
+    for row in result:
+      assert row['count'] == 1000
+      assert row['sum'] == 10 * sum(y for x, y in rows if x == row['x'])
+
+    result = list(pipeline.execute('SELECT * FROM test_cache_join ORDER BY z'))
+    assert len(result) == 10
+    for row in result:
+      assert row['count'] == 1000
+
+    # The replacement reuses the dropped view's id
+    pipeline.execute('DROP CONTINUOUS VIEW test_cache_grouped')
+    pipeline.create_cv('test_cache_grouped', 'SELECT y % 2 AS y, MAX(x) FROM cache_stream GROUP BY y % 2')
+
+    for _ in xrange(10):
+      pipeline.insert('cache_stream', ('x', 'y'), rows)
+
+    result = list(pipeline.execute('SELECT * FROM test_cache_grouped ORDER BY y'))
+    assert len(result) == 2
+    for row in result:
+      assert row['max'] == 8 + row['y']
+
+    result = list(pipeline.execute('SELECT SUM(count) FROM test_cache_join')).pop()
+    assert result['sum'] == 20000
+  finally:
+    pipeline.stop()
+    pipeline.run()
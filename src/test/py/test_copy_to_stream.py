@@ -144,6 +144,34 @@ def test_copy_to_typed_stream(pipeline, clean_db):
     assert result[1] == expected[1]
     assert result[2] == expected[2]
 
+def test_binary_copy_to_typed_stream(pipeline, clean_db):
+    """
+    Verify that binary copies into a typed stream work, including rows with
+    NULLs and rows that are larger than a single copy batch
+    """
+    pipeline.create_stream('stream', x='integer', y='text')
+
+    q = 'SELECT count(*), count(x) AS cx, sum(x) AS sx, sum(length(y)) AS ly FROM stream'
+    pipeline.create_cv('test_binary_copy_to_stream', q)
+    pipeline.create_table('test_binary_copy_to_stream_t', x='integer', y='text')
+
+    rows = [(n % 1024 if n % 7 else None, 'y' * (n % 64)) for n in range(10000)]
+    rows.extend([(1, 'z' * 500000)] * 3)
+    pipeline.insert('test_binary_copy_to_stream_t', ('x', 'y'), rows)
+
+    path = os.path.abspath(os.path.join(pipeline.tmp_dir, 'test_copy.bin'))
+    pipeline.execute('COPY test_binary_copy_to_stream_t (x, y) TO \'%s\' BINARY' % path)
+    pipeline.execute('COPY stream (x, y) FROM \'%s\' BINARY' % path)
+
+    expected = pipeline.execute('SELECT count(*), count(x) AS cx, sum(x) AS sx, sum(length(y)) AS ly '
+                                'FROM test_binary_copy_to_stream_t').first()
+    result = pipeline.execute('SELECT count, cx, sx, ly FROM test_binary_copy_to_stream').first()
+
+    assert result['count'] == expected['count']
+    assert result['cx'] == expected['cx']
+    assert result['sx'] == expected['sx']
+    assert result['ly'] == expected['ly']
+
 def test_regression(pipeline, clean_db):
   path = os.path.abspath(os.path.join(pipeline.tmp_dir, 'test_copy.csv'))
   _generate_csv(path, [['2015-06-01 00:00:00','De','Adam_Babareka','1','37433']], desc=('day', 'project', 'title', 'count', 'size'))
@@ -154,3 +182,21 @@ def test_regression(pipeline, clean_db):
     pipeline.execute("COPY copy_regression_stream (day, project, title, count, size) FROM '%s'" % path)
   except Exception, e:
     assert '(DataError) missing data for column "project"' in e.message
+
+def test_batch_ack_options(pipeline, clean_db):
+  """
+  Verify that batch_ack is only accepted for COPY FROM STDIN into a stream
+  """
+  pipeline.create_stream('stream', x='integer')
+  pipeline.create_table('test_batch_ack_t', x='integer')
+  path = os.path.abspath(os.path.join(pipeline.tmp_dir, 'test_copy.csv'))
+  _generate_csv(path, [(1, ), (2, )])
+
+  for stmt, err in [("COPY test_batch_ack_t FROM STDIN WITH (batch_ack)", 'only supported for streams'),
+                    ("COPY stream FROM '%s' WITH (batch_ack)" % path, 'only supported from STDIN'),
+                    ("COPY test_batch_ack_t TO STDOUT WITH (batch_ack)", 'only available using COPY FROM')]:
+    try:
+      pipeline.execute(stmt)
+      assert False
+    except Exception, e:
+      assert err in e.message
@@ -21,3 +21,46 @@ def test_hll_count_distinct(pipeline, clean_db):
     delta = abs(expected - result['count'])
 
     assert delta / float(expected) <= 0.02
+
+
+def test_hybrid_count_distinct(pipeline, clean_db):
+    """
+    Verify that hybrid_count_distinct is exact for groups below its threshold,
+    approximate for groups above it, and that both kinds of groups combine
+    """
+    q = """
+    SELECT k::integer, hybrid_count_distinct(x::integer) AS d0,
+    hybrid_count_distinct(x::integer, 100) AS d1 FROM stream GROUP BY k
+    """
+    pipeline.create_cv('test_hybrid_count_distinct', q)
+
+    desc = ('k', 'x')
+    rows = []
+    for n in xrange(500):
+        rows.append((0, n))
+        rows.append((0, n))
+    for n in xrange(20000):
+        rows.append((1, n))
+
+    pipeline.insert('stream', desc, rows)
+
+    result = list(pipeline.execute(
+        'SELECT d0, d1 FROM test_hybrid_count_distinct ORDER BY k'))
+    assert result[0]['d0'] == 500
+    assert abs(result[0]['d1'] - 500) <= 10
+    assert abs(result[1]['d0'] - 20000) <= 400
+    assert abs(result[1]['d1'] - 20000) <= 400
+
+    result = pipeline.execute(
+        'SELECT combine(d0) AS d0 FROM test_hybrid_count_distinct').first()
+    assert abs(result['d0'] - 20000) <= 400
+
+    # A table of exact states combines exactly
+    pipeline.execute('DROP CONTINUOUS VIEW test_hybrid_count_distinct')
+    pipeline.create_cv('test_hybrid_count_distinct',
+                       'SELECT k::integer, hybrid_count_distinct(x::integer) '
+                       'FROM stream GROUP BY k')
+    pipeline.insert('stream', desc, [(k, n) for k in xrange(4) for n in xrange(k * 100, k * 100 + 200)])
+    result = pipeline.execute(
+        'SELECT combine(hybrid_count_distinct) FROM test_hybrid_count_distinct').first()
+    assert result[0] == 500
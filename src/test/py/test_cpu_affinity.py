@@ -0,0 +1,35 @@
+from base import pipeline, clean_db
+import multiprocessing
+
+
+def allowed_cpus(pid):
+  with open('/proc/%d/status' % pid) as f:
+    for line in f:
+      if line.startswith('Cpus_allowed_list:'):
+        return line.split(':')[1].strip()
+  return None
+
+
+def test_cpu_affinity(pipeline, clean_db):
+  """
+  Verify that continuous query processes are restricted to the CPUs configured
+  for their role, and that other roles keep their default affinity
+  """
+  cpu = str(multiprocessing.cpu_count() - 1)
+  default = allowed_cpus(pipeline.execute('SELECT pg_backend_pid() AS pid').first()['pid'])
+
+  pipeline.stop()
+  pipeline.run({'continuous_query_worker_cpus': cpu})
+
+  try:
+    rows = list(pipeline.execute('SELECT type, pid FROM pipeline_proc_stats'))
+    assert rows
+
+    for row in rows:
+      if row['type'] == 'worker':
+        assert allowed_cpus(row['pid']) == cpu
+      else:
+        assert allowed_cpus(row['pid']) == default
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -194,3 +194,32 @@ def test_postmaster_worker_recovery(pipeline, clean_db):
 
   result = pipeline.execute('SELECT COUNT(*) FROM pipeline_proc_stats WHERE type = \'combiner\'').first()
   assert result['count'] == expected_combiners
+
+def test_crash_recovery_time(pipeline, clean_db):
+  """
+  Verify that with continuous_query_restart_delay = 0, processing resumes
+  right after a worker or combiner is killed
+  """
+  pipeline.stop()
+  try:
+    pipeline.run({'continuous_query_restart_delay': 0})
+
+    q = 'SELECT COUNT(*) FROM stream'
+    pipeline.create_cv('test_crash_recovery_time', q)
+    pipeline.insert('stream', ['x'], [(1, )] * 100)
+
+    for kill in (kill_worker, kill_combiner):
+      assert kill()
+
+      # synchronous inserts return once their events have been combined
+      start = time.time()
+      pipeline.insert('stream', ['x'], [(1, )] * 100)
+      elapsed = time.time() - start
+      print '%s: processing resumed after %.3fs' % (kill.__name__, elapsed)
+      assert elapsed < 1
+
+    result = pipeline.execute('SELECT count FROM test_crash_recovery_time').first()
+    assert result['count'] >= 300
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -2,28 +2,22 @@ import random
 
 from base import pipeline, clean_db
 
-# XXX(usmanm): update this, if it ever changes!
-MAX_CQS = 1024
+# more than the old hard limit of 1024, which the real limit is well above
+NUM_CQS = 1200
 
 def test_create_views(pipeline, clean_db):
   cvs = []
   q = 'SELECT count(*) FROM stream'
 
-  for i in xrange(1, MAX_CQS):
+  for i in xrange(1, NUM_CQS):
     cvs.append('cv_%d' % i)
     pipeline.create_cv(cvs[-1], q)
 
-  try:
-    pipeline.create_cv('cv_fail', q)
-    assert False
-  except Exception, e:
-    assert 'maximum number of continuous views exceeded' in e.message
-
   ids = [r['id'] for r in
          pipeline.execute('SELECT id FROM pipeline_views()')]
 
   assert len(set(ids)) == len(ids)
-  assert set(ids) == set(xrange(1, MAX_CQS))
+  assert set(ids) == set(xrange(1, NUM_CQS))
 
   num_remove = random.randint(128, 512)
 
@@ -33,3 +27,9 @@ def test_create_views(pipeline, clean_db):
   for _ in xrange(num_remove):
     cvs.append('cv_%d' % (len(cvs) + 1))
     pipeline.create_cv(cvs[-1], q)
+
+  # views with ids past the old limit read events like any other
+  pipeline.insert('stream', ('x',), [(i,) for i in xrange(100)])
+
+  for name in (cvs[0], cvs[len(cvs) / 2], cvs[-1]):
+    assert pipeline.execute('SELECT count FROM %s' % name).first()['count'] == 100
@@ -0,0 +1,54 @@
+from base import pipeline, clean_db
+from subprocess import check_output
+
+
+def num_procs(kind):
+  out = check_output('ps aux | grep "%s[0-9] \[pipeline\]" | grep -v grep || true' % kind,
+                     shell=True)
+  return len(filter(lambda s: len(s), out.split('\n')))
+
+
+def test_database_pool_size(pipeline, clean_db):
+  """
+  Verify that a database's own worker and combiner counts are used when its
+  processes are started, and that events are only routed to running workers
+  """
+  assert num_procs('worker') == 2
+  assert num_procs('combiner') == 2
+
+  pipeline.execute('ALTER DATABASE pipeline SET continuous_query_database_num_workers TO 1')
+  pipeline.execute('ALTER DATABASE pipeline SET continuous_query_database_num_combiners TO 1')
+  pipeline.stop()
+  pipeline.run()
+
+  try:
+    assert num_procs('worker') == 1
+    assert num_procs('combiner') == 1
+
+    pipeline.create_stream('pool_stream', k='integer', v='integer')
+    pipeline.create_cv('test_pool', 'SELECT k, COUNT(*), SUM(v) FROM pool_stream GROUP BY k')
+
+    rows = [(k, k) for k in xrange(1000)]
+    for _ in xrange(10):
+      pipeline.insert('pool_stream', ('k', 'v'), rows)
+
+    result = list(pipeline.execute('SELECT * FROM test_pool ORDER BY k'))
+    assert len(result) == 1000
+    for row in result:
+      assert row['count'] == 10
+      assert row['sum'] == 10 * row['k']
+
+    # these can only be set per database
+    try:
+      pipeline.execute('SET continuous_query_database_num_workers TO 2')
+      assert False
+    except Exception, e:
+      pass
+  finally:
+    pipeline.execute('ALTER DATABASE pipeline RESET continuous_query_database_num_workers')
+    pipeline.execute('ALTER DATABASE pipeline RESET continuous_query_database_num_combiners')
+    pipeline.stop()
+    pipeline.run()
+
+  assert num_procs('worker') == 2
+  assert num_procs('combiner') == 2
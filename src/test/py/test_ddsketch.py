@@ -0,0 +1,90 @@
+from base import pipeline, clean_db
+
+
+def test_ddsketch_agg(pipeline, clean_db):
+  """
+  Test ddsketch_agg, ddsketch_merge_agg, ddsketch_cdf, ddsketch_quantile
+  """
+  q = """
+  SELECT k::integer, ddsketch_agg(x::int) AS s FROM test_ddsketch_stream
+  GROUP BY k
+  """
+  desc = ('k', 'x')
+  pipeline.create_cv('test_ddsketch_agg', q)
+
+  rows = []
+  for _ in range(10):
+    for n in range(1, 1001):
+      rows.append((0, n))
+      rows.append((1, n + 500))
+
+  pipeline.insert('test_ddsketch_stream', desc, rows)
+
+  # Quantiles are within 1% of the actual ones
+  result = list(pipeline.execute(
+    'SELECT ddsketch_quantile(s, 0.1) FROM test_ddsketch_agg ORDER BY k')
+                .fetchall())
+  assert len(result) == 2
+  assert abs(result[0]['ddsketch_quantile'] - 100) <= 1
+  assert abs(result[1]['ddsketch_quantile'] - 600) <= 6
+
+  result = list(pipeline.execute(
+    'SELECT ddsketch_quantile(combine(s), 0.1) FROM test_ddsketch_agg')
+                .fetchall())
+  assert len(result) == 1
+  assert abs(result[0]['ddsketch_quantile'] - 200) <= 2
+
+  result = list(pipeline.execute(
+    'SELECT ddsketch_cdf(s, 600) FROM test_ddsketch_agg ORDER BY k')
+                .fetchall())
+  assert len(result) == 2
+  assert round(result[0]['ddsketch_cdf'], 1) == 0.6
+  assert round(result[1]['ddsketch_cdf'], 1) == 0.1
+
+  result = list(pipeline.execute(
+    'SELECT ddsketch_cdf(combine(s), 600) FROM test_ddsketch_agg').fetchall())
+  assert len(result) == 1
+  assert abs(result[0]['ddsketch_cdf'] - 0.35) <= 0.02
+
+
+def test_ddsketch_alpha(pipeline, clean_db):
+  """
+  Verify that a sketch with a lower relative accuracy has fewer buckets
+  """
+  q = """
+  SELECT ddsketch_agg(x::float8) AS s0, ddsketch_agg(x::float8, 0.1) AS s1
+  FROM test_ddsketch_alpha_stream
+  """
+  pipeline.create_cv('test_ddsketch_alpha', q)
+  pipeline.insert('test_ddsketch_alpha_stream', ('x',),
+                  [(float(n),) for n in xrange(1, 10001)])
+
+  result = pipeline.execute(
+    'SELECT octet_length(s0) AS l0, octet_length(s1) AS l1, '
+    'ddsketch_quantile(s1, 0.5) AS m FROM test_ddsketch_alpha').first()
+  assert result['l1'] < result['l0']
+  assert abs(result['m'] - 5000) <= 500
+
+
+def test_ddsketch_type(pipeline, clean_db):
+  pipeline.create_table('test_ddsketch_type', x='int', y='ddsketch')
+  pipeline.execute('INSERT INTO test_ddsketch_type (x, y) VALUES '
+                   '(1, ddsketch_empty()), (2, ddsketch_empty())')
+
+  for i in xrange(1000):
+    pipeline.execute('UPDATE test_ddsketch_type '
+                     'SET y = ddsketch_add(y, {} %% (x * 500))'.format(i))
+
+  result = list(pipeline.execute('SELECT ddsketch_cdf(y, 400), '
+                                 'ddsketch_quantile(y, 0.9) '
+                                 'FROM test_ddsketch_type ORDER BY x'))
+  assert round(result[0][0], 1) == 0.8
+  assert abs(result[0][1] - 449) <= 5
+  assert round(result[1][0], 1) == 0.4
+  assert abs(result[1][1] - 899) <= 9
+
+  try:
+    pipeline.execute('SELECT ddsketch_empty(1.5)')
+    assert False
+  except Exception, e:
+    pass
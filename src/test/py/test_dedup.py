@@ -0,0 +1,79 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_dedup_view(pipeline, clean_db):
+  """
+  Verify that events whose dedup key was seen within the dedup window are dropped
+  """
+  # keys are only remembered by the worker that saw them, so events are routed by their key
+  pipeline.execute("CREATE STREAM dedup_stream (id integer, x integer) OPTIONS (routing_key 'id')")
+  pipeline.create_cv('test_dedup', 'SELECT count(*), sum(x) FROM dedup_stream',
+                     dedup_key='id', dedup_window='1 hour')
+
+  rows = [(n % 100, 1) for n in xrange(1000)]
+  pipeline.insert('dedup_stream', ('id', 'x'), rows)
+  pipeline.insert('dedup_stream', ('id', 'x'), rows)
+
+  row = pipeline.execute('SELECT * FROM test_dedup').first()
+  assert row['count'] == 100
+  assert row['sum'] == 100
+
+  # NULL keys are never duplicates
+  pipeline.insert('dedup_stream', ('x', ), [(1, )] * 10)
+  assert pipeline.execute('SELECT count FROM test_dedup').first()['count'] == 110
+
+
+def test_dedup_window(pipeline, clean_db):
+  """
+  Verify that keys are forgotten once they fall out of the dedup window
+  """
+  pipeline.execute("CREATE STREAM dedup_window_stream (id text) OPTIONS (routing_key 'id')")
+  pipeline.create_cv('test_dedup_window', 'SELECT count(*) FROM dedup_window_stream',
+                     dedup_key='id', dedup_window='1 second')
+
+  pipeline.insert('dedup_window_stream', ('id', ), [('a', ), ('b', ), ('a', )])
+  assert pipeline.execute('SELECT count FROM test_dedup_window').first()['count'] == 2
+
+  time.sleep(3)
+
+  pipeline.insert('dedup_window_stream', ('id', ), [('a', ), ('b', ), ('a', )])
+  assert pipeline.execute('SELECT count FROM test_dedup_window').first()['count'] == 4
+
+
+def test_dedup_transform(pipeline, clean_db):
+  """
+  Verify that transforms can be deduplicated as well, by a column they don't read themselves
+  """
+  pipeline.execute("CREATE STREAM dedup_ct_in (id integer, x integer) OPTIONS (routing_key 'id')")
+  pipeline.create_stream('dedup_ct_out', x='integer')
+  pipeline.execute("""
+  CREATE CONTINUOUS TRANSFORM test_dedup_ct WITH (dedup_key = 'id', dedup_window = '1 hour') AS
+  SELECT x FROM dedup_ct_in THEN EXECUTE PROCEDURE pipeline_stream_insert('dedup_ct_out')
+  """)
+  pipeline.create_cv('test_dedup_ct_count', 'SELECT count(*) FROM dedup_ct_out')
+
+  pipeline.insert('dedup_ct_in', ('id', 'x'), [(n % 10, n) for n in xrange(100)])
+
+  assert pipeline.execute('SELECT count FROM test_dedup_ct_count').first()['count'] == 10
+
+
+def test_invalid_dedup(pipeline, clean_db):
+  """
+  Verify that the dedup key must be a column of the stream, and that both options are required
+  """
+  pipeline.create_stream('dedup_bad_stream', x='integer')
+
+  bad = [
+    {'dedup_key': 'x'},
+    {'dedup_window': '1 minute'},
+    {'dedup_key': 'y', 'dedup_window': '1 minute'},
+    {'dedup_key': 'x', 'dedup_window': '-1 minute'},
+  ]
+
+  for opts in bad:
+    try:
+      pipeline.create_cv('test_dedup_bad', 'SELECT count(*) FROM dedup_bad_stream', **opts)
+      assert False
+    except Exception:
+      pass
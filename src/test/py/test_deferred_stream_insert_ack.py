@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+import getpass
+import psycopg2
+
+
+def test_deferred_stream_insert_ack(pipeline, clean_db):
+  """
+  Verify that deferred stream inserts can be waited on and polled by token
+  """
+  pipeline.create_cv('test_deferred_ack', 'SELECT x::int, COUNT(*) FROM stream GROUP BY x')
+
+  conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' % (getpass.getuser(), pipeline.port))
+  conn.autocommit = True
+  cur = conn.cursor()
+
+  cur.execute('SELECT pipeline_stream_insert_token()')
+  assert cur.fetchone()[0] is None
+
+  cur.execute('SET stream_insert_deferred_ack TO on')
+
+  tokens = []
+  for _ in xrange(10):
+    cur.execute('INSERT INTO stream (x) VALUES %s' % ', '.join('(%d)' % (x % 10) for x in xrange(100)))
+    cur.execute('SELECT pipeline_stream_insert_token()')
+    tokens.append(cur.fetchone()[0])
+
+  assert tokens == sorted(tokens)
+  assert len(set(tokens)) == 10
+
+  cur.execute('SELECT pipeline_wait_for_stream_insert(%d)' % tokens[-1])
+  for token in tokens:
+    cur.execute('SELECT pipeline_stream_insert_acked(%d)' % token)
+    assert cur.fetchone()[0]
+
+  try:
+    cur.execute('SELECT pipeline_stream_insert_acked(%d)' % (tokens[-1] + 1))
+    assert False
+  except psycopg2.DataError, e:
+    assert 'has not been issued by this session' in e.message
+
+  conn.close()
+
+  rows = list(pipeline.execute('SELECT * FROM test_deferred_ack ORDER BY x'))
+  assert len(rows) == 10
+  for row in rows:
+    assert row['count'] == 100
@@ -0,0 +1,69 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_delta_merge(pipeline, clean_db):
+  """
+  Verify that delta-merge continuous views read correctly while their groups are spread
+  across several delta rows, and that compaction merges each group back into a single row
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_delta_compaction_interval': 1000})
+
+  try:
+    pipeline.create_stream('delta_stream', k='integer', v='integer')
+    pipeline.create_cv('test_delta_grouped',
+                       'SELECT k, COUNT(*), SUM(v), AVG(v) FROM delta_stream GROUP BY k',
+                       delta_merge=True)
+    pipeline.create_cv('test_delta_single',
+                       'SELECT COUNT(*), MAX(v) FROM delta_stream', delta_merge=True)
+
+    rows = [(k, k) for k in xrange(100)]
+    for _ in xrange(5):
+      pipeline.insert('delta_stream', ('k', 'v'), rows)
+
+    result = list(pipeline.execute('SELECT * FROM test_delta_grouped ORDER BY k'))
+    assert len(result) == 100
+    for row in result:
+      assert row['count'] == 5
+      assert row['sum'] == 5 * row['k']
+      assert row['avg'] == row['k']
+
+    row = pipeline.execute('SELECT * FROM test_delta_single').first()
+    assert row['count'] == 500
+    assert row['max'] == 99
+
+    # Compaction runs on the first sync after the interval has elapsed
+    time.sleep(2)
+    pipeline.insert('delta_stream', ('k', 'v'), rows)
+
+    row = pipeline.execute('SELECT COUNT(*) FROM test_delta_grouped_mrel').first()
+    assert row['count'] == 100
+
+    row = pipeline.execute('SELECT COUNT(*) FROM test_delta_single_mrel').first()
+    assert row['count'] == 1
+
+    for row in pipeline.execute('SELECT * FROM test_delta_grouped'):
+      assert row['count'] == 6
+      assert row['sum'] == 6 * row['k']
+
+    row = pipeline.execute('SELECT * FROM test_delta_single').first()
+    assert row['count'] == 600
+  finally:
+    pipeline.stop()
+    pipeline.run()
+
+
+def test_delta_merge_unsupported(pipeline, clean_db):
+  """
+  Verify that delta_merge is rejected for queries whose results it can't combine on read
+  """
+  pipeline.create_stream('delta_stream', k='integer', x='timestamptz')
+
+  for q in ["SELECT COUNT(*) FROM delta_stream WHERE arrival_timestamp > clock_timestamp() - interval '1 hour'",
+            'SELECT DISTINCT k FROM delta_stream']:
+    try:
+      pipeline.create_cv('test_delta_unsupported', q, delta_merge=True)
+      assert False
+    except:
+      pass
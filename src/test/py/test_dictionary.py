@@ -0,0 +1,34 @@
+from base import pipeline, clean_db
+
+
+def test_dictionary(pipeline, clean_db):
+  """
+  Verify that views grouping by dictionary-encoded text values only store the ids of the
+  values, and that the ids decode back to the original values
+  """
+  pipeline.create_table('test_dict', id='bigint', value='text')
+  pipeline.execute('CREATE INDEX test_dict_id_idx ON test_dict (id)')
+  pipeline.create_stream('dict_stream', url='text')
+  pipeline.create_cv('test_dict_cv', """
+  SELECT dict_encode('test_dict', url) AS url_id, COUNT(*)
+  FROM dict_stream GROUP BY dict_encode('test_dict', url)
+  """)
+
+  urls = ['http://example.com/%d/%s' % (x, 'x' * 100) for x in xrange(100)]
+  for _ in xrange(5):
+    pipeline.insert('dict_stream', ('url', ), [(u, ) for u in urls for _ in xrange(2)])
+
+  rows = list(pipeline.execute("SELECT dict_decode('test_dict', url_id) AS url, count FROM test_dict_cv ORDER BY url"))
+  assert [row['url'] for row in rows] == sorted(urls)
+  for row in rows:
+    assert row['count'] == 10
+
+  # every value is in the dictionary, possibly more than once if workers added it concurrently
+  row = pipeline.execute('SELECT COUNT(DISTINCT value) FROM test_dict').first()
+  assert row['count'] == 100
+
+  assert pipeline.execute("SELECT dict_decode('test_dict', 0)").first()[0] is None
+
+  # ids are stable across sessions
+  row = pipeline.execute("SELECT dict_encode('test_dict', %r) AS id" % urls[0]).first()
+  assert row['id'] in [r['url_id'] for r in pipeline.execute('SELECT url_id FROM test_dict_cv')]
@@ -39,3 +39,25 @@ def test_distinct(pipeline, clean_db):
 
   for row in result:
     assert row['x'] in reverse_uniques[row['y']]
+
+
+def test_distinct_grows(pipeline, clean_db):
+  """
+  Verify that the distinct filter of a streaming SELECT DISTINCT grows with the number of
+  distinct rows, rather than letting duplicates through once it's full
+  """
+  pipeline.create_cv('test_distinct_grows', 'SELECT DISTINCT x::integer FROM stream')
+
+  batches = 10
+  for i in xrange(batches):
+    values = [(x, ) for x in xrange(i * 10000, (i + 1) * 10000)]
+    pipeline.insert('stream', ['x'], values)
+
+  # every row is new, so only false positives can drop one
+  result = pipeline.execute('SELECT COUNT(*) FROM test_distinct_grows').first()
+  assert batches * 10000 - result['count'] <= 0.02 * batches * 10000
+
+  # and now every row is a duplicate
+  pipeline.insert('stream', ['x'], [(x, ) for x in xrange(0, batches * 10000, 7)])
+  after = pipeline.execute('SELECT COUNT(*) FROM test_distinct_grows').first()
+  assert after['count'] == result['count']
@@ -0,0 +1,67 @@
+from base import pipeline, clean_db
+
+
+def test_downsample(pipeline, clean_db):
+  """
+  Verify that vacuuming the matrel of a downsampled view merges its aged time buckets into
+  coarser ones without changing any of the view's totals
+  """
+  pipeline.create_stream('downsample_stream', x='integer', ts='timestamptz')
+  pipeline.create_cv('test_downsample', """
+  SELECT date_trunc('minute', ts) AS minute, x, COUNT(*), SUM(x), AVG(x), COUNT(DISTINCT x) AS distinct
+  FROM downsample_stream GROUP BY minute, x
+  """, downsample='1 hour: 1 hour, 2 days: 1 day')
+
+  # one event per minute over the last three days, for each x
+  pipeline.execute("""
+  INSERT INTO downsample_stream (x, ts)
+  SELECT x, now() - m * interval '1 minute' FROM generate_series(0, 3 * 24 * 60 - 1) m, generate_series(0, 2) x
+  """)
+
+  def totals():
+    q = 'SELECT x, SUM(count) AS count, SUM(sum) AS sum FROM test_downsample GROUP BY x ORDER BY x'
+    return [tuple(row) for row in pipeline.execute(q)]
+
+  before = totals()
+  nrows = pipeline.execute('SELECT COUNT(*) FROM test_downsample_mrel').first()['count']
+  pipeline.execute('VACUUM test_downsample_mrel')
+
+  assert totals() == before
+  assert pipeline.execute('SELECT COUNT(*) FROM test_downsample_mrel').first()['count'] < nrows / 10
+
+  # rows older than an hour are in hourly buckets, and rows older than two days in daily ones,
+  # give or take the time since the vacuum
+  q = """
+  SELECT COUNT(*) FROM test_downsample WHERE minute < now() - interval '%s' AND
+  date_trunc('%s', minute at time zone 'UTC') <> minute at time zone 'UTC'
+  """
+  assert pipeline.execute(q % ('1 hour 5 minutes', 'hour')).first()['count'] == 0
+  assert pipeline.execute(q % ('2 days 5 minutes', 'day')).first()['count'] == 0
+
+  for row in pipeline.execute('SELECT * FROM test_downsample'):
+    assert row['avg'] == row['x']
+    assert row['distinct'] == 1
+
+
+def test_downsample_invalid(pipeline, clean_db):
+  """
+  Verify that downsample policies must have increasing ages and resolutions, and that
+  downsampled views must group by a timestamp column
+  """
+  pipeline.create_stream('downsample_stream', x='integer', ts='timestamptz')
+
+  q = "SELECT date_trunc('minute', ts) AS minute, x, COUNT(*) FROM downsample_stream GROUP BY minute, x"
+  for policy in ('1 hour', '1 day: 1 hour, 1 hour: 1 minute', '1 day: 1 hour, 2 days: 1 minute',
+                 '1 day: 1 month', '1 day: -1 hour', 'not a policy: 1 hour'):
+    try:
+      pipeline.create_cv('test_downsample_invalid', q, downsample=policy)
+      assert False
+    except Exception:
+      pass
+
+  try:
+    pipeline.create_cv('test_downsample_invalid', 'SELECT x, COUNT(*) FROM downsample_stream GROUP BY x',
+                       downsample='1 day: 1 hour')
+    assert False
+  except Exception:
+    pass
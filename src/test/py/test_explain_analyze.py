@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+import threading
+import time
+
+
+def test_explain_analyze(pipeline, clean_db):
+  """
+  Verify that pipeline_explain_analyze instruments a continuous view's worker
+  and combiner plans while they process batches
+  """
+  pipeline.create_stream('explain_stream', x='integer')
+  pipeline.create_cv('test_explain', 'SELECT x % 10 AS g, COUNT(*) FROM explain_stream GROUP BY g')
+
+  done = threading.Event()
+
+  def insert():
+    while not done.is_set():
+      pipeline.insert('explain_stream', ('x', ), [(x, ) for x in xrange(1000)])
+      time.sleep(0.05)
+
+  t = threading.Thread(target=insert)
+  t.daemon = True
+  t.start()
+
+  try:
+    rows = pipeline.execute("SELECT * FROM pipeline_explain_analyze('test_explain', 3)")
+    lines = [r['pipeline_explain_analyze'] for r in rows]
+  finally:
+    done.set()
+    t.join()
+
+  assert lines[0] == 'Worker plan:'
+  assert 'Combiner plan:' in lines
+
+  combiner = lines.index('Combiner plan:')
+  for plan in (lines[1:combiner], lines[combiner + 1:]):
+    assert plan
+    assert 'actual time' in plan[0]
+    assert 'loops=' in plan[0]
+
+  # Unknown views are rejected
+  try:
+    pipeline.execute("SELECT * FROM pipeline_explain_analyze('test_explain_missing')")
+    assert False
+  except Exception:
+    pass
@@ -0,0 +1,52 @@
+from base import pipeline, clean_db
+
+
+def test_finalize_cache(pipeline, clean_db):
+  """
+  Verify that views with a finalize cache return the same rows as views that finalize on read
+  """
+  q = ('SELECT k, count(*), avg(x), count(DISTINCT x), '
+       'percentile_cont(0.5) WITHIN GROUP (ORDER BY x) FROM finalize_stream GROUP BY k')
+  pipeline.create_stream('finalize_stream', k='integer', x='integer')
+  pipeline.create_cv('test_finalize_cached', q, finalize_cache=True)
+  pipeline.create_cv('test_finalize_uncached', q)
+
+  def check():
+    cached = list(pipeline.execute('SELECT * FROM test_finalize_cached ORDER BY k'))
+    uncached = list(pipeline.execute('SELECT * FROM test_finalize_uncached ORDER BY k'))
+    assert len(cached) == len(uncached)
+    for c, u in zip(cached, uncached):
+      assert c == u
+
+  pipeline.insert('finalize_stream', ('k', 'x'), [(n % 10, n) for n in xrange(1000)])
+  check()
+
+  # only some groups change, so the others keep their cached values
+  pipeline.insert('finalize_stream', ('k', 'x'), [(n % 3, n * 7) for n in xrange(1000)])
+  check()
+
+  # the finalized values are materialized next to the aggregate states
+  row = pipeline.execute('SELECT * FROM test_finalize_cached_mrel WHERE k = 0').first()
+  assert row['$final_3'] == pipeline.execute(
+    'SELECT avg FROM test_finalize_uncached WHERE k = 0').first()['avg']
+
+
+def test_finalize_cache_validation(pipeline, clean_db):
+  """
+  Verify that views combining several matrel rows on read can't have a finalize cache
+  """
+  pipeline.create_stream('finalize_bad_stream', x='integer')
+
+  bad = [
+    ('SELECT count(*) FROM finalize_bad_stream', {'finalize_cache': True, 'delta_merge': True}),
+    ('SELECT count(*) FROM finalize_bad_stream', {'finalize_cache': True, 'max_age': '1 minute'}),
+    ("SELECT count(*) FROM finalize_bad_stream WHERE arrival_timestamp > clock_timestamp() - interval '1 hour'",
+     {'finalize_cache': True}),
+  ]
+
+  for q, opts in bad:
+    try:
+      pipeline.create_cv('test_finalize_bad', q, **opts)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+import random
+
+
+def test_first_values_and_keyed_min_max(pipeline, clean_db):
+  """
+  Verify first_values, keyed_min and keyed_max over many more rows than values kept,
+  for both fixed-width and variable-width keys and values
+  """
+  q = """
+  SELECT k::integer,
+  first_values(5) WITHIN GROUP (ORDER BY x::integer) AS f0,
+  first_values(3) WITHIN GROUP (ORDER BY s::text, x) AS f1,
+  keyed_min(x, s) AS kmin, keyed_max(x, s) AS kmax,
+  keyed_min(s, x) AS skmin, keyed_max(s, x) AS skmax
+  FROM test_fv_stream GROUP BY k
+  """
+  pipeline.create_cv('test_first_values', q)
+
+  rows = []
+  for n in xrange(5000):
+    x = random.randint(0, 100000)
+    rows.append((n % 4, x, 'v%d' % x))
+
+  pipeline.insert('test_fv_stream', ('k', 'x', 's'), rows)
+
+  result = list(pipeline.execute('SELECT * FROM test_first_values ORDER BY k'))
+  assert len(result) == 4
+
+  for r in result:
+    group = [row for row in rows if row[0] == r['k']]
+    xs = sorted(row[1] for row in group)
+    assert r['f0'] == xs[:5]
+
+    by_x = sorted(group, key=lambda row: row[1])
+    assert r['kmin'] == by_x[0][2]
+    assert r['kmax'] == by_x[-1][2]
+
+    by_s = sorted(group, key=lambda row: row[2])
+    assert r['skmin'] == by_s[0][1]
+    assert r['skmax'] == by_s[-1][1]
+
+  result = pipeline.execute(
+    'SELECT combine(f0) AS f0, combine(kmin) AS kmin FROM test_first_values').first()
+  assert result['f0'] == sorted(row[1] for row in rows)[:5]
+  assert result['kmin'] == min(rows, key=lambda row: row[1])[2]
@@ -0,0 +1,67 @@
+from base import pipeline, clean_db
+
+
+def test_freeze_after(pipeline, clean_db):
+  """
+  Verify that time buckets of a view with freeze_after stop taking events once the watermark
+  has passed them, and that vacuuming the matrel compacts their rows without changing them
+  """
+  pipeline.create_stream('freeze_stream', x='integer', s='text', ts='timestamptz')
+  pipeline.create_cv('test_freeze',
+                     "SELECT date_trunc('minute', ts) AS minute, x, COUNT(*), string_agg(s, ',') FROM freeze_stream GROUP BY minute, x",
+                     freeze_after='5 minutes')
+
+  def insert(age):
+    pipeline.execute("""
+    INSERT INTO freeze_stream (x, s, ts)
+    SELECT x %% 10, repeat('a', 10), now() - interval '%s' FROM generate_series(1, 1000) x
+    """ % age)
+
+  # the watermark hasn't moved yet, so this bucket is still open
+  insert('1 hour')
+
+  # this moves the watermark to the current bucket and freezes the one above
+  insert('0 seconds')
+
+  insert('1 hour')
+  insert('1 minute')
+
+  q = """
+  SELECT x, SUM(count) AS count FROM test_freeze
+  WHERE minute < now() - interval '5 minutes' GROUP BY x ORDER BY x
+  """
+  result = list(pipeline.execute(q))
+  assert len(result) == 10
+  for row in result:
+    assert row['count'] == 100
+
+  result = list(pipeline.execute('SELECT x, SUM(count) AS count FROM test_freeze GROUP BY x ORDER BY x'))
+  assert len(result) == 10
+  for row in result:
+    assert row['count'] == 300
+
+  size = "SELECT SUM(pg_column_size(m.*)) AS size FROM test_freeze_mrel m WHERE minute < now() - interval '5 minutes'"
+  before = pipeline.execute(size).first()['size']
+  pipeline.execute('VACUUM test_freeze_mrel')
+  after = pipeline.execute(size).first()['size']
+  assert after < before
+
+  result = list(pipeline.execute("SELECT * FROM test_freeze WHERE minute < now() - interval '5 minutes' ORDER BY x"))
+  assert len(result) == 10
+  for row in result:
+    assert row['count'] == 100
+    assert row['string_agg'] == ','.join(['a' * 10] * 100)
+
+
+def test_freeze_after_requires_time_bucket(pipeline, clean_db):
+  """
+  Verify that freeze_after can only be given for views grouping by a timestamp column
+  """
+  pipeline.create_stream('freeze_stream', x='integer')
+
+  try:
+    pipeline.create_cv('test_freeze_no_bucket', 'SELECT x, COUNT(*) FROM freeze_stream GROUP BY x',
+                       freeze_after='5 minutes')
+    assert False
+  except Exception, e:
+    assert '"freeze_after" requires grouping by a timestamp column' in e.message
@@ -0,0 +1,45 @@
+from base import pipeline, clean_db
+
+
+def test_group_filter(pipeline, clean_db):
+  """
+  Verify that groups ruled out by combiners' group filters are still merged with their
+  on-disk rows once they exist
+  """
+  pipeline.create_stream('group_filter_stream', x='integer')
+  pipeline.create_cv('test_group_filter', 'SELECT x, COUNT(*) FROM group_filter_stream GROUP BY x')
+
+  pipeline.insert('group_filter_stream', ('x', ), [(x, ) for x in xrange(1000)])
+  pipeline.insert('group_filter_stream', ('x', ), [(x, ) for x in xrange(500, 1500)])
+  pipeline.insert('group_filter_stream', ('x', ), [(x, ) for x in xrange(1500)])
+
+  rows = list(pipeline.execute('SELECT x, count FROM test_group_filter ORDER BY x'))
+  assert len(rows) == 1500
+  for row in rows:
+    expected = 3 if 500 <= row['x'] < 1000 else 2
+    assert row['count'] == expected
+
+
+def test_group_filter_combine_table(pipeline, clean_db):
+  """
+  Verify that groups inserted by pipeline_combine_table aren't ruled out by group filters
+  """
+  pipeline.create_stream('group_filter_stream', x='integer')
+  pipeline.create_cv('test_group_filter_ct', 'SELECT x, COUNT(*) FROM group_filter_stream GROUP BY x')
+  pipeline.create_stream('group_filter_src_stream', x='integer')
+  pipeline.create_cv('test_group_filter_src', 'SELECT x, COUNT(*) FROM group_filter_src_stream GROUP BY x')
+
+  pipeline.insert('group_filter_stream', ('x', ), [(x, ) for x in xrange(100)])
+  pipeline.insert('group_filter_src_stream', ('x', ), [(x, ) for x in xrange(100, 200)])
+
+  pipeline.execute('SELECT * INTO test_group_filter_tmp FROM test_group_filter_src_mrel')
+  pipeline.execute("SELECT pipeline_combine_table('test_group_filter_ct', 'test_group_filter_tmp')")
+
+  pipeline.insert('group_filter_stream', ('x', ), [(x, ) for x in xrange(200)])
+
+  rows = list(pipeline.execute('SELECT x, count FROM test_group_filter_ct ORDER BY x'))
+  assert len(rows) == 200
+  for row in rows:
+    assert row['count'] == 2
+
+  pipeline.execute('DROP TABLE test_group_filter_tmp')
@@ -0,0 +1,25 @@
+from base import pipeline, clean_db
+
+
+def test_group_index_lookup(pipeline, clean_db):
+  """
+  Verify that existing groups looked up through the group hash index are updated in place
+  rather than duplicated, for both plain and locality-sensitive group hashes
+  """
+  pipeline.create_stream('group_lookup_stream', k='text', ts='timestamptz', v='integer')
+  pipeline.create_cv('test_group_lookup_text',
+                     'SELECT k, COUNT(*), SUM(v) FROM group_lookup_stream GROUP BY k')
+  pipeline.create_cv('test_group_lookup_ts',
+                     "SELECT date_trunc('minute', ts) AS m, k, COUNT(*) FROM group_lookup_stream GROUP BY m, k")
+
+  rows = [('k%d' % (i % 500), '2016-01-01 00:%02d:00' % (i % 60), 1) for i in xrange(3000)]
+  for _ in xrange(5):
+    pipeline.insert('group_lookup_stream', ('k', 'ts', 'v'), rows)
+
+  row = pipeline.execute('SELECT COUNT(*), SUM(count), SUM(sum) FROM test_group_lookup_text').first()
+  assert row['count'] == 500
+  assert row['sum'] == 5 * 3000
+
+  row = pipeline.execute('SELECT COUNT(*), SUM(count) FROM test_group_lookup_ts').first()
+  assert row['count'] == len(set((r[0], r[1]) for r in rows))
+  assert row['sum'] == 5 * 3000
@@ -83,3 +83,103 @@ def test_hll_type(pipeline, clean_db):
                                  'FROM test_hll_type ORDER BY x'))
   assert result[0][0] == 995
   assert result[1][0] == 497
+
+def test_hll_dense_union(pipeline, clean_db):
+  """
+  Verify that unions of dense HLLs keep the greatest of each of their registers
+  """
+  pipeline.create_cv('test_hll_dense_union',
+                     'SELECT k::integer, hll_agg(x::integer) FROM test_hll_stream GROUP BY k')
+
+  # every group overlaps with the next one, and has enough values to be dense
+  rows = []
+  for k in xrange(10):
+    for x in xrange(k * 5000, k * 5000 + 10000):
+      rows.append((k, x))
+
+  pipeline.insert('test_hll_stream', ('k', 'x'), rows)
+
+  row = pipeline.execute('SELECT hll_cardinality(hll_union_agg(hll_agg)) FROM test_hll_dense_union').first()
+  assert abs(row[0] - 55000) < 55000 * 0.02
+
+  # a union with a subset of its registers doesn't change anything
+  row = pipeline.execute("""
+  SELECT hll_cardinality(hll_union_agg(hll_agg)) FROM test_hll_dense_union WHERE k < 5
+  """).first()
+  subset = pipeline.execute("""
+  SELECT hll_cardinality(hll_union_agg(hll_agg)) FROM
+  (SELECT hll_agg FROM test_hll_dense_union WHERE k < 5
+  UNION ALL SELECT hll_agg FROM test_hll_dense_union WHERE k < 3) s
+  """).first()
+  assert row[0] == subset[0]
+
+def test_hll_agg_batched_adds(pipeline, clean_db):
+  """
+  Verify that HLLs built by adding their elements in batches match the ones built by adding
+  them one at a time, whatever representation they end up in
+  """
+  pipeline.create_cv('test_hll_batched',
+                     'SELECT k::integer, hll_agg(x::integer), COUNT(DISTINCT x::integer) FROM test_hll_stream GROUP BY k')
+
+  # groups ending up in the explicit, sparse and dense representations
+  sizes = [10, 1000, 100000]
+  rows = []
+  for k, n in enumerate(sizes):
+    for x in xrange(n):
+      rows.append((k, x))
+
+  pipeline.insert('test_hll_stream', ('k', 'x'), rows)
+
+  for k, n in enumerate(sizes):
+    # window aggregates add their elements one at a time
+    expected = pipeline.execute("""
+    SELECT hll_cardinality(h) FROM
+    (SELECT hll_agg(x) OVER (ORDER BY x) AS h, x FROM generate_series(0, %d) x) s
+    WHERE x = %d
+    """ % (n - 1, n - 1)).first()[0]
+
+    row = pipeline.execute('SELECT hll_cardinality(hll_agg), count FROM test_hll_batched WHERE k = %d' % k).first()
+    assert row[0] == expected
+    assert row[1] == expected
+
+    row = pipeline.execute('SELECT hll_cardinality(hll_agg(x)) FROM generate_series(0, %d) x' % (n - 1)).first()
+    assert row[0] == expected
+
+def test_hll_agg_precision(pipeline, clean_db):
+  """
+  Verify that the precision given to hll_agg is kept when its states are combined, that HLLs
+  of different precisions are combined at the lower one, and that low cardinality states are
+  stored compactly
+  """
+  pipeline.create_cv('test_hll_p',
+                     'SELECT k::integer, hll_agg(x::integer, 10) AS p10, hll_agg(x::integer, 14) AS p14 FROM test_hll_stream GROUP BY k')
+
+  rows = []
+  for k in xrange(4):
+    for x in xrange(10 ** k):
+      rows.append((k, x))
+
+  pipeline.insert('test_hll_stream', ('k', 'x'), rows)
+  pipeline.insert('test_hll_stream', ('k', 'x'), rows)
+
+  result = list(pipeline.execute('SELECT hll_print(p10) FROM test_hll_p ORDER BY k'))
+  assert len(result) == 4
+  for row in result:
+    assert 'p = 10' in row[0]
+
+  for k in xrange(4):
+    expected = pipeline.execute('SELECT hll_cardinality(hll_agg(x, 10)) FROM generate_series(0, %d) x' % (10 ** k - 1)).first()[0]
+
+    row = pipeline.execute('SELECT hll_cardinality(p10) FROM test_hll_p WHERE k = %d' % k).first()
+    assert row[0] == expected
+
+    # p = 14 states are folded down to p = 10 whichever side of the union they're on
+    for q in ['SELECT p10 AS h FROM test_hll_p WHERE k = %d UNION ALL SELECT p14 FROM test_hll_p WHERE k = %d',
+              'SELECT p14 AS h FROM test_hll_p WHERE k = %d UNION ALL SELECT p10 FROM test_hll_p WHERE k = %d']:
+      row = pipeline.execute('SELECT hll_print(hll_union_agg(h)), hll_cardinality(hll_union_agg(h)) FROM (%s) s' % (q % (k, k))).first()
+      assert 'p = 10' in row[0]
+      assert row[1] == expected
+
+  # a handful of registers takes a few bytes each
+  row = pipeline.execute('SELECT pg_column_size(p14) FROM test_hll_p WHERE k = 1').first()
+  assert row[0] < 4 * 10 + 32
@@ -0,0 +1,43 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_hot_groups(pipeline, clean_db):
+  """
+  Verify that partial results of groups appearing in most batches are held and combined
+  by workers without holding other groups' partial results, and still reach combiners
+  """
+  pipeline.stop()
+  pipeline.run({'synchronous_stream_insert': 'off',
+                'continuous_query_worker_hot_group_threshold': 50,
+                'continuous_query_worker_partials_max_wait': 500})
+
+  try:
+    pipeline.create_stream('hot_stream', x='integer', y='integer')
+    pipeline.create_cv('test_hot_grouped',
+                       'SELECT x, COUNT(*), SUM(y), COUNT(DISTINCT y) AS d FROM hot_stream GROUP BY x')
+    pipeline.create_cv('test_hot_total', 'SELECT COUNT(*), MAX(y) FROM hot_stream')
+
+    # group 0 appears in every batch, while each other group only appears in a few of them
+    for i in xrange(100):
+      rows = [(0, n % 20) for n in xrange(50)] + [(1 + i % 25, i)]
+      pipeline.insert('hot_stream', ('x', 'y'), rows)
+
+    time.sleep(3)
+
+    rows = list(pipeline.execute('SELECT * FROM test_hot_grouped ORDER BY x'))
+    assert len(rows) == 26
+    assert rows[0]['count'] == 100 * 50
+    assert rows[0]['sum'] == 100 * sum(n % 20 for n in xrange(50))
+    assert rows[0]['d'] == 20
+
+    for row in rows[1:]:
+      assert row['count'] == 4
+      assert row['d'] == 4
+
+    row = pipeline.execute('SELECT * FROM test_hot_total').first()
+    assert row['count'] == 100 * 51
+    assert row['max'] == 99
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+import random
+
+
+def test_inline_transitions(pipeline, clean_db):
+  """
+  Verify that the aggregates whose transition functions are run inline get the right results in
+  continuous views, including for NULL inputs
+  """
+  pipeline.create_stream('inline_stream', k='integer', i='integer', b='bigint', ts='timestamptz')
+  q = """
+  SELECT k, count(*), count(i) AS count_i, sum(i), min(i) AS min_i, max(i) AS max_i,
+  min(b) AS min_b, max(b) AS max_b, min(ts) AS min_ts, max(ts) AS max_ts FROM %s GROUP BY k
+  """
+  pipeline.create_cv('test_inline_transitions', q % 'inline_stream')
+  pipeline.create_table('inline_table', k='integer', i='integer', b='bigint', ts='timestamptz')
+
+  rows = []
+  for n in xrange(2000):
+    i = random.randint(-2 ** 31, 2 ** 31 - 1) if n % 7 else None
+    b = int(random.randint(-2 ** 63, 2 ** 63 - 1)) if n % 5 else None
+    ts = '2016-01-01 00:00:00+00' if n % 3 else '2016-%02d-01 00:00:00+00' % random.randint(1, 12)
+    rows.append((n % 10, i, b, ts))
+
+  pipeline.insert('inline_stream', ('k', 'i', 'b', 'ts'), rows)
+  pipeline.insert('inline_table', ('k', 'i', 'b', 'ts'), rows)
+
+  result = list(pipeline.execute('SELECT * FROM test_inline_transitions ORDER BY k'))
+  assert len(result) == 10
+
+  for row in result:
+    group = [r for r in rows if r[0] == row['k']]
+    i = [r[1] for r in group if r[1] is not None]
+    b = [r[2] for r in group if r[2] is not None]
+
+    assert row['count'] == len(group)
+    assert row['count_i'] == len(i)
+    assert row['sum'] == sum(i)
+    assert row['min_i'] == min(i)
+    assert row['max_i'] == max(i)
+    assert row['min_b'] == min(b)
+    assert row['max_b'] == max(b)
+
+  # timestamps are compared with what the same aggregates give over a table
+  expected = list(pipeline.execute('SELECT k, min(ts) AS min_ts, max(ts) AS max_ts FROM inline_table GROUP BY k ORDER BY k'))
+  assert [(r['min_ts'], r['max_ts']) for r in result] == [(r['min_ts'], r['max_ts']) for r in expected]
@@ -0,0 +1,84 @@
+from base import pipeline, clean_db
+
+
+def test_inplace_updates(pipeline, clean_db):
+  """
+  Verify that groups whose changed columns are all fixed-width and non-indexed are
+  overwritten in place, and that others still get new tuple versions
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_combiner_inplace_updates': 'on'})
+
+  try:
+    pipeline.create_stream('inplace_stream', k='integer', v='integer')
+    pipeline.create_cv('test_inplace_fixed',
+                       'SELECT k, COUNT(*), SUM(v) FROM inplace_stream GROUP BY k')
+    pipeline.create_cv('test_inplace_varlena',
+                       'SELECT k, COUNT(*), AVG(v) FROM inplace_stream GROUP BY k')
+
+    rows = [(k, k) for k in xrange(100)]
+    pipeline.insert('inplace_stream', ('k', 'v'), rows)
+
+    fixed = dict((r['k'], r['ctid']) for r in pipeline.execute('SELECT k, ctid FROM test_inplace_fixed_mrel'))
+    varlena = dict((r['k'], r['ctid']) for r in pipeline.execute('SELECT k, ctid FROM test_inplace_varlena_mrel'))
+    assert len(fixed) == 100
+    assert len(varlena) == 100
+
+    for _ in xrange(5):
+      pipeline.insert('inplace_stream', ('k', 'v'), rows)
+
+    for row in pipeline.execute('SELECT k, ctid FROM test_inplace_fixed_mrel'):
+      assert row['ctid'] == fixed[row['k']]
+
+    for row in pipeline.execute('SELECT k, ctid FROM test_inplace_varlena_mrel'):
+      assert row['ctid'] != varlena[row['k']]
+
+    for row in pipeline.execute('SELECT * FROM test_inplace_fixed'):
+      assert row['count'] == 6
+      assert row['sum'] == 6 * row['k']
+
+    for row in pipeline.execute('SELECT * FROM test_inplace_varlena'):
+      assert row['count'] == 6
+      assert row['avg'] == row['k']
+  finally:
+    pipeline.stop()
+    pipeline.run()
+
+
+def test_inplace_external_sketches(pipeline, clean_db):
+  """
+  Verify that sketch columns are stored out-of-line when in-place updates are enabled, and
+  that overwriting their changed chunks keeps both the group in place and the sketch correct
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_combiner_inplace_updates': 'on'})
+
+  try:
+    pipeline.create_stream('inplace_sketch_stream', k='integer', v='integer')
+    pipeline.create_cv('test_inplace_sketch',
+                       'SELECT k, COUNT(*), bloom_agg(v) FROM inplace_sketch_stream GROUP BY k')
+
+    row = pipeline.execute("""SELECT attstorage FROM pg_attribute
+                              WHERE attrelid = 'test_inplace_sketch_mrel'::regclass AND attname = 'bloom_agg'""").first()
+    assert row['attstorage'] == 'e'
+
+    pipeline.insert('inplace_sketch_stream', ('k', 'v'), [(k, k) for k in xrange(10)])
+    ctids = dict((r['k'], r['ctid']) for r in pipeline.execute('SELECT k, ctid FROM test_inplace_sketch_mrel'))
+    assert len(ctids) == 10
+
+    for i in xrange(1, 6):
+      pipeline.insert('inplace_sketch_stream', ('k', 'v'), [(k, k + 100 * i) for k in xrange(10)])
+
+    for row in pipeline.execute('SELECT k, ctid FROM test_inplace_sketch_mrel'):
+      assert row['ctid'] == ctids[row['k']]
+
+    for row in pipeline.execute('SELECT k, count, bloom_cardinality(bloom_agg) AS card FROM test_inplace_sketch'):
+      assert row['count'] == 6
+      assert abs(row['card'] - 6) <= 1
+      for i in xrange(6):
+        contains = pipeline.execute('SELECT bloom_contains(bloom_agg, %d) FROM test_inplace_sketch WHERE k = %d' %
+                                    (row['k'] + 100 * i, row['k'])).first()
+        assert contains['bloom_contains']
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,27 @@
+from base import pipeline, clean_db
+
+
+def test_insert_waits(pipeline, clean_db):
+  """
+  Verify that pipeline_insert_waits reports the worker queue locks and acks
+  that the current session's synchronous stream inserts waited for
+  """
+  pipeline.create_stream('insert_waits_stream', x='integer')
+  pipeline.create_cv('test_insert_waits', 'SELECT count(*) FROM insert_waits_stream')
+
+  conn = pipeline.engine.connect()
+  before = conn.execute('SELECT * FROM pipeline_insert_waits()').first()
+
+  for _ in xrange(10):
+    conn.execute('INSERT INTO insert_waits_stream (x) SELECT x FROM generate_series(1, 100) x')
+
+  after = conn.execute('SELECT * FROM pipeline_insert_waits()').first()
+  conn.close()
+
+  assert after['queue_locks'] - before['queue_locks'] >= 10
+  assert after['queue_lock_misses'] >= before['queue_lock_misses']
+  assert after['ack_waits'] - before['ack_waits'] >= 10
+  assert after['ack_wait_time'] > before['ack_wait_time']
+
+  count = pipeline.execute('SELECT count FROM test_insert_waits').first()['count']
+  assert count == 1000
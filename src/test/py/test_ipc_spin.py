@@ -0,0 +1,22 @@
+from base import pipeline, clean_db
+
+
+def test_spinning_consumers(pipeline, clean_db):
+  """
+  Verify that consumers spinning on their queues instead of sleeping on their latches
+  don't miss any events
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_ipc_spin_time': '100'})
+
+  try:
+    pipeline.create_cv('test_spin', 'SELECT COUNT(*) FROM stream')
+
+    for i in xrange(100):
+      pipeline.insert('stream', ('x', ), [(i, )] * 10)
+
+    rows = list(pipeline.execute('SELECT * FROM test_spin'))
+    assert rows[0]['count'] == 1000
+  finally:
+    pipeline.stop()
+    pipeline.run()
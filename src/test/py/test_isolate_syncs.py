@@ -0,0 +1,24 @@
+from base import pipeline, clean_db
+
+
+def test_isolate_syncs(pipeline, clean_db):
+  """
+  Verify that a view whose syncs fail doesn't roll back the rows that other views synced in
+  the same combiner transaction
+  """
+  pipeline.create_stream('isolate_stream', x='integer', y='integer')
+  pipeline.create_cv('test_isolate_ok', 'SELECT x, COUNT(*) FROM isolate_stream GROUP BY x')
+  pipeline.create_cv('test_isolate_bad', 'SELECT x, MAX(y) FROM isolate_stream GROUP BY x')
+
+  # every group of the failing view has the same max, so its combiners violate this index
+  pipeline.execute('CREATE UNIQUE INDEX test_isolate_bad_max ON test_isolate_bad_mrel (max)')
+
+  for _ in xrange(5):
+    pipeline.insert('isolate_stream', ('x', 'y'), [(x % 100, 1) for x in xrange(1000)])
+
+  rows = list(pipeline.execute('SELECT x, count FROM test_isolate_ok ORDER BY x'))
+  assert len(rows) == 100
+  for row in rows:
+    assert row['count'] == 50
+
+  assert pipeline.execute('SELECT COUNT(*) FROM test_isolate_bad').first()['count'] <= 2
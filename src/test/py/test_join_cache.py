@@ -0,0 +1,84 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_join_cache(pipeline, clean_db):
+  """
+  Verify that hash tables kept for stream-table joins are rebuilt once the table they
+  were built over is modified or altered
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_join_cache_max_age': 60000,
+                'continuous_query_max_wait': 5})
+
+  try:
+    pipeline.create_table('join_cache_dim', k='integer', v='integer')
+    pipeline.insert('join_cache_dim', ('k', 'v'), [(k, k) for k in xrange(1000)])
+    pipeline.execute('ANALYZE join_cache_dim')
+
+    pipeline.create_stream('join_cache_stream', k='integer')
+    pipeline.create_cv('test_join_cache',
+                       'SELECT COUNT(*), SUM(d.v) FROM join_cache_stream s JOIN join_cache_dim d ON s.k = d.k')
+
+    for _ in xrange(10):
+      pipeline.insert('join_cache_stream', ('k', ), [(k, ) for k in xrange(0, 1000, 10)])
+
+    row = pipeline.execute('SELECT * FROM test_join_cache').first()
+    assert row['count'] == 1000
+    assert row['sum'] == 10 * sum(xrange(0, 1000, 10))
+
+    # Data changes are noticed through the stats collector, so give them time to show up
+    pipeline.execute('UPDATE join_cache_dim SET v = v + 1')
+    time.sleep(3)
+
+    pipeline.insert('join_cache_stream', ('k', ), [(k, ) for k in xrange(0, 1000, 10)])
+
+    row = pipeline.execute('SELECT * FROM test_join_cache').first()
+    assert row['count'] == 1100
+    assert row['sum'] == 10 * sum(xrange(0, 1000, 10)) + sum(xrange(1, 1001, 10))
+
+    # Schema changes are noticed right away
+    pipeline.execute('TRUNCATE join_cache_dim')
+    pipeline.insert('join_cache_stream', ('k', ), [(k, ) for k in xrange(0, 1000, 10)])
+
+    row = pipeline.execute('SELECT * FROM test_join_cache').first()
+    assert row['count'] == 1100
+  finally:
+    pipeline.stop()
+    pipeline.run()
+
+
+def test_subquery_cache(pipeline, clean_db):
+  """
+  Verify that the results of uncorrelated subqueries over tables are kept across batches
+  and computed again once the table they read is modified
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_join_cache_max_age': 60000,
+                'continuous_query_max_wait': 5})
+
+  try:
+    pipeline.create_table('subquery_cache_threshold', v='integer')
+    pipeline.insert('subquery_cache_threshold', ('v', ), [(50, )])
+
+    pipeline.create_stream('subquery_cache_stream', x='integer')
+    pipeline.create_cv('test_subquery_cache',
+                       'SELECT COUNT(*) FROM subquery_cache_stream WHERE x >= (SELECT max(v) FROM subquery_cache_threshold)')
+
+    for _ in xrange(10):
+      pipeline.insert('subquery_cache_stream', ('x', ), [(x, ) for x in xrange(100)])
+
+    row = pipeline.execute('SELECT * FROM test_subquery_cache').first()
+    assert row['count'] == 500
+
+    # Data changes are noticed through the stats collector, so give them time to show up
+    pipeline.execute('UPDATE subquery_cache_threshold SET v = 90')
+    time.sleep(3)
+
+    pipeline.insert('subquery_cache_stream', ('x', ), [(x, ) for x in xrange(100)])
+
+    row = pipeline.execute('SELECT * FROM test_subquery_cache').first()
+    assert row['count'] == 510
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,40 @@
+from base import pipeline, clean_db
+import json
+
+
+def test_json_object_int_sum(pipeline, clean_db):
+  """
+  Verify that json_object_int_sum keeps separate sums for each group across many batches,
+  and that its sums combine
+  """
+  q = """
+  SELECT k::integer, json_object_int_sum(payload::text) FROM test_jois_stream GROUP BY k
+  """
+  pipeline.create_cv('test_jois', q)
+
+  expected = {}
+  for b in xrange(10):
+    rows = []
+    for n in xrange(1000):
+      k = n % 3
+      tags = {'tag%d' % (n % 50): 1, 'quote"%d' % (n % 7): n}
+      rows.append((k, json.dumps(tags)))
+      sums = expected.setdefault(k, {})
+      for tag, v in tags.items():
+        sums[tag] = sums.get(tag, 0) + v
+    pipeline.insert('test_jois_stream', ('k', 'payload'), rows)
+
+  result = list(pipeline.execute(
+    'SELECT k, json_object_int_sum::text AS s FROM test_jois ORDER BY k'))
+  assert len(result) == 3
+  for r in result:
+    assert json.loads(r['s']) == expected[r['k']]
+
+  total = {}
+  for sums in expected.values():
+    for tag, v in sums.items():
+      total[tag] = total.get(tag, 0) + v
+
+  result = pipeline.execute(
+    'SELECT combine(json_object_int_sum)::text AS s FROM test_jois').first()
+  assert json.loads(result['s']) == total
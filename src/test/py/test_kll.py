@@ -0,0 +1,90 @@
+from base import pipeline, clean_db
+
+
+def test_kll_agg(pipeline, clean_db):
+  """
+  Test kll_agg, kll_merge_agg, kll_cdf, kll_quantile
+  """
+  q = """
+  SELECT k::integer, kll_agg(x::int) AS s FROM test_kll_stream
+  GROUP BY k
+  """
+  desc = ('k', 'x')
+  pipeline.create_cv('test_kll_agg', q)
+
+  rows = []
+  for _ in range(10):
+    for n in range(1, 1001):
+      rows.append((0, n))
+      rows.append((1, n + 500))
+
+  pipeline.insert('test_kll_stream', desc, rows)
+
+  # Ranks are within about 2% of the actual ones
+  result = list(pipeline.execute(
+    'SELECT kll_quantile(s, 0.1) FROM test_kll_agg ORDER BY k')
+                .fetchall())
+  assert len(result) == 2
+  assert abs(result[0]['kll_quantile'] - 100) <= 20
+  assert abs(result[1]['kll_quantile'] - 600) <= 20
+
+  result = list(pipeline.execute(
+    'SELECT kll_quantile(combine(s), 0.1) FROM test_kll_agg')
+                .fetchall())
+  assert len(result) == 1
+  assert abs(result[0]['kll_quantile'] - 200) <= 40
+
+  result = list(pipeline.execute(
+    'SELECT kll_cdf(s, 600) FROM test_kll_agg ORDER BY k')
+                .fetchall())
+  assert len(result) == 2
+  assert round(result[0]['kll_cdf'], 1) == 0.6
+  assert round(result[1]['kll_cdf'], 1) == 0.1
+
+  result = list(pipeline.execute(
+    'SELECT kll_cdf(combine(s), 600) FROM test_kll_agg').fetchall())
+  assert len(result) == 1
+  assert abs(result[0]['kll_cdf'] - 0.35) <= 0.02
+
+
+def test_kll_k(pipeline, clean_db):
+  """
+  Verify that a sketch with a smaller k keeps fewer items
+  """
+  q = """
+  SELECT kll_agg(x::float8) AS s0, kll_agg(x::float8, 50) AS s1
+  FROM test_kll_k_stream
+  """
+  pipeline.create_cv('test_kll_k', q)
+  pipeline.insert('test_kll_k_stream', ('x',),
+                  [(float(n),) for n in xrange(1, 10001)])
+
+  result = pipeline.execute(
+    'SELECT octet_length(s0) AS l0, octet_length(s1) AS l1, '
+    'kll_quantile(s1, 0.5) AS m FROM test_kll_k').first()
+  assert result['l1'] < result['l0']
+  assert abs(result['m'] - 5000) <= 1000
+
+
+def test_kll_type(pipeline, clean_db):
+  pipeline.create_table('test_kll_type', x='int', y='kll')
+  pipeline.execute('INSERT INTO test_kll_type (x, y) VALUES '
+                   '(1, kll_empty()), (2, kll_empty())')
+
+  for i in xrange(1000):
+    pipeline.execute('UPDATE test_kll_type '
+                     'SET y = kll_add(y, {} %% (x * 500))'.format(i))
+
+  result = list(pipeline.execute('SELECT kll_cdf(y, 400), '
+                                 'kll_quantile(y, 0.9) '
+                                 'FROM test_kll_type ORDER BY x'))
+  assert round(result[0][0], 1) == 0.8
+  assert abs(result[0][1] - 449) <= 20
+  assert round(result[1][0], 1) == 0.4
+  assert abs(result[1][1] - 899) <= 40
+
+  try:
+    pipeline.execute('SELECT kll_empty(0)')
+    assert False
+  except Exception, e:
+    pass
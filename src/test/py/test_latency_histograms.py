@@ -0,0 +1,39 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_latency_histograms(pipeline, clean_db):
+  """
+  Verify that continuous query processes report their per-stage latency
+  histograms
+  """
+  buckets = pipeline.execute('SELECT pipeline_latency_buckets()').first()['pipeline_latency_buckets']
+  assert buckets == sorted(buckets)
+
+  pipeline.create_stream('latency_stream', x='integer')
+  pipeline.create_cv('test_latency', 'SELECT x % 10 AS g, COUNT(*) FROM latency_stream GROUP BY g')
+
+  for _ in xrange(10):
+    pipeline.insert('latency_stream', ('x', ), [(x, ) for x in xrange(1000)])
+
+  # Stats are only reported every so often
+  row = None
+  for _ in xrange(20):
+    time.sleep(0.5)
+    row = pipeline.execute("SELECT * FROM pipeline_query_stats WHERE name = 'test_latency' AND type = 'combiner'").first()
+    if row and sum(row['end_to_end_latency']) > 0:
+      break
+
+  assert row
+  for col in ('exec_latency', 'lookup_latency', 'combine_latency', 'sync_latency', 'end_to_end_latency'):
+    assert len(row[col]) == len(buckets) + 1
+  assert sum(row['combine_latency']) > 0
+  assert sum(row['sync_latency']) > 0
+  assert sum(row['end_to_end_latency']) > 0
+
+  row = pipeline.execute("SELECT * FROM pipeline_query_stats WHERE name = 'test_latency' AND type = 'worker'").first()
+  assert sum(row['exec_latency']) > 0
+
+  rows = list(pipeline.execute('SELECT * FROM pipeline_proc_stats'))
+  assert sum(sum(r['worker_queue_latency']) for r in rows if r['type'] == 'worker') > 0
+  assert sum(sum(r['combiner_queue_latency']) for r in rows if r['type'] == 'combiner') > 0
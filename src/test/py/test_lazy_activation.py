@@ -0,0 +1,62 @@
+from base import pipeline, clean_db
+from subprocess import check_output
+import time
+
+
+def num_procs(kind):
+  out = check_output('ps aux | grep "%s[0-9] \[pipeline\]" | grep -v grep || true' % kind,
+                     shell=True)
+  return len(filter(lambda s: len(s), out.split('\n')))
+
+
+def wait_for_procs(kind, n):
+  for _ in xrange(50):
+    if num_procs(kind) == n:
+      return True
+    time.sleep(0.1)
+  return False
+
+
+def test_lazy_activation(pipeline, clean_db):
+  """
+  Verify that with lazy activation a database's processes aren't started until
+  a continuous query needs them, and that no events are lost once they are
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_lazy_activation': 'on'})
+
+  try:
+    time.sleep(2)
+    assert num_procs('worker') == 0
+    assert num_procs('combiner') == 0
+
+    pipeline.create_stream('lazy_stream', x='integer')
+    time.sleep(1)
+    assert num_procs('worker') == 0
+
+    pipeline.create_cv('test_lazy', 'SELECT x, COUNT(*) FROM lazy_stream GROUP BY x')
+    assert wait_for_procs('worker', 2)
+    assert wait_for_procs('combiner', 2)
+
+    pipeline.insert('lazy_stream', ('x',), [(x % 10,) for x in xrange(1000)])
+
+    result = list(pipeline.execute('SELECT * FROM test_lazy ORDER BY x'))
+    assert len(result) == 10
+    for row in result:
+      assert row['count'] == 100
+
+    # inserting is enough to start the processes after a restart
+    pipeline.stop()
+    pipeline.run({'continuous_query_lazy_activation': 'on'})
+    time.sleep(2)
+    assert num_procs('worker') == 0
+
+    pipeline.insert('lazy_stream', ('x',), [(x % 10,) for x in xrange(1000)])
+
+    result = list(pipeline.execute('SELECT * FROM test_lazy ORDER BY x'))
+    assert len(result) == 10
+    for row in result:
+      assert row['count'] == 200
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,49 @@
+from base import pipeline, clean_db
+
+
+def test_lazy_grouping_sets(pipeline, clean_db):
+  """
+  Verify that lazy_grouping_sets views only store their finest grouping set, and derive the
+  same results as regular grouping sets views from it on read
+  """
+  pipeline.create_stream('lazy_gs_stream', a='integer', b='integer', c='integer', v='integer')
+
+  q = 'SELECT a, b, c, COUNT(*), SUM(v), AVG(v) FROM lazy_gs_stream GROUP BY CUBE (a, b, c)'
+  pipeline.create_cv('test_lazy_gs', q, lazy_grouping_sets=True)
+  pipeline.create_cv('test_eager_gs', q)
+  pipeline.create_table('test_lazy_gs_t', a='integer', b='integer', c='integer', v='integer')
+
+  rows = [(x % 3, x % 5, x % 7, x) for x in xrange(1000)]
+  pipeline.insert('lazy_gs_stream', ('a', 'b', 'c', 'v'), rows)
+  pipeline.insert('test_lazy_gs_t', ('a', 'b', 'c', 'v'), rows)
+
+  # only the (a, b, c) groups are stored
+  row = pipeline.execute('SELECT COUNT(*) FROM test_lazy_gs_mrel').first()
+  assert row['count'] == 3 * 5 * 7
+
+  order = ' ORDER BY a, b, c'
+  lazy = list(pipeline.execute('SELECT * FROM test_lazy_gs' + order))
+  eager = list(pipeline.execute('SELECT * FROM test_eager_gs' + order))
+  expected = list(pipeline.execute(q.replace('lazy_gs_stream', 'test_lazy_gs_t') + order))
+
+  assert len(lazy) == len(expected) == (3 + 1) * (5 + 1) * (7 + 1)
+  assert len(eager) == len(expected)
+
+  for l, e, x in zip(lazy, eager, expected):
+    for col in ('a', 'b', 'c', 'count', 'sum'):
+      assert l[col] == e[col] == x[col]
+    assert abs(float(l['avg']) - float(x['avg'])) < 0.0001
+
+
+def test_lazy_grouping_sets_invalid(pipeline, clean_db):
+  """
+  Verify that lazy_grouping_sets is rejected for queries without grouping sets
+  """
+  pipeline.create_stream('lazy_gs_stream', a='integer')
+
+  try:
+    pipeline.create_cv('test_lazy_gs_invalid', 'SELECT a, COUNT(*) FROM lazy_gs_stream GROUP BY a',
+                       lazy_grouping_sets=True)
+    assert False
+  except Exception:
+    pass
@@ -0,0 +1,41 @@
+from base import pipeline, clean_db
+import getpass
+import psycopg2
+import threading
+
+
+def test_concurrent_lock_free_inserts(pipeline, clean_db):
+  """
+  Verify that concurrent writers using lock-free worker queue appends
+  don't lose or duplicate any events
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_ipc_lock_free_insert': 'on'})
+
+  try:
+    pipeline.create_cv('test_lock_free', 'SELECT x::int, COUNT(*) FROM stream GROUP BY x')
+
+    num_threads = 8
+    num_batches = 20
+    values = ', '.join('(%d)' % (x % 10) for x in xrange(1000))
+
+    def insert():
+      conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' %
+                              (getpass.getuser(), pipeline.port))
+      cur = conn.cursor()
+      for _ in xrange(num_batches):
+        cur.execute('INSERT INTO stream (x) VALUES %s' % values)
+        conn.commit()
+      conn.close()
+
+    threads = [threading.Thread(target=insert) for _ in xrange(num_threads)]
+    map(lambda t: t.start(), threads)
+    map(lambda t: t.join(), threads)
+
+    rows = list(pipeline.execute('SELECT * FROM test_lock_free ORDER BY x'))
+    assert len(rows) == 10
+    for row in rows:
+      assert row['count'] == num_threads * num_batches * 100
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,35 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_lookup_stats(pipeline, clean_db):
+  """
+  Verify that combiners report how often existing groups are found in their
+  cache versus looked up in the matrel, and what the lookups cost
+  """
+  pipeline.create_stream('lookup_stats_stream', x='integer')
+  pipeline.create_cv('test_lookup_stats', 'SELECT x % 100 AS g, COUNT(*) FROM lookup_stats_stream GROUP BY g')
+
+  for _ in xrange(10):
+    pipeline.insert('lookup_stats_stream', ('x', ), [(x, ) for x in xrange(1000)])
+
+  # Stats are only reported every so often
+  row = None
+  for _ in xrange(20):
+    time.sleep(0.5)
+    row = pipeline.execute("SELECT * FROM pipeline_query_stats WHERE name = 'test_lookup_stats' AND type = 'combiner'").first()
+    if row and row['lookups'] > 0:
+      break
+
+  assert row
+  assert row['lookups'] > 0
+  assert row['lookup_groups'] >= 100
+  assert row['lookup_time'] > 0
+  assert row['combine_time'] > 0
+  assert row['sync_time'] > 0
+  assert row['group_cache_misses'] > 0
+  assert row['group_cache_hits'] + row['group_cache_misses'] >= 100
+
+  # Groups are only inserted once and then updated
+  assert row['output_rows'] == 100
+  assert row['updated_rows'] > 0
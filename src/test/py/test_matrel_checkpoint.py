@@ -0,0 +1,52 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_matrel_checkpoint(pipeline, clean_db):
+  """
+  Verify that a view with a checkpoint interval has an unlogged matrel that is periodically copied
+  to its checkpoint table, and that truncating the view empties both
+  """
+  pipeline.create_stream('ckpt_stream', k='integer')
+  pipeline.create_cv('test_ckpt', 'SELECT k, count(*) FROM ckpt_stream GROUP BY k',
+                     checkpoint_interval='1 second')
+
+  row = pipeline.execute("SELECT relpersistence FROM pg_class WHERE relname = 'test_ckpt_mrel'").first()
+  assert row['relpersistence'] == 'u'
+  row = pipeline.execute("SELECT relpersistence FROM pg_class WHERE relname = 'test_ckpt_ckpt'").first()
+  assert row['relpersistence'] == 'p'
+
+  pipeline.insert('ckpt_stream', ('k', ), [(x % 10, ) for x in xrange(1000)])
+  pipeline.execute('SELECT pipeline_flush()')
+  time.sleep(3)
+
+  rows = list(pipeline.execute('SELECT * FROM test_ckpt_ckpt'))
+  assert len(rows) == 10
+  assert sum(r['count'] for r in rows) == 1000
+
+  pipeline.execute('TRUNCATE CONTINUOUS VIEW test_ckpt')
+  assert pipeline.execute('SELECT count(*) FROM test_ckpt').first()['count'] == 0
+  assert pipeline.execute('SELECT count(*) FROM test_ckpt_ckpt').first()['count'] == 0
+
+  # views without a checkpoint interval keep a logged matrel
+  pipeline.create_cv('test_ckpt_logged', 'SELECT k, count(*) FROM ckpt_stream GROUP BY k')
+  row = pipeline.execute("SELECT relpersistence FROM pg_class WHERE relname = 'test_ckpt_logged_mrel'").first()
+  assert row['relpersistence'] == 'p'
+  assert pipeline.execute("SELECT count(*) FROM pg_class WHERE relname = 'test_ckpt_logged_ckpt'").first()['count'] == 0
+
+  pipeline.drop_cv('test_ckpt')
+  assert pipeline.execute("SELECT count(*) FROM pg_class WHERE relname = 'test_ckpt_ckpt'").first()['count'] == 0
+
+
+def test_matrel_checkpoint_invalid(pipeline, clean_db):
+  """
+  Verify that only positive checkpoint intervals are accepted
+  """
+  pipeline.create_stream('ckpt_stream_invalid', k='integer')
+
+  try:
+    pipeline.create_cv('test_ckpt_invalid', 'SELECT count(*) FROM ckpt_stream_invalid',
+                       checkpoint_interval='0 seconds')
+    assert False
+  except Exception:
+    pass
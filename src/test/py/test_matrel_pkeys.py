@@ -0,0 +1,31 @@
+from base import pipeline, clean_db
+
+
+def test_matrel_pkeys(pipeline, clean_db):
+  """
+  Verify that the primary keys combiners reserve in blocks for new groups are unique, across
+  combiners and after the view's sequence is restarted
+  """
+  pipeline.create_stream('pkeys_stream', k='integer', x='integer')
+  pipeline.create_cv('test_matrel_pkeys', 'SELECT k, count(*) FROM pkeys_stream GROUP BY k')
+
+  # a mix of new and existing groups in each batch
+  for batch in xrange(10):
+    rows = [(k, 1) for k in xrange(batch * 500, batch * 500 + 1000)]
+    pipeline.insert('pkeys_stream', ('k', 'x'), rows)
+
+  row = pipeline.execute('SELECT COUNT(*), COUNT(DISTINCT "$pk") AS pks FROM test_matrel_pkeys_mrel').first()
+  assert row['count'] == 5500
+  assert row['pks'] == 5500
+
+  # keys start at the first value of the sequence
+  row = pipeline.execute('SELECT min("$pk") FROM test_matrel_pkeys_mrel').first()
+  assert row['min'] == 1
+
+  pipeline.execute('TRUNCATE CONTINUOUS VIEW test_matrel_pkeys RESTART IDENTITY')
+  pipeline.insert('pkeys_stream', ('k', 'x'), [(k, 1) for k in xrange(100)])
+  pipeline.insert('pkeys_stream', ('k', 'x'), [(k, 1) for k in xrange(100, 200)])
+
+  row = pipeline.execute('SELECT COUNT(*), COUNT(DISTINCT "$pk") AS pks FROM test_matrel_pkeys_mrel').first()
+  assert row['count'] == 200
+  assert row['pks'] == 200
@@ -0,0 +1,40 @@
+from base import pipeline, clean_db
+
+
+def test_max_staleness(pipeline, clean_db):
+  """
+  Verify that views with a max_staleness read all of the events that are fresh enough, without
+  counting any of them as dropped in the view's stats
+  """
+  pipeline.create_stream('staleness_stream', x='integer')
+  pipeline.create_cv('test_max_staleness', 'SELECT x, COUNT(*) FROM staleness_stream GROUP BY x',
+                     max_staleness='1 hour')
+  pipeline.create_cv('test_no_staleness', 'SELECT x, COUNT(*) FROM staleness_stream GROUP BY x')
+
+  for _ in xrange(5):
+    pipeline.insert('staleness_stream', ('x', ), [(x % 10, ) for x in xrange(1000)])
+
+  for name in ('test_max_staleness', 'test_no_staleness'):
+    rows = list(pipeline.execute('SELECT x, count FROM %s ORDER BY x' % name))
+    assert len(rows) == 10
+    for row in rows:
+      assert row['count'] == 500
+
+  row = pipeline.execute("SELECT stale_drops FROM pipeline_query_stats "
+                         "WHERE name = 'test_max_staleness' AND type = 'worker'").first()
+  assert row is None or row['stale_drops'] == 0
+
+
+def test_max_staleness_invalid(pipeline, clean_db):
+  """
+  Verify that max_staleness must be a positive interval
+  """
+  pipeline.create_stream('staleness_stream', x='integer')
+
+  for value in ('-1 second', '0 seconds', 10, 'not an interval'):
+    try:
+      pipeline.create_cv('test_max_staleness_invalid', 'SELECT COUNT(*) FROM staleness_stream',
+                         max_staleness=value)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,55 @@
+from base import pipeline, clean_db
+import random
+
+
+def test_merge_group(pipeline, clean_db):
+  """
+  Verify that views of a merge group get the same results as they do on their own, whether or not
+  their worker plans can be merged
+  """
+  pipeline.create_stream('merge_stream', k='integer', v='integer', s='text')
+
+  # the first view of a merge group computes the partial results of those it can be merged with
+  views = [
+    ('test_merge_count', 'SELECT k, count(*) FROM merge_stream GROUP BY k'),
+    ('test_merge_sum', 'SELECT k, sum(v), count(*) FROM merge_stream GROUP BY k'),
+    ('test_merge_distinct', 'SELECT k, count(DISTINCT s) AS count, min(v) FROM merge_stream GROUP BY k'),
+    # these can't be merged with it
+    ('test_merge_where', 'SELECT k, count(*) FROM merge_stream WHERE v > 50 GROUP BY k'),
+    ('test_merge_by_v', 'SELECT v % 7 AS k, count(*) FROM merge_stream GROUP BY k'),
+  ]
+
+  for name, q in views:
+    pipeline.create_cv(name, q, merge_group='merged')
+    pipeline.create_cv(name + '_alone', q)
+
+  rows = [(random.randint(0, 20), random.randint(0, 100), 's%d' % random.randint(0, 5)) for _ in xrange(1000)]
+  for _ in xrange(5):
+    pipeline.insert('merge_stream', ('k', 'v', 's'), rows)
+
+  # a view created once its group's merged plan was built executes its own plan
+  pipeline.create_cv('test_merge_late', views[0][1], merge_group='merged')
+  pipeline.insert('merge_stream', ('k', 'v', 's'), rows)
+  pipeline.execute('SELECT pipeline_flush()')
+
+  for name, _ in views:
+    merged = list(pipeline.execute('SELECT * FROM %s ORDER BY k' % name))
+    alone = list(pipeline.execute('SELECT * FROM %s_alone ORDER BY k' % name))
+    assert merged == alone
+
+  late = list(pipeline.execute('SELECT * FROM test_merge_late ORDER BY k'))
+  assert sum(r['count'] for r in late) == 1000
+
+
+def test_merge_group_requires_grouping(pipeline, clean_db):
+  """
+  Verify that only grouped views can be part of a merge group
+  """
+  pipeline.create_stream('merge_stream_ungrouped', x='integer')
+
+  try:
+    pipeline.create_cv('test_merge_ungrouped', 'SELECT count(*) FROM merge_stream_ungrouped',
+                       merge_group='merged')
+    assert False
+  except Exception:
+    pass
@@ -0,0 +1,68 @@
+from base import pipeline, clean_db
+import socket
+import time
+import urllib2
+
+
+def _free_port():
+  sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+  sock.bind(('', 0))
+  _, port = sock.getsockname()
+  sock.close()
+  return port
+
+
+def _scrape(port, path='/metrics'):
+  for i in xrange(50):
+    try:
+      return urllib2.urlopen('http://localhost:%d%s' % (port, path))
+    except urllib2.HTTPError:
+      raise
+    except urllib2.URLError:
+      time.sleep(0.1)
+  raise Exception('Failed to connect to the metrics exporter')
+
+
+def test_metrics(pipeline, clean_db):
+  """
+  Verify that continuous query and IPC queue stats are served in the OpenMetrics format
+  """
+  port = _free_port()
+  pipeline.stop()
+  pipeline.run({'continuous_query_metrics_port': port})
+
+  try:
+    pipeline.create_stream('metrics_stream', x='integer')
+    pipeline.create_cv('test_metrics', 'SELECT x, COUNT(*) FROM metrics_stream GROUP BY x')
+    pipeline.insert('metrics_stream', ('x', ), [(i % 10, ) for i in xrange(1000)])
+
+    resp = _scrape(port)
+    assert resp.getcode() == 200
+    assert resp.info()['Content-Type'].startswith('application/openmetrics-text')
+
+    body = resp.read()
+    lines = body.splitlines()
+    assert lines[-1] == '# EOF'
+    assert '# TYPE pipeline_proc_input_rows counter' in lines
+    assert '# TYPE pipeline_queue_size_bytes gauge' in lines
+
+    # The per view counters add up to what was inserted
+    view_id = pipeline.execute(
+      "SELECT id FROM pipeline_query WHERE relid = 'test_metrics'::regclass").first()['id']
+    total = 0
+    for line in lines:
+      if (line.startswith('pipeline_query_input_rows_total{') and
+          'view_id="%d"' % view_id in line and 'type="worker"' in line):
+        total += int(line.split()[-1])
+    assert total == 1000
+
+    assert any(line.startswith('pipeline_queue_size_bytes{') for line in lines)
+
+    try:
+      _scrape(port, '/nope')
+      assert False
+    except urllib2.HTTPError as e:
+      assert e.code == 404
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,42 @@
+from base import pipeline, clean_db
+
+
+def test_native_merge(pipeline, clean_db):
+  """
+  Verify that continuous views made entirely of sketches, whose states combiners merge
+  without the combine plan, give the same results as they would through it
+  """
+  pipeline.create_stream('native_merge_stream', k='integer', x='integer')
+  pipeline.create_cv('test_native_merge',
+                     'SELECT k, COUNT(DISTINCT x), bloom_agg(x), cmsketch_agg(x), tdigest_agg(x) '
+                     'FROM native_merge_stream GROUP BY k')
+  pipeline.create_cv('test_native_merge_single',
+                     'SELECT COUNT(DISTINCT x), cmsketch_agg(x) FROM native_merge_stream')
+
+  # Mixed with other aggregates, these are merged by the combine plan
+  pipeline.create_cv('test_native_merge_mixed',
+                     'SELECT k, COUNT(DISTINCT x), cmsketch_agg(x), COUNT(*) FROM native_merge_stream GROUP BY k')
+
+  for i in xrange(10):
+    rows = [(k, x) for k in xrange(10) for x in xrange(i * 10, (i + 1) * 10)]
+    pipeline.insert('native_merge_stream', ('k', 'x'), rows)
+
+  for v in ['test_native_merge', 'test_native_merge_mixed']:
+    result = list(pipeline.execute(
+      'SELECT k, count, cmsketch_frequency(cmsketch_agg, 5) AS f FROM %s ORDER BY k' % v))
+    assert len(result) == 10
+    for row in result:
+      assert row['count'] == 100
+      assert row['f'] == 1
+
+  for row in pipeline.execute(
+      'SELECT bloom_contains(bloom_agg, 42) AS a, bloom_contains(bloom_agg, 1000) AS b, '
+      'tdigest_quantile(tdigest_agg, 0.5) AS q FROM test_native_merge'):
+    assert row['a']
+    assert not row['b']
+    assert 45 <= row['q'] <= 55
+
+  row = pipeline.execute(
+    'SELECT count, cmsketch_frequency(cmsketch_agg, 5) AS f FROM test_native_merge_single').first()
+  assert row['count'] == 100
+  assert row['f'] == 10
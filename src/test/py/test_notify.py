@@ -0,0 +1,83 @@
+from base import pipeline, clean_db
+import getpass
+import psycopg2
+import select
+import time
+
+
+def _listen(pipeline, channel):
+  conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' % (getpass.getuser(), pipeline.port))
+  conn.autocommit = True
+  conn.cursor().execute('LISTEN %s' % channel)
+  return conn
+
+
+def _payloads(conn, timeout=5):
+  payloads = []
+  start = time.time()
+  while time.time() - start < timeout:
+    if select.select([conn], [], [], 0.5) == ([], [], []):
+      if payloads:
+        break
+      continue
+    conn.poll()
+    while conn.notifies:
+      payloads.append(conn.notifies.pop(0).payload)
+  return payloads
+
+
+def test_notify_keys(pipeline, clean_db):
+  """
+  Verify that a view notifies its channel of the groups each combiner commit changes
+  """
+  pipeline.create_stream('notify_stream', k='text', x='integer')
+  pipeline.create_cv('test_notify', 'SELECT k, count(*) FROM notify_stream GROUP BY k',
+                     notify='test_notify_changes', notify_key='k')
+
+  conn = _listen(pipeline, 'test_notify_changes')
+
+  pipeline.insert('notify_stream', ('k', 'x'), [('a', 1), ('b', 1), ('a', 2)])
+  assert sorted(set(_payloads(conn))) == ['a', 'b']
+
+  pipeline.insert('notify_stream', ('k', 'x'), [('b', 1)])
+  assert set(_payloads(conn)) == set(['b'])
+
+  conn.close()
+
+
+def test_notify_without_key(pipeline, clean_db):
+  """
+  Verify that views without a notify_key send empty notifications
+  """
+  pipeline.create_stream('notify_stream1', x='integer')
+  pipeline.create_cv('test_notify_nokey', 'SELECT count(*) FROM notify_stream1', notify='test_notify_nokey')
+
+  conn = _listen(pipeline, 'test_notify_nokey')
+
+  pipeline.insert('notify_stream1', ('x', ), [(n, ) for n in xrange(100)])
+  payloads = _payloads(conn)
+  assert payloads
+  assert set(payloads) == set([''])
+
+  conn.close()
+
+
+def test_notify_options(pipeline, clean_db):
+  """
+  Verify that invalid notify options are rejected
+  """
+  pipeline.create_stream('notify_stream2', k='text', x='integer')
+
+  bad = [
+    ('SELECT k, count(*) FROM notify_stream2 GROUP BY k', {'notify_key': 'k'}),
+    ('SELECT k, count(*) FROM notify_stream2 GROUP BY k', {'notify': 'c', 'notify_key': 'count'}),
+    ('SELECT k, count(*) FROM notify_stream2 GROUP BY k', {'notify': 'c', 'notify_key': 'nope'}),
+    ('SELECT k, count(*) FROM notify_stream2 GROUP BY k', {'notify': 'c' * 100}),
+  ]
+
+  for q, opts in bad:
+    try:
+      pipeline.create_cv('test_notify_bad', q, **opts)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,70 @@
+from base import pipeline, clean_db
+import random
+
+
+def test_numeric_aggs_combine(pipeline, clean_db):
+  """
+  Verify that numeric sum, avg and stddev states survive being sent to combiners, stored,
+  and combined, including values with many digits, negative values and NaN
+  """
+  q = """
+  SELECT k::integer, sum(x::numeric), avg(x::numeric), stddev(x::numeric) FROM test_numeric_stream
+  GROUP BY k
+  """
+  pipeline.create_cv('test_numeric_aggs', q)
+  pipeline.create_table('test_numeric_aggs_t', k='integer', x='numeric')
+
+  rows = []
+  for n in xrange(2000):
+    x = '%d.%06d' % (random.randint(-10 ** 12, 10 ** 12), random.randint(0, 999999))
+    rows.append((n % 5, x))
+  rows.append((5, 'NaN'))
+  rows.append((5, '1'))
+
+  for i in xrange(0, len(rows), 500):
+    pipeline.insert('test_numeric_stream', ('k', 'x'), rows[i:i + 500])
+  pipeline.insert('test_numeric_aggs_t', ('k', 'x'), rows)
+
+  expected = list(pipeline.execute(
+    'SELECT k, sum(x)::text AS s, avg(x)::text AS a, stddev(x)::text AS d '
+    'FROM test_numeric_aggs_t GROUP BY k ORDER BY k'))
+  result = list(pipeline.execute(
+    'SELECT k, sum::text AS s, avg::text AS a, stddev::text AS d '
+    'FROM test_numeric_aggs ORDER BY k'))
+
+  assert len(result) == 6
+  for e, r in zip(expected, result):
+    assert e == r
+
+  expected = pipeline.execute(
+    'SELECT sum(x)::text AS s, avg(x)::text AS a FROM test_numeric_aggs_t WHERE k < 5').first()
+  result = pipeline.execute(
+    'SELECT combine(sum)::text AS s, combine(avg)::text AS a FROM test_numeric_aggs '
+    'WHERE k < 5').first()
+  assert expected == result
+
+
+def test_bigint_aggs_combine(pipeline, clean_db):
+  """
+  Verify that the 128-bit states of bigint sum and avg, and of integer variance, are exact
+  after being sent to combiners, stored, and combined, even when their sums exceed 64 bits
+  """
+  q = """
+  SELECT k::integer, sum(x::bigint), avg(x::bigint), var_pop(y::integer) FROM test_bigint_stream
+  GROUP BY k
+  """
+  pipeline.create_cv('test_bigint_aggs', q)
+
+  big = 2 ** 62
+  rows = [(n % 3, big + n, n - 1000) for n in xrange(3000)]
+  for i in xrange(0, len(rows), 500):
+    pipeline.insert('test_bigint_stream', ('k', 'x', 'y'), rows[i:i + 500])
+
+  result = list(pipeline.execute(
+    'SELECT k, sum::text AS s, var_pop FROM test_bigint_aggs ORDER BY k'))
+  assert len(result) == 3
+  for r in result:
+    assert int(r['s']) == sum(row[1] for row in rows if row[0] == r['k'])
+
+  result = pipeline.execute('SELECT combine(sum)::text AS s FROM test_bigint_aggs').first()
+  assert int(result['s']) == sum(row[1] for row in rows)
@@ -0,0 +1,57 @@
+from base import pipeline, clean_db
+import getpass
+import psycopg2
+import threading
+import time
+
+
+def test_online_cv_creation(pipeline, clean_db):
+  """
+  Verify that a backend inserting into a stream keeps writing to the right
+  views while views on it and on other streams are created, deactivated and
+  activated
+  """
+  pipeline.create_stream('online_a', x='integer')
+  pipeline.create_stream('online_b', x='integer')
+  pipeline.create_cv('test_online_a', 'SELECT COUNT(*) FROM online_a')
+
+  stop = [False]
+  num_inserted = [0]
+
+  def insert():
+    conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' %
+                            (getpass.getuser(), pipeline.port))
+    conn.autocommit = True
+    cur = conn.cursor()
+    while not stop[0]:
+      cur.execute('INSERT INTO online_a (x) SELECT x FROM generate_series(1, 100) AS x')
+      num_inserted[0] += 100
+    conn.close()
+
+  t = threading.Thread(target=insert)
+  t.start()
+
+  try:
+    for i in xrange(10):
+      pipeline.create_cv('test_online_b%d' % i, 'SELECT COUNT(*) FROM online_b')
+      pipeline.create_cv('test_online_a%d' % i, 'SELECT x, COUNT(*) FROM online_a GROUP BY x')
+      pipeline.execute('DEACTIVATE test_online_b%d' % i)
+      pipeline.execute('ACTIVATE test_online_b%d' % i)
+      time.sleep(0.1)
+  finally:
+    stop[0] = True
+    t.join()
+
+  row = pipeline.execute('SELECT * FROM test_online_a').first()
+  assert row['count'] == num_inserted[0]
+
+  # Views created while the inserting backend was running see its later inserts
+  before = list(pipeline.execute('SELECT SUM(count) FROM test_online_a9')).pop()['sum'] or 0
+  pipeline.insert('online_a', ('x', ), [(x, ) for x in xrange(1, 101)])
+  after = list(pipeline.execute('SELECT SUM(count) FROM test_online_a9')).pop()['sum']
+  assert after == before + 100
+
+  pipeline.insert('online_b', ('x', ), [(x, ) for x in xrange(100)])
+  for i in xrange(10):
+    row = pipeline.execute('SELECT * FROM test_online_b%d' % i).first()
+    assert row['count'] == 100
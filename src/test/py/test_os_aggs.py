@@ -46,3 +46,25 @@ def test_percentile_cont_agg(pipeline, clean_db):
 
   # All percentiles should be within 0.5%.
   assert all(x <= 0.005 * range_top for x in diff)
+
+
+def test_percentile_cont_multiple(pipeline, clean_db):
+  """
+  Verify that percentiles estimated together are the same as when they're estimated individually,
+  whatever order they're requested in
+  """
+  q = [0.9, 0.1, 0.5, 0.99, 0.5, 0.0, 1.0, 0.25]
+
+  pipeline.create_cv('test_cq_percentile_cont_multi',
+                     'SELECT percentile_cont(ARRAY[%s]) WITHIN GROUP (ORDER BY x::integer) AS multi, %s FROM test_stream' %
+                     (', '.join(map(str, q)),
+                      ', '.join('percentile_cont(%s) WITHIN GROUP (ORDER BY x::integer) AS p%d' % (p, i) for i, p in enumerate(q))))
+
+  for _ in xrange(10):
+    pipeline.insert('test_stream', ('x',), [(random.randint(0, 100000),) for _ in xrange(5000)])
+
+  row = pipeline.execute('SELECT * FROM test_cq_percentile_cont_multi').first()
+
+  assert len(row['multi']) == len(q)
+  for i in xrange(len(q)):
+    assert row['multi'][i] == row['p%d' % i]
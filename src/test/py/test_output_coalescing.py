@@ -0,0 +1,72 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_output_threshold(pipeline, clean_db):
+  """
+  Verify that updates within a view's output threshold aren't written to its output stream
+  """
+  pipeline.create_stream('coalesce_s0', x='integer', y='integer')
+  pipeline.create_cv('coalesce_threshold', 'SELECT x, sum(y) FROM coalesce_s0 GROUP BY x',
+                     output_threshold=10, output_threshold_column='sum')
+  pipeline.create_cv('coalesce_threshold_out',
+                     "SELECT count(*), max((new).sum) FROM output_of('coalesce_threshold')")
+
+  for n in xrange(20):
+    pipeline.insert('coalesce_s0', ('x', 'y'), [(0, 1)])
+
+  assert pipeline.execute('SELECT sum FROM coalesce_threshold').first()['sum'] == 20
+
+  row = pipeline.execute('SELECT * FROM coalesce_threshold_out').first()
+  assert 1 <= row['count'] <= 2
+  assert row['max'] <= 12
+
+
+def test_output_interval(pipeline, clean_db):
+  """
+  Verify that updates within a view's output interval are coalesced, and the latest one is written
+  once the interval has passed
+  """
+  pipeline.create_stream('coalesce_s1', x='integer')
+  pipeline.create_cv('coalesce_interval', 'SELECT x, count(*) FROM coalesce_s1 GROUP BY x',
+                     output_interval='2 seconds')
+  pipeline.create_cv('coalesce_interval_out',
+                     "SELECT (new).x, count(*), max((new).count) FROM output_of('coalesce_interval') GROUP BY x")
+
+  for n in xrange(10):
+    pipeline.insert('coalesce_s1', ('x', ), [(n % 2, )])
+
+  rows = list(pipeline.execute('SELECT * FROM coalesce_interval_out ORDER BY x'))
+  assert len(rows) == 2
+  for row in rows:
+    assert row['max'] < 5
+
+  time.sleep(3)
+
+  rows = list(pipeline.execute('SELECT * FROM coalesce_interval_out ORDER BY x'))
+  assert len(rows) == 2
+  for row in rows:
+    assert row['count'] == 2
+    assert row['max'] == 5
+
+
+def test_output_coalescing_options(pipeline, clean_db):
+  """
+  Verify that invalid coalescing options are rejected
+  """
+  pipeline.create_stream('coalesce_s2', x='integer')
+
+  bad = [
+    ('SELECT x, count(*) FROM coalesce_s2 GROUP BY x', {'output_threshold': 1}),
+    ('SELECT x, count(*) FROM coalesce_s2 GROUP BY x', {'output_threshold_column': 'count'}),
+    ('SELECT x, count(*) FROM coalesce_s2 GROUP BY x', {'output_threshold': 1, 'output_threshold_column': 'y'}),
+    ('SELECT x, count(*) FROM coalesce_s2 GROUP BY x', {'output_threshold': -1, 'output_threshold_column': 'count'}),
+    ('SELECT x FROM coalesce_s2', {'output_interval': '1 second'}),
+  ]
+
+  for q, opts in bad:
+    try:
+      pipeline.create_cv('coalesce_bad', q, **opts)
+      assert False
+    except Exception:
+      pass
@@ -116,3 +116,78 @@ def test_transforms(pipeline, clean_db):
   rows = list(pipeline.execute('SELECT * FROM ct_recv'))
   assert len(rows) == 100
 
+
+
+def test_incremental_sw_ticking(pipeline, clean_db):
+  """
+  Verify that sliding-window groups are only written to output streams again
+  when their windows change, and still leave the window once all of their steps have
+  """
+  pipeline.create_cv('sw_incr', 'SELECT x::integer, count(*) FROM stream GROUP BY x',
+                     max_age='10 seconds', step_factor=10)
+  q = """
+  SELECT CASE WHEN (old).x IS NULL THEN (new).x ELSE (old).x END AS x,
+  (old).count AS old_count, (new).count AS new_count FROM sw_incr_osrel
+  """
+  pipeline.create_cv('sw_incr_output', q)
+
+  pipeline.insert('stream', ('x',), [(0,), (1,)])
+  for _ in range(4):
+    time.sleep(1)
+    pipeline.insert('stream', ('x',), [(1,)])
+
+  time.sleep(2)
+
+  # Group 0's window hasn't changed, so it must only have been written once
+  rows = list(pipeline.execute('SELECT * FROM sw_incr_output WHERE x = 0'))
+  assert len(rows) == 1
+  assert rows[0]['old_count'] is None
+  assert rows[0]['new_count'] == 1
+
+  row = pipeline.execute('SELECT max(new_count) FROM sw_incr_output WHERE x = 1').first()
+  assert row[0] == 5
+
+  time.sleep(12)
+
+  for x in range(2):
+    rows = list(pipeline.execute('SELECT * FROM sw_incr_output WHERE x = %d AND new_count IS NULL' % x))
+    assert len(rows) == 1
+    assert rows[0]['old_count'] is not None
+
+  pipeline.drop_cv('sw_incr_output')
+  pipeline.drop_cv('sw_incr')
+
+
+def test_sw_cache_mem(pipeline, clean_db):
+  """
+  Verify that sliding-window groups whose cached steps were evicted are read back from
+  the matrel, so that their output stream values remain correct
+  """
+  pipeline.execute('ALTER SYSTEM SET continuous_query_combiner_sw_cache_mem = 64')
+  pipeline.execute('SELECT pg_reload_conf()')
+
+  try:
+    pipeline.create_cv('sw_evict', 'SELECT x::integer, count(*) FROM stream GROUP BY x',
+                       max_age='1 minute', step_factor=10)
+    q = """
+    SELECT (new).x AS x, (new).count AS count FROM sw_evict_osrel
+    """
+    pipeline.create_cv('sw_evict_output', q)
+
+    rows = [(x,) for x in range(2000)]
+    pipeline.insert('stream', ('x',), rows)
+    time.sleep(2)
+    pipeline.insert('stream', ('x',), rows)
+    time.sleep(2)
+
+    row = pipeline.execute('SELECT count(DISTINCT x) FROM sw_evict_output WHERE count = 2').first()
+    assert row[0] == 2000
+
+    row = pipeline.execute("SELECT sum(sw_cache_misses) FROM pipeline_proc_stats WHERE type = 'combiner'").first()
+    assert row[0] > 0
+
+    pipeline.drop_cv('sw_evict_output')
+    pipeline.drop_cv('sw_evict')
+  finally:
+    pipeline.execute('ALTER SYSTEM RESET continuous_query_combiner_sw_cache_mem')
+    pipeline.execute('SELECT pg_reload_conf()')
@@ -62,6 +62,75 @@ def test_combine_table_no_groups(pipeline, clean_db):
   assert rows[0][0] == 2000
 
 
+def test_combine_table_sorted(pipeline, clean_db):
+  """
+  Verify that tables holding several rows per group merge like the streams they came from
+  """
+  q = 'SELECT x::int %% 50 AS k, count(*), avg(x::int), count(DISTINCT x::int) FROM %s GROUP BY k'
+  pipeline.create_stream('combine_sorted_stream', x='integer')
+  pipeline.create_cv('combine_sorted', q % 'combine_sorted_stream')
+  pipeline.create_cv('combine_sorted_direct', q % 'combine_sorted_stream')
+
+  pipeline.insert('combine_sorted_stream', ('x',), [(i,) for i in xrange(1000)])
+  pipeline.execute('SELECT * INTO tmprel FROM combine_sorted_mrel')
+  pipeline.execute('TRUNCATE CONTINUOUS VIEW combine_sorted')
+
+  # each group of the table shows up in several stream batches
+  for n in xrange(5):
+    pipeline.insert('combine_sorted_stream', ('x',), [(i * 7 + n,) for i in xrange(1000)])
+    pipeline.execute('INSERT INTO tmprel SELECT * FROM combine_sorted_mrel')
+    pipeline.execute('TRUNCATE CONTINUOUS VIEW combine_sorted')
+
+  pipeline.execute("SELECT pipeline_combine_table('combine_sorted', 'tmprel')")
+
+  merged = list(pipeline.execute('SELECT * FROM combine_sorted ORDER BY k'))
+  direct = list(pipeline.execute('SELECT * FROM combine_sorted_direct ORDER BY k'))
+  assert len(merged) == 50
+  assert merged == direct
+
+  pipeline.execute('DROP TABLE tmprel')
+
+
+def test_combine_partial(pipeline, clean_db):
+  """
+  Verify that partial results submitted with pipeline_combine_partial are merged like the events they came from,
+  and that malformed ones are rejected
+  """
+  pipeline.create_stream('combine_partial_stream', x='integer')
+  pipeline.create_cv('combine_partial',
+                     'SELECT x %% 10 AS k, count(*) AS c, count(DISTINCT x) AS d FROM combine_partial_stream GROUP BY k')
+  pipeline.insert('combine_partial_stream', ('x',), [(i,) for i in xrange(1000)])
+
+  pipeline.execute('SELECT * INTO tmprel FROM combine_partial_mrel')
+  pipeline.execute("SELECT pipeline_combine_partial('combine_partial', m) FROM tmprel m")
+
+  for _ in xrange(100):
+    if pipeline.execute('SELECT sum(c) FROM combine_partial').first()['sum'] == 2000:
+      break
+    time.sleep(0.1)
+
+  rows = list(pipeline.execute('SELECT * FROM combine_partial ORDER BY k'))
+  assert len(rows) == 10
+  for row in rows:
+    assert row['c'] == 200
+    assert row['d'] == 100
+
+  try:
+    pipeline.execute("SELECT pipeline_combine_partial('combine_partial', ROW(1, 2))")
+    assert False
+  except Exception:
+    pass
+
+  pipeline.execute("UPDATE tmprel SET d = '\\x0102'::hll")
+  try:
+    pipeline.execute("SELECT pipeline_combine_partial('combine_partial', m) FROM tmprel m")
+    assert False
+  except Exception:
+    pass
+
+  pipeline.execute('DROP TABLE tmprel')
+
+
 @async_insert
 def test_pipeline_flush(pipeline, clean_db):
   pipeline.create_cv('flush', 'SELECT x::int, pg_sleep(0.01) FROM stream')
@@ -82,3 +151,38 @@ def test_pipeline_flush(pipeline, clean_db):
 
   row = list(pipeline.execute('SELECT count(*) FROM flush'))[0]
   assert row[0] == 1000
+
+
+@async_insert
+def test_pipeline_flush_concurrent_inserts(pipeline, clean_db):
+  """
+  Verify that inserts aren't blocked while pipeline_flush waits, and that it doesn't wait for them
+  """
+  pipeline.create_stream('flush_slow_stream', x='integer')
+  pipeline.create_stream('flush_fast_stream', x='integer')
+  pipeline.create_cv('flush_slow', 'SELECT x, pg_sleep(0.01) FROM flush_slow_stream')
+  pipeline.create_cv('flush_fast', 'SELECT count(*) FROM flush_fast_stream')
+
+  # takes 0.01 * 500 = 5s to process
+  pipeline.insert('flush_slow_stream', ('x',), [(i,) for i in xrange(500)])
+
+  def flush():
+    conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' %
+                            (getpass.getuser(), pipeline.port))
+    cur = conn.cursor()
+    cur.execute('SELECT pipeline_flush()')
+    conn.close()
+
+  t = threading.Thread(target=flush)
+  t.start()
+  time.sleep(0.5)
+
+  start = time.time()
+  pipeline.insert('flush_fast_stream', ('x',), [(i,) for i in xrange(100)])
+  assert time.time() - start < 1
+  assert t.is_alive()
+
+  t.join()
+
+  row = pipeline.execute('SELECT count(*) FROM flush_slow').first()
+  assert row['count'] == 500
@@ -69,3 +69,35 @@ def test_prepared_extended(pipeline, clean_db):
   assert result['x'] == 2000
   assert result['y'] == 2000
   assert result['z'] == 2000
+
+
+def test_prepared_inserts_invalidation(pipeline, clean_db):
+  """
+  Verify that a prepared INSERT picks up readers that are added or removed after its
+  stream's insert state has been cached
+  """
+  conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' % (getpass.getuser(), pipeline.port))
+  db = conn.cursor()
+  db.execute('CREATE CONTINUOUS VIEW test_prepared_inval0 AS SELECT COUNT(*) FROM stream')
+  conn.commit()
+
+  db.execute('PREPARE ins AS INSERT INTO stream (x) VALUES ($1)')
+  for n in range(100):
+    db.execute('EXECUTE ins (%d)' % n)
+  conn.commit()
+
+  pipeline.create_cv('test_prepared_inval1', 'SELECT COUNT(*) FROM stream')
+
+  for n in range(100):
+    db.execute('EXECUTE ins (%d)' % n)
+  conn.commit()
+
+  assert pipeline.execute('SELECT count FROM test_prepared_inval0').first()['count'] == 200
+  pipeline.drop_cv('test_prepared_inval0')
+
+  for n in range(100):
+    db.execute('EXECUTE ins (%d)' % n)
+  conn.commit()
+  conn.close()
+
+  assert pipeline.execute('SELECT count FROM test_prepared_inval1').first()['count'] == 200
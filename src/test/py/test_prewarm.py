@@ -0,0 +1,28 @@
+from base import pipeline, clean_db
+
+
+def test_prewarm(pipeline, clean_db):
+  """
+  Verify that continuous query processes that build their plans and fill their group caches as soon
+  as they start keep getting the right results
+  """
+  pipeline.create_stream('prewarm_stream', k='integer')
+  pipeline.create_cv('test_prewarm', 'SELECT k, count(*) FROM prewarm_stream GROUP BY k')
+  pipeline.create_cv('test_prewarm_total', 'SELECT count(*) FROM prewarm_stream')
+
+  pipeline.insert('prewarm_stream', ('k', ), [(x % 100, ) for x in xrange(1000)])
+
+  try:
+    pipeline.stop()
+    pipeline.run({'continuous_query_prewarm': 'on',
+                  'continuous_query_combiner_group_cache_mem': '1MB'})
+
+    pipeline.insert('prewarm_stream', ('k', ), [(x % 100, ) for x in xrange(1000)])
+
+    rows = list(pipeline.execute('SELECT * FROM test_prewarm ORDER BY k'))
+    assert len(rows) == 100
+    assert all(r['count'] == 20 for r in rows)
+    assert pipeline.execute('SELECT count FROM test_prewarm_total').first()['count'] == 2000
+  finally:
+    pipeline.stop()
+    pipeline.run()
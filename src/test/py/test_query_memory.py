@@ -0,0 +1,37 @@
+from base import pipeline, clean_db
+
+
+def test_query_memory(pipeline, clean_db):
+  """
+  Verify that the memory used by each view in each process is reported, and that views
+  over continuous_query_state_mem still produce correct results
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_state_mem': 64,
+                'continuous_query_combiner_group_cache_mem': 1024})
+
+  try:
+    pipeline.create_stream('query_memory_stream', k='integer')
+    pipeline.create_cv('test_query_memory',
+                       'SELECT k, COUNT(*) FROM query_memory_stream GROUP BY k')
+
+    for i in xrange(10):
+      pipeline.insert('query_memory_stream', ('k', ), [(k, ) for k in xrange(5000)])
+
+    row = pipeline.execute('SELECT COUNT(*), SUM(count) FROM test_query_memory').first()
+    assert row['count'] == 5000
+    assert row['sum'] == 10 * 5000
+
+    rows = list(pipeline.execute(
+      "SELECT * FROM pipeline_query_memory() WHERE name = 'test_query_memory'"))
+    assert set(row['type'] for row in rows) == set(['worker', 'combiner'])
+
+    for row in rows:
+      assert row['bytes'] > 0
+      assert row['peak_bytes'] >= row['bytes']
+
+    combiners = [row for row in rows if row['type'] == 'combiner']
+    assert sum(row['limit_exceeded'] for row in combiners) > 0
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,30 @@
+from base import pipeline, clean_db
+
+
+def test_spill_to_disk(pipeline, clean_db):
+  """
+  Verify that bursts that don't fit in worker queues are spilled to disk and
+  consumed without losing any events
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_ipc_shared_mem': '32MB',
+                'stream_insert_backpressure': 'spill',
+                'synchronous_stream_insert': 'off'})
+
+  try:
+    pipeline.create_cv('test_spill', 'SELECT COUNT(*) AS total, COUNT(DISTINCT x::integer) AS uniq, MAX(length(y::text)) AS len FROM stream')
+
+    payload = 'x' * 1000
+    rows = [(i, payload) for i in xrange(10000)]
+    for _ in xrange(10):
+      pipeline.insert('stream', ('x', 'y'), rows)
+
+    pipeline.execute('SELECT pg_sleep(5)')
+
+    result = list(pipeline.execute('SELECT * FROM test_spill'))
+    assert result[0]['total'] == 100000
+    assert result[0]['uniq'] == 10000
+    assert result[0]['len'] == 1000
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,39 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_queue_stats(pipeline, clean_db):
+  """
+  Verify that pipeline_queue_stats reports every worker and combiner queue
+  and the traffic going through them
+  """
+  pipeline.create_stream('queue_stats_stream', x='integer')
+  pipeline.create_cv('test_queue_stats', 'SELECT x % 10 AS g, COUNT(*) FROM queue_stats_stream GROUP BY g')
+
+  pipeline.insert('queue_stats_stream', ('x', ), [(x, ) for x in xrange(1000)])
+
+  rows = list(pipeline.execute('SELECT * FROM pipeline_queue_stats()'))
+  types = set(r['type'] for r in rows)
+  assert types == set(['insert->worker', 'worker->broker', 'broker->worker', 'worker->combiner'])
+
+  for r in rows:
+    assert r['size'] > 0
+    assert 0 <= r['bytes'] <= r['size']
+    assert 0 <= r['occupancy'] <= 1
+    assert r['bytes_ps'] is None
+    assert r['wraps'] == r['total_bytes'] / r['size']
+    if r['type'] == 'worker->broker':
+      assert r['broker_buffered_bytes'] is not None
+    else:
+      assert r['broker_buffered_bytes'] is None
+
+  assert sum(r['total_bytes'] for r in rows if r['type'] == 'insert->worker') > 0
+  assert sum(r['total_bytes'] for r in rows if r['type'] == 'worker->combiner') > 0
+
+  # Rates are measured between calls of the same session
+  time.sleep(0.1)
+  pipeline.insert('queue_stats_stream', ('x', ), [(x, ) for x in xrange(1000)])
+
+  rows = list(pipeline.execute('SELECT * FROM pipeline_queue_stats()'))
+  assert all(r['bytes_ps'] is not None for r in rows)
+  assert sum(r['bytes_ps'] for r in rows if r['type'] == 'insert->worker') > 0
@@ -0,0 +1,61 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_read_cache(pipeline, clean_db):
+  """
+  Verify that the cached rows of a view's recently updated groups match the view's rows
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_view_read_cache_mem': '1MB'})
+
+  try:
+    pipeline.create_stream('read_cache_stream', k='text', x='integer')
+    pipeline.create_cv('test_read_cache',
+                       'SELECT k, count(*), avg(x), count(DISTINCT x) FROM read_cache_stream GROUP BY k',
+                       read_cache_key='k')
+
+    def cached(k):
+      return pipeline.execute("SELECT (pipeline_cached_row(NULL::test_read_cache, '%s')).*" % k).first()
+
+    def check(keys):
+      # rows are cached once the combiner has committed them
+      time.sleep(0.5)
+      for k in keys:
+        row = pipeline.execute("SELECT * FROM test_read_cache WHERE k = '%s'" % k).first()
+        assert cached(k) == row
+
+    pipeline.insert('read_cache_stream', ('k', 'x'), [('key%d' % (n % 10), n) for n in xrange(1000)])
+    check(['key%d' % n for n in xrange(10)])
+
+    pipeline.insert('read_cache_stream', ('k', 'x'), [('key%d' % (n % 3), n * 7) for n in xrange(1000)])
+    check(['key%d' % n for n in xrange(10)])
+
+    assert cached('nonexistent')['k'] is None
+
+    pipeline.execute('TRUNCATE CONTINUOUS VIEW test_read_cache')
+    assert cached('key0')['k'] is None
+  finally:
+    pipeline.stop()
+    pipeline.run()
+
+
+def test_read_cache_validation(pipeline, clean_db):
+  """
+  Verify that views are only cached by a grouping column and only if they have one row per group
+  """
+  pipeline.create_stream('read_cache_bad_stream', k='integer', x='integer')
+
+  bad = [
+    ('SELECT k, count(*) FROM read_cache_bad_stream GROUP BY k', {'read_cache_key': 'count'}),
+    ('SELECT k, count(*) FROM read_cache_bad_stream GROUP BY k', {'read_cache_key': 'nonexistent'}),
+    ('SELECT k, count(*) FROM read_cache_bad_stream GROUP BY k', {'read_cache_key': 'k', 'max_age': '1 minute'}),
+    ('SELECT k, count(*) FROM read_cache_bad_stream GROUP BY k', {'read_cache_key': 'k', 'delta_merge': True}),
+  ]
+
+  for q, opts in bad:
+    try:
+      pipeline.create_cv('test_read_cache_bad', q, **opts)
+      assert False
+    except Exception:
+      pass
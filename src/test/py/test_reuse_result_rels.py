@@ -0,0 +1,38 @@
+from base import pipeline, clean_db
+
+
+def test_reuse_result_rels(pipeline, clean_db):
+  """
+  Verify that combiners keeping matrel index information across syncs still maintain
+  indexes created on matrels after they've started writing to them
+  """
+  pipeline.create_stream('reuse_stream', k='integer', v='integer')
+  pipeline.create_cv('test_reuse', 'SELECT k, COUNT(*), MAX(v) FROM reuse_stream GROUP BY k')
+
+  pipeline.insert('reuse_stream', ('k', 'v'), [(k, k) for k in xrange(100)])
+
+  pipeline.execute('CREATE INDEX test_reuse_max_idx ON test_reuse_mrel (max)')
+
+  pipeline.insert('reuse_stream', ('k', 'v'), [(k, k + 1000) for k in xrange(100)])
+  pipeline.insert('reuse_stream', ('k', 'v'), [(k, k) for k in xrange(100, 200)])
+
+  pipeline.execute('SET enable_seqscan TO off')
+  pipeline.execute('SET enable_bitmapscan TO off')
+
+  row = pipeline.execute('SELECT COUNT(*) FROM test_reuse_mrel WHERE max >= 1000').first()
+  assert row['count'] == 100
+
+  row = pipeline.execute('SELECT COUNT(*) FROM test_reuse_mrel WHERE max >= 100 AND max < 200').first()
+  assert row['count'] == 100
+
+  row = pipeline.execute('SELECT COUNT(*) FROM test_reuse_mrel WHERE max < 100').first()
+  assert row['count'] == 0
+
+  pipeline.execute('RESET enable_seqscan')
+  pipeline.execute('RESET enable_bitmapscan')
+
+  pipeline.execute('DROP INDEX test_reuse_max_idx')
+  pipeline.insert('reuse_stream', ('k', 'v'), [(k, k) for k in xrange(200)])
+
+  for row in pipeline.execute('SELECT * FROM test_reuse'):
+    assert row['count'] == (3 if row['k'] < 100 else 2)
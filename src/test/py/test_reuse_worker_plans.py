@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_reuse_worker_plans(pipeline, clean_db):
+  """
+  Verify that plans kept across worker batches start each batch from scratch, and
+  that they're rebuilt when the views they belong to change
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_reuse_worker_plans': 'on',
+                'continuous_query_max_wait': 5})
+
+  try:
+    pipeline.create_stream('reuse_stream', x='integer', y='text')
+    pipeline.create_cv('test_reuse_grouped', 'SELECT x, COUNT(*), COUNT(DISTINCT y) FROM reuse_stream GROUP BY x')
+    pipeline.create_cv('test_reuse_plain', 'SELECT COUNT(*), SUM(x) FROM reuse_stream')
+
+    for i in xrange(50):
+      pipeline.insert('reuse_stream', ('x', 'y'), [(n % 5, 'y%d' % (i % 3)) for n in xrange(10)])
+
+    rows = list(pipeline.execute('SELECT * FROM test_reuse_grouped ORDER BY x'))
+    assert len(rows) == 5
+    for row in rows:
+      assert row['count'] == 100
+
+    row = pipeline.execute('SELECT * FROM test_reuse_plain').first()
+    assert row['count'] == 500
+    assert row['sum'] == 50 * sum(n % 5 for n in xrange(10))
+
+    # Replace one of the views while the other's plan is kept
+    pipeline.execute('DROP CONTINUOUS VIEW test_reuse_plain')
+    pipeline.create_cv('test_reuse_plain', 'SELECT COUNT(*), MAX(x) FROM reuse_stream')
+
+    for i in xrange(10):
+      pipeline.insert('reuse_stream', ('x', 'y'), [(n, 'y') for n in xrange(10)])
+
+    row = pipeline.execute('SELECT * FROM test_reuse_plain').first()
+    assert row['count'] == 100
+    assert row['max'] == 9
+
+    row = pipeline.execute('SELECT SUM(count) FROM test_reuse_grouped').first()
+    assert row['sum'] == 600
+  finally:
+    pipeline.stop()
+    pipeline.run()
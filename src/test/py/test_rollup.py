@@ -0,0 +1,73 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_rollup(pipeline, clean_db):
+  """
+  Verify that rollups of a continuous view match views reading the same streams directly
+  """
+  pipeline.create_stream('rollup_stream', k='integer', x='integer')
+  pipeline.create_cv('test_rollup_fine',
+                     'SELECT k, k % 3 AS m, count(*), sum(x), avg(x), count(DISTINCT x) '
+                     'FROM rollup_stream GROUP BY k, m')
+  pipeline.create_cv('test_rollup_coarse',
+                     'SELECT m * 2 AS m2, combine(count) AS count, combine(sum) AS sum, '
+                     'combine(avg) AS avg FROM test_rollup_fine GROUP BY m2')
+  pipeline.create_cv('test_rollup_total', 'SELECT combine(count) AS count FROM test_rollup_fine')
+  pipeline.create_cv('test_rollup_direct',
+                     'SELECT (k % 3) * 2 AS m2, count(*), sum(x), avg(x) FROM rollup_stream GROUP BY m2')
+
+  def check():
+    # rollups are given their partial results once the source view's combiners have committed
+    time.sleep(1)
+    rollup = list(pipeline.execute('SELECT * FROM test_rollup_coarse ORDER BY m2'))
+    direct = list(pipeline.execute('SELECT * FROM test_rollup_direct ORDER BY m2'))
+    assert len(rollup) == len(direct)
+    for r, d in zip(rollup, direct):
+      assert r['m2'] == d['m2']
+      assert r['count'] == d['count']
+      assert r['sum'] == d['sum']
+      assert r['avg'] == d['avg']
+
+    total = pipeline.execute('SELECT count FROM test_rollup_total').first()['count']
+    assert total == sum(d['count'] for d in direct)
+
+  pipeline.insert('rollup_stream', ('k', 'x'), [(n % 10, n) for n in xrange(1000)])
+  check()
+
+  pipeline.insert('rollup_stream', ('k', 'x'), [(n % 4, n * 7) for n in xrange(1000)])
+  check()
+
+
+def test_rollup_validation(pipeline, clean_db):
+  """
+  Verify that rollups may only group on grouping columns and combine aggregate columns
+  """
+  pipeline.create_stream('rollup_bad_stream', k='integer', x='integer')
+  pipeline.create_cv('test_rollup_src', 'SELECT k, count(*), sum(x) FROM rollup_bad_stream GROUP BY k')
+  pipeline.create_cv('test_rollup_sw', 'SELECT k, count(*) FROM rollup_bad_stream GROUP BY k',
+                     max_age='1 minute')
+
+  bad = [
+    'SELECT k, count FROM test_rollup_src',
+    'SELECT combine(k) FROM test_rollup_src',
+    'SELECT sum(x) FROM test_rollup_src',
+    'SELECT count, combine(sum) FROM test_rollup_src GROUP BY count',
+    'SELECT combine(count) FROM test_rollup_src WHERE k > 1',
+    'SELECT k, combine(count) FROM test_rollup_sw GROUP BY k',
+  ]
+
+  for q in bad:
+    try:
+      pipeline.create_cv('test_rollup_bad', q)
+      assert False
+    except Exception:
+      pass
+
+  # a rollup can't outlive its source view
+  pipeline.create_cv('test_rollup_dep', 'SELECT combine(count) AS count FROM test_rollup_src')
+  try:
+    pipeline.execute('DROP CONTINUOUS VIEW test_rollup_src')
+    assert False
+  except Exception:
+    pass
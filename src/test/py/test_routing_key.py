@@ -0,0 +1,23 @@
+from base import pipeline, clean_db
+
+
+def test_routing_key(pipeline, clean_db):
+  """
+  Verify that routing stream tuples to workers by key doesn't lose or duplicate any events
+  """
+  pipeline.execute("CREATE STREAM routed (k text, x int) OPTIONS (routing_key 'k')")
+  pipeline.create_cv('test_routing_key', 'SELECT k, COUNT(*), SUM(x) FROM routed GROUP BY k')
+
+  rows = [('key%d' % (i % 20), i) for i in xrange(10000)]
+  rows.extend([(None, 1)] * 100)
+  pipeline.insert('routed', ('k', 'x'), rows)
+
+  result = list(pipeline.execute('SELECT * FROM test_routing_key WHERE k IS NOT NULL ORDER BY k'))
+  assert len(result) == 20
+  for row in result:
+    assert row['count'] == 500
+
+  result = list(pipeline.execute('SELECT * FROM test_routing_key WHERE k IS NULL'))
+  assert len(result) == 1
+  assert result[0]['count'] == 100
+  assert result[0]['sum'] == 100
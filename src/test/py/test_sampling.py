@@ -0,0 +1,50 @@
+from base import pipeline, clean_db
+
+
+def test_sampled_view(pipeline, clean_db):
+  """
+  Verify that a view with a sample rate only reads around that fraction of its stream's events
+  """
+  pipeline.create_stream('sample_stream', x='integer')
+  pipeline.create_cv('test_sampled', 'SELECT count(*) FROM sample_stream', sample=0.1)
+  pipeline.create_cv('test_unsampled', 'SELECT count(*) FROM sample_stream')
+
+  pipeline.insert('sample_stream', ('x', ), [(n, ) for n in xrange(100000)])
+
+  assert pipeline.execute('SELECT count FROM test_unsampled').first()['count'] == 100000
+
+  count = pipeline.execute('SELECT count FROM test_sampled').first()['count']
+  assert 8000 < count < 12000
+
+
+def test_sampled_transform(pipeline, clean_db):
+  """
+  Verify that transforms can be sampled as well
+  """
+  pipeline.create_stream('sample_ct_in', x='integer')
+  pipeline.create_stream('sample_ct_out', x='integer')
+  pipeline.execute("""
+  CREATE CONTINUOUS TRANSFORM test_sampled_ct WITH (sample = 0.5) AS SELECT x FROM sample_ct_in
+  THEN EXECUTE PROCEDURE pipeline_stream_insert('sample_ct_out')
+  """)
+  pipeline.create_cv('test_sampled_ct_count', 'SELECT count(*) FROM sample_ct_out')
+
+  pipeline.insert('sample_ct_in', ('x', ), [(n, ) for n in xrange(20000)])
+
+  count = pipeline.execute('SELECT count FROM test_sampled_ct_count').first()['count']
+  assert 8000 < count < 12000
+
+
+def test_invalid_sample(pipeline, clean_db):
+  """
+  Verify that sample rates must be in (0, 1]
+  """
+  pipeline.create_stream('sample_bad_stream', x='integer')
+
+  for rate in [0, -0.5, 1.5, "'a'"]:
+    try:
+      pipeline.execute('CREATE CONTINUOUS VIEW test_sample_bad WITH (sample = %s) AS '
+                       'SELECT count(*) FROM sample_bad_stream' % rate)
+      assert False
+    except Exception:
+      pass
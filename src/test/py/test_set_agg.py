@@ -0,0 +1,36 @@
+from base import pipeline, clean_db
+
+
+def test_set_agg_groups(pipeline, clean_db):
+  """
+  Verify that set_agg and exact_count_distinct keep a separate set for each group,
+  and that the sets of many groups combine
+  """
+  q = """
+  SELECT k::integer, set_agg(x::integer) AS s, exact_count_distinct(x::integer) AS c
+  FROM test_set_agg_stream GROUP BY k
+  """
+  pipeline.create_cv('test_set_agg', q)
+
+  rows = []
+  for n in xrange(2000):
+    rows.append((n % 10, n % 100))
+    rows.append((n % 10, n % 100))
+
+  pipeline.insert('test_set_agg_stream', ('k', 'x'), rows)
+
+  result = list(pipeline.execute(
+    'SELECT k, array_length(s, 1), c FROM test_set_agg ORDER BY k'))
+  assert len(result) == 10
+  for r in result:
+    assert r[1] == 10
+    assert r[2] == 10
+
+  result = pipeline.execute(
+    'SELECT array_length(combine(s), 1), combine(c) FROM test_set_agg').first()
+  assert result[0] == 100
+  assert result[1] == 100
+
+  # Values are kept in the order they were first added
+  result = pipeline.execute('SELECT s FROM test_set_agg WHERE k = 3').first()
+  assert result[0] == range(3, 100, 10)
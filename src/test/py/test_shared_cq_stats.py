@@ -0,0 +1,30 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_shared_cq_stats(pipeline, clean_db):
+  """
+  Verify that continuous query counters are readable as soon as they change,
+  without waiting for the stats collector
+  """
+  pipeline.create_stream('shared_stats_stream', x='integer')
+  pipeline.create_cv('test_shared_stats', 'SELECT x % 10 AS g, COUNT(*) FROM shared_stats_stream GROUP BY g')
+
+  # The stats functions only list entries the collector already knows about
+  pipeline.insert('shared_stats_stream', ('x', ), [(x, ) for x in xrange(1000)])
+  time.sleep(1)
+
+  pipeline.insert('shared_stats_stream', ('x', ), [(x, ) for x in xrange(1000)])
+
+  # Well within the collector's reporting interval
+  row = None
+  for _ in xrange(8):
+    row = pipeline.execute("SELECT * FROM pipeline_query_stats WHERE name = 'test_shared_stats' AND type = 'worker'").first()
+    if row['input_rows'] == 2000:
+      break
+    time.sleep(0.05)
+
+  assert row['input_rows'] == 2000
+
+  rows = list(pipeline.execute("SELECT * FROM pipeline_proc_stats WHERE type = 'worker'"))
+  assert sum(r['input_rows'] for r in rows) >= 2000
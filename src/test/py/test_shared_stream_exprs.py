@@ -0,0 +1,49 @@
+from base import pipeline, clean_db
+import json
+
+
+def test_shared_stream_exprs(pipeline, clean_db):
+  """
+  Verify that queries sharing expressions over the same stream's columns all see the right
+  values when those expressions are only computed once per event
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_shared_stream_exprs': 'on'})
+
+  try:
+    pipeline.create_stream('shared_exprs_stream', x='integer', payload='json')
+    pipeline.create_stream('shared_exprs_other', x='integer', payload='json')
+
+    for i in xrange(5):
+      pipeline.create_cv('test_shared_exprs_%d' % i,
+                         "SELECT (payload->>'user')::text AS u, COUNT(*), SUM(x) AS x "
+                         "FROM shared_exprs_stream WHERE (payload->>'n')::integer >= %d GROUP BY u" % i)
+    pipeline.create_cv('test_shared_exprs_distinct',
+                       "SELECT COUNT(DISTINCT payload->>'user') AS users, "
+                       "SUM((payload->>'n')::integer) AS n FROM shared_exprs_stream")
+    pipeline.create_cv('test_shared_exprs_other',
+                       "SELECT (payload->>'user')::text AS u, COUNT(*) FROM shared_exprs_other GROUP BY u")
+
+    rows = [(i, json.dumps({'user': 'u%d' % (i % 7), 'n': i % 10})) for i in xrange(1000)]
+    pipeline.insert('shared_exprs_stream', ('x', 'payload'), [(x, p) for x, p in rows])
+    pipeline.insert('shared_exprs_other', ('x', 'payload'), [(x, json.dumps({'user': 'o%d' % (x % 3)}))
+                                                             for x in xrange(100)])
+
+    for i in xrange(5):
+      result = list(pipeline.execute('SELECT * FROM test_shared_exprs_%d' % i))
+      assert len(result) == 7
+      for row in result:
+        expected = [x for x, p in rows if json.loads(p)['n'] >= i and json.loads(p)['user'] == row['u']]
+        assert row['count'] == len(expected)
+        assert row['x'] == sum(expected)
+
+    row = pipeline.execute('SELECT * FROM test_shared_exprs_distinct').first()
+    assert row['users'] == 7
+    assert row['n'] == sum(x % 10 for x, _ in rows)
+
+    result = list(pipeline.execute('SELECT * FROM test_shared_exprs_other ORDER BY u'))
+    assert [r['u'] for r in result] == ['o0', 'o1', 'o2']
+    assert sum(r['count'] for r in result) == 100
+  finally:
+    pipeline.stop()
+    pipeline.run()
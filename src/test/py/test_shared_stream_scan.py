@@ -0,0 +1,35 @@
+from base import pipeline, clean_db
+
+
+def test_shared_stream_scan(pipeline, clean_db):
+  """
+  Verify that many queries reading the same events in a batch all see the right values
+  when events are only decoded once per batch
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_shared_stream_scan': 'on'})
+
+  try:
+    pipeline.create_stream('shared_stream', x='integer', y='text', z='float8')
+
+    for i in xrange(10):
+      pipeline.create_cv('test_shared_%d' % i,
+                         'SELECT y, COUNT(*), SUM(x) AS x, SUM(z) AS z FROM shared_stream WHERE x >= %d GROUP BY y' % i)
+    pipeline.create_cv('test_shared_z', 'SELECT COUNT(*), SUM(z) AS z FROM shared_stream')
+
+    rows = [(i % 20, 'y%d' % (i % 3) if i % 7 else None, i * 0.5) for i in xrange(1000)]
+    pipeline.insert('shared_stream', ('x', 'y', 'z'), rows)
+
+    for i in xrange(10):
+      for row in pipeline.execute('SELECT * FROM test_shared_%d' % i):
+        expected = [r for r in rows if r[0] >= i and r[1] == row['y']]
+        assert row['count'] == len(expected)
+        assert row['x'] == sum(r[0] for r in expected)
+        assert row['z'] == sum(r[2] for r in expected)
+
+    row = pipeline.execute('SELECT * FROM test_shared_z').first()
+    assert row['count'] == 1000
+    assert row['z'] == sum(r[2] for r in rows)
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,38 @@
+from base import pipeline, clean_db
+
+
+def test_shared_sw_steps(pipeline, clean_db):
+  """
+  Verify that sliding-window views only differing in window length, whose workers share
+  step-level partial results, each end up with all of their events
+  """
+  pipeline.create_stream('shared_sw_stream', x='integer', y='integer')
+
+  # all of these windows have 30 second steps
+  for name, max_age, step_factor in [('1m', '1 minute', 50), ('5m', '5 minutes', 10),
+                                     ('10m', '10 minutes', 5)]:
+    pipeline.create_cv('test_shared_sw_%s' % name,
+                       'SELECT x, COUNT(*), SUM(y) FROM shared_sw_stream GROUP BY x',
+                       max_age=max_age, step_factor=step_factor)
+
+  # a different filter means different partial results, so this one can't share
+  pipeline.create_cv('test_shared_sw_filtered',
+                     'SELECT x, COUNT(*), SUM(y) FROM shared_sw_stream WHERE y > 5 GROUP BY x',
+                     max_age='1 minute', step_factor=50)
+
+  rows = [(x, y) for x in xrange(10) for y in xrange(10)]
+  for _ in xrange(10):
+    pipeline.insert('shared_sw_stream', ('x', 'y'), rows)
+
+  for name in ['1m', '5m', '10m']:
+    result = list(pipeline.execute('SELECT * FROM test_shared_sw_%s ORDER BY x' % name))
+    assert len(result) == 10
+    for row in result:
+      assert row['count'] == 100
+      assert row['sum'] == 450
+
+  result = list(pipeline.execute('SELECT * FROM test_shared_sw_filtered ORDER BY x'))
+  assert len(result) == 10
+  for row in result:
+    assert row['count'] == 40
+    assert row['sum'] == 300
@@ -0,0 +1,93 @@
+from base import pipeline, clean_db
+import time
+
+
+def _wait_for_rows(pipeline, table, n, timeout=10):
+  start = time.time()
+  while time.time() - start < timeout:
+    total = pipeline.execute('SELECT coalesce(sum(n), 0) AS n FROM %s' % table).first()['n']
+    if total >= n:
+      return total
+    time.sleep(0.1)
+  return total
+
+
+def test_sink(pipeline, clean_db):
+  """
+  Verify that rows output to pipeline_sink are delivered to its sink function in batches
+  """
+  pipeline.create_stream('sink_stream', x='integer')
+  pipeline.create_table('sink_out', n='integer')
+  pipeline.execute("""
+  CREATE FUNCTION sink_deliver(rows anyarray) RETURNS void AS $$
+  BEGIN
+    INSERT INTO sink_out (n) VALUES (array_length(rows, 1));
+  END;
+  $$ LANGUAGE plpgsql
+  """)
+
+  pipeline.create_ct('test_sink_ct', 'SELECT x FROM sink_stream WHERE x % 2 = 0',
+                     "pipeline_sink('sink_deliver')")
+
+  pipeline.insert('sink_stream', ('x', ), [(n, ) for n in xrange(10000)])
+
+  assert _wait_for_rows(pipeline, 'sink_out', 5000) == 5000
+
+  # the sink function is called once per batch, not once per row
+  calls = pipeline.execute('SELECT count(*) FROM sink_out').first()['count']
+  assert calls < 5000
+
+  # the sink function can't be dropped while a transform delivers to it
+  try:
+    pipeline.execute('DROP FUNCTION sink_deliver(anyarray)')
+    assert False
+  except Exception:
+    pass
+
+  pipeline.execute('DROP CONTINUOUS TRANSFORM test_sink_ct')
+  pipeline.execute('DROP FUNCTION sink_deliver(anyarray)')
+  pipeline.execute('DROP TABLE sink_out')
+
+
+def test_sink_retries(pipeline, clean_db):
+  """
+  Verify that failed deliveries are retried
+  """
+  pipeline.create_stream('sink_retry_stream', x='integer')
+  pipeline.create_table('sink_retry_out', n='integer')
+  pipeline.execute('CREATE SEQUENCE sink_attempts')
+  pipeline.execute("""
+  CREATE FUNCTION sink_flaky(rows anyarray) RETURNS void AS $$
+  BEGIN
+    -- sequences aren't rolled back, so only the first attempt fails
+    IF nextval('sink_attempts') = 1 THEN
+      RAISE EXCEPTION 'delivery failed';
+    END IF;
+    INSERT INTO sink_retry_out (n) VALUES (array_length(rows, 1));
+  END;
+  $$ LANGUAGE plpgsql
+  """)
+
+  pipeline.create_ct('test_sink_retry_ct', 'SELECT x FROM sink_retry_stream', "pipeline_sink('sink_flaky')")
+  pipeline.insert('sink_retry_stream', ('x', ), [(n, ) for n in xrange(100)])
+
+  assert _wait_for_rows(pipeline, 'sink_retry_out', 100) == 100
+
+  pipeline.execute('DROP CONTINUOUS TRANSFORM test_sink_retry_ct')
+  pipeline.execute('DROP FUNCTION sink_flaky(anyarray)')
+  pipeline.execute('DROP TABLE sink_retry_out')
+  pipeline.execute('DROP SEQUENCE sink_attempts')
+
+
+def test_sink_validation(pipeline, clean_db):
+  """
+  Verify that pipeline_sink must be given a single sink function
+  """
+  pipeline.create_stream('sink_bad_stream', x='integer')
+
+  for args in ["", "'no_such_function'", "'a', 'b'"]:
+    try:
+      pipeline.create_ct('test_sink_bad', 'SELECT x FROM sink_bad_stream', 'pipeline_sink(%s)' % args)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+import random
+
+
+def test_stream_batch_id(pipeline, clean_db):
+  """
+  Verify that a stream batch written with an id that was already written is dropped, and that combiners
+  record the ids of the batches they commit
+  """
+  pipeline.create_stream('batch_id_stream', k='integer')
+  pipeline.create_cv('test_batch_id', 'SELECT k, count(*) FROM batch_id_stream GROUP BY k')
+
+  id = random.randint(1, 2 ** 62)
+  rows = [(x % 10, ) for x in xrange(1000)]
+
+  try:
+    pipeline.execute("SET stream_insert_batch_id = '%d'" % id)
+    pipeline.insert('batch_id_stream', ('k', ), rows)
+    # a retry of the same batch is dropped
+    pipeline.insert('batch_id_stream', ('k', ), rows)
+
+    pipeline.execute("SET stream_insert_batch_id = '%d'" % (id + 1))
+    pipeline.insert('batch_id_stream', ('k', ), rows)
+  finally:
+    pipeline.execute('RESET stream_insert_batch_id')
+
+  # writes without a batch id are never dropped
+  pipeline.insert('batch_id_stream', ('k', ), rows)
+  pipeline.insert('batch_id_stream', ('k', ), rows)
+
+  assert pipeline.execute('SELECT sum(count) FROM test_batch_id').first()['sum'] == 4000
+
+  n = pipeline.execute('SELECT count(DISTINCT id) FROM pipeline_stream_batch WHERE id IN (%d, %d)' % (id, id + 1)).first()
+  assert n['count'] == 2
+
+
+def test_stream_batch_id_invalid(pipeline, clean_db):
+  """
+  Verify that stream batch ids must be positive bigints
+  """
+  for id in ['0', '-1', 'abc']:
+    try:
+      pipeline.execute("SET stream_insert_batch_id = '%s'" % id)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,42 @@
+from base import pipeline, clean_db, ROOT
+import getpass
+import os
+import subprocess
+
+
+def test_stream_capture_replay(pipeline, clean_db):
+  """
+  Verify that stream inserts are captured when stream_capture_directory is set,
+  and that replaying the capture into another stream reproduces its events
+  """
+  pipeline.create_stream('capture_stream', x='integer', y='text')
+  pipeline.create_stream('replay_stream', x='integer', y='text')
+  pipeline.create_cv('test_capture_replay',
+                     'SELECT x % 10 AS g, count(*) AS n, sum(x) AS s, count(DISTINCT y) AS d FROM replay_stream GROUP BY g')
+
+  pipeline.stop()
+  try:
+    pipeline.run({'stream_capture_directory': 'capture'})
+
+    for _ in xrange(5):
+      pipeline.insert('capture_stream', ('x', 'y'), [(x, 'y%d' % x) for x in xrange(100)])
+    pipeline.insert('capture_stream', ('x', ), [(1000, )])
+  finally:
+    pipeline.stop()
+    pipeline.run()
+
+  capture = os.path.join(pipeline.data_dir, 'capture')
+  assert [f for f in os.listdir(capture) if f.endswith('.capture')]
+
+  # replay with capture off, so that the replayed events aren't captured again
+  replay = os.path.join(ROOT, 'bin', 'replay-capture')
+  subprocess.check_call([replay, capture, '--port', str(pipeline.port), '--user', getpass.getuser(),
+                         '--speed', '0', '--map', 'public.capture_stream=public.replay_stream'])
+  pipeline.execute('SELECT pipeline_flush()')
+
+  rows = list(pipeline.execute('SELECT * FROM test_capture_replay ORDER BY g'))
+  assert len(rows) == 10
+  assert sum(r['n'] for r in rows) == 501
+  assert sum(r['s'] for r in rows) == 5 * sum(xrange(100)) + 1000
+  assert rows[0]['n'] == 51
+  assert rows[0]['d'] == 10
@@ -0,0 +1,38 @@
+from base import pipeline, clean_db
+
+
+def test_stream_column_pruning(pipeline, clean_db):
+  """
+  Verify that columns no reader needs are stripped from events without affecting results,
+  and that the set of read columns follows CREATE and DROP CONTINUOUS VIEW
+  """
+  pipeline.create_stream('prune_stream', a='integer', b='text', c='integer', d='text')
+  pipeline.create_cv('test_prune_a', 'SELECT SUM(a) AS a FROM prune_stream')
+  pipeline.create_cv('test_prune_b', 'SELECT b, COUNT(*) FROM prune_stream WHERE c > 0 GROUP BY b')
+
+  rows = [(i, 'b%d' % (i % 2), i % 3, 'd' * 100) for i in xrange(100)]
+  pipeline.insert('prune_stream', ('a', 'b', 'c', 'd'), rows)
+
+  row = pipeline.execute('SELECT * FROM test_prune_a').first()
+  assert row['a'] == sum(r[0] for r in rows)
+
+  for row in pipeline.execute('SELECT * FROM test_prune_b'):
+    assert row['count'] == len([r for r in rows if r[1] == row['b'] and r[2] > 0])
+
+  # A new reader of d must start seeing it right away
+  pipeline.create_cv('test_prune_d', 'SELECT COUNT(*), MAX(length(d)) AS d FROM prune_stream')
+  pipeline.insert('prune_stream', ('a', 'b', 'c', 'd'), rows)
+
+  row = pipeline.execute('SELECT * FROM test_prune_d').first()
+  assert row['count'] == 100
+  assert row['d'] == 100
+
+  row = pipeline.execute('SELECT * FROM test_prune_a').first()
+  assert row['a'] == 2 * sum(r[0] for r in rows)
+
+  pipeline.execute('DROP CONTINUOUS VIEW test_prune_d')
+  pipeline.execute('DROP CONTINUOUS VIEW test_prune_b')
+  pipeline.insert('prune_stream', ('a', 'b', 'c', 'd'), rows)
+
+  row = pipeline.execute('SELECT * FROM test_prune_a').first()
+  assert row['a'] == 3 * sum(r[0] for r in rows)
@@ -0,0 +1,59 @@
+from base import pipeline, clean_db
+
+
+def test_decoding_routes(pipeline, clean_db):
+  """
+  Verify that rows inserted into or updated in routed tables are written to their streams when
+  a pipeline_decoding slot is consumed, and that other changes are ignored
+  """
+  pipeline.stop()
+  pipeline.run({'wal_level': 'logical', 'max_replication_slots': 4})
+
+  try:
+    pipeline.create_stream('decoding_stream', x='integer', y='text')
+    pipeline.create_cv('test_decoding_routes',
+                       'SELECT x::integer, COUNT(*), MAX(y::text) AS y FROM decoding_stream GROUP BY x')
+    pipeline.create_table('decoding_t', x='integer', y='text')
+    pipeline.create_table('decoding_ignored', x='integer', y='text')
+
+    pipeline.execute("SELECT pg_create_logical_replication_slot('decoding_slot', 'pipeline_decoding')")
+
+    pipeline.insert('decoding_t', ('x', 'y'), [(x % 10, 'a') for x in xrange(1000)])
+    pipeline.insert('decoding_ignored', ('x', 'y'), [(x % 10, 'a') for x in xrange(1000)])
+    pipeline.execute("UPDATE decoding_t SET y = 'b' WHERE x = 0")
+    pipeline.execute('DELETE FROM decoding_t WHERE x = 1')
+
+    # nothing is written to the stream until the slot is consumed
+    assert pipeline.execute('SELECT COUNT(*) FROM test_decoding_routes').first()['count'] == 0
+
+    row = pipeline.execute("SELECT sum(data::integer) AS n FROM pg_logical_slot_get_changes("
+                           "'decoding_slot', NULL, NULL, 'route', 'decoding_t=decoding_stream')").first()
+    assert row['n'] == 1100
+
+    pipeline.execute('SELECT pg_sleep(1)')
+
+    rows = list(pipeline.execute('SELECT x, count, y FROM test_decoding_routes ORDER BY x'))
+    assert len(rows) == 10
+    assert rows[0]['count'] == 200
+    assert rows[0]['y'] == 'b'
+    for row in rows[1:]:
+      assert row['count'] == 100
+      assert row['y'] == 'a'
+
+    # consumed changes aren't written again
+    row = pipeline.execute("SELECT sum(data::integer) AS n FROM pg_logical_slot_get_changes("
+                           "'decoding_slot', NULL, NULL, 'route', 'decoding_t=decoding_stream')").first()
+    assert row['n'] is None
+
+    for route in ('decoding_t', 'decoding_t=decoding_ignored', 'decoding_stream=decoding_stream'):
+      try:
+        pipeline.execute("SELECT * FROM pg_logical_slot_get_changes("
+                         "'decoding_slot', NULL, NULL, 'route', '%s')" % route)
+        assert False
+      except Exception:
+        pass
+
+    pipeline.execute("SELECT pg_drop_replication_slot('decoding_slot')")
+  finally:
+    pipeline.stop()
+    pipeline.run()
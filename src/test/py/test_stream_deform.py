@@ -0,0 +1,33 @@
+from base import pipeline, clean_db
+
+
+def test_stream_deform(pipeline, clean_db):
+  """
+  Verify that events are decoded correctly whether or not they contain nulls, and whatever
+  mix of fixed and variable width attributes a view reads
+  """
+  pipeline.create_stream('deform_stream', a='int2', b='int8', c='float8', d='text', e='integer', f='boolean')
+  pipeline.create_cv('test_deform_fixed', 'SELECT COUNT(*), SUM(a) AS a, SUM(b) AS b, SUM(c) AS c FROM deform_stream')
+  pipeline.create_cv('test_deform_after_text',
+                     'SELECT COUNT(e) AS ce, SUM(e) AS e, COUNT(DISTINCT d) AS d, '
+                     'bool_or(f) AS f, MIN(arrival_timestamp) IS NOT NULL AS ts FROM deform_stream')
+
+  rows = [(i % 100, i * 1000000000, i + 0.5, 'd%d' % (i % 3) * (i % 4 + 1), i, i % 2 == 0) for i in xrange(500)]
+  pipeline.insert('deform_stream', ('a', 'b', 'c', 'd', 'e', 'f'), rows)
+
+  # these events have nulls, and leave out attributes entirely
+  pipeline.insert('deform_stream', ('a', 'e'), [(1, 2)] * 100)
+  pipeline.insert('deform_stream', ('b', 'd'), [(3, 'x')] * 100)
+
+  row = pipeline.execute('SELECT * FROM test_deform_fixed').first()
+  assert row['count'] == 700
+  assert row['a'] == sum(r[0] for r in rows) + 100
+  assert row['b'] == sum(r[1] for r in rows) + 300
+  assert row['c'] == sum(r[2] for r in rows)
+
+  row = pipeline.execute('SELECT * FROM test_deform_after_text').first()
+  assert row['ce'] == 600
+  assert row['e'] == sum(r[4] for r in rows) + 200
+  assert row['d'] == 13
+  assert row['f']
+  assert row['ts']
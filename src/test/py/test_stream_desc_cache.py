@@ -0,0 +1,33 @@
+from base import pipeline, clean_db
+
+
+def test_stream_desc_cache(pipeline, clean_db):
+  """
+  Verify that events are projected correctly when the cached descriptor they were
+  written with changes, both across batches and after the stream is altered
+  """
+  pipeline.create_stream('desc_stream', x='integer', y='integer')
+  pipeline.create_cv('test_desc_cache', 'SELECT COUNT(*), SUM(x) AS x, SUM(y) AS y FROM desc_stream')
+
+  for _ in xrange(10):
+    pipeline.insert('desc_stream', ('x', 'y'), [(1, 2)] * 10)
+    pipeline.insert('desc_stream', ('y', ), [(3, )] * 10)
+
+  row = pipeline.execute('SELECT * FROM test_desc_cache').first()
+  assert row['count'] == 200
+  assert row['x'] == 100
+  assert row['y'] == 500
+
+  pipeline.execute('ALTER STREAM desc_stream ADD z integer')
+  pipeline.create_cv('test_desc_cache_z', 'SELECT COUNT(*), SUM(z) AS z FROM desc_stream')
+
+  for _ in xrange(10):
+    pipeline.insert('desc_stream', ('x', 'z'), [(1, 4)] * 10)
+
+  row = pipeline.execute('SELECT * FROM test_desc_cache').first()
+  assert row['count'] == 300
+  assert row['x'] == 200
+
+  row = pipeline.execute('SELECT * FROM test_desc_cache_z').first()
+  assert row['count'] == 100
+  assert row['z'] == 400
@@ -0,0 +1,48 @@
+from base import pipeline, clean_db
+
+
+def test_stream_filter_pushdown(pipeline, clean_db):
+  """
+  Verify that views with simple WHERE clauses see exactly the events they would have
+  selected themselves, regardless of whether the filter is evaluated before enqueueing
+  """
+  pipeline.create_stream('filter_stream', event_type='text', x='integer', y='integer')
+  pipeline.create_cv('test_filter_click',
+                     "SELECT COUNT(*), SUM(x) AS x FROM filter_stream WHERE event_type = 'click'")
+  pipeline.create_cv('test_filter_range',
+                     'SELECT COUNT(*) FROM filter_stream WHERE x > 5 AND (y IS NULL OR y < 3)')
+  # x / y can fail, so it's only evaluated by the worker
+  pipeline.create_cv('test_filter_mixed',
+                     "SELECT COUNT(*) FROM filter_stream WHERE event_type IN ('view', 'click') AND x / y > 0")
+  pipeline.create_cv('test_filter_none', 'SELECT COUNT(*) FROM filter_stream')
+
+  rows = []
+  for i in xrange(1000):
+    event_type = 'click' if i % 100 == 0 else 'view'
+    rows.append((event_type, i % 10, i % 4 + 1))
+
+  for _ in xrange(2):
+    pipeline.insert('filter_stream', ('event_type', 'x', 'y'), rows)
+    pipeline.insert('filter_stream', ('event_type', 'x'), [('click', 7)] * 10)
+
+  row = pipeline.execute('SELECT * FROM test_filter_click').first()
+  assert row['count'] == 2 * (10 + 10)
+  assert row['x'] == 2 * (sum(r[1] for r in rows if r[0] == 'click') + 70)
+
+  row = pipeline.execute('SELECT * FROM test_filter_range').first()
+  assert row['count'] == 2 * (len([r for r in rows if r[1] > 5 and r[2] < 3]) + 10)
+
+  row = pipeline.execute('SELECT * FROM test_filter_mixed').first()
+  assert row['count'] == 2 * len([r for r in rows if r[1] / r[2] > 0])
+
+  row = pipeline.execute('SELECT * FROM test_filter_none').first()
+  assert row['count'] == 2 * 1010
+
+  # Nothing wants these events, but synchronous inserts must still return
+  pipeline.execute('DROP CONTINUOUS VIEW test_filter_mixed')
+  pipeline.execute('DROP CONTINUOUS VIEW test_filter_none')
+  pipeline.execute('DROP CONTINUOUS VIEW test_filter_range')
+  pipeline.insert('filter_stream', ('event_type', 'x'), [('view', 1)] * 100)
+
+  row = pipeline.execute('SELECT * FROM test_filter_click').first()
+  assert row['count'] == 2 * (10 + 10)
@@ -0,0 +1,33 @@
+from base import pipeline, clean_db
+
+
+def test_batched_stream_insert_trigger(pipeline, clean_db):
+  """
+  Verify that rows buffered by pipeline_stream_insert_batch reach all target
+  streams, whether they're flushed by a statement level trigger or at commit
+  """
+  pipeline.create_table('tbl', x='integer')
+  pipeline.create_stream('s0', x='integer')
+  pipeline.create_stream('s1', x='integer')
+  pipeline.create_cv('cv0', 'SELECT COUNT(*), SUM(x) FROM s0')
+  pipeline.create_cv('cv1', 'SELECT COUNT(*), SUM(x) FROM s1')
+
+  pipeline.execute('CREATE TRIGGER tg AFTER INSERT ON tbl FOR EACH ROW '
+                   "EXECUTE PROCEDURE pipeline_stream_insert_batch('s0', 's1')")
+
+  # Flushed at commit
+  pipeline.execute('INSERT INTO tbl (x) SELECT x FROM generate_series(1, 25000) x')
+
+  for cv in ('cv0', 'cv1'):
+    rows = list(pipeline.execute('SELECT * FROM %s' % cv))
+    assert rows[0]['count'] == 25000
+    assert rows[0]['sum'] == 25000 * 25001 / 2
+
+  # Flushed at the end of the statement
+  pipeline.execute('CREATE TRIGGER tg_flush AFTER INSERT ON tbl FOR EACH STATEMENT '
+                   "EXECUTE PROCEDURE pipeline_stream_insert_batch('s0', 's1')")
+  pipeline.execute('INSERT INTO tbl (x) SELECT 1 FROM generate_series(1, 100) x')
+
+  for cv in ('cv0', 'cv1'):
+    rows = list(pipeline.execute('SELECT * FROM %s' % cv))
+    assert rows[0]['count'] == 25100
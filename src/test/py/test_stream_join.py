@@ -0,0 +1,76 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_stream_join(pipeline, clean_db):
+  """
+  Verify that events of two streams are joined with each other across batches while within the join window
+  """
+  # events are only buffered by the worker that read them, so both streams are routed by the join key
+  pipeline.execute("CREATE STREAM join_impressions (ad_id integer, x integer) OPTIONS (routing_key 'ad_id')")
+  pipeline.execute("CREATE STREAM join_clicks (ad_id integer, y integer) OPTIONS (routing_key 'ad_id')")
+  pipeline.create_cv('test_stream_join',
+                     'SELECT i.ad_id, count(*), sum(c.y) FROM join_impressions i '
+                     'JOIN join_clicks c ON i.ad_id = c.ad_id GROUP BY i.ad_id',
+                     join_window='1 hour')
+
+  # each stream is written to separately, so its events are joined with those of earlier batches
+  pipeline.insert('join_impressions', ('ad_id', 'x'), [(n, 1) for n in xrange(10)])
+  pipeline.insert('join_clicks', ('ad_id', 'y'), [(n, n) for n in xrange(5)])
+  pipeline.insert('join_impressions', ('ad_id', 'x'), [(n, 1) for n in xrange(5)])
+
+  rows = list(pipeline.execute('SELECT * FROM test_stream_join ORDER BY ad_id'))
+  assert len(rows) == 5
+  for row in rows:
+    assert row['count'] == 2
+    assert row['sum'] == row['ad_id'] * 2
+
+
+def test_stream_join_window(pipeline, clean_db):
+  """
+  Verify that events aren't joined with events that arrived longer than the join window ago
+  """
+  pipeline.execute("CREATE STREAM join_window_s0 (id text) OPTIONS (routing_key 'id')")
+  pipeline.execute("CREATE STREAM join_window_s1 (id text) OPTIONS (routing_key 'id')")
+  pipeline.create_cv('test_stream_join_window',
+                     'SELECT count(*) FROM join_window_s0 s0 JOIN join_window_s1 s1 ON s0.id = s1.id',
+                     join_window='1 second')
+
+  pipeline.insert('join_window_s0', ('id', ), [('a', ), ('b', )])
+  pipeline.insert('join_window_s1', ('id', ), [('a', )])
+  assert pipeline.execute('SELECT count FROM test_stream_join_window').first()['count'] == 1
+
+  time.sleep(3)
+
+  pipeline.insert('join_window_s1', ('id', ), [('b', )])
+  assert pipeline.execute('SELECT count FROM test_stream_join_window').first()['count'] == 1
+
+
+def test_stream_join_validation(pipeline, clean_db):
+  """
+  Verify that only joins of two different typed streams without sliding windows can have a join window
+  """
+  pipeline.create_stream('join_bad_s0', x='integer')
+  pipeline.create_stream('join_bad_s1', x='integer')
+
+  bad = [
+    'SELECT count(*) FROM join_bad_s0',
+    'SELECT count(*) FROM join_bad_s0 a JOIN join_bad_s0 b ON a.x = b.x',
+    'SELECT count(*) FROM join_bad_s0 a JOIN join_bad_s1 b ON a.x = b.x '
+    "WHERE a.arrival_timestamp > clock_timestamp() - interval '1 minute'",
+  ]
+
+  for q in bad:
+    try:
+      pipeline.create_cv('test_stream_join_bad', q, join_window='1 minute')
+      assert False
+    except Exception:
+      pass
+
+  # without a join window, streams still can't be joined with each other
+  try:
+    pipeline.create_cv('test_stream_join_bad',
+                       'SELECT count(*) FROM join_bad_s0 a JOIN join_bad_s1 b ON a.x = b.x')
+    assert False
+  except Exception:
+    pass
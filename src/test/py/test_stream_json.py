@@ -0,0 +1,50 @@
+from base import pipeline, clean_db
+import json
+
+
+def test_stream_json_fields(pipeline, clean_db):
+  """
+  Verify that declared JSON fields are extracted into their stream columns, for json and jsonb documents
+  """
+  for t in ('json', 'jsonb'):
+    pipeline.execute("""CREATE STREAM json_fields_%s (payload %s, x integer, name text, tags text)
+                        OPTIONS (json_fields 'x = payload.x, name = payload.user.name, tags = payload.tags')""" % (t, t))
+    pipeline.create_cv('test_json_fields_%s' % t,
+                       'SELECT name, sum(x), count(*), max(tags) AS tags FROM json_fields_%s GROUP BY name' % t)
+
+    rows = []
+    for i in xrange(100):
+      doc = {'x': i, 'user': {'name': 'user%d' % (i % 4), 'id': i}, 'tags': ['a', 'b'], 'other': {'x': -1}}
+      rows.append((json.dumps(doc), ))
+    pipeline.insert('json_fields_%s' % t, ('payload', ), rows)
+
+    # values the event already has aren't overwritten, and missing fields are NULL
+    pipeline.execute("""INSERT INTO json_fields_%s (payload, x) VALUES ('{"x": 1000, "user": {"name": "user0"}}', 1)""" % t)
+    pipeline.execute("""INSERT INTO json_fields_%s (payload) VALUES ('{"user": {"id": 1}}')""" % t)
+
+    result = list(pipeline.execute('SELECT * FROM test_json_fields_%s ORDER BY name' % t))
+    assert len(result) == 5
+
+    for i, row in enumerate(result[:4]):
+      assert row['name'] == 'user%d' % i
+      assert row['count'] == 25 + (1 if i == 0 else 0)
+      assert row['sum'] == sum(x for x in xrange(100) if x % 4 == i) + (1 if i == 0 else 0)
+      assert json.loads(row['tags']) == ['a', 'b']
+
+    assert result[4]['name'] is None
+    assert result[4]['sum'] is None
+    assert result[4]['count'] == 1
+
+
+def test_stream_json_fields_invalid(pipeline, clean_db):
+  """
+  Verify that inserts into streams with invalid json_fields options fail
+  """
+  pipeline.execute("CREATE STREAM json_fields_invalid (payload json, x integer) OPTIONS (json_fields 'y = payload.y')")
+  pipeline.create_cv('test_json_fields_invalid', 'SELECT count(*) FROM json_fields_invalid')
+
+  try:
+    pipeline.execute("""INSERT INTO json_fields_invalid (payload) VALUES ('{"y": 1}')""")
+    assert False
+  except Exception:
+    pass
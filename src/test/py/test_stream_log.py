@@ -0,0 +1,47 @@
+from base import pipeline, clean_db
+import os
+import time
+
+
+def _wait_for_count(pipeline, view, count):
+  for _ in xrange(100):
+    if pipeline.execute('SELECT count FROM %s' % view).first()['count'] == count:
+      return True
+    time.sleep(0.1)
+  return False
+
+
+def test_stream_log(pipeline, clean_db):
+  """
+  Verify that stream inserts are logged when stream_log is on, and that events that were consumed
+  before a restart aren't replayed after it
+  """
+  try:
+    pipeline.stop()
+    pipeline.run({'stream_log': 'on'})
+
+    pipeline.create_stream('stream_log_stream', x='integer')
+    pipeline.create_cv('test_stream_log', 'SELECT count(*) FROM stream_log_stream')
+
+    for _ in xrange(10):
+      pipeline.insert('stream_log_stream', ('x', ), [(x, ) for x in xrange(100)])
+
+    # inserts return once their events are logged, without waiting for them to be consumed
+    assert _wait_for_count(pipeline, 'test_stream_log', 1000)
+
+    dbid = pipeline.execute('SELECT oid FROM pg_database WHERE datname = current_database()').first()['oid']
+    log_dir = os.path.join(pipeline.data_dir, 'pg_stream_log', str(dbid))
+    assert os.path.isdir(log_dir)
+    assert any(len(f) == 16 for f in os.listdir(log_dir))
+
+    pipeline.stop()
+    pipeline.run({'stream_log': 'on'})
+    time.sleep(2)
+
+    assert pipeline.execute('SELECT count FROM test_stream_log').first()['count'] == 1000
+
+    pipeline.insert('stream_log_stream', ('x', ), [(x, ) for x in xrange(100)])
+    assert _wait_for_count(pipeline, 'test_stream_log', 1100)
+  finally:
+    pipeline.stop()
+    pipeline.run()
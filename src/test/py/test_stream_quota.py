@@ -0,0 +1,80 @@
+from base import pipeline, clean_db
+import time
+
+
+def _reset_quota(pipeline):
+  pipeline.execute('RESET stream_insert_quota_events')
+  pipeline.execute('RESET stream_insert_quota_bytes')
+  pipeline.execute('RESET stream_insert_quota_action')
+  pipeline.execute('RESET stream_insert_quota_key')
+
+
+def test_quota_reject(pipeline, clean_db):
+  """
+  Verify that inserts exceeding their quota fail with the reject action
+  """
+  pipeline.create_stream('quota_reject_stream', x='integer')
+  pipeline.create_cv('test_quota_reject', 'SELECT COUNT(*) FROM quota_reject_stream')
+
+  pipeline.execute('SET stream_insert_quota_events = 1000')
+  pipeline.execute("SET stream_insert_quota_action = 'reject'")
+  pipeline.execute("SET stream_insert_quota_key = 'stream'")
+
+  try:
+    pipeline.insert('quota_reject_stream', ('x', ), [(x, ) for x in xrange(500)])
+
+    try:
+      pipeline.insert('quota_reject_stream', ('x', ), [(x, ) for x in xrange(5000)])
+      assert False
+    except Exception:
+      pass
+  finally:
+    _reset_quota(pipeline)
+
+  row = pipeline.execute('SELECT count FROM test_quota_reject').first()
+  assert row['count'] == 500
+
+
+def test_quota_sample(pipeline, clean_db):
+  """
+  Verify that inserts exceeding their quota only write as many events as it allows with the sample action
+  """
+  pipeline.create_stream('quota_sample_stream', x='integer')
+  pipeline.create_cv('test_quota_sample', 'SELECT COUNT(*) FROM quota_sample_stream')
+
+  pipeline.execute('SET stream_insert_quota_events = 1000')
+  pipeline.execute("SET stream_insert_quota_action = 'sample'")
+  pipeline.execute("SET stream_insert_quota_key = 'stream'")
+
+  try:
+    pipeline.insert('quota_sample_stream', ('x', ), [(x, ) for x in xrange(10000)])
+  finally:
+    _reset_quota(pipeline)
+
+  row = pipeline.execute('SELECT count FROM test_quota_sample').first()
+  assert 0 < row['count'] <= 1100
+
+
+def test_quota_delay(pipeline, clean_db):
+  """
+  Verify that inserts exceeding their quota are paced to it with the delay action, without losing any events
+  """
+  pipeline.create_stream('quota_delay_stream', x='integer')
+  pipeline.create_cv('test_quota_delay', 'SELECT COUNT(*) FROM quota_delay_stream')
+
+  pipeline.execute('SET stream_insert_quota_events = 2000')
+  pipeline.execute("SET stream_insert_quota_key = 'stream'")
+
+  try:
+    start = time.time()
+    for _ in xrange(4):
+      pipeline.insert('quota_delay_stream', ('x', ), [(x, ) for x in xrange(2000)])
+    elapsed = time.time() - start
+  finally:
+    _reset_quota(pipeline)
+
+  # the first second worth of events is admitted right away, the rest at 2000 events per second
+  assert elapsed >= 2.5
+
+  row = pipeline.execute('SELECT count FROM test_quota_delay').first()
+  assert row['count'] == 8000
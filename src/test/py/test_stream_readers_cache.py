@@ -0,0 +1,60 @@
+from base import pipeline, clean_db
+import getpass
+import psycopg2
+
+
+def insert_from_new_backend(pipeline, rows):
+  conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' % (getpass.getuser(), pipeline.port))
+  conn.autocommit = True
+  cur = conn.cursor()
+  cur.execute('INSERT INTO readers_stream (x, y) VALUES %s' % ', '.join('(%d, %d)' % r for r in rows))
+  conn.close()
+
+
+def test_stream_readers_cache(pipeline, clean_db):
+  """
+  Verify that backends sharing a stream's readers write to the right views as
+  views are created, dropped, deactivated and activated
+  """
+  pipeline.create_stream('readers_stream', x='integer', y='integer')
+  pipeline.create_cv('test_readers_x', 'SELECT COUNT(*), SUM(x) FROM readers_stream')
+
+  rows = [(i, i) for i in xrange(100)]
+  for _ in xrange(5):
+    insert_from_new_backend(pipeline, rows)
+
+  row = pipeline.execute('SELECT * FROM test_readers_x').first()
+  assert row['count'] == 500
+  assert row['sum'] == 5 * sum(xrange(100))
+
+  # A new reader of another column
+  pipeline.create_cv('test_readers_y', 'SELECT COUNT(*), SUM(y) FROM readers_stream')
+
+  for _ in xrange(5):
+    insert_from_new_backend(pipeline, rows)
+
+  row = pipeline.execute('SELECT * FROM test_readers_x').first()
+  assert row['count'] == 1000
+  row = pipeline.execute('SELECT * FROM test_readers_y').first()
+  assert row['count'] == 500
+  assert row['sum'] == 5 * sum(xrange(100))
+
+  pipeline.execute('DEACTIVATE test_readers_x')
+
+  for _ in xrange(5):
+    insert_from_new_backend(pipeline, rows)
+
+  row = pipeline.execute('SELECT * FROM test_readers_x').first()
+  assert row['count'] == 1000
+  row = pipeline.execute('SELECT * FROM test_readers_y').first()
+  assert row['count'] == 1000
+
+  pipeline.execute('ACTIVATE test_readers_x')
+  pipeline.drop_cv('test_readers_y')
+
+  for _ in xrange(5):
+    insert_from_new_backend(pipeline, rows)
+
+  row = pipeline.execute('SELECT * FROM test_readers_x').first()
+  assert row['count'] == 1500
+  assert row['sum'] == 15 * sum(xrange(100))
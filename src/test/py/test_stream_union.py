@@ -0,0 +1,46 @@
+from base import pipeline, clean_db
+
+
+def test_stream_union(pipeline, clean_db):
+  """
+  Verify that a continuous view can read a UNION ALL of several streams into the same groups
+  """
+  pipeline.create_stream('union_s0', x='integer', y='integer')
+  pipeline.create_stream('union_s1', x='integer', y='integer')
+  pipeline.create_stream('union_s2', y='integer', x='integer')
+  pipeline.create_cv('test_stream_union',
+                     'SELECT x, count(*), sum(y) FROM '
+                     '(SELECT x, y FROM union_s0 UNION ALL SELECT x, y FROM union_s1 '
+                     'UNION ALL SELECT x, y FROM union_s2) s GROUP BY x')
+
+  pipeline.insert('union_s0', ('x', 'y'), [(n % 10, 1) for n in xrange(1000)])
+  pipeline.insert('union_s1', ('x', 'y'), [(n % 10, 2) for n in xrange(1000)])
+  pipeline.insert('union_s2', ('y', 'x'), [(3, n % 10) for n in xrange(1000)])
+
+  rows = list(pipeline.execute('SELECT * FROM test_stream_union ORDER BY x'))
+  assert len(rows) == 10
+  for row in rows:
+    assert row['count'] == 300
+    assert row['sum'] == 600
+
+
+def test_stream_union_validation(pipeline, clean_db):
+  """
+  Verify that only UNION ALLs of different typed streams can be read by continuous views
+  """
+  pipeline.create_stream('union_bad_s0', x='integer')
+  pipeline.create_stream('union_bad_s1', x='integer')
+
+  bad = [
+    'SELECT count(*) FROM (SELECT x FROM union_bad_s0 UNION SELECT x FROM union_bad_s1) s',
+    'SELECT count(*) FROM (SELECT x FROM union_bad_s0 UNION ALL SELECT x FROM union_bad_s0) s',
+    'SELECT count(*) FROM (SELECT x FROM union_bad_s0 UNION ALL SELECT x::integer FROM union_bad_inferred) s',
+    'SELECT count(*) FROM (SELECT x FROM union_bad_s0 UNION ALL SELECT count(*) FROM union_bad_s1) s',
+  ]
+
+  for q in bad:
+    try:
+      pipeline.create_cv('test_stream_union_bad', q)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,76 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_set_step_factor(pipeline, clean_db):
+  """
+  Verify that the step factor of a sliding-window view can be changed while it's running,
+  and that its window still contains the events written with the previous step size
+  """
+  pipeline.create_stream('step_stream', x='integer')
+  pipeline.create_cv('test_set_step', 'SELECT x, COUNT(*) FROM step_stream GROUP BY x',
+                     max_age='1 hour', step_factor=10)
+
+  rows = [(x,) for x in xrange(100)]
+  pipeline.insert('step_stream', ('x',), rows)
+
+  pipeline.execute("SELECT pipeline_set_step_factor('test_set_step', '1')")
+  row = pipeline.execute("""
+  SELECT step_factor, step_auto FROM pipeline_query pq JOIN pg_class c ON pq.relid = c.oid
+  WHERE c.relname = 'test_set_step'
+  """).first()
+  assert row['step_factor'] == 1
+  assert not row['step_auto']
+
+  pipeline.insert('step_stream', ('x',), rows)
+
+  result = list(pipeline.execute('SELECT * FROM test_set_step ORDER BY x'))
+  assert len(result) == 100
+  for row in result:
+    assert row['count'] == 2
+
+  try:
+    pipeline.execute("SELECT pipeline_set_step_factor('test_set_step', '0')")
+    assert False
+  except Exception, e:
+    assert 'must be a number in the range 1..50' in e.message
+
+
+def test_auto_step_factor(pipeline, clean_db):
+  """
+  Verify that a sliding-window view with an adaptive step factor moves to larger steps
+  once its window would otherwise span too many rows
+  """
+  pipeline.execute('ALTER SYSTEM SET sliding_window_auto_step_rows = 100')
+  pipeline.execute('SELECT pg_reload_conf()')
+
+  try:
+    pipeline.create_stream('auto_step_stream', x='integer')
+    pipeline.create_cv('test_auto_step', 'SELECT x, COUNT(*) FROM auto_step_stream GROUP BY x',
+                       max_age='10 seconds', step_factor='auto')
+
+    q = """
+    SELECT step_factor, step_auto FROM pipeline_query pq JOIN pg_class c ON pq.relid = c.oid
+    WHERE c.relname = 'test_auto_step'
+    """
+    row = pipeline.execute(q).first()
+    assert row['step_auto']
+    initial = row['step_factor']
+
+    rows = [(x,) for x in xrange(1000)]
+    start = time.time()
+    while time.time() - start < 30:
+      pipeline.insert('auto_step_stream', ('x',), rows)
+      time.sleep(0.5)
+      row = pipeline.execute(q).first()
+      if row['step_factor'] > initial:
+        break
+
+    assert row['step_auto']
+    assert row['step_factor'] > initial
+
+    result = list(pipeline.execute('SELECT * FROM test_auto_step'))
+    assert len(result) == 1000
+  finally:
+    pipeline.execute('ALTER SYSTEM RESET sliding_window_auto_step_rows')
+    pipeline.execute('SELECT pg_reload_conf()')
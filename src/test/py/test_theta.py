@@ -0,0 +1,87 @@
+from base import pipeline, clean_db
+
+
+def test_theta_agg(pipeline, clean_db):
+  """
+  Test theta_agg, theta_union_agg, theta_intersection_agg and combine
+  """
+  q = """
+  SELECT k::text, theta_agg(x::integer) AS s FROM test_theta_stream
+  GROUP BY k
+  """
+  desc = ('k', 'x')
+  pipeline.create_cv('test_theta_agg', q)
+
+  rows = []
+  for n in xrange(10000):
+    rows.append(('a', n))
+    rows.append(('b', n + 5000))
+    rows.append(('a', n))
+
+  pipeline.insert('test_theta_stream', desc, rows)
+
+  result = list(pipeline.execute(
+    'SELECT k, theta_estimate(s) FROM test_theta_agg ORDER BY k'))
+  assert len(result) == 2
+  assert abs(result[0][1] - 10000) <= 400
+  assert abs(result[1][1] - 10000) <= 400
+
+  result = pipeline.execute(
+    'SELECT theta_estimate(combine(s)) FROM test_theta_agg').first()
+  assert abs(result[0] - 15000) <= 600
+
+  result = pipeline.execute(
+    'SELECT theta_estimate(theta_union_agg(s)) AS u, '
+    'theta_estimate(theta_intersection_agg(s)) AS i '
+    'FROM test_theta_agg').first()
+  assert abs(result['u'] - 15000) <= 600
+  assert abs(result['i'] - 5000) <= 600
+
+
+def test_theta_set_operations(pipeline, clean_db):
+  """
+  Verify that set operations on sketches from different CVs estimate the sizes of the
+  corresponding sets of distinct elements
+  """
+  pipeline.create_cv('test_theta_seg_a',
+                     'SELECT theta_agg(x::integer) AS s FROM test_theta_seg_stream '
+                     'WHERE seg = 0')
+  pipeline.create_cv('test_theta_seg_b',
+                     'SELECT theta_agg(x::integer, 14) AS s FROM test_theta_seg_stream '
+                     'WHERE seg = 1')
+
+  rows = [(0, n) for n in xrange(20000)] + [(1, n) for n in xrange(10000, 40000)]
+  pipeline.insert('test_theta_seg_stream', ('seg', 'x'), rows)
+
+  result = pipeline.execute(
+    'SELECT theta_estimate(theta_intersection(a.s, b.s)) AS i, '
+    'theta_estimate(theta_union(a.s, b.s)) AS u, '
+    'theta_estimate(theta_a_not_b(a.s, b.s)) AS ab, '
+    'theta_estimate(theta_a_not_b(b.s, a.s)) AS ba '
+    'FROM test_theta_seg_a a, test_theta_seg_b b').first()
+
+  assert abs(result['i'] - 10000) <= 1000
+  assert abs(result['u'] - 40000) <= 1600
+  assert abs(result['ab'] - 10000) <= 1000
+  assert abs(result['ba'] - 20000) <= 1500
+
+
+def test_theta_type(pipeline, clean_db):
+  pipeline.create_table('test_theta_type', x='int', y='theta')
+  pipeline.execute('INSERT INTO test_theta_type (x, y) VALUES '
+                   '(1, theta_empty()), (2, theta_empty(4))')
+
+  for i in xrange(1000):
+    pipeline.execute('UPDATE test_theta_type SET y = theta_add(y, {})'.format(i))
+
+  result = list(pipeline.execute('SELECT theta_estimate(y) '
+                                 'FROM test_theta_type ORDER BY x'))
+  # The default sketch is exact at this size, and one with lg_k = 4 isn't
+  assert result[0][0] == 1000
+  assert abs(result[1][0] - 1000) <= 1000
+
+  try:
+    pipeline.execute('SELECT theta_empty(40)')
+    assert False
+  except Exception, e:
+    pass
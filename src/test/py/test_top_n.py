@@ -0,0 +1,47 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_top_n(pipeline, clean_db):
+  """
+  Verify that combiners of top-N views only keep the groups ranked among the top, and that
+  the top groups are still exact
+  """
+  pipeline.create_stream('top_n_stream', k='integer')
+  pipeline.create_cv('test_top_n', 'SELECT k, COUNT(*) AS total FROM top_n_stream GROUP BY k',
+                     top_n=10, top_n_column='total')
+
+  # group k has k events
+  rows = [(k, ) for k in xrange(1000) for _ in xrange(k % 100)]
+  pipeline.insert('top_n_stream', ('k', ), rows)
+
+  # groups are pruned at most once a second, after the next sync
+  time.sleep(2)
+  pipeline.insert('top_n_stream', ('k', ), [(999, )])
+
+  count = pipeline.execute('SELECT COUNT(*) FROM test_top_n_mrel').first()['count']
+  assert count < 1000
+
+  result = list(pipeline.execute('SELECT * FROM test_top_n ORDER BY total DESC, k DESC LIMIT 10'))
+  assert result[0]['k'] == 999
+  assert result[0]['total'] == 100
+  for row in result[1:]:
+    assert row['total'] == 99
+
+
+def test_top_n_invalid(pipeline, clean_db):
+  """
+  Verify that top_n is rejected without a numeric top_n_column
+  """
+  pipeline.create_stream('top_n_stream', k='integer', v='text')
+
+  for opts in [{'top_n': 10},
+               {'top_n': 0, 'top_n_column': 'total'},
+               {'top_n': 10, 'top_n_column': 'v'},
+               {'top_n': 10, 'top_n_column': 'missing'}]:
+    try:
+      pipeline.create_cv('test_top_n_invalid',
+                         'SELECT k, max(v) AS v, COUNT(*) AS total FROM top_n_stream GROUP BY k', **opts)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,63 @@
+from base import pipeline, clean_db
+
+
+def _create_chain(pipeline):
+  # enrich -> filter -> aggregate, created in pipeline order so each stage can be fused into the next
+  pipeline.create_ct('fusion_enrich', 'SELECT x, x % 10 AS y FROM fusion_s0',
+                     "pipeline_stream_insert('fusion_s1')")
+  pipeline.create_ct('fusion_filter', 'SELECT x, y FROM fusion_s1 WHERE y < 5',
+                     "pipeline_stream_insert('fusion_s2')")
+  pipeline.create_cv('fusion_agg', 'SELECT y, count(*), sum(x) FROM fusion_s2 GROUP BY y')
+  pipeline.create_cv('fusion_filtered', 'SELECT count(*) FROM fusion_s1 WHERE y = 0')
+
+
+def _check_chain(pipeline):
+  pipeline.insert('fusion_s0', ('x', ), [(n, ) for n in xrange(10000)])
+
+  rows = list(pipeline.execute('SELECT * FROM fusion_agg ORDER BY y'))
+  assert len(rows) == 5
+  for row in rows:
+    assert row['count'] == 1000
+    assert row['sum'] == sum(n for n in xrange(10000) if n % 10 == row['y'])
+
+  assert pipeline.execute('SELECT count FROM fusion_filtered').first()['count'] == 1000
+
+
+def test_fused_chain(pipeline, clean_db):
+  """
+  Verify that chained continuous transforms produce the same results with and without fusion
+  """
+  pipeline.create_stream('fusion_s0', x='integer')
+  pipeline.create_stream('fusion_s1', x='integer', y='integer')
+  pipeline.create_stream('fusion_s2', x='integer', y='integer')
+
+  try:
+    for fuse in ['on', 'off']:
+      pipeline.stop()
+      pipeline.run({'continuous_query_fuse_transforms': fuse})
+
+      _create_chain(pipeline)
+      _check_chain(pipeline)
+      pipeline.drop_all_queries()
+  finally:
+    pipeline.stop()
+    pipeline.run()
+
+
+def test_unfusable_readers(pipeline, clean_db):
+  """
+  Readers that execute before the transform writing to their stream are still given its output
+  """
+  pipeline.create_stream('fusion_u0', x='integer')
+  pipeline.create_stream('fusion_u1', x='integer')
+
+  # created before the transform, so it may have already executed by the time the transform does
+  pipeline.create_cv('fusion_before', 'SELECT count(*) FROM fusion_u1')
+  pipeline.create_ct('fusion_ct', 'SELECT x FROM fusion_u0', "pipeline_stream_insert('fusion_u1')")
+  pipeline.create_cv('fusion_after', 'SELECT count(*) FROM fusion_u1')
+
+  pipeline.insert('fusion_u0', ('x', ), [(n, ) for n in xrange(1000)])
+  pipeline.insert('fusion_u1', ('x', ), [(n, ) for n in xrange(1000)])
+
+  assert pipeline.execute('SELECT count FROM fusion_before').first()['count'] == 2000
+  assert pipeline.execute('SELECT count FROM fusion_after').first()['count'] == 2000
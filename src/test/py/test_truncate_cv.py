@@ -0,0 +1,32 @@
+from base import pipeline, clean_db
+
+
+def test_truncate_cv(pipeline, clean_db):
+  """
+  Verify that truncated views start over from their first event after the truncation, including
+  sliding-window views and views with transition state
+  """
+  pipeline.create_stream('truncate_stream', k='integer', x='integer')
+  pipeline.create_cv('test_truncate_sw', 'SELECT k, count(*), sum(x) FROM truncate_stream GROUP BY k',
+                     max_age='1 hour')
+  pipeline.create_cv('test_truncate_distinct', 'SELECT count(DISTINCT x) FROM truncate_stream')
+
+  pipeline.insert('truncate_stream', ('k', 'x'), [(n % 10, n) for n in xrange(1000)])
+
+  assert pipeline.execute('SELECT sum(count) FROM test_truncate_sw').first()['sum'] == 1000
+  assert pipeline.execute('SELECT count FROM test_truncate_distinct').first()['count'] == 1000
+
+  pipeline.execute('TRUNCATE CONTINUOUS VIEW test_truncate_sw, test_truncate_distinct')
+
+  # nothing is left behind for vacuum
+  for name in ('test_truncate_sw_mrel', 'test_truncate_distinct_mrel'):
+    assert pipeline.execute('SELECT count(*) FROM %s' % name).first()['count'] == 0
+
+  pipeline.insert('truncate_stream', ('k', 'x'), [(n % 5, n) for n in xrange(100)])
+
+  rows = list(pipeline.execute('SELECT * FROM test_truncate_sw ORDER BY k'))
+  assert len(rows) == 5
+  for row in rows:
+    assert row['count'] == 20
+
+  assert pipeline.execute('SELECT count FROM test_truncate_distinct').first()['count'] == 100
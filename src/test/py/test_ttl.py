@@ -0,0 +1,64 @@
+from base import pipeline, clean_db
+import time
+
+
+def wait_for(pipeline, q, expected):
+  # combiners delete expired groups once they're idle
+  for _ in xrange(30):
+    if pipeline.execute(q).first()['count'] in expected:
+      return True
+    time.sleep(0.5)
+  return False
+
+
+def test_ttl(pipeline, clean_db):
+  """
+  Verify that groups of views with a ttl are deleted once their time column is older than the ttl
+  """
+  pipeline.create_stream('ttl_stream', k='integer', ts='timestamptz')
+  pipeline.create_cv('test_ttl_bucket',
+                     "SELECT date_trunc('minute', ts) AS m, k, count(*) FROM ttl_stream GROUP BY m, k",
+                     ttl='10 minutes')
+  pipeline.create_cv('test_ttl_last_seen',
+                     'SELECT k, max(ts) AS last_seen, count(*) FROM ttl_stream GROUP BY k',
+                     ttl='10 minutes', ttl_column='last_seen')
+
+  pipeline.execute("INSERT INTO ttl_stream (k, ts) "
+                   "SELECT x % 100, now() - interval '1 hour' FROM generate_series(0, 999) x")
+  pipeline.execute("INSERT INTO ttl_stream (k, ts) "
+                   "SELECT x % 10, now() FROM generate_series(0, 999) x")
+
+  # the recent events may span two minutes
+  assert wait_for(pipeline, 'SELECT count(*) FROM test_ttl_bucket', (10, 20))
+  assert wait_for(pipeline, 'SELECT count(*) FROM test_ttl_last_seen', (10,))
+
+  # groups that are still alive keep their values
+  for row in pipeline.execute('SELECT * FROM test_ttl_last_seen'):
+    assert row['count'] == 110
+
+  # an expired group comes back as a new group
+  pipeline.execute("INSERT INTO ttl_stream (k, ts) VALUES (50, now())")
+  assert wait_for(pipeline, 'SELECT count(*) FROM test_ttl_last_seen WHERE k = 50 AND count = 1', (1,))
+
+
+def test_ttl_validation(pipeline, clean_db):
+  """
+  Verify that groups can only expire by a timestamp column of a grouped view
+  """
+  pipeline.create_stream('ttl_bad_stream', k='integer', ts='timestamptz')
+
+  bad = [
+    ('SELECT k, count(*) FROM ttl_bad_stream GROUP BY k', {'ttl': '1 day'}),
+    ('SELECT k, count(*) FROM ttl_bad_stream GROUP BY k', {'ttl': '1 day', 'ttl_column': 'count'}),
+    ('SELECT k, count(*) FROM ttl_bad_stream GROUP BY k', {'ttl_column': 'k'}),
+    ('SELECT max(ts) AS ts FROM ttl_bad_stream', {'ttl': '1 day', 'ttl_column': 'ts'}),
+    ('SELECT ts, count(*) FROM ttl_bad_stream GROUP BY ts', {'ttl': '1 day', 'max_age': '1 hour'}),
+    ('SELECT ts, count(*) FROM ttl_bad_stream GROUP BY ts', {'ttl': '1 day', 'delta_merge': True}),
+  ]
+
+  for q, opts in bad:
+    try:
+      pipeline.create_cv('test_ttl_bad', q, **opts)
+      assert False
+    except Exception:
+      pass
@@ -0,0 +1,57 @@
+from base import pipeline, clean_db
+
+
+def test_unchanged_groups(pipeline, clean_db):
+  """
+  Verify that partial results that can't change their groups are dropped without
+  affecting results, and that groups are still updated when they do change
+  """
+  pipeline.create_stream('unchanged_stream', k='integer', v='integer', b='boolean', s='text')
+  pipeline.create_cv('test_unchanged',
+                     'SELECT k, MAX(v), MIN(v), BOOL_OR(b), MAX(s) AS max_s FROM unchanged_stream GROUP BY k')
+  pipeline.create_cv('test_unchanged_single', 'SELECT MAX(v), BOOL_AND(b) FROM unchanged_stream')
+
+  pipeline.insert('unchanged_stream', ('k', 'v', 'b', 's'),
+                  [(k, 50, False, 'm') for k in xrange(100)])
+
+  before = dict((r['k'], r['ctid']) for r in pipeline.execute('SELECT k, ctid FROM test_unchanged_mrel'))
+  assert len(before) == 100
+
+  # None of these can change any group
+  for v in xrange(10, 50, 10):
+    pipeline.insert('unchanged_stream', ('k', 'v', 'b', 's'),
+                    [(k, v, False, 'a') for k in xrange(100)])
+    pipeline.insert('unchanged_stream', ('k', 'v', 'b', 's'),
+                    [(k, None, None, None) for k in xrange(100)])
+
+  for row in pipeline.execute('SELECT k, ctid FROM test_unchanged_mrel'):
+    assert row['ctid'] == before[row['k']]
+
+  # Only the first half of the groups' minimums change
+  pipeline.insert('unchanged_stream', ('k', 'v', 'b', 's'),
+                  [(k, 0 if k < 50 else 20, False, 'a') for k in xrange(100)])
+  # Only the odd groups' bool_or changes
+  pipeline.insert('unchanged_stream', ('k', 'v', 'b', 's'),
+                  [(k, 20, k % 2 == 1, 'a') for k in xrange(100)])
+
+  for row in pipeline.execute('SELECT * FROM test_unchanged ORDER BY k'):
+    k = row['k']
+    assert row['max'] == 50
+    assert row['min'] == (0 if k < 50 else 10)
+    assert row['bool_or'] == (k % 2 == 1)
+    assert row['max_s'] == 'm'
+
+  row = pipeline.execute('SELECT * FROM test_unchanged_single').first()
+  assert row['max'] == 50
+  assert row['bool_and'] is False
+
+  pipeline.insert('unchanged_stream', ('k', 'v', 'b', 's'), [(0, 100, True, 'z')])
+
+  row = pipeline.execute('SELECT * FROM test_unchanged WHERE k = 0').first()
+  assert row['max'] == 100
+  assert row['min'] == 0
+  assert row['bool_or'] is True
+
+  row = pipeline.execute('SELECT * FROM test_unchanged_single').first()
+  assert row['max'] == 100
+  assert row['bool_and'] is False
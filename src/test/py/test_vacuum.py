@@ -158,3 +158,82 @@ def test_concurrent_vacuum_full(pipeline, clean_db):
   # Now kill the insert threads.
   stop = True
   map(lambda t: t.join(), threads)
+
+
+def test_batched_sw_vacuum(pipeline, clean_db):
+  """
+  Verify that expired sliding-window rows are all deleted when vacuum deletes them in
+  batches that are smaller than the number of expired rows, while leaving in-window rows alone
+  """
+  pipeline.execute('ALTER SYSTEM SET sliding_window_vacuum_batch_size TO 7')
+  pipeline.execute('SELECT pg_reload_conf()')
+
+  try:
+    pipeline.create_cv(
+      'test_sw_batched', '''
+      SELECT x::int, COUNT(*)
+      FROM test_sw_batched_stream
+      WHERE arrival_timestamp > clock_timestamp() - INTERVAL '3 second'
+      GROUP BY x
+      ''')
+
+    pipeline.insert('test_sw_batched_stream', ('x', ), [(x, ) for x in xrange(100)])
+    time.sleep(4)
+    pipeline.insert('test_sw_batched_stream', ('x', ), [(x, ) for x in xrange(10)])
+
+    conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' %
+                            (getpass.getuser(), pipeline.port))
+    conn.set_isolation_level(psycopg2.extensions.ISOLATION_LEVEL_AUTOCOMMIT)
+    conn.cursor().execute('VACUUM test_sw_batched')
+    conn.close()
+
+    row = pipeline.execute('SELECT COUNT(*) FROM test_sw_batched_mrel').first()
+    assert row['count'] == 10
+
+    rows = list(pipeline.execute('SELECT * FROM test_sw_batched ORDER BY x'))
+    assert len(rows) == 10
+    for row in rows:
+      assert row['count'] == 1
+  finally:
+    pipeline.execute('ALTER SYSTEM RESET sliding_window_vacuum_batch_size')
+    pipeline.execute('SELECT pg_reload_conf()')
+
+
+def test_sw_time_index(pipeline, clean_db):
+  """
+  Verify that sliding-window matrels get a BRIN index on their time column, and that
+  vacuum still deletes every expired row while only looking at block ranges it summarizes
+  """
+  pipeline.create_cv(
+    'test_sw_brin', '''
+    SELECT x::int, COUNT(*)
+    FROM test_sw_brin_stream
+    WHERE arrival_timestamp > clock_timestamp() - INTERVAL '3 second'
+    GROUP BY x
+    ''')
+
+  row = pipeline.execute("""
+  SELECT COUNT(*) FROM pg_indexes
+  WHERE tablename = 'test_sw_brin_mrel' AND indexname = 'test_sw_brin_mrel_brin_idx'
+  AND indexdef LIKE '%%USING brin (arrival_timestamp)%%'
+  """).first()
+  assert row['count'] == 1
+
+  for _ in xrange(5):
+    pipeline.insert('test_sw_brin_stream', ('x', ), [(x, ) for x in xrange(1000)])
+  time.sleep(4)
+
+  conn = psycopg2.connect('dbname=pipeline user=%s host=localhost port=%s' %
+                          (getpass.getuser(), pipeline.port))
+  conn.set_isolation_level(psycopg2.extensions.ISOLATION_LEVEL_AUTOCOMMIT)
+  cur = conn.cursor()
+
+  # Summarize the matrel's blocks so that only the ones with expired rows are scanned
+  cur.execute('SELECT brin_summarize_new_values(\'test_sw_brin_mrel_brin_idx\'::regclass)')
+  pipeline.insert('test_sw_brin_stream', ('x', ), [(x, ) for x in xrange(10)])
+
+  cur.execute('VACUUM test_sw_brin')
+  conn.close()
+
+  row = pipeline.execute('SELECT COUNT(*) FROM test_sw_brin_mrel').first()
+  assert row['count'] == 10
@@ -0,0 +1,58 @@
+from base import pipeline, clean_db
+
+
+def test_vectorized_quals(pipeline, clean_db):
+  """
+  Verify that comparisons evaluated over vectors of events select exactly the events
+  the expression interpreter would have selected, including nulls and NaNs
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_vectorized_quals': 'on'})
+
+  try:
+    pipeline.create_stream('vector_stream', i2='int2', i4='integer', i8='int8',
+                           f='float8', t='text', v='varchar', d='date')
+    pipeline.create_cv('test_vector_ints',
+                       'SELECT COUNT(*) FROM vector_stream WHERE i2 >= 2 AND i4 < 7 AND i8 <> 5')
+    pipeline.create_cv('test_vector_commuted',
+                       'SELECT COUNT(*) FROM vector_stream WHERE 3 < i4 AND 100::int8 > i2')
+    pipeline.create_cv('test_vector_float',
+                       "SELECT COUNT(*) FROM vector_stream WHERE f > 0.5")
+    pipeline.create_cv('test_vector_nan',
+                       "SELECT COUNT(*) FROM vector_stream WHERE f = 'NaN'::float8")
+    pipeline.create_cv('test_vector_text',
+                       "SELECT COUNT(*) FROM vector_stream WHERE t = 'a' OR t IS NULL")
+    pipeline.create_cv('test_vector_mixed',
+                       "SELECT i4, COUNT(*) FROM vector_stream WHERE v <> 'b' AND d > '2016-01-03' "
+                       "AND i4 % 2 = 0 GROUP BY i4")
+
+    rows = []
+    for n in xrange(3000):
+      f = 'NaN' if n % 13 == 0 else (n % 10) / 10.0
+      t = None if n % 7 == 0 else 'abc'[n % 3]
+      rows.append((n % 4, n % 10, n % 6, f, t, 'abc'[n % 3], '2016-01-0%d' % (n % 5 + 1)))
+
+    pipeline.insert('vector_stream', ('i2', 'i4', 'i8', 'f', 't', 'v', 'd'), rows)
+    pipeline.insert('vector_stream', ('i4', ), [(4, )] * 10)
+
+    row = pipeline.execute('SELECT * FROM test_vector_ints').first()
+    assert row['count'] == len([r for r in rows if r[0] >= 2 and r[1] < 7 and r[2] != 5])
+
+    row = pipeline.execute('SELECT * FROM test_vector_commuted').first()
+    assert row['count'] == len([r for r in rows if r[1] > 3])
+
+    # NaN is larger than anything else
+    row = pipeline.execute('SELECT * FROM test_vector_float').first()
+    assert row['count'] == len([r for r in rows if r[3] == 'NaN' or r[3] > 0.5])
+
+    row = pipeline.execute('SELECT * FROM test_vector_nan').first()
+    assert row['count'] == len([r for r in rows if r[3] == 'NaN'])
+
+    row = pipeline.execute('SELECT * FROM test_vector_text').first()
+    assert row['count'] == len([r for r in rows if r[4] in ('a', None)]) + 10
+
+    for row in pipeline.execute('SELECT * FROM test_vector_mixed'):
+      assert row['count'] == len([r for r in rows if r[1] == row['i4'] and r[5] != 'b' and r[6] > '2016-01-03'])
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -0,0 +1,32 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_view_lag(pipeline, clean_db):
+  """
+  Verify that pipeline_view_lag reports how far behind its streams a continuous view is
+  """
+  pipeline.create_stream('lag_stream', x='integer')
+  pipeline.create_cv('test_view_lag', 'SELECT x, COUNT(*) FROM lag_stream GROUP BY x')
+
+  # Nothing has been committed to the view yet
+  assert pipeline.execute("SELECT pipeline_view_lag('test_view_lag') AS lag").first()['lag'] is None
+
+  pipeline.insert('lag_stream', ('x', ), [(i % 10, ) for i in xrange(1000)])
+
+  lag = pipeline.execute(
+    "SELECT extract(epoch FROM pipeline_view_lag('test_view_lag')) AS lag").first()['lag']
+  assert lag is not None
+  assert 0 <= lag < 2
+
+  # Lag grows while the stream is idle
+  time.sleep(1)
+  later = pipeline.execute(
+    "SELECT extract(epoch FROM pipeline_view_lag('test_view_lag')) AS lag").first()['lag']
+  assert later > lag
+
+  try:
+    pipeline.execute("SELECT pipeline_view_lag('not_a_view')")
+    assert False
+  except Exception:
+    pass
@@ -145,3 +145,36 @@ def test_aggs(pipeline, clean_db):
     _test_agg(pipeline, 'cmsketch_agg(x::integer)', check_fn=cmsketch_check)
     _test_agg(pipeline, 'hll_agg(x::integer)', check_fn=hll_check)
     _test_agg(pipeline, 'tdigest_agg(x::integer)', check_fn=tdigest_check)
+
+
+def test_window_index(pipeline, clean_db):
+    """
+    Verify that views with WINDOWs index their partitions in window order, and that reads
+    of a single partition use the index without sorting
+    """
+    q = 'SELECT g::integer, sum(x::integer) OVER (PARTITION BY g ORDER BY ts::timestamp) FROM window_idx_stream'
+    pipeline.create_cv('test_window_idx', q)
+    pipeline.create_table('test_window_idx_t', ts='timestamp', g='integer', x='integer')
+
+    rows = []
+    for i in range(1000):
+        ts = str(datetime.utcnow() + timedelta(seconds=i))
+        rows.append((ts, i % 10, i))
+
+    pipeline.insert('window_idx_stream', ('ts', 'g', 'x'), rows)
+    pipeline.insert('test_window_idx_t', ('ts', 'g', 'x'), rows)
+
+    row = pipeline.execute("SELECT COUNT(*) FROM pg_indexes WHERE indexname = 'test_window_idx_mrel_window_idx'").first()
+    assert row['count'] == 1
+
+    pipeline.execute('SET enable_seqscan TO off')
+    plan = '\n'.join(r[0] for r in pipeline.execute('EXPLAIN SELECT * FROM test_window_idx WHERE g = 3'))
+    pipeline.execute('SET enable_seqscan TO on')
+    assert 'test_window_idx_mrel_window_idx' in plan
+    assert 'Sort' not in plan
+
+    expected = list(pipeline.execute(q.replace('window_idx_stream', 'test_window_idx_t') + ' ORDER BY g, ts'))
+    result = list(pipeline.execute('SELECT * FROM test_window_idx ORDER BY g'))
+
+    assert len(expected) == len(result)
+    assert sorted(expected) == sorted(result)
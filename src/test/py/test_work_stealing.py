@@ -0,0 +1,34 @@
+from base import pipeline, clean_db
+
+
+def test_work_stealing(pipeline, clean_db):
+  """
+  Verify that events read by a worker other than the one they were inserted for are
+  processed and acknowledged exactly once
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_work_stealing': 'on',
+                'continuous_query_num_workers': 2,
+                'continuous_query_max_wait': 5})
+
+  try:
+    pipeline.create_stream('steal_stream', x='integer')
+    # Keep workers busy long enough for their queues to back up
+    pipeline.create_cv('test_steal_slow',
+                       'SELECT COUNT(*) FROM steal_stream WHERE pg_sleep(0.0001) IS NOT NULL')
+    pipeline.create_cv('test_steal_plain', 'SELECT x % 10 AS g, COUNT(*), SUM(x) FROM steal_stream GROUP BY g')
+
+    for i in xrange(100):
+      pipeline.insert('steal_stream', ('x', ), [(n, ) for n in xrange(50)])
+
+    row = pipeline.execute('SELECT * FROM test_steal_slow').first()
+    assert row['count'] == 5000
+
+    rows = list(pipeline.execute('SELECT * FROM test_steal_plain ORDER BY g'))
+    assert len(rows) == 10
+    for row in rows:
+      assert row['count'] == 500
+      assert row['sum'] == 100 * sum(n for n in xrange(50) if n % 10 == row['g'])
+  finally:
+    pipeline.stop()
+    pipeline.run()
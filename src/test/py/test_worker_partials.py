@@ -0,0 +1,44 @@
+from base import pipeline, clean_db
+import time
+
+
+def test_worker_partials(pipeline, clean_db):
+  """
+  Verify that partial results held by workers across batches are combined correctly
+  and still reach combiners once they've been held for long enough
+  """
+  pipeline.stop()
+  pipeline.run({'synchronous_stream_insert': 'off',
+                'continuous_query_worker_partials_mem': '64MB',
+                'continuous_query_worker_partials_max_wait': 500})
+
+  try:
+    pipeline.create_stream('partials_stream', x='integer', y='integer')
+    pipeline.create_cv('test_partials_grouped',
+                       'SELECT x, COUNT(*), SUM(y), AVG(y), COUNT(DISTINCT y) AS d FROM partials_stream GROUP BY x')
+    pipeline.create_cv('test_partials_total', 'SELECT COUNT(*), MAX(y) FROM partials_stream')
+
+    # skewed keys, so most partial results of each batch belong to the same group
+    for i in xrange(20):
+      rows = [(0, n % 20) for n in xrange(90)] + [(n % 10, i) for n in xrange(10)]
+      pipeline.insert('partials_stream', ('x', 'y'), rows)
+
+    time.sleep(3)
+
+    rows = list(pipeline.execute('SELECT * FROM test_partials_grouped ORDER BY x'))
+    assert len(rows) == 10
+    assert rows[0]['count'] == 20 * 91
+    assert rows[0]['sum'] == 20 * sum(n % 20 for n in xrange(90))
+    assert rows[0]['d'] == 20
+
+    for row in rows[1:]:
+      assert row['count'] == 20
+      assert row['sum'] == sum(xrange(20))
+      assert row['d'] == 20
+
+    row = pipeline.execute('SELECT * FROM test_partials_total').first()
+    assert row['count'] == 2000
+    assert row['max'] == 19
+  finally:
+    pipeline.stop()
+    pipeline.run()
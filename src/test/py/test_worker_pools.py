@@ -0,0 +1,66 @@
+from base import pipeline, clean_db
+import time
+
+
+def worker_input_rows(pipeline):
+  rows = pipeline.execute("SELECT pid, input_rows FROM pipeline_proc_stats WHERE type = 'worker'")
+  return dict((row['pid'], row['input_rows']) for row in rows)
+
+
+def test_worker_pools(pipeline, clean_db):
+  """
+  Verify that events are only read by the workers of the pool their views
+  are pinned to, and that views in different pools both see every event
+  """
+  pipeline.stop()
+  pipeline.run({'continuous_query_worker_pools': 'realtime:1',
+                'continuous_query_work_stealing': 'on'})
+
+  try:
+    pipeline.create_stream('pool_stream', k='integer', v='integer')
+
+    # unknown pools are rejected
+    try:
+      pipeline.create_cv('test_pool_bad', 'SELECT COUNT(*) FROM pool_stream', pool='nope')
+      assert False
+    except Exception, e:
+      pass
+
+    pipeline.create_cv('test_pool_rt', 'SELECT k, COUNT(*), SUM(v) FROM pool_stream GROUP BY k', pool='realtime')
+
+    before = worker_input_rows(pipeline)
+
+    rows = [(k, k) for k in xrange(1000)]
+    for _ in xrange(10):
+      pipeline.insert('pool_stream', ('k', 'v'), rows)
+
+    result = list(pipeline.execute('SELECT * FROM test_pool_rt ORDER BY k'))
+    assert len(result) == 1000
+    for row in result:
+      assert row['count'] == 10
+      assert row['sum'] == 10 * row['k']
+
+    # stats are flushed asynchronously
+    time.sleep(2)
+    after = worker_input_rows(pipeline)
+    busy = filter(lambda pid: after[pid] > before.get(pid, 0), after)
+    assert len(busy) == 1
+
+    # a view in the default pool sees the same events as one in a named pool
+    pipeline.create_cv('test_pool_default', 'SELECT k, COUNT(*) FROM pool_stream GROUP BY k')
+
+    for _ in xrange(10):
+      pipeline.insert('pool_stream', ('k', 'v'), rows)
+
+    result = list(pipeline.execute('SELECT * FROM test_pool_rt ORDER BY k'))
+    assert len(result) == 1000
+    for row in result:
+      assert row['count'] == 20
+
+    result = list(pipeline.execute('SELECT * FROM test_pool_default ORDER BY k'))
+    assert len(result) == 1000
+    for row in result:
+      assert row['count'] == 10
+  finally:
+    pipeline.stop()
+    pipeline.run()
@@ -23,6 +23,32 @@ DROP TABLE ct2;
 DROP CONTINUOUS TRANSFORM ct1;
 DROP CONTINUOUS VIEW ct0;
 
+-- Batch output functions
+CREATE TABLE ct_batch (x int);
+CREATE TABLE ct_batch_calls (n int);
+CREATE OR REPLACE FUNCTION ct_batch_fn(rows anyarray)
+RETURNS void AS
+$$
+BEGIN
+ INSERT INTO ct_batch (x) SELECT r.x FROM unnest(rows) r;
+ INSERT INTO ct_batch_calls (n) VALUES (array_length(rows, 1));
+END;
+$$
+LANGUAGE plpgsql;
+CREATE CONTINUOUS TRANSFORM ct_batch_ct AS SELECT x::int FROM ct_stream2 WHERE x % 3 = 0 THEN EXECUTE PROCEDURE ct_batch_fn();
+CREATE CONTINUOUS TRANSFORM ct_batch_args AS SELECT x::int FROM ct_stream2 THEN EXECUTE PROCEDURE ct_batch_fn('a');
+
+INSERT INTO ct_stream2 (x) SELECT generate_series(0, 29) AS x;
+
+SELECT count(*), sum(x) FROM ct_batch;
+SELECT sum(n) FROM ct_batch_calls;
+SELECT count(*) < 10 AS batched FROM ct_batch_calls;
+
+DROP CONTINUOUS TRANSFORM ct_batch_ct;
+DROP FUNCTION ct_batch_fn(anyarray);
+DROP TABLE ct_batch;
+DROP TABLE ct_batch_calls;
+
 -- Stream-table JOIN
 CREATE TABLE ct_t (x integer, s text);
 INSERT INTO ct_t (x, s) VALUES (0, 'zero');
@@ -0,0 +1,393 @@
+/*
+ * bench.c
+ *
+ * Microbenchmarks for the sketch kernels continuous views depend on. Each measurement is
+ * printed as one CSV line of kernel, cardinality, ops, ns/op and the size of the resulting
+ * state in bytes, so that runs can be diffed to catch regressions.
+ *
+ * Usage: bench_sketches [kernel prefix ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "postgres.h"
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "pipeline/bloom.h"
+#include "pipeline/cmsketch.h"
+#include "pipeline/fss.h"
+#include "pipeline/hll.h"
+#include "pipeline/miscutils.h"
+#include "pipeline/tdigest.h"
+#include "portability/instr_time.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+#include "utils/typcache.h"
+
+/* number of values added to each state, regardless of how many of them are distinct */
+#define NUM_ADDS 1000000
+#define NUM_LOOKUPS 1000000
+#define NUM_MERGES 1000
+#define NUM_QUANTILES 100000
+#define FSS_K 10
+
+const char *progname;
+
+static const int cardinalities[] = {100, 10000, 1000000};
+
+/* key lengths the hash functions are measured with, reported in place of a cardinality */
+static const int key_lengths[] = {4, 8, 16, 32, 128};
+static char **filters;
+static int nfilters;
+
+/*
+ * key_for
+ *
+ * Spreads the i'th one of ncard distinct keys over the full 64-bit range
+ */
+static inline uint64
+key_for(int i, int ncard)
+{
+	return ((uint64) (i % ncard) + 1) * UINT64CONST(0x9E3779B97F4A7C15);
+}
+
+static bool
+selected(const char *kernel)
+{
+	int i;
+
+	if (!nfilters)
+		return true;
+
+	for (i = 0; i < nfilters; i++)
+		if (strncmp(kernel, filters[i], strlen(filters[i])) == 0)
+			return true;
+
+	return false;
+}
+
+/*
+ * group_selected
+ *
+ * Whether any selected kernel belongs to the given sketch
+ */
+static bool
+group_selected(const char *group)
+{
+	int i;
+
+	if (!nfilters)
+		return true;
+
+	for (i = 0; i < nfilters; i++)
+		if (strncmp(group, filters[i], Min(strlen(group), strlen(filters[i]))) == 0)
+			return true;
+
+	return false;
+}
+
+static void
+report(const char *kernel, int ncard, int ops, instr_time start, Size bytes)
+{
+	instr_time elapsed;
+
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start);
+
+	printf("%s,%d,%d,%.1f,%lu\n", kernel, ncard, ops,
+			INSTR_TIME_GET_DOUBLE(elapsed) * 1e9 / ops, (unsigned long) bytes);
+	fflush(stdout);
+}
+
+static void
+bench_hll(int ncard)
+{
+	HyperLogLog *hll = HLLCreate();
+	HyperLogLog *other = HLLCreate();
+	instr_time start;
+	uint64 card = 0;
+	int result;
+	int i;
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < NUM_ADDS; i++)
+	{
+		uint64 key = key_for(i, ncard);
+		hll = HLLAdd(hll, &key, sizeof(key), &result);
+	}
+	if (selected("HLLAdd"))
+		report("HLLAdd", ncard, NUM_ADDS, start, HLLSize(hll));
+
+	for (i = 0; i < NUM_ADDS; i++)
+	{
+		uint64 key = key_for(i + ncard / 2, ncard) + 1;
+		other = HLLAdd(other, &key, sizeof(key), &result);
+	}
+
+	if (selected("HLLUnion"))
+	{
+		HyperLogLog *merged = HLLCopy(hll);
+
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_MERGES; i++)
+			merged = HLLUnion(merged, other);
+		report("HLLUnion", ncard, NUM_MERGES, start, HLLSize(merged));
+	}
+
+	if (selected("HLLCardinality"))
+	{
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_MERGES; i++)
+			card += HLLCardinality(hll);
+		report("HLLCardinality", ncard, NUM_MERGES, start, HLLSize(hll));
+	}
+
+	/* keep the estimates from being optimized away */
+	if (card == PG_UINT64_MAX)
+		printf("#\n");
+}
+
+static void
+bench_bloom(int ncard)
+{
+	BloomFilter *bf = BloomFilterCreate();
+	BloomFilter *other = BloomFilterCreate();
+	instr_time start;
+	int found = 0;
+	int i;
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < NUM_ADDS; i++)
+	{
+		uint64 key = key_for(i, ncard);
+		bf = BloomFilterAdd(bf, &key, sizeof(key));
+	}
+	if (selected("BloomFilterAdd"))
+		report("BloomFilterAdd", ncard, NUM_ADDS, start, BloomFilterSize(bf));
+
+	if (selected("BloomFilterContains"))
+	{
+		/* half of the lookups hit */
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_LOOKUPS; i++)
+		{
+			uint64 key = key_for(i, ncard) + (i & 1);
+			found += BloomFilterContains(bf, &key, sizeof(key));
+		}
+		report("BloomFilterContains", ncard, NUM_LOOKUPS, start, BloomFilterSize(bf));
+	}
+
+	if (selected("BloomFilterUnion"))
+	{
+		BloomFilter *merged = BloomFilterCopy(bf);
+
+		for (i = 0; i < NUM_ADDS; i++)
+		{
+			uint64 key = key_for(i, ncard) + 1;
+			other = BloomFilterAdd(other, &key, sizeof(key));
+		}
+
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_MERGES; i++)
+			merged = BloomFilterUnion(merged, other);
+		report("BloomFilterUnion", ncard, NUM_MERGES, start, BloomFilterSize(merged));
+	}
+
+	if (found < 0)
+		printf("#\n");
+}
+
+static void
+bench_cmsketch(int ncard)
+{
+	CountMinSketch *cms = CountMinSketchCreate();
+	instr_time start;
+	int i;
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < NUM_ADDS; i++)
+	{
+		uint64 key = key_for(i, ncard);
+		CountMinSketchAdd(cms, &key, sizeof(key), 1);
+	}
+	if (selected("CountMinSketchAdd"))
+		report("CountMinSketchAdd", ncard, NUM_ADDS, start, CountMinSketchSize(cms));
+
+	if (selected("CountMinSketchMerge"))
+	{
+		CountMinSketch *merged = CountMinSketchCreate();
+
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_MERGES; i++)
+			merged = CountMinSketchMerge(merged, cms);
+		report("CountMinSketchMerge", ncard, NUM_MERGES, start, CountMinSketchSize(merged));
+	}
+}
+
+static void
+bench_fss(int ncard)
+{
+	TypeCacheEntry *typ = palloc0(sizeof(TypeCacheEntry));
+	FSS *fss;
+	instr_time start;
+	int i;
+
+	typ->typbyval = true;
+	typ->type_id = INT8OID;
+	typ->typlen = sizeof(int64);
+
+	fss = FSSCreate(FSS_K, typ);
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < NUM_ADDS; i++)
+		fss = FSSIncrement(fss, Int64GetDatum(key_for(i, ncard)), false);
+	if (selected("FSSIncrement"))
+		report("FSSIncrement", ncard, NUM_ADDS, start, FSSSize(fss));
+
+	if (selected("FSSMerge"))
+	{
+		FSS *merged = FSSCreate(FSS_K, typ);
+
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_MERGES; i++)
+			merged = FSSMerge(merged, fss);
+		report("FSSMerge", ncard, NUM_MERGES, start, FSSSize(merged));
+	}
+}
+
+static void
+bench_tdigest(int ncard)
+{
+	TDigest *t = TDigestCreate();
+	instr_time start;
+	float8 sum = 0;
+	int i;
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < NUM_ADDS; i++)
+		t = TDigestAdd(t, (float8) (key_for(i, ncard) >> 11), 1);
+	t = TDigestCompress(t);
+	if (selected("TDigestAdd"))
+		report("TDigestAdd", ncard, NUM_ADDS, start, TDigestSize(t));
+
+	if (selected("TDigestMerge"))
+	{
+		TDigest *merged = TDigestCreate();
+
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_MERGES; i++)
+			merged = TDigestMerge(merged, t);
+		merged = TDigestCompress(merged);
+		report("TDigestMerge", ncard, NUM_MERGES, start, TDigestSize(merged));
+	}
+
+	if (selected("TDigestQuantile"))
+	{
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_QUANTILES; i++)
+			sum += TDigestQuantile(t, (float8) (i % 1000) / 1000);
+		report("TDigestQuantile", ncard, NUM_QUANTILES, start, TDigestSize(t));
+	}
+
+	if (sum < 0)
+		printf("#\n");
+}
+
+static void
+bench_hash(int len)
+{
+	char key[128];
+	instr_time start;
+	uint64 h = 0;
+	int i;
+
+	Assert(len <= sizeof(key));
+	memset(key, 'x', sizeof(key));
+
+	if (selected("HashMurmur3"))
+	{
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_ADDS; i++)
+		{
+			memcpy(key, &i, sizeof(i));
+			h ^= MurmurHash3_64(key, len, 0);
+		}
+		report("HashMurmur3", len, NUM_ADDS, start, 0);
+	}
+
+	if (selected("HashFast"))
+	{
+		INSTR_TIME_SET_CURRENT(start);
+		for (i = 0; i < NUM_ADDS; i++)
+		{
+			memcpy(key, &i, sizeof(i));
+			h ^= FastHash64(key, len, 0);
+		}
+		report("HashFast", len, NUM_ADDS, start, 0);
+	}
+
+	if (h == 0)
+		printf("#\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	MemoryContext context;
+	int i;
+
+	progname = argv[0];
+	filters = argv + 1;
+	nfilters = argc - 1;
+
+	context = AllocSetContextCreate(NULL,
+			"BenchContext",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	/* ErrorContext must be initialized for logging to work */
+	ErrorContext = AllocSetContextCreate(NULL,
+			"ErrorContext",
+			ALLOCSET_DEFAULT_MINSIZE,
+			ALLOCSET_DEFAULT_INITSIZE,
+			ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(context);
+
+	printf("kernel,cardinality,ops,ns_per_op,bytes\n");
+
+	for (i = 0; i < lengthof(cardinalities); i++)
+	{
+		int ncard = cardinalities[i];
+
+		if (group_selected("HLL"))
+			bench_hll(ncard);
+		MemoryContextReset(context);
+
+		if (group_selected("BloomFilter"))
+			bench_bloom(ncard);
+		MemoryContextReset(context);
+
+		if (group_selected("CountMinSketch"))
+			bench_cmsketch(ncard);
+		MemoryContextReset(context);
+
+		if (group_selected("FSS"))
+			bench_fss(ncard);
+		MemoryContextReset(context);
+
+		if (group_selected("TDigest"))
+			bench_tdigest(ncard);
+		MemoryContextReset(context);
+	}
+
+	for (i = 0; i < lengthof(key_lengths); i++)
+	{
+		if (group_selected("Hash"))
+			bench_hash(key_lengths[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
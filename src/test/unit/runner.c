@@ -43,6 +43,10 @@ int main(void)
 	srunner_add_suite(sr, test_bloom_suite());
 	srunner_add_suite(sr, test_cmsketch_suite());
 	srunner_add_suite(sr, test_fss_suite());
+	srunner_add_suite(sr, test_ddsketch_suite());
+	srunner_add_suite(sr, test_kll_suite());
+	srunner_add_suite(sr, test_theta_suite());
+	srunner_add_suite(sr, test_distinct_suite());
 
 	srunner_run_all(sr, CK_VERBOSE);
 	number_failed = srunner_ntests_failed(sr);
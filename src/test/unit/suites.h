@@ -9,6 +9,10 @@ extern Suite *test_hll_suite(void);
 extern Suite *test_bloom_suite(void);
 extern Suite *test_cmsketch_suite(void);
 extern Suite *test_fss_suite(void);
+extern Suite *test_ddsketch_suite(void);
+extern Suite *test_kll_suite(void);
+extern Suite *test_theta_suite(void);
+extern Suite *test_distinct_suite(void);
 
 /* Distribution sample functions */
 extern float8 uniform(void);
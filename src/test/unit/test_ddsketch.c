@@ -0,0 +1,131 @@
+#include <check.h>
+#include <math.h>
+#include <time.h>
+
+#include "suites.h"
+#include "pipeline/ddsketch.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+
+#define NUM_VALUES 100000
+
+static int
+float8_cmp(const void * a, const void * b)
+{
+	float8 diff = *(float8 *) a - *(float8 *) b;
+	if (diff < 0)
+		return -1;
+	return diff > 0 ? 1 : 0;
+}
+
+static void
+run_ddsketch_test_on_distribution(float8 (*dist)(void))
+{
+	DDSketch *s = DDSketchCreateWithAlpha(0.01);
+	float8 quantiles[] = {0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999};
+	float8 *data = (float8 *) palloc(sizeof(float8) * NUM_VALUES);
+	int i;
+
+	for (i = 0; i < NUM_VALUES; i++)
+	{
+		data[i] = dist();
+		s = DDSketchAdd(s, data[i], 1);
+	}
+
+	qsort(data, NUM_VALUES, sizeof(float8), float8_cmp);
+
+	for (i = 0; i < 7; i++)
+	{
+		float8 x = data[(int) floor(quantiles[i] * (NUM_VALUES - 1))];
+		float8 estimate_x = DDSketchQuantile(s, quantiles[i]);
+
+		/* every quantile is within the sketch's relative error of the exact one */
+		ck_assert(fabs(estimate_x - x) <= 0.01 * fabs(x) + 1e-9);
+	}
+
+	ck_assert(DDSketchQuantile(s, 0) == data[0]);
+	ck_assert(DDSketchQuantile(s, 1) == data[NUM_VALUES - 1]);
+	ck_assert(DDSketchCDF(s, data[NUM_VALUES - 1]) == 1);
+
+	pfree(data);
+}
+
+START_TEST(test_ddsketch)
+{
+	srand(time(NULL));
+
+	run_ddsketch_test_on_distribution(uniform);
+	run_ddsketch_test_on_distribution(gaussian);
+}
+END_TEST
+
+START_TEST(test_ddsketch_merge)
+{
+	DDSketch *s0 = DDSketchCreate();
+	DDSketch *s1 = DDSketchCreate();
+	DDSketch *s2 = DDSketchCreate();
+	int i;
+	float8 x;
+
+	for (i = 0; i < 50000; i++)
+	{
+		x = rand();
+		s0 = DDSketchAdd(s0, x, 1);
+		s1 = DDSketchAdd(s1, x, 1);
+	}
+
+	for (i = 0; i < 50000; i++)
+	{
+		x = -rand();
+		s0 = DDSketchAdd(s0, x, 1);
+		s2 = DDSketchAdd(s2, x, 1);
+	}
+
+	s1 = DDSketchMerge(s1, s2);
+
+	ck_assert_int_eq(s0->count, s1->count);
+
+	/* merging is exact, so both sketches have the same buckets */
+	for (i = 0; i < 100; i++)
+	{
+		x = rand() - RAND_MAX / 2;
+		ck_assert(DDSketchCDF(s0, x) == DDSketchCDF(s1, x));
+		ck_assert(DDSketchQuantile(s0, i / 100.0) == DDSketchQuantile(s1, i / 100.0));
+	}
+}
+END_TEST
+
+START_TEST(test_ddsketch_collapse)
+{
+	DDSketch *s = DDSketchCreateWithAlpha(0.01);
+	int i;
+
+	/* values spanning far more orders of magnitude than the sketch has buckets for */
+	for (i = -200; i <= 200; i++)
+		s = DDSketchAdd(s, pow(10, i / 4.0), 1);
+
+	ck_assert_int_le(s->pos_len, s->max_buckets);
+	ck_assert_int_eq(s->count, 401);
+
+	/* only the lowest quantiles lose their accuracy */
+	ck_assert(fabs(DDSketchQuantile(s, 0.9) - pow(10, 160 / 4.0)) <= 0.01 * pow(10, 160 / 4.0));
+	ck_assert(DDSketchQuantile(s, 1) == pow(10, 50));
+}
+END_TEST
+
+Suite *
+test_ddsketch_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("test_ddsketch");
+	tc = tcase_create("test_ddsketch");
+	tcase_set_timeout(tc, 30);
+	tcase_add_test(tc, test_ddsketch);
+	tcase_add_test(tc, test_ddsketch_merge);
+	tcase_add_test(tc, test_ddsketch_collapse);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
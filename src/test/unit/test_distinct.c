@@ -0,0 +1,95 @@
+#include <check.h>
+#include <math.h>
+#include <time.h>
+
+#include "suites.h"
+#include "pipeline/distinct.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+
+static struct varlena *
+add_range(struct varlena *d, int start, int end)
+{
+	int i;
+
+	for (i = start; i < end; i++)
+		d = DistinctAdd(d, &i, sizeof(int));
+
+	return d;
+}
+
+START_TEST(test_exact)
+{
+	struct varlena *d = (struct varlena *) DistinctSetCreate(1000);
+
+	d = add_range(d, 0, 1000);
+	d = add_range(d, 0, 1000);
+
+	ck_assert(DistinctIsExact(d));
+	ck_assert_int_eq(DistinctCount(d), 1000);
+}
+END_TEST
+
+START_TEST(test_fallback)
+{
+	struct varlena *d = (struct varlena *) DistinctSetCreate(1000);
+	HyperLogLog *hll = HLLCreate();
+	int result;
+	int i;
+
+	d = add_range(d, 0, 100000);
+
+	/* going over the threshold gives the same HLL adding everything to one would have */
+	for (i = 0; i < 100000; i++)
+		hll = HLLAdd(hll, &i, sizeof(int), &result);
+
+	ck_assert(!DistinctIsExact(d));
+	ck_assert_int_eq(DistinctCount(d), HLLCardinality(hll));
+	ck_assert(fabs(DistinctCount(d) - 100000.0) < 100000 * 0.02);
+}
+END_TEST
+
+START_TEST(test_merge)
+{
+	struct varlena *a = add_range((struct varlena *) DistinctSetCreate(1000), 0, 600);
+	struct varlena *b = add_range((struct varlena *) DistinctSetCreate(1000), 300, 900);
+	struct varlena *c = add_range((struct varlena *) DistinctSetCreate(1000), 500, 1500);
+	struct varlena *big = add_range((struct varlena *) DistinctSetCreate(1000), 0, 50000);
+	struct varlena *m;
+
+	/* exact states stay exact as long as their union is under the threshold */
+	m = DistinctMerge(DistinctCopy(a), b);
+	ck_assert(DistinctIsExact(m));
+	ck_assert_int_eq(DistinctCount(m), 900);
+
+	m = DistinctMerge(DistinctCopy(a), c);
+	ck_assert(!DistinctIsExact(m));
+	ck_assert(fabs(DistinctCount(m) - 1500.0) < 1500 * 0.02);
+
+	/* and exact and approximate states can be merged either way around */
+	m = DistinctMerge(DistinctCopy(a), big);
+	ck_assert(!DistinctIsExact(m));
+	ck_assert_int_eq(DistinctCount(m), DistinctCount(big));
+
+	m = DistinctMerge(DistinctCopy(big), c);
+	ck_assert(!DistinctIsExact(m));
+	ck_assert_int_eq(DistinctCount(m), DistinctCount(add_range(DistinctCopy(big), 500, 1500)));
+}
+END_TEST
+
+Suite *
+test_distinct_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("test_distinct");
+	tc = tcase_create("test_distinct");
+	tcase_set_timeout(tc, 30);
+	tcase_add_test(tc, test_exact);
+	tcase_add_test(tc, test_fallback);
+	tcase_add_test(tc, test_merge);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
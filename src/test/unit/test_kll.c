@@ -0,0 +1,132 @@
+#include <check.h>
+#include <math.h>
+#include <time.h>
+
+#include "suites.h"
+#include "pipeline/kll.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+
+#define NUM_VALUES 100000
+
+static int
+float8_cmp(const void * a, const void * b)
+{
+	float8 diff = *(float8 *) a - *(float8 *) b;
+	if (diff < 0)
+		return -1;
+	return diff > 0 ? 1 : 0;
+}
+
+static float8
+rank(float8 x, float8 *data, int n)
+{
+	int below = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		below += (data[i] <= x) ? 1 : 0;
+
+	return (float8) below / n;
+}
+
+static void
+run_kll_test_on_distribution(float8 (*dist)(void))
+{
+	KLL *s = KLLCreate();
+	float8 quantiles[] = {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99};
+	float8 *data = (float8 *) palloc(sizeof(float8) * NUM_VALUES);
+	int i;
+
+	for (i = 0; i < NUM_VALUES; i++)
+	{
+		data[i] = dist();
+		s = KLLAdd(s, data[i]);
+	}
+
+	qsort(data, NUM_VALUES, sizeof(float8), float8_cmp);
+
+	for (i = 0; i < 7; i++)
+	{
+		float8 q = quantiles[i];
+		float8 x = data[(int) floor(q * (NUM_VALUES - 1))];
+
+		/* the error of a KLL sketch is in the rank of the values it returns */
+		ck_assert(fabs(rank(KLLQuantile(s, q), data, NUM_VALUES) - q) < 0.03);
+		ck_assert(fabs(KLLCDF(s, x) - q) < 0.03);
+	}
+
+	ck_assert(KLLQuantile(s, 0) == data[0]);
+	ck_assert(KLLQuantile(s, 1) == data[NUM_VALUES - 1]);
+
+	/* the sketch is much smaller than the values it has seen */
+	ck_assert_int_lt(KLLSize(s), 16 * 1024);
+
+	pfree(data);
+}
+
+START_TEST(test_kll)
+{
+	srand(time(NULL));
+
+	run_kll_test_on_distribution(uniform);
+	run_kll_test_on_distribution(gaussian);
+}
+END_TEST
+
+START_TEST(test_kll_merge)
+{
+	KLL *s0 = KLLCreate();
+	KLL *s1 = KLLCreate();
+	KLL *s2 = KLLCreate();
+	uint64 weight = 0;
+	int i;
+	int h;
+	float8 x;
+
+	for (i = 0; i < 50000; i++)
+	{
+		x = rand();
+		s0 = KLLAdd(s0, x);
+		s1 = KLLAdd(s1, x);
+	}
+
+	for (i = 0; i < 50000; i++)
+	{
+		x = rand();
+		s0 = KLLAdd(s0, x);
+		s2 = KLLAdd(s2, x);
+	}
+
+	s1 = KLLMerge(s1, s2);
+
+	ck_assert_int_eq(s0->count, s1->count);
+
+	/* compactions keep the total weight of the items the same as the number of values */
+	for (h = 0; h < s1->num_levels; h++)
+		weight += ((uint64) 1 << h) * (s1->levels[h + 1] - s1->levels[h]);
+	ck_assert_int_eq(weight, s1->count);
+
+	for (i = 0; i < 100; i++)
+	{
+		x = rand();
+		ck_assert(fabs(KLLCDF(s0, x) - KLLCDF(s1, x)) < 0.03);
+	}
+}
+END_TEST
+
+Suite *
+test_kll_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("test_kll");
+	tc = tcase_create("test_kll");
+	tcase_set_timeout(tc, 30);
+	tcase_add_test(tc, test_kll);
+	tcase_add_test(tc, test_kll_merge);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
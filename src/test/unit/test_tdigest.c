@@ -119,6 +119,38 @@ START_TEST(test_tdigest_merge)
 }
 END_TEST
 
+START_TEST(test_tdigest_add_many)
+{
+	TDigest *t0 = TDigestCreate();
+	TDigest *t1 = TDigestCreate();
+	Centroid *centroids = palloc(sizeof(Centroid) * 10000);
+	int i;
+
+	for (i = 0; i < 10000; i++)
+	{
+		centroids[i].mean = rand();
+		centroids[i].weight = 1 + i % 3;
+		t0 = TDigestAdd(t0, centroids[i].mean, centroids[i].weight);
+	}
+
+	t1 = TDigestAddMany(t1, centroids, 10000);
+
+	t0 = TDigestCompress(t0);
+	t1 = TDigestCompress(t1);
+
+	ck_assert_int_eq(t0->total_weight, t1->total_weight);
+	ck_assert_int_eq(t0->num_centroids, t1->num_centroids);
+
+	for (i = 0; i < 100; i++)
+	{
+		float8 x = rand();
+		ck_assert(TDigestCDF(t0, x) == TDigestCDF(t1, x));
+	}
+
+	pfree(centroids);
+}
+END_TEST
+
 Suite *
 test_tdigest_suite(void)
 {
@@ -130,6 +162,7 @@ test_tdigest_suite(void)
 	tcase_set_timeout(tc, 30);
 	tcase_add_test(tc, test_tdigest);
 	tcase_add_test(tc, test_tdigest_merge);
+	tcase_add_test(tc, test_tdigest_add_many);
 	suite_add_tcase(s, tc);
 
 	return s;
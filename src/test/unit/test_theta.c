@@ -0,0 +1,119 @@
+#include <check.h>
+#include <math.h>
+#include <time.h>
+
+#include "suites.h"
+#include "pipeline/theta.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+
+static ThetaSketch *
+add_range(ThetaSketch *ts, int start, int end)
+{
+	int i;
+
+	for (i = start; i < end; i++)
+		ts = ThetaSketchAdd(ts, &i, sizeof(int));
+
+	return ts;
+}
+
+static void
+assert_estimate(ThetaSketch *ts, float8 expected, float8 error)
+{
+	ck_assert(fabs(ThetaSketchEstimate(ts) - expected) <= expected * error);
+}
+
+START_TEST(test_exact)
+{
+	ThetaSketch *ts = ThetaSketchCreate();
+
+	ts = add_range(ts, 0, 2000);
+	ts = add_range(ts, 0, 2000);
+
+	/* below the nominal number of entries, the count is exact */
+	ck_assert(ThetaSketchEstimate(ts) == 2000);
+}
+END_TEST
+
+START_TEST(test_estimate)
+{
+	int i;
+
+	for (i = 4; i <= 16; i += 4)
+	{
+		ThetaSketch *ts = ThetaSketchCreateWithLgK(i);
+		/* four standard errors */
+		float8 error = 4.0 / sqrt(1 << i);
+
+		ts = add_range(ts, 0, 100000);
+		assert_estimate(ts, 100000, error);
+		ck_assert_int_le(ts->num_entries, 3 << (i - 1));
+	}
+}
+END_TEST
+
+START_TEST(test_set_operations)
+{
+	ThetaSketch *a = ThetaSketchCreate();
+	ThetaSketch *b = ThetaSketchCreate();
+
+	a = add_range(a, 0, 200000);
+	b = add_range(b, 100000, 400000);
+
+	assert_estimate(ThetaSketchIntersection(a, b), 100000, 0.1);
+	assert_estimate(ThetaSketchANotB(a, b), 100000, 0.1);
+	assert_estimate(ThetaSketchANotB(b, a), 200000, 0.1);
+	assert_estimate(ThetaSketchUnion(ThetaSketchCopy(a), b), 400000, 0.1);
+
+	/* the intersection is the same either way around */
+	ck_assert(ThetaSketchEstimate(ThetaSketchIntersection(a, b)) ==
+			ThetaSketchEstimate(ThetaSketchIntersection(b, a)));
+
+	/* disjoint sketches have an empty intersection */
+	b = add_range(ThetaSketchCreate(), 500000, 600000);
+	ck_assert(ThetaSketchEstimate(ThetaSketchIntersection(a, b)) == 0);
+}
+END_TEST
+
+START_TEST(test_union_matches_add)
+{
+	ThetaSketch *a = ThetaSketchCreate();
+	ThetaSketch *b = ThetaSketchCreate();
+	int i;
+
+	a = add_range(a, 0, 50000);
+	b = add_range(b, 50000, 100000);
+
+	/* a union is as accurate as adding everything to one sketch, and stays as small */
+	a = ThetaSketchUnion(a, b);
+	assert_estimate(a, 100000, 4.0 / 64);
+	ck_assert_int_le(a->num_entries, 3 << 11);
+
+	/* and each of its hashes below theta comes from one of the sketches, and vice versa */
+	for (i = 0; i < (1 << a->lg_size); i++)
+	{
+		if (a->entries[i] != 0)
+			ck_assert(a->entries[i] < a->theta && a->entries[i] < b->theta);
+	}
+	ck_assert(ThetaSketchEstimate(ThetaSketchANotB(b, a)) == 0);
+}
+END_TEST
+
+Suite *
+test_theta_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("test_theta");
+	tc = tcase_create("test_theta");
+	tcase_set_timeout(tc, 30);
+	tcase_add_test(tc, test_exact);
+	tcase_add_test(tc, test_estimate);
+	tcase_add_test(tc, test_set_operations);
+	tcase_add_test(tc, test_union_matches_add);
+	suite_add_tcase(s, tc);
+
+	return s;
+}